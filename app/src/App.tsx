@@ -3,7 +3,6 @@ import type { EditorView } from "@codemirror/view";
 import AnimatedShow from "./components/AnimatedShow";
 import { worker_client } from "./lib/worker_client";
 import type { CompileMode } from "./lib/worker_client";
-import { parse_synctex } from "./lib/synctex";
 import { create_project_store } from "./lib/project_store";
 import { ProjectSessionManager } from "./lib/project_session_manager";
 import type { ProjectSession } from "./lib/project_session";
@@ -41,8 +40,6 @@ import { load_settings, set_setting, type AppSettings } from "./lib/settings_sto
 const NARROW_BREAKPOINT = 900;
 const TOO_NARROW_BREAKPOINT = 600;
 const PREVIEW_WIDTH_KEY = "eztex_preview_width";
-const MAX_CREATE_BLOB_ENCODED_BYTES = 768 * 1024;
-const MAX_CREATE_BLOBS_TOTAL_ENCODED_BYTES = 768 * 1024;
 
 function get_initial_preview_width(): number {
   const stored = localStorage.getItem(PREVIEW_WIDTH_KEY);
@@ -112,7 +109,7 @@ const App: Component = () => {
   let room_deleted_timer: ReturnType<typeof setInterval> | undefined;
   let room_deleted_cleanup_started = false;
 
-  async function compile_project(req: { files: Record<string, string | Uint8Array>; main: string; mode: CompileMode }) {
+  async function compile_project(req: { main: string; mode: CompileMode }) {
     await store.flush_dirty_blobs();
     const missing = await store.missing_blob_paths();
     if (missing.length > 0) {
@@ -126,14 +123,20 @@ const App: Component = () => {
       }
       return;
     }
-    worker_client.compile({ files: store.current_files(), main: req.main, mode: req.mode });
+    worker_client.compile({
+      source: store.file_source(),
+      main: req.main,
+      mode: req.mode,
+      focus: req.mode === "preview" ? store.current_file() : undefined,
+    });
   }
 
   const scheduler = create_compile_scheduler({
-    get_files: () => store.current_files(),
+    get_source: () => store.file_source(),
     get_main: () => store.main_file(),
     is_ready: () => worker_client.ready() && !worker_client.compiling(),
     compile: (req) => { void compile_project(req); },
+    cancel_preview: () => worker_client.cancel_preview(),
     get_permission: () => collab_permission(),
     project_id: () => store.project_id() ?? undefined,
   });
@@ -186,12 +189,11 @@ const App: Component = () => {
 
   let layout_switch_timer: ReturnType<typeof setTimeout> | undefined;
   let layout_switch_reset_timer: ReturnType<typeof setTimeout> | undefined;
-  let save_timer: ReturnType<typeof setTimeout> | undefined;
   let cleanup_watch_change: (() => void) | undefined;
-  let cleanup_autosave: (() => void) | undefined;
   let cleanup_folder_compile_sync: (() => void) | undefined;
   let cleanup_worker_ready: (() => void) | undefined;
   let cleanup_watch_compile: (() => void) | undefined;
+  let cleanup_watch_cancel: (() => void) | undefined;
   let initial_preview_requested = false;
 
   function sync_main_file_from_doc() {
@@ -214,10 +216,9 @@ const App: Component = () => {
     if (!scheduler.enabled()) return;
     if (initial_preview_requested || !worker_client.ready() || worker_client.compiling()) return;
     if (joining_room() && !collab_ready()) return;
-    const files = store.current_files();
-    if (Object.keys(files).length === 0) return;
+    if (store.file_names().length === 0) return;
     initial_preview_requested = true;
-    void compile_project({ files, main: store.main_file(), mode: "preview" });
+    void compile_project({ main: store.main_file(), mode: "preview" });
   }
 
   async function resolve_collab_auth(room_id: string): Promise<{ token: string; room_secret: string | null } | null> {
@@ -358,7 +359,7 @@ const App: Component = () => {
     if (!settings().warn_before_close) return;
     const handle_beforeunload = (e: BeforeUnloadEvent) => {
       const fs = get_current_folder_sync();
-      const has_pending_save = save_timer !== undefined || !!(fs && fs.state().dirty_files.size > 0);
+      const has_pending_save = !!session_manager.current()?.persistence.pending() || !!(fs && fs.state().dirty_files.size > 0);
       if (!has_pending_save) return;
       e.preventDefault();
       e.returnValue = "";
@@ -368,15 +369,14 @@ const App: Component = () => {
   });
 
   onCleanup(() => {
-    cleanup_autosave?.();
     cleanup_folder_compile_sync?.();
     cleanup_worker_ready?.();
     cleanup_watch_change?.();
     cleanup_watch_compile?.();
+    cleanup_watch_cancel?.();
     scheduler.destroy();
     if (layout_switch_timer !== undefined) clearTimeout(layout_switch_timer);
     if (layout_switch_reset_timer !== undefined) clearTimeout(layout_switch_reset_timer);
-    if (save_timer !== undefined) clearTimeout(save_timer);
     if (room_deleted_timer !== undefined) clearInterval(room_deleted_timer);
     cleanup_resize?.();
     cleanup_keydown?.();
@@ -463,6 +463,9 @@ const App: Component = () => {
     cleanup_watch_change?.();
     cleanup_watch_change = store.on_change(() => scheduler.notify_change());
 
+    cleanup_watch_cancel?.();
+    cleanup_watch_cancel = worker_client.on_compile_cancelled(() => scheduler.notify_compile_cancelled());
+
     cleanup_watch_compile?.();
     cleanup_watch_compile = worker_client.on_compile_done(() => {
       scheduler.notify_compile_done(worker_client.status() === "success");
@@ -472,25 +475,6 @@ const App: Component = () => {
       }
     });
 
-    cleanup_autosave?.();
-    cleanup_autosave = store.on_change(() => {
-      if (fs && fs.state().active) return;
-      if (save_timer !== undefined) clearTimeout(save_timer);
-      const timer = setTimeout(async () => {
-        const current_pid = store.project_id();
-        try {
-          if (current_pid) {
-            await store.flush_dirty_blobs();
-            await repo.save_snapshot(current_pid, store.encode_ydoc_snapshot());
-            await repo.update_main_file(current_pid, store.main_file());
-          }
-        } finally {
-          if (save_timer === timer) save_timer = undefined;
-        }
-      }, 1000);
-      save_timer = timer;
-    });
-
     cleanup_folder_compile_sync?.();
     cleanup_folder_compile_sync = worker_client.on_compile_done(() => {
       if (fs && fs.state().active && fs.state().dirty_files.size > 0) {
@@ -515,10 +499,7 @@ const App: Component = () => {
       pdf_restored = true;
     }
     if (synctex_text) {
-      const parsed = parse_synctex(synctex_text);
-      if (parsed) {
-        worker_client.restore_synctex(parsed);
-      }
+      worker_client.restore_synctex(synctex_text);
     }
 
     if (!is_collab) {
@@ -613,21 +594,10 @@ const App: Component = () => {
     document.addEventListener("keydown", handle_keydown);
     cleanup_keydown = () => document.removeEventListener("keydown", handle_keydown);
 
+    // the page may be gone before a snapshot is encoded and written; append
+    // what is queued instead
     const handle_pagehide = () => {
-      if (save_timer !== undefined) {
-        clearTimeout(save_timer);
-        save_timer = undefined;
-      }
-      const pid = store.project_id();
-      if (!pid) return;
-      const repo = session_manager.get_repository();
-      store.flush_dirty_blobs().then(() => {
-        const snapshot = store.encode_ydoc_snapshot();
-        return Promise.all([
-          repo.save_snapshot(pid, snapshot),
-          repo.update_main_file(pid, store.main_file()),
-        ]);
-      }).catch(() => {});
+      session_manager.current()?.persistence.flush().catch(() => {});
     };
 
     window.addEventListener("pagehide", handle_pagehide);
@@ -736,13 +706,7 @@ const App: Component = () => {
 
       const is_owner = !!auth.room_secret && auth.token.startsWith("w.");
       set_collab_role(is_owner ? "owner" : "guest");
-      let precomputed_blobs: Record<string, string> | undefined;
-      if (is_owner) {
-        precomputed_blobs = await store.export_blobs({
-          max_blob_encoded_bytes: MAX_CREATE_BLOB_ENCODED_BYTES,
-          max_total_encoded_bytes: MAX_CREATE_BLOBS_TOTAL_ENCODED_BYTES,
-        });
-      }
+      const blob_manifests = is_owner ? await store.export_blob_manifests() : undefined;
 
       const provider = create_collab_provider({
         room_id,
@@ -752,7 +716,8 @@ const App: Component = () => {
         awareness: store.awareness(),
         identity: get_or_create_identity(),
         ws_url: get_collab_ws_url(room_id),
-        precomputed_blobs,
+        blob_manifests,
+        get_blob_chunk: (chunk) => store.blob_chunk(chunk),
         on_status: (status) => {
           set_collab_status(status);
           if (status === "deleted") {
@@ -774,6 +739,7 @@ const App: Component = () => {
         on_blob_request: (hash) => { void store.handle_blob_request(hash); },
         on_blob_response: (hash, bytes) => { void store.handle_blob_response(hash, bytes); },
         put_blobs: (blobs) => store.import_blobs(blobs),
+        put_blob_manifests: (manifests) => store.import_blob_manifests(manifests),
       });
       store.set_blob_sync_sender({
         send_blob_available: provider.send_blob_available,
@@ -285,7 +285,7 @@ const Editor: Component<Props> = (props) => {
       foldGutter(),
       StreamLanguage.define(stex),
       syntaxHighlighting(tokyo_night_highlight),
-      latex_autocomplete(),
+      latex_autocomplete(worker_client.command_index),
       tokyo_night_theme,
       yCollab(ytext, props.store.awareness(), { undoManager }),
       keymap.of([...defaultKeymap, ...yUndoManagerKeymap, indentWithTab]),
@@ -65,7 +65,7 @@ const FilePanel: Component<Props> = (props) => {
           await props.store.request_missing_blobs();
           return;
         }
-        worker_client.compile({ files: props.store.current_files(), main: name, mode: "preview" });
+        worker_client.compile({ source: props.store.file_source(), main: name, mode: "preview" });
       });
     }
   }
@@ -5,7 +5,7 @@ import {
   format_image_bytes,
   image_reference_count,
   is_optimizable_image,
-  optimize_image_file,
+  optimize_images,
   type ImageOptimizeResult,
   type OptimizationQuality,
 } from "../lib/image_tools";
@@ -106,10 +106,6 @@ const OptimizeImagesModal: Component<Props> = (props) => {
     set_selected(new Set<string>());
   }
 
-  function yield_to_ui(): Promise<void> {
-    return new Promise((resolve) => requestAnimationFrame(() => resolve()));
-  }
-
   async function optimize_selected() {
     if (busy() || selected_count() === 0) return;
     const targets = rows().filter((row) => selected().has(row.path));
@@ -130,15 +126,14 @@ const OptimizeImagesModal: Component<Props> = (props) => {
     set_running(true);
     set_results([]);
     try {
-      const next_results: ImageOptimizeResult[] = [];
-      for (let i = 0; i < targets.length; i++) {
-        const row = targets[i];
-        set_progress(`Optimizing ${i + 1}/${targets.length}: ${row.path}`);
-        await yield_to_ui();
-        const result = await optimize_image_file(props.store, row.path, quality());
-        next_results.push(result);
-        set_results([...next_results]);
-      }
+      const done_results: ImageOptimizeResult[] = [];
+      set_progress(`Optimizing ${targets.length} image${targets.length === 1 ? "" : "s"}...`);
+      const next_results = await optimize_images(props.store, targets.map((row) => row.path), quality(), (result, done) => {
+        done_results.push(result);
+        set_results([...done_results]);
+        set_progress(`Optimized ${done}/${targets.length}: ${result.path}`);
+      });
+      set_results(next_results);
       set_selected(new Set<string>());
       const changed = next_results.filter((result) => result.changed).length;
       set_progress(`Optimized ${changed}/${next_results.length} image${next_results.length === 1 ? "" : "s"}.`);
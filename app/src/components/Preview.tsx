@@ -13,6 +13,7 @@ const Preview: Component = () => {
     if (viewer) return viewer;
     if (!container_ref) return undefined;
     viewer = new PdfViewerWrapper(container_ref);
+    worker_client.set_visible_pages(() => viewer?.visible_pages() ?? null);
     return viewer;
   }
 
@@ -29,7 +30,7 @@ const Preview: Component = () => {
     if (!v) return;
     const seq = ++load_seq;
     set_load_error("");
-    void v.load_document(bytes).catch((err: unknown) => {
+    void v.load_document(bytes, worker_client.page_digests()).catch((err: unknown) => {
       if (seq !== load_seq) return;
       set_load_error(err instanceof Error ? err.message : String(err));
     });
@@ -79,6 +80,7 @@ const Preview: Component = () => {
 
   onCleanup(() => {
     load_seq++;
+    worker_client.set_visible_pages(null);
     viewer?.destroy();
   });
 
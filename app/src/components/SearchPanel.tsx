@@ -1,53 +1,19 @@
 import { type Component, For, Show, createEffect, createMemo, createSignal, onCleanup } from "solid-js";
 import type { ProjectStore } from "../lib/project_store";
 import { is_binary } from "../lib/project_store";
+import { create_search_index } from "../lib/search_index";
+import type { FileGroup, SearchResult } from "../lib/search_index";
 import { worker_client } from "../lib/worker_client";
 import { is_modal_open } from "../lib/modal_store";
 import { current_focus_target, restore_focus, trap_tab_key } from "../lib/focus_utils";
 import AnimatedShow from "./AnimatedShow";
 
-type SearchResult = {
-  file: string;
-  line: number;
-  column: number;
-  snippet: string;
-};
-
-type FileGroup = {
-  file: string;
-  results: SearchResult[];
-};
-
 type Props = {
   store: ProjectStore;
   show: boolean;
   on_close: () => void;
 };
 
-function search_file(file: string, text: string, query: string, case_sensitive: boolean): SearchResult[] {
-  const needle = case_sensitive ? query : query.toLowerCase();
-  const results: SearchResult[] = [];
-  const lines = text.split(/\r?\n/);
-  for (let i = 0; i < lines.length; i++) {
-    const haystack = case_sensitive ? lines[i] : lines[i].toLowerCase();
-    let index = haystack.indexOf(needle);
-    while (index >= 0) {
-      const start = Math.max(0, index - 48);
-      const end = Math.min(lines[i].length, index + query.length + 72);
-      const prefix = start > 0 ? "..." : "";
-      const suffix = end < lines[i].length ? "..." : "";
-      results.push({
-        file,
-        line: i + 1,
-        column: index + 1,
-        snippet: `${prefix}${lines[i].slice(start, end)}${suffix}`,
-      });
-      index = haystack.indexOf(needle, index + Math.max(1, needle.length));
-    }
-  }
-  return results;
-}
-
 function line_column_to_offset(text: string, line: number, column: number): number | null {
   let current_line = 1;
   let offset = 0;
@@ -92,19 +58,30 @@ const SearchPanel: Component<Props> = (props) => {
   const [case_sensitive, set_case_sensitive] = createSignal(false);
   const [replace_status, set_replace_status] = createSignal("");
 
-  const groups = createMemo<FileGroup[]>(() => {
+  const [groups, set_groups] = createSignal<FileGroup[]>([]);
+
+  // searched off the main thread; results of an outdated query are dropped
+  const index = create_search_index();
+  let indexed_store: ProjectStore | null = null;
+  let search_seq = 0;
+  onCleanup(() => index.dispose());
+
+  createEffect(() => {
     const q = query();
+    const cs = case_sensitive();
     props.store.content_revision();
-    if (!q) return [];
-    const next: FileGroup[] = [];
-    for (const file of props.store.file_names()) {
-      if (is_binary(file)) continue;
-      const content = props.store.get_content(file);
-      if (typeof content !== "string") continue;
-      const results = search_file(file, content, q, case_sensitive());
-      if (results.length > 0) next.push({ file, results });
+    const seq = ++search_seq;
+    if (!props.show || !q) {
+      set_groups([]);
+      return;
+    }
+    if (indexed_store !== props.store) {
+      index.reset();
+      indexed_store = props.store;
     }
-    return next;
+    void index.search(props.store.file_source(), q, cs).then((next) => {
+      if (seq === search_seq) set_groups(next);
+    });
   });
 
   const total_results = createMemo(() => groups().reduce((sum, group) => sum + group.results.length, 0));
@@ -174,11 +151,11 @@ const SearchPanel: Component<Props> = (props) => {
     set_replace_status(`Replaced ${count} occurrence${count === 1 ? "" : "s"} in ${file}.`);
   }
 
+  // only files the index found matches in are rewritten
   function replace_all() {
     let occurrences = 0;
     let files = 0;
-    for (const file of props.store.file_names()) {
-      if (is_binary(file)) continue;
+    for (const { file } of groups()) {
       const count = replace_in_file(file);
       if (count > 0) {
         occurrences += count;
@@ -171,7 +171,7 @@ const Toolbar: Component<Props> = (props) => {
   });
 
   onMount(() => {
-    cleanup_compile_persist = worker_client.on_compile_done(() => {
+    cleanup_compile_persist = worker_client.on_pdf(() => {
       const url = worker_client.pdf_url();
       if (!url) return;
       const pid = props.store.project_id();
@@ -393,8 +393,7 @@ const Toolbar: Component<Props> = (props) => {
       });
       return;
     }
-    const files = props.store.current_files();
-    worker_client.compile({ files, main: props.store.main_file(), mode: "full" });
+    worker_client.compile({ source: props.store.file_source(), main: props.store.main_file(), mode: "full" });
   }
 
   async function handle_clear_cache() {
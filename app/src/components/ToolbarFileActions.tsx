@@ -259,7 +259,7 @@ const ToolbarFileActions: Component<Props> = (props) => {
       });
       return;
     }
-    const ok = await worker_client.compile_and_wait({ files: props.store.current_files(), main: props.store.main_file(), mode: "full" });
+    const ok = await worker_client.compile_and_wait({ source: props.store.file_source(), main: props.store.main_file(), mode: "full" });
     if (!ok) return;
     const url = worker_client.pdf_url();
     if (!url) return;
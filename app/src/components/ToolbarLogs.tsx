@@ -1,6 +1,7 @@
 import { type Component, For, Show, createEffect, createSignal, onCleanup, untrack } from "solid-js";
 import AnimatedShow from "./AnimatedShow";
 import { worker_client, type LogEntry } from "../lib/worker_client";
+import { format_size, type CompileTimings } from "../worker/protocol";
 
 type Props = {
   logs: LogEntry[];
@@ -15,6 +16,26 @@ function log_class(entry: LogEntry): string {
   return "log-line";
 }
 
+function format_ms(ms: number): string {
+  return ms >= 1000 ? `${(ms / 1000).toFixed(2)}s` : `${Math.round(ms)}ms`;
+}
+
+// the last compile's stages, then its bundle fetches and cache reads
+function timing_rows(t: CompileTimings): { label: string; value: string }[] {
+  const rows = t.stages.map((stage) => ({
+    label: stage.detail ? `${stage.name} ${stage.detail}` : stage.name,
+    value: format_ms(stage.ms),
+  }));
+  if (t.fetches > 0) {
+    rows.push({ label: `network: ${t.fetches} file(s), ${format_size(t.fetch_bytes)}`, value: format_ms(t.fetch_ms) });
+  }
+  if (t.opfs_reads > 0 || t.opfs_ms >= 1) {
+    rows.push({ label: `OPFS: ${t.opfs_reads} file(s), ${format_size(t.opfs_bytes)}`, value: format_ms(t.opfs_ms) });
+  }
+  if (t.cache_hits > 0) rows.push({ label: "cache hits", value: String(t.cache_hits) });
+  return rows;
+}
+
 function status_color(): string {
   const s = worker_client.status();
   if (s === "loading" || s === "compiling") return "var(--yellow)";
@@ -40,8 +61,15 @@ const ToolbarLogs: Component<Props> = (props) => {
     set_logs_auto_opened(false);
   }
 
+  // with the timings, so a pasted report shows where the time went
   function handle_copy_logs() {
-    const text = props.logs.map(e => e.msg).join("\n");
+    const lines = props.logs.map(e => e.msg);
+    const timings = worker_client.last_timings();
+    if (timings) {
+      lines.push(`timings: ${format_ms(timings.total_ms)}`);
+      for (const row of timing_rows(timings)) lines.push(`  ${row.label}: ${row.value}`);
+    }
+    const text = lines.join("\n");
     navigator.clipboard.writeText(text).catch(() => {});
   }
 
@@ -107,6 +135,24 @@ const ToolbarLogs: Component<Props> = (props) => {
               <svg width="12" height="12" viewBox="0 0 24 24" fill="none" stroke="currentColor" stroke-width="2"><polyline points="3 6 5 6 21 6"/><path d="M19 6v14a2 2 0 0 1-2 2H7a2 2 0 0 1-2-2V6m3 0V4a2 2 0 0 1 2-2h4a2 2 0 0 1 2 2v2"/></svg>
             </button>
           </div>
+          <Show when={worker_client.last_timings()}>
+            {(timings) => (
+              <div class="compile-timings">
+                <div class="compile-timings-row compile-timings-total">
+                  <span class="compile-timings-label">Last compile</span>
+                  <span>{format_ms(timings().total_ms)}</span>
+                </div>
+                <For each={timing_rows(timings())}>
+                  {(row) => (
+                    <div class="compile-timings-row">
+                      <span class="compile-timings-label">{row.label}</span>
+                      <span>{row.value}</span>
+                    </div>
+                  )}
+                </For>
+              </div>
+            )}
+          </Show>
           <div class="compile-logs-scroll" ref={log_ref}>
             <For each={props.logs}>
               {(entry) => <div class={log_class(entry)}>{entry.msg}</div>}
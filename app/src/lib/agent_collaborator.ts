@@ -164,6 +164,12 @@ export function create_agent_collaborator(opts: AgentCollaboratorOptions): Agent
         const snapshot_bytes = base64url_decode(msg.snapshot);
         Y.applyUpdate(doc, snapshot_bytes, PROVIDER_ORIGIN);
       }
+      // updates the room received since its snapshot was compacted
+      if (Array.isArray(msg.updates)) {
+        for (const update of msg.updates) {
+          if (typeof update === "string") Y.applyUpdate(doc, base64url_decode(update), PROVIDER_ORIGIN);
+        }
+      }
       set_status("connected");
       send_sync_step1();
     } else if (msg.type === "created") {
@@ -0,0 +1,55 @@
+// content-addressed chunks of binary project files for collab rooms
+// a blob travels as a manifest of SHA-256 chunk hashes. the chunks live once
+// in the worker's shared chunk store, whatever room or project uses them, so
+// a room only uploads chunks the store lacks and a joining peer downloads
+// them over plain HTTP, where its cache already holds any it fetched before.
+
+import { compute_hash } from "./crypto_utils";
+
+// matches MAX_CHUNK_BYTES in worker/collab_room.js
+export const BLOB_CHUNK_BYTES = 256 * 1024;
+
+export interface BlobManifest {
+  size: number;
+  chunks: string[];
+}
+
+export async function split_blob(bytes: Uint8Array): Promise<{ manifest: BlobManifest; chunks: Map<string, Uint8Array> }> {
+  const chunks = new Map<string, Uint8Array>();
+  const hashes: string[] = [];
+  for (let start = 0; start < bytes.byteLength; start += BLOB_CHUNK_BYTES) {
+    const chunk = bytes.subarray(start, Math.min(bytes.byteLength, start + BLOB_CHUNK_BYTES));
+    const hash = await compute_hash(chunk);
+    hashes.push(hash);
+    chunks.set(hash, chunk);
+  }
+  return { manifest: { size: bytes.byteLength, chunks: hashes }, chunks };
+}
+
+// download and reassemble a blob; null if a chunk is missing or the result
+// does not hash to `hash`
+export async function fetch_blob(
+  hash: string,
+  manifest: BlobManifest,
+  chunk_url: (chunk: string) => string,
+): Promise<Uint8Array | null> {
+  const parts = await Promise.all(manifest.chunks.map(async (chunk) => {
+    try {
+      const res = await fetch(chunk_url(chunk));
+      if (!res.ok) return null;
+      const bytes = new Uint8Array(await res.arrayBuffer());
+      return (await compute_hash(bytes)) === chunk ? bytes : null;
+    } catch {
+      return null;
+    }
+  }));
+  const bytes = new Uint8Array(manifest.size);
+  let offset = 0;
+  for (const part of parts) {
+    if (!part || offset + part.byteLength > manifest.size) return null;
+    bytes.set(part, offset);
+    offset += part.byteLength;
+  }
+  if (offset !== manifest.size) return null;
+  return (await compute_hash(bytes)) === hash ? bytes : null;
+}
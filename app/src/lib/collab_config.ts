@@ -31,6 +31,11 @@ export function get_collab_ws_url(room_id: string): string {
   return url.toString();
 }
 
+// a blob chunk from the worker's shared chunk store (see blob_chunks.ts)
+export function get_collab_chunk_url(chunk_hash: string): string {
+  return new URL(`/collab/chunks/${chunk_hash}`, get_collab_http_origin()).toString();
+}
+
 export function get_share_room_url(room_id: string): string {
   return new URL(`/c/${room_id}`, get_share_origin()).toString();
 }
@@ -7,6 +7,7 @@ import { encode_frame, decode_frame, FrameKind } from "./collab_protocol";
 import type { UserIdentity } from "./identity";
 import { get_jjk_name } from "./jjk_names";
 import { base64url_encode, base64url_decode } from "./crypto_utils";
+import type { BlobManifest } from "./blob_chunks";
 
 export type CollabPermission = "read" | "write";
 export type CollabStatus = "idle" | "connecting" | "connected" | "reconnecting" | "closed" | "deleted" | "error";
@@ -15,8 +16,13 @@ export interface CollabProviderOptions {
   room_id: string;
   token: string;
   room_secret?: string | null;
-  precomputed_blobs?: Record<string, string>;
+  // chunk manifests of the project's binary files, sent when creating the
+  // room; get_blob_chunk supplies the chunks the room's chunk store lacks
+  blob_manifests?: Record<string, BlobManifest>;
+  get_blob_chunk?: (chunk: string) => Promise<Uint8Array | null>;
+  // inline blobs of rooms created before chunking
   put_blobs?: (blobs: Record<string, string>) => Promise<void>;
+  put_blob_manifests?: (manifests: Record<string, BlobManifest>) => Promise<void>;
   on_blob_available?: (hash: string) => void;
   on_blob_request?: (hash: string) => void;
   on_blob_response?: (hash: string, bytes: Uint8Array) => void;
@@ -38,6 +44,11 @@ const MAX_INCOMING_BLOB_BYTES = 64 * 1024 * 1024;
 const MAX_INCOMING_BLOB_CHUNKS = Math.ceil(MAX_INCOMING_BLOB_BYTES / BLOB_CHUNK_BYTES);
 const FULL_STATE_SYNC_IDLE_MS = 2000;
 const HANDSHAKE_TIMEOUT_MS = 12000;
+// local doc updates are merged and sent once per window, and awareness
+// (cursors, selections) at most once per interval, so typing and cursor
+// movement cost a few frames a second rather than one per keystroke
+const UPDATE_BATCH_MS = 50;
+const AWARENESS_INTERVAL_MS = 100;
 
 export interface CollabProvider {
   status(): CollabStatus;
@@ -59,6 +70,11 @@ export function create_collab_provider(opts: CollabProviderOptions): CollabProvi
   let presence_timer: ReturnType<typeof setInterval> | null = null;
   let full_sync_timer: ReturnType<typeof setTimeout> | null = null;
   let handshake_timer: ReturnType<typeof setTimeout> | null = null;
+  let update_timer: ReturnType<typeof setTimeout> | null = null;
+  let awareness_timer: ReturnType<typeof setTimeout> | null = null;
+  let awareness_sent_at = 0;
+  let outgoing_updates: Uint8Array[] = [];
+  const outgoing_awareness = new Set<number>();
   let destroyed = false;
   let create_pending = false;
   let terminal_error = false;
@@ -156,6 +172,17 @@ export function create_collab_provider(opts: CollabProviderOptions): CollabProvi
     }
   }
 
+  // one chunk per message, as the socket allows; the room drops any it did
+  // not ask for
+  async function upload_chunks(chunks: unknown[]) {
+    if (!opts.get_blob_chunk) return;
+    for (const chunk of chunks) {
+      if (typeof chunk !== "string") continue;
+      const bytes = await opts.get_blob_chunk(chunk);
+      if (bytes) send_json({ type: "blob-chunk-upload", chunk, data: base64url_encode(bytes) });
+    }
+  }
+
   function handle_blob_chunk(msg: any) {
     if (typeof msg.hash !== "string" || typeof msg.data !== "string") return;
     if (!Number.isInteger(msg.index) || !Number.isInteger(msg.total)) return;
@@ -218,8 +245,8 @@ export function create_collab_provider(opts: CollabProviderOptions): CollabProvi
           color: opts.identity.color,
         },
       };
-      if (opts.precomputed_blobs) {
-        msg.blobs = opts.precomputed_blobs;
+      if (opts.blob_manifests) {
+        msg.blob_manifests = opts.blob_manifests;
       }
       create_msg = JSON.stringify(msg);
     }
@@ -306,9 +333,19 @@ export function create_collab_provider(opts: CollabProviderOptions): CollabProvi
         const snapshot_bytes = base64url_decode(msg.snapshot);
         Y.applyUpdate(opts.doc, snapshot_bytes, PROVIDER_ORIGIN);
       }
+      // updates the room received since its snapshot was compacted
+      if (Array.isArray(msg.updates)) {
+        for (const update of msg.updates) {
+          if (typeof update === "string") Y.applyUpdate(opts.doc, base64url_decode(update), PROVIDER_ORIGIN);
+        }
+      }
       if (msg.blobs && opts.put_blobs) {
         await opts.put_blobs(msg.blobs as Record<string, string>);
       }
+      if (msg.blob_manifests && opts.put_blob_manifests) {
+        // over HTTP, alongside the sync below
+        void opts.put_blob_manifests(msg.blob_manifests as Record<string, BlobManifest>);
+      }
       set_status("connected");
       // start sync protocol
       send_sync_step1();
@@ -320,6 +357,7 @@ export function create_collab_provider(opts: CollabProviderOptions): CollabProvi
         create_pending = false;
         ws.send(build_join_msg());
       }
+      if (Array.isArray(msg.missing_chunks)) void upload_chunks(msg.missing_chunks);
     } else if (msg.type === "error") {
       if (msg.code === "create_failed") {
         clear_handshake_timer();
@@ -414,17 +452,53 @@ export function create_collab_provider(opts: CollabProviderOptions): CollabProvi
     }
   }
 
+  function flush_updates() {
+    if (update_timer) {
+      clearTimeout(update_timer);
+      update_timer = null;
+    }
+    if (outgoing_updates.length === 0) return;
+    const updates = outgoing_updates;
+    outgoing_updates = [];
+    if (permission !== "write") return;
+    send_frame(FrameKind.DocUpdate, updates.length === 1 ? updates[0] : Y.mergeUpdates(updates));
+    schedule_full_state_sync();
+  }
+
+  // the states of the clients changed since the last send, as they are now
+  function flush_awareness() {
+    if (awareness_timer) {
+      clearTimeout(awareness_timer);
+      awareness_timer = null;
+    }
+    if (outgoing_awareness.size === 0) return;
+    const clients = [...outgoing_awareness];
+    outgoing_awareness.clear();
+    awareness_sent_at = Date.now();
+    send_frame(FrameKind.Awareness, encodeAwarenessUpdate(opts.awareness, clients));
+  }
+
   const doc_update_handler = (update: Uint8Array, origin: unknown) => {
     if (origin === PROVIDER_ORIGIN) return;
     if (permission !== "write") return;
-    send_frame(FrameKind.DocUpdate, update);
-    schedule_full_state_sync();
+    outgoing_updates.push(update);
+    update_timer ??= setTimeout(flush_updates, UPDATE_BATCH_MS);
   };
 
-  const awareness_handler = ({ added, updated, removed }: any) => {
-    const changedClients = added.concat(updated).concat(removed);
-    const update = encodeAwarenessUpdate(opts.awareness, changedClients);
-    send_frame(FrameKind.Awareness, update);
+  // states received from the room were already fanned out by it; only the
+  // local client's go back
+  const awareness_handler = ({ added, updated, removed }: any, origin: unknown) => {
+    for (const client of added.concat(updated).concat(removed) as number[]) {
+      if (origin === PROVIDER_ORIGIN && client !== opts.awareness.clientID) continue;
+      outgoing_awareness.add(client);
+    }
+    if (outgoing_awareness.size === 0 || awareness_timer) return;
+    const wait = awareness_sent_at + AWARENESS_INTERVAL_MS - Date.now();
+    if (wait <= 0) {
+      flush_awareness();
+    } else {
+      awareness_timer = setTimeout(flush_awareness, wait);
+    }
   };
 
   opts.doc.on("update", doc_update_handler);
@@ -455,9 +529,11 @@ export function create_collab_provider(opts: CollabProviderOptions): CollabProvi
       full_sync_timer = null;
     }
     clear_handshake_timer();
+    flush_updates();
     if (ws?.readyState === WebSocket.OPEN) {
       removeAwarenessStates(opts.awareness, [opts.awareness.clientID], PROVIDER_ORIGIN);
     }
+    flush_awareness();
     if (ws) {
       ws.close();
       ws = null;
@@ -476,6 +552,10 @@ export function create_collab_provider(opts: CollabProviderOptions): CollabProvi
   function destroy() {
     destroyed = true;
     disconnect();
+    if (awareness_timer) {
+      clearTimeout(awareness_timer);
+      awareness_timer = null;
+    }
     opts.doc.off("update", doc_update_handler);
     opts.awareness.off("change", awareness_handler);
   }
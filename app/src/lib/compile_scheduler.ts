@@ -1,22 +1,23 @@
 import { createSignal } from "solid-js";
-import type { ProjectFiles } from "./project_store";
+import type { ProjectSource } from "./project_store";
 import type { CompileMode } from "./worker_client";
 import { get_setting, set_setting } from "./settings_store";
-import { fnv1a_hash_sync } from "./crypto_utils";
+import { fnv1a_32 } from "./crypto_utils";
 
 export type WatchState = "idle" | "scheduled" | "compiling" | "dirty_compiling";
 
 export type CompileRequest = {
-  files: ProjectFiles;
   main: string;
   mode: CompileMode;
 };
 
 type CompileSchedulerDeps = {
-  get_files: () => ProjectFiles;
+  get_source: () => ProjectSource;
   get_main: () => string;
   is_ready: () => boolean;
   compile: (req: CompileRequest) => void;
+  // stop the preview compile in flight; false when there is none
+  cancel_preview: () => boolean;
   get_permission: () => string | null;
   project_id: () => string | undefined;
 };
@@ -33,58 +34,72 @@ const MAX_DEBOUNCE_MS = 3000;
 const RATE_LIMIT_MS = 3000;
 const DIRTY_DEBOUNCE_MS = 200;
 
-function deep_clone_files(files: ProjectFiles): ProjectFiles {
-  const result: ProjectFiles = {};
-  for (const [path, content] of Object.entries(files)) {
-    result[path] = content instanceof Uint8Array ? new Uint8Array(content) : content;
-  }
-  return result;
+// what was last compiled: file versions, plus a digest of the trimmed text of
+// non-.tex text files so whitespace-only edits to them can be told apart
+type CompiledSnapshot = {
+  versions: Map<string, number>;
+  texts: Map<string, number>;
+};
+
+const EMPTY_SNAPSHOT: CompiledSnapshot = { versions: new Map(), texts: new Map() };
+
+function text_digest(content: string): number {
+  return fnv1a_32(content.trim());
 }
 
-function hash_files(files: ProjectFiles): string {
-  let input = "";
-  const keys = Object.keys(files).sort();
-  for (let k = 0; k < keys.length; k++) {
-    const key = keys[k];
-    input += `p:${key.length}:${key};`;
-    const val = files[key];
-    if (typeof val === "string") {
-      input += `s:${val.length}:${val};`;
-    } else {
-      input += `b:${val.byteLength};`;
+// texts are only read for files whose version moved since `prev`
+function take_snapshot(source: ProjectSource, versions: Map<string, number>, prev: CompiledSnapshot): CompiledSnapshot {
+  const texts = new Map<string, number>();
+  for (const [path, version] of versions) {
+    if (path.endsWith(".tex")) continue;
+    const kept = prev.versions.get(path) === version ? prev.texts.get(path) : undefined;
+    if (kept !== undefined) {
+      texts.set(path, kept);
+      continue;
     }
+    const content = source.read(path);
+    if (typeof content === "string") texts.set(path, text_digest(content));
   }
-  return fnv1a_hash_sync(input);
+  return { versions, texts };
 }
 
-function has_significant_change(prev: ProjectFiles, curr: ProjectFiles): boolean {
-  const prev_keys = new Set(Object.keys(prev));
-  const curr_keys = new Set(Object.keys(curr));
-  for (const k of curr_keys) {
-    if (!prev_keys.has(k)) return true;
-  }
-  for (const k of prev_keys) {
-    if (!curr_keys.has(k)) return true;
-  }
-  for (const k of curr_keys) {
-    const old_val = prev[k];
-    const new_val = curr[k];
-    if (typeof old_val !== typeof new_val) return true;
-    if (new_val instanceof Uint8Array) {
-      if (!(old_val instanceof Uint8Array)) return true;
-      if (old_val.byteLength !== new_val.byteLength) return true;
-      for (let i = 0; i < new_val.byteLength; i++) {
-        if (old_val[i] !== new_val[i]) return true;
+// digest of the project's paths and versions. each file's digest is kept
+// until its version moves, and the digests are combined by order-independent
+// sum and xor, so a digest costs O(files) whatever the files hold.
+function create_version_digest() {
+  const files = new Map<string, { version: number; a: number; b: number }>();
+
+  return (versions: Map<string, number>): string => {
+    let sum = 0;
+    let mix = 0;
+    for (const [path, version] of versions) {
+      let entry = files.get(path);
+      if (!entry || entry.version !== version) {
+        const key = `${path}\0${version}`;
+        entry = { version, a: fnv1a_32(key), b: fnv1a_32(key, 0x01000193) };
+        files.set(path, entry);
       }
-      continue;
+      sum = (sum + entry.a) >>> 0;
+      mix = (mix ^ entry.b) >>> 0;
     }
-    if (typeof old_val === "string" && typeof new_val === "string") {
-      if (old_val === new_val) continue;
-      if (k.endsWith(".tex")) return true;
-      const trimmed_old = old_val.trim();
-      const trimmed_new = new_val.trim();
-      if (trimmed_old !== trimmed_new) return true;
+    if (files.size > versions.size) {
+      for (const path of files.keys()) if (!versions.has(path)) files.delete(path);
     }
+    const count = versions.size.toString(16);
+    return `${count}:${sum.toString(16).padStart(8, "0")}${mix.toString(16).padStart(8, "0")}`;
+  };
+}
+
+function has_significant_change(prev: CompiledSnapshot, versions: Map<string, number>, source: ProjectSource): boolean {
+  if (versions.size !== prev.versions.size) return true;
+  for (const [k, version] of versions) {
+    const prev_version = prev.versions.get(k);
+    if (prev_version === version) continue;
+    if (prev_version === undefined || k.endsWith(".tex")) return true;
+    const old_digest = prev.texts.get(k);
+    const new_val = source.read(k);
+    if (old_digest === undefined || typeof new_val !== "string") return true;
+    if (old_digest !== text_digest(new_val)) return true;
   }
   return false;
 }
@@ -107,6 +122,10 @@ export function create_compile_scheduler(deps: CompileSchedulerDeps) {
   let pre_compile_hash = "";
   let last_compile_ended_at: number = 0;
   let needs_seed = enabled();
+  // the last preview was stopped for newer content; the next one runs to the
+  // end, so steady typing cannot keep every preview from finishing
+  let preempted = false;
+  const hash_versions = create_version_digest();
 
   const tab_id = crypto.randomUUID();
   let compile_bc: BroadcastChannel | null = null;
@@ -208,8 +227,9 @@ export function create_compile_scheduler(deps: CompileSchedulerDeps) {
       return;
     }
 
-    const files = deps.get_files();
-    const h = hash_files(files);
+    const source = deps.get_source();
+    const versions = source.versions();
+    const h = hash_versions(versions);
 
     if (h === last_compiled_hash) {
       set_state("idle");
@@ -217,7 +237,7 @@ export function create_compile_scheduler(deps: CompileSchedulerDeps) {
       return;
     }
 
-    if (!has_significant_change(last_compiled_files, files)) {
+    if (!has_significant_change(last_compiled, versions, source)) {
       set_state("idle");
       set_dirty(false);
       last_compiled_hash = h;
@@ -228,16 +248,21 @@ export function create_compile_scheduler(deps: CompileSchedulerDeps) {
     set_state("compiling");
     set_dirty(false);
     broadcast_compile_requested(h);
-    deps.compile({ files: { ...files }, main: deps.get_main(), mode: "preview" });
+    deps.compile({ main: deps.get_main(), mode: "preview" });
   }
 
-  let last_compiled_files: ProjectFiles = {};
+  let last_compiled: CompiledSnapshot = EMPTY_SNAPSHOT;
+
+  function snapshot_current_files(): string {
+    const source = deps.get_source();
+    const versions = source.versions();
+    last_compiled = take_snapshot(source, versions, last_compiled);
+    return hash_versions(versions);
+  }
 
   function seed_current_files() {
     needs_seed = false;
-    const files = deps.get_files();
-    last_compiled_hash = hash_files(files);
-    last_compiled_files = deep_clone_files(files);
+    last_compiled_hash = snapshot_current_files();
   }
 
   function notify_change() {
@@ -256,6 +281,7 @@ export function create_compile_scheduler(deps: CompileSchedulerDeps) {
     if (current === "compiling" || current === "dirty_compiling") {
       set_state("dirty_compiling");
       set_dirty(true);
+      if (!preempted && deps.cancel_preview()) preempted = true;
       return;
     }
 
@@ -268,10 +294,11 @@ export function create_compile_scheduler(deps: CompileSchedulerDeps) {
   }
 
   function notify_compile_done(success: boolean) {
+    preempted = false;
     last_compile_ended_at = Date.now();
     if (success) {
       last_compiled_hash = pre_compile_hash;
-      last_compiled_files = deep_clone_files(deps.get_files());
+      snapshot_current_files();
     }
     const was_dirty = state() === "dirty_compiling";
     set_state("idle");
@@ -292,27 +319,40 @@ export function create_compile_scheduler(deps: CompileSchedulerDeps) {
     }
   }
 
-  function request_compile(files: ProjectFiles, main: string, mode: CompileMode) {
+  // a superseded preview stopped early: start the next one without the rate
+  // limit, which is there to space out compiles that ran to the end
+  function notify_compile_cancelled() {
+    set_state("idle");
+    if (compile_bc) {
+      compile_bc.postMessage({
+        type: "compile-failed",
+        tab_id,
+        timestamp: Date.now(),
+        content_hash: pre_compile_hash,
+      } satisfies CompileBCMessage);
+    }
+    if (enabled()) schedule_debounce(DIRTY_DEBOUNCE_MS);
+  }
+
+  function request_compile(main: string, mode: CompileMode) {
     const perm = deps.get_permission();
     if (perm === "read") return;
 
     clear_timers();
 
-    const h = hash_files(files);
+    const h = hash_versions(deps.get_source().versions());
     pre_compile_hash = h;
     set_state("compiling");
     set_dirty(false);
     broadcast_compile_requested(h);
-    deps.compile({ files: { ...files }, main, mode });
+    deps.compile({ main, mode });
   }
 
   function toggle(on?: boolean) {
     const next = on !== undefined ? on : !enabled();
     needs_seed = false;
     if (next && !enabled()) {
-      const files = deps.get_files();
-      last_compiled_hash = hash_files(files);
-      last_compiled_files = deep_clone_files(files);
+      last_compiled_hash = snapshot_current_files();
     }
     if (!next) {
       clear_timers();
@@ -356,6 +396,7 @@ export function create_compile_scheduler(deps: CompileSchedulerDeps) {
     toggle,
     notify_change,
     notify_compile_done,
+    notify_compile_cancelled,
     request_compile,
     seed_current_files,
     status,
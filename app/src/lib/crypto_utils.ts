@@ -21,11 +21,15 @@ export function base64url_decode(str: string): Uint8Array {
   return new Uint8Array(atob(str).split("").map((c) => c.charCodeAt(0)));
 }
 
-export function fnv1a_hash_sync(text: string): string {
-  let h = 0x811c9dc5;
+export function fnv1a_32(text: string, seed = 0x811c9dc5): number {
+  let h = seed;
   for (let i = 0; i < text.length; i++) {
     h ^= text.charCodeAt(i);
     h = Math.imul(h, 0x01000193);
   }
-  return (h >>> 0).toString(16).padStart(8, "0");
+  return h >>> 0;
+}
+
+export function fnv1a_hash_sync(text: string): string {
+  return fnv1a_32(text).toString(16).padStart(8, "0");
 }
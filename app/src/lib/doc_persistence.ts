@@ -0,0 +1,127 @@
+import * as Y from "yjs";
+import type { ProjectRepository } from "./project_repository";
+import { encode_snapshot } from "./y_project_doc";
+import type { ProjectId } from "./y_project_doc";
+
+// write-behind persistence of a session's Y.Doc. updates are queued as they
+// happen and, once per interval, merged into a single record appended to the
+// project's update log, so typing costs neither a full state encode nor a
+// rewrite of the snapshot. the log is folded back into a snapshot when it
+// outgrows LOG_COMPACT_BYTES and whenever the session is flushed.
+
+const DEFAULT_INTERVAL_MS = 1000;
+const LOG_COMPACT_BYTES = 1024 * 1024;
+
+export interface DocPersistenceOptions {
+  interval_ms?: number;
+  // while true, updates are not written (a synced folder holds the project);
+  // the next write after it is a full snapshot
+  paused?: () => boolean;
+  // runs before each write, e.g. to persist blobs the doc refers to
+  before_write?: () => Promise<void>;
+  main_file?: () => string;
+}
+
+export class DocPersistence {
+  private queue: Uint8Array[] = [];
+  private timer: ReturnType<typeof setTimeout> | undefined;
+  private writing: Promise<void> = Promise.resolve();
+  private in_flight = 0;
+  private snapshot_needed = false;
+  private saved_main_file: string | null = null;
+  private disposed = false;
+  private readonly on_update = (update: Uint8Array) => this.push(update);
+  private readonly on_destroy = () => this.dispose();
+
+  constructor(
+    private readonly repo: ProjectRepository,
+    private readonly project_id: ProjectId,
+    private readonly doc: Y.Doc,
+    private readonly options: DocPersistenceOptions = {},
+  ) {
+    doc.on("update", this.on_update);
+    // the session flushes before it destroys the doc; anything still queued
+    // by then is already in that snapshot
+    doc.on("destroy", this.on_destroy);
+  }
+
+  private push(update: Uint8Array) {
+    if (this.disposed) return;
+    if (this.options.paused?.()) {
+      this.queue = [];
+      this.snapshot_needed = true;
+      return;
+    }
+    this.queue.push(update);
+    if (this.timer === undefined) {
+      this.timer = setTimeout(() => {
+        this.timer = undefined;
+        void this.flush().catch(() => {});
+      }, this.options.interval_ms ?? DEFAULT_INTERVAL_MS);
+    }
+  }
+
+  // true while edits are queued or being written
+  pending(): boolean {
+    return this.timer !== undefined || this.queue.length > 0 || this.in_flight > 0;
+  }
+
+  // writes what is queued as one log record
+  flush(): Promise<void> {
+    return this.enqueue(false);
+  }
+
+  // writes the whole doc as the snapshot, dropping the log
+  compact(): Promise<void> {
+    return this.enqueue(true);
+  }
+
+  dispose() {
+    if (this.disposed) return;
+    this.disposed = true;
+    if (this.timer !== undefined) clearTimeout(this.timer);
+    this.timer = undefined;
+    this.queue = [];
+    this.doc.off("update", this.on_update);
+    this.doc.off("destroy", this.on_destroy);
+  }
+
+  private enqueue(full: boolean): Promise<void> {
+    if (this.timer !== undefined) {
+      clearTimeout(this.timer);
+      this.timer = undefined;
+    }
+    this.in_flight++;
+    const run = this.writing.then(() => this.write(full));
+    this.writing = run.catch(() => {}).finally(() => { this.in_flight--; });
+    return run;
+  }
+
+  private async write(full: boolean): Promise<void> {
+    if (this.disposed) return;
+    const updates = this.queue;
+    this.queue = [];
+    try {
+      await this.options.before_write?.();
+      if (full || this.snapshot_needed) {
+        this.snapshot_needed = false;
+        await this.repo.save_snapshot(this.project_id, encode_snapshot(this.doc));
+      } else if (updates.length > 0) {
+        const merged = updates.length === 1 ? updates[0] : Y.mergeUpdates(updates);
+        const log_bytes = await this.repo.append_update(this.project_id, merged);
+        if (log_bytes > LOG_COMPACT_BYTES) {
+          await this.repo.save_snapshot(this.project_id, encode_snapshot(this.doc));
+        }
+      }
+      const main_file = this.options.main_file?.();
+      if (main_file !== undefined && main_file !== this.saved_main_file) {
+        await this.repo.update_main_file(this.project_id, main_file);
+        this.saved_main_file = main_file;
+      }
+    } catch (err) {
+      // whatever did not make it to disk goes out with the next snapshot
+      this.snapshot_needed = true;
+      throw err;
+    }
+  }
+}
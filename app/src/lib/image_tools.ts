@@ -1,5 +1,6 @@
 import type { ProjectStore } from "./project_store";
 import { resolve_graphics_path, visit_includegraphics } from "./latex_graphics";
+import type { ImageRequest, ImageResponse } from "../worker/image_worker";
 
 export type OptimizationQuality = 70 | 80 | 90;
 export type ImageOptimizeResult = { path: string; old_bytes: number; new_bytes: number; changed: boolean };
@@ -116,10 +117,6 @@ export function image_reference_count(store: ProjectStore, path: string): number
   return count;
 }
 
-function yield_to_ui(): Promise<void> {
-  return new Promise((resolve) => requestAnimationFrame(() => resolve()));
-}
-
 export async function encode_image_bytes(
   bytes: Uint8Array,
   type: string,
@@ -141,6 +138,76 @@ export async function encode_image_bytes(
   }
 }
 
+// images are re-encoded in a pool of workers (see image_worker.ts), one per
+// spare core up to MAX_IMAGE_WORKERS. without OffscreenCanvas,
+// encode_image_bytes does the work on the main thread instead.
+const MAX_IMAGE_WORKERS = 4;
+
+type ImageJob = {
+  msg: ImageRequest;
+  resolve: (bytes: Uint8Array) => void;
+  reject: (err: Error) => void;
+};
+type ImageSlot = { worker: Worker; job: ImageJob | null };
+
+let image_slots: ImageSlot[] | null = null;
+const image_queue: ImageJob[] = [];
+let image_job_id = 0;
+
+function image_workers_available(): boolean {
+  return typeof OffscreenCanvas !== "undefined" && typeof Worker !== "undefined";
+}
+
+export function image_worker_count(): number {
+  if (!image_workers_available()) return 1;
+  return Math.max(1, Math.min(MAX_IMAGE_WORKERS, (navigator.hardwareConcurrency || 2) - 1));
+}
+
+function finish_image_job(slot: ImageSlot): ImageJob | null {
+  const job = slot.job;
+  slot.job = null;
+  pump_image_queue();
+  return job;
+}
+
+function create_image_slot(): ImageSlot {
+  const slot: ImageSlot = {
+    worker: new Worker(new URL("../worker/image_worker.ts", import.meta.url), { type: "module" }),
+    job: null,
+  };
+  slot.worker.onmessage = (e: MessageEvent) => {
+    const data = e.data as ImageResponse;
+    if (slot.job?.msg.id !== data.id) return;
+    const job = finish_image_job(slot)!;
+    if ("error" in data) job.reject(new Error(data.error));
+    else job.resolve(data.bytes);
+  };
+  slot.worker.onerror = (e) => {
+    finish_image_job(slot)?.reject(new Error(e.message || "Image worker failed"));
+  };
+  return slot;
+}
+
+function pump_image_queue(): void {
+  if (!image_slots) image_slots = Array.from({ length: image_worker_count() }, create_image_slot);
+  for (const slot of image_slots) {
+    if (slot.job || image_queue.length === 0) continue;
+    const job = image_queue.shift()!;
+    slot.job = job;
+    slot.worker.postMessage(job.msg, [job.msg.bytes.buffer]);
+  }
+}
+
+// encode_image_bytes in the worker pool
+function encode_image_bytes_off_thread(bytes: Uint8Array, type: string, quality?: number): Promise<Uint8Array> {
+  if (!image_workers_available()) return encode_image_bytes(bytes, type, quality);
+  return new Promise((resolve, reject) => {
+    // the store keeps its array; the worker gets its own copy, moved not cloned
+    image_queue.push({ msg: { id: ++image_job_id, bytes: bytes.slice(), type, quality }, resolve, reject });
+    pump_image_queue();
+  });
+}
+
 export async function optimize_image_file(
   store: ProjectStore,
   path: string,
@@ -150,25 +217,43 @@ export async function optimize_image_file(
   const content = store.get_content(path);
   if (!(content instanceof Uint8Array)) throw new Error(`${path} is not a binary file`);
 
-  const converted = await encode_image_bytes(content, output_mime_for_path(path), quality / 100);
-  if (converted.byteLength < content.byteLength) {
+  const converted = await encode_image_bytes_off_thread(content, output_mime_for_path(path), quality / 100);
+  // the file may have been replaced while it was being encoded
+  if (converted.byteLength < content.byteLength && store.get_content(path) === content) {
     store.update_content(path, converted);
     return { path, old_bytes: content.byteLength, new_bytes: converted.byteLength, changed: true };
   }
   return { path, old_bytes: content.byteLength, new_bytes: content.byteLength, changed: false };
 }
 
+// optimizes paths with one image in flight per pool worker. results come
+// back in the order of paths; on_result sees them as they complete
+export async function optimize_images(
+  store: ProjectStore,
+  paths: string[],
+  quality: OptimizationQuality,
+  on_result?: (result: ImageOptimizeResult, done: number) => void,
+): Promise<ImageOptimizeResult[]> {
+  const results: ImageOptimizeResult[] = new Array(paths.length);
+  let next = 0;
+  let done = 0;
+  async function run(): Promise<void> {
+    while (next < paths.length) {
+      const i = next++;
+      results[i] = await optimize_image_file(store, paths[i], quality);
+      on_result?.(results[i], ++done);
+    }
+  }
+  await Promise.all(Array.from({ length: Math.min(paths.length, image_worker_count()) }, run));
+  return results;
+}
+
 export async function optimize_all_images(
   store: ProjectStore,
   quality: OptimizationQuality,
 ): Promise<ImageOptimizeResult[]> {
   const current = store.current_file();
-  const targets = store.file_names().filter(is_optimizable_image);
-  const results = [];
-  for (const path of targets) {
-    await yield_to_ui();
-    results.push(await optimize_image_file(store, path, quality));
-  }
+  const results = await optimize_images(store, store.file_names().filter(is_optimizable_image), quality);
   if (current && store.file_names().includes(current)) store.set_current_file(current);
   return results;
 }
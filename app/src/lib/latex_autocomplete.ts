@@ -1,4 +1,5 @@
 import { autocompletion, snippetCompletion, type Completion, type CompletionContext, type CompletionResult } from "@codemirror/autocomplete";
+import type { CommandIndex } from "../worker/protocol";
 
 const BASE_COMMANDS: Completion[] = [
   snippetCompletion("documentclass{${}}", { label: "\\documentclass", type: "keyword", detail: "LaTeX class" }),
@@ -41,26 +42,76 @@ function has_amsmath(doc: string): boolean {
   return /\\usepackage(?:\[[^\]]*\])?\{[^}]*\b(?:amsmath|amssymb|mathtools)\b[^}]*\}/.test(doc);
 }
 
-function latex_completion_source(context: CompletionContext): CompletionResult | null {
-  const begin = context.matchBefore(/\\begin\{[^}\\]*/);
-  if (begin) {
-    return {
-      from: begin.from + "\\begin{".length,
-      options: ENVIRONMENTS.map((env) => ({ label: env, type: "namespace", apply: env })),
-      validFor: /^[\w*]*$/,
-    };
+// engine commands offered at once; when more match, the next keystroke asks
+// again with the longer prefix
+const MAX_INDEX_OPTIONS = 200;
+
+// first index in sorted whose entry is >= prefix
+function lower_bound(sorted: string[], prefix: string): number {
+  let lo = 0;
+  let hi = sorted.length;
+  while (lo < hi) {
+    const mid = (lo + hi) >> 1;
+    if (sorted[mid] < prefix) lo = mid + 1;
+    else hi = mid;
   }
+  return lo;
+}
+
+// the index's commands starting with prefix, minus those with a snippet;
+// truncated when there are more than MAX_INDEX_OPTIONS
+function index_commands(index: CommandIndex, prefix: string, skip: Set<string>): { options: Completion[]; truncated: boolean } {
+  const options: Completion[] = [];
+  for (let i = lower_bound(index.commands, prefix); i < index.commands.length; i++) {
+    const name = index.commands[i];
+    if (!name.startsWith(prefix)) break;
+    if (skip.has(name)) continue;
+    if (options.length === MAX_INDEX_OPTIONS) return { options, truncated: true };
+    options.push({ label: "\\" + name, type: index.kinds[i] === "m" ? "function" : "keyword", apply: name });
+  }
+  return { options, truncated: false };
+}
 
-  const command = context.matchBefore(/\\[A-Za-z]*/);
-  if (!command || (command.from === command.to && !context.explicit)) return null;
-  const doc = context.state.doc.toString();
-  return {
-    from: command.from + 1,
-    options: has_amsmath(doc) ? BASE_COMMANDS.concat(AMS_COMMANDS) : BASE_COMMANDS,
-    validFor: /^[A-Za-z]*$/,
+function snippet_names(snippets: Completion[]): Set<string> {
+  return new Set(snippets.map((c) => c.label.slice(1)));
+}
+
+const BASE_NAMES = snippet_names(BASE_COMMANDS);
+const BASE_AMS_NAMES = snippet_names(BASE_COMMANDS.concat(AMS_COMMANDS));
+
+// commands and environments come from the static lists plus, once a compile
+// has reported them, everything the document's packages define
+function latex_completion_source(index: () => CommandIndex | null) {
+  return (context: CompletionContext): CompletionResult | null => {
+    const begin = context.matchBefore(/\\begin\{[^}\\]*/);
+    if (begin) {
+      const envs = index()?.environments;
+      const names = envs ? [...new Set(ENVIRONMENTS.concat(envs))] : ENVIRONMENTS;
+      return {
+        from: begin.from + "\\begin{".length,
+        options: names.map((env) => ({ label: env, type: "namespace", apply: env })),
+        validFor: /^[\w*]*$/,
+      };
+    }
+
+    const command = context.matchBefore(/\\[A-Za-z]*/);
+    if (!command || (command.from === command.to && !context.explicit)) return null;
+    const doc = context.state.doc.toString();
+    const ams = has_amsmath(doc);
+    const snippets = ams ? BASE_COMMANDS.concat(AMS_COMMANDS) : BASE_COMMANDS;
+    const current = index();
+    if (!current) return { from: command.from + 1, options: snippets, validFor: /^[A-Za-z]*$/ };
+    const prefix = context.state.sliceDoc(command.from + 1, command.to);
+    const found = index_commands(current, prefix, ams ? BASE_AMS_NAMES : BASE_NAMES);
+    return {
+      from: command.from + 1,
+      options: snippets.concat(found.options),
+      // a longer prefix only narrows a complete list
+      validFor: found.truncated ? undefined : /^[A-Za-z]*$/,
+    };
   };
 }
 
-export function latex_autocomplete() {
-  return autocompletion({ override: [latex_completion_source], activateOnTyping: true });
+export function latex_autocomplete(index: () => CommandIndex | null = () => null) {
+  return autocompletion({ override: [latex_completion_source(index)], activateOnTyping: true });
 }
@@ -6,7 +6,7 @@ export type GraphicsRewrite = {
   new_path: string;
 };
 
-const IMAGE_EXTS = ["png", "jpg", "jpeg", "gif", "bmp", "svg", "ico", "pdf", "eps", "ps"];
+const IMAGE_EXTS = ["png", "jpg", "jpeg", "gif", "bmp", "webp", "avif", "svg", "ico", "pdf", "eps", "ps"];
 const INCLUDEGRAPHICS_RE = /(\\includegraphics(?:\s*\[[^\]]*\])?\s*\{)([^}]+)(\})/g;
 
 export function normalize_tex_path(path: string): string {
@@ -22,7 +22,7 @@ const IGNORED_PREFIXES = [".", "_minted-"];
 const SYNC_EXTS = new Set([
   "tex", "sty", "cls", "bib", "bst", "def", "cfg", "clo", "dtx", "fd",
   "txt", "md",
-  "png", "jpg", "jpeg", "gif", "bmp", "svg", "ico",
+  "png", "jpg", "jpeg", "gif", "bmp", "webp", "avif", "svg", "ico",
   "ttf", "otf", "woff", "woff2",
   "pdf", "eps", "ps",
 ]);
@@ -1,6 +1,6 @@
 // imperative PDF.js wrapper -- not reactive, controlled from SolidJS effects
 import * as PDFJS from "pdfjs-dist";
-import { PDFViewer, EventBus, PDFLinkService, LinkTarget } from "pdfjs-dist/web/pdf_viewer.mjs";
+import { PDFViewer, EventBus, PDFLinkService, LinkTarget, RenderingStates } from "pdfjs-dist/web/pdf_viewer.mjs";
 import "pdfjs-dist/web/pdf_viewer.css";
 import type { SyncToPdfResult } from "./synctex";
 
@@ -9,6 +9,20 @@ PDFJS.GlobalWorkerOptions.workerSrc = new URL(
   import.meta.url,
 ).href;
 
+// a page as the previous document rendered it (see take_snapshots)
+type PageSnapshot = {
+  index: number;
+  canvas: HTMLCanvasElement;
+  width: number;
+  height: number;
+  reuse: boolean;
+  // the new document has the page blank; reused, the copy stands in for it
+  blank: boolean;
+};
+
+// a digest per page, null for a page the preview left blank (see dpx-pagedigest.c)
+export type PageDigests = (string | null)[];
+
 export class PdfViewerWrapper {
   private container: HTMLDivElement;
   private event_bus: EventBus;
@@ -18,6 +32,7 @@ export class PdfViewerWrapper {
   private highlight_el: HTMLDivElement | null = null;
   private resize_observer: ResizeObserver | null = null;
   private load_gen = 0; // generation counter to discard stale async loads
+  private page_digests: PageDigests | null = null; // of the shown document
   private scale_key = "eztex_pdf_scale";
 
   constructor(container: HTMLDivElement) {
@@ -76,10 +91,88 @@ export class PdfViewerWrapper {
     localStorage.setItem(this.scale_key, String(this.viewer.currentScale));
   };
 
-  async load_document(data: Uint8Array): Promise<void> {
+  // copy what the current document has on screen, before it is torn down.
+  // every rendered page is kept to cover its slot until the new render lands,
+  // so reloading does not flash blank pages; unchanged ones are not rendered
+  // again at all, and neither are pages the new document left blank, which
+  // keep what they showed until a document with them in it comes.
+  private take_snapshots(pages: PageDigests | null): PageSnapshot[] {
+    const snapshots: PageSnapshot[] = [];
+    if (!this.current_doc) return snapshots;
+    for (let i = 0; i < this.current_doc.numPages; i++) {
+      const view = this.viewer.getPageView(i);
+      if (!view || view.renderingState !== RenderingStates.FINISHED) continue;
+      const src = (view.div as HTMLElement).querySelector(".canvasWrapper canvas") as HTMLCanvasElement | null;
+      if (!src || src.width === 0 || src.height === 0) continue;
+      const canvas = document.createElement("canvas");
+      canvas.width = src.width;
+      canvas.height = src.height;
+      canvas.getContext("2d")?.drawImage(src, 0, 0);
+      const shown = this.page_digests?.[i] ?? null;
+      const blank = !!pages && i < pages.length && pages[i] === null;
+      const unchanged = !!pages && i < pages.length && shown !== null && pages[i] === shown;
+      const has_links = !!(view.div as HTMLElement).querySelector(".annotationLayer section");
+      snapshots.push({
+        index: i,
+        canvas,
+        width: view.viewport.width,
+        height: view.viewport.height,
+        reuse: (blank && shown !== null) || (unchanged && !has_links),
+        blank,
+      });
+    }
+    return snapshots;
+  }
+
+  // put the copies into the new page views. a reused page is marked finished
+  // so the rendering queue skips it; the others drop their copy once they
+  // rendered. a zoom resets the page view, which removes the copy with the
+  // rest of its children and renders the page as usual.
+  private place_snapshots(snapshots: PageSnapshot[], gen: number): void {
+    for (const snap of snapshots) {
+      const view = this.viewer.getPageView(snap.index);
+      if (!view?.viewport) continue;
+      if (
+        Math.abs(view.viewport.width - snap.width) > 0.5 ||
+        Math.abs(view.viewport.height - snap.height) > 0.5 ||
+        view.renderingState !== RenderingStates.INITIAL
+      ) {
+        // a blank page with nothing covering it shows what it is
+        if (snap.blank && this.page_digests) this.page_digests[snap.index] = null;
+        continue;
+      }
+      const el = snap.canvas;
+      el.className = "eztex-page-snapshot";
+      el.style.position = "absolute";
+      el.style.inset = "0";
+      el.style.width = "100%";
+      el.style.height = "100%";
+      (view.div as HTMLElement).appendChild(el);
+      if (snap.reuse) {
+        view.renderingState = RenderingStates.FINISHED;
+        continue;
+      }
+      const on_rendered = (evt: { pageNumber: number }) => {
+        const stale = gen !== this.load_gen;
+        if (!stale && evt.pageNumber !== snap.index + 1) return;
+        el.remove();
+        this.event_bus.off("pagerendered", on_rendered);
+      };
+      this.event_bus.on("pagerendered", on_rendered);
+    }
+  }
+
+  // pages: per-page digests of data, if known. pages whose digest matches the
+  // shown document keep their pixels instead of being rendered again.
+  async load_document(data: Uint8Array, pages: PageDigests | null = null): Promise<void> {
     const gen = ++this.load_gen;
     const prev_page = this.current_doc ? this.viewer.currentPageNumber : 1;
     const prev_scroll = this.container.scrollTop;
+    const snapshots = this.take_snapshots(pages);
+    // a blank page covered by its old pixels still shows the old page
+    const kept = new Set(snapshots.filter((s) => s.blank && s.reuse).map((s) => s.index));
+    const shown = this.page_digests;
+    this.page_digests = pages?.map((d, i) => d ?? (kept.has(i) ? shown?.[i] ?? null : null)) ?? null;
 
     // clear viewer state BEFORE loading the new doc. this triggers
     // PDFViewer's internal cleanup (which zeros the global PagesMapper
@@ -104,6 +197,15 @@ export class PdfViewerWrapper {
       return;
     }
 
+    // registered after the constructor's handler, so the copies go in once
+    // the scale is applied
+    if (snapshots.length > 0) {
+      this.event_bus.on("pagesinit", () => {
+        if (gen !== this.load_gen) return; // stale
+        this.place_snapshots(snapshots, gen);
+      }, { once: true } as any);
+    }
+
     this.current_doc = doc;
     this.viewer.setDocument(doc);
     this.link_service.setDocument(doc);
@@ -202,6 +304,26 @@ export class PdfViewerWrapper {
     return { page: page_num, x: synctex_x, y: synctex_y };
   }
 
+  // the pages in the container's view, one more on either side, 1-based;
+  // null before a document is shown
+  visible_pages(): { first: number; last: number } | null {
+    if (!this.current_doc) return null;
+    const top = this.container.scrollTop;
+    const bottom = top + this.container.clientHeight;
+    let first = 0;
+    let last = 0;
+    for (let i = 0; i < this.current_doc.numPages; i++) {
+      const div = this.viewer.getPageView(i)?.div as HTMLElement | undefined;
+      if (!div) continue;
+      if (div.offsetTop + div.offsetHeight <= top) continue;
+      if (div.offsetTop >= bottom) break;
+      if (first === 0) first = i + 1;
+      last = i + 1;
+    }
+    if (first === 0) return null;
+    return { first: Math.max(1, first - 1), last: Math.min(this.current_doc.numPages, last + 1) };
+  }
+
   get page_count(): number {
     return this.current_doc?.numPages ?? 0;
   }
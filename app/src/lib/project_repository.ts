@@ -1,3 +1,4 @@
+import * as Y from "yjs";
 import { get, put, remove, get_all, delete_database } from "./storage_db";
 import {
   create_project_id,
@@ -26,6 +27,44 @@ export interface LoadedProject {
 const ROOT_DIR = "eztex-projects";
 const CACHE_DIR = "eztex-cache";
 
+// a project's Y.Doc is ydoc.bin, a full state snapshot, plus ydoc.log:
+// incremental updates appended since that snapshot, each framed as
+// [u32 LE length][update]. replaying an update twice is a no-op, so a
+// crash between writing a snapshot and dropping the log loses nothing.
+const SNAPSHOT_FILE = "ydoc.bin";
+const LOG_FILE = "ydoc.log";
+
+function frame_update(update: Uint8Array): Uint8Array {
+  const framed = new Uint8Array(4 + update.length);
+  new DataView(framed.buffer).setUint32(0, update.length, true);
+  framed.set(update, 4);
+  return framed;
+}
+
+// a record cut short by a crash mid-append ends the log
+function parse_update_log(bytes: Uint8Array): Uint8Array[] {
+  const view = new DataView(bytes.buffer, bytes.byteOffset, bytes.byteLength);
+  const updates: Uint8Array[] = [];
+  let pos = 0;
+  while (pos + 4 <= bytes.length) {
+    const len = view.getUint32(pos, true);
+    if (pos + 4 + len > bytes.length) break;
+    updates.push(bytes.subarray(pos + 4, pos + 4 + len));
+    pos += 4 + len;
+  }
+  return updates;
+}
+
+async function read_file_if_exists(dir: FileSystemDirectoryHandle, name: string): Promise<Uint8Array | null> {
+  try {
+    const handle = await dir.getFileHandle(name);
+    const file = await handle.getFile();
+    return new Uint8Array(await file.arrayBuffer());
+  } catch {
+    return null;
+  }
+}
+
 async function write_file_bytes(handle: FileSystemFileHandle, bytes: Uint8Array | FileSystemWriteChunkType): Promise<void> {
   const writable = await handle.createWritable();
   try {
@@ -89,15 +128,7 @@ export class ProjectRepository {
     const record = await this.get_project(project_id);
     if (!record) throw new Error(`Project ${project_id} not found`);
 
-    let snapshot: Uint8Array | null = null;
-    try {
-      const dir = await this.get_project_dir(project_id);
-      const handle = await dir.getFileHandle("ydoc.bin");
-      const file = await handle.getFile();
-      snapshot = new Uint8Array(await file.arrayBuffer());
-    } catch {
-      // no snapshot yet
-    }
+    const snapshot = await this.load_snapshot(project_id);
 
     let blobs_dir: FileSystemDirectoryHandle | null = null;
     try {
@@ -109,10 +140,36 @@ export class ProjectRepository {
     return { record, snapshot, blobs_dir };
   }
 
+  // replaces the doc state; the update log it supersedes is dropped
   async save_snapshot(project_id: ProjectId, snapshot: Uint8Array): Promise<void> {
     const dir = await this.get_project_dir(project_id);
-    const handle = await dir.getFileHandle("ydoc.bin", { create: true });
+    const handle = await dir.getFileHandle(SNAPSHOT_FILE, { create: true });
     await write_file_bytes(handle, snapshot);
+    try {
+      await dir.removeEntry(LOG_FILE);
+    } catch (err) {
+      if (!is_not_found_error(err)) throw err;
+    }
+  }
+
+  // appends one incremental update to the doc state, returning the size the
+  // update log has grown to
+  async append_update(project_id: ProjectId, update: Uint8Array): Promise<number> {
+    const dir = await this.get_project_dir(project_id);
+    const handle = await dir.getFileHandle(LOG_FILE, { create: true });
+    const size = (await handle.getFile()).size;
+    const framed = frame_update(update);
+    const writable = await handle.createWritable({ keepExistingData: true });
+    try {
+      await writable.write({ type: "write", position: size, data: framed });
+    } finally {
+      try {
+        await writable.close();
+      } catch {
+        // ignore close errors after a failed write
+      }
+    }
+    return size + framed.length;
   }
 
   async delete_project(project_id: ProjectId): Promise<void> {
@@ -272,7 +329,7 @@ export class ProjectRepository {
     const snapshot = await this.load_snapshot(source_id);
     if (snapshot) {
       const new_dir = await this.get_project_dir(new_id);
-      const handle = await new_dir.getFileHandle("ydoc.bin", { create: true });
+      const handle = await new_dir.getFileHandle(SNAPSHOT_FILE, { create: true });
       await write_file_bytes(handle, snapshot);
     }
 
@@ -303,15 +360,19 @@ export class ProjectRepository {
     return new_id;
   }
 
+  // the snapshot with the update log folded in
   private async load_snapshot(project_id: ProjectId): Promise<Uint8Array | null> {
+    let dir: FileSystemDirectoryHandle;
     try {
-      const dir = await this.get_project_dir(project_id);
-      const handle = await dir.getFileHandle("ydoc.bin");
-      const file = await handle.getFile();
-      return new Uint8Array(await file.arrayBuffer());
+      dir = await this.get_project_dir(project_id);
     } catch {
       return null;
     }
+    const snapshot = await read_file_if_exists(dir, SNAPSHOT_FILE);
+    const log = await read_file_if_exists(dir, LOG_FILE);
+    const updates = log ? parse_update_log(log) : [];
+    if (updates.length === 0) return snapshot;
+    return Y.mergeUpdates(snapshot && snapshot.length > 0 ? [snapshot, ...updates] : updates);
   }
 
   async recover_pending_deletes(): Promise<void> {
@@ -5,6 +5,7 @@ import type { BlobStore } from "./blob_store";
 import type { ProjectBroadcast } from "./project_broadcast";
 import type { CollabProvider } from "./collab_provider";
 import type { LocalFolderSync } from "./local_folder_sync";
+import type { DocPersistence } from "./doc_persistence";
 
 export interface ProjectSession {
   project_id: ProjectId;
@@ -15,6 +16,7 @@ export interface ProjectSession {
   collab_provider: CollabProvider | null;
   folder_sync: LocalFolderSync | null;
   cleanup?: () => void;
+  persistence: DocPersistence;
 
   flush(): Promise<void>;
   close(reason: "switch" | "tab-close" | "delete"): Promise<void>;
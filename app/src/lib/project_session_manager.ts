@@ -7,6 +7,7 @@ import { ProjectBroadcast, type BCMessage } from "./project_broadcast";
 import { create_project_store, type ProjectStore } from "./project_store";
 import { create_collab_provider, type CollabProvider } from "./collab_provider";
 import { create_local_folder_sync, type LocalFolderSync } from "./local_folder_sync";
+import { DocPersistence } from "./doc_persistence";
 import {
   bind_y_project_doc,
   apply_snapshot,
@@ -20,8 +21,6 @@ import { get_collab_ws_url } from "./collab_config";
 
 export type CloseReason = "switch" | "tab-close" | "delete";
 
-const MAX_CREATE_BLOB_ENCODED_BYTES = 768 * 1024;
-const MAX_CREATE_BLOBS_TOTAL_ENCODED_BYTES = 768 * 1024;
 const MAIN_FILE_CANDIDATES = ["main.tex", "paper.tex", "thesis.tex", "document.tex"];
 
 function detect_main_file(store: ProjectStore): string | undefined {
@@ -119,6 +118,12 @@ export class ProjectSessionManager {
     folder_sync: LocalFolderSync | null;
     cleanup?: () => void;
   }): ProjectSession {
+    const { store, folder_sync } = options;
+    const persistence = new DocPersistence(this.repo, options.project_id, options.doc, {
+      paused: () => !!folder_sync?.state().active,
+      before_write: () => store.flush_dirty_blobs(),
+      main_file: () => store.main_file(),
+    });
     return {
       project_id: options.project_id,
       doc: options.doc,
@@ -128,6 +133,7 @@ export class ProjectSessionManager {
       collab_provider: options.collab_provider,
       folder_sync: options.folder_sync,
       cleanup: options.cleanup,
+      persistence,
       flush: async () => { await this.flush(); },
       close: async (reason: CloseReason) => { await this.close_current(reason); },
     };
@@ -261,6 +267,7 @@ export class ProjectSessionManager {
       put_blobs: async (blobs: Record<string, string>) => {
         await store.import_blobs(blobs);
       },
+      put_blob_manifests: (manifests) => store.import_blob_manifests(manifests),
       on_blob_available: (hash) => { void store.handle_blob_available(hash); },
       on_blob_request: (hash) => { void store.handle_blob_request(hash); },
       on_blob_response: (hash, bytes) => { void store.handle_blob_response(hash, bytes); },
@@ -319,10 +326,7 @@ export class ProjectSessionManager {
     const room_secret = room.room_secret!;
     const write_token = await create_share_token(room_secret, room_id, "w");
 
-    const precomputed_blobs = await store.export_blobs({
-      max_blob_encoded_bytes: MAX_CREATE_BLOB_ENCODED_BYTES,
-      max_total_encoded_bytes: MAX_CREATE_BLOBS_TOTAL_ENCODED_BYTES,
-    });
+    const blob_manifests = await store.export_blob_manifests();
 
     const collab_provider = create_collab_provider({
       room_id,
@@ -332,10 +336,12 @@ export class ProjectSessionManager {
       awareness: store.awareness(),
       identity,
       ws_url: get_collab_ws_url(room_id),
-      precomputed_blobs,
+      blob_manifests,
+      get_blob_chunk: (chunk) => store.blob_chunk(chunk),
       put_blobs: async (blobs: Record<string, string>) => {
         await store.import_blobs(blobs);
       },
+      put_blob_manifests: (manifests) => store.import_blob_manifests(manifests),
       on_blob_available: (hash) => { void store.handle_blob_available(hash); },
       on_blob_request: (hash) => { void store.handle_blob_request(hash); },
       on_blob_response: (hash, bytes) => { void store.handle_blob_response(hash, bytes); },
@@ -425,10 +431,7 @@ export class ProjectSessionManager {
   async flush(): Promise<void> {
     const session = this.current_session;
     if (!session) return;
-    await session.store.flush_dirty_blobs();
-    const snapshot = session.store.encode_ydoc_snapshot();
-    await this.repo.save_snapshot(session.project_id, snapshot);
-    await this.repo.update_main_file(session.project_id, session.store.main_file());
+    await session.persistence.compact();
   }
 
   current(): ProjectSession | null {
@@ -16,13 +16,21 @@ import {
   create_binary_file_ref,
 } from "./y_project_doc";
 import type { ProjectId, FileId } from "./y_project_doc";
-import { compute_hash, base64url_encode, base64url_decode } from "./crypto_utils";
+import { compute_hash, base64url_decode } from "./crypto_utils";
 import type { BlobStore } from "./blob_store";
+import { split_blob, fetch_blob, type BlobManifest } from "./blob_chunks";
+import { get_collab_chunk_url } from "./collab_config";
 import type { ProjectBroadcast } from "./project_broadcast";
 
 export type FileContent = string | Uint8Array;
 export type ProjectFiles = Record<string, FileContent>;
 export type ProjectChange = { kind: "content" | "structure"; paths?: string[] };
+// incremental view of the project for consumers that mirror it (the compile
+// worker): a version per path that changes with its content, and the content
+export type ProjectSource = {
+  versions: () => Map<string, number>;
+  read: (path: string) => FileContent;
+};
 
 export type BlobSyncSender = {
   send_blob_available: (hash: string) => void;
@@ -33,7 +41,7 @@ export type BlobSyncSender = {
 
 
 const BINARY_EXTS = new Set([
-  "png", "jpg", "jpeg", "gif", "bmp", "svg", "ico",
+  "png", "jpg", "jpeg", "gif", "bmp", "webp", "avif", "svg", "ico",
   "ttf", "otf", "woff", "woff2",
   "pdf", "eps", "ps",
 ]);
@@ -62,6 +70,7 @@ export function create_project_store() {
   const _dirty_blob_paths = new Set<string>();
   const _requested_blob_hashes = new Set<string>();
   let _blob_store: BlobStore | null = null;
+  const _outgoing_chunks = new Map<string, Uint8Array>();
   let _broadcast: ProjectBroadcast | null = null;
   let _blob_sync_sender: BlobSyncSender | null = null;
   let _owns_doc = true;
@@ -97,7 +106,7 @@ export function create_project_store() {
         new_files[path] = binary_cache.get(path) ?? new Uint8Array(0);
       } else {
         const ytext = yp.texts.get(fid);
-        new_files[path] = ytext?.toString() ?? "";
+        new_files[path] = ytext ? read_text(ytext) : "";
       }
     }
     if (Object.keys(new_files).length === 0 && !_pid && !snapshot_expected) {
@@ -146,6 +155,58 @@ export function create_project_store() {
     return paths.length > 0 ? paths : undefined;
   }
 
+  // version tokens handed out by file_versions: a text file's token changes
+  // with its Y.Text, a binary's when binary_cache holds a new array
+  let _version_clock = 0;
+  const _content_versions = new WeakMap<object, number>();
+
+  function content_version(key: object): number {
+    let version = _content_versions.get(key);
+    if (version === undefined) {
+      version = ++_version_clock;
+      _content_versions.set(key, version);
+    }
+    return version;
+  }
+
+  // each Y.Text's string as last read, kept while its version holds: a
+  // compile, the scheduler's change check and a facade refresh all read
+  // every file, and only the edited ones need toString again
+  const _text_cache = new WeakMap<Y.Text, { version: number; text: string }>();
+
+  function read_text(ytext: Y.Text): string {
+    const version = content_version(ytext);
+    const cached = _text_cache.get(ytext);
+    if (cached && cached.version === version) return cached.text;
+    const text = ytext.toString();
+    _text_cache.set(ytext, { version, text });
+    return text;
+  }
+
+  function bump_text_versions(transaction: unknown) {
+    const changed = (transaction as { changed?: Map<unknown, unknown> } | undefined)?.changed;
+    if (!changed) return;
+    for (const type of changed.keys()) {
+      if (type instanceof Y.Text && _content_versions.has(type)) _content_versions.set(type, ++_version_clock);
+    }
+  }
+
+  function file_versions(): Map<string, number> {
+    const versions = new Map<string, number>();
+    for (const path of list_paths(yp)) {
+      const fid = get_file_id(yp, path);
+      if (!fid) continue;
+      const meta = yp.file_meta.get(fid) as Y.Map<unknown> | undefined;
+      const key = meta?.get("kind") === "binary" ? binary_cache.get(path) : yp.texts.get(fid);
+      versions.set(path, key ? content_version(key) : 0);
+    }
+    return versions;
+  }
+
+  function file_source(): ProjectSource {
+    return { versions: file_versions, read: get_content };
+  }
+
   function handle_doc_change(change: ProjectChange) {
     if (change.kind === "structure") refresh_facade();
     set_content_revision(r => r + 1);
@@ -163,6 +224,7 @@ export function create_project_store() {
       ydoc.off("update", _update_handler);
     }
     _update_handler = (update: Uint8Array, origin: unknown, _doc?: Y.Doc, transaction?: unknown) => {
+      bump_text_versions(transaction);
       if (origin === ORIGIN_LOAD && !_broadcast) {
         return;
       }
@@ -503,7 +565,7 @@ export function create_project_store() {
       return binary_cache.get(name) ?? new Uint8Array(0);
     }
     const ytext = yp.texts.get(fid);
-    return ytext?.toString() ?? "";
+    return ytext ? read_text(ytext) : "";
   }
 
   function get_text_content(name: string): string {
@@ -513,7 +575,7 @@ export function create_project_store() {
     const kind = meta?.get("kind") as string | undefined;
     if (kind === "binary") return "";
     const ytext = yp.texts.get(fid);
-    return ytext?.toString() ?? "";
+    return ytext ? read_text(ytext) : "";
   }
 
   function clear_all() {
@@ -675,7 +737,7 @@ export function create_project_store() {
         if (cached) result[path] = cached;
       } else {
         const ytext = yp.texts.get(fid);
-        result[path] = ytext?.toString() ?? "";
+        result[path] = ytext ? read_text(ytext) : "";
       }
     }
     return result;
@@ -738,9 +800,10 @@ export function create_project_store() {
     if (loaded_any) refresh_facade();
   }
 
-  async function export_blobs(options?: { max_blob_encoded_bytes?: number; max_total_encoded_bytes?: number }): Promise<Record<string, string>> {
-    const result: Record<string, string> = {};
-    let total_encoded_bytes = 0;
+  // chunk manifests of the project's binary files for a new room, keeping the
+  // chunks at hand for blob_chunk until the room asks for them
+  async function export_blob_manifests(): Promise<Record<string, BlobManifest>> {
+    const result: Record<string, BlobManifest> = {};
     for (const path of list_paths(yp)) {
       const fid = get_file_id(yp, path);
       if (!fid) continue;
@@ -748,31 +811,34 @@ export function create_project_store() {
       const kind = meta?.get("kind") as string | undefined;
       if (kind !== "binary") continue;
       const hash = yp.blob_refs.get(fid) as string | undefined;
-      if (!hash) continue;
+      if (!hash || result[hash]) continue;
 
       let bytes = binary_cache.get(path);
       if (!bytes && _blob_store) {
         bytes = (await _blob_store.get(hash)) ?? undefined;
         if (bytes) binary_cache.set(path, bytes);
       }
-      if (bytes) {
-        const encoded = base64url_encode(bytes);
-        if (options?.max_blob_encoded_bytes !== undefined && encoded.length > options.max_blob_encoded_bytes) {
-          continue;
-        }
-        if (
-          options?.max_total_encoded_bytes !== undefined
-          && total_encoded_bytes + encoded.length > options.max_total_encoded_bytes
-        ) {
-          continue;
-        }
-        result[hash] = encoded;
-        total_encoded_bytes += encoded.length;
-      }
+      if (!(bytes instanceof Uint8Array)) continue;
+      const { manifest, chunks } = await split_blob(bytes);
+      for (const [chunk, chunk_bytes] of chunks) _outgoing_chunks.set(chunk, chunk_bytes);
+      result[hash] = manifest;
     }
     return result;
   }
 
+  async function blob_chunk(chunk: string): Promise<Uint8Array | null> {
+    return _outgoing_chunks.get(chunk) ?? null;
+  }
+
+  // fetch the binary files a room lists that this project lacks
+  async function import_blob_manifests(manifests: Record<string, BlobManifest>): Promise<void> {
+    await Promise.all(Object.entries(manifests).map(async ([hash, manifest]) => {
+      if (await has_blob(hash)) return;
+      const bytes = await fetch_blob(hash, manifest, get_collab_chunk_url);
+      if (bytes) await handle_blob_response(hash, bytes);
+    }));
+  }
+
   async function import_blobs(blobs: Record<string, string>): Promise<void> {
     for (const [hash, b64] of Object.entries(blobs)) {
       try {
@@ -807,6 +873,7 @@ export function create_project_store() {
     _broadcast = null;
     _blob_sync_sender = null;
     _blob_store = null;
+    _outgoing_chunks.clear();
     awareness.destroy();
     if (_owns_doc) {
       ydoc.destroy();
@@ -837,6 +904,7 @@ export function create_project_store() {
     content_revision,
     file_names,
     current_files,
+    file_source,
     add_file,
     remove_file,
     rename_file,
@@ -861,7 +929,9 @@ export function create_project_store() {
     clear_snapshot_expected,
     flush_dirty_blobs,
     load_persisted_blobs,
-    export_blobs,
+    export_blob_manifests,
+    blob_chunk,
+    import_blob_manifests,
     import_blobs,
     missing_blob_paths,
     request_missing_blobs,
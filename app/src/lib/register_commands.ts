@@ -99,8 +99,7 @@ export function init_commands(d: CommandDeps): void {
     when: () => project.store.file_names().length > 0,
     action: async () => {
       if (await alert_if_missing_blobs()) return;
-      const files = project.store.current_files();
-      worker_client.compile({ files, main: project.store.main_file(), mode: "full" });
+      worker_client.compile({ source: project.store.file_source(), main: project.store.main_file(), mode: "full" });
     },
   });
 
@@ -380,7 +379,7 @@ export function init_commands(d: CommandDeps): void {
     action: async () => {
       if (await alert_if_missing_blobs()) return;
       const ok = await worker_client.compile_and_wait({
-        files: project.store.current_files(),
+        source: project.store.file_source(),
         main: project.store.main_file(),
         mode: "full",
       });
@@ -0,0 +1,84 @@
+// project search for SearchPanel, answered by the search worker
+// (see search_worker.ts). like the compile worker, the index mirrors the
+// project by version: before each query only files whose version moved are
+// posted, so typing in one file re-indexes that file alone.
+
+import { is_binary } from "./project_store";
+import type { ProjectSource } from "./project_store";
+import type { FileGroup, SearchRequest, SearchResponse } from "../worker/search_worker";
+
+export type { FileGroup, SearchResult } from "../worker/search_worker";
+
+export type SearchIndex = {
+  // groups in project order
+  search: (source: ProjectSource, query: string, case_sensitive: boolean) => Promise<FileGroup[]>;
+  // forget everything posted, for a different project
+  reset: () => void;
+  dispose: () => void;
+};
+
+export function create_search_index(): SearchIndex {
+  let worker: Worker | null = null;
+  let posted = new Map<string, number>();
+  let seq = 0;
+  const pending = new Map<number, (groups: FileGroup[]) => void>();
+
+  function post(msg: SearchRequest): void {
+    if (!worker) {
+      worker = new Worker(new URL("../worker/search_worker.ts", import.meta.url), {
+        type: "module",
+      });
+      worker.onmessage = (e: MessageEvent) => {
+        const data = e.data as SearchResponse;
+        const resolve = pending.get(data.id);
+        if (!resolve) return;
+        pending.delete(data.id);
+        resolve(data.groups);
+      };
+    }
+    worker.postMessage(msg);
+  }
+
+  function sync(source: ProjectSource): Map<string, number> {
+    const versions = source.versions();
+    for (const [path, version] of versions) {
+      if (is_binary(path) || posted.get(path) === version) continue;
+      const content = source.read(path);
+      if (typeof content !== "string") continue;
+      post({ type: "file_changed", path, text: content });
+      posted.set(path, version);
+    }
+    for (const path of [...posted.keys()]) {
+      if (versions.has(path)) continue;
+      post({ type: "file_deleted", path });
+      posted.delete(path);
+    }
+    return versions;
+  }
+
+  function search(source: ProjectSource, query: string, case_sensitive: boolean): Promise<FileGroup[]> {
+    const versions = sync(source);
+    const order = new Map<string, number>();
+    for (const path of versions.keys()) order.set(path, order.size);
+    const id = ++seq;
+    return new Promise<FileGroup[]>((resolve) => {
+      pending.set(id, resolve);
+      post({ type: "search", id, query, case_sensitive });
+    }).then((groups) => groups.sort((a, b) => (order.get(a.file) ?? 0) - (order.get(b.file) ?? 0)));
+  }
+
+  function reset(): void {
+    posted = new Map();
+    if (worker) post({ type: "clear" });
+  }
+
+  function dispose(): void {
+    worker?.terminate();
+    worker = null;
+    posted = new Map();
+    for (const resolve of pending.values()) resolve([]);
+    pending.clear();
+  }
+
+  return { search, reset, dispose };
+}
@@ -298,7 +298,7 @@ function blocks_to_rect(blocks: Block[]): Rect {
 
 // -- path normalization --
 // synctex records WASI paths like ./main.tex or //main.tex -- strip leading ./ and /
-function normalize_path(p: string): string {
+export function normalize_path(p: string): string {
   return p.replace(/^[./]+/, "");
 }
 
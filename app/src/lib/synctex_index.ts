@@ -0,0 +1,255 @@
+// compiled synctex index (<job>.synctex.idx, see src/SynctexIndex.zig)
+// answers sync_to_pdf/sync_to_code like synctex.ts does, straight from typed
+// array views of the blob -- no gunzip, no text parse, no per-box objects
+
+import { normalize_path } from "./synctex";
+import type { SyncToPdfResult, SyncToCodeResult } from "./synctex";
+
+const MAGIC = 0x4953_5a45; // "EZSI" read little-endian
+const VERSION = 1;
+const UNIT = 65781.76;
+const NO_WIDTH = -0x8000_0000;
+const KIND_K = "k".charCodeAt(0);
+const KIND_R = "r".charCodeAt(0);
+const PATH_WORDS = 4;
+const PAGE_WORDS = 5;
+
+export type SynctexIndex = {
+  offset: { x: number; y: number };
+  paths: string[];
+  // per path: [elem_start, elem_end)
+  path_ranges: Uint32Array;
+  line: Int32Array;
+  page: Int32Array;
+  left: Int32Array;
+  bottom: Int32Array;
+  width: Int32Array;
+  height: Int32Array;
+  kind: Uint8Array;
+  bands: number;
+  pages: Int32Array;
+  order: Uint32Array;
+  band_starts: Uint32Array;
+  band_items: Uint32Array;
+};
+
+// views over a compiled index, or null when bytes are not one.
+// typed arrays read in platform order, little-endian on every browser target
+export function open_synctex_index(bytes: Uint8Array): SynctexIndex | null {
+  if (bytes.length < 64) return null;
+  // typed array views need 4-aligned offsets
+  if (bytes.byteOffset % 4 !== 0) bytes = bytes.slice();
+  const buf = bytes.buffer as ArrayBuffer;
+  const base = bytes.byteOffset;
+  const h = new DataView(buf, base, 64);
+  const u32 = (w: number) => h.getUint32(w * 4, true);
+  if (u32(0) !== MAGIC || u32(1) !== VERSION || u32(15) !== bytes.length) return null;
+
+  const path_count = u32(4);
+  const n = u32(5);
+  const page_count = u32(6);
+  const bands = u32(7);
+  const [paths_off, elems_off, pages_off, order_off, band_starts_off, band_items_off, names_off] =
+    [8, 9, 10, 11, 12, 13, 14].map(u32);
+
+  const path_table = new Uint32Array(buf, base + paths_off, path_count * PATH_WORDS);
+  const paths: string[] = [];
+  const path_ranges = new Uint32Array(path_count * 2);
+  for (let p = 0; p < path_count; p++) {
+    const at = names_off + path_table[p * PATH_WORDS];
+    const len = path_table[p * PATH_WORDS + 1];
+    // latin1, as decompress_gzip reads the text
+    let name = "";
+    for (let i = 0; i < len; i++) name += String.fromCharCode(bytes[at + i]);
+    paths.push(name);
+    path_ranges[p * 2] = path_table[p * PATH_WORDS + 2];
+    path_ranges[p * 2 + 1] = path_table[p * PATH_WORDS + 3];
+  }
+
+  const column = (f: number) => new Int32Array(buf, base + elems_off + f * n * 4, n);
+  return {
+    offset: { x: h.getInt32(2 * 4, true) / UNIT, y: h.getInt32(3 * 4, true) / UNIT },
+    paths,
+    path_ranges,
+    line: column(0),
+    page: column(1),
+    left: column(2),
+    bottom: column(3),
+    width: column(4),
+    height: column(5),
+    kind: new Uint8Array(buf, base + elems_off + 6 * n * 4, n),
+    bands,
+    pages: new Int32Array(buf, base + pages_off, page_count * PAGE_WORDS),
+    order: new Uint32Array(buf, base + order_off, n),
+    band_starts: new Uint32Array(buf, base + band_starts_off, page_count * (bands + 1)),
+    band_items: new Uint32Array(buf, base + band_items_off, (names_off - band_items_off) / 4),
+  };
+}
+
+function find_path(idx: SynctexIndex, file: string): number {
+  const normalized = normalize_path(file);
+  let p = idx.paths.findIndex((name) => normalize_path(name) === normalized);
+  if (p >= 0) return p;
+  // case-insensitive fallback
+  const lower = normalized.toLowerCase();
+  p = idx.paths.findIndex((name) => normalize_path(name).toLowerCase() === lower);
+  return p;
+}
+
+// first element in [lo, hi) whose line is >= line
+function lower_bound_line(idx: SynctexIndex, lo: number, hi: number, line: number): number {
+  while (lo < hi) {
+    const mid = (lo + hi) >>> 1;
+    if (idx.line[mid] < line) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+// the elements of a line on its lowest page: [start, end)
+function line_run(idx: SynctexIndex, start: number, end: number): [number, number] {
+  let i = start;
+  while (i < end && idx.line[i] === idx.line[start] && idx.page[i] === idx.page[start]) i++;
+  return [start, i];
+}
+
+type Box = { top: number; bottom: number; left: number; right: number };
+
+function run_to_rect(idx: SynctexIndex, run: [number, number]): Box {
+  const r: Box = { top: 2e16, bottom: 0, left: 2e16, right: 0 };
+  for (let i = run[0]; i < run[1]; i++) {
+    if (idx.kind[i] === KIND_K || idx.kind[i] === KIND_R) continue;
+    const bottom = idx.bottom[i] / UNIT;
+    const left = idx.left[i] / UNIT;
+    r.bottom = Math.max(bottom, r.bottom);
+    r.top = Math.min(bottom - idx.height[i] / UNIT, r.top);
+    r.left = Math.min(left, r.left);
+    if (idx.width[i] !== NO_WIDTH) r.right = Math.max(left + idx.width[i] / UNIT, r.right);
+  }
+  return r;
+}
+
+// -- forward sync: editor -> PDF --
+
+export function index_sync_to_pdf(idx: SynctexIndex, file: string, line: number): SyncToPdfResult | null {
+  const p = find_path(idx, file);
+  if (p < 0) return null;
+  const start = idx.path_ranges[p * 2];
+  const end = idx.path_ranges[p * 2 + 1];
+  if (start === end) return null;
+
+  const i = lower_bound_line(idx, start, end, line);
+  let run: [number, number];
+  let rect: Box;
+  if (i === end) {
+    // line is past the last known line -- use last
+    run = line_run(idx, lower_bound_line(idx, start, end, idx.line[end - 1]), end);
+    rect = run_to_rect(idx, run);
+  } else if (i === start || idx.line[i] === line) {
+    run = line_run(idx, i, end);
+    rect = run_to_rect(idx, run);
+  } else {
+    // interpolate between bounding lines
+    const l0 = idx.line[i - 1];
+    const l1 = idx.line[i];
+    const r0 = run_to_rect(idx, line_run(idx, lower_bound_line(idx, start, end, l0), end));
+    run = line_run(idx, i, end);
+    const r1 = run_to_rect(idx, run);
+    const bottom = r0.bottom < r1.bottom
+      ? r0.bottom * (l1 - line) / (l1 - l0) + r1.bottom * (line - l0) / (l1 - l0)
+      : r1.bottom;
+    rect = { top: r1.top, bottom, left: r1.left, right: r1.right };
+  }
+
+  const raw_height = rect.bottom - rect.top;
+  const raw_width = rect.right - rect.left;
+  // same limits as sync_to_pdf in synctex.ts
+  if (raw_height > 200) return null;
+  return {
+    page: idx.page[run[0]],
+    x: rect.left + idx.offset.x,
+    y: rect.bottom + idx.offset.y,
+    width: Math.max(raw_width, 50),
+    height: Math.max(raw_height, 12),
+  };
+}
+
+// -- reverse sync: PDF click -> editor --
+
+function page_slot(idx: SynctexIndex, page: number): number {
+  let lo = 0;
+  let hi = idx.pages.length / PAGE_WORDS;
+  while (lo < hi) {
+    const mid = (lo + hi) >>> 1;
+    const at = idx.pages[mid * PAGE_WORDS];
+    if (at === page) return mid;
+    if (at < page) lo = mid + 1;
+    else hi = mid;
+  }
+  return -1;
+}
+
+function path_of(idx: SynctexIndex, elem: number): string {
+  for (let p = 0; p < idx.paths.length; p++) {
+    if (elem < idx.path_ranges[p * 2 + 1]) return idx.paths[p];
+  }
+  return "";
+}
+
+export function index_sync_to_code(idx: SynctexIndex, page: number, x: number, y: number): SyncToCodeResult | null {
+  const slot = page_slot(idx, page);
+  if (slot < 0) return null;
+  const x0 = x - idx.offset.x;
+  const y0 = y - idx.offset.y;
+  const rec = slot * PAGE_WORDS;
+  const order_start = idx.pages[rec + 1];
+  const order_end = idx.pages[rec + 2];
+  const lo = idx.pages[rec + 3];
+  const band_height = idx.pages[rec + 4];
+
+  const skip = (e: number) => idx.kind[e] === KIND_K || idx.kind[e] === KIND_R;
+  const rect_of = (e: number): Box => {
+    const bottom = idx.bottom[e] / UNIT;
+    const left = idx.left[e] / UNIT;
+    const w = idx.width[e];
+    return { top: bottom - idx.height[e] / UNIT, bottom, left, right: w !== NO_WIDTH && w !== 0 ? left + w / UNIT : left };
+  };
+
+  // pass 1: smallest containing rect, among the boxes of the click's band
+  const band = Math.min(Math.max(Math.floor((y0 * UNIT - lo) / band_height), 0), idx.bands - 1);
+  const bands_at = slot * (idx.bands + 1) + band;
+  let best = -1;
+  let best_area = Infinity;
+  for (let k = idx.band_starts[bands_at]; k < idx.band_starts[bands_at + 1]; k++) {
+    const e = idx.band_items[k];
+    if (skip(e)) continue;
+    const r = rect_of(e);
+    if (x0 < r.left || x0 > r.right || y0 < r.top || y0 > r.bottom) continue;
+    const area = (r.right - r.left) * (r.bottom - r.top);
+    if (best < 0 || area < best_area) {
+      best = e;
+      best_area = area;
+    }
+  }
+
+  // pass 2 fallback: vertical-priority distance over the whole page
+  // (see sync_to_code in synctex.ts)
+  if (best < 0) {
+    let best_dist = Infinity;
+    for (let k = order_start; k < order_end; k++) {
+      const e = idx.order[k];
+      if (skip(e)) continue;
+      const r = rect_of(e);
+      const dx = Math.max(r.left - x0, 0, x0 - r.right);
+      const dy = Math.max(r.top - y0, 0, y0 - r.bottom);
+      const dist = dx + 3 * dy;
+      if (dist < best_dist) {
+        best_dist = dist;
+        best = e;
+      }
+    }
+  }
+
+  if (best < 0) return null;
+  return { file: normalize_path(path_of(idx, best)), line: idx.line[best] };
+}
@@ -2,10 +2,11 @@
 // spawns a module worker and exposes signals for status/progress/logs/pdf
 
 import { createSignal, batch } from "solid-js";
-import type { ProjectFiles } from "./project_store";
-import type { Diagnostic } from "../worker/protocol";
-import { decompress_gzip, parse_synctex, sync_to_pdf, sync_to_code } from "./synctex";
-import type { PdfSyncObject, SyncToPdfResult } from "./synctex";
+import type { ProjectSource } from "./project_store";
+import type { CommandIndex, CompileTimings, Diagnostic } from "../worker/protocol";
+import type { SyncToPdfResult } from "./synctex";
+import type { PageDigests } from "./pdf_viewer";
+import type { SynctexRequest, SynctexResponse } from "../worker/synctex_worker";
 
 export type CompileMode = "preview" | "full";
 
@@ -18,9 +19,11 @@ export type LogEntry = {
 export type WorkerStatus = "idle" | "loading" | "compiling" | "success" | "error";
 
 export type CompileRequest = {
-  files: ProjectFiles;
+  source: ProjectSource;
   main?: string;
   mode?: CompileMode;
+  // the file being edited: a preview typesets only the \include'd part holding it
+  focus?: string;
 };
 
 const [status, set_status] = createSignal<WorkerStatus>("idle");
@@ -32,10 +35,13 @@ const [pdf_bytes, set_pdf_bytes] = createSignal<Uint8Array | null>(null);
 const [ready, set_ready] = createSignal(false);
 const [compiling, set_compiling] = createSignal(false);
 const [last_elapsed, set_last_elapsed] = createSignal<string | null>(null);
+// where the last compile's time went, shown with the logs
+const [last_timings, set_last_timings] = createSignal<CompileTimings | null>(null);
 const [diagnostics, set_diagnostics] = createSignal<Diagnostic[]>([]);
+// what the engine found defined in the last compile, for completion
+const [command_index, set_command_index] = createSignal<CommandIndex | null>(null);
 
 // synctex state
-const [synctex_data, set_synctex_data] = createSignal<PdfSyncObject | null>(null);
 const [synctex_text, set_synctex_text] = createSignal<string | null>(null);
 const [sync_target, set_sync_target] = createSignal<SyncToPdfResult | null>(null);
 
@@ -47,8 +53,22 @@ function request_goto(file: string, line: number): void {
   set_goto_request({ file, line });
 }
 
-let worker: Worker | null = null;
+// the engine: a worker of this tab's own, or with ?shared=1 a port to the
+// engine every tab shares (see shared_worker.ts)
+let worker: Worker | MessagePort | null = null;
+// releases the Web Lock that tells the shared engine this tab is connected
+let release_tab: (() => void) | null = null;
+// the PDF worker of ?pipeline=1, null otherwise
+let pdf_worker: Worker | null = null;
 let prev_pdf_url: string | null = null;
+// page digests of the PDF on screen, null when unknown (see dpx-pagedigest.c)
+let shown_page_digests: PageDigests | null = null;
+// the pages the preview shows (see PdfViewerWrapper.visible_pages)
+let visible_pages: (() => { first: number; last: number } | null) | null = null;
+
+function same_pages(a: PageDigests | null, b: PageDigests | null): boolean {
+  return !!a && !!b && a.length === b.length && a.every((d, i) => d !== null && d === b[i]);
+}
 
 // imperative compile-done callbacks -- supports multiple subscribers
 const _on_compile_done_cbs: Array<() => void> = [];
@@ -57,6 +77,22 @@ function on_compile_done(cb: () => void): () => void {
   return () => { const i = _on_compile_done_cbs.indexOf(cb); if (i >= 0) _on_compile_done_cbs.splice(i, 1); };
 }
 
+// a new PDF is on screen. with ?pipeline=1 a preview's PDF arrives after its
+// "complete", so this, not on_compile_done, is where to pick it up
+const _on_pdf_cbs: Array<() => void> = [];
+function on_pdf(cb: () => void): () => void {
+  _on_pdf_cbs.push(cb);
+  return () => { const i = _on_pdf_cbs.indexOf(cb); if (i >= 0) _on_pdf_cbs.splice(i, 1); };
+}
+
+// a preview compile stopped because a newer one superseded it (see
+// cancel_preview); on_compile_done does not fire for it
+const _on_compile_cancelled_cbs: Array<() => void> = [];
+function on_compile_cancelled(cb: () => void): () => void {
+  _on_compile_cancelled_cbs.push(cb);
+  return () => { const i = _on_compile_cancelled_cbs.indexOf(cb); if (i >= 0) _on_compile_cancelled_cbs.splice(i, 1); };
+}
+
 // imperative ready callback -- used by App for auto-compile on load
 const _on_ready_cbs: Array<() => void> = [];
 function on_ready(cb: () => void): () => void {
@@ -69,6 +105,18 @@ function on_ready(cb: () => void): () => void {
 
 // detect ?debug=1 query param for debug mode passthrough to worker
 const _debug = typeof window !== "undefined" && new URLSearchParams(window.location.search).has("debug");
+// ?simd=0 loads the baseline engine even where SIMD128 is available
+const _simd = typeof window === "undefined" || new URLSearchParams(window.location.search).get("simd") !== "0";
+// ?pipeline=1 writes preview PDFs in a second worker (see engine.send_xdv)
+const _pipeline = typeof window !== "undefined" && new URLSearchParams(window.location.search).get("pipeline") === "1";
+// ?cache_budget=<MiB> caps the engine's OPFS cache (see opfs.trim)
+const _cache_budget_mb = typeof window !== "undefined" ? Number(new URLSearchParams(window.location.search).get("cache_budget")) : 0;
+const _cache_budget = _cache_budget_mb > 0 ? _cache_budget_mb * 1024 * 1024 : undefined;
+// ?shared=1 compiles in one engine for all tabs (see shared_worker.ts). it
+// reads the bundle cache per file: SharedWorkers get no OPFS sync access
+// handles, so the pack is out of reach. not combined with ?pipeline=1
+const _shared = typeof window !== "undefined" && new URLSearchParams(window.location.search).get("shared") === "1"
+  && typeof SharedWorker !== "undefined" && "locks" in navigator && !_pipeline;
 
 function append_log(msg: string, cls: string = "") {
   const entry: LogEntry = { msg, cls, ts: Date.now() };
@@ -79,41 +127,112 @@ function clear_logs() {
   set_logs([]);
 }
 
+type PdfMessage = {
+  pdf: Uint8Array;
+  pages?: PageDigests | null;
+};
+
 type CompleteMessage = {
-  pdf: Uint8Array | null;
+  ok: boolean;
   synctex: Uint8Array | null;
   elapsed?: number;
+  synctex_index?: Uint8Array | null;
 };
 
-async function handle_complete(data: CompleteMessage) {
+// the PDF arrives ahead of "complete", so the viewer starts loading it while
+// the worker still persists intermediates. the bytes were transferred, so
+// they are used as they are.
+function handle_pdf(data: PdfMessage) {
   const pdf_data = data.pdf;
-  const synctex_raw = data.synctex;
-  if (pdf_data) {
-    set_pdf_bytes(new Uint8Array(pdf_data));
-    if (prev_pdf_url) URL.revokeObjectURL(prev_pdf_url);
-    const blob = new Blob([pdf_data as BlobPart], { type: "application/pdf" });
-    const url = URL.createObjectURL(blob);
-    prev_pdf_url = url;
-    set_pdf_url(url);
+  // every page renders as before: keep the document on screen as it is
+  const unchanged = !!pdf_bytes() && same_pages(shown_page_digests, data.pages ?? null);
+  shown_page_digests = data.pages ?? null;
+  if (unchanged) {
+    append_log("[eztex] no page changed, preview kept", "log-info");
+    return;
   }
+  set_pdf_bytes(pdf_data);
+  if (prev_pdf_url) URL.revokeObjectURL(prev_pdf_url);
+  const blob = new Blob([pdf_data as BlobPart], { type: "application/pdf" });
+  const url = URL.createObjectURL(blob);
+  prev_pdf_url = url;
+  set_pdf_url(url);
+  for (const cb of _on_pdf_cbs) cb();
+}
 
-  if (synctex_raw && synctex_raw.length > 0) {
-    try {
-      const text = await decompress_gzip(synctex_raw);
-      const parsed = parse_synctex(text);
-      if (parsed) {
-        set_synctex_text(text);
-        set_synctex_data(parsed);
+// synctex data lives in its own worker (see synctex_worker.ts): gunzip,
+// parse and queries of a long document would otherwise stall the editor
+// after every compile. loads are numbered; the text of the newest one is
+// awaited before compile-done callbacks run, so save_synctex sees it.
+let synctex_worker: Worker | null = null;
+let synctex_gen = 0;
+let synctex_text_wait: { gen: number; resolve: (text: string | null) => void } | null = null;
+let forward_id = 0;
+let reverse_id = 0;
+
+function post_synctex(msg: SynctexRequest, transfer: Transferable[] = []): void {
+  if (!synctex_worker) {
+    synctex_worker = new Worker(new URL("../worker/synctex_worker.ts", import.meta.url), {
+      type: "module",
+    });
+    synctex_worker.onmessage = handle_synctex_message;
+  }
+  synctex_worker.postMessage(msg, transfer);
+}
+
+function handle_synctex_message(e: MessageEvent) {
+  const data = e.data as SynctexResponse;
+  switch (data.type) {
+    case "text":
+      if (synctex_text_wait?.gen === data.gen) {
+        synctex_text_wait.resolve(data.text);
+        synctex_text_wait = null;
       }
-    } catch {
-      append_log("[synctex] failed to parse synchronization data", "log-error");
-    }
+      break;
+    case "error":
+      if (synctex_text_wait?.gen === data.gen) {
+        synctex_text_wait.resolve(null);
+        synctex_text_wait = null;
+      }
+      if (data.gen === synctex_gen) append_log("[synctex] failed to parse synchronization data", "log-error");
+      break;
+    case "forward":
+      // only the newest cursor position matters
+      if (data.id !== forward_id) break;
+      if (import.meta.env.DEV) console.debug("[synctex:forward] sync_forward result", data.result);
+      set_sync_target(data.result);
+      break;
+    case "reverse":
+      if (data.id !== reverse_id) break;
+      if (import.meta.env.DEV) console.debug("[synctex:reverse] do_sync_to_code result", data.result);
+      if (data.result) request_goto(data.result.file, data.result.line);
+      break;
+  }
+}
+
+function load_synctex(synctex: Uint8Array | null, index: Uint8Array | null): Promise<string | null> {
+  const gen = ++synctex_gen;
+  synctex_text_wait?.resolve(null);
+  const transfer: Transferable[] = [];
+  if (synctex) transfer.push(synctex.buffer);
+  if (index && index.buffer !== synctex?.buffer) transfer.push(index.buffer);
+  return new Promise((resolve) => {
+    synctex_text_wait = { gen, resolve };
+    post_synctex({ type: "load", gen, synctex, index }, transfer);
+  });
+}
+
+async function handle_complete(data: CompleteMessage) {
+  running_preview = null;
+  if (data.synctex_index || (data.synctex && data.synctex.length > 0)) {
+    const text = await load_synctex(data.synctex, data.synctex_index ?? null);
+    if (text) set_synctex_text(text);
   }
 
   batch(() => {
     set_compiling(false);
     set_last_elapsed(data.elapsed ? `${data.elapsed}s` : null);
-    if (!pdf_data) {
+    if (!data.ok) {
       set_status("error");
       set_status_text("Error");
     } else {
@@ -153,36 +272,154 @@ function handle_message(e: MessageEvent) {
       });
       for (const cb of _on_ready_cbs) cb();
       break;
+    case "pdf":
+      handle_pdf(data as PdfMessage);
+      break;
     case "complete": {
       void handle_complete(data as CompleteMessage);
       break;
     }
+    case "timings":
+      set_last_timings(data.timings as CompileTimings);
+      break;
+    case "commands":
+      set_command_index(data.index as CommandIndex);
+      break;
+    case "cancelled":
+      running_preview = null;
+      batch(() => {
+        set_compiling(false);
+        set_status("idle");
+        set_status_text("Cancelled");
+      });
+      for (const cb of _on_compile_cancelled_cbs) cb();
+      break;
   }
 }
 
+// compiles are numbered as posted. a superseded preview is stopped by raising
+// the worker's cancel bound past its number: in shared memory when the page
+// is cross-origin isolated, so the running engine sees it at its next page,
+// else by message, which the worker reads between compiles or while a run
+// waits on a fetch.
+let compile_seq = 0;
+let running_preview: number | null = null;
+let cancel_bound: Int32Array | null = null;
+
+// the PDF worker only reports PDFs and log lines
+function handle_pdf_worker_message(e: MessageEvent) {
+  const data = e.data;
+  if (data.type === "pdf") handle_pdf(data as PdfMessage);
+  else if (data.type === "log") append_log(data.msg, data.cls || "");
+}
+
+function start_pdf_worker() {
+  pdf_worker = new Worker(new URL("../worker/worker.ts", import.meta.url), {
+    type: "module",
+  });
+  pdf_worker.onmessage = handle_pdf_worker_message;
+  pdf_worker.onerror = (e) => append_log(`PDF worker error: ${e.message}`, "log-error");
+  const channel = new MessageChannel();
+  worker!.postMessage({ type: "pdf_port", port: channel.port1 }, [channel.port1]);
+  pdf_worker.postMessage({ type: "init_pdf", port: channel.port2, debug: _debug }, [channel.port2]);
+}
+
 function init_worker() {
   if (worker) return;
-  worker = new Worker(new URL("../worker/worker.ts", import.meta.url), {
+  posted_versions = new Map();
+  compile_seq = 0;
+  running_preview = null;
+  set_status("loading");
+  set_status_text("Loading WASM...");
+  if (_shared) {
+    connect_shared_worker();
+    return;
+  }
+  cancel_bound = typeof SharedArrayBuffer !== "undefined" && globalThis.crossOriginIsolated
+    ? new Int32Array(new SharedArrayBuffer(4))
+    : null;
+  const own = new Worker(new URL("../worker/worker.ts", import.meta.url), {
     type: "module",
   });
-  worker.onmessage = handle_message;
-  worker.onerror = (e) => {
+  own.onmessage = handle_message;
+  own.onerror = (e) => {
     append_log(`worker error: ${e.message}`, "log-error");
     set_status("error");
   };
-  set_status("loading");
-  set_status_text("Loading WASM...");
-  worker.postMessage({ type: "init", debug: _debug });
+  worker = own;
+  worker.postMessage({ type: "init", debug: _debug, simd: _simd, cancel: cancel_bound?.buffer, cache_budget: _cache_budget });
+  if (_pipeline) start_pdf_worker();
+}
+
+// shared memory does not reach a SharedWorker, so cancels go by message. the
+// lock is held until destroy; once it is free the engine drops this tab
+function connect_shared_worker() {
+  cancel_bound = null;
+  const tab_lock = `eztex-tab-${crypto.randomUUID()}`;
+  void navigator.locks.request(tab_lock, () => new Promise<void>((resolve) => { release_tab = resolve; }));
+  const shared = new SharedWorker(new URL("../worker/shared_worker.ts", import.meta.url), {
+    type: "module",
+    name: "eztex-engine",
+  });
+  shared.onerror = () => {
+    append_log("shared engine failed to start", "log-error");
+    set_status("error");
+  };
+  worker = shared.port;
+  worker.onmessage = handle_message;
+  worker.postMessage({ type: "init", debug: _debug, simd: _simd, tab_lock, cache_budget: _cache_budget });
+}
+
+// file versions the worker holds, as last posted. the worker keeps its
+// project tree between compiles, so before each compile only files whose
+// version moved are posted (file_changed), and paths gone from the project
+// are dropped (file_deleted). versions come from the Yjs doc, so nothing is
+// read or hashed for unchanged files.
+let posted_versions = new Map<string, number>();
+
+function post_file(target: Worker | MessagePort, path: string, version: number, content: string | Uint8Array): void {
+  if (content instanceof Uint8Array) {
+    // the store keeps its array; the worker gets its own copy, moved not cloned
+    const copy = content.slice();
+    target.postMessage({ type: "file_changed", path, version, content: copy }, [copy.buffer]);
+  } else {
+    target.postMessage({ type: "file_changed", path, version, content });
+  }
+}
+
+// the PDF worker gets the same tree: xdvipdfmx reads the project's images
+function sync_files(source: ProjectSource): void {
+  const versions = source.versions();
+  for (const [path, version] of versions) {
+    if (posted_versions.get(path) === version) continue;
+    const content = source.read(path);
+    post_file(worker!, path, version, content);
+    if (pdf_worker) post_file(pdf_worker, path, version, content);
+    posted_versions.set(path, version);
+  }
+  for (const path of [...posted_versions.keys()]) {
+    if (versions.has(path)) continue;
+    worker!.postMessage({ type: "file_deleted", path });
+    pdf_worker?.postMessage({ type: "file_deleted", path });
+    posted_versions.delete(path);
+  }
 }
 
 async function post_compile(req: CompileRequest, mode: CompileMode) {
   try {
     if (!worker || !ready()) return;
+    sync_files(req.source);
+    const seq = ++compile_seq;
+    running_preview = mode === "preview" ? seq : null;
+    // the PDF worker converts the pages on screen first (see write_pdf)
+    const shown = mode === "preview" && pdf_worker ? visible_pages?.() : null;
     worker.postMessage({
       type: "compile",
-      files: req.files,
       main: req.main,
       mode,
+      seq,
+      focus: req.focus,
+      pages: shown ? `${shown.first}-${shown.last}` : undefined,
       debug: _debug,
     });
   } catch (err) {
@@ -219,7 +456,20 @@ function compile_and_wait(req: CompileRequest): Promise<boolean> {
   });
 }
 
-// stub: SAB-based cancellation not yet implemented -- falls back to dirty_compiling in watch_controller
+// stop the preview compile in flight, if any; returns whether there was one.
+// the worker answers with "cancelled", or with "complete" if the run finished first
+function cancel_preview(): boolean {
+  if (!worker || running_preview === null) return false;
+  const below = running_preview + 1;
+  running_preview = null;
+  if (cancel_bound) {
+    Atomics.store(cancel_bound, 0, below);
+  } else {
+    worker.postMessage({ type: "cancel", below });
+  }
+  return true;
+}
+
 function clear_cache() {
   if (!worker) return;
   worker.postMessage({ type: "clear_cache" });
@@ -233,19 +483,37 @@ function restore_pdf_url(url: string) {
 }
 
 function restore_pdf_bytes(bytes: Uint8Array) {
+  shown_page_digests = null;
   set_pdf_bytes(bytes);
 }
 
-function restore_synctex(parsed: PdfSyncObject) {
-  set_synctex_data(parsed);
+// a saved .synctex text, parsed in the synctex worker
+function restore_synctex(text: string) {
+  set_synctex_text(text);
+  post_synctex({ type: "restore", gen: ++synctex_gen, text });
 }
 
 function destroy() {
-  worker?.terminate();
+  if (worker instanceof MessagePort) worker.close();
+  else worker?.terminate();
   worker = null;
+  release_tab?.();
+  release_tab = null;
+  pdf_worker?.terminate();
+  pdf_worker = null;
+  synctex_worker?.terminate();
+  synctex_worker = null;
+  synctex_text_wait?.resolve(null);
+  synctex_text_wait = null;
+  posted_versions = new Map();
+  running_preview = null;
+  cancel_bound = null;
   if (prev_pdf_url) URL.revokeObjectURL(prev_pdf_url);
   prev_pdf_url = null;
+  shown_page_digests = null;
     _on_compile_done_cbs.length = 0;
+  _on_compile_cancelled_cbs.length = 0;
+  _on_pdf_cbs.length = 0;
   _on_ready_cbs.length = 0;
   batch(() => {
     set_status("idle");
@@ -258,51 +526,44 @@ function destroy() {
     set_compiling(false);
     set_last_elapsed(null);
     set_diagnostics([]);
-    set_synctex_data(null);
     set_synctex_text(null);
     set_sync_target(null);
     set_goto_request(null);
   });
 }
 
-// forward sync: editor cursor -> PDF highlight
+// forward sync: editor cursor -> PDF highlight, answered by the synctex worker
 function sync_forward(file: string, line: number): void {
-  const data = synctex_data();
-  if (!data) {
-    if (import.meta.env.DEV) console.debug("[synctex:data] sync_forward: synctex_data is null, skipping");
-    return;
-  }
+  if (!synctex_worker) return;
   if (import.meta.env.DEV) console.debug("[synctex:forward] sync_forward called", { file, line });
-  const result = sync_to_pdf(data, file, line);
-  if (import.meta.env.DEV) console.debug("[synctex:forward] sync_forward result", result);
-  set_sync_target(result);
+  post_synctex({ type: "forward", id: ++forward_id, file, line });
 }
 
-// reverse sync: PDF click -> editor jump
+// reverse sync: PDF click -> editor jump, answered by the synctex worker
 function do_sync_to_code(page: number, x: number, y: number): void {
-  const data = synctex_data();
-  if (!data) {
-    if (import.meta.env.DEV) console.debug("[synctex:data] do_sync_to_code: synctex_data is null, skipping");
-    return;
-  }
+  if (!synctex_worker) return;
   if (import.meta.env.DEV) console.debug("[synctex:reverse] do_sync_to_code called", { page, x, y });
-  const result = sync_to_code(data, page, x, y);
-  if (import.meta.env.DEV) console.debug("[synctex:reverse] do_sync_to_code result", result);
-  if (result) request_goto(result.file, result.line);
+  post_synctex({ type: "reverse", id: ++reverse_id, page, x, y });
 }
 
 export const worker_client = {
   init: init_worker,
   compile,
   compile_and_wait,
+  cancel_preview,
   clear_cache,
   clear_logs,
   on_compile_done,
+  on_compile_cancelled,
+  on_pdf,
   on_ready,
   restore_pdf_url,
   restore_pdf_bytes,
   restore_synctex,
   destroy,
+  // per-page digests of the PDF in pdf_bytes, when the compile reported them
+  page_digests: () => shown_page_digests,
+  set_visible_pages: (source: typeof visible_pages) => { visible_pages = source; },
   request_goto,
   clear_goto: () => set_goto_request(null),
   sync_forward,
@@ -317,9 +578,10 @@ export const worker_client = {
   ready,
   compiling,
   last_elapsed,
+  last_timings,
   diagnostics,
+  command_index,
   goto_request,
-  synctex_data,
   synctex_text,
   sync_target,
 };
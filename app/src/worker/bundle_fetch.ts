@@ -32,30 +32,48 @@ function get_index_url(): string {
   return FALLBACK_INDEX_URL;
 }
 
-// fetch + gzip-decompress the ITAR index, with OPFS caching
+const INDEX_FILE = "_itar_index.bin";
+// the server's ETag for the cached index, sent back as If-None-Match
+const INDEX_ETAG_FILE = "_itar_index.etag";
+
+// fetch + gzip-decompress the ITAR index, with OPFS caching. a cached index
+// with an ETag is revalidated with one conditional request (304 when the
+// bundle is unchanged); offline, the cached copy is used as is.
 export async function fetch_itar_index(): Promise<Uint8Array | null> {
-  // try OPFS cache first
+  let cached: Uint8Array | null = null;
+  let etag: string | null = null;
   if (opfs.supported) {
     try {
       const dir = await opfs.get_dir();
-      const cached = await opfs.read(dir, "_itar_index.bin");
-      if (cached) {
-        index_bytes_len = cached.byteLength;
-        dbg("index", `loaded from OPFS (${format_size(cached.byteLength)})`);
-        return cached;
-      }
+      cached = await opfs.read(dir, INDEX_FILE);
+      const tag = cached ? await opfs.read(dir, INDEX_ETAG_FILE) : null;
+      if (tag) etag = new TextDecoder().decode(tag);
     } catch {
       // fall through to network
     }
   }
 
-  dbg("index", "fetching ITAR index from network...");
+  function use_cached(bytes: Uint8Array, how: string): Uint8Array {
+    index_bytes_len = bytes.byteLength;
+    dbg("index", `loaded from OPFS, ${how} (${format_size(bytes.byteLength)})`);
+    return bytes;
+  }
+
+  // cached by an older build without a validator: nothing to revalidate with
+  if (cached && !etag) return use_cached(cached, "not revalidated");
+
+  dbg("index", cached ? "revalidating cached ITAR index..." : "fetching ITAR index from network...");
   const index_url = get_index_url();
   dbg("index", `fetching: ${index_url}`);
   let resp: Response;
   try {
-    resp = await fetch(index_url, { signal: AbortSignal.timeout(30000) });
+    resp = await fetch(index_url, {
+      headers: etag ? { "If-None-Match": etag } : {},
+      cache: "no-cache",
+      signal: AbortSignal.timeout(cached ? 5000 : 30000),
+    });
   } catch (err) {
+    if (cached) return use_cached(cached, "revalidation failed");
     const offline = typeof navigator !== "undefined" && !navigator.onLine;
     const msg = err instanceof Error ? err.message : String(err);
     throw new Error(
@@ -64,7 +82,11 @@ export async function fetch_itar_index(): Promise<Uint8Array | null> {
         : `index fetch failed: ${msg}`,
     );
   }
-  if (!resp.ok) throw new Error(`index fetch failed: HTTP ${resp.status}`);
+  if (cached && resp.status === 304) return use_cached(cached, "unchanged");
+  if (!resp.ok) {
+    if (cached) return use_cached(cached, `revalidation got HTTP ${resp.status}`);
+    throw new Error(`index fetch failed: HTTP ${resp.status}`);
+  }
   const compressed = new Uint8Array(await resp.arrayBuffer());
   dbg("index", `downloaded ${format_size(compressed.byteLength)} compressed`);
 
@@ -77,11 +99,15 @@ export async function fetch_itar_index(): Promise<Uint8Array | null> {
   const bytes = new Uint8Array(decompressed);
   index_bytes_len = bytes.byteLength;
 
-  // cache to OPFS
+  // cache to OPFS. the old ETag is cleared first and the new one written
+  // last, so a validator never vouches for an index that failed to write
   if (opfs.supported) {
     try {
       const dir = await opfs.get_dir();
-      await opfs.write(dir, "_itar_index.bin", bytes);
+      await opfs.write(dir, INDEX_ETAG_FILE, new Uint8Array(0));
+      await opfs.write(dir, INDEX_FILE, bytes);
+      const new_etag = resp.headers.get("ETag");
+      if (new_etag) await opfs.write(dir, INDEX_ETAG_FILE, new TextEncoder().encode(new_etag));
     } catch {
       // non-critical
     }
@@ -95,6 +121,109 @@ function request_timeout(length: number): number {
   return 20_000 + Math.ceil(length / 100_000) * 1_000;
 }
 
+// entries at least this large (CJK fonts, big format inputs) are fetched as
+// SPLIT_PARTS parallel sub-ranges; one stream underuses high-latency links
+const SPLIT_THRESHOLD = 8 * 1024 * 1024;
+const SPLIT_PARTS = 4;
+
+// read bytes [offset, offset + dst.length) of the bundle into dst. a dropped
+// connection resumes from the last byte received instead of starting over.
+async function fetch_into(url: string, offset: number, dst: Uint8Array, attempts: number = 3): Promise<void> {
+  let done = 0;
+  let last_err = "";
+  for (let attempt = 0; attempt < attempts && done < dst.length; attempt++) {
+    if (attempt > 0) await new Promise((r) => setTimeout(r, 500));
+    try {
+      const resp = await fetch(url, {
+        headers: { Range: `bytes=${offset + done}-${offset + dst.length - 1}` },
+        signal: AbortSignal.timeout(request_timeout(dst.length - done)),
+      });
+      // a full 200 body would not line up with dst
+      if (resp.status !== 206 || !resp.body) {
+        last_err = `HTTP ${resp.status}`;
+        continue;
+      }
+      const reader = resp.body.getReader();
+      try {
+        while (true) {
+          const { done: eof, value } = await reader.read();
+          if (eof) break;
+          const n = Math.min(value.length, dst.length - done);
+          dst.set(value.subarray(0, n), done);
+          done += n;
+        }
+      } finally {
+        reader.releaseLock();
+      }
+      if (done < dst.length) last_err = `short body (${done} of ${dst.length} bytes)`;
+    } catch (err) {
+      last_err = err instanceof Error ? err.message : String(err);
+    }
+  }
+  if (done < dst.length) throw new Error(last_err);
+}
+
+// fetch a large range as parallel sub-ranges reassembled in one buffer
+async function fetch_split(url: string, offset: number, length: number): Promise<Uint8Array> {
+  const buf = new Uint8Array(length);
+  const part = Math.ceil(length / SPLIT_PARTS);
+  const parts: Promise<void>[] = [];
+  for (let start = 0; start < length; start += part) {
+    parts.push(fetch_into(url, offset + start, buf.subarray(start, Math.min(start + part, length))));
+  }
+  await Promise.all(parts);
+  dbg("fetch", `split ${format_size(length)} at offset=${offset} into ${parts.length} parts`);
+  return buf;
+}
+
+// fetch one bundle range (1 retry on failure); throws with the last error
+export async function fetch_range(offset: number, length: number): Promise<Uint8Array> {
+  const url = get_bundle_url();
+  if (length >= SPLIT_THRESHOLD) return fetch_split(url, offset, length);
+  const range_end = offset + length - 1;
+  let last_err = "";
+  for (let attempt = 0; attempt < 2; attempt++) {
+    try {
+      const resp = await fetch(url, {
+        headers: { Range: `bytes=${offset}-${range_end}` },
+        signal: AbortSignal.timeout(request_timeout(length)),
+      });
+      if (!resp.ok && resp.status !== 206) {
+        last_err = `HTTP ${resp.status}`;
+        continue;
+      }
+      return new Uint8Array(await resp.arrayBuffer());
+    } catch (err) {
+      last_err = err instanceof Error ? err.message : String(err);
+    }
+  }
+  throw new Error(last_err);
+}
+
+// inflate a gzip-compressed bundle entry (raw_length != 0 in the index).
+// compressed bundles only compress entries that shrink, so data already at
+// raw_length is stored as is.
+export async function inflate(data: Uint8Array, raw_length: number): Promise<Uint8Array> {
+  if (raw_length === 0 || data.byteLength === raw_length) return data;
+  const ds = new DecompressionStream("gzip");
+  const writer = ds.writable.getWriter();
+  writer.write(data);
+  writer.close();
+  const out = new Uint8Array(await new Response(ds.readable).arrayBuffer());
+  if (out.byteLength !== raw_length) {
+    throw new Error(`inflated to ${out.byteLength} bytes, expected ${raw_length}`);
+  }
+  return out;
+}
+
+// index entry to fetch; raw_length is 0 unless the entry is gzip-compressed
+interface PlanEntry {
+  name: string;
+  offset: bigint;
+  length: number;
+  raw_length: number;
+}
+
 // merge adjacent Range entries to reduce HTTP request count.
 // entries must be pre-sorted by offset. merges when gap <= max_gap
 // and combined size <= max_range_size.
@@ -102,12 +231,13 @@ interface MergedRange {
   names: string[];
   offsets: number[];     // per-file offset within merged response
   lengths: number[];     // per-file original length
+  raw_lengths: number[]; // per-file inflated length, 0 if stored as is
   range_start: number;   // byte offset in bundle
   range_length: number;  // total bytes to fetch
 }
 
 function merge_ranges(
-  entries: { name: string; offset: bigint; length: number }[],
+  entries: PlanEntry[],
   max_gap: number = 65536,
   max_range_size: number = 2 * 1024 * 1024,
 ): MergedRange[] {
@@ -121,6 +251,7 @@ function merge_ranges(
     names: [sorted[0].name],
     offsets: [0],
     lengths: [sorted[0].length],
+    raw_lengths: [sorted[0].raw_length],
     range_start: Number(sorted[0].offset),
     range_length: sorted[0].length,
   };
@@ -137,6 +268,7 @@ function merge_ranges(
       cur.names.push(entry.name);
       cur.offsets.push(entry_start - cur.range_start);
       cur.lengths.push(entry.length);
+      cur.raw_lengths.push(entry.raw_length);
       cur.range_length = new_length;
     } else {
       // start new range
@@ -145,6 +277,7 @@ function merge_ranges(
         names: [entry.name],
         offsets: [0],
         lengths: [entry.length],
+        raw_lengths: [entry.raw_length],
         range_start: entry_start,
         range_length: entry.length,
       };
@@ -166,7 +299,7 @@ export async function batch_fetch(
   if (names.length === 0) return;
 
   // resolve names to index entries, skip any not in index
-  const plan: { name: string; offset: bigint; length: number }[] = [];
+  const plan: PlanEntry[] = [];
   const skipped: string[] = [];
   const already_cached: string[] = [];
   for (const name of names) {
@@ -176,7 +309,7 @@ export async function batch_fetch(
     }
     const entry = wasm_api.index_lookup(name);
     if (entry) {
-      plan.push({ name, offset: entry.offset, length: entry.length });
+      plan.push({ name, offset: entry.offset, length: entry.length, raw_length: entry.raw_length });
     } else {
       skipped.push(name);
     }
@@ -202,14 +335,14 @@ export async function batch_fetch(
   dbg("batch", `merged ${plan.length} files into ${ranges.length} range requests`);
 
   // first pass: fetch all with concurrency pool
-  const failed_entries = await run_merged_fetch_pass(ranges, cached_files, opfs_queue, concurrency, tick);
+  const failed_entries = await run_slices_pass(ranges, cached_files, opfs_queue, concurrency, tick);
   fetched = plan.length - failed_entries.length;
 
   // retry failed entries individually with lower concurrency
   if (failed_entries.length > 0) {
     dbg("batch", `retrying ${failed_entries.length} failed files...`);
     const individual_plan = failed_entries.map(e => ({
-      name: e.name, offset: BigInt(e.offset), length: e.length,
+      name: e.name, offset: BigInt(e.offset), length: e.length, raw_length: e.raw_length,
     }));
     for (let attempt = 0; attempt < 2 && individual_plan.length > 0; attempt++) {
       const delay = 1000 * (attempt + 1);
@@ -237,6 +370,113 @@ export async function batch_fetch(
   }
 }
 
+// split one merged range, starting at `base` in buf, into individual files
+async function store_range(
+  range: MergedRange,
+  buf: Uint8Array,
+  base: number,
+  cached_files: Map<string, Uint8Array>,
+  opfs_queue: { name: string; data: Uint8Array }[],
+  tick?: (name: string) => void,
+): Promise<void> {
+  for (let j = 0; j < range.names.length; j++) {
+    const name = range.names[j];
+    if (cached_files.has(name)) continue;
+    const start = base + range.offsets[j];
+    const data = await inflate(buf.slice(start, start + range.lengths[j]), range.raw_lengths[j]);
+    cached_files.set(name, data);
+    opfs_queue.push({ name, data });
+    if (tick) tick(name);
+  }
+}
+
+// merged ranges per {bundle}/slices request and the bytes one may carry,
+// inside the worker's limits (MAX_SLICES, MAX_SLICES_BYTES in worker/index.js)
+const SLICES_PER_REQUEST = 64;
+const SLICES_MAX_BYTES = 8 * 1024 * 1024;
+// set once the server has no slices route; plain ranges are used from then on
+let slices_unsupported = false;
+
+function group_ranges(ranges: MergedRange[]): MergedRange[][] {
+  const groups: MergedRange[][] = [];
+  let cur: MergedRange[] = [];
+  let bytes = 0;
+  for (const range of ranges) {
+    if (cur.length > 0 && (cur.length >= SLICES_PER_REQUEST || bytes + range.range_length > SLICES_MAX_BYTES)) {
+      groups.push(cur);
+      cur = [];
+      bytes = 0;
+    }
+    cur.push(range);
+    bytes += range.range_length;
+  }
+  if (cur.length > 0) groups.push(cur);
+  return groups;
+}
+
+// fetch groups of merged ranges as one concatenated, edge-cacheable response
+// each (see /bundle/slices in worker/index.js). a group that fails goes
+// through run_merged_fetch_pass as plain Range requests.
+async function run_slices_pass(
+  ranges: MergedRange[],
+  cached_files: Map<string, Uint8Array>,
+  opfs_queue: { name: string; data: Uint8Array }[],
+  concurrency: number,
+  tick?: (name: string) => void,
+): Promise<{ name: string; offset: number; length: number; raw_length: number }[]> {
+  if (slices_unsupported || ranges.length < 2) {
+    return run_merged_fetch_pass(ranges, cached_files, opfs_queue, concurrency, tick);
+  }
+
+  // large entries go straight to split range requests
+  const fallback: MergedRange[] = ranges.filter((range) => range.range_length >= SPLIT_THRESHOLD);
+  const groups = group_ranges(ranges.filter((range) => range.range_length < SPLIT_THRESHOLD));
+  const url = `${get_bundle_url().replace(/\/$/, "")}/slices`;
+  let idx = 0;
+
+  async function worker(): Promise<void> {
+    while (true) {
+      const i = idx++;
+      if (i >= groups.length) break;
+      const group = groups[i];
+      if (slices_unsupported) {
+        fallback.push(...group);
+        continue;
+      }
+      const total = group.reduce((sum, range) => sum + range.range_length, 0);
+      const list = group.map((range) => `${range.range_start}:${range.range_length}`).join(",");
+
+      try {
+        const resp = await fetch(`${url}?r=${list}`, { signal: AbortSignal.timeout(request_timeout(total)) });
+        // a static host answers unknown paths with 404 or the app shell
+        const type = resp.headers.get("content-type") ?? "";
+        if (resp.status === 404 || (resp.ok && !type.startsWith("application/octet-stream"))) {
+          slices_unsupported = true;
+          dbg("batch", "no slices route on the bundle server, using range requests");
+        }
+        if (!resp.ok || slices_unsupported) throw new Error(`status ${resp.status}`);
+        const buf = new Uint8Array(await resp.arrayBuffer());
+        if (buf.byteLength !== total) throw new Error(`got ${buf.byteLength} of ${total} bytes`);
+        let base = 0;
+        for (const range of group) {
+          await store_range(range, buf, base, cached_files, opfs_queue, tick);
+          base += range.range_length;
+        }
+      } catch (err) {
+        const msg = err instanceof Error ? err.message : String(err);
+        dbg("fetch", `slices request failed (${group.length} ranges, ${total} bytes): ${msg}`);
+        fallback.push(...group);
+      }
+    }
+  }
+
+  const workers = Array.from({ length: Math.min(concurrency, groups.length) }, () => worker());
+  await Promise.all(workers);
+  dbg("batch", `${groups.length} slices requests for ${ranges.length} ranges, ${fallback.length} ranges left`);
+  if (fallback.length === 0) return [];
+  return run_merged_fetch_pass(fallback, cached_files, opfs_queue, concurrency, tick);
+}
+
 // fetch merged ranges with a concurrency pool, split response into individual files
 async function run_merged_fetch_pass(
   ranges: MergedRange[],
@@ -244,9 +484,9 @@ async function run_merged_fetch_pass(
   opfs_queue: { name: string; data: Uint8Array }[],
   concurrency: number,
   tick?: (name: string) => void,
-): Promise<{ name: string; offset: number; length: number }[]> {
+): Promise<{ name: string; offset: number; length: number; raw_length: number }[]> {
   let idx = 0;
-  const failures: { name: string; offset: number; length: number }[] = [];
+  const failures: { name: string; offset: number; length: number; raw_length: number }[] = [];
   const url = get_bundle_url();
 
   async function worker(): Promise<void> {
@@ -258,22 +498,18 @@ async function run_merged_fetch_pass(
       const timeout = request_timeout(range.range_length);
 
       try {
+        if (range.range_length >= SPLIT_THRESHOLD) {
+          const buf = await fetch_split(url, range.range_start, range.range_length);
+          await store_range(range, buf, 0, cached_files, opfs_queue, tick);
+          continue;
+        }
         const resp = await fetch(url, {
           headers: { Range: `bytes=${range.range_start}-${range_end}` },
           signal: AbortSignal.timeout(timeout),
         });
         if (!resp.ok && resp.status !== 206) throw new Error(`status ${resp.status}`);
         const buf = new Uint8Array(await resp.arrayBuffer());
-
-        // split merged response into individual files
-        for (let j = 0; j < range.names.length; j++) {
-          const name = range.names[j];
-          if (cached_files.has(name)) continue;
-          const data = buf.slice(range.offsets[j], range.offsets[j] + range.lengths[j]);
-          cached_files.set(name, data);
-          opfs_queue.push({ name, data });
-          if (tick) tick(name);
-        }
+        await store_range(range, buf, 0, cached_files, opfs_queue, tick);
       } catch (err) {
         const msg = err instanceof Error ? err.message : String(err);
         dbg("fetch", `merged range failed (${range.names.length} files, offset=${range.range_start}, len=${range.range_length}): ${msg}`);
@@ -284,6 +520,7 @@ async function run_merged_fetch_pass(
               name: range.names[j],
               offset: range.range_start + range.offsets[j],
               length: range.lengths[j],
+              raw_length: range.raw_lengths[j],
             });
           }
         }
@@ -304,14 +541,14 @@ async function run_merged_fetch_pass(
 // run a single fetch pass over individual entries with a concurrency pool
 // returns the list of entries that failed
 async function run_fetch_pass(
-  entries: { name: string; offset: bigint; length: number }[],
+  entries: PlanEntry[],
   cached_files: Map<string, Uint8Array>,
   opfs_queue: { name: string; data: Uint8Array }[],
   concurrency: number,
   tick?: (name: string) => void,
-): Promise<{ name: string; offset: bigint; length: number }[]> {
+): Promise<PlanEntry[]> {
   let idx = 0;
-  const failures: { name: string; offset: bigint; length: number }[] = [];
+  const failures: PlanEntry[] = [];
   const url = get_bundle_url();
 
   async function worker(): Promise<void> {
@@ -324,12 +561,18 @@ async function run_fetch_pass(
       const timeout = request_timeout(entry.length);
 
       try {
-        const resp = await fetch(url, {
-          headers: { Range: `bytes=${entry.offset}-${range_end}` },
-          signal: AbortSignal.timeout(timeout),
-        });
-        if (!resp.ok && resp.status !== 206) throw new Error(`status ${resp.status}`);
-        const data = new Uint8Array(await resp.arrayBuffer());
+        let raw: Uint8Array;
+        if (entry.length >= SPLIT_THRESHOLD) {
+          raw = await fetch_split(url, Number(entry.offset), entry.length);
+        } else {
+          const resp = await fetch(url, {
+            headers: { Range: `bytes=${entry.offset}-${range_end}` },
+            signal: AbortSignal.timeout(timeout),
+          });
+          if (!resp.ok && resp.status !== 206) throw new Error(`status ${resp.status}`);
+          raw = new Uint8Array(await resp.arrayBuffer());
+        }
+        const data = await inflate(raw, entry.raw_length);
         cached_files.set(entry.name, data);
         opfs_queue.push({ name: entry.name, data });
         if (tick) tick(entry.name);
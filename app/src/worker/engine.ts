@@ -23,16 +23,25 @@ import {
   send_status,
   send_progress,
   send_complete,
+  send_cancelled,
+  send_commands,
+  send_timings,
+  send_pdf,
   send_ready,
   send_cache_status,
   format_size,
   type Diagnostic,
+  type CommandIndex,
   type CompileMode,
-  type ProjectFiles,
+  type CompileStage,
+  type CompileTimings,
+  type FileContent,
 } from "./protocol.ts";
 import * as opfs from "./opfs.ts";
 import * as wasm_api from "./wasm_api.ts";
 import * as bundle from "./bundle_fetch.ts";
+import * as threads from "./threads.ts";
+import { FileCache } from "./file_cache.ts";
 
 const encoder = new TextEncoder();
 const decoder = new TextDecoder();
@@ -50,14 +59,246 @@ const INTERMEDIATE_SUFFIXES = [
   ".lot",
   ".vrb",
   ".synctex.gz",
+  ".synctex.idx",
 ];
 
 let wasm_module: WebAssembly.Module | null = null;
-let cached_files: Map<string, Uint8Array> | null = null;
+// bounded: packed files past the budget are dropped and re-read on demand
+let cached_files: FileCache | null = null;
 let cached_index_text: Uint8Array | null = null;
+// engine state right after undumping xelatex.fmt (the "format image", see
+// load_fmt_file in xetex-ini.c). the first compile on a format hands it over
+// via js_format_image_put; later instances get a copy back through
+// js_format_image_get and skip the undump. tied to the current xelatex.fmt.
+let format_snapshot: Uint8Array | null = null;
+
+// bundle file from memory, else from the OPFS pack; kept in memory once read
+// (until the cache evicts it) so the next compile places it in the WASI fs
+function cached_file(name: string): Uint8Array | undefined {
+  if (!cached_files) return undefined;
+  let data = cached_files.get(name);
+  if (!data) {
+    const t0 = performance.now();
+    data = opfs.read_packed(name) ?? undefined;
+    opfs_reads.ms += performance.now() - t0;
+    if (data) {
+      opfs_reads.count++;
+      opfs_reads.bytes += data.byteLength;
+      cached_files.set(name, data);
+    }
+  }
+  return data;
+}
+
+// bundle files read from the OPFS pack since the running compile started,
+// for its timings
+const opfs_reads = { count: 0, bytes: 0, ms: 0 };
+
+// compile cancellation: the main thread numbers its compiles and raises
+// cancel_bound[0] past a preview it has superseded. the engine asks before
+// every page (js_cancel_requested) and stops the run there. the bound is
+// shared with the main thread when it could create one; otherwise "cancel"
+// messages raise it, which arrive between compiles or while a JSPI run waits.
+let cancel_bound = new Int32Array(1);
+// the preview compile on the engine now, null for a full one (never stopped)
+let running_preview: number | null = null;
+
+export function set_cancel_buffer(buffer: SharedArrayBuffer): void {
+  cancel_bound = new Int32Array(buffer);
+}
+
+export function cancel_below(seq: number): void {
+  Atomics.max(cancel_bound, 0, seq);
+}
+
+function superseded(preview_seq: number | null): boolean {
+  return preview_seq !== null && preview_seq < Atomics.load(cancel_bound, 0);
+}
+
+// -- PDF worker pipelining --
+// with ?pipeline=1 the main thread starts a second worker that only runs
+// `eztex pdf`. preview compiles here then stop at the XDV (--xdv) and hand it
+// over a MessagePort, together with the bundle files their run opened that
+// the PDF worker has not been sent yet (mostly fonts), so this worker can
+// start the next preview's passes while the PDF worker writes the last PDF.
+// the PDF worker keeps what it fetches in memory only: OPFS access handles
+// are exclusive, and the bundle pack belongs to this worker.
+let pdf_port: MessagePort | null = null;
+const sent_to_pdf = new Set<string>();
+let persist_fetches = true;
+
+type PdfJob = {
+  seq: number;
+  xdv_name: string;
+  xdv: Uint8Array;
+  files: [string, Uint8Array][];
+  // the pages on screen, as "first-last": converted first, the rest after
+  pages?: string;
+};
+
+type PdfPortMsg =
+  | { type: "engine"; module: WebAssembly.Module; index: Uint8Array | null; limits: threads.MemoryLimits | null }
+  | ({ type: "xdv" } & PdfJob);
+
+export function set_pdf_port(port: MessagePort): void {
+  pdf_port = port;
+  sent_to_pdf.clear();
+  share_engine();
+}
+
+// the compiled module and index, so the PDF worker neither downloads nor
+// compiles the engine again; sent once both are here and the port is
+function share_engine(): void {
+  if (!pdf_port || !wasm_module) return;
+  pdf_port.postMessage({
+    type: "engine",
+    module: wasm_module,
+    index: cached_index_text?.slice() ?? null,
+    limits: threads.memory_limits(),
+  } satisfies PdfPortMsg);
+}
+
+function send_xdv(seq: number, xdv_name: string, xdv: Uint8Array, opened: Set<string>, pages?: string): void {
+  const files: [string, Uint8Array][] = [];
+  for (const name of opened) {
+    if (sent_to_pdf.has(name)) continue;
+    const data = cached_file(name);
+    if (!data) continue;
+    files.push([name, data]);
+    sent_to_pdf.add(name);
+  }
+  dbg("pipeline", `preview ${seq}: ${xdv_name} (${format_size(xdv.byteLength)}) and ${files.length} bundle file(s) to the PDF worker`);
+  pdf_port!.postMessage({ type: "xdv", seq, xdv_name, xdv, files, pages } satisfies PdfPortMsg, [xdv.buffer as ArrayBuffer]);
+}
+
+// the PDF worker side: only the newest XDV waiting is written, an older one
+// still queued behind a running job is dropped
+let pdf_waiting: PdfJob | null = null;
+let pdf_running = false;
+
+export function init_pdf(port: MessagePort): void {
+  persist_fetches = false;
+  port.onmessage = (e: MessageEvent<PdfPortMsg>) => {
+    const msg = e.data;
+    if (msg.type === "engine") {
+      wasm_module = msg.module;
+      // the threaded build: this worker writes the PDFs, so it deflates on threads
+      if (msg.limits) threads.start(msg.module, msg.limits);
+      cached_files = new FileCache();
+      create_api_instance();
+      load_index(msg.index);
+      dbg("pipeline", "PDF worker ready");
+    } else if (msg.type === "xdv") {
+      for (const [name, data] of msg.files) cached_files?.set(name, data);
+      if (pdf_waiting) dbg("pipeline", `preview ${pdf_waiting.seq} superseded before its PDF was written`);
+      pdf_waiting = msg;
+      void drain_pdf_jobs();
+    }
+  };
+}
+
+async function drain_pdf_jobs(): Promise<void> {
+  if (pdf_running) return;
+  pdf_running = true;
+  try {
+    while (pdf_waiting) {
+      const job = pdf_waiting;
+      pdf_waiting = null;
+      await write_pdf(job);
+    }
+  } finally {
+    pdf_running = false;
+  }
+}
+
+// with pages, those go out first in a PDF with the other pages blank, and the
+// whole PDF follows unless a newer XDV is waiting by then
+async function write_pdf(job: PdfJob): Promise<void> {
+  if (job.pages) {
+    await write_pdf_pages(job, job.pages);
+    if (pdf_waiting) return;
+  }
+  await write_pdf_pages(job, null);
+}
+
+async function write_pdf_pages(job: PdfJob, pages: string | null): Promise<void> {
+  if (!wasm_module || !cached_files) return;
+  const t0 = performance.now();
+  const files = new Map(tree.files);
+  files.set(job.xdv_name, job.xdv);
+  const pdf_name = job.xdv_name.replace(/\.xdv$/, ".pdf");
+  try {
+    const { exit_code, root_map } = await run_resident(
+      ["eztex", "pdf", "--preview", "--page-digests", ...(pages ? ["--pages", pages] : []), job.xdv_name],
+      files,
+      null,
+    );
+    const pdf_inode = exit_code === 0 ? root_map.get(pdf_name) as WasiFile | undefined : undefined;
+    if (!pdf_inode?.data) {
+      log("pipeline", "error", `no PDF written for preview ${job.seq} (exit code ${exit_code})`);
+      return;
+    }
+    const pages = read_page_digests(root_map.get(job.xdv_name.replace(/\.xdv$/, ".pages.json")) as WasiFile | undefined);
+    const pdf = pdf_inode.data === tree.files.get(pdf_name) ? pdf_inode.data.slice() : pdf_inode.data;
+    dbg("pipeline", `preview ${job.seq}: ${pdf_name}${pages ? ` (pages ${pages})` : ""} (${format_size(pdf.byteLength)}) in ${(performance.now() - t0).toFixed(0)}ms`);
+    send_pdf(pdf, pages);
+  } catch (e) {
+    log("pipeline", "error", (e as Error).message);
+  }
+}
+
+function set_format(data: Uint8Array): void {
+  cached_files!.set("xelatex.fmt", data);
+  format_snapshot = null;
+}
 
 // -- WASI filesystem builder --
 
+// project files as bytes, kept across compiles and updated per file by the
+// main thread (see worker_client.sync_files). the shared engine keeps a tree
+// per tab and compiles from the one of the tab asking (see shared_worker.ts)
+export type ProjectTree = {
+  files: Map<string, Uint8Array>;
+  versions: Map<string, number>;
+  changes: number;
+  // the command index last sent for this tree and its project, so an
+  // unchanged index is neither sent nor saved again
+  sent_commands: string | null;
+  sent_commands_project: string | null;
+};
+
+export function create_project_tree(): ProjectTree {
+  return { files: new Map(), versions: new Map(), changes: 0, sent_commands: null, sent_commands_project: null };
+}
+
+let tree = create_project_tree();
+
+export function use_project_tree(next: ProjectTree): void {
+  tree = next;
+}
+
+export function file_changed(path: string, version: number, content: FileContent, into: ProjectTree = tree): void {
+  if (into.versions.get(path) === version) return;
+  into.files.set(path, typeof content === "string" ? encoder.encode(content) : content);
+  into.versions.set(path, version);
+  into.changes++;
+}
+
+export function file_deleted(path: string, from: ProjectTree = tree): void {
+  from.files.delete(path);
+  from.versions.delete(path);
+  from.changes++;
+}
+
+// a WASI file over `data` without the copy the File constructor makes. the
+// engine opens its outputs with truncation, which replaces the array rather
+// than writing into it, so shared inputs stay intact.
+function share_file(data: Uint8Array): WasiFile {
+  const file = new WasiFile(new Uint8Array(0));
+  file.data = data;
+  return file;
+}
+
 function stable_hash(text: string): string {
   let hash = 0x811c9dc5;
   for (let i = 0; i < text.length; i++) {
@@ -90,8 +331,8 @@ function common_dir_prefix(paths: string[]): string {
   return prefix.join("/");
 }
 
-function derive_project_id(user_files: ProjectFiles, main_file: string): string {
-  const names = Object.keys(user_files).filter(Boolean).sort();
+function derive_project_id(paths: Iterable<string>, main_file: string): string {
+  const names = [...paths].filter(Boolean).sort();
   const root = common_dir_prefix(names);
   return stable_hash(`${root}\n${main_file}\n${names.join("\n")}`);
 }
@@ -124,7 +365,7 @@ function collect_intermediate_files(
 }
 
 function build_wasi_fs(
-  user_files: ProjectFiles | null,
+  user_files: Map<string, Uint8Array> | null,
   restored_files: Map<string, Uint8Array> | null = null,
 ): {
   root_map: Map<string, WasiFile | Directory>;
@@ -156,7 +397,7 @@ function build_wasi_fs(
       if (existing instanceof Directory) {
         dbg("wasi_fs", `collision: '${file_path}' exists as directory, replacing with file`);
       }
-      root.set(file_path, new WasiFile(data));
+      root.set(file_path, share_file(data));
       return;
     }
     let current = root;
@@ -168,7 +409,7 @@ function build_wasi_fs(
     if (existing instanceof Directory) {
       dbg("wasi_fs", `collision: '${file_path}' exists as directory, replacing with file`);
     }
-    current.set(leaf, new WasiFile(data));
+    current.set(leaf, share_file(data));
   }
 
   // collect format files to place in tmp/ after tmp_map is created
@@ -178,11 +419,11 @@ function build_wasi_fs(
   if (cached_files) {
     for (const [name, data] of cached_files) {
       if (name.startsWith("fonts/")) {
-        fonts_map.set(name.slice(6), new WasiFile(new Uint8Array(data)));
+        fonts_map.set(name.slice(6), share_file(data));
       } else if (name === "xelatex.fmt") {
-        format_files.push([name, new Uint8Array(data)]);
+        format_files.push([name, data]);
       } else {
-        place_file(root_map, name, new Uint8Array(data));
+        place_file(root_map, name, data);
       }
       cached_count++;
     }
@@ -198,15 +439,14 @@ function build_wasi_fs(
 
   let restored_count = 0;
   for (const [name, data] of restored_files || []) {
-    place_file(root_map, name, new Uint8Array(data));
+    place_file(root_map, name, data);
     restored_count++;
   }
 
-  // write user files into WASI filesystem (null for format generation)
-  const user_count = Object.keys(user_files || {}).length;
-  for (const [name, content] of Object.entries(user_files || {})) {
-    const bytes = typeof content === "string" ? encoder.encode(content) : new Uint8Array(content);
-    place_file(root_map, name, bytes);
+  // place user files into WASI filesystem (null for format generation)
+  const user_count = user_files?.size ?? 0;
+  for (const [name, data] of user_files || []) {
+    place_file(root_map, name, data);
   }
 
   dbg(
@@ -216,20 +456,42 @@ function build_wasi_fs(
   return { root_map, tmp_map };
 }
 
-// -- sync fetch-on-open: eztex_fetch_range import for WASM --
+// -- fetch-on-open: js_request_range import for WASM --
 // when Zig resolves a file via its index and calls this import, we:
 // 1. check memory cache (cached_files)
-// 2. do a synchronous XHR Range request if not cached
+// 2. fetch the range if not cached: a synchronous XHR, or with JSPI an async
+//    fetch() while the wasm stack is suspended
 // 3. cache the result in memory + OPFS
 // 4. write bytes into WASM memory and return
+//
+// gzip-compressed entries (raw_length != 0) are inflated before caching. the
+// sync path cannot inflate, so it hands Zig the compressed bytes and Zig
+// returns the inflated file through js_cache_put.
+//
+// with JSPI, js_prefetch_ranges also fetches whole seed batches concurrently;
+// without it the batch is declined and every miss costs one blocking request.
+
+// JS Promise Integration: imports may suspend the wasm stack on a promise
+const jspi_supported =
+  typeof (WebAssembly as any).Suspending === "function" && typeof (WebAssembly as any).promising === "function";
+
+// opened: every bundle file the engine asked JS for, cached or not
+interface FetchStats {
+  fetches: number;
+  cache_hits: number;
+  fetch_bytes: number;
+  // time spent waiting on the network
+  fetch_ms: number;
+  opened: Set<string>;
+}
 
-function make_fetch_env(): {
+function make_fetch_env(async_fetch: boolean = false): {
   env: Record<string, WebAssembly.ImportValue>;
   set_instance: (inst: WebAssembly.Instance) => void;
-  stats: { fetches: number; cache_hits: number; fetch_bytes: number };
+  stats: FetchStats;
 } {
   let wasm_instance: WebAssembly.Instance | null = null;
-  const stats = { fetches: 0, cache_hits: 0, fetch_bytes: 0 };
+  const stats: FetchStats = { fetches: 0, cache_hits: 0, fetch_bytes: 0, fetch_ms: 0, opened: new Set() };
   // cache bundle URL once at env creation time so the sync XHR hot path
   // never calls back into the api_instance (which may be a different wasm instance)
   const resolved_bundle_url = wasm_api.bundle_url();
@@ -240,97 +502,207 @@ function make_fetch_env(): {
     eztex_free(ptr: number, size: number): void;
   }
 
-  const env = {
-    // posix dup() stub -- Zig's std.posix.dup compiles to an env import on wasm32-wasi.
-    // bridge.zig calls dup() for gzdopen fd duplication. stub returns -1 (failure is handled).
-    dup(): number { return -1; },
-    js_request_range(
-      name_ptr: number,
-      name_len: number,
-      offset_lo: number,
-      offset_hi: number,
-      length: number,
-      buf_ptr_ptr: number,
-      buf_len_ptr: number,
-    ): number {
-      const exports = wasm_instance!.exports as unknown as WasmExports;
-      const mem = new Uint8Array(exports.memory.buffer);
-      const name = decoder.decode(mem.subarray(name_ptr, name_ptr + name_len));
-      // WASM i32 ABI: u32 values >= 2^31 arrive as negative JS numbers; >>> 0 restores unsigned interpretation
-      const offset = (offset_lo >>> 0) + (offset_hi >>> 0) * 0x100000000;
-      dbg("fetch_range", `called: ${name} offset=${offset} len=${length}`);
-
-      // 1. check memory cache
-      let data = cached_files?.get(name);
-      if (!data) {
-        // also check without fonts/ prefix (index stores bare names)
-        if (name.startsWith("fonts/")) {
-          data = cached_files?.get(name.slice(6));
+  function lookup_cached(name: string): Uint8Array | undefined {
+    const data = cached_file(name);
+    // also check without fonts/ prefix (index stores bare names)
+    if (!data && name.startsWith("fonts/")) return cached_file(name.slice(6));
+    return data;
+  }
+
+  function fetch_range_sync(offset: number, length: number): Uint8Array {
+    const range_end = offset + length - 1;
+    let last_err = "";
+    for (let attempt = 0; attempt < 2; attempt++) {
+      try {
+        const xhr = new XMLHttpRequest();
+        xhr.open("GET", resolved_bundle_url, false); // synchronous
+        xhr.responseType = "arraybuffer";
+        xhr.setRequestHeader("Range", `bytes=${offset}-${range_end}`);
+        xhr.send();
+
+        if (xhr.status !== 200 && xhr.status !== 206) {
+          last_err = `HTTP ${xhr.status}`;
+          continue;
         }
+        return new Uint8Array(xhr.response as ArrayBuffer);
+      } catch (err) {
+        last_err = (err as Error).message;
       }
+    }
+    throw new Error(last_err);
+  }
 
-      if (data) {
-        stats.cache_hits++;
-      } else {
-        // 2. synchronous XHR Range fetch (1 retry on failure)
-        const range_end = offset + (length >>> 0) - 1;
-        let last_err: string | null = null;
-        for (let attempt = 0; attempt < 2; attempt++) {
-          try {
-            const xhr = new XMLHttpRequest();
-            xhr.open("GET", resolved_bundle_url, false); // synchronous
-            xhr.responseType = "arraybuffer";
-            xhr.setRequestHeader("Range", `bytes=${offset}-${range_end}`);
-            xhr.send();
-
-            if (xhr.status !== 200 && xhr.status !== 206) {
-              last_err = `HTTP ${xhr.status}`;
-              continue;
-            }
-
-            data = new Uint8Array(xhr.response as ArrayBuffer);
-            last_err = null;
-            break;
-          } catch (err) {
-            last_err = (err as Error).message;
-          }
-        }
-        if (last_err || !data) {
-          const offline = typeof navigator !== "undefined" && !navigator.onLine;
-          const hint = offline
-            ? ` -- you appear to be offline and this package was not previously cached`
-            : "";
-          log("fetch", "error", `failed to fetch '${name}'${hint} (${last_err})`);
-          return -1;
-        }
+  function store_fetched(name: string, data: Uint8Array): void {
+    stats.fetches++;
+    stats.fetch_bytes += data.byteLength;
+    cached_files?.set(name, data);
+    // fire-and-forget, the data is already in memory
+    if (persist_fetches) opfs.cache_file(name, data);
+    dbg("fetch", `fetched ${name} (${format_size(data.byteLength)})`);
+  }
 
-        stats.fetches++;
-        stats.fetch_bytes += data.byteLength;
+  function report_failure(name: string, err: unknown): void {
+    const offline = typeof navigator !== "undefined" && !navigator.onLine;
+    const hint = offline
+      ? ` -- you appear to be offline and this package was not previously cached`
+      : "";
+    log("fetch", "error", `failed to fetch '${name}'${hint} (${(err as Error).message})`);
+  }
 
-        // 3. cache in memory
-        if (cached_files) {
-          cached_files.set(name, data);
-        }
+  // write data into WASM memory and hand out the buffer
+  function deliver(data: Uint8Array, buf_ptr_ptr: number, buf_len_ptr: number): number {
+    const exports = wasm_instance!.exports as unknown as WasmExports;
+    const wasm_ptr = exports.eztex_alloc(data.byteLength);
+    if (!wasm_ptr) return -1;
 
-        // 4. cache in OPFS (fire-and-forget, async is fine here since data is already in memory)
-        opfs.cache_file(name, data);
+    const wasm_mem = new Uint8Array(exports.memory.buffer);
+    wasm_mem.set(data, wasm_ptr);
 
-        dbg("fetch", `fetched ${name} (${format_size(data.byteLength)})`);
+    const view = new DataView(exports.memory.buffer);
+    view.setUint32(buf_ptr_ptr, wasm_ptr, true);
+    view.setUint32(buf_len_ptr, data.byteLength, true);
+    return 0;
+  }
+
+  function decode_request(name_ptr: number, name_len: number, offset_lo: number, offset_hi: number) {
+    const exports = wasm_instance!.exports as unknown as WasmExports;
+    const mem = new Uint8Array(exports.memory.buffer);
+    const name = decoder.decode(mem.slice(name_ptr, name_ptr + name_len));
+    // WASM i32 ABI: u32 values >= 2^31 arrive as negative JS numbers; >>> 0 restores unsigned interpretation
+    const offset = (offset_lo >>> 0) + (offset_hi >>> 0) * 0x100000000;
+    return { name, offset };
+  }
+
+  function request_range_sync(
+    name_ptr: number,
+    name_len: number,
+    offset_lo: number,
+    offset_hi: number,
+    length: number,
+    raw_length: number,
+    buf_ptr_ptr: number,
+    buf_len_ptr: number,
+  ): number {
+    const { name, offset } = decode_request(name_ptr, name_len, offset_lo, offset_hi);
+    dbg("fetch_range", `called: ${name} offset=${offset} len=${length}`);
+    stats.opened.add(name);
+
+    let data = lookup_cached(name);
+    if (data) {
+      stats.cache_hits++;
+    } else {
+      const t0 = performance.now();
+      try {
+        data = fetch_range_sync(offset, length >>> 0);
+      } catch (err) {
+        report_failure(name, err);
+        return -1;
+      } finally {
+        stats.fetch_ms += performance.now() - t0;
+      }
+      if (raw_length === 0) {
+        store_fetched(name, data);
+      } else {
+        stats.fetches++;
+        stats.fetch_bytes += data.byteLength;
       }
+    }
+    return deliver(data, buf_ptr_ptr, buf_len_ptr);
+  }
 
-      // write data into WASM memory
-      const wasm_ptr = exports.eztex_alloc(data.byteLength);
-      if (!wasm_ptr) return -1;
+  async function request_range_async(
+    name_ptr: number,
+    name_len: number,
+    offset_lo: number,
+    offset_hi: number,
+    length: number,
+    raw_length: number,
+    buf_ptr_ptr: number,
+    buf_len_ptr: number,
+  ): Promise<number> {
+    const { name, offset } = decode_request(name_ptr, name_len, offset_lo, offset_hi);
+    dbg("fetch_range", `called (async): ${name} offset=${offset} len=${length}`);
+    stats.opened.add(name);
+
+    let data = lookup_cached(name);
+    if (data) {
+      stats.cache_hits++;
+    } else {
+      const t0 = performance.now();
+      try {
+        data = await bundle.inflate(await bundle.fetch_range(offset, length >>> 0), raw_length >>> 0);
+      } catch (err) {
+        report_failure(name, err);
+        return -1;
+      } finally {
+        stats.fetch_ms += performance.now() - t0;
+      }
+      store_fetched(name, data);
+    }
+    return deliver(data, buf_ptr_ptr, buf_len_ptr);
+  }
 
-      const wasm_mem = new Uint8Array(exports.memory.buffer);
-      wasm_mem.set(data, wasm_ptr);
+  // one "name\toffset\tlength\n" record per file; returns how many are cached after
+  async function prefetch_ranges(list_ptr: number, list_len: number, concurrency: number): Promise<number> {
+    const exports = wasm_instance!.exports as unknown as WasmExports;
+    const list = decoder.decode(new Uint8Array(exports.memory.buffer, list_ptr, list_len).slice());
+    const names = list.split("\n").filter((line) => line.length > 0).map((line) => line.split("\t")[0]);
+    if (!cached_files) return 0;
+    for (const name of names) stats.opened.add(name);
+    const missing = names.filter((name) => !cached_file(name));
+    const t0 = performance.now();
+    await bundle.batch_fetch(missing, cached_files, concurrency);
+    if (missing.length > 0) stats.fetch_ms += performance.now() - t0;
+    const fetched = missing.filter((name) => cached_files!.has(name));
+    stats.fetches += fetched.length;
+    for (const name of fetched) stats.fetch_bytes += cached_files.get(name)?.byteLength ?? 0;
+    dbg("prefetch", `${fetched.length}/${missing.length} fetched (${names.length - missing.length} already cached)`);
+    return names.length - missing.length + fetched.length;
+  }
 
+  const Suspending = (WebAssembly as any).Suspending;
+  const env = {
+    // posix dup() stub -- Zig's std.posix.dup compiles to an env import on wasm32-wasi.
+    // bridge.zig calls dup() for gzdopen fd duplication. stub returns -1 (failure is handled).
+    dup(): number { return -1; },
+    js_request_range: async_fetch ? new Suspending(request_range_async) : request_range_sync,
+    js_prefetch_ranges: async_fetch ? new Suspending(prefetch_ranges) : () => -1,
+    // an entry Zig inflated itself after request_range_sync handed it the
+    // compressed bytes; keep the inflated file like any other fetch
+    js_cache_put(name_ptr: number, name_len: number, data_ptr: number, data_len: number): void {
+      if (!wasm_instance) return;
+      const exports = wasm_instance.exports as unknown as WasmExports;
+      const mem = new Uint8Array(exports.memory.buffer);
+      const name = decoder.decode(mem.slice(name_ptr, name_ptr + name_len));
+      if (lookup_cached(name)) return;
+      const data = mem.slice(data_ptr, data_ptr + data_len);
+      cached_files?.set(name, data);
+      if (persist_fetches) opfs.cache_file(name, data);
+      dbg("fetch", `inflated ${name} (${format_size(data.byteLength)})`);
+    },
+    // hand a copy of the format image snapshot to Zig (it is used in place
+    // and freed by Zig, so every instance gets its own)
+    js_format_image_get(buf_ptr_ptr: number, buf_len_ptr: number): number {
+      if (!format_snapshot || !wasm_instance) return -1;
+      const exports = wasm_instance.exports as unknown as WasmExports;
+      const wasm_ptr = exports.eztex_alloc(format_snapshot.byteLength);
+      if (!wasm_ptr) return -1;
+      new Uint8Array(exports.memory.buffer).set(format_snapshot, wasm_ptr);
       const view = new DataView(exports.memory.buffer);
       view.setUint32(buf_ptr_ptr, wasm_ptr, true);
-      view.setUint32(buf_len_ptr, data.byteLength, true);
-
+      view.setUint32(buf_len_ptr, format_snapshot.byteLength, true);
+      dbg("format_image", `restored snapshot (${format_size(format_snapshot.byteLength)})`);
       return 0;
     },
+    js_cancel_requested(): number {
+      return superseded(running_preview) ? 1 : 0;
+    },
+    js_format_image_put(data_ptr: number, data_len: number): void {
+      if (!wasm_instance) return;
+      const exports = wasm_instance.exports as unknown as WasmExports;
+      format_snapshot = new Uint8Array(exports.memory.buffer, data_ptr, data_len).slice();
+      dbg("format_image", `saved snapshot (${format_size(data_len)})`);
+    },
     // provide decompressed ITAR index text to Zig.
     // cached_index_text is set during init from the async fetch.
     js_request_index(buf_ptr_ptr: number, buf_len_ptr: number): number {
@@ -425,23 +797,92 @@ function make_diag_stderr_handler(): {
   return { handler, flush: flush_pending };
 }
 
+// -- diagnostic records --
+// builds with eztex_query_diagnostics keep the last pass's warnings and errors
+// as binary records (src/DiagRecords.zig), read once after the run instead of
+// pieced together from stderr. stderr then only feeds the log panel.
+
+function log_stderr_line(line: string): void {
+  if (line.startsWith("error: ")) send_log(line, "log-error");
+  else if (line.startsWith("warning: ")) send_log(line, "log-warn");
+  else if (line.startsWith("  ")) send_log(line, "log-info");
+  else if (line.includes("error") || line.includes("Error")) send_log(line, "log-error");
+  else if (line.includes("warning") || line.includes("Warning")) send_log(line, "log-warn");
+  else send_log(line, "log-info");
+}
+
+const diag_record_header = 13;
+
+function decode_diagnostics(bytes: Uint8Array): Diagnostic[] {
+  const view = new DataView(bytes.buffer, bytes.byteOffset, bytes.byteLength);
+  const out: Diagnostic[] = [];
+  let pos = 0;
+  while (pos + diag_record_header <= bytes.byteLength) {
+    const severity = bytes[pos] === 0 ? "error" : "warning";
+    const line = view.getUint32(pos + 1, true);
+    const file_len = view.getUint16(pos + 5, true);
+    const message_len = view.getUint16(pos + 7, true);
+    const context_len = view.getUint32(pos + 9, true);
+    pos += diag_record_header;
+    if (pos + file_len + message_len + context_len > bytes.byteLength) break;
+    const diag: Diagnostic = {
+      severity,
+      message: decoder.decode(bytes.subarray(pos + file_len, pos + file_len + message_len)),
+    };
+    if (file_len > 0) diag.file = decoder.decode(bytes.subarray(pos, pos + file_len));
+    if (line > 0) diag.line = line;
+    if (context_len > 0) {
+      const start = pos + file_len + message_len;
+      diag.context = decoder.decode(bytes.subarray(start, start + context_len));
+    }
+    pos += file_len + message_len + context_len;
+    out.push(diag);
+  }
+  return out;
+}
+
+function read_diagnostics(exports: Record<string, Function> & { memory: WebAssembly.Memory }): Diagnostic[] {
+  let cap = 64 * 1024;
+  for (;;) {
+    const ptr = exports.eztex_alloc(cap) as number;
+    if (!ptr) return [];
+    const n = exports.eztex_query_diagnostics(ptr, cap) as number;
+    if (n > cap) {
+      exports.eztex_free(ptr, cap);
+      cap = n;
+      continue;
+    }
+    const bytes = new Uint8Array(exports.memory.buffer, ptr, n).slice();
+    exports.eztex_free(ptr, cap);
+    return decode_diagnostics(bytes);
+  }
+}
+
 // -- run wasm: shared compile/format-gen runner --
 
 interface RunResult {
   exit_code: number;
   root_map: Map<string, WasiFile | Directory>;
   tmp_map: Map<string, WasiFile | Directory>;
-  fetch_stats: { fetches: number; cache_hits: number; fetch_bytes: number };
+  fetch_stats: FetchStats;
+}
+
+// WASI and env imports, plus the threaded build's own shared memory and
+// thread-spawn (threads.ts). spawn=false runs its compression inline.
+function engine_imports(wasi: WASI, env: Record<string, WebAssembly.ImportValue>, spawn: boolean = true): WebAssembly.Imports {
+  const threaded = threads.instance_imports(spawn);
+  if (!threaded) return { wasi_snapshot_preview1: wasi.wasiImport, env };
+  return { wasi_snapshot_preview1: wasi.wasiImport, env: { ...env, memory: threaded.memory }, wasi: threaded.wasi };
 }
 
 function run_wasm(
   wasi_args: string[],
-  user_files: ProjectFiles | null,
+  user_files: Map<string, Uint8Array> | null,
   classify_stderr: boolean = false,
   restored_files: Map<string, Uint8Array> | null = null,
 ): RunResult {
   const label = wasi_args[1] ?? "wasm";
-  dbg("run", `run_wasm: args=[${wasi_args.join(",")}], files=${user_files ? Object.keys(user_files).length : 0}`);
+  dbg("run", `run_wasm: args=[${wasi_args.join(",")}], files=${user_files?.size ?? 0}`);
   const { root_map, tmp_map } = build_wasi_fs(user_files, restored_files);
   const { env, set_instance, stats } = make_fetch_env();
 
@@ -459,10 +900,7 @@ function run_wasm(
 
   const wasi = new WASI(wasi_args, [], fds);
   dbg("run", `instantiating WebAssembly.Instance for ${label}...`);
-  const instance = new WebAssembly.Instance(wasm_module!, {
-    wasi_snapshot_preview1: wasi.wasiImport,
-    env,
-  });
+  const instance = new WebAssembly.Instance(wasm_module!, engine_imports(wasi, env));
   set_instance(instance);
   if (DEBUG) {
     const exp = instance.exports as Record<string, Function>;
@@ -497,6 +935,185 @@ function run_wasm(
   return { exit_code, root_map, tmp_map, fetch_stats: stats };
 }
 
+// -- resident compile instance --
+// compiles reuse one instance through the eztex_run export, so the bundle
+// index, font caches and loaded fonts stay warm between runs. the preopened
+// root map is refilled before each run; stderr goes to the current handler.
+// any trap or proc_exit drops the instance and the next compile starts fresh.
+// with JSPI the bundle imports suspend instead of blocking (see make_fetch_env),
+// so eztex_run is called through WebAssembly.promising.
+
+interface ResidentEngine {
+  instance: WebAssembly.Instance;
+  run: (args_ptr: number, args_len: number) => number | Promise<number>;
+  root_map: Map<string, WasiFile | Directory>;
+  fetch: ReturnType<typeof make_fetch_env>;
+  stderr: { handler: (line: string) => void };
+}
+
+let resident: ResidentEngine | null = null;
+// a suspended run yields to the event loop; later compiles wait their turn
+let resident_queue: Promise<void> = Promise.resolve();
+
+// the largest memory a resident instance reached, this session or (from
+// OPFS) the last one. a new instance reserves that much heap up front
+// (eztex_reserve_heap). a long-lived instance needs nothing more: its heap
+// never shrinks, and malloc reuses what the last compile freed.
+const MEMORY_FILE = "_engine_memory.json";
+let memory_high_water = 0;
+
+async function load_memory_high_water(): Promise<void> {
+  if (!opfs.supported) return;
+  try {
+    const raw = await opfs.read(await opfs.get_dir(), MEMORY_FILE);
+    const saved = raw ? (JSON.parse(decoder.decode(raw)) as { bytes?: unknown }).bytes : undefined;
+    if (typeof saved === "number") memory_high_water = Math.max(memory_high_water, saved);
+  } catch {
+    // non-critical
+  }
+}
+
+function note_memory_high_water(memory: WebAssembly.Memory): void {
+  const bytes = memory.buffer.byteLength;
+  if (bytes <= memory_high_water) return;
+  memory_high_water = bytes;
+  // the PDF worker's instances only write PDFs; this worker's set the size
+  if (!opfs.supported || !persist_fetches) return;
+  void opfs.get_dir()
+    .then((dir) => opfs.write(dir, MEMORY_FILE, encoder.encode(JSON.stringify({ bytes }))))
+    .catch(() => {});
+}
+
+function get_resident(): ResidentEngine | null {
+  if (resident) return resident;
+  const root_map = new Map<string, WasiFile | Directory>();
+  const fetch = make_fetch_env(jspi_supported);
+  const stderr = { handler: (line: string) => send_log(line, "log-info") };
+  const fds = [
+    new OpenFile(new WasiFile(new Uint8Array())),
+    ConsoleStdout.lineBuffered((line: string) => send_log(line)),
+    ConsoleStdout.lineBuffered((line: string) => stderr.handler(line)),
+    new PreopenDirectory(".", root_map),
+  ];
+  const wasi = new WASI(["eztex"], [], fds);
+  const instance = new WebAssembly.Instance(wasm_module!, engine_imports(wasi, fetch.env));
+  if (!instance.exports.eztex_run) return null;
+  wasi.initialize(instance);
+  fetch.set_instance(instance);
+  const memory = instance.exports.memory as WebAssembly.Memory;
+  const reserve = memory_high_water - memory.buffer.byteLength;
+  if (reserve > 0 && instance.exports.eztex_reserve_heap) {
+    (instance.exports.eztex_reserve_heap as Function)(reserve);
+    dbg("run", `reserved ${format_size(reserve)} of heap (memory now ${format_size(memory.buffer.byteLength)})`);
+  }
+  if (DEBUG) (instance.exports.eztex_set_debug as Function)(1);
+  if (DEBUG && instance.exports.eztex_track_memory) (instance.exports.eztex_track_memory as Function)(1);
+  const run = jspi_supported
+    ? (WebAssembly as any).promising(instance.exports.eztex_run)
+    : (instance.exports.eztex_run as (args_ptr: number, args_len: number) => number);
+  dbg("run", `resident compile instance created (${jspi_supported ? "async fetch via JSPI" : "sync XHR fetch"})`);
+  resident = { instance, run, root_map, fetch, stderr };
+  return resident;
+}
+
+// same contract as run_wasm, for compile commands on the resident instance.
+// falls back to run_wasm when the module has no eztex_run export.
+// preview_seq: the preview compile this run serves, stopped once superseded
+async function run_resident(
+  wasi_args: string[],
+  user_files: Map<string, Uint8Array>,
+  restored_files: Map<string, Uint8Array> | null,
+  preview_seq: number | null = null,
+): Promise<RunResult> {
+  const previous = resident_queue;
+  let release!: () => void;
+  resident_queue = new Promise((resolve) => (release = resolve));
+  await previous;
+  running_preview = preview_seq;
+  try {
+    return await run_resident_now(wasi_args, user_files, restored_files);
+  } finally {
+    running_preview = null;
+    release();
+  }
+}
+
+async function run_resident_now(
+  wasi_args: string[],
+  user_files: Map<string, Uint8Array>,
+  restored_files: Map<string, Uint8Array> | null,
+): Promise<RunResult> {
+  const engine = get_resident();
+  if (!engine) return run_wasm(wasi_args, user_files, true, restored_files);
+
+  const { root_map, tmp_map } = build_wasi_fs(user_files, restored_files);
+  engine.root_map.clear();
+  for (const [name, inode] of root_map) engine.root_map.set(name, inode);
+  const stats = engine.fetch.stats;
+  stats.fetches = 0;
+  stats.cache_hits = 0;
+  stats.fetch_bytes = 0;
+  stats.fetch_ms = 0;
+  stats.opened = new Set();
+
+  const exports = engine.instance.exports as Record<string, Function> & { memory: WebAssembly.Memory };
+  const diag_parser = exports.eztex_query_diagnostics ? null : make_diag_stderr_handler();
+  engine.stderr.handler = diag_parser ? diag_parser.handler : log_stderr_line;
+
+  const args = encoder.encode(wasi_args.slice(1).join("\0"));
+  const args_ptr = exports.eztex_alloc(args.byteLength) as number;
+  if (!args_ptr) throw new Error("eztex_alloc failed for compile arguments");
+  new Uint8Array(exports.memory.buffer, args_ptr, args.byteLength).set(args);
+
+  let exit_code: number;
+  try {
+    dbg("run", `eztex_run(${wasi_args.slice(1).join(",")})`);
+    exit_code = await engine.run(args_ptr, args.byteLength);
+    exports.eztex_free(args_ptr, args.byteLength);
+  } catch (e) {
+    resident = null;
+    if (e instanceof WebAssembly.RuntimeError) {
+      log("wasm", "error", `runtime error: ${e.message}`);
+      dbg("run", `RuntimeError stack: ${e.stack}`);
+      exit_code = 1;
+    } else {
+      const err = e as { exit_code?: number; message?: string; constructor?: { name?: string } };
+      if (err.exit_code !== undefined) {
+        exit_code = err.exit_code;
+      } else {
+        log("wasm", "error", `exception: ${err.constructor?.name}: ${err.message}`);
+        exit_code = 1;
+      }
+    }
+  }
+
+  diag_parser?.flush();
+  note_memory_high_water(exports.memory);
+  if (!diag_parser && resident) for (const diag of read_diagnostics(exports)) send_diagnostic(diag);
+  if (DEBUG && resident) log_memory_stats(exports);
+  return { exit_code, root_map: engine.root_map, tmp_map, fetch_stats: { ...stats } };
+}
+
+type MemoryCounter = { current: number; peak: number };
+
+// debug mode: where the last compile's heap went (eztex_query_memory_stats),
+// so an out-of-memory on a large document can be traced to a subsystem
+function log_memory_stats(exports: Record<string, Function> & { memory: WebAssembly.Memory }): void {
+  if (!exports.eztex_query_memory_stats) return;
+  const out_cap = 1024;
+  const out_ptr = exports.eztex_alloc(out_cap) as number;
+  if (!out_ptr) return;
+  const n = exports.eztex_query_memory_stats(out_ptr, out_cap) as number;
+  const text = decoder.decode(new Uint8Array(exports.memory.buffer, out_ptr, n).slice());
+  exports.eztex_free(out_ptr, out_cap);
+  if (n === 0) return;
+  const stats = JSON.parse(text) as Record<string, MemoryCounter> & { heap?: number };
+  const parts = Object.entries(stats)
+    .filter(([name]) => name !== "total" && name !== "heap")
+    .map(([name, c]) => `${name} ${format_size((c as MemoryCounter).peak)}`);
+  dbg("mem", `peak ${format_size(stats.total.peak)} (${parts.join(", ")}), heap ${format_size(stats.heap ?? 0)}`);
+}
+
 // -- download precompiled xelatex.fmt from server --
 
 async function download_format(): Promise<boolean> {
@@ -593,7 +1210,7 @@ async function download_format(): Promise<boolean> {
     return false;
   }
 
-  cached_files!.set("xelatex.fmt", data);
+  set_format(data);
   const cache_key = wasm_api.format_cache_key();
   opfs.save_format(cache_key, data);
   log("fmt", "info", `downloaded xelatex.fmt (${format_size(data.byteLength)})`);
@@ -616,7 +1233,7 @@ async function generate_format(): Promise<boolean> {
   const fmt_inode = (tmp_map.get("xelatex.fmt") ?? tmp_map.get("_make_xelatex_fmt.fmt")) as WasiFile | undefined;
   if (fmt_inode && fmt_inode.data && fmt_inode.data.byteLength > 0) {
     const fmt_copy = new Uint8Array(fmt_inode.data);
-    cached_files.set("xelatex.fmt", fmt_copy);
+    set_format(fmt_copy);
     const elapsed = ((performance.now() - t0) / 1000).toFixed(2);
     log("fmt", "info", `generated xelatex.fmt (${format_size(fmt_copy.byteLength)}) in ${elapsed}s`);
     if (fetch_stats.fetches > 0) {
@@ -637,33 +1254,82 @@ async function generate_format(): Promise<boolean> {
 
 // -- init: load WASM + ITAR index + init files from Zig exports --
 
-export async function init(): Promise<void> {
-  send_status("Loading WASM...", "loading");
-  dbg("init", "engine.init() starting");
-  const t0_total = performance.now();
+// smallest module using a v128 instruction (i8x16.splat of a constant);
+// validates only where wasm SIMD128 is implemented
+const SIMD_PROBE = new Uint8Array([
+  0, 97, 115, 109, 1, 0, 0, 0, 1, 5, 1, 96, 0, 1, 123, 3, 2, 1, 0, 10, 10, 1, 8, 0, 65, 0, 253, 15, 253, 98, 11,
+]);
 
-  // step 1: compile WASM + fetch ITAR index in parallel.
-  const wasm_promise = (async () => {
-    dbg("init", "fetching /eztex.wasm...");
-    const wasm_resp = await fetch("/eztex.wasm", { cache: "no-cache" });
-    if (!wasm_resp.ok) throw new Error("failed to fetch eztex.wasm");
-    dbg("init", `wasm response: ${wasm_resp.status}, content-length=${wasm_resp.headers.get("content-length")}`);
-    wasm_module = await WebAssembly.compileStreaming(Promise.resolve(wasm_resp));
-    dbg("init", "WebAssembly.compileStreaming complete");
-  })();
+function simd_supported(): boolean {
+  try {
+    return WebAssembly.validate(SIMD_PROBE);
+  } catch {
+    return false;
+  }
+}
 
-  const index_bytes_promise = (async () => {
-    try {
-      return await bundle.fetch_itar_index();
-    } catch (e) {
-      log("init", "warn", `index fetch failed: ${(e as Error).message}`);
-      return null;
-    }
-  })();
+// the ReleaseFast engine is larger, so the first visit loads the ReleaseSmall
+// one and downloads the fast one into the Cache API once ready. later sessions
+// use it as long as its ETag still matches what the server has.
+const FAST_ENGINE = "eztex-simd-fast.wasm";
+const ENGINE_CACHE = "eztex-engine";
 
-  await wasm_promise;
+async function cached_fast_engine(): Promise<Response | null> {
+  if (typeof caches === "undefined") return null;
+  try {
+    const cache = await caches.open(ENGINE_CACHE);
+    const hit = await cache.match(`/${FAST_ENGINE}`);
+    if (!hit) return null;
+    const head = await fetch(`/${FAST_ENGINE}`, { method: "HEAD", cache: "no-cache" });
+    const etag = head.ok ? head.headers.get("etag") : null;
+    if (etag && etag === hit.headers.get("etag")) return hit;
+    // redeployed: the old build may not match this worker's imports
+    await cache.delete(`/${FAST_ENGINE}`);
+    dbg("init", "cached fast engine is stale, dropped");
+  } catch (e) {
+    dbg("init", `fast engine cache unavailable: ${(e as Error).message}`);
+  }
+  return null;
+}
 
-  // step 2: create persistent api_instance (for index queries, cache marking, file lists)
+async function download_fast_engine(): Promise<void> {
+  if (typeof caches === "undefined") return;
+  try {
+    const resp = await fetch(`/${FAST_ENGINE}`, { cache: "no-cache" });
+    // without an ETag a later session could not tell whether it is current
+    if (!resp.ok || !resp.headers.get("etag")) return;
+    const cache = await caches.open(ENGINE_CACHE);
+    await cache.put(`/${FAST_ENGINE}`, resp);
+    dbg("init", `downloaded ${FAST_ENGINE} for the next session`);
+  } catch (e) {
+    dbg("init", `fast engine download failed: ${(e as Error).message}`);
+  }
+}
+
+// with cross-origin isolation the threaded build deflates PDF streams on a
+// pool of workers; false (fall back to the other builds) if it is missing
+const THREADED_ENGINE = "eztex-simd-threads.wasm";
+
+async function load_threaded_engine(): Promise<boolean> {
+  try {
+    const t0 = performance.now();
+    const resp = await fetch(`/${THREADED_ENGINE}`, { cache: "no-cache" });
+    if (!resp.ok) return false;
+    const [limits, module] = await Promise.all([threads.read_memory_limits(resp), WebAssembly.compileStreaming(resp)]);
+    if (!limits) return false;
+    threads.start(module, limits);
+    wasm_module = module;
+    const elapsed = ((performance.now() - t0) / 1000).toFixed(2);
+    log("init", "info", `engine build: ${THREADED_ENGINE}, loaded in ${elapsed}s`);
+    return true;
+  } catch (e) {
+    dbg("init", `threaded engine unavailable: ${(e as Error).message}`);
+    return false;
+  }
+}
+
+// persistent instance for index queries, cache marking and file lists
+function create_api_instance(): void {
   try {
     dbg("init", "creating api_instance (persistent, for index queries)...");
     const fds = [
@@ -672,15 +1338,17 @@ export async function init(): Promise<void> {
       ConsoleStdout.lineBuffered(() => {}),
     ];
     const wasi = new WASI([], [], fds);
-    const api_inst = new WebAssembly.Instance(wasm_module!, {
-      wasi_snapshot_preview1: wasi.wasiImport,
-      env: {
-        dup() { return -1; },
-        js_request_range() { return -1; },
-        js_request_index() { return -1; },
-      },
-    });
-    (wasi as any).initialize(api_inst);
+    const api_inst = new WebAssembly.Instance(wasm_module!, engine_imports(wasi, {
+      dup() { return -1; },
+      js_request_range() { return -1; },
+      js_prefetch_ranges() { return -1; },
+      js_cache_put() {},
+      js_request_index() { return -1; },
+      js_format_image_get() { return -1; },
+      js_format_image_put() {},
+      js_cancel_requested() { return 0; },
+    }, false));
+    wasi.initialize(api_inst);
     wasm_api.set_instance(api_inst);
     if (DEBUG) wasm_api.enable_zig_debug();
     dbg("init", "api_instance created and set");
@@ -688,16 +1356,66 @@ export async function init(): Promise<void> {
     log("wasm", "error", `failed to init api instance: ${(e as Error).message}`);
     throw e;
   }
+}
+
+// push the ITAR index into api_instance and keep it for per-compile instances
+function load_index(index_bytes: Uint8Array | null): void {
+  if (!index_bytes) return;
+  cached_index_text = index_bytes;
+  const ok = wasm_api.load_index(index_bytes);
+  dbg("index", `pushed to WASM: ${ok ? "ok" : "failed"} (${format_size(index_bytes.byteLength)})`);
+  if (!ok) log("init", "warn", "failed to parse index in WASM");
+}
+
+// prefer_simd=false forces the baseline build (?simd=0), to compare the two
+export async function init(prefer_simd: boolean = true): Promise<void> {
+  send_status("Loading WASM...", "loading");
+  dbg("init", "engine.init() starting");
+  const t0_total = performance.now();
+
+  // step 1: compile WASM + fetch ITAR index in parallel.
+  const simd = prefer_simd && simd_supported();
+  let fast_missing = false;
+  const wasm_promise = (async () => {
+    if (simd && threads.available() && await load_threaded_engine()) return;
+    const fast_resp = simd ? await cached_fast_engine() : null;
+    fast_missing = simd && !fast_resp;
+    const wasm_name = fast_resp ? FAST_ENGINE : simd ? "eztex-simd.wasm" : "eztex.wasm";
+    dbg("init", `fetching /${wasm_name}...`);
+    const t0 = performance.now();
+    // the module compiles while it downloads. "no-cache" revalidates but keeps
+    // the HTTP cache entry, which is where the browser stores compiled wasm
+    // code: an unchanged engine (304) is then loaded without recompiling.
+    // "no-store" here or in _headers would throw that cache away.
+    const wasm_resp = fast_resp
+      ? Promise.resolve(fast_resp)
+      : fetch(`/${wasm_name}`, { cache: "no-cache" }).then((resp) => {
+          if (!resp.ok) throw new Error(`failed to fetch ${wasm_name}`);
+          dbg("init", `wasm response: ${resp.status}, content-length=${resp.headers.get("content-length")}`);
+          return resp;
+        });
+    wasm_module = await WebAssembly.compileStreaming(wasm_resp);
+    const elapsed = ((performance.now() - t0) / 1000).toFixed(2);
+    log("init", "info", `engine build: ${wasm_name}, loaded in ${elapsed}s`);
+  })();
+
+  const index_bytes_promise = (async () => {
+    try {
+      return await bundle.fetch_itar_index();
+    } catch (e) {
+      log("init", "warn", `index fetch failed: ${(e as Error).message}`);
+      return null;
+    }
+  })();
+
+  await Promise.all([wasm_promise, load_memory_high_water()]);
+
+  // step 2: create persistent api_instance (for index queries, cache marking, file lists)
+  create_api_instance();
 
   // step 3: load ITAR index into api_instance + cache for per-compile instances
   send_status("Loading index...", "loading");
-  const index_bytes = await index_bytes_promise;
-  if (index_bytes) {
-    cached_index_text = index_bytes;
-    const ok = wasm_api.load_index(index_bytes);
-    dbg("index", `pushed to WASM: ${ok ? "ok" : "failed"} (${format_size(index_bytes.byteLength)})`);
-    if (!ok) log("init", "warn", "failed to parse index in WASM");
-  }
+  load_index(await index_bytes_promise);
 
   // step 4: get init file list from Zig comptime data
   const version = wasm_api.cache_version();
@@ -718,7 +1436,7 @@ export async function init(): Promise<void> {
   }
 
   // step 5: load init files from OPFS cache or network
-  cached_files = new Map();
+  cached_files = new FileCache();
   const cache_hit = await opfs.load_init(version, init_keys, cached_files, seed_tick);
 
   if (!cache_hit) {
@@ -750,7 +1468,7 @@ export async function init(): Promise<void> {
   if (!cached_files.has("xelatex.fmt")) {
     dbg("fmt", "no format file found, generating on first launch...");
     const fmt_keys = wasm_api.query_seed_format();
-    const fmt_needed = fmt_keys.filter((f) => !cached_files!.has(f));
+    const fmt_needed = fmt_keys.filter((f) => !cached_file(f));
     if (fmt_needed.length > 0) {
       phase_loaded = 0;
       phase_total = fmt_needed.length;
@@ -776,18 +1494,63 @@ export async function init(): Promise<void> {
   const total_elapsed = ((performance.now() - t0_total) / 1000).toFixed(2);
   log(
     "init", "info",
-    `ready in ${total_elapsed}s: ${cached_files.size} files, index ${wasm_api.is_index_loaded() ? "ok" : "missing"}${cache_hit ? " (cached)" : ""}`,
+    `ready in ${total_elapsed}s: ${cached_files.size} files (${format_size(cached_files.bytes_used)} in memory), index ${wasm_api.is_index_loaded() ? "ok" : "missing"}${cache_hit ? " (cached)" : ""}`,
   );
   send_status("Ready", "success");
   send_progress(100);
   send_ready();
+  share_engine();
+  if (fast_missing) void download_fast_engine();
+  schedule_precache();
+}
+
+// -- idle precache --
+// after the first load, the popular package files (seeds.popular, most used
+// first) are fetched into OPFS a few at a time, so a new template's first
+// compile rarely waits on the network. a compile stops it until the engine
+// has been idle again for a while.
+const PRECACHE_IDLE_MS = 10_000;
+const PRECACHE_PAUSE_MS = 1_000;
+const PRECACHE_BATCH = 8;
+let precache_timer: ReturnType<typeof setTimeout> | null = null;
+let precache_queue: string[] | null = null;
+let compiles_running = 0;
+
+function schedule_precache(delay: number = PRECACHE_IDLE_MS): void {
+  if (precache_timer !== null) clearTimeout(precache_timer);
+  precache_timer = null;
+  // only worth it where the files persist, and not on a metered connection
+  if (!opfs.supported || (precache_queue !== null && precache_queue.length === 0)) return;
+  if ((navigator as Navigator & { connection?: { saveData?: boolean } }).connection?.saveData) return;
+  precache_timer = setTimeout(() => {
+    precache_timer = null;
+    void precache_step();
+  }, delay);
+}
+
+function cancel_precache(): void {
+  if (precache_timer !== null) clearTimeout(precache_timer);
+  precache_timer = null;
+}
+
+async function precache_step(): Promise<void> {
+  if (!cached_files || compiles_running > 0 || !navigator.onLine) return;
+  if (precache_queue === null) {
+    precache_queue = wasm_api.query_seed_popular()
+      .filter((name) => !cached_files!.has(name) && !opfs.has_packed(name));
+    dbg("precache", `${precache_queue.length} popular files not cached yet`);
+  }
+  const batch = precache_queue.splice(0, PRECACHE_BATCH);
+  if (batch.length === 0) return;
+  await bundle.batch_fetch(batch, cached_files, 2);
+  if (compiles_running === 0) schedule_precache(PRECACHE_PAUSE_MS);
 }
 
 // -- resolve main file --
 
-function resolve_main(user_files: ProjectFiles, main?: string): string {
+function resolve_main(main?: string): string {
   if (main) return main;
-  const names = Object.keys(user_files);
+  const names = [...tree.files.keys()];
   if (names.length === 1) return names[0];
 
   if (wasm_api.has_instance()) {
@@ -798,92 +1561,287 @@ function resolve_main(user_files: ProjectFiles, main?: string): string {
   return names.find((n) => n === "input.tex" || n === "main.tex") || names[0];
 }
 
-// -- compile (single run, fetch-on-open) --
+// -- compile (resident instance, fetch-on-open) --
+
+// fetch what earlier compiles of this project asked for as merged, parallel
+// range requests, so the run itself rarely stops on a one-file fetch
+// the fetches made, their bytes and the time they took, for the timings
+async function prefetch_predicted(names: string[]): Promise<{ fetches: number; bytes: number; ms: number }> {
+  const missing = names.filter((name) => !cached_file(name));
+  if (missing.length === 0) return { fetches: 0, bytes: 0, ms: 0 };
+  const t0 = performance.now();
+  await bundle.batch_fetch(missing, cached_files!, 6);
+  const ms = performance.now() - t0;
+  dbg("prefetch", `${missing.length}/${names.length} predicted bundle files fetched before the run in ${ms.toFixed(0)}ms`);
+  const fetched = missing.filter((name) => cached_files!.has(name));
+  return { fetches: fetched.length, bytes: fetched.reduce((sum, name) => sum + (cached_files!.get(name)?.byteLength ?? 0), 0), ms };
+}
+
+// the engine's stages shown in a compile's timings, one row per span; spans
+// it repeats inside a pass are summed into one row each
+const TRACE_FILE = "compile-trace.json";
+const TRACE_STAGES = new Set(["setup", "preamble format", "pass", "bibtex", "xdvipdfmx", "pictures", "synctex index"]);
+const TRACE_SUMMED = new Set(["format load", "font init"]);
 
-export async function compile(user_files: ProjectFiles, main?: string, mode: CompileMode = "full"): Promise<void> {
+type TraceEvent = { ph?: string; name?: string; ts?: number; dur?: number; args?: { detail?: string } };
+
+// the stages in the order they started, from the Chrome trace the engine
+// wrote for --trace (see Timeline.zig)
+function read_trace_stages(inode: WasiFile | undefined): CompileStage[] {
+  if (!inode?.data) return [];
+  let events: unknown;
+  try {
+    events = (JSON.parse(decoder.decode(inode.data)) as { traceEvents?: unknown }).traceEvents;
+  } catch {
+    return [];
+  }
+  if (!Array.isArray(events)) return [];
+  const rows: Array<CompileStage & { ts: number }> = [];
+  const summed = new Map<string, CompileStage & { ts: number }>();
+  for (const e of events as TraceEvent[]) {
+    if (e.ph !== "X" || typeof e.name !== "string" || typeof e.dur !== "number") continue;
+    const ts = e.ts ?? 0;
+    const ms = e.dur / 1000;
+    if (TRACE_STAGES.has(e.name)) {
+      rows.push({ name: e.name, detail: e.args?.detail, ms, ts });
+    } else if (TRACE_SUMMED.has(e.name)) {
+      const row = summed.get(e.name);
+      if (row) {
+        row.ms += ms;
+        row.ts = Math.min(row.ts, ts);
+      } else {
+        const added = { name: e.name, ms, ts };
+        summed.set(e.name, added);
+        rows.push(added);
+      }
+    }
+  }
+  rows.sort((a, b) => a.ts - b.ts);
+  return rows.map(({ name, detail, ms }) => (detail === undefined ? { name, ms } : { name, detail, ms }));
+}
+
+// <jobname>.cmds (see xetex-cmdindex.c): "<kind> <name>" per line, by name
+function parse_command_index(text: string): CommandIndex {
+  const commands: string[] = [];
+  const kinds: string[] = [];
+  const environments: string[] = [];
+  for (const line of text.split("\n")) {
+    if (line.length < 3) continue;
+    const name = line.slice(2);
+    if (line[0] === "e") {
+      environments.push(name);
+    } else {
+      commands.push(name);
+      kinds.push(line[0]);
+    }
+  }
+  return { commands, kinds: kinds.join(""), environments };
+}
+
+function send_command_index(project_id: string, text: string): boolean {
+  if (project_id === tree.sent_commands_project && text === tree.sent_commands) return false;
+  tree.sent_commands = text;
+  tree.sent_commands_project = project_id;
+  send_commands(parse_command_index(text));
+  return true;
+}
+
+// pages: the pages on screen, which the PDF worker converts first (pipelined
+// previews only: elsewhere the PDF is written in the same run as the XDV)
+export async function compile(main?: string, mode: CompileMode = "full", seq: number = 0, focus?: string, pages?: string): Promise<void> {
+  const changes = tree.changes;
+  tree.changes = 0;
   if (!wasm_module || !cached_files) {
     log("eztex", "error", "engine not ready");
     return;
   }
 
-  const main_file = resolve_main(user_files, main);
-  const project_id = derive_project_id(user_files, main_file);
+  const main_file = resolve_main(main);
+  const project_id = derive_project_id(tree.files.keys(), main_file);
   send_status("Compiling...", "loading");
-  dbg("eztex", `compiling ${main_file} in ${mode} mode (${Object.keys(user_files).length} file(s))...`);
+  compiles_running++;
+  cancel_precache();
+  dbg("eztex", `compiling ${main_file} in ${mode} mode (${tree.files.size} file(s), ${changes} synced)...`);
 
   const t0 = performance.now();
+  const preview_seq = mode === "preview" ? seq : null;
+  // the PDF worker writes this preview's PDF (see send_xdv)
+  const pipelined = mode === "preview" && pdf_port !== null;
+  // a preview of only the \include'd part being edited (see Compiler.focus_source)
+  const focus_args = mode === "preview" && focus ? ["--focus", focus] : [];
+
+  opfs_reads.count = 0;
+  opfs_reads.bytes = 0;
+  opfs_reads.ms = 0;
 
   try {
+    const opfs_t0 = performance.now();
     const restored_intermediates = await opfs.load_project_intermediates(project_id);
     if (restored_intermediates.size > 0) {
       dbg("eztex", `restoring ${restored_intermediates.size} intermediate file(s) for ${project_id}`);
     }
+    const predicted = await opfs.load_project_bundle_files(project_id);
+    // completion has the last session's commands while the first compile runs
+    if (project_id !== tree.sent_commands_project) {
+      const commands = await opfs.load_command_index(project_id, wasm_api.format_cache_key());
+      if (commands) send_command_index(project_id, commands);
+    }
+    const project_opfs_ms = performance.now() - opfs_t0;
+    const prefetched = await prefetch_predicted(predicted);
+    if (superseded(preview_seq)) {
+      dbg("eztex", `preview ${seq} superseded before it ran`);
+      send_cancelled();
+      return;
+    }
 
-    const { exit_code, root_map, tmp_map, fetch_stats } = run_wasm(
-      mode === "preview"
-        ? ["eztex", "compile", "--synctex", "--preview", main_file]
-        : ["eztex", "compile", "--synctex", main_file],
-      user_files,
-      true,
+    // the resident instance keeps the dumped preamble in memory, so edits to
+    // the body skip it
+    const { exit_code, root_map, tmp_map, fetch_stats } = await run_resident(
+      pipelined
+        ? ["eztex", "compile", "--synctex", "--trace", `tmp/${TRACE_FILE}`, "--command-index", "--preamble-format", "--preview", "--no-log", "--xdv", ...focus_args, main_file]
+        : mode === "preview"
+        ? ["eztex", "compile", "--synctex", "--trace", `tmp/${TRACE_FILE}`, "--command-index", "--page-digests", "--preamble-format", "--preview", "--no-log", ...focus_args, main_file]
+        : ["eztex", "compile", "--synctex", "--trace", `tmp/${TRACE_FILE}`, "--command-index", "--page-digests", "--preamble-format", main_file],
+      tree.files,
       restored_intermediates,
+      preview_seq,
     );
 
+    // stopped at a page: its partial outputs are neither shown nor kept
+    if (exit_code !== 0 && superseded(preview_seq)) {
+      dbg("eztex", `preview ${seq} cancelled after ${((performance.now() - t0) / 1000).toFixed(2)}s`);
+      send_cancelled();
+      return;
+    }
+
+    const elapsed = ((performance.now() - t0) / 1000).toFixed(2);
+    const pdf_name = main_file.replace(/\.tex$/, ".pdf");
+    // 2: a preview stopped at an error, with the pages shipped before it
+    // converted, so the viewer follows the edit up to where it broke
+    const has_output = exit_code === 0 || (mode === "preview" && exit_code === 2);
+    const pdf_inode = has_output ? root_map.get(pdf_name) as WasiFile | undefined : undefined;
+
+    // the viewer gets the PDF before anything below is persisted. its buffer
+    // is moved, not copied, unless it is still the project's own file.
+    if (pdf_inode && pdf_inode.data) {
+      const pages_name = main_file.replace(/\.tex$/, ".pages.json");
+      const pages = read_page_digests(root_map.get(pages_name) as WasiFile | undefined);
+      const pdf = pdf_inode.data === tree.files.get(pdf_name) ? pdf_inode.data.slice() : pdf_inode.data;
+      dbg("eztex", `output: ${pdf_name} (${format_size(pdf.byteLength)})`);
+      send_pdf(pdf, pages);
+    }
+
+    // the XDV is written at the top level under the jobname
+    const xdv_name = main_file.replace(/^.*\//, "").replace(/\.tex$/, ".xdv");
+    const xdv_inode = pipelined && has_output ? root_map.get(xdv_name) as WasiFile | undefined : undefined;
+    if (xdv_inode && xdv_inode.data) {
+      send_xdv(seq, xdv_name, xdv_inode.data, fetch_stats.opened, pages);
+      root_map.delete(xdv_name);
+    }
+
     const intermediate_files = collect_intermediate_files(root_map);
     await opfs.save_project_intermediates(project_id, intermediate_files, exit_code === 0);
+    // after the intermediates: replacing them clears the project directory
+    const known = new Set(predicted);
+    const grew = [...fetch_stats.opened].some((name) => !known.has(name));
+    if (grew || (exit_code === 0 && known.size > 0)) {
+      for (const name of fetch_stats.opened) known.add(name);
+      await opfs.save_project_bundle_files(project_id, [...known]);
+    }
 
     // persist xelatex.fmt if generated during this run
     const fmt_inode = tmp_map.get("xelatex.fmt") as WasiFile | undefined;
     if (fmt_inode && fmt_inode.data && fmt_inode.data.byteLength > 0) {
       const fmt_copy = new Uint8Array(fmt_inode.data);
-      cached_files.set("xelatex.fmt", fmt_copy);
+      set_format(fmt_copy);
       dbg("fmt", `generated xelatex.fmt (${format_size(fmt_copy.byteLength)}), caching to OPFS`);
       const cache_key = wasm_api.format_cache_key();
       opfs.save_format(cache_key, fmt_copy);
     }
 
-    const elapsed = ((performance.now() - t0) / 1000).toFixed(2);
-
     if (fetch_stats.fetches > 0) {
       dbg("fetch", `fetched ${fetch_stats.fetches} files on-demand (${format_size(fetch_stats.fetch_bytes)}), ${fetch_stats.cache_hits} cache hits`);
     }
+    void opfs.trim();
+
+    send_timings({
+      total_ms: performance.now() - t0,
+      stages: read_trace_stages(tmp_map.get(TRACE_FILE) as WasiFile | undefined),
+      fetches: prefetched.fetches + fetch_stats.fetches,
+      fetch_bytes: prefetched.bytes + fetch_stats.fetch_bytes,
+      fetch_ms: prefetched.ms + fetch_stats.fetch_ms,
+      cache_hits: fetch_stats.cache_hits,
+      opfs_reads: opfs_reads.count,
+      opfs_bytes: opfs_reads.bytes,
+      opfs_ms: project_opfs_ms + opfs_reads.ms,
+    } satisfies CompileTimings);
 
     if (exit_code === 0) {
-      const pdf_name = main_file.replace(/\.tex$/, ".pdf");
       const synctex_name = main_file.replace(/\.tex$/, ".synctex.gz");
+      const synctex_index_name = main_file.replace(/\.tex$/, ".synctex.idx");
       log("eztex", "info", `compiled ${main_file} in ${elapsed}s`);
       send_status(`Done (${elapsed}s)`, "success");
 
-      const pdf_inode = root_map.get(pdf_name) as WasiFile | undefined;
+      // beside the PDF, or under the jobname when the run stopped at the XDV
+      const cmds_inode = (root_map.get(main_file.replace(/\.tex$/, ".cmds"))
+        ?? root_map.get(xdv_name.replace(/\.xdv$/, ".cmds"))) as WasiFile | undefined;
+      if (cmds_inode?.data) {
+        const commands = new TextDecoder().decode(cmds_inode.data);
+        if (send_command_index(project_id, commands)) {
+          opfs.save_command_index(project_id, wasm_api.format_cache_key(), commands);
+        }
+      }
+
       const synctex_inode = root_map.get(synctex_name) as WasiFile | undefined;
       const synctex_data = synctex_inode?.data ? new Uint8Array(synctex_inode.data) : null;
       if (synctex_data) {
         dbg("eztex", `synctex: ${synctex_name} (${format_size(synctex_data.byteLength)})`);
       }
+      const synctex_index_inode = root_map.get(synctex_index_name) as WasiFile | undefined;
+      const synctex_index = synctex_index_inode?.data ? new Uint8Array(synctex_index_inode.data) : null;
 
-      if (pdf_inode && pdf_inode.data) {
-        dbg("eztex", `output: ${pdf_name} (${format_size(pdf_inode.data.length)})`);
-        send_complete(pdf_inode.data, synctex_data, elapsed);
+      if ((pdf_inode && pdf_inode.data) || (xdv_inode && xdv_inode.data)) {
+        send_complete(true, synctex_data, elapsed, synctex_index);
       } else {
         log("eztex", "warn", `no PDF output found (expected ${pdf_name})`);
         send_status("No PDF output", "error");
-        send_complete(null, null, elapsed);
+        send_complete(false, null, elapsed);
       }
     } else {
       log("eztex", "error", `compilation failed (exit code ${exit_code}) in ${elapsed}s`);
       send_status(`Failed (${elapsed}s)`, "error");
-      send_complete(null, null, elapsed);
+      send_complete(false, null, elapsed);
     }
   } catch (e) {
     const err = e as Error;
     log("eztex", "error", err.message);
     if (err.stack) send_log(err.stack, "log-error");
     send_status("Error", "error");
-    send_complete(null, null, "0");
+    send_complete(false, null, "0");
+  } finally {
+    if (--compiles_running === 0) schedule_precache();
+  }
+}
+
+// <jobname>.pages.json from xdvipdfmx: one digest per page, in page order,
+// null for a page written blank
+function read_page_digests(inode: WasiFile | undefined): (string | null)[] | null {
+  if (!inode?.data) return null;
+  try {
+    const parsed = JSON.parse(new TextDecoder().decode(inode.data)) as { pages?: unknown };
+    return Array.isArray(parsed.pages) ? parsed.pages.map((d) => (d === null ? null : String(d))) : null;
+  } catch {
+    return null;
   }
 }
 
 // -- clear cache --
 
+// size budget of the OPFS cache in bytes, null for the default (see opfs.trim)
+export function set_cache_budget(bytes: number | null): void {
+  opfs.set_budget(bytes);
+}
+
 export async function clear_cache(): Promise<void> {
   await opfs.clear();
 }
@@ -0,0 +1,65 @@
+// in-memory bundle file cache with a byte budget
+// a Map kept in least-recently-used order: get() and set() move the entry to
+// the end, and set() evicts from the front once the budget is exceeded. only
+// files the OPFS pack can serve again are evicted, so the format and files
+// that never reached OPFS stay, and an evicted file costs one sync read.
+
+import * as opfs from "./opfs.ts";
+
+// enough for the init set plus the packages a typical project pulls in
+export const DEFAULT_BUDGET = 128 * 1024 * 1024;
+
+export class FileCache extends Map<string, Uint8Array> {
+  readonly budget: number;
+  private bytes = 0;
+
+  constructor(budget: number = DEFAULT_BUDGET) {
+    super();
+    this.budget = budget;
+  }
+
+  get bytes_used(): number {
+    return this.bytes;
+  }
+
+  get(key: string): Uint8Array | undefined {
+    const data = super.get(key);
+    if (data) {
+      super.delete(key);
+      super.set(key, data);
+    }
+    return data;
+  }
+
+  set(key: string, data: Uint8Array): this {
+    const old = super.get(key);
+    if (old) {
+      this.bytes -= old.byteLength;
+      super.delete(key);
+    }
+    super.set(key, data);
+    this.bytes += data.byteLength;
+    if (this.bytes > this.budget) this.evict();
+    return this;
+  }
+
+  delete(key: string): boolean {
+    const old = super.get(key);
+    if (old) this.bytes -= old.byteLength;
+    return super.delete(key);
+  }
+
+  clear(): void {
+    this.bytes = 0;
+    super.clear();
+  }
+
+  private evict(): void {
+    for (const [key, data] of super.entries()) {
+      if (this.bytes <= this.budget) break;
+      if (!opfs.has_packed(key)) continue;
+      super.delete(key);
+      this.bytes -= data.byteLength;
+    }
+  }
+}
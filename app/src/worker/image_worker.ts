@@ -0,0 +1,219 @@
+// image worker: re-encodes one image per message on an OffscreenCanvas, so
+// optimizing a batch of photos runs beside the editor instead of on it.
+// image_tools.ts keeps a small pool of these and spreads images across them.
+//
+// PNGs also get a lossless encoding of their own: the pixels are stored in
+// the smallest color type they fit (gray, palette, RGB), rows are filtered
+// with the usual minimum-sum-of-absolute-differences heuristic and deflated
+// by CompressionStream. the smaller of that and the canvas PNG wins.
+
+import { strip_icc_profile } from "../lib/image_tools.ts";
+
+export type ImageRequest = { id: number; bytes: Uint8Array; type: string; quality?: number };
+export type ImageResponse = { id: number; bytes: Uint8Array } | { id: number; error: string };
+
+const CRC_TABLE = (() => {
+  const table = new Uint32Array(256);
+  for (let n = 0; n < 256; n++) {
+    let c = n;
+    for (let k = 0; k < 8; k++) c = c & 1 ? 0xedb88320 ^ (c >>> 1) : c >>> 1;
+    table[n] = c >>> 0;
+  }
+  return table;
+})();
+
+function crc32(bytes: Uint8Array): number {
+  let c = 0xffffffff;
+  for (let i = 0; i < bytes.length; i++) c = CRC_TABLE[(c ^ bytes[i]) & 0xff] ^ (c >>> 8);
+  return (c ^ 0xffffffff) >>> 0;
+}
+
+function png_chunk(type: string, data: Uint8Array): Uint8Array {
+  const out = new Uint8Array(12 + data.length);
+  const view = new DataView(out.buffer);
+  view.setUint32(0, data.length);
+  for (let i = 0; i < 4; i++) out[4 + i] = type.charCodeAt(i);
+  out.set(data, 8);
+  view.setUint32(8 + data.length, crc32(out.subarray(4, 8 + data.length)));
+  return out;
+}
+
+async function zlib_deflate(data: Uint8Array): Promise<Uint8Array> {
+  const stream = new Blob([data as BlobPart]).stream().pipeThrough(new CompressionStream("deflate"));
+  return new Uint8Array(await new Response(stream).arrayBuffer());
+}
+
+function paeth(a: number, b: number, c: number): number {
+  const p = a + b - c;
+  const pa = Math.abs(p - a);
+  const pb = Math.abs(p - b);
+  const pc = Math.abs(p - c);
+  if (pa <= pb && pa <= pc) return a;
+  return pb <= pc ? b : c;
+}
+
+// filtered scanlines, each prefixed by its filter type. bpp is the filter's
+// byte distance; adaptive picks per row, otherwise every row is unfiltered
+function filter_rows(rows: Uint8Array, stride: number, height: number, bpp: number, adaptive: boolean): Uint8Array {
+  const out = new Uint8Array(height * (stride + 1));
+  const candidate = new Uint8Array(stride);
+  const zero = new Uint8Array(stride);
+  for (let y = 0; y < height; y++) {
+    const row = rows.subarray(y * stride, (y + 1) * stride);
+    const prev = y > 0 ? rows.subarray((y - 1) * stride, y * stride) : zero;
+    const at = y * (stride + 1);
+    out[at] = 0;
+    out.set(row, at + 1);
+    if (!adaptive) continue;
+    let best = Infinity;
+    for (let f = 0; f <= 4; f++) {
+      let sum = 0;
+      for (let i = 0; i < stride; i++) {
+        const a = i >= bpp ? row[i - bpp] : 0;
+        const b = prev[i];
+        const c = i >= bpp ? prev[i - bpp] : 0;
+        const predicted = f === 0 ? 0 : f === 1 ? a : f === 2 ? b : f === 3 ? (a + b) >> 1 : paeth(a, b, c);
+        const v = (row[i] - predicted) & 0xff;
+        candidate[i] = v;
+        sum += v < 128 ? v : 256 - v;
+      }
+      if (sum < best) {
+        best = sum;
+        out[at] = f;
+        out.set(candidate, at + 1);
+      }
+    }
+  }
+  return out;
+}
+
+// a PNG of the RGBA pixels in the smallest color type they fit, or null when
+// only full RGBA holds them (the canvas encoding covers that)
+async function encode_png_reduced(rgba: Uint8ClampedArray, width: number, height: number): Promise<Uint8Array | null> {
+  const pixels = width * height;
+  let opaque = true;
+  let gray = true;
+  const palette = new Map<number, number>();
+  for (let p = 0; p < pixels; p++) {
+    const i = p * 4;
+    const r = rgba[i], g = rgba[i + 1], b = rgba[i + 2], a = rgba[i + 3];
+    if (a !== 255) opaque = false;
+    if (r !== g || g !== b) gray = false;
+    if (palette.size <= 256) {
+      const key = ((r << 24) | (g << 16) | (b << 8) | a) >>> 0;
+      if (!palette.has(key)) palette.set(key, palette.size);
+    }
+  }
+
+  let color_type: number;
+  let depth = 8;
+  let channels: number;
+  if (gray && opaque) {
+    color_type = 0;
+    channels = 1;
+  } else if (palette.size <= 256) {
+    color_type = 3;
+    channels = 1;
+    depth = palette.size <= 2 ? 1 : palette.size <= 4 ? 2 : palette.size <= 16 ? 4 : 8;
+  } else if (gray) {
+    color_type = 4;
+    channels = 2;
+  } else if (opaque) {
+    color_type = 2;
+    channels = 3;
+  } else {
+    return null;
+  }
+
+  const stride = Math.ceil((width * channels * depth) / 8);
+  const rows = new Uint8Array(stride * height);
+  for (let y = 0; y < height; y++) {
+    const row = y * stride;
+    for (let x = 0; x < width; x++) {
+      const i = (y * width + x) * 4;
+      if (color_type === 3) {
+        const key = ((rgba[i] << 24) | (rgba[i + 1] << 16) | (rgba[i + 2] << 8) | rgba[i + 3]) >>> 0;
+        const index = palette.get(key)!;
+        const bit = x * depth;
+        rows[row + (bit >> 3)] |= index << (8 - depth - (bit & 7));
+      } else {
+        const at = row + x * channels;
+        rows[at] = rgba[i];
+        if (color_type === 4) rows[at + 1] = rgba[i + 3];
+        if (color_type === 2) {
+          rows[at + 1] = rgba[i + 1];
+          rows[at + 2] = rgba[i + 2];
+        }
+      }
+    }
+  }
+
+  // palette images compress best unfiltered
+  const idat = await zlib_deflate(filter_rows(rows, stride, height, Math.max(1, channels), color_type !== 3));
+
+  const ihdr = new Uint8Array(13);
+  const ihdr_view = new DataView(ihdr.buffer);
+  ihdr_view.setUint32(0, width);
+  ihdr_view.setUint32(4, height);
+  ihdr[8] = depth;
+  ihdr[9] = color_type;
+  const chunks = [new Uint8Array([0x89, 0x50, 0x4e, 0x47, 0x0d, 0x0a, 0x1a, 0x0a]), png_chunk("IHDR", ihdr)];
+  if (color_type === 3) {
+    const plte = new Uint8Array(palette.size * 3);
+    const alpha = new Uint8Array(palette.size);
+    let last_translucent = -1;
+    for (const [key, index] of palette) {
+      plte[index * 3] = key >>> 24;
+      plte[index * 3 + 1] = (key >>> 16) & 0xff;
+      plte[index * 3 + 2] = (key >>> 8) & 0xff;
+      alpha[index] = key & 0xff;
+      if (alpha[index] !== 255) last_translucent = Math.max(last_translucent, index);
+    }
+    chunks.push(png_chunk("PLTE", plte));
+    if (last_translucent >= 0) chunks.push(png_chunk("tRNS", alpha.subarray(0, last_translucent + 1)));
+  }
+  chunks.push(png_chunk("IDAT", idat), png_chunk("IEND", new Uint8Array(0)));
+
+  const out = new Uint8Array(chunks.reduce((sum, chunk) => sum + chunk.length, 0));
+  let offset = 0;
+  for (const chunk of chunks) {
+    out.set(chunk, offset);
+    offset += chunk.length;
+  }
+  return out;
+}
+
+async function encode(bytes: Uint8Array, type: string, quality?: number): Promise<Uint8Array> {
+  const image = await createImageBitmap(new Blob([bytes as BlobPart]));
+  const canvas = new OffscreenCanvas(image.width, image.height);
+  try {
+    const ctx = canvas.getContext("2d");
+    if (!ctx) throw new Error("Canvas is not available");
+    ctx.drawImage(image, 0, 0);
+    const blob = await canvas.convertToBlob({ type, quality });
+    let best = strip_icc_profile(new Uint8Array(await blob.arrayBuffer()), type);
+    if (type === "image/png") {
+      const pixels = ctx.getImageData(0, 0, canvas.width, canvas.height).data;
+      const reduced = await encode_png_reduced(pixels, canvas.width, canvas.height);
+      if (reduced && reduced.byteLength < best.byteLength) best = reduced;
+    }
+    return best;
+  } finally {
+    canvas.width = 0;
+    canvas.height = 0;
+    image.close();
+  }
+}
+
+self.onmessage = async (e: MessageEvent) => {
+  const msg = e.data as ImageRequest;
+  let reply: ImageResponse;
+  try {
+    const bytes = await encode(msg.bytes, msg.type, msg.quality);
+    reply = { id: msg.id, bytes };
+    self.postMessage(reply, { transfer: [bytes.buffer] });
+  } catch (err) {
+    reply = { id: msg.id, error: err instanceof Error ? err.message : String(err) };
+    self.postMessage(reply);
+  }
+};
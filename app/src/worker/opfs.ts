@@ -1,6 +1,9 @@
 // OPFS (Origin Private File System) cache layer
 // persists support files and format across browser sessions
-// uses nested OPFS directories matching the original path structure
+// bundle files go into one append-only pack (see "pack store" below); the
+// format, intermediates and the fallback cache use nested OPFS directories
+// matching the original path structure. the cache stays within a size
+// budget (see "size budget" below)
 
 import { send_cache_status, format_size, dbg } from "./protocol.ts";
 
@@ -89,16 +92,20 @@ async function write_nested(base: FileSystemDirectoryHandle, key: string, data:
 const encoder = new TextEncoder();
 const decoder = new TextDecoder();
 
-export async function read_meta(dir: FileSystemDirectoryHandle): Promise<Record<string, unknown> | null> {
-  const raw = await read(dir, "_metadata.json");
+async function read_json(dir: FileSystemDirectoryHandle, filename: string): Promise<unknown> {
+  const raw = await read(dir, filename);
   if (!raw) return null;
   try {
-    return JSON.parse(decoder.decode(raw)) as Record<string, unknown>;
+    return JSON.parse(decoder.decode(raw));
   } catch {
     return null;
   }
 }
 
+export async function read_meta(dir: FileSystemDirectoryHandle): Promise<Record<string, unknown> | null> {
+  return (await read_json(dir, "_metadata.json")) as Record<string, unknown> | null;
+}
+
 export async function write_meta(dir: FileSystemDirectoryHandle, meta: Record<string, unknown>): Promise<void> {
   const raw = encoder.encode(JSON.stringify(meta));
   await write(dir, "_metadata.json", raw);
@@ -106,6 +113,7 @@ export async function write_meta(dir: FileSystemDirectoryHandle, meta: Record<st
 
 export async function clear(): Promise<void> {
   if (!supported) return;
+  close_pack();
   try {
     const root = await navigator.storage.getDirectory();
     await root.removeEntry("eztex-cache", { recursive: true });
@@ -117,9 +125,159 @@ export async function clear(): Promise<void> {
   }
 }
 
+// -- pack store --
+// bundle files live in _bundle.pack, one append-only file, indexed by
+// _bundle.idx: a "eztex-pack 1\t<version>" header line, then one
+// "name\toffset\tlength" line per file. both are held open through sync
+// access handles (dedicated workers only), so a warm start is one index read
+// and every file after that is a synchronous read at a known offset. records
+// are written after the bytes they point at; a torn tail is dropped on open.
+// sync access handles are exclusive, so a second tab gets no pack and falls
+// back to the nested per-file entries.
+
+const PACK_DATA = "_bundle.pack";
+const PACK_INDEX = "_bundle.idx";
+const PACK_MAGIC = "eztex-pack 1";
+
+interface SyncAccessHandle {
+  read(buffer: Uint8Array, options?: { at: number }): number;
+  write(buffer: Uint8Array, options?: { at: number }): number;
+  truncate(size: number): void;
+  getSize(): number;
+  flush(): void;
+  close(): void;
+}
+
+interface Pack {
+  data: SyncAccessHandle;
+  index: SyncAccessHandle;
+  version: string | null;
+  entries: Map<string, { offset: number; length: number }>;
+  data_end: number;
+  index_end: number;
+}
+
+let pack: Pack | null = null;
+
+async function open_pack(dir: FileSystemDirectoryHandle): Promise<Pack | null> {
+  if (pack) return pack;
+  let data: SyncAccessHandle | null = null;
+  try {
+    const data_file = await dir.getFileHandle(PACK_DATA, { create: true });
+    const index_file = await dir.getFileHandle(PACK_INDEX, { create: true });
+    if (typeof (data_file as any).createSyncAccessHandle !== "function") return null;
+    data = (await (data_file as any).createSyncAccessHandle()) as SyncAccessHandle;
+    const index = (await (index_file as any).createSyncAccessHandle()) as SyncAccessHandle;
+    pack = { data, index, version: null, entries: new Map(), data_end: 0, index_end: 0 };
+    read_pack_index(pack);
+    return pack;
+  } catch (e) {
+    data?.close();
+    dbg("cache", `pack unavailable, using per-file entries: ${(e as Error).message}`);
+    return null;
+  }
+}
+
+function read_pack_index(p: Pack): void {
+  const raw = new Uint8Array(p.index.getSize());
+  p.index.read(raw, { at: 0 });
+  const lines = decoder.decode(raw).split("\n");
+  // the last element is "" after a complete record, or a torn one
+  if (lines.length < 2 || !lines[0].startsWith(`${PACK_MAGIC}\t`)) return;
+  p.version = lines[0].slice(PACK_MAGIC.length + 1);
+  p.index_end = encoder.encode(lines[0]).byteLength + 1;
+  const data_size = p.data.getSize();
+  for (let i = 1; i < lines.length - 1; i++) {
+    const [name, offset_text, length_text] = lines[i].split("\t");
+    const offset = Number(offset_text);
+    const length = Number(length_text);
+    if (!name || !Number.isInteger(offset) || !Number.isInteger(length) || offset + length > data_size) break;
+    p.entries.set(name, { offset, length });
+    p.data_end = Math.max(p.data_end, offset + length);
+    p.index_end += encoder.encode(lines[i]).byteLength + 1;
+  }
+}
+
+function reset_pack(p: Pack, version: string): void {
+  const header = encoder.encode(`${PACK_MAGIC}\t${version}\n`);
+  p.data.truncate(0);
+  p.index.truncate(0);
+  p.index.write(header, { at: 0 });
+  p.data.flush();
+  p.index.flush();
+  p.version = version;
+  p.entries.clear();
+  p.data_end = 0;
+  p.index_end = header.byteLength;
+}
+
+// append files not yet packed: all bytes first, then their index records
+function pack_append(p: Pack, files: Iterable<[string, Uint8Array]>): number {
+  const records: string[] = [];
+  let total_bytes = 0;
+  for (const [key, data] of files) {
+    if (p.entries.has(key)) continue;
+    const offset = p.data_end;
+    p.data.write(data, { at: offset });
+    p.entries.set(key, { offset, length: data.byteLength });
+    p.data_end = offset + data.byteLength;
+    records.push(`${key}\t${offset}\t${data.byteLength}\n`);
+    total_bytes += data.byteLength;
+  }
+  if (records.length === 0) return 0;
+  p.data.flush();
+  const raw = encoder.encode(records.join(""));
+  p.index.write(raw, { at: p.index_end });
+  p.index.flush();
+  p.index_end += raw.byteLength;
+  return total_bytes;
+}
+
+function close_pack(): void {
+  if (!pack) return;
+  pack.data.close();
+  pack.index.close();
+  pack = null;
+}
+
+// synchronous read of a packed bundle file, null if it was never cached
+export function read_packed(key: string): Uint8Array | null {
+  const entry = pack?.entries.get(key);
+  if (!pack || !entry) return null;
+  const out = new Uint8Array(entry.length);
+  return pack.data.read(out, { at: entry.offset }) === entry.length ? out : null;
+}
+
+// whether read_packed can serve key again, i.e. it may leave memory
+export function has_packed(key: string): boolean {
+  return pack?.entries.has(key) ?? false;
+}
+
+// drop the per-file bundle entries older caches wrote at the top level; the
+// format, project intermediates and "_" files are kept
+async function remove_legacy_entries(dir: FileSystemDirectoryHandle): Promise<void> {
+  const stale: string[] = [];
+  for await (const name of (dir as any).keys() as AsyncIterable<string>) {
+    if (name.startsWith("_") || name === PROJECTS_DIR || name === "formats" || name === "xelatex.fmt") continue;
+    stale.push(name);
+  }
+  for (const name of stale) {
+    await dir.removeEntry(name, { recursive: true }).catch(() => {});
+  }
+  if (stale.length > 0) dbg("cache", `removed ${stale.length} per-file cache entries`);
+}
+
 // save a single file to OPFS (fire-and-forget for on-demand fetched files)
 export async function cache_file(key: string, data: Uint8Array): Promise<void> {
   if (!supported) return;
+  if (pack) {
+    try {
+      pack_append(pack, [[key, data]]);
+    } catch {
+      // non-critical
+    }
+    return;
+  }
   try {
     const dir = await get_dir();
     await write_nested(dir, key, data);
@@ -143,6 +301,9 @@ export async function load_init(
 
   try {
     const dir = await get_dir();
+    const p = await open_pack(dir);
+    if (p) return await load_init_packed(p, dir, version, init_keys, cached_files, tick);
+
     const meta = await read_meta(dir);
 
     if (!meta || meta.version !== version) {
@@ -191,6 +352,52 @@ export async function load_init(
   }
 }
 
+// warm start from the pack: init files are read up front, everything else is
+// left for read_packed when the engine asks for it. init files that are
+// missing stay missing in cached_files, so only those get fetched.
+async function load_init_packed(
+  p: Pack,
+  dir: FileSystemDirectoryHandle,
+  version: string,
+  init_keys: string[],
+  cached_files: Map<string, Uint8Array>,
+  tick: (name: string) => void,
+): Promise<boolean> {
+  if (p.version !== version) {
+    const reason = p.version === null ? "no cache" : "version mismatch";
+    reset_pack(p, version);
+    await remove_legacy_entries(dir);
+    dbg("cache", `miss: ${reason}`);
+    send_cache_status("miss", reason);
+    return false;
+  }
+
+  send_cache_status("loading", "reading from OPFS cache...");
+  const t0 = performance.now();
+  let missing = 0;
+  for (const key of init_keys) {
+    const data = read_packed(key);
+    if (!data) {
+      missing++;
+      continue;
+    }
+    cached_files.set(key, data);
+    tick(key);
+  }
+
+  if (missing > 0) {
+    dbg("cache", `${missing} init files not in pack, falling back to network`);
+    send_cache_status("miss", `${missing} init files not cached`);
+    return false;
+  }
+
+  const cache_ms = (performance.now() - t0).toFixed(0);
+  const lazy = p.entries.size - init_keys.length;
+  dbg("cache", `loaded ${init_keys.length} init files${lazy > 0 ? ` (+ ${lazy} on demand)` : ""} in ${cache_ms}ms`);
+  send_cache_status("hit", `${cached_files.size} files from cache (${cache_ms}ms)`);
+  return true;
+}
+
 // recursively scan OPFS directories for cached files
 async function scan_dir_recursive(
   dir: FileSystemDirectoryHandle,
@@ -223,6 +430,15 @@ export async function write_all(
 ): Promise<void> {
   const t0 = performance.now();
   let total_bytes = 0;
+
+  if (pack) {
+    total_bytes = pack_append(pack, files);
+    const elapsed = (performance.now() - t0).toFixed(0);
+    dbg("cache", `packed ${format_size(total_bytes)} into OPFS in ${elapsed}ms (${pack.entries.size} files)`);
+    send_cache_status("cached", `${files.size} files saved`);
+    return;
+  }
+
   const dir = await get_dir();
 
   for (const [key, data] of files) {
@@ -243,7 +459,7 @@ export async function write_all(
 }
 
 // load xelatex.fmt from OPFS if available.
-// uses versioned cache key (e.g. "formats/v33_c16079/xelatex.fmt").
+// uses the versioned cache key from Zig ("formats/<key hash>.fmt").
 // falls back to legacy root "xelatex.fmt" for migration.
 export async function load_format(
   cached_files: Map<string, Uint8Array>,
@@ -264,6 +480,7 @@ export async function load_format(
     }
 
     if (fmt_data) {
+      if (source === cache_key) note_use(cache_key);
       cached_files.set("xelatex.fmt", fmt_data);
       dbg("cache", `loaded xelatex.fmt from OPFS (${format_size(fmt_data.byteLength)}) [${source}]`);
     }
@@ -278,15 +495,75 @@ export async function save_format(cache_key: string, data: Uint8Array): Promise<
   try {
     const dir = await get_dir();
     await write_nested(dir, cache_key, data);
+    note_use(cache_key);
     dbg("cache", `saved xelatex.fmt to OPFS [${cache_key}]`);
   } catch {
     // non-critical
   }
 }
 
+// bundle files earlier compiles of a project asked for, one name per line,
+// kept in projects/<id>/ next to the intermediates
+const BUNDLE_FILES = "_bundle_files.txt";
+
+export async function load_project_bundle_files(project_id: string): Promise<string[]> {
+  if (!supported) return [];
+  try {
+    const dir = await get_dir();
+    const projects = await dir.getDirectoryHandle(PROJECTS_DIR);
+    const project = await projects.getDirectoryHandle(project_id);
+    const raw = await read(project, BUNDLE_FILES);
+    return raw ? decoder.decode(raw).split("\n").filter((name) => name.length > 0) : [];
+  } catch {
+    return [];
+  }
+}
+
+export async function save_project_bundle_files(project_id: string, names: string[]): Promise<void> {
+  if (!supported) return;
+  try {
+    const dir = await get_dir();
+    const projects = await dir.getDirectoryHandle(PROJECTS_DIR, { create: true });
+    const project = await projects.getDirectoryHandle(project_id, { create: true });
+    await write(project, BUNDLE_FILES, encoder.encode(names.join("\n") + "\n"));
+    dbg("cache", `saved ${names.length} predicted bundle files for ${project_id}`);
+  } catch (e) {
+    dbg("cache", `bundle file list save failed for ${project_id}: ${(e as Error).message}`);
+  }
+}
+
+// the command index of a project's last compile (<jobname>.cmds, see
+// xetex-cmdindex.c), under the format cache key on its first line: the
+// bundle's packages decide what it holds, so a different bundle misses. kept
+// outside projects/<id>/, which a successful compile replaces
+const COMMANDS_DIR = "commands";
+
+export async function load_command_index(project_id: string, format_key: string): Promise<string | null> {
+  if (!supported) return null;
+  try {
+    const raw = await read_nested(await get_dir(), `${COMMANDS_DIR}/${project_id}.txt`);
+    if (!raw) return null;
+    const text = decoder.decode(raw);
+    const eol = text.indexOf("\n");
+    return eol >= 0 && text.slice(0, eol) === format_key ? text.slice(eol + 1) : null;
+  } catch {
+    return null;
+  }
+}
+
+export async function save_command_index(project_id: string, format_key: string, text: string): Promise<void> {
+  if (!supported) return;
+  try {
+    await write_nested(await get_dir(), `${COMMANDS_DIR}/${project_id}.txt`, encoder.encode(`${format_key}\n${text}`));
+  } catch (e) {
+    dbg("cache", `command index save failed for ${project_id}: ${(e as Error).message}`);
+  }
+}
+
 export async function load_project_intermediates(project_id: string): Promise<Map<string, Uint8Array>> {
   const files = new Map<string, Uint8Array>();
   if (!supported) return files;
+  note_use(`${PROJECTS_DIR}/${project_id}`);
 
   try {
     const dir = await get_project_intermediates_dir(project_id, false);
@@ -347,3 +624,125 @@ export async function save_project_intermediates(
     dbg("cache", `intermediate save failed for ${project_id}: ${(e as Error).message}`);
   }
 }
+
+// -- size budget --
+// trim() keeps the cache within a budget (set_budget, else DEFAULT_BUDGET or
+// half the origin's quota, whichever is less) by dropping whole units, least
+// recently used first: a format (formats/<key>.fmt) or a project
+// (projects/<id>/ with its commands/<id>.txt). uses are recorded in
+// _usage.json as unit -> ms; a unit without a record counts from its newest
+// file. the pack, which holds the seed set, is never dropped: it is reset
+// with the bundle version instead. neither are the format and the projects
+// this worker used since it started.
+
+const USAGE_FILE = "_usage.json";
+const DEFAULT_BUDGET = 1024 * 1024 * 1024;
+
+let budget: number | null = null;
+// units used since the worker started
+const used = new Map<string, number>();
+
+export function set_budget(bytes: number | null): void {
+  budget = bytes;
+}
+
+export function note_use(unit: string): void {
+  used.set(unit, Date.now());
+}
+
+async function effective_budget(): Promise<number> {
+  if (budget !== null) return budget;
+  try {
+    const { quota } = await navigator.storage.estimate();
+    if (quota) return Math.min(DEFAULT_BUDGET, quota / 2);
+  } catch {
+    // no estimate
+  }
+  return DEFAULT_BUDGET;
+}
+
+type Usage = { bytes: number; time: number };
+
+// total size and newest modification of the files under handle
+async function tree_usage(handle: FileSystemHandle): Promise<Usage> {
+  if (handle.kind === "file") {
+    const file = await (handle as FileSystemFileHandle).getFile();
+    return { bytes: file.size, time: file.lastModified };
+  }
+  const out = { bytes: 0, time: 0 };
+  for await (const child of (handle as any).values() as AsyncIterable<FileSystemHandle>) {
+    const u = await tree_usage(child);
+    out.bytes += u.bytes;
+    out.time = Math.max(out.time, u.time);
+  }
+  return out;
+}
+
+async function child_dir(dir: FileSystemDirectoryHandle, name: string): Promise<FileSystemDirectoryHandle | null> {
+  return dir.getDirectoryHandle(name).catch(() => null);
+}
+
+// record this worker's uses and drop the least recently used units until
+// the cache fits its budget. run after a compile, off its critical path
+export async function trim(): Promise<void> {
+  if (!supported) return;
+  try {
+    const dir = await get_dir();
+    const recorded = ((await read_json(dir, USAGE_FILE)) ?? {}) as Record<string, number>;
+    const total = (await tree_usage(dir)).bytes;
+
+    type Unit = { name: string; bytes: number; time: number; remove: () => Promise<void> };
+    const units: Unit[] = [];
+    const formats = await child_dir(dir, "formats");
+    if (formats) {
+      for await (const [name, handle] of (formats as any).entries() as AsyncIterable<[string, FileSystemHandle]>) {
+        const u = await tree_usage(handle);
+        units.push({ name: `formats/${name}`, ...u, remove: () => formats.removeEntry(name, { recursive: true }) });
+      }
+    }
+    const projects = await child_dir(dir, PROJECTS_DIR);
+    const commands = await child_dir(dir, COMMANDS_DIR);
+    if (projects) {
+      for await (const [id, handle] of (projects as any).entries() as AsyncIterable<[string, FileSystemHandle]>) {
+        const u = await tree_usage(handle);
+        units.push({
+          name: `${PROJECTS_DIR}/${id}`,
+          ...u,
+          remove: async () => {
+            await projects.removeEntry(id, { recursive: true });
+            await commands?.removeEntry(`${id}.txt`).catch(() => {});
+          },
+        });
+      }
+    }
+    for (const unit of units) {
+      unit.time = Math.max(unit.time, recorded[unit.name] ?? 0, used.get(unit.name) ?? 0);
+    }
+
+    const limit = await effective_budget();
+    let size = total;
+    const dropped = new Set<string>();
+    if (size > limit) {
+      const candidates = units.filter((u) => !used.has(u.name)).sort((a, b) => a.time - b.time);
+      for (const unit of candidates) {
+        if (size <= limit) break;
+        try {
+          await unit.remove();
+          size -= unit.bytes;
+          dropped.add(unit.name);
+        } catch {
+          // in use by another tab; try the next one
+        }
+      }
+      if (dropped.size > 0) {
+        dbg("cache", `over budget (${format_size(total)} of ${format_size(limit)}): dropped ${dropped.size} formats and projects`);
+      }
+    }
+
+    const usage: Record<string, number> = {};
+    for (const unit of units) if (!dropped.has(unit.name)) usage[unit.name] = unit.time;
+    await write(dir, USAGE_FILE, encoder.encode(JSON.stringify(usage)));
+  } catch (e) {
+    dbg("cache", `trim failed: ${(e as Error).message}`);
+  }
+}
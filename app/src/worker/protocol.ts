@@ -9,6 +9,27 @@ export type Diagnostic = {
   context?: string; // pipe-indented context lines joined with \n
 };
 
+// commands and environments the document can use (see xetex-cmdindex.c), each
+// sorted for prefix search. kinds has a letter per command: "m" for a macro,
+// "p" for a primitive or other command
+export type CommandIndex = { commands: string[]; kinds: string; environments: string[] };
+
+// where a compile's time went: the engine's stages from its --trace (each
+// pass, format load, bibtex, PDF generation), then the bundle files fetched
+// over the network and those read from the OPFS cache
+export type CompileStage = { name: string; detail?: string; ms: number };
+export type CompileTimings = {
+  total_ms: number;
+  stages: CompileStage[];
+  fetches: number;
+  fetch_bytes: number;
+  fetch_ms: number;
+  cache_hits: number;
+  opfs_reads: number;
+  opfs_bytes: number;
+  opfs_ms: number;
+};
+
 export type WorkerOutMsg =
   | { type: "status"; msg: string; cls: string }
   | { type: "progress"; pct: number }
@@ -16,15 +37,37 @@ export type WorkerOutMsg =
   | { type: "diagnostic"; diag: Diagnostic }
   | { type: "cache_status"; status: string; detail: string }
   | { type: "ready" }
-  | { type: "complete"; pdf: Uint8Array | null; synctex: Uint8Array | null; elapsed: string };
+  // sent as soon as the engine has written the PDF, ahead of "complete"
+  | { type: "pdf"; pdf: Uint8Array; pages: (string | null)[] | null }
+  | { type: "complete"; ok: boolean; synctex: Uint8Array | null; elapsed: string; synctex_index: Uint8Array | null }
+  // sent ahead of "complete" for a compile that ran to the end
+  | { type: "timings"; timings: CompileTimings }
+  // sent when the project's command index differs from the one sent last
+  | { type: "commands"; index: CommandIndex }
+  // a preview compile stopped because a newer one superseded it
+  | { type: "cancelled" };
 
 export type FileContent = string | Uint8Array;
 export type ProjectFiles = Record<string, FileContent>;
 export type CompileMode = "preview" | "full";
 
 export type WorkerInMsg =
-  | { type: "init" }
-  | { type: "compile"; files: ProjectFiles; main?: string; mode?: CompileMode }
+  // simd=false pins the baseline engine build. cancel: one Int32 the main
+  // thread raises to stop superseded compiles (see engine.cancel_below).
+  // tab_lock: the Web Lock a tab of the shared engine holds while connected.
+  // cache_budget: bytes the OPFS cache is trimmed to (see opfs.trim)
+  | { type: "init"; simd?: boolean; cancel?: SharedArrayBuffer; tab_lock?: string; cache_budget?: number }
+  // the worker's project tree, kept across compiles and synced per file
+  | { type: "file_changed"; path: string; version: number; content: FileContent }
+  | { type: "file_deleted"; path: string }
+  // ?pipeline=1: this worker stops previews at the XDV and sends it over the
+  // port to a second worker, started with init_pdf, which writes the PDF
+  | { type: "pdf_port"; port: MessagePort }
+  | { type: "init_pdf"; port: MessagePort }
+  // seq numbers compiles in the order the main thread posts them
+  | { type: "compile"; main?: string; mode?: CompileMode; seq?: number; focus?: string; pages?: string }
+  // stop preview compiles numbered below `below`; used without shared memory
+  | { type: "cancel"; below: number }
   | { type: "clear_cache" };
 
 // debug flag: set via ?debug=1 query param (passed from main thread) or EZTEX_DEBUG env
@@ -44,8 +87,17 @@ export function dbg(scope: string, msg: string): void {
   send_log(line, "log-debug");
 }
 
+// where messages go: the worker's own scope, or in the shared engine the
+// port of the tab whose request is running (see shared_worker.ts)
+type ReplyTarget = { postMessage(message: unknown, options?: StructuredSerializeOptions): void };
+let reply_target: ReplyTarget = self as unknown as ReplyTarget;
+
+export function set_reply_target(target: ReplyTarget): void {
+  reply_target = target;
+}
+
 function send(type: string, data: Record<string, unknown> = {}): void {
-  self.postMessage({ type, ...data });
+  reply_target.postMessage({ type, ...data });
 }
 
 export function send_log(msg: string, cls: string = ""): void {
@@ -74,12 +126,37 @@ export function send_cache_status(status: string, detail: string = ""): void {
   send("cache_status", { status, detail });
 }
 
-export function send_complete(pdf: Uint8Array | null, synctex: Uint8Array | null, elapsed: string): void {
-  const msg = { type: "complete", pdf, synctex, elapsed };
+// pages: a digest per page of the PDF (see dpx-pagedigest.c), when known;
+// null for a page written blank
+// synctex_index: the compiled .synctex.idx (see SynctexIndex.zig), when written
+// buffers are transferred: the worker must not touch them afterwards
+export function send_pdf(pdf: Uint8Array, pages: (string | null)[] | null): void {
+  reply_target.postMessage({ type: "pdf", pdf, pages }, { transfer: [pdf.buffer as ArrayBuffer] });
+}
+
+export function send_complete(
+  ok: boolean,
+  synctex: Uint8Array | null,
+  elapsed: string,
+  synctex_index: Uint8Array | null = null,
+): void {
+  const msg = { type: "complete", ok, synctex, elapsed, synctex_index };
   const transfer: ArrayBuffer[] = [];
-  if (pdf) transfer.push(pdf.buffer as ArrayBuffer);
   if (synctex) transfer.push(synctex.buffer as ArrayBuffer);
-  self.postMessage(msg, { transfer });
+  if (synctex_index) transfer.push(synctex_index.buffer as ArrayBuffer);
+  reply_target.postMessage(msg, { transfer });
+}
+
+export function send_timings(timings: CompileTimings): void {
+  send("timings", { timings });
+}
+
+export function send_commands(index: CommandIndex): void {
+  send("commands", { index });
+}
+
+export function send_cancelled(): void {
+  send("cancelled", {});
 }
 
 export function send_ready(): void {
@@ -0,0 +1,161 @@
+// search worker: a trigram index over the project's text files, for
+// SearchPanel. a file is re-indexed only when it is posted again, which the
+// client does when its version moves; a query scans only the files whose
+// lowercased text holds every trigram of the lowercased query.
+
+export type SearchResult = {
+  file: string;
+  line: number;
+  column: number;
+  snippet: string;
+};
+
+export type FileGroup = {
+  file: string;
+  results: SearchResult[];
+};
+
+export type SearchRequest =
+  | { type: "file_changed"; path: string; text: string }
+  | { type: "file_deleted"; path: string }
+  | { type: "clear" }
+  | { type: "search"; id: number; query: string; case_sensitive: boolean };
+
+export type SearchResponse = { type: "results"; id: number; groups: FileGroup[] };
+
+type IndexedFile = {
+  text: string;
+  lower: string;
+  trigrams: Set<number>;
+  // offsets just past each "\n", built on the first match in the file
+  line_starts: number[] | null;
+};
+
+const files = new Map<string, IndexedFile>();
+// trigram -> paths whose lowercased text contains it
+const postings = new Map<number, Set<string>>();
+
+// three UTF-16 units packed into one exact integer (48 bits)
+function trigrams_of(s: string): Set<number> {
+  const out = new Set<number>();
+  for (let i = 0; i + 2 < s.length; i++) {
+    out.add(s.charCodeAt(i) * 0x1_0000_0000 + s.charCodeAt(i + 1) * 0x1_0000 + s.charCodeAt(i + 2));
+  }
+  return out;
+}
+
+function remove_file(path: string): void {
+  const file = files.get(path);
+  if (!file) return;
+  for (const t of file.trigrams) {
+    const paths = postings.get(t);
+    if (!paths) continue;
+    paths.delete(path);
+    if (paths.size === 0) postings.delete(t);
+  }
+  files.delete(path);
+}
+
+function index_file(path: string, text: string): void {
+  remove_file(path);
+  const lower = text.toLowerCase();
+  const trigrams = trigrams_of(lower);
+  for (const t of trigrams) {
+    let paths = postings.get(t);
+    if (!paths) postings.set(t, (paths = new Set()));
+    paths.add(path);
+  }
+  files.set(path, { text, lower, trigrams, line_starts: null });
+}
+
+// paths that may hold needle; every path for queries shorter than a trigram
+function candidates(needle: string): string[] {
+  if (needle.length < 3) return [...files.keys()];
+  const lists: Set<string>[] = [];
+  for (const t of trigrams_of(needle)) {
+    const paths = postings.get(t);
+    if (!paths) return [];
+    lists.push(paths);
+  }
+  lists.sort((a, b) => a.size - b.size);
+  const [first, ...rest] = lists;
+  return [...first].filter((path) => rest.every((paths) => paths.has(path)));
+}
+
+function line_starts_of(text: string): number[] {
+  const starts = [0];
+  for (let i = text.indexOf("\n"); i >= 0; i = text.indexOf("\n", i + 1)) starts.push(i + 1);
+  return starts;
+}
+
+// index of the last line start <= offset
+function line_of(starts: number[], offset: number): number {
+  let lo = 0;
+  let hi = starts.length - 1;
+  while (lo < hi) {
+    const mid = (lo + hi + 1) >> 1;
+    if (starts[mid] <= offset) lo = mid;
+    else hi = mid - 1;
+  }
+  return lo;
+}
+
+function search_file(path: string, file: IndexedFile, query: string, case_sensitive: boolean): SearchResult[] {
+  const needle = case_sensitive ? query : query.toLowerCase();
+  const haystack = case_sensitive ? file.text : file.lower;
+  const results: SearchResult[] = [];
+  let index = haystack.indexOf(needle);
+  if (index < 0) return results;
+  const starts = (file.line_starts ??= line_starts_of(file.text));
+  while (index >= 0) {
+    const line = line_of(starts, index);
+    const line_start = starts[line];
+    let line_end = line + 1 < starts.length ? starts[line + 1] - 1 : file.text.length;
+    if (line_end > line_start && file.text.charCodeAt(line_end - 1) === 13) line_end--; // "\r"
+    const text = file.text.slice(line_start, line_end);
+    const column = index - line_start;
+    const start = Math.max(0, column - 48);
+    const end = Math.min(text.length, column + query.length + 72);
+    const prefix = start > 0 ? "..." : "";
+    const suffix = end < text.length ? "..." : "";
+    results.push({
+      file: path,
+      line: line + 1,
+      column: column + 1,
+      snippet: `${prefix}${text.slice(start, end)}${suffix}`,
+    });
+    index = haystack.indexOf(needle, index + Math.max(1, needle.length));
+  }
+  return results;
+}
+
+function search(query: string, case_sensitive: boolean): FileGroup[] {
+  const groups: FileGroup[] = [];
+  for (const path of candidates(query.toLowerCase())) {
+    const results = search_file(path, files.get(path)!, query, case_sensitive);
+    if (results.length > 0) groups.push({ file: path, results });
+  }
+  return groups;
+}
+
+self.onmessage = (e: MessageEvent) => {
+  const msg = e.data as SearchRequest;
+  if (!msg || typeof msg.type !== "string") return;
+  switch (msg.type) {
+    case "file_changed":
+      index_file(msg.path, msg.text);
+      break;
+    case "file_deleted":
+      remove_file(msg.path);
+      break;
+    case "clear":
+      files.clear();
+      postings.clear();
+      break;
+    case "search": {
+      const reply: SearchResponse = { type: "results", id: msg.id, groups: search(msg.query, msg.case_sensitive) };
+      self.postMessage(reply);
+      break;
+    }
+  }
+};
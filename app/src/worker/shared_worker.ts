@@ -0,0 +1,144 @@
+// shared engine entry point: with ?shared=1 every tab connects to this one
+// SharedWorker instead of starting a worker of its own, so the WASM module,
+// the bundle cache and the resident instance exist once however many tabs
+// are open.
+//
+// each tab keeps its own project tree here (engine.ProjectTree); file
+// messages go straight into it. requests that answer (init, compile,
+// clear_cache) run one at a time across tabs, with the engine switched to
+// the asking tab's tree and its replies sent to that tab's port. compiles
+// are renumbered in the order they run, since every tab counts its own.
+//
+// a tab holds a Web Lock for as long as it is connected (see
+// worker_client.init_worker); when this worker is granted the lock, the tab
+// is gone and its tree is dropped.
+
+import * as engine from "./engine.ts";
+import { log, send_status, set_debug, set_reply_target, dbg, type WorkerInMsg } from "./protocol.ts";
+
+type Tab = {
+  port: MessagePort;
+  tree: engine.ProjectTree;
+};
+
+type Task = {
+  tab: Tab;
+  msg: WorkerInMsg;
+};
+
+const queue: Task[] = [];
+let pumping = false;
+let initialized = false;
+// compiles numbered in the order they run here
+let engine_seq = 0;
+// the compile on the engine now: its tab, that tab's number for it, ours
+let running: { tab: Tab; seq: number; engine_seq: number; preview: boolean } | null = null;
+
+async function run(task: Task): Promise<void> {
+  const { tab, msg } = task;
+  set_reply_target(tab.port);
+  engine.use_project_tree(tab.tree);
+  switch (msg.type) {
+    case "init":
+      // the first tab's init loads the engine; later tabs only hear it is ready
+      if (initialized) {
+        tab.port.postMessage({ type: "ready" });
+        return;
+      }
+      dbg("shared", "init message received");
+      if (msg.cache_budget) engine.set_cache_budget(msg.cache_budget);
+      await engine.init(msg.simd ?? true);
+      initialized = true;
+      return;
+    case "compile": {
+      dbg("shared", `compile: mode=${msg.mode ?? "full"}, main=${msg.main}`);
+      const mode = msg.mode ?? "full";
+      running = { tab, seq: msg.seq ?? 0, engine_seq: ++engine_seq, preview: mode === "preview" };
+      try {
+        await engine.compile(msg.main, mode, running.engine_seq, msg.focus, msg.pages);
+      } finally {
+        running = null;
+      }
+      return;
+    }
+    case "clear_cache":
+      await engine.clear_cache();
+      return;
+  }
+}
+
+async function pump(): Promise<void> {
+  if (pumping) return;
+  pumping = true;
+  while (queue.length > 0) {
+    const task = queue.shift()!;
+    try {
+      await run(task);
+    } catch (err) {
+      const message = err instanceof Error ? err.message : String(err);
+      log("shared", "error", message);
+      if (err instanceof Error && err.stack) dbg("shared", `stack: ${err.stack}`);
+      send_status("Error", "error");
+    }
+  }
+  pumping = false;
+}
+
+// stop the tab's previews numbered below `below`: queued ones are dropped
+// here, a running one is stopped by the engine at its next page
+function cancel(tab: Tab, below: number): void {
+  for (let i = queue.length - 1; i >= 0; i--) {
+    const { tab: owner, msg } = queue[i];
+    if (owner !== tab || msg.type !== "compile" || msg.mode !== "preview" || (msg.seq ?? 0) >= below) continue;
+    queue.splice(i, 1);
+    tab.port.postMessage({ type: "cancelled" });
+  }
+  if (running && running.tab === tab && running.preview && running.seq < below) {
+    engine.cancel_below(running.engine_seq + 1);
+  }
+}
+
+function drop(tab: Tab): void {
+  for (let i = queue.length - 1; i >= 0; i--) {
+    if (queue[i].tab === tab) queue.splice(i, 1);
+  }
+  tab.tree = engine.create_project_tree();
+  dbg("shared", "tab disconnected");
+}
+
+function connect(port: MessagePort): void {
+  const tab: Tab = { port, tree: engine.create_project_tree() };
+  port.onmessage = (e: MessageEvent) => {
+    const msg = e.data as WorkerInMsg & { debug?: boolean };
+    if (!msg || typeof msg.type !== "string") return;
+    if (msg.debug) set_debug(true);
+    switch (msg.type) {
+      case "init":
+        if (msg.tab_lock) void navigator.locks.request(msg.tab_lock, () => drop(tab));
+        queue.push({ tab, msg });
+        void pump();
+        break;
+      case "file_changed":
+        engine.file_changed(msg.path, msg.version, msg.content, tab.tree);
+        break;
+      case "file_deleted":
+        engine.file_deleted(msg.path, tab.tree);
+        break;
+      case "cancel":
+        cancel(tab, msg.below);
+        break;
+      case "compile":
+      case "clear_cache":
+        queue.push({ tab, msg });
+        void pump();
+        break;
+      default:
+        // the PDF worker of ?pipeline=1 is not shared
+        port.postMessage({ type: "log", msg: `[shared] warn: unsupported message type: ${msg.type}`, cls: "log-warn" });
+    }
+  };
+}
+
+(self as unknown as { onconnect: (e: MessageEvent) => void }).onconnect = (e: MessageEvent) => {
+  connect(e.ports[0]);
+};
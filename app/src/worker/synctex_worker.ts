@@ -0,0 +1,92 @@
+// synctex worker: holds the sync data of the last compile and answers
+// forward/reverse queries, so gunzip and parse never block the editor.
+// messages are handled one at a time, in order, so a query posted after a
+// load is answered from the loaded data.
+
+import { decompress_gzip, parse_synctex, sync_to_pdf, sync_to_code } from "../lib/synctex.ts";
+import type { PdfSyncObject, SyncToPdfResult, SyncToCodeResult } from "../lib/synctex.ts";
+import { open_synctex_index, index_sync_to_pdf, index_sync_to_code } from "../lib/synctex_index.ts";
+import type { SynctexIndex } from "../lib/synctex_index.ts";
+
+export type SynctexRequest =
+  // after a compile: the .synctex.gz and the compiled index, either may be null
+  | { type: "load"; gen: number; synctex: Uint8Array | null; index: Uint8Array | null }
+  // a saved .synctex text, on project open
+  | { type: "restore"; gen: number; text: string }
+  | { type: "forward"; id: number; file: string; line: number }
+  | { type: "reverse"; id: number; page: number; x: number; y: number }
+  | { type: "clear" };
+
+export type SynctexResponse =
+  // the text is sent as soon as it is inflated, before the parse
+  | { type: "text"; gen: number; text: string | null }
+  | { type: "error"; gen: number }
+  | { type: "forward"; id: number; result: SyncToPdfResult | null }
+  | { type: "reverse"; id: number; result: SyncToCodeResult | null };
+
+// the compiled index is preferred over the parsed text
+let index: SynctexIndex | null = null;
+let data: PdfSyncObject | null = null;
+
+function reply(msg: SynctexResponse) {
+  self.postMessage(msg);
+}
+
+async function load(gen: number, synctex: Uint8Array | null, index_bytes: Uint8Array | null) {
+  const opened = index_bytes ? open_synctex_index(index_bytes) : null;
+  if (opened) {
+    index = opened;
+    data = null;
+  }
+  if (!synctex || synctex.length === 0) {
+    reply({ type: "text", gen, text: null });
+    return;
+  }
+  // the text is still sent for save_synctex; only parsing is skipped
+  const text = await decompress_gzip(synctex);
+  reply({ type: "text", gen, text });
+  if (!opened) restore(gen, text);
+}
+
+function restore(gen: number, text: string) {
+  const parsed = parse_synctex(text);
+  if (!parsed) {
+    reply({ type: "error", gen });
+    return;
+  }
+  index = null;
+  data = parsed;
+}
+
+function handle(msg: SynctexRequest): Promise<void> | void {
+  switch (msg.type) {
+    case "load":
+      return load(msg.gen, msg.synctex, msg.index);
+    case "restore":
+      return restore(msg.gen, msg.text);
+    case "forward": {
+      const result = index ? index_sync_to_pdf(index, msg.file, msg.line)
+        : data ? sync_to_pdf(data, msg.file, msg.line) : null;
+      return reply({ type: "forward", id: msg.id, result });
+    }
+    case "reverse": {
+      const result = index ? index_sync_to_code(index, msg.page, msg.x, msg.y)
+        : data ? sync_to_code(data, msg.page, msg.x, msg.y) : null;
+      return reply({ type: "reverse", id: msg.id, result });
+    }
+    case "clear":
+      index = null;
+      data = null;
+      return;
+  }
+}
+
+let queue: Promise<void> = Promise.resolve();
+
+self.onmessage = (e: MessageEvent) => {
+  const msg = e.data as SynctexRequest;
+  if (!msg || typeof msg.type !== "string") return;
+  queue = queue.then(() => handle(msg)).catch(() => {
+    if (msg.type === "load" || msg.type === "restore") reply({ type: "error", gen: msg.gen });
+  });
+};
@@ -0,0 +1,60 @@
+// one thread of the threaded engine (see threads.ts): runs wasi_thread_start
+// on an instance of the engine module bound to the spawning instance's
+// memory, then marks its pool slot idle again. the instance is kept for the
+// next spawn on the same memory.
+
+import { SLOT_IDLE, type ThreadInitMsg, type ThreadStartMsg } from "./threads.ts";
+
+const ENOSYS = 52;
+
+let module: WebAssembly.Module | null = null;
+let states: Int32Array | null = null;
+let bound: { memory_id: number; instance: WebAssembly.Instance } | null = null;
+
+// a compression thread only allocates and deflates. anything else it would
+// import gets a stub: WASI calls fail with ENOSYS, env calls with -1.
+function thread_imports(memory: WebAssembly.Memory): WebAssembly.Imports {
+  const imports: Record<string, Record<string, WebAssembly.ImportValue>> = {};
+  for (const imp of WebAssembly.Module.imports(module!)) {
+    const ns = (imports[imp.module] ??= {});
+    if (imp.kind === "memory") {
+      ns[imp.name] = memory;
+    } else if (imp.kind === "function") {
+      ns[imp.name] = imp.module === "wasi_snapshot_preview1" ? () => ENOSYS : () => -1;
+    }
+  }
+  const wasi = imports.wasi_snapshot_preview1 ?? {};
+  wasi.sched_yield = () => 0;
+  wasi.random_get = (ptr: number, len: number) => {
+    const bytes = new Uint8Array(len);
+    crypto.getRandomValues(bytes);
+    new Uint8Array(memory.buffer, ptr, len).set(bytes);
+    return 0;
+  };
+  wasi.proc_exit = (code: number) => {
+    throw new Error(`engine thread exited with ${code}`);
+  };
+  // no threads of threads
+  (imports.wasi ??= {})["thread-spawn"] = () => -1;
+  return imports;
+}
+
+self.onmessage = (e: MessageEvent<ThreadInitMsg | ThreadStartMsg>) => {
+  const msg = e.data;
+  if (msg.type === "init") {
+    module = msg.module;
+    states = msg.states;
+    return;
+  }
+  try {
+    if (!bound || bound.memory_id !== msg.memory_id) {
+      bound = { memory_id: msg.memory_id, instance: new WebAssembly.Instance(module!, thread_imports(msg.memory)) };
+    }
+    (bound.instance.exports.wasi_thread_start as (tid: number, arg: number) => void)(msg.tid, msg.arg);
+  } catch (err) {
+    console.error(`engine thread ${msg.tid}:`, err);
+    bound = null;
+  } finally {
+    Atomics.store(states!, msg.slot, SLOT_IDLE);
+  }
+};
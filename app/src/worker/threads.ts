@@ -0,0 +1,195 @@
+// wasi-threads for the threaded engine build (eztex-simd-threads.wasm)
+//
+// that build imports its memory (shared) and "wasi"."thread-spawn", which
+// std.Thread calls for the PDF stream compression jobs of Flate.zig. a spawn
+// runs wasi_thread_start(tid, arg) on a pooled web worker (thread_worker.ts)
+// holding an instance of the same module on the spawner's memory.
+//
+// the pool is started with the engine: a worker created while the engine is
+// blocked in a compile would not start until the compile yields, and the
+// compile joins its threads before it does. slot states live in shared
+// memory too, so a worker frees its slot without a message the busy engine
+// could not read. no free slot: thread-spawn fails and the job is deflated
+// inline (see defer_stream in dpx-pdfobj.c), so output never depends on it.
+
+import { dbg } from "./protocol.ts";
+
+export type MemoryLimits = { initial: number; maximum: number };
+
+export type ThreadStartMsg = {
+  type: "start";
+  memory: WebAssembly.Memory;
+  memory_id: number;
+  tid: number;
+  arg: number;
+  slot: number;
+};
+
+export type ThreadInitMsg = {
+  type: "init";
+  module: WebAssembly.Module;
+  states: Int32Array;
+};
+
+export const SLOT_IDLE = 0;
+export const SLOT_BUSY = 1;
+
+// threads past the engine itself; more than the streams xdvipdfmx deflates
+// at once (compression_threads in src/engine/tectonic.zig) would never run
+const MAX_POOL = 8;
+
+let limits: MemoryLimits | null = null;
+let pool: Worker[] = [];
+let states: Int32Array | null = null;
+let next_tid = 1;
+const memory_ids = new WeakMap<WebAssembly.Memory, number>();
+let next_memory_id = 1;
+
+// shared wasm memory, cross-origin isolation and a spare core
+export function available(): boolean {
+  if (typeof SharedArrayBuffer === "undefined" || !globalThis.crossOriginIsolated) return false;
+  if ((navigator.hardwareConcurrency ?? 1) < 2) return false;
+  try {
+    const probe = new WebAssembly.Memory({ initial: 1, maximum: 1, shared: true });
+    return probe.buffer instanceof SharedArrayBuffer;
+  } catch {
+    return false;
+  }
+}
+
+function read_leb(bytes: Uint8Array, at: { pos: number }): number | undefined {
+  let result = 0;
+  let shift = 0;
+  while (at.pos < bytes.length) {
+    const byte = bytes[at.pos++];
+    result += (byte & 0x7f) * 2 ** shift;
+    if ((byte & 0x80) === 0) return result;
+    shift += 7;
+  }
+  return undefined;
+}
+
+// limits of the memory a module imports, read from its import section.
+// undefined while bytes does not reach past that section yet, null when the
+// module imports no memory.
+export function parse_memory_import(bytes: Uint8Array): MemoryLimits | null | undefined {
+  const at = { pos: 8 };
+  while (at.pos < bytes.length) {
+    const id = bytes[at.pos++];
+    const size = read_leb(bytes, at);
+    if (size === undefined) return undefined;
+    if (id !== 2) {
+      // imports come before code and data; past them there is none
+      if (id > 2 && id !== 0) return null;
+      at.pos += size;
+      continue;
+    }
+    if (at.pos + size > bytes.length) return undefined;
+    const count = read_leb(bytes, at)!;
+    for (let i = 0; i < count; i++) {
+      // module and field names; the length is read before the skip
+      for (let name = 0; name < 2; name++) {
+        const len = read_leb(bytes, at)!;
+        at.pos += len;
+      }
+      const kind = bytes[at.pos++];
+      if (kind === 0) {
+        read_leb(bytes, at);
+      } else if (kind === 1) {
+        at.pos++;
+        const flags = bytes[at.pos++];
+        read_leb(bytes, at);
+        if (flags & 1) read_leb(bytes, at);
+      } else if (kind === 2) {
+        const flags = bytes[at.pos++];
+        const initial = read_leb(bytes, at)!;
+        const maximum = flags & 1 ? read_leb(bytes, at)! : 65536;
+        return { initial, maximum };
+      } else if (kind === 3) {
+        at.pos += 2;
+      } else if (kind === 4) {
+        at.pos++;
+        read_leb(bytes, at);
+      }
+    }
+    return null;
+  }
+  return undefined;
+}
+
+// the memory limits from the head of a module response, read from a clone
+// so the original can still be compiled while it streams
+export async function read_memory_limits(resp: Response): Promise<MemoryLimits | null> {
+  const reader = resp.clone().body?.getReader();
+  if (!reader) return null;
+  let bytes = new Uint8Array(0);
+  try {
+    while (bytes.length < 1024 * 1024) {
+      const { done, value } = await reader.read();
+      if (done) return parse_memory_import(bytes) ?? null;
+      const grown = new Uint8Array(bytes.length + value.length);
+      grown.set(bytes);
+      grown.set(value, bytes.length);
+      bytes = grown;
+      const parsed = parse_memory_import(bytes);
+      if (parsed !== undefined) return parsed;
+    }
+    return null;
+  } finally {
+    void reader.cancel();
+  }
+}
+
+// start the worker pool for module; later engine instances get threads
+export function start(module: WebAssembly.Module, memory_limits: MemoryLimits): void {
+  if (states) return;
+  const size = Math.min(MAX_POOL, (navigator.hardwareConcurrency ?? 2) - 1);
+  limits = memory_limits;
+  states = new Int32Array(new SharedArrayBuffer(size * 4));
+  for (let i = 0; i < size; i++) {
+    const worker = new Worker(new URL("./thread_worker.ts", import.meta.url), { type: "module" });
+    worker.postMessage({ type: "init", module, states } satisfies ThreadInitMsg);
+    pool.push(worker);
+  }
+  dbg("threads", `${size} thread workers for the threaded engine`);
+}
+
+export function enabled(): boolean {
+  return limits !== null;
+}
+
+export function memory_limits(): MemoryLimits | null {
+  return limits;
+}
+
+// the imports a threaded engine instance needs beyond WASI and env: a fresh
+// shared memory, and thread-spawn on it. spawn=false for instances that
+// never compile (the api instance), which then run everything inline.
+export function instance_imports(spawn: boolean = true): {
+  memory: WebAssembly.Memory;
+  wasi: Record<string, (arg: number) => number>;
+} | null {
+  if (!limits) return null;
+  const memory = new WebAssembly.Memory({ initial: limits.initial, maximum: limits.maximum, shared: true });
+  const memory_id = next_memory_id++;
+  memory_ids.set(memory, memory_id);
+  return {
+    memory,
+    wasi: {
+      "thread-spawn": (arg: number): number => (spawn ? spawn_thread(memory, memory_id, arg) : -1),
+    },
+  };
+}
+
+function spawn_thread(memory: WebAssembly.Memory, memory_id: number, arg: number): number {
+  if (!states) return -1;
+  for (let slot = 0; slot < pool.length; slot++) {
+    if (Atomics.compareExchange(states, slot, SLOT_IDLE, SLOT_BUSY) !== SLOT_IDLE) continue;
+    // wasi-threads ids are positive and below 2^29
+    const tid = next_tid;
+    next_tid = next_tid >= 0x1fffffff ? 1 : next_tid + 1;
+    pool[slot].postMessage({ type: "start", memory, memory_id, tid, arg, slot } satisfies ThreadStartMsg);
+    return tid;
+  }
+  return -1;
+}
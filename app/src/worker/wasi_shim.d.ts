@@ -30,5 +30,6 @@ declare module "@bjorn3/browser_wasi_shim" {
     wasiImport: Record<string, WebAssembly.ImportValue>;
     constructor(args: string[], env: string[], fds: Fd[]);
     start(instance: WebAssembly.Instance): number;
+    initialize(instance: WebAssembly.Instance): void;
   }
 }
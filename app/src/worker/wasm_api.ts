@@ -19,10 +19,17 @@ interface EztexExports extends WebAssembly.Exports {
   eztex_query_main_file(list_ptr: number, list_len: number, out_ptr: number, out_cap: number): number;
   eztex_query_seed_init(out_ptr: number, out_cap: number): number;
   eztex_query_seed_format(out_ptr: number, out_cap: number): number;
-  eztex_query_index(name_ptr: number, name_len: number, out_offset: number, out_length: number): number;
+  eztex_query_seed_popular(out_ptr: number, out_cap: number): number;
+  eztex_query_index(
+    name_ptr: number,
+    name_len: number,
+    out_offset: number,
+    out_length: number,
+    out_raw_length: number,
+  ): number;
   eztex_query_format_serial(): number;
-  eztex_query_format_url(out_ptr: number, out_cap: number): number;
-  eztex_query_format_cache_key(out_ptr: number, out_cap: number): number;
+  eztex_query_format_url(format_type: number, out_ptr: number, out_cap: number): number;
+  eztex_query_format_cache_key(format_type: number, out_ptr: number, out_cap: number): number;
 }
 
 let api_instance: WebAssembly.Instance | null = null;
@@ -87,7 +94,7 @@ export function cache_version(): string {
   const out_ptr = alloc(out_cap);
   const n = inst().eztex_query_cache_version(out_ptr, out_cap);
   const mem = new Uint8Array(inst().memory.buffer);
-  const s = decoder.decode(mem.subarray(out_ptr, out_ptr + n));
+  const s = decoder.decode(mem.slice(out_ptr, out_ptr + n));
   dealloc(out_ptr, out_cap);
   _cache_version = s;
   dbg("wasm_api", `cache_version: "${s}"`);
@@ -103,7 +110,7 @@ export function bundle_url(): string {
   const out_ptr = alloc(out_cap);
   const n = inst().eztex_query_bundle_url(out_ptr, out_cap);
   const mem = new Uint8Array(inst().memory.buffer);
-  const s = decoder.decode(mem.subarray(out_ptr, out_ptr + n));
+  const s = decoder.decode(mem.slice(out_ptr, out_ptr + n));
   dealloc(out_ptr, out_cap);
   _bundle_url = s;
   dbg("wasm_api", `bundle_url: "${s}"`);
@@ -119,7 +126,7 @@ export function index_url(): string {
   const out_ptr = alloc(out_cap);
   const n = inst().eztex_query_index_url(out_ptr, out_cap);
   const mem = new Uint8Array(inst().memory.buffer);
-  const s = decoder.decode(mem.subarray(out_ptr, out_ptr + n));
+  const s = decoder.decode(mem.slice(out_ptr, out_ptr + n));
   dealloc(out_ptr, out_cap);
   _index_url = s;
   dbg("wasm_api", `index_url: "${s}"`);
@@ -138,7 +145,7 @@ export function detect_main(filenames: string[]): string | null {
   mem.set(list_bytes, list_ptr);
 
   const n = inst().eztex_query_main_file(list_ptr, list_bytes.byteLength, out_ptr, out_cap);
-  const detected = n > 0 ? decoder.decode(mem.subarray(out_ptr, out_ptr + n)) : null;
+  const detected = n > 0 ? decoder.decode(mem.slice(out_ptr, out_ptr + n)) : null;
 
   dealloc(list_ptr, list_bytes.byteLength);
   dealloc(out_ptr, out_cap);
@@ -155,7 +162,7 @@ function read_newline_list(getter: (out_ptr: number, out_cap: number) => number,
   const ptr = alloc(cap);
   const n = getter(ptr, cap);
   const mem = new Uint8Array(inst().memory.buffer);
-  const text = decoder.decode(mem.subarray(ptr, ptr + n));
+  const text = decoder.decode(mem.slice(ptr, ptr + n));
   dealloc(ptr, cap);
   return text.split("\n").filter((s) => s.length > 0);
 }
@@ -174,6 +181,12 @@ export function query_seed_format(): string[] {
   return result;
 }
 
+export function query_seed_popular(): string[] {
+  const result = read_newline_list((p, c) => inst().eztex_query_seed_popular(p, c));
+  dbg("wasm_api", `query_seed_popular: ${result.length} files`);
+  return result;
+}
+
 let _format_serial: number | null = null;
 
 export function format_serial(): number {
@@ -183,6 +196,9 @@ export function format_serial(): number {
   return _format_serial;
 }
 
+// FormatCache.FormatType of the format the browser compiles with
+const FORMAT_XELATEX = 0;
+
 let _format_url: string | null = null;
 
 export function format_url(): string {
@@ -190,9 +206,9 @@ export function format_url(): string {
   dbg("wasm_api", "format_url: calling eztex_query_format_url");
   const out_cap = 512;
   const out_ptr = alloc(out_cap);
-  const n = inst().eztex_query_format_url(out_ptr, out_cap);
+  const n = inst().eztex_query_format_url(FORMAT_XELATEX, out_ptr, out_cap);
   const mem = new Uint8Array(inst().memory.buffer);
-  const s = decoder.decode(mem.subarray(out_ptr, out_ptr + n));
+  const s = decoder.decode(mem.slice(out_ptr, out_ptr + n));
   dealloc(out_ptr, out_cap);
   _format_url = s;
   dbg("wasm_api", `format_url: "${s}"`);
@@ -206,9 +222,9 @@ export function format_cache_key(): string {
   dbg("wasm_api", "format_cache_key: calling eztex_query_format_cache_key");
   const out_cap = 128;
   const out_ptr = alloc(out_cap);
-  const n = inst().eztex_query_format_cache_key(out_ptr, out_cap);
+  const n = inst().eztex_query_format_cache_key(FORMAT_XELATEX, out_ptr, out_cap);
   const mem = new Uint8Array(inst().memory.buffer);
-  const s = decoder.decode(mem.subarray(out_ptr, out_ptr + n));
+  const s = decoder.decode(mem.slice(out_ptr, out_ptr + n));
   dealloc(out_ptr, out_cap);
   _format_cache_key = s;
   dbg("wasm_api", `format_cache_key: "${s}"`);
@@ -217,9 +233,11 @@ export function format_cache_key(): string {
 
 // -- index lookup: resolve a filename to (offset, length) via Zig ITAR index --
 
+// raw_length is the inflated size of a gzip-compressed entry, 0 otherwise
 export interface IndexEntry {
   offset: bigint;
   length: number;
+  raw_length: number;
 }
 
 export function index_lookup(name: string): IndexEntry | null {
@@ -230,23 +248,32 @@ export function index_lookup(name: string): IndexEntry | null {
   const mem = new Uint8Array(inst().memory.buffer);
   mem.set(name_bytes, name_ptr);
 
-  // out_offset is u64 (8 bytes), out_length is u32 (4 bytes)
+  // out_offset is u64 (8 bytes), out_length and out_raw_length are u32 (4 bytes)
   const out_offset_ptr = alloc(8);
   const out_length_ptr = alloc(4);
+  const out_raw_length_ptr = alloc(4);
 
-  const rc = inst().eztex_query_index(name_ptr, name_bytes.byteLength, out_offset_ptr, out_length_ptr);
+  const rc = inst().eztex_query_index(
+    name_ptr,
+    name_bytes.byteLength,
+    out_offset_ptr,
+    out_length_ptr,
+    out_raw_length_ptr,
+  );
 
   let result: IndexEntry | null = null;
   if (rc === 0) {
     const view = new DataView(inst().memory.buffer);
     const offset = view.getBigUint64(out_offset_ptr, true);
     const length = view.getUint32(out_length_ptr, true);
-    result = { offset, length };
+    const raw_length = view.getUint32(out_raw_length_ptr, true);
+    result = { offset, length, raw_length };
   }
 
   dealloc(name_ptr, name_bytes.byteLength);
   dealloc(out_offset_ptr, 8);
   dealloc(out_length_ptr, 4);
+  dealloc(out_raw_length_ptr, 4);
 
   return result;
 }
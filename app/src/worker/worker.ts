@@ -15,11 +15,29 @@ self.onmessage = async (e: MessageEvent) => {
     switch (msg.type) {
       case "init":
         dbg("worker", "init message received");
-        await engine.init();
+        if (msg.cancel) engine.set_cancel_buffer(msg.cancel);
+        if (msg.cache_budget) engine.set_cache_budget(msg.cache_budget);
+        await engine.init(msg.simd ?? true);
+        break;
+      case "pdf_port":
+        engine.set_pdf_port(msg.port);
+        break;
+      case "init_pdf":
+        dbg("worker", "PDF worker init");
+        engine.init_pdf(msg.port);
+        break;
+      case "file_changed":
+        engine.file_changed(msg.path, msg.version, msg.content);
+        break;
+      case "file_deleted":
+        engine.file_deleted(msg.path);
         break;
       case "compile":
-        dbg("worker", `compile: mode=${msg.mode ?? "full"}, main=${msg.main}, files=${Object.keys(msg.files ?? {}).join(",")}`);
-        await engine.compile(msg.files ?? {}, msg.main, msg.mode ?? "full");
+        dbg("worker", `compile: mode=${msg.mode ?? "full"}, main=${msg.main}`);
+        await engine.compile(msg.main, msg.mode ?? "full", msg.seq ?? 0, msg.focus, msg.pages);
+        break;
+      case "cancel":
+        engine.cancel_below(msg.below);
         break;
       case "clear_cache":
         await engine.clear_cache();
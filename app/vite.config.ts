@@ -13,6 +13,9 @@ export default defineConfig({
           '**/*.{js,mjs,css,html,svg,png,ico,woff2,wasm}',
           'init/**/*',
         ],
+        // the ReleaseFast engine is fetched by the worker after first load,
+        // the threaded one only by cross-origin isolated pages
+        globIgnores: ['**/node_modules/**/*', 'sw.js', 'workbox-*.js', 'eztex-simd-fast.wasm', 'eztex-simd-threads.wasm'],
         navigateFallback: '/index.html',
         maximumFileSizeToCacheInBytes: 5 * 1024 * 1024,
         // Keep package and format fetches network-only; they are immutable and
@@ -30,4 +33,11 @@ export default defineConfig({
       manifest: false, // use public/manifest.webmanifest directly
     }),
   ],
+  // cross-origin isolation as public/_headers sets it, for the threaded engine
+  server: {
+    headers: {
+      'Cross-Origin-Opener-Policy': 'same-origin',
+      'Cross-Origin-Embedder-Policy': 'credentialless',
+    },
+  },
 })
@@ -2,6 +2,8 @@ const std = @import("std");
 
 const EngineSet = enum { all, tectonic };
 
+const ArtifactKind = enum { exe, shared_lib };
+
 pub fn build(b: *std.Build) void {
     const raw_target = b.standardTargetOptions(.{});
     const optimize = b.standardOptimizeOption(.{});
@@ -9,25 +11,44 @@ pub fn build(b: *std.Build) void {
     const is_wasm = raw_target.result.cpu.arch == .wasm32;
 
     const engines: EngineSet = b.option(EngineSet, "engines", "Engine set to link (all or tectonic)") orelse .all;
+    // sampling profiler (src/Sampler.zig): each compile logs the document
+    // lines its time went to, and wasm builds keep their function names
+    const sampling = b.option(bool, "sampling", "Log a sampling profile of each compile; keep wasm names") orelse false;
+    // Log.dbg compiled in; unset, each artifact decides by its optimize mode
+    // (on for Debug and ReleaseSafe), so the release wasm variants drop it
+    const debug_log = b.option(bool, "debug-log", "Compile in debug logging (default: Debug and ReleaseSafe only)");
 
     // build_options module so Zig source can query backend at comptime
     const options = b.addOptions();
     options.addOption([]const u8, "engines", @tagName(engines));
+    options.addOption(bool, "sampling", sampling);
+    options.addOption(?bool, "debug_log", debug_log);
     const options_mod = options.createModule();
 
     // for WASM targets, ensure exception_handling CPU features is enabled
     // (required for setjmp/longjmp via wasm exception handling proposal).
     // this avoids requiring -Dcpu=baseline+exception_handling on the CLI.
     // fixed in Zig 0.17.0-dev.269+ (PR #31438) -- wasi libc SJLJ compilation
+    // simd128 (every current browser) backs the vector paths in the C sources.
     const target = if (is_wasm) blk: {
         var query = raw_target.query;
         query.cpu_features_add.addFeature(@intFromEnum(std.Target.wasm.Feature.exception_handling));
+        query.cpu_features_add.addFeature(@intFromEnum(std.Target.wasm.Feature.simd128));
         break :blk b.resolveTargetQuery(query);
     } else raw_target;
 
-    const exe = buildEztex(b, target, optimize, engines, options_mod);
+    const exe = buildEztex(b, target, optimize, engines, options_mod, "src/main.zig", "eztex", .exe);
+    if (is_wasm and sampling) exe.root_module.strip = false;
     b.installArtifact(exe);
 
+    // libeztex: the in-memory compile API of src/Embedded.zig for other
+    // programs, C ones through its eztex_* exports (native only)
+    if (!is_wasm) {
+        const lib = buildEztex(b, target, optimize, engines, options_mod, "src/Embedded.zig", "eztex", .shared_lib);
+        const lib_step = b.step("lib", "Build libeztex, the embeddable in-memory compile library");
+        lib_step.dependOn(&b.addInstallArtifact(lib, .{}).step);
+    }
+
     // run step (native only)
     if (!is_wasm) {
         const run_cmd = b.addRunArtifact(exe);
@@ -39,28 +60,60 @@ pub fn build(b: *std.Build) void {
 
     // -- wasm step: build full engine for wasm32-wasi and copy to app/public/ --
     // This builds the complete eztex engine (tectonic + all deps) for the browser
-    // JS worker. The web app fetches /eztex.wasm and creates both api_instance
-    // (index queries) and compile_instance (wasi.start() to run TeX) from it.
+    // JS worker. Four variants are installed: eztex-simd.wasm with simd128,
+    // eztex.wasm without it, eztex-simd-fast.wasm, a ReleaseFast SIMD build
+    // that the worker caches after the first session and prefers from then on,
+    // and eztex-simd-threads.wasm for cross-origin isolated pages, which
+    // deflates PDF streams on wasi-threads (app/src/worker/threads.ts).
+    // The worker validates a tiny v128 module and fetches a SIMD build when the
+    // browser accepts it, creating both api_instance (index queries) and the
+    // resident compile instance from it.
     {
-        const wasm_query: std.Target.Query = .{
-            .os_tag = .wasi,
-            .cpu_arch = .wasm32,
-        };
-        const wasm_target = b.resolveTargetQuery(wasm_query);
-        // enable exception_handling for setjmp/longjmp
-        var query = wasm_target.query;
-        query.cpu_features_add.addFeature(@intFromEnum(std.Target.wasm.Feature.exception_handling));
-        const wasm_target_eh = b.resolveTargetQuery(query);
-
-        const wasm_exe = buildEztex(b, wasm_target_eh, .ReleaseSmall, engines, options_mod);
-
-        const copy = b.addInstallFileWithDir(
-            wasm_exe.getEmittedBin(),
-            .{ .custom = "../app/public" },
-            "eztex.wasm",
-        );
         const wasm_step = b.step("wasm", "Build full WASM engine and copy to app/public/");
-        wasm_step.dependOn(&copy.step);
+        const variants = [_]struct { name: []const u8, simd: bool, threads: bool = false, optimize: std.builtin.OptimizeMode }{
+            .{ .name = "eztex.wasm", .simd = false, .optimize = .ReleaseSmall },
+            .{ .name = "eztex-simd.wasm", .simd = true, .optimize = .ReleaseSmall },
+            .{ .name = "eztex-simd-fast.wasm", .simd = true, .optimize = .ReleaseFast },
+            .{ .name = "eztex-simd-threads.wasm", .simd = true, .threads = true, .optimize = .ReleaseSmall },
+        };
+        for (variants) |variant| {
+            const wasm_query: std.Target.Query = .{
+                .os_tag = .wasi,
+                .cpu_arch = .wasm32,
+            };
+            const wasm_target = b.resolveTargetQuery(wasm_query);
+            // exception_handling for setjmp/longjmp. bulk_memory lowers memcpy
+            // and memset to memory.copy/memory.fill; every engine with wasm
+            // exceptions has it. simd128 only goes into the SIMD variant.
+            var query = wasm_target.query;
+            query.cpu_features_add.addFeature(@intFromEnum(std.Target.wasm.Feature.exception_handling));
+            query.cpu_features_add.addFeature(@intFromEnum(std.Target.wasm.Feature.bulk_memory));
+            if (variant.simd) query.cpu_features_add.addFeature(@intFromEnum(std.Target.wasm.Feature.simd128));
+            if (variant.threads) query.cpu_features_add.addFeature(@intFromEnum(std.Target.wasm.Feature.atomics));
+            const wasm_target_eh = b.resolveTargetQuery(query);
+
+            const wasm_exe = buildEztex(b, wasm_target_eh, variant.optimize, engines, options_mod, "src/main.zig", "eztex", .exe);
+            // the name section, so browser profilers show engine functions
+            if (sampling) wasm_exe.root_module.strip = false;
+            // std.Thread spawns through the "wasi" "thread-spawn" import. each
+            // instance brings its own shared memory, which its threads import
+            // too; it is still exported for the WASI shim. 2 GiB, as every
+            // browser reserves that much for a shared memory.
+            if (variant.threads) {
+                wasm_exe.root_module.single_threaded = false;
+                wasm_exe.shared_memory = true;
+                wasm_exe.import_memory = true;
+                wasm_exe.export_memory = true;
+                wasm_exe.max_memory = 2 * 1024 * 1024 * 1024;
+            }
+
+            const copy = b.addInstallFileWithDir(
+                wasm_exe.getEmittedBin(),
+                .{ .custom = "../app/public" },
+                variant.name,
+            );
+            wasm_step.dependOn(&copy.step);
+        }
     }
 
     // -- unit tests (native only) --
@@ -69,12 +122,22 @@ pub fn build(b: *std.Build) void {
 
         // pure zig modules (no C deps)
         const pure_test_srcs: []const []const u8 = &.{
+            "src/BundleIndex.zig",
             "src/Config.zig",
+            "src/DiagRecords.zig",
             "src/FormatCache.zig",
             "src/MainDetect.zig",
+            "src/MemStats.zig",
+            "src/Packfile.zig",
+            "src/PdfUpdate.zig",
+            "src/Preamble.zig",
+            "src/SynctexIndex.zig",
+            "src/Sampler.zig",
+            "src/Timeline.zig",
             "src/Watcher.zig",
-            "src/World.zig",
             "src/compile/aux.zig",
+            "src/compile/memo.zig",
+            "src/compile/pictures.zig",
         };
         for (pure_test_srcs) |src| {
             const mod = b.createModule(.{
@@ -82,6 +145,8 @@ pub fn build(b: *std.Build) void {
                 .target = target,
                 .optimize = optimize,
             });
+            // Log.zig, which several of them import, reads debug_log
+            mod.addImport("build_options", options_mod);
             const t = b.addTest(.{ .root_module = mod });
             const run_t = b.addRunArtifact(t);
             test_step.dependOn(&run_t.step);
@@ -111,6 +176,43 @@ pub fn build(b: *std.Build) void {
         // keep test-flate as standalone alias
         const flate_step = b.step("test-flate", "Run Flate bridge tests");
         flate_step.dependOn(&run_flate_tests.step);
+
+        // one-shot compress/decompress throughput, kept out of the tests
+        // above since it only times (see src/flate_bench.zig)
+        const flate_bench_mod = b.createModule(.{
+            .root_source_file = b.path("src/flate_bench.zig"),
+            .target = target,
+            .optimize = optimize,
+            .link_libc = true,
+        });
+        flate_bench_mod.linkLibrary(zlib_lib);
+        const flate_bench = b.addExecutable(.{
+            .name = "flate-bench",
+            .root_module = flate_bench_mod,
+        });
+        const run_flate_bench = b.addRunArtifact(flate_bench);
+        if (b.args) |args| run_flate_bench.addArgs(args);
+        const bench_flate_step = b.step("bench-flate", "Benchmark Flate one-shot compress and decompress on PDF content streams");
+        bench_flate_step.dependOn(&run_flate_bench.step);
+
+        // zip project members and deflated bundle inputs inflate through
+        // Flate.zig, so these need zlib too
+        const zlib_test_srcs = [_][]const u8{
+            "src/ZipArchive.zig",
+            "src/World.zig",
+        };
+        for (zlib_test_srcs) |src| {
+            const mod = b.createModule(.{
+                .root_source_file = b.path(src),
+                .target = target,
+                .optimize = optimize,
+                .link_libc = true,
+            });
+            mod.addImport("build_options", options_mod);
+            mod.linkLibrary(zlib_lib);
+            const t = b.addTest(.{ .root_module = mod });
+            test_step.dependOn(&b.addRunArtifact(t).step);
+        }
     }
 
     // -- integration test runner (native only) --
@@ -131,17 +233,39 @@ pub fn build(b: *std.Build) void {
 
         const integration_step = b.step("test-integration", "Run integration tests");
         integration_step.dependOn(&run_runner.step);
+
+        // same runner and corpus, timed: zig build bench -- [--runs N] [--baseline FILE] ...
+        const run_bench = b.addRunArtifact(runner_exe);
+        run_bench.addArtifactArg(exe);
+        run_bench.addArg(b.pathFromRoot("tests"));
+        run_bench.addArg("--bench");
+        if (b.args) |args| run_bench.addArgs(args);
+
+        const bench_step = b.step("bench", "Benchmark the integration tests per stage (see tests/runner.zig)");
+        bench_step.dependOn(&run_bench.step);
+
+        // I/O bridge microbenchmarks, linked like eztex (see src/bridge_bench.zig)
+        const bridge_bench = buildEztex(b, target, optimize, engines, options_mod, "src/bridge_bench.zig", "bridge-bench", .exe);
+        const run_bridge_bench = b.addRunArtifact(bridge_bench);
+        if (b.args) |args| run_bridge_bench.addArgs(args);
+        const bench_io_step = b.step("bench-io", "Benchmark the C<->Zig I/O bridge per slot kind");
+        bench_io_step.dependOn(&run_bridge_bench.step);
     }
 }
 
 // builds the eztex executable for the given target and optimization level.
 // factored out so both native (default install) and wasm step can reuse.
+// `root` and `name` let tools that call into the engine bridge (bench-io)
+// link exactly as eztex does, and `kind` builds the same as libeztex.
 fn buildEztex(
     b: *std.Build,
     target: std.Build.ResolvedTarget,
     optimize: std.builtin.OptimizeMode,
     engines: EngineSet,
     options_mod: *std.Build.Module,
+    root: []const u8,
+    name: []const u8,
+    kind: ArtifactKind,
 ) *std.Build.Step.Compile {
     const is_wasm = target.result.cpu.arch == .wasm32;
 
@@ -244,7 +368,7 @@ fn buildEztex(
 
     // -- executable: eztex --
     const exe_mod = b.createModule(.{
-        .root_source_file = b.path("src/main.zig"),
+        .root_source_file = b.path(root),
         .target = target,
         .optimize = optimize,
         .link_libc = true,
@@ -294,10 +418,17 @@ fn buildEztex(
         exe_mod.linkFramework("ApplicationServices", .{});
     }
 
-    const exe = b.addExecutable(.{
-        .name = "eztex",
-        .root_module = exe_mod,
-    });
+    const exe = switch (kind) {
+        .exe => b.addExecutable(.{
+            .name = name,
+            .root_module = exe_mod,
+        }),
+        .shared_lib => b.addLibrary(.{
+            .name = name,
+            .root_module = exe_mod,
+            .linkage = .dynamic,
+        }),
+    };
 
     // WASM: export dynamic symbols (eztex_alloc, eztex_free for JS host)
     // and strip debug info to reduce binary size
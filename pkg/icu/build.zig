@@ -35,7 +35,19 @@ pub fn build(b: *std.Build) void {
         "-DU_TIMEZONE=0",
     } else &.{};
 
-    const uc_flags = concatFlags4(b, common_flags, wasm_threading_stubs, wasm_flags, &.{"-DU_COMMON_IMPLEMENTATION"});
+    // with stubdata there is no data to filter, so trimming happens in the code
+    // instead. these uconfig.h switches compile out what the engine never
+    // reaches: converters that are neither Unicode, US-ASCII nor Latin-1 (all
+    // but ISCII need tables from the data), service registration for break
+    // iterators and converters, and IDNA. xetex uses ubrk_*, ubidi_* and
+    // ucnv_open/ucnv_toAlgorithmic only
+    const trim_flags: []const []const u8 = &.{
+        "-DU_COMMON_IMPLEMENTATION",
+        "-DUCONFIG_NO_LEGACY_CONVERSION=1",
+        "-DUCONFIG_NO_SERVICE=1",
+        "-DUCONFIG_NO_IDNA=1",
+    };
+    const uc_flags = concatFlags4(b, common_flags, wasm_threading_stubs, wasm_flags, trim_flags);
     const stubdata_flags: []const []const u8 = &.{
         "-fno-exceptions",
         "-fno-sanitize=undefined",
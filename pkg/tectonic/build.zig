@@ -152,6 +152,7 @@ pub fn build(b: *std.Build) void {
     });
 
     const engine_c_files_common: []const []const u8 = &.{
+        "xetex-cmdindex.c",
         "xetex-engine-interface.c",
         "xetex-errors.c",
         "xetex-ext.c",
@@ -162,6 +163,7 @@ pub fn build(b: *std.Build) void {
         "xetex-output.c",
         "xetex-pagebuilder.c",
         "xetex-pic.c",
+        "xetex-profile.c",
         "xetex-scaledmath.c",
         "xetex-shipout.c",
         "xetex-stringpool.c",
@@ -256,7 +258,9 @@ pub fn build(b: *std.Build) void {
             "dpx-dvipdfmx.c",
             "dpx-epdf.c",
             "dpx-error.c",
+            "dpx-fontcache.c",
             "dpx-fontmap.c",
+            "dpx-imagecache.c",
             "dpx-jp2image.c",
             "dpx-jpegimage.c",
             "dpx-mem.c",
@@ -264,6 +268,7 @@ pub fn build(b: *std.Build) void {
             "dpx-mpost.c",
             "dpx-mt19937ar.c",
             "dpx-numbers.c",
+            "dpx-pagedigest.c",
             "dpx-otl_opt.c",
             "dpx-pdfcolor.c",
             "dpx-pdfdev.c",
@@ -308,6 +313,7 @@ pub fn build(b: *std.Build) void {
             "dpx-type1c.c",
             "dpx-unicode.c",
             "dpx-vf.c",
+            "dpx-webpimage.c",
         },
         .flags = pdf_io_c_flags,
     });
@@ -7,33 +7,183 @@
 #include <setjmp.h>
 #include <stdio.h> /*vsnprintf*/
 
-/* Engine run serialization: prevents concurrent engine invocations from
- * corrupting the shared jump_buffer and other global state.
- * WASI is single-threaded, so we skip the mutex there.
- */
-#ifndef __wasi__
-#ifdef _WIN32
-#include <windows.h>
-static CRITICAL_SECTION engine_mutex;
-static int engine_mutex_initialized = 0;
-static void engine_mutex_init(void) {
-    if (!engine_mutex_initialized) {
-        InitializeCriticalSection(&engine_mutex);
-        engine_mutex_initialized = 1;
+#define BUF_SIZE 1024
+static TTBC_THREAD_LOCAL char format_buf[BUF_SIZE] = "";
+
+
+/* The memory management utilities. */
+
+/* Allocation accounting. With tracking on, every block the wrappers below
+ * (and dpx's new/renew) hand out is entered in an open-addressing table of
+ * pointer -> (size, tag), and each change in what is live is reported to
+ * MemStats.zig. ttbc_free looks the pointer up and passes anything the table
+ * never saw (library allocations, blocks from before tracking began) straight
+ * to free. Tracking is per thread, like the engine: dpx's compression threads
+ * are not tracked. */
+
+#undef free
+
+typedef struct {
+    void *ptr; /* NULL: empty slot */
+    size_t size;
+    int tag;
+} mem_block_t;
+
+static TTBC_THREAD_LOCAL mem_block_t *mem_table = NULL;
+static TTBC_THREAD_LOCAL size_t mem_table_cap = 0, mem_table_len = 0;
+static TTBC_THREAD_LOCAL bool mem_tracking = false;
+static TTBC_THREAD_LOCAL int mem_tag = TTBC_MEM_ENGINE;
+
+static size_t
+mem_home(const void *ptr)
+{
+    uint64_t h = (uint64_t) (uintptr_t) ptr * 0x9e3779b97f4a7c15ULL;
+    return (size_t) (h >> 32) & (mem_table_cap - 1);
+}
+
+static mem_block_t *
+mem_find(const void *ptr)
+{
+    size_t i;
+
+    if (mem_table_cap == 0)
+        return NULL;
+    for (i = mem_home(ptr); mem_table[i].ptr != NULL; i = (i + 1) & (mem_table_cap - 1)) {
+        if (mem_table[i].ptr == ptr)
+            return &mem_table[i];
     }
+    return NULL;
 }
-#else
-#include <pthread.h>
-static pthread_mutex_t engine_mutex = PTHREAD_MUTEX_INITIALIZER;
-#endif
-#endif
 
+static void
+mem_place(mem_block_t block)
+{
+    size_t i = mem_home(block.ptr);
 
-#define BUF_SIZE 1024
-static char format_buf[BUF_SIZE] = "";
+    while (mem_table[i].ptr != NULL)
+        i = (i + 1) & (mem_table_cap - 1);
+    mem_table[i] = block;
+}
+
+static bool
+mem_grow(void)
+{
+    mem_block_t *old = mem_table;
+    size_t i, old_cap = mem_table_cap;
+    size_t cap = old_cap ? old_cap * 2 : 4096;
+
+    mem_table = calloc(cap, sizeof(mem_block_t));
+    if (mem_table == NULL) {
+        mem_table = old;
+        return false;
+    }
+    mem_table_cap = cap;
+    for (i = 0; i < old_cap; i++) {
+        if (old[i].ptr != NULL)
+            mem_place(old[i]);
+    }
+    free(old);
+    return true;
+}
+
+/* Remove ptr's entry, shifting later entries of its probe run back so that
+ * lookups need no tombstones. */
+static void
+mem_remove(mem_block_t *block)
+{
+    size_t mask = mem_table_cap - 1;
+    size_t hole = (size_t) (block - mem_table);
+    size_t i = hole;
+
+    for (;;) {
+        size_t home;
+
+        i = (i + 1) & mask;
+        if (mem_table[i].ptr == NULL)
+            break;
+        home = mem_home(mem_table[i].ptr);
+        /* movable unless its home lies cyclically in (hole, i] */
+        if ((i > hole) ? (home <= hole || home > i) : (home <= hole && home > i)) {
+            mem_table[hole] = mem_table[i];
+            hole = i;
+        }
+    }
+    mem_table[hole].ptr = NULL;
+    mem_table_len--;
+}
 
+static void
+mem_insert(void *ptr, size_t size, int tag)
+{
+    mem_block_t *block = mem_find(ptr);
+
+    if (block != NULL) {
+        /* freed behind our back (by C++ or a library) and handed out again */
+        ttbc_mem_account(block->tag, -(int64_t) block->size);
+        block->size = size;
+        block->tag = tag;
+    } else {
+        if ((mem_table_len + 1) * 4 > mem_table_cap * 3 && !mem_grow())
+            return;
+        mem_place((mem_block_t) { ptr, size, tag });
+        mem_table_len++;
+    }
+    ttbc_mem_account(tag, (int64_t) size);
+}
+
+void
+ttbc_mem_set_tracking(int enabled)
+{
+    mem_tracking = enabled != 0;
+}
+
+int
+ttbc_mem_set_tag(int tag)
+{
+    int prev = mem_tag;
+
+    mem_tag = tag;
+    return prev;
+}
+
+void *
+ttbc_mem_track(void *ptr, size_t size)
+{
+    if (mem_tracking && ptr != NULL)
+        mem_insert(ptr, size, mem_tag);
+    return ptr;
+}
+
+/* old_ptr was reallocated to new_ptr: the block keeps the tag it was counted
+ * under */
+void *
+ttbc_mem_retrack(void *old_ptr, void *new_ptr, size_t size)
+{
+    mem_block_t *block = (old_ptr != NULL && mem_table_len) ? mem_find(old_ptr) : NULL;
+    int tag = mem_tag;
+
+    if (block != NULL) {
+        tag = block->tag;
+        ttbc_mem_account(tag, -(int64_t) block->size);
+        mem_remove(block);
+    }
+    if (mem_tracking && new_ptr != NULL)
+        mem_insert(new_ptr, size, tag);
+    return new_ptr;
+}
+
+void
+ttbc_free(void *ptr)
+{
+    mem_block_t *block;
+
+    if (ptr != NULL && mem_table_len && (block = mem_find(ptr)) != NULL) {
+        ttbc_mem_account(block->tag, -(int64_t) block->size);
+        mem_remove(block);
+    }
+    free(ptr);
+}
 
-/* The memory management utilities. */
 
 void *
 xcalloc(size_t nelem, size_t elsize)
@@ -44,7 +194,7 @@ xcalloc(size_t nelem, size_t elsize)
         _tt_abort("xcalloc request for %lu elements of size %lu failed",
                   (unsigned long) nelem, (unsigned long) elsize);
 
-    return new_mem;
+    return ttbc_mem_track(new_mem, (nelem ? nelem : 1) * (elsize ? elsize : 1));
 }
 
 
@@ -56,7 +206,7 @@ xmalloc(size_t size)
     if (new_mem == NULL)
         _tt_abort("xmalloc request for %lu bytes failed", (unsigned long) size);
 
-    return new_mem;
+    return ttbc_mem_track(new_mem, size ? size : 1);
 }
 
 
@@ -71,6 +221,7 @@ xrealloc(void *old_ptr, size_t size)
         new_mem = realloc(old_ptr, size ? size : 1);
         if (new_mem == NULL)
             _tt_abort("xrealloc() to %lu bytes failed", (unsigned long) size);
+        ttbc_mem_retrack(old_ptr, new_mem, size ? size : 1);
     }
 
     return new_mem;
@@ -108,11 +259,11 @@ ttstub_diag_printf(ttbc_diagnostic_t *diag, const char *format, ...)
 
 /* The global state helpers */
 
-static jmp_buf jump_buffer;
+static TTBC_THREAD_LOCAL jmp_buf jump_buffer;
 
 /* Checkpoint callback state */
-static ttbc_checkpoint_fn tectonic_checkpoint_fn = NULL;
-static void *tectonic_checkpoint_userdata = NULL;
+static TTBC_THREAD_LOCAL ttbc_checkpoint_fn tectonic_checkpoint_fn = NULL;
+static TTBC_THREAD_LOCAL void *tectonic_checkpoint_userdata = NULL;
 
 void
 ttbc_set_checkpoint_callback(ttbc_checkpoint_fn fn, void *userdata)
@@ -122,10 +273,10 @@ ttbc_set_checkpoint_callback(ttbc_checkpoint_fn fn, void *userdata)
 }
 
 void
-ttbc_fire_checkpoint(int checkpoint_id)
+ttbc_fire_checkpoint(int checkpoint_id, const char *detail)
 {
     if (tectonic_checkpoint_fn != NULL) {
-        tectonic_checkpoint_fn(tectonic_checkpoint_userdata, checkpoint_id);
+        tectonic_checkpoint_fn(tectonic_checkpoint_userdata, checkpoint_id, detail);
     }
 }
 
@@ -152,14 +303,9 @@ _ttbc_get_error_message(void)
 jmp_buf *
 ttbc_global_engine_enter(void)
 {
-#ifndef __wasi__
-#ifdef _WIN32
-    engine_mutex_init();
-    EnterCriticalSection(&engine_mutex);
-#else
-    pthread_mutex_lock(&engine_mutex);
-#endif
-#endif
+    /* All engine state is per thread (TTBC_THREAD_LOCAL), so runs on
+     * different threads proceed concurrently; each gets its own jump
+     * buffer. */
     return &jump_buffer;
 }
 
@@ -167,13 +313,6 @@ ttbc_global_engine_enter(void)
 void
 ttbc_global_engine_exit(void)
 {
-#ifndef __wasi__
-#ifdef _WIN32
-    LeaveCriticalSection(&engine_mutex);
-#else
-    pthread_mutex_unlock(&engine_mutex);
-#endif
-#endif
 }
 
 
@@ -204,7 +343,7 @@ ttstub_issue_error(const char *format, ...)
 PRINTF_FUNC(2,3) int
 ttstub_fprintf(rust_output_handle_t handle, const char *format, ...)
 {
-    static char fprintf_buf[BUF_SIZE] = "";
+    static TTBC_THREAD_LOCAL char fprintf_buf[BUF_SIZE] = "";
     va_list ap;
 
     va_start(ap, format);
@@ -65,6 +65,20 @@
 #define PRINTF_FUNC(ifmt,iarg)
 #endif
 
+/* Portability: per-thread engine state. Every mutable global of the engines
+ * carries this, so separate threads can each run their own engine at once.
+ * WASI builds are single-threaded and keep plain globals. */
+
+#if defined __wasi__
+#define TTBC_THREAD_LOCAL
+#elif defined __cplusplus
+#define TTBC_THREAD_LOCAL thread_local
+#elif defined _MSC_VER
+#define TTBC_THREAD_LOCAL __declspec(thread)
+#else
+#define TTBC_THREAD_LOCAL _Thread_local
+#endif
+
 /* Portability: inline annotation */
 
 #ifdef _MSC_VER
@@ -156,6 +170,30 @@ void *xmalloc(size_t size);
 void *xrealloc(void *old_address, size_t new_size);
 void *xcalloc(size_t nelem, size_t elsize);
 
+/* Allocation accounting (see support.c and MemStats.zig). While tracking is
+ * on, blocks from the wrappers above are counted against the subsystem the
+ * engine is working in, which ttbc_mem_set_tag switches; it returns the tag
+ * to restore. free() in C sources goes through ttbc_free so their release is
+ * counted too. */
+
+#define TTBC_MEM_ENGINE  0
+#define TTBC_MEM_FONTS   1
+#define TTBC_MEM_PDF     2
+#define TTBC_MEM_IMAGES  3
+#define TTBC_MEM_IO      4
+
+void ttbc_mem_set_tracking(int enabled);
+int ttbc_mem_set_tag(int tag);
+void *ttbc_mem_track(void *ptr, size_t size);
+void *ttbc_mem_retrack(void *old_ptr, void *new_ptr, size_t size);
+void ttbc_free(void *ptr);
+/* implemented in MemStats.zig */
+void ttbc_mem_account(int tag, int64_t delta);
+
+#ifndef __cplusplus
+#define free(ptr) ttbc_free(ptr)
+#endif
+
 static inline void *mfree(void *ptr) {
     free(ptr);
     return NULL;
@@ -217,7 +255,9 @@ PRINTF_FUNC(2,0) void ttstub_diag_vprintf(ttbc_diagnostic_t *diag, const char *f
  * ```
  *
  * They are based on setjmp/longjmp to catch fatal error conditions so you have
- * to understand how those functions work.
+ * to understand how those functions work. The jump buffer, like all engine
+ * state, is per thread: one engine may run on each thread at the same time,
+ * but an engine must complete on the thread that entered it.
  */
 
 jmp_buf *ttbc_global_engine_enter(void);
@@ -234,12 +274,26 @@ time_t ttstub_input_get_mtime(rust_input_handle_t handle);
 size_t ttstub_input_seek(rust_input_handle_t handle, ssize_t offset, int whence);
 int ttstub_input_close(rust_input_handle_t handle);
 
-/* Checkpoint callback -- called at key engine lifecycle points */
-#define TTBC_CHECKPOINT_FORMAT_LOADED  1
-
-typedef void (*ttbc_checkpoint_fn)(void *userdata, int checkpoint_id);
+/* Checkpoint callback -- called at key engine lifecycle points. A _BEGIN id
+ * and its _END bracket a stage (FORMAT_LOADED ends FORMAT_LOAD_BEGIN);
+ * detail names what the stage works on, such as a page or a file, or is
+ * NULL. STATS stands alone: its detail is a figure the engine reports.
+ * SAMPLE too: "<file>:<line>", where XeTeX is reading, sent every
+ * sample_interval macro calls when that is set. */
+#define TTBC_CHECKPOINT_FORMAT_LOADED      1
+#define TTBC_CHECKPOINT_FORMAT_LOAD_BEGIN  2
+#define TTBC_CHECKPOINT_SHIPOUT_BEGIN      3
+#define TTBC_CHECKPOINT_SHIPOUT_END        4
+#define TTBC_CHECKPOINT_FONT_EMBED_BEGIN   5
+#define TTBC_CHECKPOINT_FONT_EMBED_END     6
+#define TTBC_CHECKPOINT_IMAGE_BEGIN        7
+#define TTBC_CHECKPOINT_IMAGE_END          8
+#define TTBC_CHECKPOINT_STATS              9
+#define TTBC_CHECKPOINT_SAMPLE            10
+
+typedef void (*ttbc_checkpoint_fn)(void *userdata, int checkpoint_id, const char *detail);
 void ttbc_set_checkpoint_callback(ttbc_checkpoint_fn fn, void *userdata);
-void ttbc_fire_checkpoint(int checkpoint_id);
+void ttbc_fire_checkpoint(int checkpoint_id, const char *detail);
 
 END_EXTERN_C
 
@@ -297,6 +297,60 @@ ssize_t ttbc_input_read(Option_InputId handle, char *data, size_t len);
  */
 ssize_t ttbc_input_read_partial(Option_InputId handle, char *data, size_t len);
 
+/**
+ * Get a pointer to the unread bytes of a Tectonic input without copying them.
+ *
+ * Returns nonzero if no such view is available (e.g. a byte was pushed back
+ * with `ungetc`), in which case callers should use `getc`. The view is valid
+ * until the next operation on the handle; advance past what was used with
+ * `ttbc_input_consume`.
+ */
+int ttbc_input_peek(Option_InputId handle, const uint8_t **data, size_t *len);
+
+/**
+ * Advance a Tectonic input past `n` bytes obtained from `ttbc_input_peek`.
+ */
+void ttbc_input_consume(Option_InputId handle, size_t n);
+
+/**
+ * Get the host's format image for the format being loaded, or NULL.
+ *
+ * A format image is the engine state left by undumping a format, in native
+ * byte order (see `load_fmt_file`). `*is_private` is set nonzero if the
+ * buffer is a private copy that the engine may use and modify in place until
+ * the end of the run; otherwise the engine copies out of it.
+ */
+void *ttbc_format_image_get(size_t *len, int *is_private);
+
+/**
+ * Start writing a format image of `total_len` bytes. Returns zero if the host
+ * does not want one.
+ */
+int ttbc_format_image_begin(uint64_t total_len);
+
+/**
+ * Write format image bytes at `offset`. Returns nonzero on failure.
+ */
+int ttbc_format_image_write(uint64_t offset, const void *data, size_t len);
+
+/**
+ * Finish the format image started with `ttbc_format_image_begin`. It is
+ * discarded unless `ok` is nonzero.
+ */
+void ttbc_format_image_end(int ok);
+
+/**
+ * The blob cached under `kind` and the 16-byte `key` by an earlier compile,
+ * or NULL. The caller frees it with `free`.
+ */
+void *ttbc_cache_blob_get(const char *kind, const unsigned char *key, size_t *len);
+
+/**
+ * Keep `len` bytes under `kind` and `key` for later compiles. Best effort;
+ * hosts without a cache directory drop them.
+ */
+void ttbc_cache_blob_put(const char *kind, const unsigned char *key, const void *data, size_t len);
+
 /**
  * Close a Tectonic input file.
  */
@@ -49,6 +49,46 @@ FlateResult tectonic_flate_compress(uint8_t *output_ptr,
                                     uint64_t input_len,
                                     uint32_t compression_level);
 
+/**
+ * Start compressing a block of data on a thread of its own. The input must
+ * stay valid until `tectonic_flate_compress_finish`.
+ *
+ * Returns NULL if no thread could be started (or the build has none); the
+ * caller then compresses in place.
+ */
+void *tectonic_flate_compress_start(const uint8_t *input_ptr,
+                                    uint64_t input_len,
+                                    uint32_t compression_level);
+
+/**
+ * Run on a compression job's thread before it compresses: returns the data
+ * to compress in place of the input, allocated with `malloc` (the job frees
+ * it), and its length; or NULL on failure, which fails the job.
+ */
+typedef uint8_t *(*tectonic_flate_prepare_fn)(void *ctx,
+                                              const uint8_t *input_ptr,
+                                              uint64_t input_len,
+                                              uint64_t *prepared_len);
+
+/**
+ * Like `tectonic_flate_compress_start`, with `prepare` called on the job's
+ * thread first. `ctx` must stay valid until `tectonic_flate_compress_finish`.
+ */
+void *tectonic_flate_compress_start_prepared(const uint8_t *input_ptr,
+                                             uint64_t input_len,
+                                             uint32_t compression_level,
+                                             tectonic_flate_prepare_fn prepare,
+                                             void *ctx);
+
+/**
+ * Wait for a job from `tectonic_flate_compress_start` and release it. On
+ * success, `output_ptr` receives the compressed data, to be freed with
+ * `free`.
+ */
+FlateResult tectonic_flate_compress_finish(void *job,
+                                           uint8_t **output_ptr,
+                                           uint64_t *output_len);
+
 /**
  * Deompress a block of data. This function maps fairly directly onto the
  * `Decompress::decompress` function provided by `flate2`.
@@ -49,6 +49,8 @@ typedef struct {
   rust_input_handle_t handle;
   int peek_char;
   bool saw_eof;
+  size_t pos;        /* bytes consumed */
+  size_t line_start; /* offset of the line last read by input_ln */
 } peekable_input_t;
 
 static peekable_input_t *peekable_open(const char *path,
@@ -65,6 +67,8 @@ static peekable_input_t *peekable_open(const char *path,
   peekable->handle = handle;
   peekable->peek_char = EOF;
   peekable->saw_eof = false;
+  peekable->pos = 0;
+  peekable->line_start = 0;
   return peekable;
 }
 
@@ -85,18 +89,29 @@ static int peekable_getc(peekable_input_t *peekable) {
   if (peekable->peek_char != EOF) {
     rv = peekable->peek_char;
     peekable->peek_char = EOF;
+    peekable->pos++;
     return rv;
   }
 
   rv = ttbc_input_getc(peekable->handle);
   if (rv == EOF)
     peekable->saw_eof = true;
+  else
+    peekable->pos++;
   return rv;
 }
 
 static void peekable_ungetc(peekable_input_t *peekable, int c) {
   /* TODO: assert c != EOF */
   peekable->peek_char = c;
+  peekable->pos--;
+}
+
+static void peekable_seek(peekable_input_t *peekable, size_t pos) {
+  ttstub_input_seek(peekable->handle, (ssize_t)pos, SEEK_SET);
+  peekable->peek_char = EOF;
+  peekable->saw_eof = false;
+  peekable->pos = pos;
 }
 
 /* eofeoln.c, adapted for Rusty I/O */
@@ -134,7 +149,7 @@ static bool eoln(peekable_input_t *peekable) {
 
 /* end eofeoln.c */
 
-static jmp_buf error_jmpbuf, recover_jmpbuf;
+static TTBC_THREAD_LOCAL jmp_buf error_jmpbuf, recover_jmpbuf;
 
 /*14:*/
 
@@ -186,238 +201,245 @@ typedef int32_t lit_stk_loc;
 typedef unsigned char /*last_lit_type */ stk_type;
 typedef int32_t blt_in_range;
 
-static rust_output_handle_t standard_output;
-static int32_t pool_size;
-static int32_t max_bib_files;
-static int32_t max_cites;
-static int32_t wiz_fn_space;
-static int32_t ent_str_size;
-static int32_t glob_str_size;
-static int32_t max_glob_strs;
-static int32_t max_fields;
-static int32_t lit_stk_size;
-static int32_t max_strings;
-static int32_t hash_size;
-static int32_t hash_prime;
-static int32_t hash_max;
-static int32_t end_of_def;
-static int32_t undefined;
-static int32_t bad;
-static unsigned char /*fatal_message */ history;
-static int32_t err_count;
-static lex_type lex_class[256];
-static id_type id_class[256];
-static int32_t char_width[256];
-static int32_t string_width;
-static ASCII_code *name_of_file;
-static int32_t name_length;
-static int32_t name_ptr;
-static int32_t buf_size;
-static buf_type buffer;
-static buf_pointer last;
-static buf_type sv_buffer;
-static buf_pointer sv_ptr1;
-static buf_pointer sv_ptr2;
-static int32_t tmp_ptr, tmp_end_ptr;
-static ASCII_code *str_pool;
-static pool_pointer *str_start;
-static pool_pointer pool_ptr;
-static str_number str_ptr;
-static pool_pointer p_ptr1, p_ptr2;
-static hash_pointer *hash_next;
-static str_number *hash_text;
-static str_ilk *hash_ilk;
-static int32_t *ilk_info;
-static int32_t hash_used;
-static bool hash_found;
-static hash_loc dummy_loc;
-static str_number s_aux_extension;
-static str_number s_log_extension;
-static str_number s_bbl_extension;
-static str_number s_bst_extension;
-static str_number s_bib_extension;
-static str_number s_bst_area;
-static str_number s_bib_area;
-static hash_loc pre_def_loc;
-static int32_t command_num;
-static buf_pointer buf_ptr1;
-static buf_pointer buf_ptr2;
-static unsigned char /*white_adjacent */ scan_result;
-static int32_t token_value;
-static int32_t aux_name_length;
-static peekable_input_t *aux_file[aux_stack_size + 1];
-static str_number aux_list[aux_stack_size + 1];
-static aux_number aux_ptr;
-static int32_t aux_ln_stack[aux_stack_size + 1];
-static str_number top_lev_str;
-static rust_output_handle_t log_file;
-static rust_output_handle_t bbl_file;
-static str_number *bib_list;
-static bib_number bib_ptr;
-static bib_number num_bib_files;
-static bool bib_seen;
-static peekable_input_t **bib_file;
-static bool bst_seen;
-static str_number bst_str;
-static peekable_input_t *bst_file;
-static str_number *cite_list;
-static cite_number cite_ptr;
-static cite_number entry_cite_ptr;
-static cite_number num_cites;
-static cite_number old_num_cites;
-static bool citation_seen;
-static hash_loc cite_loc;
-static hash_loc lc_cite_loc;
-static hash_loc lc_xcite_loc;
-static bool all_entries;
-static cite_number all_marker;
-static int32_t bbl_line_num;
-static int32_t bst_line_num;
-static hash_loc fn_loc;
-static hash_loc wiz_loc;
-static hash_loc literal_loc;
-static hash_loc macro_name_loc;
-static hash_loc macro_def_loc;
-static fn_class *fn_type;
-static wiz_fn_loc wiz_def_ptr;
-static hash_ptr2 *wiz_functions;
-static int_ent_loc int_ent_ptr;
-static int32_t *entry_ints;
-static int_ent_loc num_ent_ints;
-static str_ent_loc str_ent_ptr;
-static ASCII_code *entry_strs;
-static str_ent_loc num_ent_strs;
-static int32_t str_glb_ptr;
-static str_number *glb_str_ptr;
-static ASCII_code *global_strs;
-static int32_t *glb_str_end;
-static int32_t num_glb_strs;
-static field_loc field_ptr;
-static field_loc field_parent_ptr, field_end_ptr;
-static cite_number cite_parent_ptr, cite_xptr;
-static str_number *field_info;
-static field_loc num_fields;
-static field_loc num_pre_defined_fields;
-static field_loc crossref_num;
-static bool entry_seen;
-static bool read_seen;
-static bool read_performed;
-static bool reading_completed;
-static bool read_completed;
-static int32_t impl_fn_num;
-static int32_t bib_line_num;
-static hash_loc entry_type_loc;
-static hash_ptr2 *type_list;
-static bool type_exists;
-static bool *entry_exists;
-static bool store_entry;
-static hash_loc field_name_loc;
-static hash_loc field_val_loc;
-static bool store_field;
-static bool store_token;
-static ASCII_code right_outer_delim;
-static ASCII_code right_str_delim;
-static bool at_bib_command;
-static hash_loc cur_macro_loc;
-static str_number *cite_info;
-static bool cite_hash_found;
-static bib_number preamble_ptr;
-static bib_number num_preamble_strings;
-static int32_t bib_brace_level;
-static int32_t *lit_stack;
-static stk_type *lit_stk_type;
-static lit_stk_loc lit_stk_ptr;
-static str_number cmd_str_ptr;
-static int32_t ent_chr_ptr;
-static int32_t glob_chr_ptr;
-static buf_type ex_buf;
-static buf_pointer ex_buf_ptr;
-static buf_pointer ex_buf_length;
-static buf_type out_buf;
-static buf_pointer out_buf_ptr;
-static buf_pointer out_buf_length;
-static bool mess_with_entries;
-static cite_number sort_cite_ptr;
-static str_ent_loc sort_key_num;
-static int32_t brace_level;
-static hash_loc b_equals;
-static hash_loc b_greater_than;
-static hash_loc b_less_than;
-static hash_loc b_plus;
-static hash_loc b_minus;
-static hash_loc b_concatenate;
-static hash_loc b_gets;
-static hash_loc b_add_period;
-static hash_loc b_call_type;
-static hash_loc b_change_case;
-static hash_loc b_chr_to_int;
-static hash_loc b_cite;
-static hash_loc b_duplicate;
-static hash_loc b_empty;
-static hash_loc b_format_name;
-static hash_loc b_if;
-static hash_loc b_int_to_chr;
-static hash_loc b_int_to_str;
-static hash_loc b_missing;
-static hash_loc b_newline;
-static hash_loc b_num_names;
-static hash_loc b_pop;
-static hash_loc b_preamble;
-static hash_loc b_purify;
-static hash_loc b_quote;
-static hash_loc b_skip;
-static hash_loc b_stack;
-static hash_loc b_substring;
-static hash_loc b_swap;
-static hash_loc b_text_length;
-static hash_loc b_text_prefix;
-static hash_loc b_top_stack;
-static hash_loc b_type;
-static hash_loc b_warning;
-static hash_loc b_while;
-static hash_loc b_width;
-static hash_loc b_write;
-static hash_loc b_default;
-
-static str_number s_null;
-static str_number s_default;
-static str_number *s_preamble;
-static int32_t pop_lit1, pop_lit2, pop_lit3;
-static stk_type pop_typ1, pop_typ2, pop_typ3;
-static pool_pointer sp_ptr;
-static pool_pointer sp_xptr1, sp_xptr2;
-static pool_pointer sp_end;
-static pool_pointer sp_length, sp2_length;
-static int32_t sp_brace_level;
-static buf_pointer ex_buf_xptr, ex_buf_yptr;
-static hash_loc control_seq_loc;
-static bool preceding_white;
-static bool and_found;
-static int32_t num_names;
-static buf_pointer name_bf_ptr;
-static buf_pointer name_bf_xptr, name_bf_yptr;
-static int32_t nm_brace_level;
-static buf_pointer *name_tok;
-static ASCII_code *name_sep_char;
-static buf_pointer num_tokens;
-static bool token_starting;
-static bool alpha_found;
-static bool double_letter, end_of_group, to_be_written;
-static buf_pointer first_start;
-static buf_pointer first_end;
-static buf_pointer last_end;
-static buf_pointer von_start;
-static buf_pointer von_end;
-static buf_pointer jr_end;
-static buf_pointer cur_token, last_token;
-static bool use_default;
-static buf_pointer num_commas;
-static buf_pointer comma1, comma2;
-static buf_pointer num_text_chars;
-static unsigned char /*bad_conversion */ conversion_type;
-static bool prev_colon;
-static int verbose;
-static int32_t min_crossrefs;
+static TTBC_THREAD_LOCAL rust_output_handle_t standard_output;
+static TTBC_THREAD_LOCAL int32_t pool_size;
+static TTBC_THREAD_LOCAL int32_t max_bib_files;
+static TTBC_THREAD_LOCAL int32_t max_cites;
+static TTBC_THREAD_LOCAL int32_t wiz_fn_space;
+static TTBC_THREAD_LOCAL int32_t ent_str_size;
+static TTBC_THREAD_LOCAL int32_t glob_str_size;
+static TTBC_THREAD_LOCAL int32_t max_glob_strs;
+static TTBC_THREAD_LOCAL int32_t max_fields;
+static TTBC_THREAD_LOCAL int32_t lit_stk_size;
+static TTBC_THREAD_LOCAL int32_t max_strings;
+static TTBC_THREAD_LOCAL int32_t hash_size;
+static TTBC_THREAD_LOCAL int32_t hash_max;
+static TTBC_THREAD_LOCAL int32_t end_of_def;
+static TTBC_THREAD_LOCAL int32_t undefined;
+static TTBC_THREAD_LOCAL int32_t bad;
+static TTBC_THREAD_LOCAL unsigned char /*fatal_message */ history;
+static TTBC_THREAD_LOCAL int32_t err_count;
+static TTBC_THREAD_LOCAL lex_type lex_class[256];
+static TTBC_THREAD_LOCAL id_type id_class[256];
+static TTBC_THREAD_LOCAL int32_t char_width[256];
+static TTBC_THREAD_LOCAL int32_t string_width;
+static TTBC_THREAD_LOCAL ASCII_code *name_of_file;
+static TTBC_THREAD_LOCAL int32_t name_length;
+static TTBC_THREAD_LOCAL int32_t name_ptr;
+static TTBC_THREAD_LOCAL int32_t buf_size;
+static TTBC_THREAD_LOCAL buf_type buffer;
+static TTBC_THREAD_LOCAL buf_pointer last;
+static TTBC_THREAD_LOCAL buf_type sv_buffer;
+static TTBC_THREAD_LOCAL buf_pointer sv_ptr1;
+static TTBC_THREAD_LOCAL buf_pointer sv_ptr2;
+static TTBC_THREAD_LOCAL int32_t tmp_ptr, tmp_end_ptr;
+static TTBC_THREAD_LOCAL ASCII_code *str_pool;
+static TTBC_THREAD_LOCAL pool_pointer *str_start;
+static TTBC_THREAD_LOCAL pool_pointer pool_ptr;
+static TTBC_THREAD_LOCAL str_number str_ptr;
+static TTBC_THREAD_LOCAL pool_pointer p_ptr1, p_ptr2;
+static TTBC_THREAD_LOCAL str_number *hash_text;
+static TTBC_THREAD_LOCAL str_ilk *hash_ilk;
+static TTBC_THREAD_LOCAL int32_t *ilk_info;
+static TTBC_THREAD_LOCAL int32_t hash_used;
+/* Hash locations are handed out in order and never move, since they are kept
+ * everywhere (ilk_info, wiz_functions, type_list, the literal stack). They are
+ * found through hash_index, an open-addressed table of locations keyed by
+ * hash_code, the full hash of each location's text; only the index is rebuilt
+ * as it fills, and the location arrays grow by reallocation. */
+static TTBC_THREAD_LOCAL uint32_t *hash_code;
+static TTBC_THREAD_LOCAL hash_loc *hash_index;
+static TTBC_THREAD_LOCAL uint32_t hash_index_mask;
+static TTBC_THREAD_LOCAL int32_t hash_longest_probe;
+static TTBC_THREAD_LOCAL bool hash_found;
+static TTBC_THREAD_LOCAL hash_loc dummy_loc;
+static TTBC_THREAD_LOCAL str_number s_aux_extension;
+static TTBC_THREAD_LOCAL str_number s_log_extension;
+static TTBC_THREAD_LOCAL str_number s_bbl_extension;
+static TTBC_THREAD_LOCAL str_number s_bst_extension;
+static TTBC_THREAD_LOCAL str_number s_bib_extension;
+static TTBC_THREAD_LOCAL str_number s_bst_area;
+static TTBC_THREAD_LOCAL str_number s_bib_area;
+static TTBC_THREAD_LOCAL hash_loc pre_def_loc;
+static TTBC_THREAD_LOCAL int32_t command_num;
+static TTBC_THREAD_LOCAL buf_pointer buf_ptr1;
+static TTBC_THREAD_LOCAL buf_pointer buf_ptr2;
+static TTBC_THREAD_LOCAL unsigned char /*white_adjacent */ scan_result;
+static TTBC_THREAD_LOCAL int32_t token_value;
+static TTBC_THREAD_LOCAL int32_t aux_name_length;
+static TTBC_THREAD_LOCAL peekable_input_t *aux_file[aux_stack_size + 1];
+static TTBC_THREAD_LOCAL str_number aux_list[aux_stack_size + 1];
+static TTBC_THREAD_LOCAL aux_number aux_ptr;
+static TTBC_THREAD_LOCAL int32_t aux_ln_stack[aux_stack_size + 1];
+static TTBC_THREAD_LOCAL str_number top_lev_str;
+static TTBC_THREAD_LOCAL rust_output_handle_t log_file;
+static TTBC_THREAD_LOCAL rust_output_handle_t bbl_file;
+static TTBC_THREAD_LOCAL str_number *bib_list;
+static TTBC_THREAD_LOCAL bib_number bib_ptr;
+static TTBC_THREAD_LOCAL bib_number num_bib_files;
+static TTBC_THREAD_LOCAL bool bib_seen;
+static TTBC_THREAD_LOCAL peekable_input_t **bib_file;
+static TTBC_THREAD_LOCAL bool bst_seen;
+static TTBC_THREAD_LOCAL str_number bst_str;
+static TTBC_THREAD_LOCAL peekable_input_t *bst_file;
+static TTBC_THREAD_LOCAL str_number *cite_list;
+static TTBC_THREAD_LOCAL cite_number cite_ptr;
+static TTBC_THREAD_LOCAL cite_number entry_cite_ptr;
+static TTBC_THREAD_LOCAL cite_number num_cites;
+static TTBC_THREAD_LOCAL cite_number old_num_cites;
+static TTBC_THREAD_LOCAL bool citation_seen;
+static TTBC_THREAD_LOCAL hash_loc cite_loc;
+static TTBC_THREAD_LOCAL hash_loc lc_cite_loc;
+static TTBC_THREAD_LOCAL hash_loc lc_xcite_loc;
+static TTBC_THREAD_LOCAL bool all_entries;
+static TTBC_THREAD_LOCAL cite_number all_marker;
+static TTBC_THREAD_LOCAL int32_t bbl_line_num;
+static TTBC_THREAD_LOCAL int32_t bst_line_num;
+static TTBC_THREAD_LOCAL hash_loc fn_loc;
+static TTBC_THREAD_LOCAL hash_loc wiz_loc;
+static TTBC_THREAD_LOCAL hash_loc literal_loc;
+static TTBC_THREAD_LOCAL hash_loc macro_name_loc;
+static TTBC_THREAD_LOCAL hash_loc macro_def_loc;
+static TTBC_THREAD_LOCAL fn_class *fn_type;
+static TTBC_THREAD_LOCAL wiz_fn_loc wiz_def_ptr;
+static TTBC_THREAD_LOCAL hash_ptr2 *wiz_functions;
+static TTBC_THREAD_LOCAL int_ent_loc int_ent_ptr;
+static TTBC_THREAD_LOCAL int32_t *entry_ints;
+static TTBC_THREAD_LOCAL int_ent_loc num_ent_ints;
+static TTBC_THREAD_LOCAL str_ent_loc str_ent_ptr;
+static TTBC_THREAD_LOCAL ASCII_code *entry_strs;
+static TTBC_THREAD_LOCAL str_ent_loc num_ent_strs;
+static TTBC_THREAD_LOCAL int32_t str_glb_ptr;
+static TTBC_THREAD_LOCAL str_number *glb_str_ptr;
+static TTBC_THREAD_LOCAL ASCII_code *global_strs;
+static TTBC_THREAD_LOCAL int32_t *glb_str_end;
+static TTBC_THREAD_LOCAL int32_t num_glb_strs;
+static TTBC_THREAD_LOCAL field_loc field_ptr;
+static TTBC_THREAD_LOCAL field_loc field_parent_ptr, field_end_ptr;
+static TTBC_THREAD_LOCAL cite_number cite_parent_ptr, cite_xptr;
+static TTBC_THREAD_LOCAL str_number *field_info;
+static TTBC_THREAD_LOCAL field_loc num_fields;
+static TTBC_THREAD_LOCAL field_loc num_pre_defined_fields;
+static TTBC_THREAD_LOCAL field_loc crossref_num;
+static TTBC_THREAD_LOCAL bool entry_seen;
+static TTBC_THREAD_LOCAL bool read_seen;
+static TTBC_THREAD_LOCAL bool read_performed;
+static TTBC_THREAD_LOCAL bool reading_completed;
+static TTBC_THREAD_LOCAL bool read_completed;
+static TTBC_THREAD_LOCAL int32_t impl_fn_num;
+static TTBC_THREAD_LOCAL int32_t bib_line_num;
+static TTBC_THREAD_LOCAL hash_loc entry_type_loc;
+static TTBC_THREAD_LOCAL hash_ptr2 *type_list;
+static TTBC_THREAD_LOCAL bool type_exists;
+static TTBC_THREAD_LOCAL bool *entry_exists;
+static TTBC_THREAD_LOCAL bool store_entry;
+static TTBC_THREAD_LOCAL hash_loc field_name_loc;
+static TTBC_THREAD_LOCAL hash_loc field_val_loc;
+static TTBC_THREAD_LOCAL bool store_field;
+static TTBC_THREAD_LOCAL bool store_token;
+static TTBC_THREAD_LOCAL ASCII_code right_outer_delim;
+static TTBC_THREAD_LOCAL ASCII_code right_str_delim;
+static TTBC_THREAD_LOCAL bool at_bib_command;
+static TTBC_THREAD_LOCAL hash_loc cur_macro_loc;
+static TTBC_THREAD_LOCAL str_number *cite_info;
+static TTBC_THREAD_LOCAL bool cite_hash_found;
+static TTBC_THREAD_LOCAL bib_number preamble_ptr;
+static TTBC_THREAD_LOCAL bib_number num_preamble_strings;
+static TTBC_THREAD_LOCAL int32_t bib_brace_level;
+static TTBC_THREAD_LOCAL int32_t *lit_stack;
+static TTBC_THREAD_LOCAL stk_type *lit_stk_type;
+static TTBC_THREAD_LOCAL lit_stk_loc lit_stk_ptr;
+static TTBC_THREAD_LOCAL str_number cmd_str_ptr;
+static TTBC_THREAD_LOCAL int32_t ent_chr_ptr;
+static TTBC_THREAD_LOCAL int32_t glob_chr_ptr;
+static TTBC_THREAD_LOCAL buf_type ex_buf;
+static TTBC_THREAD_LOCAL buf_pointer ex_buf_ptr;
+static TTBC_THREAD_LOCAL buf_pointer ex_buf_length;
+static TTBC_THREAD_LOCAL buf_type out_buf;
+static TTBC_THREAD_LOCAL buf_pointer out_buf_ptr;
+static TTBC_THREAD_LOCAL buf_pointer out_buf_length;
+static TTBC_THREAD_LOCAL bool mess_with_entries;
+static TTBC_THREAD_LOCAL cite_number sort_cite_ptr;
+static TTBC_THREAD_LOCAL str_ent_loc sort_key_num;
+static TTBC_THREAD_LOCAL int32_t brace_level;
+static TTBC_THREAD_LOCAL hash_loc b_equals;
+static TTBC_THREAD_LOCAL hash_loc b_greater_than;
+static TTBC_THREAD_LOCAL hash_loc b_less_than;
+static TTBC_THREAD_LOCAL hash_loc b_plus;
+static TTBC_THREAD_LOCAL hash_loc b_minus;
+static TTBC_THREAD_LOCAL hash_loc b_concatenate;
+static TTBC_THREAD_LOCAL hash_loc b_gets;
+static TTBC_THREAD_LOCAL hash_loc b_add_period;
+static TTBC_THREAD_LOCAL hash_loc b_call_type;
+static TTBC_THREAD_LOCAL hash_loc b_change_case;
+static TTBC_THREAD_LOCAL hash_loc b_chr_to_int;
+static TTBC_THREAD_LOCAL hash_loc b_cite;
+static TTBC_THREAD_LOCAL hash_loc b_duplicate;
+static TTBC_THREAD_LOCAL hash_loc b_empty;
+static TTBC_THREAD_LOCAL hash_loc b_format_name;
+static TTBC_THREAD_LOCAL hash_loc b_if;
+static TTBC_THREAD_LOCAL hash_loc b_int_to_chr;
+static TTBC_THREAD_LOCAL hash_loc b_int_to_str;
+static TTBC_THREAD_LOCAL hash_loc b_missing;
+static TTBC_THREAD_LOCAL hash_loc b_newline;
+static TTBC_THREAD_LOCAL hash_loc b_num_names;
+static TTBC_THREAD_LOCAL hash_loc b_pop;
+static TTBC_THREAD_LOCAL hash_loc b_preamble;
+static TTBC_THREAD_LOCAL hash_loc b_purify;
+static TTBC_THREAD_LOCAL hash_loc b_quote;
+static TTBC_THREAD_LOCAL hash_loc b_skip;
+static TTBC_THREAD_LOCAL hash_loc b_stack;
+static TTBC_THREAD_LOCAL hash_loc b_substring;
+static TTBC_THREAD_LOCAL hash_loc b_swap;
+static TTBC_THREAD_LOCAL hash_loc b_text_length;
+static TTBC_THREAD_LOCAL hash_loc b_text_prefix;
+static TTBC_THREAD_LOCAL hash_loc b_top_stack;
+static TTBC_THREAD_LOCAL hash_loc b_type;
+static TTBC_THREAD_LOCAL hash_loc b_warning;
+static TTBC_THREAD_LOCAL hash_loc b_while;
+static TTBC_THREAD_LOCAL hash_loc b_width;
+static TTBC_THREAD_LOCAL hash_loc b_write;
+static TTBC_THREAD_LOCAL hash_loc b_default;
+
+static TTBC_THREAD_LOCAL str_number s_null;
+static TTBC_THREAD_LOCAL str_number s_default;
+static TTBC_THREAD_LOCAL str_number *s_preamble;
+static TTBC_THREAD_LOCAL int32_t pop_lit1, pop_lit2, pop_lit3;
+static TTBC_THREAD_LOCAL stk_type pop_typ1, pop_typ2, pop_typ3;
+static TTBC_THREAD_LOCAL pool_pointer sp_ptr;
+static TTBC_THREAD_LOCAL pool_pointer sp_xptr1, sp_xptr2;
+static TTBC_THREAD_LOCAL pool_pointer sp_end;
+static TTBC_THREAD_LOCAL pool_pointer sp_length, sp2_length;
+static TTBC_THREAD_LOCAL int32_t sp_brace_level;
+static TTBC_THREAD_LOCAL buf_pointer ex_buf_xptr, ex_buf_yptr;
+static TTBC_THREAD_LOCAL hash_loc control_seq_loc;
+static TTBC_THREAD_LOCAL bool preceding_white;
+static TTBC_THREAD_LOCAL bool and_found;
+static TTBC_THREAD_LOCAL int32_t num_names;
+static TTBC_THREAD_LOCAL buf_pointer name_bf_ptr;
+static TTBC_THREAD_LOCAL buf_pointer name_bf_xptr, name_bf_yptr;
+static TTBC_THREAD_LOCAL int32_t nm_brace_level;
+static TTBC_THREAD_LOCAL buf_pointer *name_tok;
+static TTBC_THREAD_LOCAL ASCII_code *name_sep_char;
+static TTBC_THREAD_LOCAL buf_pointer num_tokens;
+static TTBC_THREAD_LOCAL bool token_starting;
+static TTBC_THREAD_LOCAL bool alpha_found;
+static TTBC_THREAD_LOCAL bool double_letter, end_of_group, to_be_written;
+static TTBC_THREAD_LOCAL buf_pointer first_start;
+static TTBC_THREAD_LOCAL buf_pointer first_end;
+static TTBC_THREAD_LOCAL buf_pointer last_end;
+static TTBC_THREAD_LOCAL buf_pointer von_start;
+static TTBC_THREAD_LOCAL buf_pointer von_end;
+static TTBC_THREAD_LOCAL buf_pointer jr_end;
+static TTBC_THREAD_LOCAL buf_pointer cur_token, last_token;
+static TTBC_THREAD_LOCAL bool use_default;
+static TTBC_THREAD_LOCAL buf_pointer num_commas;
+static TTBC_THREAD_LOCAL buf_pointer comma1, comma2;
+static TTBC_THREAD_LOCAL buf_pointer num_text_chars;
+static TTBC_THREAD_LOCAL unsigned char /*bad_conversion */ conversion_type;
+static TTBC_THREAD_LOCAL bool prev_colon;
+static TTBC_THREAD_LOCAL int verbose;
+static TTBC_THREAD_LOCAL int32_t min_crossrefs;
 
 /*:473*/ /*12: */ /*3: */
 
@@ -437,7 +459,7 @@ static void ttstub_puts(rust_output_handle_t handle, const char *s) {
 }
 
 #define FMT_BUF_SIZE 1024
-static char fmt_buf[FMT_BUF_SIZE] = "";
+static TTBC_THREAD_LOCAL char fmt_buf[FMT_BUF_SIZE] = "";
 
 PRINTF_FUNC(1, 2) static void printf_log(const char *fmt, ...) {
   va_list ap;
@@ -500,6 +522,8 @@ static bool input_ln(peekable_input_t *peekable) {
   if (eof(peekable))
     return false;
 
+  peekable->line_start = peekable->pos;
+
   while (!eoln(peekable)) {
     if (last >= buf_size)
       buffer_overflow();
@@ -880,11 +904,6 @@ static void bib_unbalanced_braces_print(void) {
   bib_err_print();
 }
 
-static void bib_field_too_long_print(void) {
-  printf_log("Your field is more than %ld characters", (long)buf_size);
-  bib_err_print();
-}
-
 static void macro_warn_print(void) {
   puts_log("Warning--string name \"");
   print_a_token();
@@ -1107,11 +1126,9 @@ static void add_extension(str_number ext) {
 }
 
 static str_number make_string(void) {
-  if (str_ptr == max_strings) {
-    print_overflow();
-    printf_log("number of strings %ld\n", (long)max_strings);
-    longjmp(error_jmpbuf, 1);
-  }
+  if (str_ptr == max_strings)
+    BIB_XRETALLOC("str_start", str_start, pool_pointer, max_strings,
+                  max_strings + MAX_STRINGS);
   str_ptr = str_ptr + 1;
   str_start[str_ptr] = pool_ptr;
   return str_ptr - 1;
@@ -1184,84 +1201,102 @@ static void upper_case(buf_type buf, buf_pointer bf_ptr, buf_pointer len) {
   }
 }
 
+#define HASH_INDEX_MIN 4096
+
+static void hash_overflow(void) {
+  hash_loc old = hash_max + 1;
+  size_t n;
+
+  hash_size = hash_size + MAX_STRINGS;
+  hash_max = hash_size + hash_base - 1;
+  n = hash_max + 1 - old;
+  BIB_XRETALLOC_NOSET("hash_text", hash_text, str_number, hash_size, hash_max);
+  BIB_XRETALLOC_NOSET("hash_ilk", hash_ilk, str_ilk, hash_size, hash_max);
+  BIB_XRETALLOC_NOSET("ilk_info", ilk_info, int32_t, hash_size, hash_max);
+  BIB_XRETALLOC_NOSET("fn_type", fn_type, fn_class, hash_size, hash_max);
+  BIB_XRETALLOC_NOSET("hash_code", hash_code, uint32_t, hash_size, hash_max);
+  memset(hash_text + old, 0, n * sizeof(str_number));
+  memset(hash_ilk + old, 0, n * sizeof(str_ilk));
+  memset(ilk_info + old, 0, n * sizeof(int32_t));
+  memset(fn_type + old, 0, n * sizeof(fn_class));
+  memset(hash_code + old, 0, n * sizeof(uint32_t));
+}
+
+/* (re)build hash_index with `slots` entries, a power of two, over every
+ * location handed out so far */
+static void hash_index_build(uint32_t slots) {
+  hash_loc p;
+  uint32_t i;
+
+  free(hash_index);
+  hash_index = XTALLOC(slots, hash_loc);
+  hash_index_mask = slots - 1;
+
+  for (p = hash_base; p <= hash_used; p++) {
+    for (i = hash_code[p] & hash_index_mask; hash_index[i] != 0;
+         i = (i + 1) & hash_index_mask)
+      ;
+    hash_index[i] = p;
+  }
+}
+
 static hash_loc str_lookup(buf_type buf, buf_pointer j, buf_pointer l,
                            str_ilk ilk, bool insert_it) {
-  int32_t h;
+  uint32_t h, i;
   hash_loc p;
   buf_pointer k;
   str_number str_num;
-  {
-    h = 0;
-    k = j;
-    while ((k < j + l)) {
+  int32_t probe;
+
+  /* FNV-1a */
+  h = 2166136261u;
+  for (k = j; k < j + l; k++)
+    h = (h ^ buf[k]) * 16777619u;
 
-      h = h + h + buf[k];
-      while ((h >= hash_prime))
-        h = h - hash_prime;
-      k = k + 1;
-    }
-  }
-  p = h + hash_base;
   hash_found = false;
   str_num = 0;
-  while (true) {
-
-    {
-      if (hash_text[p] > 0) {
-
-        if (str_eq_buf(hash_text[p], buf, j, l)) {
-
-          if (hash_ilk[p] == ilk) {
-            hash_found = true;
-            return p; /* str_found */
-          } else {
-
-            str_num = hash_text[p];
-          }
-        }
+  probe = 0;
+  for (i = h & hash_index_mask; (p = hash_index[i]) != 0;
+       i = (i + 1) & hash_index_mask) {
+    probe++;
+    if (hash_code[p] == h && str_eq_buf(hash_text[p], buf, j, l)) {
+      if (hash_ilk[p] == ilk) {
+        hash_found = true;
+        break;
       }
+      str_num = hash_text[p];
     }
-    if (hash_next[p] == 0 /*empty */) {
-      if (!insert_it)
-        return p; /* str_not_found */
-      {
-        if (hash_text[p] > 0) {
-          do {
-            if (hash_used == hash_base) {
-              print_overflow();
-              printf_log("hash size %ld\n", (long)hash_size);
-              longjmp(error_jmpbuf, 1);
-            }
-            hash_used = hash_used - 1;
-          } while (!((hash_text[hash_used] == 0)));
-          hash_next[p] = hash_used;
-          p = hash_used;
-        }
-        if (str_num > 0)
-          hash_text[p] = str_num;
-        else {
-
-          {
-            while ((pool_ptr + l > pool_size))
-              pool_overflow();
-          }
-          k = j;
-          while ((k < j + l)) {
-
-            {
-              str_pool[pool_ptr] = buf[k];
-              pool_ptr = pool_ptr + 1;
-            }
-            k = k + 1;
-          }
-          hash_text[p] = make_string();
-        }
-        hash_ilk[p] = ilk;
-      }
-      return p; /* str_found */
+  }
+  if (probe > hash_longest_probe)
+    hash_longest_probe = probe;
+  if (hash_found)
+    return p; /* str_found */
+  if (!insert_it)
+    return 0; /* str_not_found */
+
+  if (hash_used == hash_max)
+    hash_overflow();
+  hash_used = hash_used + 1;
+  p = hash_used;
+  if (str_num > 0)
+    hash_text[p] = str_num;
+  else {
+    while ((pool_ptr + l > pool_size))
+      pool_overflow();
+    for (k = j; k < j + l; k++) {
+      str_pool[pool_ptr] = buf[k];
+      pool_ptr = pool_ptr + 1;
     }
-    p = hash_next[p];
+    hash_text[p] = make_string();
   }
+  hash_ilk[p] = ilk;
+  hash_code[p] = h;
+  hash_index[i] = p;
+
+  /* keep the index at most half full, so probes stay short */
+  if ((uint32_t)(hash_used - hash_base + 1) * 2 > hash_index_mask + 1)
+    hash_index_build((hash_index_mask + 1) * 2);
+  return p; /* str_found */
 }
 
 static void pre_define(pds_type pds, pds_len len, str_ilk ilk) {
@@ -1344,120 +1379,60 @@ static bool find_cite_locs_for_this_cite_key(str_number cite_str) {
   return hash_found;
 }
 
-static void swap(cite_number swap1, cite_number swap2) {
-  cite_number innocent_bystander;
-  innocent_bystander = cite_info[swap2];
-  cite_info[swap2] = cite_info[swap1];
-  cite_info[swap1] = innocent_bystander;
-}
+/* The SORT command orders cites by their sort.key$ entry string, bytewise,
+ * a shorter key before any key it is a prefix of, and ties by cite number.
+ * Each key is gathered once into a record carrying its first four bytes
+ * big-endian, so most comparisons are one integer compare on a contiguous
+ * array rather than a walk through entry_strs. */
+typedef struct {
+  const ASCII_code *key;
+  int32_t len;
+  uint32_t prefix;
+  cite_number cite;
+} sort_ent_t;
+
+static int sort_ent_cmp(const void *a, const void *b) {
+  const sort_ent_t *x = a, *y = b;
+  int32_t n;
+  int c;
 
-static bool less_than(cite_number arg1, cite_number arg2) {
-  int32_t char_ptr;
-  str_ent_loc ptr1, ptr2;
-  ASCII_code char1, char2;
-  ptr1 = arg1 * num_ent_strs + sort_key_num;
-  ptr2 = arg2 * num_ent_strs + sort_key_num;
-  char_ptr = 0;
-  while (true) {
+  if (x->prefix != y->prefix)
+    return x->prefix < y->prefix ? -1 : 1;
+  n = x->len < y->len ? x->len : y->len;
+  c = memcmp(x->key, y->key, n);
+  if (c != 0)
+    return c;
+  if (x->len != y->len)
+    return x->len < y->len ? -1 : 1;
+  return x->cite < y->cite ? -1 : x->cite > y->cite;
+}
 
-    char1 = entry_strs[(ptr1) * (ent_str_size + 1) + (char_ptr)];
-    char2 = entry_strs[(ptr2) * (ent_str_size + 1) + (char_ptr)];
-    if (char1 == 127 /*end_of_string */) {
+static void sort_cites(void) {
+  sort_ent_t *ents = XTALLOC(num_cites, sort_ent_t);
+  cite_number i;
+  int32_t k;
 
-      if (char2 == 127 /*end_of_string */) {
+  for (i = 0; i < num_cites; i++) {
+    sort_ent_t *e = &ents[i];
+    str_ent_loc ptr = cite_info[i] * num_ent_strs + sort_key_num;
 
-        if (arg1 < arg2) {
-          return true;
-        } else if (arg1 > arg2) {
-          return false;
-        } else {
-          puts_log("Duplicate sort key");
-          print_confusion();
-          longjmp(error_jmpbuf, 1);
-        }
-      } else {
-        return true;
-      }
-    } else if (char2 == 127 /*end_of_string */) {
-      return false;
-    } else if (char1 < char2) {
-      return true;
-    } else if (char1 > char2) {
-      return false;
-    }
-    char_ptr = char_ptr + 1;
+    e->key = &entry_strs[ptr * (ent_str_size + 1)];
+    e->len = 0;
+    while (e->key[e->len] != 127 /*end_of_string */)
+      e->len++;
+    /* padding a short key with zeros can only tie with a real zero byte,
+     * and ties fall through to the full compare */
+    e->prefix = 0;
+    for (k = 0; k < 4; k++)
+      e->prefix = (e->prefix << 8) | (k < e->len ? e->key[k] : 0);
+    e->cite = cite_info[i];
   }
-}
 
-static void quick_sort(cite_number left_end, cite_number right_end) {
-  cite_number left, right;
-  cite_number insert_ptr;
-  cite_number middle;
-  cite_number partition;
-  ;
+  qsort(ents, num_cites, sizeof(sort_ent_t), sort_ent_cmp);
 
-  if (right_end - left_end < 10 /*short_list */) { /*305: */
-    {
-      register int32_t for_end;
-      insert_ptr = left_end + 1;
-      for_end = right_end;
-      if (insert_ptr <= for_end)
-        do {
-          {
-            register int32_t for_end;
-            right = insert_ptr;
-            for_end = left_end + 1;
-            if (right >= for_end)
-              do {
-                if (less_than(cite_info[right - 1], cite_info[right]))
-                  goto lab24;
-                swap(right - 1, right);
-              } while (right-- > for_end);
-          }
-        lab24: /*next_insert */;
-        } while (insert_ptr++ < for_end);
-    }
-  } else {
-
-    {
-      left = left_end + 4;
-      middle = (left_end + right_end) / 2;
-      right = right_end - 4;
-      if (less_than(cite_info[left], cite_info[middle])) {
-
-        if (less_than(cite_info[middle], cite_info[right]))
-          swap(left_end, middle);
-        else if (less_than(cite_info[left], cite_info[right]))
-          swap(left_end, right);
-        else
-          swap(left_end, left);
-      } else if (less_than(cite_info[right], cite_info[middle]))
-        swap(left_end, middle);
-      else if (less_than(cite_info[right], cite_info[left]))
-        swap(left_end, right);
-      else
-        swap(left_end, left);
-    }
-    {
-      partition = cite_info[left_end];
-      left = left_end + 1;
-      right = right_end;
-      do {
-        while ((less_than(cite_info[left], partition)))
-          left = left + 1;
-        while ((less_than(partition, cite_info[right])))
-          right = right - 1;
-        if (left < right) {
-          swap(left, right);
-          left = left + 1;
-          right = right - 1;
-        }
-      } while (!((left == right + 1)));
-      swap(left_end, right);
-      quick_sort(left_end, right - 1);
-      quick_sort(left, right_end);
-    }
-  }
+  for (i = 0; i < num_cites; i++)
+    cite_info[i] = ents[i].cite;
+  free(ents);
 }
 
 static void build_in(pds_type pds, pds_len len, hash_loc *fn_hash_loc,
@@ -1985,10 +1960,9 @@ static bool eat_bib_white_space(void) {
 
 static bool compress_bib_white(void) {
   {
-    if (ex_buf_ptr == buf_size) {
-      bib_field_too_long_print();
-      return false;
-    } else {
+    if (ex_buf_ptr == buf_size)
+      buffer_overflow();
+    {
 
       ex_buf[ex_buf_ptr] = 32 /*space */;
       ex_buf_ptr = ex_buf_ptr + 1;
@@ -2032,10 +2006,9 @@ static bool scan_balanced_braces(void) {
       case 123: {
         bib_brace_level = bib_brace_level + 1;
         {
-          if (ex_buf_ptr == buf_size) {
-            bib_field_too_long_print();
-            return false;
-          } else {
+          if (ex_buf_ptr == buf_size)
+            buffer_overflow();
+          {
 
             ex_buf[ex_buf_ptr] = 123 /*left_brace */;
             ex_buf_ptr = ex_buf_ptr + 1;
@@ -2056,10 +2029,9 @@ static bool scan_balanced_braces(void) {
             case 125: {
               bib_brace_level = bib_brace_level - 1;
               {
-                if (ex_buf_ptr == buf_size) {
-                  bib_field_too_long_print();
-                  return false;
-                } else {
+                if (ex_buf_ptr == buf_size)
+                  buffer_overflow();
+                {
 
                   ex_buf[ex_buf_ptr] = 125 /*right_brace */;
                   ex_buf_ptr = ex_buf_ptr + 1;
@@ -2080,10 +2052,9 @@ static bool scan_balanced_braces(void) {
             case 123: {
               bib_brace_level = bib_brace_level + 1;
               {
-                if (ex_buf_ptr == buf_size) {
-                  bib_field_too_long_print();
-                  return false;
-                } else {
+                if (ex_buf_ptr == buf_size)
+                  buffer_overflow();
+                {
 
                   ex_buf[ex_buf_ptr] = 123 /*left_brace */;
                   ex_buf_ptr = ex_buf_ptr + 1;
@@ -2101,10 +2072,9 @@ static bool scan_balanced_braces(void) {
             } break;
             default: {
               {
-                if (ex_buf_ptr == buf_size) {
-                  bib_field_too_long_print();
-                  return false;
-                } else {
+                if (ex_buf_ptr == buf_size)
+                  buffer_overflow();
+                {
 
                   ex_buf[ex_buf_ptr] = buffer[buf_ptr2];
                   ex_buf_ptr = ex_buf_ptr + 1;
@@ -2130,10 +2100,9 @@ static bool scan_balanced_braces(void) {
       } break;
       default: {
         {
-          if (ex_buf_ptr == buf_size) {
-            bib_field_too_long_print();
-            return false;
-          } else {
+          if (ex_buf_ptr == buf_size)
+            buffer_overflow();
+          {
 
             ex_buf[ex_buf_ptr] = buffer[buf_ptr2];
             ex_buf_ptr = ex_buf_ptr + 1;
@@ -2244,10 +2213,9 @@ static bool scan_a_field_token_and_eat_white(void) {
       while ((tmp_ptr < buf_ptr2)) {
 
         {
-          if (ex_buf_ptr == buf_size) {
-            bib_field_too_long_print();
-            return false;
-          } else {
+          if (ex_buf_ptr == buf_size)
+            buffer_overflow();
+          {
 
             ex_buf[ex_buf_ptr] = buffer[tmp_ptr];
             ex_buf_ptr = ex_buf_ptr + 1;
@@ -2301,10 +2269,9 @@ static bool scan_a_field_token_and_eat_white(void) {
           if ((tmp_ptr < tmp_end_ptr) &&
               (lex_class[str_pool[tmp_ptr]] == 1 /*white_space */)) {
             {
-              if (ex_buf_ptr == buf_size) {
-                bib_field_too_long_print();
-                return false;
-              } else {
+              if (ex_buf_ptr == buf_size)
+                buffer_overflow();
+              {
 
                 ex_buf[ex_buf_ptr] = 32 /*space */;
                 ex_buf_ptr = ex_buf_ptr + 1;
@@ -2319,19 +2286,17 @@ static bool scan_a_field_token_and_eat_white(void) {
         while ((tmp_ptr < tmp_end_ptr)) {
 
           if (lex_class[str_pool[tmp_ptr]] != 1 /*white_space */) {
-            if (ex_buf_ptr == buf_size) {
-              bib_field_too_long_print();
-              return false;
-            } else {
+            if (ex_buf_ptr == buf_size)
+              buffer_overflow();
+            {
 
               ex_buf[ex_buf_ptr] = str_pool[tmp_ptr];
               ex_buf_ptr = ex_buf_ptr + 1;
             }
           } else if (ex_buf[ex_buf_ptr - 1] != 32 /*space */) {
-            if (ex_buf_ptr == buf_size) {
-              bib_field_too_long_print();
-              return false;
-            } else {
+            if (ex_buf_ptr == buf_size)
+              buffer_overflow();
+            {
 
               ex_buf[ex_buf_ptr] = 32 /*space */;
               ex_buf_ptr = ex_buf_ptr + 1;
@@ -5943,6 +5908,209 @@ buf_ptr2 = buf_ptr2 + 1;
 }
 }
 
+/* The entries of a .bib file, kept in the host cache under the MD5 of the
+ * file. With them, an entry whose key is not cited (so far: crossrefs cite
+ * more as the file is read) is skipped by seeking past it, rather than
+ * scanning its fields to throw them away. An index is only written for a
+ * file read without errors, so skipping cannot hide one. Commands
+ * (@string, @preamble, @comment) are always read. Not used with
+ * \nocite{*}, where every entry is kept. */
+
+#define BIB_INDEX_KIND "bibindex1"
+
+typedef struct {
+  uint32_t start;    /* offset of the entry's "@" */
+  uint32_t end;      /* offset just past its closing delimiter */
+  uint32_t end_line; /* bib_line_num there */
+  uint32_t key;      /* of its lower-cased cite key, in keys */
+  uint32_t key_len;
+} bib_index_entry;
+
+static TTBC_THREAD_LOCAL struct {
+  unsigned char digest[16];
+  bool have_digest;
+  bool cached;        /* entries came from the cache, else are being recorded */
+  int errors;         /* error count when the file was opened */
+  bib_index_entry *entries;
+  uint32_t count, max, next;
+  unsigned char *keys;
+  uint32_t keys_len, keys_max;
+  uint32_t pending_start; /* of the entry being read */
+  uint32_t skipped, total; /* for the run's stats */
+} bib_index;
+
+static int error_count(void) {
+  return history >= HISTORY_ERROR_ISSUED ? err_count : 0;
+}
+
+static bool bib_index_load(const unsigned char *data, size_t len) {
+  uint32_t header[2], i;
+  size_t entries_len;
+
+  if (len < sizeof(header))
+    return false;
+  memcpy(header, data, sizeof(header));
+  entries_len = (size_t)header[0] * sizeof(bib_index_entry);
+  if (len != sizeof(header) + entries_len + header[1])
+    return false;
+
+  bib_index.count = bib_index.max = header[0];
+  bib_index.keys_len = bib_index.keys_max = header[1];
+  bib_index.entries = xmalloc_array(bib_index_entry, bib_index.count);
+  bib_index.keys = xmalloc_array(unsigned char, bib_index.keys_len);
+  memcpy(bib_index.entries, data + sizeof(header), entries_len);
+  memcpy(bib_index.keys, data + sizeof(header) + entries_len, bib_index.keys_len);
+
+  for (i = 0; i < bib_index.count; i++) {
+    const bib_index_entry *e = &bib_index.entries[i];
+    if (e->end <= e->start || e->key_len >= (uint32_t)buf_size ||
+        e->key > bib_index.keys_len || e->key_len > bib_index.keys_len - e->key)
+      return false;
+  }
+  return true;
+}
+
+static void bib_index_reset(void) {
+  free(bib_index.entries);
+  free(bib_index.keys);
+  bib_index.entries = NULL;
+  bib_index.keys = NULL;
+  bib_index.count = bib_index.max = bib_index.next = 0;
+  bib_index.keys_len = bib_index.keys_max = 0;
+  bib_index.have_digest = false;
+  bib_index.cached = false;
+}
+
+static void bib_index_open(peekable_input_t *peekable) {
+  size_t size, done = 0;
+  unsigned char *data;
+  void *blob;
+
+  bib_index_reset();
+  bib_index.errors = error_count();
+
+  size = ttbc_input_get_size(peekable->handle);
+  if (size == 0 || size >= UINT32_MAX)
+    return;
+
+  data = xmalloc(size);
+  while (done < size) {
+    ssize_t n = ttbc_input_read(peekable->handle, (char *)data + done, size - done);
+    if (n <= 0)
+      break;
+    done += (size_t)n;
+  }
+  peekable_seek(peekable, 0);
+  if (done == size && ttbc_get_data_md5(data, size, bib_index.digest) == 0)
+    bib_index.have_digest = true;
+  free(data);
+  if (!bib_index.have_digest)
+    return;
+
+  blob = ttbc_cache_blob_get(BIB_INDEX_KIND, bib_index.digest, &size);
+  if (blob) {
+    if (bib_index_load(blob, size))
+      bib_index.cached = true;
+    else {
+      free(bib_index.entries);
+      free(bib_index.keys);
+      bib_index.entries = NULL;
+      bib_index.keys = NULL;
+      bib_index.count = bib_index.max = bib_index.keys_len = bib_index.keys_max = 0;
+    }
+    free(blob);
+  }
+}
+
+/* Skip the entry starting at start when it is in the index and uncited.
+ * Leaves the rest of its last line in buffer, as reading it would. */
+static bool bib_index_skip(size_t start) {
+  const bib_index_entry *e;
+  peekable_input_t *peekable = bib_file[bib_ptr];
+
+  if (!bib_index.cached || all_entries)
+    return false;
+
+  while (bib_index.next < bib_index.count &&
+         bib_index.entries[bib_index.next].start < start)
+    bib_index.next++;
+  if (bib_index.next == bib_index.count ||
+      bib_index.entries[bib_index.next].start != start)
+    return false;
+
+  e = &bib_index.entries[bib_index.next++];
+  bib_index.total++;
+  memcpy(ex_buf, bib_index.keys + e->key, e->key_len);
+  str_lookup(ex_buf, 0, e->key_len, 10 /*lc_cite_ilk */, false);
+  if (hash_found)
+    return false;
+
+  bib_index.skipped++;
+  peekable_seek(peekable, e->end);
+  bib_line_num = e->end_line;
+  if (!input_ln(peekable))
+    last = 0;
+  buf_ptr2 = 0;
+  return true;
+}
+
+static void bib_index_record_key(buf_type buf, buf_pointer j, buf_pointer l) {
+  if (bib_index.cached || !bib_index.have_digest)
+    return;
+
+  if (bib_index.count == bib_index.max) {
+    bib_index.max = bib_index.max ? 2 * bib_index.max : 256;
+    bib_index.entries = (bib_index_entry *)xrealloc(
+        bib_index.entries, bib_index.max * sizeof(bib_index_entry));
+  }
+  if (bib_index.keys_len + (uint32_t)l > bib_index.keys_max) {
+    while (bib_index.keys_len + (uint32_t)l > bib_index.keys_max)
+      bib_index.keys_max = bib_index.keys_max ? 2 * bib_index.keys_max : 4096;
+    bib_index.keys = (unsigned char *)xrealloc(bib_index.keys, bib_index.keys_max);
+  }
+
+  bib_index.entries[bib_index.count].start = bib_index.pending_start;
+  bib_index.entries[bib_index.count].end = 0; /* until bib_index_record_end */
+  bib_index.entries[bib_index.count].key = bib_index.keys_len;
+  bib_index.entries[bib_index.count].key_len = (uint32_t)l;
+  memcpy(bib_index.keys + bib_index.keys_len, buf + j, l);
+  bib_index.keys_len += (uint32_t)l;
+}
+
+static void bib_index_record_end(size_t end) {
+  bib_index_entry *e;
+
+  if (bib_index.cached || !bib_index.have_digest ||
+      bib_index.count == bib_index.max)
+    return;
+
+  e = &bib_index.entries[bib_index.count];
+  if (e->start != bib_index.pending_start)
+    return;
+  e->end = (uint32_t)end;
+  e->end_line = (uint32_t)bib_line_num;
+  bib_index.count++;
+}
+
+static void bib_index_close(void) {
+  if (!bib_index.cached && bib_index.have_digest &&
+      error_count() == bib_index.errors) {
+    uint32_t header[2] = {bib_index.count, bib_index.keys_len};
+    size_t entries_len = bib_index.count * sizeof(bib_index_entry);
+    size_t len = sizeof(header) + entries_len + bib_index.keys_len;
+    unsigned char *data = xmalloc(len);
+
+    memcpy(data, header, sizeof(header));
+    if (entries_len)
+      memcpy(data + sizeof(header), bib_index.entries, entries_len);
+    if (bib_index.keys_len)
+      memcpy(data + sizeof(header) + entries_len, bib_index.keys, bib_index.keys_len);
+    ttbc_cache_blob_put(BIB_INDEX_KIND, bib_index.digest, data, len);
+    free(data);
+  }
+  bib_index_reset();
+}
+
 static void get_bib_command_or_entry_and_process(void) {
   at_bib_command = false;
   while (!scan1(64 /*at_sign */)) {
@@ -5958,6 +6126,9 @@ static void get_bib_command_or_entry_and_process(void) {
       print_confusion();
       longjmp(error_jmpbuf, 1);
     }
+    bib_index.pending_start = (uint32_t)(bib_file[bib_ptr]->line_start + buf_ptr2);
+    if (bib_index_skip(bib_index.pending_start))
+      return;
     buf_ptr2 = buf_ptr2 + 1;
     {
       if (!eat_bib_white_space()) {
@@ -6159,6 +6330,7 @@ static void get_bib_command_or_entry_and_process(void) {
         tmp_ptr = tmp_ptr + 1;
       }
       lower_case(ex_buf, buf_ptr1, (buf_ptr2 - buf_ptr1));
+      bib_index_record_key(ex_buf, buf_ptr1, (buf_ptr2 - buf_ptr1));
       if (all_entries)
         lc_cite_loc = str_lookup(ex_buf, buf_ptr1, (buf_ptr2 - buf_ptr1),
                                  10 /*lc_cite_ilk */, true);
@@ -6328,6 +6500,7 @@ static void get_bib_command_or_entry_and_process(void) {
     }
   loop_exit:
     buf_ptr2 = buf_ptr2 + 1;
+    bib_index_record_end(bib_file[bib_ptr]->line_start + buf_ptr2);
   }
 }
 
@@ -6388,6 +6561,7 @@ static void bst_read_command(void) {
       }
     }
     read_performed = true;
+    bib_index.skipped = bib_index.total = 0;
     bib_ptr = 0;
     while (bib_ptr < num_bib_files) {
 
@@ -6403,13 +6577,21 @@ static void bst_read_command(void) {
       }
       bib_line_num = 0;
       buf_ptr2 = last;
+      bib_index_open(bib_file[bib_ptr]);
       while (!eof(bib_file[bib_ptr]))
         get_bib_command_or_entry_and_process();
+      bib_index_close();
       peekable_close(bib_file[bib_ptr]);
       bib_file[bib_ptr] = NULL;
       bib_ptr = bib_ptr + 1;
     }
     reading_completed = true;
+    if (bib_index.total > 0) {
+      char detail[96];
+      snprintf(detail, sizeof detail, "bib index: %u of %u entries skipped",
+               (unsigned)bib_index.skipped, (unsigned)bib_index.total);
+      ttbc_fire_checkpoint(TTBC_CHECKPOINT_STATS, detail);
+    }
     ;
 
     {
@@ -6669,7 +6851,7 @@ static void bst_sort_command(void) {
   }
 
   if (num_cites > 1)
-    quick_sort(0, num_cites - 1);
+    sort_cites();
 }
 
 static void bst_strings_command(void) {
@@ -6811,49 +6993,9 @@ static void setup_params(void) {
   if (hash_size < 5000 /*HASH_SIZE */)
     hash_size = 5000 /*HASH_SIZE */;
   hash_max = hash_size + hash_base - 1;
-  end_of_def = hash_max + 1;
-  undefined = hash_max + 1;
-}
-
-static void compute_hash_prime(void) {
-  int32_t hash_want, k, j, o, n, square;
-  bool j_prime;
-
-  hash_want = (hash_size / 20) * 17;
-  j = 1;
-  k = 1;
-  hash_prime = 2;
-  hash_next[k] = hash_prime;
-  o = 2;
-  square = 9;
-
-  while (hash_prime < hash_want) {
-    do {
-      j += 2;
-
-      if (j == square) {
-        hash_text[o] = j;
-        j += 2;
-        o += 1;
-        square = hash_next[o] * hash_next[o];
-      }
-
-      n = 2;
-      j_prime = true;
-
-      while (n < o && j_prime) {
-        while (hash_text[n] < j)
-          hash_text[n] += 2 * hash_next[n];
-        if (hash_text[n] == j)
-          j_prime = false;
-        n = n + 1;
-      }
-    } while (!j_prime);
-
-    k++;
-    hash_prime = j;
-    hash_next[k] = hash_prime;
-  }
+  /* never a location, however far the hash grows */
+  end_of_def = INT32_MAX;
+  undefined = INT32_MAX;
 }
 
 static int initialize(const char *aux_file_name) {
@@ -6868,14 +7010,8 @@ static int initialize(const char *aux_file_name) {
     bad = 10 * bad + 2;
   if (max_print_line >= buf_size)
     bad = 10 * bad + 3;
-  if (hash_prime < 128)
-    bad = 10 * bad + 4;
-  if (hash_prime > hash_size)
-    bad = 10 * bad + 5;
   if (hash_base != 1)
     bad = 10 * bad + 6;
-  if (max_strings > hash_size)
-    bad = 10 * bad + 7;
   if (max_cites > max_strings)
     bad = 10 * bad + 8;
   if (10 /*short_list */ < 2 * 4 /*end_offset */ + 2)
@@ -7029,12 +7165,12 @@ static int initialize(const char *aux_file_name) {
   char_width[125] = 500;
   char_width[126] = 500;
 
-  for (k = hash_base; k <= hash_max; k++) {
-    hash_next[k] = 0 /*empty */;
+  for (k = hash_base; k <= hash_max; k++)
     hash_text[k] = 0;
-  }
 
-  hash_used = hash_max + 1;
+  hash_used = hash_base - 1;
+  hash_longest_probe = 0;
+  hash_index_build(HASH_INDEX_MIN);
   pool_ptr = 0;
   str_ptr = 1;
   str_start[str_ptr] = pool_ptr;
@@ -7091,7 +7227,8 @@ void bibmem_cleanup(){
   free(entry_exists); entry_exists=0;
   free(cite_info); cite_info=0;
   free(str_start); str_start=0;
-  free(hash_next); hash_next=0;
+  free(hash_code); hash_code=0;
+  free(hash_index); hash_index=0;
   free(hash_text); hash_text=0;
   free(hash_ilk); hash_ilk=0;
   free(ilk_info); ilk_info=0;
@@ -7148,16 +7285,14 @@ int bibtex_main(const char *aux_file_name) {
   entry_exists = XTALLOC(max_cites + 1, bool);
   cite_info = XTALLOC(max_cites + 1, str_number);
   str_start = XTALLOC(max_strings + 1, pool_pointer);
-  hash_next = XTALLOC(hash_max + 1, hash_pointer);
   hash_text = XTALLOC(hash_max + 1, str_number);
   hash_ilk = XTALLOC(hash_max + 1, str_ilk);
   ilk_info = XTALLOC(hash_max + 1, int32_t);
   fn_type = XTALLOC(hash_max + 1, fn_class);
+  hash_code = XTALLOC(hash_max + 1, uint32_t);
   lit_stack = XTALLOC(lit_stk_size + 1, int32_t);
   lit_stk_type = XTALLOC(lit_stk_size + 1, stk_type);
 
-  compute_hash_prime();
-
   if (initialize(aux_file_name)) {
     /* TODO: log initialization or get_the_..() error */
     return HISTORY_FATAL_ERROR;
@@ -7174,8 +7309,8 @@ int bibtex_main(const char *aux_file_name) {
   {
     char buf[512];
     snprintf(buf, sizeof(buf) - 1,
-             "Capacity: max_strings=%ld, hash_size=%ld, hash_prime=%ld\n",
-             (long)max_strings, (long)hash_size, (long)hash_prime);
+             "Capacity: max_strings=%ld, hash_size=%ld (both grow as needed)\n",
+             (long)max_strings, (long)hash_size);
     ttbc_output_write(log_file, buf, strlen(buf));
   }
 
@@ -7229,6 +7364,16 @@ close_up_shop:
     print_bib_name();
   }
 
+  {
+    char buf[512];
+    snprintf(buf, sizeof(buf) - 1,
+             "Hash: %ld locations, index of %ld (longest probe %ld); "
+             "%ld strings, %ld pool characters\n",
+             (long)(hash_used - hash_base + 1), (long)(hash_index_mask + 1),
+             (long)hash_longest_probe, (long)str_ptr, (long)pool_ptr);
+    ttbc_output_write(log_file, buf, strlen(buf));
+  }
+
   switch (history) {
   case HISTORY_SPOTLESS:
     break;
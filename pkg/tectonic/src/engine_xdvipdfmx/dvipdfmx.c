@@ -46,6 +46,7 @@
 #include "dpx-fontmap.h"
 #include "dpx-mem.h"
 #include "dpx-mpost.h"
+#include "dpx-pagedigest.h"
 #include "dpx-pdfdev.h"
 #include "dpx-pdfdoc.h"
 #include "dpx-pdfencrypt.h"
@@ -74,38 +75,38 @@ typedef struct page_range
 #define OPT_PDFOBJ_NO_PREDICTOR   (1 << 5)
 #define OPT_PDFOBJ_NO_OBJSTM      (1 << 6)
 
-static char     ignore_colors = 0;
-static int      bookmark_open = 0;
-static double   mag           = 1.0;
-static int      font_dpi      = 600;
-static int      enable_thumbnail = 0;
+static TTBC_THREAD_LOCAL char     ignore_colors = 0;
+static TTBC_THREAD_LOCAL int      bookmark_open = 0;
+static TTBC_THREAD_LOCAL double   mag           = 1.0;
+static TTBC_THREAD_LOCAL int      font_dpi      = 600;
+static TTBC_THREAD_LOCAL int      enable_thumbnail = 0;
 
 /*
  * Precision is essentially limited to 0.01pt.
  * See, dev_set_string() in pdfdev.c.
  */
-static int pdfdecimaldigits = 3;
+static TTBC_THREAD_LOCAL int pdfdecimaldigits = 3;
 
 /* Image cache life in hours */
 /*  0 means erase all old images and leave new images */
 /* -1 means erase all old images and also erase new images */
 /* -2 means ignore image cache (default) */
-static int image_cache_life = -2;
+static TTBC_THREAD_LOCAL int image_cache_life = -2;
 /* Image format conversion filter template */
-static char   *filter_template  = NULL;
+static TTBC_THREAD_LOCAL char   *filter_template  = NULL;
 
 
 /* Encryption */
-static int     do_encryption = 0;
-static int     key_bits      = 40;
-static int32_t permission    = 0x003C;
+static TTBC_THREAD_LOCAL int     do_encryption = 0;
+static TTBC_THREAD_LOCAL int     key_bits      = 40;
+static TTBC_THREAD_LOCAL int32_t permission    = 0x003C;
 
 /* Page device */
 /* Tectonic: landscape_mode, paper_width, paper_height used to be defined here,
  * but are now defined in the `tectonic_pdf_io` crate. */
-static double x_offset = 72.0;
-static double y_offset = 72.0;
-static int translate_origin = 0;
+static TTBC_THREAD_LOCAL double x_offset = 72.0;
+static TTBC_THREAD_LOCAL double y_offset = 72.0;
+static TTBC_THREAD_LOCAL int translate_origin = 0;
 
 static void
 select_paper (const char *paperspec)
@@ -131,9 +132,31 @@ select_paper (const char *paperspec)
     _tt_abort("Invalid paper size: %s (%.2fx%.2f)", paperspec, paper_width, paper_height);
 }
 
-PageRange *page_ranges = NULL;
-unsigned int num_page_ranges = 0;
-unsigned int max_page_ranges = 0;
+TTBC_THREAD_LOCAL PageRange *page_ranges = NULL;
+TTBC_THREAD_LOCAL unsigned int num_page_ranges = 0;
+TTBC_THREAD_LOCAL unsigned int max_page_ranges = 0;
+
+/* Write the pages outside page_ranges blank instead of leaving them out, so
+ * a preview can convert the pages on screen and keep every page where it
+ * was (see XdvipdfmxConfig.pages). */
+static TTBC_THREAD_LOCAL int blank_unselected = 0;
+
+static int
+page_selected (const PageRange *ranges, unsigned int count, int page_no)
+{
+  unsigned int i;
+
+  for (i = 0; i < count; i++) {
+    int first = ranges[i].first, last = ranges[i].last;
+
+    if (last < 0)
+      last += dvi_npages();
+    if ((first <= page_no && page_no <= last) ||
+        (last <= page_no && page_no <= first))
+      return 1;
+  }
+  return 0;
+}
 
 static void
 select_pages (const char *pagespec)
@@ -201,9 +224,20 @@ do_dvi_pages (void)
   double   page_width, page_height;
   double   init_paper_width, init_paper_height;
   pdf_rect mediabox;
+  PageRange *selected = NULL;
+  unsigned int num_selected = 0;
 
   spc_exec_at_begin_document();
 
+  if (blank_unselected && num_page_ranges > 0) {
+    /* every page, in order; page_selected decides which get content */
+    selected = page_ranges;
+    num_selected = num_page_ranges;
+    page_ranges = NULL;
+    num_page_ranges = 0;
+    max_page_ranges = 0;
+  }
+
   if (num_page_ranges == 0) {
     if (!page_ranges) {
       page_ranges = NEW(1, struct page_range);
@@ -275,7 +309,14 @@ do_dvi_pages (void)
           mediabox.ury = page_height;
           pdf_doc_set_mediabox(page_count+1, &mediabox);
         }
-        dvi_do_page(page_height, x_offset, y_offset);
+        if (selected && !page_selected(selected, num_selected, page_no)) {
+          dvi_do_blank_page(page_height, x_offset, y_offset);
+          pagedigest_skip_page();
+        } else {
+          pagedigest_begin_page(page_width, page_height, x_offset, y_offset);
+          dvi_do_page(page_height, x_offset, y_offset);
+          pagedigest_end_page();
+        }
         page_count++;
         dpx_message("]");
       }
@@ -292,6 +333,8 @@ do_dvi_pages (void)
     }
   }
 
+  free(selected);
+
   if (page_count < 1) {
     _tt_abort("No pages fall in range!");
   }
@@ -327,7 +370,12 @@ dvipdfmx_main (
   int opt_flags,
   bool translate,
   bool compress,
+  int compression_level,
+  unsigned int compression_threads,
+  unsigned int image_dpi,
+  bool draft_images,
   bool deterministic_tags,
+  bool page_digests,
   bool quiet,
   unsigned int verbose,
   time_t build_date,
@@ -341,7 +389,6 @@ dvipdfmx_main (
   struct pdf_setting settings;
   int pdf_version_major = 1;
   int pdf_version_minor = 5;
-  int compression_level = 9;
   double annot_grow_x = 0;
   double annot_grow_y = 0;
 
@@ -361,6 +408,7 @@ dvipdfmx_main (
   pdf_dev_reset_global_state();
   pdf_obj_reset_global_state();
   pdf_font_reset_unique_tag_state();
+  pagedigest_reset();
 
   if (quiet) {
     shut_up(2);
@@ -369,6 +417,10 @@ dvipdfmx_main (
   }
 
   pdf_font_set_deterministic_unique_tags(deterministic_tags ? 1 : 0);
+  if (page_digests)
+    pagedigest_enable();
+  pdf_ximage_set_image_dpi((int) image_dpi);
+  pdf_ximage_set_draft_images(draft_images ? 1 : 0);
 
   pdf_init_fontmaps(); /* This must come before parsing options... */
 
@@ -436,6 +488,7 @@ dvipdfmx_main (
   }
 
   settings.object.compression_level = compress ? compression_level : 0;
+  settings.object.compression_threads = compression_threads;
 
   if (opt_flags & OPT_PDFOBJ_NO_OBJSTM) {
     settings.object.enable_objstm = 0;
@@ -484,10 +537,14 @@ dvipdfmx_main (
 
   pdf_close_document();
 
+  pagedigest_finish(pdf_filename);
+
   pdf_close_fontmaps(); /* pdf_font may depend on fontmap. */
 
   dvi_close();
 
+  pdf_obj_pools_close();
+
   dpx_message("\n");
   free(page_ranges);
 
@@ -503,6 +560,7 @@ tt_engine_xdvipdfmx_main(
   int rv;
 
   dpx_reset_message_handle();
+  blank_unselected = config->pages != NULL;
 
   if (setjmp(*ttbc_global_engine_enter())) {
     dpx_reset_message_handle();
@@ -516,11 +574,16 @@ tt_engine_xdvipdfmx_main(
   rv = dvipdfmx_main(
     pdfname,
     dviname,
-    NULL, /* pagespec */
-    0, /* opt_flags */
+    config->pages, /* pagespec */
+    config->enable_object_streams ? 0 : OPT_PDFOBJ_NO_OBJSTM, /* opt_flags */
     false, /* translate */
     (bool) config->enable_compression,
+    config->compression_level,
+    config->compression_threads,
+    config->image_dpi,
+    (bool) config->draft_images,
     (bool) config->deterministic_tags,
+    (bool) config->page_digests,
     false, /* quiet */
     0, /* verbose */
     (time_t) config->build_date,
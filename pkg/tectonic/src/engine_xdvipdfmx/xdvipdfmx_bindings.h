@@ -10,7 +10,17 @@ typedef struct {
   const char *paperspec;
   unsigned char enable_compression;
   unsigned char deterministic_tags;
+  unsigned char compression_level;
+  unsigned char enable_object_streams;
+  unsigned char page_digests;
+  /* raster images as gray boxes of their size, see pdf_ximage_set_draft_images */
+  unsigned char draft_images;
+  unsigned int compression_threads;
+  unsigned int image_dpi;
   uint64_t build_date;
+  /* NULL for every page; else a page range like "40-42": those pages are
+   * written as usual, the others blank, so the page count stays the same */
+  const char *pages;
 } XdvipdfmxConfig;
 
 #ifdef __cplusplus
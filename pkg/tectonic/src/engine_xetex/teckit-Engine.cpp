@@ -120,6 +120,12 @@ Stage::lookaheadCount() const
 	return 0;
 }
 
+bool
+Stage::passesThrough(UInt32 /*c*/) const
+{
+	return false;
+}
+
 #include "teckit-NormalizationData.c"
 
 Normalizer::Normalizer(bool compose)
@@ -180,6 +186,13 @@ Normalizer::Reset()
 	oBufSafe = 0;
 }
 
+bool
+Normalizer::passesThrough(UInt32 c) const
+{
+	// ASCII has no decomposition and never composes with other ASCII
+	return c < 0x80;
+}
+
 void
 Normalizer::decompose(UInt32 c)
 {
@@ -471,6 +484,40 @@ Pass::lookaheadCount() const
 			iBufEnd - iBufPtr;
 }
 
+bool
+Pass::passesThrough(UInt32 c) const
+{
+	// Only a Unicode pass can hand a char back as it came. A char whose lookup
+	// holds no rule is copied however the text around it reads, since rules are
+	// only ever tried from the lookup of the char they start at.
+	if (!bInputIsUnicode || !bOutputIsUnicode || c > 0xffff)
+		return false;
+
+	UInt16	charIndex = 0;
+	if (reinterpret_cast<const UInt8*>(lookupBase) != pageBase) {
+		const UInt8*	pageMap = pageBase;
+		if (bSupplementaryChars)
+			pageMap = READ(planeMap[0]) != 0xff ? pageBase + 256 * READ(planeMap[0]) : 0;
+		if (pageMap != 0 && READ(pageMap[c >> 8]) != 0xff) {
+			const UInt16*	charMapBase = reinterpret_cast<const UInt16*>(pageBase + 256 * numPageMaps);
+			const UInt16*	charMap = charMapBase + 256 * READ(pageMap[c >> 8]);
+			charIndex = READ(charMap[c & 0xff]);
+		}
+	}
+	const Lookup*	lookup = lookupBase + charIndex;
+
+	UInt8	ruleType = READ(lookup->rules.type);
+	if (ruleType == kLookupType_Unmapped)
+		return true;
+	if (ruleType == kLookupType_StringRules)
+		return READ(lookup->rules.ruleCount) == 0;
+	if ((ruleType & kLookupType_RuleTypeMask) == kLookupType_ExtStringRules)
+		return READ(lookup->rules.ruleCount) == 0 && (ruleType & kLookupType_ExtRuleCountMask) == 0;
+	if (ruleType == kLookupType_IllegalDBCS)
+		return false;
+	return READ(lookup->usv) == c;
+}
+
 UInt32
 Pass::inputChar(long inIndex)
 	// Called by DoMapping or match to read the character at a given location
@@ -1284,7 +1331,9 @@ Converter::Converter(const Byte* inTable, UInt32 inTableSize, bool inForward,
 	, pendingOutputChar(kInvalidChar)
 	, status(kStatus_NoError)
 	, warningStatus(0)
+	, idle(true)
 {
+	memset(asciiIdentity, 0, sizeof(asciiIdentity));
 	finalStage = this;
 	UInt16	normForm = 0;
 	if (inTable != 0) {
@@ -1433,6 +1482,8 @@ Converter::Converter(const Byte* inTable, UInt32 inTableSize, bool inForward,
 			finalStage = n;
 		}
 	}
+
+	findAsciiIdentity();
 }
 
 Converter::~Converter()
@@ -1728,6 +1779,50 @@ Converter::GetNamePtr(UInt16 nameID, const Byte*& outNamePtr, UInt32& outNameLen
 	return getNamePtrFromTable(table, nameID, outNamePtr, outNameLen);
 }
 
+void
+Converter::findAsciiIdentity()
+{
+	// Mappings such as tex-text leave most of ASCII alone; note which chars
+	// every stage copies, so text made only of those need not be run through
+	// the passes at all. Only worth it when input and output share a form.
+	if (inputForm != outputForm || inputForm < kForm_UTF8 || inputForm > kForm_UTF32LE)
+		return;
+	for (UInt32 c = 0; c < 0x80; ++c) {
+		const Stage*	s = finalStage;
+		while (s != this && s->passesThrough(c))
+			s = s->prevStage;
+		if (s == this)
+			asciiIdentity[c >> 5] |= 1UL << (c & 31);
+	}
+}
+
+bool
+Converter::copyAsciiIdentity(const Byte* inBuffer, UInt32 inLength,
+							 Byte* outBuffer, UInt32 outLength)
+{
+	UInt32	unit, low;
+	switch (inputForm) {
+		case kForm_UTF8:	unit = 1; low = 0; break;
+		case kForm_UTF16BE:	unit = 2; low = 1; break;
+		case kForm_UTF16LE:	unit = 2; low = 0; break;
+		case kForm_UTF32BE:	unit = 4; low = 3; break;
+		case kForm_UTF32LE:	unit = 4; low = 0; break;
+		default:			return false;
+	}
+	if (inLength % unit != 0 || outLength < inLength)
+		return false;
+	for (UInt32 i = 0; i < inLength; i += unit) {
+		for (UInt32 j = 0; j < unit; ++j)
+			if (j != low && inBuffer[i + j] != 0)
+				return false;
+		UInt8	c = inBuffer[i + low];
+		if (c >= 0x80 || (asciiIdentity[c >> 5] & (1UL << (c & 31))) == 0)
+			return false;
+	}
+	memcpy(outBuffer, inBuffer, inLength);
+	return true;
+}
+
 TECkit_Status
 Converter::ConvertBufferOpt(
 	const Byte* inBuffer, UInt32 inLength, UInt32* inUsed,
@@ -1740,6 +1835,18 @@ Converter::ConvertBufferOpt(
 
 	UInt32	outPtr = 0;
 
+	if (idle && (inOptions & kOptionsMask_InputComplete) == kOptionsComplete_InputIsComplete
+			&& copyAsciiIdentity(inBuffer, inLength, outBuffer, outLength)) {
+		if (inUsed)
+			*inUsed = inLength;
+		if (outUsed)
+			*outUsed = inLength;
+		if (lookaheadCount)
+			*lookaheadCount = 0;
+		return kStatus_NoError;
+	}
+	idle = false;
+
 	data = inBuffer;
 	dataLen = inLength;
 	dataPtr = 0;
@@ -1912,6 +2019,7 @@ Converter::Reset()
 		s->Reset();
 		s = s->prevStage;
 	}
+	idle = true;
 }
 
 bool
@@ -38,6 +38,9 @@ public:
 
 	virtual UInt32		lookaheadCount() const;
 
+	virtual bool		passesThrough(UInt32 c) const;
+							// true if c comes out of this stage unchanged whatever surrounds it
+
 protected:
 	friend class Converter;
 
@@ -60,6 +63,8 @@ public:
 
 	virtual void		Reset();
 
+	virtual bool		passesThrough(UInt32 c) const;
+
 protected:
 	UInt32				process();
 
@@ -91,6 +96,8 @@ public:
 
 	virtual UInt32		lookaheadCount() const;
 
+	virtual bool		passesThrough(UInt32 c) const;
+
 protected:
 	UInt32				DoMapping();
 
@@ -184,6 +191,10 @@ protected:
 	UInt32				_getCharWithSavedBytes();
 	void				_savePendingBytes();
 
+	void				findAsciiIdentity();
+	bool				copyAsciiIdentity(const Byte* inBuffer, UInt32 inLength,
+							  Byte* outBuffer, UInt32 outLength);
+
 	Byte*				table;
 
 	Stage*				finalStage;
@@ -206,6 +217,9 @@ protected:
 	long				status;
 
 	UInt32				warningStatus;
+
+	UInt32				asciiIdentity[4];	// bit per ASCII char that every stage passes through
+	bool				idle;				// no stage holds state from an earlier buffer
 };
 
 #endif /* __Engine_H__ */
@@ -39,6 +39,104 @@ authorization from the copyright holders.
 #include "tectonic_xetex_layout.h"
 #include "xetex-XeTeXOTMath.h"
 
+/* MATH table lookups are kept in font units, by the digest of the font file
+ * (ttxl_get_font_digest) and glyph, so every size of a font, every pass and,
+ * under --watch, every compile share them; only the conversion to points is
+ * done per call. Fonts without a digest go to HarfBuzz each time. Nothing is
+ * evicted: assemblies handed out stay valid, and the tables grow only with
+ * the glyphs math typesetting asks about. */
+
+#define N_MATH_CONSTANTS (HB_OT_MATH_CONSTANT_RADICAL_DEGREE_BOTTOM_RAISE_PERCENT + 1)
+
+typedef struct {
+    uint64_t digest;
+    hb_position_t values[N_MATH_CONSTANTS];
+} math_constants;
+
+enum { MATH_VARIANTS, MATH_ASSEMBLY, MATH_ITAL_CORR };
+
+typedef struct {
+    uint64_t digest; /* 0 for an empty slot */
+    uint32_t key;    /* glyph << 3 | horiz << 2 | kind */
+    unsigned int count;
+    union {
+        hb_ot_math_glyph_variant_t *variants;
+        GlyphAssembly *assembly;
+        hb_position_t ital_corr;
+    };
+} math_glyph_entry;
+
+static TTBC_THREAD_LOCAL math_constants *constants = NULL;
+static TTBC_THREAD_LOCAL size_t n_constants = 0, constants_alloc = 0;
+
+static TTBC_THREAD_LOCAL math_glyph_entry *glyph_entries = NULL;
+static TTBC_THREAD_LOCAL size_t n_glyph_entries = 0, glyph_entries_alloc = 0;
+
+static uint64_t
+font_digest(int f)
+{
+    return ttxl_get_font_digest((XeTeXLayoutEngine) font_layout_engine[f]);
+}
+
+static const hb_position_t *
+font_math_constants(int f, uint64_t digest)
+{
+    for (size_t i = 0; i < n_constants; i++) {
+        if (constants[i].digest == digest)
+            return constants[i].values;
+    }
+
+    if (n_constants == constants_alloc) {
+        constants_alloc = constants_alloc ? constants_alloc * 2 : 8;
+        constants = (math_constants *) xrealloc(constants, constants_alloc * sizeof(math_constants));
+    }
+
+    hb_font_t *hbFont = ttxl_get_hb_font((XeTeXLayoutEngine) font_layout_engine[f]);
+    math_constants *c = &constants[n_constants++];
+    c->digest = digest;
+    for (int n = 0; n < N_MATH_CONSTANTS; n++)
+        c->values[n] = hb_ot_math_get_constant(hbFont, (hb_ot_math_constant_t) n);
+    return c->values;
+}
+
+static size_t
+glyph_entry_slot(const math_glyph_entry *entries, size_t alloc, uint64_t digest, uint32_t key)
+{
+    uint64_t h = (digest ^ (key * 0x9E3779B97F4A7C15ULL)) * 0x9E3779B97F4A7C15ULL;
+    size_t i = (size_t) (h >> 32) & (alloc - 1);
+
+    while (entries[i].digest != 0 && (entries[i].digest != digest || entries[i].key != key))
+        i = (i + 1) & (alloc - 1);
+    return i;
+}
+
+/* the entry for (digest, key), with digest 0 when it is new */
+static math_glyph_entry *
+glyph_entry(uint64_t digest, int g, int horiz, int kind)
+{
+    uint32_t key = ((uint32_t) g << 3) | (horiz ? 4 : 0) | kind;
+
+    if ((n_glyph_entries + 1) * 2 > glyph_entries_alloc) {
+        size_t alloc = glyph_entries_alloc ? glyph_entries_alloc * 2 : 1024;
+        math_glyph_entry *entries = (math_glyph_entry *) xcalloc(alloc, sizeof(math_glyph_entry));
+
+        for (size_t i = 0; i < glyph_entries_alloc; i++) {
+            if (glyph_entries[i].digest != 0)
+                entries[glyph_entry_slot(entries, alloc, glyph_entries[i].digest, glyph_entries[i].key)] = glyph_entries[i];
+        }
+        free(glyph_entries);
+        glyph_entries = entries;
+        glyph_entries_alloc = alloc;
+    }
+
+    math_glyph_entry *e = &glyph_entries[glyph_entry_slot(glyph_entries, glyph_entries_alloc, digest, key)];
+    if (e->digest == 0) {
+        e->key = key;
+        n_glyph_entries++;
+    }
+    return e;
+}
+
 int
 get_ot_math_constant(int f, int n)
 {
@@ -47,8 +145,14 @@ get_ot_math_constant(int f, int n)
 
     if (font_area[f] == OTGR_FONT_FLAG) {
         XeTeXFont font = getFont((XeTeXLayoutEngine) font_layout_engine[f]);
-        hb_font_t *hbFont = ttxl_get_hb_font((XeTeXLayoutEngine) font_layout_engine[f]);
-        rval = hb_ot_math_get_constant(hbFont, constant);
+        uint64_t digest = font_digest(f);
+
+        if (digest != 0 && n >= 0 && n < N_MATH_CONSTANTS) {
+            rval = font_math_constants(f, digest)[n];
+        } else {
+            hb_font_t *hbFont = ttxl_get_hb_font((XeTeXLayoutEngine) font_layout_engine[f]);
+            rval = hb_ot_math_get_constant(hbFont, constant);
+        }
 
         /* scale according to font size, except the ones that are percentages */
         switch (constant) {
@@ -189,13 +293,34 @@ get_ot_math_variant(int f, int g, int v, int32_t* adv, int horiz)
     if (font_area[f] == OTGR_FONT_FLAG) {
         XeTeXFont font = getFont((XeTeXLayoutEngine) font_layout_engine[f]);
         hb_font_t *hbFont = ttxl_get_hb_font((XeTeXLayoutEngine) font_layout_engine[f]);
+        hb_direction_t dir = horiz ? HB_DIRECTION_RTL : HB_DIRECTION_TTB;
+        uint64_t digest = font_digest(f);
         hb_ot_math_glyph_variant_t variant[1];
-        unsigned int count = 1;
-        hb_ot_math_get_glyph_variants(hbFont, g, horiz ? HB_DIRECTION_RTL : HB_DIRECTION_TTB, v, &count, variant);
+        const hb_ot_math_glyph_variant_t *found = NULL;
+
+        if (digest != 0) {
+            math_glyph_entry *e = glyph_entry(digest, g, horiz, MATH_VARIANTS);
+            if (e->digest == 0) {
+                e->digest = digest;
+                e->count = hb_ot_math_get_glyph_variants(hbFont, g, dir, 0, NULL, NULL);
+                e->variants = NULL;
+                if (e->count > 0) {
+                    e->variants = (hb_ot_math_glyph_variant_t *) xmalloc(e->count * sizeof(hb_ot_math_glyph_variant_t));
+                    hb_ot_math_get_glyph_variants(hbFont, g, dir, 0, &e->count, e->variants);
+                }
+            }
+            if (v >= 0 && (unsigned int) v < e->count)
+                found = &e->variants[v];
+        } else {
+            unsigned int count = 1;
+            hb_ot_math_get_glyph_variants(hbFont, g, dir, v, &count, variant);
+            if (count > 0)
+                found = variant;
+        }
 
-        if (count > 0) {
-            rval = variant->glyph;
-            *adv = D2Fix(ttxl_font_units_to_points(font, variant->advance));
+        if (found) {
+            rval = found->glyph;
+            *adv = D2Fix(ttxl_font_units_to_points(font, found->advance));
         }
     }
 
@@ -203,6 +328,24 @@ get_ot_math_variant(int f, int g, int v, int32_t* adv, int horiz)
 }
 
 
+static GlyphAssembly *
+read_ot_assembly(hb_font_t *hbFont, int g, int horiz)
+{
+    hb_direction_t dir = horiz ? HB_DIRECTION_RTL : HB_DIRECTION_TTB;
+    unsigned int count = hb_ot_math_get_glyph_assembly(hbFont, g, dir, 0, NULL, NULL, NULL);
+
+    if (count == 0)
+        return NULL;
+
+    GlyphAssembly *a = (GlyphAssembly *) xmalloc(sizeof(GlyphAssembly));
+    a->count = count;
+    a->parts = (hb_ot_math_glyph_part_t *) xmalloc(count * sizeof(hb_ot_math_glyph_part_t));
+    a->cached = false;
+    hb_ot_math_get_glyph_assembly(hbFont, g, dir, 0, &a->count, a->parts, NULL);
+    return a;
+}
+
+
 void *
 get_ot_assembly_ptr(int f, int g, int horiz)
 {
@@ -210,19 +353,19 @@ get_ot_assembly_ptr(int f, int g, int horiz)
 
     if (font_area[f] == OTGR_FONT_FLAG) {
         hb_font_t *hbFont = ttxl_get_hb_font((XeTeXLayoutEngine) font_layout_engine[f]);
-
-        unsigned int count = hb_ot_math_get_glyph_assembly(hbFont, g,
-                                                           horiz ? HB_DIRECTION_RTL : HB_DIRECTION_TTB,
-                                                           0, NULL, NULL, NULL);
-
-        if (count > 0) {
-            GlyphAssembly *a = (GlyphAssembly *) xmalloc(sizeof(GlyphAssembly));
-            a->count = count;
-            a->parts = (hb_ot_math_glyph_part_t *) xmalloc(count * sizeof(hb_ot_math_glyph_part_t));
-            hb_ot_math_get_glyph_assembly(hbFont, g,
-                                          horiz ? HB_DIRECTION_RTL : HB_DIRECTION_TTB,
-                                          0, &a->count, a->parts, NULL);
-            rval = (void *) a;
+        uint64_t digest = font_digest(f);
+
+        if (digest != 0) {
+            math_glyph_entry *e = glyph_entry(digest, g, horiz, MATH_ASSEMBLY);
+            if (e->digest == 0) {
+                e->digest = digest;
+                e->assembly = read_ot_assembly(hbFont, g, horiz);
+                if (e->assembly)
+                    e->assembly->cached = true;
+            }
+            rval = (void *) e->assembly;
+        } else {
+            rval = (void *) read_ot_assembly(hbFont, g, horiz);
         }
     }
 
@@ -230,10 +373,11 @@ get_ot_assembly_ptr(int f, int g, int horiz)
 }
 
 
+/* cached assemblies belong to the cache and outlive the caller */
 void
 free_ot_assembly(GlyphAssembly* a)
 {
-    if (!a)
+    if (!a || a->cached)
         return;
     free(a->parts);
     free(a);
@@ -248,7 +392,18 @@ get_ot_math_ital_corr(int f, int g)
     if (font_area[f] == OTGR_FONT_FLAG) {
         XeTeXFont font = getFont((XeTeXLayoutEngine) font_layout_engine[f]);
         hb_font_t *hbFont = ttxl_get_hb_font((XeTeXLayoutEngine) font_layout_engine[f]);
-        rval = hb_ot_math_get_glyph_italics_correction(hbFont, g);
+        uint64_t digest = font_digest(f);
+
+        if (digest != 0) {
+            math_glyph_entry *e = glyph_entry(digest, g, 0, MATH_ITAL_CORR);
+            if (e->digest == 0) {
+                e->digest = digest;
+                e->ital_corr = hb_ot_math_get_glyph_italics_correction(hbFont, g);
+            }
+            rval = e->ital_corr;
+        } else {
+            rval = hb_ot_math_get_glyph_italics_correction(hbFont, g);
+        }
         rval = D2Fix(ttxl_font_units_to_points(font, rval));
     }
 
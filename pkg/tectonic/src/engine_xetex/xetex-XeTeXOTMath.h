@@ -41,6 +41,7 @@ authorization from the copyright holders.
 typedef struct {
     unsigned int count;
     hb_ot_math_glyph_part_t *parts;
+    bool cached; /* owned by the MATH lookup cache, see free_ot_assembly */
 } GlyphAssembly;
 
 BEGIN_EXTERN_C
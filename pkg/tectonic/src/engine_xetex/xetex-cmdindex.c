@@ -0,0 +1,184 @@
+/* xetex-cmdindex.c -- the commands a document can use, for editor completion.
+ *
+ * With command_index_enabled, the end of the run walks the control sequence
+ * hash (everything id_lookup ever entered, the format's and the preamble's
+ * alike) and writes <jobname>.cmds, one entry per line, sorted by name:
+ *
+ *     m <name>   a macro
+ *     p <name>   a primitive, register, or other defined command
+ *     e <name>   an environment: \<name> and \end<name> are both macros
+ *
+ * Only names made of ASCII letters are listed (plus '*' for environments),
+ * which leaves out the @ and _ internals and the expl3 names with ':' that
+ * a document never types.
+ */
+
+#include "xetex-core.h"
+#include "xetex-xetexd.h"
+#include "xetex-stringpool.h"
+
+typedef struct {
+    char *name;
+    char kind;
+} cmd_entry_t;
+
+static TTBC_THREAD_LOCAL cmd_entry_t *entries;
+static TTBC_THREAD_LOCAL int32_t n_entries, entries_alloc;
+
+
+static bool
+is_letter(uint16_t c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+
+/* The name of control sequence p if it is worth listing, else NULL: a letter
+ * followed by letters and '*'. */
+static char *
+listed_name(int32_t p)
+{
+    str_number s = hash[p].s1;
+    pool_pointer start;
+    int32_t i, len;
+    char *name;
+
+    if (s < 65536L || s >= str_ptr)
+        return NULL;
+
+    start = str_start[s - 65536L];
+    len = length(s);
+    if (len == 0 || !is_letter(str_pool[start]))
+        return NULL;
+    for (i = 1; i < len; i++) {
+        if (!is_letter(str_pool[start + i]) && str_pool[start + i] != '*')
+            return NULL;
+    }
+
+    name = xmalloc(len + 1);
+    for (i = 0; i < len; i++)
+        name[i] = (char) str_pool[start + i];
+    name[len] = '\0';
+    return name;
+}
+
+
+static void
+add_entry(char *name, char kind)
+{
+    if (n_entries == entries_alloc) {
+        entries_alloc = entries_alloc ? entries_alloc * 2 : 4096;
+        entries = xrealloc(entries, entries_alloc * sizeof *entries);
+    }
+    entries[n_entries].name = name;
+    entries[n_entries].kind = kind;
+    n_entries++;
+}
+
+
+static void
+add_cs(int32_t p)
+{
+    uint16_t cmd = eqtb[p].b16.s1;
+    char *name;
+
+    if (cmd == UNDEFINED_CS)
+        return;
+    name = listed_name(p);
+    if (name == NULL)
+        return;
+    add_entry(name, (cmd >= CALL && cmd <= LONG_OUTER_CALL) ? 'm' : 'p');
+}
+
+
+static int
+by_name(const void *a, const void *b)
+{
+    const cmd_entry_t *x = a, *y = b;
+    int c = strcmp(x->name, y->name);
+    return c != 0 ? c : (x->kind > y->kind) - (x->kind < y->kind);
+}
+
+
+/* whether name is among the first n entries as a macro; they are sorted */
+static bool
+is_macro(const char *name, int32_t n)
+{
+    int32_t lo = 0, hi = n - 1;
+
+    while (lo <= hi) {
+        int32_t mid = lo + (hi - lo) / 2;
+        int c = strcmp(entries[mid].name, name);
+
+        if (c == 0)
+            return entries[mid].kind == 'm';
+        if (c < 0)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+    return false;
+}
+
+
+static void
+command_index_reset(void)
+{
+    int32_t i;
+
+    for (i = 0; i < n_entries; i++)
+        free(entries[i].name);
+    entries = mfree(entries);
+    n_entries = entries_alloc = 0;
+}
+
+
+/* Write <jobname>.cmds. Called at the end of the run, once the hash holds
+ * everything the document defined. */
+void
+command_index_finish(void)
+{
+    rust_output_handle_t out;
+    char *job, *fname, *end_name;
+    int32_t p, i, n_commands;
+
+    if (job_name == 0)
+        return;
+
+    for (p = HASH_BASE; p < FROZEN_CONTROL_SEQUENCE; p++)
+        add_cs(p);
+    for (p = EQTB_SIZE + 1; p <= eqtb_top; p++)
+        add_cs(p);
+    qsort(entries, n_entries, sizeof *entries, by_name);
+
+    n_commands = n_entries;
+    for (i = 0; i < n_commands; i++) {
+        if (entries[i].kind != 'm')
+            continue;
+        end_name = xmalloc(strlen(entries[i].name) + 4);
+        strcpy(end_name, "end");
+        strcat(end_name, entries[i].name);
+        if (is_macro(end_name, n_commands))
+            add_entry(xstrdup(entries[i].name), 'e');
+        free(end_name);
+    }
+    qsort(entries, n_entries, sizeof *entries, by_name);
+
+    job = gettexstring(job_name);
+    fname = xmalloc(strlen(job) + 6);
+    strcpy(fname, job);
+    strcat(fname, ".cmds");
+    out = ttbc_output_open(fname, 0);
+    if (out != INVALID_HANDLE) {
+        for (i = 0; i < n_entries; i++) {
+            /* '*' only ever names an environment */
+            if (entries[i].kind == 'e' || strchr(entries[i].name, '*') == NULL)
+                ttstub_fprintf(out, "%c %s\n", entries[i].kind, entries[i].name);
+        }
+        ttbc_output_close(out);
+    }
+
+    free(fname);
+    free(job);
+    command_index_reset();
+}
@@ -27,12 +27,39 @@ tt_xetex_set_int_variable (const char *var_name, int value)
         halt_on_error_p = value;
     else if (streq_ptr(var_name, "in_initex_mode"))
         in_initex_mode = (value != 0);
+    else if (streq_ptr(var_name, "initex_preload_format"))
+        initex_preload_format = (value != 0);
     else if (streq_ptr(var_name, "synctex_enabled"))
         synctex_enabled = (value != 0);
     else if (streq_ptr(var_name, "semantic_pagination_enabled"))
         semantic_pagination_enabled = (value != 0);
+    else if (streq_ptr(var_name, "draft_pass_enabled"))
+        draft_pass_enabled = (value != 0);
     else if (streq_ptr(var_name, "shell_escape_enabled"))
         shell_escape_enabled = (value != 0);
+    else if (streq_ptr(var_name, "profile_expansion_enabled"))
+        profile_expansion_enabled = (value != 0);
+    else if (streq_ptr(var_name, "command_index_enabled"))
+        command_index_enabled = (value != 0);
+    else if (streq_ptr(var_name, "linebreak_memo_enabled")) {
+        /* turning it off also forgets the paragraphs seen so far */
+        linebreak_memo_enabled = (value != 0);
+        if (!linebreak_memo_enabled)
+            linebreak_memo_reset();
+    }
+    else if (streq_ptr(var_name, "sample_interval")) {
+        /* macro calls between TTBC_CHECKPOINT_SAMPLE reports; 0 for none */
+        if (value < 0)
+            return 1;
+        sample_interval = value;
+    }
+    else if (streq_ptr(var_name, "hash_prime")) {
+        /* control sequence buckets for the next initex run; a loaded format
+         * brings its own */
+        if (value < 1 || value > HASH_SIZE)
+            return 1;
+        hash_prime = value;
+    }
     else
         return 1; /* Uh oh: unrecognized variable */
 
@@ -56,6 +83,7 @@ tt_engine_xetex_main(
     int rv;
 
     if (setjmp(*ttbc_global_engine_enter())) {
+        flush_log_buffer();
         ttbc_global_engine_exit();
         return HISTORY_FATAL_ERROR;
     }
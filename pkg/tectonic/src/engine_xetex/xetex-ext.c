@@ -65,8 +65,63 @@ authorization from the copyright holders.
 #define kGPOS HB_TAG('G','P','O','S')
 
 
-static UBreakIterator* brkIter = NULL;
-static int brkLocaleStrNum = 0;
+/* Eztex customization: ICU line break iterators by locale. Mixed-language
+ * text switches locale from one run of words to the next, and ubrk_open
+ * loads the locale's break rules every time. The iterators of the last few
+ * locales stay open, and ubrk_setText points the one needed at the text.
+ * They are keyed by the locale itself: its string number means another
+ * string on the next pass. */
+#define BRK_CACHE_SIZE 8
+
+static TTBC_THREAD_LOCAL struct {
+    char           *locale;
+    UBreakIterator *iter;
+} brkCache[BRK_CACHE_SIZE];
+static TTBC_THREAD_LOCAL int brkCacheNext = 0;
+/* the iterator of the current text; NULL while Graphite breaks it */
+static TTBC_THREAD_LOCAL UBreakIterator* brkIter = NULL;
+
+static UBreakIterator*
+linebreak_iterator(const char* locale)
+{
+    UErrorCode status = U_ZERO_ERROR;
+    UBreakIterator* iter;
+    int i;
+
+    for (i = 0; i < BRK_CACHE_SIZE; i++) {
+        if (brkCache[i].locale != NULL && streq_ptr(brkCache[i].locale, locale))
+            return brkCache[i].iter;
+    }
+
+    iter = ubrk_open(UBRK_LINE, locale, NULL, 0, &status);
+    if (U_FAILURE(status)) {
+        begin_diagnostic();
+        print_nl('E');
+        print_c_string("rror ");
+        print_int(status);
+        print_c_string(" creating linebreak iterator for locale `");
+        print_c_string(locale);
+        print_c_string("'; trying default locale `en_us'.");
+        end_diagnostic(1);
+        if (iter != NULL)
+            ubrk_close(iter);
+        status = U_ZERO_ERROR;
+        iter = ubrk_open(UBRK_LINE, "en_us", NULL, 0, &status);
+    }
+
+    if (iter == NULL)
+        _tt_abort ("failed to create linebreak iterator, status=%d", (int) status);
+
+    i = brkCacheNext;
+    if (brkCache[i].iter != NULL) {
+        ubrk_close(brkCache[i].iter);
+        free(brkCache[i].locale);
+    }
+    brkCache[i].locale = xstrdup(locale);
+    brkCache[i].iter = iter;
+    brkCacheNext = (i + 1) % BRK_CACHE_SIZE;
+    return iter;
+}
 
 void
 linebreak_start(int f, int32_t localeStrNum, uint16_t* text, int32_t textLength)
@@ -76,38 +131,16 @@ linebreak_start(int f, int32_t localeStrNum, uint16_t* text, int32_t textLength)
 
     if (font_area[f] == OTGR_FONT_FLAG && streq_ptr(locale, "G")) {
         XeTeXLayoutEngine engine = (XeTeXLayoutEngine) font_layout_engine[f];
-        if (initGraphiteBreaking(engine, text, textLength))
+        if (initGraphiteBreaking(engine, text, textLength)) {
             /* user asked for Graphite line breaking and the font supports it */
+            brkIter = NULL;
+            free(locale);
             return;
-    }
-
-    if ((localeStrNum != brkLocaleStrNum) && (brkIter != NULL)) {
-        ubrk_close(brkIter);
-        brkIter = NULL;
-    }
-
-    if (brkIter == NULL) {
-        brkIter = ubrk_open(UBRK_LINE, locale, NULL, 0, &status);
-        if (U_FAILURE(status)) {
-            begin_diagnostic();
-            print_nl('E');
-            print_c_string("rror ");
-            print_int(status);
-            print_c_string(" creating linebreak iterator for locale `");
-            print_c_string(locale);
-            print_c_string("'; trying default locale `en_us'.");
-            end_diagnostic(1);
-            if (brkIter != NULL)
-                ubrk_close(brkIter);
-            status = U_ZERO_ERROR;
-            brkIter = ubrk_open(UBRK_LINE, "en_us", NULL, 0, &status);
         }
-        free(locale);
-        brkLocaleStrNum = localeStrNum;
     }
 
-    if (brkIter == NULL)
-        _tt_abort ("failed to create linebreak iterator, status=%d", (int) status);
+    brkIter = linebreak_iterator(locale);
+    free(locale);
 
     ubrk_setText(brkIter, (UChar*) text, textLength, &status);
 }
@@ -183,17 +216,42 @@ print_chars(const unsigned short* str, int len)
         print_char(*(str++));
 }
 
+/* Every font loaded with the same mapping shares one converter: a document
+ * that sets Mapping=tex-text on a dozen fonts compiles tex-text.tec once.
+ * Converters are reset after each use, so sharing them is safe; they are
+ * all disposed of together by release_font_mappings. */
+typedef struct {
+    char *name;
+    char byteMapping;
+    TECkit_Converter cnv;
+} loaded_mapping;
+
+static TTBC_THREAD_LOCAL loaded_mapping *loaded_mappings = NULL;
+static TTBC_THREAD_LOCAL int n_loaded_mappings = 0;
+static TTBC_THREAD_LOCAL int max_loaded_mappings = 0;
+
 static void*
 load_mapping_file(const char* s, const char* e, char byteMapping)
 {
     TECkit_Converter cnv = 0;
     char* buffer = xmalloc(e - s + 5);
     rust_input_handle_t map;
+    int i;
 
     strncpy(buffer, s, e - s);
     buffer[e - s] = 0;
     strcat(buffer, ".tec");
 
+    for (i = 0; i < n_loaded_mappings; i++) {
+        if (loaded_mappings[i].byteMapping == byteMapping &&
+            strcmp(loaded_mappings[i].name, buffer) == 0) {
+            if (get_tracing_fonts_state() > 1)
+                font_mapping_warning(buffer, strlen(buffer), 0); /* tracing */
+            free(buffer);
+            return loaded_mappings[i].cnv;
+        }
+    }
+
     map = ttbc_input_open (buffer, TTBC_FILE_FORMAT_MISC_FONTS, 0);
     if (map) {
         size_t mappingSize = ttbc_input_get_size (map);
@@ -226,12 +284,36 @@ load_mapping_file(const char* s, const char* e, char byteMapping)
         font_mapping_warning(buffer, strlen(buffer), 1); /* not found */
     }
 
-    free(buffer);
+    if (cnv != NULL) {
+        if (n_loaded_mappings == max_loaded_mappings) {
+            max_loaded_mappings += 8;
+            loaded_mappings = xrealloc(loaded_mappings, max_loaded_mappings * sizeof(loaded_mapping));
+        }
+        loaded_mappings[n_loaded_mappings].name = buffer;
+        loaded_mappings[n_loaded_mappings].byteMapping = byteMapping;
+        loaded_mappings[n_loaded_mappings].cnv = cnv;
+        n_loaded_mappings++;
+    } else {
+        free(buffer);
+    }
 
     return cnv;
 }
 
-static char *saved_mapping_name = NULL;
+void
+release_font_mappings(void)
+{
+    int i;
+
+    for (i = 0; i < n_loaded_mappings; i++) {
+        TECkit_DisposeConverter(loaded_mappings[i].cnv);
+        free(loaded_mappings[i].name);
+    }
+    loaded_mappings = mfree(loaded_mappings);
+    n_loaded_mappings = max_loaded_mappings = 0;
+}
+
+static TTBC_THREAD_LOCAL char *saved_mapping_name = NULL;
 void
 check_for_tfm_font_mapping(void)
 {
@@ -376,6 +458,35 @@ read_rgb_a(const char** cp)
     return rgbValue;
 }
 
+/* Eztex customization: the results of find_native_font, by font spec and
+ * size. Every pass loads the same fonts again; the layout engine of an
+ * OpenType font found before is handed out again, with the loaded_font_*
+ * values and full name it came with, and its "->" trace line. The cache
+ * owns its engines (see release_font_engine) and keeps them for the
+ * process, so later passes and later compiles on this thread skip the
+ * name lookup, the spec parsing and the engine setup. Specs that warned or
+ * load a mapping are not kept: the warnings must come again, and mappings
+ * go with release_font_mappings at the end of the run. */
+#define FONT_SPEC_CACHE_MAX 1024
+
+typedef struct {
+    char           *spec;
+    int32_t         scaled_size;
+    void           *engine;
+    char           *full_name;
+    char           *trace;
+    char            flags;
+    scaled_t        letter_space;
+    Fixed           design_size;
+} font_spec_entry;
+
+static TTBC_THREAD_LOCAL font_spec_entry *font_specs = NULL;
+static TTBC_THREAD_LOCAL int n_font_specs = 0;
+static TTBC_THREAD_LOCAL int max_font_specs = 0;
+/* set while loading a spec that must not be kept, and its trace line */
+static TTBC_THREAD_LOCAL bool spec_uncacheable;
+static TTBC_THREAD_LOCAL char *spec_trace = NULL;
+
 int
 readCommonFeatures(const char* feat, const char* end, float* extend, float* slant, float* embolden, float* letterspace, uint32_t* rgbValue)
     // returns 1 to go to next_option, -1 for bad_option, 0 to continue
@@ -385,6 +496,7 @@ readCommonFeatures(const char* feat, const char* end, float* extend, float* slan
     if (sep) {
         if (*sep != '=')
             return -1;
+        spec_uncacheable = true;
         loaded_font_mapping = load_mapping_file(sep + 1, end, 0);
         return 1;
     }
@@ -630,6 +742,7 @@ loadOTfont(RawPlatformFontRef fontRef, XeTeXFont font, Fixed scaled_size, char*
             }
 
         bad_option:
+            spec_uncacheable = true;
             font_feature_warning((void*) cp1, cp2 - cp1, 0, 0);
 
         next_option:
@@ -722,9 +835,8 @@ splitFontName(char* name, char** var, char** feat, char** end, int* index)
         *var = *feat;
 }
 
-void*
-find_native_font(char* uname, int32_t scaled_size)
-    /* scaled_size here is in TeX points, or is a negative integer for 'scaled_t' */
+static void*
+load_native_font_spec(char* uname, int32_t scaled_size)
 {
     void* rval = NULL;
     char* nameString;
@@ -790,6 +902,7 @@ find_native_font(char* uname, int32_t scaled_size)
             rval = loadOTfont(0, font, scaled_size, featString);
             if (rval == NULL)
                 deleteFont(font);
+            spec_trace = xstrdup(nameString + 1);
             if (rval != NULL && get_tracing_fonts_state() > 0) {
                 begin_diagnostic();
                 print_nl(' ');
@@ -805,11 +918,12 @@ find_native_font(char* uname, int32_t scaled_size)
          * move it here to preserve encapsulation.
          */
 
+        spec_trace = xstrdup(ttxl_platfont_get_desc(fontRef));
         if (get_tracing_fonts_state() > 0) {
             begin_diagnostic();
             print_nl(' ');
             print_c_string("-> ");
-            print_c_string(ttxl_platfont_get_desc(fontRef));
+            print_c_string(spec_trace);
             end_diagnostic(0);
         }
 
@@ -886,9 +1000,85 @@ find_native_font(char* uname, int32_t scaled_size)
     return rval;
 }
 
+void*
+find_native_font(char* uname, int32_t scaled_size)
+    /* scaled_size here is in TeX points, or is a negative integer for 'scaled_t' */
+{
+    void* rval;
+    font_spec_entry *e;
+    char* spec;
+    int i;
+
+    for (i = 0; i < n_font_specs; i++) {
+        e = &font_specs[i];
+        if (e->scaled_size != scaled_size || strcmp(e->spec, uname) != 0)
+            continue;
+
+        if (get_tracing_fonts_state() > 0) {
+            begin_diagnostic();
+            print_nl(' ');
+            print_c_string("-> ");
+            print_c_string(e->trace);
+            end_diagnostic(0);
+        }
+        loaded_font_mapping = NULL;
+        loaded_font_flags = e->flags;
+        loaded_font_letter_space = e->letter_space;
+        set_loaded_font_design_size(e->design_size);
+        native_font_type_flag = OTGR_FONT_FLAG;
+        free(name_of_file);
+        name_of_file = xstrdup(e->full_name);
+        name_length = strlen(name_of_file);
+        return e->engine;
+    }
+
+    spec_uncacheable = false;
+    spec_trace = mfree(spec_trace);
+    /* uname is name_of_file, which loading may replace */
+    spec = xstrdup(uname);
+    rval = load_native_font_spec(uname, scaled_size);
+
+    if (rval == NULL || spec_uncacheable || spec_trace == NULL || n_font_specs == FONT_SPEC_CACHE_MAX ||
+            native_font_type_flag != OTGR_FONT_FLAG || loaded_font_mapping != NULL) {
+        free(spec);
+    } else {
+        if (n_font_specs == max_font_specs) {
+            max_font_specs = max_font_specs ? max_font_specs * 2 : 64;
+            font_specs = xrealloc(font_specs, max_font_specs * sizeof(font_spec_entry));
+        }
+        e = &font_specs[n_font_specs++];
+        e->spec = spec;
+        e->scaled_size = scaled_size;
+        e->engine = rval;
+        e->full_name = xstrdup(name_of_file);
+        e->trace = spec_trace;
+        spec_trace = NULL;
+        e->flags = loaded_font_flags;
+        e->letter_space = loaded_font_letter_space;
+        e->design_size = get_loaded_font_design_size();
+    }
+    spec_trace = mfree(spec_trace);
+
+    return rval;
+}
+
+static bool
+font_spec_owns(void* engine)
+{
+    int i;
+
+    for (i = 0; i < n_font_specs; i++) {
+        if (font_specs[i].engine == engine)
+            return true;
+    }
+    return false;
+}
+
 void
 release_font_engine(void* engine, int type_flag)
 {
+    if (font_spec_owns(engine))
+        return;
 #ifdef XETEX_MAC
     if (type_flag == AAT_FONT_FLAG) {
         CFRelease((CFDictionaryRef)engine);
@@ -1100,7 +1290,7 @@ cgColorToRGBA32(CGColorRef color)
 }
 #endif
 
-static int xdvBufSize = 0;
+static TTBC_THREAD_LOCAL int xdvBufSize = 0;
 
 int
 makeXDVGlyphArrayData(void* pNode)
@@ -1317,7 +1507,7 @@ apply_mapping(void* pCnv, uint16_t* txtPtr, int txtLen)
     TECkit_Converter cnv = (TECkit_Converter)pCnv;
     UInt32 inUsed, outUsed;
     TECkit_Status status;
-    static UInt32 outLength = 0;
+    static TTBC_THREAD_LOCAL UInt32 outLength = 0;
 
     /* allocate outBuffer if not big enough */
     if (outLength < txtLen * sizeof(UniChar) + 32) {
@@ -1582,13 +1772,21 @@ measure_native_node(void* pNode, int use_glyph_metrics)
         Fixed* glyphAdvances = NULL;
         int totalGlyphCount = 0;
 
-        /* need to find direction runs within the text, and call layoutChars separately for each */
+        /* need to find direction runs within the text, and shape each separately */
 
         UBiDiDirection dir;
         void* glyph_info = 0;
-        static FloatPoint* positions = 0;
-        static float* advances = 0;
-        static uint32_t* glyphs = 0;
+        static TTBC_THREAD_LOCAL LayoutRun* runs = 0;
+        static TTBC_THREAD_LOCAL int runs_alloc = 0;
+        /* the advances are only needed while measuring, so they are kept
+           for the next word rather than freed */
+        static TTBC_THREAD_LOCAL Fixed* advances_pool = 0;
+        static TTBC_THREAD_LOCAL int advances_alloc = 0;
+        const FloatPoint* positions;
+        const float* advances;
+        const uint32_t* glyphs;
+        int nRuns, runIndex;
+        double width = 0;
 
         UBiDi* pBiDi = ubidi_open();
 
@@ -1596,99 +1794,59 @@ measure_native_node(void* pNode, int use_glyph_metrics)
         ubidi_setPara(pBiDi, (const UChar*) txtPtr, txtLen, getDefaultDirection(engine), NULL, &errorCode);
 
         dir = ubidi_getDirection(pBiDi);
+        nRuns = (dir == UBIDI_MIXED) ? ubidi_countRuns(pBiDi, &errorCode) : 1;
+        if (nRuns > runs_alloc) {
+            runs_alloc = nRuns;
+            runs = xrealloc(runs, runs_alloc * sizeof(LayoutRun));
+        }
         if (dir == UBIDI_MIXED) {
-            /* we actually do the layout twice here, once to count glyphs and then again to get them;
-               which is inefficient, but i figure that MIXED is a relatively rare occurrence, so i can't be
-               bothered to deal with the memory reallocation headache of doing it differently
-            */
-            int nRuns = ubidi_countRuns(pBiDi, &errorCode);
-            double width = 0;
-            int i, runIndex;
-            int32_t logicalStart, length;
             for (runIndex = 0; runIndex < nRuns; ++runIndex) {
+                int32_t logicalStart, length;
                 dir = ubidi_getVisualRun(pBiDi, runIndex, &logicalStart, &length);
-                totalGlyphCount += layoutChars(engine, txtPtr, logicalStart, length, txtLen, (dir == UBIDI_RTL));
+                runs[runIndex].offset = logicalStart;
+                runs[runIndex].count = length;
+                runs[runIndex].rtl = (dir == UBIDI_RTL);
             }
+        } else {
+            runs[0].offset = 0;
+            runs[0].count = txtLen;
+            runs[0].rtl = (dir == UBIDI_RTL);
+        }
 
-            if (totalGlyphCount > 0) {
-                double x, y;
-                glyph_info = xcalloc(totalGlyphCount, native_glyph_info_size);
-                locations = (FixedPoint*)glyph_info;
-                glyphIDs = (uint16_t*)(locations + totalGlyphCount);
-                glyphAdvances = xcalloc(totalGlyphCount, sizeof(Fixed));
-                totalGlyphCount = 0;
-
-                x = y = 0.0;
-                for (runIndex = 0; runIndex < nRuns; ++runIndex) {
-                    int nGlyphs;
-                    dir = ubidi_getVisualRun(pBiDi, runIndex, &logicalStart, &length);
-                    nGlyphs = layoutChars(engine, txtPtr, logicalStart, length, txtLen,
-                                            (dir == UBIDI_RTL));
-
-                    glyphs = xcalloc(nGlyphs, sizeof(uint32_t));
-                    positions = xcalloc(nGlyphs + 1, sizeof(FloatPoint));
-                    advances = xcalloc(nGlyphs, sizeof(float));
-
-                    getGlyphs(engine, glyphs);
-                    getGlyphAdvances(engine, advances);
-                    getGlyphPositions(engine, positions);
-
-                    for (i = 0; i < nGlyphs; ++i) {
-                        glyphIDs[totalGlyphCount] = glyphs[i];
-                        locations[totalGlyphCount].x = D2Fix(positions[i].x + x);
-                        locations[totalGlyphCount].y = D2Fix(positions[i].y + y);
-                        glyphAdvances[totalGlyphCount] = D2Fix(advances[i]);
-                        ++totalGlyphCount;
-                    }
-                    x += positions[nGlyphs].x;
-                    y += positions[nGlyphs].y;
-
-                    free(glyphs);
-                    free(positions);
-                    free(advances);
-                }
-                width = x;
+        /* one call shapes all runs; each run's positions end with one more
+           entry, where the next run starts */
+        totalGlyphCount = layoutRuns(engine, txtPtr, txtLen, runs, nRuns, &glyphs, &advances, &positions);
+
+        if (totalGlyphCount > 0) {
+            double x = 0.0, y = 0.0;
+            int i, g = 0, p = 0;
+            glyph_info = xcalloc(totalGlyphCount, native_glyph_info_size);
+            locations = (FixedPoint*)glyph_info;
+            glyphIDs = (uint16_t*)(locations + totalGlyphCount);
+            if (totalGlyphCount > advances_alloc) {
+                advances_alloc = totalGlyphCount;
+                advances_pool = xrealloc(advances_pool, advances_alloc * sizeof(Fixed));
             }
+            glyphAdvances = advances_pool;
 
-            node_width(node) = D2Fix(width);
-            native_glyph_count(node) = totalGlyphCount;
-            native_glyph_info_ptr(node) = glyph_info;
-        } else {
-            double width = 0;
-            totalGlyphCount = layoutChars(engine, txtPtr, 0, txtLen, txtLen, (dir == UBIDI_RTL));
-
-            glyphs = xcalloc(totalGlyphCount, sizeof(uint32_t));
-            positions = xcalloc(totalGlyphCount + 1, sizeof(FloatPoint));
-            advances = xcalloc(totalGlyphCount, sizeof(float));
-
-            getGlyphs(engine, glyphs);
-            getGlyphAdvances(engine, advances);
-            getGlyphPositions(engine, positions);
-
-            if (totalGlyphCount > 0) {
-                int i;
-                glyph_info = xcalloc(totalGlyphCount, native_glyph_info_size);
-                locations = (FixedPoint*)glyph_info;
-                glyphIDs = (uint16_t*)(locations + totalGlyphCount);
-                glyphAdvances = xcalloc(totalGlyphCount, sizeof(Fixed));
-                for (i = 0; i < totalGlyphCount; ++i) {
-                    glyphIDs[i] = glyphs[i];
-                    glyphAdvances[i] = D2Fix(advances[i]);
-                    locations[i].x = D2Fix(positions[i].x);
-                    locations[i].y = D2Fix(positions[i].y);
+            for (runIndex = 0; runIndex < nRuns; ++runIndex) {
+                for (i = 0; i < runs[runIndex].n_glyphs; ++i, ++g, ++p) {
+                    glyphIDs[g] = glyphs[g];
+                    locations[g].x = D2Fix(positions[p].x + x);
+                    locations[g].y = D2Fix(positions[p].y + y);
+                    glyphAdvances[g] = D2Fix(advances[g]);
                 }
-                width = positions[totalGlyphCount].x;
+                x += positions[p].x;
+                y += positions[p].y;
+                ++p;
             }
-
-            node_width(node) = D2Fix(width);
-            native_glyph_count(node) = totalGlyphCount;
-            native_glyph_info_ptr(node) = glyph_info;
-
-            free(glyphs);
-            free(positions);
-            free(advances);
+            width = x;
         }
 
+        node_width(node) = D2Fix(width);
+        native_glyph_count(node) = totalGlyphCount;
+        native_glyph_info_ptr(node) = glyph_info;
+
         ubidi_close(pBiDi);
 
 
@@ -1707,7 +1865,6 @@ measure_native_node(void* pNode, int use_glyph_metrics)
                 node_width(node) += lsDelta;
             }
         }
-        free(glyphAdvances);
     } else {
         _tt_abort("bad native font flag in `measure_native_node`");
     }
@@ -165,6 +165,7 @@ Fixed D2Fix(double d);
 void check_for_tfm_font_mapping(void);
 void* load_tfm_font_mapping(void);
 int apply_tfm_font_mapping(void* mapping, int c);
+void release_font_mappings(void);
 
 int aat_font_get(int what, CFDictionaryRef attrs);
 int aat_font_get_1(int what, CFDictionaryRef attrs, int param);
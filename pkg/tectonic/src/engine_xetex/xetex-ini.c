@@ -17,359 +17,369 @@
 #include "xetex_bindings.h" /* FORMAT_SERIAL */
 
 /* All the following variables are declared in xetex-xetexd.h */
-bool shell_escape_enabled = false;
-memory_word *eqtb;
-int32_t bad;
-char *name_of_file;
-UTF16_code *name_of_file16;
-int32_t name_length;
-int32_t name_length16;
-UnicodeScalar *buffer;
-int32_t first;
-int32_t last;
-int32_t max_buf_stack;
-bool in_initex_mode;
-int32_t error_line;
-int32_t half_error_line;
-int32_t max_print_line;
-int32_t max_strings;
-int32_t strings_free;
-int32_t string_vacancies;
-int32_t pool_size;
-int32_t pool_free;
-int32_t font_mem_size;
-int32_t font_max;
-int32_t hyph_size;
-int32_t trie_size;
-int32_t buf_size;
-int32_t stack_size;
-int32_t max_in_open;
-int32_t param_size;
-int32_t nest_size;
-int32_t save_size;
-int32_t expand_depth;
-int file_line_error_style_p;
-int halt_on_error_p;
-bool quoted_filename;
-bool insert_src_special_auto;
-bool insert_src_special_every_par;
-bool insert_src_special_every_math;
-bool insert_src_special_every_vbox;
-packed_UTF16_code *str_pool;
-pool_pointer *str_start;
-pool_pointer pool_ptr;
-str_number str_ptr;
-pool_pointer init_pool_ptr;
-str_number init_str_ptr;
-rust_output_handle_t rust_stdout;
-rust_output_handle_t log_file;
-selector_t selector;
-unsigned char dig[23];
-int32_t tally;
-int32_t term_offset;
-int32_t file_offset;
-UTF16_code trick_buf[256];
-int32_t trick_count;
-int32_t first_count;
-bool doing_special;
-UTF16_code *native_text;
-int32_t native_text_size;
-int32_t native_len;
-int32_t save_native_len;
-unsigned char interaction;
-bool deletions_allowed;
-bool set_box_allowed;
-tt_history_t history;
-signed char error_count;
-const char* help_line[6];
-unsigned char help_ptr;
-bool use_err_help;
-bool arith_error;
-scaled_t tex_remainder;
-int32_t randoms[55];
-unsigned char j_random;
-scaled_t random_seed;
-int32_t two_to_the[31];
-int32_t spec_log[29];
-int32_t temp_ptr;
-memory_word *mem;
-int32_t lo_mem_max;
-int32_t hi_mem_min;
-int32_t var_used, dyn_used;
-int32_t avail;
-int32_t mem_end;
-int32_t rover;
-int32_t last_leftmost_char;
-int32_t last_rightmost_char;
-int32_t hlist_stack[MAX_HLIST_STACK + 1];
-short hlist_stack_level;
-int32_t first_p;
-int32_t global_prev_p;
-int32_t font_in_short_display;
-int32_t depth_threshold;
-int32_t breadth_max;
-list_state_record *nest;
-int32_t nest_ptr;
-int32_t max_nest_stack;
-list_state_record cur_list;
-short shown_mode;
-unsigned char old_setting;
-b32x2 *hash;
-int32_t hash_used;
-int32_t hash_extra;
-int32_t hash_top;
-int32_t eqtb_top;
-int32_t hash_high;
-bool no_new_control_sequence;
-int32_t cs_count;
-b32x2 prim[PRIM_SIZE + 1];
-int32_t prim_used;
-memory_word *save_stack;
-int32_t save_ptr;
-int32_t max_save_stack;
-uint16_t cur_level;
-group_code cur_group;
-int32_t cur_boundary;
-int32_t mag_set;
-eight_bits cur_cmd;
-int32_t cur_chr;
-int32_t cur_cs;
-int32_t cur_tok;
-input_state_t *input_stack;
-int32_t input_ptr;
-int32_t max_in_stack;
-input_state_t cur_input;
-int32_t in_open;
-int32_t open_parens;
-UFILE **input_file;
-int32_t line;
-int32_t *line_stack;
-str_number *source_filename_stack;
-str_number *full_source_filename_stack;
-unsigned char scanner_status;
-int32_t warning_index;
-int32_t def_ref;
-int32_t *param_stack;
-int32_t param_ptr;
-int32_t max_param_stack;
-int32_t align_state;
-int32_t base_ptr;
-int32_t par_loc;
-int32_t par_token;
-bool force_eof;
-int32_t expand_depth_count;
-bool is_in_csname;
-int32_t cur_mark[5];
-unsigned char long_state;
-int32_t pstack[9];
-int32_t cur_val;
-int32_t cur_val1;
-unsigned char cur_val_level;
-small_number radix;
-glue_ord cur_order;
-UFILE *read_file[16];
-unsigned char read_open[17];
-int32_t cond_ptr;
-unsigned char if_limit;
-small_number cur_if;
-int32_t if_line;
-int32_t skip_line;
-str_number cur_name;
-str_number cur_area;
-str_number cur_ext;
-pool_pointer area_delimiter;
-pool_pointer ext_delimiter;
-UTF16_code file_name_quote_char;
-int32_t format_default_length;
-char *TEX_format_default;
-bool name_in_progress;
-str_number job_name;
-bool log_opened;
-const char* output_file_extension;
-str_number texmf_log_name;
-memory_word *font_info;
-font_index fmem_ptr;
-internal_font_number font_ptr;
-b16x4 *font_check;
-scaled_t *font_size;
-scaled_t *font_dsize;
-font_index *font_params;
-str_number *font_name;
-str_number *font_area;
-UTF16_code *font_bc;
-UTF16_code *font_ec;
-int32_t *font_glue;
-bool *font_used;
-int32_t *hyphen_char;
-int32_t *skew_char;
-font_index *bchar_label;
-nine_bits *font_bchar;
-nine_bits *font_false_bchar;
-void **font_layout_engine;
-void **font_mapping;
-char *font_flags;
-scaled_t *font_letter_space;
-void *loaded_font_mapping;
-char loaded_font_flags;
-scaled_t loaded_font_letter_space;
-UTF16_code *mapped_text;
-char *xdv_buffer;
-int32_t *char_base;
-int32_t *width_base;
-int32_t *height_base;
-int32_t *depth_base;
-int32_t *italic_base;
-int32_t *lig_kern_base;
-int32_t *kern_base;
-int32_t *exten_base;
-int32_t *param_base;
-b16x4 null_character;
-int32_t total_pages;
-scaled_t max_v;
-scaled_t max_h;
-int32_t max_push;
-int32_t last_bop;
-int32_t dead_cycles;
-bool doing_leaders;
-scaled_t rule_ht, rule_dp, rule_wd;
-scaled_t cur_h, cur_v;
-int32_t epochseconds;
-int32_t microseconds;
-scaled_t total_stretch[4], total_shrink[4];
-int32_t last_badness;
-int32_t adjust_tail;
-int32_t pre_adjust_tail;
-int32_t pack_begin_line;
-b32x2 empty;
-internal_font_number cur_f;
-int32_t cur_c;
-b16x4 cur_i;
-int32_t cur_align;
-int32_t cur_span;
-int32_t cur_loop;
-int32_t align_ptr;
-int32_t cur_head, cur_tail;
-int32_t cur_pre_head, cur_pre_tail;
-int32_t just_box;
-scaled_t active_width[7];
-int32_t hc[4099];
-internal_font_number hf;
-int32_t hu[4097];
-unsigned char cur_lang;
-int32_t max_hyph_char;
-unsigned char hyf[4097];
-int32_t init_list;
-bool init_lig;
-bool init_lft;
-small_number hyphen_passed;
-int32_t cur_l, cur_r;
-int32_t cur_q;
-int32_t lig_stack;
-bool ligature_present;
-bool lft_hit, rt_hit;
-trie_pointer *trie_trl;
-trie_pointer *trie_tro;
-uint16_t *trie_trc;
-small_number hyf_distance[TRIE_OP_SIZE + 1];
-small_number hyf_num[TRIE_OP_SIZE + 1];
-trie_opcode hyf_next[TRIE_OP_SIZE + 1];
-int32_t op_start[256];
-str_number *hyph_word;
-int32_t *hyph_list;
-hyph_pointer *hyph_link;
-int32_t hyph_count;
-int32_t hyph_next;
-trie_opcode trie_used[256];
-unsigned char trie_op_lang[TRIE_OP_SIZE + 1];
-trie_opcode trie_op_val[TRIE_OP_SIZE + 1];
-int32_t trie_op_ptr;
-trie_opcode max_op_used;
-packed_UTF16_code *trie_c;
-trie_opcode *trie_o;
-trie_pointer *trie_l;
-trie_pointer *trie_r;
-trie_pointer trie_ptr;
-trie_pointer *trie_hash;
-bool *trie_taken;
-trie_pointer trie_min[65536];
-trie_pointer trie_max;
-bool trie_not_ready;
-scaled_t best_height_plus_depth;
-internal_font_number main_f;
-b16x4 main_i;
-b16x4 main_j;
-font_index main_k;
-int32_t main_p;
-int32_t main_pp, main_ppp;
-int32_t main_h;
-bool is_hyph;
-int32_t space_class;
-int32_t prev_class;
-int32_t main_s;
-int32_t bchar;
-int32_t false_bchar;
-bool cancel_boundary;
-bool ins_disc;
-int32_t cur_box;
-int32_t after_token;
-bool long_help_seen;
-str_number format_ident;
-rust_output_handle_t write_file[16];
-bool write_open[18];
-int32_t write_loc;
-scaled_t cur_page_width;
-scaled_t cur_page_height;
-scaled_t cur_h_offset;
-scaled_t cur_v_offset;
-int32_t pdf_last_x_pos;
-int32_t pdf_last_y_pos;
-bool *eof_seen;
-int32_t LR_ptr;
-int32_t LR_problems;
-small_number cur_dir;
-int32_t pseudo_files;
-save_pointer *grp_stack;
-int32_t *if_stack;
-int32_t max_reg_num;
-const char* max_reg_help_line;
-int32_t sa_root[8];
-int32_t cur_ptr;
-memory_word sa_null;
-int32_t sa_chain;
-uint16_t sa_level;
-trie_pointer hyph_start;
-trie_pointer hyph_index;
-int32_t disc_ptr[4];
-pool_pointer edit_name_start;
-bool stop_at_space;
-int32_t native_font_type_flag;
-bool xtx_ligature_present;
-scaled_t delta;
-int synctex_enabled;
-bool used_tectonic_coda_tokens;
-bool semantic_pagination_enabled;
-bool gave_char_warning_help;
+TTBC_THREAD_LOCAL bool shell_escape_enabled = false;
+TTBC_THREAD_LOCAL memory_word *eqtb;
+TTBC_THREAD_LOCAL int32_t bad;
+TTBC_THREAD_LOCAL char *name_of_file;
+TTBC_THREAD_LOCAL UTF16_code *name_of_file16;
+TTBC_THREAD_LOCAL int32_t name_length;
+TTBC_THREAD_LOCAL int32_t name_length16;
+TTBC_THREAD_LOCAL UnicodeScalar *buffer;
+TTBC_THREAD_LOCAL int32_t first;
+TTBC_THREAD_LOCAL int32_t last;
+TTBC_THREAD_LOCAL int32_t max_buf_stack;
+TTBC_THREAD_LOCAL bool in_initex_mode;
+TTBC_THREAD_LOCAL bool initex_preload_format;
+TTBC_THREAD_LOCAL int32_t error_line;
+TTBC_THREAD_LOCAL int32_t half_error_line;
+TTBC_THREAD_LOCAL int32_t max_print_line;
+TTBC_THREAD_LOCAL int32_t max_strings;
+TTBC_THREAD_LOCAL int32_t strings_free;
+TTBC_THREAD_LOCAL int32_t string_vacancies;
+TTBC_THREAD_LOCAL int32_t pool_size;
+TTBC_THREAD_LOCAL int32_t pool_free;
+TTBC_THREAD_LOCAL int32_t font_mem_size;
+TTBC_THREAD_LOCAL int32_t font_max;
+TTBC_THREAD_LOCAL int32_t hyph_size;
+TTBC_THREAD_LOCAL int32_t trie_size;
+TTBC_THREAD_LOCAL int32_t buf_size;
+TTBC_THREAD_LOCAL int32_t stack_size;
+TTBC_THREAD_LOCAL int32_t max_in_open;
+TTBC_THREAD_LOCAL int32_t param_size;
+TTBC_THREAD_LOCAL int32_t nest_size;
+TTBC_THREAD_LOCAL int32_t save_size;
+TTBC_THREAD_LOCAL int32_t expand_depth;
+TTBC_THREAD_LOCAL int file_line_error_style_p;
+TTBC_THREAD_LOCAL int halt_on_error_p;
+TTBC_THREAD_LOCAL bool quoted_filename;
+TTBC_THREAD_LOCAL bool insert_src_special_auto;
+TTBC_THREAD_LOCAL bool insert_src_special_every_par;
+TTBC_THREAD_LOCAL bool insert_src_special_every_math;
+TTBC_THREAD_LOCAL bool insert_src_special_every_vbox;
+TTBC_THREAD_LOCAL packed_UTF16_code *str_pool;
+TTBC_THREAD_LOCAL pool_pointer *str_start;
+TTBC_THREAD_LOCAL pool_pointer pool_ptr;
+TTBC_THREAD_LOCAL str_number str_ptr;
+TTBC_THREAD_LOCAL pool_pointer init_pool_ptr;
+TTBC_THREAD_LOCAL str_number init_str_ptr;
+TTBC_THREAD_LOCAL rust_output_handle_t rust_stdout;
+TTBC_THREAD_LOCAL rust_output_handle_t log_file;
+TTBC_THREAD_LOCAL selector_t selector;
+TTBC_THREAD_LOCAL unsigned char dig[23];
+TTBC_THREAD_LOCAL int32_t tally;
+TTBC_THREAD_LOCAL int32_t term_offset;
+TTBC_THREAD_LOCAL int32_t file_offset;
+TTBC_THREAD_LOCAL UTF16_code trick_buf[256];
+TTBC_THREAD_LOCAL int32_t trick_count;
+TTBC_THREAD_LOCAL int32_t first_count;
+TTBC_THREAD_LOCAL bool doing_special;
+TTBC_THREAD_LOCAL UTF16_code *native_text;
+TTBC_THREAD_LOCAL int32_t native_text_size;
+TTBC_THREAD_LOCAL int32_t native_len;
+TTBC_THREAD_LOCAL int32_t save_native_len;
+TTBC_THREAD_LOCAL unsigned char interaction;
+TTBC_THREAD_LOCAL bool deletions_allowed;
+TTBC_THREAD_LOCAL bool set_box_allowed;
+TTBC_THREAD_LOCAL tt_history_t history;
+TTBC_THREAD_LOCAL signed char error_count;
+TTBC_THREAD_LOCAL const char* help_line[6];
+TTBC_THREAD_LOCAL unsigned char help_ptr;
+TTBC_THREAD_LOCAL bool use_err_help;
+TTBC_THREAD_LOCAL bool arith_error;
+TTBC_THREAD_LOCAL scaled_t tex_remainder;
+TTBC_THREAD_LOCAL int32_t randoms[55];
+TTBC_THREAD_LOCAL unsigned char j_random;
+TTBC_THREAD_LOCAL scaled_t random_seed;
+TTBC_THREAD_LOCAL int32_t two_to_the[31];
+TTBC_THREAD_LOCAL int32_t spec_log[29];
+TTBC_THREAD_LOCAL int32_t temp_ptr;
+TTBC_THREAD_LOCAL memory_word *mem;
+TTBC_THREAD_LOCAL int32_t lo_mem_max;
+TTBC_THREAD_LOCAL int32_t hi_mem_min;
+TTBC_THREAD_LOCAL int32_t var_used, dyn_used;
+TTBC_THREAD_LOCAL int32_t avail;
+TTBC_THREAD_LOCAL int32_t mem_end;
+TTBC_THREAD_LOCAL int32_t mem_max;
+TTBC_THREAD_LOCAL int32_t rover;
+TTBC_THREAD_LOCAL int32_t last_leftmost_char;
+TTBC_THREAD_LOCAL int32_t last_rightmost_char;
+TTBC_THREAD_LOCAL int32_t hlist_stack[MAX_HLIST_STACK + 1];
+TTBC_THREAD_LOCAL short hlist_stack_level;
+TTBC_THREAD_LOCAL int32_t first_p;
+TTBC_THREAD_LOCAL int32_t global_prev_p;
+TTBC_THREAD_LOCAL int32_t font_in_short_display;
+TTBC_THREAD_LOCAL int32_t depth_threshold;
+TTBC_THREAD_LOCAL int32_t breadth_max;
+TTBC_THREAD_LOCAL list_state_record *nest;
+TTBC_THREAD_LOCAL int32_t nest_ptr;
+TTBC_THREAD_LOCAL int32_t max_nest_stack;
+TTBC_THREAD_LOCAL list_state_record cur_list;
+TTBC_THREAD_LOCAL short shown_mode;
+TTBC_THREAD_LOCAL unsigned char old_setting;
+TTBC_THREAD_LOCAL b32x2 *hash;
+TTBC_THREAD_LOCAL int32_t hash_used;
+TTBC_THREAD_LOCAL int32_t hash_extra;
+TTBC_THREAD_LOCAL int32_t hash_top;
+TTBC_THREAD_LOCAL int32_t eqtb_top;
+TTBC_THREAD_LOCAL int32_t hash_high;
+TTBC_THREAD_LOCAL int32_t hash_prime = HASH_PRIME;
+TTBC_THREAD_LOCAL int64_t cs_lookups;
+TTBC_THREAD_LOCAL int64_t cs_probes;
+TTBC_THREAD_LOCAL bool no_new_control_sequence;
+TTBC_THREAD_LOCAL int32_t cs_count;
+TTBC_THREAD_LOCAL b32x2 prim[PRIM_SIZE + 1];
+TTBC_THREAD_LOCAL int32_t prim_used;
+TTBC_THREAD_LOCAL memory_word *save_stack;
+TTBC_THREAD_LOCAL int32_t save_ptr;
+TTBC_THREAD_LOCAL int32_t max_save_stack;
+TTBC_THREAD_LOCAL uint16_t cur_level;
+TTBC_THREAD_LOCAL group_code cur_group;
+TTBC_THREAD_LOCAL int32_t cur_boundary;
+TTBC_THREAD_LOCAL int32_t mag_set;
+TTBC_THREAD_LOCAL eight_bits cur_cmd;
+TTBC_THREAD_LOCAL int32_t cur_chr;
+TTBC_THREAD_LOCAL int32_t cur_cs;
+TTBC_THREAD_LOCAL int32_t cur_tok;
+TTBC_THREAD_LOCAL input_state_t *input_stack;
+TTBC_THREAD_LOCAL int32_t input_ptr;
+TTBC_THREAD_LOCAL int32_t max_in_stack;
+TTBC_THREAD_LOCAL input_state_t cur_input;
+TTBC_THREAD_LOCAL int32_t in_open;
+TTBC_THREAD_LOCAL int32_t open_parens;
+TTBC_THREAD_LOCAL UFILE **input_file;
+TTBC_THREAD_LOCAL int32_t line;
+TTBC_THREAD_LOCAL int32_t *line_stack;
+TTBC_THREAD_LOCAL str_number *source_filename_stack;
+TTBC_THREAD_LOCAL str_number *full_source_filename_stack;
+TTBC_THREAD_LOCAL unsigned char scanner_status;
+TTBC_THREAD_LOCAL int32_t warning_index;
+TTBC_THREAD_LOCAL int32_t def_ref;
+TTBC_THREAD_LOCAL int32_t *param_stack;
+TTBC_THREAD_LOCAL int32_t param_ptr;
+TTBC_THREAD_LOCAL int32_t max_param_stack;
+TTBC_THREAD_LOCAL int32_t align_state;
+TTBC_THREAD_LOCAL int32_t base_ptr;
+TTBC_THREAD_LOCAL int32_t par_loc;
+TTBC_THREAD_LOCAL int32_t par_token;
+TTBC_THREAD_LOCAL bool force_eof;
+TTBC_THREAD_LOCAL int32_t expand_depth_count;
+TTBC_THREAD_LOCAL bool is_in_csname;
+TTBC_THREAD_LOCAL int32_t cur_mark[5];
+TTBC_THREAD_LOCAL unsigned char long_state;
+TTBC_THREAD_LOCAL int32_t pstack[9];
+TTBC_THREAD_LOCAL int32_t cur_val;
+TTBC_THREAD_LOCAL int32_t cur_val1;
+TTBC_THREAD_LOCAL unsigned char cur_val_level;
+TTBC_THREAD_LOCAL small_number radix;
+TTBC_THREAD_LOCAL glue_ord cur_order;
+TTBC_THREAD_LOCAL UFILE *read_file[16];
+TTBC_THREAD_LOCAL unsigned char read_open[17];
+TTBC_THREAD_LOCAL int32_t cond_ptr;
+TTBC_THREAD_LOCAL unsigned char if_limit;
+TTBC_THREAD_LOCAL small_number cur_if;
+TTBC_THREAD_LOCAL int32_t if_line;
+TTBC_THREAD_LOCAL int32_t skip_line;
+TTBC_THREAD_LOCAL str_number cur_name;
+TTBC_THREAD_LOCAL str_number cur_area;
+TTBC_THREAD_LOCAL str_number cur_ext;
+TTBC_THREAD_LOCAL pool_pointer area_delimiter;
+TTBC_THREAD_LOCAL pool_pointer ext_delimiter;
+TTBC_THREAD_LOCAL UTF16_code file_name_quote_char;
+TTBC_THREAD_LOCAL int32_t format_default_length;
+TTBC_THREAD_LOCAL char *TEX_format_default;
+TTBC_THREAD_LOCAL bool name_in_progress;
+TTBC_THREAD_LOCAL str_number job_name;
+TTBC_THREAD_LOCAL bool log_opened;
+TTBC_THREAD_LOCAL const char* output_file_extension;
+TTBC_THREAD_LOCAL str_number texmf_log_name;
+TTBC_THREAD_LOCAL memory_word *font_info;
+TTBC_THREAD_LOCAL font_index fmem_ptr;
+TTBC_THREAD_LOCAL internal_font_number font_ptr;
+TTBC_THREAD_LOCAL b16x4 *font_check;
+TTBC_THREAD_LOCAL scaled_t *font_size;
+TTBC_THREAD_LOCAL scaled_t *font_dsize;
+TTBC_THREAD_LOCAL font_index *font_params;
+TTBC_THREAD_LOCAL str_number *font_name;
+TTBC_THREAD_LOCAL str_number *font_area;
+TTBC_THREAD_LOCAL UTF16_code *font_bc;
+TTBC_THREAD_LOCAL UTF16_code *font_ec;
+TTBC_THREAD_LOCAL int32_t *font_glue;
+TTBC_THREAD_LOCAL bool *font_used;
+TTBC_THREAD_LOCAL int32_t *hyphen_char;
+TTBC_THREAD_LOCAL int32_t *skew_char;
+TTBC_THREAD_LOCAL font_index *bchar_label;
+TTBC_THREAD_LOCAL nine_bits *font_bchar;
+TTBC_THREAD_LOCAL nine_bits *font_false_bchar;
+TTBC_THREAD_LOCAL void **font_layout_engine;
+TTBC_THREAD_LOCAL void **font_mapping;
+TTBC_THREAD_LOCAL char *font_flags;
+TTBC_THREAD_LOCAL scaled_t *font_letter_space;
+TTBC_THREAD_LOCAL void *loaded_font_mapping;
+TTBC_THREAD_LOCAL char loaded_font_flags;
+TTBC_THREAD_LOCAL scaled_t loaded_font_letter_space;
+TTBC_THREAD_LOCAL UTF16_code *mapped_text;
+TTBC_THREAD_LOCAL char *xdv_buffer;
+TTBC_THREAD_LOCAL int32_t *char_base;
+TTBC_THREAD_LOCAL int32_t *width_base;
+TTBC_THREAD_LOCAL int32_t *height_base;
+TTBC_THREAD_LOCAL int32_t *depth_base;
+TTBC_THREAD_LOCAL int32_t *italic_base;
+TTBC_THREAD_LOCAL int32_t *lig_kern_base;
+TTBC_THREAD_LOCAL int32_t *kern_base;
+TTBC_THREAD_LOCAL int32_t *exten_base;
+TTBC_THREAD_LOCAL int32_t *param_base;
+TTBC_THREAD_LOCAL b16x4 null_character;
+TTBC_THREAD_LOCAL int32_t total_pages;
+TTBC_THREAD_LOCAL scaled_t max_v;
+TTBC_THREAD_LOCAL scaled_t max_h;
+TTBC_THREAD_LOCAL int32_t max_push;
+TTBC_THREAD_LOCAL int32_t last_bop;
+TTBC_THREAD_LOCAL int32_t dead_cycles;
+TTBC_THREAD_LOCAL bool doing_leaders;
+TTBC_THREAD_LOCAL scaled_t rule_ht, rule_dp, rule_wd;
+TTBC_THREAD_LOCAL scaled_t cur_h, cur_v;
+TTBC_THREAD_LOCAL int32_t epochseconds;
+TTBC_THREAD_LOCAL int32_t microseconds;
+TTBC_THREAD_LOCAL scaled_t total_stretch[4], total_shrink[4];
+TTBC_THREAD_LOCAL int32_t last_badness;
+TTBC_THREAD_LOCAL int32_t adjust_tail;
+TTBC_THREAD_LOCAL int32_t pre_adjust_tail;
+TTBC_THREAD_LOCAL int32_t pack_begin_line;
+TTBC_THREAD_LOCAL b32x2 empty;
+TTBC_THREAD_LOCAL internal_font_number cur_f;
+TTBC_THREAD_LOCAL int32_t cur_c;
+TTBC_THREAD_LOCAL b16x4 cur_i;
+TTBC_THREAD_LOCAL int32_t cur_align;
+TTBC_THREAD_LOCAL int32_t cur_span;
+TTBC_THREAD_LOCAL int32_t cur_loop;
+TTBC_THREAD_LOCAL int32_t align_ptr;
+TTBC_THREAD_LOCAL int32_t cur_head, cur_tail;
+TTBC_THREAD_LOCAL int32_t cur_pre_head, cur_pre_tail;
+TTBC_THREAD_LOCAL int32_t just_box;
+TTBC_THREAD_LOCAL scaled_t active_width[7];
+TTBC_THREAD_LOCAL int32_t hc[4099];
+TTBC_THREAD_LOCAL internal_font_number hf;
+TTBC_THREAD_LOCAL int32_t hu[4097];
+TTBC_THREAD_LOCAL unsigned char cur_lang;
+TTBC_THREAD_LOCAL int32_t max_hyph_char;
+TTBC_THREAD_LOCAL unsigned char hyf[4097];
+TTBC_THREAD_LOCAL int32_t init_list;
+TTBC_THREAD_LOCAL bool init_lig;
+TTBC_THREAD_LOCAL bool init_lft;
+TTBC_THREAD_LOCAL small_number hyphen_passed;
+TTBC_THREAD_LOCAL int32_t cur_l, cur_r;
+TTBC_THREAD_LOCAL int32_t cur_q;
+TTBC_THREAD_LOCAL int32_t lig_stack;
+TTBC_THREAD_LOCAL bool ligature_present;
+TTBC_THREAD_LOCAL bool lft_hit, rt_hit;
+TTBC_THREAD_LOCAL trie_pointer *trie_trl;
+TTBC_THREAD_LOCAL trie_pointer *trie_tro;
+TTBC_THREAD_LOCAL uint16_t *trie_trc;
+TTBC_THREAD_LOCAL small_number hyf_distance[TRIE_OP_SIZE + 1];
+TTBC_THREAD_LOCAL small_number hyf_num[TRIE_OP_SIZE + 1];
+TTBC_THREAD_LOCAL trie_opcode hyf_next[TRIE_OP_SIZE + 1];
+TTBC_THREAD_LOCAL int32_t op_start[256];
+TTBC_THREAD_LOCAL str_number *hyph_word;
+TTBC_THREAD_LOCAL int32_t *hyph_list;
+TTBC_THREAD_LOCAL hyph_pointer *hyph_link;
+TTBC_THREAD_LOCAL int32_t hyph_count;
+TTBC_THREAD_LOCAL int32_t hyph_next;
+TTBC_THREAD_LOCAL trie_opcode trie_used[256];
+TTBC_THREAD_LOCAL unsigned char trie_op_lang[TRIE_OP_SIZE + 1];
+TTBC_THREAD_LOCAL trie_opcode trie_op_val[TRIE_OP_SIZE + 1];
+TTBC_THREAD_LOCAL int32_t trie_op_ptr;
+TTBC_THREAD_LOCAL trie_opcode max_op_used;
+TTBC_THREAD_LOCAL packed_UTF16_code *trie_c;
+TTBC_THREAD_LOCAL trie_opcode *trie_o;
+TTBC_THREAD_LOCAL trie_pointer *trie_l;
+TTBC_THREAD_LOCAL trie_pointer *trie_r;
+TTBC_THREAD_LOCAL trie_pointer trie_ptr;
+TTBC_THREAD_LOCAL trie_pointer *trie_hash;
+TTBC_THREAD_LOCAL bool *trie_taken;
+TTBC_THREAD_LOCAL trie_pointer trie_min[65536];
+TTBC_THREAD_LOCAL trie_pointer trie_max;
+TTBC_THREAD_LOCAL bool trie_not_ready;
+TTBC_THREAD_LOCAL scaled_t best_height_plus_depth;
+TTBC_THREAD_LOCAL internal_font_number main_f;
+TTBC_THREAD_LOCAL b16x4 main_i;
+TTBC_THREAD_LOCAL b16x4 main_j;
+TTBC_THREAD_LOCAL font_index main_k;
+TTBC_THREAD_LOCAL int32_t main_p;
+TTBC_THREAD_LOCAL int32_t main_pp, main_ppp;
+TTBC_THREAD_LOCAL int32_t main_h;
+TTBC_THREAD_LOCAL bool is_hyph;
+TTBC_THREAD_LOCAL int32_t space_class;
+TTBC_THREAD_LOCAL int32_t prev_class;
+TTBC_THREAD_LOCAL int32_t main_s;
+TTBC_THREAD_LOCAL int32_t bchar;
+TTBC_THREAD_LOCAL int32_t false_bchar;
+TTBC_THREAD_LOCAL bool cancel_boundary;
+TTBC_THREAD_LOCAL bool ins_disc;
+TTBC_THREAD_LOCAL int32_t cur_box;
+TTBC_THREAD_LOCAL int32_t after_token;
+TTBC_THREAD_LOCAL bool long_help_seen;
+TTBC_THREAD_LOCAL str_number format_ident;
+TTBC_THREAD_LOCAL rust_output_handle_t write_file[16];
+TTBC_THREAD_LOCAL bool write_open[18];
+TTBC_THREAD_LOCAL int32_t write_loc;
+TTBC_THREAD_LOCAL scaled_t cur_page_width;
+TTBC_THREAD_LOCAL scaled_t cur_page_height;
+TTBC_THREAD_LOCAL scaled_t cur_h_offset;
+TTBC_THREAD_LOCAL scaled_t cur_v_offset;
+TTBC_THREAD_LOCAL int32_t pdf_last_x_pos;
+TTBC_THREAD_LOCAL int32_t pdf_last_y_pos;
+TTBC_THREAD_LOCAL bool *eof_seen;
+TTBC_THREAD_LOCAL int32_t LR_ptr;
+TTBC_THREAD_LOCAL int32_t LR_problems;
+TTBC_THREAD_LOCAL small_number cur_dir;
+TTBC_THREAD_LOCAL int32_t pseudo_files;
+TTBC_THREAD_LOCAL save_pointer *grp_stack;
+TTBC_THREAD_LOCAL int32_t *if_stack;
+TTBC_THREAD_LOCAL int32_t max_reg_num;
+TTBC_THREAD_LOCAL const char* max_reg_help_line;
+TTBC_THREAD_LOCAL int32_t sa_root[8];
+TTBC_THREAD_LOCAL int32_t cur_ptr;
+TTBC_THREAD_LOCAL memory_word sa_null;
+TTBC_THREAD_LOCAL int32_t sa_chain;
+TTBC_THREAD_LOCAL uint16_t sa_level;
+TTBC_THREAD_LOCAL trie_pointer hyph_start;
+TTBC_THREAD_LOCAL trie_pointer hyph_index;
+TTBC_THREAD_LOCAL int32_t disc_ptr[4];
+TTBC_THREAD_LOCAL pool_pointer edit_name_start;
+TTBC_THREAD_LOCAL bool stop_at_space;
+TTBC_THREAD_LOCAL int32_t native_font_type_flag;
+TTBC_THREAD_LOCAL bool xtx_ligature_present;
+TTBC_THREAD_LOCAL scaled_t delta;
+TTBC_THREAD_LOCAL int synctex_enabled;
+TTBC_THREAD_LOCAL bool used_tectonic_coda_tokens;
+TTBC_THREAD_LOCAL bool semantic_pagination_enabled;
+TTBC_THREAD_LOCAL bool draft_pass_enabled;
+TTBC_THREAD_LOCAL bool profile_expansion_enabled;
+TTBC_THREAD_LOCAL int32_t sample_interval;
+TTBC_THREAD_LOCAL bool command_index_enabled;
+TTBC_THREAD_LOCAL bool linebreak_memo_enabled;
+TTBC_THREAD_LOCAL bool gave_char_warning_help;
 
 /* These ought to live in xetex-pagebuilder.c but are shared a lot: */
-int32_t page_tail;
-unsigned char page_contents;
-scaled_t page_so_far[8];
-int32_t last_glue;
-int32_t last_penalty;
-scaled_t last_kern;
-int32_t last_node_type;
-int32_t insert_penalties;
-bool output_active;
-
-uint16_t _xeq_level_array[EQTB_SIZE - INT_BASE + 1];
+TTBC_THREAD_LOCAL int32_t page_tail;
+TTBC_THREAD_LOCAL unsigned char page_contents;
+TTBC_THREAD_LOCAL scaled_t page_so_far[8];
+TTBC_THREAD_LOCAL int32_t last_glue;
+TTBC_THREAD_LOCAL int32_t last_penalty;
+TTBC_THREAD_LOCAL scaled_t last_kern;
+TTBC_THREAD_LOCAL int32_t last_node_type;
+TTBC_THREAD_LOCAL int32_t insert_penalties;
+TTBC_THREAD_LOCAL bool output_active;
+
+TTBC_THREAD_LOCAL uint16_t _xeq_level_array[EQTB_SIZE - INT_BASE + 1];
 
 #define NEG_TRIE_OP_SIZE -35111L
 #define MAX_TRIE_OP 65535L
 
-static int32_t _trie_op_hash_array[TRIE_OP_SIZE - NEG_TRIE_OP_SIZE + 1];
+static TTBC_THREAD_LOCAL int32_t _trie_op_hash_array[TRIE_OP_SIZE - NEG_TRIE_OP_SIZE + 1];
 #define TRIE_OP_HASH(i) _trie_op_hash_array[(i) - NEG_TRIE_OP_SIZE]
 
-static b32x2 *yhash;
+static TTBC_THREAD_LOCAL b32x2 *yhash;
 
 #define FORMAT_HEADER_MAGIC 0x54544E43 /* "TTNC" in ASCII */
 #define FORMAT_FOOTER_MAGIC 0x0000029A
@@ -794,6 +804,7 @@ void trie_fix(trie_pointer p)
 static void
 new_patterns(void)
 {
+    int32_t fresh;
     short /*hyphenatable_length_limit 1 */ k, l;
     bool digit_sensed;
     trie_opcode v;
@@ -1002,7 +1013,8 @@ new_patterns(void)
         help_line[0] = "All patterns must be given before typesetting begins.";
         error();
 
-        mem[GARBAGE].b32.s1 = scan_toks(false, false);
+        fresh = scan_toks(false, false);
+        mem[GARBAGE].b32.s1 = fresh;
         flush_list(def_ref);
     }
 }
@@ -1316,6 +1328,7 @@ not_found1: /*970:*/
 void
 prefixed_command(void)
 {
+    int32_t fresh;
     small_number a;
     internal_font_number f;
     int32_t j;
@@ -1704,7 +1717,8 @@ prefixed_command(void)
             avail = def_ref;
         } else {
             if (p == LOCAL_BASE + LOCAL__output_routine && !e) {
-                mem[q].b32.s1 = get_avail();
+                fresh = get_avail();
+                mem[q].b32.s1 = fresh;
                 q = LLIST_link(q);
                 mem[q].b32.s0 = (RIGHT_BRACE_TOKEN + 125);
                 q = get_avail();
@@ -2147,8 +2161,9 @@ store_fmt_file(void)
         pseudo_close(); /* TODO: can we move this farther up in this function? */
 
     dump_int(MEM_TOP);
+    dump_int(mem_end);
     dump_int(EQTB_SIZE);
-    dump_int(HASH_PRIME);
+    dump_int(hash_prime);
     dump_int(HYPH_PRIME);
 
     /* string pool */
@@ -2451,6 +2466,351 @@ pack_buffered_name(small_number n, int32_t a, int32_t b)
 }
 
 
+/* Format images.
+ *
+ * Undumping a format fills a handful of large arrays and a few dozen
+ * scalars, byte-swapping and range-checking every item. A format image is
+ * that post-undump state written out in native byte order, each array at
+ * its full allocated size and a fixed, aligned offset (the parts the undump
+ * leaves untouched are never written, so they stay file holes). The host
+ * keeps the image next to its format and offers it back on later runs: a
+ * private copy-on-write mapping is used in place, any other buffer is copied
+ * out in bulk. An image that does not match this build or this format is
+ * ignored and the format is undumped as usual. */
+
+#define FORMAT_IMAGE_MAGIC 0x49465a45 /* "EZFI" */
+#define FORMAT_IMAGE_VERSION 1
+#define FORMAT_IMAGE_ALIGN 64
+#define FORMAT_IMAGE_MAX_ARRAYS 40
+
+#define FORMAT_IMAGE_SCALARS(X)                                          \
+    X(hash_high) X(hash_extra) X(eqtb_top) X(hash_top) X(pool_ptr)       \
+    X(pool_size) X(str_ptr) X(max_strings) X(init_str_ptr)               \
+    X(init_pool_ptr) X(lo_mem_max) X(rover) X(hi_mem_min) X(avail)       \
+    X(mem_end) X(var_used) X(dyn_used) X(par_loc) X(par_token)           \
+    X(write_loc) X(hash_used) X(cs_count) X(fmem_ptr) X(font_mem_size)   \
+    X(font_ptr) X(hyph_count) X(hyph_next) X(trie_max) X(hyph_start)     \
+    X(max_hyph_char) X(trie_op_ptr) X(hash_prime)
+
+typedef struct {
+    int32_t magic;
+    int32_t version;
+    int32_t format_serial;
+    int32_t word_size; /* sizeof(memory_word), ruling out foreign ABIs */
+    int32_t font_max;
+    int32_t hyph_size;
+    uint64_t format_size; /* size of the .fmt the image was made from */
+    uint64_t total_size;
+#define X(v) int32_t v;
+    FORMAT_IMAGE_SCALARS(X)
+#undef X
+    int32_t sa_root[INTER_CHAR_VAL + 1];
+    b32x2 prim[PRIM_SIZE + 1];
+    small_number hyf_distance[TRIE_OP_SIZE + 1];
+    small_number hyf_num[TRIE_OP_SIZE + 1];
+    trie_opcode hyf_next[TRIE_OP_SIZE + 1];
+    trie_opcode trie_used[BIGGEST_LANG + 1];
+    int32_t op_start[BIGGEST_LANG + 1];
+} format_image_header_t;
+
+typedef struct {
+    void **slot;       /* the engine global pointing at the array */
+    size_t item_size;
+    size_t count;      /* allocated items */
+    size_t lo[2];      /* item ranges holding undumped state */
+    size_t n[2];
+    bool preallocated; /* allocated before the undump: always copied into */
+    uint64_t offset;
+} format_image_array_t;
+
+/* set when the load_fmt_file arrays point into a host mapping */
+static TTBC_THREAD_LOCAL bool format_image_aliased = false;
+/* set when mem has since been grown out of that mapping into the heap */
+static TTBC_THREAD_LOCAL bool mem_detached = false;
+
+#define FI_ARRAY(array, items, lo0, n0, lo1, n1, pre)             \
+    do {                                                          \
+        format_image_array_t *e_ = &a[k++];                       \
+        e_->slot = (void **) &(array);                            \
+        e_->item_size = sizeof *(array);                          \
+        e_->count = (items);                                      \
+        e_->lo[0] = (lo0); e_->n[0] = (n0);                       \
+        e_->lo[1] = (lo1); e_->n[1] = (n1);                       \
+        e_->preallocated = (pre);                                 \
+    } while (0)
+
+#define FI_FONT_ARRAY(array) FI_ARRAY(array, font_max, FONT_BASE, font_ptr + 1, 0, 0, false)
+
+/* Lay out the arrays for the current scalars. Returns the array count and
+ * stores the image size in *total. */
+static int
+format_image_layout(format_image_array_t *a, uint64_t *total)
+{
+    int i, k = 0;
+    uint64_t off;
+
+    FI_ARRAY(yhash, 1 + hash_top - hash_offset, 0, 1 + hash_top - hash_offset, 0, 0, false);
+    FI_ARRAY(eqtb, eqtb_top + 1, 0, eqtb_top + 1, 0, 0, false);
+    FI_ARRAY(mem, mem_end + 1, 0, lo_mem_max + 1, hi_mem_min, mem_end + 1 - hi_mem_min, false);
+    FI_ARRAY(str_start, max_strings, 0, str_ptr - TOO_BIG_CHAR + 1, 0, 0, false);
+    FI_ARRAY(str_pool, pool_size, 0, pool_ptr, 0, 0, false);
+    FI_ARRAY(font_info, font_mem_size, 0, fmem_ptr, 0, 0, false);
+    FI_FONT_ARRAY(font_check);
+    FI_FONT_ARRAY(font_size);
+    FI_FONT_ARRAY(font_dsize);
+    FI_FONT_ARRAY(font_params);
+    FI_FONT_ARRAY(font_name);
+    FI_FONT_ARRAY(font_area);
+    FI_FONT_ARRAY(font_bc);
+    FI_FONT_ARRAY(font_ec);
+    FI_FONT_ARRAY(font_glue);
+    FI_FONT_ARRAY(hyphen_char);
+    FI_FONT_ARRAY(skew_char);
+    FI_FONT_ARRAY(bchar_label);
+    FI_FONT_ARRAY(font_bchar);
+    FI_FONT_ARRAY(font_false_bchar);
+    FI_FONT_ARRAY(char_base);
+    FI_FONT_ARRAY(width_base);
+    FI_FONT_ARRAY(height_base);
+    FI_FONT_ARRAY(depth_base);
+    FI_FONT_ARRAY(italic_base);
+    FI_FONT_ARRAY(lig_kern_base);
+    FI_FONT_ARRAY(kern_base);
+    FI_FONT_ARRAY(exten_base);
+    FI_FONT_ARRAY(param_base);
+    FI_ARRAY(trie_trl, trie_max + 1, 0, trie_max + 1, 0, 0, false);
+    FI_ARRAY(trie_tro, trie_max + 1, 0, trie_max + 1, 0, 0, false);
+    FI_ARRAY(trie_trc, trie_max + 1, 0, trie_max + 1, 0, 0, false);
+    FI_ARRAY(hyph_word, hyph_size, 0, hyph_size, 0, 0, true);
+    FI_ARRAY(hyph_list, hyph_size, 0, hyph_size, 0, 0, true);
+    FI_ARRAY(hyph_link, hyph_size, 0, hyph_size, 0, 0, true);
+
+    off = sizeof(format_image_header_t);
+    for (i = 0; i < k; i++) {
+        off = (off + FORMAT_IMAGE_ALIGN - 1) & ~(uint64_t) (FORMAT_IMAGE_ALIGN - 1);
+        a[i].offset = off;
+        off += (uint64_t) a[i].count * a[i].item_size;
+    }
+
+    *total = off;
+    return k;
+}
+
+#undef FI_FONT_ARRAY
+#undef FI_ARRAY
+
+/* Offer the host an image of the state just undumped from a format of
+ * format_size bytes. */
+static void
+save_format_image(uint64_t format_size)
+{
+    format_image_array_t a[FORMAT_IMAGE_MAX_ARRAYS];
+    format_image_header_t *h;
+    uint64_t total;
+    int i, r, n_arrays;
+    bool ok = true;
+
+    n_arrays = format_image_layout(a, &total);
+    if (!ttbc_format_image_begin(total))
+        return;
+
+    h = xcalloc(1, sizeof *h);
+    h->magic = FORMAT_IMAGE_MAGIC;
+    h->version = FORMAT_IMAGE_VERSION;
+    h->format_serial = FORMAT_SERIAL;
+    h->word_size = sizeof(memory_word);
+    h->font_max = font_max;
+    h->hyph_size = hyph_size;
+    h->format_size = format_size;
+    h->total_size = total;
+#define X(v) h->v = v;
+    FORMAT_IMAGE_SCALARS(X)
+#undef X
+    memcpy(h->sa_root, sa_root, sizeof h->sa_root);
+    memcpy(h->prim, prim, sizeof h->prim);
+    memcpy(h->hyf_distance, hyf_distance, sizeof h->hyf_distance);
+    memcpy(h->hyf_num, hyf_num, sizeof h->hyf_num);
+    memcpy(h->hyf_next, hyf_next, sizeof h->hyf_next);
+    memcpy(h->trie_used, trie_used, sizeof h->trie_used);
+    memcpy(h->op_start, op_start, sizeof h->op_start);
+
+    ok = ttbc_format_image_write(0, h, sizeof *h) == 0;
+    free(h);
+
+    for (i = 0; ok && i < n_arrays; i++) {
+        const char *base = *a[i].slot;
+
+        for (r = 0; ok && r < 2; r++) {
+            size_t at = a[i].lo[r] * a[i].item_size;
+
+            if (a[i].n[r] > 0)
+                ok = ttbc_format_image_write(a[i].offset + at, base + at, a[i].n[r] * a[i].item_size) == 0;
+        }
+    }
+
+    ttbc_format_image_end(ok);
+}
+
+/* Restore the state of a format of format_size bytes from the host's image,
+ * if it has a matching one. On false nothing was changed. */
+static bool
+restore_format_image(uint64_t format_size)
+{
+    format_image_array_t a[FORMAT_IMAGE_MAX_ARRAYS];
+    const format_image_header_t *h;
+    char *base;
+    size_t len;
+    uint64_t total;
+    int i, r, n_arrays, is_private = 0;
+
+    base = ttbc_format_image_get(&len, &is_private);
+    if (base == NULL || len < sizeof *h)
+        return false;
+
+    h = (const format_image_header_t *) base;
+    if (h->magic != FORMAT_IMAGE_MAGIC || h->version != FORMAT_IMAGE_VERSION ||
+        h->format_serial != FORMAT_SERIAL || h->word_size != sizeof(memory_word) ||
+        h->font_max != font_max || h->hyph_size != hyph_size ||
+        h->format_size != format_size || h->total_size != len)
+        return false;
+
+    {
+        /* the layout depends on the scalars; keep the ones the undump
+         * would start from in case the image turns out not to fit */
+#define X(v) int32_t saved_##v = v;
+        FORMAT_IMAGE_SCALARS(X)
+#undef X
+#define X(v) v = h->v;
+        FORMAT_IMAGE_SCALARS(X)
+#undef X
+        n_arrays = format_image_layout(a, &total);
+        if (total != len) {
+#define X(v) v = saved_##v;
+            FORMAT_IMAGE_SCALARS(X)
+#undef X
+            return false;
+        }
+    }
+
+    memcpy(sa_root, h->sa_root, sizeof h->sa_root);
+    memcpy(prim, h->prim, sizeof h->prim);
+    memcpy(hyf_distance, h->hyf_distance, sizeof h->hyf_distance);
+    memcpy(hyf_num, h->hyf_num, sizeof h->hyf_num);
+    memcpy(hyf_next, h->hyf_next, sizeof h->hyf_next);
+    memcpy(trie_used, h->trie_used, sizeof h->trie_used);
+    memcpy(op_start, h->op_start, sizeof h->op_start);
+
+    free(trie_trl);
+    free(trie_tro);
+    free(trie_trc);
+
+    for (i = 0; i < n_arrays; i++) {
+        char *src = base + a[i].offset;
+
+        if (is_private && !a[i].preallocated) {
+            *a[i].slot = src;
+            continue;
+        }
+
+        if (!a[i].preallocated)
+            *a[i].slot = xmalloc(a[i].count * a[i].item_size);
+
+        for (r = 0; r < 2; r++) {
+            size_t at = a[i].lo[r] * a[i].item_size;
+
+            if (a[i].n[r] > 0)
+                memcpy((char *) *a[i].slot + at, src + at, a[i].n[r] * a[i].item_size);
+        }
+    }
+
+    format_image_aliased = is_private;
+
+    /* what load_fmt_file sets up besides the undumped state */
+    mem_max = mem_end;
+    hash = yhash - hash_offset;
+    max_reg_num = 32767;
+    max_reg_help_line = "A register number must be between 0 and 32767.";
+    cur_list.head = CONTRIB_HEAD;
+    cur_list.tail = CONTRIB_HEAD;
+    page_tail = PAGE_HEAD;
+    font_mapping = xcalloc_array(void *, font_max);
+    font_layout_engine = xcalloc_array(void *, font_max);
+    font_flags = xmalloc_array(char, font_max);
+    font_letter_space = xmalloc_array(scaled_t, font_max);
+    trie_not_ready = false;
+    return true;
+}
+
+/* Free the arrays load_fmt_file set up, or drop them if they live in a
+ * format image mapping owned by the host. */
+static void
+release_format_arrays(void)
+{
+    format_image_array_t a[FORMAT_IMAGE_MAX_ARRAYS];
+    uint64_t total;
+    int i, n_arrays;
+
+    n_arrays = format_image_layout(a, &total);
+    for (i = 0; i < n_arrays; i++) {
+        if (a[i].preallocated)
+            continue;
+        if (!format_image_aliased || (a[i].slot == (void **) &mem && mem_detached))
+            free(*a[i].slot);
+        *a[i].slot = NULL;
+    }
+
+    format_image_aliased = false;
+    mem_detached = false;
+}
+
+
+/* Make room for more one-word nodes by extending mem past mem_max. Nodes are
+ * addressed by index, so moving the array is safe as long as no pointer into
+ * mem is held across a call that can reach get_avail. That includes the
+ * destination of an assignment: `mem[q].b32.s1 = get_avail()` may compute
+ * &mem[q] before the call, so such results go through a temporary (`fresh`)
+ * first. Each step adds as much as has been added so far, at least
+ * GROW_MEM_MIN words. Returns false when mem cannot grow, and get_avail
+ * falls back to the gap below hi_mem_min. */
+
+#define GROW_MEM_MIN 0x100000
+
+bool
+grow_main_memory(void)
+{
+    int32_t extra, new_max;
+    memory_word *grown;
+
+    if (mem_max >= MAX_HALFWORD)
+        return false;
+
+    extra = mem_max - MEM_TOP;
+    if (extra < GROW_MEM_MIN)
+        extra = GROW_MEM_MIN;
+    new_max = (extra > MAX_HALFWORD - mem_max) ? MAX_HALFWORD : mem_max + extra;
+
+    if (format_image_aliased && !mem_detached) {
+        /* mem lives in the host's format image mapping: copy it out */
+        grown = malloc(((size_t) new_max + 1) * sizeof(memory_word));
+        if (grown != NULL)
+            memcpy(grown, mem, ((size_t) mem_end + 1) * sizeof(memory_word));
+        ttbc_mem_track(grown, ((size_t) new_max + 1) * sizeof(memory_word));
+    } else {
+        grown = realloc(mem, ((size_t) new_max + 1) * sizeof(memory_word));
+        if (grown != NULL)
+            ttbc_mem_retrack(mem, grown, ((size_t) new_max + 1) * sizeof(memory_word));
+    }
+
+    if (grown == NULL)
+        return false;
+
+    mem = grown;
+    mem_max = new_max;
+    mem_detached = format_image_aliased;
+    return true;
+}
+
+
 static bool
 load_fmt_file(void)
 {
@@ -2458,8 +2818,10 @@ load_fmt_file(void)
     int32_t p, q;
     int32_t x;
     rust_input_handle_t fmt_in;
+    uint64_t fmt_size;
 
     j = cur_input.loc;
+    string_index_reset();
 
     /* This is where a first line starting with "&" used to
      * trigger code that would change the format file. */
@@ -2482,6 +2844,14 @@ load_fmt_file(void)
         mem = NULL;
     }
 
+    fmt_size = ttbc_input_get_size(fmt_in);
+    if (!in_initex_mode && restore_format_image(fmt_size)) {
+        ttstub_input_close(fmt_in);
+        return true;
+    }
+    format_image_aliased = false;
+    mem_detached = false;
+
     /* start reading the header */
 
     undump_int(x);
@@ -2532,18 +2902,27 @@ load_fmt_file(void)
     if (x != MEM_TOP)
         goto bad_fmt;
 
+    /* one-word memory may have grown past MEM_TOP (see grow_main_memory) */
+    undump_int(x);
+    if (x < MEM_TOP || x > MAX_HALFWORD)
+        goto bad_fmt;
+    mem_end = x;
+    mem_max = x;
+
     cur_list.head = CONTRIB_HEAD;
     cur_list.tail = CONTRIB_HEAD;
     page_tail = PAGE_HEAD;
-    mem = xmalloc_array(memory_word, MEM_TOP + 1);
+    mem = xmalloc_array(memory_word, mem_max + 1);
 
     undump_int(x);
     if (x != EQTB_SIZE)
         goto bad_fmt;
 
+    /* the bucket count is chosen at initex time (see id_lookup) */
     undump_int(x);
-    if (x != HASH_PRIME)
+    if (x < 1 || x > HASH_SIZE)
         goto bad_fmt;
+    hash_prime = x;
 
     undump_int(x);
     if (x != HYPH_PRIME)
@@ -2624,13 +3003,11 @@ load_fmt_file(void)
         hi_mem_min = x;
 
     undump_int(x);
-    if (x < MIN_HALFWORD || x > MEM_TOP)
+    if (x < MIN_HALFWORD || x > mem_end)
         goto bad_fmt;
     else
         avail = x;
 
-    mem_end = MEM_TOP;
-
     undump_things(mem[hi_mem_min], mem_end + 1 - hi_mem_min);
     undump_int(var_used);
     undump_int(dyn_used);
@@ -2924,6 +3301,9 @@ load_fmt_file(void)
         goto bad_fmt;
 
     ttstub_input_close (fmt_in);
+    /* an initex run that preloaded the format goes on to change it */
+    if (!in_initex_mode)
+        save_format_image(fmt_size);
     return true;
 
 bad_fmt:
@@ -3029,7 +3409,7 @@ final_cleanup(void)
 
 /* Engine initialization */
 
-static UFILE stdin_ufile;
+static TTBC_THREAD_LOCAL UFILE stdin_ufile;
 
 static void
 init_io(void)
@@ -3455,6 +3835,7 @@ get_strings_started(void)
     str_ptr = 0;
     str_start[0] = 0;
     str_ptr = TOO_BIG_CHAR;
+    string_index_reset();
 
     if (load_pool_strings(pool_size - string_vacancies) == 0)
         _tt_abort ("must increase pool_size");
@@ -3483,12 +3864,12 @@ tt_cleanup(void) {
             font_layout_engine[font_k] = NULL;
         }
 
-        if (font_mapping[font_k] != NULL) {
-            TECkit_DisposeConverter((TECkit_Converter) font_mapping[font_k]);
-            font_mapping[font_k] = NULL;
-        }
+        /* shared between fonts; disposed of below */
+        font_mapping[font_k] = NULL;
     }
 
+    release_font_mappings();
+
     for (int i = 1; i <= in_open; i++) {
         if (input_file[i] != NULL) {
             u_close(input_file[i]);
@@ -3516,44 +3897,13 @@ tt_cleanup(void) {
     free(native_text);
 
     // Free arrays allocated in load_fmt_file
-    free(yhash);
-    free(eqtb);
-    free(mem);
-    free(str_start);
-    free(str_pool);
-    free(font_info);
-
     free(font_mapping);
     free(font_layout_engine);
     free(font_flags);
     free(font_letter_space);
-    free(font_check);
-    free(font_size);
-    free(font_dsize);
-    free(font_params);
-    free(font_name);
-    free(font_area);
-    free(font_bc);
-    free(font_ec);
-    free(font_glue);
-    free(hyphen_char);
-    free(skew_char);
-    free(bchar_label);
-    free(font_bchar);
-    free(font_false_bchar);
-    free(char_base);
-    free(width_base);
-    free(height_base);
-    free(depth_base);
-    free(italic_base);
-    free(lig_kern_base);
-    free(kern_base);
-    free(exten_base);
-    free(param_base);
-
-    trie_trl = mfree(trie_trl);
-    trie_tro = mfree(trie_tro);
-    trie_trc = mfree(trie_trc);
+
+    release_format_arrays();
+    string_index_reset();
 }
 
 tt_history_t
@@ -3600,6 +3950,10 @@ tt_run_engine(const char *dump_name, const char *input_file_name, time_t build_d
     half_error_line = 50;
     max_print_line = 79;
     hash_extra = 600000L;
+    cs_lookups = 0;
+    cs_probes = 0;
+    profile_reset();
+    hyph_cache_begin_run();
     expand_depth = 10000;
 
     /* Allocate many of our big arrays. */
@@ -3624,6 +3978,7 @@ tt_run_engine(const char *dump_name, const char *input_file_name, time_t build_d
 
     if (in_initex_mode) {
         mem = xmalloc_array(memory_word, MEM_TOP + 1);
+        mem_max = MEM_TOP;
         eqtb_top = EQTB_SIZE + hash_extra;
 
         if (hash_extra == 0)
@@ -3656,7 +4011,7 @@ tt_run_engine(const char *dump_name, const char *input_file_name, time_t build_d
         bad = 2;
     if (1100 > MEM_TOP)
         bad = 4;
-    if (HASH_PRIME > HASH_SIZE)
+    if (hash_prime < 1 || hash_prime > HASH_SIZE)
         bad = 5;
     if (max_in_open >= 128)
         bad = 6;
@@ -3755,10 +4110,13 @@ tt_run_engine(const char *dump_name, const char *input_file_name, time_t build_d
 
     no_new_control_sequence = true;
 
-    if (!in_initex_mode) {
+    /* an initex run may start from an existing format and \dump again on top
+     * of it, which is how a document preamble becomes a format of its own */
+    if (!in_initex_mode || initex_preload_format) {
+        ttbc_fire_checkpoint(TTBC_CHECKPOINT_FORMAT_LOAD_BEGIN, NULL);
         if (!load_fmt_file())
             return history;
-        ttbc_fire_checkpoint(TTBC_CHECKPOINT_FORMAT_LOADED);
+        ttbc_fire_checkpoint(TTBC_CHECKPOINT_FORMAT_LOADED, NULL);
     }
 
     if (INTPAR(end_line_char) < 0 || INTPAR(end_line_char) > BIGGEST_CHAR)
@@ -3766,7 +4124,7 @@ tt_run_engine(const char *dump_name, const char *input_file_name, time_t build_d
     else
         buffer[cur_input.limit] = INTPAR(end_line_char);
 
-    if (in_initex_mode) {
+    if (in_initex_mode && !initex_preload_format) {
         /* TeX initializes with the real date and time, but for format file
          * reproducibility we do this: */
         INTPAR(time) = 0;
@@ -11,13 +11,13 @@
 #include <stdio.h>
 #include <unicode/ucnv.h>
 
-char *name_of_input_file = NULL;
+TTBC_THREAD_LOCAL char *name_of_input_file = NULL;
 
 // Tectonic: This buffer is used for SyncTeX, which needs to emit absolute
 // filesystem paths -- which are difficult to derive in our virtualized I/O
 // system. The most backwards-compatible way to expose this information to the
 // engine was to add the `ttbc_get_last_input_abspath()` API used below.
-char abspath_of_input_file[1024] = "";
+TTBC_THREAD_LOCAL char abspath_of_input_file[1024] = "";
 
 rust_input_handle_t
 tt_xetex_open_input (int filefmt)
@@ -192,14 +192,72 @@ conversion_error(int errcode)
 }
 
 
+/* A quick check before the TECkit normalizer: a line made only of
+ * characters that are unchanged by the normalization form and that never
+ * combine with a neighbour is already normalized. For NFC that is
+ * everything below the combining diacritics at U+0300, the CJK ideographs
+ * and the Hangul syllables; for NFD, everything below the precomposed
+ * letters at U+00C0 and the CJK ideographs. Other lines, and lines with
+ * anything else in them, go through the normalizer as before. */
+#if defined(__GNUC__) || defined(__clang__)
+#define NORM_CHUNK 4
+typedef uint32_t norm_chunk_t __attribute__((vector_size(NORM_CHUNK * sizeof(uint32_t))));
+#endif
+
+static bool
+is_normalized(const uint32_t* buf, int len, int norm)
+{
+    uint32_t below = (norm == 1) ? 0x300 : 0xC0;
+    int n = 0;
+
+#ifdef NORM_CHUNK
+    /* most lines are plain Latin text, tested four characters at a time */
+    while (len - n >= NORM_CHUNK) {
+        norm_chunk_t v, over;
+        uint64_t halves[2];
+
+        memcpy(&v, buf + n, sizeof v);
+        over = (norm_chunk_t) (v >= below);
+        memcpy(halves, &over, sizeof halves);
+        if (halves[0] | halves[1])
+            break;
+        n += NORM_CHUNK;
+    }
+#endif
+
+    for (; n < len; n++) {
+        uint32_t c = buf[n];
+
+        if (c < below)
+            continue;
+        if (c >= 0x4E00 && c <= 0x9FFF)
+            continue;
+        if (norm == 1 && c >= 0xAC00 && c <= 0xD7A3)
+            continue;
+        return false;
+    }
+
+    return true;
+}
+
+
 static void
 apply_normalization(uint32_t* buf, int len, int norm)
 {
-    static TECkit_Converter normalizers[2] = { NULL, NULL };
+    static TTBC_THREAD_LOCAL TECkit_Converter normalizers[2] = { NULL, NULL };
 
     TECkit_Status status;
     UInt32 inUsed, outUsed;
     TECkit_Converter *normPtr = &normalizers[norm - 1];
+
+    if (is_normalized(buf, len, norm)) {
+        if (len > buf_size - first)
+            buffer_overflow();
+        memcpy(&buffer[first], buf, len * sizeof(*buffer));
+        last = first + len;
+        return;
+    }
+
     if (*normPtr == NULL) {
         status = TECkit_CreateConverter(NULL, 0, 1,
             NATIVE_UTF32, NATIVE_UTF32 | (norm == 1 ? kForm_NFC : kForm_NFD),
@@ -217,11 +275,84 @@ apply_normalization(uint32_t* buf, int len, int norm)
 }
 
 
+/* With GCC-style vector extensions, read_ascii_run() tests and widens 16
+ * bytes at a time: SSE2 or NEON natively, SIMD128 on wasm32. */
+#if defined(__GNUC__) || defined(__clang__)
+#define ASCII_CHUNK 16
+typedef uint8_t ascii_chunk_t __attribute__((vector_size(ASCII_CHUNK)));
+typedef int8_t ascii_mask_t __attribute__((vector_size(ASCII_CHUNK)));
+typedef UnicodeScalar ascii_wide_t __attribute__((vector_size(ASCII_CHUNK * sizeof(UnicodeScalar))));
+#endif
+
+/* Copy a run of plain ASCII for input_line() straight out of the input's
+ * buffer, instead of one ttbc_input_getc() call per byte. Stops at the end of
+ * the line, at the first non-ASCII byte, or when `buffer` is full. Returns the
+ * line terminator (consumed) or EOF when the line is complete, and -2 when the
+ * caller has to continue through get_uni_c(). */
+static int
+read_ascii_run(UFILE* f)
+{
+    const uint8_t *data;
+    size_t len, n = 0;
+    int i = -2;
+
+    if (f->encodingMode != UTF8 || f->savedChar != -1)
+        return -2;
+
+    if (ttbc_input_peek(f->handle, &data, &len) != 0)
+        return -2;
+
+    if (len == 0)
+        return EOF;
+
+#ifdef ASCII_CHUNK
+    /* Whole chunks with no line end and no byte above 0x7F go straight in;
+     * the chunk holding the first byte to stop at is left to the loop below. */
+    while (len - n >= ASCII_CHUNK && buf_size - last >= ASCII_CHUNK) {
+        ascii_chunk_t v;
+        ascii_mask_t stop;
+        ascii_wide_t wide;
+        uint64_t halves[2];
+
+        memcpy(&v, data + n, sizeof v);
+        stop = (ascii_mask_t) ((v >= 0x80) | (v == '\n') | (v == '\r'));
+        memcpy(halves, &stop, sizeof halves);
+        if (halves[0] | halves[1])
+            break;
+
+        wide = __builtin_convertvector(v, ascii_wide_t);
+        memcpy(&buffer[last], &wide, sizeof wide);
+        n += ASCII_CHUNK;
+        last += ASCII_CHUNK;
+    }
+#endif
+
+    while (n < len && last < buf_size) {
+        uint8_t c = data[n];
+
+        if (c >= 0x80)
+            break;
+
+        n++;
+
+        if (c == '\n' || c == '\r') {
+            i = c;
+            break;
+        }
+
+        buffer[last++] = c;
+    }
+
+    ttbc_input_consume(f->handle, n);
+    return i;
+}
+
+
 int
 input_line(UFILE* f)
 {
-    static char* byteBuffer = NULL;
-    static uint32_t *utf32Buf = NULL;
+    static TTBC_THREAD_LOCAL char* byteBuffer = NULL;
+    static TTBC_THREAD_LOCAL uint32_t *utf32Buf = NULL;
     int i, tmpLen;
     int norm = get_input_normalization_state();
 
@@ -323,9 +454,20 @@ input_line(UFILE* f)
             default: // none
                 if (last < buf_size && i != EOF && i != '\n' && i != '\r')
                     buffer[last++] = i;
-                if (i != EOF && i != '\n' && i != '\r')
-                    while (last < buf_size && (i = get_uni_c(f)) != EOF && i != '\n' && i != '\r')
+                while (last < buf_size && i != EOF && i != '\n' && i != '\r') {
+                    int run_end = read_ascii_run(f);
+
+                    if (run_end != -2) {
+                        i = run_end;
+                        break;
+                    }
+
+                    if (last >= buf_size)
+                        break;
+
+                    if ((i = get_uni_c(f)) != EOF && i != '\n' && i != '\r')
                         buffer[last++] = i;
+                }
 
                 if (i == EOF && errno != EINTR && last == first)
                     return false;
@@ -484,7 +626,7 @@ make_utf16_name(void)
     unsigned char* s = (unsigned char *) name_of_file;
     uint32_t rval;
     uint16_t* t;
-    static int name16len = 0;
+    static TTBC_THREAD_LOCAL int name16len = 0;
     if (name16len <= name_length) {
         free(name_of_file16);
         name16len = name_length + 10;
@@ -14,6 +14,8 @@
 #include "xetex-xetexd.h"
 #include "tectonic_bridge_core.h"
 
+#include <stdio.h> /* for snprintf */
+
 #define AWFUL_BAD 0x3FFFFFFF
 
 #define VERY_LOOSE_FIT 0
@@ -21,43 +23,43 @@
 #define DECENT_FIT 2
 #define TIGHT_FIT 3
 
-static int32_t passive;
-static scaled_t cur_active_width[7];
-static scaled_t background[7];
-static scaled_t break_width[7];
-static int32_t best_place[4];
-static int32_t best_pl_line[4];
-static scaled_t disc_width;
-static bool no_shrink_error_yet;
-static int32_t cur_p;
-static bool second_pass;
-static bool final_pass;
-static int32_t threshold;
-static int32_t minimal_demerits[4];
-static int32_t minimum_demerits;
-static int32_t easy_line;
-static int32_t last_special_line;
-static scaled_t first_width;
-static scaled_t second_width;
-static scaled_t first_indent;
-static scaled_t second_indent;
-static int32_t best_bet;
-static int32_t fewest_demerits;
-static int32_t best_line;
-static int32_t actual_looseness;
-static int32_t line_diff;
-static small_number hn;
-static int32_t ha, hb;
-static int32_t hyf_char;
-static unsigned char init_cur_lang;
-static int32_t l_hyf, r_hyf, init_l_hyf, init_r_hyf;
-static int32_t hyf_bchar;
-static int32_t last_line_fill;
-static bool do_last_line_fit;
-static small_number active_node_size;
-static scaled_t fill_width[3];
-static scaled_t best_pl_short[4];
-static scaled_t best_pl_glue[4];
+static TTBC_THREAD_LOCAL int32_t passive;
+static TTBC_THREAD_LOCAL scaled_t cur_active_width[7];
+static TTBC_THREAD_LOCAL scaled_t background[7];
+static TTBC_THREAD_LOCAL scaled_t break_width[7];
+static TTBC_THREAD_LOCAL int32_t best_place[4];
+static TTBC_THREAD_LOCAL int32_t best_pl_line[4];
+static TTBC_THREAD_LOCAL scaled_t disc_width;
+static TTBC_THREAD_LOCAL bool no_shrink_error_yet;
+static TTBC_THREAD_LOCAL int32_t cur_p;
+static TTBC_THREAD_LOCAL bool second_pass;
+static TTBC_THREAD_LOCAL bool final_pass;
+static TTBC_THREAD_LOCAL int32_t threshold;
+static TTBC_THREAD_LOCAL int32_t minimal_demerits[4];
+static TTBC_THREAD_LOCAL int32_t minimum_demerits;
+static TTBC_THREAD_LOCAL int32_t easy_line;
+static TTBC_THREAD_LOCAL int32_t last_special_line;
+static TTBC_THREAD_LOCAL scaled_t first_width;
+static TTBC_THREAD_LOCAL scaled_t second_width;
+static TTBC_THREAD_LOCAL scaled_t first_indent;
+static TTBC_THREAD_LOCAL scaled_t second_indent;
+static TTBC_THREAD_LOCAL int32_t best_bet;
+static TTBC_THREAD_LOCAL int32_t fewest_demerits;
+static TTBC_THREAD_LOCAL int32_t best_line;
+static TTBC_THREAD_LOCAL int32_t actual_looseness;
+static TTBC_THREAD_LOCAL int32_t line_diff;
+static TTBC_THREAD_LOCAL small_number hn;
+static TTBC_THREAD_LOCAL int32_t ha, hb;
+static TTBC_THREAD_LOCAL int32_t hyf_char;
+static TTBC_THREAD_LOCAL unsigned char init_cur_lang;
+static TTBC_THREAD_LOCAL int32_t l_hyf, r_hyf, init_l_hyf, init_r_hyf;
+static TTBC_THREAD_LOCAL int32_t hyf_bchar;
+static TTBC_THREAD_LOCAL int32_t last_line_fill;
+static TTBC_THREAD_LOCAL bool do_last_line_fit;
+static TTBC_THREAD_LOCAL small_number active_node_size;
+static TTBC_THREAD_LOCAL scaled_t fill_width[3];
+static TTBC_THREAD_LOCAL scaled_t best_pl_short[4];
+static TTBC_THREAD_LOCAL scaled_t best_pl_glue[4];
 
 
 static void post_line_break(bool d);
@@ -84,6 +86,467 @@ get_native_usv(int32_t p, int32_t i) {
     return c;
 }
 
+
+/* Line-break memo (linebreak_memo_enabled). A paragraph that comes round
+ * again on a later pass with the same nodes and the same breaking parameters
+ * gets the breakpoints it got before, without the search. The key hashes
+ * everything the search reads; the value lists the chosen breaks as
+ * positions in the paragraph's node list. Paragraphs the search changes
+ * (hyphenation, split native words, infinite shrink errors) and \lastlinefit
+ * paragraphs are not recorded. */
+
+#define MEMO_SLOTS 8192 /* direct mapped: a colliding paragraph replaces */
+
+typedef struct {
+    uint64_t key;
+    int32_t n_nodes;
+    int32_t n_breaks; /* 0 = empty slot */
+    int32_t *breaks; /* node positions; -1 is the end of the paragraph */
+} linebreak_memo_t;
+
+static TTBC_THREAD_LOCAL linebreak_memo_t *memo;
+static TTBC_THREAD_LOCAL bool memo_list_changed;
+
+static inline uint64_t
+mix(uint64_t h, int64_t v)
+{
+    return (h ^ (uint64_t) v) * 0x100000001B3ull;
+}
+
+static uint64_t
+memo_hash_node(uint64_t h, int32_t p)
+{
+    internal_font_number f;
+    int32_t q, i;
+
+    if (is_char_node(p)) {
+        f = CHAR_NODE_font(p);
+        h = mix(h, f);
+        h = mix(h, CHAR_NODE_character(p));
+        h = mix(h, hyphen_char[f]);
+        return mix(h, FONT_CHARACTER_WIDTH(f, effective_char(true, f, CHAR_NODE_character(p))));
+    }
+
+    h = mix(h, NODE_type(p));
+    h = mix(h, NODE_subtype(p));
+
+    switch (NODE_type(p)) {
+    case HLIST_NODE:
+    case VLIST_NODE:
+    case RULE_NODE:
+    case KERN_NODE:
+    case MATH_NODE:
+        h = mix(h, BOX_width(p));
+        break;
+
+    case LIGATURE_NODE:
+        f = LIGATURE_NODE_lig_font(p);
+        h = mix(h, f);
+        h = mix(h, LIGATURE_NODE_lig_char(p));
+        h = mix(h, hyphen_char[f]);
+        h = mix(h, FONT_CHARACTER_WIDTH(f, effective_char(true, f, LIGATURE_NODE_lig_char(p))));
+        break;
+
+    case DISC_NODE:
+        for (q = DISCRETIONARY_NODE_pre_break(p); q != TEX_NULL; q = LLIST_link(q))
+            h = memo_hash_node(h, q);
+        h = mix(h, -1);
+        for (q = DISCRETIONARY_NODE_post_break(p); q != TEX_NULL; q = LLIST_link(q))
+            h = memo_hash_node(h, q);
+        h = mix(h, -1);
+        break;
+
+    case GLUE_NODE:
+        q = GLUE_NODE_glue_ptr(p);
+        h = mix(h, BOX_width(q));
+        h = mix(h, GLUE_SPEC_stretch(q));
+        h = mix(h, GLUE_SPEC_stretch_order(q));
+        h = mix(h, GLUE_SPEC_shrink(q));
+        h = mix(h, GLUE_SPEC_shrink_order(q));
+        break;
+
+    case PENALTY_NODE:
+        h = mix(h, PENALTY_NODE_penalty(p));
+        break;
+
+    case WHATSIT_NODE:
+        switch (NODE_subtype(p)) {
+        case NATIVE_WORD_NODE:
+        case NATIVE_WORD_NODE_AT:
+            f = NATIVE_NODE_font(p);
+            h = mix(h, f);
+            h = mix(h, hyphen_char[f]);
+            for (i = 0; i < NATIVE_NODE_length(p); i++)
+                h = mix(h, NATIVE_NODE_text(p)[i]);
+            h = mix(h, BOX_width(p));
+            break;
+
+        case GLYPH_NODE:
+        case PIC_NODE:
+        case PDF_NODE:
+            h = mix(h, BOX_width(p));
+            break;
+
+        case LANGUAGE_NODE:
+            h = mix(h, LANGUAGE_NODE_what_lang(p));
+            h = mix(h, LANGUAGE_NODE_what_lhm(p));
+            h = mix(h, LANGUAGE_NODE_what_rhm(p));
+            break;
+        }
+        break;
+    }
+
+    return h;
+}
+
+/* The memo key of the paragraph at TEMP_HEAD, once line_break has set it up;
+ * the number of nodes goes in *n_nodes. */
+static uint64_t
+memo_key(int32_t *n_nodes)
+{
+    uint64_t h = 0xCBF29CE484222325ull;
+    int32_t p, i, n = 0;
+
+    h = mix(h, DIMENPAR(hsize));
+    h = mix(h, INTPAR(pretolerance));
+    h = mix(h, INTPAR(tolerance));
+    h = mix(h, DIMENPAR(emergency_stretch));
+    h = mix(h, INTPAR(looseness));
+    h = mix(h, INTPAR(line_penalty));
+    h = mix(h, INTPAR(hyphen_penalty));
+    h = mix(h, INTPAR(ex_hyphen_penalty));
+    h = mix(h, INTPAR(adj_demerits));
+    h = mix(h, INTPAR(double_hyphen_demerits));
+    h = mix(h, INTPAR(final_hyphen_demerits));
+    h = mix(h, INTPAR(uc_hyph));
+    h = mix(h, INTPAR(xetex_protrude_chars));
+    h = mix(h, INTPAR(xetex_use_glyph_metrics));
+    h = mix(h, DIMENPAR(hang_indent));
+    h = mix(h, INTPAR(hang_after));
+    h = mix(h, cur_list.prev_graf);
+    h = mix(h, init_cur_lang);
+    h = mix(h, init_l_hyf);
+    h = mix(h, init_r_hyf);
+    h = mix(h, semantic_pagination_enabled);
+
+    for (i = 1; i <= 6; i++)
+        h = mix(h, background[i]);
+
+    if (LOCAL(par_shape) != TEX_NULL) {
+        h = mix(h, LLIST_info(LOCAL(par_shape)));
+        for (i = 1; i <= 2 * LLIST_info(LOCAL(par_shape)); i++)
+            h = mix(h, mem[LOCAL(par_shape) + i].b32.s1);
+    }
+
+    for (p = LLIST_link(TEMP_HEAD); p != TEX_NULL; p = LLIST_link(p)) {
+        h = memo_hash_node(h, p);
+        n++;
+    }
+
+    *n_nodes = n;
+    return h;
+}
+
+static linebreak_memo_t *
+memo_find(uint64_t key, int32_t n_nodes)
+{
+    linebreak_memo_t *m;
+
+    if (memo == NULL)
+        memo = xcalloc(MEMO_SLOTS, sizeof *memo);
+
+    m = &memo[key & (MEMO_SLOTS - 1)];
+    if (m->n_breaks == 0 || m->key != key || m->n_nodes != n_nodes)
+        return NULL;
+    return m;
+}
+
+/* Remember the breaks ending at best_bet. Runs before post_line_break takes
+ * the list apart. */
+static void
+memo_store(uint64_t key, int32_t n_nodes)
+{
+    linebreak_memo_t *m = &memo[key & (MEMO_SLOTS - 1)];
+    int32_t p, q, i, k, n = 0;
+
+    for (q = ACTIVE_NODE_break_node(best_bet); q != TEX_NULL; q = PASSIVE_NODE_prev_break(q))
+        n++;
+
+    m->n_breaks = 0;
+    m->breaks = xrealloc(m->breaks, n * sizeof *m->breaks);
+
+    /* the chain runs from the last break back to the first */
+    k = n;
+    for (q = ACTIVE_NODE_break_node(best_bet); q != TEX_NULL; q = PASSIVE_NODE_prev_break(q))
+        m->breaks[--k] = PASSIVE_NODE_cur_break(q);
+
+    /* break nodes to positions, in one walk of the list */
+    i = 0;
+    for (p = LLIST_link(TEMP_HEAD); p != TEX_NULL && k < n; p = LLIST_link(p), i++) {
+        if (m->breaks[k] == p)
+            m->breaks[k++] = i;
+    }
+
+    if (k == n - 1 && m->breaks[k] == TEX_NULL) {
+        m->breaks[k] = -1;
+        m->key = key;
+        m->n_nodes = n_nodes;
+        m->n_breaks = n;
+    }
+}
+
+/* Set up passive and best_bet as the search would have left them for the
+ * breaks in m. */
+static void
+memo_replay(const linebreak_memo_t *m)
+{
+    int32_t p, q, r, i = 0, k, prev = TEX_NULL;
+
+    passive = TEX_NULL;
+    p = LLIST_link(TEMP_HEAD);
+
+    for (k = 0; k < m->n_breaks; k++) {
+        if (m->breaks[k] < 0) {
+            q = TEX_NULL;
+        } else {
+            for (; i < m->breaks[k]; i++)
+                p = LLIST_link(p);
+            q = p;
+        }
+
+        r = get_node(PASSIVE_NODE_SIZE);
+        LLIST_link(r) = passive;
+        passive = r;
+        PASSIVE_NODE_cur_break(r) = q;
+        PASSIVE_NODE_prev_break(r) = prev;
+        PASSIVE_NODE_serial(r) = k + 1;
+        prev = r;
+    }
+
+    best_bet = get_node(active_node_size);
+    NODE_type(best_bet) = UNHYPHENATED;
+    ACTIVE_NODE_fitness(best_bet) = DECENT_FIT;
+    ACTIVE_NODE_break_node(best_bet) = passive;
+    ACTIVE_NODE_line_number(best_bet) = cur_list.prev_graf + 1 + m->n_breaks;
+    ACTIVE_NODE_total_demerits(best_bet) = 0;
+    LLIST_link(best_bet) = LAST_ACTIVE;
+    LLIST_link(ACTIVE_LIST) = best_bet;
+    best_line = ACTIVE_NODE_line_number(best_bet);
+}
+
+
+/* Drop every remembered paragraph. */
+void
+linebreak_memo_reset(void)
+{
+    int32_t i;
+
+    if (memo == NULL)
+        return;
+
+    for (i = 0; i < MEMO_SLOTS; i++)
+        free(memo[i].breaks);
+    memo = mfree(memo);
+}
+
+/* Hyphenation cache. Once the format is loaded the pattern trie is fixed, so
+ * the hyphens it finds in a word depend on nothing but the word, its
+ * language and r_hyf (\righthyphenmin), which bounds where the pattern loop
+ * starts matching. hyphenate keeps them per (language, r_hyf, letters) and
+ * reuses them for every later occurrence, on this pass and the ones after.
+ * Exceptions (\hyphenation) are still looked up first, since they can
+ * change mid-document. Each run checks a fingerprint of the trie before
+ * trusting what an earlier run left, so a different format starts afresh. */
+
+#define HYPH_CACHE_MAX_WORDS 65536 /* then start again */
+
+typedef struct {
+    uint64_t hash;
+    int32_t lang;
+    int32_t r_hyf;
+    int32_t hn;
+    unsigned char *hyf; /* hyf[0..hn] as the patterns left it */
+    int32_t hc[]; /* hc[1..hn] */
+} hyph_word_t;
+
+static TTBC_THREAD_LOCAL hyph_word_t **hyph_cache;
+static TTBC_THREAD_LOCAL uint32_t hyph_cache_slots, hyph_cache_words;
+static TTBC_THREAD_LOCAL uint64_t hyph_cache_trie; /* fingerprint of the trie the words came from */
+static TTBC_THREAD_LOCAL bool hyph_cache_checked; /* the fingerprint, this run */
+static TTBC_THREAD_LOCAL uint64_t hyph_cache_hits, hyph_cache_misses;
+static TTBC_THREAD_LOCAL uint64_t hyph_word_hash; /* of the word being hyphenated */
+
+static uint64_t
+trie_fingerprint(void)
+{
+    uint64_t h = 0xCBF29CE484222325ull;
+    int32_t i;
+
+    h = mix(h, trie_max);
+    h = mix(h, hyph_start);
+    h = mix(h, max_hyph_char);
+    h = mix(h, trie_op_ptr);
+
+    for (i = 0; i <= trie_max; i++) {
+        h = mix(h, trie_trl[i]);
+        h = mix(h, trie_tro[i]);
+        h = mix(h, trie_trc[i]);
+    }
+
+    for (i = 1; i <= trie_op_ptr; i++) {
+        h = mix(h, hyf_distance[i]);
+        h = mix(h, hyf_num[i]);
+        h = mix(h, hyf_next[i]);
+    }
+
+    for (i = 0; i <= BIGGEST_LANG; i++)
+        h = mix(h, op_start[i]);
+
+    return h;
+}
+
+static void
+hyph_cache_clear(void)
+{
+    uint32_t s;
+
+    for (s = 0; s < hyph_cache_slots; s++)
+        free(hyph_cache[s]);
+    hyph_cache = mfree(hyph_cache);
+    hyph_cache_slots = hyph_cache_words = 0;
+}
+
+static bool
+hyph_cache_ready(void)
+{
+    uint64_t fp;
+
+    /* initex can still be adding patterns */
+    if (in_initex_mode)
+        return false;
+
+    if (!hyph_cache_checked) {
+        hyph_cache_checked = true;
+        fp = trie_fingerprint();
+        if (fp != hyph_cache_trie) {
+            hyph_cache_clear();
+            hyph_cache_trie = fp;
+        }
+    }
+
+    return true;
+}
+
+/* Fill hyf[] for the word in hc[1..hn] if it has been seen before. */
+static bool
+hyph_cache_lookup(void)
+{
+    uint64_t h = 0xCBF29CE484222325ull;
+    hyph_word_t *w;
+    uint32_t s;
+    int32_t j;
+
+    if (!hyph_cache_ready())
+        return false;
+
+    h = mix(h, cur_lang);
+    h = mix(h, r_hyf);
+    h = mix(h, hn);
+    for (j = 1; j <= hn; j++)
+        h = mix(h, hc[j]);
+    hyph_word_hash = h;
+
+    for (s = h & (hyph_cache_slots - 1); hyph_cache_slots > 0 && (w = hyph_cache[s]) != NULL; s = (s + 1) & (hyph_cache_slots - 1)) {
+        if (w->hash == h && w->lang == cur_lang && w->r_hyf == r_hyf && w->hn == hn && memcmp(w->hc, &hc[1], hn * sizeof(int32_t)) == 0) {
+            memcpy(hyf, w->hyf, hn + 1);
+            hyph_cache_hits++;
+            return true;
+        }
+    }
+
+    hyph_cache_misses++;
+    return false;
+}
+
+static void
+hyph_cache_insert(hyph_word_t *w)
+{
+    uint32_t s;
+
+    for (s = w->hash & (hyph_cache_slots - 1); hyph_cache[s] != NULL; s = (s + 1) & (hyph_cache_slots - 1))
+        ;
+    hyph_cache[s] = w;
+}
+
+/* Remember the patterns' hyf[] for the word hyph_cache_lookup missed. */
+static void
+hyph_cache_store(void)
+{
+    hyph_word_t **old, *w;
+    uint32_t s, old_slots;
+
+    if (!hyph_cache_ready())
+        return;
+
+    if (hyph_cache_words >= HYPH_CACHE_MAX_WORDS)
+        hyph_cache_clear();
+
+    if ((hyph_cache_words + 1) * 2 > hyph_cache_slots) {
+        old = hyph_cache;
+        old_slots = hyph_cache_slots;
+        hyph_cache_slots = old_slots ? old_slots * 2 : 4096;
+        hyph_cache = xcalloc(hyph_cache_slots, sizeof *hyph_cache);
+
+        for (s = 0; s < old_slots; s++) {
+            if (old[s] != NULL)
+                hyph_cache_insert(old[s]);
+        }
+        free(old);
+    }
+
+    w = xmalloc(sizeof *w + hn * sizeof(int32_t) + hn + 1);
+    w->hash = hyph_word_hash;
+    w->lang = cur_lang;
+    w->r_hyf = r_hyf;
+    w->hn = hn;
+    memcpy(w->hc, &hc[1], hn * sizeof(int32_t));
+    w->hyf = (unsigned char *) (w->hc + hn);
+    memcpy(w->hyf, hyf, hn + 1);
+
+    hyph_cache_insert(w);
+    hyph_cache_words++;
+}
+
+
+/* Called as each run starts; the words themselves are kept. */
+void
+hyph_cache_begin_run(void)
+{
+    hyph_cache_checked = false;
+    hyph_cache_hits = hyph_cache_misses = 0;
+}
+
+/* This run's figures, to the trace and (with \tracingstats) the log. Called
+ * while the log is still open. */
+void
+hyph_cache_report(void)
+{
+    char detail[160];
+
+    if (hyph_cache_hits + hyph_cache_misses == 0)
+        return;
+
+    snprintf(detail, sizeof detail, "hyphenation cache: %u words, %" PRIu64 " hits, %" PRIu64 " misses",
+             hyph_cache_words, hyph_cache_hits, hyph_cache_misses);
+    ttbc_fire_checkpoint(TTBC_CHECKPOINT_STATS, detail);
+
+    if (INTPAR(tracing_stats) > 0) {
+        flush_log_buffer();
+        ttstub_fprintf(log_file, " %s\n", detail);
+    }
+}
+
+
 /* Break a paragraph into lines (XTTP:843).
  *
  * d: true if we are breaking a partial paragraph preceding display math mode
@@ -107,6 +570,10 @@ line_break(bool d)
     int32_t l;
     int32_t i;
     int32_t for_end_1;
+    const linebreak_memo_t *hit = NULL;
+    uint64_t key = 0;
+    int32_t n_nodes = 0;
+    bool memoize;
 
     pack_begin_line = cur_list.mode_line; /* "this is for over/underfull box messages" */
 
@@ -221,6 +688,20 @@ line_break(bool d)
     else
         easy_line = MAX_HALFWORD; /*:877*/
 
+    memoize = linebreak_memo_enabled && !do_last_line_fit;
+
+    if (memoize) {
+        key = memo_key(&n_nodes);
+        hit = memo_find(key, n_nodes);
+
+        if (hit != NULL) {
+            memo_replay(hit);
+            goto done;
+        }
+
+        memo_list_changed = false;
+    }
+
     /* Start finding optimal breakpoints (892) */
 
     threshold = INTPAR(pretolerance);
@@ -497,6 +978,7 @@ line_break(bool d)
                                         set_native_metrics(q, (INTPAR(xetex_use_glyph_metrics) > 0));
                                         LLIST_link(q) = LLIST_link(ha);
                                         LLIST_link(ha) = q;
+                                        memo_list_changed = true;
                                         NATIVE_NODE_length(ha) = l;
                                         set_native_metrics(ha, (INTPAR(xetex_use_glyph_metrics) > 0));
                                         goto done3;
@@ -511,6 +993,7 @@ line_break(bool d)
                                     set_native_metrics(q, (INTPAR(xetex_use_glyph_metrics) > 0));
                                     LLIST_link(q) = LLIST_link(ha);
                                     LLIST_link(ha) = q;
+                                    memo_list_changed = true;
                                     NATIVE_NODE_length(ha) = l;
                                     set_native_metrics(ha, (INTPAR(xetex_use_glyph_metrics) > 0));
                                     ha = LLIST_link(ha);
@@ -930,6 +1413,9 @@ line_break(bool d)
     }
 
 done:
+    if (memoize && hit == NULL && !memo_list_changed && no_shrink_error_yet)
+        memo_store(key, n_nodes);
+
     if (do_last_line_fit) { /*1641:*/
         if (ACTIVE_NODE_shortfall(best_bet) == 0) {
             do_last_line_fit = false;
@@ -2078,6 +2564,8 @@ not_found:
     hn--;
     if (trie_trc[cur_lang + 1] != cur_lang)
         return;
+    if (hyph_cache_lookup())
+        goto found;
     hc[0] = 0;
     hc[hn + 1] = 0;
     hc[hn + 2] = max_hyph_char;
@@ -2107,6 +2595,7 @@ not_found:
             }
             while (j++ < for_end);
     }
+    hyph_cache_store();
  found:
     {
         register int32_t for_end;
@@ -2139,6 +2628,8 @@ not_found:
     return;
 
 found1:
+    memo_list_changed = true;
+
     if ((((ha) != TEX_NULL && (!(is_char_node(ha))) && (NODE_type(ha) == WHATSIT_NODE)
           && ((mem[ha].b16.s0 == NATIVE_WORD_NODE) || (mem[ha].b16.s0 == NATIVE_WORD_NODE_AT))))) {
         s = cur_p;
@@ -2402,6 +2893,7 @@ finite_shrink(int32_t p)
 static small_number
 reconstitute(small_number j, small_number n, int32_t bchar, int32_t hchar)
 {
+    int32_t fresh;
     int32_t p;
     int32_t t;
     b16x4 q;
@@ -2423,7 +2915,8 @@ reconstitute(small_number j, small_number n, int32_t bchar, int32_t hchar)
         while (p > TEX_NULL) {
 
             {
-                mem[t].b32.s1 = get_avail();
+                fresh = get_avail();
+                mem[t].b32.s1 = fresh;
                 t = LLIST_link(t);
                 mem[t].b16.s1 = hf;
                 mem[t].b16.s0 = mem[p].b16.s0;
@@ -2431,7 +2924,8 @@ reconstitute(small_number j, small_number n, int32_t bchar, int32_t hchar)
             p = LLIST_link(p);
         }
     } else if (cur_l < TOO_BIG_CHAR) {
-        mem[t].b32.s1 = get_avail();
+        fresh = get_avail();
+        mem[t].b32.s1 = fresh;
         t = LLIST_link(t);
         mem[t].b16.s1 = hf;
         mem[t].b16.s0 = cur_l;
@@ -2589,7 +3083,8 @@ continue_:
                                 else {
 
                                     {
-                                        mem[t].b32.s1 = get_avail();
+                                        fresh = get_avail();
+                                        mem[t].b32.s1 = fresh;
                                         t = LLIST_link(t);
                                         mem[t].b16.s1 = hf;
                                         mem[t].b16.s0 = cur_r;
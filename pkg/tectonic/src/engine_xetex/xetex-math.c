@@ -60,12 +60,12 @@ static small_number make_left_right(int32_t q, small_number style, scaled_t max_
 static void mlist_to_hlist(void);
 
 
-static b16x4 null_delimiter;
-static int32_t cur_mlist;
-static small_number cur_style;
-static int32_t cur_size;
-static scaled_t cur_mu;
-static bool mlist_penalties;
+static TTBC_THREAD_LOCAL b16x4 null_delimiter;
+static TTBC_THREAD_LOCAL int32_t cur_mlist;
+static TTBC_THREAD_LOCAL small_number cur_style;
+static TTBC_THREAD_LOCAL int32_t cur_size;
+static TTBC_THREAD_LOCAL scaled_t cur_mu;
+static TTBC_THREAD_LOCAL bool mlist_penalties;
 
 void
 initialize_math_variables(void)
@@ -1746,8 +1746,9 @@ fetch(int32_t a)
 static void
 make_over(int32_t q)
 {
-        mem[q + 1].b32.s0 =
-        overbar(clean_box(q + 1, 2 * (cur_style / 2) + 1), 3 * default_rule_thickness(), default_rule_thickness());
+    int32_t fresh;
+    fresh = overbar(clean_box(q + 1, 2 * (cur_style / 2) + 1), 3 * default_rule_thickness(), default_rule_thickness());
+    mem[q + 1].b32.s0 = fresh;
     mem[q + 1].b32.s1 = SUB_BOX;
 }
 
@@ -1787,6 +1788,7 @@ make_vcenter(int32_t q)
 static void
 make_radical(int32_t q)
 {
+    int32_t fresh;
     int32_t x, y;
     internal_font_number f;
     scaled_t rule_thickness;
@@ -1823,7 +1825,8 @@ make_radical(int32_t q)
         clr = clr + half(delta);
     mem[y + 4].b32.s1 = -(int32_t) (mem[x + 3].b32.s1 + clr);
     mem[y].b32.s1 = overbar(x, clr, mem[y + 3].b32.s1);
-    mem[q + 1].b32.s0 = hpack(y, 0, ADDITIONAL);
+    fresh = hpack(y, 0, ADDITIONAL);
+    mem[q + 1].b32.s0 = fresh;
     mem[q + 1].b32.s1 = SUB_BOX;
 }
 
@@ -2046,6 +2049,7 @@ make_math_accent(int32_t q)
 static void
 make_fraction(int32_t q)
 {
+    int32_t fresh;
     int32_t p, v, x, y, z;
     scaled_t delta, delta1, delta2, shift_up, shift_down, clr;
 
@@ -2154,7 +2158,8 @@ make_fraction(int32_t q)
     mem[x].b32.s1 = v;
     z = var_delimiter(q + 5, cur_size, delta);
     mem[v].b32.s1 = z;
-    mem[q + 1].b32.s1 = hpack(x, 0, ADDITIONAL); /*:775*/
+    fresh = hpack(x, 0, ADDITIONAL);
+    mem[q + 1].b32.s1 = fresh; /*:775*/
 }
 
 
@@ -2876,6 +2881,7 @@ make_scripts(int32_t q, scaled_t delta)
 static small_number
 make_left_right(int32_t q, small_number style, scaled_t max_d, scaled_t max_h)
 {
+    int32_t fresh;
     scaled_t delta, delta1, delta2;
 
     cur_style = style;
@@ -2894,7 +2900,8 @@ make_left_right(int32_t q, small_number style, scaled_t max_d, scaled_t max_h)
     delta2 = delta1 + delta1 - DIMENPAR(delimiter_shortfall);
     if (delta < delta2)
         delta = delta2;
-    mem[q + 1].b32.s1 = var_delimiter(q + 1, cur_size, delta);
+    fresh = var_delimiter(q + 1, cur_size, delta);
+    mem[q + 1].b32.s1 = fresh;
     return mem[q].b16.s1 - ((LEFT_NOAD - 20));
 }
 
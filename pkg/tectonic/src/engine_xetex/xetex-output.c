@@ -8,7 +8,7 @@
 #include "xetex-synctex.h"
 #include "tectonic_bridge_core.h"
 
-static ttbc_diagnostic_t *current_diagnostic = 0;
+static TTBC_THREAD_LOCAL ttbc_diagnostic_t *current_diagnostic = 0;
 
 void
 capture_to_diagnostic(ttbc_diagnostic_t *diagnostic)
@@ -67,6 +67,30 @@ error_here_with_diagnostic(const char* message)
     return error;
 }
 
+/* Eztex customization: the log goes to the bridge a block at a time. Most
+ * of it is printed a character at a time, and a ttbc_output_putc per
+ * character costs a handle lookup each. Whatever else writes to log_file
+ * (ttstub_fprintf, closing it) calls flush_log_buffer first, as does the
+ * abort path, so a failed run's log ends where the run did. */
+static TTBC_THREAD_LOCAL char log_buffer[4096];
+static TTBC_THREAD_LOCAL size_t log_buffer_len = 0;
+
+void
+flush_log_buffer(void)
+{
+    if (log_buffer_len > 0 && log_opened)
+        ttbc_output_write(log_file, log_buffer, log_buffer_len);
+    log_buffer_len = 0;
+}
+
+static inline void
+log_putc(int c)
+{
+    if (log_buffer_len == sizeof(log_buffer))
+        flush_log_buffer();
+    log_buffer[log_buffer_len++] = (char) c;
+}
+
 static void
 warn_char(int c)
 {
@@ -88,13 +112,13 @@ print_ln(void)
         warn_char('\n');
         if (!suppress_stdout)
             ttbc_output_putc(rust_stdout, '\n');
-        ttbc_output_putc(log_file, '\n');
+        log_putc('\n');
         term_offset = 0;
         file_offset = 0;
         break;
     case SELECTOR_LOG_ONLY:
         warn_char('\n');
-        ttbc_output_putc(log_file, '\n');
+        log_putc('\n');
         file_offset = 0;
         break;
     case SELECTOR_TERM_ONLY:
@@ -126,7 +150,7 @@ print_raw_char(UTF16_code s, bool incr_offset)
         warn_char(s);
         if (!suppress_stdout)
             ttbc_output_putc(rust_stdout, s);
-        ttbc_output_putc(log_file, s);
+        log_putc(s);
         if (incr_offset) {
             term_offset++;
             file_offset++;
@@ -137,17 +161,17 @@ print_raw_char(UTF16_code s, bool incr_offset)
             term_offset = 0;
         }
         if (file_offset == max_print_line) {
-            ttbc_output_putc(log_file, '\n');
+            log_putc('\n');
             file_offset = 0;
         }
         break;
     case SELECTOR_LOG_ONLY:
         warn_char(s);
-        ttbc_output_putc(log_file, s);
+        log_putc(s);
         if (incr_offset)
             file_offset++;
         if (file_offset == max_print_line) {
-            ttbc_output_putc(log_file, '\n');
+            log_putc('\n');
             file_offset = 0;
         }
         break;
@@ -16,10 +16,10 @@
 #include "xetex-xetexd.h"
 
 
-static int32_t best_page_break;
-static scaled_t best_size;
-static int32_t least_page_cost;
-static scaled_t page_max_depth;
+static TTBC_THREAD_LOCAL int32_t best_page_break;
+static TTBC_THREAD_LOCAL scaled_t best_size;
+static TTBC_THREAD_LOCAL int32_t least_page_cost;
+static TTBC_THREAD_LOCAL scaled_t page_max_depth;
 /* XXX other variables belong here but pop up all over the code */
 
 void
@@ -46,6 +46,9 @@ XeTeX_pic.c
 #include "dpx-pngimage.h"
 #include "dpx-jpegimage.h"
 #include "dpx-bmpimage.h"
+#include "dpx-webpimage.h"
+#include "dpx-dpxcrypt.h"
+#include "dpx-imagecache.h"
 
 
 /* load_picture() needs some helper types and functions */
@@ -72,17 +75,118 @@ typedef struct {
 } real_rect;
 
 
+/* Eztex customization: what a PDF picture measures, kept under the file's
+ * digest (see dpx-imagecache.c). graphicx measures every figure on every
+ * pass, and each time pdf_open parses the file's xref and page tree for
+ * one MediaBox. Recent results are kept in memory, which lasts across the
+ * compiles of a watch or a web session, and in the host's cache, which
+ * lasts across processes. */
+
+#define PICCACHE_KIND    "picbounds"
+#define PICCACHE_MAGIC   "XPIC"
+#define PICCACHE_ENTRIES 64
+
+enum { PICCACHE_RECT, PICCACHE_PAGES };
+
+typedef struct {
+    char      magic[4];
+    int32_t   pages;
+    real_rect rect;
+} piccache_entry;
+
+static TTBC_THREAD_LOCAL struct {
+    unsigned char  keys[PICCACHE_ENTRIES][16];
+    piccache_entry entries[PICCACHE_ENTRIES];
+    int            count, next;
+} piccache;
+
+static void
+piccache_key (unsigned char key[16], rust_input_handle_t handle, int what, int page, int pdf_box)
+{
+    MD5_CONTEXT    md5;
+    unsigned char  file_digest[16];
+    int            settings[4];
+
+    imagecache_file_digest(file_digest, handle);
+
+    settings[0] = what;
+    settings[1] = page;
+    settings[2] = pdf_box;
+    settings[3] = (int) sizeof(piccache_entry);
+
+    MD5_init(&md5);
+    MD5_write(&md5, file_digest, 16);
+    MD5_write(&md5, (const unsigned char *) settings, sizeof(settings));
+    MD5_final(key, &md5);
+}
+
+static void
+piccache_remember (const unsigned char key[16], const piccache_entry *entry)
+{
+    int i = piccache.next;
+
+    memcpy(piccache.keys[i], key, 16);
+    piccache.entries[i] = *entry;
+    piccache.next = (i + 1) % PICCACHE_ENTRIES;
+    if (piccache.count < PICCACHE_ENTRIES)
+        piccache.count++;
+}
+
+static int
+piccache_get (const unsigned char key[16], piccache_entry *entry)
+{
+    unsigned char *blob;
+    size_t         len = 0;
+    int            i;
+
+    for (i = 0; i < piccache.count; i++) {
+        if (memcmp(piccache.keys[i], key, 16) == 0) {
+            *entry = piccache.entries[i];
+            return 0;
+        }
+    }
+
+    blob = ttbc_cache_blob_get(PICCACHE_KIND, key, &len);
+    if (!blob)
+        return -1;
+    if (len != sizeof(*entry) || memcmp(blob, PICCACHE_MAGIC, 4)) {
+        free(blob);
+        return -1;
+    }
+    memcpy(entry, blob, sizeof(*entry));
+    free(blob);
+    piccache_remember(key, entry);
+    return 0;
+}
+
+static void
+piccache_put (const unsigned char key[16], piccache_entry *entry)
+{
+    memcpy(entry->magic, PICCACHE_MAGIC, 4);
+    piccache_remember(key, entry);
+    ttbc_cache_blob_put(PICCACHE_KIND, key, entry, sizeof(*entry));
+}
+
+
 int
 count_pdf_file_pages (void)
 {
     int pages;
     rust_input_handle_t handle;
     pdf_file *pf;
+    unsigned char key[16];
+    piccache_entry entry;
 
     handle = ttbc_input_open (name_of_file, TTBC_FILE_FORMAT_PICT, 0);
     if (handle == INVALID_HANDLE)
         return 0;
 
+    piccache_key(key, handle, PICCACHE_PAGES, 0, 0);
+    if (piccache_get(key, &entry) == 0) {
+        ttstub_input_close(handle);
+        return entry.pages;
+    }
+
     if ((pf = pdf_open(name_of_file, handle)) == NULL) {
         /* TODO: issue warning */
         ttstub_input_close(handle);
@@ -92,6 +196,10 @@ count_pdf_file_pages (void)
     pages = pdf_doc_get_page_count(pf);
     pdf_close(pf);
     ttstub_input_close(handle);
+
+    memset(&entry, 0, sizeof(entry));
+    entry.pages = pages;
+    piccache_put(key, &entry);
     return pages;
 }
 
@@ -200,6 +308,8 @@ get_image_size_in_inches (rust_input_handle_t handle, double *width, double *hei
         err = bmp_get_bbox(handle, &width_pix, &height_pix, &xdensity, &ydensity);
     else if (check_for_png(handle))
         err = png_get_bbox(handle, &width_pix, &height_pix, &xdensity, &ydensity);
+    else if (check_for_webp(handle))
+        err = webp_get_bbox(handle, &width_pix, &height_pix, &xdensity, &ydensity);
 
     if (err) {
         *width = -1;
@@ -234,7 +344,21 @@ find_pic_file (char **path, real_rect *bounds, int pdfBoxType, int page)
 
     if (pdfBoxType != 0) {
         /* if cmd was \XeTeXpdffile, use xpdflib to read it */
-        err = pdf_get_rect (name_of_file, handle, page, pdfBoxType, bounds);
+        unsigned char key[16];
+        piccache_entry entry;
+
+        piccache_key(key, handle, PICCACHE_RECT, page, pdfBoxType);
+        if (piccache_get(key, &entry) == 0) {
+            *bounds = entry.rect;
+            err = 0;
+        } else {
+            err = pdf_get_rect (name_of_file, handle, page, pdfBoxType, bounds);
+            if (err == 0) {
+                memset(&entry, 0, sizeof(entry));
+                entry.rect = *bounds;
+                piccache_put(key, &entry);
+            }
+        }
     } else {
         /* Tectonic customization: if we use single-precision math, we can
          * sometimes get numerical results that vary depending on whether we're
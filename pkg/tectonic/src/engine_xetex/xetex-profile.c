@@ -0,0 +1,439 @@
+/* xetex-profile.c -- where expansion time goes, per macro.
+ *
+ * With profile_expansion_enabled, macro_call opens a frame for the macro
+ * whose body it starts feeding, and end_token_list closes it when that body
+ * is used up. Frames form a call tree keyed by (parent frame, control
+ * sequence), so the same macro reached along different paths keeps separate
+ * figures. expand also counts how often each expandable primitive runs.
+ *
+ * At the end of the run the tree is written to <jobname>.flame in the folded
+ * format flame graph tools read ("\a;\b;\c <self microseconds>"), and the log
+ * gets the macros with the most self time and the busiest primitives.
+ *
+ * Separately, with sample_interval set, every sample_interval-th macro call
+ * reports where in the input the engine is through TTBC_CHECKPOINT_SAMPLE,
+ * for a host that times the gaps between reports (Sampler.zig).
+ */
+
+#include "xetex-core.h"
+#include "xetex-xetexd.h"
+
+#include <stdio.h> /* for snprintf */
+
+#define PROFILE_MAX_DEPTH 512
+#define PROFILE_TOP_MACROS 25
+#define PROFILE_TOP_PRIMITIVES 10
+
+/* parent of top-level frames and of the primitive counters */
+#define ROOT_FRAME (-1)
+#define PRIMITIVES (-2)
+
+typedef struct {
+    int32_t cs;
+    int32_t parent;
+    uint64_t calls;
+    uint64_t total_ns; /* including the frames below */
+    uint64_t child_ns;
+} profile_node_t;
+
+typedef struct {
+    int32_t node;
+    uint64_t start_ns;
+} profile_frame_t;
+
+static TTBC_THREAD_LOCAL profile_node_t *nodes;
+static TTBC_THREAD_LOCAL int32_t n_nodes, nodes_alloc;
+static TTBC_THREAD_LOCAL int32_t *slots; /* node index + 1, 0 = empty */
+static TTBC_THREAD_LOCAL uint32_t n_slots;
+static TTBC_THREAD_LOCAL profile_frame_t stack[PROFILE_MAX_DEPTH];
+static TTBC_THREAD_LOCAL int32_t depth;
+static TTBC_THREAD_LOCAL int32_t depth_skipped; /* frames past PROFILE_MAX_DEPTH */
+static TTBC_THREAD_LOCAL int32_t sample_ticks;
+
+
+static uint64_t
+now_ns(void)
+{
+    struct timespec ts;
+
+    if (timespec_get(&ts, TIME_UTC) == 0)
+        return 0;
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+
+static uint32_t
+slot_of(int32_t parent, int32_t cs)
+{
+    uint32_t h = (uint32_t) cs * 0x9E3779B1u ^ (uint32_t) parent * 0x85EBCA77u;
+    return h & (n_slots - 1);
+}
+
+
+static void
+rehash(uint32_t new_slots)
+{
+    int32_t i;
+    uint32_t s;
+
+    free(slots);
+    n_slots = new_slots;
+    slots = xcalloc(n_slots, sizeof *slots);
+
+    for (i = 0; i < n_nodes; i++) {
+        for (s = slot_of(nodes[i].parent, nodes[i].cs); slots[s] != 0; s = (s + 1) & (n_slots - 1))
+            ;
+        slots[s] = i + 1;
+    }
+}
+
+
+static int32_t
+find_node(int32_t parent, int32_t cs)
+{
+    uint32_t s;
+
+    if ((uint32_t) n_nodes * 2 >= n_slots)
+        rehash(n_slots ? n_slots * 2 : 4096);
+
+    for (s = slot_of(parent, cs); slots[s] != 0; s = (s + 1) & (n_slots - 1)) {
+        profile_node_t *n = &nodes[slots[s] - 1];
+
+        if (n->cs == cs && n->parent == parent)
+            return slots[s] - 1;
+    }
+
+    if (n_nodes == nodes_alloc) {
+        nodes_alloc = nodes_alloc ? nodes_alloc * 2 : 2048;
+        nodes = xrealloc(nodes, nodes_alloc * sizeof *nodes);
+    }
+
+    memset(&nodes[n_nodes], 0, sizeof nodes[n_nodes]);
+    nodes[n_nodes].cs = cs;
+    nodes[n_nodes].parent = parent;
+    slots[s] = n_nodes + 1;
+    return n_nodes++;
+}
+
+
+void
+profile_reset(void)
+{
+    nodes = mfree(nodes);
+    slots = mfree(slots);
+    n_nodes = nodes_alloc = 0;
+    n_slots = 0;
+    depth = depth_skipped = sample_ticks = 0;
+}
+
+
+void
+profile_macro_enter(int32_t cs)
+{
+    int32_t node;
+
+    if (depth == PROFILE_MAX_DEPTH) {
+        depth_skipped++;
+        return;
+    }
+
+    node = find_node(depth > 0 ? stack[depth - 1].node : ROOT_FRAME, cs);
+    nodes[node].calls++;
+    stack[depth].node = node;
+    stack[depth].start_ns = now_ns();
+    depth++;
+}
+
+
+static void
+close_frame(uint64_t end)
+{
+    uint64_t elapsed;
+
+    depth--;
+    elapsed = end - stack[depth].start_ns;
+    nodes[stack[depth].node].total_ns += elapsed;
+    if (depth > 0)
+        nodes[stack[depth - 1].node].child_ns += elapsed;
+}
+
+
+void
+profile_macro_exit(void)
+{
+    if (depth_skipped > 0) {
+        depth_skipped--;
+        return;
+    }
+
+    if (depth > 0)
+        close_frame(now_ns());
+}
+
+
+void
+profile_primitive(int32_t cs)
+{
+    nodes[find_node(PRIMITIVES, cs)].calls++;
+}
+
+
+/* UTF-8 for one character, returned in buf */
+static char *
+utf8_char(uint32_t c, unsigned char *buf)
+{
+    if (c < 0x80) {
+        buf[0] = c;
+        buf[1] = '\0';
+    } else if (c < 0x800) {
+        buf[0] = 0xC0 | (c >> 6);
+        buf[1] = 0x80 | (c & 0x3F);
+        buf[2] = '\0';
+    } else if (c < 0x10000) {
+        buf[0] = 0xE0 | (c >> 12);
+        buf[1] = 0x80 | ((c >> 6) & 0x3F);
+        buf[2] = 0x80 | (c & 0x3F);
+        buf[3] = '\0';
+    } else {
+        buf[0] = 0xF0 | (c >> 18);
+        buf[1] = 0x80 | ((c >> 12) & 0x3F);
+        buf[2] = 0x80 | ((c >> 6) & 0x3F);
+        buf[3] = 0x80 | (c & 0x3F);
+        buf[4] = '\0';
+    }
+    return (char *) buf;
+}
+
+
+/* Called from macro_call while sample_interval > 0: on every
+ * sample_interval-th call, fire TTBC_CHECKPOINT_SAMPLE with "<file>:<line>"
+ * of the innermost file being read, "-" for the terminal. */
+void
+profile_sample(void)
+{
+    char place[512];
+    unsigned char chr[5];
+    size_t j = 0, n;
+    str_number s;
+
+    if (++sample_ticks < sample_interval)
+        return;
+    sample_ticks = 0;
+
+    s = in_open > 0 ? full_source_filename_stack[in_open] : 0;
+    if (s >= 65536L && s < str_ptr) {
+        pool_pointer k = str_start[s - 65536L], end = k + length(s);
+
+        for (; k < end; k++) {
+            const char *c = utf8_char(str_pool[k], chr);
+
+            n = strlen(c);
+            if (j + n >= sizeof place - 16)
+                break;
+            memcpy(place + j, c, n);
+            j += n;
+        }
+    } else {
+        place[j++] = '-';
+    }
+    snprintf(place + j, sizeof place - j, ":%d", line);
+    ttbc_fire_checkpoint(TTBC_CHECKPOINT_SAMPLE, place);
+}
+
+
+/* The name of control sequence p as a newly allocated string, spelled as
+ * print_cs would. ';' separates frames in the folded format, so it is
+ * written as "%3B". */
+static char *
+cs_name(int32_t p)
+{
+    unsigned char chr[5];
+    char *name, *out;
+    const char *body;
+    str_number s = 0;
+    size_t i, j, len;
+    bool esc = true;
+
+    if (p == NULL_CS) {
+        body = "csname\\endcsname";
+    } else if (p >= SINGLE_BASE && p < NULL_CS) {
+        body = utf8_char(p - SINGLE_BASE, chr);
+    } else if (p >= ACTIVE_BASE && p < SINGLE_BASE) {
+        body = utf8_char(p - ACTIVE_BASE, chr);
+        esc = false;
+    } else if (p >= HASH_BASE && p < UNDEFINED_CONTROL_SEQUENCE) {
+        s = (p >= PRIM_EQTB_BASE && p < FROZEN_NULL_FONT) ? prim[p - PRIM_EQTB_BASE].s1 - 1 : hash[p].s1;
+        body = "?";
+    } else if (p > EQTB_SIZE && p <= eqtb_top) {
+        s = hash[p].s1;
+        body = "?";
+    } else {
+        body = "?";
+    }
+
+    name = NULL;
+    if (s >= 65536L && s < str_ptr)
+        body = name = gettexstring(s);
+
+    len = strlen(body);
+    out = xmalloc(len * 3 + 2);
+    j = 0;
+    if (esc)
+        out[j++] = '\\';
+    for (i = 0; i < len; i++) {
+        if (body[i] == ';') {
+            memcpy(out + j, "%3B", 3);
+            j += 3;
+        } else {
+            out[j++] = body[i];
+        }
+    }
+    out[j] = '\0';
+
+    free(name);
+    return out;
+}
+
+
+static int
+by_cs(const void *a, const void *b)
+{
+    const profile_node_t *x = a, *y = b;
+    return (x->cs > y->cs) - (x->cs < y->cs);
+}
+
+
+/* self time for macros, calls for primitives; most first */
+static int
+by_weight(const void *a, const void *b)
+{
+    const profile_node_t *x = a, *y = b;
+    uint64_t wx = x->parent == PRIMITIVES ? x->calls : x->total_ns - x->child_ns;
+    uint64_t wy = y->parent == PRIMITIVES ? y->calls : y->total_ns - y->child_ns;
+    return (wx < wy) - (wx > wy);
+}
+
+
+static void
+write_folded(rust_output_handle_t out, char **names)
+{
+    int32_t i, k, n, path[PROFILE_MAX_DEPTH];
+
+    for (i = 0; i < n_nodes; i++) {
+        uint64_t self_us;
+
+        if (nodes[i].parent == PRIMITIVES)
+            continue;
+
+        self_us = (nodes[i].total_ns - nodes[i].child_ns) / 1000;
+        if (self_us == 0)
+            continue;
+
+        n = 0;
+        for (k = i; k != ROOT_FRAME && n < PROFILE_MAX_DEPTH; k = nodes[k].parent)
+            path[n++] = k;
+
+        while (n-- > 0)
+            ttstub_fprintf(out, "%s%s", names[path[n]], n > 0 ? ";" : "");
+        ttstub_fprintf(out, " %" PRIu64 "\n", self_us);
+    }
+}
+
+
+/* Per control sequence totals of one kind, heaviest first, into flat; returns
+ * how many. */
+static int32_t
+flatten(profile_node_t *flat, bool primitives)
+{
+    int32_t i, n = 0, m = 0;
+
+    for (i = 0; i < n_nodes; i++) {
+        if ((nodes[i].parent == PRIMITIVES) == primitives)
+            flat[n++] = nodes[i];
+    }
+
+    qsort(flat, n, sizeof *flat, by_cs);
+    for (i = 0; i < n; i++) {
+        if (m > 0 && flat[m - 1].cs == flat[i].cs) {
+            flat[m - 1].calls += flat[i].calls;
+            flat[m - 1].total_ns += flat[i].total_ns - flat[i].child_ns;
+        } else {
+            flat[m] = flat[i];
+            flat[m].total_ns -= flat[m].child_ns;
+            flat[m].child_ns = 0;
+            m++;
+        }
+    }
+
+    qsort(flat, m, sizeof *flat, by_weight);
+    return m;
+}
+
+
+/* Write <jobname>.flame and the log summary, then drop the profile. Called
+ * while the log is still open. */
+void
+profile_finish(void)
+{
+    rust_output_handle_t out = INVALID_HANDLE;
+    profile_node_t *flat;
+    char **names, *job, *fname;
+    uint64_t end = now_ns(), macro_calls = 0;
+    int32_t i, n;
+
+    while (depth > 0)
+        close_frame(end);
+
+    if (n_nodes == 0 || job_name == 0) {
+        profile_reset();
+        return;
+    }
+
+    names = xmalloc(n_nodes * sizeof *names);
+    for (i = 0; i < n_nodes; i++) {
+        names[i] = cs_name(nodes[i].cs);
+        if (nodes[i].parent != PRIMITIVES)
+            macro_calls += nodes[i].calls;
+    }
+
+    job = gettexstring(job_name);
+    fname = xmalloc(strlen(job) + 7);
+    strcpy(fname, job);
+    strcat(fname, ".flame");
+    out = ttbc_output_open(fname, 0);
+    if (out != INVALID_HANDLE) {
+        write_folded(out, names);
+        ttbc_output_close(out);
+    }
+
+    if (log_opened) {
+        flat = xmalloc(n_nodes * sizeof *flat);
+
+        ttstub_fprintf(log_file, " expansion profile: %" PRIu64 " macro calls%s%s\n", macro_calls,
+                       out != INVALID_HANDLE ? ", call tree in " : "", out != INVALID_HANDLE ? fname : "");
+
+        n = flatten(flat, false);
+        for (i = 0; i < n && i < PROFILE_TOP_MACROS; i++) {
+            char *name = cs_name(flat[i].cs);
+            ttstub_fprintf(log_file, "  %10.3f ms self %10" PRIu64 " calls  %s\n",
+                           flat[i].total_ns / 1e6, flat[i].calls, name);
+            free(name);
+        }
+
+        n = flatten(flat, true);
+        for (i = 0; i < n && i < PROFILE_TOP_PRIMITIVES; i++) {
+            char *name = cs_name(flat[i].cs);
+            ttstub_fprintf(log_file, "  %10" PRIu64 " expansions of %s\n", flat[i].calls, name);
+            free(name);
+        }
+
+        free(flat);
+    }
+
+    for (i = 0; i < n_nodes; i++)
+        free(names[i]);
+    free(names);
+    free(fname);
+    free(job);
+    profile_reset();
+}
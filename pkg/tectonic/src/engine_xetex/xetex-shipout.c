@@ -12,19 +12,19 @@
 #define HALF_BUF 8192
 #define FNT_NUM_0 171 /* DVI code */
 
-static rust_output_handle_t dvi_file;
-static str_number output_file_name;
-static eight_bits *dvi_buf = NULL;
-static int32_t dvi_limit;
-static int32_t g;
-static int32_t lq, lr;
-static int32_t dvi_ptr;
-static int32_t dvi_offset;
-static int32_t dvi_gone;
-static int32_t down_ptr, right_ptr;
-static scaled_t dvi_h, dvi_v;
-static internal_font_number dvi_f;
-static int32_t cur_s;
+static TTBC_THREAD_LOCAL rust_output_handle_t dvi_file;
+static TTBC_THREAD_LOCAL str_number output_file_name;
+static TTBC_THREAD_LOCAL eight_bits *dvi_buf = NULL;
+static TTBC_THREAD_LOCAL int32_t dvi_limit;
+static TTBC_THREAD_LOCAL int32_t g;
+static TTBC_THREAD_LOCAL int32_t lq, lr;
+static TTBC_THREAD_LOCAL int32_t dvi_ptr;
+static TTBC_THREAD_LOCAL int32_t dvi_offset;
+static TTBC_THREAD_LOCAL int32_t dvi_gone;
+static TTBC_THREAD_LOCAL int32_t down_ptr, right_ptr;
+static TTBC_THREAD_LOCAL scaled_t dvi_h, dvi_v;
+static TTBC_THREAD_LOCAL internal_font_number dvi_f;
+static TTBC_THREAD_LOCAL int32_t cur_s;
 
 
 static void hlist_out(void);
@@ -86,6 +86,10 @@ ship_out(int32_t p)
     unsigned char old_setting;
     unsigned char l;
     const char *output_comment = "tectonic";
+    char page_label[24];
+
+    snprintf(page_label, sizeof page_label, "page %d", total_pages + 1);
+    ttbc_fire_checkpoint(TTBC_CHECKPOINT_SHIPOUT_BEGIN, page_label);
 
     synctex_sheet(INTPAR(mag));
 
@@ -176,9 +180,10 @@ ship_out(int32_t p)
     else
         cur_page_height = BOX_height(p) + BOX_depth(p) + 2 * cur_v_offset;
 
-    /* ... resuming 637 ... open up the DVI file if needed */
+    /* ... resuming 637 ... open up the DVI file if needed. Draft passes
+     * never open it: their bytes are dropped in write_to_dvi(). */
 
-    if (output_file_name == 0) {
+    if (output_file_name == 0 && !draft_pass_enabled) {
         if (job_name == 0)
             open_log_file();
         pack_job_name(output_file_extension);
@@ -288,6 +293,7 @@ done:
     ttbc_output_flush(rust_stdout);
     flush_node_list(p);
     synctex_teehs();
+    ttbc_fire_checkpoint(TTBC_CHECKPOINT_SHIPOUT_END, NULL);
 }
 
 
@@ -295,6 +301,7 @@ done:
 static void
 hlist_out(void)
 {
+    int32_t fresh;
     scaled_t base_line;
     scaled_t left_edge;
     scaled_t save_h, save_v;
@@ -574,7 +581,8 @@ hlist_out(void)
         SYNCTEX_tag(p, MEDIUM_NODE_SIZE) = 0; /* "SyncTeX: do nothing, it is too late" */
         LLIST_link(prev_p) = p;
         cur_h = 0;
-        LLIST_link(p) = reverse(this_box, TEX_NULL, &cur_g, &cur_glue);
+        fresh = reverse(this_box, TEX_NULL, &cur_g, &cur_glue);
+        LLIST_link(p) = fresh;
         BOX_width(p) = -cur_h;
         cur_h = save_h;
         BOX_lr_mode(this_box) = REVERSED;
@@ -988,7 +996,8 @@ hlist_out(void)
                         p = new_edge(cur_dir, rule_wd);
                         LLIST_link(prev_p) = p;
                         cur_h = cur_h - left_edge + rule_wd;
-                        LLIST_link(p) = reverse(this_box, new_edge(1 - cur_dir, 0), &cur_g, &cur_glue);
+                        fresh = reverse(this_box, new_edge(1 - cur_dir, 0), &cur_g, &cur_glue);
+                        LLIST_link(p) = fresh;
                         EDGE_NODE_edge_dist(p) = cur_h;
                         cur_dir = 1 - cur_dir;
                         cur_h = save_h;
@@ -1800,6 +1809,11 @@ dvi_native_font_def(internal_font_number f)
 {
     int32_t font_def_length, i;
 
+    /* make_font_def() has no side effects beyond filling xdv_buffer, so
+     * there's nothing to do when the bytes would be thrown away. */
+    if (draft_pass_enabled)
+        return;
+
     dvi_out(DEFINE_NATIVE_FONT);
     dvi_four(f - 1);
     font_def_length = make_font_def(f);
@@ -2307,6 +2321,17 @@ finalize_dvi_file(void)
         /* This happens when the DVI gets too big; a message has already been printed */
         return;
 
+    if (draft_pass_enabled) {
+        print_nl_cstr("Draft pass: ");
+        print_int(total_pages);
+        if (total_pages != 1)
+            print_cstr(" pages");
+        else
+            print_cstr(" page");
+        print_cstr(", no output written.");
+        return;
+    }
+
     dvi_out(POST);
     dvi_four(last_bop);
     last_bop = dvi_offset + dvi_ptr - 5;
@@ -2386,6 +2411,9 @@ write_to_dvi(int32_t a, int32_t b)
 {
     int32_t n = b - a + 1;
 
+    if (draft_pass_enabled)
+        return;
+
     if (ttbc_output_write (dvi_file, (char *) &dvi_buf[a], n) != n)
         _tt_abort ("failed to write data to XDV file");
 }
@@ -14,6 +14,81 @@ static const char *string_constants[] = {
     NULL
 };
 
+/* An index of the pool's strings by contents, for search_string. Scanning
+ * every string back to the first one made deduplicating file names and the
+ * like linear in the size of the pool.
+ *
+ * Slots hold string numbers, 0 when empty. Strings are added by make_string
+ * and search_string; since the engine also drops strings by lowering
+ * str_ptr and makes some without make_string, an entry is only a hint: a
+ * candidate must still be live and equal. The index is rebuilt from the
+ * live strings when it fills up, and after string_index_reset (a new pool
+ * or format) on the next search. */
+static TTBC_THREAD_LOCAL str_number *str_index = NULL;
+static TTBC_THREAD_LOCAL uint32_t str_index_size = 0;  /* a power of two */
+static TTBC_THREAD_LOCAL uint32_t str_index_used = 0;
+static TTBC_THREAD_LOCAL bool str_index_valid = false;
+
+static uint32_t
+str_hash(str_number s)
+{
+    uint32_t h = 2166136261u;
+    pool_pointer j;
+
+    for (j = str_start[s - 65536L]; j < str_start[s + 1 - 65536L]; j++)
+        h = (h ^ str_pool[j]) * 16777619u;
+    return h;
+}
+
+static void
+str_index_add(str_number s)
+{
+    uint32_t i = str_hash(s) & (str_index_size - 1);
+
+    while (str_index[i] != 0)
+        i = (i + 1) & (str_index_size - 1);
+    str_index[i] = s;
+    str_index_used++;
+}
+
+static void
+str_index_rebuild(void)
+{
+    str_number s;
+    uint32_t live = str_ptr > 65536L ? (uint32_t) (str_ptr - 65536L) : 0;
+
+    str_index_size = 1024;
+    while (str_index_size < live * 2)
+        str_index_size *= 2;
+    free(str_index);
+    str_index = xcalloc(str_index_size, sizeof(str_number));
+    str_index_used = 0;
+    str_index_valid = true;
+
+    for (s = 65536L; s < str_ptr; s++)
+        str_index_add(s);
+}
+
+static void
+str_index_insert(str_number s)
+{
+    if (!str_index_valid)
+        return;
+    if ((str_index_used + 1) * 2 > str_index_size)
+        str_index_rebuild(); /* which adds s, being live */
+    else
+        str_index_add(s);
+}
+
+void
+string_index_reset(void)
+{
+    str_index = mfree(str_index);
+    str_index_size = str_index_used = 0;
+    str_index_valid = false;
+}
+
+
 int
 load_pool_strings(int32_t spare_size)
 {
@@ -62,6 +137,7 @@ make_string(void)
 
     str_ptr++;
     str_start[str_ptr - TOO_BIG_CHAR] = pool_ptr;
+    str_index_insert(str_ptr - 1);
     return str_ptr - 1;
 }
 
@@ -159,31 +235,36 @@ str_eq_str(str_number s, str_number t)
 }
 
 
+/* The most recent string before `search` with the same contents, or 0. */
 str_number
 search_string(str_number search)
 {
-    str_number s;
+    str_number s, found = 0;
     int32_t len;
+    uint32_t i;
+    bool indexed = false;
 
     len = length(search);
 
-    if (len == 0) {
+    if (len == 0)
         return EMPTY_STRING;
-    } else {
-        s = search - 1;
 
-        while (s > 65535L) {
-            if (length(s) == len) {
-                if (str_eq_str(s, search)) {
-                    return s;
-                }
-            }
+    if (!str_index_valid)
+        str_index_rebuild();
 
-            s--;
-        }
+    for (i = str_hash(search) & (str_index_size - 1); (s = str_index[i]) != 0; i = (i + 1) & (str_index_size - 1)) {
+        if (s == search)
+            indexed = true;
+        else if (s > found && s < search && s < str_ptr && length(s) == len && str_eq_str(s, search))
+            found = s;
     }
 
-    return 0;
+    /* the caller keeps `search` when there is no other; it may not have
+     * come from make_string */
+    if (found == 0 && !indexed)
+        str_index_insert(search);
+
+    return found;
 }
 
 
@@ -21,6 +21,7 @@ bool str_eq_buf(str_number s, int32_t k);
 bool str_eq_str(str_number s, str_number t);
 str_number search_string(str_number search);
 str_number slow_make_string(void);
+void string_index_reset(void);
 
 END_EXTERN_C
 
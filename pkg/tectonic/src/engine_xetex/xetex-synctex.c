@@ -81,7 +81,7 @@ typedef void (*synctex_recorder_t) (int32_t);  /* recorders know how to record a
 #   define SYNCTEX_BITS_PER_BYTE 8
 
 /*  Here are all the local variables gathered in one "synchronization context"  */
-static struct {
+static TTBC_THREAD_LOCAL struct {
     rust_output_handle_t file;  /*  the foo.synctex or foo.synctex.gz I/O identifier  */
     char *root_name;            /*  in general jobname.tex  */
     int32_t count;              /*  The number of interesting records in "foo.synctex"  */
@@ -126,6 +126,97 @@ static struct {
     { 0, 0, 0, 0, 0 } /* flags */
 };
 
+/*  Tectonic: records are formatted here rather than with ttstub_fprintf,
+ *  integers by hand into synctex_buf, which is handed to the output (and so
+ *  to its gzip stream) when it fills and before the file is closed. However
+ *  large the document, this costs one buffer.
+ */
+#define SYNCTEX_BUF_SIZE 16384
+static TTBC_THREAD_LOCAL char synctex_buf[SYNCTEX_BUF_SIZE];
+static TTBC_THREAD_LOCAL size_t synctex_buf_len;
+
+static void
+synctex_flush(void)
+{
+    if (synctex_buf_len > 0 && synctex_ctxt.file != INVALID_HANDLE)
+        ttbc_output_write(synctex_ctxt.file, synctex_buf, synctex_buf_len);
+    synctex_buf_len = 0;
+}
+
+/*  The decimal digits of v, with a sign if negative, at p; returns the end.
+ *  At most 11 bytes. */
+static inline char *
+synctex_put_int(char *p, int32_t v)
+{
+    uint32_t u = v < 0 ? -(uint32_t) v : (uint32_t) v;
+    char digits[10];
+    int n = 0;
+
+    if (v < 0)
+        *p++ = '-';
+    do {
+        digits[n++] = '0' + u % 10;
+        u /= 10;
+    } while (u);
+    while (n)
+        *p++ = digits[--n];
+    return p;
+}
+
+static int
+synctex_write(const char *s, size_t n)
+{
+    if (synctex_buf_len + n > SYNCTEX_BUF_SIZE) {
+        synctex_flush();
+        if (n > SYNCTEX_BUF_SIZE) {
+            ttbc_output_write(synctex_ctxt.file, s, n);
+            return (int) n;
+        }
+    }
+    memcpy(synctex_buf + synctex_buf_len, s, n);
+    synctex_buf_len += n;
+    return (int) n;
+}
+
+static inline int
+synctex_write_str(const char *s)
+{
+    return synctex_write(s, strlen(s));
+}
+
+static inline int
+synctex_write_int(int32_t v)
+{
+    char digits[11];
+
+    return synctex_write(digits, synctex_put_int(digits, v) - digits);
+}
+
+/*  One record: the character kind, the n integers of vals with seps[i]
+ *  between vals[i] and vals[i+1], and a newline, just as
+ *  "v%i,%i:%i,%i:%i,%i,%i\n" would print it. Returns its length. */
+static int
+synctex_record(char kind, const char *seps, const int32_t *vals, int n)
+{
+    char *start, *p;
+    int i;
+
+    /* the kind, at most 11 bytes for each integer and 1 for what follows it */
+    if (synctex_buf_len + 1 + 12 * (size_t) n + 1 > SYNCTEX_BUF_SIZE)
+        synctex_flush();
+
+    start = p = synctex_buf + synctex_buf_len;
+    *p++ = kind;
+    for (i = 0; i < n; i++) {
+        if (i > 0)
+            *p++ = seps[i - 1];
+        p = synctex_put_int(p, vals[i]);
+    }
+    *p++ = '\n';
+    synctex_buf_len += p - start;
+    return (int) (p - start);
+}
+
 
 static char *
 get_current_name (void)
@@ -145,6 +236,7 @@ synctex_init_command(void)
 
     /* Reset state */
     synctex_ctxt.file = INVALID_HANDLE;
+    synctex_buf_len = 0;
     synctex_ctxt.root_name = NULL;
     synctex_ctxt.count = 0;
     synctex_ctxt.node = 0;
@@ -180,9 +272,11 @@ static void
 synctexabort(void)
 {
     if (synctex_ctxt.file) {
+        synctex_flush();
         ttbc_output_close(synctex_ctxt.file);
         synctex_ctxt.file = INVALID_HANDLE;
     }
+    synctex_buf_len = 0;
 
     synctex_ctxt.root_name = mfree(synctex_ctxt.root_name);
 
@@ -381,6 +475,7 @@ void synctex_terminate(bool log_opened)
          * (synctex_ctxt.flags.not_void == 0). I assume that this means that there
          * was an error and tectonic will not save anything anyway. */
         synctex_record_postamble();
+        synctex_flush();
         ttbc_output_close(synctex_ctxt.file);
         synctex_ctxt.file = INVALID_HANDLE;
     }
@@ -701,10 +796,11 @@ synctex_current(void)
     if (SYNCTEX_IGNORE(nothing))
         return;
 
-    len = ttstub_fprintf(synctex_ctxt.file, "x%i,%i:%i,%i\n",
-                  synctex_ctxt.tag,synctex_ctxt.line,
-                  SYNCTEX_CURH / synctex_ctxt.unit,
-                  SYNCTEX_CURV / synctex_ctxt.unit);
+    len = synctex_record('x', ",:,", (int32_t[]) {
+            synctex_ctxt.tag,
+            synctex_ctxt.line,
+            SYNCTEX_CURH / synctex_ctxt.unit,
+            SYNCTEX_CURV / synctex_ctxt.unit }, 4);
     synctex_ctxt.lastv = SYNCTEX_CURV;
 
     if (len > 0)
@@ -737,9 +833,11 @@ synctex_record_settings(void)
     if (INVALID_HANDLE == synctex_ctxt.file)
         return 0;
 
-    len = ttstub_fprintf(synctex_ctxt.file, "Output:pdf\nMagnification:%i\nUnit:%i\nX Offset:0\nY Offset:0\n",
-                  synctex_ctxt.magnification,
-                  synctex_ctxt.unit); /* magic pt/in conversion */
+    len = synctex_write_str("Output:pdf\nMagnification:");
+    len += synctex_write_int(synctex_ctxt.magnification);
+    len += synctex_write_str("\nUnit:");
+    len += synctex_write_int(synctex_ctxt.unit); /* magic pt/in conversion */
+    len += synctex_write_str("\nX Offset:0\nY Offset:0\n");
 
     if (len > 0) {
         synctex_ctxt.total_length += len;
@@ -753,7 +851,10 @@ synctex_record_settings(void)
 static inline int
 synctex_record_preamble(void)
 {
-    int len = ttstub_fprintf(synctex_ctxt.file, "SyncTeX Version:%i\n", SYNCTEX_VERSION);
+    int len = synctex_write_str("SyncTeX Version:");
+
+    len += synctex_write_int(SYNCTEX_VERSION);
+    len += synctex_write_str("\n");
 
     if (len > 0) {
         synctex_ctxt.total_length = len; /* XXX: should this be `+=`? */
@@ -767,7 +868,12 @@ synctex_record_preamble(void)
 static inline int
 synctex_record_input(int32_t tag, char *name)
 {
-    int len = ttstub_fprintf(synctex_ctxt.file, "Input:%i:%s\n", tag, name);
+    int len = synctex_write_str("Input:");
+
+    len += synctex_write_int(tag);
+    len += synctex_write_str(":");
+    len += synctex_write_str(name);
+    len += synctex_write_str("\n");
 
     if (len > 0) {
         synctex_ctxt.total_length += len;
@@ -781,7 +887,7 @@ synctex_record_input(int32_t tag, char *name)
 static inline int
 synctex_record_anchor(void)
 {
-    int len = ttstub_fprintf(synctex_ctxt.file, "!%i\n", synctex_ctxt.total_length);
+    int len = synctex_record('!', "", (int32_t[]) { synctex_ctxt.total_length }, 1);
 
     if (len > 0) {
         synctex_ctxt.total_length = len; /* XXX: should this be `+=`? */
@@ -796,7 +902,7 @@ synctex_record_anchor(void)
 static inline int
 synctex_record_content(void)
 {
-    int len = ttstub_fprintf(synctex_ctxt.file, "Content:\n");
+    int len = synctex_write_str("Content:\n");
 
     if (len > 0) {
         synctex_ctxt.total_length += len;
@@ -811,7 +917,7 @@ static inline int
 synctex_record_sheet(int32_t sheet)
 {
     if (0 == synctex_record_anchor()) {
-        int len = ttstub_fprintf(synctex_ctxt.file, "{%i\n", sheet);
+        int len = synctex_record('{', "", (int32_t[]) { sheet }, 1);
         SYNCTEX_RECORD_LEN_AND_RETURN_NOERR;
     }
 
@@ -825,7 +931,7 @@ static inline int
 synctex_record_teehs(int32_t sheet)
 {
     if (0 == synctex_record_anchor()) {
-        int len = ttstub_fprintf(synctex_ctxt.file, "}%i\n", sheet);
+        int len = synctex_record('}', "", (int32_t[]) { sheet }, 1);
         SYNCTEX_RECORD_LEN_AND_RETURN_NOERR;
     }
 
@@ -884,8 +990,7 @@ synctex_record_pdfxform(int32_t form)
         int len;
         /* XXX Tectonic: guessing that SYNCTEX_PDF_CUR_FORM = synctex_ctxt.form_depth here */
         ++synctex_ctxt.form_depth;
-        len = ttstub_fprintf(synctex_ctxt.file, "<%i\n",
-                             synctex_ctxt.form_depth);
+        len = synctex_record('<', "", (int32_t[]) { synctex_ctxt.form_depth }, 1);
         SYNCTEX_RECORD_LEN_AND_RETURN_NOERR;
     }
 
@@ -901,7 +1006,7 @@ synctex_record_mrofxfdp(void)
         int len;
         /* XXX Tectonic: mistake here in original source, no %d in format string */
         --synctex_ctxt.form_depth;
-        len = ttstub_fprintf(synctex_ctxt.file, ">\n");
+        len = synctex_record('>', "", NULL, 0);
         SYNCTEX_RECORD_LEN_AND_RETURN_NOERR;
     }
 
@@ -921,10 +1026,10 @@ synctex_record_node_pdfrefxform(int objnum) /* UNUSED form JL */
         return 0;
     } else {
         int len = 0;
-        len = ttstub_fprintf(synctex_ctxt.file, "f%i:%i,%i\n",
-                             objnum,
-                             SYNCTEX_CURH / synctex_ctxt.unit,
-                             SYNCTEX_CURV / synctex_ctxt.unit);
+        len = synctex_record('f', ":,", (int32_t[]) {
+                objnum,
+                SYNCTEX_CURH / synctex_ctxt.unit,
+                SYNCTEX_CURV / synctex_ctxt.unit }, 3);
         synctex_ctxt.lastv = SYNCTEX_CURV;
         SYNCTEX_RECORD_LEN_AND_RETURN_NOERR;
     }
@@ -936,14 +1041,14 @@ synctex_record_node_pdfrefxform(int objnum) /* UNUSED form JL */
 static inline void
 synctex_record_node_void_vlist(int32_t p)
 {
-    int len = ttstub_fprintf(synctex_ctxt.file, "v%i,%i:%i,%i:%i,%i,%i\n",
-                      SYNCTEX_TAG_MODEL(p,BOX),
-                      SYNCTEX_LINE_MODEL(p,BOX),
-                      synctex_ctxt.curh / synctex_ctxt.unit,
-                      synctex_ctxt.curv / synctex_ctxt.unit,
-                      SYNCTEX_WIDTH(p) / synctex_ctxt.unit,
-                      SYNCTEX_HEIGHT(p) / synctex_ctxt.unit,
-                      SYNCTEX_DEPTH(p) / synctex_ctxt.unit);
+    int len = synctex_record('v', ",:,:,,", (int32_t[]) {
+            SYNCTEX_TAG_MODEL(p,BOX),
+            SYNCTEX_LINE_MODEL(p,BOX),
+            synctex_ctxt.curh / synctex_ctxt.unit,
+            synctex_ctxt.curv / synctex_ctxt.unit,
+            SYNCTEX_WIDTH(p) / synctex_ctxt.unit,
+            SYNCTEX_HEIGHT(p) / synctex_ctxt.unit,
+            SYNCTEX_DEPTH(p) / synctex_ctxt.unit }, 7);
     synctex_ctxt.lastv = SYNCTEX_CURV;
 
     if (len > 0) {
@@ -961,14 +1066,14 @@ synctex_record_node_vlist(int32_t p)
 
     synctex_ctxt.flags.not_void = 1;
 
-    len = ttstub_fprintf(synctex_ctxt.file, "[%i,%i:%i,%i:%i,%i,%i\n",
-                  SYNCTEX_TAG_MODEL(p,BOX),
-                  SYNCTEX_LINE_MODEL(p,BOX),
-                  synctex_ctxt.curh / synctex_ctxt.unit,
-                  synctex_ctxt.curv / synctex_ctxt.unit,
-                  SYNCTEX_WIDTH(p) / synctex_ctxt.unit,
-                  SYNCTEX_HEIGHT(p) / synctex_ctxt.unit,
-                  SYNCTEX_DEPTH(p) / synctex_ctxt.unit);
+    len = synctex_record('[', ",:,:,,", (int32_t[]) {
+            SYNCTEX_TAG_MODEL(p,BOX),
+            SYNCTEX_LINE_MODEL(p,BOX),
+            synctex_ctxt.curh / synctex_ctxt.unit,
+            synctex_ctxt.curv / synctex_ctxt.unit,
+            SYNCTEX_WIDTH(p) / synctex_ctxt.unit,
+            SYNCTEX_HEIGHT(p) / synctex_ctxt.unit,
+            SYNCTEX_DEPTH(p) / synctex_ctxt.unit }, 7);
     synctex_ctxt.lastv = SYNCTEX_CURV;
 
     if (len > 0) {
@@ -982,7 +1087,7 @@ synctex_record_node_vlist(int32_t p)
 static inline void
 synctex_record_node_tsilv(int32_t p __attribute__ ((unused)))
 {
-    int len = ttstub_fprintf(synctex_ctxt.file, "]\n");
+    int len = synctex_record(']', "", NULL, 0);
 
     if (len > 0) {
         synctex_ctxt.total_length += len;
@@ -995,14 +1100,14 @@ synctex_record_node_tsilv(int32_t p __attribute__ ((unused)))
 static inline void
 synctex_record_node_void_hlist(int32_t p)
 {
-    int len = ttstub_fprintf(synctex_ctxt.file, "h%i,%i:%i,%i:%i,%i,%i\n",
-                      SYNCTEX_TAG_MODEL(p,BOX),
-                      SYNCTEX_LINE_MODEL(p,BOX),
-                      synctex_ctxt.curh / synctex_ctxt.unit,
-                      synctex_ctxt.curv / synctex_ctxt.unit,
-                      SYNCTEX_WIDTH(p) / synctex_ctxt.unit,
-                      SYNCTEX_HEIGHT(p) / synctex_ctxt.unit,
-                      SYNCTEX_DEPTH(p) / synctex_ctxt.unit);
+    int len = synctex_record('h', ",:,:,,", (int32_t[]) {
+            SYNCTEX_TAG_MODEL(p,BOX),
+            SYNCTEX_LINE_MODEL(p,BOX),
+            synctex_ctxt.curh / synctex_ctxt.unit,
+            synctex_ctxt.curv / synctex_ctxt.unit,
+            SYNCTEX_WIDTH(p) / synctex_ctxt.unit,
+            SYNCTEX_HEIGHT(p) / synctex_ctxt.unit,
+            SYNCTEX_DEPTH(p) / synctex_ctxt.unit }, 7);
     synctex_ctxt.lastv = SYNCTEX_CURV;
 
     if (len > 0) {
@@ -1020,14 +1125,14 @@ synctex_record_node_hlist(int32_t p)
 
     synctex_ctxt.flags.not_void = 1;
 
-    len = ttstub_fprintf(synctex_ctxt.file, "(%i,%i:%i,%i:%i,%i,%i\n",
-                  SYNCTEX_TAG_MODEL(p,BOX),
-                  SYNCTEX_LINE_MODEL(p,BOX),
-                  synctex_ctxt.curh / synctex_ctxt.unit,
-                  synctex_ctxt.curv / synctex_ctxt.unit,
-                  SYNCTEX_WIDTH(p) / synctex_ctxt.unit,
-                  SYNCTEX_HEIGHT(p) / synctex_ctxt.unit,
-                  SYNCTEX_DEPTH(p) / synctex_ctxt.unit);
+    len = synctex_record('(', ",:,:,,", (int32_t[]) {
+            SYNCTEX_TAG_MODEL(p,BOX),
+            SYNCTEX_LINE_MODEL(p,BOX),
+            synctex_ctxt.curh / synctex_ctxt.unit,
+            synctex_ctxt.curv / synctex_ctxt.unit,
+            SYNCTEX_WIDTH(p) / synctex_ctxt.unit,
+            SYNCTEX_HEIGHT(p) / synctex_ctxt.unit,
+            SYNCTEX_DEPTH(p) / synctex_ctxt.unit }, 7);
     synctex_ctxt.lastv = SYNCTEX_CURV;
 
     if (len > 0) {
@@ -1041,7 +1146,7 @@ synctex_record_node_hlist(int32_t p)
 static inline void
 synctex_record_node_tsilh(int32_t p __attribute__ ((unused)))
 {
-    int len = ttstub_fprintf(synctex_ctxt.file, ")\n");
+    int len = synctex_record(')', "", NULL, 0);
 
     if (len > 0) {
         synctex_ctxt.total_length += len;
@@ -1054,7 +1159,10 @@ synctex_record_node_tsilh(int32_t p __attribute__ ((unused)))
 static inline int
 synctex_record_count(void)
 {
-    int len = ttstub_fprintf(synctex_ctxt.file, "Count:%i\n", synctex_ctxt.count);
+    int len = synctex_write_str("Count:");
+
+    len += synctex_write_int(synctex_ctxt.count);
+    len += synctex_write_str("\n");
 
     if (len > 0) {
         synctex_ctxt.total_length += len;
@@ -1069,11 +1177,11 @@ static inline int
 synctex_record_postamble(void)
 {
     if (0 == synctex_record_anchor()) {
-        int len = ttstub_fprintf(synctex_ctxt.file, "Postamble:\n");
+        int len = synctex_write_str("Postamble:\n");
         if (len > 0) {
             synctex_ctxt.total_length += len;
             if (!synctex_record_count() && !synctex_record_anchor()) {
-                len = ttstub_fprintf(synctex_ctxt.file, "Post scriptum:\n");
+                len = synctex_write_str("Post scriptum:\n");
                 if (len > 0) {
                     synctex_ctxt.total_length += len;
                     return 0;
@@ -1089,11 +1197,11 @@ synctex_record_postamble(void)
 static inline void
 synctex_record_node_glue(int32_t p)
 {
-    int len = ttstub_fprintf(synctex_ctxt.file, "g%i,%i:%i,%i\n",
-                      SYNCTEX_TAG_MODEL(p,GLUE),
-                      SYNCTEX_LINE_MODEL(p,GLUE),
-                      synctex_ctxt.curh / synctex_ctxt.unit,
-                      synctex_ctxt.curv / synctex_ctxt.unit);
+    int len = synctex_record('g', ",:,", (int32_t[]) {
+            SYNCTEX_TAG_MODEL(p,GLUE),
+            SYNCTEX_LINE_MODEL(p,GLUE),
+            synctex_ctxt.curh / synctex_ctxt.unit,
+            synctex_ctxt.curv / synctex_ctxt.unit }, 4);
     synctex_ctxt.lastv = SYNCTEX_CURV;
 
     if (len > 0) {
@@ -1107,12 +1215,12 @@ synctex_record_node_glue(int32_t p)
 static inline void
 synctex_record_node_kern(int32_t p)
 {
-    int len = ttstub_fprintf(synctex_ctxt.file, "k%i,%i:%i,%i:%i\n",
-                      SYNCTEX_TAG_MODEL(p,GLUE),
-                      SYNCTEX_LINE_MODEL(p,GLUE),
-                      synctex_ctxt.curh / synctex_ctxt.unit,
-                      synctex_ctxt.curv / synctex_ctxt.unit,
-                      SYNCTEX_WIDTH(p) / synctex_ctxt.unit);
+    int len = synctex_record('k', ",:,:", (int32_t[]) {
+            SYNCTEX_TAG_MODEL(p,GLUE),
+            SYNCTEX_LINE_MODEL(p,GLUE),
+            synctex_ctxt.curh / synctex_ctxt.unit,
+            synctex_ctxt.curv / synctex_ctxt.unit,
+            SYNCTEX_WIDTH(p) / synctex_ctxt.unit }, 5);
     synctex_ctxt.lastv = SYNCTEX_CURV;
 
     if (len > 0) {
@@ -1126,14 +1234,14 @@ synctex_record_node_kern(int32_t p)
 static inline void
 synctex_record_node_rule(int32_t p)
 {
-    int len = ttstub_fprintf(synctex_ctxt.file, "r%i,%i:%i,%i:%i,%i,%i\n",
-                      SYNCTEX_TAG_MODEL(p,RULE),
-                      SYNCTEX_LINE_MODEL(p,RULE),
-                      synctex_ctxt.curh / synctex_ctxt.unit,
-                      synctex_ctxt.curv / synctex_ctxt.unit,
-                      rule_wd / synctex_ctxt.unit,
-                      rule_ht / synctex_ctxt.unit,
-                      rule_dp / synctex_ctxt.unit);
+    int len = synctex_record('r', ",:,:,,", (int32_t[]) {
+            SYNCTEX_TAG_MODEL(p,RULE),
+            SYNCTEX_LINE_MODEL(p,RULE),
+            synctex_ctxt.curh / synctex_ctxt.unit,
+            synctex_ctxt.curv / synctex_ctxt.unit,
+            rule_wd / synctex_ctxt.unit,
+            rule_ht / synctex_ctxt.unit,
+            rule_dp / synctex_ctxt.unit }, 7);
     synctex_ctxt.lastv = SYNCTEX_CURV;
 
     if (len > 0) {
@@ -1147,11 +1255,11 @@ synctex_record_node_rule(int32_t p)
 static void
 synctex_record_node_math(int32_t p)
 {
-    int len = ttstub_fprintf(synctex_ctxt.file, "$%i,%i:%i,%i\n",
-                      SYNCTEX_TAG_MODEL(p,MATH),
-                      SYNCTEX_LINE_MODEL(p,MATH),
-                      synctex_ctxt.curh / synctex_ctxt.unit,
-                      synctex_ctxt.curv / synctex_ctxt.unit);
+    int len = synctex_record('$', ",:,", (int32_t[]) {
+            SYNCTEX_TAG_MODEL(p,MATH),
+            SYNCTEX_LINE_MODEL(p,MATH),
+            synctex_ctxt.curh / synctex_ctxt.unit,
+            synctex_ctxt.curv / synctex_ctxt.unit }, 4);
     synctex_ctxt.lastv = SYNCTEX_CURV;
 
     if (len > 0) {
@@ -16,8 +16,8 @@
 #define HAVE_GETTIMEOFDAY
 #endif
 
-static char *last_source_name = NULL;
-static int last_lineno;
+static TTBC_THREAD_LOCAL char *last_source_name = NULL;
+static TTBC_THREAD_LOCAL int last_lineno;
 
 #define check_nprintf(size_get, size_want) \
     if ((unsigned)(size_get) >= (unsigned)(size_want)) \
@@ -25,7 +25,7 @@ static int last_lineno;
 
 /* minimum size for time_str is 24: "D:YYYYmmddHHMMSS+HH'MM'" */
 #define TIME_STR_SIZE 30
-static char start_time_str[TIME_STR_SIZE];
+static TTBC_THREAD_LOCAL char start_time_str[TIME_STR_SIZE];
 
 static void
 makepdftime(time_t t, char *time_str, bool utc)
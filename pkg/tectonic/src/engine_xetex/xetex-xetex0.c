@@ -173,7 +173,8 @@ int32_t get_avail(void)
     p = avail;
     if (p != TEX_NULL)
         avail = LLIST_link(avail);
-    else if (mem_end < MEM_TOP) {
+    else if (mem_end < mem_max || grow_main_memory()) {
+        /* growing upward first leaves the gap below hi_mem_min to get_node */
         mem_end++;
         p = mem_end;
     } else {
@@ -182,7 +183,7 @@ int32_t get_avail(void)
         p = hi_mem_min;
         if (is_char_node(lo_mem_max)) {
             runaway();
-            overflow("main memory size", MEM_TOP + 1);
+            overflow("main memory size", mem_max + 1);
         }
     }
     mem[p].b32.s1 = TEX_NULL;
@@ -1486,6 +1487,7 @@ flush_node_list(int32_t p)
 int32_t
 copy_node_list(int32_t p)
 {
+    int32_t fresh;
     int32_t h;
     int32_t q;
     int32_t r;
@@ -1508,7 +1510,8 @@ copy_node_list(int32_t p)
                 SYNCTEX_line(r, BOX_NODE_SIZE) = SYNCTEX_line(p, BOX_NODE_SIZE);
                 mem[r + 6] = mem[p + 6];
                 mem[r + 5] = mem[p + 5];
-                mem[r + 5].b32.s1 = copy_node_list(mem[p + 5].b32.s1);
+                fresh = copy_node_list(mem[p + 5].b32.s1);
+                mem[r + 5].b32.s1 = fresh;
                 words = 5;
                 break;
 
@@ -1521,7 +1524,8 @@ copy_node_list(int32_t p)
                 r = get_node(INS_NODE_SIZE);
                 mem[r + 4] = mem[p + 4];
                 GLUE_SPEC_ref_count(mem[p + 4].b32.s1)++;
-                mem[r + 4].b32.s0 = copy_node_list(mem[p + 4].b32.s0);
+                fresh = copy_node_list(mem[p + 4].b32.s0);
+                mem[r + 4].b32.s0 = fresh;
                 words = (INS_NODE_SIZE - 1);
                 break;
 
@@ -1582,7 +1586,8 @@ copy_node_list(int32_t p)
                 mem[r + 2].b32.s0 = mem[p + 2].b32.s0;
                 mem[r + 2].b32.s1 = mem[p + 2].b32.s1;
                 mem[r + 1].b32.s0 = mem[p + 1].b32.s0;
-                mem[r + 1].b32.s1 = copy_node_list(mem[p + 1].b32.s1);
+                fresh = copy_node_list(mem[p + 1].b32.s1);
+                mem[r + 1].b32.s1 = fresh;
                 break;
 
             case KERN_NODE:
@@ -1600,13 +1605,16 @@ copy_node_list(int32_t p)
             case LIGATURE_NODE:
                 r = get_node(SMALL_NODE_SIZE);
                 mem[r + 1] = mem[p + 1];
-                mem[r + 1].b32.s1 = copy_node_list(mem[p + 1].b32.s1);
+                fresh = copy_node_list(mem[p + 1].b32.s1);
+                mem[r + 1].b32.s1 = fresh;
                 break;
 
             case DISC_NODE:
                 r = get_node(SMALL_NODE_SIZE);
-                mem[r + 1].b32.s0 = copy_node_list(mem[p + 1].b32.s0);
-                mem[r + 1].b32.s1 = copy_node_list(mem[p + 1].b32.s1);
+                fresh = copy_node_list(mem[p + 1].b32.s0);
+                mem[r + 1].b32.s0 = fresh;
+                fresh = copy_node_list(mem[p + 1].b32.s1);
+                mem[r + 1].b32.s1 = fresh;
                 break;
 
             case MARK_NODE:
@@ -1617,7 +1625,8 @@ copy_node_list(int32_t p)
 
             case ADJUST_NODE:
                 r = get_node(SMALL_NODE_SIZE);
-                mem[r + 1].b32.s1 = copy_node_list(mem[p + 1].b32.s1);
+                fresh = copy_node_list(mem[p + 1].b32.s1);
+                mem[r + 1].b32.s1 = fresh;
                 break;
 
             default:
@@ -3694,22 +3703,28 @@ void not_native_font_error(int32_t cmd, int32_t c, int32_t f)
 int32_t
 id_lookup(int32_t j, int32_t l)
 {
+    uint32_t hv;
     int32_t h;
     int32_t d;
     int32_t p;
     int32_t k;
     int32_t ll;
 
-    h = 0;
+    /* FNV-1a over the code points, reduced once by the format's bucket
+     * count. TeX's h = 2h + c (mod prime) spreads the long shared prefixes
+     * of expl3 names (\__kernel_..., \l__pgf_...) poorly and reduces on
+     * every character. */
+    hv = 2166136261U;
 
     for (k = j; k <= j + l - 1; k++) {
-        h = h + h + buffer[k];
-        while (h >= HASH_PRIME)
-            h = h - 8501;
+        hv ^= (uint32_t) buffer[k];
+        hv *= 16777619U;
     }
 
+    h = (int32_t) (hv % (uint32_t) hash_prime);
     p = h + HASH_BASE;
     ll = l;
+    cs_lookups++;
 
     for (d = 0; d <= l - 1; d++) {
         if (buffer[j + d] >= 65536L)
@@ -3717,6 +3732,8 @@ id_lookup(int32_t j, int32_t l)
     }
 
     while (true) {
+        cs_probes++;
+
         if (hash[p].s1 > 0) {
             if (length(hash[p].s1) == ll) {
                 if (str_eq_buf(hash[p].s1, j))
@@ -4938,6 +4955,8 @@ void end_token_list(void)
         else {
 
             delete_token_ref(cur_input.start);
+            if (cur_input.index == MACRO && profile_expansion_enabled)
+                profile_macro_exit();
             if (cur_input.index == MACRO)
                 while (param_ptr > cur_input.limit) {
 
@@ -5969,6 +5988,10 @@ macro_call(void)
 
     begin_token_list(ref_count, MACRO);
     cur_input.name = warning_index;
+    if (profile_expansion_enabled)
+        profile_macro_enter(warning_index);
+    if (sample_interval > 0)
+        profile_sample();
     cur_input.loc = mem[r].b32.s1;
 
     if (n > 0) {
@@ -6183,6 +6206,8 @@ reswitch:
     if (cur_cmd < CALL) { /*384:*/
         if (INTPAR(tracing_commands) > 1)
             show_cur_cmd_chr();
+        if (profile_expansion_enabled)
+            profile_primitive(cur_cs);
 
         switch (cur_cmd) {
         case TOP_BOT_MARK:
@@ -9289,7 +9314,9 @@ int32_t the_toks(void)
 
 void ins_the_toks(void)
 {
-    mem[GARBAGE].b32.s1 = the_toks();
+    int32_t fresh;
+    fresh = the_toks();
+    mem[GARBAGE].b32.s1 = fresh;
     begin_token_list(mem[TEMP_HEAD].b32.s1, INSERTED);
 }
 
@@ -9297,6 +9324,7 @@ void ins_the_toks(void)
 void
 conv_toks(void)
 {
+    int32_t fresh;
     unsigned char old_setting;
     int32_t save_warning_index, save_def_ref;
     bool boolvar;
@@ -9377,7 +9405,8 @@ conv_toks(void)
     case PDF_CREATION_DATE_CODE:
         b = pool_ptr;
         getcreationdate();
-        mem[GARBAGE].b32.s1 = str_toks(b);
+        fresh = str_toks(b);
+        mem[GARBAGE].b32.s1 = fresh;
         begin_token_list(mem[TEMP_HEAD].b32.s1, INSERTED);
         break;
 
@@ -9405,7 +9434,8 @@ conv_toks(void)
         scanner_status = save_scanner_status;
         b = pool_ptr;
         getfilemoddate(s);  /* <= the difference-maker */
-        mem[GARBAGE].b32.s1 = str_toks(b);
+        fresh = str_toks(b);
+        mem[GARBAGE].b32.s1 = fresh;
 
         if (s == str_ptr - 1) {
             str_ptr--;
@@ -9441,7 +9471,8 @@ conv_toks(void)
         scanner_status = save_scanner_status;
         b = pool_ptr;
         getfilesize(s);  /* <= the difference-maker */
-        mem[GARBAGE].b32.s1 = str_toks(b);
+        fresh = str_toks(b);
+        mem[GARBAGE].b32.s1 = fresh;
 
         if (s == str_ptr - 1) {
             str_ptr--;
@@ -9480,7 +9511,8 @@ conv_toks(void)
         scanner_status = save_scanner_status;
         b = pool_ptr;
         getmd5sum(s, boolvar); /* <== the difference-maker */
-        mem[GARBAGE].b32.s1 = str_toks(b);
+        fresh = str_toks(b);
+        mem[GARBAGE].b32.s1 = fresh;
 
         if (s == str_ptr - 1) {
             str_ptr--;
@@ -9554,7 +9586,8 @@ conv_toks(void)
         scanner_status = save_scanner_status;
         b = pool_ptr;
         getfiledump(s, i, j); /* <=== non-boilerplate */
-        mem[GARBAGE].b32.s1 = str_toks(b);
+        fresh = str_toks(b);
+        mem[GARBAGE].b32.s1 = fresh;
 
         if (s == str_ptr - 1) {
             str_ptr--;
@@ -9840,7 +9873,8 @@ conv_toks(void)
     }
 
     selector = old_setting;
-    mem[GARBAGE].b32.s1 = str_toks_cat(b, cat);
+    fresh = str_toks_cat(b, cat);
+    mem[GARBAGE].b32.s1 = fresh;
     begin_token_list(mem[TEMP_HEAD].b32.s1, INSERTED);
 }
 
@@ -10876,6 +10910,7 @@ open_log_file(void)
 
     pack_job_name(".log");
 
+    flush_log_buffer();
     log_file = ttbc_output_open (name_of_file, 0);
     if (log_file == INVALID_HANDLE)
         _tt_abort ("cannot open log file output \"%s\"", name_of_file);
@@ -12941,6 +12976,7 @@ restart:
 void
 init_align(void)
 {
+    int32_t fresh;
     int32_t save_cs_ptr;
     int32_t p;
 
@@ -13006,7 +13042,8 @@ init_align(void)
                     goto done1;
                 }
             } else if (cur_cmd != SPACER || p != HOLD_HEAD) {
-                mem[p].b32.s1 = get_avail();
+                fresh = get_avail();
+                mem[p].b32.s1 = fresh;
                 p = LLIST_link(p);
                 mem[p].b32.s0 = cur_tok;
             }
@@ -13039,13 +13076,15 @@ init_align(void)
                 goto continue_;
             }
 
-            mem[p].b32.s1 = get_avail();
+            fresh = get_avail();
+            mem[p].b32.s1 = fresh;
             p = LLIST_link(p);
             mem[p].b32.s0 = cur_tok;
         }
 
     done2:
-        mem[p].b32.s1 = get_avail();
+        fresh = get_avail();
+        mem[p].b32.s1 = fresh;
         p = LLIST_link(p);
         mem[p].b32.s0 = CS_TOKEN_FLAG + FROZEN_END_TEMPLATE; /*:813*/
         mem[cur_align + 2].b32.s1 = mem[HOLD_HEAD].b32.s1; /*:808 */
@@ -13108,6 +13147,7 @@ void init_col(void)
 
 bool fin_col(void)
 {
+    int32_t fresh;
     int32_t p;
     int32_t q, r;
     int32_t s;
@@ -13135,7 +13175,8 @@ bool fin_col(void)
             r = mem[cur_loop + 3].b32.s1;
             while (r != TEX_NULL) {
 
-                mem[q].b32.s1 = get_avail();
+                fresh = get_avail();
+                mem[q].b32.s1 = fresh;
                 q = LLIST_link(q);
                 mem[q].b32.s0 = mem[r].b32.s0;
                 r = LLIST_link(r);
@@ -13146,7 +13187,8 @@ bool fin_col(void)
             r = mem[cur_loop + 2].b32.s1;
             while (r != TEX_NULL) {
 
-                mem[q].b32.s1 = get_avail();
+                fresh = get_avail();
+                mem[q].b32.s1 = fresh;
                 q = LLIST_link(q);
                 mem[q].b32.s0 = mem[r].b32.s0;
                 r = LLIST_link(r);
@@ -14297,6 +14339,7 @@ void append_kern(void)
 void
 off_save(void)
 {
+    int32_t fresh;
     int32_t p;
 
     if (cur_group == BOTTOM_LEVEL) { /*1101:*/
@@ -14325,7 +14368,8 @@ off_save(void)
             break;
         case MATH_LEFT_GROUP:
             mem[p].b32.s0 = CS_TOKEN_FLAG + FROZEN_RIGHT;
-            mem[p].b32.s1 = get_avail();
+            fresh = get_avail();
+            mem[p].b32.s1 = fresh;
             p = LLIST_link(p);
             mem[p].b32.s0 = OTHER_TOKEN + '.' ;
             print_esc_cstr("right.");
@@ -15018,6 +15062,7 @@ void delete_last(void)
 
 void unpackage(void)
 {
+    int32_t fresh;
     int32_t p;
     int32_t r;
     unsigned char /*copy_code */ c;
@@ -15055,9 +15100,10 @@ void unpackage(void)
         error();
         return;
     }
-    if (c == COPY_CODE)
-        mem[cur_list.tail].b32.s1 = copy_node_list(mem[p + 5].b32.s1);
-    else {
+    if (c == COPY_CODE) {
+        fresh = copy_node_list(mem[p + 5].b32.s1);
+        mem[cur_list.tail].b32.s1 = fresh;
+    } else {
 
         mem[cur_list.tail].b32.s1 = mem[p + 5].b32.s1;
         if (cur_val < 256)
@@ -15125,6 +15171,7 @@ void append_italic_correction(void)
 
 void append_discretionary(void)
 {
+    int32_t fresh;
     int32_t c;
 
     mem[cur_list.tail].b32.s1 = new_disc();
@@ -15134,8 +15181,10 @@ void append_discretionary(void)
         c = hyphen_char[eqtb[CUR_FONT_LOC].b32.s1];
         if (c >= 0) {
 
-            if (c <= BIGGEST_CHAR)
-                mem[cur_list.tail + 1].b32.s0 = new_character(eqtb[CUR_FONT_LOC].b32.s1, c);
+            if (c <= BIGGEST_CHAR) {
+                fresh = new_character(eqtb[CUR_FONT_LOC].b32.s1, c);
+                mem[cur_list.tail + 1].b32.s0 = fresh;
+            }
         }
     } else {
 
@@ -16022,6 +16071,7 @@ void new_font(small_number a)
     internal_font_number f;
     str_number t;
     unsigned char /*max_selector */ old_setting;
+    int mem_tag;
 
     if (job_name == 0)
         open_log_file();
@@ -16134,7 +16184,9 @@ void new_font(small_number a)
             }
             while (f++ < for_end);
     }
+    mem_tag = ttbc_mem_set_tag(TTBC_MEM_FONTS);
     f = read_font_info(u, cur_name, cur_area, s);
+    ttbc_mem_set_tag(mem_tag);
 
 common_ending:
     if ((a >= 4))
@@ -16159,12 +16211,14 @@ void new_interaction(void)
 
 void issue_message(void)
 {
+    int32_t fresh;
     unsigned char /*max_selector */ old_setting;
     unsigned char c;
     str_number s;
 
     c = cur_chr;
-    mem[GARBAGE].b32.s1 = scan_toks(false, true);
+    fresh = scan_toks(false, true);
+    mem[GARBAGE].b32.s1 = fresh;
     old_setting = selector;
     selector = SELECTOR_NEW_STRING ;
     token_show(def_ref);
@@ -16512,15 +16566,21 @@ void do_extension(void)
     case PIC_FILE_CODE:
         if (abs(cur_list.mode) == MMODE)
             report_illegal_case();
-        else
+        else {
+            int mem_tag = ttbc_mem_set_tag(TTBC_MEM_IMAGES);
             load_picture(false);
+            ttbc_mem_set_tag(mem_tag);
+        }
         break;
 
     case PDF_FILE_CODE:
         if (abs(cur_list.mode) == MMODE)
             report_illegal_case();
-        else
+        else {
+            int mem_tag = ttbc_mem_set_tag(TTBC_MEM_IMAGES);
             load_picture(true);
+            ttbc_mem_set_tag(mem_tag);
+        }
         break;
 
     case GLYPH_CODE:
@@ -16625,19 +16685,22 @@ void fix_language(void)
 void
 insert_src_special(void)
 {
+    int32_t fresh;
     int32_t toklist, p, q;
 
     if (source_filename_stack[in_open] > 0 && is_new_source(source_filename_stack[in_open], line)) {
         toklist = get_avail();
         p = toklist;
         mem[p].b32.s0 = CS_TOKEN_FLAG + FROZEN_SPECIAL;
-        mem[p].b32.s1 = get_avail();
+        fresh = get_avail();
+        mem[p].b32.s1 = fresh;
         p = LLIST_link(p);
         mem[p].b32.s0 = (LEFT_BRACE_TOKEN + '{' );
         q = str_toks(make_src_special(source_filename_stack[in_open], line));
         mem[p].b32.s1 = mem[TEMP_HEAD].b32.s1;
         p = q;
-        mem[p].b32.s1 = get_avail();
+        fresh = get_avail();
+        mem[p].b32.s1 = fresh;
         p = LLIST_link(p);
         mem[p].b32.s0 = (RIGHT_BRACE_TOKEN + '}' );
         begin_token_list(toklist, INSERTED);
@@ -16916,6 +16979,7 @@ handle_right_brace(void)
 void
 main_control(void)
 {
+    int32_t fresh;
     int32_t t;
 
     if (LOCAL(every_job) != TEX_NULL)
@@ -17082,7 +17146,8 @@ reswitch:
     case VMODE + HRULE: /* 1112*: cases of main_control that build boxes and lists */
     case HMODE + VRULE:
     case MMODE + VRULE:
-        mem[cur_list.tail].b32.s1 = scan_rule_spec();
+        fresh = scan_rule_spec();
+        mem[cur_list.tail].b32.s1 = fresh;
         cur_list.tail = LLIST_link(cur_list.tail);
 
         if (abs(cur_list.mode) == VMODE)
@@ -17586,6 +17651,64 @@ collect_native:
         if ((main_h == 0) && is_hyph)
             main_h = native_len;
 
+        /* The rest of a run of letters and other characters on the current
+         * line is taken from the buffer here, doing for each what get_next
+         * and the code above would: nothing can be expanded or change the
+         * font between them. Characters outside the BMP and runs that may
+         * insert inter-character tokens go the long way. */
+        if (cur_input.state != TOKEN_LIST && INTPAR(xetex_inter_char_tokens) <= 0
+            && cur_input.loc <= cur_input.limit) {
+            int32_t run_loc = cur_input.loc;
+
+            while (native_text_size <= native_len + cur_input.limit - run_loc + 1) {
+                native_text_size = native_text_size + 128;
+                native_text = xrealloc(native_text, native_text_size * sizeof(UTF16_code));
+            }
+
+            while (run_loc <= cur_input.limit) {
+                UnicodeScalar run_chr = buffer[run_loc];
+                int32_t run_cat;
+
+                /* one UTF-16 unit each: the rest of the line was sized for
+                 * that, and surrogate pairs are built above */
+                if (run_chr >= 0xD800)
+                    break;
+
+                run_cat = CAT_CODE(run_chr);
+                if (run_cat != LETTER && run_cat != OTHER_CHAR)
+                    break;
+
+                main_s = SF_CODE(run_chr) % 65536L;
+
+                if (main_s == 1000) {
+                    cur_list.aux.b32.s0 = 1000;
+                } else if (main_s < 1000) {
+                    if (main_s > 0)
+                        cur_list.aux.b32.s0 = main_s;
+                } else if (cur_list.aux.b32.s0 < 1000) {
+                    cur_list.aux.b32.s0 = 1000;
+                } else {
+                    cur_list.aux.b32.s0 = main_s;
+                }
+
+                native_text[native_len] = run_chr;
+                native_len++;
+
+                is_hyph = (run_chr == hyphen_char[main_f]) || ((INTPAR(xetex_dash_break) > 0)
+                                                               && ((run_chr == 8212) || (run_chr == 8211)));
+
+                if ((main_h == 0) && is_hyph)
+                    main_h = native_len;
+
+                run_loc++;
+            }
+
+            if (run_loc > cur_input.loc) {
+                cur_input.loc = run_loc;
+                cur_input.state = MID_LINE;
+            }
+        }
+
         get_next();
         if (cur_cmd == LETTER || cur_cmd == OTHER_CHAR || cur_cmd == CHAR_GIVEN)
             goto collect_native;
@@ -18431,7 +18554,28 @@ close_files_and_terminate(void)
     synctex_terminate(log_opened);
 
     if (log_opened) {
+        flush_log_buffer();
         ttbc_output_putc (log_file, '\n');
+
+        /* control sequence hash behaviour, for judging hash_prime on real
+         * preambles */
+        if (INTPAR(tracing_stats) > 0 && cs_lookups > 0)
+            ttstub_fprintf(log_file, " %" PRId64 " control sequence lookups, %.2f probes each (%d buckets)\n",
+                           cs_lookups, (double) cs_probes / (double) cs_lookups, hash_prime);
+
+        /* how far main memory reached, for sizing MEM_TOP; none of the
+         * three regions ever shrinks within a run */
+        if (INTPAR(tracing_stats) > 0)
+            ttstub_fprintf(log_file, " main memory reached %d variable-size and %d one-word words (%d allocated)\n",
+                           lo_mem_max + 1, mem_end + 1 - hi_mem_min, mem_max + 1);
+
+        hyph_cache_report();
+
+        if (profile_expansion_enabled)
+            profile_finish();
+        if (command_index_enabled)
+            command_index_finish();
+
         ttbc_output_close (log_file);
         selector = selector - 2;
         if (selector == SELECTOR_TERM_ONLY) {
@@ -382,347 +382,357 @@ void remember_source_info(str_number, int);
 /* variables! */
 
 /* All the following variables are defined in xetexini.c */
-extern bool shell_escape_enabled;
-extern memory_word *eqtb;
-extern int32_t bad;
-extern char *name_of_file;
-extern UTF16_code *name_of_file16;
-extern int32_t name_length;
-extern int32_t name_length16;
-extern UnicodeScalar *buffer;
-extern int32_t first;
-extern int32_t last;
-extern int32_t max_buf_stack;
-extern bool in_initex_mode;
-extern int32_t error_line;
-extern int32_t half_error_line;
-extern int32_t max_print_line;
-extern int32_t max_strings;
-extern int32_t strings_free;
-extern int32_t string_vacancies;
-extern int32_t pool_size;
-extern int32_t pool_free;
-extern int32_t font_mem_size;
-extern int32_t font_max;
-extern int32_t hyph_size;
-extern int32_t trie_size;
-extern int32_t buf_size;
-extern int32_t stack_size;
-extern int32_t max_in_open;
-extern int32_t param_size;
-extern int32_t nest_size;
-extern int32_t save_size;
-extern int32_t expand_depth;
-extern int file_line_error_style_p;
-extern int halt_on_error_p;
-extern bool quoted_filename;
-extern bool insert_src_special_auto;
-extern bool insert_src_special_every_par;
-extern bool insert_src_special_every_math;
-extern bool insert_src_special_every_vbox;
-extern packed_UTF16_code *str_pool;
-extern pool_pointer *str_start;
-extern pool_pointer pool_ptr;
-extern str_number str_ptr;
-extern pool_pointer init_pool_ptr;
-extern str_number init_str_ptr;
-extern rust_output_handle_t rust_stdout;
-extern rust_output_handle_t log_file;
-extern selector_t selector;
-extern unsigned char dig[23];
-extern int32_t tally;
-extern int32_t term_offset;
-extern int32_t file_offset;
-extern UTF16_code trick_buf[256];
-extern int32_t trick_count;
-extern int32_t first_count;
-extern bool doing_special;
-extern UTF16_code *native_text;
-extern int32_t native_text_size;
-extern int32_t native_len;
-extern int32_t save_native_len;
-extern unsigned char interaction;
-extern bool deletions_allowed;
-extern bool set_box_allowed;
-extern tt_history_t history;
-extern signed char error_count;
-extern const char* help_line[6];
-extern unsigned char help_ptr;
-extern bool use_err_help;
-extern bool arith_error;
-extern scaled_t tex_remainder;
-extern int32_t randoms[55];
-extern unsigned char j_random;
-extern scaled_t random_seed;
-extern int32_t two_to_the[31];
-extern int32_t spec_log[29];
-extern int32_t temp_ptr;
-extern memory_word *mem;
-extern int32_t lo_mem_max;
-extern int32_t hi_mem_min;
-extern int32_t var_used, dyn_used;
-extern int32_t avail;
-extern int32_t mem_end;
-extern int32_t rover;
-extern int32_t last_leftmost_char;
-extern int32_t last_rightmost_char;
-extern int32_t hlist_stack[MAX_HLIST_STACK + 1];
-extern short hlist_stack_level;
-extern int32_t first_p;
-extern int32_t global_prev_p;
-extern int32_t font_in_short_display;
-extern int32_t depth_threshold;
-extern int32_t breadth_max;
-extern list_state_record *nest;
-extern int32_t nest_ptr;
-extern int32_t max_nest_stack;
-extern list_state_record cur_list;
-extern short shown_mode;
-extern unsigned char old_setting;
-extern b32x2 *hash;
-extern int32_t hash_used;
-extern int32_t hash_extra;
-extern int32_t hash_top;
-extern int32_t eqtb_top;
-extern int32_t hash_high;
-extern bool no_new_control_sequence;
-extern int32_t cs_count;
-extern b32x2 prim[PRIM_SIZE + 1];
-extern int32_t prim_used;
-extern memory_word *save_stack;
-extern int32_t save_ptr;
-extern int32_t max_save_stack;
-extern uint16_t cur_level;
-extern group_code cur_group;
-extern int32_t cur_boundary;
-extern int32_t mag_set;
-extern eight_bits cur_cmd;
-extern int32_t cur_chr;
-extern int32_t cur_cs;
-extern int32_t cur_tok;
-extern input_state_t *input_stack;
-extern int32_t input_ptr;
-extern int32_t max_in_stack;
-extern input_state_t cur_input;
-extern int32_t in_open;
-extern int32_t open_parens;
-extern UFILE **input_file;
-extern int32_t line;
-extern int32_t *line_stack;
-extern str_number *source_filename_stack;
-extern str_number *full_source_filename_stack;
-extern unsigned char scanner_status;
-extern int32_t warning_index;
-extern int32_t def_ref;
-extern int32_t *param_stack;
-extern int32_t param_ptr;
-extern int32_t max_param_stack;
-extern int32_t align_state;
-extern int32_t base_ptr;
-extern int32_t par_loc;
-extern int32_t par_token;
-extern bool force_eof;
-extern int32_t expand_depth_count;
-extern bool is_in_csname;
-extern int32_t cur_mark[5];
-extern unsigned char long_state;
-extern int32_t pstack[9];
-extern int32_t cur_val;
-extern int32_t cur_val1;
-extern unsigned char cur_val_level;
-extern small_number radix;
-extern glue_ord cur_order;
-extern UFILE *read_file[16];
-extern unsigned char read_open[17];
-extern int32_t cond_ptr;
-extern unsigned char if_limit;
-extern small_number cur_if;
-extern int32_t if_line;
-extern int32_t skip_line;
-extern str_number cur_name;
-extern str_number cur_area;
-extern str_number cur_ext;
-extern pool_pointer area_delimiter;
-extern pool_pointer ext_delimiter;
-extern UTF16_code file_name_quote_char;
-extern int32_t format_default_length;
-extern char *TEX_format_default;
-extern bool name_in_progress;
-extern str_number job_name;
-extern bool log_opened;
-extern const char* output_file_extension;
-extern str_number texmf_log_name;
-extern memory_word *font_info;
-extern font_index fmem_ptr;
-extern internal_font_number font_ptr;
-extern b16x4 *font_check;
-extern scaled_t *font_size;
-extern scaled_t *font_dsize;
-extern font_index *font_params;
-extern str_number *font_name;
-extern str_number *font_area;
-extern UTF16_code *font_bc;
-extern UTF16_code *font_ec;
-extern int32_t *font_glue;
-extern bool *font_used;
-extern int32_t *hyphen_char;
-extern int32_t *skew_char;
-extern font_index *bchar_label;
-extern nine_bits *font_bchar;
-extern nine_bits *font_false_bchar;
-extern void **font_layout_engine;
-extern void **font_mapping;
-extern char *font_flags;
-extern scaled_t *font_letter_space;
-extern void *loaded_font_mapping;
-extern char loaded_font_flags;
-extern scaled_t loaded_font_letter_space;
-extern UTF16_code *mapped_text;
-extern char *xdv_buffer;
-extern int32_t *char_base;
-extern int32_t *width_base;
-extern int32_t *height_base;
-extern int32_t *depth_base;
-extern int32_t *italic_base;
-extern int32_t *lig_kern_base;
-extern int32_t *kern_base;
-extern int32_t *exten_base;
-extern int32_t *param_base;
-extern b16x4 null_character;
-extern int32_t total_pages;
-extern scaled_t max_v;
-extern scaled_t max_h;
-extern int32_t max_push;
-extern int32_t last_bop;
-extern int32_t dead_cycles;
-extern bool doing_leaders;
-extern scaled_t rule_ht, rule_dp, rule_wd;
-extern scaled_t cur_h, cur_v; /* should be internal to shipout, but accessed by synctex */
-extern int32_t epochseconds;
-extern int32_t microseconds;
-extern scaled_t total_stretch[4], total_shrink[4];
-extern int32_t last_badness;
-extern int32_t adjust_tail;
-extern int32_t pre_adjust_tail;
-extern int32_t pack_begin_line;
-extern b32x2 empty;
-extern internal_font_number cur_f;
-extern int32_t cur_c;
-extern b16x4 cur_i;
-extern int32_t cur_align;
-extern int32_t cur_span;
-extern int32_t cur_loop;
-extern int32_t align_ptr;
-extern int32_t cur_head, cur_tail;
-extern int32_t cur_pre_head, cur_pre_tail;
-extern int32_t just_box;
-extern scaled_t active_width[7];
-extern int32_t hc[4099];
-extern internal_font_number hf;
-extern int32_t hu[4097];
-extern unsigned char cur_lang;
-extern int32_t max_hyph_char;
-extern unsigned char hyf[4097];
-extern int32_t init_list;
-extern bool init_lig;
-extern bool init_lft;
-extern small_number hyphen_passed;
-extern int32_t cur_l, cur_r;
-extern int32_t cur_q;
-extern int32_t lig_stack;
-extern bool ligature_present;
-extern bool lft_hit, rt_hit;
-extern trie_pointer *trie_trl;
-extern trie_pointer *trie_tro;
-extern uint16_t *trie_trc;
-extern small_number hyf_distance[TRIE_OP_SIZE + 1];
-extern small_number hyf_num[TRIE_OP_SIZE + 1];
-extern trie_opcode hyf_next[TRIE_OP_SIZE + 1];
-extern int32_t op_start[256];
-extern str_number *hyph_word;
-extern int32_t *hyph_list;
-extern hyph_pointer *hyph_link;
-extern int32_t hyph_count;
-extern int32_t hyph_next;
-extern trie_opcode trie_used[256];
-extern unsigned char trie_op_lang[TRIE_OP_SIZE + 1];
-extern trie_opcode trie_op_val[TRIE_OP_SIZE + 1];
-extern int32_t trie_op_ptr;
-extern trie_opcode max_op_used;
-extern packed_UTF16_code *trie_c;
-extern trie_opcode *trie_o;
-extern trie_pointer *trie_l;
-extern trie_pointer *trie_r;
-extern trie_pointer trie_ptr;
-extern trie_pointer *trie_hash;
-extern bool *trie_taken;
-extern trie_pointer trie_min[65536];
-extern trie_pointer trie_max;
-extern bool trie_not_ready;
-extern scaled_t best_height_plus_depth;
-extern int32_t page_tail;
-extern unsigned char page_contents;
-extern scaled_t page_so_far[8];
-extern int32_t last_glue;
-extern int32_t last_penalty;
-extern scaled_t last_kern;
-extern int32_t last_node_type;
-extern int32_t insert_penalties;
-extern bool output_active;
-extern internal_font_number main_f;
-extern b16x4 main_i;
-extern b16x4 main_j;
-extern font_index main_k;
-extern int32_t main_p;
-extern int32_t main_pp, main_ppp;
-extern int32_t main_h;
-extern bool is_hyph;
-extern int32_t space_class;
-extern int32_t prev_class;
-extern int32_t main_s;
-extern int32_t bchar;
-extern int32_t false_bchar;
-extern bool cancel_boundary;
-extern bool ins_disc;
-extern int32_t cur_box;
-extern int32_t after_token;
-extern bool long_help_seen;
-extern str_number format_ident;
-extern rust_output_handle_t write_file[16];
-extern bool write_open[18];
-extern int32_t write_loc;
-extern scaled_t cur_page_width;
-extern scaled_t cur_page_height;
-extern scaled_t cur_h_offset;
-extern scaled_t cur_v_offset;
-extern int32_t pdf_last_x_pos;
-extern int32_t pdf_last_y_pos;
-extern bool *eof_seen;
-extern int32_t LR_ptr;
-extern int32_t LR_problems;
-extern small_number cur_dir;
-extern int32_t pseudo_files;
-extern save_pointer *grp_stack;
-extern int32_t *if_stack;
-extern int32_t max_reg_num;
-extern const char* max_reg_help_line;
-extern int32_t sa_root[8];
-extern int32_t cur_ptr;
-extern memory_word sa_null;
-extern int32_t sa_chain;
-extern uint16_t sa_level;
-extern trie_pointer hyph_start;
-extern trie_pointer hyph_index;
-extern int32_t disc_ptr[4];
-extern pool_pointer edit_name_start;
-extern bool stop_at_space;
-extern int32_t native_font_type_flag;
-extern bool xtx_ligature_present;
-extern scaled_t delta;
-extern int synctex_enabled;
-extern bool used_tectonic_coda_tokens;
-extern bool semantic_pagination_enabled;
-extern bool gave_char_warning_help;
+extern TTBC_THREAD_LOCAL bool shell_escape_enabled;
+extern TTBC_THREAD_LOCAL memory_word *eqtb;
+extern TTBC_THREAD_LOCAL int32_t bad;
+extern TTBC_THREAD_LOCAL char *name_of_file;
+extern TTBC_THREAD_LOCAL UTF16_code *name_of_file16;
+extern TTBC_THREAD_LOCAL int32_t name_length;
+extern TTBC_THREAD_LOCAL int32_t name_length16;
+extern TTBC_THREAD_LOCAL UnicodeScalar *buffer;
+extern TTBC_THREAD_LOCAL int32_t first;
+extern TTBC_THREAD_LOCAL int32_t last;
+extern TTBC_THREAD_LOCAL int32_t max_buf_stack;
+extern TTBC_THREAD_LOCAL bool in_initex_mode;
+extern TTBC_THREAD_LOCAL bool initex_preload_format;
+extern TTBC_THREAD_LOCAL int32_t error_line;
+extern TTBC_THREAD_LOCAL int32_t half_error_line;
+extern TTBC_THREAD_LOCAL int32_t max_print_line;
+extern TTBC_THREAD_LOCAL int32_t max_strings;
+extern TTBC_THREAD_LOCAL int32_t strings_free;
+extern TTBC_THREAD_LOCAL int32_t string_vacancies;
+extern TTBC_THREAD_LOCAL int32_t pool_size;
+extern TTBC_THREAD_LOCAL int32_t pool_free;
+extern TTBC_THREAD_LOCAL int32_t font_mem_size;
+extern TTBC_THREAD_LOCAL int32_t font_max;
+extern TTBC_THREAD_LOCAL int32_t hyph_size;
+extern TTBC_THREAD_LOCAL int32_t trie_size;
+extern TTBC_THREAD_LOCAL int32_t buf_size;
+extern TTBC_THREAD_LOCAL int32_t stack_size;
+extern TTBC_THREAD_LOCAL int32_t max_in_open;
+extern TTBC_THREAD_LOCAL int32_t param_size;
+extern TTBC_THREAD_LOCAL int32_t nest_size;
+extern TTBC_THREAD_LOCAL int32_t save_size;
+extern TTBC_THREAD_LOCAL int32_t expand_depth;
+extern TTBC_THREAD_LOCAL int file_line_error_style_p;
+extern TTBC_THREAD_LOCAL int halt_on_error_p;
+extern TTBC_THREAD_LOCAL bool quoted_filename;
+extern TTBC_THREAD_LOCAL bool insert_src_special_auto;
+extern TTBC_THREAD_LOCAL bool insert_src_special_every_par;
+extern TTBC_THREAD_LOCAL bool insert_src_special_every_math;
+extern TTBC_THREAD_LOCAL bool insert_src_special_every_vbox;
+extern TTBC_THREAD_LOCAL packed_UTF16_code *str_pool;
+extern TTBC_THREAD_LOCAL pool_pointer *str_start;
+extern TTBC_THREAD_LOCAL pool_pointer pool_ptr;
+extern TTBC_THREAD_LOCAL str_number str_ptr;
+extern TTBC_THREAD_LOCAL pool_pointer init_pool_ptr;
+extern TTBC_THREAD_LOCAL str_number init_str_ptr;
+extern TTBC_THREAD_LOCAL rust_output_handle_t rust_stdout;
+extern TTBC_THREAD_LOCAL rust_output_handle_t log_file;
+extern TTBC_THREAD_LOCAL selector_t selector;
+extern TTBC_THREAD_LOCAL unsigned char dig[23];
+extern TTBC_THREAD_LOCAL int32_t tally;
+extern TTBC_THREAD_LOCAL int32_t term_offset;
+extern TTBC_THREAD_LOCAL int32_t file_offset;
+extern TTBC_THREAD_LOCAL UTF16_code trick_buf[256];
+extern TTBC_THREAD_LOCAL int32_t trick_count;
+extern TTBC_THREAD_LOCAL int32_t first_count;
+extern TTBC_THREAD_LOCAL bool doing_special;
+extern TTBC_THREAD_LOCAL UTF16_code *native_text;
+extern TTBC_THREAD_LOCAL int32_t native_text_size;
+extern TTBC_THREAD_LOCAL int32_t native_len;
+extern TTBC_THREAD_LOCAL int32_t save_native_len;
+extern TTBC_THREAD_LOCAL unsigned char interaction;
+extern TTBC_THREAD_LOCAL bool deletions_allowed;
+extern TTBC_THREAD_LOCAL bool set_box_allowed;
+extern TTBC_THREAD_LOCAL tt_history_t history;
+extern TTBC_THREAD_LOCAL signed char error_count;
+extern TTBC_THREAD_LOCAL const char* help_line[6];
+extern TTBC_THREAD_LOCAL unsigned char help_ptr;
+extern TTBC_THREAD_LOCAL bool use_err_help;
+extern TTBC_THREAD_LOCAL bool arith_error;
+extern TTBC_THREAD_LOCAL scaled_t tex_remainder;
+extern TTBC_THREAD_LOCAL int32_t randoms[55];
+extern TTBC_THREAD_LOCAL unsigned char j_random;
+extern TTBC_THREAD_LOCAL scaled_t random_seed;
+extern TTBC_THREAD_LOCAL int32_t two_to_the[31];
+extern TTBC_THREAD_LOCAL int32_t spec_log[29];
+extern TTBC_THREAD_LOCAL int32_t temp_ptr;
+extern TTBC_THREAD_LOCAL memory_word *mem;
+extern TTBC_THREAD_LOCAL int32_t lo_mem_max;
+extern TTBC_THREAD_LOCAL int32_t hi_mem_min;
+extern TTBC_THREAD_LOCAL int32_t var_used, dyn_used;
+extern TTBC_THREAD_LOCAL int32_t avail;
+extern TTBC_THREAD_LOCAL int32_t mem_end;
+extern TTBC_THREAD_LOCAL int32_t mem_max;
+extern TTBC_THREAD_LOCAL int32_t rover;
+extern TTBC_THREAD_LOCAL int32_t last_leftmost_char;
+extern TTBC_THREAD_LOCAL int32_t last_rightmost_char;
+extern TTBC_THREAD_LOCAL int32_t hlist_stack[MAX_HLIST_STACK + 1];
+extern TTBC_THREAD_LOCAL short hlist_stack_level;
+extern TTBC_THREAD_LOCAL int32_t first_p;
+extern TTBC_THREAD_LOCAL int32_t global_prev_p;
+extern TTBC_THREAD_LOCAL int32_t font_in_short_display;
+extern TTBC_THREAD_LOCAL int32_t depth_threshold;
+extern TTBC_THREAD_LOCAL int32_t breadth_max;
+extern TTBC_THREAD_LOCAL list_state_record *nest;
+extern TTBC_THREAD_LOCAL int32_t nest_ptr;
+extern TTBC_THREAD_LOCAL int32_t max_nest_stack;
+extern TTBC_THREAD_LOCAL list_state_record cur_list;
+extern TTBC_THREAD_LOCAL short shown_mode;
+extern TTBC_THREAD_LOCAL unsigned char old_setting;
+extern TTBC_THREAD_LOCAL b32x2 *hash;
+extern TTBC_THREAD_LOCAL int32_t hash_used;
+extern TTBC_THREAD_LOCAL int32_t hash_extra;
+extern TTBC_THREAD_LOCAL int32_t hash_top;
+extern TTBC_THREAD_LOCAL int32_t eqtb_top;
+extern TTBC_THREAD_LOCAL int32_t hash_high;
+extern TTBC_THREAD_LOCAL int32_t hash_prime;
+extern TTBC_THREAD_LOCAL int64_t cs_lookups;
+extern TTBC_THREAD_LOCAL int64_t cs_probes;
+extern TTBC_THREAD_LOCAL bool no_new_control_sequence;
+extern TTBC_THREAD_LOCAL int32_t cs_count;
+extern TTBC_THREAD_LOCAL b32x2 prim[PRIM_SIZE + 1];
+extern TTBC_THREAD_LOCAL int32_t prim_used;
+extern TTBC_THREAD_LOCAL memory_word *save_stack;
+extern TTBC_THREAD_LOCAL int32_t save_ptr;
+extern TTBC_THREAD_LOCAL int32_t max_save_stack;
+extern TTBC_THREAD_LOCAL uint16_t cur_level;
+extern TTBC_THREAD_LOCAL group_code cur_group;
+extern TTBC_THREAD_LOCAL int32_t cur_boundary;
+extern TTBC_THREAD_LOCAL int32_t mag_set;
+extern TTBC_THREAD_LOCAL eight_bits cur_cmd;
+extern TTBC_THREAD_LOCAL int32_t cur_chr;
+extern TTBC_THREAD_LOCAL int32_t cur_cs;
+extern TTBC_THREAD_LOCAL int32_t cur_tok;
+extern TTBC_THREAD_LOCAL input_state_t *input_stack;
+extern TTBC_THREAD_LOCAL int32_t input_ptr;
+extern TTBC_THREAD_LOCAL int32_t max_in_stack;
+extern TTBC_THREAD_LOCAL input_state_t cur_input;
+extern TTBC_THREAD_LOCAL int32_t in_open;
+extern TTBC_THREAD_LOCAL int32_t open_parens;
+extern TTBC_THREAD_LOCAL UFILE **input_file;
+extern TTBC_THREAD_LOCAL int32_t line;
+extern TTBC_THREAD_LOCAL int32_t *line_stack;
+extern TTBC_THREAD_LOCAL str_number *source_filename_stack;
+extern TTBC_THREAD_LOCAL str_number *full_source_filename_stack;
+extern TTBC_THREAD_LOCAL unsigned char scanner_status;
+extern TTBC_THREAD_LOCAL int32_t warning_index;
+extern TTBC_THREAD_LOCAL int32_t def_ref;
+extern TTBC_THREAD_LOCAL int32_t *param_stack;
+extern TTBC_THREAD_LOCAL int32_t param_ptr;
+extern TTBC_THREAD_LOCAL int32_t max_param_stack;
+extern TTBC_THREAD_LOCAL int32_t align_state;
+extern TTBC_THREAD_LOCAL int32_t base_ptr;
+extern TTBC_THREAD_LOCAL int32_t par_loc;
+extern TTBC_THREAD_LOCAL int32_t par_token;
+extern TTBC_THREAD_LOCAL bool force_eof;
+extern TTBC_THREAD_LOCAL int32_t expand_depth_count;
+extern TTBC_THREAD_LOCAL bool is_in_csname;
+extern TTBC_THREAD_LOCAL int32_t cur_mark[5];
+extern TTBC_THREAD_LOCAL unsigned char long_state;
+extern TTBC_THREAD_LOCAL int32_t pstack[9];
+extern TTBC_THREAD_LOCAL int32_t cur_val;
+extern TTBC_THREAD_LOCAL int32_t cur_val1;
+extern TTBC_THREAD_LOCAL unsigned char cur_val_level;
+extern TTBC_THREAD_LOCAL small_number radix;
+extern TTBC_THREAD_LOCAL glue_ord cur_order;
+extern TTBC_THREAD_LOCAL UFILE *read_file[16];
+extern TTBC_THREAD_LOCAL unsigned char read_open[17];
+extern TTBC_THREAD_LOCAL int32_t cond_ptr;
+extern TTBC_THREAD_LOCAL unsigned char if_limit;
+extern TTBC_THREAD_LOCAL small_number cur_if;
+extern TTBC_THREAD_LOCAL int32_t if_line;
+extern TTBC_THREAD_LOCAL int32_t skip_line;
+extern TTBC_THREAD_LOCAL str_number cur_name;
+extern TTBC_THREAD_LOCAL str_number cur_area;
+extern TTBC_THREAD_LOCAL str_number cur_ext;
+extern TTBC_THREAD_LOCAL pool_pointer area_delimiter;
+extern TTBC_THREAD_LOCAL pool_pointer ext_delimiter;
+extern TTBC_THREAD_LOCAL UTF16_code file_name_quote_char;
+extern TTBC_THREAD_LOCAL int32_t format_default_length;
+extern TTBC_THREAD_LOCAL char *TEX_format_default;
+extern TTBC_THREAD_LOCAL bool name_in_progress;
+extern TTBC_THREAD_LOCAL str_number job_name;
+extern TTBC_THREAD_LOCAL bool log_opened;
+extern TTBC_THREAD_LOCAL const char* output_file_extension;
+extern TTBC_THREAD_LOCAL str_number texmf_log_name;
+extern TTBC_THREAD_LOCAL memory_word *font_info;
+extern TTBC_THREAD_LOCAL font_index fmem_ptr;
+extern TTBC_THREAD_LOCAL internal_font_number font_ptr;
+extern TTBC_THREAD_LOCAL b16x4 *font_check;
+extern TTBC_THREAD_LOCAL scaled_t *font_size;
+extern TTBC_THREAD_LOCAL scaled_t *font_dsize;
+extern TTBC_THREAD_LOCAL font_index *font_params;
+extern TTBC_THREAD_LOCAL str_number *font_name;
+extern TTBC_THREAD_LOCAL str_number *font_area;
+extern TTBC_THREAD_LOCAL UTF16_code *font_bc;
+extern TTBC_THREAD_LOCAL UTF16_code *font_ec;
+extern TTBC_THREAD_LOCAL int32_t *font_glue;
+extern TTBC_THREAD_LOCAL bool *font_used;
+extern TTBC_THREAD_LOCAL int32_t *hyphen_char;
+extern TTBC_THREAD_LOCAL int32_t *skew_char;
+extern TTBC_THREAD_LOCAL font_index *bchar_label;
+extern TTBC_THREAD_LOCAL nine_bits *font_bchar;
+extern TTBC_THREAD_LOCAL nine_bits *font_false_bchar;
+extern TTBC_THREAD_LOCAL void **font_layout_engine;
+extern TTBC_THREAD_LOCAL void **font_mapping;
+extern TTBC_THREAD_LOCAL char *font_flags;
+extern TTBC_THREAD_LOCAL scaled_t *font_letter_space;
+extern TTBC_THREAD_LOCAL void *loaded_font_mapping;
+extern TTBC_THREAD_LOCAL char loaded_font_flags;
+extern TTBC_THREAD_LOCAL scaled_t loaded_font_letter_space;
+extern TTBC_THREAD_LOCAL UTF16_code *mapped_text;
+extern TTBC_THREAD_LOCAL char *xdv_buffer;
+extern TTBC_THREAD_LOCAL int32_t *char_base;
+extern TTBC_THREAD_LOCAL int32_t *width_base;
+extern TTBC_THREAD_LOCAL int32_t *height_base;
+extern TTBC_THREAD_LOCAL int32_t *depth_base;
+extern TTBC_THREAD_LOCAL int32_t *italic_base;
+extern TTBC_THREAD_LOCAL int32_t *lig_kern_base;
+extern TTBC_THREAD_LOCAL int32_t *kern_base;
+extern TTBC_THREAD_LOCAL int32_t *exten_base;
+extern TTBC_THREAD_LOCAL int32_t *param_base;
+extern TTBC_THREAD_LOCAL b16x4 null_character;
+extern TTBC_THREAD_LOCAL int32_t total_pages;
+extern TTBC_THREAD_LOCAL scaled_t max_v;
+extern TTBC_THREAD_LOCAL scaled_t max_h;
+extern TTBC_THREAD_LOCAL int32_t max_push;
+extern TTBC_THREAD_LOCAL int32_t last_bop;
+extern TTBC_THREAD_LOCAL int32_t dead_cycles;
+extern TTBC_THREAD_LOCAL bool doing_leaders;
+extern TTBC_THREAD_LOCAL scaled_t rule_ht, rule_dp, rule_wd;
+extern TTBC_THREAD_LOCAL scaled_t cur_h, cur_v; /* should be internal to shipout, but accessed by synctex */
+extern TTBC_THREAD_LOCAL int32_t epochseconds;
+extern TTBC_THREAD_LOCAL int32_t microseconds;
+extern TTBC_THREAD_LOCAL scaled_t total_stretch[4], total_shrink[4];
+extern TTBC_THREAD_LOCAL int32_t last_badness;
+extern TTBC_THREAD_LOCAL int32_t adjust_tail;
+extern TTBC_THREAD_LOCAL int32_t pre_adjust_tail;
+extern TTBC_THREAD_LOCAL int32_t pack_begin_line;
+extern TTBC_THREAD_LOCAL b32x2 empty;
+extern TTBC_THREAD_LOCAL internal_font_number cur_f;
+extern TTBC_THREAD_LOCAL int32_t cur_c;
+extern TTBC_THREAD_LOCAL b16x4 cur_i;
+extern TTBC_THREAD_LOCAL int32_t cur_align;
+extern TTBC_THREAD_LOCAL int32_t cur_span;
+extern TTBC_THREAD_LOCAL int32_t cur_loop;
+extern TTBC_THREAD_LOCAL int32_t align_ptr;
+extern TTBC_THREAD_LOCAL int32_t cur_head, cur_tail;
+extern TTBC_THREAD_LOCAL int32_t cur_pre_head, cur_pre_tail;
+extern TTBC_THREAD_LOCAL int32_t just_box;
+extern TTBC_THREAD_LOCAL scaled_t active_width[7];
+extern TTBC_THREAD_LOCAL int32_t hc[4099];
+extern TTBC_THREAD_LOCAL internal_font_number hf;
+extern TTBC_THREAD_LOCAL int32_t hu[4097];
+extern TTBC_THREAD_LOCAL unsigned char cur_lang;
+extern TTBC_THREAD_LOCAL int32_t max_hyph_char;
+extern TTBC_THREAD_LOCAL unsigned char hyf[4097];
+extern TTBC_THREAD_LOCAL int32_t init_list;
+extern TTBC_THREAD_LOCAL bool init_lig;
+extern TTBC_THREAD_LOCAL bool init_lft;
+extern TTBC_THREAD_LOCAL small_number hyphen_passed;
+extern TTBC_THREAD_LOCAL int32_t cur_l, cur_r;
+extern TTBC_THREAD_LOCAL int32_t cur_q;
+extern TTBC_THREAD_LOCAL int32_t lig_stack;
+extern TTBC_THREAD_LOCAL bool ligature_present;
+extern TTBC_THREAD_LOCAL bool lft_hit, rt_hit;
+extern TTBC_THREAD_LOCAL trie_pointer *trie_trl;
+extern TTBC_THREAD_LOCAL trie_pointer *trie_tro;
+extern TTBC_THREAD_LOCAL uint16_t *trie_trc;
+extern TTBC_THREAD_LOCAL small_number hyf_distance[TRIE_OP_SIZE + 1];
+extern TTBC_THREAD_LOCAL small_number hyf_num[TRIE_OP_SIZE + 1];
+extern TTBC_THREAD_LOCAL trie_opcode hyf_next[TRIE_OP_SIZE + 1];
+extern TTBC_THREAD_LOCAL int32_t op_start[256];
+extern TTBC_THREAD_LOCAL str_number *hyph_word;
+extern TTBC_THREAD_LOCAL int32_t *hyph_list;
+extern TTBC_THREAD_LOCAL hyph_pointer *hyph_link;
+extern TTBC_THREAD_LOCAL int32_t hyph_count;
+extern TTBC_THREAD_LOCAL int32_t hyph_next;
+extern TTBC_THREAD_LOCAL trie_opcode trie_used[256];
+extern TTBC_THREAD_LOCAL unsigned char trie_op_lang[TRIE_OP_SIZE + 1];
+extern TTBC_THREAD_LOCAL trie_opcode trie_op_val[TRIE_OP_SIZE + 1];
+extern TTBC_THREAD_LOCAL int32_t trie_op_ptr;
+extern TTBC_THREAD_LOCAL trie_opcode max_op_used;
+extern TTBC_THREAD_LOCAL packed_UTF16_code *trie_c;
+extern TTBC_THREAD_LOCAL trie_opcode *trie_o;
+extern TTBC_THREAD_LOCAL trie_pointer *trie_l;
+extern TTBC_THREAD_LOCAL trie_pointer *trie_r;
+extern TTBC_THREAD_LOCAL trie_pointer trie_ptr;
+extern TTBC_THREAD_LOCAL trie_pointer *trie_hash;
+extern TTBC_THREAD_LOCAL bool *trie_taken;
+extern TTBC_THREAD_LOCAL trie_pointer trie_min[65536];
+extern TTBC_THREAD_LOCAL trie_pointer trie_max;
+extern TTBC_THREAD_LOCAL bool trie_not_ready;
+extern TTBC_THREAD_LOCAL scaled_t best_height_plus_depth;
+extern TTBC_THREAD_LOCAL int32_t page_tail;
+extern TTBC_THREAD_LOCAL unsigned char page_contents;
+extern TTBC_THREAD_LOCAL scaled_t page_so_far[8];
+extern TTBC_THREAD_LOCAL int32_t last_glue;
+extern TTBC_THREAD_LOCAL int32_t last_penalty;
+extern TTBC_THREAD_LOCAL scaled_t last_kern;
+extern TTBC_THREAD_LOCAL int32_t last_node_type;
+extern TTBC_THREAD_LOCAL int32_t insert_penalties;
+extern TTBC_THREAD_LOCAL bool output_active;
+extern TTBC_THREAD_LOCAL internal_font_number main_f;
+extern TTBC_THREAD_LOCAL b16x4 main_i;
+extern TTBC_THREAD_LOCAL b16x4 main_j;
+extern TTBC_THREAD_LOCAL font_index main_k;
+extern TTBC_THREAD_LOCAL int32_t main_p;
+extern TTBC_THREAD_LOCAL int32_t main_pp, main_ppp;
+extern TTBC_THREAD_LOCAL int32_t main_h;
+extern TTBC_THREAD_LOCAL bool is_hyph;
+extern TTBC_THREAD_LOCAL int32_t space_class;
+extern TTBC_THREAD_LOCAL int32_t prev_class;
+extern TTBC_THREAD_LOCAL int32_t main_s;
+extern TTBC_THREAD_LOCAL int32_t bchar;
+extern TTBC_THREAD_LOCAL int32_t false_bchar;
+extern TTBC_THREAD_LOCAL bool cancel_boundary;
+extern TTBC_THREAD_LOCAL bool ins_disc;
+extern TTBC_THREAD_LOCAL int32_t cur_box;
+extern TTBC_THREAD_LOCAL int32_t after_token;
+extern TTBC_THREAD_LOCAL bool long_help_seen;
+extern TTBC_THREAD_LOCAL str_number format_ident;
+extern TTBC_THREAD_LOCAL rust_output_handle_t write_file[16];
+extern TTBC_THREAD_LOCAL bool write_open[18];
+extern TTBC_THREAD_LOCAL int32_t write_loc;
+extern TTBC_THREAD_LOCAL scaled_t cur_page_width;
+extern TTBC_THREAD_LOCAL scaled_t cur_page_height;
+extern TTBC_THREAD_LOCAL scaled_t cur_h_offset;
+extern TTBC_THREAD_LOCAL scaled_t cur_v_offset;
+extern TTBC_THREAD_LOCAL int32_t pdf_last_x_pos;
+extern TTBC_THREAD_LOCAL int32_t pdf_last_y_pos;
+extern TTBC_THREAD_LOCAL bool *eof_seen;
+extern TTBC_THREAD_LOCAL int32_t LR_ptr;
+extern TTBC_THREAD_LOCAL int32_t LR_problems;
+extern TTBC_THREAD_LOCAL small_number cur_dir;
+extern TTBC_THREAD_LOCAL int32_t pseudo_files;
+extern TTBC_THREAD_LOCAL save_pointer *grp_stack;
+extern TTBC_THREAD_LOCAL int32_t *if_stack;
+extern TTBC_THREAD_LOCAL int32_t max_reg_num;
+extern TTBC_THREAD_LOCAL const char* max_reg_help_line;
+extern TTBC_THREAD_LOCAL int32_t sa_root[8];
+extern TTBC_THREAD_LOCAL int32_t cur_ptr;
+extern TTBC_THREAD_LOCAL memory_word sa_null;
+extern TTBC_THREAD_LOCAL int32_t sa_chain;
+extern TTBC_THREAD_LOCAL uint16_t sa_level;
+extern TTBC_THREAD_LOCAL trie_pointer hyph_start;
+extern TTBC_THREAD_LOCAL trie_pointer hyph_index;
+extern TTBC_THREAD_LOCAL int32_t disc_ptr[4];
+extern TTBC_THREAD_LOCAL pool_pointer edit_name_start;
+extern TTBC_THREAD_LOCAL bool stop_at_space;
+extern TTBC_THREAD_LOCAL int32_t native_font_type_flag;
+extern TTBC_THREAD_LOCAL bool xtx_ligature_present;
+extern TTBC_THREAD_LOCAL scaled_t delta;
+extern TTBC_THREAD_LOCAL int synctex_enabled;
+extern TTBC_THREAD_LOCAL bool used_tectonic_coda_tokens;
+extern TTBC_THREAD_LOCAL bool semantic_pagination_enabled;
+extern TTBC_THREAD_LOCAL bool draft_pass_enabled;
+extern TTBC_THREAD_LOCAL bool profile_expansion_enabled;
+extern TTBC_THREAD_LOCAL int32_t sample_interval;
+extern TTBC_THREAD_LOCAL bool command_index_enabled;
+extern TTBC_THREAD_LOCAL bool linebreak_memo_enabled;
+extern TTBC_THREAD_LOCAL bool gave_char_warning_help;
 
 /*:1683*/
 
@@ -730,7 +740,7 @@ extern bool gave_char_warning_help;
  * with negative indices. The underlying arrays used to be named "zzzaa" and
  * "zzzbb". */
 
-extern uint16_t _xeq_level_array[EQTB_SIZE - INT_BASE + 1];
+extern TTBC_THREAD_LOCAL uint16_t _xeq_level_array[EQTB_SIZE - INT_BASE + 1];
 #define XEQ_LEVEL(i) _xeq_level_array[(i) - INT_BASE]
 
 /* the former xetexcoerce.h: */
@@ -739,6 +749,7 @@ int32_t badness(scaled_t t, scaled_t s);
 void print_word(memory_word w);
 void show_token_list(int32_t p, int32_t q, int32_t l);
 void runaway(void);
+bool grow_main_memory(void);
 int32_t get_avail(void);
 void flush_list(int32_t p);
 int32_t get_node(int32_t s);
@@ -946,6 +957,9 @@ void trie_pack(trie_pointer p);
 void trie_fix(trie_pointer p);
 void init_trie(void);
 void line_break(bool d);
+void linebreak_memo_reset(void);
+void hyph_cache_begin_run(void);
+void hyph_cache_report(void);
 bool eTeX_enabled(bool b, uint16_t j, int32_t k);
 void show_save_groups(void);
 int32_t prune_page_top(int32_t p, bool s);
@@ -1028,6 +1042,10 @@ str_number tokens_to_string(int32_t p);
 void scan_pdf_ext_toks(void);
 void compare_strings(void);
 
+/* xetex-cmdindex */
+
+void command_index_finish(void);
+
 /* xetex-errors */
 
 void error(void);
@@ -1095,6 +1113,7 @@ void capture_to_diagnostic(ttbc_diagnostic_t *diagnostic);
 // complete.
 ttbc_diagnostic_t *error_here_with_diagnostic(const char* message);
 
+void flush_log_buffer(void);
 void print_ln(void);
 void print_raw_char(UTF16_code s, bool incr_offset);
 void print_char(int32_t s);
@@ -1125,6 +1144,15 @@ void print_ucs_code(UnicodeScalar n);
 void initialize_pagebuilder_variables(void);
 void build_page(void);
 
+/* xetex-profile */
+
+void profile_reset(void);
+void profile_macro_enter(int32_t cs);
+void profile_macro_exit(void);
+void profile_primitive(int32_t cs);
+void profile_finish(void);
+void profile_sample(void);
+
 /* xetex-scaledmath */
 
 int32_t tex_round(double);
@@ -350,7 +350,7 @@ agl_normalized_name (char *glyphname)
   return agln;
 }
 
-static struct ht_table aglmap;
+static TTBC_THREAD_LOCAL struct ht_table aglmap;
 
 static inline void
 hval_free (void *hval)
@@ -283,6 +283,61 @@ cff_put_header (cff_font *cff, card8 *dest, int destlen)
 }
 
 /* Only read header part but not body */
+/*
+ * INDEX headers of large CID-keyed fonts hold tens of thousands of offsets.
+ * The input layer keeps a font wholly in memory once it has been seeked in,
+ * so parse them from there rather than a byte at a time through the handle.
+ * Returns 0, with the handle untouched, when no such view is available or
+ * the INDEX runs past it; the callers then read it the old way.
+ */
+static int
+get_index_from_view (cff_font *cff, cff_index *idx, int with_data)
+{
+    const uint8_t *p;
+    size_t  avail, size, length;
+    int     i, j, count, offsize;
+
+    if (ttbc_input_peek(cff->handle, &p, &avail) != 0 || avail < 3)
+        return 0;
+
+    count   = (p[0] << 8) | p[1];
+    offsize = p[2];
+    if (count == 0 || offsize < 1 || offsize > 4)
+        return 0;
+    size = 3 + (size_t) (count + 1) * offsize;
+    if (avail < size)
+        return 0;
+
+    idx->count   = count;
+    idx->offsize = offsize;
+    idx->offset  = NEW(count + 1, l_offset);
+    for (p += 3, i = 0; i <= count; i++) {
+        l_offset v = 0;
+
+        for (j = 0; j < offsize; j++)
+            v = v*0x100u + *p++;
+        idx->offset[i] = v;
+    }
+
+    if (idx->offset[0] != 1)
+        _tt_abort(with_data ? "Invalid CFF Index offset data" : "cff_get_index(): invalid index data");
+
+    idx->data = NULL;
+    if (with_data) {
+        length = idx->offset[count] - idx->offset[0];
+        if (avail - size < length) {
+            idx->offset = mfree(idx->offset);
+            return 0;
+        }
+        idx->data = NEW(length, card8);
+        memcpy(idx->data, p, length);
+        size += length;
+    }
+
+    ttbc_input_consume(cff->handle, size);
+    return 1;
+}
+
 cff_index *
 cff_get_index_header (cff_font *cff)
 {
@@ -290,6 +345,8 @@ cff_get_index_header (cff_font *cff)
     card16     i, count;
 
     idx = NEW(1, cff_index);
+    if (get_index_from_view(cff, idx, 0))
+        return idx;
 
     idx->count = count = tt_get_unsigned_pair(cff->handle);
     if (count > 0) {
@@ -327,6 +384,8 @@ cff_get_index (cff_font *cff)
     int        length, nb_read, offset;
 
     idx = NEW(1, cff_index);
+    if (get_index_from_view(cff, idx, 1))
+        return idx;
 
     idx->count = count = tt_get_unsigned_pair(cff->handle);
     if (count > 0) {
@@ -97,8 +97,8 @@ void cff_release_dict (cff_dict *dict)
  */
 
 #define CFF_DICT_STACK_LIMIT 64
-static int    stack_top = 0;
-static double arg_stack[CFF_DICT_STACK_LIMIT];
+static TTBC_THREAD_LOCAL int    stack_top = 0;
+static TTBC_THREAD_LOCAL double arg_stack[CFF_DICT_STACK_LIMIT];
 
 /*
  * CFF DICT encoding:
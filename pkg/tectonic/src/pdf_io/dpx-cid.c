@@ -112,7 +112,7 @@ static struct {
 static void release_opt (cid_opt *opt);
 static int get_cidsysinfo (CIDSysInfo *csi, const char *map_name, const fontmap_opt *fmap_opt);
 
-int opt_flags_cidfont = 0;
+TTBC_THREAD_LOCAL int opt_flags_cidfont = 0;
 
 int
 CIDFont_is_ACCFont (pdf_font *font)
@@ -30,7 +30,7 @@
 extern CIDSysInfo CSI_IDENTITY;
 extern CIDSysInfo CSI_UNICODE;
 
-extern int opt_flags_cidfont;
+extern TTBC_THREAD_LOCAL int opt_flags_cidfont;
 extern void CIDFont_set_flags (int flags);
 
 #define CIDFONT_FORCE_FIXEDPITCH (1 << 1)
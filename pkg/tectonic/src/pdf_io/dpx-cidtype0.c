@@ -47,6 +47,7 @@
 #include "dpx-dpxconf.h"
 #include "dpx-dpxfile.h"
 #include "dpx-error.h"
+#include "dpx-fontcache.h"
 #include "dpx-mem.h"
 #include "dpx-mfileio.h"
 #include "dpx-numbers.h"
@@ -273,10 +274,31 @@ add_CIDMetrics (sfnt *sfont, pdf_obj *fontdict,
 }
 
 /*
- * Create an instance of embeddable font.
+ * FontFile
+ */
+static void
+add_FontFile3 (pdf_font *font, const unsigned char *data, int len)
+{
+    pdf_obj *fontfile, *stream_dict;
+
+    fontfile    = pdf_new_stream(STREAM_COMPRESS);
+    stream_dict = pdf_stream_dict(fontfile);
+    pdf_add_dict(font->descriptor,
+                 pdf_new_name("FontFile3"),
+                 pdf_ref_obj (fontfile));
+    pdf_add_dict(stream_dict,
+                 pdf_new_name("Subtype"),
+                 pdf_new_name("CIDFontType0C"));
+    pdf_add_stream(fontfile, data, len);
+    pdf_release_obj(fontfile);
+}
+
+/*
+ * Create an instance of embeddable font. With a key, it is also kept for
+ * the next run that embeds the same subset.
  */
 static int
-write_fontfile (pdf_font *font, cff_font *cffont)
+write_fontfile (pdf_font *font, cff_font *cffont, const fontcache_key *key)
 {
     cff_index *topdict, *fdarray, *private;
     unsigned char *dest;
@@ -382,24 +404,10 @@ write_fontfile (pdf_font *font, cff_font *cffont)
     cff_pack_index(topdict, dest + topdict_offset, cff_index_size(topdict));
     cff_release_index(topdict);
 
-    /*
-     * FontFile
-     */
-    {
-        pdf_obj *fontfile, *stream_dict;
-
-        fontfile    = pdf_new_stream(STREAM_COMPRESS);
-        stream_dict = pdf_stream_dict(fontfile);
-        pdf_add_dict(font->descriptor,
-                     pdf_new_name("FontFile3"),
-                     pdf_ref_obj (fontfile));
-        pdf_add_dict(stream_dict,
-                     pdf_new_name("Subtype"),
-                     pdf_new_name("CIDFontType0C"));
-        pdf_add_stream(fontfile, (char *) dest, offset);
-        pdf_release_obj(fontfile);
-        free(dest);
-    }
+    if (key)
+        fontcache_store(key, dest, offset);
+    add_FontFile3(font, dest, offset);
+    free(dest);
 
     return destlen;
 }
@@ -438,6 +446,8 @@ CIDFont_type0_dofont (pdf_font *font)
     int    fd, prev_fd;
     char  *used_chars;
     unsigned char *CIDToGIDMap = NULL;
+    fontcache_key key;
+    const unsigned char *cached;
 
     assert(font);
 
@@ -559,6 +569,25 @@ CIDFont_type0_dofont (pdf_font *font)
     /*
      * Embed font subset.
      */
+    fontcache_make_key(&key, handle, "CIDFontType0C", font->index,
+                       font->fontname, used_chars, last_cid);
+    if ((cached = fontcache_lookup(&key, &destlen)) != NULL) {
+        add_FontFile3(font, cached, destlen);
+        free(CIDToGIDMap);
+        cff_close(cffont);
+        sfnt_close(sfont);
+        ttstub_input_close(handle);
+
+        if (dpx_conf.verbose_level > 1)
+            dpx_message("[%u glyphs][%d bytes, cached]", num_glyphs, destlen);
+
+        if (pdf_check_version(2, 0) < 0) {
+            CIDFont_type0_add_CIDSet(font, used_chars, last_cid);
+        }
+
+        return 0;
+    }
+
     cff_read_fdselect(cffont);
     cff_read_fdarray(cffont);
     cff_read_private(cffont);
@@ -692,7 +721,7 @@ CIDFont_type0_dofont (pdf_font *font)
         }
     }
 
-    destlen = write_fontfile(font, cffont);
+    destlen = write_fontfile(font, cffont, &key);
 
     cff_close(cffont);
     sfnt_close(sfont);
@@ -1116,6 +1145,8 @@ CIDFont_type0_t1cdofont (pdf_font *font)
     int    i, cid;
     char  *used_chars;
     double default_width, nominal_width;
+    fontcache_key key;
+    const unsigned char *cached;
 
     assert(font);
 
@@ -1174,7 +1205,6 @@ CIDFont_type0_t1cdofont (pdf_font *font)
     }
 
     cff_read_private(cffont);
-    cff_read_subrs  (cffont);
 
     if (cffont->private[0] && cff_dict_known(cffont->private[0], "StdVW")) {
         double stemv;
@@ -1207,6 +1237,15 @@ CIDFont_type0_t1cdofont (pdf_font *font)
         }
     }
 
+    fontcache_make_key(&key, handle, "CIDFontType0C/t1c", font->index,
+                       font->fontname, used_chars, last_cid);
+    if ((cached = fontcache_lookup(&key, &destlen)) != NULL) {
+        add_FontFile3(font, cached, destlen);
+        goto metrics;
+    }
+
+    cff_read_subrs(cffont);
+
     {
         cff_fdselect *fdselect;
 
@@ -1366,12 +1405,13 @@ CIDFont_type0_t1cdofont (pdf_font *font)
                  (double) cff_get_sid(cffont, "Identity"));
     cff_dict_set(cffont->topdict, "ROS", 2, 0.0);
 
-    destlen = write_fontfile(font, cffont);
+    destlen = write_fontfile(font, cffont, &key);
 
     /*
      * DW, W, DW2 and W2:
      * Those values are obtained from OpenType table (not TFM).
      */
+metrics:
     {
         unsigned char *CIDToGIDMap;
 
@@ -1547,7 +1587,7 @@ create_ToUnicode_stream (cff_font *cffont,
 #define WBUF_SIZE 1024
     unsigned char  wbuf[WBUF_SIZE];
     unsigned char *p, *endptr;
-    static unsigned char range_min[2] = {0x00, 0x00};
+    static TTBC_THREAD_LOCAL unsigned char range_min[2] = {0x00, 0x00};
     static unsigned char range_max[2] = {0xff, 0xff};
 
     if (!font_name || !used_glyphs)
@@ -2060,7 +2100,7 @@ CIDFont_type0_t1dofont (pdf_font *font)
     cff_dict_set(cffont->topdict, "ROS", 2, 0.0);
 
     cffont->num_glyphs = num_glyphs;
-    offset = write_fontfile(font, cffont);
+    offset = write_fontfile(font, cffont, NULL);
 
     cff_close(cffont);
 
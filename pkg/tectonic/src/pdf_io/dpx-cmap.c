@@ -39,6 +39,7 @@
 #include "dpx-cmap.h"
 
 #include <assert.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -47,9 +48,10 @@
 #include "dpx-dpxconf.h"
 #include "dpx-dpxutil.h"
 #include "dpx-error.h"
+#include "dpx-imagecache.h"
 #include "dpx-mem.h"
 
-static int __silent  = 0;
+static TTBC_THREAD_LOCAL int __silent  = 0;
 
 void
 CMap_set_silent (int value)
@@ -830,7 +832,7 @@ struct CMap_cache {
     CMap **cmaps;
 };
 
-static struct CMap_cache *__cache = NULL;
+static TTBC_THREAD_LOCAL struct CMap_cache *__cache = NULL;
 
 #define CHECK_ID(n) do {                                                \
         if (! __cache)                                                  \
@@ -842,7 +844,7 @@ static struct CMap_cache *__cache = NULL;
 void
 CMap_cache_init (void)
 {
-    static unsigned char range_min[2] = {0x00, 0x00};
+    static TTBC_THREAD_LOCAL unsigned char range_min[2] = {0x00, 0x00};
     static unsigned char range_max[2] = {0xff, 0xff};
 
     if (__cache)
@@ -880,6 +882,333 @@ CMap_cache_get (int id)
 }
 
 
+/*
+ * CJK documents load the same few large CMaps (UniJIS-UTF16-H and friends,
+ * each tens of thousands of lines of PostScript) on every compile. Once a
+ * CMap has parsed into a valid table, the table itself is kept in the host's
+ * cache under the digest of the CMap file, and the next compile reads it
+ * back instead of tokenizing the file again.
+ *
+ * An entry, in host byte order:
+ *   "DPXC", name, i32 type, wmode, flags,
+ *   registry, ordering (none for no CIDSystemInfo), i32 supplement,
+ *   usecmap name (none for no usecmap),
+ *   u32 profile minBytesIn, maxBytesIn, minBytesOut, maxBytesOut,
+ *   u32 codespace count, each: u32 dim, codeLo, codeHi,
+ *   u8 1 and the mapping table, or u8 0 when there is none.
+ * Strings are u32 length + 1 (0 for none) and the bytes. A table is u32 the
+ * number of entries in use, then for each: u8 index, i32 flag, u32 len and
+ * the code bytes when the entry is defined, and the subtable when the flag
+ * says lookup continues.
+ *
+ * A usecmap is stored by name and looked up again on restore, so the CMap
+ * it points at goes through the cache on its own.
+ */
+
+#define CMAP_CACHE_KIND  "cmap1"
+#define CMAP_CACHE_MAGIC "DPXC"
+
+struct cmap_buffer {
+    unsigned char *data;
+    size_t         len, max;
+};
+
+static void
+cmap_put (struct cmap_buffer *b, const void *data, size_t len)
+{
+    if (b->len + len > b->max) {
+        b->max = b->len + len + b->max + 4096;
+        b->data = RENEW(b->data, b->max, unsigned char);
+    }
+    if (len > 0)
+        memcpy(b->data + b->len, data, len);
+    b->len += len;
+}
+
+static void
+cmap_put_u32 (struct cmap_buffer *b, uint32_t value)
+{
+    cmap_put(b, &value, 4);
+}
+
+static void
+cmap_put_str (struct cmap_buffer *b, const char *s)
+{
+    size_t len = s ? strlen(s) : 0;
+
+    cmap_put_u32(b, s ? (uint32_t) (len + 1) : 0);
+    cmap_put(b, s, len);
+}
+
+static void
+cmap_put_table (struct cmap_buffer *b, const mapDef *t)
+{
+    uint32_t count = 0;
+    int      c;
+
+    for (c = 0; c < 256; c++) {
+        if (MAP_DEFINED(t[c].flag) || LOOKUP_CONTINUE(t[c].flag))
+            count++;
+    }
+    cmap_put_u32(b, count);
+    for (c = 0; c < 256; c++) {
+        unsigned char index = (unsigned char) c;
+        int32_t       flag  = t[c].flag;
+
+        if (!MAP_DEFINED(flag) && !LOOKUP_CONTINUE(flag))
+            continue;
+        cmap_put(b, &index, 1);
+        cmap_put(b, &flag, 4);
+        if (MAP_DEFINED(flag)) {
+            cmap_put_u32(b, (uint32_t) t[c].len);
+            cmap_put(b, t[c].code, t[c].len);
+        }
+        if (LOOKUP_CONTINUE(flag))
+            cmap_put_table(b, t[c].next);
+    }
+}
+
+static void
+CMap_cache_store (CMap *cmap, const unsigned char digest[16])
+{
+    struct cmap_buffer b = { NULL, 0, 0 };
+    uint32_t           profile[4];
+    int32_t            ints[3];
+    unsigned int       i;
+    unsigned char      has_tbl;
+
+    cmap_put(&b, CMAP_CACHE_MAGIC, 4);
+    cmap_put_str(&b, cmap->name);
+    ints[0] = cmap->type;
+    ints[1] = cmap->wmode;
+    ints[2] = cmap->flags;
+    cmap_put(&b, ints, sizeof(ints));
+    cmap_put_str(&b, cmap->CSI ? cmap->CSI->registry : NULL);
+    cmap_put_str(&b, cmap->CSI ? cmap->CSI->ordering : NULL);
+    cmap_put_u32(&b, cmap->CSI ? (uint32_t) cmap->CSI->supplement : 0);
+    cmap_put_str(&b, cmap->useCMap ? cmap->useCMap->name : NULL);
+
+    profile[0] = (uint32_t) cmap->profile.minBytesIn;
+    profile[1] = (uint32_t) cmap->profile.maxBytesIn;
+    profile[2] = (uint32_t) cmap->profile.minBytesOut;
+    profile[3] = (uint32_t) cmap->profile.maxBytesOut;
+    cmap_put(&b, profile, sizeof(profile));
+
+    cmap_put_u32(&b, cmap->codespace.num);
+    for (i = 0; i < cmap->codespace.num; i++) {
+        rangeDef *csr = cmap->codespace.ranges + i;
+        cmap_put_u32(&b, (uint32_t) csr->dim);
+        cmap_put(&b, csr->codeLo, csr->dim);
+        cmap_put(&b, csr->codeHi, csr->dim);
+    }
+
+    has_tbl = cmap->mapTbl ? 1 : 0;
+    cmap_put(&b, &has_tbl, 1);
+    if (cmap->mapTbl)
+        cmap_put_table(&b, cmap->mapTbl);
+
+    ttbc_cache_blob_put(CMAP_CACHE_KIND, digest, b.data, b.len);
+    free(b.data);
+}
+
+struct cmap_reader {
+    const unsigned char *p, *end;
+};
+
+static int
+cmap_get (struct cmap_reader *r, void *data, size_t len)
+{
+    if ((size_t) (r->end - r->p) < len)
+        return 0;
+    memcpy(data, r->p, len);
+    r->p += len;
+    return 1;
+}
+
+/* Read a string into *s, NULL for none. Returns 0 when the entry ends first. */
+static int
+cmap_get_str (struct cmap_reader *r, char **s)
+{
+    uint32_t len;
+
+    *s = NULL;
+    if (!cmap_get(r, &len, 4))
+        return 0;
+    if (len == 0)
+        return 1;
+    if ((size_t) (r->end - r->p) < len - 1)
+        return 0;
+    *s = NEW(len, char);
+    memcpy(*s, r->p, len - 1);
+    (*s)[len - 1] = '\0';
+    r->p += len - 1;
+    return 1;
+}
+
+static mapDef *
+cmap_get_table (struct cmap_reader *r, CMap *cmap, int depth)
+{
+    mapDef  *t;
+    uint32_t count, i;
+
+    if (depth > 8 || !cmap_get(r, &count, 4) || count > 256)
+        return NULL;
+
+    t = mapDef_new();
+    for (i = 0; i < count; i++) {
+        unsigned char index;
+        int32_t       flag;
+        uint32_t      len;
+
+        if (!cmap_get(r, &index, 1) || !cmap_get(r, &flag, 4))
+            break;
+        if (MAP_DEFINED(flag)) {
+            if (!cmap_get(r, &len, 4) || len >= MEM_ALLOC_SIZE ||
+                (size_t) (r->end - r->p) < len)
+                break;
+            t[index].len  = len;
+            t[index].code = get_mem(cmap, (int) len);
+            cmap_get(r, t[index].code, len);
+        }
+        if (LOOKUP_CONTINUE(flag)) {
+            t[index].next = cmap_get_table(r, cmap, depth + 1);
+            if (!t[index].next)
+                break;
+        }
+        t[index].flag = flag;
+    }
+    if (i < count) {
+        mapDef_release(t);
+        return NULL;
+    }
+
+    return t;
+}
+
+/* Fill in a fresh cmap from the entry cached under digest. Returns 0 when
+ * there is none or it does not read back; cmap must then be thrown away. */
+static int
+CMap_cache_restore (CMap *cmap, const unsigned char digest[16])
+{
+    unsigned char     *blob, has_tbl = 0;
+    struct cmap_reader r;
+    char              *usecmap = NULL;
+    CIDSysInfo         csi = { NULL, NULL, 0 };
+    uint32_t           profile[4], num, dim, supplement, i;
+    int32_t            ints[3];
+    size_t             len = 0;
+    int                ok = 0;
+
+    blob = ttbc_cache_blob_get(CMAP_CACHE_KIND, digest, &len);
+    if (!blob)
+        return 0;
+    r.p   = blob;
+    r.end = blob + len;
+    if (len < 4 || memcmp(blob, CMAP_CACHE_MAGIC, 4) != 0)
+        goto done;
+    r.p += 4;
+
+    if (!cmap_get_str(&r, &cmap->name) || !cmap_get(&r, ints, sizeof(ints)))
+        goto done;
+    cmap->type  = ints[0];
+    cmap->wmode = ints[1];
+    cmap->flags = ints[2];
+
+    if (!cmap_get_str(&r, &csi.registry) || !cmap_get_str(&r, &csi.ordering) ||
+        !cmap_get(&r, &supplement, 4) || !cmap_get_str(&r, &usecmap))
+        goto done;
+    if (csi.registry && csi.ordering) {
+        csi.supplement = (int) supplement;
+        CMap_set_CIDSysInfo(cmap, &csi);
+    }
+
+    if (!cmap_get(&r, profile, sizeof(profile)) || !cmap_get(&r, &num, 4))
+        goto done;
+    for (i = 0; i < num; i++) {
+        rangeDef *csr;
+
+        if (!cmap_get(&r, &dim, 4) || dim == 0 || dim >= MEM_ALLOC_SIZE / 2 ||
+            (size_t) (r.end - r.p) < 2 * (size_t) dim)
+            goto done;
+        if (cmap->codespace.num + 1 > cmap->codespace.max) {
+            cmap->codespace.max += 10;
+            cmap->codespace.ranges = RENEW(cmap->codespace.ranges, cmap->codespace.max, struct rangeDef);
+        }
+        csr = cmap->codespace.ranges + cmap->codespace.num;
+        csr->dim    = dim;
+        csr->codeHi = get_mem(cmap, dim);
+        csr->codeLo = get_mem(cmap, dim);
+        cmap_get(&r, csr->codeLo, dim);
+        cmap_get(&r, csr->codeHi, dim);
+        (cmap->codespace.num)++;
+    }
+    cmap->profile.minBytesIn  = profile[0];
+    cmap->profile.maxBytesIn  = profile[1];
+    cmap->profile.minBytesOut = profile[2];
+    cmap->profile.maxBytesOut = profile[3];
+
+    if (!cmap_get(&r, &has_tbl, 1))
+        goto done;
+    if (has_tbl) {
+        cmap->mapTbl = cmap_get_table(&r, cmap, 0);
+        if (!cmap->mapTbl)
+            goto done;
+    }
+    if (r.p != r.end)
+        goto done;
+
+    if (usecmap) {
+        int id = CMap_cache_find(usecmap);
+        if (id < 0)
+            goto done;
+        cmap->useCMap = CMap_cache_get(id);
+    }
+
+    ok = CMap_is_valid(cmap);
+
+  done:
+    free(usecmap);
+    free(csi.registry);
+    free(csi.ordering);
+    free(blob);
+    return ok;
+}
+
+/*
+ * Parse the CMap file open on handle into cmap, or restore it from the
+ * host's cache when this file was parsed before. Returns as CMap_parse.
+ */
+int
+CMap_parse_cached (CMap *cmap, rust_input_handle_t handle)
+{
+    unsigned char digest[16];
+    int           result;
+
+    imagecache_file_digest(digest, handle);
+    if (CMap_cache_restore(cmap, digest)) {
+        if (dpx_conf.verbose_level > 1)
+            dpx_message("(cached)");
+        return 1;
+    }
+
+    /* A failed restore can leave anything behind. Start over in place,
+     * since cmap may already sit in the cache while usecmap is resolved. */
+    {
+        CMap *fresh = CMap_new(), tmp;
+
+        tmp    = *cmap;
+        *cmap  = *fresh;
+        *fresh = tmp;
+        CMap_release(fresh);
+    }
+
+    result = CMap_parse(cmap, handle);
+    if (result > 0)
+        CMap_cache_store(cmap, digest);
+
+    return result;
+}
+
 int
 CMap_cache_find (const char *cmap_name)
 {
@@ -920,7 +1249,7 @@ CMap_cache_find (const char *cmap_name)
     __cache->num++;
     __cache->cmaps[id] = CMap_new();
 
-    if (CMap_parse(__cache->cmaps[id], handle) < 0)
+    if (CMap_parse_cached(__cache->cmaps[id], handle) < 0)
         _tt_abort("%s: Parsing CMap file failed.", CMAP_DEBUG_STR);
 
     ttstub_input_close(handle);
@@ -31,5 +31,6 @@
 
 int CMap_parse_check_sig (rust_input_handle_t handle);
 int CMap_parse (CMap *cmap, rust_input_handle_t handle);
+int CMap_parse_cached (CMap *cmap, rust_input_handle_t handle);
 
 #endif /* _CMAP_READ_H_ */
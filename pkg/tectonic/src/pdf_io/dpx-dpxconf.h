@@ -34,7 +34,7 @@ enum dpx_mode {
   dpx_mode_mpost_mode
 };
 
-extern struct _dpx_conf {
+extern TTBC_THREAD_LOCAL struct _dpx_conf {
   int            is_xbb;
   int            verbose_level;
   enum dpx_mode  compat_mode;
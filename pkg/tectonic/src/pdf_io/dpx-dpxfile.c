@@ -42,7 +42,7 @@
 #include <stdlib.h>
 #include <string.h>
 
-static char _sbuf[128];
+static TTBC_THREAD_LOCAL char _sbuf[128];
 /*
  * SFNT type sigs:
  *  `true' (0x74727565): TrueType (Mac)
@@ -784,6 +784,23 @@ parse_c_ident (const char **pp, const char *endptr)
   return  q;
 }
 
+/* parse_c_ident without the copy: skips the identifier at *pp and returns
+ * its length, 0 when there is none. */
+int
+skip_c_ident (const char **pp, const char *endptr)
+{
+  const char *p = *pp;
+  int    n;
+
+  if (p >= endptr || !ISCNONDIGITS(*p))
+    return 0;
+
+  for (n = 0; p < endptr && ISCIDENTCHAR(*p); p++, n++);
+
+  *pp = p;
+  return  n;
+}
+
 char *
 parse_float_decimal (const char **pp, const char *endptr)
 {
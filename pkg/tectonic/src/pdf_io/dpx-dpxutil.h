@@ -127,5 +127,6 @@ int   ht_iter_next   (struct ht_iter *iter);
 char *parse_float_decimal (const char **pp, const char *endptr);
 char *parse_c_string      (const char **pp, const char *endptr);
 char *parse_c_ident       (const char **pp, const char *endptr);
+int   skip_c_ident        (const char **pp, const char *endptr);
 
 #endif /* _DPXUTIL_H_ */
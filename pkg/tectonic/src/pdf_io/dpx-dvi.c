@@ -46,6 +46,7 @@
 #include "dpx-fontmap.h"
 #include "dpx-mem.h"
 #include "dpx-numbers.h"
+#include "dpx-pagedigest.h"
 #include "dpx-pdfcolor.h"
 #include "dpx-pdfdev.h"
 #include "dpx-pdfdoc.h"
@@ -72,15 +73,15 @@
 #define UTF32toUTF16LS(x)  (0xdc00 + (  x                 & 0x3ff))
 
 /* Interal Variables */
-static rust_input_handle_t dvi_handle = INVALID_HANDLE;
-static char linear = 0; /* set to 1 for strict linear processing of the input */
+static TTBC_THREAD_LOCAL rust_input_handle_t dvi_handle = INVALID_HANDLE;
+static TTBC_THREAD_LOCAL char linear = 0; /* set to 1 for strict linear processing of the input */
 
-static uint32_t *page_loc  = NULL;
-static unsigned int num_pages = 0;
+static TTBC_THREAD_LOCAL uint32_t *page_loc  = NULL;
+static TTBC_THREAD_LOCAL unsigned int num_pages = 0;
 
-static uint32_t dvi_file_size = 0;
+static TTBC_THREAD_LOCAL uint32_t dvi_file_size = 0;
 
-static struct dvi_header
+static TTBC_THREAD_LOCAL struct dvi_header
 {
     uint32_t unit_num;
     uint32_t unit_den;
@@ -97,7 +98,7 @@ static struct dvi_header
     {'\0'}     /* comment */
 };
 
-static double dev_origin_x = 72.0, dev_origin_y = 770.0;
+static TTBC_THREAD_LOCAL double dev_origin_x = 72.0, dev_origin_y = 770.0;
 
 double get_origin (int x)
 {
@@ -115,11 +116,11 @@ struct dvi_lr
     unsigned int buf_index;
 };
 
-static struct dvi_lr lr_state;                            /* state at start of current skimming  */
-static int           lr_mode;                             /* current direction or skimming depth */
-static uint32_t      lr_width;                            /* total width of reflected segment    */
-static uint32_t      lr_width_stack[DVI_STACK_DEPTH_MAX];
-static unsigned int lr_width_stack_depth = 0;
+static TTBC_THREAD_LOCAL struct dvi_lr lr_state;                            /* state at start of current skimming  */
+static TTBC_THREAD_LOCAL int           lr_mode;                             /* current direction or skimming depth */
+static TTBC_THREAD_LOCAL uint32_t      lr_width;                            /* total width of reflected segment    */
+static TTBC_THREAD_LOCAL uint32_t      lr_width_stack[DVI_STACK_DEPTH_MAX];
+static TTBC_THREAD_LOCAL unsigned int lr_width_stack_depth = 0;
 
 #define PHYSICAL 1
 #define VIRTUAL  2
@@ -132,7 +133,7 @@ struct gm {
     spt_t advance, ascent, descent;
 };
 
-static struct loaded_font
+static TTBC_THREAD_LOCAL struct loaded_font
 {
     int    type;     /* Type is physical or virtual */
     int    font_id;  /* id returned by dev (for PHYSICAL fonts)
@@ -156,7 +157,7 @@ static struct loaded_font
     int minbytes;
     char padbytes[4];
 } *loaded_fonts = NULL;
-static unsigned int num_loaded_fonts = 0, max_loaded_fonts = 0;
+static TTBC_THREAD_LOCAL unsigned int num_loaded_fonts = 0, max_loaded_fonts = 0;
 
 static void
 need_more_fonts (unsigned int n)
@@ -167,7 +168,7 @@ need_more_fonts (unsigned int n)
     }
 }
 
-static struct font_def
+static TTBC_THREAD_LOCAL struct font_def
 {
     int32_t tex_id;
     spt_t  point_size;
@@ -192,8 +193,8 @@ static struct font_def
 #define XDV_FLAG_SLANT          0x2000
 #define XDV_FLAG_EMBOLDEN       0x4000
 
-static unsigned int num_def_fonts = 0, max_def_fonts = 0;
-static int compute_boxes = 0, link_annot    = 1;
+static TTBC_THREAD_LOCAL unsigned int num_def_fonts = 0, max_def_fonts = 0;
+static TTBC_THREAD_LOCAL int compute_boxes = 0, link_annot    = 1;
 /* If "catch_phantom" is non-zero, dvipdfmx try to catch phantom texts.
  * Dvipdfmx treats DVI horizontal movement instructions (x, w, right) differently
  * when "catch_phantom" is non-zero. Amount of horizontal move will be added to
@@ -202,15 +203,130 @@ static int compute_boxes = 0, link_annot    = 1;
  *   catch_phantom=1: with current font size
  *   catch_phantom=2: with specified height and depth
  */
-static int    catch_phantom  = 0;
-static double phantom_height = 0.0;
-static double phantom_depth  = 0.0;
+static TTBC_THREAD_LOCAL int    catch_phantom  = 0;
+static TTBC_THREAD_LOCAL double phantom_height = 0.0;
+static TTBC_THREAD_LOCAL double phantom_depth  = 0.0;
 
 #define DVI_PAGE_BUF_CHUNK              0x10000U        /* 64K should be plenty for most pages */
 
-static unsigned char* dvi_page_buffer;
-static unsigned int   dvi_page_buf_size;
-static unsigned int   dvi_page_buf_index;
+static TTBC_THREAD_LOCAL unsigned char* dvi_page_buffer;
+static TTBC_THREAD_LOCAL unsigned int   dvi_page_buf_size;
+static TTBC_THREAD_LOCAL unsigned int   dvi_page_buf_index;
+
+/* Eztex customization: the XDV mostly comes straight from xetex's memory
+ * (see World.capture_xdv), and a page scan that reads it a byte at a time
+ * through the bridge spends more on the calls than on the page. The scan
+ * reads from a view of the handle's unread bytes instead, and hands what it
+ * took back to the handle (dvi_view_end) before anything else reads from
+ * it: font definitions, and whoever reads after the scan. */
+static TTBC_THREAD_LOCAL const unsigned char *dvi_view;
+static TTBC_THREAD_LOCAL size_t dvi_view_len, dvi_view_pos;
+/* where a view taken from dvi_data starts in the file; -1 for a view of
+ * the handle, which is at the view's start */
+static TTBC_THREAD_LOCAL int64_t dvi_view_offset = -1;
+
+/* Eztex customization: the whole XDV, when the bridge holds all of it in
+ * memory (xetex's captured output, a mapped or loaded file). The postamble,
+ * the page table and each page's start are read from it in place, instead
+ * of with a seek and a bridge call per byte. NULL otherwise, and when the
+ * input is read linearly. */
+static TTBC_THREAD_LOCAL const unsigned char *dvi_data;
+static TTBC_THREAD_LOCAL size_t dvi_data_len;
+
+static void
+dvi_data_begin (void)
+{
+    const unsigned char *data;
+    size_t len;
+
+    dvi_data = NULL;
+    dvi_data_len = 0;
+    if (linear || ttbc_input_peek(dvi_handle, &data, &len) != 0)
+        return;
+    if (len == ttbc_input_get_size(dvi_handle)) {
+        dvi_data = data;
+        dvi_data_len = len;
+    }
+}
+
+/* the byte at pos, or -1 past the end */
+static int
+dvi_byte_at (int32_t pos)
+{
+    if (dvi_data)
+        return pos >= 0 && (size_t) pos < dvi_data_len ? dvi_data[pos] : -1;
+    ttstub_input_seek (dvi_handle, pos, SEEK_SET);
+    return ttbc_input_getc(dvi_handle);
+}
+
+/* the big-endian number of size (2 or 4) bytes at pos */
+static uint32_t
+dvi_unsigned_at (int32_t pos, int size)
+{
+    if (dvi_data && pos >= 0 && (size_t) pos + size <= dvi_data_len) {
+        uint32_t value = 0;
+        int i;
+
+        for (i = 0; i < size; i++)
+            value = (value << 8) | dvi_data[pos + i];
+        return value;
+    }
+    /* aborts at the end of the file, as it always did */
+    ttstub_input_seek (dvi_handle, pos, SEEK_SET);
+    return size == 2 ? tt_get_unsigned_pair(dvi_handle) : tt_get_unsigned_quad(dvi_handle);
+}
+
+static void
+dvi_view_begin (rust_input_handle_t handle)
+{
+    if (ttbc_input_peek(handle, &dvi_view, &dvi_view_len) != 0) {
+        dvi_view = NULL;
+        dvi_view_len = 0;
+    }
+    dvi_view_pos = 0;
+    dvi_view_offset = -1;
+}
+
+/* a view from offset on: in dvi_data when there is one, without moving
+ * the handle until the view ends */
+static void
+dvi_view_begin_at (rust_input_handle_t handle, uint32_t offset)
+{
+    if (dvi_data && offset < dvi_data_len) {
+        dvi_view = dvi_data + offset;
+        dvi_view_len = dvi_data_len - offset;
+        dvi_view_pos = 0;
+        dvi_view_offset = offset;
+        return;
+    }
+    ttstub_input_seek (handle, offset, SEEK_SET);
+    dvi_view_begin(handle);
+}
+
+static void
+dvi_view_end (rust_input_handle_t handle)
+{
+    if (dvi_view_offset >= 0)
+        ttstub_input_seek (handle, dvi_view_offset + dvi_view_pos, SEEK_SET);
+    else if (dvi_view_pos > 0)
+        ttbc_input_consume(handle, dvi_view_pos);
+    dvi_view = NULL;
+    dvi_view_len = dvi_view_pos = 0;
+    dvi_view_offset = -1;
+}
+
+/* count bytes into dest, from the view while it lasts */
+static int
+dvi_view_read (rust_input_handle_t handle, unsigned char *dest, size_t count)
+{
+    if (dvi_view_len - dvi_view_pos >= count) {
+        memcpy(dest, dvi_view + dvi_view_pos, count);
+        dvi_view_pos += count;
+        return 0;
+    }
+    dvi_view_end(handle);
+    return ttbc_input_read(handle, (char *) dest, count) == (ssize_t) count ? 0 : -1;
+}
 
 /* functions to read numbers from the dvi file and store them in dvi_page_buffer */
 static int
@@ -218,8 +334,13 @@ get_and_buffer_unsigned_byte (rust_input_handle_t handle)
 {
     int ch;
 
-    if ((ch = ttbc_input_getc (handle)) < 0)
-        _tt_abort("File ended prematurely\n");
+    if (dvi_view_pos < dvi_view_len) {
+        ch = dvi_view[dvi_view_pos++];
+    } else {
+        dvi_view_end(handle);
+        if ((ch = ttbc_input_getc (handle)) < 0)
+            _tt_abort("File ended prematurely\n");
+    }
 
     if (dvi_page_buf_index >= dvi_page_buf_size) {
         dvi_page_buf_size += DVI_PAGE_BUF_CHUNK;
@@ -246,7 +367,7 @@ get_and_buffer_bytes(rust_input_handle_t handle, unsigned int count)
         dvi_page_buffer = RENEW(dvi_page_buffer, dvi_page_buf_size, unsigned char);
     }
 
-    if (ttbc_input_read(handle, (char *) dvi_page_buffer + dvi_page_buf_index, count) != count)
+    if (dvi_view_read(handle, dvi_page_buffer + dvi_page_buf_index, count) < 0)
         _tt_abort("File ended prematurely\n");
 
     dvi_page_buf_index += count;
@@ -328,7 +449,7 @@ static const char invalid_signature[] =
         _tt_abort(invalid_signature);           \
     }
 
-static int pre_id_byte, post_id_byte, is_ptex = 0, has_ptex = 0;
+static TTBC_THREAD_LOCAL int pre_id_byte, post_id_byte, is_ptex = 0, has_ptex = 0;
 
 static void
 check_id_bytes (void) {
@@ -361,13 +482,12 @@ find_post (void)
         _tt_abort("DVI file size exceeds 31-bit");
     dvi_file_size = dvi_size;
 
-    ttstub_input_seek (dvi_handle, 0, SEEK_END);
     current = dvi_size;
 
     /* Scan backwards through PADDING */
     do {
-        ttstub_input_seek (dvi_handle, --current, SEEK_SET);
-    } while ((ch = ttbc_input_getc(dvi_handle)) == PADDING && current > 0);
+        ch = dvi_byte_at(--current);
+    } while (ch == PADDING && current > 0);
 
     /* file_position now points to last non padding character or
      * beginning of file */
@@ -384,27 +504,24 @@ find_post (void)
 
     /* Make sure post_post is really there */
     current = current - 5;
-    ttstub_input_seek (dvi_handle, current, SEEK_SET);
-    if ((ch = ttbc_input_getc(dvi_handle)) != POST_POST) {
+    if ((ch = dvi_byte_at(current)) != POST_POST) {
         dpx_message("Found %d where post_post opcode should be\n", ch);
         _tt_abort(invalid_signature);
     }
 
-    current = tt_get_signed_quad(dvi_handle);
-    ttstub_input_seek (dvi_handle, current, SEEK_SET);
-    if ((ch = ttbc_input_getc(dvi_handle)) != POST) {
+    current = (int32_t) dvi_unsigned_at(current + 1, 4);
+    if ((ch = dvi_byte_at(current)) != POST) {
         dpx_message("Found %d where post_post opcode should be\n", ch);
         _tt_abort(invalid_signature);
     }
 
     /* Finally check the ID byte in the preamble */
     /* An Ascii pTeX DVI file has id_byte DVI_ID in the preamble but DVIV_ID in the postamble. */
-    ttstub_input_seek (dvi_handle, 0, SEEK_SET);
-    if ((ch = tt_get_unsigned_byte(dvi_handle)) != PRE) {
+    if ((ch = dvi_byte_at(0)) != PRE) {
         dpx_message("Found %d where PRE was expected\n", ch);
         _tt_abort(invalid_signature);
     }
-    ch = tt_get_unsigned_byte(dvi_handle);
+    ch = dvi_byte_at(1);
     if (!(ch == DVI_ID || ch == XDV_ID || ch == XDV_ID_OLD)) {
         dpx_message("DVI ID = %d\n", ch);
         _tt_abort(invalid_signature);
@@ -420,8 +537,7 @@ get_page_info (int32_t post_location)
 {
     int  i;
 
-    ttstub_input_seek (dvi_handle, post_location + 27, SEEK_SET);
-    num_pages = tt_get_unsigned_pair(dvi_handle);
+    num_pages = dvi_unsigned_at(post_location + 27, 2);
     if (num_pages == 0) {
         _tt_abort("Page count is 0!");
     }
@@ -431,18 +547,16 @@ get_page_info (int32_t post_location)
 
     page_loc = NEW(num_pages, uint32_t);
 
-    ttstub_input_seek (dvi_handle, post_location + 1, SEEK_SET);
-    page_loc[num_pages-1] = tt_get_unsigned_quad(dvi_handle);
+    page_loc[num_pages-1] = dvi_unsigned_at(post_location + 1, 4);
     range_check_loc(page_loc[num_pages-1] + 41);
     for (i = num_pages - 2; i >= 0; i--) {
-        ttstub_input_seek (dvi_handle, page_loc[i+1] + 41, SEEK_SET);
-        page_loc[i] = tt_get_unsigned_quad(dvi_handle);
+        page_loc[i] = dvi_unsigned_at(page_loc[i+1] + 41, 4);
         range_check_loc(page_loc[num_pages-1] + 41);
     }
 }
 
 /* Following are computed "constants" used for unit conversion */
-static double dvi2pts = 1.52018, total_mag = 1.0;
+static TTBC_THREAD_LOCAL double dvi2pts = 1.52018, total_mag = 1.0;
 
 double
 dvi_tell_mag (void)
@@ -461,16 +575,14 @@ do_scales (double mag)
 static void
 get_dvi_info (int32_t post_location)
 {
-    ttstub_input_seek (dvi_handle, post_location + 5, SEEK_SET);
+    dvi_info.unit_num = dvi_unsigned_at(post_location + 5, 4);
+    dvi_info.unit_den = dvi_unsigned_at(post_location + 9, 4);
+    dvi_info.mag      = dvi_unsigned_at(post_location + 13, 4);
 
-    dvi_info.unit_num = tt_get_unsigned_quad(dvi_handle);
-    dvi_info.unit_den = tt_get_unsigned_quad(dvi_handle);
-    dvi_info.mag      = tt_get_unsigned_quad(dvi_handle);
+    dvi_info.media_height = dvi_unsigned_at(post_location + 17, 4);
+    dvi_info.media_width  = dvi_unsigned_at(post_location + 21, 4);
 
-    dvi_info.media_height = tt_get_unsigned_quad(dvi_handle);
-    dvi_info.media_width  = tt_get_unsigned_quad(dvi_handle);
-
-    dvi_info.stackdepth   = tt_get_unsigned_pair(dvi_handle);
+    dvi_info.stackdepth   = dvi_unsigned_at(post_location + 25, 2);
 
     if (dvi_info.stackdepth > DVI_STACK_DEPTH_MAX) {
         dpx_warning("DVI need stack depth of %d,", dvi_info.stackdepth);
@@ -748,10 +860,14 @@ static void get_comment (void)
 {
     int length;
 
-    ttstub_input_seek (dvi_handle, 14, SEEK_SET);
-    length = tt_get_unsigned_byte(dvi_handle);
-    if (ttbc_input_read(dvi_handle, dvi_info.comment, length) != length) {
+    if ((length = dvi_byte_at(14)) < 0)
         _tt_abort(invalid_signature);
+    if (dvi_data && 15 + (size_t) length <= dvi_data_len) {
+        memcpy(dvi_info.comment, dvi_data + 15, length);
+    } else {
+        ttstub_input_seek (dvi_handle, 15, SEEK_SET);
+        if (ttbc_input_read(dvi_handle, dvi_info.comment, length) != length)
+            _tt_abort(invalid_signature);
     }
     dvi_info.comment[length] = '\0';
     if (dpx_conf.verbose_level > 0) {
@@ -772,11 +888,11 @@ struct dvi_registers
     unsigned int d;
 };
 
-static struct   dvi_registers dvi_state;
-static struct   dvi_registers dvi_stack[DVI_STACK_DEPTH_MAX];
-static int      dvi_stack_depth = 0 ;
-static int      current_font    = -1;
-static int      processing_page = 0 ;
+static TTBC_THREAD_LOCAL struct   dvi_registers dvi_state;
+static TTBC_THREAD_LOCAL struct   dvi_registers dvi_stack[DVI_STACK_DEPTH_MAX];
+static TTBC_THREAD_LOCAL int      dvi_stack_depth = 0 ;
+static TTBC_THREAD_LOCAL int      current_font    = -1;
+static TTBC_THREAD_LOCAL int      processing_page = 0 ;
 
 static void
 clear_state (void)
@@ -797,8 +913,8 @@ clear_state (void)
  * and htex does tag/untag depth. pdfdev and pdfdoc now does
  * not care about line-breaking at all.
  */
-static int marked_depth =  0;
-static int tagged_depth = -1;
+static TTBC_THREAD_LOCAL int marked_depth =  0;
+static TTBC_THREAD_LOCAL int tagged_depth = -1;
 
 static void
 dvi_mark_depth (void)
@@ -876,7 +992,7 @@ dvi_set_phantom_height (double height, double depth)
  * just for implementing DVI "special" command. They do not make sense
  * and just look odd when PDF output routines are separated from dvipdfmx.
  */
-static struct spt_coord {
+static TTBC_THREAD_LOCAL struct spt_coord {
     spt_t x, y;
 } compensation = { 0, 0 };
 
@@ -1781,6 +1897,22 @@ do_fnt (uint32_t tex_id)
         def_fonts[i].font_id = font_id;
     }
     current_font = def_fonts[i].font_id;
+
+    /* The page only holds the number; what it stands for is in the postamble. */
+    if (pagedigest_active()) {
+        int32_t params[8];
+
+        params[0] = def_fonts[i].point_size;
+        params[1] = def_fonts[i].native;
+        params[2] = def_fonts[i].face_index;
+        params[3] = def_fonts[i].layout_dir;
+        params[4] = def_fonts[i].extend;
+        params[5] = def_fonts[i].slant;
+        params[6] = def_fonts[i].embolden;
+        params[7] = def_fonts[i].rgba_used ? (int32_t) def_fonts[i].rgba_color : -1;
+        pagedigest_add(def_fonts[i].font_name, strlen(def_fonts[i].font_name) + 1);
+        pagedigest_add(params, sizeof params);
+    }
 }
 
 static void
@@ -1821,6 +1953,13 @@ do_eop (void)
 {
     processing_page = 0;
 
+    /* The whole page is in dvi_page_buffer now. Its bop ends with the
+     * offset of the page before, which moves whenever that one grows. */
+    if (pagedigest_active() && dvi_page_buf_index >= 45) {
+        pagedigest_add(dvi_page_buffer, 41);
+        pagedigest_add(dvi_page_buffer + 45, dvi_page_buf_index - 45);
+    }
+
     if (dvi_stack_depth != 0) {
         _tt_abort("DVI stack depth is not zero at end of page");
     }
@@ -2094,6 +2233,18 @@ check_postamble (void)
 /* Most of the work of actually interpreting
  * the dvi file is here.
  */
+/* Its size and offsets, none of its content: no specials run, so links,
+ * destinations and colors set on the page are missing too. */
+void
+dvi_do_blank_page (double page_paper_height, double hmargin, double vmargin)
+{
+    dev_origin_x = hmargin;
+    dev_origin_y = page_paper_height - vmargin;
+
+    pdf_doc_begin_page(dvi_tell_mag(), dev_origin_x, dev_origin_y);
+    pdf_doc_end_page();
+}
+
 void
 dvi_do_page (double page_paper_height, double hmargin, double vmargin)
 {
@@ -2282,6 +2433,7 @@ dvi_init (const char *dvi_filename, double mag)
     /* DVI files are most easily read backwards by searching for post_post and
      * then post opcode.
      */
+    dvi_data_begin();
     post_location = find_post();
     get_dvi_info(post_location);
     do_scales(mag);
@@ -2315,6 +2467,8 @@ dvi_close (void)
     /* Do some house cleaning */
     ttstub_input_close(dvi_handle);
     dvi_handle = INVALID_HANDLE;
+    dvi_data = NULL;
+    dvi_data_len = 0;
 
     if (def_fonts) {
         for (i = 0; i < num_def_fonts; i++) {
@@ -2352,8 +2506,8 @@ dvi_close (void)
    is determined by the virtual font header, which
    may be undefined */
 
-static int saved_dvi_font[VF_NESTING_MAX];
-static unsigned int num_saved_fonts = 0;
+static TTBC_THREAD_LOCAL int saved_dvi_font[VF_NESTING_MAX];
+static TTBC_THREAD_LOCAL unsigned int num_saved_fonts = 0;
 
 void
 dvi_vf_init (int dev_font_id)
@@ -2709,7 +2863,7 @@ scan_special (double *wd, double *ht, double *xo, double *yo, int *lm,
     return  error;
 }
 
-static int buffered_page = -1;
+static TTBC_THREAD_LOCAL int buffered_page = -1;
 void
 dvi_scan_specials (int page_no,
                    double *page_width, double *page_height,
@@ -2737,9 +2891,10 @@ dvi_scan_specials (int page_no,
             _tt_abort("Invalid page number: %u", page_no);
         offset = page_loc[page_no];
 
-        ttstub_input_seek (dvi_handle, offset, SEEK_SET);
+        dvi_view_begin_at(dvi_handle, offset);
+    } else {
+        dvi_view_begin(dvi_handle);
     }
-
     while ((opcode = get_and_buffer_unsigned_byte(dvi_handle)) != EOP) {
         if (opcode <= SET_CHAR_127 ||
             (opcode >= FNT_NUM_0 && opcode <= FNT_NUM_63))
@@ -2760,7 +2915,7 @@ dvi_scan_specials (int page_no,
                 dvi_page_buffer = RENEW(dvi_page_buffer, dvi_page_buf_size, unsigned char);
             }
 #define buf ((char*)(dvi_page_buffer + dvi_page_buf_index))
-            if (ttbc_input_read(dvi_handle, buf, size) != size)
+            if (dvi_view_read(dvi_handle, (unsigned char *) buf, size) < 0)
                 _tt_abort("Reading DVI file failed!");
             if (scan_special(page_width, page_height, x_offset, y_offset, landscape,
                              majorversion, minorversion,
@@ -2809,7 +2964,9 @@ dvi_scan_specials (int page_no,
             break;
 
         case FNT_DEF1: case FNT_DEF2: case FNT_DEF3: case FNT_DEF4:
+            dvi_view_end(dvi_handle);
             do_fntdef(tt_get_unsigned_num(dvi_handle, opcode-FNT_DEF1));
+            dvi_view_begin(dvi_handle);
             break;
         case XDV_GLYPHS:
             need_XeTeX(opcode);
@@ -2827,7 +2984,9 @@ dvi_scan_specials (int page_no,
             break;
         case XDV_NATIVE_FONT_DEF:
             need_XeTeX(opcode);
+            dvi_view_end(dvi_handle);
             do_native_font_def(tt_get_signed_quad(dvi_handle));
+            dvi_view_begin(dvi_handle);
             break;
         case BEGIN_REFLECT:
         case END_REFLECT:
@@ -2842,6 +3001,7 @@ dvi_scan_specials (int page_no,
         case POST:
             if (linear && dvi_page_buf_index == 1) {
                 /* this is actually an indication that we've reached the end of the input */
+                dvi_view_end(dvi_handle);
                 return;
             }
             /* else fall through to error case */
@@ -2850,6 +3010,7 @@ dvi_scan_specials (int page_no,
             break;
         }
     }
+    dvi_view_end(dvi_handle);
 
     return;
 }
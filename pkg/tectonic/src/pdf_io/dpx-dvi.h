@@ -71,6 +71,8 @@ void dvi_z0    (void);
 void dvi_dirchg(unsigned char dir);
 
 void  dvi_do_page  (double paper_height, double x_offset, double y_offset);
+/* An empty page in place of the one dvi_scan_specials last read. */
+void  dvi_do_blank_page (double paper_height, double x_offset, double y_offset);
 void  dvi_scan_specials (int page_no,
                                 double *width, double *height,
                                 double *x_offset, double *y_offset, int *landscape,
@@ -28,7 +28,7 @@
 
 #include "dpx-dvipdfmx.h"
 
-time_t ttpi_source_date_epoch = (time_t) -1;
-int landscape_mode = 0;
-double paper_height = 842.0;
-double paper_width = 595.0;
+TTBC_THREAD_LOCAL time_t ttpi_source_date_epoch = (time_t) -1;
+TTBC_THREAD_LOCAL int landscape_mode = 0;
+TTBC_THREAD_LOCAL double paper_height = 842.0;
+TTBC_THREAD_LOCAL double paper_width = 595.0;
@@ -27,13 +27,15 @@
 #ifndef _DVIPDFMX_PDF_IO_INNER_H_
 #define _DVIPDFMX_PDF_IO_INNER_H_
 
+#include "tectonic_bridge_core.h"
+
 #include <time.h>
 
 #define DVIPDFMX_PROG_NAME "xdvipdfmx"
 
-extern time_t ttpi_source_date_epoch;
-extern int landscape_mode;
-extern double paper_height;
-extern double paper_width;
+extern TTBC_THREAD_LOCAL time_t ttpi_source_date_epoch;
+extern TTBC_THREAD_LOCAL int landscape_mode;
+extern TTBC_THREAD_LOCAL double paper_height;
+extern TTBC_THREAD_LOCAL double paper_width;
 
 #endif /* _DVIPDFMX_PDF_IO_INNER_H_ */
@@ -32,8 +32,8 @@ typedef enum _message_type {
     DPX_MESG_WARN,
 } message_type_t;
 
-static message_type_t _last_message_type = DPX_MESG_INFO;
-static int _dpx_quietness = 0;
+static TTBC_THREAD_LOCAL message_type_t _last_message_type = DPX_MESG_INFO;
+static TTBC_THREAD_LOCAL int _dpx_quietness = 0;
 
 void
 shut_up (int quietness)
@@ -42,8 +42,8 @@ shut_up (int quietness)
 }
 
 
-static rust_output_handle_t _dpx_message_handle = INVALID_HANDLE;
-static char _dpx_message_buf[1024];
+static TTBC_THREAD_LOCAL rust_output_handle_t _dpx_message_handle = INVALID_HANDLE;
+static TTBC_THREAD_LOCAL char _dpx_message_buf[1024];
 
 static rust_output_handle_t
 _dpx_ensure_output_handle (void)
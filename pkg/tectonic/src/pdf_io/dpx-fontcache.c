@@ -0,0 +1,133 @@
+/* This is dvipdfmx, an eXtended version of dvipdfm by Mark A. Wicks.
+
+    Copyright (C) 2002-2018 by Jin-Hwan Cho and Shunsaku Hirata,
+    the dvipdfmx project team.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+*/
+
+/*
+ * Subsetting a font program means reading and rewriting every charstring
+ * it keeps. When a document is compiled again in the same process (watch
+ * mode, the server) most fonts are used exactly as before, so the finished
+ * program is kept here and copied into the next PDF as it is. So is the
+ * ToUnicode CMap of a subset, which takes walking the font's cmap, GSUB
+ * and glyph names to make. Entries are dropped oldest first once
+ * FONTCACHE_MAX_BYTES is exceeded.
+ */
+
+#include "dpx-fontcache.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "tectonic_bridge_core.h"
+#include "dpx-dpxcrypt.h"
+#include "dpx-mem.h"
+
+#define FONTCACHE_MAX_BYTES (64 * 1024 * 1024)
+
+struct fontcache_entry {
+    fontcache_key  key;
+    unsigned char *data;
+    int            len;
+};
+
+static TTBC_THREAD_LOCAL struct fontcache_entry *entries = NULL;
+static TTBC_THREAD_LOCAL int    num_entries = 0, max_entries = 0;
+static TTBC_THREAD_LOCAL size_t total_bytes = 0;
+
+void
+fontcache_make_key (fontcache_key *key, rust_input_handle_t handle,
+                    const char *kind, int index, const char *fontname,
+                    const char *used_chars, int last_cid)
+{
+    MD5_CONTEXT    md5;
+    unsigned char  buf[16384], file_digest[16], idx[4];
+    size_t         pos, remaining;
+    ssize_t        n;
+
+    /* The whole file, so a font replaced under the same name misses. */
+    pos = ttstub_input_seek(handle, 0, SEEK_CUR);
+    ttstub_input_seek(handle, 0, SEEK_SET);
+    MD5_init(&md5);
+    remaining = ttbc_input_get_size(handle);
+    while (remaining > 0) {
+        n = ttbc_input_read(handle, (char *) buf, remaining < sizeof(buf) ? remaining : sizeof(buf));
+        if (n <= 0)
+            break;
+        MD5_write(&md5, buf, (unsigned int) n);
+        remaining -= n;
+    }
+    MD5_final(file_digest, &md5);
+    ttstub_input_seek(handle, pos, SEEK_SET);
+
+    idx[0] = (index >> 24) & 0xff;
+    idx[1] = (index >> 16) & 0xff;
+    idx[2] = (index >> 8) & 0xff;
+    idx[3] = index & 0xff;
+
+    MD5_init(&md5);
+    MD5_write(&md5, file_digest, 16);
+    MD5_write(&md5, (const unsigned char *) kind, strlen(kind) + 1);
+    MD5_write(&md5, idx, 4);
+    MD5_write(&md5, (const unsigned char *) fontname, strlen(fontname) + 1);
+    MD5_write(&md5, (const unsigned char *) used_chars, last_cid / 8 + 1);
+    MD5_final(key->digest, &md5);
+}
+
+const unsigned char *
+fontcache_lookup (const fontcache_key *key, int *len)
+{
+    int i;
+
+    for (i = 0; i < num_entries; i++) {
+        if (memcmp(entries[i].key.digest, key->digest, 16) == 0) {
+            *len = entries[i].len;
+            return entries[i].data;
+        }
+    }
+    return NULL;
+}
+
+void
+fontcache_store (const fontcache_key *key, const unsigned char *data, int len)
+{
+    int i, drop;
+
+    if (len <= 0 || len > FONTCACHE_MAX_BYTES || fontcache_lookup(key, &i))
+        return;
+
+    for (drop = 0; drop < num_entries &&
+                   total_bytes + len > FONTCACHE_MAX_BYTES; drop++) {
+        total_bytes -= entries[drop].len;
+        free(entries[drop].data);
+    }
+    if (drop > 0) {
+        num_entries -= drop;
+        memmove(entries, entries + drop, num_entries * sizeof(struct fontcache_entry));
+    }
+
+    if (num_entries == max_entries) {
+        max_entries += 16;
+        entries = RENEW(entries, max_entries, struct fontcache_entry);
+    }
+    entries[num_entries].key  = *key;
+    entries[num_entries].data = NEW(len, unsigned char);
+    memcpy(entries[num_entries].data, data, len);
+    entries[num_entries].len  = len;
+    num_entries++;
+    total_bytes += len;
+}
@@ -0,0 +1,44 @@
+/* This is dvipdfmx, an eXtended version of dvipdfm by Mark A. Wicks.
+
+    Copyright (C) 2002-2018 by Jin-Hwan Cho and Shunsaku Hirata,
+    the dvipdfmx project team.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+*/
+
+#ifndef _FONTCACHE_H_
+#define _FONTCACHE_H_
+
+#include "tectonic_bridge_core.h"
+
+/* Finished font programs and ToUnicode CMaps, kept for later runs in the
+ * same process. */
+
+typedef struct {
+    unsigned char digest[16];
+} fontcache_key;
+
+/* The key for a subset of the font read through handle: the program kind,
+ * the face index, the PDF font name (with its subset tag) and the used
+ * characters up to last_cid. Leaves the handle's position as it was. */
+extern void fontcache_make_key (fontcache_key *key, rust_input_handle_t handle,
+                                const char *kind, int index, const char *fontname,
+                                const char *used_chars, int last_cid);
+
+/* The cached program for key, or NULL; len receives its length. */
+extern const unsigned char *fontcache_lookup (const fontcache_key *key, int *len);
+extern void fontcache_store (const fontcache_key *key, const unsigned char *data, int len);
+
+#endif /* _FONTCACHE_H_ */
@@ -27,6 +27,7 @@
 #include "dpx-dpxfile.h"
 #include "dpx-dpxutil.h"
 #include "dpx-error.h"
+#include "dpx-imagecache.h"
 #include "dpx-mem.h"
 #include "dpx-mfileio.h"
 #include "dpx-subfont.h"
@@ -632,7 +633,7 @@ fontmap_parse_mapdef_dps (fontmap_rec *mrec,
 }
 
 
-static struct ht_table *fontmap = NULL;
+static TTBC_THREAD_LOCAL struct ht_table *fontmap = NULL;
 
 #define fontmap_invalid(m) (!(m) || !(m)->map_name || !(m)->font_name)
 static char *
@@ -946,6 +947,209 @@ is_pdfm_mapline (const char *mline) /* NULL terminated. */
 }
 
 
+/*
+ * A map file parses to the same records every time, and pdftex.map alone has
+ * thousands of lines. So the records of a map file that parsed cleanly are
+ * kept in the host's cache under the file's digest, and the next compile
+ * reads them back in one go instead of parsing the lines again. Only the
+ * parse is skipped: the records still go through insert/append/remove in
+ * file order, so the mode and the SFD expansion apply as before. A file
+ * with a mismatched or invalid line is not kept, and its warnings come out
+ * on every compile.
+ *
+ * An entry, in host byte order:
+ *   "DPXM", u32 count,
+ *   count times: 8 strings (u32 length + 1, or 0 for none, then the
+ *   bytes), f64 slant, extend, bold, design_size,
+ *   i32 mapc, flags, index, style, stemv, use_glyph_encoding.
+ */
+
+#define FONTMAP_CACHE_KIND  "fontmap1"
+#define FONTMAP_CACHE_MAGIC "DPXM"
+
+struct map_buffer {
+    unsigned char *data;
+    size_t         len, max;
+};
+
+static void
+map_put (struct map_buffer *b, const void *data, size_t len)
+{
+    if (b->len + len > b->max) {
+        b->max = b->len + len + b->max + 4096;
+        b->data = RENEW(b->data, b->max, unsigned char);
+    }
+    if (len > 0)
+        memcpy(b->data + b->len, data, len);
+    b->len += len;
+}
+
+static void
+map_put_i32 (struct map_buffer *b, int32_t value)
+{
+    map_put(b, &value, 4);
+}
+
+static void
+map_put_str (struct map_buffer *b, const char *s)
+{
+    size_t len = s ? strlen(s) : 0;
+
+    map_put_i32(b, s ? (int32_t) (len + 1) : 0);
+    map_put(b, s, len);
+}
+
+static void
+map_put_record (struct map_buffer *b, const fontmap_rec *mrec)
+{
+    const char *strings[8];
+    double      reals[4];
+    int32_t     ints[6];
+    int         i;
+
+    strings[0] = mrec->map_name;
+    strings[1] = mrec->font_name;
+    strings[2] = mrec->enc_name;
+    strings[3] = mrec->charmap.sfd_name;
+    strings[4] = mrec->charmap.subfont_id;
+    strings[5] = mrec->opt.otl_tags;
+    strings[6] = mrec->opt.tounicode;
+    strings[7] = mrec->opt.charcoll;
+    for (i = 0; i < 8; i++)
+        map_put_str(b, strings[i]);
+
+    reals[0] = mrec->opt.slant;
+    reals[1] = mrec->opt.extend;
+    reals[2] = mrec->opt.bold;
+    reals[3] = mrec->opt.design_size;
+    map_put(b, reals, sizeof(reals));
+
+    ints[0] = mrec->opt.mapc;
+    ints[1] = mrec->opt.flags;
+    ints[2] = (int32_t) mrec->opt.index;
+    ints[3] = mrec->opt.style;
+    ints[4] = mrec->opt.stemv;
+    ints[5] = mrec->opt.use_glyph_encoding;
+    map_put(b, ints, sizeof(ints));
+}
+
+/* Read one record at *pp into mrec (initialized). Returns 0 when the entry
+ * ends before the record does. */
+static int
+map_get_record (const unsigned char **pp, const unsigned char *end, fontmap_rec *mrec)
+{
+    char   **strings[8];
+    double   reals[4];
+    int32_t  ints[6], len;
+    int      i;
+
+    strings[0] = &mrec->map_name;
+    strings[1] = &mrec->font_name;
+    strings[2] = &mrec->enc_name;
+    strings[3] = &mrec->charmap.sfd_name;
+    strings[4] = &mrec->charmap.subfont_id;
+    strings[5] = &mrec->opt.otl_tags;
+    strings[6] = &mrec->opt.tounicode;
+    strings[7] = &mrec->opt.charcoll;
+    for (i = 0; i < 8; i++) {
+        if (end - *pp < 4)
+            return 0;
+        memcpy(&len, *pp, 4);
+        *pp += 4;
+        if (len == 0)
+            continue;
+        if (len < 0 || end - *pp < len - 1)
+            return 0;
+        *strings[i] = NEW(len, char);
+        memcpy(*strings[i], *pp, len - 1);
+        (*strings[i])[len - 1] = '\0';
+        *pp += len - 1;
+    }
+
+    if ((size_t) (end - *pp) < sizeof(reals) + sizeof(ints))
+        return 0;
+    memcpy(reals, *pp, sizeof(reals));
+    *pp += sizeof(reals);
+    memcpy(ints, *pp, sizeof(ints));
+    *pp += sizeof(ints);
+
+    mrec->opt.slant       = reals[0];
+    mrec->opt.extend      = reals[1];
+    mrec->opt.bold        = reals[2];
+    mrec->opt.design_size = reals[3];
+    mrec->opt.mapc        = ints[0];
+    mrec->opt.flags       = ints[1];
+    mrec->opt.index       = (uint32_t) ints[2];
+    mrec->opt.style       = ints[3];
+    mrec->opt.stemv       = ints[4];
+    mrec->opt.use_glyph_encoding = ints[5];
+    return 1;
+}
+
+static void
+apply_fontmap_record (fontmap_rec *mrec, int mode)
+{
+    switch (mode) {
+    case FONTMAP_RMODE_REPLACE:
+        pdf_insert_fontmap_record(mrec->map_name, mrec);
+        break;
+    case FONTMAP_RMODE_APPEND:
+        pdf_append_fontmap_record(mrec->map_name, mrec);
+        break;
+    case FONTMAP_RMODE_REMOVE:
+        pdf_remove_fontmap_record(mrec->map_name);
+        break;
+    }
+}
+
+/* Apply the records cached for a map file. Returns 0, having applied
+ * nothing, when there are none or the entry does not read back. */
+static int
+fontmap_cache_replay (const unsigned char digest[16], int mode)
+{
+    unsigned char       *blob;
+    const unsigned char *p, *end;
+    fontmap_rec         *mrecs;
+    uint32_t             count, i, n = 0;
+    size_t               len = 0;
+    int                  ok = 0;
+
+    blob = ttbc_cache_blob_get(FONTMAP_CACHE_KIND, digest, &len);
+    if (!blob)
+        return 0;
+    if (len < 8 || memcmp(blob, FONTMAP_CACHE_MAGIC, 4) != 0) {
+        free(blob);
+        return 0;
+    }
+    memcpy(&count, blob + 4, 4);
+    p   = blob + 8;
+    end = blob + len;
+
+    /* read everything before applying anything, so a damaged entry leaves
+     * the table as it was */
+    mrecs = NEW(count > 0 ? count : 1, fontmap_rec);
+    for (; n < count && (size_t) (end - p) >= 4; n++) {
+        pdf_init_fontmap_record(&mrecs[n]);
+        if (!map_get_record(&p, end, &mrecs[n])) {
+            pdf_clear_fontmap_record(&mrecs[n]);
+            break;
+        }
+    }
+    if (n == count && p == end) {
+        for (i = 0; i < n; i++)
+            apply_fontmap_record(&mrecs[i], mode);
+        ok = 1;
+    }
+    for (i = 0; i < n; i++)
+        pdf_clear_fontmap_record(&mrecs[i]);
+    free(mrecs);
+    free(blob);
+
+    if (ok && dpx_conf.verbose_level > 1)
+        dpx_message("(cached: %u records)", count);
+    return ok;
+}
+
 int
 pdf_load_fontmap_file (const char *filename, int mode)
 {
@@ -953,7 +1157,10 @@ pdf_load_fontmap_file (const char *filename, int mode)
     rust_input_handle_t handle;
     const char *p = NULL, *endptr;
     int llen, lpos  = 0;
-    int error = 0, format = 0;
+    int error = 0, format = 0, clean = 1;
+    unsigned char digest[16];
+    struct map_buffer cached = { NULL, 0, 0 };
+    uint32_t count = 0;
 
     assert(filename);
     assert(fontmap);
@@ -967,6 +1174,16 @@ pdf_load_fontmap_file (const char *filename, int mode)
         return  -1;
     }
 
+    imagecache_file_digest(digest, handle);
+    if (fontmap_cache_replay(digest, mode)) {
+        ttstub_input_close(handle);
+        if (dpx_conf.verbose_level)
+            dpx_message(">");
+        return 0;
+    }
+    map_put(&cached, FONTMAP_CACHE_MAGIC, 4);
+    map_put(&cached, &count, 4);
+
     while (!error && (p = tt_readline(work_buffer, WORK_BUFFER_SIZE, handle)) != NULL) {
         int m;
 
@@ -981,6 +1198,7 @@ pdf_load_fontmap_file (const char *filename, int mode)
         m = is_pdfm_mapline(p);
 
         if (format * m < 0) { /* mismatch */
+            clean = 0;
             dpx_warning("Found a mismatched fontmap line %d from %s.", lpos, filename);
             dpx_warning("-- Ignore the current input buffer: %s", p);
             continue;
@@ -999,17 +1217,9 @@ pdf_load_fontmap_file (const char *filename, int mode)
             free(mrec);
             continue;
         } else {
-            switch (mode) {
-            case FONTMAP_RMODE_REPLACE:
-                pdf_insert_fontmap_record(mrec->map_name, mrec);
-                break;
-            case FONTMAP_RMODE_APPEND:
-                pdf_append_fontmap_record(mrec->map_name, mrec);
-                break;
-            case FONTMAP_RMODE_REMOVE:
-                pdf_remove_fontmap_record(mrec->map_name);
-                break;
-            }
+            map_put_record(&cached, mrec);
+            count++;
+            apply_fontmap_record(mrec, mode);
         }
         pdf_clear_fontmap_record(mrec);
         free(mrec);
@@ -1017,6 +1227,12 @@ pdf_load_fontmap_file (const char *filename, int mode)
 
     ttstub_input_close(handle);
 
+    if (!error && clean) {
+        memcpy(cached.data + 4, &count, 4);
+        ttbc_cache_blob_put(FONTMAP_CACHE_KIND, digest, cached.data, cached.len);
+    }
+    free(cached.data);
+
     if (dpx_conf.verbose_level)
         dpx_message(">");
 
@@ -0,0 +1,527 @@
+/* This is dvipdfmx, an eXtended version of dvipdfm by Mark A. Wicks.
+
+    Copyright (C) 2002-2018 by Jin-Hwan Cho and Shunsaku Hirata,
+    the dvipdfmx project team.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+*/
+
+/*
+ * Decoding a raster image and compressing its samples is most of what the
+ * image costs, and a document compiled again mostly includes the same
+ * files. So the streams an image leaves in the output (its XObject, an
+ * SMask) are recorded as they are written, their data already filtered,
+ * and kept in the host's cache under the file's digest and the settings
+ * that shape them. The next compile writes them out again without touching
+ * the decoder. An image whose objects refer to anything else, such as an
+ * ICC profile held by the colorspace cache, is not kept.
+ *
+ * An entry, in host byte order:
+ *   "DPXI", u32 length of the rest,
+ *   u32 width, u32 height, f64 xdensity, f64 ydensity,
+ *   u32 index of the XObject, u32 count,
+ *   count times: the stream dict (see put_obj), u32 length, data.
+ * References within the dicts are indices into the list of streams.
+ */
+
+#include "dpx-imagecache.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "tectonic_bridge_core.h"
+#include "dpx-dpxcrypt.h"
+#include "dpx-mem.h"
+
+#define IMAGECACHE_KIND      "images"
+#define IMAGECACHE_MAGIC     "DPXI"
+/* hosts read back no cache file larger than this */
+#define IMAGECACHE_MAX_BYTES (64 * 1024 * 1024)
+
+struct buffer {
+    unsigned char *data;
+    size_t         len, max;
+};
+
+static TTBC_THREAD_LOCAL struct {
+    int           active, failed;
+    struct buffer body;
+    uint32_t     *labels;   /* of the streams recorded, in order */
+    int           count, max_count;
+    size_t       *refs;     /* offsets in body of labels to turn into indices */
+    int           num_refs, max_refs;
+} rec;
+
+void
+imagecache_file_digest (unsigned char digest[16], rust_input_handle_t handle)
+{
+    MD5_CONTEXT    md5;
+    unsigned char  buf[16384];
+    size_t         pos, remaining;
+    ssize_t        n;
+
+    pos = ttstub_input_seek(handle, 0, SEEK_CUR);
+    ttstub_input_seek(handle, 0, SEEK_SET);
+    MD5_init(&md5);
+    remaining = ttbc_input_get_size(handle);
+    while (remaining > 0) {
+        n = ttbc_input_read(handle, (char *) buf, remaining < sizeof(buf) ? remaining : sizeof(buf));
+        if (n <= 0)
+            break;
+        MD5_write(&md5, buf, (unsigned int) n);
+        remaining -= n;
+    }
+    MD5_final(digest, &md5);
+    ttstub_input_seek(handle, pos, SEEK_SET);
+}
+
+void
+imagecache_make_key (imagecache_key *key, rust_input_handle_t handle,
+                     int format, const load_options *options)
+{
+    MD5_CONTEXT    md5;
+    unsigned char  file_digest[16];
+    int            settings[9];
+
+    imagecache_file_digest(file_digest, handle);
+
+    settings[0] = format;
+    settings[1] = options->page_no;
+    settings[2] = options->bbox_type;
+    settings[3] = pdf_get_version();
+    pdf_out_get_compression(&settings[4], &settings[5]);
+    settings[6] = (int) sizeof(double); /* entries hold raw doubles */
+    settings[7] = options->max_width;
+    settings[8] = options->max_height;
+
+    MD5_init(&md5);
+    MD5_write(&md5, file_digest, 16);
+    MD5_write(&md5, (const unsigned char *) settings, sizeof(settings));
+    MD5_final(key->digest, &md5);
+}
+
+/* -- recording -- */
+
+static void
+put_bytes (struct buffer *b, const void *data, size_t len)
+{
+    if (b->len + len > b->max) {
+        b->max = b->len + len + b->max + 4096;
+        b->data = RENEW(b->data, b->max, unsigned char);
+    }
+    if (len > 0)
+        memcpy(b->data + b->len, data, len);
+    b->len += len;
+}
+
+static void
+put_u32 (struct buffer *b, uint32_t value)
+{
+    put_bytes(b, &value, 4);
+}
+
+static void
+put_name (struct buffer *b, const char *name)
+{
+    put_u32(b, strlen(name) + 1);
+    put_bytes(b, name, strlen(name) + 1);
+}
+
+static int put_obj (pdf_obj *object, int depth);
+
+struct dict_walk {
+    int      depth;
+    uint32_t count;
+};
+
+static int
+put_dict_entry (pdf_obj *key, pdf_obj *value, void *pdata)
+{
+    struct dict_walk *walk = pdata;
+
+    walk->count++;
+    put_name(&rec.body, pdf_name_value(key));
+    return put_obj(value, walk->depth);
+}
+
+/* Append object to the record: a tag byte, then what the type needs.
+ * Returns -1 for anything that cannot be written out again. */
+static int
+put_obj (pdf_obj *object, int depth)
+{
+    struct buffer   *b = &rec.body;
+    struct dict_walk walk;
+    unsigned char    tag;
+    double           number;
+    unsigned int     i, n;
+    size_t           count_at;
+
+    if (depth > PDF_OBJ_MAX_DEPTH)
+        return -1;
+
+    switch (object ? pdf_obj_typeof(object) : PDF_NULL) {
+    case PDF_NULL:
+        put_bytes(b, "n", 1);
+        return 0;
+    case PDF_BOOLEAN:
+        tag = pdf_boolean_value(object) ? 1 : 0;
+        put_bytes(b, "b", 1);
+        put_bytes(b, &tag, 1);
+        return 0;
+    case PDF_NUMBER:
+        number = pdf_number_value(object);
+        put_bytes(b, "f", 1);
+        put_bytes(b, &number, sizeof(number));
+        return 0;
+    case PDF_STRING:
+        put_bytes(b, "s", 1);
+        put_u32(b, pdf_string_length(object));
+        put_bytes(b, pdf_string_value(object), pdf_string_length(object));
+        return 0;
+    case PDF_NAME:
+        put_bytes(b, "/", 1);
+        put_name(b, pdf_name_value(object));
+        return 0;
+    case PDF_ARRAY:
+        n = pdf_array_length(object);
+        put_bytes(b, "[", 1);
+        put_u32(b, n);
+        for (i = 0; i < n; i++) {
+            if (put_obj(pdf_get_array(object, i), depth + 1) < 0)
+                return -1;
+        }
+        return 0;
+    case PDF_DICT:
+        put_bytes(b, "<", 1);
+        count_at = b->len;
+        put_u32(b, 0);
+        walk.depth = depth + 1;
+        walk.count = 0;
+        if (pdf_foreach_dict(object, put_dict_entry, &walk) < 0)
+            return -1;
+        memcpy(b->data + count_at, &walk.count, 4);
+        return 0;
+    case PDF_INDIRECT:
+        if (pdf_ref_label(object) == 0)
+            return -1;
+        if (rec.num_refs == rec.max_refs) {
+            rec.max_refs += 16;
+            rec.refs = RENEW(rec.refs, rec.max_refs, size_t);
+        }
+        put_bytes(b, "R", 1);
+        rec.refs[rec.num_refs++] = b->len;
+        put_u32(b, pdf_ref_label(object));
+        return 0;
+    }
+    return -1;
+}
+
+static void
+record_object (void *ctx, uint32_t label, pdf_obj *object,
+               const unsigned char *data, size_t length)
+{
+    (void) ctx;
+
+    if (rec.failed)
+        return;
+    /* Only streams are replayed; anything else written meanwhile is shared
+     * with the rest of the document. */
+    if (!object || rec.body.len + length > IMAGECACHE_MAX_BYTES) {
+        rec.failed = 1;
+        return;
+    }
+
+    if (rec.count == rec.max_count) {
+        rec.max_count += 4;
+        rec.labels = RENEW(rec.labels, rec.max_count, uint32_t);
+    }
+    rec.labels[rec.count++] = label;
+
+    if (put_obj(object, 0) < 0) {
+        rec.failed = 1;
+        return;
+    }
+    put_u32(&rec.body, length);
+    put_bytes(&rec.body, data, length);
+}
+
+static void
+reset_record (void)
+{
+    free(rec.body.data);
+    free(rec.labels);
+    free(rec.refs);
+    memset(&rec, 0, sizeof(rec));
+}
+
+int
+imagecache_begin (void)
+{
+    reset_record();
+    if (pdf_out_set_capture(record_object, NULL) < 0)
+        return -1;
+    rec.active = 1;
+    return 0;
+}
+
+static int
+index_of (uint32_t label)
+{
+    int i;
+
+    for (i = 0; i < rec.count; i++) {
+        if (rec.labels[i] == label)
+            return i;
+    }
+    return -1;
+}
+
+void
+imagecache_end (const imagecache_key *key, pdf_obj *reference,
+                const ximage_info *info)
+{
+    struct buffer entry = { NULL, 0, 0 };
+    uint32_t      label;
+    int           i, main_idx;
+
+    if (!rec.active)
+        return;
+    pdf_out_set_capture(NULL, NULL);
+
+    main_idx = reference ? index_of(pdf_ref_label(reference)) : -1;
+    if (rec.failed || main_idx < 0) {
+        reset_record();
+        return;
+    }
+
+    for (i = 0; i < rec.num_refs; i++) {
+        int idx;
+
+        memcpy(&label, rec.body.data + rec.refs[i], 4);
+        idx = index_of(label);
+        if (idx < 0) {
+            reset_record();
+            return;
+        }
+        label = idx;
+        memcpy(rec.body.data + rec.refs[i], &label, 4);
+    }
+
+    put_bytes(&entry, IMAGECACHE_MAGIC, 4);
+    put_u32(&entry, 4 + 4 + 8 + 8 + 4 + 4 + rec.body.len);
+    put_u32(&entry, info->width);
+    put_u32(&entry, info->height);
+    put_bytes(&entry, &info->xdensity, sizeof(double));
+    put_bytes(&entry, &info->ydensity, sizeof(double));
+    put_u32(&entry, main_idx);
+    put_u32(&entry, rec.count);
+    put_bytes(&entry, rec.body.data, rec.body.len);
+
+    ttbc_cache_blob_put(IMAGECACHE_KIND, key->digest, entry.data, entry.len);
+    free(entry.data);
+    reset_record();
+}
+
+/* -- replay -- */
+
+struct reader {
+    const unsigned char *p, *end;
+    int                  ok;
+};
+
+static const unsigned char *
+get_bytes (struct reader *r, size_t len)
+{
+    const unsigned char *p = r->p;
+
+    if (!r->ok || (size_t) (r->end - r->p) < len) {
+        r->ok = 0;
+        return NULL;
+    }
+    r->p += len;
+    return p;
+}
+
+static uint32_t
+get_u32 (struct reader *r)
+{
+    const unsigned char *p = get_bytes(r, 4);
+    uint32_t value = 0;
+
+    if (p)
+        memcpy(&value, p, 4);
+    return value;
+}
+
+static double
+get_f64 (struct reader *r)
+{
+    const unsigned char *p = get_bytes(r, sizeof(double));
+    double value = 0.0;
+
+    if (p)
+        memcpy(&value, p, sizeof(double));
+    return value;
+}
+
+static const char *
+get_name (struct reader *r)
+{
+    uint32_t len = get_u32(r);
+    const unsigned char *p = get_bytes(r, len);
+
+    if (!p || len == 0 || p[len - 1] != '\0') {
+        r->ok = 0;
+        return NULL;
+    }
+    return (const char *) p;
+}
+
+/* The object put_obj encoded at r. References resolve to streams; without
+ * streams the encoding is only checked, and NULL returned. */
+static pdf_obj *
+get_obj (struct reader *r, pdf_obj **streams, uint32_t count, int depth)
+{
+    const unsigned char *tag, *p;
+    const char *name;
+    pdf_obj    *object = NULL, *value;
+    uint32_t    i, n;
+    double      number;
+
+    tag = get_bytes(r, 1);
+    if (!tag || depth > PDF_OBJ_MAX_DEPTH) {
+        r->ok = 0;
+        return NULL;
+    }
+
+    switch (*tag) {
+    case 'n':
+        return streams ? pdf_new_null() : NULL;
+    case 'b':
+        p = get_bytes(r, 1);
+        return p && streams ? pdf_new_boolean(*p) : NULL;
+    case 'f':
+        number = get_f64(r);
+        return r->ok && streams ? pdf_new_number(number) : NULL;
+    case 's':
+        n = get_u32(r);
+        p = get_bytes(r, n);
+        return p && streams ? pdf_new_string(p, n) : NULL;
+    case '/':
+        name = get_name(r);
+        return name && streams ? pdf_new_name(name) : NULL;
+    case '[':
+        n = get_u32(r);
+        if (streams)
+            object = pdf_new_array();
+        for (i = 0; i < n && r->ok; i++) {
+            value = get_obj(r, streams, count, depth + 1);
+            if (object && value)
+                pdf_add_array(object, value);
+        }
+        return object;
+    case '<':
+        n = get_u32(r);
+        if (streams)
+            object = pdf_new_dict();
+        for (i = 0; i < n && r->ok; i++) {
+            name = get_name(r);
+            value = get_obj(r, streams, count, depth + 1);
+            if (object && name && value)
+                pdf_add_dict(object, pdf_new_name(name), value);
+        }
+        return object;
+    case 'R':
+        n = get_u32(r);
+        if (n >= count) {
+            r->ok = 0;
+            return NULL;
+        }
+        return r->ok && streams ? pdf_ref_obj(streams[n]) : NULL;
+    }
+
+    r->ok = 0;
+    return NULL;
+}
+
+pdf_obj *
+imagecache_replay (const imagecache_key *key, ximage_info *info)
+{
+    unsigned char       *entry;
+    const unsigned char *magic, *objects;
+    size_t               len = 0;
+    struct reader        r;
+    pdf_obj            **streams, *dict, *reference;
+    uint32_t             main_idx, count, i, n;
+
+    entry = ttbc_cache_blob_get(IMAGECACHE_KIND, key->digest, &len);
+    if (!entry)
+        return NULL;
+
+    r.p = entry;
+    r.end = entry + len;
+    r.ok = 1;
+
+    magic = get_bytes(&r, 4);
+    n = get_u32(&r);
+    info->width = get_u32(&r);
+    info->height = get_u32(&r);
+    info->xdensity = get_f64(&r);
+    info->ydensity = get_f64(&r);
+    main_idx = get_u32(&r);
+    count = get_u32(&r);
+    objects = r.p;
+
+    /* A damaged or truncated entry is dropped before anything is created
+     * from it: created objects would be written out. */
+    if (!r.ok || memcmp(magic, IMAGECACHE_MAGIC, 4) || n != len - 8 ||
+        count == 0 || main_idx >= count || count > len) {
+        free(entry);
+        return NULL;
+    }
+    for (i = 0; i < count && r.ok; i++) {
+        if (r.p < r.end && *r.p != '<')
+            r.ok = 0;
+        get_obj(&r, NULL, count, 0);
+        n = get_u32(&r);
+        get_bytes(&r, n);
+    }
+    if (!r.ok || r.p != r.end) {
+        free(entry);
+        return NULL;
+    }
+
+    streams = NEW(count, pdf_obj *);
+    for (i = 0; i < count; i++)
+        streams[i] = pdf_new_stream(0);
+
+    r.p = objects;
+    for (i = 0; i < count; i++) {
+        dict = get_obj(&r, streams, count, 0);
+        pdf_merge_dict(pdf_stream_dict(streams[i]), dict);
+        pdf_release_obj(dict);
+        n = get_u32(&r);
+        pdf_add_stream(streams[i], get_bytes(&r, n), n);
+    }
+
+    /* The order they were first written in. */
+    reference = pdf_ref_obj(streams[main_idx]);
+    for (i = 0; i < count; i++)
+        pdf_release_obj(streams[i]);
+
+    free(streams);
+    free(entry);
+    return reference;
+}
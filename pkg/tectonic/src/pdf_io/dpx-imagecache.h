@@ -0,0 +1,55 @@
+/* This is dvipdfmx, an eXtended version of dvipdfm by Mark A. Wicks.
+
+    Copyright (C) 2002-2018 by Jin-Hwan Cho and Shunsaku Hirata,
+    the dvipdfmx project team.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+*/
+
+#ifndef _IMAGECACHE_H_
+#define _IMAGECACHE_H_
+
+#include "tectonic_bridge_core.h"
+#include "dpx-pdfobj.h"
+#include "dpx-pdfximage.h"
+
+/* Finished image XObjects, kept in the host's cache for later compiles. */
+
+typedef struct {
+    unsigned char digest[16];
+} imagecache_key;
+
+/* The MD5 of everything handle reads, leaving its position as it was. */
+extern void imagecache_file_digest (unsigned char digest[16], rust_input_handle_t handle);
+
+/* The key for the image read through handle as format (an IMAGE_TYPE_* of
+ * pdfximage.c) with options, under the current output settings. Leaves the
+ * handle's position as it was. */
+extern void imagecache_make_key (imagecache_key *key, rust_input_handle_t handle,
+                                 int format, const load_options *options);
+
+/* Write out the objects cached for key again. Returns a reference to the
+ * image XObject, with its size and density in info, or NULL on a miss. */
+extern pdf_obj *imagecache_replay (const imagecache_key *key, ximage_info *info);
+
+/* Record the objects written from here on, for imagecache_end. Returns -1
+ * when nothing can be recorded. */
+extern int  imagecache_begin (void);
+/* Stop recording, and store what was written under key when it is exactly
+ * the image behind reference. A NULL reference just stops. */
+extern void imagecache_end   (const imagecache_key *key, pdf_obj *reference,
+                              const ximage_info *info);
+
+#endif /* _IMAGECACHE_H_ */
@@ -33,7 +33,7 @@ void *new (uint32_t size)
     _tt_abort("Out of memory - asked for %u bytes\n", size);
   }
 
-  return result;
+  return ttbc_mem_track(result, (size_t)size);
 }
 
 void *renew (void *mem, uint32_t size)
@@ -43,7 +43,7 @@ void *renew (void *mem, uint32_t size)
     if (!result) {
       _tt_abort("Out of memory - asked for %u bytes\n", size);
     }
-    return result;
+    return ttbc_mem_retrack(mem, result, (size_t)size);
   } else {
     /* realloc may not return NULL if size == 0 */
     free(mem);
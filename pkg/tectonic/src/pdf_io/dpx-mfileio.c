@@ -98,7 +98,7 @@ mfgets (char *buffer, int length, FILE *file)
 
 
 /* Note: this is really just a random array used in other files. */
-char work_buffer[WORK_BUFFER_SIZE];
+TTBC_THREAD_LOCAL char work_buffer[WORK_BUFFER_SIZE];
 
 
 /* Modified versions of the above functions based on the Tectonic I/O system. */
@@ -35,7 +35,7 @@ int32_t file_size (FILE *file);
 
 char *mfgets (char *buffer, int length, FILE *file);
 
-extern char work_buffer[];
+extern TTBC_THREAD_LOCAL char work_buffer[];
 
 #define WORK_BUFFER_SIZE 1024
 
@@ -48,8 +48,8 @@
  * match the new xetex.def and dvipdfmx.def
  */
 
-static double Xorigin, Yorigin;
-static int    translate_origin = 0;
+static TTBC_THREAD_LOCAL double Xorigin, Yorigin;
+static TTBC_THREAD_LOCAL int    translate_origin = 0;
 
 void
 mps_set_translate_origin (int v) {
@@ -75,7 +75,7 @@ mps_set_translate_origin (int v) {
 
 static int mp_parse_body (const char **start, const char *end, double x_user, double y_user);
 
-static struct mp_font
+static TTBC_THREAD_LOCAL struct mp_font
 {
   char   *font_name;
   int     font_id;
@@ -85,7 +85,7 @@ static struct mp_font
 } font_stack[PDF_GSAVE_MAX] = {
   {NULL, -1, -1, -1, 0}
 };
-static int currentfont = 0;
+static TTBC_THREAD_LOCAL int currentfont = 0;
 
 #define CURRENT_FONT() ((currentfont < 0) ? NULL : &font_stack[currentfont])
 #define FONT_DEFINED(f) ((f) && (f)->font_name && ((f)->font_id >= 0))
@@ -108,7 +108,7 @@ clear_mp_font_struct (struct mp_font *font)
 #define MP_CMODE_MPOST    0
 #define MP_CMODE_DVIPSK   1
 #define MP_CMODE_PTEXVERT 2
-static int mp_cmode = MP_CMODE_MPOST;
+static TTBC_THREAD_LOCAL int mp_cmode = MP_CMODE_MPOST;
 
 static int
 mp_setfont (const char *font_name, double pt_size)
@@ -501,8 +501,8 @@ get_opcode (const char *token)
 
 #define PS_STACK_SIZE 1024
 
-static pdf_obj *stack[PS_STACK_SIZE];
-static unsigned int top_stack = 0;
+static TTBC_THREAD_LOCAL pdf_obj *stack[PS_STACK_SIZE];
+static TTBC_THREAD_LOCAL unsigned int top_stack = 0;
 
 #define POP_STACK()     ((top_stack > 0) ? stack[--top_stack] : NULL)
 #define PUSH_STACK(o,e) { \
@@ -851,10 +851,10 @@ do_mpost_bind_def (const char *ps_code, double x_user, double y_user)
 static int
 do_texfig_operator (int opcode, double x_user, double y_user)
 {
-  static transform_info fig_p;
-  static int in_tfig = 0;
-  static int xobj_id = -1;
-  static int count   = 0;
+  static TTBC_THREAD_LOCAL transform_info fig_p;
+  static TTBC_THREAD_LOCAL int in_tfig = 0;
+  static TTBC_THREAD_LOCAL int xobj_id = -1;
+  static TTBC_THREAD_LOCAL int count   = 0;
   double values[6];
   int    error = 0;
 
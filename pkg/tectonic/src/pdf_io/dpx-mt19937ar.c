@@ -45,6 +45,8 @@
  - These functions are exposed as aliases in dpx-mem.h
 */
 
+#include "tectonic_bridge_core.h"
+
 #include <stdio.h>
 
 /* Period parameters */
@@ -54,8 +56,8 @@
 #define UPPER_MASK 0x80000000UL /* most significant w-r bits */
 #define LOWER_MASK 0x7fffffffUL /* least significant r bits */
 
-static unsigned long mt[N]; /* the array for the state vector  */
-static int mti=N+1; /* mti==N+1 means mt[N] is not initialized */
+static TTBC_THREAD_LOCAL unsigned long mt[N]; /* the array for the state vector  */
+static TTBC_THREAD_LOCAL int mti=N+1; /* mti==N+1 means mt[N] is not initialized */
 
 void init_genrand(unsigned long long s);
 long genrand_int31(void);
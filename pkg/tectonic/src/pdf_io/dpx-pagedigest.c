@@ -0,0 +1,175 @@
+/* This is dvipdfmx, an eXtended version of dvipdfm by Mark A. Wicks.
+
+    Copyright (C) 2002-2018 by Jin-Hwan Cho and Shunsaku Hirata,
+    the dvipdfmx project team.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+*/
+
+/*
+ * The file is {"pages":["<hex>",...]}, one MD5 per page in page order, as
+ * lowercase hex. A page's digest covers its size and offsets, its DVI
+ * bytes except the pointer back to the previous page (which moves when an
+ * earlier page grows), the definitions of the fonts it selects, which live
+ * in the postamble, and the contents of the image files it includes. Two
+ * compiles giving a page the same digest render it the same, short of
+ * changes to font files or to named XObjects defined on other pages.
+ * A page written blank in place of its content has null instead (see
+ * pagedigest_skip_page), as it renders like no compile's page does.
+ */
+
+#include "dpx-pagedigest.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "tectonic_bridge_core.h"
+#include "dpx-dpxcrypt.h"
+#include "dpx-error.h"
+#include "dpx-mem.h"
+
+#define PAGEDIGEST_SUFFIX ".pages.json"
+
+static TTBC_THREAD_LOCAL struct {
+    int            enabled, in_page;
+    MD5_CONTEXT    md5;
+    unsigned char *digests; /* 16 bytes a page */
+    unsigned int   count, max_count;
+} pd;
+
+void
+pagedigest_reset (void)
+{
+    free(pd.digests);
+    memset(&pd, 0, sizeof pd);
+}
+
+void
+pagedigest_enable (void)
+{
+    pd.enabled = 1;
+}
+
+void
+pagedigest_begin_page (double width, double height, double x_offset, double y_offset)
+{
+    double box[4];
+
+    if (!pd.enabled)
+        return;
+
+    box[0] = width;
+    box[1] = height;
+    box[2] = x_offset;
+    box[3] = y_offset;
+    MD5_init(&pd.md5);
+    MD5_write(&pd.md5, (const unsigned char *) box, sizeof box);
+    pd.in_page = 1;
+}
+
+void
+pagedigest_end_page (void)
+{
+    if (!pd.in_page)
+        return;
+    pd.in_page = 0;
+
+    if (pd.count == pd.max_count) {
+        pd.max_count += 64;
+        pd.digests = RENEW(pd.digests, pd.max_count * 16, unsigned char);
+    }
+    MD5_final(pd.digests + pd.count * 16, &pd.md5);
+    pd.count++;
+}
+
+int
+pagedigest_active (void)
+{
+    return pd.in_page;
+}
+
+void
+pagedigest_add (const void *data, size_t length)
+{
+    if (pd.in_page)
+        MD5_write(&pd.md5, data, (unsigned int) length);
+}
+
+/* an all-zero digest stands for the page left out; MD5 does not give it */
+void
+pagedigest_skip_page (void)
+{
+    if (!pd.enabled)
+        return;
+
+    if (pd.count == pd.max_count) {
+        pd.max_count += 64;
+        pd.digests = RENEW(pd.digests, pd.max_count * 16, unsigned char);
+    }
+    memset(pd.digests + pd.count * 16, 0, 16);
+    pd.count++;
+}
+
+static int
+is_skipped (const unsigned char *digest)
+{
+    int j;
+
+    for (j = 0; j < 16; j++) {
+        if (digest[j])
+            return 0;
+    }
+    return 1;
+}
+
+void
+pagedigest_finish (const char *pdf_filename)
+{
+    rust_output_handle_t out;
+    char *name, hex[33];
+    size_t len;
+    unsigned int i, j;
+
+    if (!pd.enabled)
+        return;
+
+    len = strlen(pdf_filename);
+    if (len > 4 && !strcmp(pdf_filename + len - 4, ".pdf"))
+        len -= 4;
+    name = NEW(len + strlen(PAGEDIGEST_SUFFIX) + 1, char);
+    memcpy(name, pdf_filename, len);
+    strcpy(name + len, PAGEDIGEST_SUFFIX);
+
+    out = ttbc_output_open(name, 0);
+    if (out == INVALID_HANDLE) {
+        dpx_warning("Could not write page digests to \"%s\".", name);
+    } else {
+        ttstub_fprintf(out, "{\"pages\":[");
+        for (i = 0; i < pd.count; i++) {
+            if (is_skipped(pd.digests + i * 16)) {
+                ttstub_fprintf(out, "%s\nnull", i > 0 ? "," : "");
+                continue;
+            }
+            for (j = 0; j < 16; j++)
+                sprintf(hex + 2 * j, "%02x", pd.digests[i * 16 + j]);
+            ttstub_fprintf(out, "%s\n\"%s\"", i > 0 ? "," : "", hex);
+        }
+        ttstub_fprintf(out, "\n]}\n");
+        ttbc_output_close(out);
+    }
+
+    free(name);
+    pagedigest_reset();
+}
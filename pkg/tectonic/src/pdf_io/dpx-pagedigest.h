@@ -0,0 +1,49 @@
+/* This is dvipdfmx, an eXtended version of dvipdfm by Mark A. Wicks.
+
+    Copyright (C) 2002-2018 by Jin-Hwan Cho and Shunsaku Hirata,
+    the dvipdfmx project team.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+*/
+
+#ifndef _PAGEDIGEST_H_
+#define _PAGEDIGEST_H_
+
+#include "tectonic_bridge_core.h"
+
+/* A digest per page of what went into it -- its DVI bytes, its size, the
+ * fonts it selects, the image files it includes -- written out as
+ * <name>.pages.json beside the PDF, so that whoever shows the PDF can tell
+ * which pages a compile changed. */
+
+extern void pagedigest_reset  (void);
+/* Digest the pages of this run, for pagedigest_finish. */
+extern void pagedigest_enable (void);
+
+extern void pagedigest_begin_page (double width, double height,
+                                   double x_offset, double y_offset);
+extern void pagedigest_end_page   (void);
+/* Whether a page is being digested. */
+extern int  pagedigest_active     (void);
+/* Fold data into the digest of the current page; nothing between pages. */
+extern void pagedigest_add        (const void *data, size_t length);
+/* A page written without its content: no digest, null in the file. */
+extern void pagedigest_skip_page  (void);
+
+/* Write the digests to pdf_filename with .pdf replaced by .pages.json, and
+ * forget them. */
+extern void pagedigest_finish (const char *pdf_filename);
+
+#endif /* _PAGEDIGEST_H_ */
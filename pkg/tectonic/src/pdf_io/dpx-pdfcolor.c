@@ -367,7 +367,7 @@ pdf_color_set_color (const pdf_color *color, char *buffer, size_t buffer_len,cha
   return len;
 }
 
-pdf_color current_fill   = {
+TTBC_THREAD_LOCAL pdf_color current_fill   = {
   -1,
   PDF_COLORSPACE_TYPE_GRAY,
   1,
@@ -376,7 +376,7 @@ pdf_color current_fill   = {
   -1
 };
 
-pdf_color current_stroke = {
+TTBC_THREAD_LOCAL pdf_color current_stroke = {
   -1,
   PDF_COLORSPACE_TYPE_GRAY,
   1,
@@ -420,7 +420,7 @@ pdf_color_compare (const pdf_color *color1, const pdf_color *color2)
 }
 
 /* Dvipdfm special */
-pdf_color default_color = {
+TTBC_THREAD_LOCAL pdf_color default_color = {
   -1,
   PDF_COLORSPACE_TYPE_GRAY,
   1,
@@ -431,7 +431,7 @@ pdf_color default_color = {
 
 #define DEV_COLOR_STACK_MAX 128
 
-static struct {
+static TTBC_THREAD_LOCAL struct {
   int       current;
   pdf_color stroke[DEV_COLOR_STACK_MAX];
   pdf_color fill[DEV_COLOR_STACK_MAX];
@@ -499,7 +499,7 @@ pdf_color_get_current (pdf_color **sc, pdf_color **fc)
 static int pdf_colorspace_defineresource (const char *ident, int subtype, void *cdata, pdf_obj *resource);
 static int pdf_colorspace_findresource   (const char *ident, int subtype, const void *cdata);
 
-static unsigned char  nullbytes16[16] = {
+static TTBC_THREAD_LOCAL unsigned char  nullbytes16[16] = {
   0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
 };
 
@@ -1133,7 +1133,7 @@ typedef struct {
   void    *cdata;
 } pdf_colorspace;
 
-static struct {
+static TTBC_THREAD_LOCAL struct {
   unsigned int count;
   unsigned int capacity;
   pdf_colorspace *colorspaces;
@@ -242,7 +242,7 @@ struct pdf_dev {
  * For a moment declare as static variable here
  * 2020/07/23 Most of the static variables put into single struct pdev
  */
-static pdf_dev pdev;
+static TTBC_THREAD_LOCAL pdf_dev pdev;
 
 static pdf_dev *
 current_device (void)
@@ -344,7 +344,24 @@ p_dtoa (double value, int prec, char *buf)
   }
 
   if (i) {
-    int m = sprintf(c, "%.0f", i);
+    int m;
+    /* Content streams are mostly coordinates below a few thousand bp:
+     * write the integer part digit by digit, and leave the rare huge
+     * value to sprintf. */
+    if (i < 1e18) {
+      uint64_t u = (uint64_t) i;
+      char     digits[20];
+      int      k = 0;
+      do {
+        digits[k++] = (char) ('0' + u % 10);
+        u /= 10;
+      } while (u != 0);
+      for (m = 0; k > 0; m++)
+        c[m] = digits[--k];
+      c[m] = '\0';
+    } else {
+      m = sprintf(c, "%.0f", i);
+    }
     c += m;
     n += m;
   } else if (g == 0) {
@@ -909,7 +926,7 @@ pdf_dev_set_font (pdf_dev *p, int font_id)
 /* These tmp buffers can't be removed since the pointer to this can be
  * used as the return value of handle_multibyte_string(): str_ptr can point these.
  */
-static unsigned char sbuf0[FORMAT_BUF_SIZE];
+static TTBC_THREAD_LOCAL unsigned char sbuf0[FORMAT_BUF_SIZE];
 
 static int
 handle_multibyte_string (struct dev_font *font,
@@ -92,7 +92,7 @@ read_thumbnail (const char *thumb_filename)
 }
 
 /* Sorry no appropriate place to put this... */
-struct ht_table *global_names = NULL;
+TTBC_THREAD_LOCAL struct ht_table *global_names = NULL;
 
 typedef struct pdf_form
 {
@@ -224,7 +224,7 @@ typedef struct pdf_doc
 
   char *thumb_basename;
 } pdf_doc;
-static pdf_doc pdoc;
+static TTBC_THREAD_LOCAL pdf_doc pdoc;
 
 static void
 pdf_doc_init_catalog (pdf_doc *p)
@@ -2347,7 +2347,7 @@ pdf_doc_finish_page (pdf_doc *p)
   return;
 }
 
-static pdf_color bgcolor = { -1, PDF_COLORSPACE_TYPE_GRAY, 1, NULL, { 1.0 }, -1};
+static TTBC_THREAD_LOCAL pdf_color bgcolor = { -1, PDF_COLORSPACE_TYPE_GRAY, 1, NULL, { 1.0 }, -1};
 
 void
 pdf_doc_set_bgcolor (const pdf_color *color)
@@ -2453,6 +2453,7 @@ pdf_open_document (const char *filename,
               settings.object.compression_level,
               settings.enable_encrypt,
                settings.object.enable_objstm, settings.object.enable_predictor);
+  pdf_out_set_compression_threads(settings.object.compression_threads);
   pdf_files_init();
 
   pdf_doc_init_catalog(p);
@@ -2722,7 +2723,7 @@ pdf_doc_end_grabbing (pdf_obj *attrib)
   return;
 }
 
-static struct
+static TTBC_THREAD_LOCAL struct
 {
   int      dirty;
   int      broken;
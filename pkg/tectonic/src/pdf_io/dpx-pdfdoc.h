@@ -61,6 +61,7 @@ struct pdf_obj_setting {
     int         enable_objstm;
     int         enable_predictor;
     int compression_level;
+    int compression_threads;
 };
 
 struct pdf_setting
@@ -174,6 +175,6 @@ void     pdf_doc_enable_manual_thumbnails (void);
 void     pdf_doc_set_bgcolor   (const pdf_color *color);
 
 /* Sorry no appropriate place to put this... */
-extern struct ht_table *global_names;
+extern TTBC_THREAD_LOCAL struct ht_table *global_names;
 
 #endif /* _PDFDOC_H_ */
@@ -227,7 +227,7 @@ static const struct {
 
 
 #define FORMAT_BUFF_LEN 1024
-static char    fmt_buf[FORMAT_BUFF_LEN];
+static TTBC_THREAD_LOCAL char    fmt_buf[FORMAT_BUFF_LEN];
 
 static void
 init_a_path (pdf_path *p)
@@ -808,8 +808,8 @@ pdf_dev__flushpath (pdf_path  *pa,
 }
 
 /* ExtGState stack */
-static dpx_stack xgs_stack;
-static int       xgs_count = 0;
+static TTBC_THREAD_LOCAL dpx_stack xgs_stack;
+static TTBC_THREAD_LOCAL int       xgs_count = 0;
 
 struct xgs_res {
   pdf_obj *object;
@@ -878,7 +878,7 @@ typedef struct pdf_gstate_
   pdf_obj *extgstate;
 } pdf_gstate;
 
-static dpx_stack gs_stack = { 0, NULL, NULL };
+static TTBC_THREAD_LOCAL dpx_stack gs_stack = { 0, NULL, NULL };
 
 static void
 init_a_gstate (pdf_gstate *gs)
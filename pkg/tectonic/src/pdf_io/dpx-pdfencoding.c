@@ -31,6 +31,7 @@
 
 #include "tectonic_bridge_core.h"
 #include "dpx-dpxconf.h"
+#include "dpx-dpxcrypt.h"
 #include "dpx-dpxfile.h"
 #include "dpx-error.h"
 #include "dpx-mem.h"
@@ -246,6 +247,101 @@ make_encoding_differences (char **enc_vec, const char **baseenc, const char *is_
 }
 
 
+/*
+ * An encoding file parses to the same 256 glyph names every time, so the
+ * names of a file that parsed are kept in the host's cache under the MD5 of
+ * its contents, next to the CMaps (see dpx-cmap.c). The PostScript array is
+ * only parsed on a miss.
+ *
+ * An entry, in host byte order: "DPXE", then the encoding name and the 256
+ * glyph names, each as u32 length + 1 (0 for none) and the bytes.
+ */
+
+#define ENCODING_CACHE_KIND  "encoding1"
+#define ENCODING_CACHE_MAGIC "DPXE"
+
+static void
+encoding_cache_store (const unsigned char digest[16],
+                      const char *enc_name, const char **enc_vec)
+{
+    unsigned char *data, *p;
+    size_t         len = 4 + 4 + (enc_name ? strlen(enc_name) : 0);
+    int            code;
+
+    for (code = 0; code < 256; code++)
+        len += 4 + (enc_vec[code] ? strlen(enc_vec[code]) : 0);
+
+    data = p = NEW(len, unsigned char);
+    memcpy(p, ENCODING_CACHE_MAGIC, 4);
+    p += 4;
+    for (code = -1; code < 256; code++) {
+        const char *s = code < 0 ? enc_name : enc_vec[code];
+        uint32_t    n = s ? (uint32_t) strlen(s) : 0;
+        uint32_t    n1 = s ? n + 1 : 0;
+
+        memcpy(p, &n1, 4);
+        p += 4;
+        if (n > 0)
+            memcpy(p, s, n);
+        p += n;
+    }
+
+    ttbc_cache_blob_put(ENCODING_CACHE_KIND, digest, data, len);
+    free(data);
+}
+
+/* Register the encoding cached under digest. Returns -1 when there is none
+ * or it does not read back. */
+static int
+encoding_cache_load (const unsigned char digest[16], const char *filename)
+{
+    unsigned char       *blob;
+    const unsigned char *p, *end;
+    char                *strings[257];
+    size_t               len = 0;
+    int                  i, n = 0, enc_id = -1;
+
+    blob = ttbc_cache_blob_get(ENCODING_CACHE_KIND, digest, &len);
+    if (!blob)
+        return -1;
+    if (len < 4 || memcmp(blob, ENCODING_CACHE_MAGIC, 4) != 0) {
+        free(blob);
+        return -1;
+    }
+    p   = blob + 4;
+    end = blob + len;
+
+    for (; n < 257; n++) {
+        uint32_t n1;
+
+        if (end - p < 4)
+            break;
+        memcpy(&n1, p, 4);
+        p += 4;
+        strings[n] = NULL;
+        if (n1 == 0)
+            continue;
+        if ((size_t) (end - p) < n1 - 1)
+            break;
+        strings[n] = NEW(n1, char);
+        memcpy(strings[n], p, n1 - 1);
+        strings[n][n1 - 1] = '\0';
+        p += n1 - 1;
+    }
+
+    if (n == 257 && p == end) {
+        enc_id = pdf_encoding_new_encoding(strings[0], filename,
+                                           (const char **) strings + 1, 0);
+        if (strings[0] && dpx_conf.verbose_level > 1)
+            dpx_message("[%s]", strings[0]);
+    }
+    for (i = 0; i < n; i++)
+        free(strings[i]);
+    free(blob);
+
+    return enc_id;
+}
+
 static int
 load_encoding_file (const char *filename)
 {
@@ -255,6 +351,8 @@ load_encoding_file (const char *filename)
     char *wbuf;
     const char *p, *endptr;
     const char *enc_vec[256];
+    unsigned char digest[16];
+    MD5_CONTEXT md5;
     int code, fsize, enc_id;
 
     if (!filename)
@@ -274,6 +372,17 @@ load_encoding_file (const char *filename)
         _tt_abort("error reading %s", filename);
     ttstub_input_close(handle);
 
+    MD5_init(&md5);
+    MD5_write(&md5, (const unsigned char *) wbuf, (unsigned int) fsize);
+    MD5_final(digest, &md5);
+    enc_id = encoding_cache_load(digest, filename);
+    if (enc_id >= 0) {
+        free(wbuf);
+        if (dpx_conf.verbose_level > 0)
+            dpx_message(")");
+        return enc_id;
+    }
+
     p = wbuf;
     endptr = wbuf + fsize;
 
@@ -304,6 +413,7 @@ load_encoding_file (const char *filename)
 
     enc_id = pdf_encoding_new_encoding(enc_name ? pdf_name_value(enc_name) : NULL,
                                        filename, enc_vec, 0);
+    encoding_cache_store(digest, enc_name ? pdf_name_value(enc_name) : NULL, enc_vec);
 
     if (enc_name) {
         if (dpx_conf.verbose_level > 1)
@@ -328,7 +438,7 @@ load_encoding_file (const char *filename)
 
 #define CACHE_ALLOC_SIZE 16u
 
-static struct {
+static TTBC_THREAD_LOCAL struct {
     int           count;
     int           capacity;
     pdf_encoding *encodings;
@@ -571,8 +681,8 @@ pdf_encoding_get_name (int enc_id)
 
 
 #define WBUF_SIZE 1024
-static unsigned char wbuf[WBUF_SIZE];
-static unsigned char range_min[1] = {0x00u};
+static TTBC_THREAD_LOCAL unsigned char wbuf[WBUF_SIZE];
+static TTBC_THREAD_LOCAL unsigned char range_min[1] = {0x00u};
 static unsigned char range_max[1] = {0xFFu};
 
 void
@@ -697,7 +807,7 @@ pdf_load_ToUnicode_stream (const char *ident)
     }
 
     cmap = CMap_new();
-    if (CMap_parse(cmap, handle) < 0) {
+    if (CMap_parse_cached(cmap, handle) < 0) {
         dpx_warning("Reading CMap file \"%s\" failed.", ident);
     } else {
         if (dpx_conf.verbose_level > 0)
@@ -65,8 +65,8 @@ pdf_font_set_dpi (int font_dpi)
  * xdvipdfmx behavior, it is a boolean flag indicating whether we need to seed
  * the random number generator (`first` in the reference source).
  */
-static int unique_tag_state = 1;
-static int unique_tags_deterministic = 0;
+static TTBC_THREAD_LOCAL int unique_tag_state = 1;
+static TTBC_THREAD_LOCAL int unique_tags_deterministic = 0;
 
 void
 pdf_font_reset_unique_tag_state(void)
@@ -253,7 +253,7 @@ pdf_clean_font_struct (pdf_font *font)
 
 #define CACHE_ALLOC_SIZE 16u
 
-static struct {
+static TTBC_THREAD_LOCAL struct {
   int       count;
   int       capacity;
   pdf_font *fonts;
@@ -515,7 +515,7 @@ try_load_ToUnicode_CMap (pdf_font *font)
 void
 pdf_close_fonts (void)
 {
-  int  font_id;
+  int  font_id, mem_tag;
 
   for (font_id = 0; font_id < font_cache.count; font_id++) {
     pdf_font  *font;
@@ -554,6 +554,9 @@ pdf_close_fonts (void)
       }
     }
 
+    ttbc_fire_checkpoint(TTBC_CHECKPOINT_FONT_EMBED_BEGIN, font->filename);
+    mem_tag = ttbc_mem_set_tag(TTBC_MEM_FONTS);
+
     /* Must come before load_xxx */
     try_load_ToUnicode_CMap(font);
 
@@ -597,6 +600,9 @@ pdf_close_fonts (void)
         dpx_message(")");
       }
     }
+
+    ttbc_mem_set_tag(mem_tag);
+    ttbc_fire_checkpoint(TTBC_CHECKPOINT_FONT_EMBED_END, NULL);
   }
 
   pdf_encoding_complete();
@@ -614,7 +620,11 @@ pdf_close_fonts (void)
     switch (font->subtype) {
     case PDF_FONT_FONTTYPE_CIDTYPE0:
     case PDF_FONT_FONTTYPE_CIDTYPE2:
+      ttbc_fire_checkpoint(TTBC_CHECKPOINT_FONT_EMBED_BEGIN, font->filename);
+      mem_tag = ttbc_mem_set_tag(TTBC_MEM_FONTS);
       pdf_font_load_cidfont(font);
+      ttbc_mem_set_tag(mem_tag);
+      ttbc_fire_checkpoint(TTBC_CHECKPOINT_FONT_EMBED_END, NULL);
       break;
     }
   }
@@ -680,6 +690,7 @@ pdf_close_fonts (void)
   font_cache.capacity = 0;
 
   CMap_cache_close();
+  otf_inverse_cmap_cache_close();
   pdf_close_encodings();
 
   agl_close_map (); /* After encoding */
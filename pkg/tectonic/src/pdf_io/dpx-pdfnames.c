@@ -45,7 +45,7 @@ static char *
 printable_key (const char *key, int keylen)
 {
 #define MAX_KEY 32
-  static char pkey[MAX_KEY+4];
+  static TTBC_THREAD_LOCAL char pkey[MAX_KEY+4];
   int    i, len;
   unsigned char hi, lo;
 
@@ -29,6 +29,7 @@
 #include <string.h>
 
 #include "dpx-dpxconf.h"
+#include "dpx-dpxcrypt.h"
 #include "dpx-dpxutil.h"
 #include "dpx-error.h"
 #include "dpx-mem.h"
@@ -103,6 +104,22 @@ struct pdf_dict
     struct pdf_dict *next;
 };
 
+/* The entries of a dict are a list, in the order they were added, ended by
+ * a node whose key is NULL. Keys are compared by their interned name (see
+ * intern_name). From DICT_INDEX_MIN entries on, an open-addressed index by
+ * that pointer finds them; removing an entry drops the index until the next
+ * search. */
+struct pdf_dict_head
+{
+    struct pdf_dict  *first;
+    struct pdf_dict  *last;
+    struct pdf_dict **index;
+    uint32_t          count;
+    uint32_t          index_mask;
+};
+
+#define DICT_INDEX_MIN 16
+
 /* DecodeParms for FlateDecode */
 struct decode_parms {
     int     predictor;
@@ -148,9 +165,100 @@ typedef struct pdf_string   pdf_string;
 typedef struct pdf_name     pdf_name;
 typedef struct pdf_array    pdf_array;
 typedef struct pdf_dict     pdf_dict;
+typedef struct pdf_dict_head pdf_dict_head;
 typedef struct pdf_stream   pdf_stream;
 typedef struct pdf_indirect pdf_indirect;
 
+/* pdf_obj and the payloads of the small types come from slab pools: a
+ * document makes and releases them by the hundred thousand, and a free list
+ * leaves malloc to the slabs. The slabs are given back together by
+ * pdf_obj_pools_close once no object is alive. */
+typedef union pdf_small
+{
+    struct pdf_boolean  boolean;
+    struct pdf_number   number;
+    struct pdf_string   string;
+    struct pdf_name     name;
+    struct pdf_array    array;
+    struct pdf_dict     dict;
+    struct pdf_dict_head dict_head;
+    struct pdf_indirect indirect;
+} pdf_small;
+
+struct obj_pool
+{
+    size_t   size;       /* of a node; free nodes are linked through it */
+    void    *free;
+    void    *slabs;      /* linked through their first node */
+    size_t   live;
+    uint64_t allocs;
+    unsigned num_slabs;
+};
+
+#define POOL_SLAB_NODES 1024
+
+static TTBC_THREAD_LOCAL struct obj_pool obj_pool   = { sizeof(struct pdf_obj), NULL, NULL, 0, 0, 0 };
+static TTBC_THREAD_LOCAL struct obj_pool small_pool = { sizeof(pdf_small), NULL, NULL, 0, 0, 0 };
+
+static void *
+pool_alloc (struct obj_pool *pool)
+{
+    void *node;
+
+    if (!pool->free) {
+        char  *slab = NEW(pool->size * (POOL_SLAB_NODES + 1), char);
+        size_t i;
+
+        *(void **) slab = pool->slabs;
+        pool->slabs = slab;
+        pool->num_slabs++;
+        for (i = POOL_SLAB_NODES; i > 0; i--) {
+            node = slab + i * pool->size;
+            *(void **) node = pool->free;
+            pool->free = node;
+        }
+    }
+
+    node = pool->free;
+    pool->free = *(void **) node;
+    pool->live++;
+    pool->allocs++;
+
+    return node;
+}
+
+static void
+pool_free (struct obj_pool *pool, void *node)
+{
+    if (!node)
+        return;
+
+    *(void **) node = pool->free;
+    pool->free = node;
+    pool->live--;
+}
+
+static void
+pool_close (struct obj_pool *pool)
+{
+    /* an object still alive (leaked, or kept by a run that aborted) keeps
+     * its slab, and the rest with it, for the next run on this thread */
+    if (pool->live == 0) {
+        while (pool->slabs) {
+            void *next = *(void **) pool->slabs;
+
+            free(pool->slabs);
+            pool->slabs = next;
+        }
+        pool->free = NULL;
+        pool->num_slabs = 0;
+    }
+    pool->allocs = 0;
+}
+
+#define NEW_SMALL(type) ((type *) pool_alloc(&small_pool))
+#define FREE_SMALL(p)   pool_free(&small_pool, (p))
+
 typedef struct xref_entry
 {
     unsigned char  type;       /* object storage type              */
@@ -169,6 +277,7 @@ struct pdf_file
     int         num_obj;
     int         file_size;
     unsigned int version;
+    unsigned int last_used; /* pdf_open tick, for trimming (see pdf_open) */
 };
 
 /* Tectonic: no error_out; it's for debugging and breaks I/O encapsulation */
@@ -176,6 +285,36 @@ struct pdf_file
 #define OBJSTM_MAX_OBJS  200
 /* the limit is only 100 for linearized PDF */
 
+/* Streams shorter than this are not worth a thread of their own. */
+#define DEFERRED_MIN_LENGTH 4096
+
+/* A PNG predictor left to run on the compression thread (see defer_stream). */
+struct png_predictor {
+    int32_t columns;
+    int32_t rows;
+    int8_t  bpc;
+    int8_t  colors;
+};
+
+/* A stream released while its data is deflated in the background. */
+struct deferred_stream {
+    pdf_obj       *dict;
+    uint32_t       label;
+    uint16_t       generation;
+    int32_t        flags;
+    unsigned char *data;     /* deflate's input */
+    size_t         length;
+    int            had_filters;
+    struct png_predictor *png;  /* run by the job, or NULL */
+    void          *job;
+};
+
+/* A stream given out by pdf_ref_shared_stream. */
+struct shared_stream {
+    unsigned char digest[16];  /* of its dict and data */
+    pdf_obj      *ref;
+};
+
 struct pdf_out {
   struct {
     int         enc_mode; /* boolean */
@@ -193,6 +332,7 @@ struct pdf_out {
     struct {
       int       level;
       int       use_predictor;
+      int       threads; /* deflating at once; 0 = all inline */
     } compression;
 
     int         enable_encrypt;
@@ -220,6 +360,25 @@ struct pdf_out {
   pdf_obj      *xref_stream;
   pdf_obj      *output_stream;
   pdf_obj      *current_objstm;
+
+  /* streams being deflated, oldest first (see defer_stream) */
+  struct deferred_stream *deferred;
+  int           num_deferred;
+
+  /* see pdf_out_set_capture */
+  struct {
+    pdf_capture_fn fn;
+    void          *ctx;
+    uint32_t       label; /* of the object being flushed */
+  } capture;
+
+  /* see pdf_ref_shared_stream */
+  struct {
+    struct shared_stream *entries;
+    int                   count;
+    int                   capacity;
+  } shared;
+
   /* The following flag bits are (8,338,607+1)/8 bytes data
    * each bit represenging if the object is freed.
    * Where the value 8,338,607 is taken from PDF ref. manual, v.1.7,
@@ -230,12 +389,12 @@ struct pdf_out {
 
 /* Underway to reform PDF related code... For a moment place pdf_out
  * object as a static variable. */
-static pdf_out pout;
+static TTBC_THREAD_LOCAL pdf_out pout;
 
 /* Tectonic: during the XeTeX pass, if a PDF is loaded as an image,
  * the current_output can be accessed without init_pdf_out_struct having
  * been called. So we add a flag to ensure that it's always initialized. */
-static int tectonic_pout_initialized = 0;
+static TTBC_THREAD_LOCAL int tectonic_pout_initialized = 0;
 static void init_pdf_out_struct (pdf_out *p);
 
 static pdf_out *
@@ -262,6 +421,7 @@ init_pdf_out_struct (pdf_out *p)
 
   p->options.compression.level = 9;
   p->options.compression.use_predictor = 1;
+  p->options.compression.threads = 0;
   p->options.enable_encrypt    = 0;
   p->options.use_objstm        = 1;
 
@@ -282,6 +442,17 @@ init_pdf_out_struct (pdf_out *p)
   p->output_stream  = NULL;
   p->current_objstm = NULL;
 
+  p->deferred     = NULL;
+  p->num_deferred = 0;
+
+  p->capture.fn    = NULL;
+  p->capture.ctx   = NULL;
+  p->capture.label = 0;
+
+  p->shared.entries  = NULL;
+  p->shared.count    = 0;
+  p->shared.capacity = 0;
+
   p->free_list = NEW((PDF_NUM_INDIRECT_MAX+1)/8, char);
   memset(p->free_list, 0, (PDF_NUM_INDIRECT_MAX+1)/8);
   tectonic_pout_initialized = 1;
@@ -290,8 +461,14 @@ init_pdf_out_struct (pdf_out *p)
 static void
 clean_pdf_out_struct (pdf_out *p)
 {
+  int i;
+
+  for (i = 0; i < p->shared.count; i++)
+    pdf_release_obj(p->shared.entries[i].ref);
+  free(p->shared.entries);
   if (p->free_list)
     free(p->free_list);
+  free(p->deferred);
   memset(p, 0, sizeof(pdf_out));
 }
 
@@ -331,10 +508,12 @@ static void release_name (pdf_name *name);
 static void write_array   (pdf_out *p, pdf_array *array);
 static void release_array (pdf_array *array);
 
-static void write_dict   (pdf_out *p, pdf_dict *dict);
-static void release_dict (pdf_dict *dict);
+static void write_dict   (pdf_out *p, pdf_dict_head *dict);
+static void release_dict (pdf_dict_head *dict);
 
 static void write_stream   (pdf_out *p, pdf_stream *stream);
+static void write_deferred (pdf_out *p);
+static void discard_deferred (pdf_out *p);
 static void release_stream (pdf_stream *stream);
 
 static void
@@ -395,6 +574,42 @@ pdf_get_version_minor (void)
     return p->version.minor;
 }
 
+void
+pdf_out_get_compression (int *level, int *use_predictor)
+{
+    pdf_out *p = current_output();
+    *level = p->options.compression.level;
+    *use_predictor = p->options.compression.use_predictor;
+}
+
+void
+pdf_out_set_compression_threads (int threads)
+{
+    pdf_out *p = current_output();
+
+    while (p->num_deferred > 0)
+        write_deferred(p);
+    p->deferred = mfree(p->deferred);
+    p->options.compression.threads = threads > 0 ? threads : 0;
+    if (p->options.compression.threads > 0)
+        p->deferred = NEW(p->options.compression.threads, struct deferred_stream);
+}
+
+int
+pdf_out_set_capture (pdf_capture_fn fn, void *ctx)
+{
+    pdf_out *p = current_output();
+
+    if (fn && p->output.handle == INVALID_HANDLE)
+        return -1;
+    /* what is still being deflated was released before this point */
+    while (p->num_deferred > 0)
+        write_deferred(p);
+    p->capture.fn  = fn;
+    p->capture.ctx = ctx;
+    return 0;
+}
+
 int
 pdf_check_version (int major, int minor)
 {
@@ -643,6 +858,9 @@ pdf_out_flush (void)
             p->current_objstm =NULL;
         }
 
+        while (p->num_deferred > 0)
+            write_deferred(p);
+
         /*
          * Label xref stream - we need the number of correct objects
          * for the xref stream dictionary (= trailer).
@@ -702,6 +920,7 @@ pdf_error_cleanup (void)
      * This routine is the cleanup required for an abnormal exit.
      * For now, simply close the file.
      */
+    discard_deferred(p);
     if (p->output.handle) {
         ttbc_output_close(p->output.handle);
         p->output.handle = INVALID_HANDLE;
@@ -824,7 +1043,7 @@ pdf_new_obj(int type)
     if (type > PDF_UNDEFINED || type < 0)
         _tt_abort("Invalid object type: %d", type);
 
-    result = NEW(1, pdf_obj);
+    result = pool_alloc(&obj_pool);
     result->type  = type;
     result->data  = NULL;
     result->label      = 0;
@@ -916,10 +1135,142 @@ pdf_ref_obj (pdf_obj *object)
     }
 }
 
+/* Hash object as it would be written; -1 for what cannot be compared
+ * (a stream within, or a reference into a PDF being read). */
+static int
+digest_obj (MD5_CONTEXT *md5, pdf_obj *object, int depth)
+{
+    unsigned char type;
+
+    if (depth > PDF_OBJ_MAX_DEPTH)
+        return -1;
+
+    type = object ? object->type : PDF_NULL;
+    MD5_write(md5, &type, 1);
+    switch (type) {
+    case PDF_NULL:
+        break;
+    case PDF_BOOLEAN:
+        MD5_write(md5, (const unsigned char *) &((pdf_boolean *) object->data)->value, 1);
+        break;
+    case PDF_NUMBER:
+        MD5_write(md5, (const unsigned char *) &((pdf_number *) object->data)->value,
+                  sizeof(double));
+        break;
+    case PDF_STRING: {
+        pdf_string *data = object->data;
+        uint32_t    len = (uint32_t) data->length;
+
+        MD5_write(md5, (const unsigned char *) &len, sizeof(len));
+        if (len > 0)
+            MD5_write(md5, data->string, len);
+        break;
+    }
+    case PDF_NAME: {
+        const char *name = ((pdf_name *) object->data)->name;
+
+        MD5_write(md5, (const unsigned char *) name, strlen(name) + 1);
+        break;
+    }
+    case PDF_ARRAY: {
+        pdf_array *data = object->data;
+        uint32_t   len = (uint32_t) data->size, i;
+
+        MD5_write(md5, (const unsigned char *) &len, sizeof(len));
+        for (i = 0; i < len; i++) {
+            if (digest_obj(md5, data->values[i], depth + 1) < 0)
+                return -1;
+        }
+        break;
+    }
+    case PDF_DICT: {
+        pdf_dict *data = ((pdf_dict_head *) object->data)->first;
+
+        for (; data->key != NULL; data = data->next) {
+            if (digest_obj(md5, data->key, depth + 1) < 0 ||
+                digest_obj(md5, data->value, depth + 1) < 0)
+                return -1;
+        }
+        type = 0; /* ends the entries */
+        MD5_write(md5, &type, 1);
+        break;
+    }
+    case PDF_INDIRECT: {
+        pdf_indirect *data = object->data;
+
+        if (data->pf)
+            return -1;
+        MD5_write(md5, (const unsigned char *) &data->label, sizeof(data->label));
+        MD5_write(md5, (const unsigned char *) &data->generation, sizeof(data->generation));
+        break;
+    }
+    default:
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * A reference to stream, or to an earlier stream with the same dict and
+ * data. Images come out the same more than once when a document includes
+ * one file under several names, or copies of it, as a report does with a
+ * logo on every page; this writes the first and refers every later one to
+ * it. References within the dict compare by object number, so an image
+ * whose SMask was shared this way matches too. The stream must not have
+ * been referred to yet; the caller releases it as after pdf_ref_obj.
+ */
+pdf_obj *
+pdf_ref_shared_stream (pdf_obj *stream)
+{
+    pdf_out       *p = current_output();
+    pdf_stream    *data;
+    MD5_CONTEXT    md5;
+    unsigned char  digest[16];
+    uint64_t       length;
+    int32_t        params[5];
+    int            i;
+
+    TYPECHECK(stream, PDF_STREAM);
+
+    if (stream->label)
+        return pdf_ref_obj(stream);
+
+    data = stream->data;
+    MD5_init(&md5);
+    if (digest_obj(&md5, data->dict, 0) < 0)
+        return pdf_ref_obj(stream);
+    params[0] = data->_flags;
+    params[1] = data->decodeparms.predictor;
+    params[2] = data->decodeparms.colors;
+    params[3] = data->decodeparms.bits_per_component;
+    params[4] = data->decodeparms.columns;
+    MD5_write(&md5, (const unsigned char *) params, sizeof(params));
+    length = data->stream_length;
+    MD5_write(&md5, (const unsigned char *) &length, sizeof(length));
+    if (data->stream_length > 0)
+        MD5_write(&md5, data->stream, (unsigned int) data->stream_length);
+    MD5_final(digest, &md5);
+
+    for (i = 0; i < p->shared.count; i++) {
+        if (memcmp(p->shared.entries[i].digest, digest, 16) == 0)
+            return pdf_link_obj(p->shared.entries[i].ref);
+    }
+
+    if (p->shared.count == p->shared.capacity) {
+        p->shared.capacity += 16;
+        p->shared.entries = RENEW(p->shared.entries, p->shared.capacity,
+                                  struct shared_stream);
+    }
+    memcpy(p->shared.entries[p->shared.count].digest, digest, 16);
+    p->shared.entries[p->shared.count].ref = pdf_ref_obj(stream);
+    return pdf_link_obj(p->shared.entries[p->shared.count++].ref);
+}
+
 static void
 release_indirect (pdf_indirect *data)
 {
-    free(data);
+    FREE_SMALL(data);
 }
 
 static void
@@ -973,7 +1324,7 @@ pdf_new_boolean (char value)
     pdf_boolean *data;
 
     result = pdf_new_obj(PDF_BOOLEAN);
-    data   = NEW(1, pdf_boolean);
+    data   = NEW_SMALL(pdf_boolean);
     data->value  = value;
     result->data = data;
 
@@ -983,7 +1334,7 @@ pdf_new_boolean (char value)
 static void
 release_boolean (pdf_obj *data)
 {
-    free (data);
+    FREE_SMALL(data);
 }
 
 static void
@@ -1015,7 +1366,7 @@ pdf_new_number (double value)
     pdf_number *data;
 
     result = pdf_new_obj(PDF_NUMBER);
-    data   = NEW(1, pdf_number);
+    data   = NEW_SMALL(pdf_number);
     data->value  = value;
     result->data = data;
 
@@ -1025,7 +1376,7 @@ pdf_new_number (double value)
 static void
 release_number (pdf_number *data)
 {
-    free (data);
+    FREE_SMALL(data);
 }
 
 static void
@@ -1072,7 +1423,7 @@ pdf_new_string (const void *str, size_t length)
     assert(str);
 
     result = pdf_new_obj(PDF_STRING);
-    data   = NEW(1, pdf_string);
+    data   = NEW_SMALL(pdf_string);
     result->data = data;
     data->length = length;
 
@@ -1224,7 +1575,7 @@ static void
 release_string (pdf_string *data)
 {
     data->string = mfree(data->string);
-    free(data);
+    FREE_SMALL(data);
 }
 
 void
@@ -1249,6 +1600,106 @@ pdf_set_string (pdf_obj *object, unsigned char *str, size_t length)
     }
 }
 
+/* Names are interned: each distinct name is stored once for the run, and
+ * name objects and dict keys share that copy, so comparing names is
+ * comparing pointers. The table is freed with the object pools. */
+struct interned_name
+{
+    char    *name;
+    uint32_t hash;
+};
+
+static TTBC_THREAD_LOCAL struct interned_name *names = NULL;
+static TTBC_THREAD_LOCAL size_t names_mask  = 0;
+static TTBC_THREAD_LOCAL size_t names_count = 0;
+
+static uint32_t
+name_hash (const char *name, size_t length)
+{
+    uint32_t h = 2166136261u;
+    size_t   i;
+
+    for (i = 0; i < length; i++) {
+        h ^= (unsigned char) name[i];
+        h *= 16777619u;
+    }
+
+    return h;
+}
+
+static struct interned_name *
+names_slot (const char *name, size_t length, uint32_t hash)
+{
+    size_t i;
+
+    for (i = hash & names_mask; names[i].name; i = (i + 1) & names_mask) {
+        if (names[i].hash == hash && !strncmp(names[i].name, name, length) &&
+            names[i].name[length] == '\0')
+            break;
+    }
+
+    return &names[i];
+}
+
+/* The interned copy of name, or NULL if no object ever had it */
+static char *
+find_name (const char *name)
+{
+    size_t length;
+
+    if (!names || !name)
+        return NULL;
+
+    length = strlen(name);
+    return names_slot(name, length, name_hash(name, length))->name;
+}
+
+static char *
+intern_name (const char *name, size_t length)
+{
+    struct interned_name *slot;
+    uint32_t hash = name_hash(name, length);
+
+    if (names_count * 2 >= names_mask) {
+        struct interned_name *old = names;
+        size_t i, old_size = names ? names_mask + 1 : 0;
+
+        names_mask = old_size ? 2 * old_size - 1 : 1023;
+        names = xcalloc(names_mask + 1, sizeof(struct interned_name));
+        for (i = 0; i < old_size; i++) {
+            if (old[i].name)
+                *names_slot(old[i].name, strlen(old[i].name), old[i].hash) = old[i];
+        }
+        free(old);
+    }
+
+    slot = names_slot(name, length, hash);
+    if (!slot->name) {
+        slot->name = NEW(length+1, char);
+        memcpy(slot->name, name, length);
+        slot->name[length] = '\0';
+        slot->hash = hash;
+        names_count++;
+    }
+
+    return slot->name;
+}
+
+static void
+names_close (void)
+{
+    size_t i;
+
+    if (!names)
+        return;
+
+    for (i = 0; i <= names_mask; i++)
+        free(names[i].name);
+    names = mfree(names);
+    names_mask  = 0;
+    names_count = 0;
+}
+
 /* Name does *not* include the /. */
 pdf_obj *
 pdf_new_name (const char *name)
@@ -1258,13 +1709,11 @@ pdf_new_name (const char *name)
     pdf_name *data;
 
     result = pdf_new_obj(PDF_NAME);
-    data   = NEW (1, pdf_name);
+    data   = NEW_SMALL(pdf_name);
     result->data = data;
     length = strlen(name);
     if (length != 0) {
-        data->name = NEW(length+1, char);
-        memcpy(data->name, name, length);
-        data->name[length] = '\0';
+        data->name = intern_name(name, length);
     } else {
         data->name = NULL;
     }
@@ -1317,8 +1766,8 @@ write_name (pdf_out *p, pdf_name *name)
 static void
 release_name (pdf_name *data)
 {
-    data->name = mfree(data->name);
-    free(data);
+    /* the name itself stays interned */
+    FREE_SMALL(data);
 }
 
 char *
@@ -1345,7 +1794,7 @@ pdf_new_array (void)
     pdf_array *data;
 
     result = pdf_new_obj(PDF_ARRAY);
-    data   = NEW(1, pdf_array);
+    data   = NEW_SMALL(pdf_array);
     data->values = NULL;
     data->max    = 0;
     data->size   = 0;
@@ -1420,7 +1869,7 @@ release_array (pdf_array *data)
         }
         data->values = mfree(data->values);
     }
-    free(data);
+    FREE_SMALL(data);
 }
 
 /*
@@ -1466,17 +1915,18 @@ pdf_unshift_array (pdf_obj *array, pdf_obj *object)
 
 
 static void
-write_dict (pdf_out *p, pdf_dict *dict)
+write_dict (pdf_out *p, pdf_dict_head *dict)
 {
+    pdf_dict *data;
+
     pdf_out_str(p, "<<", 2);
 
-    while (dict->key != NULL) {
-        pdf_write_obj(p, dict->key);
-        if (pdf_need_white(PDF_NAME, (dict->value)->type)) {
+    for (data = dict->first; data->key != NULL; data = data->next) {
+        pdf_write_obj(p, data->key);
+        if (pdf_need_white(PDF_NAME, (data->value)->type)) {
             pdf_out_white(p);
         }
-        pdf_write_obj(p, dict->value);
-        dict = dict->next;
+        pdf_write_obj(p, data->value);
     }
     pdf_out_str(p, ">>", 2);
 }
@@ -1484,34 +1934,100 @@ write_dict (pdf_out *p, pdf_dict *dict)
 pdf_obj *
 pdf_new_dict (void)
 {
-    pdf_obj  *result;
-    pdf_dict *data;
+    pdf_obj       *result;
+    pdf_dict_head *data;
+    pdf_dict      *end;
 
     result = pdf_new_obj(PDF_DICT);
-    data   = NEW(1, pdf_dict);
-    data->key    = NULL;
-    data->value  = NULL;
-    data->next   = NULL;
+    data   = NEW_SMALL(pdf_dict_head);
+    end    = NEW_SMALL(pdf_dict);
+    end->key   = NULL;
+    end->value = NULL;
+    end->next  = NULL;
+    data->first = data->last = end;
+    data->index = NULL;
+    data->count = 0;
+    data->index_mask = 0;
     result->data = data;
 
     return result;
 }
 
 static void
-release_dict (pdf_dict *data)
+release_dict (pdf_dict_head *head)
 {
-    pdf_dict *next;
+    pdf_dict *data, *next;
 
+    data = head->first;
     while (data != NULL && data->key != NULL) {
         pdf_release_obj(data->key);
         pdf_release_obj(data->value);
         data->key   = NULL;
         data->value = NULL;
         next = data->next;
-        free(data);
+        FREE_SMALL(data);
         data = next;
     }
-    free(data);
+    FREE_SMALL(data);
+    free(head->index);
+    FREE_SMALL(head);
+}
+
+#define DICT_KEY(d)        (((pdf_name *) (d)->key->data)->name)
+#define DICT_SLOT(h,name)  ((uint32_t) (((uintptr_t) (name) >> 3) * 2654435761u) & (h)->index_mask)
+
+static void
+dict_index_add (pdf_dict_head *head, pdf_dict *data)
+{
+    uint32_t i;
+
+    for (i = DICT_SLOT(head, DICT_KEY(data)); head->index[i]; i = (i + 1) & head->index_mask)
+        ;
+    head->index[i] = data;
+}
+
+static void
+dict_index_build (pdf_dict_head *head)
+{
+    pdf_dict *data;
+    uint32_t  size = 2 * DICT_INDEX_MIN;
+
+    while (size < 2 * head->count)
+        size *= 2;
+
+    free(head->index);
+    head->index = xcalloc(size, sizeof(pdf_dict *));
+    head->index_mask = size - 1;
+    for (data = head->first; data->key != NULL; data = data->next)
+        dict_index_add(head, data);
+}
+
+/* The entry with the interned key name, or NULL */
+static pdf_dict *
+dict_find (pdf_dict_head *head, const char *name)
+{
+    pdf_dict *data;
+    uint32_t  i;
+
+    if (!name)
+        return NULL;
+
+    if (head->count < DICT_INDEX_MIN) {
+        for (data = head->first; data->key != NULL; data = data->next) {
+            if (DICT_KEY(data) == name)
+                return data;
+        }
+        return NULL;
+    }
+
+    if (!head->index)
+        dict_index_build(head);
+    for (i = DICT_SLOT(head, name); (data = head->index[i]); i = (i + 1) & head->index_mask) {
+        if (DICT_KEY(data) == name)
+            return data;
+    }
+
+    return NULL;
 }
 
 /* Array is ended by a node with NULL this pointer */
@@ -1519,7 +2035,8 @@ release_dict (pdf_dict *data)
 int
 pdf_add_dict (pdf_obj *dict, pdf_obj *key, pdf_obj *value)
 {
-    pdf_dict *data, *new_node;
+    pdf_dict_head *head;
+    pdf_dict      *data, *new_node;
 
     TYPECHECK(dict, PDF_DICT);
     TYPECHECK(key,  PDF_NAME);
@@ -1528,28 +2045,39 @@ pdf_add_dict (pdf_obj *dict, pdf_obj *key, pdf_obj *value)
     if (value != NULL && INVALIDOBJ(value))
         _tt_abort("pdf_add_dict(): Passed invalid value");
 
+    head = dict->data;
+
     /* If this key already exists, simply replace the value */
-    for (data = dict->data; data->key != NULL; data = data->next) {
-        if (streq_ptr(pdf_name_value(key), pdf_name_value(data->key))) {
-            /* Release the old value */
-            pdf_release_obj(data->value);
-            /* Release the new key (we don't need it) */
-            pdf_release_obj(key);
-            data->value = value;
-            return 1;
-        }
+    data = dict_find(head, pdf_name_value(key));
+    if (data) {
+        /* Release the old value */
+        pdf_release_obj(data->value);
+        /* Release the new key (we don't need it) */
+        pdf_release_obj(key);
+        data->value = value;
+        return 1;
     }
     /*
      * We didn't find the key. We build a new "end" node and add
      * the new key just before the end
      */
-    new_node = NEW (1, pdf_dict);
+    data = head->last;
+    new_node = NEW_SMALL(pdf_dict);
     new_node->key = NULL;
     new_node->value = NULL;
     new_node->next = NULL;
     data->next  = new_node;
     data->key   = key;
     data->value = value;
+    head->last  = new_node;
+    head->count++;
+
+    if (head->index) {
+        if (2 * head->count > head->index_mask + 1)
+            dict_index_build(head);
+        else
+            dict_index_add(head, data);
+    }
     return 0;
 }
 
@@ -1563,7 +2091,7 @@ pdf_merge_dict (pdf_obj *dict1, pdf_obj *dict2)
     TYPECHECK(dict1, PDF_DICT);
     TYPECHECK(dict2, PDF_DICT);
 
-    data = dict2->data;
+    data = ((pdf_dict_head *) dict2->data)->first;
     while (data->key != NULL) {
         pdf_add_dict(dict1, pdf_link_obj(data->key), pdf_link_obj(data->value));
         data = data->next;
@@ -1581,7 +2109,7 @@ pdf_foreach_dict (pdf_obj *dict,
 
     TYPECHECK(dict, PDF_DICT);
 
-    data = dict->data;
+    data = ((pdf_dict_head *) dict->data)->first;
     while (!error &&
            data->key != NULL) {
         error = proc(data->key, data->value, pdata);
@@ -1591,7 +2119,6 @@ pdf_foreach_dict (pdf_obj *dict,
     return error;
 }
 
-#define pdf_match_name(o,s) ((o) && (s) && streq_ptr(((pdf_name *)(o)->data)->name, (s)))
 pdf_obj *
 pdf_lookup_dict (pdf_obj *dict, const char *name)
 {
@@ -1601,15 +2128,9 @@ pdf_lookup_dict (pdf_obj *dict, const char *name)
 
     TYPECHECK(dict, PDF_DICT);
 
-    data = dict->data;
-    while (data->key != NULL) {
-        if (streq_ptr(name, pdf_name_value(data->key))) {
-            return data->value;
-        }
-        data = data->next;
-    }
+    data = dict_find(dict->data, find_name(name));
 
-    return NULL;
+    return data ? data->value : NULL;
 }
 
 /* Returns array of dictionary keys */
@@ -1622,7 +2143,7 @@ pdf_dict_keys (pdf_obj *dict)
     TYPECHECK(dict, PDF_DICT);
 
     keys = pdf_new_array();
-    for (data = dict->data; (data &&
+    for (data = ((pdf_dict_head *) dict->data)->first; (data &&
                              data->key != NULL); data = data->next) {
         /* We duplicate name object rather than linking keys.
          * If we forget to free keys, broken PDF is generated.
@@ -1636,18 +2157,26 @@ pdf_dict_keys (pdf_obj *dict)
 void
 pdf_remove_dict (pdf_obj *dict, const char *name)
 {
-    pdf_dict *data, **data_p;
+    pdf_dict_head *head;
+    pdf_dict      *data, **data_p;
+    const char    *key;
 
     TYPECHECK(dict, PDF_DICT);
 
-    data   = dict->data;
-    data_p = (pdf_dict **) (void *) &(dict->data);
+    head = dict->data;
+    if (!(key = find_name(name)))
+        return;
+
+    data   = head->first;
+    data_p = &head->first;
     while (data->key != NULL) {
-        if (pdf_match_name(data->key, name)) {
+        if (DICT_KEY(data) == key) {
             pdf_release_obj(data->key);
             pdf_release_obj(data->value);
             *data_p = data->next;
-            free(data);
+            FREE_SMALL(data);
+            head->count--;
+            head->index = mfree(head->index);
             break;
         }
         data_p = &(data->next);
@@ -1718,7 +2247,7 @@ pdf_stream_set_predictor (pdf_obj *stream,
  *   Crocker in February 1995.
  */
 static unsigned char *
-filter_PNG15_apply_filter (unsigned char *raster,
+filter_PNG15_apply_filter (const unsigned char *raster,
                            int32_t columns, int32_t rows,
                            int8_t bpc, int8_t colors, int32_t *length)
 {
@@ -1730,14 +2259,17 @@ filter_PNG15_apply_filter (unsigned char *raster,
 
     assert(raster && length);
 
-    /* Result */
-    dst = NEW((rowbytes+1)*rows, unsigned char);
+    /* Result. This may run on a compression thread (see defer_stream),
+     * where NEW could not abort, so running out of memory returns NULL. */
+    dst = malloc((size_t) (rowbytes+1)*rows);
+    if (!dst)
+        return NULL;
     *length = (rowbytes + 1) * rows;
 
     for (j = 0; j < rows; j++) {
         int type = 0;
         unsigned char *pp = dst + j * (rowbytes + 1);
-        unsigned char *p  = raster + j * rowbytes;
+        const unsigned char *p  = raster + j * rowbytes;
         uint32_t sum[5]   = {0, 0, 0, 0, 0};
         /* First calculated sum of values to make a heuristic guess
          * of optimal predictor function.
@@ -1985,14 +2517,20 @@ filter_create_predictor_dict (int predictor, int32_t columns,
     return  parms;
 }
 
-static void
-write_stream (pdf_out *p, pdf_stream *stream)
+/*
+ * Take a copy of the stream's data through the predictor, if one applies,
+ * and enter the filters it will have in its dict. Returns whether the copy
+ * is still to be deflated; had_filters tells whether the dict named filters
+ * of its own, for the statistics. With png given, a PNG predictor is not
+ * applied but described there (png->rows > 0), for the caller to apply.
+ */
+static int
+filter_stream (pdf_out *p, pdf_stream *stream,
+               unsigned char **data, size_t *length, int *had_filters,
+               struct png_predictor *png)
 {
     unsigned char *filtered;
     size_t   filtered_length;
-    size_t         buffer_length;
-    uint64_t       buffer_length64;
-    unsigned char *buffer;
 
     assert(p);
 
@@ -2003,6 +2541,7 @@ write_stream (pdf_out *p, pdf_stream *stream)
     filtered = NEW(stream->stream_length, unsigned char);
     memcpy(filtered, stream->stream, stream->stream_length);
     filtered_length = stream->stream_length;
+    *had_filters = 0;
 
     /* PDF/A requires Metadata to be not filtered. */
     {
@@ -2014,9 +2553,15 @@ write_stream (pdf_out *p, pdf_stream *stream)
     }
 
     /* Apply compression filter if requested */
-    if (stream->stream_length > 0 &&
-        (stream->_flags & STREAM_COMPRESS) &&
-        p->options.compression.level > 0) {
+    if (!(stream->stream_length > 0 &&
+          (stream->_flags & STREAM_COMPRESS) &&
+          p->options.compression.level > 0)) {
+        *data = filtered;
+        *length = filtered_length;
+        return 0;
+    }
+
+    {
         pdf_obj *filters;
 
         /* First apply predictor filter if requested. */
@@ -2045,6 +2590,16 @@ write_stream (pdf_out *p, pdf_stream *stream)
                                                       stream->decodeparms.colors, &length2);
                 break;
             case 15: /* PNG optimun */
+                if (png && rows > 0) {
+                    /* the compression thread applies it */
+                    png->columns = stream->decodeparms.columns;
+                    png->rows    = rows;
+                    png->bpc     = stream->decodeparms.bits_per_component;
+                    png->colors  = stream->decodeparms.colors;
+                    pdf_add_dict(stream->dict, pdf_new_name("DecodeParms"), parms);
+                    parms = NULL;
+                    break;
+                }
                 filtered2 = filter_PNG15_apply_filter(filtered,
                                                       stream->decodeparms.columns,
                                                       rows,
@@ -2065,9 +2620,8 @@ write_stream (pdf_out *p, pdf_stream *stream)
         }
 
         filters = pdf_lookup_dict(stream->dict, "Filter");
+        *had_filters = filters != NULL;
 
-        buffer_length = filtered_length + filtered_length/1000 + 14;
-        buffer = NEW(buffer_length, unsigned char);
         {
             pdf_obj *filter_name = pdf_new_name("FlateDecode");
 
@@ -2084,29 +2638,64 @@ write_stream (pdf_out *p, pdf_stream *stream)
                  */
                 pdf_add_dict(stream->dict, pdf_new_name("Filter"), filter_name);
         }
+    }
 
-        buffer_length64 = (uint64_t) buffer_length;
+    *data = filtered;
+    *length = filtered_length;
+    return 1;
+}
 
-        if (tectonic_flate_compress(
-                buffer,
-                &buffer_length64,
-                filtered,
-                filtered_length,
-                p->options.compression.level
-            ) < 0) {
-            _tt_abort("Zlib error");
-        }
+static void
+count_compression_saved (pdf_out *p, size_t length, size_t compressed_length,
+                         int had_filters)
+{
+    p->output.compression_saved += length - compressed_length
+        - (had_filters ? strlen("/FlateDecode "): strlen("/Filter/FlateDecode\n"));
+}
 
-        buffer_length = (size_t) buffer_length64;
+/* Deflate data in place. */
+static void
+deflate_filtered (pdf_out *p, unsigned char **data, size_t *length,
+                  int had_filters)
+{
+    size_t         buffer_length;
+    uint64_t       buffer_length64;
+    unsigned char *buffer;
 
-        free(filtered);
-        p->output.compression_saved += filtered_length - buffer_length
-            - (filters ? strlen("/FlateDecode "): strlen("/Filter/FlateDecode\n"));
+    buffer_length = *length + *length/1000 + 14;
+    buffer = NEW(buffer_length, unsigned char);
 
-        filtered        = buffer;
-        filtered_length = buffer_length;
+    buffer_length64 = (uint64_t) buffer_length;
+
+    if (tectonic_flate_compress(
+            buffer,
+            &buffer_length64,
+            *data,
+            *length,
+            p->options.compression.level
+        ) < 0) {
+        _tt_abort("Zlib error");
     }
 
+    buffer_length = (size_t) buffer_length64;
+
+    free(*data);
+    count_compression_saved(p, *length, buffer_length, had_filters);
+
+    *data   = buffer;
+    *length = buffer_length;
+}
+
+/* Write a stream whose data is ready for the file, but for encryption.
+ * Takes over data. */
+static void
+write_filtered (pdf_out *p, pdf_obj *dict,
+                unsigned char *filtered, size_t filtered_length)
+{
+    if (p->capture.fn && p->capture.label)
+        p->capture.fn(p->capture.ctx, p->capture.label, dict,
+                      filtered, filtered_length);
+
     /* AES will change the size of data! */
     if (p->state.enc_mode) {
         unsigned char *cipher = NULL;
@@ -2118,10 +2707,10 @@ write_stream (pdf_out *p, pdf_stream *stream)
     }
 
 
-    pdf_add_dict(stream->dict,
+    pdf_add_dict(dict,
                  pdf_new_name("Length"), pdf_new_number(filtered_length));
 
-    pdf_write_obj(p, stream->dict);
+    pdf_write_obj(p, dict);
 
     pdf_out_str(p, "\nstream\n", 8);
 
@@ -2140,6 +2729,18 @@ write_stream (pdf_out *p, pdf_stream *stream)
     pdf_out_str(p, "endstream", 9);
 }
 
+static void
+write_stream (pdf_out *p, pdf_stream *stream)
+{
+    unsigned char *filtered;
+    size_t         filtered_length;
+    int            had_filters;
+
+    if (filter_stream(p, stream, &filtered, &filtered_length, &had_filters, NULL))
+        deflate_filtered(p, &filtered, &filtered_length, had_filters);
+    write_filtered(p, stream->dict, filtered, filtered_length);
+}
+
 static void
 release_stream (pdf_stream *stream)
 {
@@ -2861,9 +3462,9 @@ pdf_write_obj (pdf_out *p, pdf_obj *object)
     }
 }
 
-/* Write the object to the file */
+/* Start indirect object label at the current position */
 static void
-pdf_flush_obj (pdf_out *p, pdf_obj *object)
+begin_indirect (pdf_out *p, uint32_t label, uint16_t generation, int32_t flags)
 {
     size_t length;
     char buf[64];
@@ -2871,17 +3472,167 @@ pdf_flush_obj (pdf_out *p, pdf_obj *object)
     /*
      * Record file position
      */
-    add_xref_entry(p, object->label, 1,
-                   p->output.file_position, object->generation);
-    length = sprintf(buf, "%u %hu obj\n", object->label, object->generation);
-    p->state.enc_mode = p->options.enable_encrypt && !(object->flags & OBJ_NO_ENCRYPT) ? 1 : 0;
+    add_xref_entry(p, label, 1, p->output.file_position, generation);
+    length = sprintf(buf, "%u %hu obj\n", label, generation);
+    p->state.enc_mode = p->options.enable_encrypt && !(flags & OBJ_NO_ENCRYPT) ? 1 : 0;
     if (p->state.enc_mode) {
-        pdf_enc_set_label(p->sec_data, object->label);
-        pdf_enc_set_generation(p->sec_data, object->generation);
+        pdf_enc_set_label(p->sec_data, label);
+        pdf_enc_set_generation(p->sec_data, generation);
     }
     pdf_out_str(p, buf, length);
+}
+
+/* Write the object to the file */
+static void
+pdf_flush_obj (pdf_out *p, pdf_obj *object)
+{
+    begin_indirect(p, object->label, object->generation, object->flags);
+    p->capture.label = object->label;
     pdf_write_obj(p, object);
+    p->capture.label = 0;
     pdf_out_str(p, "\nendobj\n", 8);
+
+    if (p->capture.fn && object->type != PDF_STREAM)
+        p->capture.fn(p->capture.ctx, object->label, NULL, NULL, 0);
+}
+
+/* The job's first step for a stream with a PNG predictor (see defer_stream). */
+static uint8_t *
+apply_png_predictor (void *ctx, const uint8_t *data, uint64_t length,
+                     uint64_t *prepared_length)
+{
+    struct png_predictor *png = ctx;
+    unsigned char *filtered;
+    int32_t        filtered_length = 0;
+
+    (void) length;
+    filtered = filter_PNG15_apply_filter(data, png->columns, png->rows,
+                                         png->bpc, png->colors,
+                                         &filtered_length);
+    *prepared_length = filtered ? (uint64_t) filtered_length : 0;
+    return filtered;
+}
+
+/*
+ * With compression threads, a labelled stream released for writing is not
+ * flushed at once: its data is deflated on a thread of its own, while the
+ * caller carries on. A PNG predictor, which tries every filter on every
+ * row of an image, runs on that thread too; a TIFF one is applied here. The stream
+ * is written out when its slot is needed or output is flushed, oldest
+ * first, so the file comes out the same for the same number of threads.
+ * Its offset goes into the xref at that point like any other object's.
+ * Returns 0 if the stream was taken care of, -1 to have it flushed as usual.
+ */
+static int
+defer_stream (pdf_out *p, pdf_obj *object)
+{
+    pdf_stream    *stream = object->data;
+    struct deferred_stream *d;
+    unsigned char *filtered;
+    size_t         filtered_length;
+    int            had_filters;
+    struct png_predictor png = {0, 0, 0, 0};
+    struct png_predictor *pending = NULL;
+    void          *job;
+
+    if (p->options.compression.threads == 0 || p->capture.fn ||
+        object == p->xref_stream ||
+        stream->stream_length < DEFERRED_MIN_LENGTH)
+        return -1;
+
+    if (!filter_stream(p, stream, &filtered, &filtered_length, &had_filters,
+                       &png)) {
+        free(filtered);
+        return -1;
+    }
+
+    if (p->num_deferred == p->options.compression.threads)
+        write_deferred(p);
+
+    if (png.rows > 0) {
+        pending = NEW(1, struct png_predictor);
+        *pending = png;
+        job = tectonic_flate_compress_start_prepared(filtered, filtered_length,
+                                                     p->options.compression.level,
+                                                     apply_png_predictor, pending);
+    } else {
+        job = tectonic_flate_compress_start(filtered, filtered_length,
+                                            p->options.compression.level);
+    }
+    if (!job) {
+        if (pending) {
+            uint64_t       predicted_length;
+            unsigned char *predicted;
+
+            predicted = apply_png_predictor(pending, filtered, filtered_length,
+                                            &predicted_length);
+            if (!predicted)
+                _tt_abort("Out of memory");
+            free(filtered);
+            free(pending);
+            filtered = predicted;
+            filtered_length = (size_t) predicted_length;
+        }
+        deflate_filtered(p, &filtered, &filtered_length, had_filters);
+        begin_indirect(p, object->label, object->generation, object->flags);
+        write_filtered(p, stream->dict, filtered, filtered_length);
+        pdf_out_str(p, "\nendobj\n", 8);
+        return 0;
+    }
+
+    d = &p->deferred[p->num_deferred++];
+    d->dict        = pdf_link_obj(stream->dict);
+    d->label       = object->label;
+    d->generation  = object->generation;
+    d->flags       = object->flags;
+    d->data        = filtered;
+    d->length      = filtered_length;
+    d->had_filters = had_filters;
+    d->png         = pending;
+    d->job         = job;
+    return 0;
+}
+
+/* Write out the oldest deferred stream. */
+static void
+write_deferred (pdf_out *p)
+{
+    struct deferred_stream d = p->deferred[0];
+    uint8_t  *output = NULL;
+    uint64_t  output_length = 0;
+
+    p->num_deferred--;
+    memmove(p->deferred, p->deferred + 1,
+            p->num_deferred * sizeof(struct deferred_stream));
+
+    if (tectonic_flate_compress_finish(d.job, &output, &output_length) != FlateResult_Success)
+        _tt_abort("Zlib error");
+    free(d.data);
+    free(d.png);
+    count_compression_saved(p, d.length, output_length, d.had_filters);
+
+    begin_indirect(p, d.label, d.generation, d.flags);
+    write_filtered(p, d.dict, output, output_length);
+    pdf_out_str(p, "\nendobj\n", 8);
+    pdf_release_obj(d.dict);
+}
+
+/* After an error: wait for the threads, write nothing. */
+static void
+discard_deferred (pdf_out *p)
+{
+    uint8_t  *output;
+    uint64_t  output_length;
+    int       i;
+
+    for (i = 0; i < p->num_deferred; i++) {
+        output = NULL;
+        tectonic_flate_compress_finish(p->deferred[i].job, &output, &output_length);
+        free(output);
+        free(p->deferred[i].data);
+        free(p->deferred[i].png);
+    }
+    p->num_deferred = 0;
 }
 
 static int
@@ -2900,6 +3651,9 @@ pdf_add_objstm (pdf_out *p, pdf_obj *objstm, pdf_obj *object)
 
     add_xref_entry(p, object->label, 2, objstm->label, pos-1);
 
+    if (p->capture.fn)
+        p->capture.fn(p->capture.ctx, object->label, NULL, NULL, 0);
+
     /* redirect output into objstm */
     p->output_stream = objstm;
     p->state.enc_mode = false;
@@ -2975,9 +3729,10 @@ pdf_release_obj (pdf_obj *object)
             if (p->output.handle != INVALID_HANDLE) {
                 if (!p->options.use_objstm || object->flags & OBJ_NO_OBJSTM
                     || (p->options.enable_encrypt && object->flags & OBJ_NO_ENCRYPT)
-                    || object->generation)
-                    pdf_flush_obj(p, object);
-                else {
+                    || object->generation) {
+                    if (object->type != PDF_STREAM || defer_stream(p, object) < 0)
+                        pdf_flush_obj(p, object);
+                } else {
                     if (!p->current_objstm) {
                         int *data = NEW(2*OBJSTM_MAX_OBJS+2, int);
                         data[0] = data[1] = 0;
@@ -3023,7 +3778,7 @@ pdf_release_obj (pdf_obj *object)
         /* This might help detect freeing already freed objects */
         object->type = -1;
         object->data = NULL;
-        free(object);
+        pool_free(&obj_pool, object);
     }
 }
 
@@ -3194,7 +3949,7 @@ pdf_new_indirect (pdf_file *pf, uint32_t obj_num, uint16_t obj_gen)
     pdf_obj      *result;
     pdf_indirect *indirect;
 
-    indirect = NEW(1, pdf_indirect);
+    indirect = NEW_SMALL(pdf_indirect);
     indirect->pf         = pf;
     indirect->obj        = NULL;
     indirect->label      = obj_num;
@@ -3447,6 +4202,14 @@ pdf_new_ref (pdf_out *p, pdf_obj *object)
     return result;
 }
 
+uint32_t
+pdf_ref_label (pdf_obj *ref)
+{
+    if (!PDF_OBJ_INDIRECTTYPE(ref) || OBJ_FILE(ref))
+        return 0;
+    return OBJ_NUM(ref);
+}
+
 /* pdf_deref_obj always returns a link instead of the original   */
 /* It never return the null object, but the NULL pointer instead */
 pdf_obj *
@@ -3917,7 +4680,16 @@ error:
     return NULL;
 }
 
-static struct ht_table *pdf_files = NULL;
+static TTBC_THREAD_LOCAL struct ht_table *pdf_files = NULL;
+static TTBC_THREAD_LOCAL unsigned int pdf_files_tick = 0;
+
+/* Included PDF files stay open for the whole run, keyed by ident: a document
+ * taking many pages from one file parses its xref once, and the objects it
+ * shares between pages (fonts, resources) are imported once and referenced
+ * after that (see pdf_import_indirect). The objects read from a file are
+ * what costs memory, so beyond PDF_FILES_RESIDENT files the least recently
+ * opened one drops them; its xref and the imported references stay. */
+#define PDF_FILES_RESIDENT 8
 
 static pdf_file *
 pdf_file_new (rust_input_handle_t handle)
@@ -3933,6 +4705,7 @@ pdf_file_new (rust_input_handle_t handle)
     pf->catalog = NULL;
     pf->num_obj = 0;
     pf->version = 0;
+    pf->last_used = 0;
     pf->file_size = ttbc_input_get_size(handle);
 
     ttstub_input_seek(handle, 0, SEEK_END);
@@ -3961,11 +4734,54 @@ pdf_file_free (pdf_file *pf)
     free(pf);
 }
 
+/* Release the objects read from pf, to be read again on demand. */
+static void
+pdf_file_trim (pdf_file *pf)
+{
+    int i;
+
+    for (i = 0; i < pf->num_obj; i++) {
+        pdf_release_obj(pf->xref_table[i].direct);
+        pf->xref_table[i].direct = NULL;
+    }
+}
+
+static void
+pdf_files_trim (void)
+{
+    struct ht_iter iter;
+    pdf_file *oldest = NULL;
+    int resident = 0;
+
+    if (ht_set_iter(pdf_files, &iter) < 0)
+        return;
+
+    do {
+        pdf_file *pf = (pdf_file *) ht_iter_getval(&iter);
+        int i;
+
+        for (i = 0; i < pf->num_obj && !pf->xref_table[i].direct; i++)
+            ;
+        if (i == pf->num_obj)
+            continue;
+        resident++;
+        /* a file in use keeps its objects */
+        if (pf->handle == INVALID_HANDLE &&
+            (!oldest || pf->last_used < oldest->last_used))
+            oldest = pf;
+    } while (ht_iter_next(&iter) >= 0);
+    ht_clear_iter(&iter);
+
+    if (resident > PDF_FILES_RESIDENT && oldest)
+        pdf_file_trim(oldest);
+}
+
 void
 pdf_files_init (void)
 {
     pdf_files = NEW(1, struct ht_table);
     ht_init_table(pdf_files, (void (*)(void *)) pdf_file_free);
+    pdf_files_tick = 0;
 }
 
 int
@@ -4060,10 +4876,14 @@ pdf_open (const char *ident, rust_input_handle_t handle)
             pdf_release_obj(new_version);
         }
 
-        if (ident)
+        if (ident) {
             ht_append_table(pdf_files, ident, strlen(ident), pf);
+            pdf_files_trim();
+        }
     }
 
+    pf->last_used = ++pdf_files_tick;
+
     return pf;
 
 error:
@@ -4393,6 +5213,9 @@ pdf_obj_reset_global_state(void)
     if (p->output.handle != INVALID_HANDLE) {
         ttbc_output_close(p->output.handle);
     }
+    /* the references go with the object pools */
+    p->shared.entries = mfree(p->shared.entries);
+    p->shared.count = p->shared.capacity = 0;
     p->output.handle = INVALID_HANDLE;
     p->output.file_position = 0;
     p->output.line_position = 0;
@@ -4400,3 +5223,23 @@ pdf_obj_reset_global_state(void)
 
     tectonic_pout_initialized = 0;
 }
+
+/* Report this run's object allocations to the trace and give the slab
+ * pools back. Called once everything holding objects has been closed. */
+void
+pdf_obj_pools_close(void)
+{
+    char detail[160];
+
+    if (obj_pool.allocs > 0) {
+        snprintf(detail, sizeof detail, "pdf objects: %" PRIu64 " objects, %" PRIu64 " payloads, %u slab allocations, %" PRIuZ " names",
+                 obj_pool.allocs, small_pool.allocs, obj_pool.num_slabs + small_pool.num_slabs, names_count);
+        ttbc_fire_checkpoint(TTBC_CHECKPOINT_STATS, detail);
+    }
+
+    /* names are only kept by name objects */
+    if (obj_pool.live == 0)
+        names_close();
+    pool_close(&obj_pool);
+    pool_close(&small_pool);
+}
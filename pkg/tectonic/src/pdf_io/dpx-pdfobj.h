@@ -61,6 +61,7 @@ typedef struct pdf_file pdf_file;
 
 /* External interface to pdf routines */
 void     pdf_obj_reset_global_state (void);
+void     pdf_obj_pools_close (void);
 void     pdf_error_cleanup   (void);
 
 rust_output_handle_t pdf_get_output_file(void);
@@ -76,6 +77,22 @@ int pdf_get_version (void);
 int pdf_get_version_major (void);
 int pdf_get_version_minor (void);
 
+/* Compression level and whether predictors may be used: together they
+ * decide the stream data written. */
+void pdf_out_get_compression (int *level, int *use_predictor);
+
+/* Deflate up to threads streams at once, in the background; 0, the
+ * default, deflates each as it is written. */
+void pdf_out_set_compression_threads (int threads);
+
+/* While a capture is set, fn sees each labelled object as it is written:
+ * a stream as its dict and its data as filtered for the file (before any
+ * encryption), anything else as just its label. Returns -1, setting nothing,
+ * when no output file is open. A NULL fn ends the capture. */
+typedef void (*pdf_capture_fn) (void *ctx, uint32_t label, pdf_obj *object,
+                                const unsigned char *data, size_t length);
+int  pdf_out_set_capture (pdf_capture_fn fn, void *ctx);
+
 void     pdf_release_obj (pdf_obj *object);
 int      pdf_obj_typeof  (pdf_obj *object);
 
@@ -94,6 +111,8 @@ int      pdf_obj_typeof  (pdf_obj *object);
 
 pdf_obj *pdf_ref_obj        (pdf_obj *object);
 pdf_obj *pdf_link_obj       (pdf_obj *object);
+/* pdf_ref_obj for a stream that may repeat an earlier one's dict and data */
+pdf_obj *pdf_ref_shared_stream (pdf_obj *stream);
 
 void     pdf_transfer_label (pdf_obj *dst, pdf_obj *src);
 pdf_obj *pdf_new_undefined  (void);
@@ -165,6 +184,10 @@ void        pdf_stream_set_predictor (pdf_obj *stream,
  */
 int         pdf_compare_reference (pdf_obj *ref1, pdf_obj *ref2);
 
+/* The object number an indirect reference to an object of the output file
+ * is written with; 0 for anything else. */
+uint32_t    pdf_ref_label (pdf_obj *ref);
+
 int pdf_compare_object(pdf_obj *obj1, pdf_obj *obj2);
 
 /* The following routines are not appropriate for pdfobj.
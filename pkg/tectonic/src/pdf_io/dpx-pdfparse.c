@@ -53,7 +53,7 @@
 
 #define istokensep(c) (is_space((c)) || is_delim((c)))
 
-static struct {
+static TTBC_THREAD_LOCAL struct {
   int tainted;
 } parser_state = {
   0
@@ -309,7 +309,7 @@ pn_getc (const char **pp, const char *endptr)
 #endif
 
 #define STRING_BUFFER_SIZE PDF_STRING_LEN_MAX+1
-static char sbuf[PDF_STRING_LEN_MAX+1];
+static TTBC_THREAD_LOCAL char sbuf[PDF_STRING_LEN_MAX+1];
 
 
 pdf_obj *
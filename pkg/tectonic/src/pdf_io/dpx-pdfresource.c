@@ -86,7 +86,7 @@ struct res_cache
   pdf_res *resources;
 };
 
-static struct res_cache resources[PDF_NUM_RESOURCE_CATEGORIES];
+static TTBC_THREAD_LOCAL struct res_cache resources[PDF_NUM_RESOURCE_CATEGORIES];
 
 static void
 pdf_init_resource (pdf_res *res)
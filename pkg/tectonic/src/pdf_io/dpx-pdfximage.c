@@ -23,6 +23,7 @@
 #include "dpx-pdfximage.h"
 
 #include <fcntl.h>
+#include <math.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -35,16 +36,20 @@
 #include "dpx-dpxutil.h"
 #include "dpx-epdf.h"
 #include "dpx-error.h"
+#include "dpx-imagecache.h"
 #include "dpx-jpegimage.h"
 #include "dpx-mem.h"
 #include "dpx-mfileio.h"
+#include "dpx-pagedigest.h"
 #include "dpx-pdfdev.h"
 #include "dpx-pdfdraw.h"
 #include "dpx-pdfnames.h"
 #include "dpx-pdfobj.h"
 #include "dpx-pngimage.h"
+#include "dpx-webpimage.h"
 
 static int check_for_ps (rust_input_handle_t handle);
+static void scale_to_fit_I (pdf_tmatrix *T, transform_info *p, pdf_ximage *I);
 
 
 #define IMAGE_TYPE_UNKNOWN -1
@@ -54,6 +59,8 @@ static int check_for_ps (rust_input_handle_t handle);
 #define IMAGE_TYPE_EPS      5
 #define IMAGE_TYPE_BMP      6
 #define IMAGE_TYPE_JP2      7
+#define IMAGE_TYPE_WEBP     8
+#define IMAGE_TYPE_AVIF     9
 
 
 struct attr_
@@ -68,6 +75,7 @@ struct attr_
     int      bbox_type;  /* Ugh */
     pdf_obj *dict;
     char     tempfile;
+    char     downscaled; /* fewer pixels than the file has */
 };
 
 struct pdf_ximage_
@@ -84,6 +92,7 @@ struct pdf_ximage_
     pdf_obj     *reference;
     pdf_obj     *resource;
     int reserved;
+    unsigned char digest[16]; /* of the file, when pages are digested */
 };
 
 
@@ -93,7 +102,7 @@ struct opt_
     char  *cmdtmpl;
 };
 
-static struct opt_ _opts = {
+static TTBC_THREAD_LOCAL struct opt_ _opts = {
     NULL
 };
 
@@ -103,10 +112,13 @@ struct ic_
     pdf_ximage *ximages;
 };
 
-static struct ic_  _ic = {
+static TTBC_THREAD_LOCAL struct ic_  _ic = {
     0, 0, NULL
 };
 
+static TTBC_THREAD_LOCAL int image_dpi = 0;
+static TTBC_THREAD_LOCAL int draft_images = 0;
+
 static void
 pdf_init_ximage_struct (pdf_ximage *I)
 {
@@ -119,6 +131,7 @@ pdf_init_ximage_struct (pdf_ximage *I)
     I->reference = NULL;
     I->resource  = NULL;
     I->reserved = 0;
+    memset(I->digest, 0, 16);
 
     I->attr.width = I->attr.height = 0;
     I->attr.xdensity = I->attr.ydensity = 1.0;
@@ -128,6 +141,7 @@ pdf_init_ximage_struct (pdf_ximage *I)
     I->attr.page_no    = 1;
     I->attr.page_count = 1;
     I->attr.bbox_type  = 0;
+    I->attr.downscaled = 0;
 
     I->attr.dict     = NULL;
     I->attr.tempfile = 0;
@@ -195,7 +209,8 @@ source_image_type (rust_input_handle_t handle)
 
     ttstub_input_seek(handle, 0, SEEK_SET);
 
-    /* Original check order: jpeg, jp2, png, bmp, pdf, ps */
+    /* Original check order: jpeg, jp2, png, bmp, pdf, ps; webp and avif
+     * follow bmp */
 
     if (check_for_jpeg(handle))
         format = IMAGE_TYPE_JPEG;
@@ -205,6 +220,10 @@ source_image_type (rust_input_handle_t handle)
         format = IMAGE_TYPE_PNG;
     else if (check_for_bmp(handle))
         format = IMAGE_TYPE_BMP;
+    else if (check_for_webp(handle))
+        format = IMAGE_TYPE_WEBP;
+    else if (check_for_avif(handle))
+        format = IMAGE_TYPE_AVIF;
     else if (check_for_pdf(handle))
         format = IMAGE_TYPE_PDF;
     else if (check_for_ps(handle))
@@ -218,14 +237,69 @@ source_image_type (rust_input_handle_t handle)
     return format;
 }
 
+/* A draft of a raster image: one gray sample, its density stretched to the
+ * image's size, so the page comes out laid out as it will be. Only the
+ * file's header is read. Every draft writes the same stream, which the
+ * output keeps once (see pdf_ref_shared_stream). */
+static int
+load_draft_image (pdf_ximage *I, int format, rust_input_handle_t handle)
+{
+    static const unsigned char gray = 0xd9;
+    ximage_info  info;
+    unsigned int width = 0, height = 0;
+    uint32_t     png_width = 0, png_height = 0;
+    double       xdensity = 1.0, ydensity = 1.0;
+    pdf_obj     *stream;
+    int          error;
+
+    ttstub_input_seek(handle, 0, SEEK_SET);
+    switch (format) {
+    case IMAGE_TYPE_JPEG:
+        error = jpeg_get_bbox(handle, &width, &height, &xdensity, &ydensity);
+        break;
+    case IMAGE_TYPE_PNG:
+        error = png_get_bbox(handle, &png_width, &png_height, &xdensity, &ydensity);
+        width = png_width;
+        height = png_height;
+        break;
+    case IMAGE_TYPE_BMP:
+        error = bmp_get_bbox(handle, &width, &height, &xdensity, &ydensity);
+        break;
+    case IMAGE_TYPE_WEBP:
+        error = webp_get_bbox(handle, &width, &height, &xdensity, &ydensity);
+        break;
+    default:
+        return -1;
+    }
+    ttstub_input_seek(handle, 0, SEEK_SET);
+    if (error < 0 || width == 0 || height == 0)
+        return -1;
+
+    pdf_ximage_init_image_info(&info);
+    info.width = 1;
+    info.height = 1;
+    info.bits_per_component = 8;
+    info.num_components = 1;
+    info.xdensity = xdensity * width;
+    info.ydensity = ydensity * height;
+
+    stream = pdf_new_stream(0);
+    pdf_add_dict(pdf_stream_dict(stream), pdf_new_name("ColorSpace"), pdf_new_name("DeviceGray"));
+    pdf_add_stream(stream, &gray, 1);
+    pdf_ximage_set_image(I, &info, stream);
+    return 0;
+}
+
 static int
 load_image (const char *ident, const char *filename, const char *fullname,
             int format, rust_input_handle_t handle,
             load_options options)
 {
     struct ic_ *ic = &_ic;
-    int id = -1, reserved = 0;
+    int id = -1, reserved = 0, recording = 0;
     pdf_ximage *I;
+    imagecache_key key;
+    ximage_info info;
 
     if (ident) {
         for (id = 0; id < ic->count; id++) {
@@ -265,6 +339,33 @@ load_image (const char *ident, const char *filename, const char *fullname,
     I->attr.bbox_type = options.bbox_type;
     I->attr.dict = options.dict; /* unsafe? */
 
+    if (draft_images && load_draft_image(I, format, handle) == 0) {
+        if (dpx_conf.verbose_level > 0)
+            dpx_message("[draft]");
+        goto done;
+    }
+
+    /* Raster images included plainly come out the same for the same file;
+     * named ones and those with a dict of their own are done each time. */
+    if (!ident && !options.dict &&
+        (format == IMAGE_TYPE_JPEG || format == IMAGE_TYPE_PNG || format == IMAGE_TYPE_BMP ||
+         format == IMAGE_TYPE_WEBP)) {
+        imagecache_make_key(&key, handle, format, &options);
+        I->reference = imagecache_replay(&key, &info);
+        if (I->reference) {
+            if (dpx_conf.verbose_level > 0)
+                dpx_message("[cached]");
+            I->subtype = PDF_XOBJECT_TYPE_IMAGE;
+            I->attr.width = info.width;
+            I->attr.height = info.height;
+            I->attr.xdensity = info.xdensity;
+            I->attr.ydensity = info.ydensity;
+            I->attr.downscaled = options.max_width > 0 && info.width == options.max_width;
+            goto done;
+        }
+        recording = imagecache_begin() == 0;
+    }
+
     switch (format) {
     case IMAGE_TYPE_JPEG:
         if (dpx_conf.verbose_level > 0)
@@ -284,9 +385,10 @@ load_image (const char *ident, const char *filename, const char *fullname,
     case IMAGE_TYPE_PNG:
         if (dpx_conf.verbose_level > 0)
             dpx_message("[PNG]");
-        if (png_include_image(I, handle) < 0)
+        if (png_include_image(I, handle, options.max_width, options.max_height) < 0)
             goto error;
         I->subtype = PDF_XOBJECT_TYPE_IMAGE;
+        I->attr.downscaled = options.max_width > 0 && I->attr.width == options.max_width;
         break;
     case IMAGE_TYPE_BMP:
         if (dpx_conf.verbose_level > 0)
@@ -295,6 +397,18 @@ load_image (const char *ident, const char *filename, const char *fullname,
             goto error;
         I->subtype = PDF_XOBJECT_TYPE_IMAGE;
         break;
+    case IMAGE_TYPE_WEBP:
+        if (dpx_conf.verbose_level > 0)
+            dpx_message("[WebP]");
+        if (webp_include_image(I, handle) < 0)
+            goto error;
+        I->subtype = PDF_XOBJECT_TYPE_IMAGE;
+        break;
+    case IMAGE_TYPE_AVIF:
+        if (dpx_conf.verbose_level > 0)
+            dpx_message("[AVIF]");
+        dpx_warning("Tectonic: AVIF images are not supported; convert to PNG, JPEG or WebP");
+        goto error;
     case IMAGE_TYPE_PDF:
         if (dpx_conf.verbose_level > 0)
             dpx_message("[PDF]");
@@ -321,6 +435,15 @@ load_image (const char *ident, const char *filename, const char *fullname,
         goto error;
     }
 
+    if (recording) {
+        info.width = I->attr.width;
+        info.height = I->attr.height;
+        info.xdensity = I->attr.xdensity;
+        info.ydensity = I->attr.ydensity;
+        imagecache_end(&key, I->reference, &info);
+    }
+
+done:
     switch (I->subtype) {
     case PDF_XOBJECT_TYPE_IMAGE:
         sprintf(I->res_name, "Im%d", id);
@@ -335,18 +458,77 @@ load_image (const char *ident, const char *filename, const char *fullname,
     return id;
 
 error:
+    if (recording)
+        imagecache_end(&key, NULL, NULL);
     pdf_clean_ximage_struct(I);
     return -1;
 }
 
+void
+pdf_ximage_set_image_dpi (int dpi)
+{
+    image_dpi = dpi;
+}
+
+void
+pdf_ximage_set_draft_images (int enable)
+{
+    draft_images = enable;
+}
+
+/* The factor by which I's pixels exceed what image_dpi needs where p places
+ * it: the larger of the two axes, so the aspect ratio stays. The image's
+ * size in bp (pixels times density) does not change when it is scaled, so
+ * neither does its placement. */
+static double
+placement_excess (transform_info *p, pdf_ximage *I)
+{
+    pdf_tmatrix M;
+    double      need_w, need_h;
+
+    scale_to_fit_I(&M, p, I);
+    need_w = fabs(M.a) * sqrt(p->matrix.a * p->matrix.a + p->matrix.b * p->matrix.b) * image_dpi / 72.0;
+    need_h = fabs(M.d) * sqrt(p->matrix.c * p->matrix.c + p->matrix.d * p->matrix.d) * image_dpi / 72.0;
+    if (need_w <= 0.0 || need_h <= 0.0)
+        return 1.0;
+    return fmin(I->attr.width / need_w, I->attr.height / need_h);
+}
+
+/* Sets options' pixel bound for the PNG behind handle when it has well over
+ * the pixels its placement needs. Only plainly included images qualify:
+ * named ones may be placed again at any size. */
+static void
+bound_to_placement (load_options *options, const char *ident, int format,
+                    rust_input_handle_t handle)
+{
+    pdf_ximage I;
+    uint32_t   width, height;
+    double     excess;
+
+    if (image_dpi <= 0 || !options->placement || ident || options->dict || format != IMAGE_TYPE_PNG)
+        return;
+    if (png_get_bbox(handle, &width, &height, &I.attr.xdensity, &I.attr.ydensity) < 0)
+        return;
+    ttstub_input_seek(handle, 0, SEEK_SET);
+    I.attr.width = width;
+    I.attr.height = height;
+    excess = placement_excess(options->placement, &I);
+    /* a little over is not worth the resampling */
+    if (excess < 1.25)
+        return;
+    options->max_width = (int) ceil(width / excess);
+    options->max_height = (int) ceil(height / excess);
+}
+
 int
 pdf_ximage_load_image (const char *ident, const char *filename, load_options options)
 {
     struct ic_ *ic = &_ic;
     int i, id = -1;
     pdf_ximage *I;
-    int format;
+    int format, mem_tag;
     rust_input_handle_t handle;
+    unsigned char digest[16];
 
     for (i = 0; i < ic->count; i++) {
         I = &ic->ximages[i];
@@ -360,7 +542,11 @@ pdf_ximage_load_image (const char *ident, const char *filename, load_options opt
     if (id >= 0) {
         if (I->attr.page_no == options.page_no &&
             !pdf_compare_object(I->attr.dict, options.dict) && /* ????? */
-            I->attr.bbox_type == options.bbox_type) {
+            I->attr.bbox_type == options.bbox_type &&
+            /* a scaled down copy does not do for a larger placement */
+            !(I->attr.downscaled && options.placement &&
+              placement_excess(options.placement, I) < 1.0)) {
+            pagedigest_add(I->digest, 16);
             return id;
         }
 
@@ -393,8 +579,19 @@ pdf_ximage_load_image (const char *ident, const char *filename, load_options opt
         dpx_message("(Image:%s", filename);
 
     format = source_image_type(handle);
+    bound_to_placement(&options, ident, format, handle);
+    if (pagedigest_active())
+        imagecache_file_digest(digest, handle);
     /* Tectonic: no external tools to deal with funky image formats */
+    ttbc_fire_checkpoint(TTBC_CHECKPOINT_IMAGE_BEGIN, filename);
+    mem_tag = ttbc_mem_set_tag(TTBC_MEM_IMAGES);
     id = load_image(ident, filename, filename, format, handle, options);
+    ttbc_mem_set_tag(mem_tag);
+    ttbc_fire_checkpoint(TTBC_CHECKPOINT_IMAGE_END, NULL);
+    if (id >= 0 && pagedigest_active()) {
+        memcpy(ic->ximages[id].digest, digest, 16);
+        pagedigest_add(digest, 16);
+    }
 
     ttstub_input_close(handle);
 
@@ -551,7 +748,8 @@ pdf_ximage_set_image (pdf_ximage *I, void *image_info, pdf_obj *resource)
         }
         I->reserved = 0;
     } else {
-        I->reference = pdf_ref_obj(resource);
+        /* the same picture under another name is written once */
+        I->reference = pdf_ref_shared_stream(resource);
     }
 
     pdf_release_obj(resource); /* Caller don't know we are using reference. */
@@ -56,6 +56,11 @@ typedef struct {
   int      page_no;
   enum pdf_page_boundary bbox_type;
   pdf_obj *dict;
+  /* Where the image is put, for pdf_ximage_set_image_dpi. May be NULL. */
+  transform_info *placement;
+  /* Pixel size a raster image is scaled down to; 0 keeps it as it is.
+   * Worked out by pdf_ximage_load_image from placement. */
+  int      max_width, max_height;
 } load_options;
 
 typedef struct pdf_ximage_ pdf_ximage;
@@ -71,6 +76,13 @@ int      pdf_ximage_load_image     (const char *ident, const char *filename, loa
 int      pdf_ximage_defineresource (const char *ident, int subtype, void *cdata, pdf_obj *resource);
 int      pdf_ximage_reserve        (const char *ident);
 
+/* Scale raster images down to what dpi needs where they are placed, when
+ * they have noticeably more pixels than that; 0 embeds them as they are. */
+void     pdf_ximage_set_image_dpi  (int dpi);
+/* Put raster images in as plain gray boxes of their size, reading only their
+ * headers; for previews. */
+void     pdf_ximage_set_draft_images (int enable);
+
 /* Called by pngimage, jpegimage, epdf, mpost, etc. */
 void pdf_ximage_init_image_info (ximage_info *info);
 void pdf_ximage_init_form_info  (xform_info  *info);
@@ -46,7 +46,7 @@
 #define PKFONT_DPI_DEFAULT 600u
 #endif
 
-static unsigned int base_dpi = PKFONT_DPI_DEFAULT;
+static TTBC_THREAD_LOCAL unsigned int base_dpi = PKFONT_DPI_DEFAULT;
 
 void
 PKFont_set_dpi (int dpi)
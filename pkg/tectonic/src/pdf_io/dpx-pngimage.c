@@ -116,6 +116,11 @@ static pdf_obj *strip_soft_mask    (png_structp png_ptr, png_infop info_ptr,
                                     png_uint_32 width, png_uint_32 height);
 
 /* Read image body */
+static int  idat_copyable (png_structp png_ptr, png_infop info_ptr, int trans_type);
+static int  copy_idat      (pdf_obj *stream, rust_input_handle_t handle);
+
+static png_bytep downsample (png_bytep data, png_uint_32 width, png_uint_32 height,
+                             int num_comps, png_uint_32 new_width, png_uint_32 new_height);
 static void read_image_data (png_structp png_ptr,
                              png_bytep dest_ptr,
                              png_uint_32 height, png_uint_32 rowbytes);
@@ -152,13 +157,14 @@ _png_read (png_structp png_ptr, png_bytep outbytes, png_size_t n)
 }
 
 int
-png_include_image (pdf_ximage *ximage, rust_input_handle_t handle)
+png_include_image (pdf_ximage *ximage, rust_input_handle_t handle,
+                   int max_width, int max_height)
 {
     pdf_obj  *stream;
     pdf_obj  *stream_dict;
     pdf_obj  *colorspace, *mask, *intent;
     png_bytep stream_data_ptr;
-    int       trans_type;
+    int       trans_type, copy, scale;
     ximage_info info;
     /* Libpng stuff */
     png_structp png_ptr;
@@ -202,8 +208,20 @@ png_include_image (pdf_ximage *ximage, rust_input_handle_t handle)
     height     = png_get_image_height(png_ptr, png_info_ptr);
     bpc        = png_get_bit_depth   (png_ptr, png_info_ptr);
 
-    if (bpc > 8) {
-        if (pdf_check_version(1, 5) < 0) {
+    trans_type = check_transparency(png_ptr, png_info_ptr);
+    /* Scaled down to the bound at 8-bpc. Indexed colors do not average, and
+     * averaged samples would slip out of a color-key mask's range. */
+    scale = max_width > 0 && (png_uint_32) max_width < width && (png_uint_32) max_height < height &&
+        color_type != PNG_COLOR_TYPE_PALETTE && trans_type != PDF_TRANS_TYPE_BINARY;
+    copy = !scale && idat_copyable(png_ptr, png_info_ptr, trans_type);
+
+    if (copy) {
+        /* Rows are taken as they are in the file. */
+    } else if (bpc > 8) {
+        if (scale) {
+            png_set_strip_16(png_ptr);
+            bpc = 8;
+        } else if (pdf_check_version(1, 5) < 0) {
             /* Ask libpng to convert down to 8-bpc. */
             dpx_warning("%s: 16-bpc PNG requires PDF version 1.5.", PNG_DEBUG_STR);
             png_set_strip_16(png_ptr);
@@ -222,7 +240,8 @@ png_include_image (pdf_ximage *ximage, rust_input_handle_t handle)
      * It is wrong to assume screen gamma value 2.2 but...
      * We do gamma correction here only when uncalibrated color space is used.
      */
-    if (!png_get_valid(png_ptr, png_info_ptr, PNG_INFO_iCCP) &&
+    if (!copy &&
+        !png_get_valid(png_ptr, png_info_ptr, PNG_INFO_iCCP) &&
         !png_get_valid(png_ptr, png_info_ptr, PNG_INFO_sRGB) &&
         !png_get_valid(png_ptr, png_info_ptr, PNG_INFO_cHRM) &&
         png_get_valid(png_ptr, png_info_ptr, PNG_INFO_gAMA)) {
@@ -231,7 +250,6 @@ png_include_image (pdf_ximage *ximage, rust_input_handle_t handle)
         png_set_gamma(png_ptr, 2.2, G);
     }
 
-    trans_type = check_transparency(png_ptr, png_info_ptr);
     /* check_transparency() does not do updata_info() */
     png_read_update_info(png_ptr, png_info_ptr);
     rowbytes = png_get_rowbytes(png_ptr, png_info_ptr);
@@ -251,11 +269,17 @@ png_include_image (pdf_ximage *ximage, rust_input_handle_t handle)
             info.ydensity = 72.0 / 0.0254 / yppm;
     }
 
-    stream      = pdf_new_stream (STREAM_COMPRESS);
-    stream_dict = pdf_stream_dict(stream);
+    if (copy) {
+        stream      = pdf_new_stream(0);
+        stream_dict = pdf_stream_dict(stream);
+        stream_data_ptr = NULL;
+    } else {
+        stream      = pdf_new_stream (STREAM_COMPRESS);
+        stream_dict = pdf_stream_dict(stream);
 
-    stream_data_ptr = (png_bytep) NEW(rowbytes*height, png_byte);
-    read_image_data(png_ptr, stream_data_ptr, height, rowbytes);
+        stream_data_ptr = (png_bytep) NEW(rowbytes*height, png_byte);
+        read_image_data(png_ptr, stream_data_ptr, height, rowbytes);
+    }
 
     /* Non-NULL intent means there is valid sRGB chunk. */
     intent = get_rendering_intent(png_ptr, png_info_ptr);
@@ -345,8 +369,42 @@ png_include_image (pdf_ximage *ximage, rust_input_handle_t handle)
     }
     pdf_add_dict(stream_dict, pdf_new_name("ColorSpace"), colorspace);
 
-    pdf_add_stream(stream, stream_data_ptr, rowbytes*height);
-    free(stream_data_ptr);
+    if (copy) {
+        pdf_obj *parms = pdf_new_dict();
+
+        pdf_add_dict(parms, pdf_new_name("BitsPerComponent"), pdf_new_number(bpc));
+        pdf_add_dict(parms, pdf_new_name("Colors"), pdf_new_number(info.num_components));
+        pdf_add_dict(parms, pdf_new_name("Columns"), pdf_new_number(width));
+        pdf_add_dict(parms, pdf_new_name("Predictor"), pdf_new_number(15));
+        pdf_add_dict(stream_dict, pdf_new_name("Filter"), pdf_new_name("FlateDecode"));
+        pdf_add_dict(stream_dict, pdf_new_name("DecodeParms"), parms);
+        if (copy_idat(stream, handle) < 0) {
+            dpx_warning("%s: Reading IDAT chunks failed.", PNG_DEBUG_STR);
+            if (mask)
+                pdf_release_obj(mask);
+            pdf_release_obj(stream);
+            png_destroy_info_struct(png_ptr, &png_info_ptr);
+            png_destroy_read_struct(&png_ptr, NULL, NULL);
+            return -1;
+        }
+    } else if (scale) {
+        /* The soft mask keeps its pixels; it is mapped onto the same unit
+         * square whatever its size. Density grows as the pixels shrink, so
+         * the image keeps its size in bp. */
+        png_bytep scaled = downsample(stream_data_ptr, width, height, info.num_components,
+                                      max_width, max_height);
+
+        free(stream_data_ptr);
+        info.xdensity *= (double) width / max_width;
+        info.ydensity *= (double) height / max_height;
+        info.width  = max_width;
+        info.height = max_height;
+        pdf_add_stream(stream, scaled, max_width * info.num_components * max_height);
+        free(scaled);
+    } else {
+        pdf_add_stream(stream, stream_data_ptr, rowbytes*height);
+        free(stream_data_ptr);
+    }
 
     if (mask) {
         if (trans_type == PDF_TRANS_TYPE_BINARY)
@@ -356,7 +414,8 @@ png_include_image (pdf_ximage *ximage, rust_input_handle_t handle)
                 pdf_stream_set_predictor(mask, 2, info.width,
                                          info.bits_per_component, 1);
             }
-            pdf_add_dict(stream_dict, pdf_new_name("SMask"), pdf_ref_obj(mask));
+            /* shared, so that copies of the image can be too */
+            pdf_add_dict(stream_dict, pdf_new_name("SMask"), pdf_ref_shared_stream(mask));
             pdf_release_obj(mask);
         } else {
             dpx_warning("%s: Unknown transparency type...???", PNG_DEBUG_STR);
@@ -412,14 +471,17 @@ png_include_image (pdf_ximage *ximage, rust_input_handle_t handle)
     }
 #endif /* PNG_LIBPNG_VER */
 
-    png_read_end(png_ptr, NULL);
+    /* The image data was not read through libpng when copied. */
+    if (!copy)
+        png_read_end(png_ptr, NULL);
 
     /* Cleanup */
     if (png_info_ptr)
         png_destroy_info_struct(png_ptr, &png_info_ptr);
     if (png_ptr)
         png_destroy_read_struct(&png_ptr, NULL, NULL);
-    if (color_type != PNG_COLOR_TYPE_PALETTE &&
+    if (!copy &&
+        color_type != PNG_COLOR_TYPE_PALETTE &&
         info.bits_per_component >= 8 &&
         info.height > 64) {
         pdf_stream_set_predictor(stream, 15, info.width,
@@ -430,6 +492,118 @@ png_include_image (pdf_ximage *ximage, rust_input_handle_t handle)
     return 0;
 }
 
+/*
+ * Box filter from width x height to new_width x new_height 8-bit samples of
+ * num_comps each: every output pixel is the mean of the input pixels its
+ * area covers, which is what a much smaller rendering would show anyway.
+ */
+static png_bytep
+downsample (png_bytep data, png_uint_32 width, png_uint_32 height, int num_comps,
+            png_uint_32 new_width, png_uint_32 new_height)
+{
+    png_bytep     out = NEW((size_t) new_width * new_height * num_comps, png_byte);
+    png_uint_32  *x0 = NEW(new_width + 1, png_uint_32);
+    uint32_t     *sums = NEW((size_t) new_width * num_comps, uint32_t);
+    png_uint_32   x, y, oy, row_begin, row_end;
+    int           c;
+
+    for (x = 0; x <= new_width; x++)
+        x0[x] = (png_uint_32) ((uint64_t) x * width / new_width);
+
+    for (oy = 0; oy < new_height; oy++) {
+        row_begin = (png_uint_32) ((uint64_t) oy * height / new_height);
+        row_end   = (png_uint_32) ((uint64_t) (oy + 1) * height / new_height);
+        memset(sums, 0, sizeof(uint32_t) * new_width * num_comps);
+        for (y = row_begin; y < row_end; y++) {
+            png_bytep row = data + (size_t) y * width * num_comps;
+            for (x = 0; x < new_width; x++) {
+                png_uint_32 sx;
+                for (sx = x0[x]; sx < x0[x + 1]; sx++)
+                    for (c = 0; c < num_comps; c++)
+                        sums[x * num_comps + c] += row[sx * num_comps + c];
+            }
+        }
+        for (x = 0; x < new_width; x++) {
+            uint32_t area = (x0[x + 1] - x0[x]) * (row_end - row_begin);
+            png_bytep px = out + ((size_t) oy * new_width + x) * num_comps;
+            for (c = 0; c < num_comps; c++)
+                px[c] = (png_byte) ((sums[x * num_comps + c] + area / 2) / area);
+        }
+    }
+
+    free(x0);
+    free(sums);
+    return out;
+}
+
+/*
+ * IDAT chunks hold one zlib stream of filtered rows, which FlateDecode with
+ * the PNG predictors decodes. When libpng would pass the rows through
+ * unchanged, that stream can go into the PDF as it is instead of being
+ * inflated and deflated again: the image must not be interlaced, have no
+ * alpha channel to split off, need no gamma correction, and have no
+ * transparency that is composited away or needs a soft mask.
+ */
+static int
+idat_copyable (png_structp png_ptr, png_infop info_ptr, int trans_type)
+{
+    png_byte color_type = png_get_color_type(png_ptr, info_ptr);
+    png_byte bpc        = png_get_bit_depth(png_ptr, info_ptr);
+
+    if (png_get_interlace_type(png_ptr, info_ptr) != PNG_INTERLACE_NONE)
+        return 0;
+    if (color_type != PNG_COLOR_TYPE_GRAY &&
+        color_type != PNG_COLOR_TYPE_RGB &&
+        color_type != PNG_COLOR_TYPE_PALETTE)
+        return 0;
+    if (bpc > 8 && pdf_check_version(1, 5) < 0)
+        return 0;
+    if (!png_get_valid(png_ptr, info_ptr, PNG_INFO_iCCP) &&
+        !png_get_valid(png_ptr, info_ptr, PNG_INFO_sRGB) &&
+        !png_get_valid(png_ptr, info_ptr, PNG_INFO_cHRM) &&
+        png_get_valid(png_ptr, info_ptr, PNG_INFO_gAMA))
+        return 0;
+    if (trans_type == PDF_TRANS_TYPE_ALPHA ||
+        (trans_type == PDF_TRANS_TYPE_NONE &&
+         png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS)))
+        return 0;
+
+    return 1;
+}
+
+/* Append the data of every IDAT chunk to stream; -1 on a malformed file. */
+static int
+copy_idat (pdf_obj *stream, rust_input_handle_t handle)
+{
+    unsigned char hdr[8], buf[16384];
+    uint32_t      len;
+    size_t        pos = 8; /* past the signature */
+    ssize_t       n;
+
+    for (;;) {
+        ttstub_input_seek(handle, pos, SEEK_SET);
+        if (ttbc_input_read(handle, (char *) hdr, 8) != 8)
+            return -1;
+        len = ((uint32_t) hdr[0] << 24) | (hdr[1] << 16) | (hdr[2] << 8) | hdr[3];
+        if (len > 0x7fffffffu)
+            return -1;
+        if (!memcmp(hdr + 4, "IEND", 4))
+            return 0;
+        if (!memcmp(hdr + 4, "IDAT", 4)) {
+            uint32_t left = len;
+
+            while (left > 0) {
+                n = ttbc_input_read(handle, (char *) buf, left < sizeof(buf) ? left : sizeof(buf));
+                if (n <= 0)
+                    return -1;
+                pdf_add_stream(stream, buf, n);
+                left -= n;
+            }
+        }
+        pos += 12 + (size_t) len; /* length, type, data, CRC */
+    }
+}
+
 /*
  * The returned value trans_type is the type of transparency to be used for
  * this image. Possible values are:
@@ -31,7 +31,9 @@
 #include "dpx-mfileio.h"
 #include "dpx-pdfximage.h"
 
-int png_include_image (pdf_ximage *ximage, rust_input_handle_t handle);
+/* max_width and max_height bound the pixels embedded, 0 for no bound. */
+int png_include_image (pdf_ximage *ximage, rust_input_handle_t handle,
+                       int max_width, int max_height);
 int check_for_png     (rust_input_handle_t handle);
 int png_get_bbox (rust_input_handle_t handle, uint32_t *width, uint32_t *height,
                          double *xdensity, double *ydensity);
@@ -424,7 +424,7 @@ sfnt_require_table (sfnt *sfont, const char *tag, int must_exist)
  *   then store 0xB1B0AFBA - sum.
  */
 
-static unsigned char wbuf[1024], padbytes[4] = {0, 0, 0, 0};
+static TTBC_THREAD_LOCAL unsigned char wbuf[1024], padbytes[4] = {0, 0, 0, 0};
 
 pdf_obj *
 sfnt_create_FontFile_stream (sfnt *sfont)
@@ -47,13 +47,13 @@
 #include "dpx-spc_xtx.h"
 #include "dpx-specials.h"
 
-static int    block_pending = 0;
-static double pending_x     = 0.0;
-static double pending_y     = 0.0;
-static int    position_set  = 0;
+static TTBC_THREAD_LOCAL int    block_pending = 0;
+static TTBC_THREAD_LOCAL double pending_x     = 0.0;
+static TTBC_THREAD_LOCAL double pending_y     = 0.0;
+static TTBC_THREAD_LOCAL int    position_set  = 0;
 
-static char** ps_headers = 0;
-static int num_ps_headers = 0;
+static TTBC_THREAD_LOCAL char** ps_headers = 0;
+static TTBC_THREAD_LOCAL int num_ps_headers = 0;
 
 
 static int
@@ -64,7 +64,7 @@ struct spc_html_
   int       pending_type;
 };
 
-static struct spc_html_ _html_state = {
+static TTBC_THREAD_LOCAL struct spc_html_ _html_state = {
   { 0 },
   NULL, NULL, -1
 };
@@ -58,7 +58,7 @@ struct spc_stack
     struct stack stacks[PDFCOLORSTACK_MAX_STACK];
 };
 
-static struct spc_stack spc_stack;
+static TTBC_THREAD_LOCAL struct spc_stack spc_stack;
 
 static int
 pdfcolorstack__get_id (struct spc_env *spe, int *id, struct spc_arg *args)
@@ -360,9 +360,9 @@ struct fontattr {
     pdf_obj *attr;
 };
 
-struct fontattr *fontattrs = NULL;
-int num_fontattrs = 0;
-int max_fontattrs = 0;
+TTBC_THREAD_LOCAL struct fontattr *fontattrs = NULL;
+TTBC_THREAD_LOCAL int num_fontattrs = 0;
+TTBC_THREAD_LOCAL int max_fontattrs = 0;
 
 static int
 process_fontattr (const char *ident, double size, pdf_obj *attr)
@@ -64,7 +64,7 @@ struct spc_pdf_
    pdf_obj          *pageresources; /* Add to all page resource dict */
 };
 
-static struct spc_pdf_  _pdf_stat = {
+static TTBC_THREAD_LOCAL struct spc_pdf_  _pdf_stat = {
   NULL,
   255,
   { -1, 0, NULL },
@@ -1255,6 +1255,8 @@ spc_handler_pdfm_image (struct spc_env *spe, struct spc_arg *args)
     options.dict = parse_pdf_object_extended(&args->curptr, args->endptr, NULL, parse_pdf_reference, spe);
   }
 
+  if (!(ti.flags & INFO_DO_HIDE))
+    options.placement = &ti;
   xobj_id = pdf_ximage_load_image(ident, pdf_string_value(fspec), options);
 
   if (xobj_id < 0) {
@@ -1954,7 +1956,7 @@ spc_handler_pdfm_mapline (struct spc_env *spe, struct spc_arg *ap)
   fontmap_rec *mrec;
   char        *map_name, opchr;
   int          error = 0;
-  static char  buffer[THEBUFFLENGTH];
+  static TTBC_THREAD_LOCAL char  buffer[THEBUFFLENGTH];
   const char  *p;
   char        *q;
   int         count;
@@ -2341,13 +2343,38 @@ spc_pdfm_check_special (const char *buf, int len)
   return false;
 }
 
+/* pdfm_handlers by command. Every TikZ path is a pdf:literal or
+ * pdf:content, so the command is looked up in place rather than copied and
+ * compared with each key in turn. Built on first use; the table only points
+ * into pdfm_handlers. */
+static TTBC_THREAD_LOCAL struct ht_table pdfm_handler_table;
+static TTBC_THREAD_LOCAL int pdfm_handler_table_ready = 0;
+
+static struct spc_handler *
+lookup_pdfm_handler (const char *cmd, int len)
+{
+  size_t i;
+
+  if (!pdfm_handler_table_ready) {
+    ht_init_table(&pdfm_handler_table, NULL);
+    for (i = 0; i < sizeof(pdfm_handlers) / sizeof(struct spc_handler); i++) {
+      ht_append_table(&pdfm_handler_table, pdfm_handlers[i].key,
+                      strlen(pdfm_handlers[i].key), &pdfm_handlers[i]);
+    }
+    pdfm_handler_table_ready = 1;
+  }
+
+  return ht_lookup_table(&pdfm_handler_table, cmd, len);
+}
+
 int
 spc_pdfm_setup_handler (struct spc_handler *sph,
                         struct spc_env *spe, struct spc_arg *ap)
 {
   int    error = -1;
   size_t i;
-  char  *q;
+  const char *q;
+  int    len;
 
   assert(sph && spe && ap);
 
@@ -2360,8 +2387,9 @@ spc_pdfm_setup_handler (struct spc_handler *sph,
   ap->curptr += strlen("pdf:");
 
   skip_white(&ap->curptr, ap->endptr);
-  q = parse_c_ident(&ap->curptr, ap->endptr);
-  if (q) {
+  q   = ap->curptr;
+  len = skip_c_ident(&ap->curptr, ap->endptr);
+  if (len > 0) {
     int is_pdft_compat = 0;
     if (ap->curptr < ap->endptr) {
       if (ap->curptr[0] == ':') {
@@ -2371,7 +2399,8 @@ spc_pdfm_setup_handler (struct spc_handler *sph,
     }
     if (is_pdft_compat) {
       for (i = 0; i < sizeof(pdft_compat_handlers) / sizeof(struct spc_handler); i++) {
-        if (!strcmp(q, pdft_compat_handlers[i].key)) {
+        if (strlen(pdft_compat_handlers[i].key) == (size_t) len &&
+            !memcmp(q, pdft_compat_handlers[i].key, len)) {
           ap->command = pdft_compat_handlers[i].key;
           sph->key   = "pdf:";
           sph->exec  = pdft_compat_handlers[i].exec;
@@ -2381,18 +2410,15 @@ spc_pdfm_setup_handler (struct spc_handler *sph,
         }
       }
     } else {
-      for (i = 0; i < sizeof(pdfm_handlers) / sizeof(struct spc_handler); i++) {
-        if (!strcmp(q, pdfm_handlers[i].key)) {
-          ap->command = pdfm_handlers[i].key;
-          sph->key   = "pdf:";
-          sph->exec  = pdfm_handlers[i].exec;
-          skip_white(&ap->curptr, ap->endptr);
-          error = 0;
-          break;
-        }
+      struct spc_handler *h = lookup_pdfm_handler(q, len);
+      if (h) {
+        ap->command = h->key;
+        sph->key   = "pdf:";
+        sph->exec  = h->exec;
+        skip_white(&ap->curptr, ap->endptr);
+        error = 0;
       }
     }
-    free(q);
   }
 
   return  error;
@@ -90,7 +90,7 @@ struct spc_tpic_
 };
 
 #if  1
-static struct spc_tpic_ _tpic_state;
+static TTBC_THREAD_LOCAL struct spc_tpic_ _tpic_state;
 #endif
 
 /* We use pdf_doc_add_page_content() here
@@ -84,8 +84,8 @@ spc_handler_xtx_scale (struct spc_env *spe, struct spc_arg *args)
 }
 
 /* Scaling without gsave/grestore. */
-static pdf_coord *scaleFactors = 0;
-static int scaleFactorCount = -1;
+static TTBC_THREAD_LOCAL pdf_coord *scaleFactors = 0;
+static TTBC_THREAD_LOCAL int scaleFactorCount = -1;
 
 static int
 spc_handler_xtx_bscale (struct spc_env *spe, struct spc_arg *args)
@@ -195,7 +195,7 @@ spc_handler_xtx_fontmapline (struct spc_env *spe, struct spc_arg *ap)
   fontmap_rec *mrec;
   char        *map_name, opchr;
   int          error = 0;
-  static char  buffer[THEBUFFLENGTH];
+  static TTBC_THREAD_LOCAL char  buffer[THEBUFFLENGTH];
   const char  *p;
   char        *q;
   int         count;
@@ -291,7 +291,7 @@ spc_handler_xtx_fontmapfile (struct spc_env *spe, struct spc_arg *args)
   return  error;
 }
 
-static char overlay_name[256];
+static TTBC_THREAD_LOCAL char overlay_name[256];
 
 static int
 spc_handler_xtx_initoverlay (struct spc_env *spe, struct spc_arg *args)
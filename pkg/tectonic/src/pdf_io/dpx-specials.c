@@ -24,6 +24,7 @@
 
 #include <assert.h>
 #include <ctype.h>
+#include <inttypes.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -55,7 +56,7 @@ void
 spc_warn (struct spc_env *spe, const char *fmt, ...)
 {
   va_list  ap;
-  static char buf[1024];
+  static TTBC_THREAD_LOCAL char buf[1024];
 
   va_start(ap, fmt);
 
@@ -301,7 +302,7 @@ spc_clear_objects (struct spc_env *spe)
 /* Migrated form pdf_dev.c
  * No need to palce this into pdfdev.c at all.
  */
-static dpx_stack coords;
+static TTBC_THREAD_LOCAL dpx_stack coords;
 
 void
 spc_get_coord (struct spc_env *spe, double *x, double *y)
@@ -348,7 +349,7 @@ spc_pop_coord (struct spc_env *spe)
  *
  */
 
-static dpx_stack pt_fixee;
+static TTBC_THREAD_LOCAL dpx_stack pt_fixee;
 
 void
 spc_set_fixed_point (struct spc_env *spe, double x, double y)
@@ -615,6 +616,46 @@ static struct {
   {NULL} /* end */
 };
 
+#define NUM_KNOWN_SPECIALS (sizeof(known_specials) / sizeof(known_specials[0]) - 1)
+
+/* Specials run this document, by known_specials entry; the last slot
+ * counts the ones nobody claimed. */
+static TTBC_THREAD_LOCAL uint64_t special_counts[NUM_KNOWN_SPECIALS + 1];
+
+/* The entry a special belongs to. The prefixes that only one entry checks
+ * for are told apart by their first bytes, without calling check_func;
+ * pdf: comes first, as it is by far the most common. Everything else asks
+ * each check_func in turn. Returns -1 when no entry claims it. */
+static int
+find_special (const char *buffer, int32_t size)
+{
+  static const struct {
+    const char *prefix;
+    int         index;
+  } prefixes[] = {
+    {"pdf:",      0},
+    {"x:",        1},
+    {"dvipdfmx:", 2},
+  };
+  const char *p = buffer, *endptr = buffer + size;
+  size_t i;
+
+  skip_white(&p, endptr);
+  for (i = 0; i < sizeof(prefixes) / sizeof(prefixes[0]); i++) {
+    size_t len = strlen(prefixes[i].prefix);
+    if (p + len <= endptr && p[0] == prefixes[i].prefix[0] &&
+        !memcmp(p, prefixes[i].prefix, len))
+      return prefixes[i].index;
+  }
+
+  for (i = 0; known_specials[i].key != NULL; i++) {
+    if (known_specials[i].check_func(buffer, size))
+      return (int) i;
+  }
+
+  return -1;
+}
+
 int
 spc_begin_form (struct spc_env *spe, const char *ident, pdf_coord cp, pdf_rect *cropbox)
 {
@@ -694,6 +735,7 @@ spc_exec_at_begin_document (void)
       error = known_specials[i].bodhk_func();
     }
   }
+  memset(special_counts, 0, sizeof(special_counts));
 
   dpx_stack_init(&coords);
   dpx_stack_init(&pt_fixee);
@@ -701,6 +743,25 @@ spc_exec_at_begin_document (void)
   return error;
 }
 
+/* This document's specials by kind, to the trace. */
+static void
+report_special_counts (void)
+{
+  char   detail[256];
+  int    len;
+  size_t i;
+
+  len = snprintf(detail, sizeof detail, "specials:");
+  for (i = 0; i <= NUM_KNOWN_SPECIALS && len < (int) sizeof detail; i++) {
+    if (special_counts[i] == 0)
+      continue;
+    len += snprintf(detail + len, sizeof detail - len, " %" PRIu64 " %s", special_counts[i],
+                    i < NUM_KNOWN_SPECIALS ? known_specials[i].key : "unknown");
+  }
+  if (len > (int) strlen("specials:"))
+    ttbc_fire_checkpoint(TTBC_CHECKPOINT_STATS, detail);
+}
+
 int
 spc_exec_at_end_document (void)
 {
@@ -713,6 +774,7 @@ spc_exec_at_end_document (void)
       error = known_specials[i].eodhk_func();
     }
   }
+  report_special_counts();
 
   while ((p = dpx_stack_pop(&coords)) != NULL) {
     free(p);
@@ -782,7 +844,6 @@ spc_exec_special (const char *buffer, int32_t size,
 {
   int    error = -1;
   int    i;
-  bool   found;
   struct spc_env     spe;
   struct spc_arg     args;
   struct spc_handler special;
@@ -794,26 +855,24 @@ spc_exec_special (const char *buffer, int32_t size,
 
   init_special(&special, &spe, &args, buffer, size, x_user, y_user, mag);
 
-  for (i = 0; known_specials[i].key != NULL; i++) {
-    found = known_specials[i].check_func(buffer, size);
-    if (found) {
-      error = known_specials[i].setup_func(&special, &spe, &args);
-      if (!error) {
-        error = special.exec(&spe, &args);
-      }
-      if (error) {
-        print_error(known_specials[i].key, &spe, &args);
-      } else {
-        if (is_drawable)
-          *is_drawable = spe.info.is_drawable;
-        if (rect) {
-          rect->llx    = spe.info.rect.llx;
-          rect->lly    = spe.info.rect.lly;
-          rect->urx    = spe.info.rect.urx;
-          rect->ury    = spe.info.rect.ury;
-        }
+  i = find_special(buffer, size);
+  special_counts[i < 0 ? NUM_KNOWN_SPECIALS : (size_t) i]++;
+  if (i >= 0) {
+    error = known_specials[i].setup_func(&special, &spe, &args);
+    if (!error) {
+      error = special.exec(&spe, &args);
+    }
+    if (error) {
+      print_error(known_specials[i].key, &spe, &args);
+    } else {
+      if (is_drawable)
+        *is_drawable = spe.info.is_drawable;
+      if (rect) {
+        rect->llx    = spe.info.rect.llx;
+        rect->lly    = spe.info.rect.lly;
+        rect->urx    = spe.info.rect.urx;
+        rect->ury    = spe.info.rect.ury;
       }
-      break;
     }
   }
 
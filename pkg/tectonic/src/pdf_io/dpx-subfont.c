@@ -88,11 +88,11 @@ clean_sfd_file_ (struct sfd_file_ *sfd)
     init_sfd_file_(sfd);
 }
 
-static struct sfd_file_ *sfd_files = NULL;
-static int num_sfd_files = 0, max_sfd_files = 0;
+static TTBC_THREAD_LOCAL struct sfd_file_ *sfd_files = NULL;
+static TTBC_THREAD_LOCAL int num_sfd_files = 0, max_sfd_files = 0;
 
-static struct sfd_rec_ *sfd_record = NULL;
-static int num_sfd_records = 0, max_sfd_records = 0;
+static TTBC_THREAD_LOCAL struct sfd_rec_ *sfd_record = NULL;
+static TTBC_THREAD_LOCAL int num_sfd_records = 0, max_sfd_records = 0;
 
 
 
@@ -101,7 +101,7 @@ static int num_sfd_records = 0, max_sfd_records = 0;
  * 4096 is usually enough.
  */
 #define LINE_BUF_SIZE 4096
-static char line_buf[LINE_BUF_SIZE];
+static TTBC_THREAD_LOCAL char line_buf[LINE_BUF_SIZE];
 
 /* Each lines describes character code mapping for each
  * subfonts. '#' is start of comment.
@@ -241,8 +241,8 @@ fm_clear (struct font_metric *fm)
 #define MAX_FONTS 16
 #endif
 
-static struct font_metric *fms = NULL;
-static unsigned int numfms = 0, max_fms = 0;
+static TTBC_THREAD_LOCAL struct font_metric *fms = NULL;
+static TTBC_THREAD_LOCAL unsigned int numfms = 0, max_fms = 0;
 
 void
 tfm_reset_global_state(void)
@@ -43,6 +43,7 @@
 /* Hash */
 #include "dpx-dpxutil.h"
 #include "dpx-error.h"
+#include "dpx-fontcache.h"
 #include "dpx-mem.h"
 #include "dpx-pdfresource.h"
 #include "dpx-sfnt.h"
@@ -215,6 +216,9 @@ struct cmap4
     USHORT *idDelta;
     USHORT *idRangeOffset;
     USHORT *glyphIndexArray;
+    USHORT  numGlyphIndex;
+    /* segments in order and apart, for a binary search (see lookup_cmap4) */
+    int     disjoint;
 };
 
 static struct cmap4 *
@@ -256,6 +260,7 @@ read_cmap4(sfnt *sfont, ULONG len)
         map->idRangeOffset[i] = sfnt_get_ushort(sfont);
 
     n = (len - 16 - 8 * segCount) / 2;
+    map->numGlyphIndex = n;
     if (n == 0)
         map->glyphIndexArray = NULL;
     else {
@@ -264,6 +269,13 @@ read_cmap4(sfnt *sfont, ULONG len)
             map->glyphIndexArray[i] = sfnt_get_ushort(sfont);
     }
 
+    map->disjoint = 1;
+    for (i = 0; i < segCount; i++) {
+        if (map->startCount[i] > map->endCount[i] ||
+            (i > 0 && map->endCount[i-1] >= map->startCount[i]))
+            map->disjoint = 0;
+    }
+
     return map;
 }
 
@@ -280,36 +292,63 @@ release_cmap4 (struct cmap4 *map)
     }
 }
 
+/* The glyph of cc in segment i, which holds it. */
+static USHORT
+lookup_cmap4_segment (struct cmap4 *map, USHORT i, USHORT cc)
+{
+    USHORT gid, j, segCount = map->segCountX2 / 2;
+
+    if (map->idRangeOffset[i] == 0)
+        return (cc + map->idDelta[i]) & 0xffff;
+    if (cc == 0xffff && map->idRangeOffset[i] == 0xffff) {
+        /* this is for protection against some old broken fonts... */
+        return 0;
+    }
+    j  = map->idRangeOffset[i] - (segCount - i) * 2;
+    j  = (cc - map->startCount[i]) + (j / 2);
+    /* past the table only in a broken font */
+    if (j >= map->numGlyphIndex)
+        return 0;
+    gid = map->glyphIndexArray[j];
+    if (gid != 0)
+        gid = (gid + map->idDelta[i]) & 0xffff;
+
+    return gid;
+}
+
 static USHORT
 lookup_cmap4 (struct cmap4 *map, USHORT cc)
 {
-    USHORT gid = 0;
-    USHORT i, j, segCount;
+    USHORT i, segCount;
 
     /*
      * Segments are sorted in order of increasing endCode values.
      * Last segment maps 0xffff to gid 0 (?)
      */
-    i = segCount = map->segCountX2 / 2;
-    while (i-- > 0 && cc <= map->endCount[i]) {
-        if (cc >= map->startCount[i]) {
-            if (map->idRangeOffset[i] == 0) {
-                gid = (cc + map->idDelta[i]) & 0xffff;
-            } else if (cc == 0xffff && map->idRangeOffset[i] == 0xffff) {
-                /* this is for protection against some old broken fonts... */
-                gid = 0;
-            } else {
-                j  = map->idRangeOffset[i] - (segCount - i) * 2;
-                j  = (cc - map->startCount[i]) + (j / 2);
-                gid = map->glyphIndexArray[j];
-                if (gid != 0)
-                    gid = (gid + map->idDelta[i]) & 0xffff;
-            }
-            break;
+    segCount = map->segCountX2 / 2;
+    if (map->disjoint) {
+        /* only the first segment ending at or after cc can hold it */
+        int lo = 0, hi = segCount;
+
+        while (lo < hi) {
+            int mid = lo + (hi - lo) / 2;
+            if (map->endCount[mid] < cc)
+                lo = mid + 1;
+            else
+                hi = mid;
         }
+        if (lo < segCount && cc >= map->startCount[lo])
+            return lookup_cmap4_segment(map, lo, cc);
+        return 0;
     }
 
-    return gid;
+    i = segCount;
+    while (i-- > 0 && cc <= map->endCount[i]) {
+        if (cc >= map->startCount[i])
+            return lookup_cmap4_segment(map, i, cc);
+    }
+
+    return 0;
 }
 
 /* format 6: trimmed table mapping */
@@ -384,6 +423,8 @@ struct cmap12
 {
     ULONG  nGroups;
     struct charGroup *groups;
+    /* groups in order and apart, for a binary search (see lookup_cmap12) */
+    int    disjoint;
 };
 
 /* ULONG length */
@@ -407,6 +448,13 @@ read_cmap12 (sfnt *sfont, ULONG len)
         map->groups[i].startGlyphID  = sfnt_get_ulong(sfont);
     }
 
+    map->disjoint = 1;
+    for (i = 0; i < map->nGroups; i++) {
+        if (map->groups[i].startCharCode > map->groups[i].endCharCode ||
+            (i > 0 && map->groups[i-1].endCharCode >= map->groups[i].startCharCode))
+            map->disjoint = 0;
+    }
+
     return map;
 }
 
@@ -425,6 +473,24 @@ lookup_cmap12 (struct cmap12 *map, ULONG cccc)
     USHORT gid = 0;
     int i;
 
+    if (map->disjoint) {
+        /* only the first group ending at or after cccc can hold it */
+        ULONG lo = 0, hi = map->nGroups;
+
+        while (lo < hi) {
+            ULONG mid = lo + (hi - lo) / 2;
+            if (map->groups[mid].endCharCode < cccc)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        if (lo < map->nGroups && cccc >= map->groups[lo].startCharCode)
+            gid = (USHORT) ((cccc -
+                             map->groups[lo].startCharCode +
+                             map->groups[lo].startGlyphID) & 0xffff);
+        return gid;
+    }
+
     i = map->nGroups;
     while (i-- > 0 &&
            cccc <= map->groups[i].endCharCode) {
@@ -472,6 +538,8 @@ tt_cmap_read (sfnt *sfont, USHORT platform, USHORT encoding)
     cmap->map      = NULL;
     cmap->platform = platform;
     cmap->encoding = encoding;
+    cmap->pages     = NULL;
+    cmap->num_pages = 0;
 
     sfnt_seek_set(sfont, offset);
     cmap->format = sfnt_get_ushort(sfont);
@@ -517,9 +585,15 @@ tt_cmap_read (sfnt *sfont, USHORT platform, USHORT encoding)
 
     if (!cmap->map) {
         tt_cmap_release(cmap);
-        cmap = NULL;
+        return NULL;
     }
 
+    /* the searching formats, for all of BMP or of Unicode */
+    if (cmap->format == 4)
+        cmap->num_pages = 0x100;
+    else if (cmap->format == 12)
+        cmap->num_pages = 0x1100;
+
     return cmap;
 }
 
@@ -550,6 +624,12 @@ tt_cmap_release (tt_cmap *cmap)
                 break;
             }
         }
+        if (cmap->pages) {
+            ULONG i;
+            for (i = 0; i < cmap->num_pages; i++)
+                free(cmap->pages[i]);
+            free(cmap->pages);
+        }
         free(cmap);
     }
 
@@ -557,18 +637,11 @@ tt_cmap_release (tt_cmap *cmap)
 }
 
 
-USHORT
-tt_cmap_lookup (tt_cmap *cmap, ULONG cc)
+static USHORT
+lookup_subtable (tt_cmap *cmap, ULONG cc)
 {
     USHORT gid = 0;
 
-    assert(cmap);
-
-    if (cc > 0xffffL && cmap->format < 12) {
-        dpx_warning("Four bytes charcode not supported in OpenType/TrueType cmap format 0...6.");
-        return 0;
-    }
-
     switch (cmap->format) {
     case 0:
         gid = lookup_cmap0(cmap->map,  (USHORT) cc);
@@ -593,6 +666,42 @@ tt_cmap_lookup (tt_cmap *cmap, ULONG cc)
     return gid;
 }
 
+/*
+ * Formats 4 and 12 search their segments for every code, and a font is
+ * asked for the same codes over and over. Their glyphs are kept in pages
+ * of 256 codes, each filled by searching once for all of its codes the
+ * first time a lookup falls in it.
+ */
+USHORT
+tt_cmap_lookup (tt_cmap *cmap, ULONG cc)
+{
+    USHORT *page;
+    ULONG   i;
+
+    assert(cmap);
+
+    if (cc > 0xffffL && cmap->format < 12) {
+        dpx_warning("Four bytes charcode not supported in OpenType/TrueType cmap format 0...6.");
+        return 0;
+    }
+
+    if (cc >= cmap->num_pages << 8)
+        return lookup_subtable(cmap, cc);
+
+    if (!cmap->pages) {
+        cmap->pages = NEW(cmap->num_pages, USHORT *);
+        memset(cmap->pages, 0, cmap->num_pages * sizeof(USHORT *));
+    }
+    page = cmap->pages[cc >> 8];
+    if (!page) {
+        page = cmap->pages[cc >> 8] = NEW(256, USHORT);
+        for (i = 0; i < 256; i++)
+            page[i] = lookup_subtable(cmap, (cc & ~0xffUL) | i);
+    }
+
+    return page[cc & 0xff];
+}
+
 static unsigned char srange_min[2] = {0x00, 0x00};
 static unsigned char srange_max[2] = {0xff, 0xff};
 static unsigned char lrange_min[4] = {0x00, 0x00, 0x00, 0x00};
@@ -868,23 +977,53 @@ create_inverse_cmap12 (int32_t *map_base, int32_t *map_sub, USHORT num_glyphs,
   }
 }
 
-/* NOTE: Reverse mapping code which had been placed here is removed since:
- *  - Implementation of reserve CMap mapping itself is imcomplete.
- *  - It is wrong to assume that all CMap passed here is Unicode to CID mapping.
- * Especially, the second one causes problems.
+/*
+ * The glyph to Unicode maps of a font's cmap, kept for the rest of the
+ * document: each subset of the same font (one per size or feature set)
+ * needs them for its ToUnicode CMap, and building them walks every code
+ * of the cmap.
  */
-static pdf_obj *
-create_ToUnicode_cmap (tt_cmap *ttcmap,
-                       const char *cmap_name,
-                       CMap *cmap_add,
-                       const char *used_chars,
-                       sfnt *sfont)
+struct inverse_cmap {
+    char    *key;      /* font name and TTC index */
+    USHORT   num_glyphs;
+    int32_t *map_base;
+    int32_t *map_sub;  /* PUA and presentation forms */
+};
+
+static TTBC_THREAD_LOCAL struct {
+    struct inverse_cmap *maps;
+    int count;
+    int capacity;
+} inverse_cache = { NULL, 0, 0 };
+
+static char *
+inverse_cmap_key (const char *font_name, uint32_t ttc_index)
 {
-    pdf_obj  *stream = NULL;
-    int32_t *map_base = NULL, *map_sub = NULL;
-    USHORT gid, num_glyphs = 0;
+    size_t len = strlen(font_name) + 16;
+    char  *key = NEW(len, char);
+
+    snprintf(key, len, "%s:%u", font_name, ttc_index);
+    return key;
+}
 
-    assert(ttcmap);
+static struct inverse_cmap *
+find_inverse_cmap (const char *key)
+{
+    int i;
+
+    for (i = 0; i < inverse_cache.count; i++) {
+        if (streq_ptr(inverse_cache.maps[i].key, key))
+            return &inverse_cache.maps[i];
+    }
+    return NULL;
+}
+
+/* Takes over key. */
+static struct inverse_cmap *
+add_inverse_cmap (char *key, tt_cmap *ttcmap, sfnt *sfont)
+{
+    struct inverse_cmap *inv;
+    USHORT gid, num_glyphs = 0;
 
     /* Get num_glyphs from maxp talbe */
     {
@@ -897,24 +1036,73 @@ create_ToUnicode_cmap (tt_cmap *ttcmap,
         }
     }
 
+    if (inverse_cache.count == inverse_cache.capacity) {
+        inverse_cache.capacity += 16;
+        inverse_cache.maps = RENEW(inverse_cache.maps, inverse_cache.capacity,
+                                   struct inverse_cmap);
+    }
+    inv = &inverse_cache.maps[inverse_cache.count++];
+    inv->key        = key;
+    inv->num_glyphs = num_glyphs;
+
     /* Initialize GID to Unicode mapping table */
-    map_base = NEW(num_glyphs, int32_t);
-    map_sub  = NEW(num_glyphs, int32_t);
+    inv->map_base = NEW(num_glyphs, int32_t);
+    inv->map_sub  = NEW(num_glyphs, int32_t);
     for (gid = 0; gid < num_glyphs; gid++) {
-        map_base[gid] = -1;
-        map_sub [gid] = -1;
+        inv->map_base[gid] = -1;
+        inv->map_sub [gid] = -1;
     }
 
     /* Create "base" mapping from inverse mapping of OpenType cmap */
     switch (ttcmap->format) {
     case 4:
-        create_inverse_cmap4(map_base, map_sub, num_glyphs, ttcmap->map);
+        create_inverse_cmap4(inv->map_base, inv->map_sub, num_glyphs, ttcmap->map);
         break;
     case 12:
-        create_inverse_cmap12(map_base, map_sub, num_glyphs, ttcmap->map);
+        create_inverse_cmap12(inv->map_base, inv->map_sub, num_glyphs, ttcmap->map);
         break;
     }
 
+    return inv;
+}
+
+void
+otf_inverse_cmap_cache_close (void)
+{
+    int i;
+
+    for (i = 0; i < inverse_cache.count; i++) {
+        free(inverse_cache.maps[i].key);
+        free(inverse_cache.maps[i].map_base);
+        free(inverse_cache.maps[i].map_sub);
+    }
+    inverse_cache.maps = mfree(inverse_cache.maps);
+    inverse_cache.count    = 0;
+    inverse_cache.capacity = 0;
+}
+
+/* NOTE: Reverse mapping code which had been placed here is removed since:
+ *  - Implementation of reserve CMap mapping itself is imcomplete.
+ *  - It is wrong to assume that all CMap passed here is Unicode to CID mapping.
+ * Especially, the second one causes problems.
+ */
+static pdf_obj *
+create_ToUnicode_cmap (struct inverse_cmap *inv,
+                       const char *cmap_name,
+                       CMap *cmap_add,
+                       const char *used_chars,
+                       sfnt *sfont)
+{
+    pdf_obj  *stream = NULL;
+    int32_t *map_base, *map_sub;
+    USHORT gid, num_glyphs;
+
+    assert(inv);
+
+    num_glyphs = inv->num_glyphs;
+    map_base   = inv->map_base;
+    map_sub    = inv->map_sub;
+
     /* Now create ToUnicode CMap stream */
     {
         CMap     *cmap;
@@ -1033,8 +1221,6 @@ create_ToUnicode_cmap (tt_cmap *ttcmap,
         }
         CMap_release(cmap);
     }
-    free(map_base);
-    free(map_sub);
 
     return stream;
 }
@@ -1065,6 +1251,11 @@ otf_create_ToUnicode_stream (const char *font_name,
     sfnt       *sfont;
     ULONG       offset = 0;
     tt_cmap    *ttcmap;
+    struct inverse_cmap *inv;
+    char       *inv_key;
+    fontcache_key key;
+    const unsigned char *cached;
+    int         cached_len;
     int         cmap_id, cmap_add_id;
     size_t      i;
 
@@ -1150,32 +1341,66 @@ otf_create_ToUnicode_stream (const char *font_name,
         }
     }
 
-    ttcmap = NULL;
-    for (i = 0; i < sizeof(cmap_plat_encs) / sizeof(cmap_plat_enc_rec); ++i) {
-        ttcmap = tt_cmap_read(sfont, cmap_plat_encs[i].platform, cmap_plat_encs[i].encoding);
-        if (!ttcmap)
-            continue;
+    /*
+     * The same subset in an earlier run of this process made the same
+     * CMap; its text is kept with the font programs (see dpx-fontcache.c).
+     * A ToUnicode CMap stream has nothing in its dict to restore.
+     */
+    fontcache_make_key(&key, handle, cmap_add ? "ToUnicode/add" : "ToUnicode",
+                       (int) ttc_index, cmap_name, used_chars, 65535);
+    if ((cached = fontcache_lookup(&key, &cached_len)) != NULL) {
+        pdf_obj *cmap_obj = pdf_new_stream(STREAM_COMPRESS);
+
+        pdf_add_stream(cmap_obj, cached, cached_len);
+        cmap_id = pdf_defineresource("CMap", cmap_name,
+                                     cmap_obj, PDF_RES_FLUSH_IMMEDIATE);
+        cmap_ref = pdf_get_resource_reference(cmap_id);
 
-        if (ttcmap->format == 4 || ttcmap->format == 12) {
-             break;
-        } else {
+        free(cmap_name);
+        sfnt_close(sfont);
+        ttstub_input_close(handle);
+        return cmap_ref;
+    }
+
+    inv_key = inverse_cmap_key(font_name, ttc_index);
+    inv = find_inverse_cmap(inv_key);
+    if (inv) {
+        free(inv_key);
+    } else {
+        ttcmap = NULL;
+        for (i = 0; i < sizeof(cmap_plat_encs) / sizeof(cmap_plat_enc_rec); ++i) {
+            ttcmap = tt_cmap_read(sfont, cmap_plat_encs[i].platform, cmap_plat_encs[i].encoding);
+            if (!ttcmap)
+                continue;
+
+            if (ttcmap->format == 4 || ttcmap->format == 12) {
+                 break;
+            } else {
+                tt_cmap_release(ttcmap);
+                ttcmap = NULL;
+            }
+        }
+        if (ttcmap) {
+            inv = add_inverse_cmap(inv_key, ttcmap, sfont);
             tt_cmap_release(ttcmap);
-            ttcmap = NULL;
+        } else {
+            free(inv_key);
         }
     }
 
-    if (ttcmap) {
+    if (inv) {
         pdf_obj *cmap_obj;
 
         CMap_set_silent(1); /* many warnings without this... */
-        cmap_obj = create_ToUnicode_cmap(ttcmap, cmap_name, cmap_add, used_chars, sfont);
+        cmap_obj = create_ToUnicode_cmap(inv, cmap_name, cmap_add, used_chars, sfont);
         CMap_set_silent(0);
         if (cmap_obj) {
+            fontcache_store(&key, pdf_stream_dataptr(cmap_obj),
+                            pdf_stream_length(cmap_obj));
             cmap_id = pdf_defineresource("CMap", cmap_name,
                                       cmap_obj, PDF_RES_FLUSH_IMMEDIATE);
             cmap_ref = pdf_get_resource_reference(cmap_id);
         }
-        tt_cmap_release(ttcmap);
     }
 
     /* Cleanup */
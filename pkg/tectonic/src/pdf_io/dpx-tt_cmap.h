@@ -33,6 +33,9 @@ typedef struct
   USHORT encoding;
   ULONG  language; /* or version, only for Mac */
   void  *map;
+  /* glyphs of codes looked up, by 256 (see tt_cmap_lookup) */
+  USHORT **pages;
+  ULONG    num_pages;
 } tt_cmap;
 
 /* Paltform ID */
@@ -75,4 +78,6 @@ int      otf_load_Unicode_CMap       (const char *map_name,
                                              uint32_t ttc_index,
                                              const char *otl_opts, int wmode);
 int otf_try_load_GID_to_CID_map (const char *map_name, uint32_t ttc_index, int wmode);
+/* Forget the glyph to Unicode maps kept for ToUnicode CMaps */
+void otf_inverse_cmap_cache_close (void);
 #endif /* _TT_CMAP_H_ */
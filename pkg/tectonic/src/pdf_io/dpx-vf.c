@@ -64,9 +64,9 @@ struct vf
     unsigned int num_chars;
 };
 
-static struct vf *vf_fonts = NULL;
-static unsigned int num_vf_fonts = 0;
-static unsigned int max_vf_fonts = 0;
+static TTBC_THREAD_LOCAL struct vf *vf_fonts = NULL;
+static TTBC_THREAD_LOCAL unsigned int num_vf_fonts = 0;
+static TTBC_THREAD_LOCAL unsigned int max_vf_fonts = 0;
 
 
 void
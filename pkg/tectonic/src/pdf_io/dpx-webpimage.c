@@ -0,0 +1,2647 @@
+/* This is dvipdfmx, an eXtended version of dvipdfm by Mark A. Wicks.
+
+   Copyright (C) 2002-2018 by Jin-Hwan Cho and Shunsaku Hirata,
+   the dvipdfmx project team.
+
+   Copyright (C) 1998, 1999 by Mark A. Wicks <mwicks@kettering.edu>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+*/
+
+/*
+ * WebP SUPPORT: Still images, lossless (VP8L) and lossy (VP8, with the
+ * alpha plane of an ALPH chunk), simple or extended (VP8X) files.
+ *   Unsupported features: Animation, ICC profiles.
+ *
+ * There is no libwebp to link, so both bitstreams are decoded here after
+ * RFC 9649 and RFC 6386, giving the same pixels as libwebp does. They go out
+ * as a Flate stream like those of PNG, with an SMask for alpha that is not
+ * opaque throughout. The file is decoded once: the image cache replays the
+ * XObject for later inclusions of it.
+ */
+
+#include "tectonic_bridge_core.h"
+#include "dpx-webpimage.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dpx-error.h"
+#include "dpx-mem.h"
+#include "dpx-pdfobj.h"
+
+#define WEBP_DEBUG_STR "WebP"
+
+/* Neither dimension of a WebP image goes past 16384. */
+#define WEBP_MAX_DIMENSION 16384
+
+struct webp_info {
+    unsigned int   width;
+    unsigned int   height;
+    int            lossless;
+    const uint8_t *bits;      /* payload of the VP8 or VP8L chunk */
+    size_t         bits_len;
+    const uint8_t *alpha;     /* payload of the ALPH chunk, lossy only */
+    size_t         alpha_len;
+};
+
+static uint32_t
+get_le24 (const uint8_t *p)
+{
+    return p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16);
+}
+
+static uint32_t
+get_le32 (const uint8_t *p)
+{
+    return get_le24(p) | ((uint32_t) p[3] << 24);
+}
+
+/* Size of the frame a chunk starts, read from its first bytes: 10 of them
+ * for VP8 and VP8X, 5 for VP8L. */
+static int
+frame_size (const uint8_t *chunk, size_t len, unsigned int *width, unsigned int *height)
+{
+    const uint8_t *p = chunk + 8;
+
+    if (len < 8)
+        return -1;
+    len -= 8;
+    if (!memcmp(chunk, "VP8X", 4)) {
+        if (len < 10)
+            return -1;
+        *width  = get_le24(p + 4) + 1;
+        *height = get_le24(p + 7) + 1;
+    } else if (!memcmp(chunk, "VP8 ", 4)) {
+        if (len < 10 || (p[0] & 1) || p[3] != 0x9d || p[4] != 0x01 || p[5] != 0x2a)
+            return -1;
+        *width  = (p[6] | (p[7] << 8)) & 0x3fff;
+        *height = (p[8] | (p[9] << 8)) & 0x3fff;
+    } else if (!memcmp(chunk, "VP8L", 4)) {
+        uint32_t bits;
+
+        if (len < 5 || p[0] != 0x2f)
+            return -1;
+        bits = get_le32(p + 1);
+        if ((bits >> 29) != 0)
+            return -1;
+        *width  = (bits & 0x3fff) + 1;
+        *height = ((bits >> 14) & 0x3fff) + 1;
+    } else {
+        return -1;
+    }
+    if (*width == 0 || *height == 0 ||
+        *width > WEBP_MAX_DIMENSION || *height > WEBP_MAX_DIMENSION)
+        return -1;
+    return 0;
+}
+
+int
+check_for_webp (rust_input_handle_t handle)
+{
+    unsigned char sigbytes[16];
+
+    if (handle == INVALID_HANDLE)
+        return 0;
+
+    ttstub_input_seek(handle, 0, SEEK_SET);
+    if (ttbc_input_read(handle, (char *) sigbytes, sizeof(sigbytes)) != sizeof(sigbytes) ||
+        memcmp(sigbytes, "RIFF", 4) || memcmp(sigbytes + 8, "WEBPVP8", 7))
+        return 0;
+    return 1;
+}
+
+/* An ISO BMFF file whose ftyp brand is avif or avis. */
+int
+check_for_avif (rust_input_handle_t handle)
+{
+    unsigned char sigbytes[12];
+
+    if (handle == INVALID_HANDLE)
+        return 0;
+
+    ttstub_input_seek(handle, 0, SEEK_SET);
+    if (ttbc_input_read(handle, (char *) sigbytes, sizeof(sigbytes)) != sizeof(sigbytes) ||
+        memcmp(sigbytes + 4, "ftyp", 4) ||
+        (memcmp(sigbytes + 8, "avif", 4) && memcmp(sigbytes + 8, "avis", 4)))
+        return 0;
+    return 1;
+}
+
+int
+webp_get_bbox (rust_input_handle_t handle, unsigned int *width, unsigned int *height,
+               double *xdensity, double *ydensity)
+{
+    uint8_t hdr[30];
+
+    ttstub_input_seek(handle, 0, SEEK_SET);
+    if (ttbc_input_read(handle, (char *) hdr, sizeof(hdr)) != sizeof(hdr) ||
+        frame_size(hdr + 12, sizeof(hdr) - 12, width, height) < 0) {
+        dpx_warning("%s: Invalid file header.", WEBP_DEBUG_STR);
+        return -1;
+    }
+    /* WebP has no resolution of its own; EXIF might, but is not read. */
+    *xdensity = *ydensity = 1.0;
+
+    return 0;
+}
+
+static int
+parse_chunks (const uint8_t *data, size_t len, struct webp_info *info)
+{
+    size_t pos = 12;
+    int    extended = 0;
+
+    memset(info, 0, sizeof(*info));
+    if (len < 20 || memcmp(data, "RIFF", 4) || memcmp(data + 8, "WEBP", 4))
+        return -1;
+    if ((size_t) get_le32(data + 4) + 8 < len)
+        len = (size_t) get_le32(data + 4) + 8;
+
+    if (frame_size(data + pos, len - pos, &info->width, &info->height) < 0)
+        return -1;
+    while (pos + 8 <= len) {
+        const uint8_t *chunk = data + pos;
+        size_t size = get_le32(chunk + 4);
+
+        if (size > len - pos - 8)
+            return -1;
+        if (!memcmp(chunk, "VP8X", 4)) {
+            if (pos != 12)
+                return -1;
+            extended = 1;
+            if (chunk[8] & 0x02) {
+                dpx_warning("%s: Animated images are not supported.", WEBP_DEBUG_STR);
+                return -1;
+            }
+        } else if (!memcmp(chunk, "ALPH", 4)) {
+            if (extended && !info->alpha) {
+                info->alpha = chunk + 8;
+                info->alpha_len = size;
+            }
+        } else if (!memcmp(chunk, "VP8 ", 4) || !memcmp(chunk, "VP8L", 4)) {
+            unsigned int width, height;
+
+            if (frame_size(chunk, size + 8, &width, &height) < 0 ||
+                width != info->width || height != info->height)
+                return -1;
+            info->lossless = chunk[3] == 'L';
+            info->bits = chunk + 8;
+            info->bits_len = size;
+            if (info->lossless)
+                info->alpha = NULL;
+            return 0;
+        } else if (!memcmp(chunk, "ANIM", 4) || !memcmp(chunk, "ANMF", 4)) {
+            dpx_warning("%s: Animated images are not supported.", WEBP_DEBUG_STR);
+            return -1;
+        }
+        pos += 8 + size + (size & 1);
+    }
+
+    return -1;
+}
+
+/* ------------------------------------------------------------------------
+ * VP8L: lossless
+ * ------------------------------------------------------------------------ */
+
+/* Bits are read least significant first, with zeros past the end of the
+ * data; eos is set once any of those is consumed. */
+struct vp8l_bits {
+    const uint8_t *buf;
+    size_t         len, pos;
+    uint64_t       val;
+    int            nbits;
+    int            pad;
+    int            eos;
+};
+
+static void
+vp8l_init (struct vp8l_bits *br, const uint8_t *buf, size_t len)
+{
+    memset(br, 0, sizeof(*br));
+    br->buf = buf;
+    br->len = len;
+}
+
+static void
+vp8l_fill (struct vp8l_bits *br)
+{
+    while (br->nbits <= 56) {
+        uint64_t byte = 0;
+
+        if (br->pos < br->len)
+            byte = br->buf[br->pos++];
+        else
+            br->pad++;
+        br->val |= byte << br->nbits;
+        br->nbits += 8;
+    }
+}
+
+static void
+vp8l_skip (struct vp8l_bits *br, int n)
+{
+    br->val >>= n;
+    br->nbits -= n;
+    if (br->nbits < 8 * br->pad)
+        br->eos = 1;
+}
+
+static uint32_t
+vp8l_read (struct vp8l_bits *br, int n)
+{
+    uint32_t v;
+
+    if (n == 0)
+        return 0;
+    if (br->nbits < n)
+        vp8l_fill(br);
+    v = (uint32_t) (br->val & ((1ULL << n) - 1));
+    vp8l_skip(br, n);
+    return v;
+}
+
+#define HUFFMAN_LUT_BITS 8
+#define HUFFMAN_MAX_LEN  15
+
+/* A canonical prefix code: codes of up to HUFFMAN_LUT_BITS bits are looked
+ * up at once (entries hold length << 12 | symbol), longer ones are walked a
+ * bit at a time. A code of one symbol takes no bits at all. */
+struct huffman {
+    int       single;
+    uint16_t  count[HUFFMAN_MAX_LEN + 1];
+    uint16_t *symbols;
+    uint16_t  lut[1 << HUFFMAN_LUT_BITS];
+};
+
+static void
+huffman_free (struct huffman *h)
+{
+    h->symbols = mfree(h->symbols);
+}
+
+static int
+huffman_build (struct huffman *h, const uint8_t *lengths, int nsyms)
+{
+    uint16_t offs[HUFFMAN_MAX_LEN + 2];
+    int      len, sym, n = 0, left = 1, code = 0, idx = 0;
+
+    memset(h->count, 0, sizeof(h->count));
+    memset(h->lut, 0, sizeof(h->lut));
+    h->single  = -1;
+    h->symbols = NULL;
+    for (sym = 0; sym < nsyms; sym++) {
+        if (lengths[sym]) {
+            h->count[lengths[sym]]++;
+            n++;
+            h->single = sym;
+        }
+    }
+    if (n == 0)
+        return -1;
+    if (n == 1)
+        return 0;
+    h->single = -1;
+
+    /* Only complete codes are valid. */
+    for (len = 1; len <= HUFFMAN_MAX_LEN; len++) {
+        left = (left << 1) - h->count[len];
+        if (left < 0)
+            return -1;
+    }
+    if (left > 0)
+        return -1;
+
+    offs[1] = 0;
+    for (len = 1; len <= HUFFMAN_MAX_LEN; len++)
+        offs[len + 1] = offs[len] + h->count[len];
+    h->symbols = NEW(n, uint16_t);
+    for (sym = 0; sym < nsyms; sym++) {
+        if (lengths[sym])
+            h->symbols[offs[lengths[sym]]++] = sym;
+    }
+
+    for (len = 1; len <= HUFFMAN_LUT_BITS; len++) {
+        int i;
+
+        for (i = 0; i < h->count[len]; i++, code++, idx++) {
+            int rev = 0, b, j;
+
+            for (b = 0; b < len; b++)
+                rev |= ((code >> b) & 1) << (len - 1 - b);
+            for (j = rev; j < (1 << HUFFMAN_LUT_BITS); j += 1 << len)
+                h->lut[j] = (len << 12) | h->symbols[idx];
+        }
+        code <<= 1;
+    }
+
+    return 0;
+}
+
+static int
+huffman_read (struct huffman *h, struct vp8l_bits *br)
+{
+    int len, code = 0, first = 0, index = 0;
+    uint16_t e;
+
+    if (h->single >= 0)
+        return h->single;
+    if (br->nbits < HUFFMAN_MAX_LEN)
+        vp8l_fill(br);
+    e = h->lut[br->val & ((1 << HUFFMAN_LUT_BITS) - 1)];
+    if (e) {
+        vp8l_skip(br, e >> 12);
+        return e & 0xfff;
+    }
+    for (len = 1; len <= HUFFMAN_MAX_LEN; len++) {
+        int count = h->count[len];
+
+        code |= (br->val >> (len - 1)) & 1;
+        if (code - count < first) {
+            vp8l_skip(br, len);
+            return h->symbols[index + (code - first)];
+        }
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+
+    return -1;
+}
+
+static int
+read_code_lengths (struct vp8l_bits *br, uint8_t *lengths, int nsyms)
+{
+    static const uint8_t order[19] = {
+        17, 18, 0, 1, 2, 3, 4, 5, 16, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15
+    };
+    uint8_t        cl_lengths[19];
+    struct huffman cl;
+    int            i, n, max_symbol, prev = 8, sym = 0;
+
+    memset(cl_lengths, 0, sizeof(cl_lengths));
+    n = vp8l_read(br, 4) + 4;
+    for (i = 0; i < n; i++)
+        cl_lengths[order[i]] = vp8l_read(br, 3);
+    if (huffman_build(&cl, cl_lengths, 19) < 0)
+        return -1;
+
+    if (vp8l_read(br, 1)) {
+        max_symbol = 2 + vp8l_read(br, 2 + 2 * vp8l_read(br, 3));
+        if (max_symbol > nsyms) {
+            huffman_free(&cl);
+            return -1;
+        }
+    } else {
+        max_symbol = nsyms;
+    }
+
+    memset(lengths, 0, nsyms);
+    while (sym < nsyms && max_symbol-- > 0) {
+        int code = huffman_read(&cl, br);
+
+        if (code < 0 || br->eos) {
+            huffman_free(&cl);
+            return -1;
+        }
+        if (code < 16) {
+            lengths[sym++] = code;
+            if (code)
+                prev = code;
+        } else {
+            int repeat, value = 0;
+
+            if (code == 16) {
+                repeat = 3 + vp8l_read(br, 2);
+                value = prev;
+            } else if (code == 17) {
+                repeat = 3 + vp8l_read(br, 3);
+            } else {
+                repeat = 11 + vp8l_read(br, 7);
+            }
+            if (sym + repeat > nsyms) {
+                huffman_free(&cl);
+                return -1;
+            }
+            while (repeat-- > 0)
+                lengths[sym++] = value;
+        }
+    }
+    huffman_free(&cl);
+
+    return 0;
+}
+
+static int
+read_huffman (struct vp8l_bits *br, struct huffman *h, int nsyms)
+{
+    uint8_t *lengths = NEW(nsyms, uint8_t);
+    int      r = 0;
+
+    memset(lengths, 0, nsyms);
+    if (vp8l_read(br, 1)) {
+        /* simple code: one or two symbols */
+        int count = vp8l_read(br, 1) + 1;
+        int s0 = vp8l_read(br, vp8l_read(br, 1) ? 8 : 1);
+
+        if (s0 < nsyms)
+            lengths[s0] = 1;
+        else
+            r = -1;
+        if (count == 2) {
+            int s1 = vp8l_read(br, 8);
+
+            if (s1 < nsyms)
+                lengths[s1] = 1;
+            else
+                r = -1;
+        }
+    } else {
+        r = read_code_lengths(br, lengths, nsyms);
+    }
+    if (r == 0 && !br->eos)
+        r = huffman_build(h, lengths, nsyms);
+    else
+        r = -1;
+    free(lengths);
+
+    return r;
+}
+
+#define GREEN  0
+#define RED    1
+#define BLUE   2
+#define ALPHA  3
+#define DIST   4
+
+struct huffman_group {
+    struct huffman codes[5];
+};
+
+static void
+free_groups (struct huffman_group *groups, int count)
+{
+    int i, j;
+
+    for (i = 0; i < count; i++) {
+        for (j = 0; j < 5; j++)
+            huffman_free(&groups[i].codes[j]);
+    }
+    free(groups);
+}
+
+static int
+prefix_value (struct vp8l_bits *br, int code)
+{
+    int extra;
+
+    if (code < 4)
+        return code + 1;
+    extra = (code - 2) >> 1;
+    return ((2 + (code & 1)) << extra) + vp8l_read(br, extra) + 1;
+}
+
+/* Distance codes up to 120 are the nearest neighbours, as (dx, dy). */
+static int
+plane_distance (int xsize, int code)
+{
+    static const int8_t plane[120][2] = {
+        { 0, 1}, { 1, 0}, { 1, 1}, {-1, 1}, { 0, 2}, { 2, 0}, { 1, 2}, {-1, 2},
+        { 2, 1}, {-2, 1}, { 2, 2}, {-2, 2}, { 0, 3}, { 3, 0}, { 1, 3}, {-1, 3},
+        { 3, 1}, {-3, 1}, { 2, 3}, {-2, 3}, { 3, 2}, {-3, 2}, { 0, 4}, { 4, 0},
+        { 1, 4}, {-1, 4}, { 4, 1}, {-4, 1}, { 3, 3}, {-3, 3}, { 2, 4}, {-2, 4},
+        { 4, 2}, {-4, 2}, { 0, 5}, { 3, 4}, {-3, 4}, { 4, 3}, {-4, 3}, { 5, 0},
+        { 1, 5}, {-1, 5}, { 5, 1}, {-5, 1}, { 2, 5}, {-2, 5}, { 5, 2}, {-5, 2},
+        { 4, 4}, {-4, 4}, { 3, 5}, {-3, 5}, { 5, 3}, {-5, 3}, { 0, 6}, { 6, 0},
+        { 1, 6}, {-1, 6}, { 6, 1}, {-6, 1}, { 2, 6}, {-2, 6}, { 6, 2}, {-6, 2},
+        { 4, 5}, {-4, 5}, { 5, 4}, {-5, 4}, { 3, 6}, {-3, 6}, { 6, 3}, {-6, 3},
+        { 0, 7}, { 7, 0}, { 1, 7}, {-1, 7}, { 5, 5}, {-5, 5}, { 7, 1}, {-7, 1},
+        { 4, 6}, {-4, 6}, { 6, 4}, {-6, 4}, { 2, 7}, {-2, 7}, { 7, 2}, {-7, 2},
+        { 3, 7}, {-3, 7}, { 7, 3}, {-7, 3}, { 5, 6}, {-5, 6}, { 6, 5}, {-6, 5},
+        { 8, 0}, { 4, 7}, {-4, 7}, { 7, 4}, {-7, 4}, { 8, 1}, { 8, 2}, { 6, 6},
+        {-6, 6}, { 8, 3}, { 5, 7}, {-5, 7}, { 7, 5}, {-7, 5}, { 8, 4}, { 6, 7},
+        {-6, 7}, { 7, 6}, {-7, 6}, { 8, 5}, { 7, 7}, {-7, 7}, { 8, 6}, { 8, 7}
+    };
+    int dist;
+
+    if (code > 120)
+        return code - 120;
+    dist = plane[code - 1][0] + plane[code - 1][1] * xsize;
+    return dist >= 1 ? dist : 1;
+}
+
+#define DIV_ROUND_UP(n, bits) (((n) + (1 << (bits)) - 1) >> (bits))
+
+/* Entropy-coded image of xsize by ysize pixels. Only the main image has
+ * meta prefix codes, varying over its tiles. */
+static uint32_t *
+decode_entropy_image (struct vp8l_bits *br, int xsize, int ysize, int is_main)
+{
+    struct huffman_group *groups;
+    uint32_t *pixels, *cache = NULL, *meta = NULL;
+    int       cache_bits = 0, meta_bits = 0, meta_xsize = 0;
+    int       num_groups = 1, i, j;
+    size_t    total = (size_t) xsize * ysize, pos = 0;
+
+    if (vp8l_read(br, 1)) {
+        cache_bits = vp8l_read(br, 4);
+        if (cache_bits < 1 || cache_bits > 11)
+            return NULL;
+    }
+    if (is_main && vp8l_read(br, 1)) {
+        meta_bits  = vp8l_read(br, 3) + 2;
+        meta_xsize = DIV_ROUND_UP(xsize, meta_bits);
+        meta = decode_entropy_image(br, meta_xsize, DIV_ROUND_UP(ysize, meta_bits), 0);
+        if (!meta)
+            return NULL;
+        for (i = 0; i < meta_xsize * DIV_ROUND_UP(ysize, meta_bits); i++) {
+            meta[i] = (meta[i] >> 8) & 0xffff;
+            if ((int) meta[i] >= num_groups)
+                num_groups = meta[i] + 1;
+        }
+    }
+
+    groups = NEW(num_groups, struct huffman_group);
+    memset(groups, 0, num_groups * sizeof(struct huffman_group));
+    for (i = 0; i < num_groups; i++) {
+        static const int sizes[5] = { 256 + 24, 256, 256, 256, 40 };
+
+        for (j = 0; j < 5; j++) {
+            int nsyms = sizes[j] + (j == GREEN && cache_bits ? 1 << cache_bits : 0);
+
+            if (read_huffman(br, &groups[i].codes[j], nsyms) < 0) {
+                free_groups(groups, num_groups);
+                free(meta);
+                return NULL;
+            }
+        }
+    }
+
+    if (cache_bits) {
+        cache = NEW(1 << cache_bits, uint32_t);
+        memset(cache, 0, (1 << cache_bits) * sizeof(uint32_t));
+    }
+    pixels = NEW(total, uint32_t);
+    while (pos < total) {
+        struct huffman_group *g = groups;
+        int code;
+
+        if (meta) {
+            int x = pos % xsize, y = pos / xsize;
+
+            g = &groups[meta[(y >> meta_bits) * meta_xsize + (x >> meta_bits)]];
+        }
+        code = huffman_read(&g->codes[GREEN], br);
+        if (code < 0) {
+            break;
+        } else if (code < 256) {
+            uint32_t red = huffman_read(&g->codes[RED], br);
+            uint32_t blue = huffman_read(&g->codes[BLUE], br);
+            uint32_t alpha = huffman_read(&g->codes[ALPHA], br);
+
+            pixels[pos++] = (alpha << 24) | (red << 16) | (code << 8) | blue;
+            if (cache)
+                cache[(0x1e35a7bdu * pixels[pos - 1]) >> (32 - cache_bits)] = pixels[pos - 1];
+        } else if (code < 256 + 24) {
+            int    length = prefix_value(br, code - 256);
+            int    dcode = huffman_read(&g->codes[DIST], br);
+            size_t dist;
+
+            if (dcode < 0)
+                break;
+            dist = plane_distance(xsize, prefix_value(br, dcode));
+            if (dist > pos || (size_t) length > total - pos)
+                break;
+            for (i = 0; i < length; i++, pos++) {
+                pixels[pos] = pixels[pos - dist];
+                if (cache)
+                    cache[(0x1e35a7bdu * pixels[pos]) >> (32 - cache_bits)] = pixels[pos];
+            }
+        } else {
+            pixels[pos++] = cache[code - 256 - 24];
+        }
+        if (br->eos)
+            break;
+    }
+
+    free_groups(groups, num_groups);
+    free(cache);
+    free(meta);
+    if (pos < total) {
+        free(pixels);
+        return NULL;
+    }
+
+    return pixels;
+}
+
+#define PREDICTOR_TRANSFORM      0
+#define CROSS_COLOR_TRANSFORM    1
+#define SUBTRACT_GREEN_TRANSFORM 2
+#define COLOR_INDEXING_TRANSFORM 3
+
+struct vp8l_transform {
+    int       type;
+    int       bits;
+    int       xsize;  /* of the image the transform is undone on */
+    uint32_t *data;
+};
+
+static uint32_t
+add_pixels (uint32_t a, uint32_t b)
+{
+    return (((a & 0xff00ff00u) + (b & 0xff00ff00u)) & 0xff00ff00u) |
+           (((a & 0x00ff00ffu) + (b & 0x00ff00ffu)) & 0x00ff00ffu);
+}
+
+static uint32_t
+average2 (uint32_t a, uint32_t b)
+{
+    return (((a ^ b) & 0xfefefefeu) >> 1) + (a & b);
+}
+
+static int
+clip255 (int v)
+{
+    return v < 0 ? 0 : v > 255 ? 255 : v;
+}
+
+static uint32_t
+select_pixel (uint32_t left, uint32_t top, uint32_t top_left)
+{
+    int shift, p_left = 0, p_top = 0;
+
+    for (shift = 0; shift < 32; shift += 8) {
+        int l = (left >> shift) & 0xff, t = (top >> shift) & 0xff;
+        int tl = (top_left >> shift) & 0xff;
+
+        p_left += abs(t - tl);
+        p_top  += abs(l - tl);
+    }
+    return p_left < p_top ? left : top;
+}
+
+static uint32_t
+clamp_add_subtract_full (uint32_t a, uint32_t b, uint32_t c)
+{
+    uint32_t r = 0;
+    int shift;
+
+    for (shift = 0; shift < 32; shift += 8) {
+        int v = ((a >> shift) & 0xff) + ((b >> shift) & 0xff) - ((c >> shift) & 0xff);
+
+        r |= (uint32_t) clip255(v) << shift;
+    }
+    return r;
+}
+
+static uint32_t
+clamp_add_subtract_half (uint32_t a, uint32_t b)
+{
+    uint32_t r = 0;
+    int shift;
+
+    for (shift = 0; shift < 32; shift += 8) {
+        int ca = (a >> shift) & 0xff, cb = (b >> shift) & 0xff;
+
+        r |= (uint32_t) clip255(ca + (ca - cb) / 2) << shift;
+    }
+    return r;
+}
+
+static uint32_t
+predict (int mode, uint32_t left, uint32_t top, uint32_t top_left, uint32_t top_right)
+{
+    switch (mode) {
+    case 1:  return left;
+    case 2:  return top;
+    case 3:  return top_right;
+    case 4:  return top_left;
+    case 5:  return average2(average2(left, top_right), top);
+    case 6:  return average2(left, top_left);
+    case 7:  return average2(left, top);
+    case 8:  return average2(top_left, top);
+    case 9:  return average2(top, top_right);
+    case 10: return average2(average2(left, top_left), average2(top, top_right));
+    case 11: return select_pixel(left, top, top_left);
+    case 12: return clamp_add_subtract_full(left, top, top_left);
+    case 13: return clamp_add_subtract_half(average2(left, top), top_left);
+    default: return 0xff000000u;
+    }
+}
+
+static uint32_t *
+inverse_transform (struct vp8l_transform *t, uint32_t *pixels, int ysize)
+{
+    int xsize = t->xsize, x, y;
+    int tiles = DIV_ROUND_UP(xsize, t->bits);
+
+    switch (t->type) {
+    case PREDICTOR_TRANSFORM:
+        for (y = 0; y < ysize; y++) {
+            uint32_t *row = pixels + (size_t) y * xsize;
+
+            for (x = 0; x < xsize; x++) {
+                uint32_t pred;
+
+                if (y == 0)
+                    pred = x == 0 ? 0xff000000u : row[x - 1];
+                else if (x == 0)
+                    pred = row[x - xsize];
+                else {
+                    int mode = (t->data[(y >> t->bits) * tiles + (x >> t->bits)] >> 8) & 0xf;
+
+                    pred = predict(mode, row[x - 1], row[x - xsize],
+                                   row[x - xsize - 1], row[x - xsize + 1]);
+                }
+                row[x] = add_pixels(row[x], pred);
+            }
+        }
+        break;
+    case CROSS_COLOR_TRANSFORM:
+        for (y = 0; y < ysize; y++) {
+            uint32_t *row = pixels + (size_t) y * xsize;
+
+            for (x = 0; x < xsize; x++) {
+                uint32_t m = t->data[(y >> t->bits) * tiles + (x >> t->bits)];
+                int green_to_red  = (int8_t) (m & 0xff);
+                int green_to_blue = (int8_t) ((m >> 8) & 0xff);
+                int red_to_blue   = (int8_t) ((m >> 16) & 0xff);
+                int green = (int8_t) ((row[x] >> 8) & 0xff);
+                int red  = (row[x] >> 16) & 0xff;
+                int blue = row[x] & 0xff;
+
+                red = (red + ((green_to_red * green) >> 5)) & 0xff;
+                blue += (green_to_blue * green) >> 5;
+                blue = (blue + ((red_to_blue * (int8_t) red) >> 5)) & 0xff;
+                row[x] = (row[x] & 0xff00ff00u) | ((uint32_t) red << 16) | blue;
+            }
+        }
+        break;
+    case SUBTRACT_GREEN_TRANSFORM:
+        for (x = 0; x < xsize * ysize; x++) {
+            uint32_t green = (pixels[x] >> 8) & 0xff;
+
+            pixels[x] = add_pixels(pixels[x], (green << 16) | green);
+        }
+        break;
+    case COLOR_INDEXING_TRANSFORM:
+        {
+            /* Indices of 1, 2 or 4 bits are packed into the green of one
+             * pixel, the leftmost in the low bits. */
+            int       width = t->xsize, packed = DIV_ROUND_UP(width, t->bits);
+            int       bits_per_index = 8 >> t->bits;
+            uint32_t *out = NEW((size_t) width * ysize, uint32_t);
+
+            for (y = 0; y < ysize; y++) {
+                for (x = 0; x < width; x++) {
+                    uint32_t g = (pixels[(size_t) y * packed + (x >> t->bits)] >> 8) & 0xff;
+                    int shift = (x & ((1 << t->bits) - 1)) * bits_per_index;
+
+                    out[(size_t) y * width + x] = t->data[(g >> shift) & ((1 << bits_per_index) - 1)];
+                }
+            }
+            free(pixels);
+            pixels = out;
+        }
+        break;
+    }
+
+    return pixels;
+}
+
+/* The image of a VP8L stream without its header: the main image of a VP8L
+ * chunk, or the alpha plane of an ALPH chunk in its green. */
+static uint32_t *
+vp8l_decode (const uint8_t *data, size_t len, int xsize, int ysize)
+{
+    struct vp8l_bits      br;
+    struct vp8l_transform t[4];
+    uint32_t *pixels = NULL;
+    int       n = 0, seen = 0, width = xsize, i;
+
+    vp8l_init(&br, data, len);
+    while (vp8l_read(&br, 1)) {
+        struct vp8l_transform *tr = &t[n];
+        int type = vp8l_read(&br, 2);
+
+        if (seen & (1 << type))
+            goto done;
+        seen |= 1 << type;
+        tr->type  = type;
+        tr->xsize = width;
+        tr->bits  = 0;
+        tr->data  = NULL;
+        n++;
+        if (type == PREDICTOR_TRANSFORM || type == CROSS_COLOR_TRANSFORM) {
+            tr->bits = vp8l_read(&br, 3) + 2;
+            tr->data = decode_entropy_image(&br, DIV_ROUND_UP(width, tr->bits),
+                                            DIV_ROUND_UP(ysize, tr->bits), 0);
+            if (!tr->data)
+                goto done;
+        } else if (type == COLOR_INDEXING_TRANSFORM) {
+            int       colors = vp8l_read(&br, 8) + 1;
+            uint32_t *palette = decode_entropy_image(&br, colors, 1, 0);
+
+            if (!palette)
+                goto done;
+            /* out-of-range indices are transparent black */
+            tr->data = NEW(256, uint32_t);
+            memset(tr->data, 0, 256 * sizeof(uint32_t));
+            tr->data[0] = palette[0];
+            for (i = 1; i < colors; i++)
+                tr->data[i] = add_pixels(palette[i], tr->data[i - 1]);
+            free(palette);
+            tr->bits = colors > 16 ? 0 : colors > 4 ? 1 : colors > 2 ? 2 : 3;
+            width = DIV_ROUND_UP(width, tr->bits);
+        }
+        if (br.eos)
+            goto done;
+    }
+
+    pixels = decode_entropy_image(&br, width, ysize, 1);
+    if (pixels && br.eos)
+        pixels = mfree(pixels);
+    for (i = n - 1; pixels && i >= 0; i--)
+        pixels = inverse_transform(&t[i], pixels, ysize);
+
+  done:
+    for (i = 0; i < n; i++)
+        free(t[i].data);
+    return pixels;
+}
+
+/* ------------------------------------------------------------------------
+ * VP8: lossy, key frames only
+ * ------------------------------------------------------------------------ */
+
+/* Boolean entropy decoder of RFC 6386, section 7.3 */
+struct vp8_bool {
+    const uint8_t *p, *end;
+    uint32_t       value;
+    uint32_t       range;
+    int            bit_count;
+};
+
+static int
+vp8_next_byte (struct vp8_bool *br)
+{
+    return br->p < br->end ? *br->p++ : 0;
+}
+
+static void
+vp8_bool_init (struct vp8_bool *br, const uint8_t *p, size_t len)
+{
+    br->p = p;
+    br->end = p + len;
+    br->value = vp8_next_byte(br) << 8;
+    br->value |= vp8_next_byte(br);
+    br->range = 255;
+    br->bit_count = 0;
+}
+
+static int
+vp8_get_bit (struct vp8_bool *br, int prob)
+{
+    uint32_t split = 1 + (((br->range - 1) * prob) >> 8);
+    int      bit;
+
+    if (br->value >= split << 8) {
+        bit = 1;
+        br->range -= split;
+        br->value -= split << 8;
+    } else {
+        bit = 0;
+        br->range = split;
+    }
+    while (br->range < 128) {
+        br->value <<= 1;
+        br->range <<= 1;
+        if (++br->bit_count == 8) {
+            br->bit_count = 0;
+            br->value |= vp8_next_byte(br);
+        }
+    }
+
+    return bit;
+}
+
+static int
+vp8_get_value (struct vp8_bool *br, int nbits)
+{
+    int v = 0;
+
+    while (nbits-- > 0)
+        v = (v << 1) | vp8_get_bit(br, 128);
+    return v;
+}
+
+static int
+vp8_get_signed_value (struct vp8_bool *br, int nbits)
+{
+    int v = vp8_get_value(br, nbits);
+
+    return vp8_get_bit(br, 128) ? -v : v;
+}
+
+/* optional signed value, 0 when absent */
+static int
+vp8_get_delta (struct vp8_bool *br, int nbits)
+{
+    return vp8_get_bit(br, 128) ? vp8_get_signed_value(br, nbits) : 0;
+}
+
+static const uint8_t vp8_dc_table[128] = {
+      4,   5,   6,   7,   8,   9,  10,  10,  11,  12,  13,  14,  15,  16,  17,  17,
+     18,  19,  20,  20,  21,  21,  22,  22,  23,  23,  24,  25,  25,  26,  27,  28,
+     29,  30,  31,  32,  33,  34,  35,  36,  37,  37,  38,  39,  40,  41,  42,  43,
+     44,  45,  46,  46,  47,  48,  49,  50,  51,  52,  53,  54,  55,  56,  57,  58,
+     59,  60,  61,  62,  63,  64,  65,  66,  67,  68,  69,  70,  71,  72,  73,  74,
+     75,  76,  76,  77,  78,  79,  80,  81,  82,  83,  84,  85,  86,  87,  88,  89,
+     91,  93,  95,  96,  98, 100, 101, 102, 104, 106, 108, 110, 112, 114, 116, 118,
+    122, 124, 126, 128, 130, 132, 134, 136, 138, 140, 143, 145, 148, 151, 154, 157
+};
+
+static const uint16_t vp8_ac_table[128] = {
+      4,   5,   6,   7,   8,   9,  10,  11,  12,  13,  14,  15,  16,  17,  18,  19,
+     20,  21,  22,  23,  24,  25,  26,  27,  28,  29,  30,  31,  32,  33,  34,  35,
+     36,  37,  38,  39,  40,  41,  42,  43,  44,  45,  46,  47,  48,  49,  50,  51,
+     52,  53,  54,  55,  56,  57,  58,  60,  62,  64,  66,  68,  70,  72,  74,  76,
+     78,  80,  82,  84,  86,  88,  90,  92,  94,  96,  98, 100, 102, 104, 106, 108,
+    110, 112, 114, 116, 119, 122, 125, 128, 131, 134, 137, 140, 143, 146, 149, 152,
+    155, 158, 161, 164, 167, 170, 173, 177, 181, 185, 189, 193, 197, 201, 205, 209,
+    213, 217, 221, 225, 229, 234, 239, 245, 249, 254, 259, 264, 269, 274, 279, 284
+};
+
+static const uint8_t vp8_coeff_update_probs[4][8][3][11] = {
+    {
+        {
+            { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 }
+        },
+        {
+            { 176, 246, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 223, 241, 252, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 249, 253, 253, 255, 255, 255, 255, 255, 255, 255, 255 }
+        },
+        {
+            { 255, 244, 252, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 234, 254, 254, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 253, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 }
+        },
+        {
+            { 255, 246, 254, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 239, 253, 254, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 254, 255, 254, 255, 255, 255, 255, 255, 255, 255, 255 }
+        },
+        {
+            { 255, 248, 254, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 251, 255, 254, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 }
+        },
+        {
+            { 255, 253, 254, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 251, 254, 254, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 254, 255, 254, 255, 255, 255, 255, 255, 255, 255, 255 }
+        },
+        {
+            { 255, 254, 253, 255, 254, 255, 255, 255, 255, 255, 255 },
+            { 250, 255, 254, 255, 254, 255, 255, 255, 255, 255, 255 },
+            { 254, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 }
+        },
+        {
+            { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 }
+        }
+    },
+    {
+        {
+            { 217, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 225, 252, 241, 253, 255, 255, 254, 255, 255, 255, 255 },
+            { 234, 250, 241, 250, 253, 255, 253, 254, 255, 255, 255 }
+        },
+        {
+            { 255, 254, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 223, 254, 254, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 238, 253, 254, 254, 255, 255, 255, 255, 255, 255, 255 }
+        },
+        {
+            { 255, 248, 254, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 249, 254, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 }
+        },
+        {
+            { 255, 253, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 247, 254, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 }
+        },
+        {
+            { 255, 253, 254, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 252, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 }
+        },
+        {
+            { 255, 254, 254, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 253, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 }
+        },
+        {
+            { 255, 254, 253, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 250, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 254, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 }
+        },
+        {
+            { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 }
+        }
+    },
+    {
+        {
+            { 186, 251, 250, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 234, 251, 244, 254, 255, 255, 255, 255, 255, 255, 255 },
+            { 251, 251, 243, 253, 254, 255, 254, 255, 255, 255, 255 }
+        },
+        {
+            { 255, 253, 254, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 236, 253, 254, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 251, 253, 253, 254, 254, 255, 255, 255, 255, 255, 255 }
+        },
+        {
+            { 255, 254, 254, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 254, 254, 254, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 }
+        },
+        {
+            { 255, 254, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 254, 254, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 254, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 }
+        },
+        {
+            { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 254, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 }
+        },
+        {
+            { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 }
+        },
+        {
+            { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 }
+        },
+        {
+            { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 }
+        }
+    },
+    {
+        {
+            { 248, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 250, 254, 252, 254, 255, 255, 255, 255, 255, 255, 255 },
+            { 248, 254, 249, 253, 255, 255, 255, 255, 255, 255, 255 }
+        },
+        {
+            { 255, 253, 253, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 246, 253, 253, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 252, 254, 251, 254, 254, 255, 255, 255, 255, 255, 255 }
+        },
+        {
+            { 255, 254, 252, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 248, 254, 253, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 253, 255, 254, 254, 255, 255, 255, 255, 255, 255, 255 }
+        },
+        {
+            { 255, 251, 254, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 245, 251, 254, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 253, 253, 254, 255, 255, 255, 255, 255, 255, 255, 255 }
+        },
+        {
+            { 255, 251, 253, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 252, 253, 254, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 255, 254, 255, 255, 255, 255, 255, 255, 255, 255, 255 }
+        },
+        {
+            { 255, 252, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 249, 255, 254, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 255, 255, 254, 255, 255, 255, 255, 255, 255, 255, 255 }
+        },
+        {
+            { 255, 255, 253, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 250, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 }
+        },
+        {
+            { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 254, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+            { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 }
+        }
+    }
+};
+
+static const uint8_t vp8_coeff_probs[4][8][3][11] = {
+    {
+        {
+            { 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128 },
+            { 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128 },
+            { 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128 }
+        },
+        {
+            { 253, 136, 254, 255, 228, 219, 128, 128, 128, 128, 128 },
+            { 189, 129, 242, 255, 227, 213, 255, 219, 128, 128, 128 },
+            { 106, 126, 227, 252, 214, 209, 255, 255, 128, 128, 128 }
+        },
+        {
+            {   1,  98, 248, 255, 236, 226, 255, 255, 128, 128, 128 },
+            { 181, 133, 238, 254, 221, 234, 255, 154, 128, 128, 128 },
+            {  78, 134, 202, 247, 198, 180, 255, 219, 128, 128, 128 }
+        },
+        {
+            {   1, 185, 249, 255, 243, 255, 128, 128, 128, 128, 128 },
+            { 184, 150, 247, 255, 236, 224, 128, 128, 128, 128, 128 },
+            {  77, 110, 216, 255, 236, 230, 128, 128, 128, 128, 128 }
+        },
+        {
+            {   1, 101, 251, 255, 241, 255, 128, 128, 128, 128, 128 },
+            { 170, 139, 241, 252, 236, 209, 255, 255, 128, 128, 128 },
+            {  37, 116, 196, 243, 228, 255, 255, 255, 128, 128, 128 }
+        },
+        {
+            {   1, 204, 254, 255, 245, 255, 128, 128, 128, 128, 128 },
+            { 207, 160, 250, 255, 238, 128, 128, 128, 128, 128, 128 },
+            { 102, 103, 231, 255, 211, 171, 128, 128, 128, 128, 128 }
+        },
+        {
+            {   1, 152, 252, 255, 240, 255, 128, 128, 128, 128, 128 },
+            { 177, 135, 243, 255, 234, 225, 128, 128, 128, 128, 128 },
+            {  80, 129, 211, 255, 194, 224, 128, 128, 128, 128, 128 }
+        },
+        {
+            {   1,   1, 255, 128, 128, 128, 128, 128, 128, 128, 128 },
+            { 246,   1, 255, 128, 128, 128, 128, 128, 128, 128, 128 },
+            { 255, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128 }
+        }
+    },
+    {
+        {
+            { 198,  35, 237, 223, 193, 187, 162, 160, 145, 155,  62 },
+            { 131,  45, 198, 221, 172, 176, 220, 157, 252, 221,   1 },
+            {  68,  47, 146, 208, 149, 167, 221, 162, 255, 223, 128 }
+        },
+        {
+            {   1, 149, 241, 255, 221, 224, 255, 255, 128, 128, 128 },
+            { 184, 141, 234, 253, 222, 220, 255, 199, 128, 128, 128 },
+            {  81,  99, 181, 242, 176, 190, 249, 202, 255, 255, 128 }
+        },
+        {
+            {   1, 129, 232, 253, 214, 197, 242, 196, 255, 255, 128 },
+            {  99, 121, 210, 250, 201, 198, 255, 202, 128, 128, 128 },
+            {  23,  91, 163, 242, 170, 187, 247, 210, 255, 255, 128 }
+        },
+        {
+            {   1, 200, 246, 255, 234, 255, 128, 128, 128, 128, 128 },
+            { 109, 178, 241, 255, 231, 245, 255, 255, 128, 128, 128 },
+            {  44, 130, 201, 253, 205, 192, 255, 255, 128, 128, 128 }
+        },
+        {
+            {   1, 132, 239, 251, 219, 209, 255, 165, 128, 128, 128 },
+            {  94, 136, 225, 251, 218, 190, 255, 255, 128, 128, 128 },
+            {  22, 100, 174, 245, 186, 161, 255, 199, 128, 128, 128 }
+        },
+        {
+            {   1, 182, 249, 255, 232, 235, 128, 128, 128, 128, 128 },
+            { 124, 143, 241, 255, 227, 234, 128, 128, 128, 128, 128 },
+            {  35,  77, 181, 251, 193, 211, 255, 205, 128, 128, 128 }
+        },
+        {
+            {   1, 157, 247, 255, 236, 231, 255, 255, 128, 128, 128 },
+            { 121, 141, 235, 255, 225, 227, 255, 255, 128, 128, 128 },
+            {  45,  99, 188, 251, 195, 217, 255, 224, 128, 128, 128 }
+        },
+        {
+            {   1,   1, 251, 255, 213, 255, 128, 128, 128, 128, 128 },
+            { 203,   1, 248, 255, 255, 128, 128, 128, 128, 128, 128 },
+            { 137,   1, 177, 255, 224, 255, 128, 128, 128, 128, 128 }
+        }
+    },
+    {
+        {
+            { 253,   9, 248, 251, 207, 208, 255, 192, 128, 128, 128 },
+            { 175,  13, 224, 243, 193, 185, 249, 198, 255, 255, 128 },
+            {  73,  17, 171, 221, 161, 179, 236, 167, 255, 234, 128 }
+        },
+        {
+            {   1,  95, 247, 253, 212, 183, 255, 255, 128, 128, 128 },
+            { 239,  90, 244, 250, 211, 209, 255, 255, 128, 128, 128 },
+            { 155,  77, 195, 248, 188, 195, 255, 255, 128, 128, 128 }
+        },
+        {
+            {   1,  24, 239, 251, 218, 219, 255, 205, 128, 128, 128 },
+            { 201,  51, 219, 255, 196, 186, 128, 128, 128, 128, 128 },
+            {  69,  46, 190, 239, 201, 218, 255, 228, 128, 128, 128 }
+        },
+        {
+            {   1, 191, 251, 255, 255, 128, 128, 128, 128, 128, 128 },
+            { 223, 165, 249, 255, 213, 255, 128, 128, 128, 128, 128 },
+            { 141, 124, 248, 255, 255, 128, 128, 128, 128, 128, 128 }
+        },
+        {
+            {   1,  16, 248, 255, 255, 128, 128, 128, 128, 128, 128 },
+            { 190,  36, 230, 255, 236, 255, 128, 128, 128, 128, 128 },
+            { 149,   1, 255, 128, 128, 128, 128, 128, 128, 128, 128 }
+        },
+        {
+            {   1, 226, 255, 128, 128, 128, 128, 128, 128, 128, 128 },
+            { 247, 192, 255, 128, 128, 128, 128, 128, 128, 128, 128 },
+            { 240, 128, 255, 128, 128, 128, 128, 128, 128, 128, 128 }
+        },
+        {
+            {   1, 134, 252, 255, 255, 128, 128, 128, 128, 128, 128 },
+            { 213,  62, 250, 255, 255, 128, 128, 128, 128, 128, 128 },
+            {  55,  93, 255, 128, 128, 128, 128, 128, 128, 128, 128 }
+        },
+        {
+            { 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128 },
+            { 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128 },
+            { 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128 }
+        }
+    },
+    {
+        {
+            { 202,  24, 213, 235, 186, 191, 220, 160, 240, 175, 255 },
+            { 126,  38, 182, 232, 169, 184, 228, 174, 255, 187, 128 },
+            {  61,  46, 138, 219, 151, 178, 240, 170, 255, 216, 128 }
+        },
+        {
+            {   1, 112, 230, 250, 199, 191, 247, 159, 255, 255, 128 },
+            { 166, 109, 228, 252, 211, 215, 255, 174, 128, 128, 128 },
+            {  39,  77, 162, 232, 172, 180, 245, 178, 255, 255, 128 }
+        },
+        {
+            {   1,  52, 220, 246, 198, 199, 249, 220, 255, 255, 128 },
+            { 124,  74, 191, 243, 183, 193, 250, 221, 255, 255, 128 },
+            {  24,  71, 130, 219, 154, 170, 243, 182, 255, 255, 128 }
+        },
+        {
+            {   1, 182, 225, 249, 219, 240, 255, 224, 128, 128, 128 },
+            { 149, 150, 226, 252, 216, 205, 255, 171, 128, 128, 128 },
+            {  28, 108, 170, 242, 183, 194, 254, 223, 255, 255, 128 }
+        },
+        {
+            {   1,  81, 230, 252, 204, 203, 255, 192, 128, 128, 128 },
+            { 123, 102, 209, 247, 188, 196, 255, 233, 128, 128, 128 },
+            {  20,  95, 153, 243, 164, 173, 255, 203, 128, 128, 128 }
+        },
+        {
+            {   1, 222, 248, 255, 216, 213, 128, 128, 128, 128, 128 },
+            { 168, 175, 246, 252, 235, 205, 255, 255, 128, 128, 128 },
+            {  47, 116, 215, 255, 211, 212, 255, 255, 128, 128, 128 }
+        },
+        {
+            {   1, 121, 236, 253, 212, 214, 255, 255, 128, 128, 128 },
+            { 141,  84, 213, 252, 201, 202, 255, 219, 128, 128, 128 },
+            {  42,  80, 160, 240, 162, 185, 255, 205, 128, 128, 128 }
+        },
+        {
+            {   1,   1, 255, 128, 128, 128, 128, 128, 128, 128, 128 },
+            { 244,   1, 255, 128, 128, 128, 128, 128, 128, 128, 128 },
+            { 238,   1, 255, 128, 128, 128, 128, 128, 128, 128, 128 }
+        }
+    }
+};
+
+static const uint8_t vp8_bmode_probs[10][10][9] = {
+    {
+        { 231, 120,  48,  89, 115, 113, 120, 152, 112 },
+        { 152, 179,  64, 126, 170, 118,  46,  70,  95 },
+        { 175,  69, 143,  80,  85,  82,  72, 155, 103 },
+        {  56,  58,  10, 171, 218, 189,  17,  13, 152 },
+        { 114,  26,  17, 163,  44, 195,  21,  10, 173 },
+        { 121,  24,  80, 195,  26,  62,  44,  64,  85 },
+        { 144,  71,  10,  38, 171, 213, 144,  34,  26 },
+        { 170,  46,  55,  19, 136, 160,  33, 206,  71 },
+        {  63,  20,   8, 114, 114, 208,  12,   9, 226 },
+        {  81,  40,  11,  96, 182,  84,  29,  16,  36 }
+    },
+    {
+        { 134, 183,  89, 137,  98, 101, 106, 165, 148 },
+        {  72, 187, 100, 130, 157, 111,  32,  75,  80 },
+        {  66, 102, 167,  99,  74,  62,  40, 234, 128 },
+        {  41,  53,   9, 178, 241, 141,  26,   8, 107 },
+        {  74,  43,  26, 146,  73, 166,  49,  23, 157 },
+        {  65,  38, 105, 160,  51,  52,  31, 115, 128 },
+        { 104,  79,  12,  27, 217, 255,  87,  17,   7 },
+        {  87,  68,  71,  44, 114,  51,  15, 186,  23 },
+        {  47,  41,  14, 110, 182, 183,  21,  17, 194 },
+        {  66,  45,  25, 102, 197, 189,  23,  18,  22 }
+    },
+    {
+        {  88,  88, 147, 150,  42,  46,  45, 196, 205 },
+        {  43,  97, 183, 117,  85,  38,  35, 179,  61 },
+        {  39,  53, 200,  87,  26,  21,  43, 232, 171 },
+        {  56,  34,  51, 104, 114, 102,  29,  93,  77 },
+        {  39,  28,  85, 171,  58, 165,  90,  98,  64 },
+        {  34,  22, 116, 206,  23,  34,  43, 166,  73 },
+        { 107,  54,  32,  26,  51,   1,  81,  43,  31 },
+        {  68,  25, 106,  22,  64, 171,  36, 225, 114 },
+        {  34,  19,  21, 102, 132, 188,  16,  76, 124 },
+        {  62,  18,  78,  95,  85,  57,  50,  48,  51 }
+    },
+    {
+        { 193, 101,  35, 159, 215, 111,  89,  46, 111 },
+        {  60, 148,  31, 172, 219, 228,  21,  18, 111 },
+        { 112, 113,  77,  85, 179, 255,  38, 120, 114 },
+        {  40,  42,   1, 196, 245, 209,  10,  25, 109 },
+        {  88,  43,  29, 140, 166, 213,  37,  43, 154 },
+        {  61,  63,  30, 155,  67,  45,  68,   1, 209 },
+        { 100,  80,   8,  43, 154,   1,  51,  26,  71 },
+        { 142,  78,  78,  16, 255, 128,  34, 197, 171 },
+        {  41,  40,   5, 102, 211, 183,   4,   1, 221 },
+        {  51,  50,  17, 168, 209, 192,  23,  25,  82 }
+    },
+    {
+        { 138,  31,  36, 171,  27, 166,  38,  44, 229 },
+        {  67,  87,  58, 169,  82, 115,  26,  59, 179 },
+        {  63,  59,  90, 180,  59, 166,  93,  73, 154 },
+        {  40,  40,  21, 116, 143, 209,  34,  39, 175 },
+        {  47,  15,  16, 183,  34, 223,  49,  45, 183 },
+        {  46,  17,  33, 183,   6,  98,  15,  32, 183 },
+        {  57,  46,  22,  24, 128,   1,  54,  17,  37 },
+        {  65,  32,  73, 115,  28, 128,  23, 128, 205 },
+        {  40,   3,   9, 115,  51, 192,  18,   6, 223 },
+        {  87,  37,   9, 115,  59,  77,  64,  21,  47 }
+    },
+    {
+        { 104,  55,  44, 218,   9,  54,  53, 130, 226 },
+        {  64,  90,  70, 205,  40,  41,  23,  26,  57 },
+        {  54,  57, 112, 184,   5,  41,  38, 166, 213 },
+        {  30,  34,  26, 133, 152, 116,  10,  32, 134 },
+        {  39,  19,  53, 221,  26, 114,  32,  73, 255 },
+        {  31,   9,  65, 234,   2,  15,   1, 118,  73 },
+        {  75,  32,  12,  51, 192, 255, 160,  43,  51 },
+        {  88,  31,  35,  67, 102,  85,  55, 186,  85 },
+        {  56,  21,  23, 111,  59, 205,  45,  37, 192 },
+        {  55,  38,  70, 124,  73, 102,   1,  34,  98 }
+    },
+    {
+        { 125,  98,  42,  88, 104,  85, 117, 175,  82 },
+        {  95,  84,  53,  89, 128, 100, 113, 101,  45 },
+        {  75,  79, 123,  47,  51, 128,  81, 171,   1 },
+        {  57,  17,   5,  71, 102,  57,  53,  41,  49 },
+        {  38,  33,  13, 121,  57,  73,  26,   1,  85 },
+        {  41,  10,  67, 138,  77, 110,  90,  47, 114 },
+        { 115,  21,   2,  10, 102, 255, 166,  23,   6 },
+        { 101,  29,  16,  10,  85, 128, 101, 196,  26 },
+        {  57,  18,  10, 102, 102, 213,  34,  20,  43 },
+        { 117,  20,  15,  36, 163, 128,  68,   1,  26 }
+    },
+    {
+        { 102,  61,  71,  37,  34,  53,  31, 243, 192 },
+        {  69,  60,  71,  38,  73, 119,  28, 222,  37 },
+        {  68,  45, 128,  34,   1,  47,  11, 245, 171 },
+        {  62,  17,  19,  70, 146,  85,  55,  62,  70 },
+        {  37,  43,  37, 154, 100, 163,  85, 160,   1 },
+        {  63,   9,  92, 136,  28,  64,  32, 201,  85 },
+        {  75,  15,   9,   9,  64, 255, 184, 119,  16 },
+        {  86,   6,  28,   5,  64, 255,  25, 248,   1 },
+        {  56,   8,  17, 132, 137, 255,  55, 116, 128 },
+        {  58,  15,  20,  82, 135,  57,  26, 121,  40 }
+    },
+    {
+        { 164,  50,  31, 137, 154, 133,  25,  35, 218 },
+        {  51, 103,  44, 131, 131, 123,  31,   6, 158 },
+        {  86,  40,  64, 135, 148, 224,  45, 183, 128 },
+        {  22,  26,  17, 131, 240, 154,  14,   1, 209 },
+        {  45,  16,  21,  91,  64, 222,   7,   1, 197 },
+        {  56,  21,  39, 155,  60, 138,  23, 102, 213 },
+        {  83,  12,  13,  54, 192, 255,  68,  47,  28 },
+        {  85,  26,  85,  85, 128, 128,  32, 146, 171 },
+        {  18,  11,   7,  63, 144, 171,   4,   4, 246 },
+        {  35,  27,  10, 146, 174, 171,  12,  26, 128 }
+    },
+    {
+        { 190,  80,  35,  99, 180,  80, 126,  54,  45 },
+        {  85, 126,  47,  87, 176,  51,  41,  20,  32 },
+        { 101,  75, 128, 139, 118, 146, 116, 128,  85 },
+        {  56,  41,  15, 176, 236,  85,  37,   9,  62 },
+        {  71,  30,  17, 119, 118, 255,  17,  18, 138 },
+        { 101,  38,  60, 138,  55,  70,  43,  26, 142 },
+        { 146,  36,  19,  30, 171, 255,  97,  27,  20 },
+        { 138,  45,  61,  62, 219,   1,  81, 188,  64 },
+        {  32,  41,  20, 117, 151, 142,  20,  21, 163 },
+        { 112,  19,  12,  61, 195, 128,  48,   4,  24 }
+    }
+};
+
+static const uint8_t vp8_zigzag[16] = {
+    0, 1, 4, 8, 5, 2, 3, 6, 9, 12, 13, 10, 7, 11, 14, 15
+};
+
+static const uint8_t vp8_bands[16 + 1] = {
+    0, 1, 2, 3, 6, 4, 5, 6, 6, 6, 6, 6, 6, 6, 6, 7, 0
+};
+
+static const uint8_t vp8_cat3[] = { 173, 148, 140, 0 };
+static const uint8_t vp8_cat4[] = { 176, 155, 140, 135, 0 };
+static const uint8_t vp8_cat5[] = { 180, 157, 141, 134, 130, 0 };
+static const uint8_t vp8_cat6[] = {
+    254, 254, 243, 230, 196, 177, 153, 140, 133, 130, 129, 0
+};
+static const uint8_t *const vp8_cat3456[] = { vp8_cat3, vp8_cat4, vp8_cat5, vp8_cat6 };
+
+/* Intra modes; those of whole blocks share the numbers of their 4x4 kin. */
+enum {
+    B_DC_PRED = 0, B_TM_PRED, B_VE_PRED, B_HE_PRED, B_RD_PRED,
+    B_VR_PRED, B_LD_PRED, B_VL_PRED, B_HD_PRED, B_HU_PRED
+};
+#define DC_PRED B_DC_PRED
+#define TM_PRED B_TM_PRED
+#define V_PRED  B_VE_PRED
+#define H_PRED  B_HE_PRED
+
+/* Coefficient types */
+#define TYPE_I16_AC 0
+#define TYPE_I16_DC 1
+#define TYPE_CHROMA 2
+#define TYPE_I4     3
+
+/* Stride of the work area a macroblock is predicted and reconstructed in,
+ * with its top and left neighbours (and those above to its right) around. */
+#define BPS 32
+
+struct vp8_quant {
+    int y1[2], y2[2], uv[2]; /* dc, ac */
+};
+
+struct vp8_filter {
+    int limit;   /* 0: no filtering */
+    int ilevel;
+    int hev_thresh;
+    int inner;
+};
+
+struct vp8_decoder {
+    uint8_t            probs[4][8][3][11];
+    struct vp8_quant   quant[4];
+    struct vp8_filter  fstrengths[4][2];
+    int                filter_type;  /* 0: none, 1: simple, 2: normal */
+    int                use_skip;
+    int                skip_prob;
+    int                update_map;
+    uint8_t            segment_probs[3];
+    int                num_parts;
+    int                mb_w, mb_h;
+};
+
+static int
+get_large_value (struct vp8_bool *br, const uint8_t *p)
+{
+    int v;
+
+    if (!vp8_get_bit(br, p[3])) {
+        if (!vp8_get_bit(br, p[4]))
+            v = 2;
+        else
+            v = 3 + vp8_get_bit(br, p[5]);
+    } else if (!vp8_get_bit(br, p[6])) {
+        if (!vp8_get_bit(br, p[7])) {
+            v = 5 + vp8_get_bit(br, 159);
+        } else {
+            v = 7 + 2 * vp8_get_bit(br, 165);
+            v += vp8_get_bit(br, 145);
+        }
+    } else {
+        const uint8_t *tab;
+        int bit1 = vp8_get_bit(br, p[8]);
+        int bit0 = vp8_get_bit(br, p[9 + bit1]);
+        int cat = 2 * bit1 + bit0;
+
+        v = 0;
+        for (tab = vp8_cat3456[cat]; *tab; tab++)
+            v += v + vp8_get_bit(br, *tab);
+        v += 3 + (8 << cat);
+    }
+
+    return v;
+}
+
+/* Tokens of one block from coefficient n on. Returns the position after
+ * the last non-zero coefficient (16 if the tokens run to the end). */
+static int
+get_coeffs (struct vp8_bool *br, uint8_t (*bands)[3][11], int ctx,
+            const int *dq, int n, int16_t *out)
+{
+    const uint8_t *p = bands[vp8_bands[n]][ctx];
+
+    for (; n < 16; n++) {
+        int v;
+
+        if (!vp8_get_bit(br, p[0]))
+            return n;
+        while (!vp8_get_bit(br, p[1])) {
+            if (++n == 16)
+                return 16;
+            p = bands[vp8_bands[n]][0];
+        }
+        if (!vp8_get_bit(br, p[2])) {
+            v = 1;
+            p = bands[vp8_bands[n + 1]][1];
+        } else {
+            v = get_large_value(br, p);
+            p = bands[vp8_bands[n + 1]][2];
+        }
+        if (vp8_get_bit(br, 128))
+            v = -v;
+        out[vp8_zigzag[n]] = (int16_t) (v * dq[n > 0]);
+    }
+
+    return 16;
+}
+
+static void
+transform_wht (const int16_t *in, int16_t *out)
+{
+    int tmp[16], i;
+
+    for (i = 0; i < 4; i++) {
+        int a0 = in[0 + i] + in[12 + i];
+        int a1 = in[4 + i] + in[ 8 + i];
+        int a2 = in[4 + i] - in[ 8 + i];
+        int a3 = in[0 + i] - in[12 + i];
+
+        tmp[0  + i] = a0 + a1;
+        tmp[8  + i] = a0 - a1;
+        tmp[4  + i] = a3 + a2;
+        tmp[12 + i] = a3 - a2;
+    }
+    for (i = 0; i < 4; i++) {
+        int dc = tmp[0 + i * 4] + 3;
+        int a0 = dc             + tmp[3 + i * 4];
+        int a1 = tmp[1 + i * 4] + tmp[2 + i * 4];
+        int a2 = tmp[1 + i * 4] - tmp[2 + i * 4];
+        int a3 = dc             - tmp[3 + i * 4];
+
+        out[ 0] = (int16_t) ((a0 + a1) >> 3);
+        out[16] = (int16_t) ((a3 + a2) >> 3);
+        out[32] = (int16_t) ((a0 - a1) >> 3);
+        out[48] = (int16_t) ((a3 - a2) >> 3);
+        out += 64;
+    }
+}
+
+static uint8_t
+clip8 (int v)
+{
+    return (uint8_t) (v < 0 ? 0 : v > 255 ? 255 : v);
+}
+
+#define MUL1(a) ((((a) * 20091) >> 16) + (a))
+#define MUL2(a) (((a) * 35468) >> 16)
+
+/* inverse DCT of a block, added to the prediction in dst */
+static void
+transform_add (const int16_t *in, uint8_t *dst)
+{
+    int C[16], *tmp = C, i;
+
+    for (i = 0; i < 16 && !in[i]; i++)
+        ;
+    if (i == 16)
+        return;
+    for (i = 0; i < 4; i++) {
+        int a = in[0] + in[8];
+        int b = in[0] - in[8];
+        int c = MUL2(in[4]) - MUL1(in[12]);
+        int d = MUL1(in[4]) + MUL2(in[12]);
+
+        tmp[0] = a + d;
+        tmp[1] = b + c;
+        tmp[2] = b - c;
+        tmp[3] = a - d;
+        tmp += 4;
+        in++;
+    }
+    tmp = C;
+    for (i = 0; i < 4; i++) {
+        int dc = tmp[0] + 4;
+        int a = dc + tmp[8];
+        int b = dc - tmp[8];
+        int c = MUL2(tmp[4]) - MUL1(tmp[12]);
+        int d = MUL1(tmp[4]) + MUL2(tmp[12]);
+
+        dst[0] = clip8(dst[0] + ((a + d) >> 3));
+        dst[1] = clip8(dst[1] + ((b + c) >> 3));
+        dst[2] = clip8(dst[2] + ((b - c) >> 3));
+        dst[3] = clip8(dst[3] + ((a - d) >> 3));
+        tmp++;
+        dst += BPS;
+    }
+}
+
+#define AVG3(a, b, c) ((uint8_t) (((a) + 2 * (b) + (c) + 2) >> 2))
+#define AVG2(a, b)    ((uint8_t) (((a) + (b) + 1) >> 1))
+#define DST(x, y)     dst[(x) + (y) * BPS]
+
+static void
+predict_4x4 (uint8_t *dst, int mode)
+{
+    const uint8_t *top = dst - BPS;
+    const int X = top[-1], A = top[0], B = top[1], C = top[2], D = top[3];
+    const int E = top[4], F = top[5], G = top[6], H = top[7];
+    const int I = dst[-1], J = dst[-1 + BPS], K = dst[-1 + 2 * BPS], L = dst[-1 + 3 * BPS];
+    int x, y;
+
+    switch (mode) {
+    case B_DC_PRED:
+        {
+            int dc = 4;
+
+            for (x = 0; x < 4; x++)
+                dc += top[x] + dst[-1 + x * BPS];
+            for (y = 0; y < 4; y++)
+                memset(dst + y * BPS, dc >> 3, 4);
+        }
+        break;
+    case B_TM_PRED:
+        for (y = 0; y < 4; y++) {
+            for (x = 0; x < 4; x++)
+                DST(x, y) = clip8(dst[-1 + y * BPS] + top[x] - X);
+        }
+        break;
+    case B_VE_PRED:
+        for (y = 0; y < 4; y++) {
+            DST(0, y) = AVG3(X, A, B);
+            DST(1, y) = AVG3(A, B, C);
+            DST(2, y) = AVG3(B, C, D);
+            DST(3, y) = AVG3(C, D, E);
+        }
+        break;
+    case B_HE_PRED:
+        memset(dst + 0 * BPS, AVG3(X, I, J), 4);
+        memset(dst + 1 * BPS, AVG3(I, J, K), 4);
+        memset(dst + 2 * BPS, AVG3(J, K, L), 4);
+        memset(dst + 3 * BPS, AVG3(K, L, L), 4);
+        break;
+    case B_RD_PRED:
+        DST(0, 3)                                     = AVG3(J, K, L);
+        DST(1, 3) = DST(0, 2)                         = AVG3(I, J, K);
+        DST(2, 3) = DST(1, 2) = DST(0, 1)             = AVG3(X, I, J);
+        DST(3, 3) = DST(2, 2) = DST(1, 1) = DST(0, 0) = AVG3(A, X, I);
+                    DST(3, 2) = DST(2, 1) = DST(1, 0) = AVG3(B, A, X);
+                                DST(3, 1) = DST(2, 0) = AVG3(C, B, A);
+                                            DST(3, 0) = AVG3(D, C, B);
+        break;
+    case B_LD_PRED:
+        DST(0, 0)                                     = AVG3(A, B, C);
+        DST(1, 0) = DST(0, 1)                         = AVG3(B, C, D);
+        DST(2, 0) = DST(1, 1) = DST(0, 2)             = AVG3(C, D, E);
+        DST(3, 0) = DST(2, 1) = DST(1, 2) = DST(0, 3) = AVG3(D, E, F);
+                    DST(3, 1) = DST(2, 2) = DST(1, 3) = AVG3(E, F, G);
+                                DST(3, 2) = DST(2, 3) = AVG3(F, G, H);
+                                            DST(3, 3) = AVG3(G, H, H);
+        break;
+    case B_VR_PRED:
+        DST(0, 0) = DST(1, 2) = AVG2(X, A);
+        DST(1, 0) = DST(2, 2) = AVG2(A, B);
+        DST(2, 0) = DST(3, 2) = AVG2(B, C);
+        DST(3, 0)             = AVG2(C, D);
+        DST(0, 3) =             AVG3(K, J, I);
+        DST(0, 2) =             AVG3(J, I, X);
+        DST(0, 1) = DST(1, 3) = AVG3(I, X, A);
+        DST(1, 1) = DST(2, 3) = AVG3(X, A, B);
+        DST(2, 1) = DST(3, 3) = AVG3(A, B, C);
+        DST(3, 1) =             AVG3(B, C, D);
+        break;
+    case B_VL_PRED:
+        DST(0, 0) =             AVG2(A, B);
+        DST(1, 0) = DST(0, 2) = AVG2(B, C);
+        DST(2, 0) = DST(1, 2) = AVG2(C, D);
+        DST(3, 0) = DST(2, 2) = AVG2(D, E);
+        DST(0, 1) =             AVG3(A, B, C);
+        DST(1, 1) = DST(0, 3) = AVG3(B, C, D);
+        DST(2, 1) = DST(1, 3) = AVG3(C, D, E);
+        DST(3, 1) = DST(2, 3) = AVG3(D, E, F);
+        DST(3, 2) =             AVG3(E, F, G);
+        DST(3, 3) =             AVG3(F, G, H);
+        break;
+    case B_HD_PRED:
+        DST(0, 0) = DST(2, 1) = AVG2(I, X);
+        DST(0, 1) = DST(2, 2) = AVG2(J, I);
+        DST(0, 2) = DST(2, 3) = AVG2(K, J);
+        DST(0, 3)             = AVG2(L, K);
+        DST(3, 0)             = AVG3(A, B, C);
+        DST(2, 0)             = AVG3(X, A, B);
+        DST(1, 0) = DST(3, 1) = AVG3(I, X, A);
+        DST(1, 1) = DST(3, 2) = AVG3(J, I, X);
+        DST(1, 2) = DST(3, 3) = AVG3(K, J, I);
+        DST(1, 3)             = AVG3(L, K, J);
+        break;
+    case B_HU_PRED:
+        DST(0, 0) =             AVG2(I, J);
+        DST(2, 0) = DST(0, 1) = AVG2(J, K);
+        DST(2, 1) = DST(0, 2) = AVG2(K, L);
+        DST(1, 0) =             AVG3(I, J, K);
+        DST(3, 0) = DST(1, 1) = AVG3(J, K, L);
+        DST(3, 1) = DST(1, 2) = AVG3(K, L, L);
+        DST(3, 2) = DST(2, 2) = DST(0, 3) = DST(1, 3) = DST(2, 3) = DST(3, 3) = L;
+        break;
+    }
+}
+
+/* 16x16 luma or 8x8 chroma. DC falls back on the edges there are: none at
+ * all on the top left macroblock. */
+static void
+predict_block (uint8_t *dst, int size, int mode, int mb_x, int mb_y)
+{
+    const uint8_t *top = dst - BPS;
+    int x, y, shift = size == 16 ? 4 : 3;
+
+    switch (mode) {
+    case DC_PRED:
+        {
+            int dc = 0;
+
+            if (mb_y > 0) {
+                for (x = 0; x < size; x++)
+                    dc += top[x];
+            }
+            if (mb_x > 0) {
+                for (y = 0; y < size; y++)
+                    dc += dst[-1 + y * BPS];
+            }
+            if (mb_x > 0 && mb_y > 0)
+                dc = (dc + size) >> (shift + 1);
+            else if (mb_x > 0 || mb_y > 0)
+                dc = (dc + (size >> 1)) >> shift;
+            else
+                dc = 0x80;
+            for (y = 0; y < size; y++)
+                memset(dst + y * BPS, dc, size);
+        }
+        break;
+    case TM_PRED:
+        for (y = 0; y < size; y++) {
+            for (x = 0; x < size; x++)
+                dst[x + y * BPS] = clip8(dst[-1 + y * BPS] + top[x] - top[-1]);
+        }
+        break;
+    case V_PRED:
+        for (y = 0; y < size; y++)
+            memcpy(dst + y * BPS, top, size);
+        break;
+    case H_PRED:
+        for (y = 0; y < size; y++)
+            memset(dst + y * BPS, dst[-1 + y * BPS], size);
+        break;
+    }
+}
+
+/* Edges of a work area: the row above from the plane, 127 above the image;
+ * the column to the left, 129 left of it. */
+static void
+load_edges (uint8_t *work, const uint8_t *plane, int stride, int size,
+            int mb_x, int mb_y)
+{
+    const uint8_t *src = plane + (size_t) mb_y * size * stride + mb_x * size;
+    int y;
+
+    if (mb_y > 0) {
+        memcpy(work + 1, src - stride, size);
+        work[0] = mb_x > 0 ? src[-stride - 1] : 129;
+    } else {
+        memset(work, 127, size + 1);
+    }
+    for (y = 0; y < size; y++)
+        work[(y + 1) * BPS] = mb_x > 0 ? src[(size_t) y * stride - 1] : 129;
+}
+
+static void
+store_block (const uint8_t *work, uint8_t *plane, int stride, int size, int mb_x, int mb_y)
+{
+    uint8_t *dst = plane + (size_t) mb_y * size * stride + mb_x * size;
+    int y;
+
+    for (y = 0; y < size; y++)
+        memcpy(dst + (size_t) y * stride, work + (y + 1) * BPS + 1, size);
+}
+
+/* In-loop filters, as libwebp has them */
+
+static int
+sclip1 (int v)
+{
+    return v < -128 ? -128 : v > 127 ? 127 : v;
+}
+
+static int
+sclip2 (int v)
+{
+    return v < -16 ? -16 : v > 15 ? 15 : v;
+}
+
+static void
+do_filter2 (uint8_t *p, int step)
+{
+    const int p1 = p[-2 * step], p0 = p[-step], q0 = p[0], q1 = p[step];
+    const int a = 3 * (q0 - p0) + sclip1(p1 - q1);
+    const int a1 = sclip2((a + 4) >> 3);
+    const int a2 = sclip2((a + 3) >> 3);
+
+    p[-step] = clip8(p0 + a2);
+    p[    0] = clip8(q0 - a1);
+}
+
+static void
+do_filter4 (uint8_t *p, int step)
+{
+    const int p1 = p[-2 * step], p0 = p[-step], q0 = p[0], q1 = p[step];
+    const int a = 3 * (q0 - p0);
+    const int a1 = sclip2((a + 4) >> 3);
+    const int a2 = sclip2((a + 3) >> 3);
+    const int a3 = (a1 + 1) >> 1;
+
+    p[-2 * step] = clip8(p1 + a3);
+    p[-    step] = clip8(p0 + a2);
+    p[        0] = clip8(q0 - a1);
+    p[     step] = clip8(q1 - a3);
+}
+
+static void
+do_filter6 (uint8_t *p, int step)
+{
+    const int p2 = p[-3 * step], p1 = p[-2 * step], p0 = p[-step];
+    const int q0 = p[0], q1 = p[step], q2 = p[2 * step];
+    const int a = sclip1(3 * (q0 - p0) + sclip1(p1 - q1));
+    const int a1 = (27 * a + 63) >> 7;
+    const int a2 = (18 * a + 63) >> 7;
+    const int a3 = (9  * a + 63) >> 7;
+
+    p[-3 * step] = clip8(p2 + a3);
+    p[-2 * step] = clip8(p1 + a2);
+    p[-    step] = clip8(p0 + a1);
+    p[        0] = clip8(q0 - a1);
+    p[     step] = clip8(q1 - a2);
+    p[ 2 * step] = clip8(q2 - a3);
+}
+
+static int
+high_edge_variance (const uint8_t *p, int step, int thresh)
+{
+    return abs(p[-2 * step] - p[-step]) > thresh || abs(p[step] - p[0]) > thresh;
+}
+
+static int
+needs_filter (const uint8_t *p, int step, int t)
+{
+    return 4 * abs(p[-step] - p[0]) + abs(p[-2 * step] - p[step]) <= t;
+}
+
+static int
+needs_filter2 (const uint8_t *p, int step, int t, int it)
+{
+    const int p3 = p[-4 * step], p2 = p[-3 * step], p1 = p[-2 * step];
+    const int p0 = p[-step], q0 = p[0];
+    const int q1 = p[step], q2 = p[2 * step], q3 = p[3 * step];
+
+    if (4 * abs(p0 - q0) + abs(p1 - q1) > t)
+        return 0;
+    return abs(p3 - p2) <= it && abs(p2 - p1) <= it && abs(p1 - p0) <= it &&
+           abs(q3 - q2) <= it && abs(q2 - q1) <= it && abs(q1 - q0) <= it;
+}
+
+/* size pixels across an edge, step apart across it and stride along it */
+static void
+simple_filter (uint8_t *p, int step, int stride, int size, int thresh)
+{
+    const int thresh2 = 2 * thresh + 1;
+    int i;
+
+    for (i = 0; i < size; i++, p += stride) {
+        if (needs_filter(p, step, thresh2))
+            do_filter2(p, step);
+    }
+}
+
+static void
+normal_filter (uint8_t *p, int step, int stride, int size, int thresh,
+               int ithresh, int hev_thresh, int edge)
+{
+    const int thresh2 = 2 * thresh + 1;
+    int i;
+
+    for (i = 0; i < size; i++, p += stride) {
+        if (!needs_filter2(p, step, thresh2, ithresh))
+            continue;
+        if (high_edge_variance(p, step, hev_thresh))
+            do_filter2(p, step);
+        else if (edge)
+            do_filter6(p, step);
+        else
+            do_filter4(p, step);
+    }
+}
+
+static void
+filter_macroblock (const struct vp8_filter *f, int filter_type, int mb_x, int mb_y,
+                   uint8_t *y_plane, int y_stride, uint8_t *u_plane, uint8_t *v_plane,
+                   int uv_stride)
+{
+    uint8_t *y_dst = y_plane + (size_t) mb_y * 16 * y_stride + mb_x * 16;
+    uint8_t *planes[2];
+    int      limit = f->limit, k, c;
+
+    if (limit == 0)
+        return;
+    planes[0] = u_plane + (size_t) mb_y * 8 * uv_stride + mb_x * 8;
+    planes[1] = v_plane + (size_t) mb_y * 8 * uv_stride + mb_x * 8;
+
+    if (filter_type == 1) {
+        if (mb_x > 0)
+            simple_filter(y_dst, 1, y_stride, 16, limit + 4);
+        if (f->inner) {
+            for (k = 4; k < 16; k += 4)
+                simple_filter(y_dst + k, 1, y_stride, 16, limit);
+        }
+        if (mb_y > 0)
+            simple_filter(y_dst, y_stride, 1, 16, limit + 4);
+        if (f->inner) {
+            for (k = 4; k < 16; k += 4)
+                simple_filter(y_dst + k * y_stride, y_stride, 1, 16, limit);
+        }
+        return;
+    }
+
+    if (mb_x > 0) {
+        normal_filter(y_dst, 1, y_stride, 16, limit + 4, f->ilevel, f->hev_thresh, 1);
+        for (c = 0; c < 2; c++)
+            normal_filter(planes[c], 1, uv_stride, 8, limit + 4, f->ilevel, f->hev_thresh, 1);
+    }
+    if (f->inner) {
+        for (k = 4; k < 16; k += 4)
+            normal_filter(y_dst + k, 1, y_stride, 16, limit, f->ilevel, f->hev_thresh, 0);
+        for (c = 0; c < 2; c++)
+            normal_filter(planes[c] + 4, 1, uv_stride, 8, limit, f->ilevel, f->hev_thresh, 0);
+    }
+    if (mb_y > 0) {
+        normal_filter(y_dst, y_stride, 1, 16, limit + 4, f->ilevel, f->hev_thresh, 1);
+        for (c = 0; c < 2; c++)
+            normal_filter(planes[c], uv_stride, 1, 8, limit + 4, f->ilevel, f->hev_thresh, 1);
+    }
+    if (f->inner) {
+        for (k = 4; k < 16; k += 4)
+            normal_filter(y_dst + k * y_stride, y_stride, 1, 16, limit, f->ilevel, f->hev_thresh, 0);
+        for (c = 0; c < 2; c++)
+            normal_filter(planes[c] + 4 * uv_stride, uv_stride, 1, 8, limit, f->ilevel, f->hev_thresh, 0);
+    }
+}
+
+static int
+parse_frame_header (struct vp8_decoder *dec, struct vp8_bool *br)
+{
+    int use_segment, absolute = 0, level, sharpness, simple;
+    int quantizer[4] = { 0, 0, 0, 0 }, strength[4] = { 0, 0, 0, 0 };
+    int ref_delta = 0, mode_delta = 0, use_lf_delta;
+    int base_q, dq_y1_dc, dq_y2_dc, dq_y2_ac, dq_uv_dc, dq_uv_ac;
+    int s, i, t, b, c, p;
+
+    vp8_get_value(br, 1); /* color space */
+    vp8_get_value(br, 1); /* clamping type */
+
+    dec->update_map = 0;
+    memset(dec->segment_probs, 255, sizeof(dec->segment_probs));
+    use_segment = vp8_get_value(br, 1);
+    if (use_segment) {
+        dec->update_map = vp8_get_value(br, 1);
+        if (vp8_get_value(br, 1)) {
+            absolute = vp8_get_value(br, 1);
+            for (s = 0; s < 4; s++)
+                quantizer[s] = vp8_get_delta(br, 7);
+            for (s = 0; s < 4; s++)
+                strength[s] = vp8_get_delta(br, 6);
+        }
+        if (dec->update_map) {
+            for (i = 0; i < 3; i++)
+                dec->segment_probs[i] = vp8_get_bit(br, 128) ? vp8_get_value(br, 8) : 255;
+        }
+    }
+
+    simple    = vp8_get_value(br, 1);
+    level     = vp8_get_value(br, 6);
+    sharpness = vp8_get_value(br, 3);
+    use_lf_delta = vp8_get_value(br, 1);
+    if (use_lf_delta && vp8_get_value(br, 1)) {
+        for (i = 0; i < 4; i++) {
+            int d = vp8_get_delta(br, 6);
+
+            if (i == 0)
+                ref_delta = d;
+        }
+        for (i = 0; i < 4; i++) {
+            int d = vp8_get_delta(br, 6);
+
+            if (i == 0)
+                mode_delta = d;
+        }
+    }
+    dec->filter_type = level == 0 ? 0 : simple ? 1 : 2;
+
+    dec->num_parts = 1 << vp8_get_value(br, 2);
+
+    base_q   = vp8_get_value(br, 7);
+    dq_y1_dc = vp8_get_delta(br, 4);
+    dq_y2_dc = vp8_get_delta(br, 4);
+    dq_y2_ac = vp8_get_delta(br, 4);
+    dq_uv_dc = vp8_get_delta(br, 4);
+    dq_uv_ac = vp8_get_delta(br, 4);
+    for (s = 0; s < 4; s++) {
+        struct vp8_quant *m = &dec->quant[s];
+        int q = base_q;
+
+        if (use_segment)
+            q = quantizer[s] + (absolute ? 0 : base_q);
+#define QCLIP(v, max) ((v) < 0 ? 0 : (v) > (max) ? (max) : (v))
+        m->y1[0] = vp8_dc_table[QCLIP(q + dq_y1_dc, 127)];
+        m->y1[1] = vp8_ac_table[QCLIP(q, 127)];
+        m->y2[0] = vp8_dc_table[QCLIP(q + dq_y2_dc, 127)] * 2;
+        m->y2[1] = (vp8_ac_table[QCLIP(q + dq_y2_ac, 127)] * 101581) >> 16;
+        if (m->y2[1] < 8)
+            m->y2[1] = 8;
+        m->uv[0] = vp8_dc_table[QCLIP(q + dq_uv_dc, 117)];
+        m->uv[1] = vp8_ac_table[QCLIP(q + dq_uv_ac, 127)];
+#undef QCLIP
+    }
+
+    if (dec->filter_type > 0) {
+        for (s = 0; s < 4; s++) {
+            int base = use_segment ? strength[s] + (absolute ? 0 : level) : level;
+
+            for (i = 0; i < 2; i++) {
+                struct vp8_filter *f = &dec->fstrengths[s][i];
+                int lvl = base;
+
+                if (use_lf_delta) {
+                    lvl += ref_delta;
+                    if (i)
+                        lvl += mode_delta;
+                }
+                lvl = lvl < 0 ? 0 : lvl > 63 ? 63 : lvl;
+                f->inner = i;
+                if (lvl > 0) {
+                    int ilevel = lvl;
+
+                    if (sharpness > 0) {
+                        ilevel >>= sharpness > 4 ? 2 : 1;
+                        if (ilevel > 9 - sharpness)
+                            ilevel = 9 - sharpness;
+                    }
+                    if (ilevel < 1)
+                        ilevel = 1;
+                    f->ilevel = ilevel;
+                    f->limit = 2 * lvl + ilevel;
+                    f->hev_thresh = lvl >= 40 ? 2 : lvl >= 15 ? 1 : 0;
+                } else {
+                    f->limit = 0;
+                }
+            }
+        }
+    }
+
+    vp8_get_value(br, 1); /* refresh entropy probs: one frame, no matter */
+    for (t = 0; t < 4; t++) {
+        for (b = 0; b < 8; b++) {
+            for (c = 0; c < 3; c++) {
+                for (p = 0; p < 11; p++) {
+                    dec->probs[t][b][c][p] = vp8_get_bit(br, vp8_coeff_update_probs[t][b][c][p]) ?
+                        vp8_get_value(br, 8) : vp8_coeff_probs[t][b][c][p];
+                }
+            }
+        }
+    }
+    dec->use_skip = vp8_get_value(br, 1);
+    dec->skip_prob = dec->use_skip ? vp8_get_value(br, 8) : 0;
+
+    return 0;
+}
+
+/* Nonzero-coefficient contexts, above (per block column) and left. */
+struct vp8_nz {
+    uint8_t y[4], u[2], v[2], dc;
+};
+
+/* Tokens of a macroblock into coeffs: 16 luma blocks, then 4 of each
+ * chroma. Returns whether any block has coefficients. */
+static int
+parse_residuals (struct vp8_decoder *dec, struct vp8_bool *br, const struct vp8_quant *q,
+                 int is_i4x4, struct vp8_nz *top, struct vp8_nz *left, int16_t *coeffs)
+{
+    int16_t *dst = coeffs;
+    int      first, type, x, y, ch, non_zero = 0;
+
+    if (!is_i4x4) {
+        int16_t dc[16];
+        int     nz;
+
+        memset(dc, 0, sizeof(dc));
+        nz = get_coeffs(br, dec->probs[TYPE_I16_DC], top->dc + left->dc, q->y2, 0, dc);
+        top->dc = left->dc = nz > 0;
+        transform_wht(dc, dst);
+        first = 1;
+        type = TYPE_I16_AC;
+    } else {
+        first = 0;
+        type = TYPE_I4;
+    }
+
+    for (y = 0; y < 4; y++) {
+        for (x = 0; x < 4; x++) {
+            int nz = get_coeffs(br, dec->probs[type], top->y[x] + left->y[y], q->y1, first, dst);
+
+            top->y[x] = left->y[y] = nz > first;
+            non_zero |= nz > 1 || dst[0] != 0;
+            dst += 16;
+        }
+    }
+    for (ch = 0; ch < 2; ch++) {
+        uint8_t *tnz = ch ? top->v : top->u, *lnz = ch ? left->v : left->u;
+
+        for (y = 0; y < 2; y++) {
+            for (x = 0; x < 2; x++) {
+                int nz = get_coeffs(br, dec->probs[TYPE_CHROMA], tnz[x] + lnz[y], q->uv, 0, dst);
+
+                tnz[x] = lnz[y] = nz > 0;
+                non_zero |= nz > 1 || dst[0] != 0;
+                dst += 16;
+            }
+        }
+    }
+
+    return non_zero;
+}
+
+/* Decodes a key frame into planes of whole macroblocks: luma mb_w * 16
+ * wide, chroma mb_w * 8. */
+static int
+vp8_decode (const uint8_t *data, size_t len, unsigned int width, unsigned int height,
+            uint8_t **y_out, uint8_t **u_out, uint8_t **v_out, int *y_stride, int *uv_stride)
+{
+    struct vp8_decoder dec;
+    struct vp8_bool    br, parts[8];
+    struct vp8_nz     *top_nz, left_nz;
+    struct vp8_filter *finfo = NULL;
+    uint8_t           *top_modes, left_modes[4];
+    uint8_t           *y_plane, *u_plane, *v_plane;
+    uint8_t            yw[17 * BPS], uw[9 * BPS], vw[9 * BPS];
+    int16_t            coeffs[384];
+    uint32_t           bits, part0_len;
+    const uint8_t     *part, *end = data + len;
+    int                num_parts, mb_x, mb_y, ys, uvs, i;
+
+    if (len < 10)
+        return -1;
+    bits = get_le24(data);
+    part0_len = bits >> 5;
+    if ((bits & 1) || ((bits >> 1) & 7) > 3 || !((bits >> 4) & 1) || part0_len > len - 10)
+        return -1;
+    vp8_bool_init(&br, data + 10, part0_len);
+
+    memset(&dec, 0, sizeof(dec));
+    parse_frame_header(&dec, &br);
+    num_parts = dec.num_parts;
+    dec.mb_w = (width + 15) >> 4;
+    dec.mb_h = (height + 15) >> 4;
+
+    part = data + 10 + part0_len;
+    if ((size_t) (end - part) < 3 * (size_t) (num_parts - 1))
+        return -1;
+    {
+        const uint8_t *sizes = part, *p = part + 3 * (num_parts - 1);
+
+        for (i = 0; i < num_parts - 1; i++) {
+            size_t size = get_le24(sizes + 3 * i);
+
+            if (size > (size_t) (end - p))
+                size = end - p;
+            vp8_bool_init(&parts[i], p, size);
+            p += size;
+        }
+        vp8_bool_init(&parts[num_parts - 1], p, end - p);
+    }
+
+    ys  = dec.mb_w * 16;
+    uvs = dec.mb_w * 8;
+    y_plane = NEW((size_t) ys * dec.mb_h * 16, uint8_t);
+    u_plane = NEW((size_t) uvs * dec.mb_h * 8, uint8_t);
+    v_plane = NEW((size_t) uvs * dec.mb_h * 8, uint8_t);
+    top_nz = NEW(dec.mb_w, struct vp8_nz);
+    memset(top_nz, 0, dec.mb_w * sizeof(struct vp8_nz));
+    top_modes = NEW(dec.mb_w * 4, uint8_t);
+    memset(top_modes, B_DC_PRED, dec.mb_w * 4);
+    if (dec.filter_type > 0)
+        finfo = NEW((size_t) dec.mb_w * dec.mb_h, struct vp8_filter);
+
+    for (mb_y = 0; mb_y < dec.mb_h; mb_y++) {
+        struct vp8_bool *tokens = &parts[mb_y & (num_parts - 1)];
+
+        memset(&left_nz, 0, sizeof(left_nz));
+        memset(left_modes, B_DC_PRED, sizeof(left_modes));
+        for (mb_x = 0; mb_x < dec.mb_w; mb_x++) {
+            uint8_t *modes = top_modes + 4 * mb_x, imodes[16];
+            uint8_t *ydst = yw + BPS + 1;
+            int      segment = 0, skip, is_i4x4, ymode = 0, uvmode, non_zero = 0, n;
+
+            /* macroblock header, in the first partition */
+            if (dec.update_map) {
+                segment = !vp8_get_bit(&br, dec.segment_probs[0]) ?
+                    vp8_get_bit(&br, dec.segment_probs[1]) :
+                    vp8_get_bit(&br, dec.segment_probs[2]) + 2;
+            }
+            skip = dec.use_skip ? vp8_get_bit(&br, dec.skip_prob) : 0;
+            is_i4x4 = !vp8_get_bit(&br, 145);
+            if (!is_i4x4) {
+                ymode = vp8_get_bit(&br, 156) ?
+                    (vp8_get_bit(&br, 128) ? TM_PRED : H_PRED) :
+                    (vp8_get_bit(&br, 163) ? V_PRED : DC_PRED);
+                memset(modes, ymode, 4);
+                memset(left_modes, ymode, 4);
+            } else {
+                for (n = 0; n < 16; n++) {
+                    const uint8_t *prob = vp8_bmode_probs[modes[n & 3]][left_modes[n >> 2]];
+                    int m;
+
+                    m = !vp8_get_bit(&br, prob[0]) ? B_DC_PRED :
+                        !vp8_get_bit(&br, prob[1]) ? B_TM_PRED :
+                        !vp8_get_bit(&br, prob[2]) ? B_VE_PRED :
+                        !vp8_get_bit(&br, prob[3]) ?
+                            (!vp8_get_bit(&br, prob[4]) ? B_HE_PRED :
+                             !vp8_get_bit(&br, prob[5]) ? B_RD_PRED : B_VR_PRED) :
+                            (!vp8_get_bit(&br, prob[6]) ? B_LD_PRED :
+                             !vp8_get_bit(&br, prob[7]) ? B_VL_PRED :
+                             !vp8_get_bit(&br, prob[8]) ? B_HD_PRED : B_HU_PRED);
+                    imodes[n] = modes[n & 3] = left_modes[n >> 2] = m;
+                }
+            }
+            uvmode = !vp8_get_bit(&br, 142) ? DC_PRED :
+                     !vp8_get_bit(&br, 114) ? V_PRED :
+                     vp8_get_bit(&br, 183) ? TM_PRED : H_PRED;
+
+            /* coefficients, in the token partition of the row */
+            memset(coeffs, 0, sizeof(coeffs));
+            if (!skip) {
+                non_zero = parse_residuals(&dec, tokens, &dec.quant[segment], is_i4x4,
+                                           &top_nz[mb_x], &left_nz, coeffs);
+            } else {
+                memset(top_nz[mb_x].y, 0, 4);
+                memset(top_nz[mb_x].u, 0, 2);
+                memset(top_nz[mb_x].v, 0, 2);
+                memset(left_nz.y, 0, 4);
+                memset(left_nz.u, 0, 2);
+                memset(left_nz.v, 0, 2);
+                if (!is_i4x4)
+                    top_nz[mb_x].dc = left_nz.dc = 0;
+            }
+            if (finfo) {
+                finfo[mb_y * dec.mb_w + mb_x] = dec.fstrengths[segment][is_i4x4];
+                finfo[mb_y * dec.mb_w + mb_x].inner |= non_zero;
+            }
+
+            /* prediction and reconstruction */
+            load_edges(yw, y_plane, ys, 16, mb_x, mb_y);
+            load_edges(uw, u_plane, uvs, 8, mb_x, mb_y);
+            load_edges(vw, v_plane, uvs, 8, mb_x, mb_y);
+            if (is_i4x4) {
+                uint8_t *top_right = ydst - BPS + 16;
+
+                /* above right of the macroblock, for the rightmost column
+                 * of 4x4 blocks in every row */
+                if (mb_y == 0)
+                    memset(top_right, 127, 4);
+                else if (mb_x == dec.mb_w - 1)
+                    memset(top_right, y_plane[(size_t) (mb_y * 16 - 1) * ys + mb_x * 16 + 15], 4);
+                else
+                    memcpy(top_right, y_plane + (size_t) (mb_y * 16 - 1) * ys + mb_x * 16 + 16, 4);
+                for (i = 1; i < 4; i++)
+                    memcpy(top_right + 4 * i * BPS, top_right, 4);
+                for (n = 0; n < 16; n++) {
+                    uint8_t *dst = ydst + (n & 3) * 4 + (n >> 2) * 4 * BPS;
+
+                    predict_4x4(dst, imodes[n]);
+                    transform_add(coeffs + 16 * n, dst);
+                }
+            } else {
+                predict_block(ydst, 16, ymode, mb_x, mb_y);
+                for (n = 0; n < 16; n++)
+                    transform_add(coeffs + 16 * n, ydst + (n & 3) * 4 + (n >> 2) * 4 * BPS);
+            }
+            predict_block(uw + BPS + 1, 8, uvmode, mb_x, mb_y);
+            predict_block(vw + BPS + 1, 8, uvmode, mb_x, mb_y);
+            for (n = 0; n < 4; n++) {
+                int offset = BPS + 1 + (n & 1) * 4 + (n >> 1) * 4 * BPS;
+
+                transform_add(coeffs + 256 + 16 * n, uw + offset);
+                transform_add(coeffs + 320 + 16 * n, vw + offset);
+            }
+            store_block(yw, y_plane, ys, 16, mb_x, mb_y);
+            store_block(uw, u_plane, uvs, 8, mb_x, mb_y);
+            store_block(vw, v_plane, uvs, 8, mb_x, mb_y);
+        }
+    }
+
+    /* Prediction reads unfiltered pixels, so the loop filter can as well
+     * run over the whole frame afterwards, in the same order. */
+    if (finfo) {
+        for (mb_y = 0; mb_y < dec.mb_h; mb_y++) {
+            for (mb_x = 0; mb_x < dec.mb_w; mb_x++) {
+                filter_macroblock(&finfo[mb_y * dec.mb_w + mb_x], dec.filter_type, mb_x, mb_y,
+                                  y_plane, ys, u_plane, v_plane, uvs);
+            }
+        }
+        free(finfo);
+    }
+    free(top_nz);
+    free(top_modes);
+
+    *y_out = y_plane;
+    *u_out = u_plane;
+    *v_out = v_plane;
+    *y_stride = ys;
+    *uv_stride = uvs;
+
+    return 0;
+}
+
+static int
+yuv_clip8 (int v)
+{
+    return (v & ~16383) == 0 ? v >> 6 : v < 0 ? 0 : 255;
+}
+
+/* Fixed-point BT.601, studio range, as libwebp converts */
+static uint32_t
+yuv_to_argb (int y, int u, int v)
+{
+    int luma = (y * 19077) >> 8;
+    int r = yuv_clip8(luma + ((v * 26149) >> 8) - 14234);
+    int g = yuv_clip8(luma - ((u * 6419) >> 8) - ((v * 13320) >> 8) + 8708);
+    int b = yuv_clip8(luma + ((u * 33050) >> 8) - 17685);
+
+    return 0xff000000u | ((uint32_t) r << 16) | ((uint32_t) g << 8) | b;
+}
+
+/* Chroma is upsampled bilinearly, each sample weighing 9:3:3:1 over the
+ * four pixels around it (the "fancy" upsampling of libwebp). */
+static uint32_t *
+vp8_to_argb (const uint8_t *y_plane, const uint8_t *u_plane, const uint8_t *v_plane,
+             int ys, int uvs, unsigned int width, unsigned int height)
+{
+    uint32_t *argb = NEW((size_t) width * height, uint32_t);
+    int       cw = (width + 1) / 2, ch = (height + 1) / 2;
+    unsigned int x, y;
+
+    for (y = 0; y < height; y++) {
+        int cy = y >> 1;
+        int fy = (y & 1) ? cy + 1 : cy - 1;
+
+        if (fy < 0)
+            fy = 0;
+        if (fy >= ch)
+            fy = ch - 1;
+        for (x = 0; x < width; x++) {
+            int cx = x >> 1;
+            int fx = (x & 1) ? cx + 1 : cx - 1;
+            int u, v;
+
+            if (fx < 0)
+                fx = 0;
+            if (fx >= cw)
+                fx = cw - 1;
+            u = (9 * u_plane[cy * uvs + cx] + 3 * u_plane[cy * uvs + fx] +
+                 3 * u_plane[fy * uvs + cx] + u_plane[fy * uvs + fx] + 8) >> 4;
+            v = (9 * v_plane[cy * uvs + cx] + 3 * v_plane[cy * uvs + fx] +
+                 3 * v_plane[fy * uvs + cx] + v_plane[fy * uvs + fx] + 8) >> 4;
+            argb[(size_t) y * width + x] = yuv_to_argb(y_plane[(size_t) y * ys + x], u, v);
+        }
+    }
+
+    return argb;
+}
+
+/* Alpha plane of an ALPH chunk into the pixels of a lossy image */
+static int
+decode_alpha (const uint8_t *data, size_t len, unsigned int width, unsigned int height,
+              uint32_t *argb)
+{
+    uint8_t *alpha;
+    int      method, filter;
+    size_t   i, total = (size_t) width * height;
+    unsigned int x, y;
+
+    if (len < 1)
+        return -1;
+    method = data[0] & 3;
+    filter = (data[0] >> 2) & 3;
+    if (method > 1 || ((data[0] >> 4) & 3) > 1 || (data[0] >> 6) != 0)
+        return -1;
+
+    alpha = NEW(total, uint8_t);
+    if (method == 0) {
+        if (len - 1 < total) {
+            free(alpha);
+            return -1;
+        }
+        memcpy(alpha, data + 1, total);
+    } else {
+        uint32_t *plane = vp8l_decode(data + 1, len - 1, width, height);
+
+        if (!plane) {
+            free(alpha);
+            return -1;
+        }
+        for (i = 0; i < total; i++)
+            alpha[i] = (plane[i] >> 8) & 0xff;
+        free(plane);
+    }
+
+    /* 1: from the left, 2: from above, 3: gradient. The first row is
+     * always predicted from the left, the first column from above. */
+    if (filter) {
+        for (y = 0; y < height; y++) {
+            uint8_t *row = alpha + (size_t) y * width;
+            const uint8_t *prev = y > 0 ? row - width : NULL;
+
+            for (x = 0; x < width; x++) {
+                int pred;
+
+                if (!prev)
+                    pred = x > 0 ? row[x - 1] : 0;
+                else if (x == 0 || filter == 2)
+                    pred = prev[x];
+                else if (filter == 1)
+                    pred = row[x - 1];
+                else
+                    pred = clip255(row[x - 1] + prev[x] - prev[x - 1]);
+                row[x] = (uint8_t) (row[x] + pred);
+            }
+        }
+    }
+
+    for (i = 0; i < total; i++)
+        argb[i] = (argb[i] & 0x00ffffffu) | ((uint32_t) alpha[i] << 24);
+    free(alpha);
+
+    return 0;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static uint32_t *
+webp_decode (const struct webp_info *info)
+{
+    uint8_t  *y_plane, *u_plane, *v_plane;
+    uint32_t *argb;
+    int       ys, uvs;
+
+    if (info->lossless) {
+        if (info->bits_len < 5)
+            return NULL;
+        return vp8l_decode(info->bits + 5, info->bits_len - 5, info->width, info->height);
+    }
+
+    if (vp8_decode(info->bits, info->bits_len, info->width, info->height,
+                   &y_plane, &u_plane, &v_plane, &ys, &uvs) < 0)
+        return NULL;
+    argb = vp8_to_argb(y_plane, u_plane, v_plane, ys, uvs, info->width, info->height);
+    free(y_plane);
+    free(u_plane);
+    free(v_plane);
+    /* A broken alpha plane leaves the image opaque, as in libwebp's
+     * incremental decoding; a warning says so. */
+    if (info->alpha && decode_alpha(info->alpha, info->alpha_len, info->width,
+                                    info->height, argb) < 0)
+        dpx_warning("%s: Invalid alpha channel, image included opaque.", WEBP_DEBUG_STR);
+
+    return argb;
+}
+
+int
+webp_include_image (pdf_ximage *ximage, rust_input_handle_t handle)
+{
+    pdf_obj         *stream, *stream_dict;
+    ximage_info      info;
+    struct webp_info webp;
+    uint8_t         *data, *row;
+    uint32_t        *argb;
+    size_t           size, got = 0, i;
+    int              gray = 1, opaque = 1, ncomp, x, y;
+
+    pdf_ximage_init_image_info(&info);
+
+    size = ttbc_input_get_size(handle);
+    data = NEW(size > 0 ? size : 1, uint8_t);
+    ttstub_input_seek(handle, 0, SEEK_SET);
+    while (got < size) {
+        ssize_t n = ttbc_input_read(handle, (char *) data + got, size - got);
+
+        if (n <= 0)
+            break;
+        got += n;
+    }
+    if (got < size || parse_chunks(data, size, &webp) < 0) {
+        dpx_warning("%s: Invalid or unsupported file.", WEBP_DEBUG_STR);
+        free(data);
+        return -1;
+    }
+    argb = webp_decode(&webp);
+    free(data);
+    if (!argb) {
+        dpx_warning("%s: Decoding %s image data failed.", WEBP_DEBUG_STR,
+                    webp.lossless ? "lossless" : "lossy");
+        return -1;
+    }
+
+    for (i = 0; i < (size_t) webp.width * webp.height; i++) {
+        uint32_t p = argb[i];
+
+        if (((p >> 16) & 0xff) != (p & 0xff) || ((p >> 8) & 0xff) != (p & 0xff))
+            gray = 0;
+        if ((p >> 24) != 0xff)
+            opaque = 0;
+    }
+
+    info.width  = webp.width;
+    info.height = webp.height;
+    info.bits_per_component = 8;
+    info.num_components = ncomp = gray ? 1 : 3;
+    info.xdensity = info.ydensity = 1.0;
+
+    stream      = pdf_new_stream(STREAM_COMPRESS);
+    stream_dict = pdf_stream_dict(stream);
+    pdf_add_dict(stream_dict, pdf_new_name("ColorSpace"),
+                 pdf_new_name(gray ? "DeviceGray" : "DeviceRGB"));
+    row = NEW(info.width * ncomp, uint8_t);
+    for (y = 0; y < info.height; y++) {
+        const uint32_t *src = argb + (size_t) y * info.width;
+
+        for (x = 0; x < info.width; x++) {
+            if (gray) {
+                row[x] = src[x] & 0xff;
+            } else {
+                row[3 * x    ] = (src[x] >> 16) & 0xff;
+                row[3 * x + 1] = (src[x] >> 8) & 0xff;
+                row[3 * x + 2] = src[x] & 0xff;
+            }
+        }
+        pdf_add_stream(stream, row, info.width * ncomp);
+    }
+    if (info.height > 64)
+        pdf_stream_set_predictor(stream, 15, info.width, 8, ncomp);
+
+    if (!opaque) {
+        pdf_obj *mask = pdf_new_stream(STREAM_COMPRESS);
+        pdf_obj *dict = pdf_stream_dict(mask);
+
+        pdf_add_dict(dict, pdf_new_name("Type"),    pdf_new_name("XObject"));
+        pdf_add_dict(dict, pdf_new_name("Subtype"), pdf_new_name("Image"));
+        pdf_add_dict(dict, pdf_new_name("Width"),      pdf_new_number(info.width));
+        pdf_add_dict(dict, pdf_new_name("Height"),     pdf_new_number(info.height));
+        pdf_add_dict(dict, pdf_new_name("ColorSpace"), pdf_new_name("DeviceGray"));
+        pdf_add_dict(dict, pdf_new_name("BitsPerComponent"), pdf_new_number(8));
+        for (y = 0; y < info.height; y++) {
+            const uint32_t *src = argb + (size_t) y * info.width;
+
+            for (x = 0; x < info.width; x++)
+                row[x] = src[x] >> 24;
+            pdf_add_stream(mask, row, info.width);
+        }
+        if (info.width > 64)
+            pdf_stream_set_predictor(mask, 2, info.width, 8, 1);
+        /* shared, so that copies of the image can be too */
+        pdf_add_dict(stream_dict, pdf_new_name("SMask"), pdf_ref_shared_stream(mask));
+        pdf_release_obj(mask);
+    }
+    free(row);
+    free(argb);
+
+    pdf_ximage_set_image(ximage, &info, stream);
+
+    return 0;
+}
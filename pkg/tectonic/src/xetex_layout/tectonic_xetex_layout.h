@@ -52,6 +52,13 @@ typedef struct {
   float y;
 } FloatPoint;
 
+typedef struct {
+  int32_t offset;
+  int32_t count;
+  bool rtl;
+  int32_t n_glyphs;
+} LayoutRun;
+
 typedef uint32_t OTTag;
 
 #if !defined(XETEX_MAC)
@@ -144,6 +151,9 @@ bool isOpenTypeMathFont(XeTeXLayoutEngine engine);
 
 hb_font_t *ttxl_get_hb_font(XeTeXLayoutEngine engine);
 
+/* digest of the font file's contents, the same for every size; 0 if unknown */
+uint64_t ttxl_get_font_digest(XeTeXLayoutEngine engine);
+
 int layoutChars(XeTeXLayoutEngine engine,
                 uint16_t *chars,
                 int32_t offset,
@@ -151,6 +161,15 @@ int layoutChars(XeTeXLayoutEngine engine,
                 int32_t max,
                 bool rtl);
 
+int layoutRuns(XeTeXLayoutEngine engine,
+               uint16_t *chars,
+               int32_t max,
+               LayoutRun *runs,
+               int n_runs,
+               const uint32_t **glyphs,
+               const float **advances,
+               const FloatPoint **positions);
+
 const char *getFontFilename(XeTeXLayoutEngine engine, uint32_t *index);
 
 void freeFontFilename(const char *filename);
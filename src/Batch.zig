@@ -0,0 +1,168 @@
+// Batch.zig -- `eztex compile a.tex b.tex ...` on a pool of worker processes.
+//
+// The parent loads the bundle index, cache manifest and format once (see
+// Compiler.warm_up) and then forks the workers, which inherit all of it
+// copy-on-write. Each worker takes the next input off a counter in shared
+// memory until none are left, so a document costs its TeX passes instead of
+// a process start-up.
+//
+// Workers are processes rather than threads because every job runs in its
+// input's directory (outputs land beside the document and same-named
+// documents do not collide), and the working directory is per process.
+//
+// run_indexed is the pool itself, for any set of jobs that leave their
+// results in files (the compiler runs a document's bibtex jobs on it).
+//
+// Native POSIX only; elsewhere the inputs compile one after another.
+
+const std = @import("std");
+const builtin = @import("builtin");
+const posix = std.posix;
+const c = std.c;
+const Io = std.Io;
+const Log = @import("Log.zig");
+
+const can_fork = builtin.os.tag != .windows and builtin.os.tag != .wasi and builtin.cpu.arch != .wasm32;
+
+// per-batch state shared by the parent and all workers
+const Shared = struct {
+    next: u32,
+    // 0 = not run, else the job's exit code + 1
+    results: [max_inputs]u8,
+};
+
+pub const max_inputs = 4096;
+
+pub const Summary = struct {
+    succeeded: usize = 0,
+    failed: usize = 0,
+};
+
+// default pool size: one worker per CPU, no more than there are inputs
+pub fn default_jobs(inputs: usize) usize {
+    const cpus = std.Thread.getCpuCount() catch 1;
+    return @max(1, @min(cpus, inputs));
+}
+
+// compile every input with ctx.run_job(io, input) -> u8 (exit code), in the
+// input's directory, on up to `jobs` workers.
+pub fn run(io: Io, inputs: []const []const u8, jobs: usize, ctx: anytype) Summary {
+    var home_buf: [4096]u8 = undefined;
+    const home: ?[*:0]const u8 = if (can_fork) @ptrCast(c.getcwd(&home_buf, home_buf.len)) else null;
+
+    const codes = std.heap.c_allocator.alloc(?u8, inputs.len) catch return .{ .failed = inputs.len };
+    defer std.heap.c_allocator.free(codes);
+    const in_place = InPlace(@TypeOf(ctx)){ .inputs = inputs, .home = home, .ctx = ctx };
+    // without a directory to come back to, jobs cannot each go to their own
+    run_indexed(io, inputs.len, if (home == null) 1 else jobs, &in_place, codes);
+
+    var summary: Summary = .{};
+    for (inputs, codes) |input, code| {
+        const ok = if (code) |exit_code| exit_code == 0 else blk: {
+            // the worker died mid-job (crash or signal)
+            Log.log(io, "eztex", .err, "'{s}' did not finish", .{input});
+            break :blk false;
+        };
+        if (ok) summary.succeeded += 1 else summary.failed += 1;
+    }
+    return summary;
+}
+
+fn InPlace(comptime Ctx: type) type {
+    return struct {
+        inputs: []const []const u8,
+        home: ?[*:0]const u8,
+        ctx: Ctx,
+
+        pub fn run_one(self: *const @This(), io: Io, i: usize) u8 {
+            const input = self.inputs[i];
+            return if (self.home) |h| run_in_place(io, input, h, self.ctx) else self.ctx.run_job(io, input);
+        }
+    };
+}
+
+// run ctx.run_one(io, i) -> u8 (exit code) for every i below count, on up to
+// `jobs` forked workers, and leave each exit code in codes[i], or null when
+// its worker died mid-job. Jobs run in the caller's working directory and
+// see its state as it was at the call; whatever they change in memory is
+// lost, so they must leave their results in files. Where processes cannot
+// be forked, or a single worker would do, the jobs run in this process.
+pub fn run_indexed(io: Io, count: usize, jobs: usize, ctx: anytype, codes: []?u8) void {
+    std.debug.assert(codes.len >= count);
+    if (comptime !can_fork) return run_serial(io, count, ctx, codes);
+    if (jobs <= 1 or count <= 1 or count > max_inputs) return run_serial(io, count, ctx, codes);
+
+    const mem = posix.mmap(
+        null,
+        @sizeOf(Shared),
+        posix.PROT.READ | posix.PROT.WRITE,
+        .{ .TYPE = .SHARED, .ANONYMOUS = true },
+        -1,
+        0,
+    ) catch return run_serial(io, count, ctx, codes);
+    defer posix.munmap(mem);
+    const shared: *Shared = @ptrCast(mem.ptr);
+    shared.next = 0;
+    @memset(shared.results[0..count], 0);
+
+    var pids: [256]c.pid_t = undefined;
+    var started: usize = 0;
+    while (started < @min(jobs, count, pids.len)) : (started += 1) {
+        const pid = c.fork();
+        if (pid < 0) break;
+        if (pid == 0) {
+            worker(io, count, shared, ctx);
+            c._exit(0);
+        }
+        pids[started] = pid;
+    }
+    if (started == 0) return run_serial(io, count, ctx, codes);
+    Log.dbg(io, "eztex", "batch: {d} jobs on {d} workers", .{ count, started });
+
+    for (pids[0..started]) |pid| {
+        var status: c_int = 0;
+        while (true) {
+            const rc = c.waitpid(pid, &status, 0);
+            if (rc >= 0 or posix.errno(rc) != .INTR) break;
+        }
+    }
+
+    for (codes[0..count], shared.results[0..count]) |*code, result| {
+        code.* = if (result == 0) null else result - 1;
+    }
+}
+
+fn worker(io: Io, count: usize, shared: *Shared, ctx: anytype) void {
+    while (true) {
+        const i = @atomicRmw(u32, &shared.next, .Add, 1, .monotonic);
+        if (i >= count) return;
+        const code = ctx.run_one(io, i);
+        @atomicStore(u8, &shared.results[i], @min(code, 254) + 1, .release);
+    }
+}
+
+fn run_serial(io: Io, count: usize, ctx: anytype, codes: []?u8) void {
+    for (codes[0..count], 0..) |*code, i| code.* = ctx.run_one(io, i);
+}
+
+// run one job from inside the input's directory, passing the input relative
+// to it: "docs/a.tex" runs as "a.tex" in docs/, a project directory as "."
+fn run_in_place(io: Io, input: []const u8, home: [*:0]const u8, ctx: anytype) u8 {
+    defer _ = c.chdir(home);
+
+    const is_dir = blk: {
+        var dir = Io.Dir.cwd().openDir(io, input, .{}) catch break :blk false;
+        dir.close(io);
+        break :blk true;
+    };
+    const dir = if (is_dir) input else std.fs.path.dirname(input) orelse return ctx.run_job(io, input);
+    const rel = if (is_dir) "." else std.fs.path.basename(input);
+
+    var dir_buf: [4096]u8 = undefined;
+    const dir_z = std.fmt.bufPrintZ(&dir_buf, "{s}", .{dir}) catch return ctx.run_job(io, input);
+    if (c.chdir(dir_z.ptr) != 0) {
+        Log.log(io, "eztex", .err, "cannot enter directory '{s}'", .{dir});
+        return 1;
+    }
+    return ctx.run_job(io, rel);
+}
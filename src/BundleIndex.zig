@@ -0,0 +1,226 @@
+// BundleIndex.zig -- compiled bundle index, searched in place.
+//
+// The ITAR index text ("name offset length" per line) is compiled once into a
+// single blob that can be cached as-is and queried without building a hash map
+// or allocating per entry:
+//
+//   header   "EZIX" | version u32 | count u32 | names_len u32
+//   entries  count x { offset u64 | length u32 | raw_length u32 | name_off u32 | name_len u32 }
+//   names    lowercased names (entries point into this region)
+//
+// A compressed bundle adds a fourth column, the entry's size once inflated:
+// its `length` bytes are then a gzip member (see BundleStore.resolve_file).
+//
+// Entries are sorted by name so lookups are a binary search. All integers are
+// little-endian and read unaligned, so the blob can live anywhere: an mmap, a
+// heap buffer, or WASM linear memory handed over from JS.
+//
+// Self-contained (std only) so wasm_exports.zig can use it too.
+
+const std = @import("std");
+
+const BundleIndex = @This();
+
+pub const Entry = struct {
+    offset: u64,
+    length: u32,
+    // inflated size of a gzip-compressed entry; 0 when stored as is
+    raw_length: u32 = 0,
+};
+
+const magic = "EZIX";
+const version: u32 = 2;
+const header_len = 16;
+const entry_len = 24;
+
+bytes: []const u8,
+count: usize,
+
+pub const empty: BundleIndex = .{ .bytes = &.{}, .count = 0 };
+
+pub fn is_compiled(bytes: []const u8) bool {
+    return bytes.len >= header_len and std.mem.eql(u8, bytes[0..4], magic);
+}
+
+// view a compiled blob. the blob must outlive the returned index.
+pub fn open(bytes: []const u8) !BundleIndex {
+    if (!is_compiled(bytes)) return error.InvalidIndex;
+    if (read_u32(bytes, 4) != version) return error.InvalidIndex;
+    const n: usize = read_u32(bytes, 8);
+    const names_len: usize = read_u32(bytes, 12);
+    if (bytes.len != header_len + n * entry_len + names_len) return error.InvalidIndex;
+    return .{ .bytes = bytes, .count = n };
+}
+
+// look up a lowercased name.
+pub fn get(self: BundleIndex, lower_name: []const u8) ?Entry {
+    var lo: usize = 0;
+    var hi: usize = self.count;
+    while (lo < hi) {
+        const mid = lo + (hi - lo) / 2;
+        switch (std.mem.order(u8, self.name_at(mid), lower_name)) {
+            .lt => lo = mid + 1,
+            .gt => hi = mid,
+            .eq => {
+                const rec = header_len + mid * entry_len;
+                return .{
+                    .offset = read_u64(self.bytes, rec),
+                    .length = read_u32(self.bytes, rec + 8),
+                    .raw_length = read_u32(self.bytes, rec + 12),
+                };
+            },
+        }
+    }
+    return null;
+}
+
+pub fn contains(self: BundleIndex, lower_name: []const u8) bool {
+    return self.get(lower_name) != null;
+}
+
+fn name_at(self: BundleIndex, i: usize) []const u8 {
+    const rec = header_len + i * entry_len;
+    const names_start = header_len + self.count * entry_len;
+    const off: usize = read_u32(self.bytes, rec + 16);
+    const len: usize = read_u32(self.bytes, rec + 20);
+    const start = @min(names_start + off, self.bytes.len);
+    return self.bytes[start..@min(start + len, self.bytes.len)];
+}
+
+// -- compile --
+
+const Pending = struct {
+    name_off: u32,
+    name_len: u32,
+    entry: Entry,
+};
+
+fn pending_less(names: []const u8, a: Pending, b: Pending) bool {
+    return std.mem.lessThan(u8, names[a.name_off..][0..a.name_len], names[b.name_off..][0..b.name_len]);
+}
+
+// compile ITAR index text. names are lowercased for case-insensitive lookup
+// (TeX requests lowercase but the bundle stores names like "T1PTSerif-TLF.fd");
+// on duplicates the first entry wins. caller owns the returned blob.
+pub fn compile(allocator: std.mem.Allocator, text: []const u8) ![]u8 {
+    var names: std.ArrayList(u8) = .empty;
+    defer names.deinit(allocator);
+    var pending: std.ArrayList(Pending) = .empty;
+    defer pending.deinit(allocator);
+
+    var line_iter = std.mem.splitScalar(u8, text, '\n');
+    while (line_iter.next()) |line| {
+        const trimmed = std.mem.trim(u8, line, " \t\r");
+        if (trimmed.len == 0) continue;
+
+        var parts = std.mem.splitScalar(u8, trimmed, ' ');
+        const name = parts.next() orelse continue;
+        const offset_str = parts.next() orelse continue;
+        const length_str = parts.next() orelse continue;
+        if (name.len == 0) continue;
+        if (std.mem.eql(u8, name, "SVNREV") or std.mem.eql(u8, name, "GITHASH")) continue;
+
+        const offset = std.fmt.parseInt(u64, offset_str, 10) catch continue;
+        const length = std.fmt.parseInt(u32, length_str, 10) catch continue;
+        const raw_length = if (parts.next()) |raw_str| std.fmt.parseInt(u32, raw_str, 10) catch continue else 0;
+
+        const name_off = names.items.len;
+        try names.appendSlice(allocator, name);
+        for (names.items[name_off..]) |*c| c.* = std.ascii.toLower(c.*);
+        try pending.append(allocator, .{
+            .name_off = @intCast(name_off),
+            .name_len = @intCast(name.len),
+            .entry = .{ .offset = offset, .length = length, .raw_length = raw_length },
+        });
+    }
+
+    // stable, so the first of several duplicates stays in front
+    std.mem.sort(Pending, pending.items, names.items, pending_less);
+
+    var unique: usize = 0;
+    for (pending.items) |p| {
+        if (unique > 0) {
+            const prev = pending.items[unique - 1];
+            if (std.mem.eql(u8, names.items[prev.name_off..][0..prev.name_len], names.items[p.name_off..][0..p.name_len])) continue;
+        }
+        pending.items[unique] = p;
+        unique += 1;
+    }
+
+    const out = try allocator.alloc(u8, header_len + unique * entry_len + names.items.len);
+    @memcpy(out[0..4], magic);
+    write_u32(out, 4, version);
+    write_u32(out, 8, @intCast(unique));
+    write_u32(out, 12, @intCast(names.items.len));
+    for (pending.items[0..unique], 0..) |p, i| {
+        const rec = header_len + i * entry_len;
+        std.mem.writeInt(u64, out[rec..][0..8], p.entry.offset, .little);
+        write_u32(out, rec + 8, p.entry.length);
+        write_u32(out, rec + 12, p.entry.raw_length);
+        write_u32(out, rec + 16, p.name_off);
+        write_u32(out, rec + 20, p.name_len);
+    }
+    @memcpy(out[header_len + unique * entry_len ..], names.items);
+    return out;
+}
+
+fn read_u32(bytes: []const u8, at: usize) u32 {
+    return std.mem.readInt(u32, bytes[at..][0..4], .little);
+}
+
+fn read_u64(bytes: []const u8, at: usize) u64 {
+    return std.mem.readInt(u64, bytes[at..][0..8], .little);
+}
+
+fn write_u32(bytes: []u8, at: usize, value: u32) void {
+    std.mem.writeInt(u32, bytes[at..][0..4], value, .little);
+}
+
+// -- tests --
+
+test "compile and look up entries case-insensitively" {
+    const text =
+        \\SVNREV 12345
+        \\T1PTSerif-TLF.fd 1000 200
+        \\article.cls 0 500
+        \\article.cls 9 9
+        \\broken-line 12
+        \\
+        \\zapf.tfm 4294967296 7
+    ;
+    const blob = try compile(std.testing.allocator, text);
+    defer std.testing.allocator.free(blob);
+
+    const index = try open(blob);
+    try std.testing.expectEqual(@as(usize, 3), index.count);
+    try std.testing.expectEqual(Entry{ .offset = 1000, .length = 200 }, index.get("t1ptserif-tlf.fd").?);
+    try std.testing.expectEqual(Entry{ .offset = 0, .length = 500 }, index.get("article.cls").?);
+    try std.testing.expectEqual(Entry{ .offset = 4294967296, .length = 7 }, index.get("zapf.tfm").?);
+    try std.testing.expect(index.get("T1PTSerif-TLF.fd") == null);
+    try std.testing.expect(!index.contains("svnrev"));
+    try std.testing.expect(!index.contains("missing.sty"));
+}
+
+test "compressed entries keep their inflated length" {
+    const text =
+        \\pgf.tex 2000 300 1200
+        \\plain.tex 0 900
+        \\bad.sty 1 2 x
+    ;
+    const blob = try compile(std.testing.allocator, text);
+    defer std.testing.allocator.free(blob);
+
+    const index = try open(blob);
+    try std.testing.expectEqual(Entry{ .offset = 2000, .length = 300, .raw_length = 1200 }, index.get("pgf.tex").?);
+    try std.testing.expectEqual(@as(u32, 0), index.get("plain.tex").?.raw_length);
+    try std.testing.expect(!index.contains("bad.sty"));
+}
+
+test "open rejects truncated or foreign blobs" {
+    const blob = try compile(std.testing.allocator, "a.sty 1 2\n");
+    defer std.testing.allocator.free(blob);
+
+    try std.testing.expectError(error.InvalidIndex, open(blob[0 .. blob.len - 1]));
+    try std.testing.expectError(error.InvalidIndex, open("a.sty 1 2\n"));
+    try std.testing.expect(!is_compiled("a.sty 1 2\n"));
+}
@@ -2,54 +2,95 @@
 //
 // Platform-agnostic: all platform divergences are behind Host.zig.
 // Flow: open_file(name) -> cache hit -> ensure index -> fetch -> cache -> return
+// A bundle on disk (a file:// URL, see Config.local_path) skips the cache:
+// open_file(name) -> ensure index -> slice of the mapped bundle
 
 const std = @import("std");
+const builtin = @import("builtin");
 const fs = std.fs;
 const Io = std.Io;
 const Host = @import("Host.zig");
+const Config = @import("Config.zig");
+const BundleIndex = @import("BundleIndex.zig");
+const Flate = @import("Flate.zig");
+const Preamble = @import("Preamble.zig");
+const Timeline = @import("Timeline.zig");
 
 const Log = @import("Log.zig");
 
 const BundleStore = @This();
 
 const is_wasm = Host.is_wasm;
+// local bundles are mapped, which needs mmap
+const local_supported = !is_wasm and builtin.os.tag != .windows;
 
 pub const IndexEntry = Host.IndexEntry;
+pub const OpenedFile = Host.CachedFile;
 
 allocator: std.mem.Allocator,
-bundle_index: std.StringHashMap(IndexEntry),
+// view over index_blob (see BundleIndex.zig)
+bundle_index: BundleIndex,
+index_blob: ?[]u8,
 bundle_index_loaded: bool,
 url: []const u8,
 digest: [64]u8,
+// bundle files opened while tracing, in first-open order (see begin_trace)
+trace_key: ?u64,
+trace: std.ArrayList([]const u8),
+traced: std.StringHashMapUnmanaged(void),
+trace_grew: bool,
 
 pub fn init(allocator: std.mem.Allocator, url: []const u8, digest: *const [64]u8) BundleStore {
     const bs: BundleStore = .{
         .allocator = allocator,
-        .bundle_index = std.StringHashMap(IndexEntry).init(allocator),
+        .bundle_index = .empty,
+        .index_blob = null,
         .bundle_index_loaded = false,
         .url = url,
         .digest = digest.*,
+        .trace_key = null,
+        .trace = .empty,
+        .traced = .empty,
+        .trace_grew = false,
     };
     return bs;
 }
 
 pub fn deinit(self: *BundleStore) void {
+    self.finish_compile();
+    self.drop_index();
+}
+
+// persist what this compile learned but keep the index loaded, for a
+// resident process that compiles again with the same bundle.
+pub fn finish_compile(self: *BundleStore) void {
+    self.end_trace();
     Host.cache_save();
+}
 
-    var it = self.bundle_index.iterator();
-    while (it.next()) |entry| {
-        self.allocator.free(entry.key_ptr.*);
-    }
-    self.bundle_index.deinit();
+// whether this store already serves the given bundle with its index loaded
+pub fn serves(self: *const BundleStore, url: []const u8, digest: *const [64]u8) bool {
+    return self.bundle_index_loaded and std.mem.eql(u8, &self.digest, digest) and std.mem.eql(u8, self.url, url);
+}
+
+// resolve a file and note it in the trace
+pub fn open_file(self: *BundleStore, io: Io, name: []const u8) !OpenedFile {
+    const started = Timeline.now();
+    defer Timeline.span(.bundle, "open_file", name, started);
+    const opened = try self.resolve_file(io, name);
+    self.note_opened(name);
+    return opened;
 }
 
 // resolve a file: cache -> index lookup -> fetch -> write -> return
-pub fn open_file(self: *BundleStore, io: Io, name: []const u8) !Io.File {
+fn resolve_file(self: *BundleStore, io: Io, name: []const u8) !OpenedFile {
     Log.dbg(io, "bundle", "open_file: \"{s}\"", .{name});
+    if (local_supported and self.is_local()) return self.resolve_local(io, name);
+
     // 1. check persistent cache (Host abstracts disk vs OPFS)
-    if (Host.cache_open(name)) |file| {
+    if (Host.cache_open(name)) |hit| {
         Log.dbg(io, "bundle", "open_file: cache hit for \"{s}\"", .{name});
-        return file;
+        return hit;
     }
 
     // 2. bundle_index lookup
@@ -60,39 +101,101 @@ pub fn open_file(self: *BundleStore, io: Io, name: []const u8) !Io.File {
     };
     Log.dbg(io, "bundle", "open_file: index entry \"{s}\" offset={d} len={d}", .{ name, entry.offset, entry.length });
 
-    // 3. fetch via Host (abstracts HTTP Range vs sync XHR)
+    // 3. another process sharing the cache may be fetching it already
+    const owned = Host.cache_claim(name);
+    defer if (owned) Host.cache_release(name);
+    if (!owned) {
+        if (Host.cache_open(name)) |hit| {
+            Log.dbg(io, "bundle", "open_file: fetched by another process \"{s}\"", .{name});
+            return hit;
+        }
+    }
+
+    // 4. fetch via Host (abstracts HTTP Range vs sync XHR)
     Log.dbg(io, "bundle", "fetching: {s}", .{name});
-    const content = try Host.fetch_range(name, entry, self.allocator);
-    defer self.allocator.free(content);
+    const fetch_started = Timeline.now();
+    const fetched = try Host.fetch_range(name, entry, self.allocator);
+    Timeline.span_bytes(.bundle, "fetch", name, fetch_started, fetched.len);
+    const content = try inflate_entry(io, self.allocator, name, entry, fetched);
 
-    // 4. persist to cache (Host abstracts disk vs OPFS, no-op on WASM)
+    // 5. persist to cache (Host abstracts disk vs OPFS, no-op on WASM)
     Host.cache_write(name, content);
 
-    // 5. Try opening from cache (cache_write just stored it)
+    // 6. Try opening from cache (cache_write just stored it)
     if (Host.cache_open(name)) |cached_file| {
         Log.dbg(io, "bundle", "open_file: reopened from cache \"{s}\"", .{name});
+        self.allocator.free(content);
         return cached_file;
     }
 
-    // Fallback: write to tmp/ directory (not cwd)
-    Io.Dir.cwd().createDir(io, "tmp", Io.Dir.Permissions.default_dir) catch {};
-    var tmp_buf: [1024]u8 = undefined;
-    const tmp_name = std.fmt.bufPrint(&tmp_buf, "tmp/{s}", .{name}) catch return error.CacheWriteFailed;
-    const file = Io.Dir.cwd().createFile(io, tmp_name, .{}) catch return error.CacheWriteFailed;
-    var write_buf: [4096]u8 = undefined;
-    var writer = file.writerStreaming(io, &write_buf);
-    writer.interface.writeAll(content) catch {
-        file.close(io);
-        return error.CacheWriteFailed;
+    // no cache (always on WASM): hand the fetched buffer to the caller as is
+    return .{ .owned = .{ .data = content, .allocator = self.allocator } };
+}
+
+// compressed local entries inflating to at least this much are handed out
+// deflated and inflated as they are read; smaller ones inflate whole
+const stream_inflate_min: usize = 256 * 1024;
+
+// a local bundle's entry, borrowed from the mapping. compressed bundles
+// inflate each open, which still costs less than a copy in the cache
+fn resolve_local(self: *BundleStore, io: Io, name: []const u8) !OpenedFile {
+    const data = try self.local_bundle(io);
+    try self.ensure_index(io);
+    const entry = self.resolve_index_entry(name) orelse return error.FileNotFound;
+    if (entry.offset + entry.length > data.len) {
+        Log.dbg(io, "bundle", "open_file: \"{s}\" lies past the end of the bundle file", .{name});
+        return error.FileNotFound;
+    }
+    const bytes = data[@intCast(entry.offset)..][0..entry.length];
+    if (entry.raw_length == 0 or entry.length == entry.raw_length) return .{ .bytes = bytes };
+    if (entry.raw_length >= stream_inflate_min) return .{ .deflated = .{ .data = bytes, .raw_len = entry.raw_length } };
+    const content = Flate.inflate_exact(self.allocator, bytes, entry.raw_length) catch |err| {
+        Log.dbg(io, "bundle", "inflate failed for \"{s}\": {}", .{ name, err });
+        return err;
+    };
+    return .{ .owned = .{ .data = content, .allocator = self.allocator } };
+}
+
+pub fn is_local(self: *const BundleStore) bool {
+    return local_supported and Config.local_path(self.url) != null;
+}
+
+// the mapped local bundle. entries are handed out as OpenedFile.bytes, which
+// stay valid for the rest of the process, so a mapping is never unmapped; a
+// process switching to another bundle file keeps the old one mapped too
+var local_map: ?[]align(std.heap.page_size_min) const u8 = null;
+var local_map_path: [fs.max_path_bytes]u8 = undefined;
+var local_map_path_len: usize = 0;
+// runtimes on other threads share the mapping
+var local_map_mutex = std.atomic.Mutex.unlocked;
+
+fn local_bundle(self: *BundleStore, io: Io) ![]const u8 {
+    const path = Config.local_path(self.url).?;
+    while (!local_map_mutex.tryLock()) std.atomic.spinLoopHint();
+    defer local_map_mutex.unlock();
+    if (local_map) |m| if (std.mem.eql(u8, local_map_path[0..local_map_path_len], path)) return m;
+    if (path.len > local_map_path.len) return error.NameTooLong;
+    const file = (if (fs.path.isAbsolute(path))
+        Io.Dir.openFileAbsolute(io, path, .{})
+    else
+        Io.Dir.cwd().openFile(io, path, .{})) catch |err| {
+        Log.log(io, "bundle", .err, "cannot open bundle file {s}: {}", .{ path, err });
+        return err;
     };
-    _ = writer.interface.flush() catch {};
-    file.close(io);
-    return Io.Dir.cwd().openFile(io, tmp_name, .{}) catch error.CacheWriteFailed;
+    defer file.close(io);
+    const size = (try file.stat(io)).size;
+    if (size == 0) return error.FileNotFound;
+    const m = try std.posix.mmap(null, @intCast(size), std.posix.PROT.READ, .{ .TYPE = .SHARED }, file.handle, 0);
+    local_map = m;
+    @memcpy(local_map_path[0..path.len], path);
+    local_map_path_len = path.len;
+    Log.dbg(io, "bundle", "mapped bundle file {s} ({d} bytes)", .{ path, size });
+    return m;
 }
 
 // check if a file exists in cache or index (case-insensitive for index)
 pub fn has(self: *BundleStore, io: Io, name: []const u8) !bool {
-    if (Host.cache_check(name) == .hit) return true;
+    if (!self.is_local() and Host.cache_check(name) == .hit) return true;
     try self.ensure_index(io);
     var buf: [1024]u8 = undefined;
     const lower = lower_into(&buf, name) orelse return false;
@@ -101,21 +204,36 @@ pub fn has(self: *BundleStore, io: Io, name: []const u8) !bool {
 
 pub fn count(self: *BundleStore, io: Io) !usize {
     try self.ensure_index(io);
-    return self.bundle_index.count();
+    return self.bundle_index.count;
 }
 
 // resolve name to index entry, handling case-insensitive lookup and fonts/ prefix stripping.
-// index keys are stored lowercased (see parse_index_into), so we lowercase the query too.
+// index keys are stored lowercased (see BundleIndex.compile), so we lowercase the query too.
 pub fn resolve_index_entry(self: *BundleStore, name: []const u8) ?IndexEntry {
     var buf: [1024]u8 = undefined;
     const lower = lower_into(&buf, name) orelse return null;
-    if (self.bundle_index.get(lower)) |entry| return entry;
-    // try stripping fonts/ prefix (WASM fetches use bare names in index)
-    const fonts_prefix = "fonts/";
-    if (lower.len > fonts_prefix.len and std.mem.eql(u8, lower[0..fonts_prefix.len], fonts_prefix)) {
-        return self.bundle_index.get(lower[fonts_prefix.len..]);
-    }
-    return null;
+    const found = self.bundle_index.get(lower) orelse blk: {
+        // try stripping fonts/ prefix (WASM fetches use bare names in index)
+        const fonts_prefix = "fonts/";
+        if (lower.len > fonts_prefix.len and std.mem.eql(u8, lower[0..fonts_prefix.len], fonts_prefix)) {
+            break :blk self.bundle_index.get(lower[fonts_prefix.len..]);
+        }
+        break :blk null;
+    } orelse return null;
+    return .{ .offset = found.offset, .length = found.length, .raw_length = found.raw_length };
+}
+
+// inflate a compressed entry, taking ownership of `fetched`. compressed
+// bundles only compress entries that shrink (worker/compress-bundle.ts), so
+// bytes already at raw_length were inflated by the host (the wasm host's
+// memory cache holds entries inflated).
+pub fn inflate_entry(io: Io, alloc: std.mem.Allocator, name: []const u8, entry: IndexEntry, fetched: []u8) ![]u8 {
+    if (entry.raw_length == 0 or fetched.len == entry.raw_length) return fetched;
+    defer alloc.free(fetched);
+    return Flate.inflate_exact(alloc, fetched, entry.raw_length) catch |err| {
+        Log.dbg(io, "bundle", "inflate failed for \"{s}\": {}", .{ name, err });
+        return err;
+    };
 }
 
 fn lower_into(buf: []u8, s: []const u8) ?[]u8 {
@@ -131,85 +249,64 @@ pub fn ensure_index(self: *BundleStore, io: Io) !void {
     if (self.bundle_index_loaded) return;
     Log.dbg(io, "bundle", "ensure_index: loading...", .{});
 
+    // a local bundle reads its index beside it: a cached copy, keyed by the
+    // URL, would outlive the file being replaced at the same path
+    const local = self.is_local();
+
     // try loading cached index first (native: disk cache, wasm: always null)
-    if (Host.load_cached_index(&self.digest, self.allocator)) |content| {
-        defer self.allocator.free(content);
-        self.parse_index(content) catch {
-            // cache corrupted, fall through to network fetch
-        };
-        if (self.bundle_index.count() > 0) {
-            self.bundle_index_loaded = true;
-            Log.dbg(io, "bundle", "bundle_index loaded from cache ({d} entries)", .{self.bundle_index.count()});
-            return;
-        }
+    if (!local) if (Host.load_cached_index(&self.digest, self.allocator)) |content| cached: {
+        const was_compiled = BundleIndex.is_compiled(content);
+        // cache corrupted: fall through to network fetch
+        self.adopt_index(content) catch break :cached;
+        if (self.bundle_index.count == 0) break :cached;
+        self.bundle_index_loaded = true;
+        Log.dbg(io, "bundle", "bundle_index loaded from cache ({d} entries)", .{self.bundle_index.count});
+        // upgrade a text index cached by an older build
+        if (!was_compiled) Host.cache_index(&self.digest, self.index_blob.?);
+        return;
     }
 
-    // fetch from network (native: HTTP + decompress, wasm: error.IndexNotLoaded)
+    // fetch from network (native: HTTP + decompress or the local file, wasm: error.IndexNotLoaded)
     const content = try Host.fetch_index(self.allocator);
-    defer self.allocator.free(content);
 
     Log.dbg(io, "bundle", "bundle index downloaded ({d} bytes decompressed)", .{content.len});
 
-    try self.parse_index(content);
+    try self.adopt_index(content);
     self.bundle_index_loaded = true;
-    Log.dbg(io, "bundle", "bundle_index fetched from network ({d} entries)", .{self.bundle_index.count()});
+    Log.dbg(io, "bundle", "bundle_index fetched from network ({d} entries)", .{self.bundle_index.count});
 
-    // cache for future runs
-    Host.cache_index(&self.digest, content);
+    // cache the compiled form for future runs
+    if (!local) Host.cache_index(&self.digest, self.index_blob.?);
 }
 
-// load index from raw ITAR text content. clears any previously loaded index.
-// used by both native (from disk/HTTP) and WASM (from JS-provided bytes via eztex_push_index).
+// load index from ITAR text or a compiled BundleIndex blob (borrowed).
+// clears any previously loaded index.
 pub fn load_index(self: *BundleStore, content: []const u8) !void {
-    var it = self.bundle_index.iterator();
-    while (it.next()) |entry| {
-        self.allocator.free(entry.key_ptr.*);
-    }
-    self.bundle_index.clearRetainingCapacity();
-    try parse_index_into(self.allocator, &self.bundle_index, content);
+    const blob = try self.allocator.dupe(u8, content);
+    try self.adopt_index(blob);
     self.bundle_index_loaded = true;
 }
 
-fn parse_index(self: *BundleStore, content: []const u8) !void {
-    self.bundle_index.clearRetainingCapacity();
-    try parse_index_into(self.allocator, &self.bundle_index, content);
+// take ownership of `content` (text or compiled, allocated with self.allocator)
+// and make it the current index.
+fn adopt_index(self: *BundleStore, content: []u8) !void {
+    self.drop_index();
+    const blob = if (BundleIndex.is_compiled(content)) content else blk: {
+        defer self.allocator.free(content);
+        break :blk try BundleIndex.compile(self.allocator, content);
+    };
+    self.bundle_index = BundleIndex.open(blob) catch |err| {
+        self.allocator.free(blob);
+        return err;
+    };
+    self.index_blob = blob;
 }
 
-// standalone index parser: populate any StringHashMap(IndexEntry) from ITAR index text.
-// keys are lowercased for case-insensitive lookup (TeX requests lowercase but
-// the bundle index stores mixed-case filenames like "T1PTSerif-TLF.fd").
-pub fn parse_index_into(
-    allocator: std.mem.Allocator,
-    index: *std.StringHashMap(IndexEntry),
-    content: []const u8,
-) !void {
-    var line_iter = std.mem.splitScalar(u8, content, '\n');
-    while (line_iter.next()) |line| {
-        const trimmed = std.mem.trim(u8, line, " \t\r");
-        if (trimmed.len == 0) continue;
-
-        var parts = std.mem.splitScalar(u8, trimmed, ' ');
-        const name = parts.next() orelse continue;
-        const offset_str = parts.next() orelse continue;
-        const length_str = parts.next() orelse continue;
-        if (name.len == 0) continue;
-        if (std.mem.eql(u8, name, "SVNREV") or std.mem.eql(u8, name, "GITHASH")) continue;
-
-        const offset = std.fmt.parseInt(u64, offset_str, 10) catch continue;
-        const length = std.fmt.parseInt(u32, length_str, 10) catch continue;
-
-        const owned_name = try allocator.dupe(u8, name);
-        ascii_lower(owned_name);
-        // Check for duplicate key first to avoid leaking owned_name
-        if (index.contains(owned_name)) {
-            allocator.free(owned_name);
-            continue;
-        }
-        index.put(owned_name, .{ .offset = offset, .length = length }) catch {
-            allocator.free(owned_name);
-            continue;
-        };
-    }
+fn drop_index(self: *BundleStore) void {
+    if (self.index_blob) |blob| self.allocator.free(blob);
+    self.index_blob = null;
+    self.bundle_index = .empty;
+    self.bundle_index_loaded = false;
 }
 
 fn ascii_lower(s: []u8) void {
@@ -218,6 +315,65 @@ fn ascii_lower(s: []u8) void {
     }
 }
 
+// -- prefetch trace --
+// records which bundle files a compile opens, keyed by Preamble.key. the list
+// saved by earlier compiles with the same key predicts what this one needs, so
+// it can be seeded in one parallel batch instead of fetched serially on open.
+
+// start tracing under `key`. returns the names recorded for it by earlier
+// compiles (empty if none); valid until end_trace.
+pub fn begin_trace(self: *BundleStore, key: u64) []const []const u8 {
+    self.end_trace();
+    self.trace_key = key;
+    const content = Host.load_prefetch_list(key, self.allocator) orelse return &.{};
+    defer self.allocator.free(content);
+
+    var lines = std.mem.splitScalar(u8, content, '\n');
+    while (lines.next()) |line| {
+        const name = std.mem.trim(u8, line, " \t\r");
+        if (name.len > 0) self.add_traced(name) catch break;
+    }
+    self.trace_grew = false;
+    return self.trace.items;
+}
+
+fn note_opened(self: *BundleStore, name: []const u8) void {
+    if (self.trace_key == null or self.traced.contains(name)) return;
+    self.add_traced(name) catch return;
+    self.trace_grew = true;
+}
+
+fn add_traced(self: *BundleStore, name: []const u8) !void {
+    if (self.traced.contains(name)) return;
+    const owned = try self.allocator.dupe(u8, name);
+    errdefer self.allocator.free(owned);
+    try self.trace.append(self.allocator, owned);
+    errdefer _ = self.trace.pop();
+    try self.traced.put(self.allocator, owned, {});
+}
+
+// persist the trace if this compile opened files the saved list lacked, then reset.
+// the saved list only grows; a changed preamble gets a new key.
+pub fn end_trace(self: *BundleStore) void {
+    if (self.trace_key) |key| {
+        if (self.trace_grew) {
+            var out: std.ArrayList(u8) = .empty;
+            defer out.deinit(self.allocator);
+            for (self.trace.items) |name| {
+                out.appendSlice(self.allocator, name) catch break;
+                out.append(self.allocator, '\n') catch break;
+            } else Host.cache_prefetch_list(key, out.items);
+        }
+    }
+    for (self.trace.items) |name| self.allocator.free(name);
+    self.trace.deinit(self.allocator);
+    self.traced.deinit(self.allocator);
+    self.trace = .empty;
+    self.traced = .empty;
+    self.trace_key = null;
+    self.trace_grew = false;
+}
+
 // -- batch seed cache --
 // fetches a list of files in parallel, skipping cached and unknown entries.
 // delegates concurrency strategy to Host (OS threads on native, sequential on WASM).
@@ -230,7 +386,8 @@ pub const SeedResult = struct {
 };
 
 pub fn seed_cache(self: *BundleStore, io: Io, names: []const []const u8, concurrency: usize) SeedResult {
-    if (names.len == 0) return .{ .fetched = 0, .skipped_cached = 0, .skipped_unknown = 0, .failed = 0 };
+    // a local bundle has nothing to fetch
+    if (names.len == 0 or self.is_local()) return .{ .fetched = 0, .skipped_cached = 0, .skipped_unknown = 0, .failed = 0 };
 
     self.ensure_index(io) catch |err| {
         Log.dbg(io, "bundle", "seed: failed to load bundle index: {}", .{err});
@@ -244,7 +401,13 @@ pub fn seed_cache(self: *BundleStore, io: Io, names: []const []const u8, concurr
     var skipped_cached: usize = 0;
     var skipped_unknown: usize = 0;
 
+    // callers may concatenate overlapping lists
+    var seen: std.StringHashMapUnmanaged(void) = .empty;
+    defer seen.deinit(self.allocator);
+
     for (names) |name| {
+        const gop = seen.getOrPut(self.allocator, name) catch continue;
+        if (gop.found_existing) continue;
         if (Host.cache_check(name) == .hit) {
             skipped_cached += 1;
             continue;
@@ -270,7 +433,14 @@ pub fn seed_cache(self: *BundleStore, io: Io, names: []const []const u8, concurr
     });
 
     // delegate to Host (threads on native, sequential on WASM)
+    const seed_started = Timeline.now();
     const result = Host.batch_seed(work_items.items, concurrency);
+    if (Timeline.enabled()) {
+        // the ranges asked for; a failed item may have moved less
+        var requested: u64 = 0;
+        for (work_items.items) |item| requested += item.entry.length;
+        Timeline.span_bytes(.bundle, "seed fetch", null, seed_started, requested);
+    }
 
     return .{
         .fetched = result.fetched,
@@ -279,3 +449,83 @@ pub fn seed_cache(self: *BundleStore, io: Io, names: []const []const u8, concurr
         .failed = result.failed,
     };
 }
+
+// -- preamble closure seed --
+// seeds the classes and packages a document loads, then level by level the
+// ones those files \RequirePackage or \LoadClass, until nothing new turns up.
+// each level is one parallel seed_cache batch; `also` joins the first one.
+
+const max_closure_depth = 8;
+
+pub fn seed_preamble_closure(self: *BundleStore, io: Io, src: []const u8, also: []const []const u8, concurrency: usize) SeedResult {
+    var total: SeedResult = .{ .fetched = 0, .skipped_cached = 0, .skipped_unknown = 0, .failed = 0 };
+    if (self.is_local()) return total;
+    self.ensure_index(io) catch return self.seed_cache(io, also, concurrency);
+
+    var arena = std.heap.ArenaAllocator.init(self.allocator);
+    defer arena.deinit();
+    const a = arena.allocator();
+
+    var seen: std.StringHashMapUnmanaged(void) = .empty;
+    var level: std.ArrayList([]const u8) = .empty;
+    self.add_closure_items(a, &seen, &level, src);
+
+    var batch: std.ArrayList([]const u8) = .empty;
+    batch.appendSlice(a, also) catch {};
+    batch.appendSlice(a, level.items) catch {};
+
+    var depth: usize = 0;
+    while (batch.items.len > 0) : (depth += 1) {
+        const r = self.seed_cache(io, batch.items, concurrency);
+        total.fetched += r.fetched;
+        total.skipped_cached += r.skipped_cached;
+        total.skipped_unknown += r.skipped_unknown;
+        total.failed += r.failed;
+        if (depth + 1 >= max_closure_depth) break;
+
+        var next: std.ArrayList([]const u8) = .empty;
+        for (level.items) |name| {
+            const content = read_cached(io, a, name) orelse continue;
+            self.add_closure_items(a, &seen, &next, content);
+        }
+        Log.dbg(io, "bundle", "seed: closure level {d}: {d} files, {d} new requirements", .{ depth, level.items.len, next.items.len });
+        level = next;
+        batch = next;
+    }
+    return total;
+}
+
+fn add_closure_items(self: *BundleStore, a: std.mem.Allocator, seen: *std.StringHashMapUnmanaged(void), out: *std.ArrayList([]const u8), src: []const u8) void {
+    var it = Preamble.iterate(src);
+    while (it.next()) |item| {
+        const ext = switch (item.kind) {
+            .class => "cls",
+            .package => "sty",
+        };
+        const name = std.fmt.allocPrint(a, "{s}.{s}", .{ item.name, ext }) catch continue;
+        const gop = seen.getOrPut(a, name) catch continue;
+        if (gop.found_existing) continue;
+        // local files and macro parameters (\RequirePackage{#1}) are not in the bundle
+        if (self.resolve_index_entry(name) == null) continue;
+        out.append(a, name) catch continue;
+    }
+}
+
+// content of a cached file, borrowed from the cache pack or read into `a`
+fn read_cached(io: Io, a: std.mem.Allocator, name: []const u8) ?[]const u8 {
+    return switch (Host.cache_open(name) orelse return null) {
+        .bytes => |bytes| bytes,
+        .deflated => |deflated| Flate.inflate_exact(a, deflated.data, deflated.raw_len) catch null,
+        .owned => |owned| blk: {
+            defer owned.allocator.free(owned.data);
+            break :blk a.dupe(u8, owned.data) catch null;
+        },
+        .file => |file| blk: {
+            defer file.close(io);
+            const stat = file.stat(io) catch return null;
+            const data = a.alloc(u8, @intCast(stat.size)) catch return null;
+            const n = file.readPositionalAll(io, data, 0) catch return null;
+            break :blk data[0..n];
+        },
+    };
+}
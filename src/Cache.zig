@@ -1,8 +1,17 @@
 // Cache.zig -- content-addressed file cache for native target.
 //
-// Stores files using SHA-256 content hashing in a layout compatible with
-// the ITAR bundle cache: files/{hash[0:2]}/{hash[2:]}
-// Manifest format: "name size hash\n" per line.
+// New entries go to a per-bundle packfile (packs/{digest}.pack + .idx, see
+// Packfile.zig). Entries cached by older builds, and entries whose names do
+// not fit a pack record, are loose files named by a hash of their content
+// (see hash_content) in a layout compatible with the ITAR bundle cache:
+// files/{hash[0:2]}/{hash[2:]}
+// The manifest lists loose files only: "name size hash\n" per line. It is a
+// journal: saves append the entries recorded since the last save, a later
+// line for a name overrides earlier ones, and the file is rewritten
+// (compacted) once stale lines outnumber live ones.
+//
+// With a size budget (max_bytes) the cache drops whole bundles and formats,
+// least recently used first (see trim).
 //
 // Cache directory:
 //   macOS:  ~/Library/Caches/eztex/v1/
@@ -16,6 +25,7 @@ const fs = std.fs;
 const Io = std.Io;
 const posix = std.posix;
 const Digest = @import("Digest.zig");
+const Packfile = @import("Packfile.zig");
 
 const Cache = @This();
 
@@ -26,6 +36,29 @@ manifest: std.StringHashMap(ManifestEntry),
 manifest_path: [1024]u8 = @splat(0),
 manifest_path_len: usize = 0,
 dirty: bool = false,
+// lines in the manifest file on disk, live or overridden
+manifest_lines: usize = 0,
+// how far the manifest file has been read, and which file that was; other
+// processes append to it too (see refresh_manifest)
+manifest_read_end: u64 = 0,
+manifest_inode: Io.File.INode = 0,
+// names recorded since the last save (keys of `manifest`), appended on save
+journal: std.ArrayList([]const u8) = .empty,
+pack: Packfile,
+// data path of the open pack; a resident process reopening the same pack
+// keeps its mapping (see open_pack)
+pack_path: [1024]u8 = undefined,
+pack_path_len: usize = 0,
+// size budget; null keeps everything (see trim)
+max_bytes: ?u64 = null,
+// units this process used ("packs/<digest>", "formats/<key>") with the unix
+// time of the use; keys are owned
+used: std.StringHashMapUnmanaged(i64) = .empty,
+// uses or stores not yet seen by trim
+trim_pending: bool = false,
+
+// packs and cross-process locking need mmap and flock
+pub const pack_supported = builtin.os.tag != .windows;
 
 pub const ManifestEntry = struct {
     hash: [64]u8,
@@ -36,15 +69,36 @@ pub fn init(allocator: std.mem.Allocator) Cache {
     return .{
         .allocator = allocator,
         .manifest = std.StringHashMap(ManifestEntry).init(allocator),
+        .pack = Packfile.init(allocator),
     };
 }
 
+// a cache hit: a loose file, or a slice of the mapped pack that stays valid
+// for the lifetime of the Cache
+pub const Hit = union(enum) {
+    file: Io.File,
+    bytes: []const u8,
+};
+
+// where store_content() put an entry; pass it on to record()
+pub const Location = union(enum) {
+    loose,
+    pack: u64,
+};
+
 pub fn deinit(self: *Cache) void {
     var it = self.manifest.iterator();
     while (it.next()) |entry| {
         self.allocator.free(entry.key_ptr.*);
     }
     self.manifest.deinit();
+    self.journal.deinit(self.allocator);
+    var used_it = self.used.keyIterator();
+    while (used_it.next()) |key| self.allocator.free(key.*);
+    self.used.deinit(self.allocator);
+
+    var threaded: std.Io.Threaded = .init_single_threaded;
+    self.pack.deinit(threaded.io());
 }
 
 // detect and set the platform-appropriate cache directory.
@@ -90,7 +144,7 @@ pub fn ensure_dirs(self: *Cache) !void {
 
     // create base dirs manually using createDirPath (creates parent dirs as needed)
     var buf: [1024]u8 = undefined;
-    for ([_][]const u8{ "files", "manifests", "indexes", "formats" }) |sub| {
+    for ([_][]const u8{ "files", "packs", "manifests", "indexes", "formats" }) |sub| {
         const path = std.fmt.bufPrint(&buf, "{s}/{s}", .{ dir, sub }) catch continue;
         // Create dir and any parent directories - ignore errors if it exists
         Io.Dir.cwd().createDirPath(io, path) catch {};
@@ -103,19 +157,41 @@ pub fn load_manifest(self: *Cache, path: []const u8) !void {
     var threaded: std.Io.Threaded = .init_single_threaded;
     const io = threaded.io();
 
+    // remember manifest path for save and refresh
+    const copy_len = @min(path.len, self.manifest_path.len);
+    @memcpy(self.manifest_path[0..copy_len], path[0..copy_len]);
+    self.manifest_path_len = copy_len;
+
+    try self.refresh_manifest(io);
+}
+
+// read manifest lines appended (by this or another process) since the last
+// load. a manifest replaced by compaction is read again from the start.
+fn refresh_manifest(self: *Cache, io: Io) !void {
+    if (self.manifest_path_len == 0) return;
+    const path = self.manifest_path[0..self.manifest_path_len];
     const file = try Io.Dir.cwd().openFile(io, path, .{});
     defer file.close(io);
 
-    // Read file content manually (Io.File doesn't have readToEndAlloc in 0.16)
     const stat = try file.stat(io);
-    const content = try self.allocator.alloc(u8, stat.size);
-    errdefer self.allocator.free(content);
-    var read_buf: [4096]u8 = undefined;
-    var file_reader = file.readerStreaming(io, &read_buf);
-    const reader = &file_reader.interface;
-    try reader.readSliceAll(content);
+    if (stat.inode != self.manifest_inode or stat.size < self.manifest_read_end) {
+        self.manifest_inode = stat.inode;
+        self.manifest_read_end = 0;
+        self.manifest_lines = 0;
+    }
+    if (stat.size == self.manifest_read_end) return;
 
-    var line_iter = std.mem.splitScalar(u8, content, '\n');
+    const content = try self.allocator.alloc(u8, @intCast(stat.size - self.manifest_read_end));
+    defer self.allocator.free(content);
+    const n = try file.readPositionalAll(io, content, self.manifest_read_end);
+    self.manifest_read_end += try self.ingest_manifest(content[0..n]);
+}
+
+// parse complete manifest lines into `manifest`. returns the bytes consumed;
+// an unterminated tail (an append in progress, or torn) is left for later.
+fn ingest_manifest(self: *Cache, content: []const u8) !usize {
+    const complete = if (std.mem.lastIndexOfScalar(u8, content, '\n')) |nl| nl + 1 else 0;
+    var line_iter = std.mem.splitScalar(u8, content[0..complete], '\n');
     while (line_iter.next()) |line| {
         const trimmed = std.mem.trim(u8, line, " \t\r");
         if (trimmed.len < 66) continue; // minimum: "x 0 " + 64 hex chars
@@ -154,43 +230,123 @@ pub fn load_manifest(self: *Cache, path: []const u8) !void {
         var entry = ManifestEntry{ .hash = undefined, .size = size };
         @memcpy(&entry.hash, hash_str);
 
-        const owned_name = try self.allocator.dupe(u8, filename);
-        self.manifest.put(owned_name, entry) catch {
-            self.allocator.free(owned_name);
-            continue;
-        };
+        // journal order: the last line for a name wins
+        self.manifest_lines += 1;
+        const gop = try self.manifest.getOrPut(filename);
+        if (!gop.found_existing) {
+            gop.key_ptr.* = self.allocator.dupe(u8, filename) catch |err| {
+                self.manifest.removeByPtr(gop.key_ptr);
+                return err;
+            };
+        }
+        gop.value_ptr.* = entry;
     }
-
-    // remember manifest path for save
-    const copy_len = @min(path.len, self.manifest_path.len);
-    @memcpy(self.manifest_path[0..copy_len], path[0..copy_len]);
-    self.manifest_path_len = copy_len;
+    return complete;
 }
 
-// save manifest to disk (only if dirty)
+// save manifest to disk (only if dirty): append the journal, or compact
+// when the file would hold more stale lines than live ones. holds the
+// manifest lock and first picks up lines other processes appended, so
+// neither an append nor a compaction drops their entries.
 pub fn save_manifest(self: *Cache, io: Io) !void {
     if (!self.dirty) return;
     if (self.manifest_path_len == 0) return error.NoManifestPath;
 
+    const lock = self.lock_manifest(io);
+    defer if (lock) |f| f.close(io);
+    self.refresh_manifest(io) catch {};
+
+    const live = self.manifest.count();
+    const stale = (self.manifest_lines + self.journal.items.len) -| live;
+    if (self.manifest_lines == 0 or stale > @max(live, 256)) {
+        try self.compact_manifest(io);
+    } else {
+        try self.append_journal(io);
+    }
+    self.journal.clearRetainingCapacity();
+    self.dirty = false;
+}
+
+// exclusive flock on {manifest}.lock: one process writes the manifest at a
+// time. readers take none, as compaction renames its file into place and
+// ingest_manifest leaves a torn tail for later. released by closing the
+// returned file. null where flock is unavailable.
+fn lock_manifest(self: *const Cache, io: Io) ?Io.File {
+    var buf: [1040]u8 = undefined;
+    const path = std.fmt.bufPrint(&buf, "{s}.lock", .{self.manifest_path[0..self.manifest_path_len]}) catch return null;
+    return lock_file(io, path);
+}
+
+fn lock_file(io: Io, path: []const u8) ?Io.File {
+    if (!pack_supported) return null;
+    const file = Io.Dir.cwd().createFile(io, path, .{ .truncate = false }) catch return null;
+    posix.flock(file.handle, posix.LOCK.EX) catch {
+        file.close(io);
+        return null;
+    };
+    return file;
+}
+
+fn append_journal(self: *Cache, io: Io) !void {
+    var out: std.ArrayList(u8) = .empty;
+    defer out.deinit(self.allocator);
+    for (self.journal.items) |name| {
+        const entry = self.manifest.get(name) orelse continue;
+        try out.print(self.allocator, "{s} {d} {s}\n", .{ name, entry.size, &entry.hash });
+    }
+
     const path = self.manifest_path[0..self.manifest_path_len];
-    const file = try Io.Dir.cwd().createFile(io, path, .{});
+    const file = try Io.Dir.cwd().createFile(io, path, .{ .read = true, .truncate = false });
     defer file.close(io);
 
-    var write_buf: [4096]u8 = undefined;
-    var writer = file.writerStreaming(io, &write_buf);
+    // an interrupted append can leave the last line unterminated
+    const stat = try file.stat(io);
+    var end = stat.size;
+    if (end > 0) {
+        var last: [1]u8 = undefined;
+        if (try file.readPositionalAll(io, &last, end - 1) == 1 and last[0] != '\n') {
+            try file.writePositionalAll(io, "\n", end);
+            end += 1;
+        }
+    }
+    try file.writePositionalAll(io, out.items, end);
+    self.manifest_lines += self.journal.items.len;
+    self.manifest_inode = stat.inode;
+    self.manifest_read_end = end + out.items.len;
+}
+
+// rewrite the manifest with one line per live entry. written to a temp file
+// and renamed into place, so a crash leaves the old journal intact.
+fn compact_manifest(self: *Cache, io: Io) !void {
+    var out: std.ArrayList(u8) = .empty;
+    defer out.deinit(self.allocator);
     var it = self.manifest.iterator();
     while (it.next()) |entry| {
-        var buf: [2048]u8 = undefined;
-        const line = std.fmt.bufPrint(&buf, "{s} {d} {s}\n", .{
+        try out.print(self.allocator, "{s} {d} {s}\n", .{
             entry.key_ptr.*,
             entry.value_ptr.size,
             &entry.value_ptr.hash,
-        }) catch continue;
-        writer.interface.writeAll(line) catch {};
+        });
     }
-    _ = writer.interface.flush() catch {};
 
-    self.dirty = false;
+    const path = self.manifest_path[0..self.manifest_path_len];
+    var tmp_buf: [1040]u8 = undefined;
+    const tmp_path = std.fmt.bufPrint(&tmp_buf, "{s}.tmp", .{path}) catch return error.PathTooLong;
+
+    const inode = blk: {
+        const file = try Io.Dir.cwd().createFile(io, tmp_path, .{});
+        defer file.close(io);
+        try file.writePositionalAll(io, out.items, 0);
+        break :blk (try file.stat(io)).inode;
+    };
+
+    Io.Dir.cwd().rename(tmp_path, Io.Dir.cwd(), path, io) catch |err| {
+        Io.Dir.cwd().deleteFile(io, tmp_path) catch {};
+        return err;
+    };
+    self.manifest_lines = self.manifest.count();
+    self.manifest_inode = inode;
+    self.manifest_read_end = out.items.len;
 }
 
 // set manifest path for the given bundle digest
@@ -198,15 +354,134 @@ pub fn set_manifest_path(self: *Cache, digest: []const u8) void {
     const dir = self.get_cache_dir();
     const result = std.fmt.bufPrint(&self.manifest_path, "{s}/manifests/{s}.txt", .{ dir, digest }) catch return;
     self.manifest_path_len = result.len;
+    self.note_use("packs", digest);
+}
+
+// open the packfile for the given bundle digest, creating it if needed.
+// on failure the cache keeps working with loose files only. a pack that is
+// already open at the same path is kept and refreshed.
+pub fn open_pack(self: *Cache, io: Io, digest: []const u8) !void {
+    if (!pack_supported) return;
+    const dir = self.get_cache_dir();
+    if (dir.len == 0) return error.NoCacheDir;
+
+    var dir_buf: [1024]u8 = undefined;
+    const packs_dir = std.fmt.bufPrint(&dir_buf, "{s}/packs", .{dir}) catch return error.PathTooLong;
+    Io.Dir.cwd().createDirPath(io, packs_dir) catch {};
+
+    var data_buf: [1024]u8 = undefined;
+    const data_path = std.fmt.bufPrint(&data_buf, "{s}/{s}.pack", .{ packs_dir, digest }) catch return error.PathTooLong;
+    var index_buf: [1024]u8 = undefined;
+    const index_path = std.fmt.bufPrint(&index_buf, "{s}/{s}.idx", .{ packs_dir, digest }) catch return error.PathTooLong;
+    if (self.pack.is_open() and std.mem.eql(u8, self.pack_path[0..self.pack_path_len], data_path)) {
+        return self.pack.refresh(io);
+    }
+    self.pack_path_len = 0;
+    try self.pack.open(io, Io.Dir.cwd(), data_path, index_path);
+    @memcpy(self.pack_path[0..data_path.len], data_path);
+    self.pack_path_len = data_path.len;
+}
+
+// -- in-flight fetches --
+// several eztex processes can share one cache. before fetching a missing
+// entry a process claims it by creating inflight/{name hash}; the others wait
+// for the marker to go away and then pick the entry up from the shared pack
+// or manifest instead of downloading it again.
+
+pub const Claim = enum {
+    // caller fetches and must release()
+    owner,
+    // another process fetched it; the cache has been refreshed
+    waited,
+    // no coordination possible here; caller fetches without a marker
+    uncoordinated,
+};
+
+const claim_poll_ms = 50;
+const claim_timeout_ns: i128 = 30 * std.time.ns_per_s;
+// a marker this old belongs to a process that died mid-fetch
+const claim_stale_ns: i128 = 120 * std.time.ns_per_s;
+
+fn inflight_path(self: *const Cache, buf: []u8, name: []const u8) ?[]const u8 {
+    return std.fmt.bufPrint(buf, "{s}/inflight/{x:0>16}", .{ self.get_cache_dir(), std.hash.Wyhash.hash(0, name) }) catch null;
+}
+
+pub fn claim(self: *Cache, io: Io, name: []const u8) Claim {
+    if (!pack_supported or self.base_dir_len == 0) return .uncoordinated;
+    var buf: [1040]u8 = undefined;
+    const path = self.inflight_path(&buf, name) orelse return .uncoordinated;
+
+    const start = std.time.nanoTimestamp();
+    var waited = false;
+    while (true) {
+        if (Io.Dir.cwd().createFile(io, path, .{ .exclusive = true })) |file| {
+            file.close(io);
+            if (!waited) return .owner;
+            // the other process gave up or died; the entry may still be missing
+            self.refresh(io);
+            if (self.has(name)) {
+                self.release(io, name);
+                return .waited;
+            }
+            return .owner;
+        } else |err| switch (err) {
+            error.PathAlreadyExists => {},
+            error.FileNotFound => {
+                var dir_buf: [1024]u8 = undefined;
+                const dir = std.fmt.bufPrint(&dir_buf, "{s}/inflight", .{self.get_cache_dir()}) catch return .uncoordinated;
+                Io.Dir.cwd().createDirPath(io, dir) catch return .uncoordinated;
+                continue;
+            },
+            else => return .uncoordinated,
+        }
+
+        const now = std.time.nanoTimestamp();
+        // released between our create and this open: try again
+        const marker = Io.Dir.cwd().openFile(io, path, .{}) catch continue;
+        const stat = marker.stat(io);
+        marker.close(io);
+        if (stat) |st| {
+            if (now - st.mtime.nanoseconds > claim_stale_ns) {
+                Io.Dir.cwd().deleteFile(io, path) catch {};
+                continue;
+            }
+        } else |_| {}
+        if (now - start > claim_timeout_ns) return .uncoordinated;
+
+        waited = true;
+        const ts = std.c.timespec{ .sec = 0, .nsec = claim_poll_ms * std.time.ns_per_ms };
+        _ = std.c.nanosleep(&ts, null);
+    }
+}
+
+// publish the fetched entry, then drop the marker. loose entries only become
+// visible to other processes through the manifest, so append it right away.
+pub fn release(self: *Cache, io: Io, name: []const u8) void {
+    if (self.dirty) self.save_manifest(io) catch {};
+    var buf: [1040]u8 = undefined;
+    const path = self.inflight_path(&buf, name) orelse return;
+    Io.Dir.cwd().deleteFile(io, path) catch {};
 }
 
-// check if a file is in the manifest
+// pick up entries other processes added to the pack or manifest
+pub fn refresh(self: *Cache, io: Io) void {
+    self.pack.refresh(io) catch {};
+    self.refresh_manifest(io) catch {};
+}
+
+// check if a file is in the pack or the manifest
 pub fn has(self: *const Cache, name: []const u8) bool {
-    return self.manifest.contains(name);
+    return self.pack.contains(name) or self.manifest.contains(name);
 }
 
-// open a cached file by name. returns null if not in manifest or file missing.
-pub fn open_cached(self: *const Cache, io: Io, name: []const u8) ?Io.File {
+// look a cached file up by name. returns null if unknown or the loose file is missing.
+pub fn open_cached(self: *Cache, io: Io, name: []const u8) ?Hit {
+    if (self.pack.get(name)) |bytes| return .{ .bytes = bytes };
+    const file = self.open_loose(io, name) orelse return null;
+    return .{ .file = file };
+}
+
+fn open_loose(self: *const Cache, io: Io, name: []const u8) ?Io.File {
     const entry = self.manifest.get(name) orelse return null;
     const dir = self.get_cache_dir();
     if (dir.len == 0) return null;
@@ -237,8 +512,30 @@ pub fn open_cached(self: *const Cache, io: Io, name: []const u8) ?Io.File {
     return file;
 }
 
-// write content to cache under its content hash. updates manifest.
+// write content to cache under its content hash. updates pack index or manifest.
 pub fn write(self: *Cache, io: Io, name: []const u8, hex_hash: *const [64]u8, content: []const u8) !void {
+    const loc = try self.store_content(io, name, hex_hash, content);
+    try self.record(io, name, hex_hash, content.len, loc);
+}
+
+// write content for `name` to the pack, or to its content-addressed loose
+// path when the pack is unavailable or the name does not fit. safe to call
+// from several threads; only the following record() needs serializing.
+pub fn store_content(self: *Cache, io: Io, name: []const u8, hex_hash: *const [64]u8, content: []const u8) !Location {
+    if (self.pack.writable and name.len <= Packfile.max_name_len) {
+        if (self.pack.store(io, content)) |offset| {
+            return .{ .pack = offset };
+        } else |err| {
+            std.log.debug("pack write failed for '{s}': {}, using a loose file", .{ name, err });
+        }
+    }
+    try self.store_loose(io, hex_hash, content);
+    return .loose;
+}
+
+// the data goes to a per-thread temp file first and is renamed into place, so a
+// reader never sees a partially written entry.
+fn store_loose(self: *const Cache, io: Io, hex_hash: *const [64]u8, content: []const u8) !void {
     const dir = self.get_cache_dir();
     if (dir.len == 0) return error.NoCacheDir;
 
@@ -250,7 +547,6 @@ pub fn write(self: *Cache, io: Io, name: []const u8, hex_hash: *const [64]u8, co
     }) catch return error.PathTooLong;
     Io.Dir.cwd().createDirPath(io, sub_dir) catch {};
 
-    // write file
     var path_buf: [1024]u8 = undefined;
     const path = std.fmt.bufPrint(&path_buf, "{s}/files/{s}/{s}", .{
         dir,
@@ -258,41 +554,63 @@ pub fn write(self: *Cache, io: Io, name: []const u8, hex_hash: *const [64]u8, co
         hex_hash[2..],
     }) catch return error.PathTooLong;
 
-    const file = try Io.Dir.cwd().createFile(io, path, .{});
-    defer file.close(io);
-    var write_buf: [4096]u8 = undefined;
-    var writer = file.writerStreaming(io, &write_buf);
-    try writer.interface.writeAll(content);
-    try writer.interface.flush();
-
-    // update manifest
-    const size: u32 = @intCast(@min(content.len, std.math.maxInt(u32)));
-    if (self.manifest.get(name) == null) {
-        const owned_name = try self.allocator.dupe(u8, name);
-        var entry = ManifestEntry{ .hash = undefined, .size = size };
-        @memcpy(&entry.hash, hex_hash);
-        self.manifest.put(owned_name, entry) catch {
-            self.allocator.free(owned_name);
-            return;
+    var tmp_buf: [1024]u8 = undefined;
+    const tmp_path = std.fmt.bufPrint(&tmp_buf, "{s}.tmp{d}", .{ path, std.Thread.getCurrentId() }) catch return error.PathTooLong;
+
+    {
+        const file = try Io.Dir.cwd().createFile(io, tmp_path, .{});
+        defer file.close(io);
+        var write_buf: [4096]u8 = undefined;
+        var writer = file.writerStreaming(io, &write_buf);
+        try writer.interface.writeAll(content);
+        try writer.interface.flush();
+    }
+
+    Io.Dir.cwd().rename(tmp_path, Io.Dir.cwd(), path, io) catch |err| {
+        Io.Dir.cwd().deleteFile(io, tmp_path) catch {};
+        return err;
+    };
+}
+
+// point `name` at stored content in the pack index or manifest. not thread-safe.
+pub fn record(self: *Cache, io: Io, name: []const u8, hex_hash: *const [64]u8, content_len: usize, loc: Location) !void {
+    const size: u32 = @intCast(@min(content_len, std.math.maxInt(u32)));
+    switch (loc) {
+        .pack => |offset| {
+            var hash: [32]u8 = undefined;
+            _ = try std.fmt.hexToBytes(&hash, hex_hash);
+            self.trim_pending = true;
+            return self.pack.append(io, name, offset, size, &hash);
+        },
+        .loose => {},
+    }
+    const gop = try self.manifest.getOrPut(name);
+    if (!gop.found_existing) {
+        gop.key_ptr.* = self.allocator.dupe(u8, name) catch |err| {
+            self.manifest.removeByPtr(gop.key_ptr);
+            return err;
         };
-    } else {
-        // update existing entry
-        const ptr = self.manifest.getPtr(name).?;
-        @memcpy(&ptr.hash, hex_hash);
-        ptr.size = size;
     }
+    gop.value_ptr.* = .{ .hash = hex_hash.*, .size = size };
+    try self.journal.append(self.allocator, gop.key_ptr.*);
 
     self.dirty = true;
+    self.trim_pending = true;
 }
 
-// compute sha256 hex hash of content
+// content address of a cached file: a BLAKE3 hex digest (see Digest.zig).
+// entries written under SHA-256 addresses keep them; the manifest says where
+// each one lives
 pub fn hash_content(content: []const u8) [64]u8 {
-    return Digest.hexDigest(content);
+    return Digest.hexInternal(content);
 }
 
 // read cached file content by name (returns owned slice, caller frees)
-pub fn read_cached(self: *const Cache, io: Io, name: []const u8) ?[]u8 {
-    const file = self.open_cached(io, name) orelse return null;
+pub fn read_cached(self: *Cache, io: Io, name: []const u8) ?[]u8 {
+    const file = switch (self.open_cached(io, name) orelse return null) {
+        .bytes => |bytes| return self.allocator.dupe(u8, bytes) catch null,
+        .file => |f| f,
+    };
     defer file.close(io);
 
     // Read file content manually (Io.File doesn't have readToEndAlloc in 0.16)
@@ -309,7 +627,240 @@ pub fn read_cached(self: *const Cache, io: Io, name: []const u8) ?[]u8 {
     return content;
 }
 
-// get the number of entries in the manifest
+// get the number of cached entries (pack and loose)
 pub fn count(self: *const Cache) usize {
-    return self.manifest.count();
+    return self.pack.count() + self.manifest.count();
+}
+
+// -- size budget --
+// trim() keeps the cache under max_bytes by dropping whole units, least
+// recently used first:
+//   packs/<digest>   a bundle: its pack and pack index, its manifest, its
+//                    bundle index (indexes/), and the loose files no other
+//                    manifest lists
+//   formats/<key>    a format and its image
+// Uses are recorded in usage.txt, one "<unit> <unix seconds>" line per unit,
+// which each trim rewrites under usage.txt.lock; a unit without a line counts
+// from its newest file. Units this process used are never dropped: the
+// bundle it has open, which holds the seed set, and the formats it loaded.
+// The rest of the cache directory (deps/, blobs) is small and not counted.
+
+const usage_name = "usage.txt";
+
+const Unit = struct {
+    bytes: u64 = 0,
+    // unix seconds of the last use
+    time: i64 = 0,
+};
+
+const Units = std.StringArrayHashMapUnmanaged(Unit);
+
+fn unix_seconds(ns: i128) i64 {
+    return @intCast(@divTrunc(ns, std.time.ns_per_s));
+}
+
+// record a use of kind/key ("packs", digest or "formats", key hex) for trim
+pub fn note_use(self: *Cache, kind: []const u8, key: []const u8) void {
+    var buf: [128]u8 = undefined;
+    const unit = std.fmt.bufPrint(&buf, "{s}/{s}", .{ kind, key }) catch return;
+    const now = unix_seconds(std.time.nanoTimestamp());
+    self.trim_pending = true;
+    if (self.used.getPtr(unit)) |t| {
+        t.* = now;
+        return;
+    }
+    const owned = self.allocator.dupe(u8, unit) catch return;
+    self.used.put(self.allocator, owned, now) catch self.allocator.free(owned);
+}
+
+// record this process's uses and drop least recently used units until the
+// cache fits max_bytes. does nothing when nothing was used or stored since
+// the last call
+pub fn trim(self: *Cache, io: Io) void {
+    if (!self.trim_pending or self.base_dir_len == 0) return;
+    self.trim_pending = false;
+    var arena = std.heap.ArenaAllocator.init(self.allocator);
+    defer arena.deinit();
+    const a = arena.allocator();
+    const dir = self.get_cache_dir();
+
+    var usage_buf: [1040]u8 = undefined;
+    const usage_path = std.fmt.bufPrint(&usage_buf, "{s}/{s}", .{ dir, usage_name }) catch return;
+    var lock_buf: [1048]u8 = undefined;
+    const lock = lock_file(io, std.fmt.bufPrint(&lock_buf, "{s}.lock", .{usage_path}) catch return);
+    defer if (lock) |f| f.close(io);
+
+    var units: Units = .empty;
+    collect_units(io, a, &units, dir, "packs", "packs", &.{ ".pack", ".idx" });
+    collect_units(io, a, &units, dir, "manifests", "packs", &.{".txt"});
+    collect_units(io, a, &units, dir, "indexes", "packs", &.{ ".bin", ".txt" });
+    collect_units(io, a, &units, dir, "formats", "formats", &.{ ".fmt", ".img" });
+    for (units.keys(), units.values()) |name, *u| {
+        if (std.mem.startsWith(u8, name, "packs/")) {
+            for (read_loose_entries(io, a, dir, name["packs/".len..])) |e| u.bytes += e.size;
+        }
+        if (self.used.get(name)) |t| u.time = @max(u.time, t);
+    }
+    if (read_small(io, a, usage_path)) |text| {
+        var lines = std.mem.splitScalar(u8, text, '\n');
+        while (lines.next()) |line| {
+            const sp = std.mem.lastIndexOfScalar(u8, line, ' ') orelse continue;
+            const t = std.fmt.parseInt(i64, line[sp + 1 ..], 10) catch continue;
+            if (units.getPtr(line[0..sp])) |u| u.time = @max(u.time, t);
+        }
+    }
+
+    if (self.max_bytes) |max| self.drop_over_budget(io, a, &units, dir, max);
+
+    var out: std.ArrayList(u8) = .empty;
+    for (units.keys(), units.values()) |name, u| {
+        out.print(a, "{s} {d}\n", .{ name, u.time }) catch return;
+    }
+    var tmp_buf: [1048]u8 = undefined;
+    const tmp_path = std.fmt.bufPrint(&tmp_buf, "{s}.tmp", .{usage_path}) catch return;
+    Io.Dir.cwd().writeFile(io, .{ .sub_path = tmp_path, .data = out.items }) catch return;
+    Io.Dir.cwd().rename(tmp_path, Io.Dir.cwd(), usage_path, io) catch {
+        Io.Dir.cwd().deleteFile(io, tmp_path) catch {};
+    };
+}
+
+// remove units, oldest first, while the total is over max; removed units
+// leave `units`
+fn drop_over_budget(self: *const Cache, io: Io, a: std.mem.Allocator, units: *Units, dir: []const u8, max: u64) void {
+    var total: u64 = 0;
+    for (units.values()) |u| total += u.bytes;
+    if (total <= max) return;
+
+    const Candidate = struct { name: []const u8, unit: Unit };
+    var candidates: std.ArrayList(Candidate) = .empty;
+    for (units.keys(), units.values()) |name, u| {
+        if (self.used.contains(name)) continue;
+        candidates.append(a, .{ .name = name, .unit = u }) catch return;
+    }
+    std.mem.sort(Candidate, candidates.items, {}, struct {
+        fn lt(_: void, x: Candidate, y: Candidate) bool {
+            return x.unit.time < y.unit.time;
+        }
+    }.lt);
+
+    var dropped: usize = 0;
+    var dropped_bundles: std.ArrayList([]const u8) = .empty;
+    for (candidates.items) |c| {
+        if (total <= max) break;
+        const sep = std.mem.indexOfScalar(u8, c.name, '/').?;
+        const key = c.name[sep + 1 ..];
+        if (std.mem.eql(u8, c.name[0..sep], "formats")) {
+            delete_in(io, dir, "formats", key, &.{ ".fmt", ".img" });
+        } else {
+            delete_in(io, dir, "packs", key, &.{ ".pack", ".idx" });
+            delete_in(io, dir, "indexes", key, &.{ ".bin", ".txt" });
+            dropped_bundles.append(a, key) catch {};
+        }
+        total -|= c.unit.bytes;
+        _ = units.orderedRemove(c.name);
+        dropped += 1;
+    }
+    if (dropped == 0) return;
+
+    // loose files go with the last manifest listing them; manifests are
+    // removed after being read
+    var kept: std.StringHashMapUnmanaged(void) = .empty;
+    for (units.keys()) |name| {
+        if (!std.mem.startsWith(u8, name, "packs/")) continue;
+        for (read_loose_entries(io, a, dir, name["packs/".len..])) |e| kept.put(a, e.hash, {}) catch return;
+    }
+    for (dropped_bundles.items) |digest| {
+        for (read_loose_entries(io, a, dir, digest)) |e| {
+            if (kept.contains(e.hash)) continue;
+            var buf: [1024]u8 = undefined;
+            const path = std.fmt.bufPrint(&buf, "{s}/files/{s}/{s}", .{ dir, e.hash[0..2], e.hash[2..] }) catch continue;
+            Io.Dir.cwd().deleteFile(io, path) catch {};
+        }
+        delete_in(io, dir, "manifests", digest, &.{".txt"});
+    }
+    std.log.debug("cache over budget: dropped {d} bundles and formats, {d} bytes left", .{ dropped, total });
+}
+
+// add the files <64 hex><ext> in cache_dir/sub to the units kind/<hex>
+fn collect_units(io: Io, a: std.mem.Allocator, units: *Units, cache_dir: []const u8, sub: []const u8, kind: []const u8, exts: []const []const u8) void {
+    var buf: [1024]u8 = undefined;
+    const path = std.fmt.bufPrint(&buf, "{s}/{s}", .{ cache_dir, sub }) catch return;
+    var d = Io.Dir.cwd().openDir(io, path, .{ .iterate = true }) catch return;
+    defer d.close(io);
+    var it = d.iterate();
+    while (it.next(io) catch null) |entry| {
+        if (entry.kind != .file or entry.name.len <= 64) continue;
+        if (!ext_listed(exts, entry.name[64..])) continue;
+        const st = d.statFile(io, entry.name, .{}) catch continue;
+        const name = std.fmt.allocPrint(a, "{s}/{s}", .{ kind, entry.name[0..64] }) catch return;
+        const gop = units.getOrPut(a, name) catch return;
+        if (!gop.found_existing) gop.value_ptr.* = .{};
+        gop.value_ptr.bytes += st.size;
+        gop.value_ptr.time = @max(gop.value_ptr.time, unix_seconds(st.mtime.nanoseconds));
+    }
+}
+
+fn ext_listed(exts: []const []const u8, ext: []const u8) bool {
+    for (exts) |e| {
+        if (std.mem.eql(u8, e, ext)) return true;
+    }
+    return false;
+}
+
+fn delete_in(io: Io, cache_dir: []const u8, sub: []const u8, key: []const u8, exts: []const []const u8) void {
+    for (exts) |ext| {
+        var buf: [1024]u8 = undefined;
+        const path = std.fmt.bufPrint(&buf, "{s}/{s}/{s}{s}", .{ cache_dir, sub, key, ext }) catch continue;
+        Io.Dir.cwd().deleteFile(io, path) catch {};
+    }
+}
+
+const LooseEntry = struct {
+    hash: []const u8,
+    size: u32,
+};
+
+// the loose files manifests/<digest>.txt lists, a line per entry as
+// ingest_manifest reads them
+fn read_loose_entries(io: Io, a: std.mem.Allocator, cache_dir: []const u8, digest: []const u8) []const LooseEntry {
+    var buf: [1024]u8 = undefined;
+    const path = std.fmt.bufPrint(&buf, "{s}/manifests/{s}.txt", .{ cache_dir, digest }) catch return &.{};
+    const text = read_small(io, a, path) orelse return &.{};
+    var entries: std.ArrayList(LooseEntry) = .empty;
+    var lines = std.mem.splitScalar(u8, text, '\n');
+    while (lines.next()) |line| {
+        const trimmed = std.mem.trim(u8, line, " \t\r");
+        if (trimmed.len < 66 or trimmed[trimmed.len - 65] != ' ') continue;
+        const rest = trimmed[0 .. trimmed.len - 65];
+        const sp = std.mem.lastIndexOfScalar(u8, rest, ' ') orelse continue;
+        const size = std.fmt.parseInt(u32, rest[sp + 1 ..], 10) catch continue;
+        entries.append(a, .{ .hash = trimmed[trimmed.len - 64 ..], .size = size }) catch break;
+    }
+    return entries.items;
+}
+
+// a small file of the cache directory, arena-owned
+fn read_small(io: Io, a: std.mem.Allocator, path: []const u8) ?[]const u8 {
+    const file = Io.Dir.cwd().openFile(io, path, .{}) catch return null;
+    defer file.close(io);
+    const stat = file.stat(io) catch return null;
+    const text = a.alloc(u8, @intCast(@min(stat.size, 64 * 1024 * 1024))) catch return null;
+    const n = file.readPositionalAll(io, text, 0) catch return null;
+    return text[0..n];
+}
+
+// a size like "2G", "500M" or a byte count, for the budget
+pub fn parse_size(text: []const u8) ?u64 {
+    const t = std.mem.trim(u8, text, " ");
+    if (t.len == 0) return null;
+    const shift: u6 = switch (std.ascii.toUpper(t[t.len - 1])) {
+        'K' => 10,
+        'M' => 20,
+        'G' => 30,
+        'T' => 40,
+        else => 0,
+    };
+    const digits = if (shift == 0) t else t[0 .. t.len - 1];
+    const n = std.fmt.parseInt(u64, digits, 10) catch return null;
+    return std.math.shlExact(u64, n, shift) catch null;
 }
@@ -1,6 +1,7 @@
 const Compiler = @This();
 const std = @import("std");
 const builtin = @import("builtin");
+const build_options = @import("build_options");
 const Io = std.Io;
 const testing = std.testing;
 const fs_path = std.fs.path;
@@ -13,9 +14,20 @@ const Config = @import("Config.zig");
 const FormatCache = @import("FormatCache.zig");
 const Runtime = @import("Runtime.zig");
 const seeds = @import("seeds.zig");
+const Preamble = @import("Preamble.zig");
 const Project = @import("Project.zig");
+const Timeline = @import("Timeline.zig");
+const Sampler = @import("Sampler.zig");
+const MemStats = Bridge.MemStats;
+const Batch = @import("Batch.zig");
+const PdfUpdate = @import("PdfUpdate.zig");
+const SynctexIndex = @import("SynctexIndex.zig");
 const diag = @import("compile/diagnostics.zig");
 const aux = @import("compile/aux.zig");
+const memo = @import("compile/memo.zig");
+const pictures = @import("compile/pictures.zig");
+const RemoteCache = @import("RemoteCache.zig");
+const DiagRecords = @import("DiagRecords.zig");
 
 pub const Backend = enum {
     xetex,
@@ -37,7 +49,6 @@ pub fn engine_display_name(comptime b: Backend) []const u8 {
 }
 
 pub const Format = EngineApi.Format;
-const engine_serial: u32 = 33;
 
 pub const CompileConfig = struct {
     input_file: ?[]const u8 = null,
@@ -48,13 +59,60 @@ pub const CompileConfig = struct {
     verbose: bool = false,
     deterministic: bool = false,
     paperspec: []const u8 = "letter",
+    // how the PDF is written; null picks by mode (preview: fast, full: small)
+    pdf_profile: ?EngineApi.PdfProfile = null,
     synctex: bool = false,
+    // expansion profile of the last pass in <jobname>.flame, summary in the log
+    profile: bool = false,
+    // commands and environments the document can use in <jobname>.cmds, for
+    // editor completion
+    command_index: bool = false,
+    // reuse the line breaks of paragraphs unchanged since the previous pass
+    memo_linebreaks: bool = false,
+    // append what changed to the previous PDF instead of replacing it (see PdfUpdate.zig)
+    incremental_pdf: bool = false,
+    // <jobname>.pages.json beside the PDF: a digest per page, to tell which changed
+    page_digests: bool = false,
+    // PNGs with well over this many pixels per inch where they are placed are
+    // scaled down before embedding; 0 keeps them. null picks by mode
+    // (preview: preview_image_dpi, full: 0)
+    image_dpi: ?u16 = null,
+    // Chrome trace JSON of the compile's stages (see Timeline.zig)
+    trace_file: ?[]const u8 = null,
+    // start from a format with the document's preamble dumped into it,
+    // rebuilt when the preamble changes (see use_preamble_format)
+    preamble_format: bool = false,
+    // stop at <jobname>.xdv instead of running xdvipdfmx; `eztex pdf` (see
+    // xdv_to_pdf) turns it into the PDF later, possibly in another process
+    xdv_only: bool = false,
+    // keep the PDF as it is when nothing it was made from changed since the
+    // compile that wrote it (see compile/memo.zig)
+    reuse_output: bool = true,
+    // the file being edited: a preview typesets only the \include'd part
+    // holding it, when the other parts have their .aux (see focus_source)
+    focus: ?[]const u8 = null,
+    // the pages a preview shows: only they are converted to PDF, the others
+    // are left blank in their place for a later full conversion to fill in
+    pages: ?EngineApi.PageRange = null,
+    // typeset each TikZ picture once, into the cache, and include its PDF
+    // on later compiles (see PictureCache)
+    externalize_pictures: bool = false,
+    // a preview writes no <jobname>.log; its warnings and errors still reach
+    // the diagnostics (see DiagRecords). full compiles always write it
+    no_log: bool = false,
+    // a preview puts raster images in as gray boxes of their size, read from
+    // their headers only; full compiles always embed them
+    draft_images: bool = false,
     cache_dir: ?[]const u8 = null,
 };
 
 pub const max_auto_passes: u8 = 5;
 pub const max_preview_passes: u8 = 2;
 
+// the exit code of a preview that stopped at an error after converting the
+// pages shipped before it: a failed compile, with a PDF (or XDV) to show
+pub const exit_partial_output: u8 = 2;
+
 const stabilization_extensions = [_][]const u8{
     ".aux",
     ".toc",
@@ -79,10 +137,6 @@ const default_diag_handler = diag.default_diag_handler;
 const diag_write_with_severity = diag.diag_write_with_severity;
 const read_file_contents = aux.read_file_contents;
 const free_file_contents = aux.free_file_contents;
-const aux_changed = aux.aux_changed;
-const aux_is_biblatex = aux.aux_is_biblatex;
-const aux_needs_bibtex = aux.aux_needs_bibtex;
-const bibliography_state = aux.bibliography_state;
 const read_bibliography_state = aux.read_bibliography_state;
 const write_bibliography_state = aux.write_bibliography_state;
 const bib_inputs_changed = aux.bib_inputs_changed;
@@ -96,21 +150,22 @@ const BibliographyAction = enum {
     unsupported_biblatex,
 };
 
-fn bibliography_action(io: Io, aux_path: []const u8, aux_contents: ?[]const u8) BibliographyAction {
-    if (aux_needs_bibtex(io, aux_path, aux_contents)) return .run_bibtex;
-    if (aux_is_biblatex(io, aux_path, aux_contents)) return .unsupported_biblatex;
-    return .none;
+fn bibliography_action(kind: aux.BibliographyKind) BibliographyAction {
+    return switch (kind) {
+        .bibtex => .run_bibtex,
+        .biblatex => .unsupported_biblatex,
+        .none => .none,
+    };
 }
 
-fn preview_needs_bibtex(io: Io, bbl_path: []const u8, current_state: ?aux.BibliographyState, bib_state_path: []const u8) bool {
+// whether the .bbl on disk is missing or was made from other citations, style or
+// databases than the aux names now (see the .bibstate written after bibtex runs)
+fn bibtex_outputs_stale(io: Io, bbl_path: []const u8, current_state: ?aux.BibliographyState, bib_state_path: []const u8) bool {
     if (current_state == null) return true;
 
-    if (Io.Dir.cwd().access(io, bbl_path, .{})) |_| {
-        const previous_state = read_bibliography_state(io, bib_state_path);
-        return bib_inputs_changed(current_state, previous_state) or bib_citations_changed(current_state, previous_state);
-    } else |_| {
-        return true;
-    }
+    if (!aux.file_exists(io, bbl_path)) return true;
+    const previous_state = read_bibliography_state(io, bib_state_path);
+    return bib_inputs_changed(current_state, previous_state) or bib_citations_changed(current_state, previous_state);
 }
 
 fn persist_bibliography_state(io: Io, path: []const u8, state: ?aux.BibliographyState) void {
@@ -120,8 +175,79 @@ fn persist_bibliography_state(io: Io, path: []const u8, state: ?aux.Bibliography
     };
 }
 
-fn on_checkpoint(_: ?*anyopaque, id: c_int) void {
-    _ = id;
+extern fn _tt_abort(format: [*:0]const u8, ...) noreturn;
+
+// set when a superseded compile was stopped; its run reports nothing further
+threadlocal var g_cancelled: bool = false;
+
+// what one job of `eztex serve --max-cpu/--max-memory` may use. checked
+// where cancellation is, as each page ships out, so a runaway document is
+// stopped at its next page and the job fails saying why
+pub const Limits = struct {
+    cpu_ms: ?u64 = null,
+    memory_bytes: ?u64 = null,
+};
+
+pub threadlocal var limits: Limits = .{};
+threadlocal var g_cpu_start_us: u64 = 0;
+
+// how this thread's compiles were served, for the metrics of `eztex serve`
+pub const CacheStats = struct {
+    compiles: u64 = 0,
+    memo_hits: u64 = 0,
+    remote_hits: u64 = 0,
+    format_hits: u64 = 0,
+    format_misses: u64 = 0,
+};
+
+pub threadlocal var cache_stats: CacheStats = .{};
+
+fn over_limit() ?[*:0]const u8 {
+    if (limits.cpu_ms) |max| if (Host.cpu_time_us()) |now| {
+        if (now -| g_cpu_start_us > max * std.time.us_per_ms) return "compile stopped: over its CPU time limit";
+    };
+    if (limits.memory_bytes) |max| {
+        if (MemStats.snapshot().total.current > max) return "compile stopped: over its memory limit";
+    }
+    return null;
+}
+
+// pages are where a run can be stopped cheaply: the host is asked before each
+// ship_out, and a superseded compile leaves the engine through its fatal
+// error path (the same as any abort, so a resident instance stays usable)
+fn on_checkpoint(_: ?*anyopaque, id: c_int, detail: ?[*:0]const u8) void {
+    if (id == Timeline.checkpoint_shipout_begin and Host.cancel_requested()) {
+        g_cancelled = true;
+        _tt_abort("compile cancelled");
+    }
+    if (id == Timeline.checkpoint_shipout_begin) {
+        if (over_limit()) |reason| _tt_abort("%s", reason);
+    }
+    Timeline.checkpoint(id, detail);
+    Sampler.checkpoint(id, detail);
+}
+
+// the compile's heap by subsystem (see MemStats.zig), as trace notes
+fn trace_memory_stats() void {
+    const stats = MemStats.snapshot();
+    inline for (std.meta.tags(MemStats.Tag)) |tag| {
+        const c = stats.tags[@intFromEnum(tag)];
+        Timeline.note_bytes(.compile, "peak memory: " ++ @tagName(tag), @intCast(@max(c.peak, 0)));
+        Timeline.note_bytes(.compile, "live memory: " ++ @tagName(tag), @intCast(@max(c.current, 0)));
+    }
+    Timeline.note_bytes(.compile, "peak memory: total", @intCast(@max(stats.total.peak, 0)));
+}
+
+// the sampling profile's histogram, into the log (the app's log panel)
+fn log_sampling_profile(io: Io) void {
+    defer Sampler.discard();
+    var buf: [4096]u8 = undefined;
+    var w: Io.Writer = .fixed(&buf);
+    Sampler.write_report(&w, 15) catch {};
+    var lines = std.mem.splitScalar(u8, w.buffered(), '\n');
+    while (lines.next()) |line| {
+        if (line.len > 0) Log.log(io, "profile", .info, "{s}", .{line});
+    }
 }
 
 fn get_stem(input_file: []const u8) []const u8 {
@@ -168,6 +294,9 @@ fn current_build_date(deterministic: bool) u64 {
     return @intCast(@max(ts.sec, 0));
 }
 
+// enough for a screen at the zoom a preview is read at
+const preview_image_dpi: u16 = 150;
+
 fn create_default_engine(io: Io, world: *Bridge.World, opts: *const CompileConfig) !EngineApi.Engine {
     const cfg = EngineApi.EngineConfig{
         .allocator = std.heap.c_allocator,
@@ -177,27 +306,183 @@ fn create_default_engine(io: Io, world: *Bridge.World, opts: *const CompileConfi
         .build_date = current_build_date(opts.deterministic),
         .deterministic = opts.deterministic,
         .paperspec = opts.paperspec,
+        .pdf_profile = opts.pdf_profile orelse switch (opts.mode) {
+            .preview => .fast,
+            .full => .small,
+        },
+        .page_digests = opts.page_digests,
+        .image_dpi = opts.image_dpi orelse switch (opts.mode) {
+            .preview => preview_image_dpi,
+            .full => 0,
+        },
+        .draft_images = opts.draft_images and opts.mode == .preview,
+        .pages = if (opts.mode == .preview) opts.pages else null,
     };
     return EngineApi.tectonic.create(&cfg);
 }
 
-fn run_engine(engine: EngineApi.Engine, input_file: []const u8, format: Format, opts: *const CompileConfig) !EngineApi.EngineResult {
+fn run_engine(engine: EngineApi.Engine, input_file: []const u8, format: Format, opts: *const CompileConfig, draft: bool, pass: u8) !EngineApi.EngineResult {
+    const started = Timeline.now();
+    defer {
+        var label_buf: [24]u8 = undefined;
+        const label = std.fmt.bufPrint(&label_buf, "{d}{s}", .{ pass, if (draft) @as([]const u8, " (draft)") else "" }) catch null;
+        Timeline.span(.engine, "pass", label, started);
+    }
     try engine.setFormat(format);
-    try engine.setVariable(.synctex, .{ .boolean = opts.synctex });
+    // a draft pass is never the last, so its .synctex would only be overwritten
+    try engine.setVariable(.synctex, .{ .boolean = opts.synctex and !draft });
     try engine.setVariable(.halt_on_error, .{ .boolean = true });
+    try engine.setVariable(.draft_pass, .{ .boolean = draft });
+    try engine.setVariable(.profile_expansion, .{ .boolean = opts.profile });
+    try engine.setVariable(.sample_interval, .{ .integer = if (Sampler.enabled()) Sampler.default_interval else 0 });
+    Sampler.set_phase("typesetting");
+    try engine.setVariable(.command_index, .{ .boolean = opts.command_index and !draft });
+    // the memo lives as long as the process; start each document afresh
+    if (pass == 1) try engine.setVariable(.linebreak_memo, .{ .boolean = false });
+    try engine.setVariable(.linebreak_memo, .{ .boolean = opts.memo_linebreaks });
     try engine.setPrimaryInput(input_file);
     return engine.run();
 }
 
 fn run_bibtex(io: Io, engine: EngineApi.Engine, aux_name: []const u8) EngineApi.EngineResult {
+    const started = Timeline.now();
+    defer Timeline.span(.bibtex, "bibtex", aux_name, started);
+    Sampler.set_phase("bibtex");
     return engine.runBibtex(aux_name) catch |err| {
         Log.log(io, "eztex", .err, "bibtex failed to start: {}", .{err});
         return .{ .code = 3 };
     };
 }
 
+// the .bbl, .blg or .bibstate beside an aux file
+fn bibtex_companion(buf: []u8, aux_path: []const u8, ext: []const u8) ?[]const u8 {
+    const stem = if (std.mem.endsWith(u8, aux_path, ".aux")) aux_path[0 .. aux_path.len - 4] else aux_path;
+    return std.fmt.bufPrint(buf, "{s}{s}", .{ stem, ext }) catch null;
+}
+
+// one hash over the .bbl of each of jobs, missing ones included, to
+// tell whether a bibtex run changed what the pass before it read
+fn bbl_digest(io: Io, jobs: []const aux.BibtexJob) u64 {
+    var hasher = std.hash.Wyhash.init(0);
+    for (jobs) |job| {
+        var bbl_buf: [512]u8 = undefined;
+        const bbl_path = bibtex_companion(&bbl_buf, job.path, ".bbl") orelse continue;
+        const contents = read_file_contents(io, bbl_path);
+        defer free_file_contents(contents);
+        hasher.update(bbl_path);
+        if (contents) |c| {
+            hasher.update(std.mem.asBytes(&c.len));
+            hasher.update(c);
+        } else {
+            hasher.update("\x00missing");
+        }
+    }
+    return hasher.final();
+}
+
+fn report_bibtex_failure(io: Io, engine: EngineApi.Engine, aux_path: []const u8, code: c_int) void {
+    Log.log(io, "eztex", .err, "bibtex failed on '{s}' (exit code {d})", .{ aux_path, code });
+
+    const msg_slice = engine.errorMessage();
+    if (msg_slice.len > 0) {
+        diag_write_with_severity(io, msg_slice, "error");
+    }
+
+    var blg_buf: [512]u8 = undefined;
+    if (bibtex_companion(&blg_buf, aux_path, ".blg")) |path| {
+        if (aux.file_exists(io, path)) {
+            Log.log(io, "eztex", .info, "preserved bibtex log: {s}", .{path});
+        }
+    }
+}
+
+// the bibtex jobs of one document, for Batch.run_indexed. a job on a forked
+// worker reports its own failure, since only the exit code comes back.
+const BibtexJobs = struct {
+    engine: EngineApi.Engine,
+    aux_paths: []const []const u8,
+
+    pub fn run_one(self: *const BibtexJobs, io: Io, i: usize) u8 {
+        const result = run_bibtex(io, self.engine, self.aux_paths[i]);
+        if (!result.succeeded()) report_bibtex_failure(io, self.engine, self.aux_paths[i], result.code);
+        return @intCast(std.math.clamp(result.code, 0, 255));
+    }
+};
+
+fn forget_bibtex_outputs(world: *Bridge.World, aux_paths: []const []const u8) void {
+    for (aux_paths) |path| {
+        for ([_][]const u8{ ".bbl", ".blg" }) |ext| {
+            var buf: [512]u8 = undefined;
+            if (bibtex_companion(&buf, path, ext)) |name| world.forget_missing(name);
+        }
+    }
+}
+
+// run bibtex on each of bib_jobs (see aux.scan_aux) whose .bbl is stale.
+// several run side by side on forked workers: the engine's state is its
+// process's, and each job leaves a .bbl and .blg of its own. null when every
+// .bbl could be reused, else the first failure in order or success.
+fn run_bibtex_jobs(io: Io, engine: EngineApi.Engine, bib_jobs: []const aux.BibtexJob) ?EngineApi.EngineResult {
+    const alloc = aux.scratch_allocator();
+    var stale: std.ArrayListUnmanaged([]const u8) = .empty;
+    defer stale.deinit(alloc);
+    var states: std.ArrayListUnmanaged(?aux.BibliographyState) = .empty;
+    defer states.deinit(alloc);
+
+    for (bib_jobs) |job| {
+        const path = job.path;
+        const state = job.state;
+
+        var bbl_buf: [512]u8 = undefined;
+        var state_buf: [512]u8 = undefined;
+        const bbl_path = bibtex_companion(&bbl_buf, path, ".bbl");
+        const state_path = bibtex_companion(&state_buf, path, ".bibstate");
+        if (bbl_path != null and state_path != null and !bibtex_outputs_stale(io, bbl_path.?, state, state_path.?)) {
+            Log.log(io, "eztex", .info, "citations and databases unchanged, reusing {s}", .{bbl_path.?});
+            continue;
+        }
+        stale.append(alloc, path) catch return .{ .code = 3 };
+        states.append(alloc, state) catch return .{ .code = 3 };
+    }
+    if (stale.items.len == 0) return null;
+
+    Log.log(io, "eztex", .info, "aux file contains bibliography commands, running bibtex...", .{});
+    const codes = alloc.alloc(?u8, stale.items.len) catch return .{ .code = 3 };
+    defer alloc.free(codes);
+    const jobs = BibtexJobs{ .engine = engine, .aux_paths = stale.items };
+    if (stale.items.len > 1) Log.dbg(io, "eztex", "bibtex: {d} aux files with bibliographies of their own", .{stale.items.len});
+    // a forked job's own span stays in its worker; this one covers them all
+    const started = Timeline.now();
+    // a forked job could not hand back the .bbl of an embedded compile
+    const workers = if (is_wasm or Bridge.get_world().memory_files != null) 1 else Batch.default_jobs(stale.items.len);
+    Batch.run_indexed(io, stale.items.len, workers, &jobs, codes);
+    if (stale.items.len > 1) Timeline.span(.bibtex, "bibtex jobs", null, started);
+    // a forked job forgot its outputs in its worker's world only: the next
+    // pass has to find the .bbl a pass before it probed for in vain
+    forget_bibtex_outputs(Bridge.get_world(), stale.items);
+
+    var result: EngineApi.EngineResult = .{ .code = 0 };
+    for (stale.items, states.items, codes) |path, state, code| {
+        const job_result: EngineApi.EngineResult = if (code) |exit_code| .{ .code = exit_code } else blk: {
+            Log.log(io, "eztex", .err, "bibtex on '{s}' did not finish", .{path});
+            break :blk .{ .code = 3 };
+        };
+        if (job_result.succeeded()) {
+            var state_buf: [512]u8 = undefined;
+            if (bibtex_companion(&state_buf, path, ".bibstate")) |state_path| persist_bibliography_state(io, state_path, state);
+        } else if (result.succeeded()) {
+            result = job_result;
+        }
+    }
+    return result;
+}
+
 fn run_initex(io: Io, world: *Bridge.World, engine: EngineApi.Engine, format: Format, force: bool) void {
     const fmt_path = engine.generatedFormatPath(format);
+    // the format goes to the cache on disk, even for an embedded compile
+    const memory_files = world.memory_files;
+    world.memory_files = null;
+    defer world.memory_files = memory_files;
 
     if (force) {
         Io.Dir.cwd().deleteFile(io, fmt_path) catch {};
@@ -277,9 +562,12 @@ fn run_initex(io: Io, world: *Bridge.World, engine: EngineApi.Engine, format: Fo
     world.reset_io(io);
 }
 
-var g_fmt_buf: [1024]u8 = undefined;
-var g_format_bytes: ?[]u8 = null;
-var g_format_key: ?FormatCache.Key = null;
+threadlocal var g_fmt_buf: [1024]u8 = undefined;
+// formats and dumped preambles of recent compiles, so a watch or server
+// session moving between documents, bundles or preambles reuses them from
+// memory. the browser's engine keeps only the one in use and the newest.
+threadlocal var g_formats: FormatCache.MemoryCache = .{ .budget = if (is_wasm) 0 else format_memory_budget };
+const format_memory_budget: usize = 256 * 1024 * 1024;
 
 fn format_cache_type(format: Format) FormatCache.FormatType {
     return switch (backend) {
@@ -295,48 +583,35 @@ fn format_cache_type(format: Format) FormatCache.FormatType {
 }
 
 fn make_format_cache_key(format: Format, active_digest: *const [64]u8) FormatCache.Key {
-    var digest_bytes: [32]u8 = undefined;
-    for (0..32) |i| {
-        const hi = hex_digit(active_digest[i * 2]);
-        const lo = hex_digit(active_digest[i * 2 + 1]);
-        digest_bytes[i] = (hi << 4) | lo;
-    }
-    return .{
-        .bundle_digest = digest_bytes,
-        .engine_version = @intCast(engine_serial),
-        .format_type = format_cache_type(format),
-    };
-}
-
-fn hex_digit(c: u8) u8 {
-    return switch (c) {
-        '0'...'9' => c - '0',
-        'a'...'f' => c - 'a' + 10,
-        'A'...'F' => c - 'A' + 10,
-        else => 0,
-    };
+    return FormatCache.Key.init(active_digest, format_cache_type(format));
 }
 
 fn try_load_cached_format(io: Io, world: *Bridge.World, engine: EngineApi.Engine, cache_dir: []const u8, format: Format, active_digest: *const [64]u8) bool {
     const fmt_filename = engine.formatFileName(format);
     const key = make_format_cache_key(format, active_digest);
 
-    if (g_format_bytes) |bytes| {
-        if (g_format_key) |cached_key| {
-            const key_matches = std.mem.eql(u8, &cached_key.bundle_digest, &key.bundle_digest) and
-                cached_key.engine_version == key.engine_version and
-                cached_key.format_type == key.format_type;
-            if (key_matches) {
-                world.set_format_data(bytes, fmt_filename);
-                Log.dbg(io, "eztex", "reusing in-memory format ({d} bytes)", .{bytes.len});
-                return true;
-            }
+    if (g_formats.get(key)) |entry| {
+        if (entry.bytes) |bytes| {
+            g_formats.use(key);
+            world.set_format_data(bytes, fmt_filename);
+            set_format_image(world, cache_dir, key);
+            Log.dbg(io, "eztex", "reusing in-memory format ({d} bytes)", .{bytes.len});
+            return true;
+        }
+    }
+
+    if (!is_wasm) {
+        if (FormatCache.map(io, cache_dir, key)) |mapped| {
+            set_format_memory(world, mapped, true, fmt_filename, key);
+            set_format_image(world, cache_dir, key);
+            Log.dbg(io, "eztex", "mapped format from content-addressed cache ({d} bytes)", .{mapped.len});
+            return true;
         }
-        // Different key, will load new one (old will be freed when new is set)
     }
 
     if (FormatCache.load(io, std.heap.c_allocator, cache_dir, key) catch null) |bytes| {
-        set_format_memory(world, bytes, fmt_filename, key);
+        set_format_memory(world, bytes, false, fmt_filename, key);
+        set_format_image(world, cache_dir, key);
         Log.dbg(io, "eztex", "loaded format from content-addressed cache ({d} bytes, memory-backed)", .{bytes.len});
         return true;
     }
@@ -373,7 +648,7 @@ fn try_load_cached_format(io: Io, world: *Bridge.World, engine: EngineApi.Engine
             Log.dbg(io, "eztex", "short read of format file: {d}/{d} bytes", .{ bytes_read, size });
             return false;
         }
-        set_format_memory(world, bytes, fmt_filename, key);
+        set_format_memory(world, bytes, false, fmt_filename, key);
         Log.dbg(io, "eztex", "loaded legacy format into memory ({d} bytes)", .{bytes.len});
         return true;
     }
@@ -381,24 +656,30 @@ fn try_load_cached_format(io: Io, world: *Bridge.World, engine: EngineApi.Engine
     return false;
 }
 
-fn set_format_memory(world: *Bridge.World, bytes: []u8, name: []const u8, key: FormatCache.Key) void {
-    // Take ownership of bytes (caller must transfer ownership to us)
-    // Free old format data unconditionally when overwriting
-    if (g_format_bytes) |old| {
-        std.heap.c_allocator.free(old);
-    }
-    g_format_bytes = bytes;
-    g_format_key = key;
+// takes ownership of bytes (c_allocator memory, or a mapping if mapped)
+fn set_format_memory(world: *Bridge.World, bytes: []const u8, mapped: bool, name: []const u8, key: FormatCache.Key) void {
+    // the world lets go of the format in use before the cache may drop it
+    world.clear_format_data();
+    g_formats.in_use = null;
+    g_formats.put(key, bytes, mapped);
+    g_formats.use(key);
     world.set_format_data(bytes, name);
 }
 
-fn clear_format_memory(world: *Bridge.World) void {
-    if (g_format_bytes) |old| {
-        std.heap.c_allocator.free(old);
-        g_format_bytes = null;
-    }
-    g_format_key = null;
+// let the engine restore from (or write) the format image kept next to the
+// cached format, skipping the per-item undump (see load_fmt_file)
+fn set_format_image(world: *Bridge.World, cache_dir: []const u8, key: FormatCache.Key) void {
+    const name = key.hex_filename();
+    Host.cache_note_format(name[0..64]);
+    var buf: [1024]u8 = undefined;
+    const path = FormatCache.image_path(cache_dir, key, &buf) orelse return;
+    world.set_format_image_path(path);
+}
+
+fn clear_format_memory(io: Io, world: *Bridge.World) void {
+    world.clear_format_image(io);
     world.clear_format_data();
+    g_formats.in_use = null;
 }
 
 fn cache_generated_format(io: Io, engine: EngineApi.Engine, cache_dir: []const u8, format: Format, key: FormatCache.Key) void {
@@ -439,15 +720,151 @@ fn load_generated_format(io: Io, world: *Bridge.World, engine: EngineApi.Engine,
         return false;
     }
 
-    set_format_memory(world, bytes, engine.formatFileName(format), key);
+    set_format_memory(world, bytes, false, engine.formatFileName(format), key);
+    return true;
+}
+
+// the document's preamble dumped on top of the loaded format is kept in
+// g_formats under its own key; an entry without bytes is a preamble that did
+// not dump. the format in use stays while a preamble is added, since the
+// world still holds it.
+fn set_preamble_memory(bytes: ?[]const u8, mapped: bool, key: FormatCache.Key) void {
+    g_formats.put(key, bytes, mapped);
+}
+
+fn preamble_known(key: FormatCache.Key) bool {
+    return g_formats.get(key) != null;
+}
+
+// what a dumped preamble depends on besides the format: its text and the
+// local classes and packages it loads
+fn preamble_digest(io: Io, preamble: []const u8, input_dir: ?[]const u8) [32]u8 {
+    var h = std.crypto.hash.sha2.Sha256.init(.{});
+    h.update(preamble);
+    var it = Preamble.iterate(preamble);
+    while (it.next()) |item| {
+        const ext = switch (item.kind) {
+            .class => "cls",
+            .package => "sty",
+        };
+        var buf: [1024]u8 = undefined;
+        const path = (if (input_dir) |dir|
+            std.fmt.bufPrint(&buf, "{s}/{s}.{s}", .{ dir, item.name, ext })
+        else
+            std.fmt.bufPrint(&buf, "{s}.{s}", .{ item.name, ext })) catch continue;
+        const contents = read_project_file(io, path) orelse continue;
+        defer free_file_contents(contents);
+        h.update(path);
+        h.update(&.{0});
+        h.update(contents);
+    }
+    return h.finalResult();
+}
+
+fn load_cached_preamble_format(io: Io, cache_dir: []const u8, key: FormatCache.Key) void {
+    if (!is_wasm) {
+        if (FormatCache.map(io, cache_dir, key)) |mapped| return set_preamble_memory(mapped, true, key);
+    }
+    if (FormatCache.load(io, std.heap.c_allocator, cache_dir, key) catch null) |bytes| {
+        return set_preamble_memory(bytes, false, key);
+    }
+    // stored empty: this preamble did not dump before
+    if (FormatCache.exists(io, cache_dir, key)) set_preamble_memory(null, false, key);
+}
+
+// start the engine from a format holding the document's preamble, so every
+// pass begins at \begin{document}. the format is dumped on first use and
+// reused, from memory or the format cache, until the preamble or a local
+// package it loads changes. false leaves the world on the regular format.
+fn use_preamble_format(io: Io, world: *Bridge.World, engine: EngineApi.Engine, cache_dir: ?[]const u8, format: Format, bundle_digest: *const [64]u8, input_file: []const u8) bool {
+    const source = read_project_file(io, input_file) orelse return false;
+    defer free_file_contents(source);
+    const preamble = Preamble.dumpable(source) orelse return false;
+
+    var key = make_format_cache_key(format, bundle_digest);
+    key.preamble = preamble_digest(io, preamble, fs_path.dirname(input_file));
+    const key_name = key.hex_filename();
+    Host.cache_note_format(key_name[0..64]);
+
+    if (!preamble_known(key)) {
+        if (cache_dir) |cdir| load_cached_preamble_format(io, cdir, key);
+    }
+    if (!preamble_known(key)) {
+        const bytes = dump_preamble_format(io, world, engine, format, input_file);
+        set_preamble_memory(bytes, false, key);
+        if (cache_dir) |cdir| {
+            FormatCache.store(io, std.heap.c_allocator, cdir, key, bytes orelse "") catch |err| {
+                Log.dbg(io, "eztex", "failed to cache preamble format: {}", .{err});
+            };
+        }
+    }
+
+    const bytes = (g_formats.get(key) orelse return false).bytes orelse return false;
+    g_formats.use(key);
+    world.set_format_data(bytes, engine.formatFileName(format));
+    world.clear_format_image(io);
+    world.host_format_image = false;
+    if (cache_dir) |cdir| set_format_image(world, cdir, key);
     return true;
 }
 
-fn setup_world(io: Io, engine: EngineApi.Engine, format: Format, verbose: bool, cache_dir_override: ?[]const u8, bundle: Config.ResolvedBundle, bundle_digest: *const [64]u8, deterministic: bool) void {
+// run initex on top of the loaded format until the document reaches
+// \begin{document} (see Preamble.dump_driver) and return the dumped format,
+// c_allocator-owned, or null if it did not dump. fontspec and other native
+// fonts cannot be dumped, so such preambles end up here.
+fn dump_preamble_format(io: Io, world: *Bridge.World, engine: EngineApi.Engine, format: Format, input_file: []const u8) ?[]const u8 {
+    const started = Timeline.now();
+    defer Timeline.span(.compile, "preamble format", null, started);
+
+    const driver = Preamble.dump_driver(std.heap.c_allocator, input_file) catch return null;
+    defer std.heap.c_allocator.free(driver);
+
+    // the driver runs under the document's jobname, so the preamble sees the
+    // \jobname of later runs, and dumps to tmp/<jobname>.fmt
+    const jobname = get_jobname(input_file);
+    var fmt_buf: [512]u8 = undefined;
+    const fmt_path = std.fmt.bufPrint(&fmt_buf, "tmp/{s}.fmt", .{jobname}) catch return null;
+    var log_buf: [512]u8 = undefined;
+    const log_path = std.fmt.bufPrint(&log_buf, "tmp/{s}.log", .{jobname}) catch return null;
+
+    Bridge.set_diagnostic_handler(diag.quiet_diag_handler);
+    defer Bridge.set_diagnostic_handler(default_diag_handler);
+    defer world.reset_io(io);
+    defer {
+        Io.Dir.cwd().deleteFile(io, fmt_path) catch {};
+        Io.Dir.cwd().deleteFile(io, log_path) catch {};
+    }
+
+    engine.prepareInitex("tmp") catch return null;
+    defer engine.finishInitex() catch {};
+    engine.setVariable(.preload_format, .{ .boolean = true }) catch return null;
+    engine.setFormat(format) catch return null;
+    engine.setPrimaryInput(input_file) catch return null;
+    world.primary_input_override = driver;
+    defer world.primary_input_override = null;
+
+    Log.dbg(io, "eztex", "dumping the preamble of {s}...", .{input_file});
+    const result = engine.run() catch return null;
+    if (!result.succeeded()) {
+        Log.dbg(io, "eztex", "preamble did not dump (exit code {d})", .{result.code});
+        return null;
+    }
+    const bytes = read_file_contents(io, fmt_path) orelse return null;
+    if (bytes.len == 0) {
+        free_file_contents(bytes);
+        return null;
+    }
+    return bytes;
+}
+
+// returns the format cache directory, null on wasm
+fn setup_world(io: Io, engine: EngineApi.Engine, format: Format, verbose: bool, cache_dir_override: ?[]const u8, bundle: Config.ResolvedBundle, bundle_digest: *const [64]u8, deterministic: bool, background_formats: bool) ?[]const u8 {
     const world = Bridge.get_world();
     world.reset_search_dirs();
+    world.clear_missing_inputs();
     world.add_search_dir(".");
     world.deterministic_mtime = if (deterministic) 1 else null;
+    world.host_format_image = true;
 
     Bridge.set_diagnostic_handler(default_diag_handler);
     Bridge.set_checkpoint_callback(.{
@@ -465,25 +882,35 @@ fn setup_world(io: Io, engine: EngineApi.Engine, format: Format, verbose: bool,
     const key = make_format_cache_key(format, bundle_digest);
 
     if (cache_dir) |cdir| {
-        if (!try_load_cached_format(io, world, engine, cdir, format, bundle_digest)) {
-            clear_format_memory(world);
+        world.clear_format_image(io);
+        if (try_load_cached_format(io, world, engine, cdir, format, bundle_digest)) {
+            cache_stats.format_hits += 1;
+        } else {
+            cache_stats.format_misses += 1;
+            clear_format_memory(io, world);
             if (!is_wasm and format == .latex) seed_cache(io, &seeds.xelatex_fmt);
             run_initex(io, world, engine, format, true);
             if (load_generated_format(io, world, engine, format, key)) {
                 cache_generated_format(io, engine, cdir, format, key);
+                set_format_image(world, cdir, key);
+            }
+            // a miss means a new bundle or engine: build the other formats now,
+            // off the critical path, instead of on their first compile
+            if (background_formats and !is_wasm and Host.generate_formats_in_background(cache_dir_override)) {
+                Log.dbg(io, "eztex", "generating remaining formats in the background", .{});
             }
         }
     } else {
-        clear_format_memory(world);
+        clear_format_memory(io, world);
         run_initex(io, world, engine, format, false);
         _ = load_generated_format(io, world, engine, format, key);
     }
+    return cache_dir;
 }
 
 const default_seed_concurrency: usize = 6;
 
 fn seed_cache(io: Io, names: []const []const u8) void {
-    if (is_wasm) return;
     const bs = Bridge.get_bundle_store();
     const result = bs.seed_cache(io, names, default_seed_concurrency);
     Log.dbg(io, "eztex", "seed: {d} fetched, {d} cached, {d} unknown, {d} failed", .{
@@ -491,22 +918,334 @@ fn seed_cache(io: Io, names: []const []const u8) void {
     });
 }
 
+// seed the static init list together with the bundle files earlier compiles of
+// documents with the same format and preamble packages opened (see
+// BundleStore.begin_trace). without such a list, seed the preamble's class and
+// package closure instead, one parallel batch per \RequirePackage level.
+fn seed_for_document(io: Io, input_file: []const u8, format: Format) void {
+    const bs = Bridge.get_bundle_store();
+    const source = read_project_file(io, input_file);
+    defer aux.free_file_contents(source);
+    const src = source orelse "";
+    const predicted = bs.begin_trace(Preamble.key(@tagName(format), src));
+
+    if (predicted.len == 0) {
+        const result = bs.seed_preamble_closure(io, src, &seeds.init, default_seed_concurrency);
+        Log.dbg(io, "eztex", "seed: {d} fetched, {d} cached, {d} unknown, {d} failed (with preamble closure)", .{
+            result.fetched, result.skipped_cached, result.skipped_unknown, result.failed,
+        });
+        return;
+    }
+
+    var names: std.ArrayList([]const u8) = .empty;
+    defer names.deinit(std.heap.c_allocator);
+    names.appendSlice(std.heap.c_allocator, &seeds.init) catch {};
+    names.appendSlice(std.heap.c_allocator, predicted) catch {};
+    Log.dbg(io, "eztex", "seed: {d} files predicted from earlier compiles", .{predicted.len});
+    seed_cache(io, names.items);
+}
+
+// a file of the document: from the project archive of a zip project (see
+// World.archive), else from disk. free with free_file_contents
+fn read_project_file(io: Io, path: []const u8) ?[]const u8 {
+    if (Bridge.get_world().archive) |archive| {
+        if (archive.read_alloc(std.heap.c_allocator, path) catch null) |data| return data;
+    }
+    return read_file_contents(io, path);
+}
+
+// which \include'd part of source focus (the file being edited) is, by the
+// name \include gives it. only when every other part has its .aux from
+// an earlier compile: LaTeX reads those for the parts \includeonly leaves
+// out, so their labels, pages and counters carry over
+fn focused_part(io: Io, source: []const u8, input_dir: ?[]const u8, focus: []const u8) ?[]const u8 {
+    var name = focus;
+    if (input_dir) |dir| {
+        if (std.mem.startsWith(u8, name, dir) and name.len > dir.len and name[dir.len] == '/') name = name[dir.len + 1 ..];
+    }
+    if (std.mem.startsWith(u8, name, "./")) name = name[2..];
+    if (std.mem.endsWith(u8, name, ".tex")) name = name[0 .. name.len - 4];
+
+    var part: ?[]const u8 = null;
+    var it = Preamble.includes(source);
+    while (it.next()) |include| {
+        const bare = if (std.mem.endsWith(u8, include, ".tex")) include[0 .. include.len - 4] else include;
+        if (std.mem.eql(u8, bare, name)) {
+            part = include;
+            continue;
+        }
+        var buf: [512]u8 = undefined;
+        const aux_name = std.fmt.bufPrint(&buf, "{s}.aux", .{bare}) catch return null;
+        if (!aux.file_exists(io, aux_name)) {
+            Log.dbg(io, "eztex", "focus: no {s} from an earlier compile, typesetting every part", .{aux_name});
+            return null;
+        }
+    }
+    return part;
+}
+
+// the document with \includeonly{part} in front, when a preview can
+// typeset only the part holding opts.focus. the line goes on the first line
+// of the document, so every line number stays where it was. free with
+// free_file_contents
+fn focus_source(io: Io, input_file: []const u8, input_dir: ?[]const u8, opts: *const CompileConfig) ?[]const u8 {
+    const focus = opts.focus orelse return null;
+    if (opts.mode != .preview or opts.format != .latex) return null;
+    const source = read_project_file(io, input_file) orelse return null;
+    defer free_file_contents(source);
+    const part = focused_part(io, source, input_dir, focus) orelse return null;
+    Log.dbg(io, "eztex", "focus: typesetting only \\include{{{s}}}", .{part});
+    return std.fmt.allocPrint(std.heap.c_allocator, "\\includeonly{{{s}}}{s}", .{ part, source }) catch null;
+}
+
+// the picture cache of a compile (see compile/pictures.zig): the input
+// filter swaps each picture with a PDF there for it, and notes the others
+// for compile_pictures. latex documents with a preamble that reads no files
+// of its own (see Preamble.dumpable) only: the key of a picture covers the
+// preamble's text and the local packages it loads, nothing else
+const PictureCache = struct {
+    io: Io,
+    // <cache>/pictures
+    dir_buf: [1024]u8 = undefined,
+    dir_len: usize = 0,
+    // the preamble the pictures are typeset under, c_allocator-owned
+    preamble: []const u8,
+    // what their PDFs depend on besides their own text
+    digest: [32]u8,
+    // the pictures with no PDF yet, by key, texts c_allocator-owned
+    misses: std.AutoArrayHashMapUnmanaged(pictures.Key, []const u8) = .empty,
+
+    fn open(io: Io, cache_dir: []const u8, input_file: []const u8, format: Format, bundle_digest: *const [64]u8, opts: *const CompileConfig) ?PictureCache {
+        const source = read_project_file(io, input_file) orelse return null;
+        defer free_file_contents(source);
+        const preamble = Preamble.dumpable(source) orelse {
+            Log.dbg(io, "eztex", "pictures: the preamble reads files of its own, typesetting pictures in place", .{});
+            return null;
+        };
+
+        var h = std.crypto.hash.sha2.Sha256.init(.{});
+        h.update(&preamble_digest(io, preamble, fs_path.dirname(input_file)));
+        h.update(&make_format_cache_key(format, bundle_digest).hash());
+        const flags = [_]u8{
+            @intFromEnum(opts.mode),
+            if (opts.pdf_profile) |p| @as(u8, @intCast(@intFromEnum(p))) + 1 else 0,
+            @intFromBool(opts.draft_images),
+        };
+        h.update(&flags);
+        const dpi: u32 = if (opts.image_dpi) |d| d else std.math.maxInt(u32);
+        h.update(std.mem.asBytes(&dpi));
+
+        var cache: PictureCache = .{
+            .io = io,
+            .preamble = std.heap.c_allocator.dupe(u8, preamble) catch return null,
+            .digest = h.finalResult(),
+        };
+        const dir = std.fmt.bufPrint(&cache.dir_buf, "{s}/pictures", .{cache_dir}) catch null;
+        if (dir == null or !pictures.usable_dir(dir.?)) {
+            Log.dbg(io, "eztex", "pictures: the cache path cannot go into \\includegraphics", .{});
+            std.heap.c_allocator.free(cache.preamble);
+            return null;
+        }
+        cache.dir_len = dir.?.len;
+        return cache;
+    }
+
+    fn deinit(self: *PictureCache) void {
+        for (self.misses.values()) |text| std.heap.c_allocator.free(text);
+        self.misses.deinit(std.heap.c_allocator);
+        std.heap.c_allocator.free(self.preamble);
+    }
+
+    fn dir(self: *const PictureCache) []const u8 {
+        return self.dir_buf[0..self.dir_len];
+    }
+
+    fn input_filter(self: *PictureCache) Bridge.World.InputFilter {
+        return .{ .ctx = self, .filter = filter };
+    }
+
+    fn filter(ctx: *anyopaque, text: []const u8) ?[]u8 {
+        const self: *PictureCache = @ptrCast(@alignCast(ctx));
+        var out: Io.Writer.Allocating = .init(std.heap.c_allocator);
+        defer out.deinit();
+        var copied: usize = 0;
+        var it = pictures.iterate(text);
+        while (it.next()) |pic| {
+            const picture = text[pic.start..pic.end];
+            if (!pictures.externalizable(picture)) continue;
+            const k = pictures.key(&self.digest, picture);
+            var entry_buf: [256]u8 = undefined;
+            const entry = pictures.lookup(self.io, self.dir(), &k, &entry_buf) orelse {
+                self.note_miss(&k, picture);
+                continue;
+            };
+            out.writer.writeAll(text[copied..pic.start]) catch return null;
+            pictures.write_replacement(&out.writer, self.dir(), entry, picture) catch return null;
+            copied = pic.end;
+        }
+        if (copied == 0) return null;
+        out.writer.writeAll(text[copied..]) catch return null;
+        return out.toOwnedSlice() catch null;
+    }
+
+    fn note_miss(self: *PictureCache, k: *const pictures.Key, picture: []const u8) void {
+        const gop = self.misses.getOrPut(std.heap.c_allocator, k.*) catch return;
+        if (gop.found_existing) return;
+        gop.value_ptr.* = std.heap.c_allocator.dupe(u8, picture) catch {
+            _ = self.misses.pop();
+            return;
+        };
+    }
+};
+
+// typeset the pictures a compile found no PDF for into one PDF, a page each
+// (see pictures.write_batch), and put it in the picture cache. best effort:
+// pictures it fails on are typeset in place again next time
+fn compile_pictures(io: Io, world: *Bridge.World, engine: EngineApi.Engine, cache: *const PictureCache, format: Format, input_dir: ?[]const u8) void {
+    const texts = cache.misses.values();
+    if (texts.len == 0) return;
+    const started = Timeline.now();
+    defer Timeline.span(.compile, "pictures", null, started);
+
+    var doc: Io.Writer.Allocating = .init(std.heap.c_allocator);
+    defer doc.deinit();
+    pictures.write_batch(&doc.writer, cache.preamble, texts) catch return;
+
+    const job = pictures.batch_jobname;
+    Bridge.set_diagnostic_handler(diag.quiet_diag_handler);
+    defer Bridge.set_diagnostic_handler(default_diag_handler);
+    // through the disk, leaving the document's XDV in memory as it is
+    world.capture_xdv = false;
+    defer world.capture_xdv = true;
+    defer {
+        cleanup_intermediates(io, job, false);
+        inline for (.{ ".depths", ".pdf", ".pages.json", ".synctex.gz" }) |ext| {
+            Io.Dir.cwd().deleteFile(io, job ++ ext) catch {};
+        }
+    }
+
+    reset_world_io(io);
+    world.add_search_dir(".");
+    if (input_dir) |idir| world.add_search_dir(idir);
+    engine.setFormat(format) catch return;
+    engine.setVariable(.synctex, .{ .boolean = false }) catch return;
+    engine.setVariable(.draft_pass, .{ .boolean = false }) catch return;
+    engine.setVariable(.profile_expansion, .{ .boolean = false }) catch return;
+    engine.setVariable(.command_index, .{ .boolean = false }) catch return;
+    engine.setVariable(.linebreak_memo, .{ .boolean = false }) catch return;
+    engine.setPrimaryInput(job ++ ".tex") catch return;
+    world.primary_input_override = doc.written();
+    defer world.primary_input_override = null;
+
+    Log.dbg(io, "eztex", "typesetting {d} picture{s} for the picture cache...", .{ texts.len, if (texts.len == 1) @as([]const u8, "") else "s" });
+    const result = engine.run() catch return;
+    if (!result.succeeded()) {
+        Log.dbg(io, "eztex", "pictures did not typeset (exit code {d})", .{result.code});
+        return;
+    }
+    reset_world_io(io);
+    const pdf_result = engine.postProcess(job ++ ".xdv", job ++ ".pdf") catch return;
+    if (pdf_result.code != 0) return;
+
+    const pdf = read_file_contents(io, job ++ ".pdf") orelse return;
+    defer free_file_contents(pdf);
+    const depths = read_file_contents(io, job ++ ".depths") orelse return;
+    defer free_file_contents(depths);
+    pictures.store(io, cache.dir(), cache.misses.keys(), pdf, depths) catch |err| {
+        Log.dbg(io, "eztex", "failed to cache pictures: {}", .{err});
+        return;
+    };
+    Log.dbg(io, "eztex", "cached {d} picture{s}", .{ texts.len, if (texts.len == 1) @as([]const u8, "") else "s" });
+}
+
 fn reset_world_io(io: Io) void {
     Bridge.get_world().reset_io(io);
 }
 
-fn cleanup_intermediates(io: Io, stem: []const u8) void {
+// write the in-memory XDV to disk so --keep-intermediates still leaves it behind.
+fn persist_memory_output(io: Io, world: *Bridge.World) void {
+    const data = world.memory_output orelse return;
+    const name = world.memory_output_name[0..world.memory_output_name_len];
+    Io.Dir.cwd().writeFile(io, .{ .sub_path = name, .data = data }) catch |err| {
+        Log.log(io, "eztex", .warn, "failed to write intermediate '{s}': {}", .{ name, err });
+    };
+}
+
+fn cleanup_intermediates(io: Io, stem: []const u8, keep_xdv: bool) void {
     const extensions = [_][]const u8{
         ".aux", ".log", ".xdv", ".lof", ".lot", ".out",
         ".toc", ".bbl", ".blg", ".bibstate", ".nav", ".snm", ".vrb",
     };
     for (extensions) |ext| {
+        if (keep_xdv and std.mem.eql(u8, ext, ".xdv")) continue;
         var buf: [512]u8 = undefined;
         const path = std.fmt.bufPrint(&buf, "{s}{s}", .{ stem, ext }) catch continue;
         Io.Dir.cwd().deleteFile(io, path) catch {};
     }
 }
 
+// move <stem><ext> from the working directory to the directory of final_pdf
+fn move_beside_output(io: Io, stem: []const u8, ext: []const u8, final_pdf: []const u8) void {
+    const out_dir = fs_path.dirname(final_pdf) orelse return;
+    if (std.mem.eql(u8, out_dir, ".")) return;
+    var src_buf: [512]u8 = undefined;
+    const src = std.fmt.bufPrint(&src_buf, "{s}{s}", .{ stem, ext }) catch return;
+    var dst_buf: [512]u8 = undefined;
+    const dst = std.fmt.bufPrint(&dst_buf, "{s}/{s}{s}", .{ out_dir, stem, ext }) catch return;
+    if (std.mem.eql(u8, src, dst)) return;
+    Io.Dir.cwd().createDirPath(io, out_dir) catch {};
+    Io.Dir.cwd().rename(src, Io.Dir.cwd(), dst, io) catch {};
+}
+
+// compile <stem>.synctex.gz into <stem>.synctex.idx (see SynctexIndex.zig).
+// without it the app falls back to parsing the .synctex.gz itself.
+fn write_synctex_index(io: Io, stem: []const u8) void {
+    const started = Timeline.now();
+    var gz_buf: [512]u8 = undefined;
+    const gz_path = std.fmt.bufPrint(&gz_buf, "{s}.synctex.gz", .{stem}) catch return;
+    var idx_buf: [512]u8 = undefined;
+    const idx_path = std.fmt.bufPrint(&idx_buf, "{s}.synctex.idx", .{stem}) catch return;
+    // a stale index would point at the previous layout
+    Io.Dir.cwd().deleteFile(io, idx_path) catch {};
+
+    const alloc = std.heap.c_allocator;
+    const gz = read_file_contents(io, gz_path) orelse return;
+    defer free_file_contents(gz);
+    const text = SynctexIndex.gunzip(alloc, gz) catch |err| {
+        Log.log(io, "eztex", .warn, "cannot index '{s}': {}", .{ gz_path, err });
+        return;
+    };
+    defer alloc.free(text);
+    const index = SynctexIndex.compile(alloc, text) catch |err| {
+        Log.log(io, "eztex", .warn, "cannot index '{s}': {}", .{ gz_path, err });
+        return;
+    };
+    defer alloc.free(index);
+    Io.Dir.cwd().writeFile(io, .{ .sub_path = idx_path, .data = index }) catch |err| {
+        Log.log(io, "eztex", .warn, "failed to write '{s}': {}", .{ idx_path, err });
+        return;
+    };
+    Timeline.span(.compile, "synctex index", idx_path, started);
+    Log.dbg(io, "eztex", "synctex index: {d} bytes from {d}", .{ index.len, text.len });
+}
+
+// --incremental-pdf: make pdf_name the previous PDF plus an update with the
+// objects that changed, or leave it whole when they do not line up
+fn append_pdf_update(io: Io, previous: []const u8, pdf_name: []const u8) void {
+    const fresh = read_file_contents(io, pdf_name) orelse return;
+    defer free_file_contents(fresh);
+    const update = (PdfUpdate.append(std.heap.c_allocator, previous, fresh) catch null) orelse {
+        Log.dbg(io, "eztex", "incremental pdf: written whole", .{});
+        return;
+    };
+    defer std.heap.c_allocator.free(update.pdf);
+    Io.Dir.cwd().writeFile(io, .{ .sub_path = pdf_name, .data = update.pdf }) catch |err| {
+        Log.log(io, "eztex", .warn, "failed to write incremental update to '{s}': {}", .{ pdf_name, err });
+        return;
+    };
+    Log.log(io, "eztex", .info, "incremental pdf: {d} of {d} objects rewritten", .{ update.rewritten, update.objects });
+}
+
 fn rename_output(io: Io, stem: []const u8, output_file: []const u8) void {
     var default_buf: [512]u8 = undefined;
     const default_pdf = std.fmt.bufPrint(&default_buf, "{s}.pdf", .{stem}) catch return;
@@ -516,15 +1255,9 @@ fn rename_output(io: Io, stem: []const u8, output_file: []const u8) void {
     };
 }
 
+// a digest of each stabilization file, null when it is missing or empty
 const StabilizationSnapshot = struct {
-    files: [stabilization_extensions.len]?[]const u8 = std.mem.zeroes([stabilization_extensions.len]?[]const u8),
-
-    fn deinit(self: *StabilizationSnapshot) void {
-        for (&self.files) |*contents| {
-            free_file_contents(contents.*);
-            contents.* = null;
-        }
-    }
+    digests: [stabilization_extensions.len]?u64 = @splat(null),
 };
 
 const StabilizationStatus = struct {
@@ -533,25 +1266,186 @@ const StabilizationStatus = struct {
     changed_extension: ?[]const u8,
 };
 
+// where the PDF ends up: -o, else beside the input, except a zip
+// project's, which has no directory of its own on disk, and an embedded
+// compile's, which stays where xdvipdfmx wrote it
+fn final_pdf_path(buf: []u8, pdf_name: []const u8, opts: *const CompileConfig, project: *const Project.ProjectInput, input_dir: ?[]const u8, jobname: []const u8) []const u8 {
+    if (Bridge.get_world().memory_files != null) return pdf_name;
+    if (opts.output_file) |out| return out;
+    if (project.archive != null) return pdf_name;
+    const idir = input_dir orelse return pdf_name;
+    return std.fmt.bufPrint(buf, "{s}/{s}.pdf", .{ idir, jobname }) catch pdf_name;
+}
+
+// what a compile leaves beside its PDF, shared through the remote cache
+const output_companions = [_][]const u8{ ".synctex.gz", ".synctex.idx", ".flame", ".cmds", ".pages.json" };
+
+// where an entry of a memo pack goes: "output.<ext>" beside the PDF,
+// "job.<ext>" in the working directory. null for any other name, and for
+// one that would reach outside those
+fn pack_entry_path(buf: []u8, name: []const u8, final_pdf: []const u8, jobname: []const u8) ?[]const u8 {
+    if (std.mem.indexOfAny(u8, name, "/\\") != null or std.mem.indexOf(u8, name, "..") != null) return null;
+    if (std.mem.eql(u8, name, "output.pdf")) return final_pdf;
+    const pdf_stem = if (std.mem.endsWith(u8, final_pdf, ".pdf")) final_pdf[0 .. final_pdf.len - 4] else final_pdf;
+    if (std.mem.startsWith(u8, name, "output.")) return std.fmt.bufPrint(buf, "{s}{s}", .{ pdf_stem, name["output".len..] }) catch null;
+    if (std.mem.startsWith(u8, name, "job.")) return std.fmt.bufPrint(buf, "{s}{s}", .{ jobname, name["job".len..] }) catch null;
+    return null;
+}
+
+// write the outputs of the same compile from the remote cache where this
+// one would write them, and the manifest that vouches for them here. false
+// on a miss, with nothing written
+fn restore_from_remote(io: Io, remote: *const RemoteCache, key: *const memo.Key, manifest_path: []const u8, final_pdf: []const u8, jobname: []const u8) bool {
+    const alloc = std.heap.c_allocator;
+    const hit = remote.fetch(io, key) orelse return false;
+    defer hit.deinit();
+
+    // the whole pack checks out before any of it is written
+    var check = memo.unpack(hit.pack) catch return false;
+    var has_pdf = false;
+    while (check.next() catch return false) |entry| {
+        var path_buf: [1024]u8 = undefined;
+        if (pack_entry_path(&path_buf, entry.name, final_pdf, jobname) == null) return false;
+        if (std.mem.eql(u8, entry.name, "output.pdf")) has_pdf = true;
+    }
+    if (!has_pdf) return false;
+
+    var entries = memo.unpack(hit.pack) catch return false;
+    while (entries.next() catch return false) |entry| {
+        var path_buf: [1024]u8 = undefined;
+        const path = pack_entry_path(&path_buf, entry.name, final_pdf, jobname) orelse return false;
+        Io.Dir.cwd().writeFile(io, .{ .sub_path = path, .data = entry.data }) catch |err| {
+            Log.log(io, "eztex", .warn, "failed to write {s} from the remote cache: {}", .{ path, err });
+            return false;
+        };
+    }
+
+    var paths: std.ArrayListUnmanaged([]const u8) = .empty;
+    defer paths.deinit(alloc);
+    var inputs = memo.inputs(hit.manifest);
+    while (inputs.next()) |input| {
+        // the watcher still watches what the compile would have read
+        Bridge.get_world().note_opened(null, input);
+        paths.append(alloc, input) catch return true;
+    }
+    memo.record(io, alloc, manifest_path, key, final_pdf, paths.items, &.{});
+    return true;
+}
+
+fn add_pack_entry(io: Io, entries: *std.ArrayListUnmanaged(memo.PackEntry), name: []const u8, path: []const u8) void {
+    const data = read_file_contents(io, path) orelse return;
+    entries.append(std.heap.c_allocator, .{ .name = name, .data = data }) catch free_file_contents(data);
+}
+
+// share a finished compile: the manifest just written, and its outputs
+fn push_to_remote(io: Io, remote: *const RemoteCache, key: *const memo.Key, manifest_path: []const u8, final_pdf: []const u8, jobname: []const u8, keep_intermediates: bool) void {
+    const alloc = std.heap.c_allocator;
+    const manifest = read_file_contents(io, manifest_path) orelse return;
+    defer free_file_contents(manifest);
+
+    var entries: std.ArrayListUnmanaged(memo.PackEntry) = .empty;
+    defer {
+        for (entries.items) |e| free_file_contents(e.data);
+        entries.deinit(alloc);
+    }
+    add_pack_entry(io, &entries, "output.pdf", final_pdf);
+    if (entries.items.len == 0) return;
+    const pdf_stem = if (std.mem.endsWith(u8, final_pdf, ".pdf")) final_pdf[0 .. final_pdf.len - 4] else final_pdf;
+    inline for (output_companions) |ext| {
+        var path_buf: [1024]u8 = undefined;
+        if (std.fmt.bufPrint(&path_buf, "{s}{s}", .{ pdf_stem, ext })) |path| {
+            add_pack_entry(io, &entries, "output" ++ ext, path);
+        } else |_| {}
+    }
+    if (keep_intermediates) {
+        inline for (stabilization_extensions ++ [_][]const u8{".bbl"}) |ext| {
+            var path_buf: [512]u8 = undefined;
+            if (std.fmt.bufPrint(&path_buf, "{s}{s}", .{ jobname, ext })) |path| {
+                add_pack_entry(io, &entries, "job" ++ ext, path);
+            } else |_| {}
+        }
+    }
+
+    const pack = memo.pack(alloc, entries.items) catch return;
+    defer alloc.free(pack);
+    remote.store(io, key, manifest, pack);
+}
+
+// what a compile's PDF depends on besides the files it reads: engine and
+// format (with the bundle), the input, and the options that change output
+fn memo_key(engine: EngineApi.Engine, format: Format, bundle_digest: *const [64]u8, input_file: []const u8, opts: *const CompileConfig) memo.Key {
+    var h = std.crypto.hash.sha2.Sha256.init(.{});
+    h.update(&make_format_cache_key(format, bundle_digest).hash());
+    h.update(engine.name());
+    h.update(&.{0});
+    h.update(input_file);
+    h.update(&.{0});
+    h.update(opts.paperspec);
+    h.update(&.{0});
+    const flags = [_]u8{
+        @intFromEnum(opts.mode),
+        if (opts.pdf_profile) |p| @as(u8, @intCast(@intFromEnum(p))) + 1 else 0,
+        @intFromBool(opts.deterministic),
+        @intFromBool(opts.synctex),
+        @intFromBool(opts.profile),
+        @intFromBool(opts.command_index),
+        @intFromBool(opts.incremental_pdf),
+        @intFromBool(opts.page_digests),
+        @intFromBool(opts.externalize_pictures),
+        @intFromBool(opts.draft_images),
+    };
+    h.update(&flags);
+    const dpi: u32 = if (opts.image_dpi) |d| d else std.math.maxInt(u32);
+    h.update(std.mem.asBytes(&dpi));
+    h.update(opts.focus orelse "");
+    h.update(&.{0});
+    const pages: [2]u32 = if (opts.pages) |p| .{ p.first, p.last } else .{ 0, 0 };
+    h.update(std.mem.asBytes(&pages));
+    return h.finalResult();
+}
+
 fn build_job_file_path(buf: []u8, jobname: []const u8, ext: []const u8) ![]const u8 {
     return std.fmt.bufPrint(buf, "{s}{s}", .{ jobname, ext });
 }
 
-fn read_stabilization_snapshot(io: Io, jobname: []const u8) !StabilizationSnapshot {
+// the digests the World took of the files as the engines wrote them (see
+// World.watch_digests). a file no engine wrote since is read and hashed
+// once: an intermediate restored from a previous build, or none at all
+fn take_stabilization_snapshot(io: Io, world: *Bridge.World, jobname: []const u8) !StabilizationSnapshot {
     var snapshot = StabilizationSnapshot{};
-    errdefer snapshot.deinit();
-
     inline for (stabilization_extensions, 0..) |ext, i| {
-        var path_buf: [512]u8 = undefined;
-        const path = try build_job_file_path(&path_buf, jobname, ext);
-        snapshot.files[i] = read_file_contents(io, path);
+        const digest = world.output_digest(i) orelse blk: {
+            var path_buf: [512]u8 = undefined;
+            const path = try build_job_file_path(&path_buf, jobname, ext);
+            const contents = aux.read_scratch(io, path);
+            defer aux.free_scratch(contents);
+            const d: Bridge.World.OutputDigest = if (contents) |c|
+                .{ .hash = std.hash.Wyhash.hash(0, c), .len = c.len }
+            else
+                .{ .hash = 0, .len = 0 };
+            world.set_output_digest(i, d);
+            break :blk d;
+        };
+        snapshot.digests[i] = if (digest.len > 0) digest.hash else null;
     }
+    return snapshot;
+}
 
+fn load_restored_snapshot(io: Io, world: *Bridge.World, jobname: []const u8) ?StabilizationSnapshot {
+    const snapshot = take_stabilization_snapshot(io, world, jobname) catch return null;
+    if (snapshot.digests[aux_stabilization_index] == null) return null;
+    Log.dbg(io, "eztex", "found intermediates from a previous build", .{});
     return snapshot;
 }
 
+fn digest_changed(prev: ?u64, curr: ?u64) bool {
+    if (prev == null and curr == null) return false;
+    if (prev == null or curr == null) return true;
+    return prev.? != curr.?;
+}
+
 fn compare_stabilization_snapshots(prev: *const StabilizationSnapshot, curr: *const StabilizationSnapshot) StabilizationStatus {
-    if (aux_changed(prev.files[aux_stabilization_index], curr.files[aux_stabilization_index])) {
+    if (digest_changed(prev.digests[aux_stabilization_index], curr.digests[aux_stabilization_index])) {
         return .{
             .aux_stable = false,
             .all_stable = false,
@@ -561,7 +1455,7 @@ fn compare_stabilization_snapshots(prev: *const StabilizationSnapshot, curr: *co
 
     inline for (stabilization_extensions, 0..) |ext, i| {
         if (i == aux_stabilization_index) continue;
-        if (aux_changed(prev.files[i], curr.files[i])) {
+        if (digest_changed(prev.digests[i], curr.digests[i])) {
             return .{
                 .aux_stable = true,
                 .all_stable = false,
@@ -588,6 +1482,17 @@ pub fn compile(io: Io, opts: *const CompileConfig, loaded_config: ?Config) u8 {
 }
 
 pub fn compileWithEngine(io: Io, opts: *const CompileConfig, loaded_config: ?Config, engine: EngineApi.Engine) u8 {
+    // first, so it is freed after everything below is done with it
+    var scratch = std.heap.ArenaAllocator.init(std.heap.c_allocator);
+    const outer_scratch = aux.scratch;
+    aux.scratch = &scratch;
+    defer {
+        aux.scratch = outer_scratch;
+        scratch.deinit();
+    }
+
+    g_cancelled = false;
+    DiagRecords.reset();
     const old_engine = if (Runtime.instance) |rt| rt.active_engine else null;
     if (Runtime.instance) |rt| rt.active_engine = engine;
     defer {
@@ -599,21 +1504,37 @@ pub fn compileWithEngine(io: Io, opts: *const CompileConfig, loaded_config: ?Con
         return 1;
     };
 
-    const project = if (!is_wasm)
+    if (opts.trace_file != null) Timeline.start();
+    defer if (opts.trace_file) |path| Timeline.finish(io, path);
+    if (opts.trace_file != null or MemStats.wanted or limits.memory_bytes != null) Bridge.begin_memory_stats();
+    g_cpu_start_us = Host.cpu_time_us() orelse 0;
+    cache_stats.compiles += 1;
+    if (build_options.sampling) Sampler.start();
+    defer if (build_options.sampling) log_sampling_profile(io);
+    const compile_started = Timeline.now();
+    defer Timeline.span(.compile, "compile", raw_input, compile_started);
+    defer if (Timeline.enabled()) {
+        if (Host.peak_rss_bytes()) |rss| Timeline.note_bytes(.compile, "peak rss", rss);
+        trace_memory_stats();
+    };
+
+    // an embedded compile's files are in memory only (see World.memory_files)
+    const in_memory = Bridge.get_world().memory_files != null;
+    const project = if (!is_wasm and !in_memory)
         Project.resolve_project_input(io, std.heap.c_allocator, raw_input, opts.verbose) orelse return 1
     else
         Project.ProjectInput{ .tex_file = raw_input };
 
-    defer if (project.temp_dir) |tmp| {
-        Io.Dir.cwd().deleteTree(io, tmp) catch {};
-    };
+    defer project.deinit();
+    Bridge.get_world().archive = project.archive;
+    defer Bridge.get_world().archive = null;
 
     const input_file = project.tex_file;
 
-    Io.Dir.cwd().access(io, input_file, .{}) catch {
+    if (project.archive == null and !aux.file_exists(io, input_file)) {
         Log.log(io, "eztex", .err, "input file '{s}' not found", .{input_file});
         return 1;
-    };
+    }
 
     const jobname = get_jobname(input_file);
     const input_dir = fs_path.dirname(input_file);
@@ -633,6 +1554,42 @@ pub fn compileWithEngine(io: Io, opts: *const CompileConfig, loaded_config: ?Con
         Config.default().effective_bundle();
     const bundle_digest = Config.digest_from_url(bundle.url);
 
+    // record what the engine reads, for the manifest below; the watcher
+    // may already have asked for the same
+    const own_open_log = Bridge.get_world().open_log == null;
+    if (own_open_log) Bridge.get_world().begin_open_log();
+    defer if (own_open_log) Bridge.get_world().end_open_log();
+
+    const use_memo = !is_wasm and opts.reuse_output and !opts.xdv_only;
+    const inputs_key = memo_key(engine, format, &bundle_digest, input_file, opts);
+    var memo_name_buf: [512]u8 = undefined;
+    var memo_pdf_buf: [512]u8 = undefined;
+    var manifest_buf: [512]u8 = undefined;
+    const memo_pdf: ?[]const u8 = if (use_memo) blk: {
+        const pdf_name = std.fmt.bufPrint(&memo_name_buf, "{s}.pdf", .{jobname}) catch break :blk null;
+        break :blk final_pdf_path(&memo_pdf_buf, pdf_name, opts, &project, input_dir, jobname);
+    } else null;
+    const manifest = if (memo_pdf) |pdf| memo.manifest_path(&manifest_buf, pdf) else null;
+    if (manifest) |path| {
+        if (memo.lookup(io, path, &inputs_key, memo_pdf.?)) |text| {
+            defer free_file_contents(text);
+            // the watcher still watches what the compile would have read
+            var inputs = memo.inputs(text);
+            while (inputs.next()) |input| Bridge.get_world().note_opened(null, input);
+            Log.log(io, "eztex", .info, "output: {s} (nothing changed since it was written, 0 passes)", .{memo_pdf.?});
+            cache_stats.memo_hits += 1;
+            return 0;
+        }
+    }
+    const remote = if (use_memo) RemoteCache.from_config(loaded_config) else null;
+    if (manifest) |path| if (remote) |*r| {
+        if (restore_from_remote(io, r, &inputs_key, path, memo_pdf.?, jobname)) {
+            Log.log(io, "eztex", .info, "output: {s} (from the remote cache, 0 passes)", .{memo_pdf.?});
+            cache_stats.remote_hits += 1;
+            return 0;
+        }
+    };
+
     const is_custom_url = !std.mem.eql(u8, bundle.url, Config.default_bundle_url);
     const is_custom_index = !std.mem.eql(u8, bundle.index_url, Config.default_index_url);
     if (is_custom_url) {
@@ -642,21 +1599,40 @@ pub fn compileWithEngine(io: Io, opts: *const CompileConfig, loaded_config: ?Con
         Log.dbg(io, "eztex", "index URL override: {s}", .{bundle.index_url});
     }
 
-    setup_world(io, engine, format, verbose, opts.cache_dir, bundle, &bundle_digest, opts.deterministic);
+    const setup_started = Timeline.now();
+    const cache_dir = setup_world(io, engine, format, verbose, opts.cache_dir, bundle, &bundle_digest, opts.deterministic, true);
+    Timeline.span(.compile, "setup", null, setup_started);
 
     const world = Bridge.get_world();
 
-    if (!is_wasm) {
-        seed_cache(io, &seeds.init);
-    }
+    seed_for_document(io, input_file, format);
 
     if (input_dir) |idir| {
         world.add_search_dir(idir);
         Log.dbg(io, "eztex", "added input directory to search path: {s}", .{idir});
     }
 
+    if (opts.preamble_format and format == .latex) {
+        if (use_preamble_format(io, world, engine, cache_dir, format, &bundle_digest, input_file)) {
+            Log.dbg(io, "eztex", "starting from the preamble format", .{});
+        }
+        // a dump run resets the world's search path
+        if (input_dir) |idir| world.add_search_dir(idir);
+    }
+
     world.set_output_dir(".");
 
+    // keep the XDV in memory between xetex and xdvipdfmx (see World.capture_xdv)
+    world.capture_xdv = true;
+    defer {
+        if (opts.keep_intermediates) persist_memory_output(io, world);
+        world.capture_xdv = false;
+        world.clear_memory_output();
+    }
+
+    world.discard_log = opts.no_log and opts.mode == .preview;
+    defer world.discard_log = false;
+
     const max_passes: u8 = if (opts.mode == .preview) max_preview_passes else max_auto_passes;
 
     var aux_path_buf: [512]u8 = undefined;
@@ -665,20 +1641,26 @@ pub fn compileWithEngine(io: Io, opts: *const CompileConfig, loaded_config: ?Con
         return 1;
     };
 
-    var bbl_path_buf: [512]u8 = undefined;
-    const bbl_path = std.fmt.bufPrint(&bbl_path_buf, "{s}.bbl", .{jobname}) catch {
-        Log.log(io, "eztex", .err, "jobname too long", .{});
-        return 1;
-    };
-
-    var bib_state_path_buf: [512]u8 = undefined;
-    const bib_state_path = std.fmt.bufPrint(&bib_state_path_buf, "{s}.bibstate", .{jobname}) catch {
-        Log.log(io, "eztex", .err, "jobname too long", .{});
-        return 1;
-    };
+    // the stabilization files are digested as the engines write them
+    world.watch_digests(jobname, &stabilization_extensions);
+    defer world.watch_digests("", &.{});
 
     var prev_snapshot: ?StabilizationSnapshot = null;
-    defer if (prev_snapshot) |*snapshot| snapshot.deinit();
+
+    // intermediates left by a previous build (restored by the web app, or --keep-intermediates).
+    // if the first pass reproduces them byte for byte it already reached the fixed point.
+    const restored_snapshot = load_restored_snapshot(io, world, jobname);
+
+    const focused = focus_source(io, input_file, input_dir, opts);
+    defer if (focused) |src| free_file_contents(src);
+
+    var picture_cache: ?PictureCache = null;
+    if (!is_wasm and opts.externalize_pictures and format == .latex) {
+        if (cache_dir) |cdir| picture_cache = PictureCache.open(io, cdir, input_file, format, &bundle_digest, opts);
+    }
+    defer if (picture_cache) |*pc| pc.deinit();
+    if (picture_cache) |*pc| world.input_filter = pc.input_filter();
+    defer world.input_filter = null;
 
     var last_result = EngineApi.EngineResult{ .code = -1 };
     var pass: u8 = 0;
@@ -686,24 +1668,44 @@ pub fn compileWithEngine(io: Io, opts: *const CompileConfig, loaded_config: ?Con
     var bibtex_ran = false;
     var aux_stable = false;
     var stabilization_stable = false;
+    // the engine itself stopped at an error, not bibtex or a cancel
+    var typeset_failed = false;
+
+    // without a previous build to compare against, a latex first pass always writes an .aux
+    // and so can never be the last one: run it as a draft that skips xdv output
+    // (see draft_pass_enabled in xetex-shipout.c)
+    var draft = format == .latex and restored_snapshot == null;
 
     while (pass < max_passes) : (pass += 1) {
-        Log.dbg(io, "eztex", "pass {d} (auto, max {d})...", .{ pass + 1, max_passes });
+        Log.dbg(io, "eztex", "pass {d} (auto, max {d}{s})...", .{ pass + 1, max_passes, if (draft) @as([]const u8, ", draft") else "" });
 
         if (pass > 0) reset_world_io(io);
-
-        last_result = run_engine(engine, input_file, format, opts) catch |err| {
+        // the diagnostics of the last pass are the document's (see DiagRecords.zig)
+        DiagRecords.reset();
+        // so an XDV found after the loop is the last pass's
+        world.clear_memory_output();
+
+        world.primary_input_override = focused;
+        last_result = run_engine(engine, input_file, format, opts, draft, pass + 1) catch |err| {
+            world.primary_input_override = null;
             Log.log(io, "eztex", .err, "engine failed to start on pass {d}: {}", .{ pass + 1, err });
             break;
         };
+        world.primary_input_override = null;
         total_passes = pass + 1;
 
+        if (g_cancelled) {
+            Log.log(io, "eztex", .info, "compile cancelled on pass {d}", .{pass + 1});
+            break;
+        }
+
         if (!last_result.succeeded()) {
             Log.log(io, "eztex", .err, "{s} failed on pass {d} (exit code {d})", .{ engine.name(), pass + 1, last_result.code });
             const msg_slice = engine.errorMessage();
             if (msg_slice.len > 0) {
                 diag_write_with_severity(io, msg_slice, "error");
             }
+            typeset_failed = true;
             break;
         }
 
@@ -711,70 +1713,71 @@ pub fn compileWithEngine(io: Io, opts: *const CompileConfig, loaded_config: ?Con
             Log.dbg(io, "eztex", "pass {d} completed with warnings", .{pass + 1});
         }
 
-        var curr_snapshot = read_stabilization_snapshot(io, jobname) catch |err| {
+        const curr_snapshot = take_stabilization_snapshot(io, world, jobname) catch |err| {
             Log.log(io, "eztex", .err, "failed to read stabilization files after pass {d}: {}", .{ pass + 1, err });
             last_result = .{ .code = 3 };
             break;
         };
-        const curr_aux = curr_snapshot.files[aux_stabilization_index];
+        const has_aux = curr_snapshot.digests[aux_stabilization_index] != null;
+
+        if (prev_snapshot == null) {
+            if (!has_aux and draft) {
+                // no \begin{document}; the guess was wrong, so emit output on a real pass
+                draft = false;
+                Log.dbg(io, "eztex", "draft pass produced no aux file, rerunning for output", .{});
+                continue;
+            }
 
-        if (pass == 0) {
-            if (curr_aux == null) {
+            if (!has_aux) {
                 aux_stable = true;
                 stabilization_stable = true;
-                curr_snapshot.deinit();
                 Log.log(io, "eztex", .info, "no aux file produced, single pass sufficient", .{});
                 break;
             }
 
-            const bib_action = bibliography_action(io, aux_path, curr_aux);
+            // only the first pass reads the .aux itself, for its bibliography
+            const curr_aux = aux.read_scratch(io, aux_path);
+            defer aux.free_scratch(curr_aux);
+
+            var scan = aux.scan_aux(io, aux_path, curr_aux);
+            defer scan.deinit();
+            const bib_action = bibliography_action(scan.kind);
             const needs_bibtex = bib_action == .run_bibtex;
-            const current_bib_state = if (needs_bibtex) bibliography_state(io, aux_path, curr_aux) else null;
 
             if (bib_action == .unsupported_biblatex) {
                 last_result = .{ .code = 3 };
                 Log.log(io, "eztex", .err, "{s}", .{unsupported_biblatex_message});
-                curr_snapshot.deinit();
                 break;
             }
 
+            // a bibtex run that rewrites every .bbl as pass 1 read it changes
+            // none of pass 1's inputs, so pass 1 can still be the last
+            var bbl_changed = false;
             if (!bibtex_ran and needs_bibtex) {
-                const should_run_bibtex = switch (opts.mode) {
-                    .full => true,
-                    .preview => preview_needs_bibtex(io, bbl_path, current_bib_state, bib_state_path),
-                };
-
-                if (should_run_bibtex) {
-                    Log.log(io, "eztex", .info, "aux file contains bibliography commands, running bibtex...", .{});
-                    const bib_result = run_bibtex(io, engine, aux_path);
+                const bbl_before = if (restored_snapshot != null) bbl_digest(io, scan.jobs.items) else 0;
+                if (run_bibtex_jobs(io, engine, scan.jobs.items)) |bib_result| {
                     bibtex_ran = true;
                     if (!bib_result.succeeded()) {
                         last_result = bib_result;
-                        Log.log(io, "eztex", .err, "bibtex failed (exit code {d})", .{bib_result.code});
-
-                        const msg_slice = engine.errorMessage();
-                        if (msg_slice.len > 0) {
-                            diag_write_with_severity(io, msg_slice, "error");
-                        }
-
-                        var blg_buf: [512]u8 = undefined;
-                        const blg_path = std.fmt.bufPrint(&blg_buf, "{s}.blg", .{jobname}) catch null;
-                        if (blg_path) |path| {
-                            if (Io.Dir.cwd().access(io, path, .{})) |_| {
-                                Log.log(io, "eztex", .info, "preserved bibtex log: {s}", .{path});
-                            } else |_| {}
-                        }
-
-                        curr_snapshot.deinit();
                         break;
                     }
+                    bbl_changed = restored_snapshot == null or bbl_digest(io, scan.jobs.items) != bbl_before;
+                    if (!bbl_changed) Log.dbg(io, "eztex", "bibtex left the bibliography as pass 1 read it", .{});
+                }
+            }
 
-                    persist_bibliography_state(io, bib_state_path, current_bib_state);
-                } else {
-                    Log.dbg(io, "eztex", "preview mode reusing persisted bibliography outputs", .{});
+            if (!bbl_changed) {
+                if (restored_snapshot) |*restored| {
+                    if (compare_stabilization_snapshots(restored, &curr_snapshot).all_stable) {
+                        aux_stable = true;
+                        stabilization_stable = true;
+                        Log.log(io, "eztex", .info, "stabilization files match previous build, single pass sufficient", .{});
+                        break;
+                    }
                 }
             }
 
+            draft = false;
             prev_snapshot = curr_snapshot;
             Log.dbg(io, "eztex", "stabilization files produced, will check stability on next pass", .{});
         } else {
@@ -783,12 +1786,10 @@ pub fn compileWithEngine(io: Io, opts: *const CompileConfig, loaded_config: ?Con
 
             if (status.all_stable) {
                 stabilization_stable = true;
-                curr_snapshot.deinit();
                 Log.log(io, "eztex", .info, "stabilization files stable after pass {d}, done", .{pass + 1});
                 break;
             }
 
-            if (prev_snapshot) |*snapshot| snapshot.deinit();
             prev_snapshot = curr_snapshot;
 
             if (status.changed_extension) |ext| {
@@ -805,7 +1806,26 @@ pub fn compileWithEngine(io: Io, opts: *const CompileConfig, loaded_config: ?Con
         Log.log(io, "eztex", .info, "preview mode stopped after {d} passes before stabilization files converged", .{total_passes});
     }
 
-    if (last_result.succeeded()) {
+    // a preview stopped by an error still converts the pages it shipped
+    // before the error, so the viewer follows the edit up to where it broke.
+    // a draft pass ships none
+    const partial = opts.mode == .preview and typeset_failed and engine.outputFormat() == .xdv and
+        has_xdv: {
+            var xdv_buf: [512]u8 = undefined;
+            const xdv_name = std.fmt.bufPrint(&xdv_buf, "{s}.xdv", .{jobname}) catch break :has_xdv false;
+            break :has_xdv world.find_memory_output(xdv_name) != null;
+        };
+    if (partial) Log.log(io, "eztex", .info, "converting the pages shipped before the error", .{});
+
+    if ((last_result.succeeded() or partial) and opts.xdv_only) {
+        persist_memory_output(io, world);
+        if (opts.synctex) write_synctex_index(io, jobname);
+        Log.log(io, "eztex", .info, "output: {s}.xdv ({d} pass{s})", .{
+            jobname,
+            total_passes,
+            if (total_passes == 1) @as([]const u8, "") else "es",
+        });
+    } else if (last_result.succeeded() or partial) {
         var pdf_buf: [512]u8 = undefined;
         const pdf_name = std.fmt.bufPrint(&pdf_buf, "{s}.pdf", .{jobname}) catch {
             Log.log(io, "eztex", .err, "filename too long for pdf", .{});
@@ -813,6 +1833,13 @@ pub fn compileWithEngine(io: Io, opts: *const CompileConfig, loaded_config: ?Con
             return 1;
         };
 
+        var final_pdf_buf: [512]u8 = undefined;
+        const final_pdf = final_pdf_path(&final_pdf_buf, pdf_name, opts, &project, input_dir, jobname);
+
+        // the PDF being replaced, before xdvipdfmx overwrites it
+        const previous_pdf = if (opts.incremental_pdf) read_file_contents(io, final_pdf) else null;
+        defer free_file_contents(previous_pdf);
+
         if (engine.outputFormat() == .xdv) {
             var xdv_buf: [512]u8 = undefined;
             const xdv_name = std.fmt.bufPrint(&xdv_buf, "{s}.xdv", .{jobname}) catch {
@@ -823,11 +1850,14 @@ pub fn compileWithEngine(io: Io, opts: *const CompileConfig, loaded_config: ?Con
 
             reset_world_io(io);
 
+            const pdf_started = Timeline.now();
+            Sampler.set_phase("xdvipdfmx");
             const pdf_result = engine.postProcess(xdv_name, pdf_name) catch |err| {
                 Log.log(io, "eztex", .err, "post-processing failed to start: {}", .{err});
                 Bridge.deinit_bundle_store();
                 return 1;
             };
+            Timeline.span(.pdf, "xdvipdfmx", pdf_name, pdf_started);
 
             if (pdf_result.code != 0) {
                 Log.log(io, "eztex", .err, "post-processing failed (exit code {d})", .{pdf_result.code});
@@ -838,40 +1868,30 @@ pub fn compileWithEngine(io: Io, opts: *const CompileConfig, loaded_config: ?Con
                 Bridge.deinit_bundle_store();
                 return 1;
             }
-        }
 
-        var final_pdf_buf: [512]u8 = undefined;
-        const final_pdf = if (opts.output_file) |out|
-            out
-        else if (project.temp_dir != null)
-            pdf_name
-        else if (input_dir) |idir|
-            std.fmt.bufPrint(&final_pdf_buf, "{s}/{s}.pdf", .{ idir, jobname }) catch pdf_name
-        else
-            pdf_name;
+            if (previous_pdf) |previous| append_pdf_update(io, previous, pdf_name);
+        }
 
-        if (!std.mem.eql(u8, pdf_name, final_pdf)) {
+        if (!in_memory and !std.mem.eql(u8, pdf_name, final_pdf)) {
             rename_output(io, jobname, final_pdf);
         }
 
         if (opts.synctex) {
-            if (fs_path.dirname(final_pdf)) |out_dir| {
-                if (!std.mem.eql(u8, out_dir, ".")) {
-                    var synctex_src_buf: [512]u8 = undefined;
-                    const synctex_src = std.fmt.bufPrint(&synctex_src_buf, "{s}.synctex.gz", .{jobname}) catch null;
-                    if (synctex_src) |src| {
-                        Io.Dir.cwd().createDirPath(io, out_dir) catch {};
-                        var synctex_dst_buf: [512]u8 = undefined;
-                        const synctex_dst = std.fmt.bufPrint(&synctex_dst_buf, "{s}/{s}.synctex.gz", .{ out_dir, jobname }) catch null;
-                        if (synctex_dst) |dst| {
-                            if (!std.mem.eql(u8, src, dst)) {
-                                Io.Dir.cwd().rename(src, Io.Dir.cwd(), dst, io) catch {};
-                            }
-                        }
-                    }
-                }
-            }
+            write_synctex_index(io, jobname);
+            move_beside_output(io, jobname, ".synctex.gz", final_pdf);
+            move_beside_output(io, jobname, ".synctex.idx", final_pdf);
         }
+        if (opts.profile) move_beside_output(io, jobname, ".flame", final_pdf);
+        if (opts.command_index) move_beside_output(io, jobname, ".cmds", final_pdf);
+        if (opts.page_digests) move_beside_output(io, jobname, ".pages.json", final_pdf);
+        if (manifest) |path| if (!partial) memo: {
+            var missing_arena: std.heap.ArenaAllocator = .init(std.heap.c_allocator);
+            defer missing_arena.deinit();
+            // without the lookups that failed, a manifest could outlive a new input
+            const missing = world.missing_input_paths(missing_arena.allocator()) catch break :memo;
+            memo.record(io, std.heap.c_allocator, path, &inputs_key, final_pdf, world.open_log.?.keys(), missing);
+            if (remote) |*r| if (r.push) push_to_remote(io, r, &inputs_key, path, final_pdf, jobname, opts.keep_intermediates);
+        };
 
         Log.log(io, "eztex", .info, "output: {s} ({d} pass{s})", .{
             final_pdf,
@@ -880,13 +1900,22 @@ pub fn compileWithEngine(io: Io, opts: *const CompileConfig, loaded_config: ?Con
         });
     }
 
-    if (!opts.keep_intermediates and xetex_succeeded(last_result.code)) {
-        cleanup_intermediates(io, jobname);
+    // a preview converting only some pages would leave the others blank
+    if (picture_cache) |*pc| if (last_result.succeeded() and opts.pages == null) {
+        world.input_filter = null;
+        compile_pictures(io, world, engine, pc, format, input_dir);
+    };
+
+    // the files of an embedded compile are the embedder's to keep or drop
+    if (!in_memory and !opts.keep_intermediates and xetex_succeeded(last_result.code)) {
+        cleanup_intermediates(io, jobname, opts.xdv_only);
 
         if (!opts.synctex) {
             var synctex_buf: [512]u8 = undefined;
             const synctex_path = std.fmt.bufPrint(&synctex_buf, "{s}.synctex.gz", .{jobname}) catch null;
             if (synctex_path) |p| Io.Dir.cwd().deleteFile(io, p) catch {};
+            const index_path = std.fmt.bufPrint(&synctex_buf, "{s}.synctex.idx", .{jobname}) catch null;
+            if (index_path) |p| Io.Dir.cwd().deleteFile(io, p) catch {};
         }
 
         Log.dbg(io, "eztex", "cleaned up intermediate files", .{});
@@ -894,10 +1923,90 @@ pub fn compileWithEngine(io: Io, opts: *const CompileConfig, loaded_config: ?Con
 
     Bridge.deinit_bundle_store();
 
+    if (partial) return exit_partial_output;
     if (!last_result.succeeded()) return 1;
     return 0;
 }
 
+// run only xdvipdfmx, on an XDV a compile with xdv_only left behind. the web
+// app does this in a second worker, so one preview's PDF is written while
+// the next preview's passes run. needs the bundle (fonts, maps) but no format.
+pub fn xdv_to_pdf(io: Io, opts: *const CompileConfig, loaded_config: ?Config) u8 {
+    const world = Bridge.get_world();
+    var engine = create_default_engine(io, world, opts) catch |err| {
+        Log.log(io, "eztex", .err, "failed to create engine: {}", .{err});
+        return 1;
+    };
+    defer engine.destroy();
+    return xdvToPdfWithEngine(io, opts, loaded_config, engine);
+}
+
+pub fn xdvToPdfWithEngine(io: Io, opts: *const CompileConfig, loaded_config: ?Config, engine: EngineApi.Engine) u8 {
+    const old_engine = if (Runtime.instance) |rt| rt.active_engine else null;
+    if (Runtime.instance) |rt| rt.active_engine = engine;
+    defer {
+        if (Runtime.instance) |rt| rt.active_engine = old_engine;
+    }
+
+    const xdv_file = opts.input_file orelse {
+        Log.log(io, "eztex", .err, "no input file specified", .{});
+        return 1;
+    };
+    if (!std.mem.endsWith(u8, xdv_file, ".xdv")) {
+        Log.log(io, "eztex", .err, "'{s}' is not an .xdv file", .{xdv_file});
+        return 1;
+    }
+    Io.Dir.cwd().access(io, xdv_file, .{}) catch {
+        Log.log(io, "eztex", .err, "input file '{s}' not found", .{xdv_file});
+        return 1;
+    };
+
+    var pdf_buf: [512]u8 = undefined;
+    const pdf_name = if (opts.output_file) |out| out else std.fmt.bufPrint(&pdf_buf, "{s}.pdf", .{xdv_file[0 .. xdv_file.len - 4]}) catch {
+        Log.log(io, "eztex", .err, "filename too long for pdf", .{});
+        return 1;
+    };
+
+    const bundle = if (loaded_config) |config|
+        config.effective_bundle()
+    else
+        Config.default().effective_bundle();
+    const bundle_digest = Config.digest_from_url(bundle.url);
+
+    const world = Bridge.get_world();
+    world.reset_search_dirs();
+    world.clear_missing_inputs();
+    world.add_search_dir(".");
+    if (fs_path.dirname(xdv_file)) |idir| world.add_search_dir(idir);
+    world.deterministic_mtime = if (opts.deterministic) 1 else null;
+    Bridge.set_diagnostic_handler(default_diag_handler);
+    Log.set_debug(opts.verbose);
+
+    _ = Host.setup(world, opts.verbose, opts.cache_dir, bundle.url, bundle.index_url, &bundle_digest);
+    defer Bridge.deinit_bundle_store();
+    world.set_output_dir(".");
+    reset_world_io(io);
+
+    const started = Timeline.now();
+    const result = engine.postProcess(xdv_file, pdf_name) catch |err| {
+        Log.log(io, "eztex", .err, "post-processing failed to start: {}", .{err});
+        return 1;
+    };
+    Timeline.span(.pdf, "xdvipdfmx", pdf_name, started);
+
+    if (result.code != 0) {
+        Log.log(io, "eztex", .err, "post-processing failed (exit code {d})", .{result.code});
+        const msg_slice = engine.errorMessage();
+        if (msg_slice.len > 0) {
+            Log.log(io, "eztex", .err, "post-processing abort reason: {s}", .{msg_slice});
+        }
+        return 1;
+    }
+
+    Log.log(io, "eztex", .info, "output: {s}", .{pdf_name});
+    return 0;
+}
+
 pub fn generate_format(io: Io, opts: *const CompileConfig, loaded_config: ?Config) u8 {
     const world = Bridge.get_world();
     var engine = create_default_engine(io, world, opts) catch |err| {
@@ -925,10 +2034,10 @@ pub fn generateFormatWithEngine(io: Io, opts: *const CompileConfig, loaded_confi
         Config.default().effective_bundle();
     const bundle_digest = Config.digest_from_url(bundle.url);
 
-    setup_world(io, engine, format, opts.verbose, opts.cache_dir, bundle, &bundle_digest, opts.deterministic);
+    _ = setup_world(io, engine, format, opts.verbose, opts.cache_dir, bundle, &bundle_digest, opts.deterministic, false);
     defer Bridge.deinit_bundle_store();
 
-    if (g_format_bytes == null) {
+    if (g_formats.in_use_bytes() == null) {
         Log.log(io, "eztex", .err, "format generation failed -- {s} not loaded into memory", .{engine.formatFileName(format)});
         return 1;
     }
@@ -937,16 +2046,51 @@ pub fn generateFormatWithEngine(io: Io, opts: *const CompileConfig, loaded_confi
     return 0;
 }
 
+// load the bundle index, cache manifest and format without compiling, so that
+// batch workers forked afterwards (Batch.zig) start warm. callers mark the
+// Runtime resident first, or the bundle store is torn down again here.
+pub fn warm_up(io: Io, opts: *const CompileConfig, loaded_config: ?Config) void {
+    const world = Bridge.get_world();
+    var engine = create_default_engine(io, world, opts) catch return;
+    defer engine.destroy();
+
+    const bundle = if (loaded_config) |config|
+        config.effective_bundle()
+    else
+        Config.default().effective_bundle();
+    const bundle_digest = Config.digest_from_url(bundle.url);
+
+    _ = setup_world(io, engine, opts.format, opts.verbose, opts.cache_dir, bundle, &bundle_digest, opts.deterministic, true);
+    Bridge.deinit_bundle_store();
+}
+
+// every format the engine supports, each initex run in its own process so
+// they overlap instead of queueing. formats already cached finish at once.
+pub fn generate_all_formats(io: Io, opts: *const CompileConfig) u8 {
+    const names = comptime blk: {
+        const fields = @typeInfo(Format).@"enum".fields;
+        var list: [fields.len][]const u8 = undefined;
+        for (fields, 0..) |f, i| list[i] = f.name;
+        break :blk list;
+    };
+    Log.log(io, "eztex", .info, "generating {d} formats...", .{names.len});
+    const failed = Host.generate_formats(&names, opts.cache_dir);
+    if (failed != 0) {
+        Log.log(io, "eztex", .err, "{d} of {d} formats failed to generate", .{ failed, names.len });
+        return 1;
+    }
+    Log.log(io, "eztex", .info, "all formats ready", .{});
+    return 0;
+}
+
 test "stabilization comparison treats aux as primary" {
     var prev = StabilizationSnapshot{};
-    defer prev.deinit();
     var curr = StabilizationSnapshot{};
-    defer curr.deinit();
 
-    prev.files[aux_stabilization_index] = try std.heap.c_allocator.dupe(u8, "same aux");
-    curr.files[aux_stabilization_index] = try std.heap.c_allocator.dupe(u8, "different aux");
-    prev.files[1] = try std.heap.c_allocator.dupe(u8, "same toc");
-    curr.files[1] = try std.heap.c_allocator.dupe(u8, "changed toc");
+    prev.digests[aux_stabilization_index] = std.hash.Wyhash.hash(0, "same aux");
+    curr.digests[aux_stabilization_index] = std.hash.Wyhash.hash(0, "different aux");
+    prev.digests[1] = std.hash.Wyhash.hash(0, "same toc");
+    curr.digests[1] = std.hash.Wyhash.hash(0, "changed toc");
 
     const status = compare_stabilization_snapshots(&prev, &curr);
 
@@ -957,14 +2101,12 @@ test "stabilization comparison treats aux as primary" {
 
 test "stabilization comparison detects secondary file changes" {
     var prev = StabilizationSnapshot{};
-    defer prev.deinit();
     var curr = StabilizationSnapshot{};
-    defer curr.deinit();
 
-    prev.files[aux_stabilization_index] = try std.heap.c_allocator.dupe(u8, "same aux");
-    curr.files[aux_stabilization_index] = try std.heap.c_allocator.dupe(u8, "same aux");
-    prev.files[1] = try std.heap.c_allocator.dupe(u8, "old toc");
-    curr.files[1] = try std.heap.c_allocator.dupe(u8, "new toc");
+    prev.digests[aux_stabilization_index] = std.hash.Wyhash.hash(0, "same aux");
+    curr.digests[aux_stabilization_index] = std.hash.Wyhash.hash(0, "same aux");
+    prev.digests[1] = std.hash.Wyhash.hash(0, "old toc");
+    curr.digests[1] = std.hash.Wyhash.hash(0, "new toc");
 
     const status = compare_stabilization_snapshots(&prev, &curr);
 
@@ -975,14 +2117,12 @@ test "stabilization comparison detects secondary file changes" {
 
 test "stabilization comparison accepts unchanged optional set" {
     var prev = StabilizationSnapshot{};
-    defer prev.deinit();
     var curr = StabilizationSnapshot{};
-    defer curr.deinit();
 
-    prev.files[aux_stabilization_index] = try std.heap.c_allocator.dupe(u8, "same aux");
-    curr.files[aux_stabilization_index] = try std.heap.c_allocator.dupe(u8, "same aux");
-    prev.files[1] = try std.heap.c_allocator.dupe(u8, "same toc");
-    curr.files[1] = try std.heap.c_allocator.dupe(u8, "same toc");
+    prev.digests[aux_stabilization_index] = std.hash.Wyhash.hash(0, "same aux");
+    curr.digests[aux_stabilization_index] = std.hash.Wyhash.hash(0, "same aux");
+    prev.digests[1] = std.hash.Wyhash.hash(0, "same toc");
+    curr.digests[1] = std.hash.Wyhash.hash(0, "same toc");
 
     const status = compare_stabilization_snapshots(&prev, &curr);
 
@@ -992,10 +2132,14 @@ test "stabilization comparison accepts unchanged optional set" {
 }
 
 test "bibliography_action rejects pure biblatex aux" {
-    try testing.expectEqual(BibliographyAction.unsupported_biblatex, bibliography_action(testing.io, "main.aux", "\\relax\n\\abx@aux@cite{0}{refA}\n"));
+    var scan = aux.scan_aux(testing.io, "main.aux", "\\relax\n\\abx@aux@cite{0}{refA}\n");
+    defer scan.deinit();
+    try testing.expectEqual(BibliographyAction.unsupported_biblatex, bibliography_action(scan.kind));
 }
 
 test "bibliography_action prefers bibtex for mixed markers" {
     const aux_contents = "\\relax\n\\abx@aux@cite{0}{refA}\n\\bibdata{refs}\n\\bibstyle{plain}\n";
-    try testing.expectEqual(BibliographyAction.run_bibtex, bibliography_action(testing.io, "main.aux", aux_contents));
+    var scan = aux.scan_aux(testing.io, "main.aux", aux_contents);
+    defer scan.deinit();
+    try testing.expectEqual(BibliographyAction.run_bibtex, bibliography_action(scan.kind));
 }
@@ -26,11 +26,20 @@ bundle: ?Bundle = null,
 // extra files to include in compilation environment
 files: ?[]const []const u8 = null,
 
+// compile cache shared between machines (see RemoteCache.zig)
+remote_cache: ?RemoteCache = null,
+
 pub const Format = enum { latex, plain };
 pub const Bundle = struct {
     url: ?[]const u8 = null,
     index: ?[]const u8 = null,
 };
+pub const RemoteCache = struct {
+    // base URL the cache's objects go under
+    url: ?[]const u8 = null,
+    // upload what this machine compiles, not only download (default: true)
+    push: ?bool = null,
+};
 
 pub const filename = "eztex.zon";
 
@@ -68,6 +77,16 @@ pub fn effective_bundle(self: Config) ResolvedBundle {
     };
 }
 
+// the path of a bundle or index kept on disk, given as "file:///srv/tex/bundle.tar";
+// null for one fetched over HTTP. a local bundle's entries are read from a
+// mapping of the file (see BundleStore.local_bundle); its index defaults to
+// <bundle>.index.gz beside it.
+pub fn local_path(url: []const u8) ?[]const u8 {
+    const scheme = "file://";
+    if (!std.mem.startsWith(u8, url, scheme) or url.len == scheme.len) return null;
+    return url[scheme.len..];
+}
+
 // compute SHA-256 hex digest from a URL at runtime. returns by value (thread-safe).
 pub fn digest_from_url(url: []const u8) [64]u8 {
     if (std.mem.eql(u8, url, default_bundle_url)) return default_bundle_digest;
@@ -278,3 +297,44 @@ test "digest_from_url returns deterministic hash for custom URL" {
     const d2 = digest_from_url("https://example.com/bundle.tar");
     try std.testing.expectEqualStrings(&d1, &d2);
 }
+
+test "local_path recognizes file URLs" {
+    try std.testing.expectEqualStrings("/srv/tex/bundle.tar", local_path("file:///srv/tex/bundle.tar").?);
+    try std.testing.expectEqualStrings("bundle.tar", local_path("file://bundle.tar").?);
+    try std.testing.expect(local_path("file://") == null);
+    try std.testing.expect(local_path("https://example.com/bundle.tar") == null);
+    try std.testing.expect(local_path(default_bundle_url) == null);
+}
+
+test "load config with remote cache" {
+    const allocator = std.testing.allocator;
+    const io = std.testing.io;
+    var tmp_dir = std.testing.tmpDir(.{});
+    defer tmp_dir.cleanup();
+
+    const content: [:0]const u8 =
+        \\.{
+        \\    .remote_cache = .{
+        \\        .url = "https://cache.example.com/eztex",
+        \\        .push = false,
+        \\    },
+        \\}
+    ;
+    try tmp_dir.dir.writeFile(io, .{ .sub_path = filename, .data = content });
+
+    var rel_buf: [256]u8 = undefined;
+    const tmp_path = std.fmt.bufPrintZ(&rel_buf, ".zig-cache/tmp/{s}", .{&tmp_dir.sub_path}) catch return error.Unexpected;
+    var path_buf: [4096]u8 = undefined;
+    const dir_path_raw = std.c.realpath(tmp_path, &path_buf) orelse return error.Unexpected;
+    const dir_path: []const u8 = std.mem.sliceTo(dir_path_raw, 0);
+
+    const config = try Config.load(io, allocator, dir_path);
+    try std.testing.expect(config != null);
+    const c = config.?;
+    defer c.deinit(allocator);
+
+    const r = c.remote_cache.?;
+    try std.testing.expectEqualStrings("https://cache.example.com/eztex", r.url.?);
+    try std.testing.expect(r.push.? == false);
+    try std.testing.expect(c.bundle == null);
+}
@@ -0,0 +1,134 @@
+// DiagRecords.zig -- the compile's warnings and errors as compact records.
+//
+// The engines hand each diagnostic over as text ("file:line: message" and
+// context lines, see compile/diagnostics.zig), which is split once, when it
+// arrives, and appended here. The app reads the buffer through
+// eztex_query_diagnostics instead of matching every stderr line of a log
+// with thousands of overfull boxes; embedders get it in Embedded.Result.
+//
+// Only the last TeX pass counts: the compiler resets the buffer before each
+// pass, since earlier passes warn about references the later ones resolve.
+// The buffer keeps its capacity across compiles.
+//
+// A record, little endian:
+//   u8   severity (0 error, 1 warning)
+//   u32  line, 0 when there is none
+//   u16  file length, u16 message length, u32 context length
+//   the file, message and context bytes
+
+const std = @import("std");
+
+pub const Severity = enum(u8) {
+    err = 0,
+    warning = 1,
+};
+
+pub const Record = struct {
+    severity: Severity,
+    file: ?[]const u8 = null,
+    line: ?u32 = null,
+    message: []const u8,
+    context: ?[]const u8 = null,
+};
+
+const header_len = 1 + 4 + 2 + 2 + 4;
+// a runaway document's warnings stop being kept here, not being printed
+const max_bytes = 4 * 1024 * 1024;
+
+threadlocal var buf: std.ArrayList(u8) = .empty;
+threadlocal var dropped: u32 = 0;
+
+pub fn reset() void {
+    buf.clearRetainingCapacity();
+    dropped = 0;
+}
+
+pub fn append(r: Record) void {
+    if (buf.items.len >= max_bytes) {
+        dropped += 1;
+        return;
+    }
+    encode(&buf, std.heap.c_allocator, r) catch {
+        dropped += 1;
+    };
+}
+
+fn encode(out: *std.ArrayList(u8), gpa: std.mem.Allocator, r: Record) !void {
+    const file = r.file orelse "";
+    const f = file[0..@min(file.len, std.math.maxInt(u16))];
+    const m = r.message[0..@min(r.message.len, std.math.maxInt(u16))];
+    const ctx = r.context orelse "";
+    try out.ensureUnusedCapacity(gpa, header_len + f.len + m.len + ctx.len);
+    var header: [header_len]u8 = undefined;
+    header[0] = @intFromEnum(r.severity);
+    std.mem.writeInt(u32, header[1..5], r.line orelse 0, .little);
+    std.mem.writeInt(u16, header[5..7], @intCast(f.len), .little);
+    std.mem.writeInt(u16, header[7..9], @intCast(m.len), .little);
+    std.mem.writeInt(u32, header[9..13], @intCast(ctx.len), .little);
+    out.appendSliceAssumeCapacity(&header);
+    out.appendSliceAssumeCapacity(f);
+    out.appendSliceAssumeCapacity(m);
+    out.appendSliceAssumeCapacity(ctx);
+}
+
+// the records since the last reset
+pub fn bytes() []const u8 {
+    return buf.items;
+}
+
+// diagnostics left out once the buffer was full
+pub fn dropped_count() u32 {
+    return dropped;
+}
+
+pub const Iterator = struct {
+    data: []const u8,
+    pos: usize = 0,
+
+    pub fn next(self: *Iterator) ?Record {
+        const rest = self.data[self.pos..];
+        if (rest.len < header_len) return null;
+        const severity = std.meta.intToEnum(Severity, rest[0]) catch return null;
+        const line = std.mem.readInt(u32, rest[1..5], .little);
+        const file_len = std.mem.readInt(u16, rest[5..7], .little);
+        const message_len = std.mem.readInt(u16, rest[7..9], .little);
+        const context_len = std.mem.readInt(u32, rest[9..13], .little);
+        const total = header_len + file_len + message_len + context_len;
+        if (rest.len < total) return null;
+        self.pos += total;
+        const file = rest[header_len..][0..file_len];
+        const message = rest[header_len + file_len ..][0..message_len];
+        const context = rest[header_len + file_len + message_len ..][0..context_len];
+        return .{
+            .severity = severity,
+            .file = if (file.len > 0) file else null,
+            .line = if (line > 0) line else null,
+            .message = message,
+            .context = if (context.len > 0) context else null,
+        };
+    }
+};
+
+pub fn iterate(data: []const u8) Iterator {
+    return .{ .data = data };
+}
+
+test "records round trip" {
+    const gpa = std.testing.allocator;
+    var out: std.ArrayList(u8) = .empty;
+    defer out.deinit(gpa);
+    try encode(&out, gpa, .{ .severity = .err, .file = "./main.tex", .line = 12, .message = "Undefined control sequence.", .context = "l.12 \\foo" });
+    try encode(&out, gpa, .{ .severity = .warning, .message = "Overfull \\hbox" });
+
+    var it = iterate(out.items);
+    const first = it.next().?;
+    try std.testing.expectEqual(Severity.err, first.severity);
+    try std.testing.expectEqualStrings("./main.tex", first.file.?);
+    try std.testing.expectEqual(@as(?u32, 12), first.line);
+    try std.testing.expectEqualStrings("Undefined control sequence.", first.message);
+    try std.testing.expectEqualStrings("l.12 \\foo", first.context.?);
+    const second = it.next().?;
+    try std.testing.expectEqual(Severity.warning, second.severity);
+    try std.testing.expect(second.file == null and second.line == null and second.context == null);
+    try std.testing.expect(it.next() == null);
+}
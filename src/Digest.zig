@@ -1,11 +1,26 @@
-// Digest.zig -- unified SHA-256 hex digest utilities.
+// Digest.zig -- unified digest utilities.
 //
-// Single source of truth for computing SHA-256 hashes and converting
-// them to lowercase hex strings. All functions are comptime-capable.
+// Single source of truth for the hashes eztex computes and for turning
+// them into lowercase hex strings.
+//
+// SHA-256 is for digests that leave the process or the machine: the bundle
+// digest, format cache keys, memo results shared through RemoteCache.zig.
+// std's Sha256 uses the SHA-NI (x86) and SHA2 (aarch64) instructions when
+// the target CPU has them, which a native build (the default -Dcpu) does on
+// any recent machine; a baseline or wasm build hashes in software.
+//
+// BLAKE3 (Internal) is for digests only this eztex compares with each
+// other: the bundle cache's content addresses, picture keys, the watcher's
+// input digests. it is several times faster than SHA-256 in software and
+// still ahead of the SHA extensions once its SIMD paths kick in. nothing
+// persistent may switch between the two without a version bump.
 
 const std = @import("std");
+const Io = std.Io;
 const Sha256 = std.crypto.hash.sha2.Sha256;
 
+pub const Internal = std.crypto.hash.Blake3;
+
 // convert 32 raw bytes to 64-char lowercase hex string.
 pub fn toHex(raw: [32]u8) [64]u8 {
     const hex_chars = "0123456789abcdef";
@@ -28,3 +43,38 @@ pub fn hashBytes(input: []const u8) [32]u8 {
 pub fn hexDigest(input: []const u8) [64]u8 {
     return toHex(hashBytes(input));
 }
+
+// compute raw BLAKE3 hash of input bytes, for internal digests.
+pub fn internalBytes(input: []const u8) [32]u8 {
+    var hash: [32]u8 = undefined;
+    Internal.hash(input, &hash, .{});
+    return hash;
+}
+
+// compute BLAKE3 hash and return as 64-char hex string.
+pub fn hexInternal(input: []const u8) [64]u8 {
+    return toHex(internalBytes(input));
+}
+
+// hash a file's content with Hash (Sha256, Internal, Md5 for the engines),
+// streaming it in 64 KiB reads. null when it cannot be opened or read.
+pub fn hashFile(comptime Hash: type, io: Io, path: []const u8) ?[Hash.digest_length]u8 {
+    const file = Io.Dir.cwd().openFile(io, path, .{}) catch return null;
+    defer file.close(io);
+    return hashOpenFile(Hash, io, file);
+}
+
+pub fn hashOpenFile(comptime Hash: type, io: Io, file: Io.File) ?[Hash.digest_length]u8 {
+    var h = Hash.init(.{});
+    var buf: [64 * 1024]u8 = undefined;
+    var offset: u64 = 0;
+    while (true) {
+        const n = file.readPositionalAll(io, &buf, offset) catch return null;
+        h.update(buf[0..n]);
+        if (n < buf.len) break;
+        offset += n;
+    }
+    var out: [Hash.digest_length]u8 = undefined;
+    h.final(&out);
+    return out;
+}
@@ -0,0 +1,214 @@
+// Embedded.zig -- compile a document held in memory, for embedders.
+//
+// Editors and services that link eztex hand over the document's files as
+// bytes and get the PDF back the same way; nothing of the document touches
+// the disk. The engines read the files from World.memory_files before the
+// bundle, and every output they close lands there too (see
+// World.wants_memory_output), as do the .bibstate and other files the
+// compiler writes itself (see aux.Overlay). Only the bundle cache and the
+// format cache stay on disk, where every compile shares them.
+//
+//   var result = try Embedded.compile(io, &.{
+//       .{ .path = "main.tex", .data = source },
+//       .{ .path = "refs.bib", .data = bib },
+//   }, .{ .main = "main.tex" });
+//   defer result.deinit();
+//   if (result.pdf) |pdf| ...
+//
+// The result keeps every file of the compile, the .aux, .toc and .bbl
+// among them. Passing them back with the next compile of the same document
+// lets its first pass be the last, as --keep-intermediates does on disk.
+//
+// C callers get the same through eztex_compile and friends, exported from
+// libeztex (zig build lib).
+
+const std = @import("std");
+const Io = std.Io;
+const Host = @import("Host.zig");
+const Bridge = @import("Engine.zig");
+const World = @import("World.zig");
+const Runtime = @import("Runtime.zig");
+const Compiler = @import("Compiler.zig");
+const EngineApi = @import("EngineInterface.zig");
+const aux = @import("compile/aux.zig");
+const DiagRecords = @import("DiagRecords.zig");
+
+pub const File = struct {
+    path: []const u8,
+    data: []const u8,
+};
+
+pub const Options = struct {
+    // the document to typeset, one of the files
+    main: []const u8,
+    mode: Compiler.CompileMode = .full,
+    format: Compiler.Format = .latex,
+    paperspec: []const u8 = "letter",
+    pdf_profile: ?EngineApi.PdfProfile = null,
+    deterministic: bool = false,
+    verbose: bool = false,
+    cache_dir: ?[]const u8 = null,
+};
+
+pub const Result = struct {
+    ok: bool = false,
+    // <jobname>.pdf and <jobname>.log, when the compile got that far
+    pdf: ?[]const u8 = null,
+    log: ?[]const u8 = null,
+    // the files passed in and everything the compile wrote, by name
+    files: World.MemoryFiles = .{},
+    // the last pass's warnings and errors, as DiagRecords.zig lays them out
+    diagnostics: []u8 = &.{},
+
+    pub fn get(self: *const Result, name: []const u8) ?[]const u8 {
+        return self.files.get(name);
+    }
+
+    pub fn diagnostic_records(self: *const Result) DiagRecords.Iterator {
+        return DiagRecords.iterate(self.diagnostics);
+    }
+
+    pub fn deinit(self: *Result) void {
+        self.files.deinit();
+        std.heap.c_allocator.free(self.diagnostics);
+        self.* = .{};
+    }
+};
+
+// typeset options.main from files. the result owns its bytes; errors are
+// for files that could not be copied in, a failed compile is result.ok false
+pub fn compile(io: Io, files: []const File, options: Options) !Result {
+    var result: Result = .{};
+    errdefer result.deinit();
+    for (files) |f| try result.files.put_copy(f.path, f.data);
+
+    // a caller without a runtime of its own gets one for this compile
+    var own_runtime: ?Runtime = null;
+    if (Runtime.instance == null) {
+        Bridge.set_global_io(io);
+        own_runtime = Runtime.init(io);
+        own_runtime.?.activate();
+    }
+    defer if (own_runtime) |*rt| rt.deactivate();
+
+    const world = Bridge.get_world();
+    world.memory_files = &result.files;
+    defer world.memory_files = null;
+    aux.overlay = .{ .ctx = &result.files, .read = overlay_read, .write = overlay_write };
+    defer aux.overlay = null;
+
+    // gz outputs (synctex) and the manifest beside the PDF need a file, and
+    // the picture cache and preamble formats write to the document's cache
+    const cc: Compiler.CompileConfig = .{
+        .input_file = options.main,
+        .mode = options.mode,
+        .format = options.format,
+        .paperspec = options.paperspec,
+        .pdf_profile = options.pdf_profile,
+        .deterministic = options.deterministic,
+        .verbose = options.verbose,
+        .cache_dir = options.cache_dir,
+        .reuse_output = false,
+    };
+    result.ok = Compiler.compile(io, &cc, null) == 0;
+    result.diagnostics = try std.heap.c_allocator.dupe(u8, DiagRecords.bytes());
+
+    const base = std.fs.path.basename(options.main);
+    const jobname = if (std.mem.endsWith(u8, base, ".tex")) base[0 .. base.len - 4] else base;
+    var buf: [512]u8 = undefined;
+    if (std.fmt.bufPrint(&buf, "{s}.pdf", .{jobname})) |name| result.pdf = result.files.get(name) else |_| {}
+    if (std.fmt.bufPrint(&buf, "{s}.log", .{jobname})) |name| result.log = result.files.get(name) else |_| {}
+    if (!result.ok) result.pdf = null;
+    return result;
+}
+
+fn overlay_read(ctx: *anyopaque, path: []const u8) ?[]const u8 {
+    const files: *World.MemoryFiles = @ptrCast(@alignCast(ctx));
+    return files.get(path);
+}
+
+fn overlay_write(ctx: *anyopaque, path: []const u8, data: []const u8) bool {
+    const files: *World.MemoryFiles = @ptrCast(@alignCast(ctx));
+    files.put_copy(path, data) catch return false;
+    return true;
+}
+
+// -- C ABI --
+//
+//   typedef struct { const char *path; const uint8_t *data; size_t len; } eztex_file;
+//
+//   eztex_result *eztex_compile(const eztex_file *files, size_t n,
+//                               const char *main, int preview);
+//   int eztex_result_ok(const eztex_result *r);
+//   const uint8_t *eztex_result_pdf(const eztex_result *r, size_t *len);
+//   const uint8_t *eztex_result_file(const eztex_result *r, const char *name, size_t *len);
+//   const uint8_t *eztex_result_diagnostics(const eztex_result *r, size_t *len);
+//   void eztex_result_free(eztex_result *r);
+//
+// eztex_compile returns NULL only when out of memory. the bytes the result
+// hands out live until eztex_result_free.
+
+pub const CFile = extern struct {
+    path: [*:0]const u8,
+    data: [*]const u8,
+    len: usize,
+};
+
+fn eztex_compile(c_files: [*]const CFile, n: usize, main: [*:0]const u8, preview: c_int) callconv(.c) ?*Result {
+    const alloc = std.heap.c_allocator;
+    var threaded: Io.Threaded = .init_single_threaded;
+    const io = threaded.io();
+
+    const files = alloc.alloc(File, n) catch return null;
+    defer alloc.free(files);
+    for (files, c_files[0..n]) |*f, c| f.* = .{ .path = std.mem.span(c.path), .data = c.data[0..c.len] };
+
+    const result = alloc.create(Result) catch return null;
+    result.* = compile(io, files, .{
+        .main = std.mem.span(main),
+        .mode = if (preview != 0) .preview else .full,
+    }) catch {
+        alloc.destroy(result);
+        return null;
+    };
+    return result;
+}
+
+fn eztex_result_ok(result: *const Result) callconv(.c) c_int {
+    return @intFromBool(result.ok);
+}
+
+fn eztex_result_pdf(result: *const Result, len: *usize) callconv(.c) ?[*]const u8 {
+    const pdf = result.pdf orelse return null;
+    len.* = pdf.len;
+    return pdf.ptr;
+}
+
+fn eztex_result_file(result: *const Result, name: [*:0]const u8, len: *usize) callconv(.c) ?[*]const u8 {
+    const data = result.get(std.mem.span(name)) orelse return null;
+    len.* = data.len;
+    return data.ptr;
+}
+
+// the records of DiagRecords.zig, for the caller to walk
+fn eztex_result_diagnostics(result: *const Result, len: *usize) callconv(.c) [*]const u8 {
+    len.* = result.diagnostics.len;
+    return result.diagnostics.ptr;
+}
+
+fn eztex_result_free(result: ?*Result) callconv(.c) void {
+    const r = result orelse return;
+    r.deinit();
+    std.heap.c_allocator.destroy(r);
+}
+
+comptime {
+    if (!Host.is_wasm) {
+        @export(&eztex_compile, .{ .name = "eztex_compile" });
+        @export(&eztex_result_ok, .{ .name = "eztex_result_ok" });
+        @export(&eztex_result_pdf, .{ .name = "eztex_result_pdf" });
+        @export(&eztex_result_file, .{ .name = "eztex_result_file" });
+        @export(&eztex_result_diagnostics, .{ .name = "eztex_result_diagnostics" });
+        @export(&eztex_result_free, .{ .name = "eztex_result_free" });
+    }
+}
@@ -6,13 +6,16 @@
 //   - Re-exports of World.zig and BundleStore.zig for internal callers
 
 const std = @import("std");
-const builtin = @import("builtin");
 const Io = std.Io;
 const Log = @import("Log.zig");
 const Config = @import("Config.zig");
 pub const World = @import("World.zig");
 pub const BundleStore = @import("BundleStore.zig");
 const Runtime = @import("Runtime.zig");
+const Host = @import("Host.zig");
+const Digest = @import("Digest.zig");
+const Flate = @import("Flate.zig");
+pub const MemStats = @import("MemStats.zig");
 
 var global_io_instance: ?Io = null;
 var fallback_threaded: std.Io.Threaded = .init_single_threaded;
@@ -49,9 +52,9 @@ const Diagnostic = struct {
     }
 };
 
-var global_world: World = .{};
-var global_bundle_store: ?BundleStore = null;
-var global_diag_handler: ?World.DiagnosticHandler = null;
+threadlocal var global_world: World = .{};
+threadlocal var global_bundle_store: ?BundleStore = null;
+threadlocal var global_diag_handler: ?World.DiagnosticHandler = null;
 
 pub fn get_world() *World {
     if (Runtime.instance) |rt| return &rt.world;
@@ -85,6 +88,10 @@ pub fn ensure_bundle_store() *BundleStore {
 
 pub fn deinit_bundle_store() void {
     if (Runtime.instance) |rt| {
+        if (rt.resident) {
+            rt.bundle_store.finish_compile();
+            return;
+        }
         rt.bundle_store.deinit();
         return;
     }
@@ -137,18 +144,38 @@ export fn ttbc_issue_error(text: [*:0]const u8) void {
     emit_error(io, std.mem.span(text));
 }
 
-export fn ttbc_diag_begin_warning() ?*Diagnostic {
-    const alloc = std.heap.c_allocator;
-    const d = alloc.create(Diagnostic) catch return null;
-    d.* = .{ .is_error = false };
+// finished diagnostics wait here for the next ttbc_diag_begin_*: a log full
+// of overfull boxes would otherwise allocate (and zero) one per warning
+threadlocal var diag_pool: [4]?*Diagnostic = @splat(null);
+
+fn take_diagnostic(is_error: bool) ?*Diagnostic {
+    const d = for (&diag_pool) |*slot| {
+        if (slot.*) |d| {
+            slot.* = null;
+            break d;
+        }
+    } else std.heap.c_allocator.create(Diagnostic) catch return null;
+    d.len = 0;
+    d.is_error = is_error;
     return d;
 }
 
+fn return_diagnostic(d: *Diagnostic) void {
+    for (&diag_pool) |*slot| {
+        if (slot.* == null) {
+            slot.* = d;
+            return;
+        }
+    }
+    std.heap.c_allocator.destroy(d);
+}
+
+export fn ttbc_diag_begin_warning() ?*Diagnostic {
+    return take_diagnostic(false);
+}
+
 export fn ttbc_diag_begin_error() ?*Diagnostic {
-    const alloc = std.heap.c_allocator;
-    const d = alloc.create(Diagnostic) catch return null;
-    d.* = .{ .is_error = true };
-    return d;
+    return take_diagnostic(true);
 }
 
 export fn ttbc_diag_append(diag: ?*Diagnostic, text: [*:0]const u8) void {
@@ -166,7 +193,7 @@ export fn ttbc_diag_finish(diag: ?*Diagnostic) void {
                 emit_warning(io, d.slice());
             }
         }
-        std.heap.c_allocator.destroy(d);
+        return_diagnostic(d);
     }
 }
 
@@ -177,21 +204,46 @@ export fn ttbc_get_file_md5(path: [*:0]const u8, digest: [*]u8) c_int {
     const world = get_world();
     const io = get_global_io();
 
-    const file = world.try_open_input(io, path_slice, World.TTBC_FILE_FORMAT_TEX) orelse {
+    const file = switch (world.try_open_input(io, path_slice, World.TTBC_FILE_FORMAT_TEX) orelse {
         @memset(digest[0..16], 0);
         return 1;
+    }) {
+        .bytes => |bytes| {
+            Md5.hash(bytes, digest[0..16], .{});
+            return 0;
+        },
+        .owned => |owned| {
+            defer owned.allocator.free(owned.data);
+            Md5.hash(owned.data, digest[0..16], .{});
+            return 0;
+        },
+        .deflated => |deflated| {
+            const data = Flate.inflate_exact(std.heap.c_allocator, deflated.data, deflated.raw_len) catch {
+                @memset(digest[0..16], 0);
+                return 1;
+            };
+            defer std.heap.c_allocator.free(data);
+            Md5.hash(data, digest[0..16], .{});
+            return 0;
+        },
+        .file => |f| f,
     };
     defer file.close(io);
 
-    var read_buf: [64 * 1024]u8 = undefined;
-    var file_reader = Io.File.Reader.init(file, io, &read_buf);
-    const content = file_reader.interface.allocRemaining(std.heap.c_allocator, .limited(16 * 1024 * 1024)) catch {
+    // files on disk are hashed once per content, going by size and mtime
+    const stat = file.stat(io) catch null;
+    if (stat) |st| {
+        if (world.cached_file_md5(path_slice, st)) |d| {
+            digest[0..16].* = d;
+            return 0;
+        }
+    }
+    const d = Digest.hashOpenFile(Md5, io, file) orelse {
         @memset(digest[0..16], 0);
         return 1;
     };
-    defer std.heap.c_allocator.free(content);
-
-    Md5.hash(content, digest[0..16], .{});
+    if (stat) |st| world.note_file_md5(path_slice, st, d);
+    digest[0..16].* = d;
     return 0;
 }
 
@@ -206,6 +258,19 @@ export fn ttbc_output_open(name: [*:0]const u8, is_gz: c_int) Handle {
     Log.dbg(io, "bridge", "output_open('{s}', is_gz={d})", .{ name_slice, is_gz });
 
     const world = get_world();
+    world.forget_missing(name_slice);
+
+    if (world.wants_discarded_output(name_slice)) {
+        Log.dbg(io, "bridge", "  -> discarded", .{});
+        return world.alloc_discard_output(name_slice);
+    }
+
+    if (is_gz == 0 and world.wants_memory_output(name_slice)) {
+        const h = world.alloc_memory_output(name_slice);
+        Log.dbg(io, "bridge", "  -> memory-backed output handle {d}", .{h});
+        return h;
+    }
+
     const file = blk: {
         if (world.output_dir_len > 0) {
             const out_dir = world.output_dir[0..world.output_dir_len];
@@ -220,6 +285,7 @@ export fn ttbc_output_open(name: [*:0]const u8, is_gz: c_int) Handle {
         }
     };
 
+    world.note_written(name_slice);
     return world.alloc_output(file, name_slice, false, is_gz != 0);
 }
 
@@ -253,68 +319,38 @@ export fn ttbc_output_flush(handle: Handle) c_int {
     return 0;
 }
 
-extern fn gzdopen(fd: c_int, mode: [*:0]const u8) ?*anyopaque;
-extern fn gzwrite(gz: *anyopaque, buf: [*]const u8, len: c_uint) c_int;
-extern fn gzclose(gz: *anyopaque) c_int;
-
 export fn ttbc_output_close(handle: Handle) c_int {
     const world = get_world();
     const io = get_global_io();
     var slot = world.get_output(handle) orelse return 0;
-    defer world.outputs[handle - 1] = null;
-
-    if (slot.is_gz) {
-        if (slot.gz_buf) |buf| {
-            defer {
-                buf.deinit(std.heap.c_allocator);
-                std.heap.c_allocator.destroy(buf);
-            }
-            const data = buf.items;
-            const raw_fd = slot.file.handle;
-            if (builtin.os.tag == .windows) {
-                var write_buf: [4096]u8 = undefined;
-                var writer = slot.file.writer(io, &write_buf);
-                if (data.len > 0) _ = writer.interface.writeAll(data) catch {};
-                _ = writer.interface.flush() catch {};
-                slot.file.close(io);
-                return 0;
-            }
-            const dup_result = std.posix.system.dup(raw_fd);
-            if (dup_result < 0) {
-                var write_buf: [4096]u8 = undefined;
-                var writer = slot.file.writer(io, &write_buf);
-                if (data.len > 0) _ = writer.interface.writeAll(data) catch {};
-                _ = writer.interface.flush() catch {};
-                slot.file.close(io);
-                return 0;
-            }
-            const dup_fd: c_int = @intCast(dup_result);
-            const gz = gzdopen(dup_fd, "wb") orelse {
-                _ = std.posix.system.close(dup_fd);
-                var write_buf: [4096]u8 = undefined;
-                var writer = slot.file.writer(io, &write_buf);
-                if (data.len > 0) _ = writer.interface.writeAll(data) catch {};
-                _ = writer.interface.flush() catch {};
-                slot.file.close(io);
-                return -1;
-            };
-            if (data.len > 0) {
-                const written = gzwrite(gz, data.ptr, @intCast(data.len));
-                if (written < 0 or @as(usize, @intCast(written)) != data.len) {
-                    _ = gzclose(gz);
-                    slot.file.close(io);
-                    return -1;
-                }
-            }
-            _ = gzclose(gz);
-            slot.file.close(io);
-        }
+    defer world.release_output(handle);
+
+    if (slot.mem_buf) |buf| {
+        defer World.io_alloc.destroy(buf);
+        slot.note_digest(buf.items);
+        world.record_output_digest(slot);
+        const data = buf.toOwnedSlice(World.io_alloc) catch {
+            buf.deinit(World.io_alloc);
+            return -1;
+        };
+        Log.dbg(io, "bridge", "output_close: retained '{s}' in memory ({d} bytes)", .{ slot.get_name(), data.len });
+        world.set_memory_output(data, slot.get_name());
         return 0;
     }
 
+    if (slot.discard) return 0;
+    const file = slot.file orelse return -1;
+
+    if (slot.gz != null) {
+        const ok = slot.finish_gz(io);
+        file.close(io);
+        return if (ok) 0 else -1;
+    }
+
     if (!slot.is_stdout) {
         slot.flush(io) catch {};
-        slot.file.close(io);
+        world.record_output_digest(slot);
+        file.close(io);
     }
     return 0;
 }
@@ -327,6 +363,12 @@ export fn ttbc_input_open(name: [*:0]const u8, format: FileFormat, is_gz: c_int)
 
     const world = get_world();
 
+    if (world.find_memory_output(name_slice)) |data| {
+        const h = world.alloc_memory_input(data, name_slice);
+        Log.dbg(io, "bridge", "  -> memory output handoff {d} ({d} bytes)", .{ h, data.len });
+        return h;
+    }
+
     if (format == World.TTBC_FILE_FORMAT_FORMAT) {
         if (world.format_data) |data| {
             const h = world.alloc_memory_input(data, name_slice);
@@ -335,12 +377,12 @@ export fn ttbc_input_open(name: [*:0]const u8, format: FileFormat, is_gz: c_int)
         }
     }
 
-    const file = world.try_open_input(io, name_slice, format) orelse {
+    const opened = world.try_open_input(io, name_slice, format) orelse {
         Log.dbg(io, "bridge", "  -> not found", .{});
         return INVALID_HANDLE;
     };
 
-    const h = world.alloc_input(io, file, name_slice);
+    const h = world.alloc_opened_input(io, world.filter_opened_input(io, opened, format), name_slice);
     Log.dbg(io, "bridge", "  -> handle {d}", .{h});
     return h;
 }
@@ -355,12 +397,22 @@ export fn ttbc_input_open_primary() Handle {
     const name = world.primary_input[0..world.primary_input_len];
     Log.dbg(io, "bridge", "input_open_primary('{s}')", .{name});
 
-    const file = world.try_open_input(io, name, World.TTBC_FILE_FORMAT_TEX) orelse {
+    if (world.primary_input_override) |data| {
+        world.primary_input_override = null;
+        // it stands in for the document: synctex and the open log see that
+        world.record_abspath(io, name);
+        world.note_opened(null, name);
+        Log.dbg(io, "bridge", "  -> override ({d} bytes)", .{data.len});
+        if (world.filter_text(data)) |filtered| return world.alloc_owned_input(filtered, std.heap.c_allocator, name);
+        return world.alloc_memory_input(data, name);
+    }
+
+    const opened = world.try_open_input(io, name, World.TTBC_FILE_FORMAT_TEX) orelse {
         Log.dbg(io, "bridge", "  -> not found", .{});
         return INVALID_HANDLE;
     };
 
-    return world.alloc_input(io, file, name);
+    return world.alloc_opened_input(io, world.filter_opened_input(io, opened, World.TTBC_FILE_FORMAT_TEX), name);
 }
 
 export fn ttbc_get_last_input_abspath(buffer: [*]u8, len: usize) isize {
@@ -471,6 +523,26 @@ export fn ttbc_input_getc(handle: Handle) c_int {
     return @intCast(buf[0]);
 }
 
+// Zero-copy view of the unread bytes of an input, for readers that scan a whole
+// line at a time (see input_line in xetex-io.c). Refuses while an ungetc byte is
+// pending so the caller falls back to ttbc_input_getc.
+export fn ttbc_input_peek(handle: Handle, data: *[*]const u8, len: *usize) c_int {
+    const world = get_world();
+    const io = get_global_io();
+    const slot = world.get_input(handle) orelse return -1;
+    if (slot.ungetc_byte != null) return -1;
+    const span = slot.peek(io) catch return -1;
+    data.* = span.ptr;
+    len.* = span.len;
+    return 0;
+}
+
+export fn ttbc_input_consume(handle: Handle, n: usize) void {
+    const world = get_world();
+    const slot = world.get_input(handle) orelse return;
+    slot.consume(n);
+}
+
 export fn ttbc_input_ungetc(handle: Handle, ch: c_int) c_int {
     const world = get_world();
     const slot = world.get_input(handle) orelse return -1;
@@ -528,16 +600,72 @@ export fn ttbc_input_close(handle: Handle) c_int {
     const io = get_global_io();
     const slot = world.get_input(handle) orelse return 0;
     slot.close(io);
-    world.inputs[handle - 1] = null;
+    world.release_input(handle);
     return 0;
 }
 
+// -- format images (see load_fmt_file in xetex-ini.c) --
+
+export fn ttbc_format_image_get(len: *usize, is_private: *c_int) ?*anyopaque {
+    const world = get_world();
+    const io = get_global_io();
+    const image = world.map_format_image(io) orelse return null;
+    Log.dbg(io, "bridge", "format_image_get -> {d} bytes (private mapping)", .{image.len});
+    len.* = image.len;
+    is_private.* = 1;
+    return image.ptr;
+}
+
+export fn ttbc_format_image_begin(total_len: u64) c_int {
+    const world = get_world();
+    const io = get_global_io();
+    const wanted = world.begin_format_image(io, total_len);
+    if (wanted) Log.dbg(io, "bridge", "format_image_begin({d} bytes)", .{total_len});
+    return @intFromBool(wanted);
+}
+
+export fn ttbc_format_image_write(offset: u64, data: [*]const u8, len: usize) c_int {
+    const world = get_world();
+    return if (world.write_format_image(get_global_io(), offset, data[0..len])) 0 else -1;
+}
+
+export fn ttbc_format_image_end(ok: c_int) void {
+    const world = get_world();
+    world.end_format_image(get_global_io(), ok != 0);
+}
+
+// -- cached blobs (see dpx-imagecache.c) --
+
+export fn ttbc_cache_blob_get(kind: [*:0]const u8, key: *const [16]u8, len: *usize) ?*anyopaque {
+    const content = Host.load_blob(std.mem.span(kind), key, std.heap.c_allocator) orelse return null;
+    if (content.len == 0) {
+        std.heap.c_allocator.free(content);
+        return null;
+    }
+    len.* = content.len;
+    return content.ptr;
+}
+
+export fn ttbc_cache_blob_put(kind: [*:0]const u8, key: *const [16]u8, data: [*]const u8, len: usize) void {
+    Host.cache_blob(std.mem.span(kind), key, data[0..len]);
+}
+
 export fn ttbc_shell_escape(cmd: [*]const u16, len: usize) c_int {
     _ = cmd;
     _ = len;
     return 1;
 }
 
+// -- allocation accounting (see MemStats.zig and support.c) --
+
+extern fn ttbc_mem_set_tracking(enabled: c_int) void;
+
+// count the C engines' allocations from here on, with peaks measured from now
+pub fn begin_memory_stats() void {
+    ttbc_mem_set_tracking(1);
+    MemStats.reset_peaks();
+}
+
 comptime {
     _ = @import("Flate.zig");
     _ = @import("Layout.zig");
@@ -547,19 +675,19 @@ comptime {
 pub const CheckpointCallback = Runtime.CheckpointCallback;
 
 extern fn ttbc_set_checkpoint_callback(
-    func: ?*const fn (userdata: ?*anyopaque, id: c_int) callconv(.c) void,
+    func: ?*const fn (userdata: ?*anyopaque, id: c_int, detail: ?[*:0]const u8) callconv(.c) void,
     userdata: ?*anyopaque,
 ) void;
 
-fn checkpoint_trampoline(userdata: ?*anyopaque, raw_id: c_int) callconv(.c) void {
+fn checkpoint_trampoline(userdata: ?*anyopaque, raw_id: c_int, detail: ?[*:0]const u8) callconv(.c) void {
     _ = userdata;
     const h = if (Runtime.instance) |rt| rt.checkpoint_handler else checkpoint_handler;
     if (h) |cb| {
-        cb.func(cb.userdata, raw_id);
+        cb.func(cb.userdata, raw_id, detail);
     }
 }
 
-var checkpoint_handler: ?CheckpointCallback = null;
+threadlocal var checkpoint_handler: ?CheckpointCallback = null;
 
 pub fn set_checkpoint_callback(callback: ?CheckpointCallback) void {
     if (Runtime.instance) |rt| {
@@ -4,6 +4,8 @@ pub const EngineConfig = config.EngineConfig;
 pub const EngineResult = config.EngineResult;
 pub const Format = config.Format;
 pub const OutputFormat = config.OutputFormat;
+pub const PdfProfile = config.PdfProfile;
+pub const PageRange = config.PageRange;
 pub const Value = config.Value;
 pub const Variable = config.Variable;
 
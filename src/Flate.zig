@@ -1,8 +1,10 @@
 // Flate.zig -- Zig implementation of tectonic_bridge_flate ABI.
 //
-// Replaces stubs/bridge_flate_stub.c. Compression delegates to zlib compress2
-// (Zig 0.15 flate.Compress is incomplete). Decompression uses std.compress.flate
-// with automatic container detection (gzip / zlib / raw).
+// Replaces stubs/bridge_flate_stub.c. Both one-shot calls go to zlib, which
+// always has the whole buffer here: compression through a deflate state kept
+// per thread (Zig 0.15 flate.Compress is incomplete), decompression through
+// inflate with the container (gzip / zlib / raw) found by sniffing. The
+// streaming decompressor uses std.compress.flate.
 
 const std = @import("std");
 const builtin = @import("builtin");
@@ -10,7 +12,7 @@ const flate = std.compress.flate;
 const Io = std.Io;
 
 // FlateResult matching the C ABI enum in tectonic_bridge_flate.h
-const FlateResult = enum(c_int) {
+pub const FlateResult = enum(c_int) {
     success = 0,
     stream_end = 1,
     buf_error = -1,
@@ -26,8 +28,42 @@ extern fn compress2(
     level: c_int,
 ) c_int;
 
+// z_stream of zlib.h
+const ZStream = extern struct {
+    next_in: ?[*]const u8 = null,
+    avail_in: c_uint = 0,
+    total_in: c_ulong = 0,
+    next_out: ?[*]u8 = null,
+    avail_out: c_uint = 0,
+    total_out: c_ulong = 0,
+    msg: ?[*:0]const u8 = null,
+    state: ?*anyopaque = null,
+    zalloc: ?*const anyopaque = null,
+    zfree: ?*const anyopaque = null,
+    @"opaque": ?*anyopaque = null,
+    data_type: c_int = 0,
+    adler: c_ulong = 0,
+    reserved: c_ulong = 0,
+};
+
+extern fn zlibVersion() [*:0]const u8;
+extern fn deflateInit2_(strm: *ZStream, level: c_int, method: c_int, window_bits: c_int, mem_level: c_int, strategy: c_int, version: [*:0]const u8, stream_size: c_int) c_int;
+extern fn deflate(strm: *ZStream, flush: c_int) c_int;
+extern fn deflateReset(strm: *ZStream) c_int;
+extern fn deflateEnd(strm: *ZStream) c_int;
+extern fn inflateInit2_(strm: *ZStream, window_bits: c_int, version: [*:0]const u8, stream_size: c_int) c_int;
+extern fn inflate(strm: *ZStream, flush: c_int) c_int;
+extern fn inflateEnd(strm: *ZStream) c_int;
+
 const Z_OK: c_int = 0;
+const Z_STREAM_END: c_int = 1;
 const Z_BUF_ERROR: c_int = -5;
+const Z_FINISH: c_int = 4;
+const Z_DEFLATED: c_int = 8;
+const Z_DEFAULT_STRATEGY: c_int = 0;
+// what compress2 uses, so the output is the same byte for byte
+const deflate_window_bits: c_int = 15;
+const deflate_mem_level: c_int = 8;
 
 // Detect gzip / zlib / raw container from the leading bytes.
 fn sniff_container(data: []const u8) flate.Container {
@@ -42,9 +78,53 @@ fn sniff_container(data: []const u8) flate.Container {
     return .raw;
 }
 
-// -- one-shot compress (zlib format via extern compress2) --
+// -- one-shot compress (zlib format) --
+
+// the engine thread's deflate state. setting one up (some 256 KiB of window
+// and tables, cleared) costs more than deflating a small content stream,
+// and a PDF has thousands of those; deflateReset keeps the memory.
+threadlocal var deflater: ZStream = .{};
+threadlocal var deflater_level: c_int = -1;
+
+pub export fn tectonic_flate_compress(
+    output_ptr: [*]u8,
+    output_len: *u64,
+    input_ptr: [*]const u8,
+    input_len: u64,
+    compression_level: u32,
+) FlateResult {
+    const level: c_int = @intCast(compression_level);
+    // avail_in and avail_out are 32 bits; compress2 splits larger buffers
+    if (input_len > std.math.maxInt(c_uint) or output_len.* > std.math.maxInt(c_uint)) {
+        return compress_once(output_ptr, output_len, input_ptr, input_len, compression_level);
+    }
+
+    if (deflater_level != level) {
+        if (deflater_level >= 0) _ = deflateEnd(&deflater);
+        deflater = .{};
+        deflater_level = -1;
+        if (deflateInit2_(&deflater, level, Z_DEFLATED, deflate_window_bits, deflate_mem_level, Z_DEFAULT_STRATEGY, zlibVersion(), @sizeOf(ZStream)) != Z_OK)
+            return .other_error;
+        deflater_level = level;
+    } else if (deflateReset(&deflater) != Z_OK) {
+        return .other_error;
+    }
+
+    deflater.next_in = input_ptr;
+    deflater.avail_in = @intCast(input_len);
+    deflater.next_out = output_ptr;
+    deflater.avail_out = @intCast(output_len.*);
+    const rc = deflate(&deflater, Z_FINISH);
+    output_len.* = deflater.total_out;
+    if (rc == Z_STREAM_END) return .success;
+    // compress2 reports a full output the same way
+    if (rc == Z_OK or rc == Z_BUF_ERROR) return .buf_error;
+    return .other_error;
+}
 
-export fn tectonic_flate_compress(
+// compress2: a deflate state of its own, for threads that stop (see
+// CompressJob) and for buffers too large for one deflate call
+pub fn compress_once(
     output_ptr: [*]u8,
     output_len: *u64,
     input_ptr: [*]const u8,
@@ -65,9 +145,170 @@ export fn tectonic_flate_compress(
     return .other_error;
 }
 
-// -- one-shot decompress (Zig flate with container sniff) --
+// -- background compress (see defer_stream in dpx-pdfobj.c) --
+// each job runs tectonic_flate_compress on a thread of its own; the caller
+// bounds how many are in flight. a job may first hand its input to a C
+// callback (a PNG predictor) and compress what that returns.
+
+// tectonic_flate_prepare_fn: a malloc'd buffer and its length, or null
+const PrepareFn = *const fn (ctx: ?*anyopaque, input_ptr: [*]const u8, input_len: u64, prepared_len: *u64) callconv(.c) ?[*]u8;
+
+extern fn compressBound(source_len: c_ulong) c_ulong;
+
+const CompressJob = struct {
+    thread: std.Thread,
+    input: []const u8,
+    level: u32,
+    prepare: ?PrepareFn = null,
+    ctx: ?*anyopaque = null,
+    output: ?[]u8 = null,
+    result: FlateResult = .other_error,
+
+    const heap = std.heap.c_allocator;
+
+    fn run(self: *CompressJob) void {
+        var input = self.input;
+        var prepared: ?[*]u8 = null;
+        defer if (prepared) |ptr| std.c.free(ptr);
+        if (self.prepare) |prepare| {
+            var prepared_len: u64 = 0;
+            prepared = prepare(self.ctx, input.ptr, input.len, &prepared_len) orelse return;
+            input = prepared.?[0..@intCast(prepared_len)];
+        }
+
+        const bound: usize = @intCast(compressBound(@intCast(input.len)));
+        const output = heap.alloc(u8, bound) catch return;
+        var len: u64 = output.len;
+        // this thread ends with the job, so it keeps no deflate state
+        self.result = compress_once(output.ptr, &len, input.ptr, input.len, self.level);
+        if (self.result != .success) {
+            heap.free(output);
+            return;
+        }
+        self.output = output[0..@intCast(len)];
+    }
+};
+
+export fn tectonic_flate_compress_start(
+    input_ptr: [*]const u8,
+    input_len: u64,
+    compression_level: u32,
+) ?*anyopaque {
+    return tectonic_flate_compress_start_prepared(input_ptr, input_len, compression_level, null, null);
+}
+
+export fn tectonic_flate_compress_start_prepared(
+    input_ptr: [*]const u8,
+    input_len: u64,
+    compression_level: u32,
+    prepare: ?PrepareFn,
+    ctx: ?*anyopaque,
+) ?*anyopaque {
+    if (comptime builtin.single_threaded) {
+        return null;
+    } else {
+        const job = CompressJob.heap.create(CompressJob) catch return null;
+        job.* = .{
+            .thread = undefined,
+            .input = input_ptr[0..@intCast(input_len)],
+            .level = compression_level,
+            .prepare = prepare,
+            .ctx = ctx,
+        };
+        job.thread = std.Thread.spawn(.{}, CompressJob.run, .{job}) catch {
+            CompressJob.heap.destroy(job);
+            return null;
+        };
+        return @ptrCast(job);
+    }
+}
 
-export fn tectonic_flate_decompress(
+export fn tectonic_flate_compress_finish(
+    handle: *anyopaque,
+    output_ptr: *?[*]u8,
+    output_len: *u64,
+) FlateResult {
+    const job: *CompressJob = @ptrCast(@alignCast(handle));
+    job.thread.join();
+    defer CompressJob.heap.destroy(job);
+    const output = job.output orelse {
+        output_ptr.* = null;
+        output_len.* = 0;
+        return job.result;
+    };
+    output_ptr.* = output.ptr;
+    output_len.* = output.len;
+    return .success;
+}
+
+// -- one-shot decompress (zlib inflate with container sniff) --
+
+pub export fn tectonic_flate_decompress(
+    output_ptr: [*]u8,
+    output_len: *u64,
+    input_ptr: [*]const u8,
+    input_len: u64,
+) FlateResult {
+    if (input_len > std.math.maxInt(c_uint) or output_len.* > std.math.maxInt(c_uint)) {
+        return decompress_std(output_ptr, output_len, input_ptr, input_len);
+    }
+
+    const window_bits: c_int = switch (sniff_container(input_ptr[0..@intCast(input_len)])) {
+        .gzip => 16 + 15,
+        .zlib => 15,
+        .raw => -15,
+    };
+    var zs: ZStream = .{};
+    if (inflateInit2_(&zs, window_bits, zlibVersion(), @sizeOf(ZStream)) != Z_OK) {
+        output_len.* = 0;
+        return .other_error;
+    }
+    defer _ = inflateEnd(&zs);
+
+    zs.next_in = input_ptr;
+    zs.avail_in = @intCast(input_len);
+    zs.next_out = output_ptr;
+    zs.avail_out = @intCast(output_len.*);
+    const rc = inflate(&zs, Z_FINISH);
+    output_len.* = zs.total_out;
+    if (rc == Z_STREAM_END) return .success;
+    // out of room, as opposed to out of input
+    if ((rc == Z_OK or rc == Z_BUF_ERROR) and zs.avail_out == 0) return .buf_error;
+    return .other_error;
+}
+
+// inflate a gzip, zlib or raw deflate stream that must come out at exactly
+// raw_len bytes (a compressed bundle entry). caller frees the result.
+pub fn inflate_exact(alloc: std.mem.Allocator, input: []const u8, raw_len: usize) ![]u8 {
+    const out = try alloc.alloc(u8, raw_len);
+    errdefer alloc.free(out);
+    var out_len: u64 = raw_len;
+    const rc = tectonic_flate_decompress(out.ptr, &out_len, input.ptr, input.len);
+    if (rc != .success or out_len != raw_len) return error.CorruptEntry;
+    return out;
+}
+
+// inflate a raw deflate stream (a zip member) that must come out at exactly
+// raw_len bytes. no sniffing: raw data can happen to look like a zlib header.
+// caller frees the result.
+pub fn inflate_raw_exact(alloc: std.mem.Allocator, input: []const u8, raw_len: usize) ![]u8 {
+    if (input.len > std.math.maxInt(c_uint) or raw_len > std.math.maxInt(c_uint)) return error.EntryTooLarge;
+    const out = try alloc.alloc(u8, raw_len);
+    errdefer alloc.free(out);
+
+    var zs: ZStream = .{};
+    if (inflateInit2_(&zs, -15, zlibVersion(), @sizeOf(ZStream)) != Z_OK) return error.OutOfMemory;
+    defer _ = inflateEnd(&zs);
+    zs.next_in = input.ptr;
+    zs.avail_in = @intCast(input.len);
+    zs.next_out = out.ptr;
+    zs.avail_out = @intCast(raw_len);
+    if (inflate(&zs, Z_FINISH) != Z_STREAM_END or zs.total_out != raw_len) return error.CorruptEntry;
+    return out;
+}
+
+// std.compress.flate over the whole buffer, for sizes past zlib's 32-bit counts
+pub fn decompress_std(
     output_ptr: [*]u8,
     output_len: *u64,
     input_ptr: [*]const u8,
@@ -140,7 +381,7 @@ const Decompressor = struct {
     }
 };
 
-export fn tectonic_flate_new_decompressor(
+pub export fn tectonic_flate_new_decompressor(
     input_ptr: [*]const u8,
     input_len: u64,
 ) ?*anyopaque {
@@ -148,7 +389,7 @@ export fn tectonic_flate_new_decompressor(
     return @ptrCast(dc);
 }
 
-export fn tectonic_flate_decompress_chunk(
+pub export fn tectonic_flate_decompress_chunk(
     handle: ?*anyopaque,
     output_ptr: [*]u8,
     output_len: *u64,
@@ -161,7 +402,7 @@ export fn tectonic_flate_decompress_chunk(
     return dc.read_chunk(output_ptr, output_len);
 }
 
-export fn tectonic_flate_free_decompressor(handle: ?*anyopaque) void {
+pub export fn tectonic_flate_free_decompressor(handle: ?*anyopaque) void {
     const ptr = handle orelse return;
     const dc: *Decompressor = @ptrCast(@alignCast(ptr));
     dc.destroy();
@@ -202,6 +443,23 @@ test "gzip decompress" {
     try testing.expectEqualStrings("hello", out[0..@intCast(out_len)]);
 }
 
+test "inflate_exact checks the inflated length" {
+    const out = try inflate_exact(testing.allocator, &gzip_hello, 5);
+    defer testing.allocator.free(out);
+    try testing.expectEqualStrings("hello", out);
+    try testing.expectError(error.CorruptEntry, inflate_exact(testing.allocator, &gzip_hello, 4));
+    try testing.expectError(error.CorruptEntry, inflate_exact(testing.allocator, &gzip_hello, 6));
+}
+
+test "inflate_raw_exact takes the stream as raw deflate" {
+    // "hello" as raw deflate
+    const raw_hello = [_]u8{ 0xcb, 0x48, 0xcd, 0xc9, 0xc9, 0x07, 0x00 };
+    const out = try inflate_raw_exact(testing.allocator, &raw_hello, 5);
+    defer testing.allocator.free(out);
+    try testing.expectEqualStrings("hello", out);
+    try testing.expectError(error.CorruptEntry, inflate_raw_exact(testing.allocator, &raw_hello, 6));
+}
+
 test "compress then decompress roundtrip (zlib container)" {
     const input = "The quick brown fox jumps over the lazy dog";
     var compressed: [256]u8 = undefined;
@@ -277,6 +535,86 @@ test "streaming small chunks reassemble correctly" {
     try testing.expectEqualStrings(input, result[0..total]);
 }
 
+test "background compress matches one-shot compress" {
+    const input = "background background background background background";
+    var expected: [256]u8 = undefined;
+    var expected_len: u64 = expected.len;
+    try testing.expectEqual(FlateResult.success, tectonic_flate_compress(&expected, &expected_len, input.ptr, input.len, 6));
+
+    const job = tectonic_flate_compress_start(input.ptr, input.len, 6) orelse return error.SkipZigTest;
+    var out: ?[*]u8 = null;
+    var out_len: u64 = 0;
+    try testing.expectEqual(FlateResult.success, tectonic_flate_compress_finish(job, &out, &out_len));
+    defer std.c.free(out);
+    try testing.expectEqualSlices(u8, expected[0..@intCast(expected_len)], out.?[0..@intCast(out_len)]);
+}
+
+test "reused deflate state matches compress2" {
+    const input = "q 1 0 0 1 72 720 cm BT /F1 9.9626 Tf (reused) Tj ET Q";
+    for ([_]u32{ 9, 9, 1, 6 }) |level| {
+        var expected: [256]u8 = undefined;
+        var expected_len: u64 = expected.len;
+        try testing.expectEqual(FlateResult.success, compress_once(&expected, &expected_len, input.ptr, input.len, level));
+        var got: [256]u8 = undefined;
+        var got_len: u64 = got.len;
+        try testing.expectEqual(FlateResult.success, tectonic_flate_compress(&got, &got_len, input.ptr, input.len, level));
+        try testing.expectEqualSlices(u8, expected[0..@intCast(expected_len)], got[0..@intCast(got_len)]);
+    }
+}
+
+test "raw deflate decompresses" {
+    // "hi" as a stored raw deflate block
+    const raw = [_]u8{ 0x01, 0x02, 0x00, 0xfd, 0xff, 'h', 'i' };
+    var out: [8]u8 = undefined;
+    var out_len: u64 = out.len;
+    try testing.expectEqual(FlateResult.success, tectonic_flate_decompress(&out, &out_len, &raw, raw.len));
+    try testing.expectEqualStrings("hi", out[0..@intCast(out_len)]);
+}
+
+// content streams shaped like xdvipdfmx's: text-showing operators with
+// varying positions and kerns, a few KiB per page (flate_bench.zig times
+// the paths below on them)
+pub fn fake_content_streams(alloc: std.mem.Allocator, pages: usize) ![]u8 {
+    var out: std.ArrayList(u8) = .empty;
+    errdefer out.deinit(alloc);
+    for (0..pages) |page| {
+        for (0..48) |line| {
+            try out.print(alloc, "BT /F{d} 9.9626 Tf {d}.{d:0>3} {d}.{d:0>3} Td [(Lorem)-333(ipsum)-334(dolor{d})-333(sit)-27(amet,)]TJ ET\n", .{
+                (line + page) % 5 + 1, 72 + line % 7, (line * 37) % 1000, 720 - line * 14, (page * 91) % 1000, line,
+            });
+        }
+    }
+    return out.toOwnedSlice(alloc);
+}
+
+test "PDF content streams round-trip through every path" {
+    const alloc = testing.allocator;
+    const pages = 8;
+    const input = try fake_content_streams(alloc, pages);
+    defer alloc.free(input);
+    const page_len = input.len / pages;
+
+    const packed_buf = try alloc.alloc(u8, page_len * 2 + 64);
+    defer alloc.free(packed_buf);
+    const unpacked = try alloc.alloc(u8, page_len + 64);
+    defer alloc.free(unpacked);
+
+    for (0..pages) |i| {
+        const page = input[i * page_len ..][0..page_len];
+        var once_len: u64 = packed_buf.len;
+        try testing.expectEqual(FlateResult.success, compress_once(packed_buf.ptr, &once_len, page.ptr, page.len, 9));
+        var len: u64 = unpacked.len;
+        try testing.expectEqual(FlateResult.success, decompress_std(unpacked.ptr, &len, packed_buf.ptr, once_len));
+        try testing.expectEqualSlices(u8, page, unpacked[0..@intCast(len)]);
+
+        var kept_len: u64 = packed_buf.len;
+        try testing.expectEqual(FlateResult.success, tectonic_flate_compress(packed_buf.ptr, &kept_len, page.ptr, page.len, 9));
+        len = unpacked.len;
+        try testing.expectEqual(FlateResult.success, tectonic_flate_decompress(unpacked.ptr, &len, packed_buf.ptr, kept_len));
+        try testing.expectEqualSlices(u8, page, unpacked[0..@intCast(len)]);
+    }
+}
+
 test "decompress buf_error on undersized output" {
     const input = "this string is longer than four bytes";
     var compressed: [256]u8 = undefined;
@@ -1,12 +1,18 @@
 // FormatCache.zig -- content-addressed cache for XeTeX format files.
-// cache key = SHA256(bundle_digest ++ engine_version ++ format_type)
+// cache key = SHA256(bundle_digest ++ engine_version ++ format_type
+//                    [++ preamble digest])
 // on hit: return cached bytes. on miss: return null.
 const std = @import("std");
+const builtin = @import("builtin");
 const Io = std.Io;
 const Sha256 = std.crypto.hash.sha2.Sha256;
 const Digest = @import("Digest.zig");
 const FormatCache = @This();
 
+// bumped whenever the engine changes what a format holds, so every cached
+// or published format built by an older engine misses
+pub const engine_version: u32 = 35;
+
 pub const FormatType = enum(u8) {
     xelatex = 0,
     plain = 1,
@@ -17,6 +23,25 @@ pub const Key = struct {
     bundle_digest: [32]u8,
     engine_version: u32,
     format_type: FormatType,
+    // digest of a document preamble dumped on top of the format (see
+    // Preamble.dumpable); null for the bundle's own format
+    preamble: ?[32]u8 = null,
+
+    // key of this engine's format built from the bundle with the given
+    // 64-char hex digest
+    pub fn init(digest_hex: *const [64]u8, format_type: FormatType) Key {
+        var digest_bytes: [32]u8 = undefined;
+        for (0..32) |i| {
+            const hi = hex_digit(digest_hex[i * 2]);
+            const lo = hex_digit(digest_hex[i * 2 + 1]);
+            digest_bytes[i] = (hi << 4) | lo;
+        }
+        return .{
+            .bundle_digest = digest_bytes,
+            .engine_version = engine_version,
+            .format_type = format_type,
+        };
+    }
 
     pub fn hash(self: Key) [32]u8 {
         var h = Sha256.init(.{});
@@ -24,6 +49,7 @@ pub const Key = struct {
         const ver_bytes: [4]u8 = @bitCast(std.mem.nativeToBig(u32, self.engine_version));
         h.update(&ver_bytes);
         h.update(&.{@intFromEnum(self.format_type)});
+        if (self.preamble) |p| h.update(&p);
         return h.finalResult();
     }
 
@@ -39,6 +65,15 @@ pub const Key = struct {
     }
 };
 
+fn hex_digit(c: u8) u8 {
+    return switch (c) {
+        '0'...'9' => c - '0',
+        'a'...'f' => c - 'a' + 10,
+        'A'...'F' => c - 'A' + 10,
+        else => 0,
+    };
+}
+
 pub const LoadError = error{
     CacheDirNotFound,
     FileNotFound,
@@ -57,6 +92,19 @@ fn format_dir_path(cache_dir: []const u8, buf: []u8) ?[]const u8 {
     return std.fmt.bufPrint(buf, "{s}/formats", .{cache_dir}) catch null;
 }
 
+// path of the format image kept next to the format (see load_fmt_file in
+// xetex-ini.c). the engine writes it on the first load of the format.
+pub fn image_path(cache_dir: []const u8, key: Key, buf: []u8) ?[]const u8 {
+    const name = key.hex_filename();
+    return std.fmt.bufPrint(buf, "{s}/formats/{s}.img", .{ cache_dir, name[0..64] }) catch null;
+}
+
+fn remove_image(io: Io, cache_dir: []const u8, key: Key) void {
+    var buf: [1024]u8 = undefined;
+    const path = image_path(cache_dir, key, &buf) orelse return;
+    Io.Dir.cwd().deleteFile(io, path) catch {};
+}
+
 // load cached format bytes. returns null on miss.
 pub fn load(io: Io, allocator: std.mem.Allocator, cache_dir: []const u8, key: Key) LoadError!?[]u8 {
     const name = key.hex_filename();
@@ -87,8 +135,35 @@ pub fn load(io: Io, allocator: std.mem.Allocator, cache_dir: []const u8, key: Ke
     return bytes;
 }
 
-// store format bytes under the cache key.
+// whether anything is stored under key, including the empty file that
+// marks a format which could not be built (load and map miss on it)
+pub fn exists(io: Io, cache_dir: []const u8, key: Key) bool {
+    const name = key.hex_filename();
+    var path_buf: [1024]u8 = undefined;
+    const path = std.fmt.bufPrint(&path_buf, "{s}/formats/{s}", .{ cache_dir, &name }) catch return false;
+    Io.Dir.cwd().access(io, path, .{}) catch return false;
+    return true;
+}
+
+// map cached format bytes read-only instead of reading them (native only).
+// formats are stored uncompressed, so the engine undumps straight from the
+// page cache and pages a format image makes unnecessary are never read.
+// returns null on miss; release with std.posix.munmap.
+pub fn map(io: Io, cache_dir: []const u8, key: Key) ?[]align(std.heap.page_size_min) const u8 {
+    const name = key.hex_filename();
+    var path_buf: [1024]u8 = undefined;
+    const path = std.fmt.bufPrint(&path_buf, "{s}/formats/{s}", .{ cache_dir, &name }) catch return null;
+    const file = Io.Dir.cwd().openFile(io, path, .{}) catch return null;
+    defer file.close(io);
+    const size: usize = @intCast((file.stat(io) catch return null).size);
+    if (size == 0) return null;
+    return std.posix.mmap(null, size, std.posix.PROT.READ, .{ .TYPE = .PRIVATE }, file.handle, 0) catch null;
+}
+
+// store format bytes under the cache key, dropping the image of any
+// format stored there before.
 pub fn store(io: Io, _: std.mem.Allocator, cache_dir: []const u8, key: Key, bytes: []const u8) StoreError!void {
+    remove_image(io, cache_dir, key);
     const name = key.hex_filename();
     var dir_buf: [1024]u8 = undefined;
     const formats_path = format_dir_path(cache_dir, &dir_buf) orelse return StoreError.MakeDirFailed;
@@ -102,13 +177,24 @@ pub fn store(io: Io, _: std.mem.Allocator, cache_dir: []const u8, key: Key, byte
     };
     defer dir.close(io);
 
-    const file = dir.createFile(io, &name, .{}) catch return StoreError.WriteFailed;
-    defer file.close(io);
-
-    var write_buf: [4096]u8 = undefined;
-    var writer = file.writerStreaming(io, &write_buf);
-    writer.interface.writeAll(bytes) catch return StoreError.WriteFailed;
-    _ = writer.interface.flush() catch {};
+    // write aside and rename, so mappings of the previous file (see map)
+    // keep their contents
+    var tmp_name: [name.len + 4]u8 = undefined;
+    @memcpy(tmp_name[0..name.len], &name);
+    @memcpy(tmp_name[name.len..], ".tmp");
+    {
+        const file = dir.createFile(io, &tmp_name, .{}) catch return StoreError.WriteFailed;
+        defer file.close(io);
+
+        var write_buf: [4096]u8 = undefined;
+        var writer = file.writerStreaming(io, &write_buf);
+        writer.interface.writeAll(bytes) catch return StoreError.WriteFailed;
+        writer.interface.flush() catch return StoreError.WriteFailed;
+    }
+    dir.rename(&tmp_name, dir, &name, io) catch {
+        dir.deleteFile(io, &tmp_name) catch {};
+        return StoreError.WriteFailed;
+    };
 }
 
 // remove cached entry for key. no-op if not present.
@@ -119,8 +205,107 @@ pub fn invalidate(io: Io, cache_dir: []const u8, key: Key) void {
     defer dir.close(io);
     const name = key.hex_filename();
     dir.deleteFile(io, &name) catch {};
+    remove_image(io, cache_dir, key);
 }
 
+// formats kept in memory across compiles, keyed by Key.hash, so a server or
+// watch session switching between the xelatex, plain and preamble formats of
+// its jobs does not read them back from disk. an entry owns its bytes:
+// c_allocator memory or (native) a read-only mapping from map; null bytes
+// record a preamble that did not dump. past the budget, the least recently
+// used entries go, except the one the engine is using and the newest.
+pub const MemoryCache = struct {
+    entries: std.ArrayList(Entry) = .empty,
+    budget: usize,
+    total: usize = 0,
+    clock: u64 = 0,
+    // the hash of the entry whose bytes the world holds (see use)
+    in_use: ?[32]u8 = null,
+
+    pub const Entry = struct {
+        hash: [32]u8,
+        bytes: ?[]const u8,
+        mapped: bool,
+        last_use: u64,
+    };
+
+    pub fn get(self: *MemoryCache, key: Key) ?*Entry {
+        const entry = self.find(key.hash()) orelse return null;
+        self.clock += 1;
+        entry.last_use = self.clock;
+        return entry;
+    }
+
+    // take ownership of bytes under key, replacing what was there
+    pub fn put(self: *MemoryCache, key: Key, bytes: ?[]const u8, mapped: bool) void {
+        const hash = key.hash();
+        self.clock += 1;
+        if (self.find(hash)) |entry| {
+            if (entry.bytes) |old| {
+                self.total -= old.len;
+                if (self.in_use != null and std.mem.eql(u8, &self.in_use.?, &hash)) self.in_use = null;
+                release(old, entry.mapped);
+            }
+            entry.* = .{ .hash = hash, .bytes = bytes, .mapped = mapped, .last_use = self.clock };
+        } else {
+            self.entries.append(std.heap.c_allocator, .{ .hash = hash, .bytes = bytes, .mapped = mapped, .last_use = self.clock }) catch {
+                if (bytes) |b| release(b, mapped);
+                return;
+            };
+        }
+        if (bytes) |b| self.total += b.len;
+        self.evict(hash);
+    }
+
+    // mark key's entry as the one the world holds; it is not evicted
+    pub fn use(self: *MemoryCache, key: Key) void {
+        self.in_use = key.hash();
+    }
+
+    pub fn in_use_bytes(self: *MemoryCache) ?[]const u8 {
+        const hash = self.in_use orelse return null;
+        const entry = self.find(hash) orelse return null;
+        return entry.bytes;
+    }
+
+    pub fn deinit(self: *MemoryCache) void {
+        for (self.entries.items) |entry| if (entry.bytes) |b| release(b, entry.mapped);
+        self.entries.deinit(std.heap.c_allocator);
+        self.* = .{ .budget = self.budget };
+    }
+
+    fn find(self: *MemoryCache, hash: [32]u8) ?*Entry {
+        for (self.entries.items) |*entry| {
+            if (std.mem.eql(u8, &entry.hash, &hash)) return entry;
+        }
+        return null;
+    }
+
+    fn evict(self: *MemoryCache, newest: [32]u8) void {
+        while (self.total > self.budget) {
+            var victim: ?usize = null;
+            for (self.entries.items, 0..) |entry, i| {
+                if (std.mem.eql(u8, &entry.hash, &newest)) continue;
+                if (self.in_use) |h| if (std.mem.eql(u8, &entry.hash, &h)) continue;
+                if (entry.bytes == null) continue;
+                if (victim == null or entry.last_use < self.entries.items[victim.?].last_use) victim = i;
+            }
+            const i = victim orelse return;
+            const entry = self.entries.swapRemove(i);
+            self.total -= entry.bytes.?.len;
+            release(entry.bytes.?, entry.mapped);
+        }
+    }
+
+    fn release(bytes: []const u8, mapped: bool) void {
+        if (mapped) {
+            if (comptime !builtin.cpu.arch.isWasm()) std.posix.munmap(@alignCast(bytes));
+        } else {
+            std.heap.c_allocator.free(bytes);
+        }
+    }
+};
+
 // -- tests --
 
 const testing = std.testing;
@@ -263,6 +448,56 @@ test "invalidate removes cached entry" {
     try testing.expect(loaded2 == null);
 }
 
+test "map returns the stored bytes" {
+    var tmp = testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    var rel_buf: [256]u8 = undefined;
+    const tmp_path = std.fmt.bufPrintZ(&rel_buf, ".zig-cache/tmp/{s}", .{&tmp.sub_path}) catch return error.Unexpected;
+    var path_buf: [4096]u8 = undefined;
+    const cache_dir_raw = std.c.realpath(tmp_path, &path_buf) orelse return error.Unexpected;
+    const cache_dir: []const u8 = std.mem.sliceTo(cache_dir_raw, 0);
+
+    const key = Key{
+        .bundle_digest = @splat(0xAC),
+        .engine_version = 33,
+        .format_type = .plain,
+    };
+    try testing.expect(FormatCache.map(testing.io, cache_dir, key) == null);
+
+    try FormatCache.store(testing.io, testing.allocator, cache_dir, key, "mapped format bytes");
+    const mapped = FormatCache.map(testing.io, cache_dir, key).?;
+    defer std.posix.munmap(mapped);
+    try testing.expectEqualStrings("mapped format bytes", mapped);
+}
+
+test "storing a format drops the image of the previous one" {
+    var tmp = testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    var rel_buf: [256]u8 = undefined;
+    const tmp_path = std.fmt.bufPrintZ(&rel_buf, ".zig-cache/tmp/{s}", .{&tmp.sub_path}) catch return error.Unexpected;
+    var path_buf: [4096]u8 = undefined;
+    const cache_dir_raw = std.c.realpath(tmp_path, &path_buf) orelse return error.Unexpected;
+    const cache_dir: []const u8 = std.mem.sliceTo(cache_dir_raw, 0);
+
+    const key = Key{
+        .bundle_digest = @splat(0xAB),
+        .engine_version = 33,
+        .format_type = .xelatex,
+    };
+
+    try FormatCache.store(testing.io, testing.allocator, cache_dir, key, "old format");
+    var img_buf: [1024]u8 = undefined;
+    const img = image_path(cache_dir, key, &img_buf).?;
+    try testing.expect(std.mem.endsWith(u8, img, ".img"));
+    const file = try Io.Dir.cwd().createFile(testing.io, img, .{});
+    file.close(testing.io);
+
+    try FormatCache.store(testing.io, testing.allocator, cache_dir, key, "new format");
+    try testing.expectError(error.FileNotFound, Io.Dir.cwd().access(testing.io, img, .{}));
+}
+
 test "key hash is deterministic" {
     const key = Key{
         .bundle_digest = @splat(0xEE),
@@ -273,3 +508,68 @@ test "key hash is deterministic" {
     const h2 = key.hash();
     try testing.expectEqualSlices(u8, &h1, &h2);
 }
+
+test "key from hex digest" {
+    const key = Key.init(&(@as([64]u8, @splat('e'))), .xelatex);
+    try testing.expectEqualSlices(u8, &@as([32]u8, @splat(0xEE)), &key.bundle_digest);
+    try testing.expectEqual(engine_version, key.engine_version);
+    try testing.expectEqual(FormatType.xelatex, key.format_type);
+}
+
+test "preamble digest affects cache key" {
+    const base = Key.init(&(@as([64]u8, @splat('a'))), .xelatex);
+    var with_preamble = base;
+    with_preamble.preamble = @splat(0x01);
+    var other_preamble = base;
+    other_preamble.preamble = @splat(0x02);
+
+    try testing.expect(!std.mem.eql(u8, &base.hash(), &with_preamble.hash()));
+    try testing.expect(!std.mem.eql(u8, &with_preamble.hash(), &other_preamble.hash()));
+}
+
+test "an empty entry exists but never loads" {
+    var tmp = testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    var rel_buf: [256]u8 = undefined;
+    const tmp_path = std.fmt.bufPrintZ(&rel_buf, ".zig-cache/tmp/{s}", .{&tmp.sub_path}) catch return error.Unexpected;
+    var path_buf: [4096]u8 = undefined;
+    const cache_dir_raw = std.c.realpath(tmp_path, &path_buf) orelse return error.Unexpected;
+    const cache_dir: []const u8 = std.mem.sliceTo(cache_dir_raw, 0);
+
+    var key = Key.init(&(@as([64]u8, @splat('f'))), .xelatex);
+    key.preamble = @splat(0x03);
+    try testing.expect(!FormatCache.exists(testing.io, cache_dir, key));
+
+    try FormatCache.store(testing.io, testing.allocator, cache_dir, key, "");
+    try testing.expect(FormatCache.exists(testing.io, cache_dir, key));
+    try testing.expect(try FormatCache.load(testing.io, testing.allocator, cache_dir, key) == null);
+    try testing.expect(FormatCache.map(testing.io, cache_dir, key) == null);
+}
+
+test "memory cache evicts the least recently used format past its budget" {
+    var cache: MemoryCache = .{ .budget = 10 };
+    defer cache.deinit();
+
+    const a = Key{ .bundle_digest = @splat(0x01), .engine_version = 1, .format_type = .xelatex };
+    const b = Key{ .bundle_digest = @splat(0x01), .engine_version = 1, .format_type = .plain };
+    const c = Key{ .bundle_digest = @splat(0x01), .engine_version = 1, .format_type = .xelatex, .preamble = @splat(0x02) };
+
+    cache.put(a, try std.heap.c_allocator.dupe(u8, "aaaa"), false);
+    cache.use(a);
+    cache.put(b, try std.heap.c_allocator.dupe(u8, "bbbb"), false);
+    try testing.expect(cache.get(b) != null);
+    try testing.expectEqual(@as(usize, 8), cache.total);
+
+    // over budget: b is older than c but a is in use, so b goes
+    cache.put(c, try std.heap.c_allocator.dupe(u8, "cccc"), false);
+    try testing.expect(cache.get(b) == null);
+    try testing.expectEqualStrings("aaaa", cache.get(a).?.bytes.?);
+    try testing.expectEqualStrings("cccc", cache.get(c).?.bytes.?);
+    try testing.expectEqualStrings("aaaa", cache.in_use_bytes().?);
+
+    // a preamble that did not dump is remembered without bytes
+    cache.put(b, null, false);
+    try testing.expect(cache.get(b).?.bytes == null);
+    try testing.expectEqual(@as(usize, 8), cache.total);
+}
@@ -26,10 +26,35 @@ else
 pub const IndexEntry = struct {
     offset: u64,
     length: u32,
+    // nonzero: the range is a gzip member inflating to this many bytes
+    raw_length: u32 = 0,
 };
 
 pub const CacheStatus = enum { hit, miss, unsupported };
 
+// a persistent cache hit: an open file, or bytes of a mapped cache pack that
+// stay valid for the rest of the process
+pub const CachedFile = union(enum) {
+    file: Io.File,
+    bytes: []const u8,
+    // freshly fetched bytes handed over to the receiver, which frees them
+    owned: OwnedBytes,
+    // a compressed entry of a mapped local bundle, left for the receiver to
+    // inflate as it reads (see World.InputSlot)
+    deflated: DeflatedBytes,
+};
+
+pub const OwnedBytes = struct {
+    data: []u8,
+    allocator: std.mem.Allocator,
+};
+
+pub const DeflatedBytes = struct {
+    // borrowed, valid for the rest of the process like .bytes
+    data: []const u8,
+    raw_len: usize,
+};
+
 pub const SeedItem = struct {
     name: []const u8,
     entry: IndexEntry,
@@ -56,6 +81,9 @@ pub fn init(cache_dir: ?[]const u8, data_url: []const u8, index_url: []const u8,
 
 // -- range fetch: retrieve bytes from bundle at (offset, length) --
 // both platforms: return owned slice or error. caller frees with allocator.
+// a compressed entry (raw_length != 0) may come back still compressed or,
+// from the wasm host's memory cache, already inflated (see
+// BundleStore.inflate_entry).
 pub fn fetch_range(
     name: []const u8,
     entry: IndexEntry,
@@ -72,36 +100,59 @@ pub fn cache_check(name: []const u8) CacheStatus {
 }
 
 // read file content from the persistent cache. returns null if not cached.
-pub fn cache_open(name: []const u8) ?Io.File {
+pub fn cache_open(name: []const u8) ?CachedFile {
     return Impl.cache_open(name);
 }
 
+// before fetching a missing file: returns true if this process should fetch
+// it and must cache_release() afterwards. returns false after waiting for
+// another process sharing the cache to fetch it (check cache_open again), or
+// when there is nothing to coordinate with.
+// native: inflight/ markers in the cache directory (see Cache.claim)
+// wasm: always false
+pub fn cache_claim(name: []const u8) bool {
+    return Impl.cache_claim(name);
+}
+
+pub fn cache_release(name: []const u8) void {
+    Impl.cache_release(name);
+}
+
 // write file content to persistent cache
 pub fn cache_write(name: []const u8, content: []const u8) void {
     Impl.cache_write(name, content);
 }
 
-// save cache manifest (native: writes manifest to disk, wasm: no-op)
+// save cache manifest and keep the cache within its size budget (native:
+// see Cache.trim, wasm: no-op)
 pub fn cache_save() void {
     Impl.cache_save();
 }
 
+// a format in the cache directory (formats/<key_hex>.fmt) was used, so the
+// size budget keeps it (native only; the app tracks its own in opfs.ts)
+pub fn cache_note_format(key_hex: []const u8) void {
+    Impl.cache_note_format(key_hex);
+}
+
 // number of entries in the persistent cache
 pub fn cache_count() usize {
     return Impl.cache_count();
 }
 
-// -- batch seed (native only) --
-// fetch multiple files concurrently using OS thread pool with work-stealing.
-// only available on native -- callers must guard with `if (!is_wasm)`.
+// -- batch seed --
+// fetch multiple files concurrently.
+// native: OS thread pool with work-stealing, into the persistent cache.
+// wasm: one batch handed to the JS host, which fetches it concurrently when
+// it can suspend the call (JSPI) and skips it otherwise (files then load on open).
 pub fn batch_seed(items: []const SeedItem, concurrency: usize) SeedResult {
-    if (is_wasm) @compileError("batch_seed is not available on WASM");
     return Impl.batch_seed(items, concurrency);
 }
 
 // -- bundle index --
-// try loading cached index from disk. returns decompressed text or null.
-// native: reads from {cache_dir}/indexes/{digest}.txt
+// try loading cached index from disk. returns a compiled BundleIndex blob,
+// index text (caches from older builds), or null.
+// native: reads from {cache_dir}/indexes/{digest}.bin (or .txt)
 // wasm: always returns null (index is fetched fresh via js_request_index extern)
 pub fn load_cached_index(digest: []const u8, alloc: std.mem.Allocator) ?[]u8 {
     return Impl.load_cached_index(digest, alloc);
@@ -114,15 +165,118 @@ pub fn fetch_index(alloc: std.mem.Allocator) ![]u8 {
     return Impl.fetch_index(alloc);
 }
 
-// cache decompressed index text to disk for future runs.
-// native: writes to {cache_dir}/indexes/{digest}.txt
+// cache the compiled index (see BundleIndex.zig) to disk for future runs.
+// native: writes to {cache_dir}/indexes/{digest}.bin
 // wasm: no-op
 pub fn cache_index(digest: []const u8, content: []const u8) void {
     Impl.cache_index(digest, content);
 }
 
+// -- prefetch lists --
+// bundle files a previous compile opened, keyed by Preamble.key (see
+// BundleStore.begin_trace). newline-separated names.
+// native: {cache_dir}/deps/{key}.txt
+// wasm: not persisted (load returns null, cache is a no-op)
+pub fn load_prefetch_list(key: u64, alloc: std.mem.Allocator) ?[]u8 {
+    return Impl.load_prefetch_list(key, alloc);
+}
+
+pub fn cache_prefetch_list(key: u64, content: []const u8) void {
+    Impl.cache_prefetch_list(key, content);
+}
+
+// -- cached blobs --
+// finished engine output kept between compiles (image XObjects, see
+// dpx-imagecache.c), filed under a kind and a 16-byte content key.
+// native: {cache_dir}/{kind}/{key as hex}.bin
+// wasm: not persisted (load returns null, cache is a no-op)
+pub fn load_blob(kind: []const u8, key: *const [16]u8, alloc: std.mem.Allocator) ?[]u8 {
+    return Impl.load_blob(kind, key, alloc);
+}
+
+pub fn cache_blob(kind: []const u8, key: *const [16]u8, content: []const u8) void {
+    Impl.cache_blob(kind, key, content);
+}
+
+// -- remote compile cache --
+// whole objects for RemoteCache.zig, from any store that takes a plain GET
+// and PUT (S3 or R2 through presigned or public URLs, or a proxy), with
+// token, when given, sent as a bearer token.
+// native: std.http; a miss, an error, or an unreachable server all read null
+// wasm: not supported (get returns null, put fails)
+pub fn remote_get(url: []const u8, token: ?[]const u8, alloc: std.mem.Allocator) ?[]u8 {
+    return Impl.remote_get(url, token, alloc);
+}
+
+// true once the store took it
+pub fn remote_put(url: []const u8, token: ?[]const u8, body: []const u8) bool {
+    return Impl.remote_put(url, token, body);
+}
+
+// -- format image snapshot --
+// the engine state undumped from the current format (see load_fmt_file in
+// xetex-ini.c), restored with a copy instead of undumping the format again.
+// native: not used here; World keeps the image in a file next to the cached
+// format (load returns null, save is a no-op)
+// wasm: held by the JS host across instances (js_format_image_get/put), so
+// each compile's fresh instance starts from it
+pub fn load_format_image() ?[]u8 {
+    return Impl.load_format_image();
+}
+
+// release an image returned by load_format_image
+pub fn free_format_image(image: []u8) void {
+    Impl.free_format_image(image);
+}
+
+pub fn save_format_image(content: []const u8) void {
+    Impl.save_format_image(content);
+}
+
+// -- format generation --
+// run `eztex generate-format --format <name>` for each format, one process
+// each so initex runs in parallel, in scratch directories under the cache.
+// blocks until all finish and returns how many failed.
+// native: child processes of this executable
+// wasm: unsupported (every format fails)
+pub fn generate_formats(formats: []const []const u8, cache_dir_override: ?[]const u8) usize {
+    return Impl.generate_formats(formats, cache_dir_override);
+}
+
+// start `eztex generate-format --all` in the background, filling the format
+// cache without blocking the caller. returns whether it started.
+// wasm: no-op (returns false)
+pub fn generate_formats_in_background(cache_dir_override: ?[]const u8) bool {
+    return Impl.generate_formats_in_background(cache_dir_override);
+}
+
+// -- cancellation --
+// whether the compile in progress has been superseded and should stop at its
+// next page (see on_checkpoint in Compiler.zig).
+// native: never
+// wasm: asks the JS host (js_cancel_requested)
+pub fn cancel_requested() bool {
+    return Impl.cancel_requested();
+}
+
 // -- time --
 
 pub fn timestamp_ns() i128 {
     return Impl.timestamp_ns();
 }
+
+// CPU time the process has used, user and system, for the job limits of
+// `eztex serve` (see Compiler.Limits).
+// native: getrusage (null on Windows)
+// wasm: null
+pub fn cpu_time_us() ?u64 {
+    return Impl.cpu_time_us();
+}
+
+// -- memory --
+// the process's peak resident set, for traces.
+// native: getrusage (null on Windows)
+// wasm: null; the JS heap is the browser's to measure
+pub fn peak_rss_bytes() ?u64 {
+    return Impl.peak_rss_bytes();
+}
@@ -17,7 +17,7 @@
 // - OT script/language/feature enumeration (countScripts, getIndScript,
 //   countLanguages, getIndLanguage, countFeatures, getIndFeature)
 // - OT math font detection (isOpenTypeMathFont)
-// - HarfBuzz font accessor (ttxl_get_hb_font)
+// - HarfBuzz font accessor (ttxl_get_hb_font), font file digest (ttxl_get_font_digest)
 // - Font slant (getSlant)
 // - Glyph name query (getGlyphName, freeGlyphName)
 // - Glyph count (countGlyphs)
@@ -29,8 +29,11 @@
 // - Engine lifecycle: createLayoutEngine, createLayoutEngineBorrowed, deleteLayoutEngine
 // - Font creation/deletion: createFontFromFile, deleteFont
 // - Glyph output: getGlyphs, getGlyphAdvances, getGlyphPositions
-// - Text shaping: layoutChars (HarfBuzz shape plan with cached/fallback logic)
-// - Font manager lifecycle: destroy_font_manager (FT shutdown + HB font funcs singleton destroy)
+// - Text shaping: layoutChars (HarfBuzz shape plan with cached/fallback logic), layoutRuns
+// - Shaping cache: bounded LRU of layoutChars results, kept across passes
+// - Unscaled glyph box cache: FreeType cboxes by font digest, kept across passes
+// - Font manager lifecycle: destroy_font_manager (FT shutdown + HB font funcs singleton destroy),
+//   reporting the run's font figures (load time, cache hit rates, resident bytes)
 // - Platform font functions (non-Mac only, via conditional @export):
 //   findFontByName, getFullName, ttxl_platfont_get_desc, createFont
 // - Platform font functions (macOS CoreText, via conditional @export):
@@ -40,6 +43,11 @@
 const std = @import("std");
 const builtin = @import("builtin");
 const Log = @import("Log.zig");
+const MemStats = @import("MemStats.zig");
+const Timeline = @import("Timeline.zig");
+
+// the caches and faces here are counted as font memory (see MemStats.zig)
+const font_alloc = MemStats.allocator(.fonts);
 
 // == Threading Model ==
 // This module uses mutable file-scope globals (14+ vars) for font caches, FreeType
@@ -60,12 +68,33 @@ comptime {
 // Module state (consolidated globals)
 // ========================================
 
+// one run's font figures, reported and cleared by destroy_font_manager
+const FontStats = struct {
+    faces_loaded: u32 = 0,
+    load_ns: u64 = 0,
+    shape_calls: u64 = 0,
+    plan_reuses: u64 = 0,
+    bbox_hits: u64 = 0,
+    bbox_misses: u64 = 0,
+    unit_bbox_hits: u64 = 0,
+    unit_bbox_misses: u64 = 0,
+    gr_hits: u64 = 0,
+    gr_misses: u64 = 0,
+};
+
 const State = struct {
+    stats: FontStats = .{},
     bbox_cache: ?std.AutoHashMap(u32, GlyphBBox) = null,
+    unit_bbox_cache: ?std.AutoHashMap(UnitBBoxKey, FT_BBox_Long) = null,
     left_prot: ?std.AutoHashMap(u64, i32) = null,
     right_prot: ?std.AutoHashMap(u64, i32) = null,
     loaded_font_design_size: i32 = 655360,
-    gr_cache: ?std.AutoHashMap(usize, GrCacheEntry) = null,
+    shape_cache: ?ShapeCache = null,
+    face_cache: ?FaceCache = null,
+    font_catalog: ?FontCatalog = null,
+    run_glyphs: std.ArrayList(u32) = .empty,
+    run_advances: std.ArrayList(f32) = .empty,
+    run_positions: std.ArrayList(FloatPoint) = .empty,
     req_engine: u8 = 0,
     ft_lib: ?*anyopaque = null,
     ft_face_count: c_int = 0,
@@ -77,7 +106,7 @@ const State = struct {
     mac_desc_buf: [1024]u8 = undefined,
 };
 
-var state: State = .{};
+threadlocal var state: State = .{};
 
 // -- Extern struct layouts matching C definitions in xetex_layout.c --
 
@@ -113,6 +142,11 @@ const XeTeXLayoutEngine_rec = extern struct {
     slant: f32,
     embolden: f32,
     hb_buffer: ?*anyopaque, // hb_buffer_t*
+    shaped: u32, // index + 1 of the cached run the glyph queries read; 0 = hb_buffer
+    // the shape plan of the last layoutChars and the segment properties it
+    // was made for; font, features and shapers are fixed per engine
+    plan: ?*hb_shape_plan_t = null,
+    plan_props: hb_segment_properties_t = .{ .direction = 0, .script = 0, .language = null, .reserved1 = null, .reserved2 = null },
 };
 
 const GlyphBBox = extern struct {
@@ -193,6 +227,14 @@ const FloatPoint = extern struct {
     y: f32,
 };
 
+// LayoutRun matches C typedef in tectonic_xetex_layout.h
+const LayoutRun = extern struct {
+    offset: i32,
+    count: i32,
+    rtl: bool,
+    n_glyphs: i32,
+};
+
 // -- Internal helpers --
 
 fn font_units_to_points(f: *const XeTeXFont_rec, units: f64) f64 {
@@ -209,7 +251,7 @@ fn font_points_to_units(f: *const XeTeXFont_rec, points: f64) f64 {
 
 fn get_bbox_cache() *std.AutoHashMap(u32, GlyphBBox) {
     if (state.bbox_cache) |*c| return c;
-    state.bbox_cache = std.AutoHashMap(u32, GlyphBBox).init(std.heap.c_allocator);
+    state.bbox_cache = std.AutoHashMap(u32, GlyphBBox).init(font_alloc);
     return &state.bbox_cache.?;
 }
 
@@ -217,9 +259,11 @@ export fn getCachedGlyphBBox(font_id: u16, glyph_id: u16, bbox: *GlyphBBox) i32
     const key: u32 = (@as(u32, font_id) << 16) | glyph_id;
     const cache = get_bbox_cache();
     if (cache.get(key)) |cached| {
+        state.stats.bbox_hits += 1;
         bbox.* = cached;
         return 1;
     }
+    state.stats.bbox_misses += 1;
     return 0;
 }
 
@@ -236,7 +280,7 @@ export fn cacheGlyphBBox(font_id: u16, glyph_id: u16, bbox: *const GlyphBBox) vo
 fn get_cp_table(side: i32) *std.AutoHashMap(u64, i32) {
     const ptr = if (side == 0) &state.left_prot else &state.right_prot;
     if (ptr.*) |*c| return c;
-    ptr.* = std.AutoHashMap(u64, i32).init(std.heap.c_allocator);
+    ptr.* = std.AutoHashMap(u64, i32).init(font_alloc);
     return &ptr.*.?;
 }
 
@@ -363,9 +407,7 @@ const gr_face_ops = extern struct {
 };
 
 extern fn gr_make_face_with_ops(app_face_handle: ?*const anyopaque, face_ops: *const gr_face_ops, face_options: c_uint) ?*anyopaque;
-extern fn gr_make_font(ppm: f32, face: *const anyopaque) ?*anyopaque;
 extern fn gr_face_destroy(face: *anyopaque) void;
-extern fn gr_font_destroy(font: *anyopaque) void;
 extern fn gr_face_n_fref(face: *const anyopaque) u16;
 extern fn gr_face_fref(face: *const anyopaque, i: u16) ?*const anyopaque;
 extern fn gr_face_find_fref(face: *const anyopaque, feat_id: u32) ?*const anyopaque;
@@ -413,40 +455,26 @@ fn gr_release_table(_: ?*const anyopaque, table_buffer: ?*const anyopaque) callc
 // Graphite2 gr_face on-demand cache
 // ========================================
 
-const GrCacheEntry = struct {
-    gr_face: *anyopaque,
-    gr_font: *anyopaque,
-};
-
-fn get_gr_cache() *std.AutoHashMap(usize, GrCacheEntry) {
-    if (state.gr_cache) |*c| return c;
-    state.gr_cache = std.AutoHashMap(usize, GrCacheEntry).init(std.heap.c_allocator);
-    return &state.gr_cache.?;
-}
-
+// one gr_face per shared face (see acquire_face), made on the first feature
+// query and destroyed with the face or by destroy_font_manager. it reads its
+// tables from the FT_Face, so it cannot outlive it.
 fn get_or_create_gr_face(engine: *XeTeXLayoutEngine_rec) ?*anyopaque {
     const font = engine.font orelse return null;
     const ft_face = font.ft_face orelse return null;
-    const key = @intFromPtr(ft_face);
-
-    const cache = get_gr_cache();
-    if (cache.get(key)) |entry| return entry.gr_face;
+    const shared = get_face_cache().by_face.get(@intFromPtr(ft_face)) orelse return null;
+    if (shared.gr_face) |gf| {
+        state.stats.gr_hits += 1;
+        return gf;
+    }
+    state.stats.gr_misses += 1;
 
     const ops = gr_face_ops{
         .size = @sizeOf(gr_face_ops),
         .get_table = &gr_get_table,
         .release_table = &gr_release_table,
     };
-    const gr_face_ptr = gr_make_face_with_ops(ft_face, &ops, 0) orelse return null;
-
-    const ppm = font.point_size;
-    const gr_font_ptr = gr_make_font(ppm, gr_face_ptr) orelse {
-        gr_face_destroy(gr_face_ptr);
-        return null;
-    };
-
-    cache.put(key, .{ .gr_face = gr_face_ptr, .gr_font = gr_font_ptr }) catch return null;
-    return gr_face_ptr;
+    shared.gr_face = gr_make_face_with_ops(ft_face, &ops, 0);
+    return shared.gr_face;
 }
 
 // ========================================
@@ -713,9 +741,7 @@ const HB_OT_TAG_GPOS = hb_tag('G', 'P', 'O', 'S'); // 0x47504F53
 extern fn hb_font_get_face(*hb_font_t) ?*hb_face_t;
 extern fn hb_ot_math_has_data(*hb_face_t) c_int;
 extern fn hb_ot_layout_table_get_script_tags(*hb_face_t, u32, c_uint, *c_uint, ?[*]u32) c_uint;
-extern fn hb_ot_layout_table_find_script(*hb_face_t, u32, u32, *c_uint) c_int;
 extern fn hb_ot_layout_script_get_language_tags(*hb_face_t, u32, c_uint, c_uint, *c_uint, ?[*]u32) c_uint;
-extern fn hb_ot_layout_script_select_language(*hb_face_t, u32, c_uint, c_uint, [*]const u32, *c_uint) c_int;
 extern fn hb_ot_layout_language_get_feature_tags(*hb_face_t, u32, c_uint, c_uint, c_uint, *c_uint, ?[*]u32) c_uint;
 extern fn hb_ot_layout_get_size_params(*hb_face_t, *c_uint, *c_uint, *c_uint, *c_uint, *c_uint) c_int;
 
@@ -732,13 +758,99 @@ fn get_hb_face_from_font(font: ?*XeTeXFont_rec) ?*hb_face_t {
     return hb_font_get_face(hb);
 }
 
-// Pick the larger of GSUB/GPOS script tables (same logic as C).
-fn get_ot_table_tag(face: *hb_face_t) u32 {
-    var gsub_count: c_uint = 0;
-    var gpos_count: c_uint = 0;
-    _ = hb_ot_layout_table_get_script_tags(face, HB_OT_TAG_GSUB, 0, &gsub_count, null);
-    _ = hb_ot_layout_table_get_script_tags(face, HB_OT_TAG_GPOS, 0, &gpos_count, null);
-    return if (gsub_count > gpos_count) HB_OT_TAG_GSUB else HB_OT_TAG_GPOS;
+// -- OpenType script/language/feature tables --
+// fontspec walks every script, language and feature of a font while setting it
+// up, one query at a time. the tags are read from the hb_face_t once, on the
+// first query, into this per shared face summary (see SharedFace.ot), and the
+// queries below answer from it.
+
+const HB_OT_LAYOUT_DEFAULT_LANGUAGE_INDEX: c_uint = 0xFFFF;
+const HB_OT_TAG_DEFAULT_LANGUAGE = hb_tag('d', 'f', 'l', 't');
+
+const OtScript = struct {
+    tag: u32,
+    langs: []u32,
+    // per language, then the default language system last
+    features: [][]u32,
+};
+
+const OtLayout = struct {
+    arena: std.heap.ArenaAllocator,
+    // GSUB, GPOS
+    tables: [2][]OtScript,
+    // the table whose scripts countScripts/getIndScript list: the larger
+    // one, favouring GPOS on a tie (same logic as C)
+    main: usize,
+
+    fn find_script(self: *const OtLayout, table: usize, tag: u32) ?*const OtScript {
+        for (self.tables[table]) |*sc| {
+            if (sc.tag == tag) return sc;
+        }
+        return null;
+    }
+};
+
+const ot_table_tags = [2]u32{ HB_OT_TAG_GSUB, HB_OT_TAG_GPOS };
+
+// all tags of one hb_ot_layout_*_get_*_tags enumeration
+fn ot_tags(a: std.mem.Allocator, comptime getter: anytype, args: anytype) ![]u32 {
+    var count: c_uint = 0;
+    _ = @call(.auto, getter, args ++ .{ @as(c_uint, 0), &count, null });
+    const tags = try a.alloc(u32, count);
+    var got: c_uint = count;
+    if (count > 0) _ = @call(.auto, getter, args ++ .{ @as(c_uint, 0), &got, tags.ptr });
+    return tags[0..@min(got, count)];
+}
+
+fn build_ot_layout(face: *hb_face_t) !*OtLayout {
+    const ot = try font_alloc.create(OtLayout);
+    ot.arena = .init(font_alloc);
+    errdefer {
+        ot.arena.deinit();
+        font_alloc.destroy(ot);
+    }
+    const a = ot.arena.allocator();
+
+    for (ot_table_tags, 0..) |table_tag, t| {
+        const script_tags = try ot_tags(a, hb_ot_layout_table_get_script_tags, .{ face, table_tag });
+        const scripts = try a.alloc(OtScript, script_tags.len);
+        for (scripts, script_tags, 0..) |*sc, tag, si| {
+            const script_index: c_uint = @intCast(si);
+            sc.tag = tag;
+            sc.langs = try ot_tags(a, hb_ot_layout_script_get_language_tags, .{ face, table_tag, script_index });
+            sc.features = try a.alloc([]u32, sc.langs.len + 1);
+            for (sc.features, 0..) |*feats, li| {
+                const lang_index: c_uint = if (li == sc.langs.len) HB_OT_LAYOUT_DEFAULT_LANGUAGE_INDEX else @intCast(li);
+                feats.* = try ot_tags(a, hb_ot_layout_language_get_feature_tags, .{ face, table_tag, script_index, lang_index });
+            }
+        }
+        ot.tables[t] = scripts;
+    }
+    ot.main = if (ot.tables[0].len > ot.tables[1].len) 0 else 1;
+    return ot;
+}
+
+fn get_ot_layout(font: ?*XeTeXFont_rec) ?*const OtLayout {
+    const f = font orelse return null;
+    const ft_face = f.ft_face orelse return null;
+    const shared = get_face_cache().by_face.get(@intFromPtr(ft_face)) orelse return null;
+    if (shared.ot) |ot| return ot;
+    shared.ot = build_ot_layout(shared.hb_face) catch return null;
+    return shared.ot;
+}
+
+// the features of language in sc, chosen as hb_ot_layout_script_select_language
+// does: the language itself, else 'dflt', else the default language system.
+// null when the language is not in sc and is not 0 (no language asked for).
+fn ot_language_features(sc: *const OtScript, language: u32) ?[]const u32 {
+    for (sc.langs, 0..) |tag, li| {
+        if (tag == language) return sc.features[li];
+    }
+    if (language != 0) return null;
+    for (sc.langs, 0..) |tag, li| {
+        if (tag == HB_OT_TAG_DEFAULT_LANGUAGE) return sc.features[li];
+    }
+    return sc.features[sc.langs.len];
 }
 
 // -- Phase 2 exported functions --
@@ -757,86 +869,48 @@ export fn setFontLayoutDir(font: ?*XeTeXFont_rec, vertical: c_int) void {
 }
 
 export fn countScripts(font: ?*XeTeXFont_rec) c_uint {
-    const face = get_hb_face_from_font(font) orelse return 0;
-    var gsub_count: c_uint = 0;
-    var gpos_count: c_uint = 0;
-    _ = hb_ot_layout_table_get_script_tags(face, HB_OT_TAG_GSUB, 0, &gsub_count, null);
-    _ = hb_ot_layout_table_get_script_tags(face, HB_OT_TAG_GPOS, 0, &gpos_count, null);
-    return if (gsub_count > gpos_count) gsub_count else gpos_count;
+    const ot = get_ot_layout(font) orelse return 0;
+    return @intCast(ot.tables[ot.main].len);
 }
 
 export fn getIndScript(font: ?*XeTeXFont_rec, index: c_uint) u32 {
-    const face = get_hb_face_from_font(font) orelse return 0;
-    const table_tag = get_ot_table_tag(face);
-    var tags = [1]u32{0};
-    var count: c_uint = 1;
-    _ = hb_ot_layout_table_get_script_tags(face, table_tag, index, &count, &tags);
-    return if (count == 0) 0 else tags[0];
+    const ot = get_ot_layout(font) orelse return 0;
+    const scripts = ot.tables[ot.main];
+    return if (index < scripts.len) scripts[index].tag else 0;
 }
 
 export fn countLanguages(font: ?*XeTeXFont_rec, script: u32) c_uint {
-    const face = get_hb_face_from_font(font) orelse return 0;
-    const table_tag = get_ot_table_tag(face);
-    var script_index: c_uint = 0;
-    if (hb_ot_layout_table_find_script(face, table_tag, script, &script_index) == 0)
-        return 0;
-    var lang_count: c_uint = 0;
-    _ = hb_ot_layout_script_get_language_tags(face, table_tag, script_index, 0, &lang_count, null);
-    return lang_count;
+    const ot = get_ot_layout(font) orelse return 0;
+    const sc = ot.find_script(ot.main, script) orelse return 0;
+    return @intCast(sc.langs.len);
 }
 
 export fn getIndLanguage(font: ?*XeTeXFont_rec, script: u32, index: c_uint) u32 {
-    const face = get_hb_face_from_font(font) orelse return 0;
-    const table_tag = get_ot_table_tag(face);
-    var script_index: c_uint = 0;
-    if (hb_ot_layout_table_find_script(face, table_tag, script, &script_index) == 0)
-        return 0;
-    var tags = [1]u32{0};
-    var count: c_uint = 1;
-    _ = hb_ot_layout_script_get_language_tags(face, table_tag, script_index, index, &count, &tags);
-    return if (count == 0) 0 else tags[0];
+    const ot = get_ot_layout(font) orelse return 0;
+    const sc = ot.find_script(ot.main, script) orelse return 0;
+    return if (index < sc.langs.len) sc.langs[index] else 0;
 }
 
+// features count across GSUB then GPOS
 export fn countFeatures(font: ?*XeTeXFont_rec, script: u32, language: u32) c_uint {
-    const face = get_hb_face_from_font(font) orelse return 0;
-    const table_tags = [2]u32{ HB_OT_TAG_GSUB, HB_OT_TAG_GPOS };
+    const ot = get_ot_layout(font) orelse return 0;
     var rval: c_uint = 0;
-    for (table_tags) |table_tag| {
-        var script_index: c_uint = 0;
-        if (hb_ot_layout_table_find_script(face, table_tag, script, &script_index) == 0)
-            continue;
-        const lang_arr = [1]u32{language};
-        var lang_index: c_uint = 0;
-        const found = hb_ot_layout_script_select_language(face, table_tag, script_index, 1, &lang_arr, &lang_index);
-        if (found == 0 and language != 0) continue;
-        var feat_count: c_uint = 0;
-        _ = hb_ot_layout_language_get_feature_tags(face, table_tag, script_index, lang_index, 0, &feat_count, null);
-        rval += feat_count;
+    for (0..ot_table_tags.len) |t| {
+        const sc = ot.find_script(t, script) orelse continue;
+        const feats = ot_language_features(sc, language) orelse continue;
+        rval += @intCast(feats.len);
     }
     return rval;
 }
 
 export fn getIndFeature(font: ?*XeTeXFont_rec, script: u32, language: u32, index: c_uint) u32 {
-    const face = get_hb_face_from_font(font) orelse return 0;
-    const table_tags = [2]u32{ HB_OT_TAG_GSUB, HB_OT_TAG_GPOS };
-    var idx = index;
-    for (table_tags) |table_tag| {
-        var script_index: c_uint = 0;
-        if (hb_ot_layout_table_find_script(face, table_tag, script, &script_index) == 0)
-            continue;
-        const lang_arr = [1]u32{language};
-        var lang_index: c_uint = 0;
-        const found = hb_ot_layout_script_select_language(face, table_tag, script_index, 1, &lang_arr, &lang_index);
-        if (found == 0 and language != 0) continue;
-        var feat_count: c_uint = 0;
-        _ = hb_ot_layout_language_get_feature_tags(face, table_tag, script_index, lang_index, 0, &feat_count, null);
-        if (idx < feat_count) {
-            var ftags = [1]u32{0};
-            var fcount: c_uint = 1;
-            _ = hb_ot_layout_language_get_feature_tags(face, table_tag, script_index, lang_index, idx, &fcount, &ftags);
-            return if (fcount > 0) ftags[0] else 0;
-        }
-        idx -= feat_count;
+    const ot = get_ot_layout(font) orelse return 0;
+    var idx: usize = index;
+    for (0..ot_table_tags.len) |t| {
+        const sc = ot.find_script(t, script) orelse continue;
+        const feats = ot_language_features(sc, language) orelse continue;
+        if (idx < feats.len) return feats[idx];
+        idx -= feats.len;
     }
     return 0;
 }
@@ -855,6 +929,16 @@ export fn ttxl_get_hb_font(engine: ?*XeTeXLayoutEngine_rec) ?*hb_font_t {
     return @ptrCast(f.hb_font);
 }
 
+// SharedFace.digest of the engine's font, for the MATH table caches in
+// xetex-XeTeXOTMath.cpp; 0 when the face is not in the face cache
+export fn ttxl_get_font_digest(engine: ?*XeTeXLayoutEngine_rec) u64 {
+    const e = engine orelse return 0;
+    const f = e.font orelse return 0;
+    const face_ptr = f.ft_face orelse return 0;
+    const shared = get_face_cache().by_face.get(@intFromPtr(face_ptr)) orelse return 0;
+    return shared.digest;
+}
+
 // ========================================
 // Phase 2b: Font metric functions (getSlant, getGlyphName, freeGlyphName)
 // ========================================
@@ -1081,29 +1165,65 @@ extern fn FT_Done_Glyph(glyph: ?*anyopaque) void;
 
 const FT_GLYPH_BBOX_UNSCALED: c_uint = 0;
 
-// Internal helper: compute glyph bounding box in points (matches C get_glyph_bounds_internal).
-// Uses FT_Load_Glyph + FT_Get_Glyph + FT_Glyph_Get_CBox to avoid accessing FT_GlyphSlotRec_
-// fields directly. Only accesses face->glyph pointer via FT_FacePartial.
-fn get_glyph_bounds_internal(font: ?*XeTeXFont_rec, gid: u16) GlyphBBox {
-    const zero: GlyphBBox = .{ .x_min = 0, .y_min = 0, .x_max = 0, .y_max = 0 };
-    const f = font orelse return zero;
-    const face_ptr: *anyopaque = f.ft_face orelse return zero;
+// -- unscaled glyph boxes --
+// the FreeType cbox of a glyph in font units, keyed by the digest of the font
+// file's contents (SharedFace.digest) and glyph id, so it holds for every size
+// of the font and every document that loads the same file. kept for the
+// process, across passes and, under --watch, across compiles; cleared when
+// it reaches unit_bbox_max entries.
+
+const UnitBBoxKey = struct {
+    digest: u64,
+    gid: u16,
+};
+
+const unit_bbox_max = 1 << 20;
+
+fn unit_bbox(face_ptr: *anyopaque, gid: u16) FT_BBox_Long {
+    var ft_bbox: FT_BBox_Long = .{ .x_min = 0, .y_min = 0, .x_max = 0, .y_max = 0 };
 
     // Load glyph at NO_SCALE to get raw font units.
-    if (FT_Load_Glyph(face_ptr, @as(c_uint, gid), FT_LOAD_NO_SCALE) != 0) return zero;
+    if (FT_Load_Glyph(face_ptr, @as(c_uint, gid), FT_LOAD_NO_SCALE) != 0) return ft_bbox;
 
     // Access face->glyph (the glyph slot pointer) via partial struct layout.
     const face: *const FT_FacePartial = @ptrCast(@alignCast(face_ptr));
-    const slot: *anyopaque = face.glyph orelse return zero;
+    const slot: *anyopaque = face.glyph orelse return ft_bbox;
 
     // Extract standalone glyph object from slot and compute its cbox.
     var glyph_obj: ?*anyopaque = null;
-    if (FT_Get_Glyph(slot, &glyph_obj) != 0) return zero;
-    const glyph = glyph_obj orelse return zero;
+    if (FT_Get_Glyph(slot, &glyph_obj) != 0) return ft_bbox;
+    const glyph = glyph_obj orelse return ft_bbox;
 
-    var ft_bbox: FT_BBox_Long = .{ .x_min = 0, .y_min = 0, .x_max = 0, .y_max = 0 };
     FT_Glyph_Get_CBox(glyph, FT_GLYPH_BBOX_UNSCALED, &ft_bbox);
     FT_Done_Glyph(glyph);
+    return ft_bbox;
+}
+
+fn cached_unit_bbox(face_ptr: *anyopaque, gid: u16) FT_BBox_Long {
+    const shared = get_face_cache().by_face.get(@intFromPtr(face_ptr)) orelse return unit_bbox(face_ptr, gid);
+    if (state.unit_bbox_cache == null) state.unit_bbox_cache = .init(font_alloc);
+    const cache = &state.unit_bbox_cache.?;
+
+    const key: UnitBBoxKey = .{ .digest = shared.digest, .gid = gid };
+    if (cache.get(key)) |b| {
+        state.stats.unit_bbox_hits += 1;
+        return b;
+    }
+    state.stats.unit_bbox_misses += 1;
+    const b = unit_bbox(face_ptr, gid);
+    if (cache.count() >= unit_bbox_max) cache.clearRetainingCapacity();
+    cache.put(key, b) catch {};
+    return b;
+}
+
+// Internal helper: compute glyph bounding box in points (matches C get_glyph_bounds_internal).
+// Uses FT_Load_Glyph + FT_Get_Glyph + FT_Glyph_Get_CBox to avoid accessing FT_GlyphSlotRec_
+// fields directly. Only accesses face->glyph pointer via FT_FacePartial.
+fn get_glyph_bounds_internal(font: ?*XeTeXFont_rec, gid: u16) GlyphBBox {
+    const zero: GlyphBBox = .{ .x_min = 0, .y_min = 0, .x_max = 0, .y_max = 0 };
+    const f = font orelse return zero;
+    const face_ptr: *anyopaque = f.ft_face orelse return zero;
+    const ft_bbox = cached_unit_bbox(face_ptr, gid);
 
     // Convert from font units to points.
     return .{
@@ -1356,6 +1476,7 @@ export fn deleteLayoutEngine(engine: ?*XeTeXLayoutEngine_rec) void {
         free(ptr);
     }
     if (e.hb_buffer) |buf| hb_buffer_destroy(buf);
+    if (e.plan) |plan| hb_shape_plan_destroy(plan);
     free(@ptrCast(e));
 }
 
@@ -1466,53 +1587,79 @@ extern fn ttstub_input_close(handle: usize) c_int;
 
 // -- libc externs (Phase 2g: malloc/free/strdup/calloc declared above) --
 
-// initialize_ft_internal: full FT font init pipeline.
-// Opens font file via bridge I/O (fallback chain: OT -> TT -> T1), creates FT_Face,
-// reads metrics, loads AFM for non-SFNT Type1 fonts, then initializes HarfBuzz font.
-fn initialize_ft_internal(font: *XeTeXFont_rec, pathname: [*:0]const u8, index: c_int) c_int {
-    const lib = get_ft_library() orelse return -1;
+// -- shared faces --
+// a font file loaded at several sizes (\small, \large, ...) is parsed once: the
+// FT_Face and hb_face_t are shared by every XeTeXFont_rec with the same path and
+// face index, and reference counted. each rec keeps its own hb_font_t. nothing
+// in a face depends on the size, as glyphs are loaded unscaled and converted
+// with the rec's point_size.
+
+const SharedFace = struct {
+    key: []u8,
+    // of the file's contents, for caches that outlive the face
+    digest: u64,
+    ft_face: *anyopaque,
+    hb_face: *hb_face_t,
+    // made on demand (see get_or_create_gr_face, get_ot_layout)
+    gr_face: ?*anyopaque = null,
+    ot: ?*OtLayout = null,
+    data: [*]u8,
+    size: usize,
+    refs: u32,
+};
+
+// faces by "index:path" and by FT_Face (for deleteFont)
+const FaceCache = struct {
+    by_path: std.StringHashMap(*SharedFace),
+    by_face: std.AutoHashMap(usize, *SharedFace),
+    hits: u64 = 0,
+};
+
+fn get_face_cache() *FaceCache {
+    if (state.face_cache) |*c| return c;
+    state.face_cache = .{
+        .by_path = .init(font_alloc),
+        .by_face = .init(font_alloc),
+    };
+    return &state.face_cache.?;
+}
+
+// read the font file via bridge I/O (fallback chain: OT -> TT -> T1) and
+// create its FT_Face, with the companion .afm of a Type1 font attached
+fn load_face(pathname: [*:0]const u8, index: c_int, data_out: *[*]u8, size_out: *usize) ?*anyopaque {
+    const lib = get_ft_library() orelse return null;
 
-    // open via bridge I/O with fallback chain
     var handle: usize = ttbc_input_open(pathname, TTBC_FILE_FORMAT_OPEN_TYPE, 0);
     if (handle == 0) handle = ttbc_input_open(pathname, TTBC_FILE_FORMAT_TRUE_TYPE, 0);
     if (handle == 0) handle = ttbc_input_open(pathname, TTBC_FILE_FORMAT_TYPE1, 0);
-    if (handle == 0) return -1;
+    if (handle == 0) return null;
 
     const sz = ttbc_input_get_size(handle);
     const data_raw = malloc(sz) orelse {
         _ = ttstub_input_close(handle);
-        return -1;
+        return null;
     };
 
     const nread = ttbc_input_read(handle, data_raw, sz);
     _ = ttstub_input_close(handle);
     if (nread < 0 or @as(usize, @intCast(nread)) != sz) {
         free(data_raw);
-        return -1;
+        return null;
     }
 
-    font.font_data = @ptrCast(data_raw);
-    font.font_data_size = sz;
-
     var ft_face_out: ?*anyopaque = null;
     const ft_err = FT_New_Memory_Face(lib, data_raw, @intCast(sz), @intCast(index), &ft_face_out);
     if (ft_err != 0) {
         free(data_raw);
-        font.font_data = null;
-        return -1;
+        return null;
     }
-    font.ft_face = ft_face_out;
-    state.ft_face_count += 1;
 
     // check scalability
     const face: *const FT_FacePartial = @ptrCast(@alignCast(ft_face_out.?));
     if ((face.face_flags & FT_FACE_FLAG_SCALABLE) == 0) {
         _ = FT_Done_Face(ft_face_out.?);
-        state.ft_face_count -= 1;
-        font.ft_face = null;
         free(data_raw);
-        font.font_data = null;
-        return -1;
+        return null;
     }
 
     // for non-SFNT fonts (Type1), try loading companion .afm
@@ -1546,6 +1693,100 @@ fn initialize_ft_internal(font: *XeTeXFont_rec, pathname: [*:0]const u8, index:
         }
     }
 
+    data_out.* = data_raw;
+    size_out.* = sz;
+    return ft_face_out;
+}
+
+fn acquire_face(pathname: [*:0]const u8, index: c_int) ?*SharedFace {
+    const alloc = font_alloc;
+    const cache = get_face_cache();
+
+    var key_buf: [1040]u8 = undefined;
+    const key = std.fmt.bufPrint(&key_buf, "{d}:{s}", .{ index, std.mem.span(pathname) }) catch return null;
+    if (cache.by_path.get(key)) |shared| {
+        shared.refs += 1;
+        cache.hits += 1;
+        return shared;
+    }
+    cache.by_path.ensureUnusedCapacity(1) catch return null;
+    cache.by_face.ensureUnusedCapacity(1) catch return null;
+
+    const started = std.time.nanoTimestamp();
+    var data: [*]u8 = undefined;
+    var size: usize = 0;
+    const ft_face = load_face(pathname, index, &data, &size) orelse return null;
+    const face: *const FT_FacePartial = @ptrCast(@alignCast(ft_face));
+
+    // the hb_face reads tables straight from the FT_Face; hb_data is a single
+    // pointer holding it, freed with the hb_face
+    const hb_data_raw = malloc(@sizeOf(?*anyopaque));
+    const hb_face: ?*hb_face_t = if (hb_data_raw) |raw| blk: {
+        const hb_data: *?*anyopaque = @ptrCast(@alignCast(raw));
+        hb_data.* = ft_face;
+        break :blk hb_face_create_for_tables(@ptrCast(&hb_reference_table_func), @ptrCast(raw), @ptrCast(&free));
+    } else null;
+
+    const shared = alloc.create(SharedFace) catch null;
+    const owned_key = alloc.dupe(u8, key) catch null;
+    if (hb_face == null or shared == null or owned_key == null) {
+        if (hb_face) |hf| hb_face_destroy(hf) else if (hb_data_raw) |raw| free(raw);
+        if (shared) |sf| alloc.destroy(sf);
+        if (owned_key) |k| alloc.free(k);
+        _ = FT_Done_Face(ft_face);
+        free(data);
+        return null;
+    }
+    hb_face_set_index(hb_face.?, @intCast(index));
+    hb_face_set_upem(hb_face.?, face.units_per_em);
+
+    shared.?.* = .{ .key = owned_key.?, .digest = std.hash.Wyhash.hash(@intCast(index), data[0..size]), .ft_face = ft_face, .hb_face = hb_face.?, .data = data, .size = size, .refs = 1 };
+    state.ft_face_count += 1;
+    cache.by_path.putAssumeCapacity(owned_key.?, shared.?);
+    cache.by_face.putAssumeCapacity(@intFromPtr(ft_face), shared.?);
+
+    const elapsed: u64 = @intCast(@max(0, std.time.nanoTimestamp() - started));
+    state.stats.faces_loaded += 1;
+    state.stats.load_ns += elapsed;
+    var threaded: std.Io.Threaded = .init_single_threaded;
+    Log.dbg(threaded.io(), "layout", "loaded face {s} ({d} KiB) in {d}.{d:0>3} ms", .{ key, size / 1024, elapsed / 1_000_000, elapsed / 1000 % 1000 });
+    return shared.?;
+}
+
+// drop one reference to the face behind ft_face, freeing it with the last
+fn release_face(ft_face: *anyopaque) void {
+    const cache = get_face_cache();
+    const shared = cache.by_face.get(@intFromPtr(ft_face)) orelse return;
+    shared.refs -= 1;
+    if (shared.refs > 0) return;
+
+    _ = cache.by_path.remove(shared.key);
+    _ = cache.by_face.remove(@intFromPtr(ft_face));
+    if (shared.gr_face) |gf| gr_face_destroy(gf);
+    if (shared.ot) |ot| {
+        ot.arena.deinit();
+        font_alloc.destroy(ot);
+    }
+    hb_face_destroy(shared.hb_face);
+    _ = FT_Done_Face(ft_face);
+    state.ft_face_count -= 1;
+    free(shared.data);
+    font_alloc.free(shared.key);
+    font_alloc.destroy(shared);
+}
+
+// initialize_ft_internal: full FT font init pipeline.
+// Takes the shared face for (pathname, index), loading it on first use, reads
+// metrics, then initializes the rec's own HarfBuzz font. On failure the rec
+// holds nothing.
+fn initialize_ft_internal(font: *XeTeXFont_rec, pathname: [*:0]const u8, index: c_int) c_int {
+    const shared = acquire_face(pathname, index) orelse return -1;
+    const ft_face = shared.ft_face;
+    font.ft_face = ft_face;
+    font.font_data = @ptrCast(shared.data);
+    font.font_data_size = shared.size;
+
+    const face: *const FT_FacePartial = @ptrCast(@alignCast(ft_face));
     font.filename = strdup(pathname);
     font.index = @intCast(index);
     font.units_per_em = face.units_per_em;
@@ -1553,14 +1794,14 @@ fn initialize_ft_internal(font: *XeTeXFont_rec, pathname: [*:0]const u8, index:
     font.descent = @floatCast(font_units_to_points(font, @floatFromInt(face.descender)));
 
     // italic angle from PostScript table
-    const post_ptr = FT_Get_Sfnt_Table(ft_face_out.?, FT_SFNT_POST);
+    const post_ptr = FT_Get_Sfnt_Table(ft_face, FT_SFNT_POST);
     if (post_ptr) |pp| {
         const post: *const TT_Postscript_Partial = @ptrCast(@alignCast(pp));
         font.italic_angle = @floatCast(fix_to_d(@intCast(post.italic_angle)));
     }
 
     // cap_height and x_height from OS/2 table
-    const os2_ptr = FT_Get_Sfnt_Table(ft_face_out.?, FT_SFNT_OS2);
+    const os2_ptr = FT_Get_Sfnt_Table(ft_face, FT_SFNT_OS2);
     if (os2_ptr) |op| {
         const os2: *const TT_OS2_Partial = @ptrCast(@alignCast(op));
         font.cap_height = @floatCast(font_units_to_points(font, @floatFromInt(os2.s_cap_height)));
@@ -1568,7 +1809,15 @@ fn initialize_ft_internal(font: *XeTeXFont_rec, pathname: [*:0]const u8, index:
     }
 
     // create HarfBuzz font via C helper (encapsulates custom font funcs)
-    return initialize_hb_font(font);
+    if (initialize_hb_font(font, shared.hb_face) != 0) {
+        release_face(ft_face);
+        font.ft_face = null;
+        font.font_data = null;
+        if (font.filename) |f| free(@ptrCast(f));
+        font.filename = null;
+        return -1;
+    }
+    return 0;
 }
 
 export fn createFontFromFile(filename: [*:0]const u8, index: c_int, point_size: i32) ?*XeTeXFont_rec {
@@ -1587,16 +1836,16 @@ export fn createFontFromFile(filename: [*:0]const u8, index: c_int, point_size:
 
 export fn deleteFont(font_opt: ?*XeTeXFont_rec) void {
     const font = font_opt orelse return;
-    if (font.ft_face) |face| {
-        _ = FT_Done_Face(face);
-        font.ft_face = null;
-        state.ft_face_count -= 1;
-    }
+    // the hb_font holds a reference to the shared hb_face; drop it first
     if (font.hb_font) |hf| {
         hb_font_destroy(hf);
         font.hb_font = null;
     }
-    if (font.font_data) |fd| free(fd);
+    if (font.ft_face) |face| {
+        release_face(face);
+        font.ft_face = null;
+        font.font_data = null;
+    }
     if (font.filename) |f| {
         const ptr: ?*anyopaque = @ptrCast(@constCast(f));
         free(ptr);
@@ -1611,8 +1860,12 @@ export fn deleteFont(font_opt: ?*XeTeXFont_rec) void {
 
 export fn getGlyphs(engine: ?*XeTeXLayoutEngine_rec, glyphs: ?[*]u32) void {
     const e = engine orelse return;
-    const buf = e.hb_buffer orelse return;
     const out = glyphs orelse return;
+    if (cached_run(e)) |run| {
+        @memcpy(out[0..run.glyphs.len], run.glyphs);
+        return;
+    }
+    const buf = e.hb_buffer orelse return;
 
     var count: c_uint = undefined;
     const info = hb_buffer_get_glyph_infos(buf, &count);
@@ -1624,12 +1877,10 @@ export fn getGlyphs(engine: ?*XeTeXLayoutEngine_rec, glyphs: ?[*]u32) void {
 
 export fn getGlyphAdvances(engine: ?*XeTeXLayoutEngine_rec, advances: ?[*]f32) void {
     const e = engine orelse return;
-    const buf = e.hb_buffer orelse return;
     const out = advances orelse return;
     const font = e.font orelse return;
-
-    var count: c_uint = undefined;
-    const pos = hb_buffer_get_glyph_positions(buf, &count);
+    const pos = last_positions(e) orelse return;
+    const count = pos.len;
 
     for (0..count) |i| {
         const advance: i32 = if (font.vertical != 0) pos[i].y_advance else pos[i].x_advance;
@@ -1639,12 +1890,10 @@ export fn getGlyphAdvances(engine: ?*XeTeXLayoutEngine_rec, advances: ?[*]f32) v
 
 export fn getGlyphPositions(engine: ?*XeTeXLayoutEngine_rec, positions: ?[*]FloatPoint) void {
     const e = engine orelse return;
-    const buf = e.hb_buffer orelse return;
     const out = positions orelse return;
     const font = e.font orelse return;
-
-    var count: c_uint = undefined;
-    const pos = hb_buffer_get_glyph_positions(buf, &count);
+    const pos = last_positions(e) orelse return;
+    const count = pos.len;
 
     var x: f32 = 0.0;
     var y: f32 = 0.0;
@@ -1677,6 +1926,181 @@ export fn getGlyphPositions(engine: ?*XeTeXLayoutEngine_rec, positions: ?[*]Floa
     }
 }
 
+// ========================================
+// Shaping cache -- bounded LRU of layoutChars results
+// ========================================
+// Documents repeat their words, and every pass shapes them all again. A run
+// is cached under everything HarfBuzz is given: the font (file, index, size,
+// transform), script, language, features, shapers, direction, and the UTF-16
+// context with the run's place in it. Fonts are reloaded each pass, at
+// addresses that get reused, so the key names them by value (the language is
+// an interned HarfBuzz pointer, fixed for the process); the cache outlives
+// destroy_font_manager and serves the next pass too.
+
+const shape_cache_capacity = 16384;
+const no_run = std.math.maxInt(u32);
+
+const ShapedRun = struct {
+    key: []u8,
+    glyphs: []u32,
+    positions: []hb_glyph_position_t,
+    shaper: ?[*:0]u8, // strdup'd, as in used_shaper
+    // LRU list through run indices
+    prev: u32 = no_run,
+    next: u32 = no_run,
+};
+
+const ShapeCache = struct {
+    map: std.StringHashMap(u32),
+    runs: std.ArrayList(ShapedRun) = .empty,
+    head: u32 = no_run, // most recently used
+    tail: u32 = no_run,
+    key: std.ArrayList(u8) = .empty, // the key being looked up
+    hits: u64 = 0,
+    misses: u64 = 0,
+};
+
+fn get_shape_cache() *ShapeCache {
+    if (state.shape_cache) |*c| return c;
+    state.shape_cache = .{ .map = std.StringHashMap(u32).init(font_alloc) };
+    return &state.shape_cache.?;
+}
+
+// the run the engine's last layoutChars came from. valid until the next
+// layoutChars on any engine, which is how xetex-ext.c uses it.
+fn cached_run(e: *const XeTeXLayoutEngine_rec) ?*const ShapedRun {
+    if (e.shaped == 0) return null;
+    const c = if (state.shape_cache) |*c| c else return null;
+    return &c.runs.items[e.shaped - 1];
+}
+
+// glyph positions of the last layoutChars, cached or in HarfBuzz's buffer
+fn last_positions(e: *const XeTeXLayoutEngine_rec) ?[]const hb_glyph_position_t {
+    if (cached_run(e)) |run| return run.positions;
+    const buf = e.hb_buffer orelse return null;
+    var count: c_uint = undefined;
+    const pos = hb_buffer_get_glyph_positions(buf, &count);
+    return pos[0..count];
+}
+
+fn lru_unlink(c: *ShapeCache, i: u32) void {
+    const r = &c.runs.items[i];
+    if (r.prev != no_run) c.runs.items[r.prev].next = r.next else c.head = r.next;
+    if (r.next != no_run) c.runs.items[r.next].prev = r.prev else c.tail = r.prev;
+    r.prev = no_run;
+    r.next = no_run;
+}
+
+fn lru_push_front(c: *ShapeCache, i: u32) void {
+    const r = &c.runs.items[i];
+    r.prev = no_run;
+    r.next = c.head;
+    if (c.head != no_run) c.runs.items[c.head].prev = i else c.tail = i;
+    c.head = i;
+}
+
+// build the key for shaping chars[offset..][0..count] of max into c.key;
+// false for fonts without a file to name them by
+fn shape_key(c: *ShapeCache, e: *const XeTeXLayoutEngine_rec, font: *const XeTeXFont_rec, chars: [*]const u16, offset: i32, count: i32, max: i32, direction: c_uint) !bool {
+    const path = font.filename orelse return false;
+    const a = font_alloc;
+    const k = &c.key;
+    k.clearRetainingCapacity();
+
+    try k.appendSlice(a, std.mem.span(path));
+    try k.append(a, 0);
+    inline for (.{
+        font.index,
+        font.point_size,
+        font.units_per_em,
+        font.vertical,
+        e.script,
+        @intFromPtr(e.language),
+        e.extend,
+        e.slant,
+        e.embolden,
+        direction,
+        e.n_features,
+        e.n_shapers,
+        offset,
+        count,
+        max,
+    }) |v| try k.appendSlice(a, std.mem.asBytes(&v));
+
+    if (e.features) |raw| {
+        const feats: [*]const hb_feature_t = @ptrCast(@alignCast(raw));
+        try k.appendSlice(a, std.mem.sliceAsBytes(feats[0..@intCast(@max(e.n_features, 0))]));
+    }
+    if (e.shaper_list) |raw| {
+        const list: [*]const ?[*:0]const u8 = @ptrCast(@alignCast(raw));
+        for (list[0..@intCast(@max(e.n_shapers, 0))]) |name| {
+            if (name) |n| try k.appendSlice(a, std.mem.span(n));
+            try k.append(a, 0);
+        }
+    }
+    try k.appendSlice(a, std.mem.sliceAsBytes(chars[0..@intCast(@max(max, 0))]));
+    return true;
+}
+
+fn free_run(run: *ShapedRun) void {
+    const a = font_alloc;
+    a.free(run.key);
+    a.free(run.glyphs);
+    a.free(run.positions);
+    if (run.shaper) |s| {
+        const ptr: ?*anyopaque = @ptrCast(s);
+        free(ptr);
+    }
+}
+
+// keep what HarfBuzz just left in buf under c.key, evicting the least
+// recently used run once the cache is full; returns the run's index
+fn remember_run(c: *ShapeCache, buf: *anyopaque, shaper: ?[*:0]const u8) ?u32 {
+    const a = font_alloc;
+    var n: c_uint = 0;
+    const infos = hb_buffer_get_glyph_infos(buf, &n);
+    const pos = hb_buffer_get_glyph_positions(buf, &n);
+
+    const key = a.dupe(u8, c.key.items) catch return null;
+    const glyphs = a.alloc(u32, n) catch {
+        a.free(key);
+        return null;
+    };
+    const positions = a.dupe(hb_glyph_position_t, pos[0..n]) catch {
+        a.free(key);
+        a.free(glyphs);
+        return null;
+    };
+    for (glyphs, infos[0..n]) |*g, info| g.* = info.codepoint;
+
+    var run: ShapedRun = .{
+        .key = key,
+        .glyphs = glyphs,
+        .positions = positions,
+        .shaper = if (shaper) |s| strdup(s) else null,
+    };
+
+    var i: u32 = undefined;
+    if (c.runs.items.len < shape_cache_capacity) {
+        c.runs.append(a, run) catch {
+            free_run(&run);
+            return null;
+        };
+        i = @intCast(c.runs.items.len - 1);
+    } else {
+        i = c.tail;
+        lru_unlink(c, i);
+        const old = &c.runs.items[i];
+        _ = c.map.remove(old.key);
+        free_run(old);
+        old.* = run;
+    }
+    // a run the map could not take is still on the LRU list and ages out
+    c.map.put(c.runs.items[i].key, i) catch {};
+    lru_push_front(c, i);
+    return i;
+}
+
 // ========================================
 // Text shaping (Phase 2h part 2)
 // ========================================
@@ -1695,6 +2119,7 @@ export fn layoutChars(
     if (chars == null) return 0;
 
     const buf = e.hb_buffer orelse return 0;
+    e.shaped = 0;
     hb_buffer_reset(buf);
 
     // add UTF-16 text
@@ -1742,8 +2167,38 @@ export fn layoutChars(
         e.used_shaper = null;
     }
 
-    // try cached shape plan first
-    var plan = hb_shape_plan_create_cached(hb_face_ptr, &seg_props, e.features, n_feat, shapers_to_use) orelse return 0;
+    // the buffer is set up as shaping would leave it, so getDefaultDirection
+    // reads the same script from a cached run
+    state.stats.shape_calls += 1;
+    const cache = get_shape_cache();
+    const cacheable = shape_key(cache, e, font, chars.?, offset, count, max, direction) catch false;
+    if (cacheable) {
+        if (cache.map.get(cache.key.items)) |i| {
+            cache.hits += 1;
+            lru_unlink(cache, i);
+            lru_push_front(cache, i);
+            const run = &cache.runs.items[i];
+            if (run.shaper) |s| e.used_shaper = strdup(s);
+            e.shaped = i + 1;
+            return @intCast(run.glyphs.len);
+        }
+        cache.misses += 1;
+    }
+
+    // the engine's plan while the segment properties stay the same, else
+    // one from HarfBuzz's plan cache, kept for the next call
+    const props_match = e.plan != null and
+        e.plan_props.direction == seg_props.direction and
+        e.plan_props.script == seg_props.script and
+        e.plan_props.language == seg_props.language;
+    if (props_match) {
+        state.stats.plan_reuses += 1;
+    } else {
+        if (e.plan) |old| hb_shape_plan_destroy(old);
+        e.plan = hb_shape_plan_create_cached(hb_face_ptr, &seg_props, e.features, n_feat, shapers_to_use);
+        e.plan_props = seg_props;
+    }
+    var plan = e.plan orelse return 0;
 
     var success = hb_shape_plan_execute(plan, hb_font_ptr, buf, e.features, n_feat);
 
@@ -1754,7 +2209,6 @@ export fn layoutChars(
         }
     } else {
         // retry with default (no shaper list), non-cached
-        hb_shape_plan_destroy(plan);
         plan = hb_shape_plan_create(hb_face_ptr, &seg_props, e.features, n_feat, null) orelse return 0;
         success = hb_shape_plan_execute(plan, hb_font_ptr, buf, e.features, n_feat);
         if (success != 0) {
@@ -1763,13 +2217,66 @@ export fn layoutChars(
                 e.used_shaper = strdup(s);
             }
         }
+        hb_shape_plan_destroy(plan);
     }
 
-    hb_shape_plan_destroy(plan);
+    if (cacheable and success != 0) {
+        if (remember_run(cache, buf, e.used_shaper)) |i| e.shaped = i + 1;
+    }
 
     return @intCast(hb_buffer_get_length(buf));
 }
 
+// layoutRuns: shape several runs of one text with one engine, as the bidi
+// runs of a native word are. The glyphs, advances and positions of all runs
+// go end to end into buffers kept across calls; each run's positions carry
+// one more entry, its end, as getGlyphPositions writes. runs[i].n_glyphs
+// gets the run's glyph count. The buffers stay valid until the next call.
+export fn layoutRuns(
+    engine: ?*XeTeXLayoutEngine_rec,
+    chars: ?[*]const u16,
+    max: i32,
+    runs: ?[*]LayoutRun,
+    n_runs: c_int,
+    glyphs: *?[*]const u32,
+    advances: *?[*]const f32,
+    positions: *?[*]const FloatPoint,
+) c_int {
+    const alloc = font_alloc;
+    state.run_glyphs.clearRetainingCapacity();
+    state.run_advances.clearRetainingCapacity();
+    state.run_positions.clearRetainingCapacity();
+    glyphs.* = null;
+    advances.* = null;
+    positions.* = null;
+    const rs = runs orelse return 0;
+    const n: usize = if (n_runs > 0) @intCast(n_runs) else 0;
+
+    var total: c_int = 0;
+    for (rs[0..n]) |*r| {
+        r.n_glyphs = 0;
+        const count = layoutChars(engine, chars, r.offset, r.count, max, r.rtl);
+        const ng: usize = @intCast(count);
+        const g = state.run_glyphs.addManyAsSlice(alloc, ng) catch return 0;
+        const a = state.run_advances.addManyAsSlice(alloc, ng) catch return 0;
+        const p = state.run_positions.addManyAsSlice(alloc, ng + 1) catch return 0;
+        // a run that failed to shape leaves them as zeroes
+        @memset(g, 0);
+        @memset(a, 0);
+        @memset(p, .{ .x = 0, .y = 0 });
+        getGlyphs(engine, g.ptr);
+        getGlyphAdvances(engine, a.ptr);
+        getGlyphPositions(engine, p.ptr);
+        r.n_glyphs = count;
+        total += count;
+    }
+
+    glyphs.* = state.run_glyphs.items.ptr;
+    advances.* = state.run_advances.items.ptr;
+    positions.* = state.run_positions.items.ptr;
+    return total;
+}
+
 // ========================================
 // FreeType library singleton + HarfBuzz font funcs infrastructure
 // (ported from csrc/xetex/layout.c)
@@ -1823,8 +2330,13 @@ const HB_MEMORY_MODE_WRITABLE: c_uint = 2;
 
 // -- FreeType library singleton state (single-threaded: no synchronization needed) --
 
+// FreeType and the HarfBuzz font funcs below are set up on first use, so a
+// TFM-only document never pays for either; their spans in --trace (and
+// font_init_ms in zig build bench) show when a run does
 fn get_ft_library() ?*anyopaque {
     if (state.ft_lib) |lib| return lib;
+    const started = Timeline.now();
+    defer Timeline.span(.engine, "font init", "freetype", started);
     var lib_out: ?*anyopaque = null;
     const err = FT_Init_FreeType(&lib_out);
     if (err != 0) return null;
@@ -1933,6 +2445,8 @@ fn hb_glyph_name_func(_: ?*anyopaque, font_data: ?*anyopaque, glyph: u32, name:
 
 fn get_font_funcs() *hb_font_funcs_t {
     if (state.custom_font_funcs) |funcs| return funcs;
+    const started = Timeline.now();
+    defer Timeline.span(.engine, "font init", "harfbuzz", started);
     const funcs = hb_font_funcs_create() orelse unreachable;
     hb_font_funcs_set_nominal_glyph_func(funcs, @ptrCast(&hb_nominal_glyph_func), null, null);
     hb_font_funcs_set_variation_glyph_func(funcs, @ptrCast(&hb_variation_glyph_func), null, null);
@@ -1968,26 +2482,11 @@ fn hb_reference_table_func(_: ?*anyopaque, tag: u32, user_data: ?*anyopaque) cal
 
 // -- HarfBuzz font initialization (ported from layout.c initialize_hb_font) --
 
-fn initialize_hb_font(font: *XeTeXFont_rec) c_int {
-    // allocate hb_face_data: a single pointer holding the FT_Face
-    const hb_data_raw = malloc(@sizeOf(?*anyopaque)) orelse return -1;
-    const hb_data: *?*anyopaque = @ptrCast(@alignCast(hb_data_raw));
-    hb_data.* = font.ft_face;
-
-    const hb_face: *hb_face_t = hb_face_create_for_tables(
-        @ptrCast(&hb_reference_table_func),
-        @ptrCast(hb_data_raw),
-        @ptrCast(&free),
-    ) orelse return -1;
-    hb_face_set_index(hb_face, font.index);
-    hb_face_set_upem(hb_face, font.units_per_em);
-
-    const hb_font_ptr: *hb_font_t = hb_font_create(hb_face) orelse {
-        hb_face_destroy(hb_face);
-        return -1;
-    };
+// hb_face is the font's shared face (see acquire_face); the hb_font takes its
+// own reference to it
+fn initialize_hb_font(font: *XeTeXFont_rec, hb_face: *hb_face_t) c_int {
+    const hb_font_ptr: *hb_font_t = hb_font_create(hb_face) orelse return -1;
     font.hb_font = hb_font_ptr;
-    hb_face_destroy(hb_face);
 
     hb_font_set_funcs(hb_font_ptr, get_font_funcs(), font.ft_face, null);
     _ = hb_font_set_user_data(hb_font_ptr, @ptrCast(&state.ft_face_user_data_key), font.ft_face, null, 0);
@@ -2000,19 +2499,71 @@ fn initialize_hb_font(font: *XeTeXFont_rec) c_int {
 // Font manager lifecycle
 // ========================================
 
+extern fn ttbc_fire_checkpoint(checkpoint_id: c_int, detail: ?[*:0]const u8) void;
+const checkpoint_stats = 9; // TTBC_CHECKPOINT_STATS
+
+fn hit_rate(hits: u64, misses: u64) u64 {
+    return if (hits + misses == 0) 0 else hits * 100 / (hits + misses);
+}
+
+// this run's font figures, to the debug log (--verbose) and the trace
+fn report_font_stats() void {
+    const st = &state.stats;
+    var shape_hits: u64 = 0;
+    var shape_misses: u64 = 0;
+    var faces_open: usize = 0;
+    var faces_shared: u64 = 0;
+    var resident: usize = 0;
+    if (state.shape_cache) |*c| {
+        shape_hits = c.hits;
+        shape_misses = c.misses;
+    }
+    if (state.face_cache) |*c| {
+        faces_shared = c.hits;
+        faces_open = c.by_face.count();
+        var it = c.by_face.valueIterator();
+        while (it.next()) |shared| resident += shared.*.size;
+    }
+    if (faces_open == 0 and st.shape_calls == 0) return;
+
+    var threaded: std.Io.Threaded = .init_single_threaded;
+    const io = threaded.io();
+    var buf: [256]u8 = undefined;
+
+    const faces = std.fmt.bufPrintZ(&buf, "font faces: {d} loaded in {d}.{d:0>3} ms, {d} loads saved, {d} open, {d} KiB resident", .{
+        st.faces_loaded, st.load_ns / 1_000_000, st.load_ns / 1000 % 1000, faces_shared, faces_open, resident / 1024,
+    }) catch return;
+    Log.dbg(io, "layout", "{s}", .{faces});
+    ttbc_fire_checkpoint(checkpoint_stats, faces.ptr);
+
+    const caches = std.fmt.bufPrintZ(&buf, "font caches: {d} shaping calls ({d}% cached, {d} plans reused), glyph boxes {d}% of {d}, unscaled boxes {d}% of {d}, graphite faces {d}% of {d}", .{
+        st.shape_calls,
+        hit_rate(shape_hits, shape_misses),
+        st.plan_reuses,
+        hit_rate(st.bbox_hits, st.bbox_misses),
+        st.bbox_hits + st.bbox_misses,
+        hit_rate(st.unit_bbox_hits, st.unit_bbox_misses),
+        st.unit_bbox_hits + st.unit_bbox_misses,
+        hit_rate(st.gr_hits, st.gr_misses),
+        st.gr_hits + st.gr_misses,
+    }) catch return;
+    Log.dbg(io, "layout", "{s}", .{caches});
+    ttbc_fire_checkpoint(checkpoint_stats, caches.ptr);
+}
+
 export fn destroy_font_manager() void {
-    // destroy graphite cache entries (gr_face + gr_font objects)
-    if (state.gr_cache) |*cache| {
-        var it = cache.valueIterator();
-        while (it.next()) |entry| {
-            gr_font_destroy(entry.gr_font);
-            gr_face_destroy(entry.gr_face);
+    // destroy the graphite faces of faces still open; a later query makes
+    // them again
+    if (state.face_cache) |*c| {
+        var it = c.by_face.valueIterator();
+        while (it.next()) |shared| {
+            if (shared.*.gr_face) |gf| gr_face_destroy(gf);
+            shared.*.gr_face = null;
         }
-        cache.deinit();
-        state.gr_cache = null;
     }
 
-    // destroy bbox and protrusion caches
+    // destroy bbox and protrusion caches; the unscaled boxes are kept (see
+    // cached_unit_bbox)
     if (state.bbox_cache) |*c| {
         c.deinit();
         state.bbox_cache = null;
@@ -2026,6 +2577,17 @@ export fn destroy_font_manager() void {
         state.right_prot = null;
     }
 
+    report_font_stats();
+
+    // the shaping cache is kept for the next pass (see shape_key), and shared
+    // faces go with the last font using them (see release_face)
+    if (state.shape_cache) |*c| {
+        c.hits = 0;
+        c.misses = 0;
+    }
+    if (state.face_cache) |*c| c.hits = 0;
+    state.stats = .{};
+
     state.ft_lib_shutdown_pending = 1;
     maybe_shutdown_ft();
     if (state.custom_font_funcs) |funcs| {
@@ -2358,6 +2920,150 @@ fn ttxl_platfont_get_desc_mac(font_ref: ?*anyopaque) callconv(.c) [*:0]const u8
 // non-Mac (WASM) implementations
 // ----------------------------------------
 
+// -- non-Mac font catalog --
+// every name find_font_by_name_nonmac can resolve in the local font dirs, read
+// from one listing of each: file names, stems before .otf/.ttf/.OTF/.TTF, and
+// the PostScript, "family style" and (for regular faces) family names inside
+// the font files. built on the first lookup and kept for the process; a dir
+// whose mtime moved (a font added or removed under --watch) rebuilds it.
+
+const font_dirs = [_][]const u8{ ".", "fonts" };
+const font_exts = [_][]const u8{ ".otf", ".ttf", ".OTF", ".TTF" };
+
+const CatalogEntry = struct {
+    path: [:0]u8,
+    index: u32,
+};
+
+const FontCatalog = struct {
+    names: std.StringHashMap(CatalogEntry),
+    mtimes: [font_dirs.len]?i96,
+};
+
+fn dir_mtime(io: std.Io, dir: []const u8) ?i96 {
+    const st = std.Io.Dir.cwd().statFile(io, dir, .{}) catch return null;
+    return st.mtime.nanoseconds;
+}
+
+// first name in wins, so callers add in lookup priority order
+fn catalog_add(c: *FontCatalog, key: []const u8, path: []const u8, index: u32) void {
+    if (key.len == 0 or c.names.contains(key)) return;
+    const k = font_alloc.dupe(u8, key) catch return;
+    const p = font_alloc.dupeZ(u8, path) catch {
+        font_alloc.free(k);
+        return;
+    };
+    c.names.put(k, .{ .path = p, .index = index }) catch {
+        font_alloc.free(k);
+        font_alloc.free(p);
+    };
+}
+
+fn free_catalog(c: *FontCatalog) void {
+    var it = c.names.iterator();
+    while (it.next()) |e| {
+        font_alloc.free(e.key_ptr.*);
+        font_alloc.free(e.value_ptr.path);
+    }
+    c.names.deinit();
+}
+
+fn is_font_file(file: []const u8) bool {
+    const dot = std.mem.lastIndexOfScalar(u8, file, '.') orelse return false;
+    const ext = file[dot..];
+    for ([_][]const u8{ ".otf", ".ttf", ".otc", ".ttc" }) |e| {
+        if (std.ascii.eqlIgnoreCase(ext, e)) return true;
+    }
+    return false;
+}
+
+// the names inside each face of a font file
+fn catalog_add_faces(c: *FontCatalog, path: [:0]const u8) void {
+    const lib = get_ft_library() orelse return;
+    var num_faces: c_long = 1;
+    var i: c_long = 0;
+    while (i < num_faces) : (i += 1) {
+        var face_out: ?*anyopaque = null;
+        if (FT_New_Face(lib, path.ptr, i, &face_out) != 0) return;
+        const face_ptr = face_out.?;
+        defer _ = FT_Done_Face(face_ptr);
+        const face: *const FT_FacePartial = @ptrCast(@alignCast(face_ptr));
+        num_faces = face.num_faces;
+        const index: u32 = @intCast(i);
+
+        if (FT_Get_Postscript_Name(face_ptr)) |ps| catalog_add(c, std.mem.span(ps), path, index);
+        const family = std.mem.span(face.family_name orelse continue);
+        const style = if (face.style_name) |st| std.mem.span(st) else "";
+        var buf: [512]u8 = undefined;
+        if (std.fmt.bufPrint(&buf, "{s} {s}", .{ family, style })) |full| {
+            catalog_add(c, full, path, index);
+        } else |_| {}
+        if (style.len == 0 or std.mem.eql(u8, style, "Regular")) catalog_add(c, family, path, index);
+    }
+}
+
+fn build_font_catalog(io: std.Io) FontCatalog {
+    var c: FontCatalog = .{ .names = .init(font_alloc), .mtimes = undefined };
+    var listed: [font_dirs.len]std.ArrayList([]u8) = @splat(.empty);
+    defer for (&listed) |*files| {
+        for (files.items) |f| font_alloc.free(f);
+        files.deinit(font_alloc);
+    };
+
+    for (font_dirs, 0..) |dir_path, d| {
+        c.mtimes[d] = dir_mtime(io, dir_path);
+        var dir = std.Io.Dir.cwd().openDir(io, dir_path, .{ .iterate = true }) catch continue;
+        defer dir.close(io);
+        var iter = dir.iterate();
+        while (iter.next(io) catch null) |entry| {
+            if (entry.kind != .file and entry.kind != .sym_link) continue;
+            const file = font_alloc.dupe(u8, entry.name) catch continue;
+            listed[d].append(font_alloc, file) catch font_alloc.free(file);
+        }
+    }
+
+    // file names first, in the order the old probing tried them: per dir, the
+    // name as given, then the name plus each extension in turn
+    var path_buf: [1024]u8 = undefined;
+    for (font_dirs, listed) |dir_path, files| {
+        for (files.items) |file| {
+            const path = std.fmt.bufPrint(&path_buf, "{s}/{s}", .{ dir_path, file }) catch continue;
+            catalog_add(&c, file, path, 0);
+        }
+        for (font_exts) |ext| {
+            for (files.items) |file| {
+                if (file.len <= ext.len or !std.mem.endsWith(u8, file, ext)) continue;
+                const path = std.fmt.bufPrint(&path_buf, "{s}/{s}", .{ dir_path, file }) catch continue;
+                catalog_add(&c, file[0 .. file.len - ext.len], path, 0);
+            }
+        }
+    }
+
+    // then the names the fonts give themselves, which never shadow a file name
+    for (font_dirs, listed) |dir_path, files| {
+        for (files.items) |file| {
+            if (!is_font_file(file)) continue;
+            const path = std.fmt.bufPrintZ(&path_buf, "{s}/{s}", .{ dir_path, file }) catch continue;
+            catalog_add_faces(&c, path);
+        }
+    }
+
+    Log.dbg(io, "layout", "font catalog: {d} names", .{c.names.count()});
+    return c;
+}
+
+fn get_font_catalog(io: std.Io) *FontCatalog {
+    if (state.font_catalog) |*c| {
+        for (font_dirs, c.mtimes) |dir_path, mtime| {
+            const now = dir_mtime(io, dir_path);
+            if ((now == null) != (mtime == null) or (now != null and now.? != mtime.?)) break;
+        } else return c;
+        free_catalog(c);
+    }
+    state.font_catalog = build_font_catalog(io);
+    return &state.font_catalog.?;
+}
+
 fn file_exists_check(path: [*:0]const u8) bool {
     var threaded: std.Io.Threaded = .init_single_threaded;
     const io = threaded.io();
@@ -2366,16 +3072,21 @@ fn file_exists_check(path: [*:0]const u8) bool {
     return true;
 }
 
-fn try_font_path_internal(path: [*:0]const u8) ?*FcPattern {
-    if (!file_exists_check(path)) return null;
+fn font_pattern(path: [*:0]const u8, index: u32) ?*FcPattern {
     const raw = calloc(1, @sizeOf(FcPattern)) orelse return null;
     const pat: *FcPattern = @ptrCast(@alignCast(raw));
     pat.file = strdup(path);
-    pat.index = 0;
+    pat.index = @intCast(index);
     return pat;
 }
 
-// non-Mac findFontByName: searches {., fonts} x {as-is, .otf, .ttf, .OTF, .TTF} for a font file.
+fn try_font_path_internal(path: [*:0]const u8) ?*FcPattern {
+    if (!file_exists_check(path)) return null;
+    return font_pattern(path, 0);
+}
+
+// non-Mac findFontByName: looks the name up in the font catalog of {., fonts}.
+// a name with a directory in it is probed as {., fonts}/name as before.
 fn find_font_by_name_nonmac(name: ?[*:0]const u8, variant: ?[*]u8, size: f64) callconv(.c) ?*FcPattern {
     _ = size;
     parse_engine_variant(variant);
@@ -2386,23 +3097,15 @@ fn find_font_by_name_nonmac(name: ?[*:0]const u8, variant: ?[*]u8, size: f64) ca
     const n = name orelse return null;
     const name_slice = std.mem.span(n);
 
-    const search_dirs = [_][]const u8{ ".", "fonts" };
-    const exts = [_][]const u8{ ".otf", ".ttf", ".OTF", ".TTF" };
-
-    var path_buf: [1024]u8 = undefined;
-
-    for (search_dirs) |dir| {
-        // try name as-is (might already have extension)
-        if (std.fmt.bufPrintZ(&path_buf, "{s}/{s}", .{ dir, name_slice })) |path_z| {
-            if (try_font_path_internal(path_z.ptr)) |result| {
-                Log.log(io, "layout", .info, "found font '{s}' at '{s}'", .{ name_slice, path_z });
-                return result;
-            }
-        } else |_| {}
-
-        // try with extensions
-        for (exts) |ext| {
-            if (std.fmt.bufPrintZ(&path_buf, "{s}/{s}{s}", .{ dir, name_slice, ext })) |path_z| {
+    if (std.mem.indexOfScalar(u8, name_slice, '/') == null) {
+        if (get_font_catalog(io).names.get(name_slice)) |entry| {
+            Log.log(io, "layout", .info, "found font '{s}' at '{s}'", .{ name_slice, entry.path });
+            return font_pattern(entry.path.ptr, entry.index);
+        }
+    } else {
+        var path_buf: [1024]u8 = undefined;
+        for (font_dirs) |dir| {
+            if (std.fmt.bufPrintZ(&path_buf, "{s}/{s}", .{ dir, name_slice })) |path_z| {
                 if (try_font_path_internal(path_z.ptr)) |result| {
                     Log.log(io, "layout", .info, "found font '{s}' at '{s}'", .{ name_slice, path_z });
                     return result;
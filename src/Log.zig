@@ -5,6 +5,7 @@
 
 const std = @import("std");
 const builtin = @import("builtin");
+const build_options = @import("build_options");
 const Io = std.Io;
 
 const is_wasm = builtin.cpu.arch == .wasm32;
@@ -18,6 +19,15 @@ pub fn stderr_writer(io: Io, buf: []u8) Io.File.Writer {
 
 pub const Level = enum { info, warn, err };
 
+// whether dbg is compiled in at all: -Ddebug-log, by default on in Debug and
+// ReleaseSafe builds and off in ReleaseFast and ReleaseSmall ones. when off,
+// dbg calls and the formatting of their arguments compile to nothing, and
+// set_debug has no effect on them.
+pub const debug_compiled = build_options.debug_log orelse switch (builtin.mode) {
+    .Debug, .ReleaseSafe => true,
+    .ReleaseFast, .ReleaseSmall => false,
+};
+
 // debug mode: off by default, can be enabled at runtime.
 // on WASM: JS host sets this via an exported function.
 // on native: set via --debug flag or env var.
@@ -29,12 +39,14 @@ pub fn set_debug(enabled: bool) void {
 }
 
 pub fn is_debug() bool {
-    return debug_enabled.load(.monotonic);
+    return debug_compiled and debug_enabled.load(.monotonic);
 }
 
-// debug log: only emits when debug_enabled is true.
-// zero cost when debug is off (just an atomic bool load).
-pub fn dbg(io: Io, comptime scope: []const u8, comptime fmt: []const u8, args: anytype) void {
+// debug log: only emits when debug_enabled is true. inline, so that without
+// debug_compiled nothing of the call is left, its arguments included; with
+// it, debug off costs an atomic bool load.
+pub inline fn dbg(io: Io, comptime scope: []const u8, comptime fmt: []const u8, args: anytype) void {
+    if (comptime !debug_compiled) return;
     if (!debug_enabled.load(.monotonic)) return;
     log_stderr(io, "[dbg:" ++ scope ++ "] ", fmt, args);
 }
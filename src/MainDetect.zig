@@ -15,14 +15,17 @@ const known_names = [_][]const u8{
     "report.tex",
 };
 
+// how much of a file the \documentclass scan looks at: the preamble
+pub const preamble_len = 4096;
+
 // detect the main TeX file from a list of filenames.
 // files: list of filenames (relative paths, e.g. "chapter1.tex", "main.tex")
-// read_fn: optional callback to read first N bytes of a file (for \documentclass scan)
-//          returns null if file can't be read.
+// read_fn: optional callback to read the first preamble_len bytes of a file
+//          (for the \documentclass scan); returns null if it can't be read.
 //
 // heuristics (first match wins):
 //   1. only one .tex file in root -> use it
-//   2. file containing \documentclass (scan first 4096 bytes)
+//   2. file containing \documentclass (scan first preamble_len bytes)
 //   3. well-known names: main.tex, index.tex, thesis.tex, paper.tex, document.tex
 //   4. alphabetically first .tex file (last resort)
 pub fn detect(
@@ -30,14 +33,41 @@ pub fn detect(
     files: []const []const u8,
     ctx: ?*anyopaque,
     read_fn: ?*const fn (?*anyopaque, []const u8) ?[]const u8,
+) ?[]const u8 {
+    const reader = read_fn orelse return detect_marked(allocator, files, null);
+    if (count_root_tex(files) <= 1) return detect_marked(allocator, files, null);
+
+    const marks = allocator.alloc(bool, files.len) catch return detect_marked(allocator, files, null);
+    defer allocator.free(marks);
+    for (files, marks) |f, *mark| {
+        mark.* = false;
+        if (!is_root_tex(f)) continue;
+        if (reader(ctx, f)) |content| mark.* = has_documentclass(content);
+    }
+    return detect_marked(allocator, files, marks);
+}
+
+// detect with the \documentclass scan already done (see Project.zig, which
+// reads candidates in parallel): marks[i] tells whether files[i] has one in
+// its preamble. null marks skip heuristic 2.
+pub fn detect_marked(
+    allocator: std.mem.Allocator,
+    files: []const []const u8,
+    marks: ?[]const bool,
 ) ?[]const u8 {
     // collect root-level .tex files (no path separators)
     var tex_files: std.ArrayList([]const u8) = .empty;
     defer tex_files.deinit(allocator);
+    var doc_class_file: ?[]const u8 = null;
+    var doc_class_count: usize = 0;
 
-    for (files) |f| {
+    for (files, 0..) |f, i| {
         if (is_root_tex(f)) {
             tex_files.append(allocator, f) catch continue;
+            if (marks != null and marks.?[i]) {
+                doc_class_count += 1;
+                if (doc_class_file == null) doc_class_file = f;
+            }
         }
     }
 
@@ -46,37 +76,18 @@ pub fn detect(
     // heuristic 1: only one .tex file
     if (tex_files.items.len == 1) return tex_files.items[0];
 
-    // heuristic 2: scan for \documentclass
-    if (read_fn) |reader| {
-        // first pass: find files with \documentclass
-        var doc_class_file: ?[]const u8 = null;
-        var doc_class_count: usize = 0;
-
-        for (tex_files.items) |f| {
-            if (reader(ctx, f)) |content| {
-                if (has_documentclass(content)) {
-                    doc_class_count += 1;
-                    if (doc_class_file == null) doc_class_file = f;
-                }
-            }
-        }
+    // heuristic 2: \documentclass
+    // if exactly one has \documentclass, use it
+    if (doc_class_count == 1) return doc_class_file;
 
-        // if exactly one has \documentclass, use it
-        if (doc_class_count == 1) return doc_class_file;
-
-        // if multiple have \documentclass, prefer known names among them
-        if (doc_class_count > 1) {
-            for (&known_names) |name| {
-                for (tex_files.items) |f| {
-                    if (std.mem.eql(u8, basename(f), name)) {
-                        if (reader(ctx, f)) |content| {
-                            if (has_documentclass(content)) return f;
-                        }
-                    }
-                }
+    // if multiple have \documentclass, prefer known names among them
+    if (doc_class_count > 1) {
+        for (&known_names) |name| {
+            for (files, 0..) |f, i| {
+                if (marks.?[i] and is_root_tex(f) and std.mem.eql(u8, basename(f), name)) return f;
             }
-            // fall through to known names check
         }
+        // fall through to known names check
     }
 
     // heuristic 3: well-known names
@@ -95,7 +106,13 @@ pub fn detect(
     return tex_files.items[0];
 }
 
-fn is_root_tex(path: []const u8) bool {
+fn count_root_tex(files: []const []const u8) usize {
+    var n: usize = 0;
+    for (files) |f| n += @intFromBool(is_root_tex(f));
+    return n;
+}
+
+pub fn is_root_tex(path: []const u8) bool {
     // root-level: no directory separators, ends with .tex
     if (std.mem.indexOfScalar(u8, path, '/') != null) return false;
     if (std.mem.indexOfScalar(u8, path, '\\') != null) return false;
@@ -108,9 +125,9 @@ fn basename(path: []const u8) []const u8 {
     return path;
 }
 
-fn has_documentclass(content: []const u8) bool {
-    // scan for \documentclass (within first 4096 bytes or full content)
-    const scan_limit = @min(content.len, 4096);
+pub fn has_documentclass(content: []const u8) bool {
+    // scan for \documentclass (within the preamble or full content)
+    const scan_limit = @min(content.len, preamble_len);
     const scan = content[0..scan_limit];
     return std.mem.indexOf(u8, scan, "\\documentclass") != null;
 }
@@ -182,3 +199,14 @@ test "detect with documentclass reader" {
     try std.testing.expect(result != null);
     try std.testing.expectEqualStrings("mydoc.tex", result.?);
 }
+
+test "detect_marked prefers a known name among several documents" {
+    const allocator = std.testing.allocator;
+    const files = [_][]const u8{ "answers.tex", "main.tex", "notes.md", "handout.tex" };
+    const marks = [_]bool{ true, true, false, false };
+    try std.testing.expectEqualStrings("main.tex", detect_marked(allocator, &files, &marks).?);
+
+    // a known name without \documentclass loses to the one document
+    const one = [_]bool{ true, false, false, false };
+    try std.testing.expectEqualStrings("answers.tex", detect_marked(allocator, &files, &one).?);
+}
@@ -0,0 +1,176 @@
+// MemStats.zig -- current and peak heap bytes per subsystem, for finding out
+// what a large document fills memory with (the WASM heap only grows).
+//
+// Zig code allocates through allocator(tag), a counting wrapper over
+// c_allocator. The C engines count in support.c: with tracking on, xmalloc
+// and friends (and dpx's new/renew) enter each block in a pointer table under
+// the subsystem the engine is working in, and report every change here
+// through ttbc_mem_account. Blocks allocated before tracking began, or by
+// libraries with their own malloc calls, are not counted.
+//
+// The figures go into the trace (--trace) as notes at the end of a compile,
+// and to the app through eztex_query_memory_stats.
+
+const std = @import("std");
+const Io = std.Io;
+const Alignment = std.mem.Alignment;
+
+// as TTBC_MEM_* in tectonic_bridge_core.h
+pub const Tag = enum(c_int) {
+    // TeX's arrays, string pool, hash, format image; everything untagged
+    engine = 0,
+    // TFM and native fonts, the layout caches, font embedding
+    fonts = 1,
+    // xdvipdfmx's objects and streams
+    pdf = 2,
+    // image inclusion on either side
+    images = 3,
+    // World's buffers and open files
+    io = 4,
+};
+
+const n_tags = std.meta.fields(Tag).len;
+
+pub const Counter = struct {
+    current: i64 = 0,
+    peak: i64 = 0,
+
+    fn add(self: *Counter, delta: i64) void {
+        self.current += delta;
+        if (self.current > self.peak) self.peak = self.current;
+    }
+};
+
+pub const Snapshot = struct {
+    tags: [n_tags]Counter,
+    // peak of the sum, which is not the sum of the peaks
+    total: Counter,
+};
+
+// set by the app (eztex_track_memory) to have every compile counted, not
+// only traced ones
+pub var wanted: bool = false;
+
+// engine state is per thread (see TTBC_THREAD_LOCAL), and so are its counts
+threadlocal var counters: [n_tags]Counter = @splat(.{});
+threadlocal var total: Counter = .{};
+
+pub fn account(tag: Tag, delta: i64) void {
+    counters[@intFromEnum(tag)].add(delta);
+    total.add(delta);
+}
+
+export fn ttbc_mem_account(tag: c_int, delta: i64) void {
+    const t = std.enums.fromInt(Tag, tag) orelse .engine;
+    account(t, delta);
+}
+
+// start measuring peaks from what is live now (the start of a compile)
+pub fn reset_peaks() void {
+    for (&counters) |*c| c.peak = c.current;
+    total.peak = total.current;
+}
+
+pub fn snapshot() Snapshot {
+    return .{ .tags = counters, .total = total };
+}
+
+fn bytes(v: i64) u64 {
+    return @intCast(@max(v, 0));
+}
+
+// {"engine":{"current":N,"peak":N},...,"total":{...}}, and "heap":N when
+// the caller knows the size of the whole heap
+pub fn write_json(w: *Io.Writer, s: Snapshot, heap: ?u64) Io.Writer.Error!void {
+    try w.writeByte('{');
+    for (s.tags, 0..) |c, i| {
+        const tag: Tag = @enumFromInt(i);
+        try w.print("\"{s}\":{{\"current\":{d},\"peak\":{d}}},", .{ @tagName(tag), bytes(c.current), bytes(c.peak) });
+    }
+    try w.print("\"total\":{{\"current\":{d},\"peak\":{d}}}", .{ bytes(s.total.current), bytes(s.total.peak) });
+    if (heap) |h| try w.print(",\"heap\":{d}", .{h});
+    try w.writeByte('}');
+}
+
+// -- counting allocators --
+
+const tag_ids: [n_tags]Tag = blk: {
+    var ids: [n_tags]Tag = undefined;
+    for (&ids, 0..) |*id, i| id.* = @enumFromInt(i);
+    break :blk ids;
+};
+
+const vtable: std.mem.Allocator.VTable = .{
+    .alloc = alloc,
+    .resize = resize,
+    .remap = remap,
+    .free = free,
+};
+
+// c_allocator, with what it hands out counted against tag
+pub fn allocator(tag: Tag) std.mem.Allocator {
+    return .{ .ptr = @constCast(&tag_ids[@intFromEnum(tag)]), .vtable = &vtable };
+}
+
+fn tagOf(ctx: *anyopaque) Tag {
+    const id: *const Tag = @ptrCast(@alignCast(ctx));
+    return id.*;
+}
+
+const child = std.heap.c_allocator;
+
+fn alloc(ctx: *anyopaque, len: usize, alignment: Alignment, ret_addr: usize) ?[*]u8 {
+    const p = child.rawAlloc(len, alignment, ret_addr) orelse return null;
+    account(tagOf(ctx), @intCast(len));
+    return p;
+}
+
+fn resize(ctx: *anyopaque, memory: []u8, alignment: Alignment, new_len: usize, ret_addr: usize) bool {
+    if (!child.rawResize(memory, alignment, new_len, ret_addr)) return false;
+    account(tagOf(ctx), @as(i64, @intCast(new_len)) - @as(i64, @intCast(memory.len)));
+    return true;
+}
+
+fn remap(ctx: *anyopaque, memory: []u8, alignment: Alignment, new_len: usize, ret_addr: usize) ?[*]u8 {
+    const p = child.rawRemap(memory, alignment, new_len, ret_addr) orelse return null;
+    account(tagOf(ctx), @as(i64, @intCast(new_len)) - @as(i64, @intCast(memory.len)));
+    return p;
+}
+
+fn free(ctx: *anyopaque, memory: []u8, alignment: Alignment, ret_addr: usize) void {
+    child.rawFree(memory, alignment, ret_addr);
+    account(tagOf(ctx), -@as(i64, @intCast(memory.len)));
+}
+
+test "counts track current and peak per tag and in total" {
+    counters = @splat(.{});
+    total = .{};
+
+    account(.fonts, 1000);
+    account(.io, 24);
+    try std.testing.expectEqual(@as(i64, 1000), snapshot().tags[@intFromEnum(Tag.fonts)].current);
+    try std.testing.expectEqual(@as(i64, 1024), snapshot().total.peak);
+
+    account(.fonts, -1000);
+    const s = snapshot();
+    try std.testing.expectEqual(@as(i64, 0), s.tags[@intFromEnum(Tag.fonts)].current);
+    try std.testing.expectEqual(@as(i64, 1000), s.tags[@intFromEnum(Tag.fonts)].peak);
+    try std.testing.expectEqual(@as(i64, 24), s.total.current);
+
+    reset_peaks();
+    try std.testing.expectEqual(@as(i64, 0), snapshot().tags[@intFromEnum(Tag.fonts)].peak);
+    try std.testing.expectEqual(@as(i64, 24), snapshot().total.peak);
+
+    // from C, an unknown tag counts as engine
+    ttbc_mem_account(@intFromEnum(Tag.pdf), 500);
+    ttbc_mem_account(@intFromEnum(Tag.pdf), -500);
+    ttbc_mem_account(42, 8);
+    try std.testing.expectEqual(@as(i64, 500), snapshot().tags[@intFromEnum(Tag.pdf)].peak);
+    try std.testing.expectEqual(@as(i64, 8), snapshot().tags[@intFromEnum(Tag.engine)].current);
+
+    var buf: [512]u8 = undefined;
+    var w: Io.Writer = .fixed(&buf);
+    try write_json(&w, snapshot(), null);
+    try std.testing.expect(std.mem.indexOf(u8, w.buffered(), "\"pdf\":{\"current\":0,\"peak\":500}") != null);
+    try std.testing.expect(std.mem.endsWith(u8, w.buffered(), "\"total\":{\"current\":32,\"peak\":524}}"));
+}
@@ -0,0 +1,311 @@
+// Packfile.zig -- append-only pack of cached bundle files.
+//
+// Instead of one loose file per cache entry (an open + stat per lookup, an
+// inode per entry), a pack keeps every entry of a bundle in two files:
+//
+//   {digest}.pack  entry contents, appended back to back
+//   {digest}.idx   "EZPK" | version u32, then fixed 128-byte records:
+//                  offset u64 | size u32 | name_len u16 | reserved u16 |
+//                  sha256 [32]u8 | name [80]u8
+//
+// Both are mmapped on open, so a lookup is a hash probe plus a slice of the
+// data mapping. A record is appended only after its data is written; a torn
+// tail record or one pointing past the end of the data file is ignored, and
+// later records for a name override earlier ones.
+//
+// One process appends at a time (flock on the index). Others open the pack
+// read-only, leave new entries to the caller (Cache writes loose files) and
+// can refresh() to see what the writer appended since. The data mapping is
+// MAP_SHARED, so all processes read the same page-cache pages.
+//
+// Native only (needs mmap). Self-contained (std only) so it can be tested alone.
+
+const std = @import("std");
+const Io = std.Io;
+const posix = std.posix;
+
+const Packfile = @This();
+
+pub const max_name_len = 80;
+
+const magic = "EZPK";
+const version: u32 = 1;
+const header_len = 8;
+const record_len = 128;
+
+// data mappings are reserved with slack so appends rarely need a new one
+const min_map_len: usize = 64 * 1024 * 1024;
+
+const Mapping = []align(std.heap.page_size_min) const u8;
+
+const Record = struct {
+    offset: u64,
+    size: u32,
+};
+
+allocator: std.mem.Allocator,
+data_file: ?Io.File = null,
+index_file: ?Io.File = null,
+writable: bool = false,
+// next free byte of the data file, reserved atomically so writers run in parallel
+data_end: std.atomic.Value(u64) = .init(0),
+// next record slot of the index file; appends are serialized by the caller
+index_end: u64 = 0,
+index_map: ?Mapping = null,
+// newest last. older mappings stay alive: slices handed out by get() point into them
+maps: std.ArrayList(Mapping) = .empty,
+entries: std.StringHashMapUnmanaged(Record) = .empty,
+// names of records appended after open (loaded names point into index_map)
+names: std.heap.ArenaAllocator,
+
+pub fn init(allocator: std.mem.Allocator) Packfile {
+    return .{ .allocator = allocator, .names = .init(allocator) };
+}
+
+pub fn deinit(self: *Packfile, io: Io) void {
+    self.close(io);
+    self.names.deinit();
+}
+
+pub fn close(self: *Packfile, io: Io) void {
+    for (self.maps.items) |m| posix.munmap(m);
+    self.maps.deinit(self.allocator);
+    if (self.index_map) |m| posix.munmap(m);
+    if (self.data_file) |f| f.close(io);
+    if (self.index_file) |f| f.close(io); // releases the flock
+    self.entries.deinit(self.allocator);
+    _ = self.names.reset(.free_all);
+    self.* = .{ .allocator = self.allocator, .names = self.names };
+}
+
+pub fn is_open(self: *const Packfile) bool {
+    return self.data_file != null;
+}
+
+// open (creating if needed) the pack at data_path/index_path under dir.
+pub fn open(self: *Packfile, io: Io, dir: Io.Dir, data_path: []const u8, index_path: []const u8) !void {
+    self.close(io);
+    errdefer self.close(io);
+
+    self.index_file = try dir.createFile(io, index_path, .{ .read = true, .truncate = false });
+    self.data_file = try dir.createFile(io, data_path, .{ .read = true, .truncate = false });
+    const index_file = self.index_file.?;
+    const data_file = self.data_file.?;
+
+    self.writable = if (posix.flock(index_file.handle, posix.LOCK.EX | posix.LOCK.NB)) true else |_| false;
+
+    const data_len = (try data_file.stat(io)).size;
+    const index_len: usize = @intCast((try index_file.stat(io)).size);
+
+    if (index_len < header_len) {
+        if (!self.writable) return;
+        var header: [header_len]u8 = undefined;
+        @memcpy(header[0..4], magic);
+        std.mem.writeInt(u32, header[4..8], version, .little);
+        try index_file.writePositionalAll(io, &header, 0);
+        self.index_end = header_len;
+        self.data_end.store(data_len, .monotonic);
+        return;
+    }
+
+    const index_map = try posix.mmap(null, index_len, posix.PROT.READ, .{ .TYPE = .SHARED }, index_file.handle, 0);
+    self.index_map = index_map;
+    if (!std.mem.eql(u8, index_map[0..4], magic) or std.mem.readInt(u32, index_map[4..8], .little) != version) {
+        return error.InvalidPack;
+    }
+
+    const n = (index_len - header_len) / record_len;
+    try self.entries.ensureTotalCapacity(self.allocator, @intCast(n));
+    for (0..n) |i| {
+        const rec = index_map[header_len + i * record_len ..][0..record_len];
+        const offset = std.mem.readInt(u64, rec[0..8], .little);
+        const size = std.mem.readInt(u32, rec[8..12], .little);
+        const name_len = std.mem.readInt(u16, rec[12..14], .little);
+        if (name_len == 0 or name_len > max_name_len) continue;
+        if (offset + size > data_len) continue;
+        self.entries.putAssumeCapacity(rec[48..][0..name_len], .{ .offset = offset, .size = size });
+    }
+
+    // a torn tail record is overwritten by the next append
+    self.index_end = header_len + n * record_len;
+    self.data_end.store(data_len, .monotonic);
+    if (data_len > 0) try self.map_data(data_len);
+}
+
+// read-only opens only: pick up records the writing process appended since.
+pub fn refresh(self: *Packfile, io: Io) !void {
+    if (self.writable) return;
+    const index_file = self.index_file orelse return;
+    const index_len = (try index_file.stat(io)).size;
+    if (self.index_end == 0) {
+        // the writer had not initialized the index when we opened it
+        var header: [header_len]u8 = undefined;
+        if (index_len < header_len or try index_file.readPositionalAll(io, &header, 0) != header_len) return;
+        if (!std.mem.eql(u8, header[0..4], magic) or std.mem.readInt(u32, header[4..8], .little) != version) return error.InvalidPack;
+        self.index_end = header_len;
+    }
+    if (index_len < self.index_end + record_len) return;
+
+    const data_len = (try self.data_file.?.stat(io)).size;
+    const n: usize = @intCast((index_len - self.index_end) / record_len);
+    var rec: [record_len]u8 = undefined;
+    for (0..n) |_| {
+        if (try index_file.readPositionalAll(io, &rec, self.index_end) != record_len) break;
+        const offset = std.mem.readInt(u64, rec[0..8], .little);
+        const size = std.mem.readInt(u32, rec[8..12], .little);
+        const name_len = std.mem.readInt(u16, rec[12..14], .little);
+        // data is written before its record, so this only trips on corruption
+        if (name_len == 0 or name_len > max_name_len or offset + size > data_len) {
+            self.index_end += record_len;
+            continue;
+        }
+        const name = rec[48..][0..name_len];
+        const gop = try self.entries.getOrPut(self.allocator, name);
+        if (!gop.found_existing) {
+            gop.key_ptr.* = self.names.allocator().dupe(u8, name) catch |err| {
+                self.entries.removeByPtr(gop.key_ptr);
+                return err;
+            };
+        }
+        gop.value_ptr.* = .{ .offset = offset, .size = size };
+        self.index_end += record_len;
+    }
+}
+
+fn map_data(self: *Packfile, needed: u64) !void {
+    const want = @max(min_map_len, needed * 2);
+    const len = std.mem.alignForward(usize, @intCast(want), std.heap.page_size_min);
+    // mapping past EOF is fine: pages are only touched once their records exist
+    const m = try posix.mmap(null, len, posix.PROT.READ, .{ .TYPE = .SHARED }, self.data_file.?.handle, 0);
+    errdefer posix.munmap(m);
+    try self.maps.append(self.allocator, m);
+}
+
+pub fn contains(self: *const Packfile, name: []const u8) bool {
+    return self.entries.contains(name);
+}
+
+pub fn count(self: *const Packfile) usize {
+    return self.entries.count();
+}
+
+// content of `name`, valid until close(). not thread-safe against append().
+pub fn get(self: *Packfile, name: []const u8) ?[]const u8 {
+    const rec = self.entries.get(name) orelse return null;
+    const end = rec.offset + rec.size;
+    if (rec.size == 0) return &.{};
+    if (self.maps.items.len == 0 or self.maps.getLast().len < end) {
+        self.map_data(end) catch return null;
+    }
+    return self.maps.getLast()[@intCast(rec.offset)..@intCast(end)];
+}
+
+// reserve space for `len` bytes of content and write it there. safe to call
+// from several threads; the returned offset goes to append().
+pub fn store(self: *Packfile, io: Io, content: []const u8) !u64 {
+    if (!self.writable) return error.ReadOnlyPack;
+    if (content.len > std.math.maxInt(u32)) return error.FileTooBig;
+    const offset = self.data_end.fetchAdd(content.len, .monotonic);
+    try self.data_file.?.writePositionalAll(io, content, offset);
+    return offset;
+}
+
+// publish stored content under `name`. not thread-safe.
+pub fn append(self: *Packfile, io: Io, name: []const u8, offset: u64, size: u32, hash: *const [32]u8) !void {
+    if (!self.writable) return error.ReadOnlyPack;
+    if (name.len == 0 or name.len > max_name_len) return error.NameTooLong;
+
+    var rec: [record_len]u8 = @splat(0);
+    std.mem.writeInt(u64, rec[0..8], offset, .little);
+    std.mem.writeInt(u32, rec[8..12], size, .little);
+    std.mem.writeInt(u16, rec[12..14], @intCast(name.len), .little);
+    @memcpy(rec[16..48], hash);
+    @memcpy(rec[48..][0..name.len], name);
+    try self.index_file.?.writePositionalAll(io, &rec, self.index_end);
+    self.index_end += record_len;
+
+    const gop = try self.entries.getOrPut(self.allocator, name);
+    if (!gop.found_existing) gop.key_ptr.* = try self.names.allocator().dupe(u8, name);
+    gop.value_ptr.* = .{ .offset = offset, .size = size };
+}
+
+// -- tests --
+
+test "entries survive reopen; later records win" {
+    const io = std.testing.io;
+    var tmp_dir = std.testing.tmpDir(.{});
+    defer tmp_dir.cleanup();
+
+    const hash: [32]u8 = @splat(0xab);
+    {
+        var pack = Packfile.init(std.testing.allocator);
+        defer pack.deinit(io);
+        try pack.open(io, tmp_dir.dir, "b.pack", "b.idx");
+        try std.testing.expect(pack.writable);
+
+        const a = try pack.store(io, "\\ProvidesFile{a.sty}");
+        try pack.append(io, "a.sty", a, 20, &hash);
+        const b = try pack.store(io, "old");
+        try pack.append(io, "b.tfm", b, 3, &hash);
+        const b2 = try pack.store(io, "new!");
+        try pack.append(io, "b.tfm", b2, 4, &hash);
+
+        try std.testing.expectEqualStrings("\\ProvidesFile{a.sty}", pack.get("a.sty").?);
+        try std.testing.expectEqualStrings("new!", pack.get("b.tfm").?);
+        try std.testing.expectError(error.NameTooLong, pack.append(io, "x" ** (max_name_len + 1), a, 1, &hash));
+    }
+
+    var pack = Packfile.init(std.testing.allocator);
+    defer pack.deinit(io);
+    try pack.open(io, tmp_dir.dir, "b.pack", "b.idx");
+    try std.testing.expectEqual(@as(usize, 2), pack.count());
+    try std.testing.expectEqualStrings("\\ProvidesFile{a.sty}", pack.get("a.sty").?);
+    try std.testing.expectEqualStrings("new!", pack.get("b.tfm").?);
+    try std.testing.expect(pack.get("c.sty") == null);
+}
+
+test "read-only opens see appends after refresh" {
+    const io = std.testing.io;
+    var tmp_dir = std.testing.tmpDir(.{});
+    defer tmp_dir.cleanup();
+
+    const hash: [32]u8 = @splat(0);
+    var writer = Packfile.init(std.testing.allocator);
+    defer writer.deinit(io);
+    try writer.open(io, tmp_dir.dir, "b.pack", "b.idx");
+
+    var reader = Packfile.init(std.testing.allocator);
+    defer reader.deinit(io);
+    try reader.open(io, tmp_dir.dir, "b.pack", "b.idx");
+    try std.testing.expect(!reader.writable);
+    try std.testing.expectError(error.ReadOnlyPack, reader.store(io, "x"));
+
+    const a = try writer.store(io, "shared");
+    try writer.append(io, "a.sty", a, 6, &hash);
+    try std.testing.expect(reader.get("a.sty") == null);
+    try reader.refresh(io);
+    try std.testing.expectEqualStrings("shared", reader.get("a.sty").?);
+}
+
+test "records past the end of the data file are ignored" {
+    const io = std.testing.io;
+    var tmp_dir = std.testing.tmpDir(.{});
+    defer tmp_dir.cleanup();
+
+    const hash: [32]u8 = @splat(0);
+    {
+        var pack = Packfile.init(std.testing.allocator);
+        defer pack.deinit(io);
+        try pack.open(io, tmp_dir.dir, "b.pack", "b.idx");
+        const a = try pack.store(io, "kept");
+        try pack.append(io, "a.sty", a, 4, &hash);
+        // record published without its data, as after a crash
+        try pack.append(io, "lost.sty", 4, 100, &hash);
+    }
+
+    var pack = Packfile.init(std.testing.allocator);
+    defer pack.deinit(io);
+    try pack.open(io, tmp_dir.dir, "b.pack", "b.idx");
+    try std.testing.expectEqualStrings("kept", pack.get("a.sty").?);
+    try std.testing.expect(!pack.contains("lost.sty"));
+}
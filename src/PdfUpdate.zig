@@ -0,0 +1,498 @@
+// PdfUpdate.zig -- `--incremental-pdf`: keep the previous PDF and append an
+// update section instead of replacing the file.
+//
+// xdvipdfmx still writes the whole document. append() compares it, object by
+// object, with the PDF from the compile before and, where the object numbers
+// line up, returns the old file followed by the objects whose bytes differ,
+// an xref section for them and a trailer pointing back at the old xref
+// (/Prev), as the PDF spec's incremental updates have it. An edit to one page
+// of a long document then adds that page's content stream and a few
+// dictionaries rather than rewriting everything.
+//
+// Only classic xref tables are read, so this needs object streams off (the
+// fast profile). Whenever the two files do not fit together -- an xref
+// stream, encryption, objects that went away, most of the document changed,
+// an update chain grown well past the document -- append returns null and
+// the freshly written PDF stands as it is.
+//
+// Self-contained (std only).
+
+const std = @import("std");
+const Allocator = std.mem.Allocator;
+
+pub const Update = struct {
+    // the whole new file: the previous PDF, then the update
+    pdf: []u8,
+    // objects written into the update, of all in-use objects
+    rewritten: usize,
+    objects: usize,
+};
+
+// update sections followed back from the newest
+const max_sections = 256;
+const max_trailer_entries = 16;
+
+// the previous PDF plus what changed in fresh, or null to keep fresh whole
+pub fn append(alloc: Allocator, previous: []const u8, fresh: []const u8) !?Update {
+    var old = try Xref.parse(alloc, previous) orelse return null;
+    defer old.deinit(alloc);
+    var new = try Xref.parse(alloc, fresh) orelse return null;
+    defer new.deinit(alloc);
+
+    // fresh from xdvipdfmx: one section, same header, nothing encrypted
+    if (new.sections != 1) return null;
+    if (!std.mem.eql(u8, first_line(previous), first_line(fresh))) return null;
+    if (entry_value(new.trailer, "Encrypt") != null or entry_value(old.trailer, "Encrypt") != null) return null;
+    // an object the new file no longer has would need a free entry
+    const old_offsets = old.offsets.items;
+    const new_offsets = new.offsets.items;
+    for (old_offsets, 0..) |off, num| {
+        if (off != 0 and (num >= new_offsets.len or new_offsets[num] == 0)) return null;
+    }
+
+    var out: std.ArrayList(u8) = .empty;
+    errdefer out.deinit(alloc);
+    try out.appendSlice(alloc, previous);
+    if (previous[previous.len - 1] != '\n') try out.append(alloc, '\n');
+    const update_start = out.items.len;
+
+    // number and new offset of each rewritten object, in number order
+    var written: std.ArrayList(struct { num: usize, offset: usize }) = .empty;
+    defer written.deinit(alloc);
+    var objects: usize = 0;
+    var object_bytes: usize = 0;
+    for (new_offsets, 0..) |off, num| {
+        if (off == 0) continue;
+        const bytes = new.object(fresh, num) orelse return null;
+        objects += 1;
+        object_bytes += bytes.len;
+        if (num < old_offsets.len and old_offsets[num] != 0) {
+            const before = old.object(previous, num) orelse return null;
+            if (std.mem.eql(u8, before, bytes)) continue;
+        }
+        try written.append(alloc, .{ .num = num, .offset = out.items.len });
+        try out.appendSlice(alloc, bytes);
+    }
+
+    // not worth it: most of the document, or a chain of updates that has
+    // grown well past the document itself
+    if (out.items.len - update_start > object_bytes / 2) return null;
+    if (out.items.len > fresh.len * 4) return null;
+
+    const xref_offset = out.items.len;
+    try out.appendSlice(alloc, "xref\n");
+    var i: usize = 0;
+    while (i < written.items.len) {
+        var run: usize = 1;
+        while (i + run < written.items.len and written.items[i + run].num == written.items[i].num + run) run += 1;
+        try out.print(alloc, "{d} {d}\n", .{ written.items[i].num, run });
+        for (written.items[i .. i + run]) |w| {
+            try out.print(alloc, "{d:0>10} {d:0>5} n \n", .{ w.offset, new.generations.items[w.num] });
+        }
+        i += run;
+    }
+
+    try out.appendSlice(alloc, "trailer\n<<");
+    var entries: [max_trailer_entries]Entry = undefined;
+    for (dict_entries(new.trailer, &entries) orelse return null) |e| {
+        if (std.mem.eql(u8, e.key, "Prev")) continue;
+        try out.print(alloc, "/{s} ", .{e.key});
+        if (std.mem.eql(u8, e.key, "ID")) {
+            // the first identifier stays that of the original file
+            if (merged_id(entry_value(old.trailer, "ID"), e.value)) |id| {
+                try out.print(alloc, "[{s} {s}]", .{ id[0], id[1] });
+                continue;
+            }
+        }
+        try out.appendSlice(alloc, e.value);
+    }
+    try out.print(alloc, "/Prev {d}>>\nstartxref\n{d}\n%%EOF\n", .{ old.startxref, xref_offset });
+
+    return .{ .pdf = try out.toOwnedSlice(alloc), .rewritten = written.items.len, .objects = objects };
+}
+
+// -- xref tables --
+
+const Xref = struct {
+    // offset of each object's newest version, 0 when not in use
+    offsets: std.ArrayList(u64) = .empty,
+    generations: std.ArrayList(u16) = .empty,
+    // every object offset and xref section start ever written, sorted: an
+    // object runs to the next of them
+    bounds: std.ArrayList(u64) = .empty,
+    // newest section
+    startxref: u64,
+    trailer: []const u8 = &.{},
+    sections: usize = 0,
+
+    fn deinit(self: *Xref, alloc: Allocator) void {
+        self.offsets.deinit(alloc);
+        self.generations.deinit(alloc);
+        self.bounds.deinit(alloc);
+    }
+
+    fn parse(alloc: Allocator, pdf: []const u8) !?Xref {
+        const startxref = last_startxref(pdf) orelse return null;
+
+        var self: Xref = .{ .startxref = startxref };
+        errdefer self.deinit(alloc);
+
+        var seen: std.DynamicBitSetUnmanaged = .{};
+        defer seen.deinit(alloc);
+
+        var section = startxref;
+        while (true) {
+            if (self.sections == max_sections or section >= pdf.len) return self.fail(alloc);
+            self.sections += 1;
+            try self.bounds.append(alloc, section);
+
+            var pos: usize = @intCast(section);
+            if (!std.mem.startsWith(u8, pdf[pos..], "xref")) return self.fail(alloc);
+            pos += 4;
+            while (true) {
+                const first = next_token(pdf, &pos) orelse return self.fail(alloc);
+                if (std.mem.eql(u8, first.text, "trailer")) break;
+                const start = parse_int(first) orelse return self.fail(alloc);
+                const count = parse_int(next_token(pdf, &pos) orelse return self.fail(alloc)) orelse return self.fail(alloc);
+                // entries are 20 bytes each after the end of this line
+                while (pos < pdf.len and (pdf[pos] == ' ' or pdf[pos] == '\r' or pdf[pos] == '\n')) pos += 1;
+                if (start + count > std.math.maxInt(u32) or count > (pdf.len - pos) / 20) return self.fail(alloc);
+                try self.grow(alloc, &seen, @intCast(start + count));
+                for (0..@intCast(count)) |k| {
+                    const line = pdf[pos + k * 20 ..][0..20];
+                    const num: usize = @intCast(start + k);
+                    const off = std.fmt.parseInt(u64, line[0..10], 10) catch return self.fail(alloc);
+                    const gen = std.fmt.parseInt(u16, line[11..16], 10) catch return self.fail(alloc);
+                    const in_use = line[17] == 'n';
+                    if (in_use) try self.bounds.append(alloc, off);
+                    // an older section's entry is superseded
+                    if (seen.isSet(num)) continue;
+                    seen.set(num);
+                    self.offsets.items[num] = if (in_use and num != 0) off else 0;
+                    self.generations.items[num] = gen;
+                }
+                pos += @as(usize, @intCast(count)) * 20;
+            }
+
+            const dict_start = pos;
+            const dict_end = value_end(pdf, &pos) orelse return self.fail(alloc);
+            const trailer = pdf[dict_start..dict_end];
+            if (self.sections == 1) self.trailer = trailer;
+            const prev = entry_value(trailer, "Prev") orelse break;
+            section = int_value(prev) orelse return self.fail(alloc);
+        }
+
+        // the trailer's /Size covers every object number
+        const size = int_value(entry_value(self.trailer, "Size") orelse "") orelse return self.fail(alloc);
+        if (size != self.offsets.items.len) return self.fail(alloc);
+
+        for (self.offsets.items) |off| if (off >= startxref) return self.fail(alloc);
+        std.mem.sort(u64, self.bounds.items, {}, std.sort.asc(u64));
+        return self;
+    }
+
+    fn fail(self: *Xref, alloc: Allocator) ?Xref {
+        self.deinit(alloc);
+        return null;
+    }
+
+    fn grow(self: *Xref, alloc: Allocator, seen: *std.DynamicBitSetUnmanaged, len: usize) !void {
+        const have = self.offsets.items.len;
+        if (len <= have) return;
+        try self.offsets.appendNTimes(alloc, 0, len - have);
+        try self.generations.appendNTimes(alloc, 0, len - have);
+        try seen.resize(alloc, len, false);
+    }
+
+    // the bytes of object num, "num gen obj" through "endobj\n"
+    fn object(self: *const Xref, pdf: []const u8, num: usize) ?[]const u8 {
+        const off = self.offsets.items[num];
+        // first bound past off
+        var lo: usize = 0;
+        var hi: usize = self.bounds.items.len;
+        while (lo < hi) {
+            const mid = (lo + hi) / 2;
+            if (self.bounds.items[mid] <= off) lo = mid + 1 else hi = mid;
+        }
+        if (lo == self.bounds.items.len) return null;
+        const bytes = pdf[@intCast(off)..@intCast(self.bounds.items[lo])];
+
+        var head_buf: [16]u8 = undefined;
+        const head = std.fmt.bufPrint(&head_buf, "{d} ", .{num}) catch return null;
+        if (!std.mem.startsWith(u8, bytes, head)) return null;
+        return bytes;
+    }
+};
+
+fn last_startxref(pdf: []const u8) ?u64 {
+    const tail_start = pdf.len -| 1024;
+    const at = std.mem.lastIndexOf(u8, pdf[tail_start..], "startxref") orelse return null;
+    var pos = tail_start + at + "startxref".len;
+    return parse_int(next_token(pdf, &pos) orelse return null);
+}
+
+fn first_line(pdf: []const u8) []const u8 {
+    const end = std.mem.indexOfScalar(u8, pdf, '\n') orelse pdf.len;
+    return pdf[0..end];
+}
+
+// -- tokens, enough for xref sections and trailers --
+
+const Kind = enum { name, string, dict_open, dict_close, array_open, array_close, word };
+
+const Token = struct {
+    kind: Kind,
+    text: []const u8,
+};
+
+fn is_space(c: u8) bool {
+    return switch (c) {
+        ' ', '\t', '\r', '\n', 0x0c, 0 => true,
+        else => false,
+    };
+}
+
+fn is_delimiter(c: u8) bool {
+    return switch (c) {
+        '(', ')', '<', '>', '[', ']', '{', '}', '/', '%' => true,
+        else => is_space(c),
+    };
+}
+
+fn next_token(text: []const u8, pos: *usize) ?Token {
+    var i = pos.*;
+    while (i < text.len) {
+        if (is_space(text[i])) {
+            i += 1;
+        } else if (text[i] == '%') {
+            while (i < text.len and text[i] != '\n' and text[i] != '\r') i += 1;
+        } else break;
+    }
+    if (i >= text.len) return null;
+
+    const start = i;
+    const kind: Kind = switch (text[i]) {
+        '/' => blk: {
+            i += 1;
+            while (i < text.len and !is_delimiter(text[i])) i += 1;
+            break :blk .name;
+        },
+        '(' => blk: {
+            // balanced parentheses, backslash escapes
+            var depth: usize = 0;
+            while (i < text.len) : (i += 1) {
+                switch (text[i]) {
+                    '\\' => i += 1,
+                    '(' => depth += 1,
+                    ')' => {
+                        depth -= 1;
+                        if (depth == 0) break;
+                    },
+                    else => {},
+                }
+            }
+            if (i >= text.len) return null;
+            i += 1;
+            break :blk .string;
+        },
+        '<' => blk: {
+            if (i + 1 < text.len and text[i + 1] == '<') {
+                i += 2;
+                break :blk .dict_open;
+            }
+            i = 1 + (std.mem.indexOfScalarPos(u8, text, i, '>') orelse return null);
+            break :blk .string;
+        },
+        '>' => blk: {
+            if (i + 1 >= text.len or text[i + 1] != '>') return null;
+            i += 2;
+            break :blk .dict_close;
+        },
+        '[' => blk: {
+            i += 1;
+            break :blk .array_open;
+        },
+        ']' => blk: {
+            i += 1;
+            break :blk .array_close;
+        },
+        else => blk: {
+            while (i < text.len and !is_delimiter(text[i])) i += 1;
+            if (i == start) return null;
+            break :blk .word;
+        },
+    };
+    pos.* = i;
+    return .{ .kind = kind, .text = text[start..i] };
+}
+
+fn parse_int(t: Token) ?u64 {
+    if (t.kind != .word) return null;
+    return std.fmt.parseInt(u64, t.text, 10) catch null;
+}
+
+// an entry's value that is a plain number
+fn int_value(value: []const u8) ?u64 {
+    var pos: usize = 0;
+    return parse_int(next_token(value, &pos) orelse return null);
+}
+
+// past the value starting at pos: a dictionary or array with all it holds,
+// "n g R", or a single token
+fn value_end(text: []const u8, pos: *usize) ?usize {
+    const first = next_token(text, pos) orelse return null;
+    switch (first.kind) {
+        .dict_open, .array_open => {
+            var depth: usize = 1;
+            while (depth > 0) {
+                const t = next_token(text, pos) orelse return null;
+                switch (t.kind) {
+                    .dict_open, .array_open => depth += 1,
+                    .dict_close, .array_close => depth -= 1,
+                    else => {},
+                }
+            }
+        },
+        .dict_close, .array_close => return null,
+        .word => if (parse_int(first) != null) {
+            var ahead = pos.*;
+            const gen = next_token(text, &ahead);
+            const r = next_token(text, &ahead);
+            if (gen != null and r != null and parse_int(gen.?) != null and std.mem.eql(u8, r.?.text, "R")) pos.* = ahead;
+        },
+        else => {},
+    }
+    return pos.*;
+}
+
+const Entry = struct {
+    // without the slash
+    key: []const u8,
+    value: []const u8,
+};
+
+fn dict_entries(dict: []const u8, out: *[max_trailer_entries]Entry) ?[]Entry {
+    var pos: usize = 0;
+    const open = next_token(dict, &pos) orelse return null;
+    if (open.kind != .dict_open) return null;
+    var n: usize = 0;
+    while (true) {
+        const key = next_token(dict, &pos) orelse return null;
+        if (key.kind == .dict_close) return out[0..n];
+        if (key.kind != .name or n == out.len) return null;
+        while (pos < dict.len and is_space(dict[pos])) pos += 1;
+        const start = pos;
+        const end = value_end(dict, &pos) orelse return null;
+        out[n] = .{ .key = key.text[1..], .value = dict[start..end] };
+        n += 1;
+    }
+}
+
+fn entry_value(dict: []const u8, key: []const u8) ?[]const u8 {
+    var entries: [max_trailer_entries]Entry = undefined;
+    for (dict_entries(dict, &entries) orelse return null) |e| {
+        if (std.mem.eql(u8, e.key, key)) return e.value;
+    }
+    return null;
+}
+
+// the old /ID's first string with the new one's second
+fn merged_id(old_id: ?[]const u8, new_id: []const u8) ?[2][]const u8 {
+    const old_first = (id_strings(old_id orelse return null) orelse return null)[0];
+    const new_second = (id_strings(new_id) orelse return null)[1];
+    return .{ old_first, new_second };
+}
+
+fn id_strings(id: []const u8) ?[2][]const u8 {
+    var pos: usize = 0;
+    var ids: [2][]const u8 = undefined;
+    if ((next_token(id, &pos) orelse return null).kind != .array_open) return null;
+    for (&ids) |*s| {
+        const t = next_token(id, &pos) orelse return null;
+        if (t.kind != .string) return null;
+        s.* = t.text;
+    }
+    return ids;
+}
+
+// -- tests --
+
+const testing = std.testing;
+
+// a PDF with one object per body, laid out as xdvipdfmx writes it
+fn test_pdf(alloc: Allocator, bodies: []const []const u8, id: []const u8) ![]u8 {
+    var out: std.ArrayList(u8) = .empty;
+    errdefer out.deinit(alloc);
+    try out.appendSlice(alloc, "%PDF-1.5\n%\xe4\xf0\xed\xf8\n");
+    var offsets: [8]usize = undefined;
+    for (bodies, 1..) |body, num| {
+        offsets[num - 1] = out.items.len;
+        try out.print(alloc, "{d} 0 obj\n{s}\nendobj\n", .{ num, body });
+    }
+    const xref = out.items.len;
+    try out.print(alloc, "xref\n0 {d}\n0000000000 65535 f \n", .{bodies.len + 1});
+    for (offsets[0..bodies.len]) |off| try out.print(alloc, "{d:0>10} 00000 n \n", .{off});
+    try out.print(alloc, "trailer\n<</Size {d}/Root 1 0 R/Info 2 0 R/ID[{s}]>>\nstartxref\n{d}\n%%EOF\n", .{ bodies.len + 1, id, xref });
+    return out.toOwnedSlice(alloc);
+}
+
+const page_a = "<</Length 3>>\nstream\nA()\nendstream";
+const page_b = "<</Length 3>>\nstream\nB>>\nendstream";
+
+test "only changed objects go into the update" {
+    const alloc = testing.allocator;
+    const v1 = try test_pdf(alloc, &.{ "<</Type/Catalog>>", "<</Producer(x)>>", page_a, page_b }, "<0011><2233>");
+    defer alloc.free(v1);
+    const v2 = try test_pdf(alloc, &.{ "<</Type/Catalog>>", "<</Producer(x)>>", page_a, "<</Length 3>>\nstream\nC>>\nendstream" }, "<4455><6677>");
+    defer alloc.free(v2);
+
+    const u = (try append(alloc, v1, v2)).?;
+    defer alloc.free(u.pdf);
+    try testing.expectEqual(@as(usize, 1), u.rewritten);
+    try testing.expectEqual(@as(usize, 4), u.objects);
+    try testing.expect(std.mem.startsWith(u8, u.pdf, v1));
+    try testing.expect(std.mem.indexOf(u8, u.pdf[v1.len..], "/ID [<0011> <6677>]") != null);
+
+    // the update reads back: newest object 4 is C, object 3 still the old A
+    var x = (try Xref.parse(alloc, u.pdf)).?;
+    defer x.deinit(alloc);
+    try testing.expectEqual(@as(usize, 2), x.sections);
+    try testing.expect(std.mem.indexOf(u8, x.object(u.pdf, 4).?, "C>>") != null);
+    try testing.expect(std.mem.indexOf(u8, x.object(u.pdf, 3).?, "A()") != null);
+
+    // and a second update stacks on the first
+    const v3 = try test_pdf(alloc, &.{ "<</Type/Catalog>>", "<</Producer(x)>>", "<</Length 3>>\nstream\nD()\nendstream", "<</Length 3>>\nstream\nC>>\nendstream" }, "<8899><aabb>");
+    defer alloc.free(v3);
+    const u2 = (try append(alloc, u.pdf, v3)).?;
+    defer alloc.free(u2.pdf);
+    try testing.expectEqual(@as(usize, 1), u2.rewritten);
+    try testing.expect(std.mem.indexOf(u8, u2.pdf[u.pdf.len..], "/ID [<0011> <aabb>]") != null);
+}
+
+test "files that do not line up are written whole" {
+    const alloc = testing.allocator;
+    const v1 = try test_pdf(alloc, &.{ "<</Type/Catalog>>", "<<>>", page_a, page_b }, "<00><11>");
+    defer alloc.free(v1);
+
+    // an object that went away
+    const fewer = try test_pdf(alloc, &.{ "<</Type/Catalog>>", "<<>>", page_a }, "<00><11>");
+    defer alloc.free(fewer);
+    try testing.expect((try append(alloc, v1, fewer)) == null);
+
+    // everything changed
+    const other = try test_pdf(alloc, &.{ "<</Type/Catalog/X 1>>", "<</Y 2>>", page_b, page_a }, "<00><11>");
+    defer alloc.free(other);
+    try testing.expect((try append(alloc, v1, other)) == null);
+
+    // not a PDF with an xref table
+    try testing.expect((try append(alloc, "%PDF-1.5\nstartxref\n9\n%%EOF\n", v1)) == null);
+}
+
+test "trailer tokens" {
+    var entries: [max_trailer_entries]Entry = undefined;
+    const got = dict_entries("<</Size 12/Root 1 0 R/ID[(a\\)>>]b)<ff>]/Prev 345>>", &entries).?;
+    try testing.expectEqual(@as(usize, 4), got.len);
+    try testing.expectEqualStrings("1 0 R", got[1].value);
+    try testing.expectEqualStrings("[(a\\)>>]b)<ff>]", got[2].value);
+    try testing.expectEqualStrings("345", entry_value("<</Size 12/Prev 345>>", "Prev").?);
+}
@@ -0,0 +1,373 @@
+// Preamble.zig -- scan a TeX source for the classes and packages it loads.
+//
+// A cheap textual scan, not a TeX parser: it finds \documentclass,
+// \LoadClass, \usepackage and \RequirePackage up to \begin{document},
+// skipping % comments and [options]. Good enough to key and seed bundle
+// prefetches; anything it misses is still fetched on open.
+//
+// dumpable and dump_driver decide whether a preamble can be dumped into a
+// format of its own and write the TeX that does it. includes lists the
+// parts a document \include's, for a preview of only one of them.
+//
+// Self-contained (std only) so it can be shared by native and WASM paths.
+
+const std = @import("std");
+
+pub const Kind = enum { class, package };
+
+pub const Item = struct {
+    kind: Kind,
+    name: []const u8,
+};
+
+const commands = [_]struct { name: []const u8, kind: Kind }{
+    .{ .name = "documentclass", .kind = .class },
+    .{ .name = "LoadClass", .kind = .class },
+    .{ .name = "usepackage", .kind = .package },
+    .{ .name = "RequirePackage", .kind = .package },
+};
+
+pub const Iterator = struct {
+    src: []const u8,
+    pos: usize = 0,
+    // remaining {a,b,c} argument of the current command
+    list: []const u8 = &.{},
+    list_pos: usize = 0,
+    kind: Kind = .package,
+
+    pub fn next(self: *Iterator) ?Item {
+        while (true) {
+            if (self.next_in_list()) |name| return .{ .kind = self.kind, .name = name };
+            if (!self.next_command()) return null;
+        }
+    }
+
+    fn next_in_list(self: *Iterator) ?[]const u8 {
+        const l = self.list;
+        var i = self.list_pos;
+        while (i < l.len) {
+            switch (l[i]) {
+                ',', ' ', '\t', '\r', '\n' => i += 1,
+                '%' => i = line_end(l, i),
+                else => {
+                    const start = i;
+                    while (i < l.len and !is_list_delim(l[i])) i += 1;
+                    self.list_pos = i;
+                    return l[start..i];
+                },
+            }
+        }
+        self.list_pos = i;
+        return null;
+    }
+
+    // advance to the next class/package command and load its argument list
+    fn next_command(self: *Iterator) bool {
+        const s = self.src;
+        while (self.pos < s.len) {
+            const c = s[self.pos];
+            if (c == '%') {
+                self.pos = line_end(s, self.pos);
+                continue;
+            }
+            if (c != '\\') {
+                self.pos += 1;
+                continue;
+            }
+            const word_start = self.pos + 1;
+            var i = word_start;
+            while (i < s.len and std.ascii.isAlphabetic(s[i])) i += 1;
+            const word = s[word_start..i];
+            self.pos = @max(i, word_start + 1);
+
+            if (std.mem.eql(u8, word, "begin") and std.mem.startsWith(u8, skip_space(s, i), "{document}")) {
+                self.pos = s.len;
+                return false;
+            }
+            for (commands) |cmd| {
+                if (!std.mem.eql(u8, word, cmd.name)) continue;
+                const arg = self.read_argument(i) orelse break;
+                self.kind = cmd.kind;
+                self.list = arg;
+                self.list_pos = 0;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // skip optional [...] and return the contents of the following {...}
+    fn read_argument(self: *Iterator, from: usize) ?[]const u8 {
+        const s = self.src;
+        var i = s.len - skip_space(s, from).len;
+        if (i < s.len and s[i] == '[') {
+            const close = std.mem.indexOfScalarPos(u8, s, i, ']') orelse return null;
+            i = s.len - skip_space(s, close + 1).len;
+        }
+        if (i >= s.len or s[i] != '{') return null;
+        const close = std.mem.indexOfScalarPos(u8, s, i + 1, '}') orelse return null;
+        self.pos = close + 1;
+        return s[i + 1 .. close];
+    }
+};
+
+pub fn iterate(src: []const u8) Iterator {
+    return .{ .src = src };
+}
+
+// order-insensitive hash of the format and the loaded classes and packages,
+// identifying documents that open (roughly) the same bundle files.
+pub fn key(format_name: []const u8, src: []const u8) u64 {
+    var sum: u64 = 0;
+    var it = iterate(src);
+    while (it.next()) |item| {
+        sum +%= std.hash.Wyhash.hash(@intFromEnum(item.kind), item.name);
+    }
+    return std.hash.Wyhash.hash(sum, format_name);
+}
+
+// control words a preamble format cannot keep: they read or write files that
+// change independently of the preamble, or capture the dump run's state
+const undumpable = [_][]const u8{
+    "input",           "include",          "InputIfFileExists", "IfFileExists",
+    "openout",         "immediate",        "jobname",           "DocumentMetadata",
+    "makeindex",       "makeglossaries",   "makenomenclature",  "loadglsentries",
+    "externaldocument", "tikzexternalize", "subfile",           "import",
+};
+
+// the preamble of src, everything before its \begin{document}, when it can be
+// dumped into a format of its own (see dump_driver): it starts with
+// \documentclass, ends at a top-level \begin{document} and reads no files
+// besides the classes and packages it loads. null otherwise.
+pub fn dumpable(src: []const u8) ?[]const u8 {
+    var i = skip_space_and_comments(src, 0);
+    if (!std.mem.startsWith(u8, src[i..], "\\documentclass")) return null;
+    var depth: usize = 0;
+    while (i < src.len) {
+        switch (src[i]) {
+            '%' => i = line_end(src, i),
+            '{' => {
+                depth += 1;
+                i += 1;
+            },
+            '}' => {
+                if (depth == 0) return null;
+                depth -= 1;
+                i += 1;
+            },
+            '\\' => {
+                const word_start = i + 1;
+                var j = word_start;
+                while (j < src.len and std.ascii.isAlphabetic(src[j])) j += 1;
+                const word = src[word_start..j];
+                if (word.len == 0) {
+                    // control symbol: \% \{ \} and friends do not count
+                    i = @min(j + 1, src.len);
+                    continue;
+                }
+                if (std.mem.eql(u8, word, "begin")) {
+                    const rest = skip_space(src, j);
+                    if (depth == 0 and std.mem.startsWith(u8, rest, "{document}")) return src[0..i];
+                    if (std.mem.startsWith(u8, rest, "{filecontents")) return null;
+                }
+                for (undumpable) |blocked| {
+                    if (std.mem.eql(u8, word, blocked)) return null;
+                }
+                i = j;
+            },
+            else => i += 1,
+        }
+    }
+    return null;
+}
+
+// TeX source for the initex run that dumps a preamble. it runs on top of the
+// format under the document's jobname, reads the document and dumps on
+// reaching \begin{document}. in the dumped format \documentclass skips
+// everything up to \begin{document}, so a run of the same document goes
+// straight to the body.
+pub fn dump_driver(allocator: std.mem.Allocator, input_path: []const u8) ![]u8 {
+    if (std.mem.indexOfScalar(u8, input_path, '"') != null) return error.UnsupportedPath;
+    return std.fmt.allocPrint(allocator,
+        \\\catcode`\@=11
+        \\\let\eztex@begin\begin
+        \\\def\eztex@document{{document}}
+        \\\protected\def\begin#1{{\def\eztex@env{{#1}}\ifx\eztex@env\eztex@document
+        \\  \expandafter\eztex@dump\else\expandafter\eztex@begin\fi{{#1}}}}
+        \\\def\eztex@dump#1{{\let\begin\eztex@begin
+        \\  \let\eztex@documentclass\documentclass\let\documentclass\eztex@skip
+        \\  \primitive\dump}}
+        \\\long\def\eztex@skip#1\begin#2{{\def\eztex@env{{#2}}\ifx\eztex@env\eztex@document
+        \\  \expandafter\eztex@resume\else\expandafter\eztex@skip\fi}}
+        \\\def\eztex@resume{{\let\documentclass\eztex@documentclass\begin{{document}}}}
+        \\\catcode`\@=12
+        \\\csname @@input\endcsname "{s}"
+        \\
+    , .{input_path});
+}
+
+// the parts src reads with \include{name}, in order, for \includeonly.
+// textual like the rest: % comments are skipped, macros are not expanded
+pub const Includes = struct {
+    src: []const u8,
+    pos: usize = 0,
+
+    pub fn next(self: *Includes) ?[]const u8 {
+        const src = self.src;
+        while (self.pos < src.len) {
+            switch (src[self.pos]) {
+                '%' => self.pos = line_end(src, self.pos),
+                '\\' => {
+                    const word_start = self.pos + 1;
+                    var j = word_start;
+                    while (j < src.len and std.ascii.isAlphabetic(src[j])) j += 1;
+                    // control symbol: \% and friends
+                    self.pos = if (j == word_start) @min(j + 1, src.len) else j;
+                    if (!std.mem.eql(u8, src[word_start..j], "include")) continue;
+                    const rest = skip_space(src, j);
+                    if (!std.mem.startsWith(u8, rest, "{")) continue;
+                    const close = std.mem.indexOfScalar(u8, rest, '}') orelse return null;
+                    self.pos = src.len - rest.len + close + 1;
+                    const name = std.mem.trim(u8, rest[1..close], " \t\r\n");
+                    if (name.len > 0) return name;
+                },
+                else => self.pos += 1,
+            }
+        }
+        return null;
+    }
+};
+
+pub fn includes(src: []const u8) Includes {
+    return .{ .src = src };
+}
+
+fn skip_space_and_comments(s: []const u8, from: usize) usize {
+    var i = from;
+    while (i < s.len) {
+        if (s[i] == '%') {
+            i = line_end(s, i);
+        } else if (std.ascii.isWhitespace(s[i])) {
+            i += 1;
+        } else break;
+    }
+    return i;
+}
+
+fn is_list_delim(c: u8) bool {
+    return c == ',' or c == '%' or std.ascii.isWhitespace(c);
+}
+
+fn line_end(s: []const u8, from: usize) usize {
+    return if (std.mem.indexOfScalarPos(u8, s, from, '\n')) |nl| nl + 1 else s.len;
+}
+
+fn skip_space(s: []const u8, from: usize) []const u8 {
+    var i = from;
+    while (i < s.len and std.ascii.isWhitespace(s[i])) i += 1;
+    return s[i..];
+}
+
+// -- tests --
+
+fn expect_items(src: []const u8, expected: []const Item) !void {
+    var it = iterate(src);
+    for (expected) |want| {
+        const got = it.next() orelse return error.TestUnexpectedEnd;
+        try std.testing.expectEqual(want.kind, got.kind);
+        try std.testing.expectEqualStrings(want.name, got.name);
+    }
+    try std.testing.expect(it.next() == null);
+}
+
+test "scan classes and packages up to begin document" {
+    try expect_items(
+        \\\documentclass[11pt,a4paper]{article}
+        \\% \usepackage{commented}
+        \\\usepackage[utf8]{inputenc}
+        \\\usepackage{amsmath, amssymb,% trailing comment
+        \\  graphicx}
+        \\\usepackage {tikz} % spaced
+        \\\newcommand{\foo}{bar}
+        \\\begin {document}
+        \\\usepackage{late}
+    , &.{
+        .{ .kind = .class, .name = "article" },
+        .{ .kind = .package, .name = "inputenc" },
+        .{ .kind = .package, .name = "amsmath" },
+        .{ .kind = .package, .name = "amssymb" },
+        .{ .kind = .package, .name = "graphicx" },
+        .{ .kind = .package, .name = "tikz" },
+    });
+}
+
+test "scan package files" {
+    try expect_items(
+        \\\NeedsTeXFormat{LaTeX2e}
+        \\\LoadClass[a4paper]{report}
+        \\\RequirePackage{kvoptions}\RequirePackage[x]{geometry}
+        \\\usepackage[unterminated
+    , &.{
+        .{ .kind = .class, .name = "report" },
+        .{ .kind = .package, .name = "kvoptions" },
+        .{ .kind = .package, .name = "geometry" },
+    });
+}
+
+test "key ignores order and the document body" {
+    const a = "\\documentclass{article}\\usepackage{a}\\usepackage{b}\\begin{document}x";
+    const b = "\\documentclass{article}\n\\usepackage{b,a}\n\\begin{document}y";
+    const c = "\\documentclass{beamer}\\usepackage{a}\\usepackage{b}";
+    try std.testing.expectEqual(key("latex", a), key("latex", b));
+    try std.testing.expect(key("latex", a) != key("latex", c));
+    try std.testing.expect(key("latex", a) != key("plain", a));
+}
+
+test "dumpable preamble ends at begin document" {
+    const src =
+        \\% leading comment
+        \\\documentclass{article}
+        \\\usepackage{amsmath} % \input{commented}
+        \\\newcommand{\env}{\begin{document}}
+        \\\newcommand{\pct}{\%}
+        \\\begin{document}
+        \\\input{body}
+    ;
+    const preamble = dumpable(src).?;
+    try std.testing.expect(std.mem.endsWith(u8, preamble, "\\newcommand{\\pct}{\\%}\n"));
+}
+
+test "preambles that read files or lack documentclass are not dumpable" {
+    try std.testing.expect(dumpable("\\documentclass{article}\\input{macros}\\begin{document}") == null);
+    try std.testing.expect(dumpable("\\documentclass{article}\\makeindex\\begin{document}") == null);
+    try std.testing.expect(dumpable("\\documentclass{article}\\begin{filecontents}{x}\\end{filecontents}\\begin{document}") == null);
+    try std.testing.expect(dumpable("\\RequirePackage{fix-cm}\\documentclass{article}\\begin{document}") == null);
+    try std.testing.expect(dumpable("\\documentclass{article}\\usepackage{amsmath}") == null);
+    try std.testing.expect(dumpable("\\documentclass{article}{\\begin{document}") == null);
+    // longer words starting with a blocked one are fine
+    try std.testing.expect(dumpable("\\documentclass{article}\\graphicspath{{img/}}\\newcommand{\\logo}{\\includegraphics{logo}}\\begin{document}") != null);
+}
+
+test "dump driver reads the document" {
+    const driver = try dump_driver(std.testing.allocator, "dir/main.tex");
+    defer std.testing.allocator.free(driver);
+    try std.testing.expect(std.mem.endsWith(u8, driver, "\\csname @@input\\endcsname \"dir/main.tex\"\n"));
+    try std.testing.expectError(error.UnsupportedPath, dump_driver(std.testing.allocator, "a\"b.tex"));
+}
+
+test "includes lists the parts a document includes" {
+    var it = includes(
+        \\\documentclass{book}
+        \\\includeonly{ch2}
+        \\\begin{document}
+        \\\include{chapters/ch1}
+        \\% \include{draft}
+        \\\include { ch2 }\input{appendix}\includegraphics{fig}
+        \\50\% \include{ch3}
+        \\\end{document}
+    );
+    try std.testing.expectEqualStrings("chapters/ch1", it.next().?);
+    try std.testing.expectEqualStrings("ch2", it.next().?);
+    try std.testing.expectEqualStrings("ch3", it.next().?);
+    try std.testing.expect(it.next() == null);
+}
@@ -2,6 +2,7 @@
 //
 // Detects whether input is a directory, zip, or plain .tex file.
 // For directories/zips: scans for main .tex using MainDetect heuristics.
+// A zip is not extracted: its members are served from the archive.
 
 const Project = @This();
 const std = @import("std");
@@ -10,21 +11,27 @@ const Io = std.Io;
 const fs_path = std.fs.path;
 const Log = @import("Log.zig");
 const MainDetect = @import("MainDetect.zig");
+const ZipArchive = @import("ZipArchive.zig");
 
 pub const ProjectInput = struct {
     // resolved .tex file path to compile
     tex_file: []const u8,
     // directory to chdir into before compiling (for project mode)
     project_dir: ?[]const u8 = null,
-    // temp directory to clean up after compile (for zip mode)
-    temp_dir: ?[]const u8 = null,
+    // zip mode: the project's files are read from the archive, without
+    // extracting it (see World.archive); tex_file names a member
+    archive: ?*ZipArchive = null,
     // original cwd to restore after project mode compile
     original_cwd: ?Io.Dir = null,
+
+    pub fn deinit(self: *const ProjectInput) void {
+        if (self.archive) |archive| archive.destroy();
+    }
 };
 
 // detect whether input is a directory, zip file, or plain .tex file.
 // for directories: scan for main .tex file using heuristics.
-// for zip files: extract to temp dir, then scan for main .tex file.
+// for zip files: index the archive, then scan it for the main .tex file.
 // returns resolved ProjectInput or null on error.
 pub fn resolve_project_input(io: Io, alloc: std.mem.Allocator, input: []const u8, verbose: bool) ?ProjectInput {
     _ = verbose;
@@ -77,21 +84,7 @@ fn resolve_directory_project(io: Io, alloc: std.mem.Allocator, dir_path: []const
         return null;
     }
 
-    const Ctx = struct {
-        io: Io,
-        dir: Io.Dir,
-        fn read_file(ctx: ?*anyopaque, name: []const u8) ?[]const u8 {
-            const self: *@This() = @ptrCast(@alignCast(ctx.?));
-            const file = self.dir.openFile(self.io, name, .{}) catch return null;
-            defer file.close(self.io);
-            var read_buf: [4096]u8 = undefined;
-            var reader = Io.File.Reader.init(file, self.io, &read_buf);
-            return reader.interface.allocRemaining(std.heap.c_allocator, .limited(4096)) catch null;
-        }
-    };
-    var ctx = Ctx{ .io = io, .dir = dir };
-
-    const main_file = MainDetect.detect(alloc, files.items, &ctx, Ctx.read_file) orelse {
+    const main_file = detect_in_dir(io, alloc, dir, dir_path, files.items) orelse {
         Log.log(io, "eztex", .err, "no main .tex file found in '{s}'", .{dir_path});
         return null;
     };
@@ -110,74 +103,150 @@ fn resolve_directory_project(io: Io, alloc: std.mem.Allocator, dir_path: []const
     };
 }
 
-fn resolve_zip_project(io: Io, alloc: std.mem.Allocator, zip_path: []const u8) ?ProjectInput {
-    Log.dbg(io, "eztex", "project mode: extracting zip '{s}'", .{zip_path});
+// -- main file detection for directories --
 
-    const tmp_dir_path = "tmp/zip_extract";
-    Io.Dir.cwd().deleteTree(io, tmp_dir_path) catch {};
-    Io.Dir.cwd().createDirPath(io, tmp_dir_path) catch |err| {
-        Log.log(io, "eztex", .err, "cannot create temp directory: {}", .{err});
-        return null;
-    };
+// the main file found for a directory, keyed by listing_key: a server or a
+// batch run resolving the same project again skips the scan. names are owned
+// (c_allocator); dropped wholesale past detect_cache_max entries.
+var detect_cache: std.AutoHashMapUnmanaged(u64, []const u8) = .empty;
+const detect_cache_max = 64;
 
-    const zip_file = Io.Dir.cwd().openFile(io, zip_path, .{}) catch |err| {
-        Log.log(io, "eztex", .err, "cannot open zip file '{s}': {}", .{ zip_path, err });
-        return null;
-    };
-    defer zip_file.close(io);
+// below this many candidates, threads cost more than the reads they save
+const parallel_scan_min = 16;
+const max_scan_threads = 8;
 
-    var dest_dir = Io.Dir.cwd().openDir(io, tmp_dir_path, .{ .iterate = true }) catch |err| {
-        Log.log(io, "eztex", .err, "cannot open temp directory: {}", .{err});
-        return null;
-    };
-    defer dest_dir.close(io);
+fn by_name(_: void, a: []const u8, b: []const u8) bool {
+    return std.mem.order(u8, a, b) == .lt;
+}
 
-    var read_buf: [64 * 1024]u8 = undefined;
-    var file_reader = Io.File.Reader.init(zip_file, io, &read_buf);
-    std.zip.extract(dest_dir, &file_reader, .{}) catch |err| {
-        Log.log(io, "eztex", .err, "zip extraction failed: {}", .{err});
-        return null;
+// the directory, its root .tex files and their mtimes: what the outcome of
+// MainDetect depends on, short of the files' contents
+fn listing_key(io: Io, dir: Io.Dir, dir_path: []const u8, tex_files: []const []const u8) u64 {
+    var h = std.hash.Wyhash.init(0);
+    h.update(dir_path);
+    for (tex_files) |name| {
+        const mtime: i128 = if (dir.statFile(io, name, .{})) |st| st.mtime.nanoseconds else |_| 0;
+        h.update(&.{0});
+        h.update(name);
+        h.update(std.mem.asBytes(&mtime));
+    }
+    return h.final();
+}
+
+// whether name has \documentclass in its first MainDetect.preamble_len bytes
+fn preamble_has_documentclass(io: Io, dir: Io.Dir, name: []const u8) bool {
+    const file = dir.openFile(io, name, .{}) catch return false;
+    defer file.close(io);
+    var buf: [MainDetect.preamble_len]u8 = undefined;
+    const n = file.readPositionalAll(io, &buf, 0) catch return false;
+    return MainDetect.has_documentclass(buf[0..n]);
+}
+
+// mark which files have \documentclass in their preamble, reading the root
+// .tex files on up to max_scan_threads threads when there are many of them
+fn scan_preambles(io: Io, dir: Io.Dir, files: []const []const u8, marks: []bool) void {
+    const Scan = struct {
+        io: Io,
+        dir: Io.Dir,
+        files: []const []const u8,
+        marks: []bool,
+        next: std.atomic.Value(usize) = .init(0),
+
+        fn run(self: *@This()) void {
+            while (true) {
+                const i = self.next.fetchAdd(1, .monotonic);
+                if (i >= self.files.len) break;
+                const f = self.files[i];
+                self.marks[i] = MainDetect.is_root_tex(f) and preamble_has_documentclass(self.io, self.dir, f);
+            }
+        }
     };
+    var scan: Scan = .{ .io = io, .dir = dir, .files = files, .marks = marks };
+
+    var candidates: usize = 0;
+    for (files) |f| candidates += @intFromBool(MainDetect.is_root_tex(f));
+    var threads: [max_scan_threads]?std.Thread = @splat(null);
+    const thread_count = if (candidates < parallel_scan_min) 0 else @min(max_scan_threads, candidates / parallel_scan_min + 1);
+    for (threads[0..thread_count]) |*t| t.* = std.Thread.spawn(.{}, Scan.run, .{&scan}) catch null;
+    // this thread takes part too, and finishes alone if none could start
+    scan.run();
+    for (threads[0..thread_count]) |t| if (t) |thread| thread.join();
+}
 
-    Log.dbg(io, "eztex", "zip extracted to '{s}'", .{tmp_dir_path});
+fn detect_in_dir(io: Io, alloc: std.mem.Allocator, dir: Io.Dir, dir_path: []const u8, files: [][]const u8) ?[]const u8 {
+    // a stable order, so the same listing gives the same key and answer
+    std.mem.sort([]const u8, files, {}, by_name);
 
-    var files: std.ArrayList([]const u8) = .empty;
-    defer {
-        for (files.items) |f| alloc.free(f);
-        files.deinit(alloc);
+    var tex_files: std.ArrayList([]const u8) = .empty;
+    defer tex_files.deinit(alloc);
+    for (files) |f| {
+        if (MainDetect.is_root_tex(f)) tex_files.append(alloc, f) catch return null;
     }
+    if (tex_files.items.len <= 1) return MainDetect.detect_marked(alloc, files, null);
 
-    var dir_iter = dest_dir.iterate();
-    while (dir_iter.next(io) catch null) |entry| {
-        if (entry.kind != .file and entry.kind != .sym_link) continue;
-        const name = alloc.dupe(u8, entry.name) catch continue;
-        files.append(alloc, name) catch {
-            alloc.free(name);
-            continue;
-        };
+    const key = listing_key(io, dir, dir_path, tex_files.items);
+    if (detect_cache.get(key)) |cached| {
+        Log.dbg(io, "eztex", "project mode: main file of '{s}' known from an earlier scan", .{dir_path});
+        return cached;
     }
 
-    if (files.items.len == 0) {
+    const marks = alloc.alloc(bool, files.len) catch return null;
+    defer alloc.free(marks);
+    scan_preambles(io, dir, files, marks);
+    const main_file = MainDetect.detect_marked(alloc, files, marks) orelse return null;
+
+    if (detect_cache.count() >= detect_cache_max) {
+        var it = detect_cache.valueIterator();
+        while (it.next()) |v| std.heap.c_allocator.free(v.*);
+        detect_cache.clearRetainingCapacity();
+    }
+    const owned = std.heap.c_allocator.dupe(u8, main_file) catch return main_file;
+    detect_cache.put(std.heap.c_allocator, key, owned) catch {
+        std.heap.c_allocator.free(owned);
+        return main_file;
+    };
+    return owned;
+}
+
+fn resolve_zip_project(io: Io, alloc: std.mem.Allocator, zip_path: []const u8) ?ProjectInput {
+    Log.dbg(io, "eztex", "project mode: indexing zip '{s}'", .{zip_path});
+
+    const archive = ZipArchive.open(io, zip_path) catch |err| {
+        Log.log(io, "eztex", .err, "cannot read zip file '{s}': {}", .{ zip_path, err });
+        return null;
+    };
+    var keep = false;
+    defer if (!keep) archive.destroy();
+
+    if (archive.names().len == 0) {
         Log.log(io, "eztex", .err, "zip file '{s}' contains no files", .{zip_path});
         return null;
     }
 
-    const main_file = MainDetect.detect(alloc, files.items, null, null) orelse {
-        Log.log(io, "eztex", .err, "no main .tex file found in zip '{s}'", .{zip_path});
-        return null;
+    // MainDetect peeks at candidates; what it reads is dropped with the arena
+    var arena: std.heap.ArenaAllocator = .init(std.heap.c_allocator);
+    defer arena.deinit();
+    const Ctx = struct {
+        archive: *ZipArchive,
+        arena: std.mem.Allocator,
+        fn read_file(ctx: ?*anyopaque, name: []const u8) ?[]const u8 {
+            const self: *@This() = @ptrCast(@alignCast(ctx.?));
+            const data = (self.archive.read_alloc(self.arena, name) catch return null) orelse return null;
+            return data[0..@min(data.len, 4096)];
+        }
     };
+    var ctx = Ctx{ .archive = archive, .arena = arena.allocator() };
 
-    var path_buf: [1024]u8 = undefined;
-    const full_path = std.fmt.bufPrint(&path_buf, "{s}/{s}", .{ tmp_dir_path, main_file }) catch {
-        Log.log(io, "eztex", .err, "path too long", .{});
+    const main_file = MainDetect.detect(alloc, archive.names(), &ctx, Ctx.read_file) orelse {
+        Log.log(io, "eztex", .err, "no main .tex file found in zip '{s}'", .{zip_path});
         return null;
     };
-    const result_path = alloc.dupe(u8, full_path) catch return null;
 
     Log.log(io, "eztex", .info, "project mode: detected main file '{s}' from zip", .{main_file});
+    keep = true;
     return ProjectInput{
-        .tex_file = result_path,
-        .project_dir = tmp_dir_path,
-        .temp_dir = tmp_dir_path,
+        .tex_file = main_file,
+        .project_dir = fs_path.dirname(zip_path) orelse ".",
+        .archive = archive,
     };
 }
@@ -0,0 +1,100 @@
+// RemoteCache.zig -- compile outputs shared between machines, for CI.
+//
+// The manifest beside a PDF (see compile/memo.zig) saves a compile when
+// nothing changed since this machine wrote that PDF. This takes the same
+// idea to a store every runner can reach, set up in eztex.zon:
+//
+//   .remote_cache = .{ .url = "https://cache.example.com/eztex" },
+//
+// with EZTEX_CACHE_TOKEN, when set, sent as a bearer token (see
+// Host.remote_get). Two kinds of object live under the URL:
+//
+//   manifests/<key>     the memo manifest of the last compile under key
+//                       (engine, format, options; see Compiler.memo_key)
+//   results/<digest>    that compile's outputs as a memo pack, under
+//                       memo.result_digest: key, and each input as it read
+//
+// A compile fetches the manifest for its key, digests the files it lists as
+// they read here, and asks for the result under that digest. The same
+// document compiled from the same files, on another branch or runner, has
+// left its outputs there. Whatever is missing or out of reach is a miss,
+// and the compile runs as it would without the cache.
+
+const std = @import("std");
+const Io = std.Io;
+const Config = @import("Config.zig");
+const Host = @import("Host.zig");
+const Log = @import("Log.zig");
+const memo = @import("compile/memo.zig");
+
+const RemoteCache = @This();
+
+url: []const u8,
+token: ?[]const u8,
+push: bool,
+
+const alloc = std.heap.c_allocator;
+
+// the cache eztex.zon sets up, if any
+pub fn from_config(config: ?Config) ?RemoteCache {
+    const c = config orelse return null;
+    const r = c.remote_cache orelse return null;
+    const url = r.url orelse return null;
+    const token: ?[]const u8 = if (std.c.getenv("EZTEX_CACHE_TOKEN")) |t| std.mem.span(t) else null;
+    return .{
+        .url = std.mem.trimEnd(u8, url, "/"),
+        .token = token,
+        .push = r.push orelse true,
+    };
+}
+
+fn object_url(self: *const RemoteCache, buf: []u8, kind: []const u8, digest: *const [32]u8) ?[]const u8 {
+    return std.fmt.bufPrint(buf, "{s}/{s}/{s}", .{ self.url, kind, &std.fmt.bytesToHex(digest.*, .lower) }) catch null;
+}
+
+pub const Hit = struct {
+    manifest: []u8,
+    pack: []u8,
+
+    pub fn deinit(self: Hit) void {
+        alloc.free(self.manifest);
+        alloc.free(self.pack);
+    }
+};
+
+// the manifest and outputs of a compile of these very files under key
+pub fn fetch(self: *const RemoteCache, io: Io, key: *const memo.Key) ?Hit {
+    var url_buf: [2048]u8 = undefined;
+    const manifest_url = self.object_url(&url_buf, "manifests", key) orelse return null;
+    const manifest = Host.remote_get(manifest_url, self.token, alloc) orelse return null;
+
+    const digest = memo.result_digest(io, key, manifest);
+    const result_url = self.object_url(&url_buf, "results", &digest) orelse {
+        alloc.free(manifest);
+        return null;
+    };
+    const pack = Host.remote_get(result_url, self.token, alloc) orelse {
+        Log.dbg(io, "remote", "no outputs for these inputs under {s}", .{result_url});
+        alloc.free(manifest);
+        return null;
+    };
+    return .{ .manifest = manifest, .pack = pack };
+}
+
+// upload a compile's manifest and its packed outputs. the result goes
+// first, so a manifest on the store always has something to point to
+pub fn store(self: *const RemoteCache, io: Io, key: *const memo.Key, manifest: []const u8, pack: []const u8) void {
+    var url_buf: [2048]u8 = undefined;
+    const digest = memo.result_digest(io, key, manifest);
+    const result_url = self.object_url(&url_buf, "results", &digest) orelse return;
+    if (!Host.remote_put(result_url, self.token, pack)) {
+        Log.log(io, "eztex", .warn, "could not upload outputs to the remote cache", .{});
+        return;
+    }
+    const manifest_url = self.object_url(&url_buf, "manifests", key) orelse return;
+    if (!Host.remote_put(manifest_url, self.token, manifest)) {
+        Log.log(io, "eztex", .warn, "could not upload the input manifest to the remote cache", .{});
+        return;
+    }
+    Log.dbg(io, "remote", "uploaded {d} bytes of outputs", .{pack.len});
+}
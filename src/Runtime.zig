@@ -10,6 +10,12 @@
 //   3. All engine operations run.
 //   4. rt.deactivate() clears the pointer.
 //   5. Runtime goes out of scope.
+//
+// `instance` is per thread, like the engines' own C globals
+// (TTBC_THREAD_LOCAL) and the layout and format state, so threads that
+// each activate their own Runtime can compile concurrently. They still
+// share the process working directory, which relative inputs and outputs
+// resolve against.
 
 const std = @import("std");
 const Io = std.Io;
@@ -19,11 +25,12 @@ const EngineApi = @import("EngineInterface.zig");
 
 const Runtime = @This();
 
-// the active runtime instance, dereferenced by C ABI bridge functions.
-pub var instance: ?*Runtime = null;
+// the calling thread's active runtime, dereferenced by C ABI bridge functions.
+pub threadlocal var instance: ?*Runtime = null;
 
 pub const CheckpointCallback = struct {
-    func: *const fn (userdata: ?*anyopaque, id: c_int) void,
+    // detail names what the stage works on (a page, a file), if anything
+    func: *const fn (userdata: ?*anyopaque, id: c_int, detail: ?[*:0]const u8) void,
     userdata: ?*anyopaque,
 };
 
@@ -33,6 +40,9 @@ bundle_store: BundleStore,
 active_engine: ?EngineApi.Engine,
 diag_handler: ?World.DiagnosticHandler,
 checkpoint_handler: ?CheckpointCallback,
+// set by `eztex serve`, batch and watch mode: the bundle store (and its
+// index) outlives each compile instead of being torn down with it
+resident: bool,
 
 pub fn init(io: Io) Runtime {
     return .{
@@ -46,6 +56,7 @@ pub fn init(io: Io) Runtime {
         .active_engine = null,
         .diag_handler = null,
         .checkpoint_handler = null,
+        .resident = false,
     };
 }
 
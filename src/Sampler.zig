@@ -0,0 +1,184 @@
+// Sampler.zig -- `-Dsampling=true`: which lines of the document a compile
+// spends its time on, for builds where a profiler sees only anonymous WASM.
+//
+// XeTeX reports where it is reading ("<file>:<line>") every so many macro
+// calls through the TTBC_CHECKPOINT_SAMPLE checkpoint (see
+// profile_sample in xetex-profile.c). Each report is charged the time since
+// the one before, under the engine phase at that moment: format load,
+// typesetting, ship_out, or a phase Zig names (bibtex, xdvipdfmx) whose time
+// has no line to go to. At the end the heaviest places are logged as a
+// histogram. Nothing is recorded unless start was called.
+
+const std = @import("std");
+const Io = std.Io;
+
+// as TTBC_CHECKPOINT_* in tectonic_bridge_core.h
+const checkpoint_format_loaded = 1;
+const checkpoint_format_load_begin = 2;
+const checkpoint_shipout_begin = 3;
+const checkpoint_shipout_end = 4;
+pub const checkpoint_sample = 10;
+
+// macro calls between samples: often enough for a line to stand out, rarely
+// enough that formatting the place costs nothing measurable
+pub const default_interval = 4096;
+
+const alloc = std.heap.c_allocator;
+
+const State = struct {
+    // "<phase>\t<place>" -> nanoseconds charged; keys are owned
+    charged: std.StringHashMapUnmanaged(u64) = .empty,
+    phase: []const u8 = "typesetting",
+    place: [256]u8 = undefined,
+    place_len: usize = 0,
+    last_ns: i128,
+    samples: u64 = 0,
+};
+
+// engine state is per thread (see TTBC_THREAD_LOCAL), and so is its profile
+threadlocal var state: ?State = null;
+
+fn clock_ns() i128 {
+    return std.time.nanoTimestamp();
+}
+
+// start sampling, dropping anything recorded before
+pub fn start() void {
+    discard();
+    state = .{ .last_ns = clock_ns() };
+}
+
+pub fn enabled() bool {
+    return state != null;
+}
+
+// charge the time since the last charge to the current phase and place
+fn charge(s: *State, t: i128) void {
+    const elapsed: u64 = @intCast(@max(t - s.last_ns, 0));
+    s.last_ns = t;
+    if (elapsed == 0) return;
+
+    var key_buf: [320]u8 = undefined;
+    const key = std.fmt.bufPrint(&key_buf, "{s}\t{s}", .{ s.phase, s.place[0..s.place_len] }) catch return;
+    if (s.charged.getPtr(key)) |ns| {
+        ns.* += elapsed;
+        return;
+    }
+    const owned = alloc.dupe(u8, key) catch return;
+    s.charged.put(alloc, owned, elapsed) catch alloc.free(owned);
+}
+
+fn set_place(s: *State, place: []const u8) void {
+    const n = @min(place.len, s.place.len);
+    @memcpy(s.place[0..n], place[0..n]);
+    s.place_len = n;
+}
+
+// a phase the engine does not report itself; phase is a static string
+pub fn set_phase(phase: []const u8) void {
+    const s = if (state) |*s| s else return;
+    charge(s, clock_ns());
+    s.phase = phase;
+    s.place_len = 0;
+}
+
+// the checkpoint callback's share: samples and the engine's phases
+pub fn checkpoint(id: c_int, detail_z: ?[*:0]const u8) void {
+    const s = if (state) |*s| s else return;
+    switch (id) {
+        checkpoint_sample => {
+            const place = if (detail_z) |d| std.mem.span(d) else "";
+            set_place(s, place);
+            charge(s, clock_ns());
+            s.samples += 1;
+        },
+        checkpoint_format_load_begin, checkpoint_format_loaded, checkpoint_shipout_begin, checkpoint_shipout_end => {
+            charge(s, clock_ns());
+            s.phase = switch (id) {
+                checkpoint_format_load_begin => "format load",
+                checkpoint_shipout_begin => "ship_out",
+                else => "typesetting",
+            };
+        },
+        else => {},
+    }
+}
+
+const Entry = struct {
+    key: []const u8,
+    ns: u64,
+
+    fn heavier(_: void, a: Entry, b: Entry) bool {
+        return a.ns > b.ns;
+    }
+};
+
+// the `top` heaviest places, one line each, most first:
+//   "  41.5%    812 ms  typesetting  tikzlibrarydecorations.code.tex:94"
+pub fn write_report(w: *Io.Writer, top: usize) !void {
+    const s = if (state) |*s| s else return;
+    charge(s, clock_ns());
+
+    var entries: std.ArrayList(Entry) = .empty;
+    defer entries.deinit(alloc);
+    var total: u64 = 0;
+    var it = s.charged.iterator();
+    while (it.next()) |e| {
+        try entries.append(alloc, .{ .key = e.key_ptr.*, .ns = e.value_ptr.* });
+        total += e.value_ptr.*;
+    }
+    std.mem.sort(Entry, entries.items, {}, Entry.heavier);
+
+    try w.print("sampling profile: {d} samples over {d} ms\n", .{ s.samples, total / std.time.ns_per_ms });
+    for (entries.items[0..@min(top, entries.items.len)]) |e| {
+        const tab = std.mem.indexOfScalar(u8, e.key, '\t') orelse e.key.len;
+        const place = if (tab < e.key.len) e.key[tab + 1 ..] else "";
+        const pct = @as(f64, @floatFromInt(e.ns)) * 100 / @as(f64, @floatFromInt(@max(total, 1)));
+        try w.print("  {d:>5.1}% {d:>6} ms  {s}  {s}\n", .{ pct, e.ns / std.time.ns_per_ms, e.key[0..tab], place });
+    }
+}
+
+// stop sampling and drop the profile
+pub fn discard() void {
+    const s = if (state) |*s| s else return;
+    var it = s.charged.keyIterator();
+    while (it.next()) |k| alloc.free(k.*);
+    s.charged.deinit(alloc);
+    state = null;
+}
+
+test "samples are charged to their phase and place" {
+    start();
+    defer discard();
+    const s = &state.?;
+
+    // drive the clock by hand: each step charges exactly what is added
+    s.last_ns = 0;
+    set_place(s, "main.tex:3");
+    charge(s, 30 * std.time.ns_per_ms);
+    set_place(s, "tikzlibraryfoo.code.tex:12");
+    charge(s, 100 * std.time.ns_per_ms);
+    s.phase = "ship_out";
+    charge(s, 110 * std.time.ns_per_ms);
+    s.phase = "typesetting";
+    charge(s, 120 * std.time.ns_per_ms);
+    s.last_ns = clock_ns();
+
+    try std.testing.expectEqual(@as(u64, 30 * std.time.ns_per_ms), s.charged.get("typesetting\tmain.tex:3").?);
+    try std.testing.expectEqual(@as(u64, 80 * std.time.ns_per_ms), s.charged.get("typesetting\ttikzlibraryfoo.code.tex:12").?);
+    try std.testing.expectEqual(@as(u64, 10 * std.time.ns_per_ms), s.charged.get("ship_out\ttikzlibraryfoo.code.tex:12").?);
+
+    set_phase("xdvipdfmx");
+    try std.testing.expectEqual(@as(usize, 0), s.place_len);
+
+    var buf: [1024]u8 = undefined;
+    var w: Io.Writer = .fixed(&buf);
+    try write_report(&w, 2);
+    const out = w.buffered();
+    try std.testing.expect(std.mem.startsWith(u8, out, "sampling profile: 0 samples over 120 ms\n"));
+    // heaviest first, and only the top two
+    const first = std.mem.indexOf(u8, out, "typesetting  tikzlibraryfoo.code.tex:12").?;
+    const second = std.mem.indexOf(u8, out, "typesetting  main.tex:3").?;
+    try std.testing.expect(first < second);
+    try std.testing.expect(std.mem.indexOf(u8, out, "ship_out") == null);
+}
@@ -0,0 +1,439 @@
+// Server.zig -- resident compile server (`eztex serve`) and its client.
+//
+// A long-running eztex keeps what every `eztex compile` process otherwise
+// rebuilds from scratch: the loaded bundle index and mapped cache pack (see
+// Runtime.resident), the decompressed format (Compiler.g_format_bytes) and
+// the FreeType/HarfBuzz font state in Layout.zig. Jobs arrive on a Unix
+// socket and run one at a time, so a warm compile costs about the TeX run.
+//
+// Jobs that arrive while one runs wait in a queue. Previews (--preview) go
+// first, since someone is looking at the screen for them; a full compile
+// that has waited promote_after_ns goes with them. Among equals, the client
+// directory served least recently goes first, so one project's burst of
+// jobs does not hold up everyone else's. A full queue turns jobs away.
+//
+// Protocol, one job per connection:
+//   client -> server   "cwd <dir>\n", one "arg <argument>\n" per argument, "\n"
+//   server -> client   the job's stdout and stderr, then 0x00 "<exit code>\n"
+//
+// A request of just "stats\n\n" gets the server's metrics instead (see
+// write_stats): queue depth, jobs, latency percentiles, cache hit rates.
+//
+// Native POSIX only.
+
+const std = @import("std");
+const posix = std.posix;
+const c = std.c;
+const Io = std.Io;
+const Log = @import("Log.zig");
+const Cache = @import("Cache.zig");
+
+pub const Handler = struct {
+    // runs one forwarded command line (argv without argv[0]) and returns its exit code
+    run: *const fn (io: Io, args: []const []const u8) u8,
+    // lines of the caller's own for the stats report
+    report: *const fn (w: *Io.Writer) Io.Writer.Error!void,
+};
+
+const max_request_len = 64 * 1024;
+const max_args = 256;
+const exit_marker = 0;
+const max_queued = 64;
+const promote_after_ns: i128 = 10 * std.time.ns_per_s;
+
+// {cache}/serve.sock, shared by `eztex serve` and `--server` without a path
+pub fn default_socket_path(buf: []u8) ?[]const u8 {
+    var probe: Cache = Cache.init(std.heap.c_allocator);
+    if (!probe.detect_cache_dir()) return null;
+    return std.fmt.bufPrint(buf, "{s}/serve.sock", .{probe.get_cache_dir()}) catch null;
+}
+
+fn make_addr(path: []const u8) ?c.sockaddr.un {
+    var addr: c.sockaddr.un = .{ .family = c.AF.UNIX, .path = undefined };
+    if (path.len >= addr.path.len) return null;
+    @memset(&addr.path, 0);
+    @memcpy(addr.path[0..path.len], path);
+    return addr;
+}
+
+fn connect_to(addr: *const c.sockaddr.un) ?c.fd_t {
+    const fd = c.socket(c.AF.UNIX, c.SOCK.STREAM, 0);
+    if (fd < 0) return null;
+    if (c.connect(fd, @ptrCast(addr), @sizeOf(c.sockaddr.un)) != 0) {
+        _ = c.close(fd);
+        return null;
+    }
+    return fd;
+}
+
+// -- server --
+
+pub fn serve(io: Io, socket_path: []const u8, handler: Handler) u8 {
+    var addr = make_addr(socket_path) orelse {
+        Log.log(io, "eztex", .err, "socket path too long: {s}", .{socket_path});
+        return 1;
+    };
+    const addr_z: [*:0]const u8 = @ptrCast(&addr.path);
+
+    // a socket file left by a crashed server would make bind fail, but one
+    // that still answers belongs to a live server
+    if (connect_to(&addr)) |fd| {
+        _ = c.close(fd);
+        Log.log(io, "eztex", .err, "a server is already listening on {s}", .{socket_path});
+        return 1;
+    }
+    _ = c.unlink(addr_z);
+
+    const fd = c.socket(c.AF.UNIX, c.SOCK.STREAM, 0);
+    if (fd < 0) {
+        Log.log(io, "eztex", .err, "cannot create socket", .{});
+        return 1;
+    }
+    defer _ = c.close(fd);
+    if (c.bind(fd, @ptrCast(&addr), @sizeOf(c.sockaddr.un)) != 0 or c.listen(fd, max_queued) != 0) {
+        Log.log(io, "eztex", .err, "cannot listen on {s}", .{socket_path});
+        return 1;
+    }
+    defer _ = c.unlink(addr_z);
+
+    // jobs write to the client's connection; a client that goes away must
+    // fail those writes, not kill the server
+    const ignore: posix.Sigaction = .{
+        .handler = .{ .handler = posix.SIG.IGN },
+        .mask = posix.sigemptyset(),
+        .flags = 0,
+    };
+    posix.sigaction(posix.SIG.PIPE, &ignore, null);
+
+    var home_buf: [4096]u8 = undefined;
+    const home: [*:0]const u8 = @ptrCast(c.getcwd(&home_buf, home_buf.len) orelse {
+        Log.log(io, "eztex", .err, "cannot determine working directory", .{});
+        return 1;
+    });
+
+    var sched: Scheduler = .{ .started = std.time.nanoTimestamp() };
+    defer sched.deinit();
+
+    Log.log(io, "eztex", .info, "serving on {s}", .{socket_path});
+    while (true) {
+        // wait for a connection only when there is nothing to run
+        sched.accept_pending(fd, handler);
+        const job = sched.next() orelse continue;
+        const code = handle(io, job.conn, job.req, handler);
+        _ = c.close(job.conn);
+        _ = c.chdir(home);
+        sched.finished(job, code);
+    }
+}
+
+const Class = enum(u1) { interactive, batch };
+
+const Job = struct {
+    conn: c.fd_t,
+    // the request text, c_allocator-owned
+    req: []u8,
+    class: Class,
+    // the client's working directory, hashed
+    tenant: u64,
+    arrived: i128,
+};
+
+const Scheduler = struct {
+    queue: std.ArrayList(Job) = .empty,
+    // when each recent tenant's last job started, oldest overwritten first
+    tenants: [64]struct { id: u64 = 0, served: i128 = 0 } = @splat(.{}),
+    tenants_next: usize = 0,
+
+    started: i128,
+    jobs: [2]u64 = .{ 0, 0 },
+    failed: u64 = 0,
+    rejected: u64 = 0,
+    // arrival to exit code of the last latencies.len jobs, in ms
+    latencies: [256]u32 = undefined,
+    latencies_n: usize = 0,
+
+    fn deinit(self: *Scheduler) void {
+        for (self.queue.items) |job| {
+            _ = c.close(job.conn);
+            std.heap.c_allocator.free(job.req);
+        }
+        self.queue.deinit(std.heap.c_allocator);
+    }
+
+    fn accept_pending(self: *Scheduler, fd: c.fd_t, handler: Handler) void {
+        var timeout: c_int = if (self.queue.items.len == 0) -1 else 0;
+        while (true) : (timeout = 0) {
+            var pfd = [_]posix.pollfd{.{ .fd = fd, .events = posix.POLL.IN, .revents = 0 }};
+            const ready = posix.poll(&pfd, timeout) catch return;
+            if (ready == 0) return;
+            const conn = c.accept(fd, null, null);
+            if (conn < 0) continue;
+            self.admit(conn, handler);
+        }
+    }
+
+    fn admit(self: *Scheduler, conn: c.fd_t, handler: Handler) void {
+        var req_buf: [max_request_len]u8 = undefined;
+        const req = read_request(conn, &req_buf) orelse {
+            send_exit(conn, 2);
+            _ = c.close(conn);
+            return;
+        };
+        if (std.mem.eql(u8, req, "stats\n")) {
+            var out_buf: [4096]u8 = undefined;
+            var w: Io.Writer = .fixed(&out_buf);
+            self.write_stats(&w, handler) catch {};
+            write_all(conn, w.buffered());
+            send_exit(conn, 0);
+            _ = c.close(conn);
+            return;
+        }
+        if (self.queue.items.len == max_queued) {
+            self.rejected += 1;
+            write_all(conn, "eztex serve: too many jobs waiting, try again later\n");
+            send_exit(conn, 2);
+            _ = c.close(conn);
+            return;
+        }
+        const owned = std.heap.c_allocator.dupe(u8, req) catch {
+            send_exit(conn, 2);
+            _ = c.close(conn);
+            return;
+        };
+        const job: Job = .{
+            .conn = conn,
+            .req = owned,
+            .class = if (std.mem.indexOf(u8, req, "\narg --preview\n") != null) .interactive else .batch,
+            .tenant = std.hash.Wyhash.hash(0, request_cwd(req)),
+            .arrived = std.time.nanoTimestamp(),
+        };
+        self.queue.append(std.heap.c_allocator, job) catch {
+            std.heap.c_allocator.free(owned);
+            send_exit(conn, 2);
+            _ = c.close(conn);
+        };
+    }
+
+    // previews and long-waiting full compiles first, then the tenant served
+    // least recently, then the job that came first
+    fn next(self: *Scheduler) ?Job {
+        if (self.queue.items.len == 0) return null;
+        const now = std.time.nanoTimestamp();
+        var best: usize = 0;
+        var best_rank = self.rank(self.queue.items[0], now);
+        for (self.queue.items[1..], 1..) |job, i| {
+            const r = self.rank(job, now);
+            if (r.class < best_rank.class or (r.class == best_rank.class and r.served < best_rank.served)) {
+                best = i;
+                best_rank = r;
+            }
+        }
+        const job = self.queue.orderedRemove(best);
+        self.note_served(job.tenant, now);
+        return job;
+    }
+
+    fn rank(self: *const Scheduler, job: Job, now: i128) struct { class: u1, served: i128 } {
+        const promoted = now - job.arrived > promote_after_ns;
+        return .{
+            .class = if (promoted) 0 else @intFromEnum(job.class),
+            .served = self.last_served(job.tenant),
+        };
+    }
+
+    fn last_served(self: *const Scheduler, tenant: u64) i128 {
+        for (self.tenants) |t| if (t.id == tenant) return t.served;
+        return 0;
+    }
+
+    fn note_served(self: *Scheduler, tenant: u64, now: i128) void {
+        for (&self.tenants) |*t| if (t.id == tenant) {
+            t.served = now;
+            return;
+        };
+        self.tenants[self.tenants_next] = .{ .id = tenant, .served = now };
+        self.tenants_next = (self.tenants_next + 1) % self.tenants.len;
+    }
+
+    fn finished(self: *Scheduler, job: Job, code: u8) void {
+        defer std.heap.c_allocator.free(job.req);
+        self.jobs[@intFromEnum(job.class)] += 1;
+        if (code != 0) self.failed += 1;
+        const ms = @divTrunc(std.time.nanoTimestamp() - job.arrived, std.time.ns_per_ms);
+        self.latencies[self.latencies_n % self.latencies.len] = @intCast(std.math.clamp(ms, 0, std.math.maxInt(u32)));
+        self.latencies_n += 1;
+    }
+
+    fn percentile(self: *const Scheduler, p: usize) u32 {
+        const n = @min(self.latencies_n, self.latencies.len);
+        if (n == 0) return 0;
+        var sorted: [256]u32 = undefined;
+        @memcpy(sorted[0..n], self.latencies[0..n]);
+        std.mem.sort(u32, sorted[0..n], {}, std.sort.asc(u32));
+        return sorted[@min(n - 1, n * p / 100)];
+    }
+
+    fn write_stats(self: *const Scheduler, w: *Io.Writer, handler: Handler) Io.Writer.Error!void {
+        const up_s = @divTrunc(std.time.nanoTimestamp() - self.started, std.time.ns_per_s);
+        try w.print("uptime_seconds {d}\n", .{up_s});
+        try w.print("queue_depth {d}\n", .{self.queue.items.len});
+        try w.print("jobs_interactive {d}\n", .{self.jobs[@intFromEnum(Class.interactive)]});
+        try w.print("jobs_batch {d}\n", .{self.jobs[@intFromEnum(Class.batch)]});
+        try w.print("jobs_failed {d}\n", .{self.failed});
+        try w.print("jobs_rejected {d}\n", .{self.rejected});
+        try w.print("latency_ms_p50 {d}\n", .{self.percentile(50)});
+        try w.print("latency_ms_p99 {d}\n", .{self.percentile(99)});
+        try handler.report(w);
+    }
+};
+
+fn request_cwd(req: []const u8) []const u8 {
+    var lines = std.mem.splitScalar(u8, req, '\n');
+    while (lines.next()) |line| {
+        if (std.mem.startsWith(u8, line, "cwd ")) return line[4..];
+    }
+    return "";
+}
+
+// runs the job and returns its exit code, also sent to the client
+fn handle(io: Io, conn: c.fd_t, req: []u8, handler: Handler) u8 {
+    var args: [max_args][]const u8 = undefined;
+    var argc: usize = 0;
+    var cwd: ?[:0]u8 = null;
+    var lines = std.mem.splitScalar(u8, req, '\n');
+    while (lines.next()) |line| {
+        if (std.mem.startsWith(u8, line, "cwd ")) {
+            // terminate the path in place, over its newline
+            const end = @intFromPtr(line.ptr) - @intFromPtr(req.ptr) + line.len;
+            req[end] = 0;
+            cwd = req[end - (line.len - 4) .. end :0];
+        } else if (std.mem.startsWith(u8, line, "arg ")) {
+            if (argc == max_args) return fail(conn, 2);
+            args[argc] = line[4..];
+            argc += 1;
+        }
+    }
+
+    if (cwd) |dir| {
+        if (c.chdir(dir.ptr) != 0) {
+            write_all(conn, "eztex serve: cannot enter the client's working directory\n");
+            return fail(conn, 2);
+        }
+    }
+
+    // route the job's stdout and stderr (engine output, Log) to the client
+    const saved_out = c.dup(1);
+    const saved_err = c.dup(2);
+    _ = c.dup2(conn, 1);
+    _ = c.dup2(conn, 2);
+    const code = handler.run(io, args[0..argc]);
+    if (saved_out >= 0) {
+        _ = c.dup2(saved_out, 1);
+        _ = c.close(saved_out);
+    }
+    if (saved_err >= 0) {
+        _ = c.dup2(saved_err, 2);
+        _ = c.close(saved_err);
+    }
+    send_exit(conn, code);
+    return code;
+}
+
+fn fail(conn: c.fd_t, code: u8) u8 {
+    send_exit(conn, code);
+    return code;
+}
+
+// read up to and including the blank line that ends a request
+fn read_request(fd: c.fd_t, buf: []u8) ?[]const u8 {
+    var len: usize = 0;
+    while (len < buf.len) {
+        const n = c.read(fd, buf[len..].ptr, buf.len - len);
+        if (n <= 0) return null;
+        len += @intCast(n);
+        if (std.mem.indexOf(u8, buf[0..len], "\n\n")) |end| return buf[0 .. end + 1];
+    }
+    return null;
+}
+
+fn send_exit(conn: c.fd_t, code: u8) void {
+    var buf: [8]u8 = undefined;
+    write_all(conn, std.fmt.bufPrint(&buf, "{c}{d}\n", .{ exit_marker, code }) catch return);
+}
+
+fn write_all(fd: c.fd_t, bytes: []const u8) void {
+    var done: usize = 0;
+    while (done < bytes.len) {
+        const n = c.write(fd, bytes[done..].ptr, bytes.len - done);
+        if (n <= 0) return;
+        done += @intCast(n);
+    }
+}
+
+// -- client --
+
+// run a command line on the server at socket_path, relaying its output to
+// stderr. returns the job's exit code, or null when no server answered (the
+// caller then compiles in-process).
+pub fn forward(io: Io, socket_path: []const u8, args: []const []const u8) ?u8 {
+    const addr = make_addr(socket_path) orelse return null;
+
+    var req: std.ArrayList(u8) = .empty;
+    defer req.deinit(std.heap.c_allocator);
+    var cwd_buf: [4096]u8 = undefined;
+    const cwd = std.mem.span(@as([*:0]const u8, @ptrCast(c.getcwd(&cwd_buf, cwd_buf.len) orelse return null)));
+    if (std.mem.indexOfScalar(u8, cwd, '\n') != null) return null;
+    req.print(std.heap.c_allocator, "cwd {s}\n", .{cwd}) catch return null;
+    for (args) |arg| {
+        // newlines cannot be framed; such jobs run locally
+        if (std.mem.indexOfScalar(u8, arg, '\n') != null) return null;
+        req.print(std.heap.c_allocator, "arg {s}\n", .{arg}) catch return null;
+    }
+    req.append(std.heap.c_allocator, '\n') catch return null;
+    if (req.items.len > max_request_len) return null;
+
+    Log.dbg(io, "eztex", "forwarding to server at {s}", .{socket_path});
+    return exchange(io, &addr, req.items, 2);
+}
+
+// print the metrics of the server at socket_path to stdout; null when none answered
+pub fn stats(io: Io, socket_path: []const u8) ?u8 {
+    const addr = make_addr(socket_path) orelse return null;
+    return exchange(io, &addr, "stats\n\n", 1);
+}
+
+// send a request and relay what comes back to out until the exit marker
+fn exchange(io: Io, addr: *const c.sockaddr.un, req: []const u8, out: c.fd_t) ?u8 {
+    const fd = connect_to(addr) orelse return null;
+    defer _ = c.close(fd);
+    write_all(fd, req);
+
+    var buf: [4096]u8 = undefined;
+    var code_buf: [8]u8 = undefined;
+    var code_len: usize = 0;
+    var finished = false;
+    while (true) {
+        const n = c.read(fd, &buf, buf.len);
+        if (n <= 0) break;
+        var chunk = buf[0..@intCast(n)];
+        if (!finished) {
+            if (std.mem.indexOfScalar(u8, chunk, exit_marker)) |at| {
+                write_all(out, chunk[0..at]);
+                chunk = chunk[at + 1 ..];
+                finished = true;
+            } else {
+                write_all(out, chunk);
+                continue;
+            }
+        }
+        const take = @min(chunk.len, code_buf.len - code_len);
+        @memcpy(code_buf[code_len..][0..take], chunk[0..take]);
+        code_len += take;
+    }
+    if (!finished) {
+        Log.log(io, "eztex", .err, "server closed the connection before the job finished", .{});
+        return 1;
+    }
+    const text = std.mem.trim(u8, code_buf[0..code_len], " \r\n");
+    return std.fmt.parseInt(u8, text, 10) catch 1;
+}
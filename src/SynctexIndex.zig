@@ -0,0 +1,478 @@
+// SynctexIndex.zig -- compiled synctex sidecar (<job>.synctex.idx).
+//
+// The app answered forward and inverse search by gunzipping the whole
+// .synctex.gz and parsing it into objects after every compile. This compiles
+// the same records once, on the engine side, into a blob that JS reads
+// through typed arrays (app/src/lib/synctex_index.ts) without parsing:
+//
+//   header   16 x u32: "EZSI" | version | x_offset | y_offset | path_count |
+//            elem_count | page_count | bands | paths_off | elems_off |
+//            pages_off | order_off | band_starts_off | band_items_off |
+//            names_off | total_len
+//   paths    path_count x { name_off u32 | name_len u32 | elem_start u32 | elem_end u32 }
+//   elems    line, page, left, bottom, width, height: elem_count x i32 each,
+//            then kind: elem_count x u8, padded to 4
+//   pages    page_count x { page i32 | order_start u32 | order_end u32 | lo i32 | band_height i32 }
+//   order    per page, the indices of its elements, ascending
+//   bands    band_starts: page_count x (bands + 1) u32 into band_items;
+//            band_items: element indices, ascending within a band
+//   names    input paths as written in the synctex file
+//
+// Elements are the records the app's text parser keeps (synctex.ts): one per
+// kern, glue, math, rule, void box or character run that sits inside a box,
+// its width from the record (min_i32 when absent) and its height that of the
+// enclosing box. They are sorted by input path (in the order the records
+// first name it), line, page and record order, so each path is one range,
+// lines come in order within it and the first elements of a line are those
+// on its lowest page. The order of a page's elements is the order inverse
+// search scans candidates in.
+//
+// Each page's vertical extent is cut into `bands` bands; an element is listed
+// in every band its box [bottom - height, bottom] touches, padded by 1sp, so a
+// click only tests the boxes of its band. Coordinates stay in sp, as in the
+// file; readers divide by the unit (65781.76 sp per big point).
+//
+// All integers are little-endian and every section is 4-aligned, so the blob
+// maps straight onto Int32Array/Uint32Array views.
+//
+// Self-contained (std only).
+
+const std = @import("std");
+const Allocator = std.mem.Allocator;
+const Io = std.Io;
+
+pub const magic = "EZSI";
+pub const version: u32 = 1;
+pub const bands: u32 = 64;
+pub const no_width: i32 = std.math.minInt(i32);
+
+const header_words = 16;
+const path_words = 4;
+const page_words = 5;
+
+const Elem = struct {
+    path: u32,
+    line: i32,
+    page: i32,
+    left: i32,
+    bottom: i32,
+    width: i32,
+    height: i32,
+    kind: u8,
+};
+
+fn elem_less(_: void, a: Elem, b: Elem) bool {
+    if (a.path != b.path) return a.path < b.path;
+    if (a.line != b.line) return a.line < b.line;
+    return a.page < b.page;
+}
+
+// the synctex text, gunzipped when it starts with the gzip magic
+pub fn gunzip(allocator: Allocator, data: []const u8) ![]u8 {
+    if (data.len < 2 or data[0] != 0x1f or data[1] != 0x8b) return allocator.dupe(u8, data);
+    var input_reader: Io.Reader = .fixed(data);
+    var window_buf: [std.compress.flate.max_window_len]u8 = undefined;
+    var decompress = std.compress.flate.Decompress.init(&input_reader, .gzip, &window_buf);
+
+    var output: Io.Writer.Allocating = .init(allocator);
+    errdefer output.deinit();
+    _ = decompress.reader.streamRemaining(&output.writer) catch return error.DecompressError;
+    return try output.toOwnedSlice();
+}
+
+// "tag,line:left,bottom" with an optional ":width", then for boxes
+// ",height,depth"
+const Record = struct {
+    tag: []const u8,
+    line: i32,
+    left: i32,
+    bottom: i32,
+    width: ?i32 = null,
+    height: ?i32 = null,
+};
+
+fn parse_record(text: []const u8) ?Record {
+    var pos: usize = 0;
+    const tag_end = std.mem.indexOfScalarPos(u8, text, pos, ',') orelse return null;
+    const tag = text[pos..tag_end];
+    if (tag.len == 0) return null;
+    for (tag) |c| if (!std.ascii.isDigit(c)) return null;
+    pos = tag_end + 1;
+    var rec: Record = .{
+        .tag = tag,
+        .line = take_int(text, &pos, ':') orelse return null,
+        .left = take_int(text, &pos, ',') orelse return null,
+        .bottom = 0,
+    };
+    rec.bottom = take_int(text, &pos, ':') orelse return null;
+    if (pos >= text.len or text[pos - 1] != ':') return rec;
+    rec.width = take_int(text, &pos, ',') orelse return rec;
+    if (pos >= text.len or text[pos - 1] != ',') return rec;
+    rec.height = take_int(text, &pos, ',');
+    return rec;
+}
+
+// an integer starting at pos, then past the separator that ends it (or the
+// end of text or any other character, which stops it without being taken)
+fn take_int(text: []const u8, pos: *usize, sep: u8) ?i32 {
+    var end = pos.*;
+    if (end < text.len and text[end] == '-') end += 1;
+    const digits_start = end;
+    while (end < text.len and std.ascii.isDigit(text[end])) end += 1;
+    if (end == digits_start) return null;
+    const value = std.fmt.parseInt(i32, text[pos.*..end], 10) catch return null;
+    pos.* = if (end < text.len and text[end] == sep) end + 1 else text.len + 1;
+    return value;
+}
+
+// compile the text of a .synctex file. a file without elements compiles to a
+// blob with empty sections.
+pub fn compile(allocator: Allocator, text: []const u8) ![]u8 {
+    var tag_paths: std.StringHashMapUnmanaged([]const u8) = .empty;
+    defer tag_paths.deinit(allocator);
+    var path_ranks: std.StringHashMapUnmanaged(u32) = .empty;
+    defer path_ranks.deinit(allocator);
+    var paths: std.ArrayListUnmanaged([]const u8) = .empty;
+    defer paths.deinit(allocator);
+    var elems: std.ArrayListUnmanaged(Elem) = .empty;
+    defer elems.deinit(allocator);
+    // heights of the open boxes; the outermost is never closed (synctex.ts
+    // pops a box only into another box)
+    var boxes: std.ArrayListUnmanaged(i32) = .empty;
+    defer boxes.deinit(allocator);
+
+    var x_offset: i32 = 0;
+    var y_offset: i32 = 0;
+    var page: ?i32 = null;
+
+    var lines = std.mem.splitScalar(u8, text, '\n');
+    _ = lines.next(); // "SyncTeX Version:N"
+    while (lines.next()) |line| {
+        if (line.len == 0) continue;
+        if (std.mem.startsWith(u8, line, "Input:")) {
+            const rest = line["Input:".len..];
+            const colon = std.mem.indexOfScalar(u8, rest, ':') orelse continue;
+            if (colon == 0 or colon + 1 >= rest.len) continue;
+            try tag_paths.put(allocator, rest[0..colon], rest[colon + 1 ..]);
+            continue;
+        }
+        if (std.mem.startsWith(u8, line, "X Offset:")) {
+            x_offset = std.fmt.parseInt(i32, line["X Offset:".len..], 10) catch x_offset;
+            continue;
+        }
+        if (std.mem.startsWith(u8, line, "Y Offset:")) {
+            y_offset = std.fmt.parseInt(i32, line["Y Offset:".len..], 10) catch y_offset;
+            continue;
+        }
+        switch (line[0]) {
+            '{' => if (std.fmt.parseInt(i32, line[1..], 10)) |n| {
+                page = n;
+                boxes.clearRetainingCapacity();
+                continue;
+            } else |_| {},
+            '}' => if (page != null) {
+                page = null;
+                continue;
+            },
+            '[', '(' => if (parse_record(line[1..])) |rec| if (rec.height) |h| {
+                if (page != null) try boxes.append(allocator, h);
+                continue;
+            },
+            else => {},
+        }
+        if (line[line.len - 1] == ']' or line[line.len - 1] == ')') {
+            if (boxes.items.len >= 2) boxes.items.len -= 1;
+            continue;
+        }
+
+        const on_page = page orelse continue;
+        if (boxes.items.len == 0) continue;
+        const rec = parse_record(line[1..]) orelse continue;
+        const path = tag_paths.get(rec.tag) orelse continue;
+        const rank = try path_ranks.getOrPut(allocator, path);
+        if (!rank.found_existing) {
+            rank.value_ptr.* = @intCast(paths.items.len);
+            try paths.append(allocator, path);
+        }
+        try elems.append(allocator, .{
+            .path = rank.value_ptr.*,
+            .line = rec.line,
+            .page = on_page,
+            .left = rec.left,
+            .bottom = rec.bottom,
+            .width = rec.width orelse no_width,
+            .height = boxes.items[boxes.items.len - 1],
+            .kind = line[0],
+        });
+    }
+
+    // stable, so record order survives within a line and page
+    std.mem.sort(Elem, elems.items, {}, elem_less);
+    return write(allocator, x_offset, y_offset, paths.items, elems.items);
+}
+
+fn write(allocator: Allocator, x_offset: i32, y_offset: i32, paths: []const []const u8, elems: []const Elem) ![]u8 {
+    const n = elems.len;
+
+    // the pages, ascending, and each element's slot among them
+    var page_nos: std.ArrayListUnmanaged(i32) = .empty;
+    defer page_nos.deinit(allocator);
+    for (elems) |e| {
+        const at = std.sort.lowerBound(i32, page_nos.items, e.page, order_i32);
+        if (at < page_nos.items.len and page_nos.items[at] == e.page) continue;
+        try page_nos.insert(allocator, at, e.page);
+    }
+    const page_count = page_nos.items.len;
+    const slots = try allocator.alloc(u32, n);
+    defer allocator.free(slots);
+    const order_starts = try allocator.alloc(u32, page_count + 1);
+    defer allocator.free(order_starts);
+    @memset(order_starts, 0);
+    const lo = try allocator.alloc(i64, page_count);
+    defer allocator.free(lo);
+    const hi = try allocator.alloc(i64, page_count);
+    defer allocator.free(hi);
+    @memset(lo, std.math.maxInt(i64));
+    @memset(hi, std.math.minInt(i64));
+    for (elems, 0..) |e, i| {
+        const slot: u32 = @intCast(std.sort.lowerBound(i32, page_nos.items, e.page, order_i32));
+        slots[i] = slot;
+        order_starts[slot + 1] += 1;
+        const top = @as(i64, e.bottom) - e.height;
+        if (top > e.bottom) continue;
+        lo[slot] = @min(lo[slot], top);
+        hi[slot] = @max(hi[slot], e.bottom);
+    }
+    for (1..page_count + 1) |p| order_starts[p] += order_starts[p - 1];
+
+    const band_height = try allocator.alloc(i64, page_count);
+    defer allocator.free(band_height);
+    for (0..page_count) |p| {
+        if (lo[p] > hi[p]) {
+            lo[p] = 0;
+            hi[p] = 0;
+        }
+        band_height[p] = @max(1, @divFloor(hi[p] - lo[p] + bands, bands));
+    }
+
+    // band counts first, then starts, then items
+    const band_starts = try allocator.alloc(u32, page_count * (bands + 1));
+    defer allocator.free(band_starts);
+    @memset(band_starts, 0);
+    var band_total: usize = 0;
+    for (elems, 0..) |e, i| {
+        const r = band_range(e, lo[slots[i]], band_height[slots[i]]) orelse continue;
+        const base = slots[i] * (bands + 1);
+        for (r[0]..r[1] + 1) |b| band_starts[base + b + 1] += 1;
+        band_total += r[1] + 1 - r[0];
+    }
+    var running: u32 = 0;
+    for (0..page_count) |p| {
+        const base = p * (bands + 1);
+        band_starts[base] = running;
+        for (0..bands) |b| {
+            running += band_starts[base + b + 1];
+            band_starts[base + b + 1] = running;
+        }
+    }
+
+    const paths_off = header_words * 4;
+    const elems_off = paths_off + paths.len * path_words * 4;
+    const pages_off = elems_off + n * 6 * 4 + std.mem.alignForward(usize, n, 4);
+    const order_off = pages_off + page_count * page_words * 4;
+    const band_starts_off = order_off + n * 4;
+    const band_items_off = band_starts_off + band_starts.len * 4;
+    const names_off = band_items_off + band_total * 4;
+    var names_len: usize = 0;
+    for (paths) |p| names_len += p.len;
+    const total = names_off + names_len;
+    if (total > std.math.maxInt(u32)) return error.IndexTooLarge;
+
+    const out = try allocator.alloc(u8, total);
+    errdefer allocator.free(out);
+    @memset(out, 0);
+    @memcpy(out[0..4], magic);
+    const header = [_]usize{
+        version,   0,         0,         paths.len, n,               page_count,     bands,
+        paths_off, elems_off, pages_off, order_off, band_starts_off, band_items_off, names_off,
+        total,
+    };
+    for (header, 1..) |v, w| write_u32(out, w * 4, @intCast(v));
+    write_i32(out, 2 * 4, x_offset);
+    write_i32(out, 3 * 4, y_offset);
+
+    var name_at: usize = 0;
+    for (paths, 0..) |p, rank| {
+        const rec = paths_off + rank * path_words * 4;
+        write_u32(out, rec, @intCast(name_at));
+        write_u32(out, rec + 4, @intCast(p.len));
+        @memcpy(out[names_off + name_at ..][0..p.len], p);
+        name_at += p.len;
+    }
+    // paths are contiguous runs of the sorted elements
+    for (elems, 0..) |e, i| {
+        const rec = paths_off + e.path * path_words * 4;
+        if (i == 0 or elems[i - 1].path != e.path) write_u32(out, rec + 8, @intCast(i));
+        write_u32(out, rec + 12, @intCast(i + 1));
+    }
+
+    for (elems, 0..) |e, i| {
+        const fields = [_]i32{ e.line, e.page, e.left, e.bottom, e.width, e.height };
+        for (fields, 0..) |v, f| write_i32(out, elems_off + (f * n + i) * 4, v);
+        out[elems_off + 6 * n * 4 + i] = e.kind;
+    }
+
+    for (0..page_count) |p| {
+        const rec = pages_off + p * page_words * 4;
+        write_i32(out, rec, page_nos.items[p]);
+        write_u32(out, rec + 4, order_starts[p]);
+        write_u32(out, rec + 8, order_starts[p + 1]);
+        write_i32(out, rec + 12, std.math.cast(i32, lo[p]) orelse return error.IndexTooLarge);
+        write_i32(out, rec + 16, @intCast(@min(band_height[p], std.math.maxInt(i32))));
+    }
+
+    // fill order and band items by walking elements ascending, so every
+    // list comes out ascending
+    const order_fill = try allocator.dupe(u32, order_starts[0..page_count]);
+    defer allocator.free(order_fill);
+    const band_fill = try allocator.dupe(u32, band_starts);
+    defer allocator.free(band_fill);
+    for (elems, 0..) |e, i| {
+        const slot = slots[i];
+        write_u32(out, order_off + order_fill[slot] * 4, @intCast(i));
+        order_fill[slot] += 1;
+        const r = band_range(e, lo[slot], band_height[slot]) orelse continue;
+        for (r[0]..r[1] + 1) |b| {
+            const at = &band_fill[slot * (bands + 1) + b];
+            write_u32(out, band_items_off + at.* * 4, @intCast(i));
+            at.* += 1;
+        }
+    }
+    return out;
+}
+
+// the bands an element's box touches, padded by 1sp; null for a box turned
+// inside out by a negative height, which contains no point
+fn band_range(e: Elem, lo: i64, band_height: i64) ?[2]usize {
+    const top = @as(i64, e.bottom) - e.height;
+    if (top > e.bottom) return null;
+    return .{ band_of(top - 1, lo, band_height), band_of(@as(i64, e.bottom) + 1, lo, band_height) };
+}
+
+fn band_of(y: i64, lo: i64, band_height: i64) usize {
+    const b = @divFloor(y - lo, band_height);
+    return @intCast(std.math.clamp(b, 0, bands - 1));
+}
+
+fn order_i32(a: i32, b: i32) std.math.Order {
+    return std.math.order(a, b);
+}
+
+fn read_u32(bytes: []const u8, at: usize) u32 {
+    return std.mem.readInt(u32, bytes[at..][0..4], .little);
+}
+
+fn read_i32(bytes: []const u8, at: usize) i32 {
+    return std.mem.readInt(i32, bytes[at..][0..4], .little);
+}
+
+fn write_u32(bytes: []u8, at: usize, value: u32) void {
+    std.mem.writeInt(u32, bytes[at..][0..4], value, .little);
+}
+
+fn write_i32(bytes: []u8, at: usize, value: i32) void {
+    std.mem.writeInt(i32, bytes[at..][0..4], value, .little);
+}
+
+// -- tests --
+
+test "compile sorts elements by path and line and bands each page" {
+    const text =
+        \\SyncTeX Version:1
+        \\Input:1:./main.tex
+        \\Input:2:./chap.tex
+        \\Output:pdf
+        \\Magnification:1000
+        \\Unit:1
+        \\X Offset:0
+        \\Y Offset:0
+        \\Content:
+        \\!200
+        \\{1
+        \\[1,10:0,50000:400000,40000,0
+        \\(1,12:100,20000:3000,9000,0
+        \\x1,12:100,20000
+        \\g2,3:200,20000
+        \\k1,11:300,20000:50
+        \\)
+        \\h1,10:400,45000:900,8000,0
+        \\]
+        \\}1
+        \\{2
+        \\[1,20:0,50000:400000,40000,0
+        \\x2,1:5,30000
+        \\$9,1:5,30000
+        \\]
+        \\}2
+        \\Postamble:
+    ;
+    const blob = try compile(std.testing.allocator, text);
+    defer std.testing.allocator.free(blob);
+
+    try std.testing.expectEqualStrings(magic, blob[0..4]);
+    try std.testing.expectEqual(@as(u32, 2), read_u32(blob, 4 * 4));
+    const n = read_u32(blob, 5 * 4);
+    try std.testing.expectEqual(@as(u32, 5), n);
+    try std.testing.expectEqual(@as(u32, 2), read_u32(blob, 6 * 4));
+    try std.testing.expectEqual(@as(usize, read_u32(blob, 15 * 4)), blob.len);
+
+    // main.tex first (named first), its lines ascending
+    const paths_off = read_u32(blob, 8 * 4);
+    const names_off = read_u32(blob, 14 * 4);
+    const name_len = read_u32(blob, paths_off + 4);
+    try std.testing.expectEqualStrings("./main.tex", blob[names_off..][0..name_len]);
+    try std.testing.expectEqual(@as(u32, 0), read_u32(blob, paths_off + 8));
+    try std.testing.expectEqual(@as(u32, 3), read_u32(blob, paths_off + 12));
+
+    const elems_off = read_u32(blob, 9 * 4);
+    const lines = [_]i32{ 10, 11, 12, 1, 3 };
+    for (lines, 0..) |l, i| try std.testing.expectEqual(l, read_i32(blob, elems_off + i * 4));
+    // the void hbox takes the height of the vbox around it, the kern its
+    // width, and the char run has none
+    const height_at = elems_off + 5 * n * 4;
+    try std.testing.expectEqual(@as(i32, 40000), read_i32(blob, height_at));
+    try std.testing.expectEqual(@as(i32, 9000), read_i32(blob, height_at + 2 * 4));
+    try std.testing.expectEqual(@as(i32, 50), read_i32(blob, elems_off + (4 * n + 1) * 4));
+    try std.testing.expectEqual(no_width, read_i32(blob, elems_off + (4 * n + 2) * 4));
+    try std.testing.expectEqual(@as(u8, 'k'), blob[elems_off + 6 * n * 4 + 1]);
+
+    // page 2 holds only chap.tex line 1 (tag 9 names no input)
+    const pages_off = read_u32(blob, 10 * 4);
+    const p2 = pages_off + page_words * 4;
+    try std.testing.expectEqual(@as(i32, 2), read_i32(blob, p2));
+    try std.testing.expectEqual(@as(u32, 1), read_u32(blob, p2 + 8) - read_u32(blob, p2 + 4));
+
+    // every element of page 1 sits in some band, listed ascending
+    const band_starts_off = read_u32(blob, 12 * 4);
+    const band_items_off = read_u32(blob, 13 * 4);
+    var seen = [_]bool{false} ** 5;
+    for (0..bands) |b| {
+        const from = read_u32(blob, band_starts_off + b * 4);
+        const to = read_u32(blob, band_starts_off + (b + 1) * 4);
+        var prev: ?u32 = null;
+        for (from..to) |k| {
+            const idx = read_u32(blob, band_items_off + k * 4);
+            if (prev) |p| try std.testing.expect(p < idx);
+            prev = idx;
+            seen[idx] = true;
+        }
+    }
+    try std.testing.expect(seen[0] and seen[1] and seen[2] and seen[4]);
+    try std.testing.expect(!seen[3]);
+}
+
+test "gunzip passes plain text through" {
+    const out = try gunzip(std.testing.allocator, "SyncTeX Version:1\n");
+    defer std.testing.allocator.free(out);
+    try std.testing.expectEqualStrings("SyncTeX Version:1\n", out);
+}
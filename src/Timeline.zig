@@ -0,0 +1,273 @@
+// Timeline.zig -- `--trace <file.json>`: where a compile's time goes, as spans
+// in the Chrome trace event format (chrome://tracing, ui.perfetto.dev).
+//
+// Zig code brackets its stages with now() and span(). The engines report
+// theirs (format load, each ship_out, font embedding, image inclusion)
+// through the checkpoint callback as TTBC_CHECKPOINT_* begin/end pairs,
+// which are matched here on a small stack, and the figures they report at the
+// end of a run (TTBC_CHECKPOINT_STATS) as instant events. Nothing is recorded
+// unless start was called; after that a span costs a clock read and an append.
+
+const std = @import("std");
+const Io = std.Io;
+const Log = @import("Log.zig");
+
+pub const Category = enum { compile, engine, bibtex, pdf, bundle };
+
+const Event = struct {
+    cat: Category,
+    name: []const u8,
+    // owned copy, naming what the span covers (a page, a file)
+    detail: ?[]const u8,
+    start_ns: i128,
+    end_ns: i128,
+    // a moment rather than a span (see note)
+    instant: bool = false,
+    // bytes moved or held, written as args.bytes (see span_bytes, note_bytes)
+    bytes: ?u64 = null,
+};
+
+// a span opened by a _BEGIN checkpoint, waiting for its _END
+const Open = struct {
+    begin_id: c_int,
+    cat: Category,
+    name: []const u8,
+    detail: ?[]const u8,
+    start_ns: i128,
+};
+
+const max_open = 16;
+
+const State = struct {
+    epoch_ns: i128,
+    events: std.ArrayList(Event) = .empty,
+    open: [max_open]Open = undefined,
+    open_len: usize = 0,
+};
+
+// engine state is per thread (see TTBC_THREAD_LOCAL), and so is its timeline
+threadlocal var state: ?State = null;
+
+// checkpoint ids, as in tectonic_bridge_core.h
+const checkpoint_format_loaded = 1;
+const checkpoint_format_load_begin = 2;
+pub const checkpoint_shipout_begin = 3;
+const checkpoint_shipout_end = 4;
+const checkpoint_font_embed_begin = 5;
+const checkpoint_font_embed_end = 6;
+const checkpoint_image_begin = 7;
+const checkpoint_image_end = 8;
+const checkpoint_stats = 9;
+
+const alloc = std.heap.c_allocator;
+
+// the clock behind Host.timestamp_ns, read directly so this file does not
+// pull in the hosts and its tests run standalone
+fn clock_ns() i128 {
+    return std.time.nanoTimestamp();
+}
+
+// start recording, dropping anything recorded before
+pub fn start() void {
+    discard();
+    state = .{ .epoch_ns = clock_ns() };
+}
+
+pub fn enabled() bool {
+    return state != null;
+}
+
+// the start of a span, for a later span(); 0 while not recording
+pub fn now() i128 {
+    return if (state != null) clock_ns() else 0;
+}
+
+// record a span from `started` (see now) until now
+pub fn span(cat: Category, name: []const u8, detail: ?[]const u8, started: i128) void {
+    if (state == null) return;
+    record(cat, name, dupe(detail), started, clock_ns());
+}
+
+// a span that moved `bytes`, such as a fetch
+pub fn span_bytes(cat: Category, name: []const u8, detail: ?[]const u8, started: i128, bytes: u64) void {
+    const s = if (state) |*s| s else return;
+    const d = dupe(detail);
+    s.events.append(alloc, .{ .cat = cat, .name = name, .detail = d, .start_ns = started, .end_ns = clock_ns(), .bytes = bytes }) catch {
+        if (d) |owned| alloc.free(owned);
+    };
+}
+
+// record a moment, such as a figure reported at the end of a run
+pub fn note(cat: Category, name: []const u8, detail: ?[]const u8) void {
+    const s = if (state) |*s| s else return;
+    const t = clock_ns();
+    const d = dupe(detail);
+    s.events.append(alloc, .{ .cat = cat, .name = name, .detail = d, .start_ns = t, .end_ns = t, .instant = true }) catch {
+        if (d) |owned| alloc.free(owned);
+    };
+}
+
+// a figure in bytes at this moment, such as peak memory
+pub fn note_bytes(cat: Category, name: []const u8, bytes: u64) void {
+    const s = if (state) |*s| s else return;
+    const t = clock_ns();
+    s.events.append(alloc, .{ .cat = cat, .name = name, .detail = null, .start_ns = t, .end_ns = t, .instant = true, .bytes = bytes }) catch {};
+}
+
+// the checkpoint callback's share: open or close an engine span
+pub fn checkpoint(id: c_int, detail_z: ?[*:0]const u8) void {
+    const s = if (state) |*s| s else return;
+    const detail: ?[]const u8 = if (detail_z) |d| std.mem.span(d) else null;
+    switch (id) {
+        checkpoint_format_load_begin => push(s, id, .engine, "format load", detail),
+        checkpoint_shipout_begin => push(s, id, .engine, "ship_out", detail),
+        checkpoint_font_embed_begin => push(s, id, .pdf, "embed font", detail),
+        checkpoint_image_begin => push(s, id, .pdf, "include image", detail),
+        checkpoint_format_loaded => pop(s, checkpoint_format_load_begin),
+        checkpoint_shipout_end => pop(s, checkpoint_shipout_begin),
+        checkpoint_font_embed_end => pop(s, checkpoint_font_embed_begin),
+        checkpoint_image_end => pop(s, checkpoint_image_begin),
+        checkpoint_stats => note(.engine, "stats", detail),
+        else => {},
+    }
+}
+
+fn push(s: *State, id: c_int, cat: Category, name: []const u8, detail: ?[]const u8) void {
+    if (s.open_len == max_open) return;
+    s.open[s.open_len] = .{ .begin_id = id, .cat = cat, .name = name, .detail = dupe(detail), .start_ns = clock_ns() };
+    s.open_len += 1;
+}
+
+// close the innermost span opened by begin_id. spans above it were left
+// open by an engine that aborted; they are dropped.
+fn pop(s: *State, begin_id: c_int) void {
+    var i = s.open_len;
+    while (i > 0) {
+        i -= 1;
+        if (s.open[i].begin_id != begin_id) continue;
+        const o = s.open[i];
+        for (s.open[i + 1 .. s.open_len]) |dropped| if (dropped.detail) |d| alloc.free(d);
+        s.open_len = i;
+        record(o.cat, o.name, o.detail, o.start_ns, clock_ns());
+        return;
+    }
+}
+
+fn dupe(detail: ?[]const u8) ?[]const u8 {
+    const d = detail orelse return null;
+    return alloc.dupe(u8, d) catch null;
+}
+
+fn record(cat: Category, name: []const u8, detail: ?[]const u8, start_ns: i128, end_ns: i128) void {
+    const s = if (state) |*s| s else return;
+    s.events.append(alloc, .{ .cat = cat, .name = name, .detail = detail, .start_ns = start_ns, .end_ns = end_ns }) catch {
+        if (detail) |d| alloc.free(d);
+    };
+}
+
+// write what was recorded to path and stop recording
+pub fn finish(io: Io, path: []const u8) void {
+    const s = if (state) |*s| s else return;
+    defer discard();
+
+    var out: std.ArrayList(u8) = .empty;
+    defer out.deinit(alloc);
+    write_json(&out, s) catch {
+        Log.log(io, "eztex", .warn, "trace too large to write", .{});
+        return;
+    };
+
+    const file = if (std.fs.path.isAbsolute(path))
+        Io.Dir.createFileAbsolute(io, path, .{})
+    else
+        Io.Dir.cwd().createFile(io, path, .{});
+    const f = file catch |err| {
+        Log.log(io, "eztex", .warn, "cannot write trace '{s}': {}", .{ path, err });
+        return;
+    };
+    defer f.close(io);
+    f.writeStreamingAll(io, out.items) catch |err| {
+        Log.log(io, "eztex", .warn, "cannot write trace '{s}': {}", .{ path, err });
+        return;
+    };
+    Log.dbg(io, "eztex", "trace: {d} spans written to {s}", .{ s.events.items.len, path });
+}
+
+fn write_json(out: *std.ArrayList(u8), s: *const State) !void {
+    try out.appendSlice(alloc, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    for (s.events.items, 0..) |e, i| {
+        if (i > 0) try out.append(alloc, ',');
+        // timestamps and durations are microseconds from start()
+        const ph = if (e.instant) "i" else "X";
+        try out.print(alloc, "\n{{\"ph\":\"{s}\",\"pid\":1,\"tid\":1,\"cat\":\"{s}\",\"name\":", .{ ph, @tagName(e.cat) });
+        try write_string(out, e.name);
+        try out.print(alloc, ",\"ts\":{d}", .{@divTrunc(e.start_ns - s.epoch_ns, 1000)});
+        if (e.instant) {
+            // scoped to the whole trace, drawn as a line across it
+            try out.appendSlice(alloc, ",\"s\":\"g\"");
+        } else {
+            try out.print(alloc, ",\"dur\":{d}", .{@divTrunc(e.end_ns - e.start_ns, 1000)});
+        }
+        if (e.detail != null or e.bytes != null) {
+            try out.appendSlice(alloc, ",\"args\":{");
+            if (e.detail) |d| {
+                try out.appendSlice(alloc, "\"detail\":");
+                try write_string(out, d);
+            }
+            if (e.bytes) |n| try out.print(alloc, "{s}\"bytes\":{d}", .{ if (e.detail != null) "," else "", n });
+            try out.append(alloc, '}');
+        }
+        try out.append(alloc, '}');
+    }
+    try out.appendSlice(alloc, "\n]}\n");
+}
+
+fn write_string(out: *std.ArrayList(u8), text: []const u8) !void {
+    try out.append(alloc, '"');
+    for (text) |ch| switch (ch) {
+        '"' => try out.appendSlice(alloc, "\\\""),
+        '\\' => try out.appendSlice(alloc, "\\\\"),
+        0...0x1f => try out.print(alloc, "\\u{x:0>4}", .{ch}),
+        else => try out.append(alloc, ch),
+    };
+    try out.append(alloc, '"');
+}
+
+fn discard() void {
+    const s = if (state) |*s| s else return;
+    for (s.events.items) |e| if (e.detail) |d| alloc.free(d);
+    s.events.deinit(alloc);
+    for (s.open[0..s.open_len]) |o| if (o.detail) |d| alloc.free(d);
+    state = null;
+}
+
+test "checkpoints pair into spans and render as trace events" {
+    start();
+    defer discard();
+
+    checkpoint(checkpoint_format_load_begin, null);
+    checkpoint(checkpoint_format_loaded, null);
+    checkpoint(checkpoint_shipout_begin, "page 1");
+    // an image span the engine never closed, then the page ends
+    checkpoint(checkpoint_image_begin, "a.png");
+    checkpoint(checkpoint_shipout_end, null);
+    span(.bibtex, "bibtex", "doc\"1\".aux", now());
+    checkpoint(checkpoint_stats, "hyphenation cache: 3 words");
+    span_bytes(.bundle, "fetch", "a.sty", now(), 1234);
+    note_bytes(.compile, "peak rss", 5678);
+
+    const s = &state.?;
+    try std.testing.expectEqual(@as(usize, 6), s.events.items.len);
+    try std.testing.expectEqual(@as(usize, 0), s.open_len);
+    try std.testing.expectEqualStrings("format load", s.events.items[0].name);
+    try std.testing.expectEqualStrings("page 1", s.events.items[1].detail.?);
+
+    var out: std.ArrayList(u8) = .empty;
+    defer out.deinit(alloc);
+    try write_json(&out, s);
+    try std.testing.expect(std.mem.indexOf(u8, out.items, "\"name\":\"ship_out\"") != null);
+    try std.testing.expect(std.mem.indexOf(u8, out.items, "\"detail\":\"doc\\\"1\\\".aux\"") != null);
+    try std.testing.expect(std.mem.indexOf(u8, out.items, "{\"ph\":\"i\",") != null);
+    try std.testing.expect(std.mem.indexOf(u8, out.items, "\"args\":{\"detail\":\"a.sty\",\"bytes\":1234}") != null);
+    try std.testing.expect(std.mem.indexOf(u8, out.items, "\"args\":{\"bytes\":5678}") != null);
+}
@@ -3,6 +3,9 @@
 // Falls back to mtime polling on unsupported platforms.
 // Not available on WASM (compile-time gated).
 // Backend is comptime-selected to avoid pulling in inotify symbols on macOS or vice versa.
+// Events only say that something under the watch root changed; do_watch
+// recompiles when the content of a file the last compile read has changed
+// (see InputDigests).
 
 const Watcher = @This();
 const std = @import("std");
@@ -16,6 +19,9 @@ const Host = @import("Host.zig");
 const Log = @import("Log.zig");
 const Compiler = @import("Compiler.zig");
 const Project = @import("Project.zig");
+const Bridge = @import("Engine.zig");
+const Runtime = @import("Runtime.zig");
+const Digest = @import("Digest.zig");
 
 // file extensions we watch for changes
 const watched_extensions = [_][]const u8{ ".tex", ".bib", ".bst", ".cls", ".sty", ".def", ".cfg", ".clo", ".dtx", ".fd", ".zon" };
@@ -75,6 +81,9 @@ const KqueueState = struct {
 const InotifyState = struct {
     ifd: i32,
     watch_descs: std.ArrayList(WatchDesc),
+    // names of files added one by one (watch_file): events for them count
+    // whatever their extension. keys are owned
+    file_names: std.StringHashMapUnmanaged(void) = .empty,
 
     const WatchDesc = struct {
         wd: i32,
@@ -107,11 +116,13 @@ pub fn init(allocator: Allocator) !Watcher {
         },
         .inotify => .{
             .ifd = ifd: {
-                const fd = c.inotify_init1(0);
+                // non-blocking, so inotify_wait can drain whatever is queued
+                const fd = c.inotify_init1(std.os.linux.IN.NONBLOCK);
                 if (fd == -1) return error.InotifyInitFailed;
                 break :ifd fd;
             },
             .watch_descs = std.ArrayList(InotifyState.WatchDesc).empty,
+            .file_names = .empty,
         },
         .poll => .{
             .files = std.ArrayList(PollState.PollFile).empty,
@@ -136,6 +147,8 @@ pub fn deinit(self: *Watcher) void {
                 self.allocator.free(wd.dir_path);
             }
             self.state.watch_descs.deinit(self.allocator);
+            clear_file_names(self.allocator, &self.state);
+            self.state.file_names.deinit(self.allocator);
             _ = posix.system.close(self.state.ifd);
         },
         .poll => {
@@ -176,15 +189,26 @@ pub fn watch_dir_recursive(self: *Watcher, io: Io, dir_path: []const u8) !void {
     }
 }
 
-// add a single file to the watch set.
-pub fn watch_file(self: *Watcher, file_path: []const u8) !void {
+// add a single file to the watch set, whatever its extension.
+pub fn watch_file(self: *Watcher, io: Io, file_path: []const u8) !void {
     switch (active_backend) {
         .kqueue => try kqueue_add_file(self.allocator, &self.state, file_path),
-        .inotify => {
-            const dir = fs.path.dirname(file_path) orelse ".";
-            try self.watch_dir(dir);
-        },
-        .poll => try poll_add_file(self.allocator, &self.state, file_path),
+        .inotify => try inotify_add_file(self.allocator, &self.state, file_path),
+        .poll => try poll_add_file(self.allocator, io, &self.state, file_path),
+    }
+}
+
+// watch exactly the files in `paths` (what a compile opened), and `dir`
+// itself for watchable files created in it, so that the cost follows the
+// document rather than everything under the project root.
+pub fn watch_inputs(self: *Watcher, io: Io, paths: []const []const u8, dir: []const u8) !void {
+    for (paths) |path| try self.watch_file(io, path);
+    switch (active_backend) {
+        // a directory's vnode sees NOTE_WRITE when an entry is added
+        .kqueue => try kqueue_add_file(self.allocator, &self.state, dir),
+        .inotify => try inotify_watch_dir(self.allocator, &self.state, dir),
+        // and its mtime moves
+        .poll => try poll_add_file(self.allocator, io, &self.state, dir),
     }
 }
 
@@ -214,6 +238,7 @@ pub fn reset(self: *Watcher) void {
                 self.allocator.free(wd.dir_path);
             }
             self.state.watch_descs.clearRetainingCapacity();
+            clear_file_names(self.allocator, &self.state);
         },
         .poll => {
             for (self.state.files.items) |f| {
@@ -311,6 +336,21 @@ fn inotify_watch_dir(allocator: Allocator, ino: *InotifyState, dir_path: []const
     try ino.watch_descs.append(allocator, .{ .wd = wd, .dir_path = path_owned });
 }
 
+fn inotify_add_file(allocator: Allocator, ino: *InotifyState, file_path: []const u8) !void {
+    try inotify_watch_dir(allocator, ino, fs.path.dirname(file_path) orelse ".");
+    const name = fs.path.basename(file_path);
+    if (ino.file_names.contains(name)) return;
+    const owned = try allocator.dupe(u8, name);
+    errdefer allocator.free(owned);
+    try ino.file_names.put(allocator, owned, {});
+}
+
+fn clear_file_names(allocator: Allocator, ino: *InotifyState) void {
+    var it = ino.file_names.keyIterator();
+    while (it.next()) |key| allocator.free(key.*);
+    ino.file_names.clearRetainingCapacity();
+}
+
 fn inotify_wait(ino: *InotifyState, timeout_ms: u32) !bool {
     var poll_fds = [_]posix.pollfd{.{
         .fd = ino.ifd,
@@ -321,6 +361,8 @@ fn inotify_wait(ino: *InotifyState, timeout_ms: u32) !bool {
     const n = try posix.poll(&poll_fds, @intCast(timeout_ms));
     if (n == 0) return false;
 
+    // an editor save is a burst of events (write, rename, swap file); take
+    // every one already queued, so the burst wakes the caller once
     var buf: [4096]u8 align(@alignOf(std.os.linux.inotify_event)) = undefined;
     var found_relevant = false;
     while (true) {
@@ -336,7 +378,7 @@ fn inotify_wait(ino: *InotifyState, timeout_ms: u32) !bool {
             const event: *const std.os.linux.inotify_event = @ptrCast(@alignCast(&buf[offset]));
             const name = event.getName();
             if (name) |n_slice| {
-                if (is_watched_extension(n_slice)) {
+                if (is_watched_extension(n_slice) or ino.file_names.contains(n_slice)) {
                     found_relevant = true;
                 }
             } else {
@@ -344,7 +386,6 @@ fn inotify_wait(ino: *InotifyState, timeout_ms: u32) !bool {
             }
             offset += @sizeOf(std.os.linux.inotify_event) + event.len;
         }
-        break;
     }
     return found_relevant;
 }
@@ -401,28 +442,95 @@ pub fn is_watched_extension(name: []const u8) bool {
     return false;
 }
 
+// -- input digests --
+
+// Digest of each file the last compile read from the project (World's open
+// log), taken once the compile is done, so that its own outputs (.aux, .toc)
+// are recorded as it left them. An event then recompiles only if one of these
+// files reads differently: saving without a change, editor swap and backup
+// files, and the compile's own writes all fire events but change nothing here.
+pub const InputDigests = struct {
+    // path -> digest, null for a file that could not be read; keys are owned
+    files: std.StringArrayHashMapUnmanaged(?[32]u8) = .empty,
+
+    pub fn deinit(self: *InputDigests, allocator: Allocator) void {
+        self.clear(allocator);
+        self.files.deinit(allocator);
+    }
+
+    pub fn clear(self: *InputDigests, allocator: Allocator) void {
+        for (self.files.keys()) |key| allocator.free(key);
+        self.files.clearRetainingCapacity();
+    }
+
+    pub fn count(self: *const InputDigests) usize {
+        return self.files.count();
+    }
+
+    // replace the set with paths as they read now
+    pub fn record(self: *InputDigests, allocator: Allocator, io: Io, paths: []const []const u8) !void {
+        self.clear(allocator);
+        try self.files.ensureTotalCapacity(allocator, paths.len);
+        for (paths) |path| {
+            const owned = try allocator.dupe(u8, path);
+            self.files.putAssumeCapacity(owned, digest_file(io, path));
+        }
+    }
+
+    // the first recorded file whose content differs from its digest, or that
+    // appeared or went away; null if none did
+    pub fn first_changed(self: *const InputDigests, io: Io) ?[]const u8 {
+        var it = self.files.iterator();
+        while (it.next()) |e| {
+            const now = digest_file(io, e.key_ptr.*);
+            const was = e.value_ptr.*;
+            if ((now == null) != (was == null)) return e.key_ptr.*;
+            if (now != null and !std.mem.eql(u8, &now.?, &was.?)) return e.key_ptr.*;
+        }
+        return null;
+    }
+};
+
+// BLAKE3: these digests never leave this process
+fn digest_file(io: Io, path: []const u8) ?[32]u8 {
+    return Digest.hashFile(Digest.Internal, io, path);
+}
+
 // -- watch command (integrated from main.zig) --
 
-pub fn do_watch(io: Io, config: Compiler.CompileConfig) u8 {
+pub fn do_watch(io: Io, watch_config: Compiler.CompileConfig) u8 {
     if (comptime Host.is_wasm) {
         Log.log(io, "eztex", .err, "watch mode is not supported on WASM", .{});
         return 1;
     }
 
+    // each PDF is replaced within moments, so speed beats size
+    var config = watch_config;
+    if (config.pdf_profile == null) config.pdf_profile = .fast;
+
     const input_file = config.input_file orelse {
         Log.log(io, "eztex", .err, "no input file specified for watch", .{});
         return 1;
     };
 
     const project = Project.resolve_project_input(io, std.heap.c_allocator, input_file, config.verbose) orelse return 1;
-    defer if (project.temp_dir) |tmp| {
-        Io.Dir.cwd().deleteTree(io, tmp) catch {};
-    };
+    defer project.deinit();
 
-    Io.Dir.cwd().access(io, project.tex_file, .{}) catch {
-        Log.log(io, "eztex", .err, "input file '{s}' not found", .{project.tex_file});
-        return 1;
-    };
+    if (project.archive == null) {
+        Io.Dir.cwd().access(io, project.tex_file, .{}) catch {
+            Log.log(io, "eztex", .err, "input file '{s}' not found", .{project.tex_file});
+            return 1;
+        };
+        // resolved once: a project directory is not scanned again for every
+        // recompile. a zip is indexed again, as it may have been replaced
+        config.input_file = project.tex_file;
+    }
+
+    // stay warm between recompiles like `eztex serve`: the bundle store and
+    // its index outlive each compile, next to the format bytes and Layout's
+    // font caches, which the process keeps anyway. a recompile then resets
+    // only the engine's per-document state before the TeX run starts.
+    if (Runtime.instance) |rt| rt.resident = true;
 
     const watch_root = project.project_dir orelse std.fs.path.dirname(project.tex_file) orelse ".";
 
@@ -432,15 +540,17 @@ pub fn do_watch(io: Io, config: Compiler.CompileConfig) u8 {
     };
     defer watcher.deinit();
 
-    watcher.watch_dir_recursive(io, watch_root) catch |err| {
-        Log.log(io, "eztex", .err, "failed to watch directory '{s}': {}", .{ watch_root, err });
-        return 1;
-    };
+    // a zip's members are not on disk; its own directory is watched instead
+    const main_dir = if (project.archive != null) watch_root else std.fs.path.dirname(project.tex_file) orelse ".";
 
-    Log.log(io, "eztex", .info, "watching '{s}' ({d} files) for changes... (Ctrl+C to stop)", .{ watch_root, watcher.watched_count() });
+    var digests: InputDigests = .{};
+    defer digests.deinit(std.heap.c_allocator);
 
     Log.log(io, "eztex", .info, "initial compile...", .{});
-    _ = Compiler.compile(io, &config, null);
+    var ok = compile_and_digest(io, &config, &digests);
+    rewatch(io, &watcher, &digests, ok, watch_root, main_dir);
+
+    Log.log(io, "eztex", .info, "watching '{s}' ({d} watches) for changes... (Ctrl+C to stop)", .{ watch_root, watcher.watched_count() });
 
     const debounce_ms: u32 = 200;
     while (true) {
@@ -456,17 +566,55 @@ pub fn do_watch(io: Io, config: Compiler.CompileConfig) u8 {
             if (!more) break;
         }
 
-        Log.log(io, "eztex", .info, "change detected, recompiling...", .{});
-        _ = Compiler.compile(io, &config, null);
+        // after a failed compile an input may be missing that is only now
+        // being written, and it is not among the digests: recompile on any event
+        if (ok and digests.count() > 0) {
+            const path = digests.first_changed(io) orelse {
+                Log.dbg(io, "eztex", "no input changed, not recompiling", .{});
+                continue;
+            };
+            Log.log(io, "eztex", .info, "'{s}' changed, recompiling...", .{path});
+        } else {
+            Log.log(io, "eztex", .info, "change detected, recompiling...", .{});
+        }
+        ok = compile_and_digest(io, &config, &digests);
+        rewatch(io, &watcher, &digests, ok, watch_root, main_dir);
+    }
+}
 
-        watcher.reset();
+// watch the files the last compile read, plus the main file's directory for
+// new ones. after a failed compile, or with nothing recorded, watch the whole
+// root instead: what the document was missing may turn up anywhere in it.
+fn rewatch(io: Io, watcher: *Watcher, digests: *const InputDigests, ok: bool, watch_root: []const u8, main_dir: []const u8) void {
+    watcher.reset();
+    if (ok and digests.count() > 0) {
+        watcher.watch_inputs(io, digests.files.keys(), main_dir) catch |err| {
+            Log.log(io, "eztex", .warn, "failed to watch inputs: {}", .{err});
+        };
+        Log.dbg(io, "eztex", "watching {d} inputs ({d} watches)", .{ digests.count(), watcher.watched_count() });
+    } else {
         watcher.watch_dir_recursive(io, watch_root) catch |err| {
-            Log.log(io, "eztex", .warn, "failed to re-watch directory: {}", .{err});
+            Log.log(io, "eztex", .warn, "failed to watch directory '{s}': {}", .{ watch_root, err });
         };
-        Log.dbg(io, "eztex", "re-watching {d} files", .{watcher.watched_count()});
+        Log.dbg(io, "eztex", "watching '{s}' ({d} watches)", .{ watch_root, watcher.watched_count() });
     }
 }
 
+// compile with World's open log on, then digest what the compile read
+fn compile_and_digest(io: Io, config: *const Compiler.CompileConfig, digests: *InputDigests) bool {
+    const world = Bridge.get_world();
+    world.begin_open_log();
+    defer world.end_open_log();
+    const code = Compiler.compile(io, config, null);
+
+    digests.record(std.heap.c_allocator, io, world.open_log.?.keys()) catch |err| {
+        Log.log(io, "eztex", .warn, "failed to digest inputs: {}", .{err});
+        digests.clear(std.heap.c_allocator);
+    };
+    Log.dbg(io, "eztex", "digested {d} inputs", .{digests.count()});
+    return code == 0;
+}
+
 // -- tests --
 
 test "is_watched_extension" {
@@ -482,6 +630,38 @@ test "is_watched_extension" {
     try expect(!is_watched_extension("Makefile"));
 }
 
+test "InputDigests reports only a real content change" {
+    const allocator = std.testing.allocator;
+    const io = std.testing.io;
+    var tmp_dir = std.testing.tmpDir(.{});
+    defer tmp_dir.cleanup();
+    try tmp_dir.dir.writeFile(io, .{ .sub_path = "main.tex", .data = "\\input{intro}" });
+    try tmp_dir.dir.writeFile(io, .{ .sub_path = "intro.tex", .data = "Hello." });
+
+    var main_buf: [256]u8 = undefined;
+    var intro_buf: [256]u8 = undefined;
+    const main_path = try std.fmt.bufPrint(&main_buf, ".zig-cache/tmp/{s}/main.tex", .{&tmp_dir.sub_path});
+    const intro_path = try std.fmt.bufPrint(&intro_buf, ".zig-cache/tmp/{s}/intro.tex", .{&tmp_dir.sub_path});
+
+    var digests: InputDigests = .{};
+    defer digests.deinit(allocator);
+    try digests.record(allocator, io, &.{ main_path, intro_path });
+    try std.testing.expectEqual(@as(usize, 2), digests.count());
+    try std.testing.expect(digests.first_changed(io) == null);
+
+    // rewritten with the same bytes, as a save without an edit does
+    try tmp_dir.dir.writeFile(io, .{ .sub_path = "intro.tex", .data = "Hello." });
+    // a file the compile never read
+    try tmp_dir.dir.writeFile(io, .{ .sub_path = ".main.tex.swp", .data = "swap" });
+    try std.testing.expect(digests.first_changed(io) == null);
+
+    try tmp_dir.dir.writeFile(io, .{ .sub_path = "intro.tex", .data = "Hello, world." });
+    try std.testing.expectEqualStrings(intro_path, digests.first_changed(io).?);
+
+    try tmp_dir.dir.deleteFile(io, "intro.tex");
+    try std.testing.expectEqualStrings(intro_path, digests.first_changed(io).?);
+}
+
 // Io parameter for wait_for_event dispatch
 test "poll_wait with io" {
     // This test is a placeholder to ensure poll_wait signature is correct
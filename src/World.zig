@@ -8,6 +8,7 @@
 // Nonzero uintptr_t = index+1 into the handle table.
 
 const std = @import("std");
+const builtin = @import("builtin");
 const fs = std.fs;
 const Io = std.Io;
 const posix = std.posix;
@@ -15,11 +16,18 @@ const Log = @import("Log.zig");
 const Host = @import("Host.zig");
 const is_wasm = Host.is_wasm;
 const BundleStore = @import("BundleStore.zig");
+const MemStats = @import("MemStats.zig");
+const ZipArchive = @import("ZipArchive.zig");
+const Flate = @import("Flate.zig");
 
 const World = @This();
 
 // -- public types --
 
+// read copies of input files and memory-backed outputs, counted as I/O
+// buffers (see MemStats.zig)
+pub const io_alloc = MemStats.allocator(.io);
+
 pub const Handle = usize;
 pub const FileFormat = c_int;
 pub const INVALID_HANDLE: Handle = 0;
@@ -53,7 +61,12 @@ pub const SEEK_SET: c_int = 0;
 pub const SEEK_CUR: c_int = 1;
 pub const SEEK_END: c_int = 2;
 
-const MAX_HANDLES: usize = 256;
+
+// file-backed inputs at least this large are mmapped instead of copied to the heap
+const mmap_threshold: usize = 256 * 1024;
+
+// size of the chunks a deflated input is inflated in
+const inflate_chunk_len: usize = 64 * 1024;
 
 // -- slot types --
 
@@ -63,22 +76,29 @@ pub const InputSlot = struct {
     // memory-backed input (null when file-backed)
     mem_data: ?[]const u8 = null,
     mem_pos: usize = 0,
-    // true if this slot owns mem_data (lazily loaded from file)
-    owns_mem: bool = false,
-    name: [512]u8 = @splat(0),
-    name_len: usize = 0,
+    // frees mem_data on close when the slot owns it (lazily loaded from
+    // file, or a fetched buffer adopted by alloc_owned_input)
+    mem_owner: ?std.mem.Allocator = null,
+    // native only: read-only mapping backing mem_data for large files, so the
+    // pages are faulted in on demand and shared with the page cache
+    mapped: ?[]align(std.heap.page_size_min) const u8 = null,
+    // a deflated input (see alloc_deflated_input) is inflated a chunk at a
+    // time: mem_data is then the chunk in inflate_buf, which starts
+    // inflate_base bytes into the inflated content. seeking back inflates
+    // the rest of it whole.
+    inflater: ?*anyopaque = null,
+    inflate_buf: ?[]u8 = null,
+    inflate_base: usize = 0,
+    deflated: []const u8 = &.{},
+    raw_len: usize = 0,
+    // owned by World.names, valid until the next reset_io
+    name: []const u8 = "",
     ungetc_byte: ?u8 = null,
     // mtime in seconds since epoch (0 for memory/bundle inputs without real filesystem backing)
     mtime_sec: i64 = 0,
 
-    pub fn set_name(self: *InputSlot, n: []const u8) void {
-        const copy_len = @min(n.len, self.name.len);
-        @memcpy(self.name[0..copy_len], n[0..copy_len]);
-        self.name_len = copy_len;
-    }
-
     pub fn get_name(self: *const InputSlot) []const u8 {
-        return self.name[0..self.name_len];
+        return self.name;
     }
 
     // Helper: ensure file-backed input is loaded into memory for seeking
@@ -94,67 +114,121 @@ pub const InputSlot = struct {
             self.file = null;
             return;
         }
-        const data = std.heap.c_allocator.alloc(u8, size) catch return error.OutOfMemory;
+        if (!is_wasm and size >= mmap_threshold) {
+            if (posix.mmap(null, size, posix.PROT.READ, .{ .TYPE = .PRIVATE }, f.handle, 0)) |mapped| {
+                f.close(io);
+                self.file = null;
+                self.mapped = mapped;
+                self.mem_data = mapped;
+                self.mem_pos = 0;
+                return;
+            } else |_| {} // fall back to a heap copy
+        }
+        const data = io_alloc.alloc(u8, size) catch return error.OutOfMemory;
         const bytes_read = f.readPositionalAll(io, data, 0) catch |err| {
-            std.heap.c_allocator.free(data);
+            io_alloc.free(data);
             return err;
         };
         f.close(io);
         self.file = null;
         self.mem_data = data[0..bytes_read];
         self.mem_pos = 0;
-        self.owns_mem = true;
+        self.mem_owner = io_alloc;
+    }
+
+    // inflate the next chunk of a deflated input into mem_data. false at
+    // the end of it, and for any other input.
+    fn inflate_next(self: *InputSlot) !bool {
+        const dc = self.inflater orelse return false;
+        const buf = self.inflate_buf.?;
+        self.inflate_base += self.mem_data.?.len;
+        var n: u64 = buf.len;
+        if (Flate.tectonic_flate_decompress_chunk(dc, buf.ptr, &n) != 0) return error.ReadError;
+        self.mem_data = buf[0..@intCast(n)];
+        self.mem_pos = 0;
+        if (n > 0) return true;
+        if (self.inflate_base != self.raw_len) return error.ReadError;
+        return false;
+    }
+
+    // trade a deflated input's chunks for its whole content
+    fn inflate_whole(self: *InputSlot) !void {
+        const data = Flate.inflate_exact(io_alloc, self.deflated, self.raw_len) catch return error.ReadError;
+        self.end_inflate();
+        self.mem_data = data;
+        self.mem_owner = io_alloc;
+        self.mem_pos = 0;
+        self.inflate_base = 0;
+    }
+
+    fn end_inflate(self: *InputSlot) void {
+        Flate.tectonic_flate_free_decompressor(self.inflater);
+        self.inflater = null;
+        if (self.inflate_buf) |buf| io_alloc.free(buf);
+        self.inflate_buf = null;
+        self.mem_data = null;
     }
 
     pub fn read(self: *InputSlot, io: Io, dest: []u8) !usize {
-        if (self.mem_data) |data| {
-            if (self.mem_pos >= data.len) return 0;
-            const avail = data.len - self.mem_pos;
-            const n = @min(dest.len, avail);
-            @memcpy(dest[0..n], data[self.mem_pos..][0..n]);
-            self.mem_pos += n;
-            return n;
-        }
         // Lazy-load file into memory on first read, then use mem_data path
-        if (self.file) |f| {
-            const stat = f.stat(io) catch return 0;
-            const size: usize = @intCast(@min(stat.size, std.math.maxInt(usize)));
-            // TODO: add a configurable maximum file size for file-backed inputs
-            if (size == 0) {
-                f.close(io);
-                self.file = null;
-                return 0;
-            }
-            const data = std.heap.c_allocator.alloc(u8, size) catch return error.OutOfMemory;
-            const bytes_read = f.readPositionalAll(io, data, 0) catch |err| {
-                std.heap.c_allocator.free(data);
-                return err;
-            };
-            f.close(io);
-            self.file = null;
-            self.mem_data = data[0..bytes_read];
-            self.mem_pos = 0;
-            self.owns_mem = true;
-            // Recurse into mem_data path
-            return self.read(io, dest);
+        if (self.mem_data == null) try self.ensure_mem_loaded(io);
+        var data = self.mem_data orelse return 0;
+        if (self.mem_pos >= data.len) {
+            if (!try self.inflate_next()) return 0;
+            data = self.mem_data.?;
+        }
+        const avail = data.len - self.mem_pos;
+        const n = @min(dest.len, avail);
+        @memcpy(dest[0..n], data[self.mem_pos..][0..n]);
+        self.mem_pos += n;
+        return n;
+    }
+
+    // Unread bytes of the input, without copying. Pair with consume().
+    // A deflated input only shows the rest of its current chunk.
+    pub fn peek(self: *InputSlot, io: Io) ![]const u8 {
+        if (self.mem_data == null) try self.ensure_mem_loaded(io);
+        var data = self.mem_data orelse return &.{};
+        if (self.mem_pos >= data.len) {
+            if (!try self.inflate_next()) return &.{};
+            data = self.mem_data.?;
         }
-        return 0;
+        return data[@min(self.mem_pos, data.len)..];
+    }
+
+    pub fn consume(self: *InputSlot, n: usize) void {
+        const data = self.mem_data orelse return;
+        self.mem_pos = @min(self.mem_pos + n, data.len);
     }
 
     pub fn get_size(self: *InputSlot, io: Io) !usize {
+        if (self.inflater != null) return self.raw_len;
         if (self.mem_data) |data| return data.len;
         const stat = try self.file.?.stat(io);
         return @intCast(@min(stat.size, std.math.maxInt(usize)));
     }
 
     pub fn get_pos(self: *InputSlot, io: Io) !u64 {
-        if (self.mem_data != null) return @intCast(self.mem_pos);
+        if (self.mem_data != null) return @intCast(self.inflate_base + self.mem_pos);
         // Lazy-load file into memory so we can track position
         try self.ensure_mem_loaded(io);
         return @intCast(self.mem_pos);
     }
 
     pub fn seek_to(self: *InputSlot, io: Io, pos: u64) !void {
+        if (self.inflater != null) {
+            const target: usize = @intCast(@min(pos, self.raw_len));
+            if (target < self.inflate_base) {
+                try self.inflate_whole();
+            } else {
+                // forward: inflate up to the chunk holding target
+                while (target > self.inflate_base + self.mem_data.?.len) {
+                    if (!try self.inflate_next()) break;
+                }
+                self.mem_pos = @min(target - self.inflate_base, self.mem_data.?.len);
+                return;
+            }
+        }
         if (self.mem_data) |data| {
             self.mem_pos = @min(@as(usize, @intCast(pos)), data.len);
             return;
@@ -167,6 +241,11 @@ pub const InputSlot = struct {
     }
 
     pub fn seek_by(self: *InputSlot, io: Io, offset: i64) !void {
+        if (self.inflater != null) {
+            const cur: i64 = @intCast(self.inflate_base + self.mem_pos);
+            const new = cur + offset;
+            return self.seek_to(io, if (new < 0) 0 else @intCast(new));
+        }
         if (self.mem_data) |data| {
             const cur: i64 = @intCast(self.mem_pos);
             const new = cur + offset;
@@ -183,46 +262,71 @@ pub const InputSlot = struct {
     }
 
     pub fn close(self: *InputSlot, io: Io) void {
+        if (self.inflater != null) self.end_inflate();
         if (self.file) |f| f.close(io);
-        // Only free if we own the memory (lazily loaded from file)
-        if (self.owns_mem) {
-            if (self.mem_data) |data| {
-                std.heap.c_allocator.free(data);
-            }
+        if (self.mapped) |mapped| posix.munmap(mapped);
+        // Only free if we own the memory
+        if (self.mem_owner) |owner| {
+            if (self.mem_data) |data| owner.free(data);
         }
         self.* = .{};
     }
 };
 
+// zlib gzFile API, used to stream gzip outputs (resolved at link time via build.zig zlib_lib)
+extern fn gzdopen(fd: c_int, mode: [*:0]const u8) ?*anyopaque;
+extern fn gzwrite(gz: *anyopaque, buf: [*]const u8, len: c_uint) c_int;
+extern fn gzclose(gz: *anyopaque) c_int;
+
 pub const OutputSlot = struct {
-    file: Io.File,
-    name: [512]u8 = @splat(0),
-    name_len: usize = 0,
+    // null for memory-backed outputs (see mem_buf)
+    file: ?Io.File,
+    // owned by World.names, valid until the next reset_io
+    name: []const u8 = "",
     is_stdout: bool = false,
-    // When is_gz is true, all writes go into gz_buf; at close time the buffer
-    // is gzip-compressed and written to `file` via gzdopen.
+    // When is_gz is true, flushes go through the gzip stream `gz` (opened on a
+    // dup of `file`), so compression is incremental and memory stays bounded.
+    // If the stream could not be opened (windows, dup/gzdopen failure) the
+    // data is written to `file` uncompressed.
     is_gz: bool = false,
-    gz_buf: ?*std.ArrayList(u8) = null,
-    // Write buffer for non-gz outputs. Accumulates data between flushes.
+    gz: ?*anyopaque = null,
+    // When set, all writes go into mem_buf and nothing touches the filesystem.
+    // At close time the buffer is handed to World as its memory output.
+    mem_buf: ?*std.ArrayList(u8) = null,
+    // When set, writes are dropped (see World.discard_log).
+    discard: bool = false,
+    // Index into World.digest_extensions when this is one of the outputs
+    // World digests (see watch_digests); the bytes are hashed as they are
+    // flushed, or at close for memory outputs.
+    digest_index: ?u8 = null,
+    digest: std.hash.Wyhash = .init(0),
+    digest_len: u64 = 0,
+    // Write buffer for non-memory outputs. Accumulates data between flushes.
     write_buf: [4096]u8 = undefined,
     write_len: usize = 0,
 
-    pub fn set_name(self: *OutputSlot, n: []const u8) void {
-        const copy_len = @min(n.len, self.name.len);
-        @memcpy(self.name[0..copy_len], n[0..copy_len]);
-        self.name_len = copy_len;
+    pub fn get_name(self: *const OutputSlot) []const u8 {
+        return self.name;
     }
 
-    pub fn get_name(self: *const OutputSlot) []const u8 {
-        return self.name[0..self.name_len];
+    fn open_gz(self: *OutputSlot) void {
+        if (builtin.os.tag == .windows) return;
+        const f = self.file orelse return;
+        const dup_result = posix.system.dup(f.handle);
+        if (dup_result < 0) return;
+        const dup_fd: c_int = @intCast(dup_result);
+        self.gz = gzdopen(dup_fd, "wb") orelse {
+            _ = posix.system.close(dup_fd);
+            return;
+        };
     }
 
     // Append data to the write buffer. Flushes automatically when buffer is full.
     // For stdout, also flushes on newline to provide progressive output.
     pub fn write(self: *OutputSlot, io: Io, data: []const u8) Io.File.Writer.Error!void {
-        if (self.is_gz) {
-            const buf = self.gz_buf orelse return error.Unexpected;
-            buf.appendSlice(std.heap.c_allocator, data) catch return error.SystemResources;
+        if (self.discard) return;
+        if (self.mem_buf) |buf| {
+            buf.appendSlice(io_alloc, data) catch return error.SystemResources;
             return;
         }
 
@@ -248,9 +352,9 @@ pub const OutputSlot = struct {
     }
 
     pub fn writeByte(self: *OutputSlot, io: Io, byte: u8) Io.File.Writer.Error!void {
-        if (self.is_gz) {
-            const buf = self.gz_buf orelse return error.Unexpected;
-            buf.append(std.heap.c_allocator, byte) catch return error.SystemResources;
+        if (self.discard) return;
+        if (self.mem_buf) |buf| {
+            buf.append(io_alloc, byte) catch return error.SystemResources;
             return;
         }
 
@@ -266,28 +370,109 @@ pub const OutputSlot = struct {
     }
 
     pub fn flush(self: *OutputSlot, io: Io) Io.File.Writer.Error!void {
-        if (self.is_gz) return;
         if (self.write_len == 0) return;
-        try self.file.writeStreamingAll(io, self.write_buf[0..self.write_len]);
+        self.note_digest(self.write_buf[0..self.write_len]);
+        if (self.gz) |gz| {
+            const written = gzwrite(gz, &self.write_buf, @intCast(self.write_len));
+            if (written < 0 or @as(usize, @intCast(written)) != self.write_len) return error.InputOutput;
+            self.write_len = 0;
+            return;
+        }
+        const f = self.file orelse return;
+        try f.writeStreamingAll(io, self.write_buf[0..self.write_len]);
         self.write_len = 0;
     }
 
+    pub fn note_digest(self: *OutputSlot, data: []const u8) void {
+        if (self.digest_index == null) return;
+        self.digest.update(data);
+        self.digest_len += data.len;
+    }
+
+    // Flush and close the gzip stream, if any. Returns false if zlib failed.
+    pub fn finish_gz(self: *OutputSlot, io: Io) bool {
+        const gz = self.gz orelse return true;
+        var ok = true;
+        self.flush(io) catch {
+            ok = false;
+        };
+        self.gz = null;
+        if (gzclose(gz) != 0) ok = false;
+        return ok;
+    }
+
+    // discard without publishing: used when the engine never closed the
+    // handle itself (abort, reset_io between passes).
     pub fn close(self: *OutputSlot, io: Io) void {
-        if (self.is_gz) {
-            if (self.gz_buf) |buf| {
-                buf.deinit(std.heap.c_allocator);
-                std.heap.c_allocator.destroy(buf);
-                self.gz_buf = null;
-            }
+        if (self.mem_buf) |buf| {
+            buf.deinit(io_alloc);
+            io_alloc.destroy(buf);
+            self.mem_buf = null;
+            return;
+        }
+        if (self.gz != null) {
+            _ = self.finish_gz(io);
         } else {
             self.flush(io) catch {};
         }
         if (!self.is_stdout) {
-            self.file.close(io);
+            if (self.file) |f| f.close(io);
         }
     }
 };
 
+// -- handle table --
+
+// Growable slot table. Handles are index+1 and stay stable for the lifetime of
+// the slot; freed indices are recycled through a free list, so alloc and
+// release are O(1). Pointers returned by get() are invalidated by alloc().
+fn HandleTable(comptime Slot: type) type {
+    return struct {
+        const Self = @This();
+
+        slots: std.ArrayList(?Slot) = .empty,
+        free: std.ArrayList(usize) = .empty,
+
+        fn alloc(self: *Self, slot: Slot) Handle {
+            const gpa = std.heap.c_allocator;
+            if (self.free.pop()) |idx| {
+                self.slots.items[idx] = slot;
+                return idx + 1;
+            }
+            // reserve the free-list entry up front so release() never allocates
+            self.free.ensureTotalCapacity(gpa, self.slots.items.len + 1) catch return INVALID_HANDLE;
+            self.slots.append(gpa, slot) catch return INVALID_HANDLE;
+            return self.slots.items.len;
+        }
+
+        fn get(self: *Self, handle: Handle) ?*Slot {
+            if (handle == INVALID_HANDLE or handle > self.slots.items.len) return null;
+            const entry = &self.slots.items[handle - 1];
+            return if (entry.* != null) &(entry.*.?) else null;
+        }
+
+        fn release(self: *Self, handle: Handle) void {
+            if (self.get(handle) == null) return;
+            self.slots.items[handle - 1] = null;
+            self.free.appendAssumeCapacity(handle - 1);
+        }
+
+        // close every live slot and forget them, keeping the capacity
+        fn reset(self: *Self, io: Io) void {
+            for (self.slots.items) |*entry| {
+                if (entry.*) |*slot| slot.close(io);
+            }
+            self.slots.clearRetainingCapacity();
+            self.free.clearRetainingCapacity();
+        }
+
+        fn deinit(self: *Self) void {
+            self.slots.deinit(std.heap.c_allocator);
+            self.free.deinit(std.heap.c_allocator);
+        }
+    };
+}
+
 // -- diagnostics --
 
 pub const DiagnosticHandler = struct {
@@ -298,13 +483,19 @@ pub const DiagnosticHandler = struct {
 
 // -- World struct --
 
-inputs: [MAX_HANDLES]?InputSlot = @splat(null),
-outputs: [MAX_HANDLES]?OutputSlot = @splat(null),
-input_count: usize = 0,
-output_count: usize = 0,
+inputs: HandleTable(InputSlot) = .{},
+outputs: HandleTable(OutputSlot) = .{},
+// slot names; freed wholesale by reset_io
+names: std.heap.ArenaAllocator = .init(std.heap.c_allocator),
+
+// borrowed: callers keep the paths alive while they are registered
+search_dirs: std.ArrayList([]const u8) = .empty,
 
-search_dirs: [16]?[]const u8 = @splat(null),
-search_dir_count: usize = 0,
+// negative lookup cache: names try_open_input failed to find, with one bit per
+// file format probed. LaTeX repeats the same probe sequence on every pass, so
+// this lives across reset_io and is only cleared per compile (see
+// clear_missing_inputs). keys are owned (c_allocator).
+missing_inputs: std.StringHashMapUnmanaged(u64) = .empty,
 
 primary_input: [512]u8 = @splat(0),
 primary_input_len: usize = 0,
@@ -317,6 +508,11 @@ last_input_abspath_len: usize = 0,
 
 bundle_store: ?*BundleStore = null,
 
+// zip project (see Project.resolve_zip_project): the document's files are
+// read from the archive, after the filesystem (where the compile's own
+// outputs land) and before the bundle. borrowed, for the length of a compile.
+archive: ?*ZipArchive = null,
+
 diagnostic_handler: ?*const DiagnosticHandler = null,
 
 // when set, ttbc_input_get_mtime returns this fixed value instead of real file mtimes.
@@ -329,16 +525,84 @@ format_data: ?[]const u8 = null,
 format_name: [64]u8 = @splat(0),
 format_name_len: usize = 0,
 
+// format image (see load_fmt_file in xetex-ini.c): where the image that
+// belongs to format_data lives, set when the format came from the cache.
+// each engine run restores from a fresh private mapping of it, or writes it
+// after a regular undump when it does not exist yet. native only.
+format_image_path: [1024]u8 = @splat(0),
+format_image_path_len: usize = 0,
+format_image_map: ?[]align(std.heap.page_size_min) u8 = null,
+format_image_out: ?Io.File = null,
+
+// wasm keeps the format image in the JS host instead (Host.load_format_image):
+// the copy handed to this run, which the engine's arrays alias, and the image
+// being written after a regular undump.
+format_image_host: ?[]u8 = null,
+format_image_pending: ?[]u8 = null,
+// the host holds the image of one format only; off while another format
+// (a dumped preamble) is loaded
+host_format_image: bool = true,
+
+// bytes served for the next open of the primary input instead of the file,
+// so a driver can run under the document's jobname and \input the document
+// itself (see Compiler.dump_preamble_format), or the document can be read
+// with a line in front (see Compiler.focus_source). owned by the caller.
+primary_input_override: ?[]const u8 = null,
+
+// rewrites the document's own .tex files as the engine opens them (see
+// Compiler.PictureCache). survives reset_io.
+input_filter: ?InputFilter = null,
+
+// in-memory XDV handoff: when capture_xdv is set, ttbc_output_open for an
+// .xdv name returns a memory-backed slot. on close the bytes are kept here
+// (owned, c_allocator) and ttbc_input_open serves them back to xdvipdfmx,
+// so the intermediate never touches the filesystem. survives reset_io.
+capture_xdv: bool = false,
+memory_output: ?[]u8 = null,
+memory_output_name: [512]u8 = @splat(0),
+memory_output_name_len: usize = 0,
+
+// an embedded compile (see Embedded.zig): the document's files as the
+// embedder passed them, and every output the engines close, by name. the
+// engines read these before disk and write nothing to it but .gz outputs.
+// null for a compile on the filesystem. owned by the embedder
+memory_files: ?*MemoryFiles = null,
+
+// running digests of <digest_stem><ext> for each of digest_extensions, as
+// the engines last closed them, or as read from disk (see
+// Compiler.take_stabilization_snapshot): a pass is compared with the one
+// before without reading its files back. survives reset_io.
+digest_stem: []const u8 = "",
+digest_extensions: []const []const u8 = &.{},
+output_digests: [max_digested_outputs]?OutputDigest = @splat(null),
+
+// ttbc_get_file_md5 results for files on disk, by the name the engine asked
+// for, with the size and mtime the file had (\pdffilemdfivesum and pdf IDs
+// ask for the same files on every pass). keys are owned (c_allocator).
+// survives reset_io and compiles.
+file_md5s: std.StringHashMapUnmanaged(FileMd5) = .empty,
+
+// the engines' .log outputs are opened but nothing is written (see
+// Compiler.CompileConfig.no_log). survives reset_io.
+discard_log: bool = false,
+
+// project files try_open_input found on disk (not in the bundle) since
+// begin_open_log, as cwd-relative paths without repeats, for the watcher to
+// digest (see Watcher.InputDigests). keys are owned (c_allocator); null
+// while nobody asked. survives reset_io.
+open_log: ?std.StringArrayHashMapUnmanaged(void) = null,
+// files written since begin_open_log. they are the compile's own (.aux,
+// .bbl, the PDF) and leave open_log, even when read back later
+written_log: std.StringHashMapUnmanaged(void) = .empty,
+
 pub fn add_search_dir(self: *World, dir: []const u8) void {
-    if (self.search_dir_count < self.search_dirs.len) {
-        self.search_dirs[self.search_dir_count] = dir;
-        self.search_dir_count += 1;
-    }
+    self.search_dirs.append(std.heap.c_allocator, dir) catch {};
+    // a new directory may hold anything we failed to find so far
+    self.clear_missing_inputs();
 }
 
 pub fn reset_search_dirs(self: *World) void {
-    self.search_dirs = @splat(null);
-    self.search_dir_count = 0;
+    self.search_dirs.clearRetainingCapacity();
 }
 
 pub fn set_primary_input(self: *World, path: []const u8) void {
@@ -367,24 +631,211 @@ pub fn clear_format_data(self: *World) void {
     self.format_name_len = 0;
 }
 
-pub fn reset_io(self: *World, io: Io) void {
-    for (self.inputs[0..self.input_count]) |*slot| {
-        if (slot.*) |*s| {
-            s.close(io);
-            slot.* = null;
+pub fn set_format_image_path(self: *World, path: []const u8) void {
+    if (is_wasm or path.len > self.format_image_path.len) return;
+    @memcpy(self.format_image_path[0..path.len], path);
+    self.format_image_path_len = path.len;
+}
+
+pub fn clear_format_image(self: *World, io: Io) void {
+    self.unmap_format_image();
+    self.end_format_image(io, false);
+    self.format_image_path_len = 0;
+}
+
+fn unmap_format_image(self: *World) void {
+    if (is_wasm) {
+        if (self.format_image_host) |image| Host.free_format_image(image);
+        self.format_image_host = null;
+        return;
+    }
+    if (self.format_image_map) |m| posix.munmap(m);
+    self.format_image_map = null;
+}
+
+// a private, writable mapping of the format image for this engine run.
+// replaces the previous run's mapping, which that run no longer uses.
+// wasm: a copy of the image the JS host holds, if it holds one.
+pub fn map_format_image(self: *World, io: Io) ?[]u8 {
+    if (is_wasm) {
+        self.unmap_format_image();
+        if (!self.host_format_image) return null;
+        self.format_image_host = Host.load_format_image();
+        return self.format_image_host;
+    }
+    if (self.format_image_path_len == 0) return null;
+    self.unmap_format_image();
+    const path = self.format_image_path[0..self.format_image_path_len];
+    const file = Io.Dir.cwd().openFile(io, path, .{}) catch return null;
+    defer file.close(io);
+    const size: usize = @intCast((file.stat(io) catch return null).size);
+    if (size == 0) return null;
+    const m = posix.mmap(null, size, posix.PROT.READ | posix.PROT.WRITE, .{ .TYPE = .PRIVATE }, file.handle, 0) catch return null;
+    self.format_image_map = m;
+    return m;
+}
+
+// start writing the format image to a temporary file next to it. the engine
+// only asks after a regular undump, i.e. when the image is missing or did not
+// match, so any existing one is replaced.
+pub fn begin_format_image(self: *World, io: Io, total_len: u64) bool {
+    if (is_wasm) {
+        if (!self.host_format_image or self.format_image_pending != null) return false;
+        const image = MemStats.allocator(.engine).alloc(u8, @intCast(total_len)) catch return false;
+        @memset(image, 0);
+        self.format_image_pending = image;
+        return true;
+    }
+    if (self.format_image_path_len == 0 or self.format_image_out != null) return false;
+    const path = self.format_image_path[0..self.format_image_path_len];
+    var tmp_buf: [1040]u8 = undefined;
+    const tmp_path = std.fmt.bufPrint(&tmp_buf, "{s}.tmp", .{path}) catch return false;
+    const file = Io.Dir.cwd().createFile(io, tmp_path, .{ .read = true }) catch return false;
+    // unwritten ranges stay holes
+    file.setLength(io, total_len) catch {
+        file.close(io);
+        Io.Dir.cwd().deleteFile(io, tmp_path) catch {};
+        return false;
+    };
+    self.format_image_out = file;
+    return true;
+}
+
+pub fn write_format_image(self: *World, io: Io, offset: u64, data: []const u8) bool {
+    if (is_wasm) {
+        const image = self.format_image_pending orelse return false;
+        if (offset > image.len or data.len > image.len - offset) return false;
+        @memcpy(image[@intCast(offset)..][0..data.len], data);
+        return true;
+    }
+    const file = self.format_image_out orelse return false;
+    file.writePositionalAll(io, data, offset) catch return false;
+    return true;
+}
+
+// finish the image: publish it under its name if complete, else drop it
+pub fn end_format_image(self: *World, io: Io, ok: bool) void {
+    if (is_wasm) {
+        const image = self.format_image_pending orelse return;
+        if (ok) Host.save_format_image(image);
+        MemStats.allocator(.engine).free(image);
+        self.format_image_pending = null;
+        return;
+    }
+    const file = self.format_image_out orelse return;
+    file.close(io);
+    self.format_image_out = null;
+    const path = self.format_image_path[0..self.format_image_path_len];
+    var tmp_buf: [1040]u8 = undefined;
+    const tmp_path = std.fmt.bufPrint(&tmp_buf, "{s}.tmp", .{path}) catch return;
+    if (ok) {
+        Io.Dir.cwd().rename(tmp_path, Io.Dir.cwd(), path, io) catch {
+            Io.Dir.cwd().deleteFile(io, tmp_path) catch {};
+        };
+    } else {
+        Io.Dir.cwd().deleteFile(io, tmp_path) catch {};
+    }
+}
+
+pub const MemoryFiles = struct {
+    // names c_allocator-owned, bytes io_alloc-owned
+    files: std.StringArrayHashMapUnmanaged([]u8) = .empty,
+    // bytes a later write replaced; an input slot may still be reading them
+    retired: std.ArrayList([]u8) = .empty,
+
+    pub fn get(self: *const MemoryFiles, name: []const u8) ?[]const u8 {
+        return self.files.get(clean_name(name));
+    }
+
+    // takes over data, which must come from io_alloc
+    pub fn put(self: *MemoryFiles, name: []const u8, data: []u8) !void {
+        errdefer io_alloc.free(data);
+        const key = clean_name(name);
+        if (self.files.getPtr(key)) |existing| {
+            try self.retired.append(std.heap.c_allocator, existing.*);
+            existing.* = data;
+            return;
         }
+        const owned = try std.heap.c_allocator.dupe(u8, key);
+        errdefer std.heap.c_allocator.free(owned);
+        try self.files.put(std.heap.c_allocator, owned, data);
     }
-    for (self.outputs[0..self.output_count]) |*slot| {
-        if (slot.*) |*s| {
-            s.close(io);
-            slot.* = null;
+
+    pub fn put_copy(self: *MemoryFiles, name: []const u8, data: []const u8) !void {
+        try self.put(name, try io_alloc.dupe(u8, data));
+    }
+
+    pub fn deinit(self: *MemoryFiles) void {
+        for (self.files.keys(), self.files.values()) |key, data| {
+            std.heap.c_allocator.free(key);
+            io_alloc.free(data);
         }
+        self.files.deinit(std.heap.c_allocator);
+        for (self.retired.items) |data| io_alloc.free(data);
+        self.retired.deinit(std.heap.c_allocator);
+        self.* = .{};
+    }
+
+    fn clean_name(name: []const u8) []const u8 {
+        var n = name;
+        while (std.mem.startsWith(u8, n, "./")) n = n[2..];
+        return n;
     }
-    self.input_count = 0;
-    self.output_count = 0;
+};
+
+pub fn wants_memory_output(self: *const World, name: []const u8) bool {
+    if (self.memory_files != null) return true;
+    return self.capture_xdv and std.mem.endsWith(u8, name, ".xdv");
+}
+
+// take ownership of a closed memory output, replacing any previous one.
+pub fn set_memory_output(self: *World, data: []u8, name: []const u8) void {
+    if (self.memory_files) |files| {
+        files.put(name, data) catch {};
+        return;
+    }
+    self.clear_memory_output();
+    const copy_len = @min(name.len, self.memory_output_name.len);
+    @memcpy(self.memory_output_name[0..copy_len], name[0..copy_len]);
+    self.memory_output_name_len = copy_len;
+    self.memory_output = data;
+}
+
+// bytes of the retained memory output if `name` refers to it.
+pub fn find_memory_output(self: *const World, name: []const u8) ?[]const u8 {
+    if (self.memory_files) |files| return files.get(name);
+    const data = self.memory_output orelse return null;
+    if (!std.mem.eql(u8, name, self.memory_output_name[0..self.memory_output_name_len])) return null;
+    return data;
+}
+
+pub fn clear_memory_output(self: *World) void {
+    if (self.memory_output) |data| io_alloc.free(data);
+    self.memory_output = null;
+    self.memory_output_name_len = 0;
+}
+
+pub fn reset_io(self: *World, io: Io) void {
+    self.inputs.reset(io);
+    self.outputs.reset(io);
+    _ = self.names.reset(.retain_capacity);
     self.reset_search_dirs();
 }
 
+pub fn deinit(self: *World, io: Io) void {
+    self.reset_io(io);
+    self.clear_memory_output();
+    self.clear_missing_inputs();
+    self.missing_inputs.deinit(std.heap.c_allocator);
+    self.end_open_log();
+    self.clear_file_md5s();
+    self.file_md5s.deinit(std.heap.c_allocator);
+    self.inputs.deinit();
+    self.outputs.deinit();
+    self.names.deinit();
+    self.search_dirs.deinit(std.heap.c_allocator);
+}
+
 pub fn alloc_input(self: *World, io: Io, file: Io.File, name: []const u8) Handle {
     var slot = InputSlot{ .file = file };
     // capture mtime from file stat if available
@@ -400,59 +851,177 @@ pub fn alloc_memory_input(self: *World, data: []const u8, name: []const u8) Hand
     return self.alloc_input_slot(.{ .mem_data = data }, name);
 }
 
-fn alloc_input_slot(self: *World, slot_init: InputSlot, name: []const u8) Handle {
-    for (self.inputs[0..self.input_count], 0..) |*slot, idx| {
-        if (slot.* == null) {
-            slot.* = slot_init;
-            slot.*.?.set_name(name);
-            return idx + 1;
-        }
+// takes over `data` without copying; the slot frees it with `owner` on close
+pub fn alloc_owned_input(self: *World, data: []u8, owner: std.mem.Allocator, name: []const u8) Handle {
+    const h = self.alloc_input_slot(.{ .mem_data = data, .mem_owner = owner }, name);
+    if (h == INVALID_HANDLE) owner.free(data);
+    return h;
+}
+
+// bytes from the cache pack are not owned by the slot (see Cache.Hit);
+// freshly fetched bytes are adopted as they are
+pub fn alloc_opened_input(self: *World, io: Io, opened: OpenedInput, name: []const u8) Handle {
+    return switch (opened) {
+        .file => |file| self.alloc_input(io, file, name),
+        .bytes => |bytes| self.alloc_memory_input(bytes, name),
+        .owned => |owned| self.alloc_owned_input(owned.data, owned.allocator, name),
+        .deflated => |deflated| self.alloc_deflated_input(deflated, name),
+    };
+}
+
+// a compressed entry of a mapped local bundle (see BundleStore.resolve_local),
+// inflated as it is read, so only one chunk of it is ever on the heap unless
+// the reader seeks back
+pub fn alloc_deflated_input(self: *World, deflated: Host.DeflatedBytes, name: []const u8) Handle {
+    const buf = io_alloc.alloc(u8, inflate_chunk_len) catch return INVALID_HANDLE;
+    const dc = Flate.tectonic_flate_new_decompressor(deflated.data.ptr, deflated.data.len) orelse {
+        io_alloc.free(buf);
+        return INVALID_HANDLE;
+    };
+    const h = self.alloc_input_slot(.{
+        .mem_data = buf[0..0],
+        .inflater = dc,
+        .inflate_buf = buf,
+        .deflated = deflated.data,
+        .raw_len = deflated.raw_len,
+    }, name);
+    if (h == INVALID_HANDLE) {
+        Flate.tectonic_flate_free_decompressor(dc);
+        io_alloc.free(buf);
     }
-    if (self.input_count >= MAX_HANDLES) return INVALID_HANDLE;
-    const idx = self.input_count;
-    self.inputs[idx] = slot_init;
-    self.inputs[idx].?.set_name(name);
-    self.input_count += 1;
-    return idx + 1;
+    return h;
+}
+
+fn alloc_input_slot(self: *World, slot_init: InputSlot, name: []const u8) Handle {
+    var slot = slot_init;
+    slot.name = self.names.allocator().dupe(u8, name) catch return INVALID_HANDLE;
+    return self.inputs.alloc(slot);
 }
 
 pub fn get_input(self: *World, handle: Handle) ?*InputSlot {
-    if (handle == INVALID_HANDLE) return null;
-    const idx = handle - 1;
-    if (idx >= self.input_count) return null;
-    return if (self.inputs[idx] != null) &(self.inputs[idx].?) else null;
+    return self.inputs.get(handle);
+}
+
+// forget a slot the caller has already closed
+pub fn release_input(self: *World, handle: Handle) void {
+    self.inputs.release(handle);
 }
 
 pub fn alloc_output(self: *World, file: Io.File, name: []const u8, is_stdout: bool, is_gz: bool) Handle {
-    const new_slot = blk: {
-        var s = OutputSlot{ .file = file, .is_stdout = is_stdout, .is_gz = is_gz };
-        if (is_gz) {
-            const buf = std.heap.c_allocator.create(std.ArrayList(u8)) catch return INVALID_HANDLE;
-            buf.* = .empty;
-            s.gz_buf = buf;
-        }
-        break :blk s;
-    };
-    for (self.outputs[0..self.output_count], 0..) |*slot, idx| {
-        if (slot.* == null) {
-            slot.* = new_slot;
-            slot.*.?.set_name(name);
-            return idx + 1;
-        }
+    var new_slot = OutputSlot{ .file = file, .is_stdout = is_stdout, .is_gz = is_gz };
+    if (is_gz) new_slot.open_gz();
+    const h = self.alloc_output_slot(new_slot, name);
+    if (h == INVALID_HANDLE) {
+        if (new_slot.gz) |gz| _ = gzclose(gz);
     }
-    if (self.output_count >= MAX_HANDLES) return INVALID_HANDLE;
-    const idx = self.output_count;
-    self.outputs[idx] = new_slot;
-    self.outputs[idx].?.set_name(name);
-    self.output_count += 1;
-    return idx + 1;
+    return h;
+}
+
+pub const max_digested_outputs = 8;
+
+// len 0 for a file that is missing or empty
+pub const OutputDigest = struct {
+    hash: u64,
+    len: u64,
+};
+
+// digest the outputs named stem ++ one of exts from now on, forgetting the
+// digests taken so far. stem and exts must outlive the watch; an empty stem
+// ends it
+pub fn watch_digests(self: *World, stem: []const u8, exts: []const []const u8) void {
+    std.debug.assert(exts.len <= max_digested_outputs);
+    self.digest_stem = stem;
+    self.digest_extensions = exts;
+    self.output_digests = @splat(null);
+}
+
+fn digest_index_of(self: *const World, name: []const u8) ?u8 {
+    if (self.digest_stem.len == 0) return null;
+    const n = MemoryFiles.clean_name(name);
+    if (!std.mem.startsWith(u8, n, self.digest_stem)) return null;
+    const ext = n[self.digest_stem.len..];
+    for (self.digest_extensions, 0..) |e, i| {
+        if (std.mem.eql(u8, e, ext)) return @intCast(i);
+    }
+    return null;
+}
+
+// the digest of digest_extensions[i]'s file, if one was taken
+pub fn output_digest(self: *const World, i: usize) ?OutputDigest {
+    return self.output_digests[i];
+}
+
+pub fn set_output_digest(self: *World, i: usize, digest: OutputDigest) void {
+    self.output_digests[i] = digest;
+}
+
+// a digested output was closed with everything written
+pub fn record_output_digest(self: *World, slot: *OutputSlot) void {
+    const i = slot.digest_index orelse return;
+    self.output_digests[i] = .{ .hash = slot.digest.final(), .len = slot.digest_len };
+}
+
+pub const FileMd5 = struct {
+    size: u64,
+    mtime_ns: i96,
+    digest: [16]u8,
+};
+
+// the md5 of name taken earlier, if the file it opened to still has the
+// same size and mtime
+pub fn cached_file_md5(self: *const World, name: []const u8, stat: Io.File.Stat) ?[16]u8 {
+    const e = self.file_md5s.get(name) orelse return null;
+    if (e.size != stat.size or e.mtime_ns != stat.mtime.nanoseconds) return null;
+    return e.digest;
+}
+
+pub fn note_file_md5(self: *World, name: []const u8, stat: Io.File.Stat, digest: [16]u8) void {
+    const gpa = std.heap.c_allocator;
+    const e: FileMd5 = .{ .size = stat.size, .mtime_ns = stat.mtime.nanoseconds, .digest = digest };
+    if (self.file_md5s.getPtr(name)) |slot| {
+        slot.* = e;
+        return;
+    }
+    const key = gpa.dupe(u8, name) catch return;
+    self.file_md5s.put(gpa, key, e) catch gpa.free(key);
+}
+
+pub fn clear_file_md5s(self: *World) void {
+    var it = self.file_md5s.keyIterator();
+    while (it.next()) |key| std.heap.c_allocator.free(key.*);
+    self.file_md5s.clearRetainingCapacity();
+}
+
+pub fn wants_discarded_output(self: *const World, name: []const u8) bool {
+    return self.discard_log and std.mem.endsWith(u8, name, ".log");
+}
+
+pub fn alloc_discard_output(self: *World, name: []const u8) Handle {
+    return self.alloc_output_slot(.{ .file = null, .discard = true }, name);
+}
+
+pub fn alloc_memory_output(self: *World, name: []const u8) Handle {
+    const buf = io_alloc.create(std.ArrayList(u8)) catch return INVALID_HANDLE;
+    buf.* = .empty;
+    const h = self.alloc_output_slot(.{ .file = null, .mem_buf = buf }, name);
+    if (h == INVALID_HANDLE) io_alloc.destroy(buf);
+    return h;
+}
+
+fn alloc_output_slot(self: *World, new_slot: OutputSlot, name: []const u8) Handle {
+    var slot = new_slot;
+    slot.name = self.names.allocator().dupe(u8, name) catch return INVALID_HANDLE;
+    if (!slot.is_gz) slot.digest_index = self.digest_index_of(name);
+    return self.outputs.alloc(slot);
 }
 
 pub fn get_output(self: *World, handle: Handle) ?*OutputSlot {
-    if (handle == INVALID_HANDLE) return null;
-    const idx = handle - 1;
-    if (idx >= self.output_count) return null;
-    return if (self.outputs[idx] != null) &(self.outputs[idx].?) else null;
+    return self.outputs.get(handle);
+}
+
+// forget a slot the caller has already closed
+pub fn release_output(self: *World, handle: Handle) void {
+    self.outputs.release(handle);
 }
 
 // extensions to try for a given file format
@@ -481,19 +1050,195 @@ pub fn extensions_for_format(format: FileFormat) []const []const u8 {
     };
 }
 
+fn missing_bit(format: FileFormat) ?u64 {
+    if (format < 0 or format >= 64) return null;
+    return @as(u64, 1) << @intCast(format);
+}
+
+pub fn is_known_missing(self: *const World, name: []const u8, format: FileFormat) bool {
+    const bit = missing_bit(format) orelse return false;
+    const mask = self.missing_inputs.get(name) orelse return false;
+    return mask & bit != 0;
+}
+
+fn note_missing(self: *World, name: []const u8, format: FileFormat) void {
+    const bit = missing_bit(format) orelse return;
+    const gpa = std.heap.c_allocator;
+    if (self.missing_inputs.getPtr(name)) |mask| {
+        mask.* |= bit;
+        return;
+    }
+    const key = gpa.dupe(u8, name) catch return;
+    self.missing_inputs.put(gpa, key, bit) catch gpa.free(key);
+}
+
+fn forget_missing_name(self: *World, name: []const u8) void {
+    if (self.missing_inputs.fetchRemove(name)) |kv| std.heap.c_allocator.free(kv.key);
+}
+
+// called when the engine creates `name`: a later probe for it, with or without
+// its extension, has to hit the filesystem again.
+pub fn forget_missing(self: *World, name: []const u8) void {
+    self.forget_missing_name(name);
+    const base_start = if (std.mem.lastIndexOfScalar(u8, name, '/')) |slash| slash + 1 else 0;
+    if (std.mem.lastIndexOfScalar(u8, name[base_start..], '.')) |dot| {
+        self.forget_missing_name(name[0 .. base_start + dot]);
+    }
+}
+
+pub fn clear_missing_inputs(self: *World) void {
+    var it = self.missing_inputs.keyIterator();
+    while (it.next()) |key| std.heap.c_allocator.free(key.*);
+    self.missing_inputs.clearRetainingCapacity();
+}
+
+// where try_open_input would have found each name it missed on disk: as
+// named and, for a name without an extension, with each extension of the
+// formats it was probed as, at the working directory and under each search
+// directory. a file showing up at one of them can change what a compile
+// reads (see compile/memo.zig); the compile's own outputs are left out.
+// paths are allocated from arena
+pub fn missing_input_paths(self: *const World, arena: std.mem.Allocator) ![]const []const u8 {
+    var paths: std.StringArrayHashMapUnmanaged(void) = .empty;
+    var it = self.missing_inputs.iterator();
+    while (it.next()) |entry| {
+        const name = entry.key_ptr.*;
+        const base_start = if (std.mem.lastIndexOfScalar(u8, name, '/')) |slash| slash + 1 else 0;
+        const has_ext = std.mem.indexOfScalar(u8, name[base_start..], '.') != null;
+        const n_dirs = if (fs.path.isAbsolute(name)) 0 else self.search_dirs.items.len;
+        for (0..n_dirs + 1) |d| {
+            const dir = if (d == 0) "" else self.search_dirs.items[d - 1];
+            if (d > 0 and (dir.len == 0 or std.mem.eql(u8, dir, "."))) continue;
+            const path = if (d == 0) name else try std.fmt.allocPrint(arena, "{s}/{s}", .{ dir, name });
+            try self.put_missing_path(arena, &paths, path);
+            if (has_ext) continue;
+            var mask = entry.value_ptr.*;
+            while (mask != 0) : (mask &= mask - 1) {
+                for (extensions_for_format(@intCast(@ctz(mask)))) |ext| {
+                    try self.put_missing_path(arena, &paths, try std.fmt.allocPrint(arena, "{s}.{s}", .{ path, ext }));
+                }
+            }
+        }
+    }
+    return paths.keys();
+}
+
+fn put_missing_path(self: *const World, arena: std.mem.Allocator, paths: *std.StringArrayHashMapUnmanaged(void), path: []const u8) !void {
+    if (self.written_log.contains(path)) return;
+    if (self.open_log) |log| if (log.contains(path)) return;
+    try paths.put(arena, path, {});
+}
+
+pub fn begin_open_log(self: *World) void {
+    self.end_open_log();
+    self.open_log = .empty;
+}
+
+pub fn end_open_log(self: *World) void {
+    var written = self.written_log.keyIterator();
+    while (written.next()) |key| std.heap.c_allocator.free(key.*);
+    self.written_log.clearAndFree(std.heap.c_allocator);
+    const log = if (self.open_log) |*l| l else return;
+    for (log.keys()) |key| std.heap.c_allocator.free(key);
+    log.deinit(std.heap.c_allocator);
+    self.open_log = null;
+}
+
+fn log_path(buf: []u8, dir: ?[]const u8, name: []const u8) ?[]const u8 {
+    const d = dir orelse return name;
+    if (d.len == 0 or std.mem.eql(u8, d, ".")) return name;
+    return std.fmt.bufPrint(buf, "{s}/{s}", .{ d, name }) catch null;
+}
+
+pub fn note_opened(self: *World, dir: ?[]const u8, name: []const u8) void {
+    const log = if (self.open_log) |*l| l else return;
+    var buf: [1024]u8 = undefined;
+    const path = log_path(&buf, dir, name) orelse return;
+    if (log.contains(path) or self.written_log.contains(path)) return;
+    const owned = std.heap.c_allocator.dupe(u8, path) catch return;
+    log.put(std.heap.c_allocator, owned, {}) catch std.heap.c_allocator.free(owned);
+}
+
+// an output opened under the output directory, as name
+pub fn note_written(self: *World, name: []const u8) void {
+    const log = if (self.open_log) |*l| l else return;
+    var buf: [1024]u8 = undefined;
+    const dir = if (self.output_dir_len > 0) self.output_dir[0..self.output_dir_len] else null;
+    const path = log_path(&buf, dir, name) orelse return;
+    if (log.fetchOrderedRemove(path)) |kv| std.heap.c_allocator.free(kv.key);
+    if (self.written_log.contains(path)) return;
+    const owned = std.heap.c_allocator.dupe(u8, path) catch return;
+    self.written_log.put(std.heap.c_allocator, owned, {}) catch std.heap.c_allocator.free(owned);
+}
+
+pub const OpenedInput = BundleStore.OpenedFile;
+
+pub const InputFilter = struct {
+    ctx: *anyopaque,
+    // the text to read instead, c_allocator-owned, or null to leave it be
+    filter: *const fn (ctx: *anyopaque, text: []const u8) ?[]u8,
+};
+
+// text as the input filter rewrites it, if it does
+pub fn filter_text(self: *const World, text: []const u8) ?[]u8 {
+    const f = self.input_filter orelse return null;
+    return f.filter(f.ctx, text);
+}
+
+// opened, or the input filter's rewrite of it when it is a .tex file of
+// the document that try_open_input just found on disk
+pub fn filter_opened_input(self: *World, io: Io, opened: OpenedInput, format: FileFormat) OpenedInput {
+    if (self.input_filter == null or format != TTBC_FILE_FORMAT_TEX) return opened;
+    const file = switch (opened) {
+        .file => |f| f,
+        else => return opened,
+    };
+    if (!std.mem.endsWith(u8, self.last_input_abspath[0..self.last_input_abspath_len], ".tex")) return opened;
+
+    const stat = file.stat(io) catch return opened;
+    const text = std.heap.c_allocator.alloc(u8, @intCast(stat.size)) catch return opened;
+    defer std.heap.c_allocator.free(text);
+    const n = file.readPositionalAll(io, text, 0) catch return opened;
+    const filtered = self.filter_text(text[0..n]) orelse return opened;
+    file.close(io);
+    return .{ .owned = .{ .data = filtered, .allocator = std.heap.c_allocator } };
+}
+
 // try to open a file by name, searching directories, extensions, and package manager
-pub fn try_open_input(self: *World, io: Io, name: []const u8, format: FileFormat) ?Io.File {
-    // 1. filesystem + search_dirs (direct path and with extensions)
-    if (self.try_open_path(io, name)) |f| return f;
+pub fn try_open_input(self: *World, io: Io, name: []const u8, format: FileFormat) ?OpenedInput {
+    if (self.is_known_missing(name, format)) {
+        Log.dbg(io, "world", "  -> known missing: '{s}'", .{name});
+        return null;
+    }
+    const file = self.try_open_input_uncached(io, name, format) orelse {
+        self.note_missing(name, format);
+        return null;
+    };
+    return file;
+}
 
+fn try_open_input_uncached(self: *World, io: Io, name: []const u8, format: FileFormat) ?OpenedInput {
     const exts = extensions_for_format(format);
-    for (exts) |ext| {
-        var buf: [1024]u8 = undefined;
-        const full = std.fmt.bufPrint(&buf, "{s}.{s}", .{ name, ext }) catch continue;
-        if (self.try_open_path(io, full)) |f| return f;
+
+    // 1. filesystem + search_dirs (direct path and with extensions), or
+    // the files of an embedded compile in its place
+    if (self.memory_files) |files| {
+        if (self.try_open_from_memory(files, name, exts)) |f| return f;
+    } else {
+        if (self.try_open_path(io, name)) |f| return .{ .file = f };
+        for (exts) |ext| {
+            var buf: [1024]u8 = undefined;
+            const full = std.fmt.bufPrint(&buf, "{s}.{s}", .{ name, ext }) catch continue;
+            if (self.try_open_path(io, full)) |f| return .{ .file = f };
+        }
     }
 
-    // 2. bundle store (unified cache + network fetch)
+    // 2. the project archive
+    if (self.archive) |archive| {
+        if (self.try_open_from_archive(io, archive, name, exts)) |f| return f;
+    }
+
+    // 3. bundle store (unified cache + network fetch)
     if (self.bundle_store) |bs| {
         if (self.try_open_from_bundle_store(io, bs, name)) |f| return f;
         for (exts) |ext| {
@@ -508,19 +1253,96 @@ pub fn try_open_input(self: *World, io: Io, name: []const u8, format: FileFormat
     return null;
 }
 
-fn try_open_from_bundle_store(self: *World, io: Io, bs: *BundleStore, name: []const u8) ?Io.File {
-    const file = bs.open_file(io, name) catch |err| {
+// name as given and with each extension, as named and under each search
+// directory, like try_open_from_archive
+fn try_open_from_memory(self: *World, files: *const MemoryFiles, name: []const u8, exts: []const []const u8) ?OpenedInput {
+    var prefixes: [16][]const u8 = undefined;
+    prefixes[0] = "";
+    var n_prefixes: usize = 1;
+    for (self.search_dirs.items) |dir| {
+        if (n_prefixes == prefixes.len) break;
+        if (std.mem.eql(u8, dir, ".")) continue;
+        prefixes[n_prefixes] = dir;
+        n_prefixes += 1;
+    }
+
+    for (prefixes[0..n_prefixes]) |prefix| {
+        const sep: []const u8 = if (prefix.len > 0) "/" else "";
+        var buf: [1024]u8 = undefined;
+        const path = std.fmt.bufPrint(&buf, "{s}{s}{s}", .{ prefix, sep, name }) catch continue;
+        if (files.get(path)) |data| return self.opened_from_memory(path, data);
+        for (exts) |ext| {
+            var ext_buf: [1024]u8 = undefined;
+            const full = std.fmt.bufPrint(&ext_buf, "{s}.{s}", .{ path, ext }) catch continue;
+            if (files.get(full)) |data| return self.opened_from_memory(full, data);
+        }
+    }
+    return null;
+}
+
+// the files sit at the root of their own tree, for synctex and the filter
+fn opened_from_memory(self: *World, path: []const u8, data: []const u8) OpenedInput {
+    self.record_abspath_in_dir("", path);
+    self.note_opened(null, path);
+    return .{ .bytes = data };
+}
+
+// name as given and with each extension, at the archive's root and under
+// each search directory (the main file's directory among them)
+fn try_open_from_archive(self: *World, io: Io, archive: *ZipArchive, name: []const u8, exts: []const []const u8) ?OpenedInput {
+    var prefixes: [16][]const u8 = undefined;
+    prefixes[0] = "";
+    var n_prefixes: usize = 1;
+    for (self.search_dirs.items) |dir| {
+        if (n_prefixes == prefixes.len) break;
+        if (std.mem.eql(u8, dir, ".")) continue;
+        prefixes[n_prefixes] = dir;
+        n_prefixes += 1;
+    }
+
+    for (prefixes[0..n_prefixes]) |prefix| {
+        const sep: []const u8 = if (prefix.len > 0) "/" else "";
+        var buf: [1024]u8 = undefined;
+        const path = std.fmt.bufPrint(&buf, "{s}{s}{s}", .{ prefix, sep, name }) catch continue;
+        if (self.open_archive_member(io, archive, path)) |f| return f;
+        for (exts) |ext| {
+            var ext_buf: [1024]u8 = undefined;
+            const full = std.fmt.bufPrint(&ext_buf, "{s}.{s}", .{ path, ext }) catch continue;
+            if (self.open_archive_member(io, archive, full)) |f| return f;
+        }
+    }
+    return null;
+}
+
+fn open_archive_member(self: *World, io: Io, archive: *ZipArchive, name: []const u8) ?OpenedInput {
+    const contents = (archive.read(name) catch |err| {
+        Log.dbg(io, "world", "  -> cannot read '{s}' from the archive: {}", .{ name, err });
+        return null;
+    }) orelse return null;
+    Log.dbg(io, "world", "  -> found in the project archive: '{s}'", .{name});
+    self.last_input_abspath_len = 0;
+    // the watcher digests the archive as a whole
+    self.note_opened(null, archive.path);
+    return switch (contents) {
+        .stored => |bytes| .{ .bytes = bytes },
+        .inflated => |data| .{ .owned = .{ .data = data, .allocator = ZipArchive.alloc } },
+    };
+}
+
+fn try_open_from_bundle_store(self: *World, io: Io, bs: *BundleStore, name: []const u8) ?OpenedInput {
+    const opened = bs.open_file(io, name) catch |err| {
         Log.dbg(io, "world", "  -> bundle store error for '{s}': {}", .{ name, err });
         return null;
     };
     Log.dbg(io, "world", "  -> found via bundle store: '{s}'", .{name});
     self.last_input_abspath_len = 0;
-    return file;
+    return opened;
 }
 
 fn try_open_path(self: *World, io: Io, name: []const u8) ?Io.File {
     if (open_file_relative(io, Io.Dir.cwd(), name)) |f| {
         self.record_abspath(io, name);
+        self.note_opened(null, name);
         return f;
     }
 
@@ -544,6 +1366,7 @@ fn try_open_path(self: *World, io: Io, name: []const u8) ?Io.File {
                     if (open_file_relative(io, Io.Dir.cwd(), stripped)) |f| {
                         Log.dbg(io, "world", "  -> jobname fallback: '{s}' -> '{s}'", .{ name, stripped });
                         self.record_abspath(io, stripped);
+                        self.note_opened(null, stripped);
                         return f;
                     }
                 }
@@ -551,13 +1374,13 @@ fn try_open_path(self: *World, io: Io, name: []const u8) ?Io.File {
         }
     }
 
-    for (self.search_dirs[0..self.search_dir_count]) |maybe_dir| {
-        const dir_path = maybe_dir orelse continue;
+    for (self.search_dirs.items) |dir_path| {
         const dir = Io.Dir.cwd().openDir(io, dir_path, .{}) catch continue;
         var dir_handle = dir;
         defer dir_handle.close(io);
         if (open_file_relative(io, dir_handle, name)) |f| {
             self.record_abspath_in_dir(dir_path, name);
+            self.note_opened(dir_path, name);
             return f;
         }
     }
@@ -565,7 +1388,7 @@ fn try_open_path(self: *World, io: Io, name: []const u8) ?Io.File {
     return null;
 }
 
-fn record_abspath(self: *World, io: Io, name: []const u8) void {
+pub fn record_abspath(self: *World, io: Io, name: []const u8) void {
     var cwd_buf: [512]u8 = undefined;
     const cwd_len = Io.Dir.cwd().realPath(io, &cwd_buf) catch {
         self.last_input_abspath_len = 0;
@@ -654,6 +1477,19 @@ test "memory input: seek_by negative clamps to zero" {
     try std.testing.expectEqual(@as(u64, 0), try slot.get_pos(io));
 }
 
+test "memory input: peek and consume" {
+    const io = std.testing.io;
+    var slot = InputSlot{ .mem_data = "line one\nline two" };
+    try std.testing.expectEqualStrings("line one\nline two", try slot.peek(io));
+    slot.consume(9);
+    try std.testing.expectEqualStrings("line two", try slot.peek(io));
+    var buf: [4]u8 = undefined;
+    _ = try slot.read(io, &buf);
+    try std.testing.expectEqualStrings("line", &buf);
+    slot.consume(100);
+    try std.testing.expectEqual(@as(usize, 0), (try slot.peek(io)).len);
+}
+
 test "memory input: get_size" {
     const io = std.testing.io;
     const data = "twelve chars";
@@ -674,6 +1510,30 @@ test "memory input: ungetc integration" {
     try std.testing.expectEqual(@as(?u8, 'Z'), slot.ungetc_byte);
 }
 
+test "file input: large files are mapped and seekable" {
+    const io = std.testing.io;
+    var tmp_dir = std.testing.tmpDir(.{});
+    defer tmp_dir.cleanup();
+
+    const data = try std.testing.allocator.alloc(u8, mmap_threshold + 17);
+    defer std.testing.allocator.free(data);
+    for (data, 0..) |*b, i| b.* = @truncate(i);
+    try tmp_dir.dir.writeFile(io, .{ .sub_path = "big.bin", .data = data });
+
+    var slot = InputSlot{ .file = try tmp_dir.dir.openFile(io, "big.bin", .{}) };
+    defer slot.close(io);
+
+    try std.testing.expectEqual(data.len, try slot.get_size(io));
+    try slot.seek_to(io, mmap_threshold);
+    try std.testing.expect(slot.mapped != null);
+    try std.testing.expect(slot.mem_owner == null);
+
+    var buf: [32]u8 = undefined;
+    const n = try slot.read(io, &buf);
+    try std.testing.expectEqual(@as(usize, 17), n);
+    try std.testing.expectEqualSlices(u8, data[mmap_threshold..], buf[0..n]);
+}
+
 test "world: alloc_memory_input and get_input" {
     const io = std.testing.io;
     var world = World{};
@@ -689,6 +1549,169 @@ test "world: alloc_memory_input and get_input" {
     try std.testing.expectEqualStrings("format", buf[0..6]);
 }
 
+test "world: alloc_owned_input frees the adopted buffer on close" {
+    const io = std.testing.io;
+    var world = World{};
+    defer world.deinit(io);
+
+    const data = try std.testing.allocator.dupe(u8, "fetched font bytes");
+    const h = world.alloc_owned_input(data, std.testing.allocator, "font.otf");
+    try std.testing.expect(h != INVALID_HANDLE);
+    const slot = world.get_input(h).?;
+    try std.testing.expectEqual(data.ptr, (try slot.peek(io)).ptr);
+    slot.close(io);
+    world.release_input(h);
+}
+
+test "world: deflated inputs inflate in chunks and seek back whole" {
+    const io = std.testing.io;
+    var world = World{};
+    defer world.deinit(io);
+
+    const a = std.testing.allocator;
+    const data = try a.alloc(u8, inflate_chunk_len * 3 + 100);
+    defer a.free(data);
+    for (data, 0..) |*b, i| b.* = @truncate(i * 7 + i / 1000);
+    const packed_buf = try a.alloc(u8, data.len + 1024);
+    defer a.free(packed_buf);
+    var packed_len: u64 = packed_buf.len;
+    try std.testing.expect(Flate.tectonic_flate_compress(packed_buf.ptr, &packed_len, data.ptr, data.len, 6) == .success);
+
+    const h = world.alloc_deflated_input(.{ .data = packed_buf[0..@intCast(packed_len)], .raw_len = data.len }, "big.sty");
+    try std.testing.expect(h != INVALID_HANDLE);
+    const slot = world.get_input(h).?;
+    defer {
+        slot.close(io);
+        world.release_input(h);
+    }
+    try std.testing.expectEqual(data.len, try slot.get_size(io));
+
+    // peek only reaches the end of the current chunk
+    const first = try slot.peek(io);
+    try std.testing.expectEqual(inflate_chunk_len, first.len);
+    try std.testing.expectEqualSlices(u8, data[0..inflate_chunk_len], first);
+    slot.consume(first.len - 10);
+
+    // reads carry on into the next chunks
+    var buf: [100]u8 = undefined;
+    try std.testing.expectEqual(@as(usize, 10), try slot.read(io, &buf));
+    try std.testing.expectEqual(@as(usize, 100), try slot.read(io, &buf));
+    try std.testing.expectEqualSlices(u8, data[inflate_chunk_len..][0..100], &buf);
+
+    // forward seeks stay chunked
+    try slot.seek_to(io, inflate_chunk_len * 3 + 50);
+    try std.testing.expect(slot.inflater != null);
+    try std.testing.expectEqual(@as(usize, 50), try slot.read(io, &buf));
+    try std.testing.expectEqualSlices(u8, data[inflate_chunk_len * 3 + 50 ..], buf[0..50]);
+    try std.testing.expectEqual(@as(usize, 0), try slot.read(io, &buf));
+
+    // seeking back inflates the whole entry
+    try slot.seek_by(io, -200);
+    try std.testing.expect(slot.inflater == null);
+    try std.testing.expectEqual(@as(u64, data.len - 200), try slot.get_pos(io));
+    try std.testing.expectEqual(@as(usize, 100), try slot.read(io, &buf));
+    try std.testing.expectEqualSlices(u8, data[data.len - 200 ..][0..100], &buf);
+}
+
+test "world: handle table grows and recycles released handles" {
+    const io = std.testing.io;
+    var world = World{};
+    defer world.deinit(io);
+
+    var handles: [1000]Handle = undefined;
+    for (&handles) |*h| {
+        h.* = world.alloc_memory_input("x", "chapter.tex");
+        try std.testing.expect(h.* != INVALID_HANDLE);
+    }
+    try std.testing.expectEqualStrings("chapter.tex", world.get_input(handles[999]).?.get_name());
+
+    world.get_input(handles[10]).?.close(io);
+    world.release_input(handles[10]);
+    try std.testing.expect(world.get_input(handles[10]) == null);
+    try std.testing.expectEqual(handles[10], world.alloc_memory_input("y", "fig.pdf"));
+    try std.testing.expectEqualStrings("fig.pdf", world.get_input(handles[10]).?.get_name());
+
+    world.reset_io(io);
+    try std.testing.expect(world.get_input(handles[0]) == null);
+    try std.testing.expectEqual(@as(Handle, 1), world.alloc_memory_input("z", "main.tex"));
+}
+
+test "world: missing inputs are forgotten when the engine writes them" {
+    const io = std.testing.io;
+    var world = World{};
+    defer world.deinit(io);
+
+    world.note_missing("thesis.aux", TTBC_FILE_FORMAT_TEX);
+    world.note_missing("thesis", TTBC_FILE_FORMAT_TEX);
+    world.note_missing("babel-foo.cfg", TTBC_FILE_FORMAT_TEX);
+    try std.testing.expect(world.is_known_missing("thesis.aux", TTBC_FILE_FORMAT_TEX));
+    try std.testing.expect(!world.is_known_missing("thesis.aux", TTBC_FILE_FORMAT_BIB));
+
+    world.reset_io(io);
+    try std.testing.expect(world.is_known_missing("babel-foo.cfg", TTBC_FILE_FORMAT_TEX));
+
+    world.forget_missing("thesis.aux");
+    try std.testing.expect(!world.is_known_missing("thesis.aux", TTBC_FILE_FORMAT_TEX));
+    try std.testing.expect(!world.is_known_missing("thesis", TTBC_FILE_FORMAT_TEX));
+
+    world.clear_missing_inputs();
+    try std.testing.expect(!world.is_known_missing("babel-foo.cfg", TTBC_FILE_FORMAT_TEX));
+}
+
+test "world: missing inputs map to the paths that would satisfy them" {
+    const io = std.testing.io;
+    var world = World{};
+    defer world.deinit(io);
+    var arena: std.heap.ArenaAllocator = .init(std.testing.allocator);
+    defer arena.deinit();
+
+    world.add_search_dir(".");
+    world.add_search_dir("chapters");
+    world.note_missing("ch3.tex", TTBC_FILE_FORMAT_TEX);
+    world.note_missing("logo", TTBC_FILE_FORMAT_PICT);
+
+    const paths = try world.missing_input_paths(arena.allocator());
+    var found: usize = 0;
+    for (paths) |path| {
+        for ([_][]const u8{ "ch3.tex", "chapters/ch3.tex", "logo", "logo.pdf", "chapters/logo.jpg" }) |want| {
+            if (std.mem.eql(u8, path, want)) found += 1;
+        }
+        try std.testing.expect(!std.mem.eql(u8, path, "ch3.tex.tex"));
+    }
+    try std.testing.expectEqual(@as(usize, 5), found);
+}
+
+test "world: open log keeps each project path once" {
+    const io = std.testing.io;
+    var world = World{};
+    defer world.deinit(io);
+
+    world.note_opened(null, "main.tex");
+    try std.testing.expect(world.open_log == null);
+
+    world.begin_open_log();
+    world.note_opened(null, "main.tex");
+    world.note_opened(".", "main.tex");
+    world.note_opened("chapters", "intro.tex");
+    world.reset_io(io);
+    world.note_opened("chapters", "intro.tex");
+    const keys = world.open_log.?.keys();
+    try std.testing.expectEqual(@as(usize, 2), keys.len);
+    try std.testing.expectEqualStrings("main.tex", keys[0]);
+    try std.testing.expectEqualStrings("chapters/intro.tex", keys[1]);
+
+    // the compile's own files leave the log, whenever they are read
+    world.set_output_dir(".");
+    world.note_opened(null, "main.aux");
+    world.note_written("main.aux");
+    world.note_opened(null, "main.aux");
+    try std.testing.expectEqual(@as(usize, 2), world.open_log.?.count());
+
+    world.end_open_log();
+    try std.testing.expectEqual(@as(usize, 0), world.written_log.count());
+    try std.testing.expect(world.open_log == null);
+}
+
 test "world: set_format_data and clear_format_data" {
     var world = World{};
     const data = "fake format";
@@ -699,3 +1722,28 @@ test "world: set_format_data and clear_format_data" {
     try std.testing.expectEqual(@as(?[]const u8, null), world.format_data);
     try std.testing.expectEqual(@as(usize, 0), world.format_name_len);
 }
+
+test "world: memory output handoff survives reset_io" {
+    const io = std.testing.io;
+    var world = World{ .capture_xdv = true };
+    defer world.clear_memory_output();
+
+    try std.testing.expect(world.wants_memory_output("main.xdv"));
+    try std.testing.expect(!world.wants_memory_output("main.log"));
+
+    const h = world.alloc_memory_output("main.xdv");
+    try std.testing.expect(h != INVALID_HANDLE);
+    const out = world.get_output(h).?;
+    try out.write(io, "xdv ");
+    try out.writeByte(io, '!');
+
+    const buf = out.mem_buf.?;
+    const data = try buf.toOwnedSlice(io_alloc);
+    io_alloc.destroy(buf);
+    world.outputs[h - 1] = null;
+    world.set_memory_output(data, "main.xdv");
+
+    world.reset_io(io);
+    try std.testing.expectEqualStrings("xdv !", world.find_memory_output("main.xdv").?);
+    try std.testing.expect(world.find_memory_output("other.xdv") == null);
+}
@@ -0,0 +1,283 @@
+// ZipArchive.zig -- a zip project served from the archive itself.
+//
+// The archive is read into memory once and its central directory indexed by
+// member name. A member is inflated only when the engine opens it (see
+// World.archive); stored members are handed out as slices of the archive.
+// When every member sits under one top-level directory (a zipped project
+// folder), names are taken relative to it. Encrypted members are left out;
+// ZIP64 archives are refused.
+
+const ZipArchive = @This();
+const std = @import("std");
+const Io = std.Io;
+const Flate = @import("Flate.zig");
+
+// the archive bytes, the index and inflated members
+pub const alloc = std.heap.c_allocator;
+
+const eocd_signature = 0x06054b50;
+const central_signature = 0x02014b50;
+const local_signature = 0x04034b50;
+const eocd_len = 22;
+const central_len = 46;
+const local_len = 30;
+const max_comment_len = 0xffff;
+
+const method_stored = 0;
+const method_deflated = 8;
+
+const Member = struct {
+    method: u16,
+    crc32: u32,
+    compressed_len: u32,
+    len: u32,
+    local_header: u32,
+};
+
+pub const Contents = union(enum) {
+    // borrowed from the archive
+    stored: []const u8,
+    // inflated for this open; the caller frees it with `alloc`
+    inflated: []u8,
+};
+
+// as given to open, for the watcher's open log
+path: []u8,
+data: []u8,
+// member name relative to the root -> where it is; keys are slices of data
+members: std.StringArrayHashMapUnmanaged(Member) = .empty,
+
+pub fn open(io: Io, path: []const u8) !*ZipArchive {
+    const file = try Io.Dir.cwd().openFile(io, path, .{});
+    defer file.close(io);
+    const stat = try file.stat(io);
+    const data = try alloc.alloc(u8, @intCast(stat.size));
+    errdefer alloc.free(data);
+    const n = try file.readPositionalAll(io, data, 0);
+    if (n != data.len) return error.CorruptArchive;
+    return from_bytes(data, path);
+}
+
+// takes over data (allocated with `alloc`), also on error
+pub fn from_bytes(data: []u8, path: []const u8) !*ZipArchive {
+    errdefer alloc.free(data);
+    const self = try alloc.create(ZipArchive);
+    errdefer alloc.destroy(self);
+    const path_owned = try alloc.dupe(u8, path);
+    errdefer alloc.free(path_owned);
+    self.* = .{ .path = path_owned, .data = data };
+    errdefer self.members.deinit(alloc);
+    try self.index();
+    return self;
+}
+
+pub fn destroy(self: *ZipArchive) void {
+    self.members.deinit(alloc);
+    alloc.free(self.data);
+    alloc.free(self.path);
+    alloc.destroy(self);
+}
+
+// member names, in archive order
+pub fn names(self: *const ZipArchive) []const []const u8 {
+    return self.members.keys();
+}
+
+pub fn contains(self: *const ZipArchive, name: []const u8) bool {
+    return self.members.contains(trim_dot(name));
+}
+
+// the member's bytes, or null if the archive has no such member
+pub fn read(self: *const ZipArchive, name: []const u8) !?Contents {
+    const m = self.members.get(trim_dot(name)) orelse return null;
+    const raw = try self.member_bytes(m);
+    if (m.len == 0) return .{ .stored = raw[0..0] };
+    if (m.method == method_stored) {
+        try check_crc(m, raw);
+        return .{ .stored = raw };
+    }
+    const out = try inflate(alloc, m, raw);
+    return .{ .inflated = out };
+}
+
+// a copy of the member's bytes, owned by the caller
+pub fn read_alloc(self: *const ZipArchive, gpa: std.mem.Allocator, name: []const u8) !?[]u8 {
+    const m = self.members.get(trim_dot(name)) orelse return null;
+    const raw = try self.member_bytes(m);
+    if (m.len == 0) return try gpa.alloc(u8, 0);
+    if (m.method == method_stored) {
+        try check_crc(m, raw);
+        return try gpa.dupe(u8, raw);
+    }
+    return try inflate(gpa, m, raw);
+}
+
+fn inflate(gpa: std.mem.Allocator, m: Member, raw: []const u8) ![]u8 {
+    const out = try Flate.inflate_raw_exact(gpa, raw, m.len);
+    errdefer gpa.free(out);
+    try check_crc(m, out);
+    return out;
+}
+
+fn check_crc(m: Member, bytes: []const u8) !void {
+    if (std.hash.Crc32.hash(bytes) != m.crc32) return error.CorruptEntry;
+}
+
+fn trim_dot(name: []const u8) []const u8 {
+    return if (std.mem.startsWith(u8, name, "./")) name[2..] else name;
+}
+
+fn u16_at(data: []const u8, offset: usize) u16 {
+    return std.mem.readInt(u16, data[offset..][0..2], .little);
+}
+
+fn u32_at(data: []const u8, offset: usize) u32 {
+    return std.mem.readInt(u32, data[offset..][0..4], .little);
+}
+
+// the compressed bytes of m, after its local header
+fn member_bytes(self: *const ZipArchive, m: Member) ![]const u8 {
+    const lh: usize = m.local_header;
+    if (lh + local_len > self.data.len or u32_at(self.data, lh) != local_signature) return error.CorruptArchive;
+    const start = lh + local_len + u16_at(self.data, lh + 26) + u16_at(self.data, lh + 28);
+    if (start + m.compressed_len > self.data.len) return error.CorruptArchive;
+    if (m.method == method_stored and m.compressed_len != m.len) return error.CorruptEntry;
+    if (m.method != method_stored and m.method != method_deflated) return error.UnsupportedMethod;
+    return self.data[start..][0..m.compressed_len];
+}
+
+// the end of central directory record, searched back over a comment
+fn find_eocd(data: []const u8) ?usize {
+    if (data.len < eocd_len) return null;
+    const lowest = data.len -| (eocd_len + max_comment_len);
+    var i = data.len - eocd_len;
+    while (true) : (i -= 1) {
+        if (u32_at(data, i) == eocd_signature) return i;
+        if (i == lowest) return null;
+    }
+}
+
+const Entry = struct {
+    name: []const u8,
+    member: Member,
+};
+
+fn index(self: *ZipArchive) !void {
+    const data = self.data;
+    const eocd = find_eocd(data) orelse return error.NotZip;
+    const count = u16_at(data, eocd + 10);
+    const cd_offset = u32_at(data, eocd + 16);
+    if (count == 0xffff or cd_offset == 0xffffffff) return error.Zip64Unsupported;
+
+    var entries: std.ArrayList(Entry) = .empty;
+    defer entries.deinit(alloc);
+    var o: usize = cd_offset;
+    for (0..count) |_| {
+        if (o + central_len > data.len or u32_at(data, o) != central_signature) return error.CorruptArchive;
+        const flags = u16_at(data, o + 8);
+        const name_len = u16_at(data, o + 28);
+        const next = o + central_len + name_len + u16_at(data, o + 30) + u16_at(data, o + 32);
+        if (next > data.len) return error.CorruptArchive;
+        const member: Member = .{
+            .method = u16_at(data, o + 10),
+            .crc32 = u32_at(data, o + 16),
+            .compressed_len = u32_at(data, o + 20),
+            .len = u32_at(data, o + 24),
+            .local_header = u32_at(data, o + 42),
+        };
+        if (member.compressed_len == 0xffffffff or member.len == 0xffffffff or member.local_header == 0xffffffff) {
+            return error.Zip64Unsupported;
+        }
+        const name = trim_dot(data[o + central_len ..][0..name_len]);
+        o = next;
+
+        // directories, encrypted members and macOS resource forks
+        if (name.len == 0 or name[name.len - 1] == '/') continue;
+        if (flags & 1 != 0) continue;
+        if (std.mem.startsWith(u8, name, "__MACOSX/")) continue;
+        try entries.append(alloc, .{ .name = name, .member = member });
+    }
+
+    const root_len = common_root(entries.items);
+    try self.members.ensureTotalCapacity(alloc, entries.items.len);
+    for (entries.items) |e| self.members.putAssumeCapacity(e.name[root_len..], e.member);
+}
+
+// length of "<dir>/" when every entry lies under that one directory, else 0
+fn common_root(entries: []const Entry) usize {
+    if (entries.len == 0) return 0;
+    const first = entries[0].name;
+    const slash = std.mem.indexOfScalar(u8, first, '/') orelse return 0;
+    const root = first[0 .. slash + 1];
+    for (entries) |e| {
+        if (!std.mem.startsWith(u8, e.name, root)) return 0;
+    }
+    return root.len;
+}
+
+// -- tests --
+
+// a zipped "paper" folder: paper/main.tex deflated, paper/intro.tex stored
+const paper_zip = [_]u8{
+    0x50, 0x4b, 0x03, 0x04, 0x14, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x21, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x06, 0x00, 0x00, 0x00, 0x70, 0x61,
+    0x70, 0x65, 0x72, 0x2f, 0x50, 0x4b, 0x03, 0x04, 0x14, 0x00, 0x00, 0x00, 0x08, 0x00, 0x7c, 0x23,
+    0x4f, 0x5d, 0x50, 0x67, 0x43, 0x5a, 0x36, 0x00, 0x00, 0x00, 0x43, 0x00, 0x00, 0x00, 0x0e, 0x00,
+    0x00, 0x00, 0x70, 0x61, 0x70, 0x65, 0x72, 0x2f, 0x6d, 0x61, 0x69, 0x6e, 0x2e, 0x74, 0x65, 0x78,
+    0x8b, 0x49, 0xc9, 0x4f, 0x2e, 0xcd, 0x4d, 0xcd, 0x2b, 0x49, 0xce, 0x49, 0x2c, 0x2e, 0xae, 0x4e,
+    0x2c, 0x2a, 0xc9, 0x4c, 0xce, 0x49, 0xad, 0x8d, 0x49, 0x4a, 0x4d, 0xcf, 0xcc, 0xab, 0x86, 0x49,
+    0xd6, 0xc6, 0x64, 0xe6, 0x15, 0x94, 0x96, 0x54, 0x67, 0xe6, 0x95, 0x14, 0xe5, 0xd7, 0xc6, 0xa4,
+    0xe6, 0xa5, 0x20, 0xa4, 0xb8, 0x00, 0x50, 0x4b, 0x03, 0x04, 0x14, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x7c, 0x23, 0x4f, 0x5d, 0x51, 0xc4, 0xda, 0x37, 0x07, 0x00, 0x00, 0x00, 0x07, 0x00, 0x00, 0x00,
+    0x0f, 0x00, 0x00, 0x00, 0x70, 0x61, 0x70, 0x65, 0x72, 0x2f, 0x69, 0x6e, 0x74, 0x72, 0x6f, 0x2e,
+    0x74, 0x65, 0x78, 0x48, 0x65, 0x6c, 0x6c, 0x6f, 0x2e, 0x0a, 0x50, 0x4b, 0x01, 0x02, 0x14, 0x03,
+    0x14, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x21, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x06, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x80, 0x01, 0x00, 0x00, 0x00, 0x00, 0x70, 0x61, 0x70, 0x65, 0x72, 0x2f, 0x50, 0x4b,
+    0x01, 0x02, 0x14, 0x03, 0x14, 0x00, 0x00, 0x00, 0x08, 0x00, 0x7c, 0x23, 0x4f, 0x5d, 0x50, 0x67,
+    0x43, 0x5a, 0x36, 0x00, 0x00, 0x00, 0x43, 0x00, 0x00, 0x00, 0x0e, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80, 0x01, 0x24, 0x00, 0x00, 0x00, 0x70, 0x61, 0x70, 0x65,
+    0x72, 0x2f, 0x6d, 0x61, 0x69, 0x6e, 0x2e, 0x74, 0x65, 0x78, 0x50, 0x4b, 0x01, 0x02, 0x14, 0x03,
+    0x14, 0x00, 0x00, 0x00, 0x00, 0x00, 0x7c, 0x23, 0x4f, 0x5d, 0x51, 0xc4, 0xda, 0x37, 0x07, 0x00,
+    0x00, 0x00, 0x07, 0x00, 0x00, 0x00, 0x0f, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x80, 0x01, 0x86, 0x00, 0x00, 0x00, 0x70, 0x61, 0x70, 0x65, 0x72, 0x2f, 0x69, 0x6e,
+    0x74, 0x72, 0x6f, 0x2e, 0x74, 0x65, 0x78, 0x50, 0x4b, 0x05, 0x06, 0x00, 0x00, 0x00, 0x00, 0x03,
+    0x00, 0x03, 0x00, 0xad, 0x00, 0x00, 0x00, 0xba, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+test "members are indexed under the project folder and read on demand" {
+    const testing = std.testing;
+    const archive = try from_bytes(try alloc.dupe(u8, &paper_zip), "paper.zip");
+    defer archive.destroy();
+
+    try testing.expectEqual(@as(usize, 2), archive.names().len);
+    try testing.expectEqualStrings("main.tex", archive.names()[0]);
+    try testing.expect(archive.contains("./intro.tex"));
+    try testing.expect(!archive.contains("paper/intro.tex"));
+    try testing.expect(try archive.read("missing.tex") == null);
+
+    const intro = (try archive.read("intro.tex")).?;
+    try testing.expectEqualStrings("Hello.\n", intro.stored);
+
+    const main = (try archive.read("main.tex")).?;
+    defer alloc.free(main.inflated);
+    try testing.expect(std.mem.startsWith(u8, main.inflated, "\\documentclass{article}"));
+
+    const copy = (try archive.read_alloc(testing.allocator, "main.tex")).?;
+    defer testing.allocator.free(copy);
+    try testing.expectEqualStrings(main.inflated, copy);
+}
+
+test "a damaged member fails its checksum" {
+    var bytes = paper_zip;
+    // the last byte of intro.tex's data
+    const at = std.mem.indexOf(u8, &bytes, "Hello.\n").? + 5;
+    bytes[at] = '!';
+    const archive = try from_bytes(try alloc.dupe(u8, &bytes), "paper.zip");
+    defer archive.destroy();
+    try std.testing.expectError(error.CorruptEntry, archive.read("intro.tex"));
+}
+
+test "not a zip" {
+    try std.testing.expectError(error.NotZip, from_bytes(try alloc.dupe(u8, "\\documentclass{article}"), "x.zip"));
+}
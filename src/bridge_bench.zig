@@ -0,0 +1,292 @@
+// bridge_bench.zig -- microbenchmarks for the C<->Zig I/O bridge.
+//
+// Every byte the engines read or write crosses the ttbc_* exports of
+// Engine.zig. This drives those exports the way the C side does, against
+// each kind of slot World hands out, so a change to InputSlot/OutputSlot
+// buffering can be measured without a whole compile around it:
+//
+//   input   memory, file (heap copy, below mmap_threshold), file (mapped)
+//           x getc, read in 4 KiB blocks, peek/consume a line at a time
+//   output  file, gzip file, memory (the in-memory .xdv handoff)
+//           x putc, write in 16-byte pieces (a short fprintf), 64 KiB blocks
+//   open    a file on disk and a name known to be missing, opened (and
+//           closed) over and over, as a compile loading packages does
+//
+// The open cases are mostly Log.dbg calls around a little lookup: compare
+// a build with -Ddebug-log=false against one with -Ddebug-log=true, and
+// --debug (stderr to /dev/null) for what formatting the messages costs.
+//
+// usage: zig build bench-io -Doptimize=ReleaseFast [-- --mib N --filter S --debug]
+// scratch files go to tmp/bridge_bench under the current directory.
+
+const std = @import("std");
+const Io = std.Io;
+const Log = @import("Log.zig");
+const Engine = @import("Engine.zig");
+const World = Engine.World;
+
+const Handle = World.Handle;
+const INVALID_HANDLE = World.INVALID_HANDLE;
+
+// the bridge as support.c sees it; resolved against Engine.zig's exports
+extern fn ttbc_input_open(name: [*:0]const u8, format: c_int, is_gz: c_int) Handle;
+extern fn ttbc_input_getc(handle: Handle) c_int;
+extern fn ttbc_input_read(handle: Handle, data: [*]u8, len: usize) isize;
+extern fn ttbc_input_peek(handle: Handle, data: *[*]const u8, len: *usize) c_int;
+extern fn ttbc_input_consume(handle: Handle, n: usize) void;
+extern fn ttbc_input_close(handle: Handle) c_int;
+extern fn ttbc_output_open(name: [*:0]const u8, is_gz: c_int) Handle;
+extern fn ttbc_output_putc(handle: Handle, c: c_int) c_int;
+extern fn ttbc_output_write(handle: Handle, data: [*]const u8, len: usize) usize;
+extern fn ttbc_output_close(handle: Handle) c_int;
+
+const scratch_dir = "tmp/bridge_bench";
+// a small input: read whole, like most .sty and .tfm files
+const small_file_len = 128 * 1024;
+
+const InputKind = enum { memory, file_small, file_mapped };
+const InputPattern = enum { getc, read_4k, peek_lines };
+const OutputKind = enum { file, gzip, memory };
+const OutputPattern = enum { putc, write_16, write_64k };
+
+const Bench = struct {
+    io: Io,
+    // text-like bytes (lines of TeX source), so gzip sees a realistic ratio
+    payload: []u8,
+    filter: ?[]const u8,
+    w: *Io.Writer,
+
+    fn selected(self: *const Bench, name: []const u8) bool {
+        const f = self.filter orelse return true;
+        return std.mem.indexOf(u8, name, f) != null;
+    }
+
+    fn report(self: *Bench, name: []const u8, bytes: usize, calls: usize, elapsed_ns: u64, check: u64) !void {
+        const secs = @as(f64, @floatFromInt(@max(elapsed_ns, 1))) / std.time.ns_per_s;
+        const mib = @as(f64, @floatFromInt(bytes)) / (1024 * 1024);
+        try self.w.print("  {s:<28} {d:>9.1} MiB/s  {d:>7.2} ns/call  ({d} calls, check {x})\n", .{
+            name,
+            mib / secs,
+            @as(f64, @floatFromInt(elapsed_ns)) / @as(f64, @floatFromInt(@max(calls, 1))),
+            calls,
+            check & 0xffff,
+        });
+        try self.w.flush();
+    }
+};
+
+fn fillPayload(payload: []u8) void {
+    const line = "\\section{Results} The value of $x_{i}$ is \\SI{12.5}{\\milli\\metre}, see~\\cite{knuth1984}.\n";
+    var i: usize = 0;
+    var n: u32 = 0;
+    while (i < payload.len) : (n +%= 1) {
+        const chunk = @min(line.len, payload.len - i);
+        @memcpy(payload[i..][0..chunk], line[0..chunk]);
+        // vary a digit per line so the text is not one repeated string
+        if (chunk > 40) payload[i + 40] = '0' + @as(u8, @intCast(n % 10));
+        i += chunk;
+    }
+}
+
+// -- inputs --
+
+fn openInput(b: *Bench, kind: InputKind, path: []const u8) !Handle {
+    const world = Engine.get_world();
+    const h = switch (kind) {
+        .memory => world.alloc_memory_input(b.payload, "bench.tex"),
+        .file_small, .file_mapped => blk: {
+            const file = try Io.Dir.cwd().openFile(b.io, path, .{});
+            break :blk world.alloc_input(b.io, file, path);
+        },
+    };
+    if (h == INVALID_HANDLE) return error.OpenFailed;
+    return h;
+}
+
+// read one opened input to its end; returns calls made and adds to check
+fn drainInput(h: Handle, pattern: InputPattern, check: *u64) usize {
+    var calls: usize = 0;
+    switch (pattern) {
+        .getc => while (true) {
+            const c = ttbc_input_getc(h);
+            calls += 1;
+            if (c < 0) break;
+            check.* +%= @intCast(c);
+        },
+        .read_4k => {
+            var buf: [4096]u8 = undefined;
+            while (true) {
+                const n = ttbc_input_read(h, &buf, buf.len);
+                calls += 1;
+                if (n <= 0) break;
+                check.* +%= buf[@intCast(n - 1)];
+                if (n < @as(isize, buf.len)) break;
+            }
+        },
+        .peek_lines => while (true) {
+            var data: [*]const u8 = undefined;
+            var len: usize = 0;
+            calls += 1;
+            if (ttbc_input_peek(h, &data, &len) != 0 or len == 0) break;
+            const line_len = if (std.mem.indexOfScalar(u8, data[0..len], '\n')) |nl| nl + 1 else len;
+            check.* +%= data[line_len - 1];
+            ttbc_input_consume(h, line_len);
+        },
+    }
+    return calls;
+}
+
+fn benchInput(b: *Bench, kind: InputKind, pattern: InputPattern, small_path: []const u8, large_path: []const u8) !void {
+    var name_buf: [64]u8 = undefined;
+    const name = try std.fmt.bufPrint(&name_buf, "in  {s} {s}", .{ @tagName(kind), @tagName(pattern) });
+    if (!b.selected(name)) return;
+
+    // small files are opened again until the payload's worth has been read
+    const per_open: usize = if (kind == .file_small) small_file_len else b.payload.len;
+    const opens = @max(b.payload.len / per_open, 1);
+    const path = if (kind == .file_small) small_path else large_path;
+
+    var check: u64 = 0;
+    var calls: usize = 0;
+    const started = Io.Clock.Timestamp.now(b.io, .awake);
+    for (0..opens) |_| {
+        const h = try openInput(b, kind, path);
+        calls += drainInput(h, pattern, &check);
+        _ = ttbc_input_close(h);
+    }
+    const elapsed: u64 = @intCast(@max(0, started.untilNow(b.io).raw.nanoseconds));
+    Engine.get_world().reset_io(b.io);
+    try b.report(name, opens * per_open, calls, elapsed, check);
+}
+
+// -- opens --
+
+const open_count = 100_000;
+
+fn benchOpen(b: *Bench, comptime what: []const u8, name: [*:0]const u8) !void {
+    const bench_name = "open " ++ what;
+    if (!b.selected(bench_name)) return;
+
+    var check: u64 = 0;
+    const started = Io.Clock.Timestamp.now(b.io, .awake);
+    for (0..open_count) |_| {
+        const h = ttbc_input_open(name, World.TTBC_FILE_FORMAT_TEX, 0);
+        if (h != INVALID_HANDLE) {
+            check +%= h;
+            _ = ttbc_input_close(h);
+        }
+    }
+    const elapsed: u64 = @intCast(@max(0, started.untilNow(b.io).raw.nanoseconds));
+    Engine.get_world().reset_io(b.io);
+    try b.report(bench_name, 0, open_count, elapsed, check);
+}
+
+// -- outputs --
+
+fn benchOutput(b: *Bench, kind: OutputKind, pattern: OutputPattern) !void {
+    var name_buf: [64]u8 = undefined;
+    const name = try std.fmt.bufPrint(&name_buf, "out {s} {s}", .{ @tagName(kind), @tagName(pattern) });
+    if (!b.selected(name)) return;
+
+    const world = Engine.get_world();
+    world.capture_xdv = kind == .memory;
+    defer world.capture_xdv = false;
+    const file_name: [*:0]const u8 = switch (kind) {
+        .file => "bench.out",
+        .gzip => "bench.out.gz",
+        .memory => "bench.xdv",
+    };
+
+    var calls: usize = 0;
+    const started = Io.Clock.Timestamp.now(b.io, .awake);
+    const h = ttbc_output_open(file_name, @intFromBool(kind == .gzip));
+    if (h == INVALID_HANDLE) return error.OpenFailed;
+    switch (pattern) {
+        .putc => for (b.payload) |c| {
+            _ = ttbc_output_putc(h, c);
+            calls += 1;
+        },
+        .write_16, .write_64k => {
+            const step: usize = if (pattern == .write_16) 16 else 64 * 1024;
+            var i: usize = 0;
+            while (i < b.payload.len) : (i += step) {
+                const n = @min(step, b.payload.len - i);
+                _ = ttbc_output_write(h, b.payload[i..].ptr, n);
+                calls += 1;
+            }
+        },
+    }
+    if (ttbc_output_close(h) != 0) return error.CloseFailed;
+    const elapsed: u64 = @intCast(@max(0, started.untilNow(b.io).raw.nanoseconds));
+
+    // the memory handoff keeps the bytes for xdvipdfmx; check and drop them
+    var check: u64 = 0;
+    if (world.find_memory_output("bench.xdv")) |data| check = data.len;
+    world.clear_memory_output();
+    world.reset_io(b.io);
+    try b.report(name, b.payload.len, calls, elapsed, check);
+}
+
+fn writeScratch(io: Io, path: []const u8, data: []const u8) !void {
+    try Io.Dir.cwd().writeFile(io, .{ .sub_path = path, .data = data });
+}
+
+pub fn main(init: std.process.Init) !u8 {
+    const io = init.io;
+    Engine.set_global_io(io);
+    const allocator = std.heap.c_allocator;
+
+    var mib: usize = 64;
+    var filter: ?[]const u8 = null;
+    var args = try init.minimal.args.iterateAllocator(allocator);
+    defer args.deinit();
+    _ = args.next();
+    while (args.next()) |arg| {
+        if (std.mem.eql(u8, arg, "--mib")) {
+            mib = try std.fmt.parseInt(usize, args.next() orelse return error.MissingValue, 10);
+        } else if (std.mem.eql(u8, arg, "--filter")) {
+            filter = args.next() orelse return error.MissingValue;
+        } else if (std.mem.eql(u8, arg, "--debug")) {
+            Log.set_debug(true);
+        } else {
+            std.debug.print("usage: bridge-bench [--mib N] [--filter TEXT] [--debug]\n", .{});
+            return 1;
+        }
+    }
+
+    const payload = try allocator.alloc(u8, @max(mib, 1) * 1024 * 1024);
+    defer allocator.free(payload);
+    fillPayload(payload);
+
+    try Io.Dir.cwd().createDirPath(io, scratch_dir);
+    defer Io.Dir.cwd().deleteTree(io, scratch_dir) catch {};
+    const small_path = scratch_dir ++ "/small.tex";
+    const large_path = scratch_dir ++ "/large.tex";
+    try writeScratch(io, small_path, payload[0..small_file_len]);
+    try writeScratch(io, large_path, payload);
+    Engine.get_world().set_output_dir(scratch_dir);
+
+    const stdout_file = Io.File.stdout();
+    var out_buf: [4096]u8 = undefined;
+    var file_writer = stdout_file.writer(io, &out_buf);
+    var b: Bench = .{ .io = io, .payload = payload, .filter = filter, .w = &file_writer.interface };
+
+    try b.w.print("=== bridge I/O: {d} MiB per case, debug log {s} ===\n", .{
+        mib,
+        if (!Log.debug_compiled) "compiled out" else if (Log.is_debug()) "on" else "off",
+    });
+    inline for (std.meta.tags(InputKind)) |kind| {
+        inline for (std.meta.tags(InputPattern)) |pattern| {
+            try benchInput(&b, kind, pattern, small_path, large_path);
+        }
+    }
+    try benchOpen(&b, "file", small_path);
+    try benchOpen(&b, "missing", scratch_dir ++ "/missing.sty");
+    inline for (std.meta.tags(OutputKind)) |kind| {
+        inline for (std.meta.tags(OutputPattern)) |pattern| {
+            try benchOutput(&b, kind, pattern);
+        }
+    }
+    try b.w.flush();
+    return 0;
+}
@@ -12,7 +12,7 @@ pub const BibliographyState = struct {
     citation_digest: [Md5.digest_length * 2]u8,
 };
 
-const BibliographyKind = enum {
+pub const BibliographyKind = enum {
     none,
     biblatex,
     bibtex,
@@ -27,7 +27,49 @@ const biblatex_markers = [_][]const u8{
     "\\abx@aux@",
 };
 
+// where the compile's files are when they are not on disk: an embedded
+// compile (see Embedded.zig) keeps the document and everything the engines
+// write in memory, and the reads and writes here go there instead
+pub const Overlay = struct {
+    ctx: *anyopaque,
+    read: *const fn (ctx: *anyopaque, path: []const u8) ?[]const u8,
+    write: *const fn (ctx: *anyopaque, path: []const u8, data: []const u8) bool,
+};
+
+pub threadlocal var overlay: ?Overlay = null;
+
+// the compile's scratch arena, for what its passes allocate and drop again:
+// the aux files the walks below read and the paths they resolve, the
+// stabilization snapshots. Compiler.compileWithEngine sets it and frees it
+// all when the compile ends, so frees into it cost nothing and a
+// long-running server does not hold on to a compile's leftovers. outside a
+// compile (tests, tools) the same calls go to c_allocator.
+pub threadlocal var scratch: ?*std.heap.ArenaAllocator = null;
+
+pub fn scratch_allocator() std.mem.Allocator {
+    if (scratch) |arena| return arena.allocator();
+    return std.heap.c_allocator;
+}
+
+// read_file_contents into scratch_allocator; free with free_scratch
+pub fn read_scratch(io: Io, path: []const u8) ?[]const u8 {
+    return read_file_contents_alloc(io, scratch_allocator(), path);
+}
+
+pub fn free_scratch(contents: ?[]const u8) void {
+    if (contents) |c| scratch_allocator().free(c);
+}
+
 pub fn read_file_contents(io: Io, path: []const u8) ?[]const u8 {
+    return read_file_contents_alloc(io, std.heap.c_allocator, path);
+}
+
+fn read_file_contents_alloc(io: Io, gpa: std.mem.Allocator, path: []const u8) ?[]const u8 {
+    if (overlay) |o| {
+        const data = o.read(o.ctx, path) orelse return null;
+        if (data.len == 0) return null;
+        return gpa.dupe(u8, data) catch null;
+    }
     // Use openFileAbsolute for absolute paths, cwd().openFile for relative paths
     const file = if (std.fs.path.isAbsolute(path))
         Io.Dir.openFileAbsolute(io, path, .{}) catch return null
@@ -40,16 +82,16 @@ pub fn read_file_contents(io: Io, path: []const u8) ?[]const u8 {
     if (size == 0) return null;
     
     // Use the same pattern as World.zig for reading files
-    const data = std.heap.c_allocator.alloc(u8, size) catch return null;
-    errdefer std.heap.c_allocator.free(data);
+    const data = gpa.alloc(u8, size) catch return null;
+    errdefer gpa.free(data);
     
     const bytes_read = file.readPositionalAll(io, data, 0) catch {
-        std.heap.c_allocator.free(data);
+        gpa.free(data);
         return null;
     };
     
     if (bytes_read != size) {
-        std.heap.c_allocator.free(data);
+        gpa.free(data);
         return null;
     }
     
@@ -66,58 +108,91 @@ pub fn aux_changed(prev: ?[]const u8, curr: ?[]const u8) bool {
     return !std.mem.eql(u8, prev.?, curr.?);
 }
 
-pub fn aux_needs_bibtex(io: Io, aux_path: []const u8, aux_contents: ?[]const u8) bool {
-    return detect_bibliography_kind(io, aux_path, aux_contents) == .bibtex;
-}
-
-pub fn aux_is_biblatex(io: Io, aux_path: []const u8, aux_contents: ?[]const u8) bool {
-    return detect_bibliography_kind(io, aux_path, aux_contents) == .biblatex;
-}
+// what one walk over an aux file and the aux files it \@input's finds,
+// each of them read once. Free with deinit.
+pub const AuxScan = struct {
+    kind: BibliographyKind = .none,
+    // of the whole tree; null when it has no bibliography
+    state: ?BibliographyState = null,
+    // the aux files to run bibtex on, as paths relative to where the main aux
+    // is. Normally that is just the main aux: bibtex follows its \@input lines
+    // itself. When more than one aux file names its own databases (chapterbib
+    // and the like give each \include'd chapter a bibliography), each of
+    // those is a separate job with its own .bbl and its own state.
+    jobs: std.ArrayListUnmanaged(BibtexJob) = .empty,
+
+    pub fn deinit(self: *AuxScan) void {
+        const allocator = scratch_allocator();
+        for (self.jobs.items) |job| allocator.free(job.path);
+        self.jobs.deinit(allocator);
+        self.* = .{};
+    }
+};
 
-fn detect_bibliography_kind(io: Io, aux_path: []const u8, aux_contents: ?[]const u8) BibliographyKind {
-    const allocator = std.heap.c_allocator;
-    var detected = bibliography_kind_from_bcf(io, aux_path);
+pub const BibtexJob = struct {
+    path: []u8,
+    state: ?BibliographyState,
+};
 
-    const content = aux_contents orelse return detected;
+pub fn scan_aux(io: Io, aux_path: []const u8, aux_contents: ?[]const u8) AuxScan {
+    const allocator = scratch_allocator();
+    var scan: AuxScan = .{ .kind = bibliography_kind_from_bcf(io, aux_path) };
+
+    if (aux_contents) |content| {
+        var scanner: AuxScanner = .{ .io = io, .allocator = allocator, .scan = &scan };
+        defer scanner.deinit();
+        if (resolve_aux_path(allocator, null, aux_path)) |resolved| {
+            if (scanner.visited.append(allocator, resolved)) |_| {
+                scan.state = scanner.walk(resolved, aux_path, content);
+            } else |_| allocator.free(resolved);
+        } else |_| {
+            scan.kind = merge_bibliography_kind(scan.kind, aux_contents_bibliography_kind(content));
+        }
+    }
 
-    var visited: std.ArrayListUnmanaged([]u8) = .empty;
-    defer {
-        for (visited.items) |path| allocator.free(path);
-        visited.deinit(allocator);
+    if (scan.jobs.items.len <= 1) {
+        for (scan.jobs.items) |job| allocator.free(job.path);
+        scan.jobs.clearRetainingCapacity();
+        const main = allocator.dupe(u8, aux_path) catch return scan;
+        scan.jobs.append(allocator, .{ .path = main, .state = scan.state }) catch allocator.free(main);
     }
+    return scan;
+}
 
-    const resolved_aux_path = resolve_aux_path(allocator, null, aux_path) catch {
-        return merge_bibliography_kind(detected, aux_contents_bibliography_kind(content));
-    };
-    visited.append(allocator, resolved_aux_path) catch {
-        allocator.free(resolved_aux_path);
-        return merge_bibliography_kind(detected, aux_contents_bibliography_kind(content));
-    };
+pub fn aux_needs_bibtex(io: Io, aux_path: []const u8, aux_contents: ?[]const u8) bool {
+    var scan = scan_aux(io, aux_path, aux_contents);
+    defer scan.deinit();
+    return scan.kind == .bibtex;
+}
 
-    detected = merge_bibliography_kind(detected, detect_bibliography_kind_recursive(io, resolved_aux_path, content, &visited));
-    return detected;
+pub fn aux_is_biblatex(io: Io, aux_path: []const u8, aux_contents: ?[]const u8) bool {
+    var scan = scan_aux(io, aux_path, aux_contents);
+    defer scan.deinit();
+    return scan.kind == .biblatex;
 }
 
 pub fn bibliography_state(io: Io, aux_path: []const u8, aux_contents: ?[]const u8) ?BibliographyState {
-    const content = aux_contents orelse return null;
-    const allocator = std.heap.c_allocator;
-
-    var visited: std.ArrayListUnmanaged([]u8) = .empty;
-    defer {
-        for (visited.items) |path| allocator.free(path);
-        visited.deinit(allocator);
+    var scan = scan_aux(io, aux_path, aux_contents);
+    defer scan.deinit();
+    return scan.state;
+}
+
+// the paths of scan_aux's jobs. Free with free_bibtex_jobs.
+pub fn bibtex_jobs(io: Io, aux_path: []const u8, aux_contents: ?[]const u8) std.ArrayListUnmanaged([]u8) {
+    const allocator = scratch_allocator();
+    var scan = scan_aux(io, aux_path, aux_contents);
+    defer scan.deinit();
+    var jobs: std.ArrayListUnmanaged([]u8) = .empty;
+    for (scan.jobs.items) |*job| {
+        jobs.append(allocator, job.path) catch continue;
+        job.path = &.{};
     }
+    return jobs;
+}
 
-    const resolved_aux_path = resolve_aux_path(allocator, null, aux_path) catch return null;
-    visited.append(allocator, resolved_aux_path) catch {
-        allocator.free(resolved_aux_path);
-        return null;
-    };
-
-    var collector = BibliographyCollector.init();
-    bibliography_state_recursive(io, resolved_aux_path, content, &visited, &collector);
-    if (!collector.has_bibliography) return null;
-    return collector.finish();
+pub fn free_bibtex_jobs(jobs: *std.ArrayListUnmanaged([]u8)) void {
+    for (jobs.items) |job| scratch_allocator().free(job);
+    jobs.deinit(scratch_allocator());
 }
 
 pub fn read_bibliography_state(io: Io, path: []const u8) ?BibliographyState {
@@ -146,18 +221,26 @@ pub fn read_bibliography_state(io: Io, path: []const u8) ?BibliographyState {
 }
 
 pub fn write_bibliography_state(io: Io, path: []const u8, state: BibliographyState) !void {
-    const file = if (std.fs.path.isAbsolute(path))
-        try Io.Dir.createFileAbsolute(io, path, .{})
-    else
-        try Io.Dir.cwd().createFile(io, path, .{});
-    defer file.close(io);
-
     var buf: [160]u8 = undefined;
     const contents = try std.fmt.bufPrint(&buf, "inputs={s}\ncitations={s}\n", .{
         state.input_digest,
         state.citation_digest,
     });
-    try file.writeStreamingAll(io, contents);
+    try write_file(io, path, contents);
+}
+
+// a file the compile writes itself, beside its outputs
+pub fn write_file(io: Io, path: []const u8, data: []const u8) !void {
+    if (overlay) |o| {
+        if (!o.write(o.ctx, path, data)) return error.OutOfMemory;
+        return;
+    }
+    const file = if (std.fs.path.isAbsolute(path))
+        try Io.Dir.createFileAbsolute(io, path, .{})
+    else
+        try Io.Dir.cwd().createFile(io, path, .{});
+    defer file.close(io);
+    try file.writeStreamingAll(io, data);
 }
 
 pub fn bib_inputs_changed(current: ?BibliographyState, previous: ?BibliographyState) bool {
@@ -181,36 +264,6 @@ fn aux_contents_bibliography_kind(aux_contents: []const u8) BibliographyKind {
     return .none;
 }
 
-fn detect_bibliography_kind_recursive(io: Io, aux_path: []const u8, aux_contents: []const u8, visited: *std.ArrayListUnmanaged([]u8)) BibliographyKind {
-    const allocator = std.heap.c_allocator;
-    var detected = aux_contents_bibliography_kind(aux_contents);
-    if (detected == .bibtex) return .bibtex;
-
-    var lines = std.mem.splitScalar(u8, aux_contents, '\n');
-    while (lines.next()) |line| {
-        const include_path = parse_aux_input_path(line) orelse continue;
-        const resolved_include = resolve_aux_path(allocator, aux_path, include_path) catch continue;
-
-        if (path_was_visited(visited.items, resolved_include)) {
-            allocator.free(resolved_include);
-            continue;
-        }
-
-        visited.append(allocator, resolved_include) catch {
-            allocator.free(resolved_include);
-            continue;
-        };
-
-        const include_contents = read_file_contents(io, resolved_include) orelse continue;
-        defer free_file_contents(include_contents);
-
-        detected = merge_bibliography_kind(detected, detect_bibliography_kind_recursive(io, resolved_include, include_contents, visited));
-        if (detected == .bibtex) return .bibtex;
-    }
-
-    return detected;
-}
-
 fn merge_bibliography_kind(lhs: BibliographyKind, rhs: BibliographyKind) BibliographyKind {
     if (lhs == .bibtex or rhs == .bibtex) return .bibtex;
     if (lhs == .biblatex or rhs == .biblatex) return .biblatex;
@@ -218,7 +271,7 @@ fn merge_bibliography_kind(lhs: BibliographyKind, rhs: BibliographyKind) Bibliog
 }
 
 fn bibliography_kind_from_bcf(io: Io, aux_path: []const u8) BibliographyKind {
-    const allocator = std.heap.c_allocator;
+    const allocator = scratch_allocator();
     const bcf_path = companion_file_path(allocator, aux_path, ".bcf") catch return .none;
     defer allocator.free(bcf_path);
 
@@ -231,7 +284,8 @@ fn companion_file_path(allocator: std.mem.Allocator, path: []const u8, ext: []co
     return std.fmt.allocPrint(allocator, "{s}{s}", .{ path[0..stem_len], ext });
 }
 
-fn file_exists(io: Io, path: []const u8) bool {
+pub fn file_exists(io: Io, path: []const u8) bool {
+    if (overlay) |o| return o.read(o.ctx, path) != null;
     const file = if (std.fs.path.isAbsolute(path))
         Io.Dir.openFileAbsolute(io, path, .{}) catch return false
     else
@@ -291,61 +345,118 @@ const BibliographyCollector = struct {
     }
 };
 
-fn bibliography_state_recursive(io: Io, aux_path: []const u8, aux_contents: []const u8, visited: *std.ArrayListUnmanaged([]u8), collector: *BibliographyCollector) void {
-    const allocator = std.heap.c_allocator;
+// the walk of scan_aux. A bibliography's citations and databases are hashed
+// into the collector of the main aux and into that of each job file the walk
+// is inside of, so every job gets the state of its own tree as well.
+const AuxScanner = struct {
+    io: Io,
+    allocator: std.mem.Allocator,
+    scan: *AuxScan,
+    visited: std.ArrayListUnmanaged([]u8) = .empty,
+    collectors: std.ArrayListUnmanaged(BibliographyCollector) = .empty,
+
+    fn deinit(self: *AuxScanner) void {
+        for (self.visited.items) |path| self.allocator.free(path);
+        self.visited.deinit(self.allocator);
+        self.collectors.deinit(self.allocator);
+    }
 
-    var lines = std.mem.splitScalar(u8, aux_contents, '\n');
-    while (lines.next()) |line| {
-        if (parse_bibdata(line)) |entries| {
-            collector.record_citation(line);
-            record_bib_inputs(io, aux_path, entries, ".bib", collector);
+    // the state of aux_path's tree, with aux_path visited already
+    fn walk(self: *AuxScanner, aux_path: []const u8, job_path: []const u8, aux_contents: []const u8) ?BibliographyState {
+        const allocator = self.allocator;
+        self.scan.kind = merge_bibliography_kind(self.scan.kind, aux_contents_bibliography_kind(aux_contents));
+
+        // a job file comes before the jobs \@input'd from it
+        const job_index: ?usize = if (names_databases(aux_contents)) blk: {
+            const path = allocator.dupe(u8, job_path) catch break :blk null;
+            self.scan.jobs.append(allocator, .{ .path = path, .state = null }) catch {
+                allocator.free(path);
+                break :blk null;
+            };
+            break :blk self.scan.jobs.items.len - 1;
+        } else null;
+        self.collectors.append(allocator, BibliographyCollector.init()) catch return null;
+
+        var lines = std.mem.splitScalar(u8, aux_contents, '\n');
+        while (lines.next()) |line| {
+            if (parse_bibdata(line)) |entries| {
+                self.record_citation(line);
+                self.record_bib_inputs(aux_path, entries, ".bib");
+            }
+
+            if (parse_bibstyle(line)) |style| {
+                self.record_citation(line);
+                self.record_bib_inputs(aux_path, style, ".bst");
+            }
+
+            if (parse_citation_line(line)) {
+                self.record_citation(line);
+            }
+
+            const include_path = parse_aux_input_path(line) orelse continue;
+            const resolved_include = resolve_aux_path(allocator, aux_path, include_path) catch continue;
+
+            if (path_was_visited(self.visited.items, resolved_include)) {
+                allocator.free(resolved_include);
+                continue;
+            }
+
+            self.visited.append(allocator, resolved_include) catch {
+                allocator.free(resolved_include);
+                continue;
+            };
+
+            const include_contents = read_scratch(self.io, resolved_include) orelse continue;
+            defer free_scratch(include_contents);
+
+            // as bibtex itself names it: relative to the including aux's directory
+            const include_job = if (std.fs.path.isAbsolute(include_path) or std.fs.path.dirname(job_path) == null)
+                allocator.dupe(u8, include_path) catch continue
+            else
+                std.fs.path.join(allocator, &.{ std.fs.path.dirname(job_path).?, include_path }) catch continue;
+            defer allocator.free(include_job);
+
+            _ = self.walk(resolved_include, include_job, include_contents);
         }
 
-        if (parse_bibstyle(line)) |style| {
-            collector.record_citation(line);
-            record_bib_inputs(io, aux_path, style, ".bst", collector);
-        }
+        var collector = self.collectors.pop().?;
+        const state: ?BibliographyState = if (collector.has_bibliography) collector.finish() else null;
+        if (job_index) |index| self.scan.jobs.items[index].state = state;
+        return state;
+    }
 
-        if (parse_citation_line(line)) {
-            collector.record_citation(line);
-        }
+    fn record_citation(self: *AuxScanner, line: []const u8) void {
+        for (self.collectors.items) |*collector| collector.record_citation(line);
+    }
 
-        const include_path = parse_aux_input_path(line) orelse continue;
-        const resolved_include = resolve_aux_path(allocator, aux_path, include_path) catch continue;
+    fn record_bib_inputs(self: *AuxScanner, aux_path: []const u8, payload: []const u8, default_ext: []const u8) void {
+        const allocator = self.allocator;
+        var parts = std.mem.splitScalar(u8, payload, ',');
+        while (parts.next()) |part_raw| {
+            const part = std.mem.trim(u8, part_raw, " \t\r");
+            if (part.len == 0) continue;
 
-        if (path_was_visited(visited.items, resolved_include)) {
-            allocator.free(resolved_include);
-            continue;
-        }
+            const normalized = normalize_bib_input(allocator, part, default_ext) catch continue;
+            defer allocator.free(normalized);
 
-        visited.append(allocator, resolved_include) catch {
-            allocator.free(resolved_include);
-            continue;
-        };
+            const resolved = resolve_aux_path(allocator, aux_path, normalized) catch continue;
+            defer allocator.free(resolved);
 
-        const include_contents = read_file_contents(io, resolved_include) orelse continue;
-        defer free_file_contents(include_contents);
-        bibliography_state_recursive(io, resolved_include, include_contents, visited, collector);
+            const contents = read_file_contents(self.io, resolved);
+            defer free_file_contents(contents);
+            // the name as the aux gives it, not where it resolved: the same sources
+            // checked out elsewhere (a CI runner restoring intermediates) match
+            for (self.collectors.items) |*collector| collector.record_input(normalized, contents);
+        }
     }
-}
-
-fn record_bib_inputs(io: Io, aux_path: []const u8, payload: []const u8, default_ext: []const u8, collector: *BibliographyCollector) void {
-    const allocator = std.heap.c_allocator;
-    var parts = std.mem.splitScalar(u8, payload, ',');
-    while (parts.next()) |part_raw| {
-        const part = std.mem.trim(u8, part_raw, " \t\r");
-        if (part.len == 0) continue;
-
-        const normalized = normalize_bib_input(allocator, part, default_ext) catch continue;
-        defer allocator.free(normalized);
-
-        const resolved = resolve_aux_path(allocator, aux_path, normalized) catch continue;
-        defer allocator.free(resolved);
+};
 
-        const contents = read_file_contents(io, resolved);
-        defer free_file_contents(contents);
-        collector.record_input(resolved, contents);
+fn names_databases(aux_contents: []const u8) bool {
+    var lines = std.mem.splitScalar(u8, aux_contents, '\n');
+    while (lines.next()) |line| {
+        if (parse_bibdata(line) != null) return true;
     }
+    return false;
 }
 
 fn normalize_bib_input(allocator: std.mem.Allocator, value: []const u8, default_ext: []const u8) ![]u8 {
@@ -548,3 +659,61 @@ test "bibliography_state roundtrip and change helpers" {
     try testing.expect(!bib_inputs_changed(state, loaded));
     try testing.expect(!bib_citations_changed(state, loaded));
 }
+
+test "bibliography_state does not depend on where the sources live" {
+    var tmp = testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    const aux_data = "\\relax\n\\citation{refA}\n\\bibdata{refs}\n\\bibstyle{plain}\n";
+    for ([_][]const u8{ "a", "b" }) |sub| {
+        try tmp.dir.createDirPath(testing.io, sub);
+        var name_buf: [64]u8 = undefined;
+        try tmp.dir.writeFile(testing.io, .{ .sub_path = try std.fmt.bufPrint(&name_buf, "{s}/main.aux", .{sub}), .data = aux_data });
+        try tmp.dir.writeFile(testing.io, .{ .sub_path = try std.fmt.bufPrint(&name_buf, "{s}/refs.bib", .{sub}), .data = "@article{refA,title={One}}\n" });
+    }
+
+    var rel_buf: [256]u8 = undefined;
+    const tmp_path = std.fmt.bufPrintZ(&rel_buf, ".zig-cache/tmp/{s}", .{&tmp.sub_path}) catch return error.Unexpected;
+    var path_buf: [4096]u8 = undefined;
+    const dir_path_raw = std.c.realpath(tmp_path, &path_buf) orelse return error.Unexpected;
+    const dir_path = std.mem.sliceTo(dir_path_raw, 0);
+
+    var a_buf: [4096]u8 = undefined;
+    const a = bibliography_state(testing.io, try std.fmt.bufPrint(&a_buf, "{s}/a/main.aux", .{dir_path}), aux_data) orelse return error.Unexpected;
+    var b_buf: [4096]u8 = undefined;
+    const b = bibliography_state(testing.io, try std.fmt.bufPrint(&b_buf, "{s}/b/main.aux", .{dir_path}), aux_data) orelse return error.Unexpected;
+    try testing.expectEqualStrings(a.input_digest[0..], b.input_digest[0..]);
+    try testing.expectEqualStrings(a.citation_digest[0..], b.citation_digest[0..]);
+}
+
+test "bibtex_jobs splits per-chapter bibliographies" {
+    var tmp = testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    try tmp.dir.writeFile(testing.io, .{ .sub_path = "main.aux", .data = "\\relax\n\\@input{one.aux}\n\\@input{two.aux}\n" });
+    try tmp.dir.writeFile(testing.io, .{ .sub_path = "one.aux", .data = "\\citation{refA}\n\\bibdata{refs}\n\\bibstyle{plain}\n" });
+    try tmp.dir.writeFile(testing.io, .{ .sub_path = "two.aux", .data = "\\citation{refB}\n\\bibdata{refs}\n\\bibstyle{plain}\n" });
+
+    var rel_buf: [256]u8 = undefined;
+    const tmp_path = std.fmt.bufPrintZ(&rel_buf, ".zig-cache/tmp/{s}", .{&tmp.sub_path}) catch return error.Unexpected;
+    var path_buf: [4096]u8 = undefined;
+    const dir_path_raw = std.c.realpath(tmp_path, &path_buf) orelse return error.Unexpected;
+    const dir_path = std.mem.sliceTo(dir_path_raw, 0);
+
+    var main_buf: [4096]u8 = undefined;
+    const main_aux_path = std.fmt.bufPrint(&main_buf, "{s}/main.aux", .{dir_path}) catch return error.Unexpected;
+    const main_aux_contents = read_file_contents(testing.io, main_aux_path) orelse return error.Unexpected;
+    defer free_file_contents(main_aux_contents);
+
+    var jobs = bibtex_jobs(testing.io, main_aux_path, main_aux_contents);
+    defer free_bibtex_jobs(&jobs);
+    try testing.expectEqual(@as(usize, 2), jobs.items.len);
+    try testing.expectEqualStrings("one.aux", std.fs.path.basename(jobs.items[0]));
+    try testing.expectEqualStrings("two.aux", std.fs.path.basename(jobs.items[1]));
+
+    // one bibliography, wherever it is named, is the main aux's job
+    var single = bibtex_jobs(testing.io, "main.aux", "\\relax\n\\@input{missing.aux}\n\\bibdata{refs}\n");
+    defer free_bibtex_jobs(&single);
+    try testing.expectEqual(@as(usize, 1), single.items.len);
+    try testing.expectEqualStrings("main.aux", single.items[0]);
+}
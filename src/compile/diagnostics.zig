@@ -9,6 +9,7 @@ const Io = std.Io;
 const Log = @import("../Log.zig");
 const Host = @import("../Host.zig");
 const World = @import("../World.zig");
+const DiagRecords = @import("../DiagRecords.zig");
 const is_wasm = Host.is_wasm;
 
 pub fn diag_write_stderr(io: Io, text: []const u8) void {
@@ -81,13 +82,22 @@ pub fn detect_use_color(_: Io) bool {
     return std.c.isatty(2) == 1;
 }
 
+// print a diagnostic and keep it as a record (see DiagRecords.zig), split once
 pub fn diag_write_with_severity(io: Io, text: []const u8, comptime severity: []const u8) void {
     if (text.len == 0) return;
+    const parsed = parse_diag_text(text);
+    DiagRecords.append(.{
+        .severity = if (comptime std.mem.eql(u8, severity, "error")) .err else .warning,
+        .file = parsed.file,
+        .line = if (parsed.line) |l| std.fmt.parseInt(u32, l, 10) catch null else null,
+        .message = parsed.message,
+        .context = parsed.context,
+    });
+
     var buf: [8192]u8 = undefined;
     var w = Log.stderr_writer(io, &buf);
     const iface = &w.interface;
     const use_color = detect_use_color(io);
-    const parsed = parse_diag_text(text);
 
     if (use_color) {
         const color = if (comptime std.mem.eql(u8, severity, "error")) "\x1b[1;31m" else "\x1b[1;33m";
@@ -153,6 +163,19 @@ pub const default_diag_handler = World.DiagnosticHandler{
     .on_info = on_diag_info,
 };
 
+fn on_diag_quiet(io: Io, text: []const u8) void {
+    Log.dbg(io, "engine", "{s}", .{text});
+}
+
+// for engine runs the user did not ask for, whose failure is handled by
+// falling back (a preamble that does not dump): everything goes to the
+// debug log only
+pub const quiet_diag_handler = World.DiagnosticHandler{
+    .on_warning = on_diag_quiet,
+    .on_error = on_diag_quiet,
+    .on_info = on_diag_quiet,
+};
+
 // -- tests --
 
 test "parse_file_line_prefix: valid file:line: message" {
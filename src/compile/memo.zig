@@ -0,0 +1,265 @@
+// compile/memo.zig -- whole-compile memoization.
+//
+// A successful compile leaves a manifest beside its PDF: a key for what the
+// output depends on besides files (engine, format, bundle, options), the
+// PDF's own digest, and the digest of every project file the engine read.
+// Paths the engine looked for and did not find are listed too, as files
+// that could not be read, so that one appearing (a new \include target, a
+// config picked up by \InputIfFileExists) counts as a change. When the next
+// compile comes with the same key, and the PDF and every one of those files
+// still read the same, the PDF already there is the one it would write, and
+// the compile can stop before it starts.
+//
+//   eztex-memo 1 <key, hex> <pdf sha256, hex>
+//   <sha256, hex, or - for a file that could not be read> <path>
+//   ...
+
+const std = @import("std");
+const Io = std.Io;
+const Allocator = std.mem.Allocator;
+const Sha256 = std.crypto.hash.sha2.Sha256;
+const aux = @import("aux.zig");
+const Digest = @import("../Digest.zig");
+
+pub const Key = [32]u8;
+
+const magic = "eztex-memo 1";
+
+// sha-256: result_digest is shared with other machines
+pub fn digest_file(io: Io, path: []const u8) ?[32]u8 {
+    return Digest.hashFile(Sha256, io, path);
+}
+
+// the manifest of pdf_path: its path with .pdf swapped for .inputs
+pub fn manifest_path(buf: []u8, pdf_path: []const u8) ?[]const u8 {
+    const stem = if (std.mem.endsWith(u8, pdf_path, ".pdf")) pdf_path[0 .. pdf_path.len - 4] else pdf_path;
+    return std.fmt.bufPrint(buf, "{s}.inputs", .{stem}) catch null;
+}
+
+fn write_digest(w: *Io.Writer, digest: ?[32]u8) Io.Writer.Error!void {
+    if (digest) |d| try w.writeAll(&std.fmt.bytesToHex(d, .lower)) else try w.writeByte('-');
+}
+
+// write the manifest of a compile that wrote pdf_path from inputs, having
+// looked for missing and not found them. one that cannot be written is left
+// out: the next compile then runs in full
+pub fn record(io: Io, allocator: Allocator, path: []const u8, key: *const Key, pdf_path: []const u8, inputs: []const []const u8, missing: []const []const u8) void {
+    const pdf = digest_file(io, pdf_path) orelse return;
+    var out: Io.Writer.Allocating = .init(allocator);
+    defer out.deinit();
+    write_manifest(io, &out.writer, key, pdf, inputs, missing) catch return;
+    Io.Dir.cwd().writeFile(io, .{ .sub_path = path, .data = out.written() }) catch {};
+}
+
+fn write_manifest(io: Io, w: *Io.Writer, key: *const Key, pdf: [32]u8, inputs: []const []const u8, missing: []const []const u8) !void {
+    try w.print("{s} {s} {s}\n", .{ magic, std.fmt.bytesToHex(key.*, .lower), std.fmt.bytesToHex(pdf, .lower) });
+    for (inputs) |input| {
+        if (std.mem.indexOfScalar(u8, input, '\n') != null) return error.UnlistablePath;
+        try write_digest(w, digest_file(io, input));
+        try w.print(" {s}\n", .{input});
+    }
+    for (missing) |name| {
+        if (std.mem.indexOfScalar(u8, name, '\n') != null) return error.UnlistablePath;
+        try w.print("- {s}\n", .{name});
+    }
+}
+
+// the manifest at path, if it vouches for the PDF at pdf_path under key:
+// the PDF and every input it lists read as they did. owned (see
+// aux.free_file_contents); null on any difference
+pub fn lookup(io: Io, path: []const u8, key: *const Key, pdf_path: []const u8) ?[]const u8 {
+    const text = aux.read_file_contents(io, path) orelse return null;
+    if (!vouches(io, text, key, pdf_path)) {
+        aux.free_file_contents(text);
+        return null;
+    }
+    return text;
+}
+
+fn vouches(io: Io, text: []const u8, key: *const Key, pdf_path: []const u8) bool {
+    var lines = std.mem.splitScalar(u8, text, '\n');
+    const header = lines.next() orelse return false;
+    if (!std.mem.startsWith(u8, header, magic ++ " ")) return false;
+    var fields = std.mem.splitScalar(u8, header[magic.len + 1 ..], ' ');
+    const key_hex = fields.next() orelse return false;
+    const pdf_hex = fields.next() orelse return false;
+    if (!std.mem.eql(u8, key_hex, &std.fmt.bytesToHex(key.*, .lower))) return false;
+    if (!digest_matches(pdf_hex, digest_file(io, pdf_path))) return false;
+
+    while (lines.next()) |line| {
+        if (line.len == 0) continue;
+        const sp = std.mem.indexOfScalar(u8, line, ' ') orelse return false;
+        if (!digest_matches(line[0..sp], digest_file(io, line[sp + 1 ..]))) return false;
+    }
+    return true;
+}
+
+fn digest_matches(hex: []const u8, digest: ?[32]u8) bool {
+    const d = digest orelse return std.mem.eql(u8, hex, "-");
+    return std.mem.eql(u8, hex, &std.fmt.bytesToHex(d, .lower));
+}
+
+pub const Inputs = struct {
+    lines: std.mem.SplitIterator(u8, .scalar),
+
+    pub fn next(self: *Inputs) ?[]const u8 {
+        while (self.lines.next()) |line| {
+            const sp = std.mem.indexOfScalar(u8, line, ' ') orelse continue;
+            return line[sp + 1 ..];
+        }
+        return null;
+    }
+};
+
+// the input paths a manifest lists
+pub fn inputs(text: []const u8) Inputs {
+    var lines = std.mem.splitScalar(u8, text, '\n');
+    _ = lines.next();
+    return .{ .lines = lines };
+}
+
+// the digest a compile's outputs are shared under (see RemoteCache.zig): key,
+// and each input a manifest lists as it reads here
+pub fn result_digest(io: Io, key: *const Key, manifest_text: []const u8) [32]u8 {
+    var h = Sha256.init(.{});
+    h.update(key);
+    var it = inputs(manifest_text);
+    while (it.next()) |input| {
+        h.update(input);
+        h.update(&.{0});
+        if (digest_file(io, input)) |d| h.update(&d) else h.update("-");
+    }
+    return h.finalResult();
+}
+
+// -- packs --
+// a compile's output files in one object, each under a name that says
+// where it goes ("output.pdf", "output.synctex.gz": beside the PDF;
+// "job.aux": the job's own, in the working directory):
+//
+//   eztex-pack 1\n
+//   <name>\n<length>\n<bytes>   for each file
+
+const pack_magic = "eztex-pack 1\n";
+
+pub const PackEntry = struct {
+    name: []const u8,
+    data: []const u8,
+};
+
+pub fn pack(allocator: Allocator, entries: []const PackEntry) ![]u8 {
+    var out: Io.Writer.Allocating = .init(allocator);
+    errdefer out.deinit();
+    try out.writer.writeAll(pack_magic);
+    for (entries) |e| {
+        try out.writer.print("{s}\n{d}\n", .{ e.name, e.data.len });
+        try out.writer.writeAll(e.data);
+    }
+    return out.toOwnedSlice();
+}
+
+pub const Unpacker = struct {
+    data: []const u8,
+    pos: usize,
+
+    pub fn next(self: *Unpacker) error{CorruptPack}!?PackEntry {
+        if (self.pos == self.data.len) return null;
+        const name_end = std.mem.indexOfScalarPos(u8, self.data, self.pos, '\n') orelse return error.CorruptPack;
+        const len_end = std.mem.indexOfScalarPos(u8, self.data, name_end + 1, '\n') orelse return error.CorruptPack;
+        const len = std.fmt.parseInt(usize, self.data[name_end + 1 .. len_end], 10) catch return error.CorruptPack;
+        if (len > self.data.len - (len_end + 1)) return error.CorruptPack;
+        const entry: PackEntry = .{ .name = self.data[self.pos..name_end], .data = self.data[len_end + 1 ..][0..len] };
+        self.pos = len_end + 1 + len;
+        return entry;
+    }
+};
+
+pub fn unpack(data: []const u8) error{CorruptPack}!Unpacker {
+    if (!std.mem.startsWith(u8, data, pack_magic)) return error.CorruptPack;
+    return .{ .data = data, .pos = pack_magic.len };
+}
+
+test "a manifest vouches only for unchanged inputs and output" {
+    const io = std.testing.io;
+    var tmp_dir = std.testing.tmpDir(.{});
+    defer tmp_dir.cleanup();
+    try tmp_dir.dir.writeFile(io, .{ .sub_path = "main.tex", .data = "\\input{intro}" });
+    try tmp_dir.dir.writeFile(io, .{ .sub_path = "intro.tex", .data = "Hello." });
+    try tmp_dir.dir.writeFile(io, .{ .sub_path = "main.pdf", .data = "%PDF-1.5" });
+
+    var bufs: [4][256]u8 = undefined;
+    const main_path = try std.fmt.bufPrint(&bufs[0], ".zig-cache/tmp/{s}/main.tex", .{&tmp_dir.sub_path});
+    const intro_path = try std.fmt.bufPrint(&bufs[1], ".zig-cache/tmp/{s}/intro.tex", .{&tmp_dir.sub_path});
+    const pdf_path = try std.fmt.bufPrint(&bufs[2], ".zig-cache/tmp/{s}/main.pdf", .{&tmp_dir.sub_path});
+    const path = manifest_path(&bufs[3], pdf_path).?;
+    try std.testing.expect(std.mem.endsWith(u8, path, "/main.inputs"));
+
+    const key: Key = @splat(7);
+    record(io, std.testing.allocator, path, &key, pdf_path, &.{ main_path, intro_path }, &.{});
+
+    const text = lookup(io, path, &key, pdf_path).?;
+    defer aux.free_file_contents(text);
+    var it = inputs(text);
+    try std.testing.expectEqualStrings(main_path, it.next().?);
+    try std.testing.expectEqualStrings(intro_path, it.next().?);
+    try std.testing.expect(it.next() == null);
+
+    // another key: other options, engine, or bundle
+    const other: Key = @splat(8);
+    try std.testing.expect(lookup(io, path, &other, pdf_path) == null);
+
+    // a save without an edit still matches; an edit does not
+    try tmp_dir.dir.writeFile(io, .{ .sub_path = "intro.tex", .data = "Hello." });
+    aux.free_file_contents(lookup(io, path, &key, pdf_path) orelse return error.TestUnexpectedResult);
+    try tmp_dir.dir.writeFile(io, .{ .sub_path = "intro.tex", .data = "Hello, world." });
+    try std.testing.expect(lookup(io, path, &key, pdf_path) == null);
+    try tmp_dir.dir.writeFile(io, .{ .sub_path = "intro.tex", .data = "Hello." });
+
+    // the PDF itself replaced or gone
+    try tmp_dir.dir.deleteFile(io, "main.pdf");
+    try std.testing.expect(lookup(io, path, &key, pdf_path) == null);
+}
+
+test "packs round-trip and reject truncation" {
+    const allocator = std.testing.allocator;
+    const data = try pack(allocator, &.{
+        .{ .name = "output.pdf", .data = "%PDF-1.5\n%%EOF" },
+        .{ .name = "job.aux", .data = "" },
+    });
+    defer allocator.free(data);
+
+    var it = try unpack(data);
+    const pdf = (try it.next()).?;
+    try std.testing.expectEqualStrings("output.pdf", pdf.name);
+    try std.testing.expectEqualStrings("%PDF-1.5\n%%EOF", pdf.data);
+    const job_aux = (try it.next()).?;
+    try std.testing.expectEqualStrings("job.aux", job_aux.name);
+    try std.testing.expectEqual(@as(usize, 0), job_aux.data.len);
+    try std.testing.expect((try it.next()) == null);
+
+    var cut = try unpack(data[0 .. data.len - 4]);
+    _ = try cut.next();
+    try std.testing.expectError(error.CorruptPack, cut.next());
+    try std.testing.expectError(error.CorruptPack, unpack("not a pack"));
+}
+
+test "a manifest stops vouching once a file it looked for appears" {
+    const io = std.testing.io;
+    var tmp_dir = std.testing.tmpDir(.{});
+    defer tmp_dir.cleanup();
+    try tmp_dir.dir.writeFile(io, .{ .sub_path = "main.tex", .data = "\\include{ch3}" });
+    try tmp_dir.dir.writeFile(io, .{ .sub_path = "main.pdf", .data = "%PDF-1.5" });
+
+    var bufs: [4][256]u8 = undefined;
+    const main_path = try std.fmt.bufPrint(&bufs[0], ".zig-cache/tmp/{s}/main.tex", .{&tmp_dir.sub_path});
+    const ch3_path = try std.fmt.bufPrint(&bufs[1], ".zig-cache/tmp/{s}/ch3.tex", .{&tmp_dir.sub_path});
+    const pdf_path = try std.fmt.bufPrint(&bufs[2], ".zig-cache/tmp/{s}/main.pdf", .{&tmp_dir.sub_path});
+    const path = manifest_path(&bufs[3], pdf_path).?;
+
+    const key: Key = @splat(7);
+    record(io, std.testing.allocator, path, &key, pdf_path, &.{main_path}, &.{ch3_path});
+    aux.free_file_contents(lookup(io, path, &key, pdf_path) orelse return error.TestUnexpectedResult);
+
+    try tmp_dir.dir.writeFile(io, .{ .sub_path = "ch3.tex", .data = "Chapter three." });
+    try std.testing.expect(lookup(io, path, &key, pdf_path) == null);
+}
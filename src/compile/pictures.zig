@@ -0,0 +1,358 @@
+// compile/pictures.zig -- TikZ pictures typeset once and reused as PDFs.
+//
+// tikz's own externalization runs a TeX per picture through \write18, which
+// eztex does not allow. This does the same from outside the engine: the
+// document's .tex files are scanned as the engine opens them (see
+// World.input_filter), and each top-level tikzpicture is looked up by a key
+// of its text and the preamble it is typeset under. A picture with a PDF
+// in the cache is swapped for
+//
+//   \raisebox{-<depth>}{\includegraphics[page=<n>]{<cache>/<batch>.pdf}}
+//
+// and those without one are typeset after the compile, all into one PDF,
+// a page each, trimmed to the picture (see write_batch). The cache holds
+// the batch PDFs and, per picture, an entry naming its page:
+//
+//   <cache>/<batch key, hex>.pdf
+//   <cache>/<picture key, hex>.pic   "<batch key, hex>.pdf <page> <depth>\n"
+//
+// A textual scan, like Preamble.zig: pictures that refer to anything but
+// their own text and the preamble (labels, references, the page, other
+// pictures, macro parameters, the width of the line or column they sit in)
+// are left in the document, and so is anything in a verbatim-like
+// environment or \verb. What the scan cannot see is state the body sets
+// around a picture: a \tikzset or \definecolor after \begin{document}, the
+// font size or colour in force. The batch typesets every picture under the
+// preamble alone, so such pictures come out as they would at the start of
+// the document.
+
+const std = @import("std");
+const Io = std.Io;
+const Digest = @import("../Digest.zig");
+
+pub const Key = [32]u8;
+
+// jobname of the batch run, in the working directory
+pub const batch_jobname = "eztex-pictures";
+
+const begin_tag = "\\begin{tikzpicture}";
+const end_tag = "\\end{tikzpicture}";
+
+pub const Picture = struct {
+    start: usize,
+    end: usize,
+};
+
+// environments whose body TeX reads as text, not as commands
+const verbatim_envs = [_][]const u8{
+    "verbatim",   "verbatim*", "Verbatim", "Verbatim*",    "BVerbatim",     "LVerbatim",
+    "lstlisting", "minted",    "comment",  "filecontents", "filecontents*",
+};
+
+// the end of the verbatim-like environment or \verb at s[i], if one starts
+// there
+fn verbatim_end(s: []const u8, i: usize) ?usize {
+    const verb = "\\verb";
+    if (std.mem.startsWith(u8, s[i..], verb)) {
+        var j = i + verb.len;
+        if (j < s.len and s[j] == '*') j += 1;
+        // \verbatim and the like are other commands
+        if (j >= s.len or std.ascii.isAlphabetic(s[j])) return null;
+        const close = std.mem.indexOfScalarPos(u8, s, j + 1, s[j]) orelse return s.len;
+        return close + 1;
+    }
+    const begin = "\\begin{";
+    if (!std.mem.startsWith(u8, s[i..], begin)) return null;
+    const name_end = std.mem.indexOfScalarPos(u8, s, i + begin.len, '}') orelse return null;
+    const name = s[i + begin.len .. name_end];
+    for (verbatim_envs) |env| {
+        if (!std.mem.eql(u8, name, env)) continue;
+        var end_buf: [32]u8 = undefined;
+        const end = std.fmt.bufPrint(&end_buf, "\\end{{{s}}}", .{env}) catch return null;
+        const at = std.mem.indexOfPos(u8, s, name_end + 1, end) orelse return s.len;
+        return at + end.len;
+    }
+    return null;
+}
+
+// the outermost tikzpicture environments of a source, outside % comments
+// and verbatim text
+pub const Iterator = struct {
+    src: []const u8,
+    pos: usize = 0,
+
+    pub fn next(self: *Iterator) ?Picture {
+        const s = self.src;
+        var i = self.pos;
+        var start: usize = 0;
+        var depth: usize = 0;
+        while (i < s.len) {
+            switch (s[i]) {
+                '%' => i = std.mem.indexOfScalarPos(u8, s, i, '\n') orelse s.len,
+                '\\' => {
+                    if (verbatim_end(s, i)) |end| {
+                        i = end;
+                    } else if (std.mem.startsWith(u8, s[i..], begin_tag)) {
+                        if (depth == 0) start = i;
+                        depth += 1;
+                        i += begin_tag.len;
+                    } else if (depth > 0 and std.mem.startsWith(u8, s[i..], end_tag)) {
+                        depth -= 1;
+                        i += end_tag.len;
+                        if (depth == 0) {
+                            self.pos = i;
+                            return .{ .start = start, .end = i };
+                        }
+                    } else {
+                        // control symbol: \% is not a comment
+                        i = @min(i + 2, s.len);
+                    }
+                },
+                else => i += 1,
+            }
+        }
+        self.pos = s.len;
+        return null;
+    }
+};
+
+pub fn iterate(src: []const u8) Iterator {
+    return .{ .src = src };
+}
+
+// what makes a picture depend on more than its text and the preamble
+const dependent = [_][]const u8{
+    "remember picture", "overlay",   "current page", "\\label",
+    "\\ref",            "\\pageref", "\\cite",       "\\footnote",
+    "\\thepage",        "\\input",   "\\include",    "#",
+    "\\linewidth",      "\\hsize",   "\\textwidth",  "\\columnwidth",
+};
+
+// whether a picture can be typeset on its own and included in its place.
+// its braces must balance too: a \begin{tikzpicture} in one argument of a
+// \newenvironment and its \end in the next is not a picture
+pub fn externalizable(text: []const u8) bool {
+    for (dependent) |word| {
+        if (std.mem.indexOf(u8, text, word) != null) return false;
+    }
+    var depth: usize = 0;
+    var i: usize = 0;
+    while (i < text.len) : (i += 1) {
+        switch (text[i]) {
+            '\\' => i += 1,
+            '%' => i = std.mem.indexOfScalarPos(u8, text, i, '\n') orelse text.len,
+            '{' => depth += 1,
+            '}' => {
+                if (depth == 0) return false;
+                depth -= 1;
+            },
+            else => {},
+        }
+    }
+    return depth == 0;
+}
+
+// the key of a picture: its text under a preamble, by that preamble's digest
+// (and whatever else changes how it is typeset or written to PDF)
+pub fn key(preamble: *const [32]u8, text: []const u8) Key {
+    var h = Digest.Internal.init(.{});
+    h.update(preamble);
+    h.update(text);
+    var out: Key = undefined;
+    h.final(&out);
+    return out;
+}
+
+// the cache directory's path goes into \includegraphics as it is
+pub fn usable_dir(dir: []const u8) bool {
+    return std.mem.indexOfAny(u8, dir, " %#{}\\~$&^") == null;
+}
+
+pub const Entry = struct {
+    // file name of the batch PDF, in the cache directory
+    pdf: []const u8,
+    page: u32,
+    // a TeX dimension, as \the\dp0 wrote it
+    depth: []const u8,
+};
+
+pub fn parse_entry(text: []const u8) ?Entry {
+    var fields = std.mem.tokenizeAny(u8, text, " \n");
+    const pdf = fields.next() orelse return null;
+    const page_text = fields.next() orelse return null;
+    const depth = fields.next() orelse return null;
+    if (!std.mem.endsWith(u8, pdf, ".pdf") or std.mem.indexOfScalar(u8, pdf, '/') != null) return null;
+    const page = std.fmt.parseInt(u32, page_text, 10) catch return null;
+    if (page == 0 or !is_dimension(depth)) return null;
+    return .{ .pdf = pdf, .page = page, .depth = depth };
+}
+
+fn is_dimension(text: []const u8) bool {
+    if (!std.mem.endsWith(u8, text, "pt")) return false;
+    const number = text[0 .. text.len - 2];
+    if (number.len == 0) return false;
+    for (number, 0..) |c, i| {
+        if (!std.ascii.isDigit(c) and c != '.' and !(c == '-' and i == 0)) return false;
+    }
+    return true;
+}
+
+fn entry_path(buf: []u8, dir: []const u8, k: *const Key) ?[]const u8 {
+    return std.fmt.bufPrint(buf, "{s}/{s}.pic", .{ dir, &std.fmt.bytesToHex(k.*, .lower) }) catch null;
+}
+
+// the entry of a picture in the cache at dir, read into buf, if its PDF is
+// there too
+pub fn lookup(io: Io, dir: []const u8, k: *const Key, buf: []u8) ?Entry {
+    var path_buf: [1024]u8 = undefined;
+    const path = entry_path(&path_buf, dir, k) orelse return null;
+    const file = Io.Dir.cwd().openFile(io, path, .{}) catch return null;
+    defer file.close(io);
+    const n = file.readPositionalAll(io, buf, 0) catch return null;
+    const entry = parse_entry(buf[0..n]) orelse return null;
+    const pdf_path = std.fmt.bufPrint(&path_buf, "{s}/{s}", .{ dir, entry.pdf }) catch return null;
+    Io.Dir.cwd().access(io, pdf_path, .{}) catch return null;
+    return entry;
+}
+
+// what a cached picture is swapped for. it ends in as many newlines as the
+// picture's text had, so the lines after it keep their numbers
+pub fn write_replacement(w: *Io.Writer, dir: []const u8, entry: Entry, text: []const u8) Io.Writer.Error!void {
+    try w.print("\\raisebox{{-{s}}}{{\\includegraphics[page={d}]{{{s}/{s}}}}}", .{ entry.depth, entry.page, dir, entry.pdf });
+    try w.splatByteAll('\n', std.mem.count(u8, text, "\n"));
+}
+
+// the document that typesets pictures, one page each, under the preamble
+// they were found under. each page is trimmed to its picture, placed at
+// the top left corner, and the picture's depth is written to
+// <batch_jobname>.depths, a line each, for store
+pub fn write_batch(w: *Io.Writer, preamble: []const u8, texts: []const []const u8) Io.Writer.Error!void {
+    try w.writeAll(preamble);
+    try w.writeAll(
+        \\\begin{document}%
+        \\\newwrite\eztexdepths
+        \\\immediate\openout\eztexdepths=
+    ++ batch_jobname ++
+        \\.depths\relax
+        \\\hoffset=-1in \voffset=-1in
+        \\
+    );
+    for (texts) |text| {
+        try w.writeAll("\\setbox0=\\hbox{");
+        try w.writeAll(text);
+        try w.writeAll(
+            \\}%
+            \\\ifdim\wd0=0pt \wd0=1pt \fi
+            \\\dimen0=\dimexpr\ht0+\dp0\relax
+            \\\ifdim\dimen0=0pt \dimen0=1pt \fi
+            \\\immediate\write\eztexdepths{\the\dp0}%
+            \\\paperwidth=\wd0 \paperheight=\dimen0
+            \\\pdfpagewidth=\paperwidth \pdfpageheight=\paperheight
+            \\\shipout\hbox{\special{papersize=\the\paperwidth,\the\paperheight}\box0}%
+            \\
+        );
+    }
+    try w.writeAll(
+        \\\immediate\closeout\eztexdepths
+        \\\end{document}
+        \\
+    );
+}
+
+// file the batch PDF goes under in the cache: a key of the pictures in it
+pub fn batch_name(keys: []const Key) [64 + 4]u8 {
+    var h = Digest.Internal.init(.{});
+    for (keys) |*k| h.update(k);
+    var digest: [32]u8 = undefined;
+    h.final(&digest);
+    var name: [64 + 4]u8 = undefined;
+    name[0..64].* = Digest.toHex(digest);
+    name[64..].* = ".pdf".*;
+    return name;
+}
+
+// put a batch run's PDF in the cache at dir, with an entry for each of
+// keys, the pictures it typeset in order, and their depths as the run wrote
+// them. the entries go last, so none names a PDF that is not there
+pub fn store(io: Io, dir: []const u8, keys: []const Key, pdf: []const u8, depths: []const u8) !void {
+    var lines = std.mem.tokenizeScalar(u8, depths, '\n');
+    var n: usize = 0;
+    while (lines.next()) |line| : (n += 1) {
+        if (!is_dimension(line)) return error.BadDepths;
+    }
+    if (n != keys.len) return error.BadDepths;
+
+    try Io.Dir.cwd().createDirPath(io, dir);
+    const name = batch_name(keys);
+    var path_buf: [1024]u8 = undefined;
+    const pdf_path = try std.fmt.bufPrint(&path_buf, "{s}/{s}", .{ dir, &name });
+    try Io.Dir.cwd().writeFile(io, .{ .sub_path = pdf_path, .data = pdf });
+
+    lines.reset();
+    for (keys, 1..) |*k, page| {
+        var line_buf: [128]u8 = undefined;
+        const line = try std.fmt.bufPrint(&line_buf, "{s} {d} {s}\n", .{ &name, page, lines.next().? });
+        const path = entry_path(&path_buf, dir, k) orelse return error.NameTooLong;
+        try Io.Dir.cwd().writeFile(io, .{ .sub_path = path, .data = line });
+    }
+}
+
+test "pictures are found outside comments and stored by key" {
+    const src =
+        \\Text % \begin{tikzpicture} in a comment
+        \\\begin{tikzpicture}
+        \\  \draw (0,0) -- (1,1);
+        \\  \begin{tikzpicture}\end{tikzpicture}
+        \\\end{tikzpicture} 50\%
+        \\\begin{tikzpicture}[remember picture]\end{tikzpicture}
+        \\\newenvironment{box}{\begin{tikzpicture}}{\end{tikzpicture}}
+        \\\begin{verbatim}
+        \\\begin{tikzpicture}\end{tikzpicture}
+        \\\end{verbatim}
+        \\\begin{minted}{latex}\begin{tikzpicture}\end{minted}
+        \\\verb|\begin{tikzpicture}| \verb*+\end{tikzpicture}+
+        \\\begin{tikzpicture}\draw (0,0) -- (\linewidth,0);\end{tikzpicture}
+    ;
+    var it = iterate(src);
+    const first = it.next().?;
+    const text = src[first.start..first.end];
+    try std.testing.expect(std.mem.startsWith(u8, text, "\\begin{tikzpicture}\n  \\draw"));
+    try std.testing.expect(std.mem.endsWith(u8, text, "\\end{tikzpicture}\n\\end{tikzpicture}"));
+    try std.testing.expect(externalizable(text));
+    const second = it.next().?;
+    try std.testing.expect(!externalizable(src[second.start..second.end]));
+    const third = it.next().?;
+    try std.testing.expect(!externalizable(src[third.start..third.end]));
+    // verbatim text is passed over; a picture as wide as the line is found
+    // but stays
+    const fourth = it.next().?;
+    try std.testing.expect(std.mem.indexOf(u8, src[fourth.start..fourth.end], "\\linewidth") != null);
+    try std.testing.expect(!externalizable(src[fourth.start..fourth.end]));
+    try std.testing.expect(it.next() == null);
+
+    const io = std.testing.io;
+    var tmp_dir = std.testing.tmpDir(.{});
+    defer tmp_dir.cleanup();
+    var dir_buf: [256]u8 = undefined;
+    const dir = try std.fmt.bufPrint(&dir_buf, ".zig-cache/tmp/{s}/pictures", .{&tmp_dir.sub_path});
+
+    const preamble: [32]u8 = @splat(1);
+    const keys = [_]Key{ key(&preamble, text), key(&preamble, "\\begin{tikzpicture}\\end{tikzpicture}") };
+    try std.testing.expectError(error.BadDepths, store(io, dir, &keys, "%PDF-1.5", "2.5pt\n"));
+    try store(io, dir, &keys, "%PDF-1.5", "2.5pt\n0.0pt\n");
+
+    var buf: [256]u8 = undefined;
+    const entry = lookup(io, dir, &keys[0], &buf).?;
+    try std.testing.expectEqualStrings(&batch_name(&keys), entry.pdf);
+    try std.testing.expectEqual(@as(u32, 1), entry.page);
+    try std.testing.expectEqualStrings("2.5pt", entry.depth);
+    try std.testing.expectEqual(@as(u32, 2), lookup(io, dir, &keys[1], &buf).?.page);
+    const other: [32]u8 = @splat(2);
+    try std.testing.expect(lookup(io, dir, &key(&other, text), &buf) == null);
+
+    var out: Io.Writer.Allocating = .init(std.testing.allocator);
+    defer out.deinit();
+    try write_replacement(&out.writer, "/c", entry, text);
+    try std.testing.expect(std.mem.startsWith(u8, out.written(), "\\raisebox{-2.5pt}{\\includegraphics[page=1]{/c/"));
+    try std.testing.expectEqual(std.mem.count(u8, text, "\n"), std.mem.count(u8, out.written(), "\n"));
+}
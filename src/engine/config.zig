@@ -10,12 +10,53 @@ pub const OutputFormat = enum {
     xdv,
 };
 
+// what xdvipdfmx trades for speed when writing the PDF
+pub const PdfProfile = enum {
+    // deflate level 1, no object streams: for PDFs looked at and replaced
+    fast,
+    // deflate level 9 with object and xref streams
+    small,
+};
+
+// pages, 1-based and inclusive, that a preview converts to PDF; the others
+// are written blank (see XdvipdfmxConfig.pages)
+pub const PageRange = struct {
+    first: u32,
+    last: u32,
+
+    // "40-42" or "40"
+    pub fn parse(spec: []const u8) ?PageRange {
+        const dash = std.mem.indexOfScalar(u8, spec, '-');
+        const first = std.fmt.parseInt(u32, spec[0 .. dash orelse spec.len], 10) catch return null;
+        const last = if (dash) |d| std.fmt.parseInt(u32, spec[d + 1 ..], 10) catch return null else first;
+        if (first == 0 or last < first) return null;
+        return .{ .first = first, .last = last };
+    }
+};
+
 pub const Variable = enum {
     halt_on_error,
     synctex,
     shell_escape,
     initex_mode,
+    // initex starts from the selected format instead of an empty table, so a
+    // \dump adds to it
+    preload_format,
     semantic_pagination,
+    draft_pass,
+    // control sequence hash buckets for initex (prime, at most 15000)
+    hash_prime,
+    // per-macro expansion profile, written to <jobname>.flame
+    profile_expansion,
+    // macro calls between TTBC_CHECKPOINT_SAMPLE reports of the place being
+    // read, 0 for none (see Sampler.zig)
+    sample_interval,
+    // commands and environments defined by the end of the run, written to
+    // <jobname>.cmds
+    command_index,
+    // replay line breaks of paragraphs seen on an earlier pass; false also
+    // forgets them
+    linebreak_memo,
 };
 
 pub const Value = union(enum) {
@@ -40,4 +81,13 @@ pub const EngineConfig = struct {
     build_date: u64 = 0,
     deterministic: bool = false,
     paperspec: []const u8 = "letter",
+    pdf_profile: PdfProfile = .small,
+    // xdvipdfmx writes <jobname>.pages.json, a digest per page
+    page_digests: bool = false,
+    // target resolution of placed PNGs, 0 to embed them as they are
+    image_dpi: u16 = 0,
+    // raster images go in as gray boxes of their size, read from headers only
+    draft_images: bool = false,
+    // only these pages get their content in the PDF, null for all
+    pages: ?PageRange = null,
 };
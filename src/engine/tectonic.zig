@@ -1,14 +1,18 @@
 const std = @import("std");
+const builtin = @import("builtin");
 const Io = std.Io;
 const EngineApi = @import("../EngineInterface.zig");
 const Log = @import("../Log.zig");
 const World = @import("../World.zig");
+const MemStats = @import("../MemStats.zig");
 
 const Engine = EngineApi.Engine;
 const EngineConfig = EngineApi.EngineConfig;
 const EngineResult = EngineApi.EngineResult;
 const Format = EngineApi.Format;
 const OutputFormat = EngineApi.OutputFormat;
+const PdfProfile = EngineApi.PdfProfile;
+const PageRange = EngineApi.PageRange;
 const Value = EngineApi.Value;
 const Variable = EngineApi.Variable;
 
@@ -27,9 +31,21 @@ const XdvipdfmxConfig = extern struct {
     paperspec: [*:0]const u8,
     enable_compression: u8,
     deterministic_tags: u8,
+    compression_level: u8,
+    enable_object_streams: u8,
+    page_digests: u8,
+    draft_images: u8,
+    compression_threads: c_uint,
+    image_dpi: c_uint,
     build_date: u64,
+    pages: ?[*:0]const u8,
 };
 
+// streams xdvipdfmx deflates at once (see defer_stream in dpx-pdfobj.c). a
+// fixed number rather than the core count: it decides the order of objects
+// in the file, which should not vary between machines.
+const compression_threads: c_uint = if (builtin.single_threaded) 0 else 8;
+
 extern fn tt_engine_xdvipdfmx_main(
     cfg: *const XdvipdfmxConfig,
     dviname: [*:0]const u8,
@@ -38,6 +54,13 @@ extern fn tt_engine_xdvipdfmx_main(
 
 extern fn bibtex_main(aux_file_name: [*:0]const u8) c_int;
 extern fn _ttbc_get_error_message() [*:0]const u8;
+extern fn ttbc_mem_set_tag(tag: c_int) c_int;
+
+// start an engine run counting C allocations against tag; a previous run
+// that aborted inside a font or image scope leaves its tag behind
+fn setMemTag(tag: MemStats.Tag) void {
+    _ = ttbc_mem_set_tag(@intFromEnum(tag));
+}
 
 const TectonicEngine = struct {
     allocator: std.mem.Allocator,
@@ -47,6 +70,11 @@ const TectonicEngine = struct {
     build_date: u64,
     deterministic: bool,
     paperspec: []const u8,
+    pdf_profile: PdfProfile,
+    page_digests: bool,
+    image_dpi: u16,
+    draft_images: bool,
+    pages: ?PageRange,
     primary_input: [512]u8 = @splat(0),
     primary_input_len: usize = 0,
 };
@@ -61,6 +89,11 @@ pub fn create(config: *const EngineConfig) !Engine {
         .build_date = config.build_date,
         .deterministic = config.deterministic,
         .paperspec = config.paperspec,
+        .pdf_profile = config.pdf_profile,
+        .page_digests = config.page_digests,
+        .image_dpi = config.image_dpi,
+        .draft_images = config.draft_images,
+        .pages = config.pages,
     };
     return .{ .ptr = ctx, .vtable = &vtable };
 }
@@ -98,6 +131,7 @@ fn run(ctx: *anyopaque) !EngineResult {
     const self: *TectonicEngine = @ptrCast(@alignCast(ctx));
     if (self.primary_input_len == 0) return error.PrimaryInputNotSet;
     const input_z: [*:0]const u8 = self.primary_input[0..self.primary_input_len :0];
+    setMemTag(.engine);
     return .{ .code = tt_engine_xetex_main(formatDumpNameZ(self.format), input_z, self.build_date) };
 }
 
@@ -155,16 +189,29 @@ fn initexContent(_: *anyopaque, format: Format) []const u8 {
     };
 }
 
+// control sequence buckets for generated formats: the largest prime that
+// fits XeTeX's 15000-entry hash region rather than TeX's 8501. chains spill
+// into the 600000-entry hash_extra area, so nearly every slot can be a
+// bucket. recorded in the format.
+const initex_hash_prime: c_int = 14983;
+
 fn prepareInitex(ctx: *anyopaque, output_dir: []const u8) !void {
     const self: *TectonicEngine = @ptrCast(@alignCast(ctx));
     self.world.set_output_dir(output_dir);
     try setIntVariable(.initex_mode, 1);
     try setIntVariable(.halt_on_error, 1);
     try setIntVariable(.synctex, 0);
+    try setIntVariable(.draft_pass, 0);
+    try setIntVariable(.profile_expansion, 0);
+    try setIntVariable(.sample_interval, 0);
+    try setIntVariable(.command_index, 0);
+    try setIntVariable(.linebreak_memo, 0);
+    try setIntVariable(.hash_prime, initex_hash_prime);
 }
 
 fn finishInitex(_: *anyopaque) !void {
     try setIntVariable(.initex_mode, 0);
+    try setIntVariable(.preload_format, 0);
 }
 
 fn postProcess(ctx: *anyopaque, input_path: []const u8, output_path: []const u8) !EngineResult {
@@ -187,14 +234,35 @@ fn postProcess(ctx: *anyopaque, input_path: []const u8, output_path: []const u8)
     paperspec_buf[self.paperspec.len] = 0;
     const paperspec_z: [*:0]const u8 = paperspec_buf[0..self.paperspec.len :0];
 
+    var pages_buf: [32]u8 = undefined;
+    const pages_z: ?[*:0]const u8 = if (self.pages) |p|
+        try std.fmt.bufPrintZ(&pages_buf, "{d}-{d}", .{ p.first, p.last })
+    else
+        null;
+
     const cfg = XdvipdfmxConfig{
         .paperspec = paperspec_z,
         .enable_compression = 1,
         .deterministic_tags = if (self.deterministic) 1 else 0,
+        .compression_level = switch (self.pdf_profile) {
+            .fast => 1,
+            .small => 9,
+        },
+        .enable_object_streams = switch (self.pdf_profile) {
+            .fast => 0,
+            .small => 1,
+        },
+        .page_digests = if (self.page_digests) 1 else 0,
+        .draft_images = if (self.draft_images) 1 else 0,
+        .compression_threads = compression_threads,
+        .image_dpi = self.image_dpi,
         .build_date = self.build_date,
+        .pages = pages_z,
     };
 
     Log.dbg(self.io, "eztex", "calling xdvipdfmx('{s}' -> '{s}')...", .{ input_path, output_path });
+    setMemTag(.pdf);
+    defer setMemTag(.engine);
     const result = tt_engine_xdvipdfmx_main(&cfg, input_z, output_z);
     Log.dbg(self.io, "eztex", "xdvipdfmx returned: {d}", .{result});
     return .{ .code = result };
@@ -210,6 +278,7 @@ fn runBibtex(ctx: *anyopaque, aux_path: []const u8) !EngineResult {
 
     Log.log(self.io, "eztex", .info, "running bibtex on '{s}'...", .{aux_path});
     self.world.reset_io(self.io);
+    setMemTag(.engine);
     const result = bibtex_main(aux_z);
     Log.dbg(self.io, "eztex", "bibtex returned: {d}", .{result});
     return .{ .code = result };
@@ -231,9 +300,16 @@ fn variableName(variable: Variable) [*:0]const u8 {
     return switch (variable) {
         .halt_on_error => "halt_on_error_p",
         .initex_mode => "in_initex_mode",
+        .preload_format => "initex_preload_format",
         .synctex => "synctex_enabled",
         .semantic_pagination => "semantic_pagination_enabled",
         .shell_escape => "shell_escape_enabled",
+        .draft_pass => "draft_pass_enabled",
+        .hash_prime => "hash_prime",
+        .profile_expansion => "profile_expansion_enabled",
+        .sample_interval => "sample_interval",
+        .command_index => "command_index_enabled",
+        .linebreak_memo => "linebreak_memo_enabled",
     };
 }
 
@@ -0,0 +1,105 @@
+// flate_bench.zig -- throughput of Flate.zig's one-shot paths.
+//
+// xdvipdfmx compresses each page's content stream on its own, and reading
+// a PDF back inflates them one at a time. This times both directions over
+// page-sized streams (Flate.fake_content_streams):
+//
+//   compress     compress2 per stream, and the deflate state kept per thread
+//   decompress   std.compress.flate, and zlib's inflate
+//
+// usage: zig build bench-flate -Doptimize=ReleaseFast [-- --pages N]
+
+const std = @import("std");
+const Io = std.Io;
+const Flate = @import("Flate.zig");
+
+const FlateResult = Flate.FlateResult;
+
+// room for a stream that does not compress, as in the engine's own buffers
+fn packed_cap(page_len: usize) usize {
+    return page_len * 2 + 64;
+}
+
+fn check(rc: FlateResult) !void {
+    if (rc != .success) return error.FlateFailed;
+}
+
+fn report(w: *Io.Writer, name: []const u8, bytes: usize, elapsed_ns: u64) !void {
+    const secs = @as(f64, @floatFromInt(@max(elapsed_ns, 1))) / std.time.ns_per_s;
+    const mib = @as(f64, @floatFromInt(bytes)) / (1024 * 1024);
+    try w.print("  {s:<20} {d:>9.1} MiB/s\n", .{ name, mib / secs });
+    try w.flush();
+}
+
+fn elapsed_since(io: Io, started: Io.Clock.Timestamp) u64 {
+    return @intCast(@max(0, started.untilNow(io).raw.nanoseconds));
+}
+
+pub fn main(init: std.process.Init) !u8 {
+    const io = init.io;
+    const allocator = std.heap.c_allocator;
+
+    var pages: usize = 200;
+    var args = try init.minimal.args.iterateAllocator(allocator);
+    defer args.deinit();
+    _ = args.next();
+    while (args.next()) |arg| {
+        if (std.mem.eql(u8, arg, "--pages")) {
+            pages = try std.fmt.parseInt(usize, args.next() orelse return error.MissingValue, 10);
+        } else {
+            std.debug.print("usage: flate-bench [--pages N]\n", .{});
+            return 1;
+        }
+    }
+    pages = @max(pages, 1);
+
+    const input = try Flate.fake_content_streams(allocator, pages);
+    defer allocator.free(input);
+    const page_len = input.len / pages;
+    const cap = packed_cap(page_len);
+
+    const packed_buf = try allocator.alloc(u8, cap * pages);
+    defer allocator.free(packed_buf);
+    const lens = try allocator.alloc(u64, pages);
+    defer allocator.free(lens);
+    const unpacked = try allocator.alloc(u8, page_len + 64);
+    defer allocator.free(unpacked);
+
+    const stdout_file = Io.File.stdout();
+    var out_buf: [4096]u8 = undefined;
+    var file_writer = stdout_file.writer(io, &out_buf);
+    const w = &file_writer.interface;
+    const total = page_len * pages;
+
+    try w.print("=== flate: {d} streams of {d} bytes ===\n", .{ pages, page_len });
+
+    var started = Io.Clock.Timestamp.now(io, .awake);
+    for (0..pages) |i| {
+        var len: u64 = cap;
+        try check(Flate.compress_once(packed_buf[i * cap ..].ptr, &len, input[i * page_len ..].ptr, page_len, 9));
+    }
+    try report(w, "compress2", total, elapsed_since(io, started));
+
+    started = Io.Clock.Timestamp.now(io, .awake);
+    for (0..pages) |i| {
+        lens[i] = cap;
+        try check(Flate.tectonic_flate_compress(packed_buf[i * cap ..].ptr, &lens[i], input[i * page_len ..].ptr, page_len, 9));
+    }
+    try report(w, "kept deflate state", total, elapsed_since(io, started));
+
+    started = Io.Clock.Timestamp.now(io, .awake);
+    for (0..pages) |i| {
+        var len: u64 = unpacked.len;
+        try check(Flate.decompress_std(unpacked.ptr, &len, packed_buf[i * cap ..].ptr, lens[i]));
+    }
+    try report(w, "std inflate", total, elapsed_since(io, started));
+
+    started = Io.Clock.Timestamp.now(io, .awake);
+    for (0..pages) |i| {
+        var len: u64 = unpacked.len;
+        try check(Flate.tectonic_flate_decompress(unpacked.ptr, &len, packed_buf[i * cap ..].ptr, lens[i]));
+        if (!std.mem.eql(u8, input[i * page_len ..][0..page_len], unpacked[0..@intCast(len)])) return error.RoundTripMismatch;
+    }
+    try report(w, "zlib inflate", total, elapsed_since(io, started));
+    return 0;
+}
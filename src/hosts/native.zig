@@ -11,10 +11,13 @@ const posix = std.posix;
 const http = std.http;
 const Io = std.Io;
 const Cache = @import("../Cache.zig");
+const Config = @import("../Config.zig");
 const Host = @import("../Host.zig");
 const Engine = @import("../Engine.zig");
 const Log = @import("../Log.zig");
 const BundleStore = @import("../BundleStore.zig");
+const Flate = @import("../Flate.zig");
+const Runtime = @import("../Runtime.zig");
 
 const retry_attempts: usize = 3;
 const retry_sleep_ns: u64 = 500 * std.time.ns_per_ms;
@@ -50,7 +53,7 @@ const State = struct {
     digest_len: usize,
 };
 
-var state: State = .{
+threadlocal var state: State = .{
     .cache = Cache.init(std.heap.c_allocator),
     .data_url_buf = undefined,
     .data_url_len = 0,
@@ -67,6 +70,15 @@ var threaded: Io.Threaded = .init_single_threaded;
 const io = threaded.io();
 
 pub fn init(cache_dir: ?[]const u8, url: []const u8, idx_url: []const u8, digest: []const u8) void {
+    // clear cached redirect when URL changes (e.g. bundle URL override);
+    // a resident server re-running setup for the same bundle keeps it
+    if (!std.mem.eql(u8, state.data_url_buf[0..state.data_url_len], url)) {
+        if (state.resolved_url) |u| {
+            std.heap.c_allocator.free(u);
+            state.resolved_url = null;
+        }
+    }
+
     if (url.len <= state.data_url_buf.len) {
         @memcpy(state.data_url_buf[0..url.len], url);
         state.data_url_len = url.len;
@@ -77,12 +89,6 @@ pub fn init(cache_dir: ?[]const u8, url: []const u8, idx_url: []const u8, digest
         state.index_url_len = idx_url.len;
     }
 
-    // clear cached redirect when URL changes (e.g. bundle URL override)
-    if (state.resolved_url) |u| {
-        std.heap.c_allocator.free(u);
-        state.resolved_url = null;
-    }
-
     set_digest(digest);
 
     if (cache_dir) |dir| {
@@ -98,26 +104,39 @@ pub fn fetch_range(
     entry: Host.IndexEntry,
     alloc: std.mem.Allocator,
 ) ![]u8 {
-    const url = get_data_url();
-    const c = get_client();
-    return fetch_range_with_client(c, url, name, entry, alloc);
+    Log.dbg(io, "bundle", "downloading '{s}' (offset={d}, len={d})", .{ name, entry.offset, entry.length });
+    if (entry.length >= split_threshold) {
+        const data = try alloc.alloc(u8, @intCast(entry.length));
+        errdefer alloc.free(data);
+        fetch_split(get_data_url(), entry.offset, data) catch |err| {
+            Log.dbg(io, "bundle", "failed to download '{s}' in {d} parts", .{ name, split_parts });
+            return err;
+        };
+        Log.dbg(io, "bundle", "  downloaded {d} bytes in {d} parts", .{ data.len, split_parts });
+        return data;
+    }
+    const data = fetch_bytes(get_client(), get_data_url(), entry.offset, entry.length, alloc) catch |err| {
+        Log.dbg(io, "bundle", "failed to download '{s}' after {d} attempts", .{ name, retry_attempts });
+        return err;
+    };
+    Log.dbg(io, "bundle", "  downloaded {d} bytes", .{data.len});
+    return data;
 }
 
-fn fetch_range_with_client(
+// GET bytes [offset, offset + length) of the bundle, with retries.
+// shared by on-demand fetches and batch_seed workers (each with its own client).
+fn fetch_bytes(
     c: *http.Client,
     url: []const u8,
-    name: []const u8,
-    entry: Host.IndexEntry,
+    offset: u64,
+    length: u64,
     alloc: std.mem.Allocator,
 ) ![]u8 {
     var range_buf: [64]u8 = undefined;
-    const range_end = entry.offset + entry.length - 1;
     const range_header = std.fmt.bufPrint(&range_buf, "bytes={d}-{d}", .{
-        entry.offset, range_end,
+        offset, offset + length - 1,
     }) catch return error.FormatError;
 
-    Log.dbg(io, "bundle", "downloading '{s}' (offset={d}, len={d})", .{ name, entry.offset, entry.length });
-
     for (0..retry_attempts) |attempt| {
         var body_out: Io.Writer.Allocating = .init(alloc);
         errdefer body_out.deinit();
@@ -144,66 +163,125 @@ fn fetch_range_with_client(
             continue;
         }
 
-        const data = body_out.toOwnedSlice() catch |err| {
+        return body_out.toOwnedSlice() catch |err| {
             Log.dbg(io, "bundle", "  alloc failed: {}", .{err});
             body_out.deinit();
             continue;
         };
-        Log.dbg(io, "bundle", "  downloaded {d} bytes", .{data.len});
-        return data;
     }
 
-    Log.dbg(io, "bundle", "failed to download '{s}' after {d} attempts", .{ name, retry_attempts });
     return error.NetworkError;
 }
 
-// standalone range fetch for worker threads (uses provided client)
-fn fetch_range_standalone(
-    c: *http.Client,
-    url: []const u8,
-    name: []const u8,
-    entry: Host.IndexEntry,
-) ![]u8 {
-    var range_buf: [64]u8 = undefined;
-    const range_end = entry.offset + entry.length - 1;
-    const range_header = std.fmt.bufPrint(&range_buf, "bytes={d}-{d}", .{
-        entry.offset, range_end,
-    }) catch return error.FormatError;
+// entries at least this large (CJK fonts, big format inputs) are fetched as
+// split_parts parallel sub-ranges; one stream underuses high-latency links
+const split_threshold: u64 = 8 * 1024 * 1024;
+const split_parts: usize = 4;
 
+// GET bytes [offset, offset + dst.len) of the bundle into dst. a dropped
+// connection resumes from the last byte received instead of starting over.
+fn fetch_into(c: *http.Client, url: []const u8, offset: u64, dst: []u8) !void {
+    var done: usize = 0;
     for (0..retry_attempts) |attempt| {
-        var body_out: Io.Writer.Allocating = .init(std.heap.c_allocator);
-        errdefer body_out.deinit();
+        var range_buf: [64]u8 = undefined;
+        const range_header = std.fmt.bufPrint(&range_buf, "bytes={d}-{d}", .{
+            offset + done, offset + dst.len - 1,
+        }) catch return error.FormatError;
 
+        var body_out: Io.Writer = .fixed(dst[done..]);
         const result = c.fetch(.{
             .location = .{ .url = url },
-            .response_writer = &body_out.writer,
+            .response_writer = &body_out,
             .extra_headers = &.{
                 .{ .name = "Range", .value = range_header },
             },
         }) catch |err| {
-            if (attempt == retry_attempts - 1)
-                Log.dbg(io, "bundle", "prefetch: failed '{s}': {}", .{ name, err });
-            body_out.deinit();
+            // a body longer than asked for (Range ignored) is not a prefix of dst
+            if (err != error.WriteFailed) done += body_out.end;
+            Log.dbg(io, "bundle", "  fetch failed at {d}/{d} bytes (attempt {d}/{d}): {}", .{ done, dst.len, attempt + 1, retry_attempts, err });
+            if (done == dst.len) return;
             sleepMs(500);
             continue;
         };
 
-        if (result.status != .partial_content and result.status != .ok) {
-            if (attempt == retry_attempts - 1)
-                Log.dbg(io, "bundle", "prefetch: HTTP {d} for '{s}'", .{ @intFromEnum(result.status), name });
-            body_out.deinit();
+        if (result.status != .partial_content) {
+            Log.dbg(io, "bundle", "  unexpected HTTP status: {d} (attempt {d}/{d})", .{
+                @intFromEnum(result.status), attempt + 1, retry_attempts,
+            });
             sleepMs(500);
             continue;
         }
+        done += body_out.end;
+        if (done == dst.len) return;
+    }
+    return error.NetworkError;
+}
+
+// fetch dst from the bundle at offset as split_parts sub-ranges, each on its
+// own thread and client
+fn fetch_split(url: []const u8, offset: u64, dst: []u8) !void {
+    var failed = std.atomic.Value(bool).init(false);
+    const part_fn = struct {
+        fn run(u: []const u8, off: u64, part: []u8, fail: *std.atomic.Value(bool)) void {
+            var part_client: http.Client = .{ .allocator = std.heap.c_allocator, .io = io };
+            defer part_client.deinit();
+            fetch_into(&part_client, u, off, part) catch fail.store(true, .monotonic);
+        }
+    }.run;
 
-        return body_out.toOwnedSlice() catch |err| {
-            Log.dbg(io, "bundle", "prefetch: alloc failed for '{s}': {}", .{ name, err });
-            body_out.deinit();
-            continue;
+    const part_len = (dst.len + split_parts - 1) / split_parts;
+    var threads: [split_parts]?std.Thread = @splat(null);
+    for (0..split_parts) |i| {
+        const start = @min(i * part_len, dst.len);
+        const part = dst[start..@min(start + part_len, dst.len)];
+        if (part.len == 0) continue;
+        // no thread to spare: fetch this part here
+        threads[i] = std.Thread.spawn(.{}, part_fn, .{ url, offset + start, part, &failed }) catch blk: {
+            part_fn(url, offset + start, part, &failed);
+            break :blk null;
         };
     }
+    for (threads) |t| if (t) |thread| thread.join();
+    if (failed.load(.monotonic)) return error.NetworkError;
+}
 
-    return error.NetworkError;
+// coalescing limits for batch_seed, same as merge_ranges in app/src/worker/bundle_fetch.ts
+const max_merge_gap: u64 = 64 * 1024;
+const max_merged_range: u64 = 2 * 1024 * 1024;
+
+// a run of seed items (sorted by offset) served by one range request
+const SeedRange = struct {
+    first: usize,
+    count: usize,
+    start: u64,
+    length: u64,
+};
+
+fn seed_offset_less(_: void, a: Host.SeedItem, b: Host.SeedItem) bool {
+    return a.entry.offset < b.entry.offset;
+}
+
+fn merge_seed_ranges(alloc: std.mem.Allocator, sorted: []const Host.SeedItem) ![]SeedRange {
+    var ranges: std.ArrayList(SeedRange) = .empty;
+    errdefer ranges.deinit(alloc);
+
+    for (sorted, 0..) |item, i| {
+        const start = item.entry.offset;
+        const end = start + item.entry.length;
+        if (ranges.items.len > 0) {
+            const cur = &ranges.items[ranges.items.len - 1];
+            const cur_end = cur.start + cur.length;
+            const merged_len = @max(end, cur_end) - cur.start;
+            if (start <= cur_end + max_merge_gap and merged_len <= max_merged_range) {
+                cur.count += 1;
+                cur.length = merged_len;
+                continue;
+            }
+        }
+        try ranges.append(alloc, .{ .first = i, .count = 1, .start = start, .length = item.entry.length });
+    }
+
+    return ranges.toOwnedSlice(alloc);
 }
 
 // -- cache --
@@ -213,8 +291,26 @@ pub fn cache_check(name: []const u8) Host.CacheStatus {
     return if (state.cache.has(name)) .hit else .miss;
 }
 
-pub fn cache_open(name: []const u8) ?std.Io.File {
-    return state.cache.open_cached(io, name);
+pub fn cache_open(name: []const u8) ?Host.CachedFile {
+    return switch (state.cache.open_cached(io, name) orelse return null) {
+        .file => |f| .{ .file = f },
+        .bytes => |bytes| .{ .bytes = bytes },
+    };
+}
+
+pub fn cache_claim(name: []const u8) bool {
+    return switch (state.cache.claim(io, name)) {
+        .owner => true,
+        .waited => blk: {
+            Log.dbg(io, "bundle", "waited for another process to fetch '{s}'", .{name});
+            break :blk false;
+        },
+        .uncoordinated => false,
+    };
+}
+
+pub fn cache_release(name: []const u8) void {
+    state.cache.release(io, name);
 }
 
 pub fn cache_write(name: []const u8, content: []const u8) void {
@@ -226,6 +322,11 @@ pub fn cache_write(name: []const u8, content: []const u8) void {
 
 pub fn cache_save() void {
     state.cache.save_manifest(io) catch {};
+    state.cache.trim(io);
+}
+
+pub fn cache_note_format(key_hex: []const u8) void {
+    state.cache.note_use("formats", key_hex);
 }
 
 pub fn cache_count() usize {
@@ -242,26 +343,70 @@ pub fn get_cache() *Cache {
 pub fn batch_seed(items: []const Host.SeedItem, concurrency: usize) Host.SeedResult {
     if (items.len == 0) return .{ .fetched = 0, .failed = 0 };
 
+    const alloc = std.heap.c_allocator;
     const url = get_data_url();
 
+    // neighbouring files are fetched with one request and split locally
+    const sorted = alloc.dupe(Host.SeedItem, items) catch return .{ .fetched = 0, .failed = items.len };
+    defer alloc.free(sorted);
+    std.mem.sort(Host.SeedItem, sorted, {}, seed_offset_less);
+    const ranges = merge_seed_ranges(alloc, sorted) catch return .{ .fetched = 0, .failed = items.len };
+    defer alloc.free(ranges);
+
+    Log.dbg(io, "bundle", "seed: merged {d} files into {d} range requests", .{ items.len, ranges.len });
+
     var work_index = std.atomic.Value(usize).init(0);
     var fetched_count = std.atomic.Value(usize).init(0);
     var failed_count = std.atomic.Value(usize).init(0);
     var cache_mutex = std.atomic.Mutex.unlocked;
 
-    const actual_concurrency = @min(concurrency, items.len);
-
     const WorkerCtx = struct {
         items: []const Host.SeedItem,
+        ranges: []const SeedRange,
         work_idx: *std.atomic.Value(usize),
         fetched: *std.atomic.Value(usize),
         failed: *std.atomic.Value(usize),
         cache_mtx: *std.atomic.Mutex,
         url: []const u8,
+
+        // hashing and file I/O run in parallel; only the index/manifest insert is locked
+        fn store(self: @This(), item: Host.SeedItem, fetched: []const u8) void {
+            // the cache holds entries inflated, as BundleStore.inflate_entry does
+            const inflated = if (item.entry.raw_length != 0)
+                Flate.inflate_exact(std.heap.c_allocator, fetched, item.entry.raw_length) catch |err| {
+                    Log.dbg(io, "bundle", "seed: inflate failed for '{s}': {}", .{ item.name, err });
+                    _ = self.failed.fetchAdd(1, .monotonic);
+                    return;
+                }
+            else
+                null;
+            defer if (inflated) |data| std.heap.c_allocator.free(data);
+            const content = inflated orelse fetched;
+
+            const hex_hash = Cache.hash_content(content);
+
+            const loc = state.cache.store_content(io, item.name, &hex_hash, content) catch |err| {
+                Log.dbg(io, "bundle", "seed: cache write failed for '{s}': {}", .{ item.name, err });
+                _ = self.failed.fetchAdd(1, .monotonic);
+                return;
+            };
+
+            while (!self.cache_mtx.tryLock()) std.atomic.spinLoopHint();
+            defer self.cache_mtx.unlock();
+
+            state.cache.record(io, item.name, &hex_hash, content.len, loc) catch |err| {
+                Log.dbg(io, "bundle", "seed: manifest insert failed for '{s}': {}", .{ item.name, err });
+                _ = self.failed.fetchAdd(1, .monotonic);
+                return;
+            };
+
+            _ = self.fetched.fetchAdd(1, .monotonic);
+        }
     };
 
     const ctx = WorkerCtx{
-        .items = items,
+        .items = sorted,
+        .ranges = ranges,
         .work_idx = &work_index,
         .fetched = &fetched_count,
         .failed = &failed_count,
@@ -271,37 +416,48 @@ pub fn batch_seed(items: []const Host.SeedItem, concurrency: usize) Host.SeedRes
 
     const worker_fn = struct {
         fn run(wctx: WorkerCtx) void {
+            // one client per worker for all of its ranges, so connections stay warm
             var thread_client: http.Client = .{ .allocator = std.heap.c_allocator, .io = io };
+            defer thread_client.deinit();
 
             while (true) {
                 const idx = wctx.work_idx.fetchAdd(1, .monotonic);
-                if (idx >= wctx.items.len) break;
-
-                const item = wctx.items[idx];
-                const content = fetch_range_standalone(&thread_client, wctx.url, item.name, item.entry) catch {
-                    _ = wctx.failed.fetchAdd(1, .monotonic);
+                if (idx >= wctx.ranges.len) break;
+
+                const range = wctx.ranges[idx];
+                const group = wctx.items[range.first..][0..range.count];
+
+                if (group.len > 1) merged: {
+                    const data = fetch_bytes(&thread_client, wctx.url, range.start, range.length, std.heap.c_allocator) catch |err| {
+                        Log.dbg(io, "bundle", "seed: range {d}+{d} failed ({}), fetching files individually", .{ range.start, range.length, err });
+                        break :merged;
+                    };
+                    defer std.heap.c_allocator.free(data);
+                    // a server that ignored the Range header sent something else
+                    if (data.len != range.length) break :merged;
+
+                    for (group) |item| {
+                        const rel: usize = @intCast(item.entry.offset - range.start);
+                        wctx.store(item, data[rel..][0..item.entry.length]);
+                    }
                     continue;
-                };
-                defer std.heap.c_allocator.free(content);
-
-                const hex_hash = Cache.hash_content(content);
-
-                while (!wctx.cache_mtx.tryLock()) std.atomic.spinLoopHint();
-                defer wctx.cache_mtx.unlock();
-
-                state.cache.write(io, item.name, &hex_hash, content) catch |err| {
-                    Log.dbg(io, "bundle", "seed: cache write failed for '{s}': {}", .{ item.name, err });
-                    _ = wctx.failed.fetchAdd(1, .monotonic);
-                    continue;
-                };
-
-                _ = wctx.fetched.fetchAdd(1, .monotonic);
+                }
+
+                for (group) |item| {
+                    const content = fetch_bytes(&thread_client, wctx.url, item.entry.offset, item.entry.length, std.heap.c_allocator) catch {
+                        Log.dbg(io, "bundle", "prefetch: failed '{s}'", .{item.name});
+                        _ = wctx.failed.fetchAdd(1, .monotonic);
+                        continue;
+                    };
+                    defer std.heap.c_allocator.free(content);
+                    wctx.store(item, content);
+                }
             }
         }
     }.run;
 
     var threads: [64]?std.Thread = @splat(null);
-    const thread_count = @min(actual_concurrency, 64);
+    const thread_count = @min(concurrency, ranges.len, 64);
     for (0..thread_count) |i| {
         threads[i] = std.Thread.spawn(.{}, worker_fn, .{ctx}) catch null;
     }
@@ -320,34 +476,53 @@ pub fn batch_seed(items: []const Host.SeedItem, concurrency: usize) Host.SeedRes
 
 // -- bundle index --
 
+// prefers the compiled index ({digest}.bin); falls back to text cached by
+// older builds ({digest}.txt), which BundleStore recompiles and re-caches.
 pub fn load_cached_index(digest: []const u8, alloc: std.mem.Allocator) ?[]u8 {
     const cache_dir = state.cache.get_cache_dir();
     if (cache_dir.len == 0) return null;
 
-    var path_buf: [1024]u8 = undefined;
-    const path = std.fmt.bufPrint(&path_buf, "{s}/indexes/{s}.txt", .{
-        cache_dir, digest,
-    }) catch return null;
+    for ([_][]const u8{ "bin", "txt" }) |ext| {
+        var path_buf: [1024]u8 = undefined;
+        const path = std.fmt.bufPrint(&path_buf, "{s}/indexes/{s}.{s}", .{
+            cache_dir, digest, ext,
+        }) catch return null;
+        if (read_cache_file(path, alloc)) |content| return content;
+    }
+    return null;
+}
 
+fn read_cache_file(path: []const u8, alloc: std.mem.Allocator) ?[]u8 {
     const file = Io.Dir.cwd().openFile(io, path, .{}) catch return null;
     defer file.close(io);
 
     const stat = file.stat(io) catch return null;
     const size: usize = @intCast(@min(stat.size, 64 * 1024 * 1024));
     const content = alloc.alloc(u8, size) catch return null;
-    var read_buf: [4096]u8 = undefined;
-    var file_reader = file.readerStreaming(io, &read_buf);
-    const reader = &file_reader.interface;
-    reader.readSliceAll(content) catch {
+    const n = file.readPositionalAll(io, content, 0) catch {
         alloc.free(content);
         return null;
     };
+    if (n != size) {
+        alloc.free(content);
+        return null;
+    }
     return content;
 }
 
 pub fn fetch_index(alloc: std.mem.Allocator) ![]u8 {
     const idx_url = get_index_url();
 
+    // a local bundle's index: a file:// index URL, else <bundle>.index.gz
+    if (Config.local_path(idx_url)) |path| return read_local_index(path, alloc);
+    if (Config.local_path(state.data_url_buf[0..state.data_url_len])) |bundle_path| {
+        if (std.mem.eql(u8, idx_url, Config.default_index_url)) {
+            var path_buf: [2048]u8 = undefined;
+            const path = std.fmt.bufPrint(&path_buf, "{s}.index.gz", .{bundle_path}) catch return error.NameTooLong;
+            return read_local_index(path, alloc);
+        }
+    }
+
     Log.dbg(io, "bundle", "fetching bundle index from {s}", .{idx_url});
 
     const c = get_client();
@@ -369,8 +544,22 @@ pub fn fetch_index(alloc: std.mem.Allocator) ![]u8 {
 
     const compressed = body_out.written();
     Log.dbg(io, "bundle", "bundle index downloaded ({d} bytes compressed)", .{compressed.len});
+    return gunzip(alloc, compressed);
+}
+
+// the index file of a local bundle: gzipped as served, or already inflated
+fn read_local_index(path: []const u8, alloc: std.mem.Allocator) ![]u8 {
+    Log.dbg(io, "bundle", "reading bundle index {s}", .{path});
+    const content = read_cache_file(path, alloc) orelse {
+        Log.log(io, "bundle", .err, "cannot read bundle index {s}", .{path});
+        return error.FileNotFound;
+    };
+    if (content.len < 2 or content[0] != 0x1f or content[1] != 0x8b) return content;
+    defer alloc.free(content);
+    return gunzip(alloc, content);
+}
 
-    // gzip decompress
+fn gunzip(alloc: std.mem.Allocator, compressed: []const u8) ![]u8 {
     var input_reader: Io.Reader = .fixed(compressed);
     var window_buf: [std.compress.flate.max_window_len]u8 = undefined;
     var decompress = std.compress.flate.Decompress.init(&input_reader, .gzip, &window_buf);
@@ -396,10 +585,14 @@ pub fn cache_index(digest: []const u8, content: []const u8) void {
     Io.Dir.cwd().createDirPath(io, dir_path) catch {};
 
     var path_buf: [1024]u8 = undefined;
-    const path = std.fmt.bufPrint(&path_buf, "{s}/indexes/{s}.txt", .{
+    const path = std.fmt.bufPrint(&path_buf, "{s}/indexes/{s}.bin", .{
         cache_dir, digest,
     }) catch return;
 
+    write_cache_file(path, content);
+}
+
+fn write_cache_file(path: []const u8, content: []const u8) void {
     const file = Io.Dir.cwd().createFile(io, path, .{}) catch return;
     defer file.close(io);
     var write_buf: [4096]u8 = undefined;
@@ -408,12 +601,232 @@ pub fn cache_index(digest: []const u8, content: []const u8) void {
     _ = writer.interface.flush() catch {};
 }
 
+// -- prefetch lists --
+
+pub fn load_prefetch_list(key: u64, alloc: std.mem.Allocator) ?[]u8 {
+    const cache_dir = state.cache.get_cache_dir();
+    if (cache_dir.len == 0) return null;
+
+    var path_buf: [1024]u8 = undefined;
+    const path = std.fmt.bufPrint(&path_buf, "{s}/deps/{x:0>16}.txt", .{ cache_dir, key }) catch return null;
+    return read_cache_file(path, alloc);
+}
+
+pub fn cache_prefetch_list(key: u64, content: []const u8) void {
+    const cache_dir = state.cache.get_cache_dir();
+    if (cache_dir.len == 0) return;
+
+    var dir_buf: [1024]u8 = undefined;
+    const dir_path = std.fmt.bufPrint(&dir_buf, "{s}/deps", .{cache_dir}) catch return;
+    Io.Dir.cwd().createDirPath(io, dir_path) catch {};
+
+    var path_buf: [1024]u8 = undefined;
+    const path = std.fmt.bufPrint(&path_buf, "{s}/deps/{x:0>16}.txt", .{ cache_dir, key }) catch return;
+    write_cache_file(path, content);
+}
+
+// -- cached blobs --
+
+pub fn load_blob(kind: []const u8, key: *const [16]u8, alloc: std.mem.Allocator) ?[]u8 {
+    const cache_dir = state.cache.get_cache_dir();
+    if (cache_dir.len == 0) return null;
+
+    var path_buf: [1024]u8 = undefined;
+    const path = std.fmt.bufPrint(&path_buf, "{s}/{s}/{s}.bin", .{ cache_dir, kind, &std.fmt.bytesToHex(key.*, .lower) }) catch return null;
+    return read_cache_file(path, alloc);
+}
+
+pub fn cache_blob(kind: []const u8, key: *const [16]u8, content: []const u8) void {
+    const cache_dir = state.cache.get_cache_dir();
+    if (cache_dir.len == 0) return;
+
+    var dir_buf: [1024]u8 = undefined;
+    const dir_path = std.fmt.bufPrint(&dir_buf, "{s}/{s}", .{ cache_dir, kind }) catch return;
+    Io.Dir.cwd().createDirPath(io, dir_path) catch {};
+
+    var path_buf: [1024]u8 = undefined;
+    const path = std.fmt.bufPrint(&path_buf, "{s}/{s}/{s}.bin", .{ cache_dir, kind, &std.fmt.bytesToHex(key.*, .lower) }) catch return;
+    write_cache_file(path, content);
+}
+
+// -- remote compile cache --
+
+fn bearer(buf: []u8, token: ?[]const u8) http.Client.Request.Headers.Value {
+    const t = token orelse return .default;
+    return .{ .override = std.fmt.bufPrint(buf, "Bearer {s}", .{t}) catch return .default };
+}
+
+pub fn remote_get(url: []const u8, token: ?[]const u8, alloc: std.mem.Allocator) ?[]u8 {
+    var auth_buf: [1024]u8 = undefined;
+    var body_out: Io.Writer.Allocating = .init(alloc);
+    defer body_out.deinit();
+
+    const result = get_client().fetch(.{
+        .location = .{ .url = url },
+        .response_writer = &body_out.writer,
+        .headers = .{ .authorization = bearer(&auth_buf, token) },
+    }) catch |err| {
+        Log.dbg(io, "remote", "GET {s} failed: {}", .{ url, err });
+        return null;
+    };
+    if (result.status != .ok) {
+        if (result.status != .not_found) Log.dbg(io, "remote", "GET {s} returned HTTP {d}", .{ url, @intFromEnum(result.status) });
+        return null;
+    }
+    return body_out.toOwnedSlice() catch null;
+}
+
+pub fn remote_put(url: []const u8, token: ?[]const u8, body: []const u8) bool {
+    var auth_buf: [1024]u8 = undefined;
+    const result = get_client().fetch(.{
+        .location = .{ .url = url },
+        .method = .PUT,
+        .payload = body,
+        .headers = .{ .authorization = bearer(&auth_buf, token) },
+    }) catch |err| {
+        Log.dbg(io, "remote", "PUT {s} failed: {}", .{ url, err });
+        return false;
+    };
+    if (result.status.class() != .success) {
+        Log.dbg(io, "remote", "PUT {s} returned HTTP {d}", .{ url, @intFromEnum(result.status) });
+        return false;
+    }
+    return true;
+}
+
+// -- format image snapshot (World keeps it next to the cached format) --
+
+pub fn load_format_image() ?[]u8 {
+    return null;
+}
+
+pub fn free_format_image(_: []u8) void {}
+
+pub fn save_format_image(_: []const u8) void {}
+
+// -- format generation --
+
+const max_format_jobs = 4;
+
+// absolute cache dir for child processes, which run in other directories
+fn absolute_cache_dir(cache_dir_override: ?[]const u8, buf: []u8) ?[]const u8 {
+    const override = cache_dir_override orelse return find_cache_dir(buf);
+    Io.Dir.cwd().createDirPath(io, override) catch {};
+    var z_buf: [1024]u8 = undefined;
+    const z = std.fmt.bufPrintZ(&z_buf, "{s}", .{override}) catch return null;
+    var real_buf: [4096]u8 = undefined;
+    const real = std.mem.sliceTo(std.c.realpath(z, &real_buf) orelse return null, 0);
+    if (real.len > buf.len) return null;
+    @memcpy(buf[0..real.len], real);
+    return buf[0..real.len];
+}
+
+pub fn generate_formats(formats: []const []const u8, cache_dir_override: ?[]const u8) usize {
+    if (formats.len > max_format_jobs) return formats.len;
+    var cache_buf: [1024]u8 = undefined;
+    const cache_dir = absolute_cache_dir(cache_dir_override, &cache_buf) orelse return formats.len;
+    var exe_buf: [1024]u8 = undefined;
+    const exe = std.process.executablePath(io, &exe_buf) catch return formats.len;
+
+    var scratch_bufs: [max_format_jobs][1100]u8 = undefined;
+    var scratch: [max_format_jobs][]const u8 = undefined;
+    var children: [max_format_jobs]?std.process.Child = @splat(null);
+    var failed: usize = 0;
+    const pid = std.c.getpid();
+
+    for (formats, 0..) |name, i| {
+        // initex writes its input, log and output into the working directory
+        scratch[i] = std.fmt.bufPrint(&scratch_bufs[i], "{s}/formats/gen-{d}-{s}", .{ cache_dir, pid, name }) catch {
+            failed += 1;
+            continue;
+        };
+        Io.Dir.cwd().createDirPath(io, scratch[i]) catch {
+            failed += 1;
+            continue;
+        };
+        const argv = [_][]const u8{ exe, "generate-format", "--format", name, "--cache-dir", cache_dir };
+        children[i] = std.process.spawn(io, .{
+            .argv = &argv,
+            .cwd = scratch[i],
+            .stdin = .ignore,
+            .stdout = .ignore,
+            .stderr = .inherit,
+        }) catch |err| {
+            Log.log(io, "eztex", .warn, "failed to start {s} format generation: {}", .{ name, err });
+            Io.Dir.cwd().deleteTree(io, scratch[i]) catch {};
+            failed += 1;
+            continue;
+        };
+        Log.dbg(io, "eztex", "generating {s} format in {s}", .{ name, scratch[i] });
+    }
+
+    for (formats, 0..) |name, i| {
+        var child = children[i] orelse continue;
+        defer Io.Dir.cwd().deleteTree(io, scratch[i]) catch {};
+        const term = child.wait(io) catch {
+            failed += 1;
+            continue;
+        };
+        const ok = switch (term) {
+            .exited => |code| code == 0,
+            else => false,
+        };
+        if (!ok) {
+            Log.log(io, "eztex", .warn, "{s} format generation failed", .{name});
+            failed += 1;
+        }
+    }
+    return failed;
+}
+
+pub fn generate_formats_in_background(cache_dir_override: ?[]const u8) bool {
+    var cache_buf: [1024]u8 = undefined;
+    const cache_dir = absolute_cache_dir(cache_dir_override, &cache_buf) orelse return false;
+    var exe_buf: [1024]u8 = undefined;
+    const exe = std.process.executablePath(io, &exe_buf) catch return false;
+
+    // not waited for: it outlives a short compile and cleans up after itself
+    const argv = [_][]const u8{ exe, "generate-format", "--all", "--cache-dir", cache_dir };
+    _ = std.process.spawn(io, .{
+        .argv = &argv,
+        .cwd = cache_dir,
+        .stdin = .ignore,
+        .stdout = .ignore,
+        .stderr = .ignore,
+    }) catch return false;
+    return true;
+}
+
+// -- cancellation (a native compile runs to completion) --
+
+pub fn cancel_requested() bool {
+    return false;
+}
+
 // -- time --
 
 pub fn timestamp_ns() i128 {
     return std.time.nanoTimestamp();
 }
 
+pub fn cpu_time_us() ?u64 {
+    if (comptime builtin.os.tag == .windows) return null;
+    const usage = std.posix.getrusage(std.posix.rusage.SELF);
+    const sec: i64 = @as(i64, usage.utime.sec) + usage.stime.sec;
+    const usec: i64 = @as(i64, usage.utime.usec) + usage.stime.usec;
+    return @intCast(@max(sec * std.time.us_per_s + usec, 0));
+}
+
+// -- memory --
+
+pub fn peak_rss_bytes() ?u64 {
+    if (comptime builtin.os.tag == .windows) return null;
+    const usage = std.posix.getrusage(std.posix.rusage.SELF);
+    const maxrss: u64 = @intCast(@max(usage.maxrss, 0));
+    // bytes on Darwin, KiB everywhere else
+    return if (comptime builtin.os.tag.isDarwin()) maxrss else maxrss * 1024;
+}
+
 // -- internal helpers --
 
 fn get_client() *http.Client {
@@ -465,9 +878,9 @@ pub fn set_digest(digest: []const u8) void {
 // native platform setup: cache directory discovery, manifest loading, PM creation.
 // returns cache directory path, or null if unavailable.
 
-var g_cache_dir_buf: [512]u8 = undefined;
-var g_manifest_buf: [1024]u8 = undefined;
-var g_setup_digest_buf: [128]u8 = undefined;
+threadlocal var g_cache_dir_buf: [512]u8 = undefined;
+threadlocal var g_manifest_buf: [1024]u8 = undefined;
+threadlocal var g_setup_digest_buf: [128]u8 = undefined;
 
 pub fn setup(world: *Engine.World, _: bool, cache_dir_override: ?[]const u8, data_url: []const u8, index_url: []const u8, digest: *const [64]u8) ?[]const u8 {
     const cache_dir = if (cache_dir_override) |override| blk: {
@@ -508,6 +921,7 @@ pub fn setup(world: *Engine.World, _: bool, cache_dir_override: ?[]const u8, dat
 
     // initialize the Host layer (sets cache dir, data URL, index URL, digest on module state)
     init(cache_dir, data_url, index_url, digest);
+    state.cache.max_bytes = cache_budget();
 
     // load the cache manifest from disk if it exists
     if (find_manifest_info(cache_dir, &g_manifest_buf, &g_setup_digest_buf, digest)) |info| {
@@ -520,16 +934,42 @@ pub fn setup(world: *Engine.World, _: bool, cache_dir_override: ?[]const u8, dat
         Log.log(io, "eztex", .info, "no cached manifest found, will bootstrap from network on demand", .{});
     }
 
-    // create BundleStore with active bundle settings
-    const bs = BundleStore.init(std.heap.c_allocator, data_url, digest);
+    state.cache.open_pack(io, digest) catch |err| {
+        Log.log(io, "eztex", .warn, "failed to open cache pack, using loose files: {}", .{err});
+    };
+    if (state.cache.pack.is_open()) {
+        Log.dbg(io, "eztex", "cache pack: {d} entries{s}", .{
+            state.cache.pack.count(), if (state.cache.pack.writable) "" else " (read-only, in use by another process)",
+        });
+    }
 
-    Engine.set_bundle_store(bs);
+    // create BundleStore with active bundle settings. a resident server keeps
+    // the previous store (and its loaded index) when the bundle is unchanged
+    const keep = if (Runtime.instance) |rt| rt.resident and rt.bundle_store.serves(data_url, digest) else false;
+    if (!keep) {
+        if (Runtime.instance) |rt| {
+            if (rt.resident) rt.bundle_store.deinit();
+        }
+        Engine.set_bundle_store(BundleStore.init(std.heap.c_allocator, data_url, digest));
+    }
     world.bundle_store = Engine.get_bundle_store();
     Log.dbg(io, "eztex", "bundle store initialized", .{});
 
     return cache_dir;
 }
 
+// EZTEX_CACHE_MAX, e.g. "2G": the size the cache is trimmed to after each
+// compile (see Cache.trim). unset or unreadable keeps everything
+fn cache_budget() ?u64 {
+    const text = std.c.getenv("EZTEX_CACHE_MAX") orelse return null;
+    const value = std.mem.span(text);
+    const bytes = Cache.parse_size(value) orelse {
+        Log.log(io, "eztex", .warn, "ignoring EZTEX_CACHE_MAX={s}: expected a size like 500M or 2G", .{value});
+        return null;
+    };
+    return bytes;
+}
+
 fn find_cache_dir(buf: []u8) ?[]const u8 {
     var probe: Cache = Cache.init(std.heap.c_allocator);
     if (probe.detect_cache_dir()) {
@@ -575,3 +1015,22 @@ fn find_manifest_info(cdir: []const u8, path_buf: []u8, dbuf: []u8, digest: *con
     const path = std.fmt.bufPrint(path_buf, "{s}", .{manifest_path}) catch return null;
     return .{ .path = path, .digest = dbuf[0..digest.len] };
 }
+
+test "merge_seed_ranges coalesces neighbours within the gap and size limits" {
+    const items = [_]Host.SeedItem{
+        .{ .name = "a.sty", .entry = .{ .offset = 0, .length = 100 } },
+        .{ .name = "b.sty", .entry = .{ .offset = 100, .length = 50 } },
+        .{ .name = "c.sty", .entry = .{ .offset = 150 + max_merge_gap, .length = 10 } },
+        .{ .name = "d.sty", .entry = .{ .offset = 1 << 30, .length = 10 } },
+        .{ .name = "e.otf", .entry = .{ .offset = (1 << 30) + 10, .length = max_merged_range } },
+    };
+    const ranges = try merge_seed_ranges(std.testing.allocator, &items);
+    defer std.testing.allocator.free(ranges);
+
+    try std.testing.expectEqual(@as(usize, 3), ranges.len);
+    try std.testing.expectEqual(@as(usize, 3), ranges[0].count);
+    try std.testing.expectEqual(@as(u64, 160 + max_merge_gap), ranges[0].length);
+    try std.testing.expectEqual(@as(usize, 3), ranges[1].first);
+    try std.testing.expectEqual(@as(usize, 1), ranges[1].count);
+    try std.testing.expectEqual(@as(usize, 4), ranges[2].first);
+}
@@ -3,7 +3,7 @@
 // Wraps the js_request_range extern import for range fetches.
 // Index fetching uses js_request_index extern (JS returns cached decompressed bytes).
 // WASM has no persistent cache (OPFS is managed by JS host externally).
-// Single-threaded: batch seed just does sequential fetches.
+// Single-threaded: batch seed hands the whole list to JS in one call.
 
 const std = @import("std");
 const fs = std.fs;
@@ -11,6 +11,7 @@ const Host = @import("../Host.zig");
 const Engine = @import("../Engine.zig");
 const BundleStore = @import("../BundleStore.zig");
 const Log = @import("../Log.zig");
+const Runtime = @import("../Runtime.zig");
 
 // WASM allocator: use wasm_allocator for JS buffer management (no libc dependency).
 // The alloc parameter passed to functions is used for returned data.
@@ -22,16 +23,38 @@ const wasm_allocator = std.heap.wasm_allocator;
 // exported allocator path (eztex_alloc). This ensures freeing with wasm_allocator
 // on the Zig side is valid. JS receives the allocator via the import table.
 
+// raw_length is the entry's inflated size when it is a gzip member (0 when
+// stored as is); JS returns it inflated when it can, or as fetched.
 extern "env" fn js_request_range(
     name_ptr: [*]const u8,
     name_len: usize,
     offset_lo: u32,
     offset_hi: u32,
     length: u32,
+    raw_length: u32,
     buf_ptr: *[*]u8,
     buf_len: *usize,
 ) i32;
 
+// JS fetches a batch of bundle ranges into its memory cache, so later
+// js_request_range calls for them are hits. `list` holds one
+// "name\toffset\tlength\n" record per file. returns the number fetched,
+// or -1 when the host cannot fetch concurrently (no JSPI).
+extern "env" fn js_prefetch_ranges(
+    list_ptr: [*]const u8,
+    list_len: usize,
+    concurrency: u32,
+) i32;
+
+// JS keeps a copy of a file Zig fetched and inflated itself, so the memory
+// cache and OPFS only ever hold inflated entries. no-op if JS has it already.
+extern "env" fn js_cache_put(
+    name_ptr: [*]const u8,
+    name_len: usize,
+    data_ptr: [*]const u8,
+    data_len: usize,
+) void;
+
 // JS provides decompressed ITAR index text (cached from async fetch during init).
 // returns 0 on success, -1 if index not available.
 // The returned buffer must be allocated via the module's exported allocator.
@@ -40,6 +63,24 @@ extern "env" fn js_request_index(
     buf_len: *usize,
 ) i32;
 
+// JS hands over a copy of the format image snapshot it holds, if any.
+// returns 0 on success, -1 when it holds none.
+// The returned buffer must be allocated via the module's exported allocator.
+extern "env" fn js_format_image_get(
+    buf_ptr: *[*]u8,
+    buf_len: *usize,
+) i32;
+
+// JS copies the bytes out into its snapshot, replacing any previous one.
+extern "env" fn js_format_image_put(
+    data_ptr: [*]const u8,
+    data_len: usize,
+) void;
+
+// nonzero when the main thread has superseded the running preview compile.
+// polled at every ship_out, so it must stay cheap: JS reads a shared flag.
+extern "env" fn js_cancel_requested() i32;
+
 // -- init (no-op on WASM, JS manages transport state) --
 
 pub fn init(_: ?[]const u8, _: []const u8, _: []const u8, _: []const u8) void {}
@@ -48,12 +89,21 @@ pub fn init(_: ?[]const u8, _: []const u8, _: []const u8, _: []const u8) void {}
 // WASM platform setup: init BundleStore with wasm_allocator.
 // files are fetched on demand from JS host via js_request_range.
 // returns null (WASM has no persistent cache directory).
+// a resident instance (see eztex_run in main.zig) keeps the previous store,
+// and its loaded index, when the bundle is unchanged.
 pub fn setup(world: *Engine.World, _: bool, _: ?[]const u8, data_url: []const u8, _: []const u8, digest: *const [64]u8) ?[]const u8 {
     var threaded: std.Io.Threaded = .init_single_threaded;
     const io = threaded.io();
-    Log.dbg(io, "wasm", "setup: initializing BundleStore with wasm_allocator", .{});
-    const bs = BundleStore.init(wasm_allocator, data_url, digest);
-    Engine.set_bundle_store(bs);
+    const keep = if (Runtime.instance) |rt| rt.resident and rt.bundle_store.serves(data_url, digest) else false;
+    if (keep) {
+        Log.dbg(io, "wasm", "setup: keeping resident BundleStore", .{});
+    } else {
+        Log.dbg(io, "wasm", "setup: initializing BundleStore with wasm_allocator", .{});
+        if (Runtime.instance) |rt| {
+            if (rt.resident) rt.bundle_store.deinit();
+        }
+        Engine.set_bundle_store(BundleStore.init(wasm_allocator, data_url, digest));
+    }
     world.bundle_store = Engine.get_bundle_store();
     Log.dbg(io, "wasm", "setup: complete, bundle_store set", .{});
     return null;
@@ -77,6 +127,7 @@ pub fn fetch_range(name: []const u8, entry: Host.IndexEntry, alloc: std.mem.Allo
         offset_lo,
         offset_hi,
         entry.length,
+        entry.raw_length,
         &buf_ptr,
         &buf_len,
     );
@@ -91,28 +142,64 @@ pub fn fetch_range(name: []const u8, entry: Host.IndexEntry, alloc: std.mem.Allo
 
     Log.dbg(io, "wasm", "fetch_range: got {d} bytes from JS", .{buf_len});
     const js_slice = buf_ptr[0..buf_len];
-    // copy out of JS-allocated buffer, then free via wasm_allocator (valid
-    // because JS allocated through the module's exported allocator path).
+    // JS allocated through the module's exported allocator path, so the buffer
+    // is already wasm_allocator memory: the BundleStore (which uses it too)
+    // takes it over without a copy.
+    if (alloc.vtable == wasm_allocator.vtable) return js_slice;
     const owned = try alloc.dupe(u8, js_slice);
     wasm_allocator.free(js_slice);
     return owned;
 }
 
+// -- batch seed --
+
+pub fn batch_seed(items: []const Host.SeedItem, concurrency: usize) Host.SeedResult {
+    if (items.len == 0) return .{ .fetched = 0, .failed = 0 };
+    var threaded: std.Io.Threaded = .init_single_threaded;
+    const io = threaded.io();
+
+    var list: std.ArrayList(u8) = .empty;
+    defer list.deinit(wasm_allocator);
+    for (items) |item| {
+        list.print(wasm_allocator, "{s}\t{d}\t{d}\n", .{ item.name, item.entry.offset, item.entry.length }) catch
+            return .{ .fetched = 0, .failed = items.len };
+    }
+
+    const result = js_prefetch_ranges(list.items.ptr, list.items.len, @intCast(concurrency));
+    if (result < 0) {
+        Log.dbg(io, "wasm", "batch_seed: host fetches on open, skipped {d} files", .{items.len});
+        return .{ .fetched = 0, .failed = 0 };
+    }
+    const fetched: usize = @min(@as(usize, @intCast(result)), items.len);
+    return .{ .fetched = fetched, .failed = items.len - fetched };
+}
+
 // -- cache (WASM has no persistent cache from Zig's perspective) --
-// JS pre-loads files into WASI filesystem and manages OPFS externally.
+// JS pre-loads files into WASI filesystem and manages OPFS externally;
+// cache_write only hands JS the files it could not inflate itself.
 
 pub fn cache_check(_: []const u8) Host.CacheStatus {
     return .unsupported;
 }
 
-pub fn cache_open(_: []const u8) ?std.Io.File {
+pub fn cache_open(_: []const u8) ?Host.CachedFile {
     return null;
 }
 
-pub fn cache_write(_: []const u8, _: []const u8) void {}
+pub fn cache_claim(_: []const u8) bool {
+    return false;
+}
+
+pub fn cache_release(_: []const u8) void {}
+
+pub fn cache_write(name: []const u8, content: []const u8) void {
+    js_cache_put(name.ptr, name.len, content.ptr, content.len);
+}
 
 pub fn cache_save() void {}
 
+pub fn cache_note_format(_: []const u8) void {}
+
 pub fn cache_count() usize {
     return 0;
 }
@@ -144,9 +231,89 @@ pub fn fetch_index(alloc: std.mem.Allocator) ![]u8 {
 
 pub fn cache_index(_: []const u8, _: []const u8) void {}
 
+// -- prefetch lists --
+
+pub fn load_prefetch_list(_: u64, _: std.mem.Allocator) ?[]u8 {
+    return null;
+}
+
+pub fn cache_prefetch_list(_: u64, _: []const u8) void {}
+
+// -- cached blobs --
+
+pub fn load_blob(_: []const u8, _: *const [16]u8, _: std.mem.Allocator) ?[]u8 {
+    return null;
+}
+
+pub fn cache_blob(_: []const u8, _: *const [16]u8, _: []const u8) void {}
+
+// -- remote compile cache (not supported) --
+
+pub fn remote_get(_: []const u8, _: ?[]const u8, _: std.mem.Allocator) ?[]u8 {
+    return null;
+}
+
+pub fn remote_put(_: []const u8, _: ?[]const u8, _: []const u8) bool {
+    return false;
+}
+
+// -- format image snapshot --
+// JS keeps it in an ArrayBuffer across per-compile instances. the image is
+// used in place (the engine aliases its arrays into it), so unlike fetched
+// files it is not copied out of the JS-allocated buffer.
+
+pub fn load_format_image() ?[]u8 {
+    var buf_ptr: [*]u8 = undefined;
+    var buf_len: usize = 0;
+
+    if (js_format_image_get(&buf_ptr, &buf_len) != 0 or buf_len == 0) return null;
+    const image = buf_ptr[0..buf_len];
+    // the engine lays the image out in 64-byte aligned arrays. an allocation
+    // this large comes from whole wasm pages, but do not rely on it.
+    if (!std.mem.isAligned(@intFromPtr(image.ptr), 64)) {
+        wasm_allocator.free(image);
+        return null;
+    }
+    return image;
+}
+
+pub fn free_format_image(image: []u8) void {
+    wasm_allocator.free(image);
+}
+
+pub fn save_format_image(content: []const u8) void {
+    js_format_image_put(content.ptr, content.len);
+}
+
+// -- format generation --
+
+pub fn generate_formats(formats: []const []const u8, _: ?[]const u8) usize {
+    return formats.len;
+}
+
+pub fn generate_formats_in_background(_: ?[]const u8) bool {
+    return false;
+}
+
+// -- cancellation --
+
+pub fn cancel_requested() bool {
+    return js_cancel_requested() != 0;
+}
+
 // -- time --
 
 pub fn timestamp_ns() i128 {
     // WASM: use WASI clock (available via std.time on wasm32-wasi)
     return std.time.nanoTimestamp();
 }
+
+pub fn cpu_time_us() ?u64 {
+    return null;
+}
+
+// -- memory --
+
+pub fn peak_rss_bytes() ?u64 {
+    return null;
+}
@@ -7,6 +7,7 @@
 pub const Compiler = @import("Compiler.zig");
 pub const Config = @import("Config.zig");
 pub const Digest = @import("Digest.zig");
+pub const Embedded = @import("Embedded.zig");
 pub const Engine = @import("Engine.zig");
 pub const engine = @import("EngineInterface.zig");
 pub const EngineInterface = engine.Engine;
@@ -15,9 +16,12 @@ pub const EngineResult = engine.EngineResult;
 pub const EngineVariable = engine.Variable;
 pub const EngineValue = engine.Value;
 pub const EngineOutputFormat = engine.OutputFormat;
+pub const PageRange = engine.PageRange;
 pub const Host = @import("Host.zig");
 pub const Log = @import("Log.zig");
 pub const Runtime = @import("Runtime.zig");
+pub const Server = @import("Server.zig");
+pub const Batch = @import("Batch.zig");
 pub const BundleStore = @import("BundleStore.zig");
 pub const Watcher = @import("Watcher.zig");
 pub const seeds = @import("seeds.zig");
@@ -10,10 +10,13 @@ const Host = eztex.Host;
 const Config = eztex.Config;
 const Compiler = eztex.Compiler;
 const Watcher = eztex.Watcher;
+const Server = eztex.Server;
+const Batch = eztex.Batch;
 const Engine = eztex.Engine;
 const Runtime = @import("Runtime.zig");
 
 const Format = eztex.Format;
+const PageRange = eztex.PageRange;
 const CompileMode = Compiler.CompileMode;
 
 // -- CLI types --
@@ -22,6 +25,8 @@ const Command = enum {
     compile,
     watch,
     generate_format,
+    pdf,
+    serve,
     init,
     help,
     version,
@@ -30,6 +35,10 @@ const Command = enum {
 const Options = struct {
     command: Command = .help,
     input_file: ?[]const u8 = null,
+    // further inputs of a batch compile (`eztex compile a.tex b.tex ...`)
+    extra_inputs: std.ArrayList([]const u8) = .empty,
+    // batch worker processes, --jobs/-j (default: one per CPU)
+    jobs: ?usize = null,
     output_file: ?[]const u8 = null,
     mode: CompileMode = .full,
     format: Format = .latex,
@@ -38,6 +47,46 @@ const Options = struct {
     cache_dir: ?[]const u8 = null,
     deterministic: bool = false,
     synctex: bool = false,
+    // --profile writes the expansion profile to <jobname>.flame
+    profile: bool = false,
+    // --command-index writes <jobname>.cmds, the commands the document can use
+    command_index: bool = false,
+    // --memo-linebreaks replays unchanged paragraphs' line breaks on later passes
+    memo_linebreaks: bool = false,
+    // --incremental-pdf appends changed objects to the previous PDF
+    incremental_pdf: bool = false,
+    // --page-digests writes <jobname>.pages.json, a digest per page
+    page_digests: bool = false,
+    // --preamble-format starts from a format with the preamble dumped in
+    // (always on for watch)
+    preamble_format: bool = false,
+    // --xdv stops at <jobname>.xdv, for a later `eztex pdf`
+    xdv_only: bool = false,
+    // --force compiles even when nothing changed since the PDF was written
+    force: bool = false,
+    // --externalize-tikz typesets each TikZ picture once and reuses its PDF
+    externalize_pictures: bool = false,
+    // --focus previews only the \include'd part holding this file
+    focus: ?[]const u8 = null,
+    // --pages converts only these pages of a preview, the rest left blank
+    pages: ?PageRange = null,
+    // --image-dpi scales PNGs down to this resolution where they are placed
+    image_dpi: ?u16 = null,
+    // --draft-images puts a preview's raster images in as gray boxes
+    draft_images: bool = false,
+    // --no-log skips the .log of a preview
+    no_log: bool = false,
+    // --trace writes a Chrome trace of the compile's stages
+    trace_file: ?[]const u8 = null,
+    // --server forwards to a running `eztex serve`, --socket picks its socket
+    server: bool = false,
+    socket_path: ?[]const u8 = null,
+    // serve --stats prints a running server's metrics; --max-cpu and
+    // --max-memory limit each job it runs (see Compiler.Limits)
+    serve_stats: bool = false,
+    job_limits: Compiler.Limits = .{},
+    // generate-format --all builds every format in parallel processes
+    all_formats: bool = false,
     cli_set: CliSet = .{},
 
     const CliSet = packed struct {
@@ -79,6 +128,21 @@ const Options = struct {
             .verbose = self.verbose,
             .deterministic = self.deterministic,
             .synctex = self.synctex,
+            .profile = self.profile,
+            .command_index = self.command_index,
+            .memo_linebreaks = self.memo_linebreaks,
+            .incremental_pdf = self.incremental_pdf,
+            .page_digests = self.page_digests,
+            .preamble_format = self.preamble_format or self.command == .watch,
+            .xdv_only = self.xdv_only,
+            .reuse_output = !self.force,
+            .externalize_pictures = self.externalize_pictures,
+            .no_log = self.no_log,
+            .focus = self.focus,
+            .pages = self.pages,
+            .image_dpi = self.image_dpi,
+            .draft_images = self.draft_images,
+            .trace_file = self.trace_file,
             .cache_dir = self.cache_dir,
         };
     }
@@ -86,18 +150,35 @@ const Options = struct {
 
 // -- argument parsing --
 
-fn parse_args(init: std.process.Init) Options {
-    const io = init.io;
-    const is_wasm = Host.is_wasm;
-    var opts = Options{};
-    
+fn args_iterator(init: std.process.Init) !std.process.Args.Iterator {
     // Create args iterator from init.minimal.args
-    var args = if (is_wasm or builtin.os.tag == .windows)
-        (std.process.Args.Iterator.initAllocator(init.minimal.args, std.heap.c_allocator) catch return opts)
-    else 
+    return if (Host.is_wasm or builtin.os.tag == .windows)
+        try std.process.Args.Iterator.initAllocator(init.minimal.args, std.heap.c_allocator)
+    else
         std.process.Args.Iterator.init(init.minimal.args);
+}
+
+fn parse_args(init: std.process.Init) Options {
+    var args = args_iterator(init) catch return .{};
     defer args.deinit();
     _ = args.next(); // skip argv[0]
+    return parse_arg_list(init.io, &args);
+}
+
+// a forwarded command line, as received by `eztex serve`
+const SliceArgs = struct {
+    items: []const []const u8,
+    pos: usize = 0,
+
+    fn next(self: *SliceArgs) ?[]const u8 {
+        if (self.pos == self.items.len) return null;
+        defer self.pos += 1;
+        return self.items[self.pos];
+    }
+};
+
+fn parse_arg_list(io: Io, args: anytype) Options {
+    var opts = Options{};
 
     const cmd_str = args.next() orelse return opts;
 
@@ -107,6 +188,10 @@ fn parse_args(init: std.process.Init) Options {
         opts.command = .watch;
     } else if (std.mem.eql(u8, cmd_str, "generate-format")) {
         opts.command = .generate_format;
+    } else if (std.mem.eql(u8, cmd_str, "pdf")) {
+        opts.command = .pdf;
+    } else if (std.mem.eql(u8, cmd_str, "serve")) {
+        opts.command = .serve;
     } else if (std.mem.eql(u8, cmd_str, "init")) {
         opts.command = .init;
         return opts;
@@ -138,6 +223,8 @@ fn parse_args(init: std.process.Init) Options {
             opts.cli_set.keep_intermediates = true;
         } else if (std.mem.eql(u8, arg, "--preview")) {
             opts.mode = .preview;
+        } else if (std.mem.eql(u8, arg, "--no-log")) {
+            opts.no_log = true;
         } else if (std.mem.eql(u8, arg, "--format")) {
             if (args.next()) |val| {
                 if (std.mem.eql(u8, val, "latex") or std.mem.eql(u8, val, "xelatex")) {
@@ -171,6 +258,89 @@ fn parse_args(init: std.process.Init) Options {
         } else if (std.mem.eql(u8, arg, "--synctex")) {
             opts.synctex = true;
             opts.cli_set.synctex = true;
+        } else if (std.mem.eql(u8, arg, "--profile")) {
+            opts.profile = true;
+        } else if (std.mem.eql(u8, arg, "--command-index")) {
+            opts.command_index = true;
+        } else if (std.mem.eql(u8, arg, "--memo-linebreaks")) {
+            opts.memo_linebreaks = true;
+        } else if (std.mem.eql(u8, arg, "--incremental-pdf")) {
+            opts.incremental_pdf = true;
+        } else if (std.mem.eql(u8, arg, "--page-digests")) {
+            opts.page_digests = true;
+        } else if (std.mem.eql(u8, arg, "--preamble-format")) {
+            opts.preamble_format = true;
+        } else if (std.mem.eql(u8, arg, "--xdv")) {
+            opts.xdv_only = true;
+        } else if (std.mem.eql(u8, arg, "--force")) {
+            opts.force = true;
+        } else if (std.mem.eql(u8, arg, "--externalize-tikz")) {
+            opts.externalize_pictures = true;
+        } else if (std.mem.eql(u8, arg, "--image-dpi")) {
+            const val = args.next() orelse "";
+            opts.image_dpi = std.fmt.parseInt(u16, val, 10) catch {
+                Log.log(io, "eztex", .err, "--image-dpi requires a resolution (0 to keep images as they are)", .{});
+                opts.command = .help;
+                return opts;
+            };
+        } else if (std.mem.eql(u8, arg, "--draft-images")) {
+            opts.draft_images = true;
+        } else if (std.mem.eql(u8, arg, "--focus")) {
+            if (args.next()) |val| {
+                opts.focus = val;
+            } else {
+                Log.log(io, "eztex", .err, "--focus requires a file", .{});
+                opts.command = .help;
+                return opts;
+            }
+        } else if (std.mem.eql(u8, arg, "--pages")) {
+            opts.pages = if (args.next()) |val| PageRange.parse(val) else null;
+            if (opts.pages == null) {
+                Log.log(io, "eztex", .err, "--pages requires a range like 40-42", .{});
+                opts.command = .help;
+                return opts;
+            }
+        } else if (std.mem.eql(u8, arg, "--trace")) {
+            if (args.next()) |val| {
+                opts.trace_file = val;
+            } else {
+                Log.log(io, "eztex", .err, "--trace requires a path", .{});
+                opts.command = .help;
+                return opts;
+            }
+        } else if (std.mem.eql(u8, arg, "--jobs") or std.mem.eql(u8, arg, "-j")) {
+            const val = args.next() orelse "";
+            opts.jobs = std.fmt.parseInt(usize, val, 10) catch {
+                Log.log(io, "eztex", .err, "{s} requires a number of workers", .{arg});
+                opts.command = .help;
+                return opts;
+            };
+        } else if (std.mem.eql(u8, arg, "--all")) {
+            opts.all_formats = true;
+        } else if (std.mem.eql(u8, arg, "--server")) {
+            opts.server = true;
+        } else if (std.mem.eql(u8, arg, "--socket")) {
+            if (args.next()) |val| {
+                opts.socket_path = val;
+            } else {
+                Log.log(io, "eztex", .err, "--socket requires a path", .{});
+                opts.command = .help;
+                return opts;
+            }
+        } else if (std.mem.eql(u8, arg, "--stats")) {
+            opts.serve_stats = true;
+        } else if (std.mem.eql(u8, arg, "--max-cpu") or std.mem.eql(u8, arg, "--max-memory")) {
+            const val = args.next() orelse "";
+            const n = std.fmt.parseInt(u64, val, 10) catch {
+                Log.log(io, "eztex", .err, "{s} requires a number", .{arg});
+                opts.command = .help;
+                return opts;
+            };
+            if (std.mem.eql(u8, arg, "--max-cpu")) {
+                opts.job_limits.cpu_ms = n * std.time.ms_per_s;
+            } else {
+                opts.job_limits.memory_bytes = n * 1024 * 1024;
+            }
         } else if (std.mem.eql(u8, arg, "--help") or std.mem.eql(u8, arg, "-h")) {
             opts.command = .help;
             return opts;
@@ -181,6 +351,8 @@ fn parse_args(init: std.process.Init) Options {
         } else {
             if (opts.input_file == null) {
                 opts.input_file = arg;
+            } else if (opts.command == .compile) {
+                opts.extra_inputs.append(std.heap.c_allocator, arg) catch {};
             } else {
                 Log.log(io, "eztex", .err, "unexpected argument '{s}'", .{arg});
                 opts.command = .help;
@@ -201,7 +373,12 @@ fn print_usage(io: Io) void {
         \\  eztex compile <directory/> [options]   compile a project directory
         \\  eztex compile <project.zip> [options]  compile from zip archive
         \\  eztex <file.tex> [options]             shorthand for compile
+        \\  eztex compile a.tex b/ c.zip [options]  batch compile, each beside its input
         \\  eztex watch <file.tex> [options]       watch and recompile on changes
+        \\  eztex serve [--socket <path>]          keep bundle, format and fonts warm for --server
+        \\  eztex serve --stats                    print a running server's queue, latency and cache metrics
+        \\  eztex pdf <file.xdv> [options]         write the PDF of an XDV left by compile --xdv
+        \\  eztex generate-format [--all]          build the latex (or --format) format; --all builds every format in parallel
         \\  eztex init                             create eztex.zon in current directory
         \\  eztex help                             show this help
         \\  eztex version                          show version
@@ -212,11 +389,38 @@ fn print_usage(io: Io) void {
         \\  --format <latex|plain>      TeX format (default: latex)
         \\  --deterministic             reproducible output (stable tags + timestamps)
         \\  --synctex                   enable synctex source references
+        \\  --profile                   per-macro expansion times in <jobname>.flame (and the .log)
+        \\  --command-index             commands and environments the document can use in <jobname>.cmds
+        \\  --memo-linebreaks           reuse line breaks of paragraphs unchanged since the last pass
+        \\  --incremental-pdf           (experimental) append only changed objects to the previous PDF, for watch
+        \\  --page-digests              a digest per page in <jobname>.pages.json, to tell which pages changed
+        \\  --preamble-format           dump the preamble into a format reused until it changes (on for watch)
+        \\  --xdv                       stop at <jobname>.xdv; `eztex pdf` writes the PDF from it
+        \\  --force                     compile even if no input changed since the PDF was written
+        \\  --externalize-tikz          typeset each TikZ picture once, into the cache, and include it from there
+        \\                              (typeset under the preamble alone: a \tikzset or colour defined in the
+        \\                              body and the font and colour around a picture are not seen; pictures
+        \\                              using \linewidth, \textwidth or \columnwidth stay in the document)
+        \\  --focus <file>              with --preview, typeset only the \include'd part holding <file>
+        \\  --pages <first-last>        with --preview, convert only these pages; the others stay blank
+        \\  --no-log                    with --preview, write no .log (warnings and errors still show)
+        \\  --image-dpi <n>             scale PNGs down to n dpi where placed (default: 150 preview, 0 = off for full)
+        \\  --draft-images              with --preview, put raster images in as gray boxes of their size
+        \\  --trace <file.json>         Chrome trace of format load, passes, pages, bibtex, fonts, fetches
         \\  --keep-intermediates        keep .aux, .log, .xdv files
         \\  --cache-dir <path>           override cache directory (native only)
+        \\  --jobs, -j <n>              batch worker processes (default: one per CPU)
+        \\  --server                    run on a running `eztex serve` (falls back to local)
+        \\  --socket <path>             server socket (default: <cache>/serve.sock)
+        \\  --max-cpu <seconds>         serve: stop a job after this much CPU time
+        \\  --max-memory <MiB>          serve: stop a job whose heap grows past this
         \\  --verbose, -v               show pass details and engine output
         \\  --help, -h                  show this help
         \\
+        \\environment:
+        \\  EZTEX_CACHE_MAX=<size>      trim the cache to this size (e.g. 500M, 2G) after each compile,
+        \\                              dropping the least recently used bundles and formats
+        \\
         \\project mode:
         \\  pass a directory or .zip file to auto-detect the main .tex file.
         \\  detection heuristics: single .tex file, \documentclass, known names
@@ -230,6 +434,8 @@ fn print_usage(io: Io) void {
         \\  eztex compile ./my-thesis/
         \\  eztex compile project.zip
         \\  eztex compile                          (uses main from eztex.zon)
+        \\  eztex serve                            (in another terminal)
+        \\  eztex paper.tex --server               compile on the warm server
         \\
     ;
     var buf: [4096]u8 = undefined;
@@ -280,28 +486,133 @@ fn do_init(io: Io) u8 {
     return 1;
 }
 
-// -- entry point --
+// -- compile server --
 
-pub fn main(init: std.process.Init) u8 {
+fn socket_path_or_default(opts: *const Options, buf: []u8) ?[]const u8 {
+    return opts.socket_path orelse Server.default_socket_path(buf);
+}
+
+fn do_serve(io: Io, opts: *const Options) u8 {
+    if (Host.is_wasm or builtin.os.tag == .windows) {
+        Log.log(io, "eztex", .err, "serve is only supported on POSIX systems", .{});
+        return 1;
+    }
+    var buf: [1024]u8 = undefined;
+    const socket_path = socket_path_or_default(opts, &buf) orelse {
+        Log.log(io, "eztex", .err, "no cache directory for the default socket, pass --socket", .{});
+        return 1;
+    };
+    if (opts.serve_stats) {
+        return Server.stats(io, socket_path) orelse {
+            Log.log(io, "eztex", .err, "no server at {s}", .{socket_path});
+            return 1;
+        };
+    }
+    Runtime.instance.?.resident = true;
+    serve_limits = opts.job_limits;
+    return Server.serve(io, socket_path, .{ .run = serve_job, .report = serve_report });
+}
+
+var serve_limits: Compiler.Limits = .{};
+
+// one `eztex serve` job: a forwarded compile or generate-format command line
+fn serve_job(io: Io, args: []const []const u8) u8 {
+    var it: SliceArgs = .{ .items = args };
+    var opts = parse_arg_list(io, &it);
+    opts.server = false;
+    Compiler.limits = serve_limits;
+    defer Compiler.limits = .{};
+    switch (opts.command) {
+        .compile, .generate_format, .pdf => return run_command(io, &opts),
+        else => {
+            Log.log(io, "eztex", .err, "serve only runs compile, pdf and generate-format jobs", .{});
+            return 2;
+        },
+    }
+}
+
+fn serve_report(w: *Io.Writer) Io.Writer.Error!void {
+    const stats = Compiler.cache_stats;
+    try w.print("compiles {d}\n", .{stats.compiles});
+    try w.print("memo_hits {d}\n", .{stats.memo_hits});
+    try w.print("remote_cache_hits {d}\n", .{stats.remote_hits});
+    try w.print("format_cache_hits {d}\n", .{stats.format_hits});
+    try w.print("format_cache_misses {d}\n", .{stats.format_misses});
+}
+
+// run this command line on a server; null when none answered
+fn try_forward(init: std.process.Init, opts: *const Options) ?u8 {
+    if (Host.is_wasm or builtin.os.tag == .windows) return null;
     const io = init.io;
+    var buf: [1024]u8 = undefined;
+    const socket_path = socket_path_or_default(opts, &buf) orelse return null;
 
-    // Set the global io for C ABI bridge callbacks (ttbc_* functions).
-    Engine.set_global_io(io);
+    var args = args_iterator(init) catch return null;
+    defer args.deinit();
+    _ = args.next(); // skip argv[0]
+    var list: [256][]const u8 = undefined;
+    var n: usize = 0;
+    while (args.next()) |arg| {
+        if (std.mem.eql(u8, arg, "--server")) continue;
+        if (n == list.len) return null;
+        list[n] = arg;
+        n += 1;
+    }
+    const code = Server.forward(io, socket_path, list[0..n]);
+    if (code == null) Log.log(io, "eztex", .warn, "no server at {s}, compiling locally", .{socket_path});
+    return code;
+}
 
-    // Create and activate the centralized Runtime.
-    var rt = Runtime.init(io);
-    rt.activate();
-    defer rt.deactivate();
+// -- batch compile --
 
-    var opts = parse_args(init);
+const BatchJob = struct {
+    // command line options before any eztex.zon is applied
+    opts: *const Options,
+
+    // compile one input from inside its directory, with that directory's eztex.zon
+    pub fn run_job(self: *const BatchJob, io: Io, input: []const u8) u8 {
+        var job = self.opts.*;
+        job.input_file = input;
+        job.extra_inputs = .empty;
+        return run_command(io, &job);
+    }
+};
+
+fn do_batch(io: Io, opts: *Options) u8 {
+    if (opts.cli_set.output_file) {
+        Log.log(io, "eztex", .err, "--output cannot be used with several inputs", .{});
+        return 1;
+    }
+    var inputs: std.ArrayList([]const u8) = .empty;
+    defer inputs.deinit(std.heap.c_allocator);
+    inputs.append(std.heap.c_allocator, opts.input_file.?) catch return 1;
+    inputs.appendSlice(std.heap.c_allocator, opts.extra_inputs.items) catch return 1;
+
+    // load the index, manifest and format once for every worker, using the
+    // first input's bundle; the store stays warm across jobs like in serve
+    Runtime.instance.?.resident = true;
+    var first = opts.*;
+    const warm_config = load_config(io, &first);
+    const warm_cc = first.to_compile_config();
+    Compiler.warm_up(io, &warm_cc, warm_config);
+
+    const jobs = opts.jobs orelse Batch.default_jobs(inputs.items.len);
+    const ctx: BatchJob = .{ .opts = opts };
+    const summary = Batch.run(io, inputs.items, jobs, &ctx);
+    Log.log(io, "eztex", .info, "batch: {d} succeeded, {d} failed", .{ summary.succeeded, summary.failed });
+    return if (summary.failed == 0) 0 else 1;
+}
 
-    var loaded_config: ?Config = null;
+// -- entry point --
+
+// eztex.zon next to the input (or in the current directory), applied to opts
+fn load_config(io: Io, opts: *Options) ?Config {
     if (opts.input_file) |input| {
         const config_dir = fs_path.dirname(input);
         if (Config.load(io, std.heap.c_allocator, config_dir)) |maybe_config| {
             if (maybe_config) |config| {
                 opts.apply_config(config);
-                loaded_config = config;
+                return config;
             }
         } else |_| {}
     } else if (opts.command == .compile or opts.command == .init) {
@@ -311,10 +622,16 @@ pub fn main(init: std.process.Init) u8 {
                     opts.input_file = main_file;
                 }
                 opts.apply_config(config);
-                loaded_config = config;
+                return config;
             }
         } else |_| {}
     }
+    return null;
+}
+
+fn run_command(io: Io, opts: *Options) u8 {
+    if (opts.command == .compile and opts.extra_inputs.items.len > 0) return do_batch(io, opts);
+    const loaded_config = load_config(io, opts);
 
     switch (opts.command) {
         .help => {
@@ -326,14 +643,77 @@ pub fn main(init: std.process.Init) u8 {
             return 0;
         },
         .init => return do_init(io),
+        .serve => return do_serve(io, opts),
         .watch => return Watcher.do_watch(io, opts.to_compile_config()),
         .compile => {
             const cc = opts.to_compile_config();
             return Compiler.compile(io, &cc, loaded_config);
         },
+        .pdf => {
+            const cc = opts.to_compile_config();
+            return Compiler.xdv_to_pdf(io, &cc, loaded_config);
+        },
         .generate_format => {
             const cc = opts.to_compile_config();
+            if (opts.all_formats) return Compiler.generate_all_formats(io, &cc);
             return Compiler.generate_format(io, &cc, loaded_config);
         },
     }
 }
+
+pub fn main(init: std.process.Init) u8 {
+    const io = init.io;
+
+    // Set the global io for C ABI bridge callbacks (ttbc_* functions).
+    Engine.set_global_io(io);
+
+    // Create and activate the centralized Runtime.
+    var rt = Runtime.init(io);
+    rt.activate();
+    defer rt.deactivate();
+
+    var opts = parse_args(init);
+    if (opts.server and (opts.command == .compile or opts.command == .generate_format)) {
+        if (try_forward(init, &opts)) |code| return code;
+    }
+    return run_command(io, &opts);
+}
+
+// -- resident wasm engine --
+// the web worker keeps one instance and calls eztex_run per compile instead
+// of instantiating the module and running _start each time. the runtime is
+// resident like `eztex serve`, so the bundle index, font caches and shared
+// engine data survive between compiles while run_command resets the engines.
+
+var resident_threaded: Io.Threaded = .init_single_threaded;
+var resident_runtime: ?Runtime = null;
+
+// args: NUL-separated command line without argv[0], e.g. "compile\x00main.tex"
+fn eztex_run(args_ptr: [*]const u8, args_len: usize) callconv(.c) u8 {
+    const io = resident_threaded.io();
+    if (resident_runtime == null) {
+        Engine.set_global_io(io);
+        resident_runtime = Runtime.init(io);
+        resident_runtime.?.resident = true;
+    }
+    resident_runtime.?.activate();
+    defer resident_runtime.?.deactivate();
+
+    var list: [256][]const u8 = undefined;
+    var n: usize = 0;
+    var it = std.mem.splitScalar(u8, args_ptr[0..args_len], 0);
+    while (it.next()) |arg| {
+        if (arg.len == 0) continue;
+        if (n == list.len) {
+            Log.log(io, "eztex", .err, "too many arguments", .{});
+            return 2;
+        }
+        list[n] = arg;
+        n += 1;
+    }
+    return serve_job(io, list[0..n]);
+}
+
+comptime {
+    if (Host.is_wasm) @export(&eztex_run, .{ .name = "eztex_run" });
+}
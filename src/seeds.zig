@@ -415,6 +415,99 @@ pub const xelatex_fmt = [_][]const u8{
     "zerohyph.tex",
 };
 
+// package files first compiles of common templates open beyond the init set,
+// most used first. the web app fetches them while idle after the first load
+// (precache_step in app/src/worker/engine.ts); names not in the bundle are
+// skipped.
+pub const popular = [_][]const u8{
+    "fontspec.sty",
+    "fontspec-xetex.sty",
+    "fontspec.cfg",
+    "amsthm.sty",
+    "mathtools.sty",
+    "mhsetup.sty",
+    "babel.sty",
+    "babel.def",
+    "english.ldf",
+    "natbib.sty",
+    "cleveref.sty",
+    "ifthen.sty",
+    "calc.sty",
+    "xspace.sty",
+    "setspace.sty",
+    "bm.sty",
+    "textcomp.sty",
+    "xkeyval.sty",
+    "tikz.sty",
+    "pgf.sty",
+    "pgfcore.sty",
+    "pgfrcs.sty",
+    "pgfrcs.code.tex",
+    "pgfutil-common.tex",
+    "pgfutil-latex.def",
+    "pgf.revision.tex",
+    "pgfsys.sty",
+    "pgfsys.code.tex",
+    "pgfsys-xetex.def",
+    "pgfsys-dvipdfmx.def",
+    "pgfsys-common-pdf.def",
+    "pgfsyssoftpath.code.tex",
+    "pgfsysprotocol.code.tex",
+    "pgfkeys.sty",
+    "pgfkeys.code.tex",
+    "pgfkeyslibraryfiltered.code.tex",
+    "pgfmath.sty",
+    "pgfmath.code.tex",
+    "pgfcore.code.tex",
+    "pgfcomp-version-0-65.sty",
+    "pgfcomp-version-1-18.sty",
+    "pgffor.sty",
+    "pgffor.code.tex",
+    "tikz.code.tex",
+    "siunitx.sty",
+    "algorithm.sty",
+    "algorithmicx.sty",
+    "algpseudocode.sty",
+    "wrapfig.sty",
+    "microtype.sty",
+    "microtype-xetex.def",
+    "microtype.cfg",
+    "csquotes.sty",
+    "csquotes.def",
+    "csquotes.cfg",
+    "lipsum.sty",
+    "lipsum.ltd.tex",
+    "fancyvrb.sty",
+    "upquote.sty",
+    "framed.sty",
+    "soul.sty",
+    "ulem.sty",
+    "ragged2e.sty",
+    "footmisc.sty",
+    "appendix.sty",
+    "lastpage.sty",
+    "mathrsfs.sty",
+    "dsfont.sty",
+    "cancel.sty",
+    "tcolorbox.sty",
+    "pdfpages.sty",
+    "eso-pic.sty",
+    "unicode-math.sty",
+    "unicode-math-xetex.sty",
+    "unicode-math-table.tex",
+    "latinmodern-math.otf",
+    "lmroman10-italic.otf",
+    "lmroman10-bolditalic.otf",
+    "lmsans10-regular.otf",
+    "lmmono10-regular.otf",
+    "report.cls",
+    "book.cls",
+    "size12.clo",
+    "bk10.clo",
+    "bk11.clo",
+    "bk12.clo",
+};
+
 // write newline-separated init seed list to buffer.
 // returns bytes written, or 0 if buffer too small.
 pub fn write_init_seed_list(out: [*]u8, cap: usize) usize {
@@ -441,3 +534,16 @@ pub fn write_format_gen_seed_list(out: [*]u8, cap: usize) usize {
     }
     return pos;
 }
+
+// write newline-separated popular package list to buffer.
+pub fn write_popular_list(out: [*]u8, cap: usize) usize {
+    var pos: usize = 0;
+    for (popular) |name| {
+        if (pos + name.len + 1 > cap) return 0;
+        @memcpy(out[pos..][0..name.len], name);
+        pos += name.len;
+        out[pos] = '\n';
+        pos += 1;
+    }
+    return pos;
+}
@@ -1,12 +1,16 @@
 // wasm_exports.zig -- WASM/WASI exported functions.
 //
 // Provides the eztex_* export surface called from JS:
-//   memory:     eztex_alloc, eztex_free
+//   memory:     eztex_alloc, eztex_free, eztex_reserve_heap
 //   index:      eztex_push_index (api_instance), eztex_query_index
 //   cache:      eztex_query_cache_version
 //   bundle:     eztex_query_bundle_url, eztex_query_index_url
-//   file lists: eztex_query_seed_init, eztex_query_seed_format
+//   format:     eztex_query_format_serial, eztex_query_format_url,
+//               eztex_query_format_cache_key
+//   file lists: eztex_query_seed_init, eztex_query_seed_format, eztex_query_seed_popular
 //   project:    eztex_query_main_file
+//   memory:     eztex_track_memory, eztex_query_memory_stats
+//   diagnostics: eztex_query_diagnostics
 //
 // This module is self-contained for freestanding wasm32 (no Host.zig, Engine.zig,
 // or BundleStore.zig dependencies). It implements its own minimal index store
@@ -25,84 +29,52 @@ else
 const Config = @import("Config.zig");
 const seeds = @import("seeds.zig");
 const MainDetect = @import("MainDetect.zig");
+const FormatCache = @import("FormatCache.zig");
 const Log = @import("Log.zig");
+const MemStats = @import("MemStats.zig");
+const DiagRecords = @import("DiagRecords.zig");
 
 // -- minimal wasm-only index store (no Host/Engine/BundleStore deps) --
 
-const IndexEntry = struct {
-    offset: u64,
-    length: u32,
-};
+const BundleIndex = @import("BundleIndex.zig");
+const IndexEntry = BundleIndex.Entry;
 
-var global_index: ?std.StringHashMap(IndexEntry) = null;
-var global_index_loaded: bool = false;
-
-fn ensure_index() *std.StringHashMap(IndexEntry) {
-    if (global_index == null) {
-        global_index = std.StringHashMap(IndexEntry).init(allocator);
-    }
-    return &(global_index.?);
-}
+// compiled index blob (owned) and the view over it
+var global_index_blob: ?[]u8 = null;
+var global_index: BundleIndex = .empty;
 
 fn clear_index() void {
-    if (global_index) |*idx| {
-        var it = idx.iterator();
-        while (it.next()) |entry| {
-            allocator.free(entry.key_ptr.*);
-        }
-        idx.clearRetainingCapacity();
-    }
-    global_index_loaded = false;
+    if (global_index_blob) |blob| allocator.free(blob);
+    global_index_blob = null;
+    global_index = .empty;
 }
 
-// parse ITAR index text into the global index. keys are lowercased for
-// case-insensitive lookup. clears any previously loaded index.
+// load ITAR index text, or an already compiled BundleIndex blob, into the
+// global index. clears any previously loaded index.
 fn parse_index(content: []const u8) !void {
     clear_index();
-    const idx = ensure_index();
-
-    var line_iter = std.mem.splitScalar(u8, content, '\n');
-    while (line_iter.next()) |line| {
-        const trimmed = std.mem.trim(u8, line, " \t\r");
-        if (trimmed.len == 0) continue;
-
-        var parts = std.mem.splitScalar(u8, trimmed, ' ');
-        const name = parts.next() orelse continue;
-        const offset_str = parts.next() orelse continue;
-        const length_str = parts.next() orelse continue;
-        if (name.len == 0) continue;
-        if (std.mem.eql(u8, name, "SVNREV") or std.mem.eql(u8, name, "GITHASH")) continue;
-
-        const offset = std.fmt.parseInt(u64, offset_str, 10) catch continue;
-        const length = std.fmt.parseInt(u32, length_str, 10) catch continue;
-
-        const owned_name = try allocator.dupe(u8, name);
-        ascii_lower(owned_name);
-        // handle duplicate keys: if key exists, free the new key and update value
-        const result = idx.fetchPut(owned_name, .{ .offset = offset, .length = length }) catch {
-            allocator.free(owned_name);
-            continue;
-        };
-        if (result) |old_entry| {
-            allocator.free(old_entry.key);
-        }
-    }
-    global_index_loaded = true;
+    const blob = if (BundleIndex.is_compiled(content))
+        try allocator.dupe(u8, content)
+    else
+        try BundleIndex.compile(allocator, content);
+    global_index = BundleIndex.open(blob) catch |err| {
+        allocator.free(blob);
+        return err;
+    };
+    global_index_blob = blob;
 }
 
 // resolve name to index entry, handling case-insensitive lookup and fonts/ prefix stripping.
 // index keys are stored lowercased, so we lowercase the query too.
 fn resolve_index_entry(name: []const u8) ?IndexEntry {
-    const idx = ensure_index();
-
     var buf: [1024]u8 = undefined;
     const lower = lower_into(&buf, name) orelse return null;
-    if (idx.get(lower)) |entry| return entry;
+    if (global_index.get(lower)) |entry| return entry;
 
     // try stripping fonts/ prefix (WASM fetches use bare names in index)
     const fonts_prefix = "fonts/";
     if (lower.len > fonts_prefix.len and std.mem.eql(u8, lower[0..fonts_prefix.len], fonts_prefix)) {
-        return idx.get(lower[fonts_prefix.len..]);
+        return global_index.get(lower[fonts_prefix.len..]);
     }
     return null;
 }
@@ -138,6 +110,16 @@ pub export fn eztex_free(ptr: [*]u8, size: usize) void {
     allocator.free(ptr[0..size]);
 }
 
+// grow the C heap by bytes with one memory.grow: a block allocated and freed
+// again stays with malloc (wasi-libc's dlmalloc never hands memory back), so
+// a fresh instance starts at the last compile's high-water mark instead of
+// growing, and copying the heap, page by page. no-op without libc.
+pub export fn eztex_reserve_heap(bytes: usize) void {
+    if (!builtin.link_libc) return;
+    const block = std.c.malloc(bytes) orelse return;
+    std.c.free(block);
+}
+
 // -- debug mode export --
 
 pub export fn eztex_set_debug(enabled: u32) void {
@@ -146,7 +128,7 @@ pub export fn eztex_set_debug(enabled: u32) void {
 
 // -- index management exports --
 
-// parse ITAR index text into the global index. used by the JS api_instance
+// load ITAR index text (or a compiled index) into the global index. used by the JS api_instance
 // for index_lookup queries (batch_fetch). returns 0 on success, -1 on error.
 pub export fn eztex_push_index(data_ptr: [*]const u8, data_len: usize) i32 {
     dbg_wasm("wasm_export", "eztex_push_index: {d} bytes", .{data_len});
@@ -155,18 +137,19 @@ pub export fn eztex_push_index(data_ptr: [*]const u8, data_len: usize) i32 {
         dbg_wasm("wasm_export", "eztex_push_index: parse failed: {}", .{err});
         return -1;
     };
-    const idx = ensure_index();
-    dbg_wasm("wasm_export", "eztex_push_index: success, {d} entries", .{idx.count()});
+    dbg_wasm("wasm_export", "eztex_push_index: success, {d} entries", .{global_index.count});
     return 0;
 }
 
 // query: look up index entry for Range request parameters.
-// returns 0 on success (writes offset/length to output pointers), -1 if not found.
+// returns 0 on success (writes offset/length/raw_length to output pointers),
+// -1 if not found. raw_length is 0 unless the entry is gzip-compressed.
 pub export fn eztex_query_index(
     name_ptr: [*]const u8,
     name_len: usize,
     out_offset: *u64,
     out_length: *u32,
+    out_raw_length: *u32,
 ) i32 {
     const name = name_ptr[0..name_len];
     dbg_wasm("wasm_export", "eztex_query_index: \"{s}\"", .{name});
@@ -176,6 +159,7 @@ pub export fn eztex_query_index(
     };
     out_offset.* = entry.offset;
     out_length.* = entry.length;
+    out_raw_length.* = entry.raw_length;
     dbg_wasm("wasm_export", "eztex_query_index: found offset={d} len={d}", .{ entry.offset, entry.length });
     return 0;
 }
@@ -209,40 +193,45 @@ pub export fn eztex_query_index_url(out_ptr: [*]u8, out_cap: usize) usize {
     return url.len;
 }
 
-// format serial number embedded in .fmt files (must match xetex_bindings.h)
-pub const FORMAT_SERIAL = 33;
+// format serial number embedded in .fmt files (must match FORMAT_SERIAL in
+// pkg/tectonic/src/engine_xetex/xetex_bindings.h, bumped with it)
+pub const FORMAT_SERIAL = 35;
 
 // return format serial number for JS-side validation.
 pub export fn eztex_query_format_serial() u32 {
     return FORMAT_SERIAL;
 }
 
+// published formats are named like the native format cache,
+// formats/<FormatCache.Key hash>.fmt: one immutable object per bundle digest,
+// engine version and format type (worker/generate-wasm-format.ts builds them).
+fn format_key(format_type: u32) ?FormatCache.Key {
+    const ft = std.enums.fromInt(FormatCache.FormatType, format_type) orelse return null;
+    return FormatCache.Key.init(&Config.default_bundle_digest, ft);
+}
+
 // build precompiled format download URL.
-// format: {bundle_base}/formats/xelatex_v{serial}_{target}_{digest_prefix}.fmt
+// format: {bundle_base}/formats/{key_hash}.fmt
 // where bundle_base is default_bundle_url with last path segment stripped.
-pub export fn eztex_query_format_url(out_ptr: [*]u8, out_cap: usize) usize {
+pub export fn eztex_query_format_url(format_type: u32, out_ptr: [*]u8, out_cap: usize) usize {
+    const key = format_key(format_type) orelse return 0;
     const bundle_url = Config.default_bundle_url;
     // find last '/' to get base URL
     const last_slash = std.mem.lastIndexOfScalar(u8, bundle_url, '/');
     const base = if (last_slash) |idx| bundle_url[0..idx] else bundle_url;
 
-    const digest_prefix = Config.default_bundle_digest[0..16];
-    const suffix = std.fmt.comptimePrint("/formats/xelatex_v{d}_wasm32-wasi_{s}.fmt", .{ FORMAT_SERIAL, digest_prefix });
-    const total = base.len + suffix.len;
-    if (out_cap < total) return 0;
-    @memcpy(out_ptr[0..base.len], base);
-    @memcpy(out_ptr[base.len..][0..suffix.len], suffix);
-    return total;
+    const name = key.hex_filename();
+    const out = std.fmt.bufPrint(out_ptr[0..out_cap], "{s}/formats/{s}", .{ base, &name }) catch return 0;
+    return out.len;
 }
 
-// return the OPFS cache key for format files.
-// format: formats/v{serial}_{digest_prefix}/xelatex.fmt
-pub export fn eztex_query_format_cache_key(out_ptr: [*]u8, out_cap: usize) usize {
-    const digest_prefix = Config.default_bundle_digest[0..16];
-    const key = std.fmt.comptimePrint("formats/v{d}_{s}/xelatex.fmt", .{ FORMAT_SERIAL, digest_prefix });
-    if (out_cap < key.len) return 0;
-    @memcpy(out_ptr[0..key.len], key);
-    return key.len;
+// return the OPFS cache key (and R2 object key) for format files.
+// format: formats/{key_hash}.fmt
+pub export fn eztex_query_format_cache_key(format_type: u32, out_ptr: [*]u8, out_cap: usize) usize {
+    const key = format_key(format_type) orelse return 0;
+    const name = key.hex_filename();
+    const out = std.fmt.bufPrint(out_ptr[0..out_cap], "formats/{s}", .{&name}) catch return 0;
+    return out.len;
 }
 
 // -- file list exports --
@@ -255,6 +244,10 @@ pub export fn eztex_query_seed_format(out_ptr: [*]u8, out_cap: usize) usize {
     return seeds.write_format_gen_seed_list(out_ptr, out_cap);
 }
 
+pub export fn eztex_query_seed_popular(out_ptr: [*]u8, out_cap: usize) usize {
+    return seeds.write_popular_list(out_ptr, out_cap);
+}
+
 // -- main file detection export --
 
 pub export fn eztex_query_main_file(
@@ -283,3 +276,32 @@ pub export fn eztex_query_main_file(
     @memcpy(out_ptr[0..result.len], result);
     return result.len;
 }
+
+// -- memory accounting exports --
+
+// count allocations per subsystem in every compile from now on (see
+// MemStats.zig); off by default, as the C side then keeps a pointer table
+pub export fn eztex_track_memory(enabled: u32) void {
+    MemStats.wanted = enabled != 0;
+}
+
+// the last compile's current and peak bytes per subsystem, as JSON, plus
+// "heap": the size of linear memory, which never shrinks. returns the length
+// written, 0 if out_cap is too small.
+pub export fn eztex_query_memory_stats(out_ptr: [*]u8, out_cap: usize) usize {
+    var w: std.Io.Writer = .fixed(out_ptr[0..out_cap]);
+    const heap: ?u64 = if (builtin.cpu.arch == .wasm32) @as(u64, @wasmMemorySize(0)) * 64 * 1024 else null;
+    MemStats.write_json(&w, MemStats.snapshot(), heap) catch return 0;
+    return w.end;
+}
+
+// -- diagnostics export --
+
+// the last compile's warnings and errors as DiagRecords.zig lays them out.
+// returns their length; copies nothing when out_cap is too small, so the
+// caller can allocate that much and ask again
+pub export fn eztex_query_diagnostics(out_ptr: [*]u8, out_cap: usize) usize {
+    const data = DiagRecords.bytes();
+    if (data.len <= out_cap) @memcpy(out_ptr[0..data.len], data);
+    return data.len;
+}
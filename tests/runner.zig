@@ -2,8 +2,10 @@
 // replaces tests/run_tests.sh with parallel execution via std.Thread.Pool
 //
 // usage: zig build test-integration
+//        zig build bench [-- bench options]   (see BenchOptions)
 //   argv[1] = path to eztex binary (injected by build.zig via addArtifactArg)
 //   argv[2] = path to tests/ directory
+//   argv[3..] = --bench and its options
 
 const std = @import("std");
 const fs = std.fs;
@@ -39,6 +41,8 @@ const test_cases = [_]TestCase{
     .{ .name = "basic_text", .tex_dir = "latex", .format = .latex },
     .{ .name = "bibtex_basic", .tex_dir = "latex", .format = .latex, .assets = &.{"refs.bib"} },
     .{ .name = "bibtex_missing_database", .tex_dir = "latex", .format = .latex, .expect_fail = true, .expect_blg_on_fail = true },
+    .{ .name = "bibtex_chapter_bibliographies", .tex_dir = "latex", .format = .latex, .assets = &.{"refs.bib"}, .companions = &.{ "bibchap1.tex", "bibchap2.tex" } },
+    .{ .name = "expl3_tikz_preamble", .tex_dir = "latex", .format = .latex },
     .{ .name = "fonts", .tex_dir = "latex", .format = .latex },
     .{ .name = "footnotes", .tex_dir = "latex", .format = .latex },
     .{ .name = "lists_and_tables", .tex_dir = "latex", .format = .latex },
@@ -62,6 +66,7 @@ const test_cases = [_]TestCase{
     },
     .{ .name = "issue393_ungetc", .tex_dir = "plain", .format = .plain, .assets = &.{"issue393_ungetc_trigger.pdf"} },
     .{ .name = "md5_of_hello", .tex_dir = "plain", .format = .plain },
+    .{ .name = "native_run_non_bmp", .tex_dir = "plain", .format = .plain },
     .{ .name = "negative_roman_numeral", .tex_dir = "plain", .format = .plain },
     .{ .name = "no_shell_escape", .tex_dir = "plain", .format = .plain },
     .{ .name = "otf_basic", .tex_dir = "plain", .format = .plain },
@@ -87,6 +92,13 @@ const test_cases = [_]TestCase{
     .{ .name = "tex_logo", .tex_dir = "plain", .format = .plain },
     .{ .name = "the_letter_a", .tex_dir = "plain", .format = .plain },
     .{ .name = "utf8_chars", .tex_dir = "plain", .format = .plain },
+    .{ .name = "webp_broken", .tex_dir = "plain", .format = .plain, .assets = &.{ "webp_truncated.webp", "webp_corrupt.webp" } },
+    .{ .name = "webp_formats", .tex_dir = "plain", .format = .plain, .assets = &.{
+        "webp_lossy.webp",
+        "webp_lossless.webp",
+        "webp_lossy_alpha.webp",
+        "webp_lossless_palette.webp",
+    } },
     .{ .name = "xetex_g_builtins", .tex_dir = "plain", .format = .plain },
     .{ .name = "xetex_ot_builtins", .tex_dir = "plain", .format = .plain },
 
@@ -97,6 +109,32 @@ const test_cases = [_]TestCase{
     .{ .name = "tectoniccodatokens_noend", .tex_dir = "plain", .format = .plain, .expect_fail = true },
 };
 
+// -- benchmark corpus (tests/bench/*.tex) -- run by zig build bench only --
+// representative loads rather than features. the text is generated at
+// compile time by bench/benchtext.tex, so the sources stay small and hold
+// no third-party content; bench_thesis.bib is synthetic.
+
+const bench_cases = [_]TestCase{
+    // ~300 pages, toc, lot, cross-references, bibtex
+    .{ .name = "bench_thesis", .tex_dir = "bench", .format = .latex, .companions = &.{ "benchtext.tex", "bench_thesis.bib" } },
+    // beamer with overlays, TikZ on every slide
+    .{ .name = "bench_beamer", .tex_dir = "bench", .format = .latex, .companions = &.{"benchtext.tex"} },
+    // pgfplots 2D and 3D
+    .{ .name = "bench_pgfplots", .tex_dir = "bench", .format = .latex, .companions = &.{"benchtext.tex"} },
+    // xeCJK with the Fandol fonts
+    .{ .name = "bench_cjk", .tex_dir = "bench", .format = .latex, .companions = &.{"benchtext.tex"} },
+    // 240 placed images
+    .{ .name = "bench_catalog", .tex_dir = "bench", .format = .latex, .companions = &.{"benchtext.tex"}, .assets = &.{
+        "redbox.png",
+        "png_rgba.png",
+        "png_rgba_16_bit.png",
+        "png_graya.png",
+        "png_palette_alpha.png",
+        "png_palette_4bit.png",
+        "png_gray_4bit.png",
+    } },
+};
+
 // -- per-test result (written once per slot, no mutex needed) --
 
 const Result = enum { pass, fail, skip };
@@ -195,42 +233,10 @@ fn runOneTestInner(
     const work_dir = try std.fmt.allocPrint(allocator, "{s}/{s}", .{ work_base, safe_name });
     defer allocator.free(work_dir);
 
-    // rm -rf and recreate
-    std.Io.Dir.deleteTree(.cwd(), io, work_dir) catch {};
-    try std.Io.Dir.createDirAbsolute(io, work_dir, @enumFromInt(0o755));
+    try prepareWorkDir(allocator, tests_root, work_dir, tc, io);
 
-    // resolve tex source directory
-    const tex_src_dir = try std.fmt.allocPrint(allocator, "{s}/{s}", .{ tests_root, tc.tex_dir });
-    defer allocator.free(tex_src_dir);
-
-    // copy .tex file
     const tex_filename = try std.fmt.allocPrint(allocator, "{s}.tex", .{tc.name});
     defer allocator.free(tex_filename);
-    {
-        const src = try std.fmt.allocPrint(allocator, "{s}/{s}", .{ tex_src_dir, tex_filename });
-        defer allocator.free(src);
-        const dst = try std.fmt.allocPrint(allocator, "{s}/{s}", .{ work_dir, tex_filename });
-        defer allocator.free(dst);
-        try copyFile(src, dst, io);
-    }
-
-    // copy companion files (from same tex_dir)
-    for (tc.companions) |comp| {
-        const src = try std.fmt.allocPrint(allocator, "{s}/{s}", .{ tex_src_dir, comp });
-        defer allocator.free(src);
-        const dst = try std.fmt.allocPrint(allocator, "{s}/{s}", .{ work_dir, comp });
-        defer allocator.free(dst);
-        try copyFile(src, dst, io);
-    }
-
-    // copy asset files (from tests/assets/)
-    for (tc.assets) |asset| {
-        const src = try std.fmt.allocPrint(allocator, "{s}/assets/{s}", .{ tests_root, asset });
-        defer allocator.free(src);
-        const dst = try std.fmt.allocPrint(allocator, "{s}/{s}", .{ work_dir, asset });
-        defer allocator.free(dst);
-        try copyFile(src, dst, io);
-    }
 
     // build argv
     var argv: std.ArrayListUnmanaged([]const u8) = .empty;
@@ -396,6 +402,46 @@ fn runOneTestInner(
     return validate(allocator, tc, work_dir, elapsed_ns_final, io);
 }
 
+// fresh copy of the case's .tex, companions and assets in work_dir
+fn prepareWorkDir(allocator: std.mem.Allocator, tests_root: []const u8, work_dir: []const u8, tc: TestCase, io: std.Io) !void {
+    // rm -rf and recreate
+    std.Io.Dir.deleteTree(.cwd(), io, work_dir) catch {};
+    try std.Io.Dir.createDirAbsolute(io, work_dir, @enumFromInt(0o755));
+
+    // resolve tex source directory
+    const tex_src_dir = try std.fmt.allocPrint(allocator, "{s}/{s}", .{ tests_root, tc.tex_dir });
+    defer allocator.free(tex_src_dir);
+
+    // copy .tex file
+    const tex_filename = try std.fmt.allocPrint(allocator, "{s}.tex", .{tc.name});
+    defer allocator.free(tex_filename);
+    {
+        const src = try std.fmt.allocPrint(allocator, "{s}/{s}", .{ tex_src_dir, tex_filename });
+        defer allocator.free(src);
+        const dst = try std.fmt.allocPrint(allocator, "{s}/{s}", .{ work_dir, tex_filename });
+        defer allocator.free(dst);
+        try copyFile(src, dst, io);
+    }
+
+    // copy companion files (from same tex_dir)
+    for (tc.companions) |comp| {
+        const src = try std.fmt.allocPrint(allocator, "{s}/{s}", .{ tex_src_dir, comp });
+        defer allocator.free(src);
+        const dst = try std.fmt.allocPrint(allocator, "{s}/{s}", .{ work_dir, comp });
+        defer allocator.free(dst);
+        try copyFile(src, dst, io);
+    }
+
+    // copy asset files (from tests/assets/)
+    for (tc.assets) |asset| {
+        const src = try std.fmt.allocPrint(allocator, "{s}/assets/{s}", .{ tests_root, asset });
+        defer allocator.free(src);
+        const dst = try std.fmt.allocPrint(allocator, "{s}/{s}", .{ work_dir, asset });
+        defer allocator.free(dst);
+        try copyFile(src, dst, io);
+    }
+}
+
 fn validate(allocator: std.mem.Allocator, tc: TestCase, work_dir: []const u8, elapsed: u64, io: std.Io) !TestResult {
     const pdf_path = try std.fmt.allocPrint(allocator, "{s}/{s}.pdf", .{ work_dir, tc.name });
     defer allocator.free(pdf_path);
@@ -552,6 +598,14 @@ fn toLower(c: u8) u8 {
     return if (c >= 'A' and c <= 'Z') c + 32 else c;
 }
 
+fn readFileAlloc(allocator: std.mem.Allocator, path: []const u8, io: std.Io) ![]u8 {
+    const file = try std.Io.Dir.openFileAbsolute(io, path, .{});
+    defer file.close(io);
+    var read_buf: [8192]u8 = undefined;
+    var reader = file.reader(io, &read_buf);
+    return reader.interface.allocRemaining(allocator, .unlimited);
+}
+
 fn writeLog(dir: []const u8, filename: []const u8, content: []const u8, allocator: std.mem.Allocator, io: std.Io) void {
     const path = std.fmt.allocPrint(allocator, "{s}/{s}", .{ dir, filename }) catch return;
     defer allocator.free(path);
@@ -632,6 +686,493 @@ fn printResults(io: std.Io) void {
     w.flush() catch {};
 }
 
+// -- benchmark mode --
+// every case that is expected to succeed is compiled cold (empty cache dir:
+// bundle fetches and format generation included) and then warm (the same
+// cache, fresh sources), each run with --trace. the trace gives the stages;
+// per case and mode the median of each figure goes to a JSON report, which
+// can be held against an earlier one with --baseline. the smoke-sized
+// test cases run first, then the bench_cases corpus; --filter bench_ keeps
+// only the latter.
+//
+// zig build bench -Doptimize=ReleaseFast -- --runs 5 --baseline bench.json
+
+const BenchOptions = struct {
+    warm_runs: usize = 3,
+    cold_runs: usize = 1,
+    // default <project>/tmp/bench.json
+    out_path: ?[]const u8 = null,
+    baseline_path: ?[]const u8 = null,
+    // a time regresses when it grows by more than threshold_pct and min_ms
+    threshold_pct: f64 = 10,
+    min_ms: f64 = 20,
+    // peak RSS and bytes fetched, which are steadier than times
+    bytes_threshold_pct: f64 = 5,
+    // only cases whose name contains this
+    filter: ?[]const u8 = null,
+};
+
+const max_runs = 64;
+const max_passes = 8;
+// a byte figure regresses only when it also grows by this much
+const min_regression_bytes: f64 = 64 * 1024;
+
+// the figures of one run, or the medians of several
+const Sample = struct {
+    wall_ms: f64 = 0,
+    // the "compile" span: everything but process start and exit
+    total_ms: f64 = 0,
+    format_load_ms: f64 = 0,
+    pass_ms: f64 = 0,
+    bibtex_ms: f64 = 0,
+    xdvipdfmx_ms: f64 = 0,
+    // FreeType and HarfBuzz setup, which TFM-only documents skip
+    font_init_ms: f64 = 0,
+    peak_rss_bytes: f64 = 0,
+    fetched_bytes: f64 = 0,
+    // each pass in order, the first max_passes of them
+    passes: [max_passes]f64 = @splat(0),
+    pass_count: usize = 0,
+};
+
+const Unit = enum { ms, bytes };
+
+// the figures reported and compared, by Sample field
+const metrics = [_]struct { field: []const u8, unit: Unit }{
+    .{ .field = "wall_ms", .unit = .ms },
+    .{ .field = "total_ms", .unit = .ms },
+    .{ .field = "format_load_ms", .unit = .ms },
+    .{ .field = "pass_ms", .unit = .ms },
+    .{ .field = "bibtex_ms", .unit = .ms },
+    .{ .field = "xdvipdfmx_ms", .unit = .ms },
+    .{ .field = "font_init_ms", .unit = .ms },
+    .{ .field = "peak_rss_bytes", .unit = .bytes },
+    .{ .field = "fetched_bytes", .unit = .bytes },
+};
+
+const CaseReport = struct {
+    name: []const u8,
+    cold: ?Sample = null,
+    warm: ?Sample = null,
+};
+
+const Mode = enum { cold, warm };
+
+// the parts of a --trace file the bench reads (see Timeline.write_json)
+const TraceArgs = struct {
+    detail: ?[]const u8 = null,
+    bytes: ?u64 = null,
+};
+
+const TraceEvent = struct {
+    name: []const u8,
+    dur: ?i64 = null,
+    args: ?TraceArgs = null,
+};
+
+const Trace = struct {
+    traceEvents: []const TraceEvent,
+};
+
+fn readTrace(allocator: std.mem.Allocator, path: []const u8, io: std.Io, sample: *Sample) !void {
+    const content = try readFileAlloc(allocator, path, io);
+    defer allocator.free(content);
+    const parsed = try std.json.parseFromSlice(Trace, allocator, content, .{ .ignore_unknown_fields = true });
+    defer parsed.deinit();
+
+    // parallel bibtex runs overlap; their enclosing span is the time taken
+    var bibtex_jobs_ms: ?f64 = null;
+    for (parsed.value.traceEvents) |e| {
+        const ms = @as(f64, @floatFromInt(e.dur orelse 0)) / 1000.0;
+        const bytes: f64 = if (e.args) |a| @floatFromInt(a.bytes orelse 0) else 0;
+        if (std.mem.eql(u8, e.name, "compile")) {
+            sample.total_ms += ms;
+        } else if (std.mem.eql(u8, e.name, "format load")) {
+            sample.format_load_ms += ms;
+        } else if (std.mem.eql(u8, e.name, "pass")) {
+            sample.pass_ms += ms;
+            if (sample.pass_count < max_passes) {
+                sample.passes[sample.pass_count] = ms;
+                sample.pass_count += 1;
+            }
+        } else if (std.mem.eql(u8, e.name, "bibtex")) {
+            sample.bibtex_ms += ms;
+        } else if (std.mem.eql(u8, e.name, "bibtex jobs")) {
+            bibtex_jobs_ms = ms;
+        } else if (std.mem.eql(u8, e.name, "xdvipdfmx")) {
+            sample.xdvipdfmx_ms += ms;
+        } else if (std.mem.eql(u8, e.name, "font init")) {
+            sample.font_init_ms += ms;
+        } else if (std.mem.eql(u8, e.name, "fetch") or std.mem.eql(u8, e.name, "seed fetch")) {
+            sample.fetched_bytes += bytes;
+        } else if (std.mem.eql(u8, e.name, "peak rss")) {
+            sample.peak_rss_bytes = @max(sample.peak_rss_bytes, bytes);
+        }
+    }
+    if (bibtex_jobs_ms) |ms| sample.bibtex_ms = ms;
+}
+
+fn median(values: []f64) f64 {
+    if (values.len == 0) return 0;
+    std.mem.sort(f64, values, {}, std.sort.asc(f64));
+    const mid = values.len / 2;
+    return if (values.len % 2 == 1) values[mid] else (values[mid - 1] + values[mid]) / 2;
+}
+
+fn summarize(samples: []const Sample) Sample {
+    var out: Sample = .{};
+    var values: [max_runs]f64 = undefined;
+    inline for (metrics) |m| {
+        for (samples, 0..) |sample, i| values[i] = @field(sample, m.field);
+        @field(out, m.field) = median(values[0..samples.len]);
+    }
+    out.pass_count = max_passes;
+    for (samples) |sample| out.pass_count = @min(out.pass_count, sample.pass_count);
+    for (0..out.pass_count) |p| {
+        for (samples, 0..) |sample, i| values[i] = sample.passes[p];
+        out.passes[p] = median(values[0..samples.len]);
+    }
+    return out;
+}
+
+// one traced compile of tc from fresh sources against cache_dir
+fn benchRun(
+    allocator: std.mem.Allocator,
+    eztex_path: []const u8,
+    tests_root: []const u8,
+    work_dir: []const u8,
+    cache_dir: []const u8,
+    timeout_s: u64,
+    io: std.Io,
+    tc: TestCase,
+) !Sample {
+    try prepareWorkDir(allocator, tests_root, work_dir, tc, io);
+
+    const tex_filename = try std.fmt.allocPrint(allocator, "{s}.tex", .{tc.name});
+    defer allocator.free(tex_filename);
+    const trace_path = try std.fmt.allocPrint(allocator, "{s}/trace.json", .{work_dir});
+    defer allocator.free(trace_path);
+
+    var argv: std.ArrayListUnmanaged([]const u8) = .empty;
+    defer argv.deinit(allocator);
+    try argv.append(allocator, eztex_path);
+    try argv.append(allocator, "compile");
+    try argv.append(allocator, tex_filename);
+    if (tc.format == .plain) {
+        try argv.append(allocator, "--format");
+        try argv.append(allocator, "plain");
+    }
+    for (tc.extra_args) |arg| try argv.append(allocator, arg);
+    try argv.appendSlice(allocator, &.{ "--cache-dir", cache_dir, "--trace", trace_path });
+
+    const timer_start = std.Io.Clock.Timestamp.now(io, .awake);
+    var child = try std.process.spawn(io, .{
+        .argv = argv.items,
+        .cwd = .{ .path = work_dir },
+        .stdout = .pipe,
+        .stderr = .pipe,
+    });
+    const child_pid = child.id orelse return error.InvalidChildPid;
+    var wd_ctx = WatchdogCtx{
+        .pid = child_pid,
+        .timeout_ns = timeout_s * std.time.ns_per_s,
+    };
+    const watchdog = std.Thread.spawn(.{}, watchdogFn, .{ &wd_ctx, io }) catch null;
+
+    // drain both pipes into logs, kept for a failing run
+    inline for (.{ .{ child.stdout, "stdout.log" }, .{ child.stderr, "stderr.log" } }) |pipe| {
+        if (pipe[0]) |file| {
+            var read_buf: [8192]u8 = undefined;
+            var reader = file.reader(io, &read_buf);
+            if (reader.interface.allocRemaining(allocator, .unlimited) catch null) |content| {
+                writeLog(work_dir, pipe[1], content, allocator, io);
+                allocator.free(content);
+            }
+        }
+    }
+
+    const term = child.wait(io) catch |err| {
+        wd_ctx.cancelled.store(true, .release);
+        if (watchdog) |wd| wd.join();
+        return err;
+    };
+    wd_ctx.cancelled.store(true, .release);
+    if (watchdog) |wd| wd.join();
+    const elapsed_ns: u64 = @intCast(@max(0, timer_start.untilNow(io).raw.nanoseconds));
+
+    switch (term) {
+        .exited => |code| if (code != 0) return error.CompileFailed,
+        .signal => |sig| return if (sig == .KILL) error.Timeout else error.CompileFailed,
+        else => return error.CompileFailed,
+    }
+
+    var sample: Sample = .{ .wall_ms = @as(f64, @floatFromInt(elapsed_ns)) / std.time.ns_per_ms };
+    try readTrace(allocator, trace_path, io, &sample);
+    return sample;
+}
+
+fn benchCase(
+    allocator: std.mem.Allocator,
+    eztex_path: []const u8,
+    tests_root: []const u8,
+    work_base: []const u8,
+    cache_dir: []const u8,
+    io: std.Io,
+    tc: TestCase,
+    opts: BenchOptions,
+    w: *std.Io.Writer,
+) !CaseReport {
+    var name_buf: [256]u8 = undefined;
+    const work_dir = try std.fmt.allocPrint(allocator, "{s}/{s}", .{ work_base, safeDirName(tc.name, &name_buf) });
+    defer allocator.free(work_dir);
+
+    var report: CaseReport = .{ .name = tc.name };
+    var samples: [max_runs]Sample = undefined;
+
+    for (0..opts.cold_runs) |i| {
+        std.Io.Dir.deleteTree(.cwd(), io, cache_dir) catch {};
+        samples[i] = try benchRun(allocator, eztex_path, tests_root, work_dir, cache_dir, first_run_timeout_s, io, tc);
+        try w.print("    cold {d}/{d}: {d:.0}ms\n", .{ i + 1, opts.cold_runs, samples[i].wall_ms });
+        try w.flush();
+    }
+    if (opts.cold_runs > 0) {
+        report.cold = summarize(samples[0..opts.cold_runs]);
+    } else if (opts.warm_runs > 0) {
+        // fill the cache (and the OS page cache); not counted
+        _ = try benchRun(allocator, eztex_path, tests_root, work_dir, cache_dir, first_run_timeout_s, io, tc);
+    }
+
+    for (0..opts.warm_runs) |i| {
+        samples[i] = try benchRun(allocator, eztex_path, tests_root, work_dir, cache_dir, default_timeout_s, io, tc);
+        try w.print("    warm {d}/{d}: {d:.0}ms\n", .{ i + 1, opts.warm_runs, samples[i].wall_ms });
+        try w.flush();
+    }
+    if (opts.warm_runs > 0) report.warm = summarize(samples[0..opts.warm_runs]);
+    return report;
+}
+
+fn printSample(w: *std.Io.Writer, mode: Mode, s: Sample) !void {
+    try w.print("    {s}: total {d:.0}ms  format {d:.0}ms  passes", .{ @tagName(mode), s.total_ms, s.format_load_ms });
+    for (s.passes[0..s.pass_count]) |ms| try w.print(" {d:.0}", .{ms});
+    try w.print("ms  bibtex {d:.0}ms  xdvipdfmx {d:.0}ms  font init {d:.1}ms  rss {d:.1}MiB  fetched {d:.1}MiB\n", .{
+        s.bibtex_ms,
+        s.xdvipdfmx_ms,
+        s.font_init_ms,
+        s.peak_rss_bytes / (1024 * 1024),
+        s.fetched_bytes / (1024 * 1024),
+    });
+}
+
+fn writeJsonString(out: *std.ArrayListUnmanaged(u8), allocator: std.mem.Allocator, text: []const u8) !void {
+    try out.append(allocator, '"');
+    for (text) |ch| switch (ch) {
+        '"' => try out.appendSlice(allocator, "\\\""),
+        '\\' => try out.appendSlice(allocator, "\\\\"),
+        0...0x1f => try out.print(allocator, "\\u{x:0>4}", .{ch}),
+        else => try out.append(allocator, ch),
+    };
+    try out.append(allocator, '"');
+}
+
+fn writeReport(allocator: std.mem.Allocator, reports: []const CaseReport, opts: BenchOptions, path: []const u8, io: std.Io) !void {
+    var out: std.ArrayListUnmanaged(u8) = .empty;
+    defer out.deinit(allocator);
+    try out.print(allocator, "{{\"version\":1,\"warm_runs\":{d},\"cold_runs\":{d},\"cases\":[", .{ opts.warm_runs, opts.cold_runs });
+    for (reports, 0..) |r, i| {
+        if (i > 0) try out.append(allocator, ',');
+        try out.appendSlice(allocator, "\n{\"name\":");
+        try writeJsonString(&out, allocator, r.name);
+        inline for (.{ Mode.cold, Mode.warm }) |mode| {
+            if (@field(r, @tagName(mode))) |s| {
+                try out.print(allocator, ",\"{s}\":{{", .{@tagName(mode)});
+                inline for (metrics, 0..) |m, j| {
+                    if (j > 0) try out.append(allocator, ',');
+                    switch (m.unit) {
+                        .ms => try out.print(allocator, "\"{s}\":{d:.1}", .{ m.field, @field(s, m.field) }),
+                        .bytes => try out.print(allocator, "\"{s}\":{d}", .{ m.field, @as(u64, @intFromFloat(@field(s, m.field))) }),
+                    }
+                }
+                try out.appendSlice(allocator, ",\"passes\":[");
+                for (s.passes[0..s.pass_count], 0..) |ms, p| {
+                    if (p > 0) try out.append(allocator, ',');
+                    try out.print(allocator, "{d:.1}", .{ms});
+                }
+                try out.appendSlice(allocator, "]}");
+            }
+        }
+        try out.append(allocator, '}');
+    }
+    try out.appendSlice(allocator, "\n]}\n");
+
+    const file = try std.Io.Dir.createFileAbsolute(io, path, .{});
+    defer file.close(io);
+    var buf: [4096]u8 = undefined;
+    var writer = file.writer(io, &buf);
+    try writer.interface.writeAll(out.items);
+    try writer.interface.flush();
+}
+
+fn jsonNumber(value: ?std.json.Value) ?f64 {
+    return switch (value orelse return null) {
+        .integer => |n| @floatFromInt(n),
+        .float => |f| f,
+        else => null,
+    };
+}
+
+// print each figure that grew past its threshold since the baseline report;
+// returns how many did. cases or figures the baseline lacks are not compared
+fn compareBaseline(
+    allocator: std.mem.Allocator,
+    reports: []const CaseReport,
+    opts: BenchOptions,
+    path: []const u8,
+    io: std.Io,
+    w: *std.Io.Writer,
+) !usize {
+    const content = try readFileAlloc(allocator, path, io);
+    defer allocator.free(content);
+    const parsed = try std.json.parseFromSlice(std.json.Value, allocator, content, .{});
+    defer parsed.deinit();
+
+    const cases = switch (parsed.value) {
+        .object => |root| switch (root.get("cases") orelse return error.InvalidBaseline) {
+            .array => |a| a.items,
+            else => return error.InvalidBaseline,
+        },
+        else => return error.InvalidBaseline,
+    };
+
+    var compared: usize = 0;
+    var regressions: usize = 0;
+    for (reports) |r| {
+        const base_case = for (cases) |c| {
+            if (c != .object) continue;
+            const name = c.object.get("name") orelse continue;
+            if (name == .string and std.mem.eql(u8, name.string, r.name)) break c.object;
+        } else continue;
+
+        inline for (.{ Mode.cold, Mode.warm }) |mode| {
+            const sample = @field(r, @tagName(mode));
+            const base_mode = base_case.get(@tagName(mode));
+            if (sample != null and base_mode != null and base_mode.? == .object) {
+                inline for (metrics) |m| {
+                    if (jsonNumber(base_mode.?.object.get(m.field))) |base| {
+                        const now = @field(sample.?, m.field);
+                        const pct = if (m.unit == .ms) opts.threshold_pct else opts.bytes_threshold_pct;
+                        const floor = if (m.unit == .ms) opts.min_ms else min_regression_bytes;
+                        compared += 1;
+                        if (now > base * (1 + pct / 100) and now - base >= floor) {
+                            regressions += 1;
+                            const growth = if (base > 0) (now / base - 1) * 100 else 100;
+                            try w.print("  {s}REGRESSION{s} {s} {s} {s}: {d:.1} -> {d:.1} (+{d:.1}%)\n", .{
+                                esc_red, esc_reset, r.name, @tagName(mode), m.field, base, now, growth,
+                            });
+                        }
+                    }
+                }
+            }
+        }
+    }
+    try w.print("\ncompared {d} figures against {s}: {d} regression(s)\n", .{ compared, path, regressions });
+    return regressions;
+}
+
+fn runBench(
+    allocator: std.mem.Allocator,
+    eztex_path: []const u8,
+    tests_root: []const u8,
+    project_root: []const u8,
+    work_base: []const u8,
+    cwd: []const u8,
+    opts: BenchOptions,
+    io: std.Io,
+) !u8 {
+    const stdout_file = std.Io.File.stdout();
+    var out_buf: [4096]u8 = undefined;
+    var file_writer = stdout_file.writer(io, &out_buf);
+    const w = &file_writer.interface;
+
+    const bench_base = try std.fmt.allocPrint(allocator, "{s}/bench", .{work_base});
+    defer allocator.free(bench_base);
+    std.Io.Dir.createDirAbsolute(io, bench_base, @enumFromInt(0o755)) catch |err| switch (err) {
+        error.PathAlreadyExists => {},
+        else => return err,
+    };
+    const cache_dir = try std.fmt.allocPrint(allocator, "{s}/cache", .{bench_base});
+    defer allocator.free(cache_dir);
+
+    const out_path = if (opts.out_path) |p|
+        try std.fs.path.resolve(allocator, &.{ cwd, p })
+    else
+        try std.fmt.allocPrint(allocator, "{s}/tmp/bench.json", .{project_root});
+    defer allocator.free(out_path);
+
+    try w.print("=== eztex benchmark ===\n", .{});
+    try w.print("binary: {s}\n", .{eztex_path});
+    try w.print("runs per case: {d} cold, {d} warm\n\n", .{ opts.cold_runs, opts.warm_runs });
+    try w.flush();
+
+    var reports: std.ArrayListUnmanaged(CaseReport) = .empty;
+    defer reports.deinit(allocator);
+    var failures: usize = 0;
+    for (&(test_cases ++ bench_cases)) |*tc| {
+        if (tc.skip or tc.expect_fail) continue;
+        if (opts.filter) |f| if (std.mem.indexOf(u8, tc.name, f) == null) continue;
+
+        try w.print("  {s}\n", .{tc.name});
+        try w.flush();
+        const report = benchCase(allocator, eztex_path, tests_root, bench_base, cache_dir, io, tc.*, opts, w) catch |err| {
+            failures += 1;
+            try w.print("    {s}[FAIL]{s} {s}\n", .{ esc_red, esc_reset, @errorName(err) });
+            continue;
+        };
+        if (report.cold) |s| try printSample(w, .cold, s);
+        if (report.warm) |s| try printSample(w, .warm, s);
+        try reports.append(allocator, report);
+    }
+
+    try writeReport(allocator, reports.items, opts, out_path, io);
+    try w.print("\nreport: {s}\n", .{out_path});
+
+    var regressions: usize = 0;
+    if (opts.baseline_path) |p| {
+        const baseline_path = try std.fs.path.resolve(allocator, &.{ cwd, p });
+        defer allocator.free(baseline_path);
+        regressions = try compareBaseline(allocator, reports.items, opts, baseline_path, io, w);
+    }
+    if (failures > 0) try w.print("{s}{s}{d} CASE(S) FAILED{s}\n", .{ esc_bold, esc_red, failures, esc_reset });
+    try w.flush();
+    return if (failures > 0 or regressions > 0) 1 else 0;
+}
+
+fn parseBenchArgs(args: anytype, opts: *BenchOptions) !void {
+    while (args.next()) |arg| {
+        if (std.mem.eql(u8, arg, "--bench")) continue;
+        const value = args.next() orelse return error.MissingValue;
+        if (std.mem.eql(u8, arg, "--runs")) {
+            opts.warm_runs = try std.fmt.parseInt(usize, value, 10);
+        } else if (std.mem.eql(u8, arg, "--cold-runs")) {
+            opts.cold_runs = try std.fmt.parseInt(usize, value, 10);
+        } else if (std.mem.eql(u8, arg, "--out")) {
+            opts.out_path = value;
+        } else if (std.mem.eql(u8, arg, "--baseline")) {
+            opts.baseline_path = value;
+        } else if (std.mem.eql(u8, arg, "--threshold")) {
+            opts.threshold_pct = try std.fmt.parseFloat(f64, value);
+        } else if (std.mem.eql(u8, arg, "--min-ms")) {
+            opts.min_ms = try std.fmt.parseFloat(f64, value);
+        } else if (std.mem.eql(u8, arg, "--bytes-threshold")) {
+            opts.bytes_threshold_pct = try std.fmt.parseFloat(f64, value);
+        } else if (std.mem.eql(u8, arg, "--filter")) {
+            opts.filter = value;
+        } else {
+            return error.UnknownOption;
+        }
+    }
+    if (opts.warm_runs > max_runs or opts.cold_runs > max_runs) return error.TooManyRuns;
+}
+
 // -- main --
 
 pub fn main(init: std.process.Init) !u8 {
@@ -643,11 +1184,17 @@ pub fn main(init: std.process.Init) !u8 {
     defer args.deinit();
     _ = args.next(); // skip argv[0]
     const eztex_path_raw = args.next() orelse {
-        std.debug.print("usage: test-runner <eztex-binary> <tests-dir>\n", .{});
+        std.debug.print("usage: test-runner <eztex-binary> <tests-dir> [--bench [options]]\n", .{});
         return 1;
     };
     const tests_root_raw = args.next() orelse {
-        std.debug.print("usage: test-runner <eztex-binary> <tests-dir>\n", .{});
+        std.debug.print("usage: test-runner <eztex-binary> <tests-dir> [--bench [options]]\n", .{});
+        return 1;
+    };
+    const bench = if (args.next()) |arg| std.mem.eql(u8, arg, "--bench") else false;
+    var bench_opts: BenchOptions = .{};
+    if (bench) parseBenchArgs(&args, &bench_opts) catch |err| {
+        std.debug.print("bench: {s}\noptions: --runs N --cold-runs N --out FILE --baseline FILE --threshold PCT --min-ms MS --bytes-threshold PCT --filter NAME\n", .{@errorName(err)});
         return 1;
     };
 
@@ -659,6 +1206,23 @@ pub fn main(init: std.process.Init) !u8 {
     const tests_root = try std.fs.path.resolve(allocator, &.{ cwd, tests_root_raw });
     defer allocator.free(tests_root);
 
+    // create work directory (sibling to tests_root: <project>/tmp/test_runs)
+    const project_root = std.fs.path.dirname(tests_root) orelse tests_root;
+    const work_base = try std.fmt.allocPrint(allocator, "{s}/tmp/test_runs", .{project_root});
+    defer allocator.free(work_base);
+    const tmp_dir = try std.fmt.allocPrint(allocator, "{s}/tmp", .{project_root});
+    defer allocator.free(tmp_dir);
+    std.Io.Dir.createDirAbsolute(init.io, tmp_dir, @enumFromInt(0o755)) catch |err| switch (err) {
+        error.PathAlreadyExists => {},
+        else => return err,
+    };
+    std.Io.Dir.createDirAbsolute(init.io, work_base, @enumFromInt(0o755)) catch |err| switch (err) {
+        error.PathAlreadyExists => {},
+        else => return err,
+    };
+
+    if (bench) return runBench(allocator, eztex_path, tests_root, project_root, work_base, cwd, bench_opts, init.io);
+
     const stdout_file = std.Io.File.stdout();
     var out_buf: [4096]u8 = undefined;
     var file_writer = stdout_file.writer(init.io, &out_buf);
@@ -687,21 +1251,6 @@ pub fn main(init: std.process.Init) !u8 {
     try w.print("running {d} tests ({d} skipped)\n\n", .{ active, skipped });
     try w.flush();
 
-    // create work directory (sibling to tests_root: <project>/tmp/test_runs)
-    const project_root = std.fs.path.dirname(tests_root) orelse tests_root;
-    const work_base = try std.fmt.allocPrint(allocator, "{s}/tmp/test_runs", .{project_root});
-    defer allocator.free(work_base);
-    const tmp_dir = try std.fmt.allocPrint(allocator, "{s}/tmp", .{project_root});
-    defer allocator.free(tmp_dir);
-    std.Io.Dir.createDirAbsolute(init.io, tmp_dir, @enumFromInt(0o755)) catch |err| switch (err) {
-        error.PathAlreadyExists => {},
-        else => return err,
-    };
-    std.Io.Dir.createDirAbsolute(init.io, work_base, @enumFromInt(0o755)) catch |err| switch (err) {
-        error.PathAlreadyExists => {},
-        else => return err,
-    };
-
     // run all tests sequentially
     inline for (0..test_cases.len) |i| {
         runOneTest(allocator, eztex_path, tests_root, work_base, timeout, init.io, i);
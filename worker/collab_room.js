@@ -3,7 +3,18 @@ import * as Y from "yjs";
 const ROOM_META_KEY = "room-meta";
 const YDOC_SNAPSHOT_KEY = "ydoc-snapshot";
 const LAST_COMPACTED_AT_KEY = "last-compacted-at";
+// updates since the snapshot, one merged batch per persist, keyed by a
+// zero-padded sequence number so storage lists them in order
+const YDOC_UPDATE_PREFIX = "ydoc-update:";
+// blob:<hash> holds a BlobManifest ({ size, chunks }) whose chunks live in the
+// shared chunk store, or the whole blob base64url-encoded in older rooms
 const BLOB_PREFIX = "blob:";
+// R2 prefix of the content-addressed blob chunks, shared by every room so an
+// image used in several projects is stored once (served by /collab/chunks/)
+export const CHUNK_PREFIX = "collab-chunks/";
+export const MAX_CHUNK_BYTES = 256 * 1024;
+const MAX_MANIFEST_CHUNKS = 256;
+const SHA256_HEX = /^[0-9a-f]{64}$/;
 const SEVEN_DAYS_MS = 7 * 24 * 60 * 60 * 1000;
 
 function is_room_deleted(meta) {
@@ -29,6 +40,21 @@ function base64url_decode(str) {
   return bytes;
 }
 
+async function sha256_hex(bytes) {
+  const digest = new Uint8Array(await crypto.subtle.digest("SHA-256", bytes));
+  return Array.from(digest).map((b) => b.toString(16).padStart(2, "0")).join("");
+}
+
+function is_valid_manifest(manifest) {
+  return manifest !== null
+    && typeof manifest === "object"
+    && Number.isInteger(manifest.size)
+    && manifest.size >= 0
+    && Array.isArray(manifest.chunks)
+    && manifest.chunks.length <= MAX_MANIFEST_CHUNKS
+    && manifest.chunks.every((c) => typeof c === "string" && SHA256_HEX.test(c));
+}
+
 async function hmac_truncated(secret_bytes, message_text) {
   const key = await crypto.subtle.importKey(
     "raw",
@@ -83,6 +109,87 @@ export const FrameKind = {
   Awareness: 3,
 };
 
+// the update log is folded into a new snapshot once it holds this many
+// batches, or once its bytes exceed both a floor and a share of the snapshot,
+// so a persist writes what changed and a big room is rewritten rarely
+const COMPACT_MAX_UPDATES = 256;
+const COMPACT_MIN_BYTES = 256 * 1024;
+const COMPACT_SNAPSHOT_RATIO = 0.5;
+const STORAGE_DELETE_BATCH = 128;
+
+function update_key(seq) {
+  return YDOC_UPDATE_PREFIX + String(seq).padStart(12, "0");
+}
+
+// doc updates and awareness from peers are fanned out once per window,
+// merged, rather than one frame per received frame per peer
+const FANOUT_BATCH_MS = 30;
+
+function encode_frame(kind, payload) {
+  const frame = new Uint8Array(payload.length + 1);
+  frame[0] = kind;
+  frame.set(payload, 1);
+  return frame;
+}
+
+function read_var_uint(bytes, at) {
+  let result = 0;
+  let shift = 0;
+  while (at.pos < bytes.length) {
+    const byte = bytes[at.pos++];
+    result += (byte & 0x7f) * 2 ** shift;
+    if ((byte & 0x80) === 0) return result;
+    shift += 7;
+  }
+  throw new Error("truncated varint");
+}
+
+function write_var_uint(out, value) {
+  while (value > 0x7f) {
+    out.push((value % 0x80) | 0x80);
+    value = Math.floor(value / 0x80);
+  }
+  out.push(value);
+}
+
+// awareness updates (y-protocols: count, then clientID, clock and JSON state
+// per client) merged into one, keeping each client's newest entry. entries
+// are copied as they are, never parsed.
+function merge_awareness_updates(updates) {
+  if (updates.length === 1) return updates[0];
+  const entries = new Map();
+  for (const bytes of updates) {
+    const at = { pos: 0 };
+    const count = read_var_uint(bytes, at);
+    for (let i = 0; i < count; i++) {
+      const start = at.pos;
+      const client = read_var_uint(bytes, at);
+      const clock = read_var_uint(bytes, at);
+      const len = read_var_uint(bytes, at);
+      at.pos += len;
+      if (at.pos > bytes.length) throw new Error("truncated awareness entry");
+      const prev = entries.get(client);
+      if (!prev || clock >= prev.clock) entries.set(client, { clock, bytes: bytes.subarray(start, at.pos) });
+    }
+  }
+  const head = [];
+  write_var_uint(head, entries.size);
+  let size = head.length;
+  for (const entry of entries.values()) size += entry.bytes.length;
+  const merged = new Uint8Array(size);
+  merged.set(head);
+  let pos = head.length;
+  for (const entry of entries.values()) {
+    merged.set(entry.bytes, pos);
+    pos += entry.bytes.length;
+  }
+  return merged;
+}
+
+function merge_doc_updates(updates) {
+  return updates.length === 1 ? updates[0] : Y.mergeUpdates(updates);
+}
+
 const MAX_AGENT_FRAME_BYTES = 512 * 1024;
 const MAX_AGENT_UPDATES_PER_MINUTE = 120;
 
@@ -96,6 +203,13 @@ export class CollabRoom {
     this._pending_updates = 0;
     this._persist_timer = null;
     this._agent_update_timestamps = new Map();
+    this._fanout = [];
+    this._fanout_timer = null;
+    // chunks a create reported missing from the chunk store, and the sockets
+    // allowed to upload them before they join
+    this._expected_chunks = new Set();
+    this._creators = new WeakSet();
+    this._reset_update_log(new Uint8Array(0), 0);
 
     this.ctx.blockConcurrencyWhile(async () => {
       const meta = await this.ctx.storage.get(ROOM_META_KEY);
@@ -103,8 +217,22 @@ export class CollabRoom {
 
       const snapshot = await this.ctx.storage.get(YDOC_SNAPSHOT_KEY);
       this.room_doc = new Y.Doc();
-      if (!is_room_deleted(this.room_meta) && snapshot && snapshot.byteLength > 0) {
-        Y.applyUpdate(this.room_doc, new Uint8Array(snapshot));
+      if (!is_room_deleted(this.room_meta)) {
+        if (snapshot && snapshot.byteLength > 0) {
+          const bytes = new Uint8Array(snapshot);
+          Y.applyUpdate(this.room_doc, bytes);
+          this._snapshot = bytes;
+        }
+        const updates = await this.ctx.storage.list({ prefix: YDOC_UPDATE_PREFIX });
+        for (const [key, value] of updates) {
+          const seq = Number(key.slice(YDOC_UPDATE_PREFIX.length));
+          const bytes = new Uint8Array(value);
+          Y.applyUpdate(this.room_doc, bytes);
+          if (this._log.length === 0) this._log_start = seq;
+          this._log.push(bytes);
+          this._log_bytes += bytes.byteLength;
+          this._log_seq = seq + 1;
+        }
       }
 
       for (const ws of this.ctx.getWebSockets()) {
@@ -144,6 +272,8 @@ export class CollabRoom {
         await this._handle_delete(ws, parsed);
       } else if (parsed.type === "join") {
         await this._handle_join(ws, parsed);
+      } else if (parsed.type === "blob-chunk-upload") {
+        await this._handle_chunk_upload(ws, peer, parsed);
       } else if (parsed.type === "ping") {
         ws.send(JSON.stringify({ type: "pong" }));
       } else if (
@@ -193,11 +323,11 @@ export class CollabRoom {
           ws.send(JSON.stringify({ type: "error", code: "invalid_update", message: "Invalid document update" }));
           return;
         }
-        this._broadcast_binary(bytes, ws);
+        this._queue_fanout(kind, payload, ws);
       } else if (kind === FrameKind.SyncStep1 || kind === FrameKind.SyncStep2) {
         this._broadcast_binary(bytes, ws);
       } else if (kind === FrameKind.Awareness) {
-        this._broadcast_binary(bytes, ws);
+        this._queue_fanout(kind, payload, ws);
       }
     }
   }
@@ -238,7 +368,7 @@ export class CollabRoom {
   }
 
   async _handle_create(ws, msg) {
-    const { room_id, room_secret, peer_id, identity, initial_state, blobs } = msg;
+    const { room_id, room_secret, peer_id, identity, initial_state, blobs, blob_manifests } = msg;
     let was_freshly_created = false;
 
     if (typeof room_id !== "string" || !room_id.startsWith("r_")) {
@@ -294,14 +424,20 @@ export class CollabRoom {
       if (initial_bytes && initial_bytes.byteLength > 0) {
         const bytes = new Uint8Array(initial_bytes);
         Y.applyUpdate(this.room_doc, bytes);
-        await this._persist_snapshot();
+        await this._compact();
       }
 
       if (blobs && typeof blobs === "object") {
         await this._store_blobs(blobs);
       }
+      let missing_chunks = [];
+      if (blob_manifests && typeof blob_manifests === "object") {
+        missing_chunks = await this._store_blob_manifests(blob_manifests);
+        for (const chunk of missing_chunks) this._expected_chunks.add(chunk);
+        this._creators.add(ws);
+      }
 
-      ws.send(JSON.stringify({ type: "created", room_id, snapshot_applied: !!initial_bytes }));
+      ws.send(JSON.stringify({ type: "created", room_id, snapshot_applied: !!initial_bytes, missing_chunks }));
     } catch (err) {
       console.error("Room create persistence failed:", err);
       ws.send(JSON.stringify({ type: "error", code: "create_failed", message: "Failed to persist room data" }));
@@ -310,10 +446,12 @@ export class CollabRoom {
       if (was_freshly_created) {
         this.room_meta = null;
         this.room_doc = new Y.Doc();
+        this._reset_update_log(new Uint8Array(0), 0);
         const blob_entries = await this.ctx.storage.list({ prefix: BLOB_PREFIX });
         await this.ctx.storage.delete(ROOM_META_KEY);
         await this.ctx.storage.delete(YDOC_SNAPSHOT_KEY);
         await this.ctx.storage.delete(LAST_COMPACTED_AT_KEY);
+        await this._delete_update_log();
         for (const key of blob_entries.keys()) {
           await this.ctx.storage.delete(key);
         }
@@ -355,14 +493,19 @@ export class CollabRoom {
     this.room_meta.last_active_at = Date.now();
     await this.ctx.storage.put(ROOM_META_KEY, this.room_meta);
 
-    const snapshot = Y.encodeStateAsUpdate(this.room_doc);
-    const blobs = await this._load_blobs();
+    // the last compacted snapshot, encoded once, and the updates since then
+    // merged into one, instead of encoding the whole document per join
+    if (this._snapshot_b64 === null) this._snapshot_b64 = base64url_encode(this._snapshot);
+    const tail = [...this._log, ...this._pending];
+    const { blobs, blob_manifests } = await this._load_blobs();
     ws.send(JSON.stringify({
       type: "joined",
       room_id,
       permission,
-      snapshot: base64url_encode(snapshot),
+      snapshot: this._snapshot_b64,
+      updates: tail.length > 0 ? [base64url_encode(Y.mergeUpdates(tail))] : [],
       blobs,
+      blob_manifests,
     }));
 
     this._broadcast_peer_count();
@@ -416,6 +559,7 @@ export class CollabRoom {
     }
     this._pending_updates = 0;
     this.room_doc = new Y.Doc();
+    this._reset_update_log(new Uint8Array(0), 0);
 
     await this.ctx.storage.put(ROOM_META_KEY, this.room_meta);
 
@@ -438,6 +582,7 @@ export class CollabRoom {
     const blob_entries = await this.ctx.storage.list({ prefix: BLOB_PREFIX });
     await this.ctx.storage.delete(YDOC_SNAPSHOT_KEY);
     await this.ctx.storage.delete(LAST_COMPACTED_AT_KEY);
+    await this._delete_update_log();
     for (const key of blob_entries.keys()) {
       await this.ctx.storage.delete(key);
     }
@@ -449,6 +594,7 @@ export class CollabRoom {
   _apply_update(update_bytes) {
     if (is_room_deleted(this.room_meta)) return;
     Y.applyUpdate(this.room_doc, update_bytes);
+    this._pending.push(update_bytes);
     this._pending_updates++;
     if (this._pending_updates >= 100) {
       this._debounced_persist(0);
@@ -463,18 +609,111 @@ export class CollabRoom {
     }
     this._persist_timer = setTimeout(() => {
       this._persist_timer = null;
-      this._persist_snapshot().catch((err) => {
-        console.error("Failed to persist room snapshot:", err);
+      this._persist_updates().catch((err) => {
+        console.error("Failed to persist room updates:", err);
       });
     }, delay_ms);
   }
 
-  async _persist_snapshot() {
+  _reset_update_log(snapshot, next_seq) {
+    this._snapshot = snapshot;
+    this._snapshot_b64 = null;
+    this._log = [];
+    this._log_bytes = 0;
+    this._log_start = next_seq;
+    this._log_seq = next_seq;
+    this._pending = [];
+  }
+
+  // append the updates since the last persist to the log as one batch, and
+  // compact once the log has grown past its thresholds
+  async _persist_updates() {
     if (is_room_deleted(this.room_meta)) return;
+    if (this._pending.length === 0) return;
+    const batch = this._pending.length === 1 ? this._pending[0] : Y.mergeUpdates(this._pending);
+    this._pending = [];
     this._pending_updates = 0;
+    const seq = this._log_seq++;
+    this._log.push(batch);
+    this._log_bytes += batch.byteLength;
+    await this.ctx.storage.put(update_key(seq), batch);
+
+    const log_limit = Math.max(COMPACT_MIN_BYTES, this._snapshot.byteLength * COMPACT_SNAPSHOT_RATIO);
+    if (this._log.length >= COMPACT_MAX_UPDATES || this._log_bytes >= log_limit) {
+      await this._compact();
+    }
+  }
+
+  // fold the whole document into a new snapshot and drop the log it covers.
+  // the snapshot is written first: replaying a leftover batch on load is
+  // harmless, as applying a Yjs update twice is a no-op.
+  async _compact() {
+    if (is_room_deleted(this.room_meta)) return;
     const snapshot = Y.encodeStateAsUpdate(this.room_doc);
-    await this.ctx.storage.put(YDOC_SNAPSHOT_KEY, snapshot);
-    await this.ctx.storage.put(LAST_COMPACTED_AT_KEY, Date.now());
+    const stale_start = this._log_start;
+    const stale_end = this._log_seq;
+    this._reset_update_log(snapshot, stale_end);
+    this._pending_updates = 0;
+    await this.ctx.storage.put({
+      [YDOC_SNAPSHOT_KEY]: snapshot,
+      [LAST_COMPACTED_AT_KEY]: Date.now(),
+    });
+    const stale = [];
+    for (let seq = stale_start; seq < stale_end; seq++) stale.push(update_key(seq));
+    for (let i = 0; i < stale.length; i += STORAGE_DELETE_BATCH) {
+      await this.ctx.storage.delete(stale.slice(i, i + STORAGE_DELETE_BATCH));
+    }
+  }
+
+  async _delete_update_log() {
+    const entries = await this.ctx.storage.list({ prefix: YDOC_UPDATE_PREFIX });
+    const keys = [...entries.keys()];
+    for (let i = 0; i < keys.length; i += STORAGE_DELETE_BATCH) {
+      await this.ctx.storage.delete(keys.slice(i, i + STORAGE_DELETE_BATCH));
+    }
+  }
+
+  _queue_fanout(kind, payload, from_ws) {
+    this._fanout.push({ kind, payload, from: from_ws });
+    if (!this._fanout_timer) {
+      this._fanout_timer = setTimeout(() => this._flush_fanout(), FANOUT_BATCH_MS);
+    }
+  }
+
+  // each peer gets at most one doc update and one awareness frame per
+  // window, merged from what the other peers sent. peers that sent nothing
+  // share the frames merged from everything.
+  _flush_fanout() {
+    this._fanout_timer = null;
+    const queued = this._fanout;
+    this._fanout = [];
+    if (queued.length === 0) return;
+    const senders = new Set(queued.map((item) => item.from));
+    const frames_for = (exclude_ws) => {
+      const frames = [];
+      for (const [kind, merge] of [[FrameKind.DocUpdate, merge_doc_updates], [FrameKind.Awareness, merge_awareness_updates]]) {
+        const payloads = queued.filter((item) => item.kind === kind && item.from !== exclude_ws).map((item) => item.payload);
+        if (payloads.length === 0) continue;
+        try {
+          frames.push(encode_frame(kind, merge(payloads)));
+        } catch (err) {
+          console.error("Failed to merge fan-out frames:", err);
+          for (const payload of payloads) frames.push(encode_frame(kind, payload));
+        }
+      }
+      return frames;
+    };
+    let shared = null;
+    for (const [ws] of this.peers) {
+      const frames = senders.has(ws) ? frames_for(ws) : (shared ??= frames_for(null));
+      for (const frame of frames) {
+        try {
+          ws.send(frame);
+        } catch {
+          // ignore send errors
+        }
+      }
+    }
   }
 
   _broadcast_binary(bytes, exclude_ws) {
@@ -543,19 +782,62 @@ export class CollabRoom {
     }
   }
 
+  // store the manifests and return the chunks the chunk store lacks
+  async _store_blob_manifests(manifests) {
+    const chunks = new Set();
+    for (const [hash, manifest] of Object.entries(manifests)) {
+      if (!SHA256_HEX.test(hash) || !is_valid_manifest(manifest)) continue;
+      await this.ctx.storage.put(BLOB_PREFIX + hash, { size: manifest.size, chunks: manifest.chunks });
+      for (const chunk of manifest.chunks) chunks.add(chunk);
+    }
+    const missing = [];
+    for (const chunk of chunks) {
+      if (!(await this.env.LATEX_ASSETS.head(CHUNK_PREFIX + chunk))) missing.push(chunk);
+    }
+    return missing;
+  }
+
+  async _handle_chunk_upload(ws, peer, msg) {
+    const { chunk, data } = msg;
+    if (typeof chunk !== "string" || typeof data !== "string") return;
+    if (!this._expected_chunks.has(chunk)) return;
+    if (!this._creators.has(ws) && peer?.permission !== "write") return;
+    if (data.length > Math.ceil(MAX_CHUNK_BYTES * 4 / 3) + 8) return;
+
+    let bytes;
+    try {
+      bytes = base64url_decode(data);
+    } catch {
+      return;
+    }
+    if (bytes.byteLength > MAX_CHUNK_BYTES || (await sha256_hex(bytes)) !== chunk) {
+      ws.send(JSON.stringify({ type: "error", code: "invalid_chunk", message: "Blob chunk does not match its hash" }));
+      return;
+    }
+    await this.env.LATEX_ASSETS.put(CHUNK_PREFIX + chunk, bytes, {
+      httpMetadata: { contentType: "application/octet-stream" },
+    });
+    this._expected_chunks.delete(chunk);
+  }
+
+  // legacy inline blobs and chunk manifests, by blob hash
   async _load_blobs() {
+    const blobs = {};
+    const blob_manifests = {};
     try {
       const entries = await this.ctx.storage.list({ prefix: BLOB_PREFIX });
-      const result = {};
       for (const [key, value] of entries) {
+        const hash = key.slice(BLOB_PREFIX.length);
         if (typeof value === "string") {
-          result[key.slice(BLOB_PREFIX.length)] = value;
+          blobs[hash] = value;
+        } else if (is_valid_manifest(value)) {
+          blob_manifests[hash] = value;
         }
       }
-      return result;
     } catch {
-      return {};
+      // join without blobs; peers can still send them
     }
+    return { blobs, blob_manifests };
   }
 
   _check_agent_rate(peer_id) {
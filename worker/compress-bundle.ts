@@ -0,0 +1,60 @@
+// compress-bundle.ts -- rewrite a bundle with gzip-compressed entries
+//
+// usage: bun run compress-bundle.ts <bundle> <index.gz> <out-bundle> <out-index.gz>
+//
+// each entry is stored as its own gzip member when that makes it smaller, and
+// as is otherwise. the index gains a fourth column, the inflated length, on
+// compressed entries only; eztex inflates those after fetching them, so they
+// stay independently addressable by Range requests and slices.
+
+import { gzipSync, gunzipSync } from "node:zlib";
+
+const [bundlePath, indexPath, outBundlePath, outIndexPath] = process.argv.slice(2);
+if (!bundlePath || !indexPath || !outBundlePath || !outIndexPath) {
+  console.error("usage: bun run compress-bundle.ts <bundle> <index.gz> <out-bundle> <out-index.gz>");
+  process.exit(1);
+}
+
+const bundle = Bun.file(bundlePath);
+const indexText = new TextDecoder().decode(gunzipSync(new Uint8Array(await Bun.file(indexPath).arrayBuffer())));
+
+const writer = Bun.file(outBundlePath).writer();
+const outLines: string[] = [];
+let offset = 0;
+let rawTotal = 0;
+let compressed = 0;
+
+for (const line of indexText.split("\n")) {
+  const parts = line.trim().split(" ");
+  if (parts.length < 3) {
+    if (line.trim().length > 0) outLines.push(line);
+    continue;
+  }
+  const [name, startStr, lengthStr] = parts;
+  const start = Number(startStr);
+  const length = Number(lengthStr);
+  if (!Number.isFinite(start) || !Number.isFinite(length)) {
+    outLines.push(line);
+    continue;
+  }
+
+  const raw = new Uint8Array(await bundle.slice(start, start + length).arrayBuffer());
+  const gz = gzipSync(raw, { level: 9 });
+  if (gz.byteLength < raw.byteLength) {
+    writer.write(gz);
+    outLines.push(`${name} ${offset} ${gz.byteLength} ${raw.byteLength}`);
+    offset += gz.byteLength;
+    compressed++;
+  } else {
+    writer.write(raw);
+    outLines.push(`${name} ${offset} ${raw.byteLength}`);
+    offset += raw.byteLength;
+  }
+  rawTotal += raw.byteLength;
+}
+await writer.end();
+
+await Bun.write(outIndexPath, gzipSync(new TextEncoder().encode(outLines.join("\n") + "\n")));
+
+console.log(`${outLines.length} entries, ${compressed} compressed`);
+console.log(`  ${(rawTotal / 1024 ** 2).toFixed(1)} MiB -> ${(offset / 1024 ** 2).toFixed(1)} MiB`);
@@ -1,21 +1,27 @@
-// generate-wasm-format.ts -- generate xelatex.fmt using the WASM engine under Bun.
-// this ensures the format is 100% compatible with the WASM build.
+// generate-wasm-format.ts -- generate every published format using the WASM engine under Bun.
+// this ensures the formats are 100% compatible with the WASM build.
 //
 // usage:
 //   cd worker
-//   bun run generate-wasm-format.ts
+//   bun run generate-wasm-format.ts [out-dir]
 //
 // The script:
 // 1. Loads the WASM module from ../zig-out/bin/eztex.wasm
-// 2. Queries the seed file list from Zig exports
+// 2. Queries the seed file list and each format's object key from Zig exports
 // 3. Fetches the ITAR bundle index
 // 4. Pre-fetches all seed files via HTTP Range
-// 5. Creates a WASI filesystem with the seed files
-// 6. Runs 'eztex generate-format' in WASM
-// 7. Extracts tmp/xelatex.fmt and writes to assets/
-// 8. Prints the upload command
+// 5. Runs 'eztex generate-format --format <name>' in WASM for each format,
+//    fetching whatever files a run asked for and was missing before rerunning
+// 6. Writes each format to <out-dir>/<key hash>.fmt plus a manifest.json
+// 7. Prints the upload command
+//
+// Object keys are FormatCache.Key hashes (bundle digest, engine version,
+// format type), so every object is immutable: a new bundle or engine gets
+// new keys instead of overwriting old formats.
 
 import path from "path";
+import { createHash } from "crypto";
+import { gunzipSync } from "node:zlib";
 import {
   WASI,
   File as WasiFile,
@@ -29,16 +35,54 @@ const BUNDLE_URL = "https://eztex.thuvasooriya.me/bundle";
 const INDEX_URL = "https://eztex.thuvasooriya.me/index.gz";
 const WASM_PATH = "../zig-out/bin/eztex.wasm";
 const ASSETS_DIR = "assets";
+// reruns allowed for files a run found missing
+const MAX_ROUNDS = 4;
+
+// engine format name -> FormatCache.FormatType for the XeTeX backend
+const FORMATS = [
+  { name: "latex", type: 0, file: "xelatex.fmt", initex: "_make_xelatex_fmt.fmt" },
+  { name: "plain", type: 1, file: "plain.fmt", initex: "_make_plain_fmt.fmt" },
+];
+
+const outputDir = process.argv[2] ?? path.join(ASSETS_DIR, "formats");
 
-const defaultOutputPath = path.join(ASSETS_DIR, "xelatex_v33_wasm32-wasi_c1607948053fc5d4.fmt");
-const outputPath = process.argv[2] ?? defaultOutputPath;
+// missing-file names recorded by js_request_range during a run
+let missing = new Set<string>();
+let runInstanceRef: WebAssembly.Instance | null = null;
+
+function envImports() {
+  return {
+    dup() {
+      return -1;
+    },
+    // Bun has no sync fetch: record the name, fail the open, fetch it before the next round
+    js_request_range(name_ptr: number, name_len: number) {
+      if (runInstanceRef) {
+        const mem = new Uint8Array((runInstanceRef.exports.memory as WebAssembly.Memory).buffer);
+        missing.add(new TextDecoder().decode(mem.subarray(name_ptr, name_ptr + name_len)));
+      }
+      return -1;
+    },
+    js_prefetch_ranges() {
+      return -1;
+    },
+    js_cache_put() {},
+    js_request_index() {
+      return -1;
+    },
+    js_format_image_get() {
+      return -1;
+    },
+    js_format_image_put() {},
+  };
+}
 
 // -- load wasm --
 console.log("loading WASM module...");
 const wasmBytes = await Bun.file(WASM_PATH).arrayBuffer();
 const wasmModule = await WebAssembly.compile(wasmBytes);
 
-// -- create minimal api_instance to query seed lists --
+// -- create minimal api_instance to query seed lists and format keys --
 const apiFds = [
   new OpenFile(new WasiFile(new Uint8Array())),
   ConsoleStdout.lineBuffered(() => {}),
@@ -47,17 +91,7 @@ const apiFds = [
 const apiWasi = new WASI([], [], apiFds);
 const apiInstance = new WebAssembly.Instance(wasmModule, {
   wasi_snapshot_preview1: apiWasi.wasiImport,
-  env: {
-    dup() {
-      return -1;
-    },
-    js_request_range() {
-      return -1;
-    },
-    js_request_index() {
-      return -1;
-    },
-  },
+  env: envImports(),
 });
 apiWasi.initialize(apiInstance);
 
@@ -68,8 +102,13 @@ const exports = apiInstance.exports as unknown as {
   eztex_query_seed_init(out_ptr: number, out_cap: number): number;
   eztex_query_seed_format(out_ptr: number, out_cap: number): number;
   eztex_query_bundle_url(out_ptr: number, out_cap: number): number;
+  eztex_query_format_cache_key(format_type: number, out_ptr: number, out_cap: number): number;
+  eztex_query_format_serial(): number;
 };
 
+// the serial the engine writes into formats, straight from the build
+const FORMAT_SERIAL = exports.eztex_query_format_serial();
+
 function readExportString(getter: (out_ptr: number, out_cap: number) => number): string {
   const cap = 32768;
   const ptr = exports.eztex_alloc(cap);
@@ -97,16 +136,12 @@ if (!indexResp.ok) throw new Error(`index fetch failed: HTTP ${indexResp.status}
 const compressed = new Uint8Array(await indexResp.arrayBuffer());
 console.log(`index downloaded (${compressed.length} bytes compressed)`);
 
-const ds = new DecompressionStream("gzip");
-const writer = ds.writable.getWriter();
-writer.write(compressed);
-writer.close();
-const decompressed = await new Response(ds.readable).arrayBuffer();
-const indexText = new TextDecoder().decode(decompressed);
+const indexText = new TextDecoder().decode(gunzipSync(compressed));
 console.log(`index decompressed (${indexText.length} bytes)`);
 
-// parse index into Map<name, {offset, length}>
-const index = new Map<string, { offset: number; length: number }>();
+// parse index into Map<name, {offset, length, rawLength}>; rawLength is set on
+// gzip-compressed entries (see compress-bundle.ts)
+const index = new Map<string, { offset: number; length: number; rawLength: number }>();
 for (const line of indexText.split("\n")) {
   const trimmed = line.trim();
   if (!trimmed || trimmed.startsWith("SVNREV") || trimmed.startsWith("GITHASH")) continue;
@@ -115,52 +150,48 @@ for (const line of indexText.split("\n")) {
   const name = parts[0].toLowerCase();
   const offset = parseInt(parts[1], 10);
   const length = parseInt(parts[2], 10);
+  const rawLength = parts.length > 3 ? parseInt(parts[3], 10) : 0;
   if (!isNaN(offset) && !isNaN(length)) {
-    index.set(name, { offset, length });
+    index.set(name, { offset, length, rawLength: isNaN(rawLength) ? 0 : rawLength });
   }
 }
 console.log(`index entries: ${index.size}`);
 
-// -- pre-fetch seed files --
-const allSeeds = [...new Set([...initSeeds, ...formatSeeds])];
+// -- fetch bundle files --
 const cachedFiles = new Map<string, Uint8Array>();
 
-console.log(`pre-fetching ${allSeeds.length} seed files...`);
-let fetched = 0;
-let failed = 0;
-
-for (const name of allSeeds) {
-  const entry = index.get(name.toLowerCase());
-  if (!entry) {
-    failed++;
-    continue;
-  }
-
-  const rangeEnd = entry.offset + entry.length - 1;
-  try {
-    const resp = await fetch(BUNDLE_URL, {
-      headers: { Range: `bytes=${entry.offset}-${rangeEnd}` },
-      signal: AbortSignal.timeout(30000),
-    });
-    if (!resp.ok) {
-      failed++;
-      continue;
+async function fetchFiles(names: string[]): Promise<number> {
+  let fetched = 0;
+  for (const name of names) {
+    if (cachedFiles.has(name)) continue;
+    const key = name.toLowerCase();
+    const entry = index.get(key) ?? (key.startsWith("fonts/") ? index.get(key.slice(6)) : undefined);
+    if (!entry) continue;
+
+    const rangeEnd = entry.offset + entry.length - 1;
+    try {
+      const resp = await fetch(BUNDLE_URL, {
+        headers: { Range: `bytes=${entry.offset}-${rangeEnd}` },
+        signal: AbortSignal.timeout(30000),
+      });
+      if (!resp.ok) continue;
+      let data = new Uint8Array(await resp.arrayBuffer());
+      if (entry.rawLength !== 0 && data.byteLength !== entry.rawLength) data = new Uint8Array(gunzipSync(data));
+      cachedFiles.set(name, data);
+      fetched++;
+    } catch {
+      // reported as missing by the next run
     }
-    const data = new Uint8Array(await resp.arrayBuffer());
-    cachedFiles.set(name, data);
-    fetched++;
-  } catch {
-    failed++;
   }
+  return fetched;
 }
 
-console.log(`fetched ${fetched} files, ${failed} failed`);
+const allSeeds = [...new Set([...initSeeds, ...formatSeeds])];
+console.log(`pre-fetching ${allSeeds.length} seed files...`);
+const seeded = await fetchFiles(allSeeds);
+console.log(`fetched ${seeded} files, ${allSeeds.length - seeded} failed`);
 
 // -- build WASI filesystem --
-const rootMap = new Map<string, WasiFile | Directory>();
-const fontsMap = new Map<string, WasiFile | Directory>();
-const tmpMap = new Map<string, WasiFile | Directory>();
-
 function ensureDir(parent: Map<string, WasiFile | Directory>, name: string): Map<string, WasiFile | Directory> {
   const existing = parent.get(name);
   if (existing instanceof Directory) return existing.contents;
@@ -182,86 +213,118 @@ function placeFile(root: Map<string, WasiFile | Directory>, filePath: string, da
   current.set(parts[parts.length - 1], new WasiFile(data));
 }
 
-for (const [name, data] of cachedFiles) {
-  if (name.startsWith("fonts/")) {
-    fontsMap.set(name.slice(6), new WasiFile(new Uint8Array(data)));
-  } else {
-    placeFile(rootMap, name, new Uint8Array(data));
+function buildFilesystem() {
+  const rootMap = new Map<string, WasiFile | Directory>();
+  const fontsMap = new Map<string, WasiFile | Directory>();
+  const tmpMap = new Map<string, WasiFile | Directory>();
+  for (const [name, data] of cachedFiles) {
+    if (name.startsWith("fonts/")) {
+      fontsMap.set(name.slice(6), new WasiFile(new Uint8Array(data)));
+    } else {
+      placeFile(rootMap, name, new Uint8Array(data));
+    }
   }
+  rootMap.set("fonts", new Directory(fontsMap));
+  rootMap.set("tmp", new Directory(tmpMap));
+  return { rootMap, tmpMap };
 }
 
-rootMap.set("fonts", new Directory(fontsMap));
-rootMap.set("tmp", new Directory(tmpMap));
-
-console.log(`WASI filesystem: ${cachedFiles.size} files + fonts dir`);
-
 // -- run generate-format in WASM --
-console.log("running WASM generate-format...");
-const runFds = [
-  new OpenFile(new WasiFile(new Uint8Array())),
-  ConsoleStdout.lineBuffered((line: string) => console.log("[stdout]", line)),
-  ConsoleStdout.lineBuffered((line: string) => console.log("[stderr]", line)),
-  new PreopenDirectory(".", rootMap),
-];
-const runWasi = new WASI(["eztex", "generate-format"], [], runFds);
-
-const runInstance = new WebAssembly.Instance(wasmModule, {
-  wasi_snapshot_preview1: runWasi.wasiImport,
-  env: {
-    dup() {
-      return -1;
-    },
-    js_request_range() {
-      return -1;
-    },
-    js_request_index() {
-      return -1;
-    },
-  },
-});
-
-let exitCode: number;
-try {
-  exitCode = runWasi.start(runInstance);
-} catch (e: any) {
-  if (e.exit_code !== undefined) {
-    exitCode = e.exit_code;
-  } else {
-    console.error("WASM runtime error:", e.message);
-    exitCode = 1;
+function runGenerate(format: string): { exitCode: number; tmpMap: Map<string, WasiFile | Directory> } {
+  const { rootMap, tmpMap } = buildFilesystem();
+  const runFds = [
+    new OpenFile(new WasiFile(new Uint8Array())),
+    ConsoleStdout.lineBuffered((line: string) => console.log("[stdout]", line)),
+    ConsoleStdout.lineBuffered((line: string) => console.log("[stderr]", line)),
+    new PreopenDirectory(".", rootMap),
+  ];
+  const runWasi = new WASI(["eztex", "generate-format", "--format", format], [], runFds);
+  const runInstance = new WebAssembly.Instance(wasmModule, {
+    wasi_snapshot_preview1: runWasi.wasiImport,
+    env: envImports(),
+  });
+  runInstanceRef = runInstance;
+
+  let exitCode: number;
+  try {
+    exitCode = runWasi.start(runInstance);
+  } catch (e: any) {
+    if (e.exit_code !== undefined) {
+      exitCode = e.exit_code;
+    } else {
+      console.error("WASM runtime error:", e.message);
+      exitCode = 1;
+    }
   }
+  runInstanceRef = null;
+  return { exitCode, tmpMap };
 }
 
-console.log(`WASM exit code: ${exitCode}`);
+function validate(fmtBytes: Uint8Array): boolean {
+  const magic = new TextDecoder().decode(fmtBytes.slice(0, 4));
+  const serial = new DataView(fmtBytes.buffer, fmtBytes.byteOffset, fmtBytes.byteLength).getUint32(4, false);
+  console.log(`format magic: "${magic}", serial: ${serial}`);
+  return magic === "TTNC" && serial === FORMAT_SERIAL;
+}
 
-// -- extract format --
-const fmtFile = tmpMap.get("xelatex.fmt") ?? tmpMap.get("_make_xelatex_fmt.fmt");
-if (!fmtFile || !(fmtFile instanceof WasiFile) || !fmtFile.data || fmtFile.data.byteLength === 0) {
-  console.error("ERROR: no format file found in tmp/");
-  process.exit(1);
+interface ManifestEntry {
+  format: string;
+  key: string;
+  size: number;
+  sha256: string;
 }
+const manifest: ManifestEntry[] = [];
 
-const fmtBytes = new Uint8Array(fmtFile.data);
-console.log(`format generated: ${fmtBytes.length} bytes`);
+for (const format of FORMATS) {
+  const key = readExportString((p, c) => exports.eztex_query_format_cache_key(format.type, p, c));
+  if (!key) {
+    console.error(`ERROR: no object key for format type ${format.type}`);
+    process.exit(1);
+  }
+  console.log(`\n-- ${format.file} -> ${key} --`);
+
+  let fmtFile: WasiFile | Directory | undefined;
+  for (let round = 0; round < MAX_ROUNDS; round++) {
+    missing = new Set();
+    console.log(`running WASM generate-format --format ${format.name}...`);
+    const { exitCode, tmpMap } = runGenerate(format.name);
+    console.log(`WASM exit code: ${exitCode}`);
+    fmtFile = tmpMap.get(format.file) ?? tmpMap.get(format.initex);
+    if (exitCode === 0 && fmtFile) break;
+
+    const wanted = [...missing].filter((name) => !cachedFiles.has(name));
+    if (wanted.length === 0) break;
+    console.log(`fetching ${wanted.length} files the run asked for...`);
+    if ((await fetchFiles(wanted)) === 0) break;
+  }
 
-// validate header
-const magic = new TextDecoder().decode(fmtBytes.slice(0, 4));
-const serial = new DataView(fmtBytes.buffer, fmtBytes.byteOffset, fmtBytes.byteLength).getUint32(4, false);
-console.log(`format magic: "${magic}", serial: ${serial}`);
+  if (!fmtFile || !(fmtFile instanceof WasiFile) || !fmtFile.data || fmtFile.data.byteLength === 0) {
+    console.error(`ERROR: no ${format.file} found in tmp/`);
+    process.exit(1);
+  }
 
-if (magic !== "TTNC" || serial !== 33) {
-  console.error("ERROR: format validation failed");
-  process.exit(1);
+  const fmtBytes = new Uint8Array(fmtFile.data);
+  console.log(`format generated: ${fmtBytes.length} bytes`);
+  if (!validate(fmtBytes)) {
+    console.error("ERROR: format validation failed");
+    process.exit(1);
+  }
+
+  const outputPath = path.join(outputDir, path.basename(key));
+  await Bun.write(outputPath, fmtBytes);
+  const sha256 = createHash("sha256").update(fmtBytes).digest("hex");
+  manifest.push({ format: format.file, key, size: fmtBytes.length, sha256 });
+  console.log(`written to ${outputPath} (sha256 ${sha256.slice(0, 16)}...)`);
 }
 
-await Bun.write(outputPath, fmtBytes);
-console.log(`written to ${outputPath}`);
+await Bun.write(path.join(outputDir, "manifest.json"), JSON.stringify(manifest, null, 2) + "\n");
 
 console.log("\n--- Next steps ---");
 console.log("Upload to R2:");
 console.log(`  bun run upload-format`);
 console.log("\nOr manually:");
-const objectKey = `formats/${path.basename(outputPath)}`;
-console.log(`  bun run upload ${outputPath} ${objectKey}`);
+for (const entry of manifest) {
+  console.log(`  bun run upload ${path.join(outputDir, path.basename(entry.key))} ${entry.key}`);
+}
 console.log("\nRedeploy worker (only needed if you changed index.js or wrangler.toml):");
 console.log("  bun run deploy");
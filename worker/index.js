@@ -3,15 +3,18 @@
  *
  * Routes:
  *   GET /               -- health check
- *   GET /bundle         -- R2 primary, Tectonic fallback (2.8GB tar, Range requests)
- *   GET /index.gz       -- R2 primary, Tectonic fallback (1.2MB gzipped index)
+ *   GET /bundle         -- R2 primary, Tectonic fallback (2.8GB tar, Range requests
+ *                          served from edge-cached 1 MiB blocks)
+ *   GET /bundle/slices  -- several bundle ranges concatenated, edge-cached (?r=start:length,...)
+ *   GET /index.gz       -- R2 primary, Tectonic fallback (1.2MB gzipped index; 304 on If-None-Match)
  *   GET /formats/*      -- R2 only (23MB .fmt files)
  *   GET /collab/health  -- collab health check
+ *   GET /collab/chunks/* -- content-addressed blob chunks of collab rooms (R2, immutable)
  *   GET /collab/ws/*    -- WebSocket upgrade to Durable Object room
  *   OPTIONS *           -- CORS preflight
  */
 
-import { CollabRoom } from './collab_room.js';
+import { CollabRoom, CHUNK_PREFIX } from './collab_room.js';
 export { CollabRoom };
 
 // upstream Tectonic bundle (fallback origin)
@@ -23,6 +26,17 @@ const R2_BUNDLE_KEY = 'tlextras-2022.0r0.tar';
 const R2_INDEX_KEY = 'tlextras-2022.0r0.tar.index.gz';
 
 const FORMAT_PREFIX = '/formats/';
+const COLLAB_CHUNKS_PREFIX = '/collab/chunks/';
+const SLICES_PATH = '/bundle/slices';
+// a slices request is one cache object; keep it well under the edge cache limits
+const MAX_SLICES = 256;
+const MAX_SLICES_BYTES = 32 * 1024 * 1024;
+const SLICES_CACHE_VERSION = 'v1';
+// Range requests are served from aligned blocks of the bundle, each cached at
+// the edge as a plain 200 response (the Cache API rejects 206)
+const BLOCK_SIZE = 1024 * 1024;
+const MAX_BLOCKS_PER_RANGE = 8;
+const BLOCK_CACHE_VERSION = 'v1';
 const INDEX_CACHE_VERSION = 'v2';
 const BUNDLE_CACHE_CONTROL = 'public, max-age=31536000, immutable';
 const FORMAT_CACHE_CONTROL = 'public, max-age=31536000, immutable';
@@ -80,6 +94,7 @@ export default {
         status: 'ok',
         routes: {
           '/bundle': 'tar file (R2 primary, Tectonic fallback)',
+          '/bundle/slices': 'concatenated bundle ranges, edge-cached',
           '/index.gz': 'gzipped index (R2 primary, Tectonic fallback)',
           '/formats/*': 'precompiled format files from R2',
         },
@@ -102,7 +117,13 @@ export default {
       return response;
     }
 
+    if (path === SLICES_PATH) {
+      return handleSlicesRequest(request, env, url, ctx);
+    }
+
     if (path === '/bundle' || path === '/bundle/') {
+      const fromBlocks = await serveRangeFromBlocks(request, env, ctx);
+      if (fromBlocks) return fromBlocks;
       return serveR2OrFallback(request, env, R2_BUNDLE_KEY, TECTONIC_BUNDLE_URL, 'application/octet-stream', ctx);
     }
 
@@ -110,6 +131,10 @@ export default {
       return handleFormatRequest(request, env, path);
     }
 
+    if (path.startsWith(COLLAB_CHUNKS_PREFIX)) {
+      return handleChunkRequest(request, env, path.slice(COLLAB_CHUNKS_PREFIX.length));
+    }
+
     return new Response('Not found', {
       status: 404,
       headers: { 'Cache-Control': 'no-store', ...corsHeaders(request) },
@@ -125,6 +150,14 @@ async function getCachedIndex(request) {
     const cached = await cache.match(cacheKey);
     if (cached) {
       console.log('index cache hit');
+      // revalidation by a client that already holds this index
+      const etag = cached.headers.get('ETag');
+      if (etag && etagMatches(request.headers.get('If-None-Match'), etag)) {
+        return new Response(null, {
+          status: 304,
+          headers: { ETag: etag, 'Cache-Control': cached.headers.get('Cache-Control') ?? BUNDLE_CACHE_CONTROL, ...corsHeaders(request) },
+        });
+      }
       return withCors(cached, request);
     }
   } catch (err) {
@@ -143,6 +176,13 @@ async function cacheIndexResponse(request, response) {
   }
 }
 
+// weak comparison, as If-None-Match uses
+function etagMatches(header, etag) {
+  if (!header) return false;
+  const strip = tag => tag.trim().replace(/^W\//, '');
+  return header.split(',').some(tag => tag.trim() === '*' || strip(tag) === strip(etag));
+}
+
 function indexCacheKey(request) {
   const url = new URL(request.url);
   url.searchParams.set('__eztex_index_cache', INDEX_CACHE_VERSION);
@@ -194,6 +234,236 @@ function conditionalStatus(request) {
   return 304;
 }
 
+// -- bundle slices --
+// the files a seed batch needs, as one response: the ranges listed in
+// ?r=start:length,... concatenated in order. the list comes from the client's
+// merged seed plan, which is the same for everyone starting from the same
+// cache state, so the composed blob is cached at the edge under the bundle
+// object and the exact list.
+
+function parseSlices(param) {
+  if (!param) return null;
+  const slices = [];
+  let total = 0;
+  for (const part of param.split(',')) {
+    const match = part.match(/^(\d+):(\d+)$/);
+    if (!match) return null;
+    const offset = parseInt(match[1], 10);
+    const length = parseInt(match[2], 10);
+    if (length === 0) return null;
+    total += length;
+    slices.push({ offset, length });
+  }
+  if (slices.length === 0 || slices.length > MAX_SLICES || total > MAX_SLICES_BYTES) return null;
+  return { slices, total };
+}
+
+function slicesCacheKey(url) {
+  const key = new URL(url.toString());
+  key.search = '';
+  key.searchParams.set('bundle', R2_BUNDLE_KEY);
+  key.searchParams.set('r', url.searchParams.get('r'));
+  key.searchParams.set('__eztex_slices_cache', SLICES_CACHE_VERSION);
+  return new Request(key.toString(), { method: 'GET' });
+}
+
+// one range of the bundle: R2 first, the Tectonic bundle if R2 has no object
+async function fetchBundleBytes(env, offset, length) {
+  try {
+    const object = await env.LATEX_ASSETS.get(R2_BUNDLE_KEY, { range: { offset, length } });
+    if (object && object.body) return new Uint8Array(await object.arrayBuffer());
+  } catch (err) {
+    console.error(`R2 slice read failed at ${offset}+${length}:`, err);
+  }
+  const response = await fetch(TECTONIC_BUNDLE_URL, {
+    headers: { Range: `bytes=${offset}-${offset + length - 1}` },
+  });
+  if (response.status !== 206) throw new Error(`upstream status ${response.status}`);
+  return new Uint8Array(await response.arrayBuffer());
+}
+
+async function handleSlicesRequest(request, env, url, ctx) {
+  const parsed = parseSlices(url.searchParams.get('r'));
+  if (!parsed) {
+    return new Response('Bad slice list', {
+      status: 400,
+      headers: { 'Cache-Control': 'no-store', ...corsHeaders(request) },
+    });
+  }
+
+  const cacheKey = slicesCacheKey(url);
+  try {
+    const cached = await caches.default.match(cacheKey);
+    if (cached) return withCors(cached, request);
+  } catch (err) {
+    console.error('Cache match error:', err);
+  }
+
+  let body;
+  try {
+    const size = await getBundleSize(env);
+    const parts = await Promise.all(parsed.slices.map(s => size === null
+      ? fetchBundleBytes(env, s.offset, s.length)
+      : readBundleRange(request, env, ctx, s.offset, s.length, size)));
+    body = new Uint8Array(parsed.total);
+    let at = 0;
+    for (let i = 0; i < parts.length; i++) {
+      // a short read would shift every later file; fail the whole request
+      if (parts[i].byteLength !== parsed.slices[i].length) throw new Error('short slice');
+      body.set(parts[i], at);
+      at += parts[i].byteLength;
+    }
+  } catch (err) {
+    console.error('Slice compose failed:', err);
+    return new Response('Slice compose failed', {
+      status: 502,
+      headers: { 'Cache-Control': 'no-store', ...corsHeaders(request) },
+    });
+  }
+
+  const response = new Response(request.method === 'HEAD' ? null : body, {
+    status: 200,
+    headers: {
+      'Content-Type': 'application/octet-stream',
+      'Content-Length': String(parsed.total),
+      'Cache-Control': BUNDLE_CACHE_CONTROL,
+      ...corsHeaders(request),
+    },
+  });
+  if (request.method === 'GET') {
+    ctx.waitUntil(caches.default.put(cacheKey, response.clone()).catch(err => {
+      console.error('Cache put error:', err);
+    }));
+  }
+  return response;
+}
+
+// -- bundle blocks --
+// a Range request that needs a few blocks is answered by slicing cached
+// blocks; only blocks missing from this colo's cache go to R2. conditional,
+// HEAD and very large requests take the direct R2 path instead.
+
+// size and ETag of the bundle object, looked up once per isolate
+let bundleMeta = null;
+
+async function getBundleMeta(env) {
+  if (bundleMeta) return bundleMeta;
+  try {
+    const head = await env.LATEX_ASSETS.head(R2_BUNDLE_KEY);
+    if (head) bundleMeta = { size: head.size, etag: head.httpEtag };
+  } catch (err) {
+    console.error('R2 head failed for bundle:', err);
+  }
+  return bundleMeta;
+}
+
+async function getBundleSize(env) {
+  const meta = await getBundleMeta(env);
+  return meta ? meta.size : null;
+}
+
+// resolve a single bytes= range against the object size; null if unusable
+function resolveRange(rangeHeader, size) {
+  const match = rangeHeader.match(/^bytes=(\d*)-(\d*)$/);
+  if (!match || (match[1] === '' && match[2] === '')) return null;
+  let start;
+  let end;
+  if (match[1] === '') {
+    start = Math.max(0, size - parseInt(match[2], 10));
+    end = size - 1;
+  } else {
+    start = parseInt(match[1], 10);
+    end = match[2] === '' ? size - 1 : Math.min(parseInt(match[2], 10), size - 1);
+  }
+  if (start > end || start >= size) return null;
+  return { start, end };
+}
+
+function blockCacheKey(request, index) {
+  const url = new URL(request.url);
+  url.pathname = '/bundle/block';
+  url.search = '';
+  url.searchParams.set('bundle', R2_BUNDLE_KEY);
+  url.searchParams.set('block', String(index));
+  url.searchParams.set('__eztex_block_cache', BLOCK_CACHE_VERSION);
+  return new Request(url.toString(), { method: 'GET' });
+}
+
+async function readBlock(request, env, ctx, index, size) {
+  const key = blockCacheKey(request, index);
+  try {
+    const cached = await caches.default.match(key);
+    if (cached) return new Uint8Array(await cached.arrayBuffer());
+  } catch (err) {
+    console.error('Cache match error:', err);
+  }
+  const offset = index * BLOCK_SIZE;
+  const data = await fetchBundleBytes(env, offset, Math.min(BLOCK_SIZE, size - offset));
+  const response = new Response(data, {
+    headers: { 'Content-Type': 'application/octet-stream', 'Cache-Control': BUNDLE_CACHE_CONTROL },
+  });
+  ctx.waitUntil(caches.default.put(key, response).catch(err => {
+    console.error('Cache put error:', err);
+  }));
+  return data;
+}
+
+// bytes [offset, offset + length) of the bundle, assembled from blocks
+async function readBundleRange(request, env, ctx, offset, length, size) {
+  const first = Math.floor(offset / BLOCK_SIZE);
+  const last = Math.floor((offset + length - 1) / BLOCK_SIZE);
+  const indices = [];
+  for (let i = first; i <= last; i++) indices.push(i);
+  const blocks = await Promise.all(indices.map(i => readBlock(request, env, ctx, i, size)));
+  const out = new Uint8Array(length);
+  let at = 0;
+  for (let i = 0; i < blocks.length; i++) {
+    const blockStart = indices[i] * BLOCK_SIZE;
+    const from = Math.max(offset, blockStart) - blockStart;
+    const to = Math.min(offset + length, blockStart + blocks[i].byteLength) - blockStart;
+    out.set(blocks[i].subarray(from, to), at);
+    at += to - from;
+  }
+  if (at !== length) throw new Error(`short block read (${at}/${length})`);
+  return out;
+}
+
+async function serveRangeFromBlocks(request, env, ctx) {
+  const rangeHeader = request.headers.get('Range');
+  if (request.method !== 'GET' || !rangeHeader) return null;
+  const hasConditionals = ['If-None-Match', 'If-Modified-Since', 'If-Match', 'If-Unmodified-Since', 'If-Range'].some(
+    h => request.headers.has(h)
+  );
+  if (hasConditionals) return null;
+
+  const meta = await getBundleMeta(env);
+  if (!meta) return null;
+  const range = resolveRange(rangeHeader, meta.size);
+  if (!range) return null;
+  const length = range.end - range.start + 1;
+  const blocks = Math.floor(range.end / BLOCK_SIZE) - Math.floor(range.start / BLOCK_SIZE) + 1;
+  if (blocks > MAX_BLOCKS_PER_RANGE) return null;
+
+  let body;
+  try {
+    body = await readBundleRange(request, env, ctx, range.start, length, meta.size);
+  } catch (err) {
+    console.error('Block read failed:', err);
+    return null;
+  }
+
+  const headers = {
+    'Content-Type': 'application/octet-stream',
+    'Content-Length': String(length),
+    'Content-Range': `bytes ${range.start}-${range.end}/${meta.size}`,
+    'Cache-Control': BUNDLE_CACHE_CONTROL,
+    'Accept-Ranges': 'bytes',
+    ...corsHeaders(request),
+  };
+  if (meta.etag) headers.ETag = meta.etag;
+  return new Response(body, { status: 206, headers });
+}
+
 // serve from R2, fallback to Tectonic proxy on failure
 async function serveR2OrFallback(request, env, r2Key, fallbackUrl, contentType, ctx) {
   // validate Range header before hitting R2
@@ -362,6 +632,32 @@ async function handleFormatRequest(request, env, path) {
   }
 }
 
+// a chunk is named by the SHA-256 of its bytes, so it never changes and every
+// room and browser can cache it for good
+async function handleChunkRequest(request, env, hash) {
+  if (!/^[0-9a-f]{64}$/.test(hash)) {
+    return new Response('Invalid chunk', {
+      status: 400,
+      headers: { 'Cache-Control': 'no-store', ...corsHeaders(request) },
+    });
+  }
+  const object = await env.LATEX_ASSETS.get(CHUNK_PREFIX + hash);
+  if (object === null) {
+    return new Response('Chunk not found', {
+      status: 404,
+      headers: { 'Cache-Control': 'no-store', ...corsHeaders(request) },
+    });
+  }
+  const headers = new Headers({
+    'Content-Type': 'application/octet-stream',
+    'Content-Length': String(object.size),
+    'Cache-Control': BUNDLE_CACHE_CONTROL,
+    ETag: `"${hash}"`,
+    ...corsHeaders(request),
+  });
+  return new Response(request.method === 'HEAD' ? null : object.body, { status: 200, headers });
+}
+
 function buildFormatHeaders(object, request) {
   const headers = new Headers();
   if (object.writeHttpMetadata) {
@@ -410,6 +706,8 @@ function corsHeaders(request) {
     'Access-Control-Allow-Methods': 'GET, HEAD, OPTIONS',
     'Access-Control-Allow-Headers': 'Range, If-Range, Content-Type, If-Modified-Since, If-None-Match, If-Match, If-Unmodified-Since',
     'Access-Control-Expose-Headers': 'Content-Length, Content-Range, Accept-Ranges, ETag, Last-Modified',
+    // loadable from the cross-origin isolated app
+    'Cross-Origin-Resource-Policy': 'cross-origin',
     'Vary': 'Origin',
   };
 }
@@ -2,9 +2,11 @@
 //
 // usage:
 //   bun run upload-r2.ts <local-file> <object-key>
+//   bun run upload-r2.ts --dir <local-dir> <key-prefix>
 //
 // examples:
-//   bun run upload-r2.ts assets/xelatex_v33_wasm32-wasi_c1607948053fc5d4.fmt formats/xelatex_v33_wasm32-wasi_c1607948053fc5d4.fmt
+//   bun run upload-r2.ts assets/bundle.tar bundle.tar
+//   bun run upload-r2.ts --dir assets/formats formats   (every *.fmt, as formats/<name>)
 //
 // required env vars:
 //   R2_ACCOUNT_ID      -- Cloudflare account ID (32-char hex)
@@ -15,14 +17,17 @@ const BUCKET = "eztex-assets";
 
 if (Bun.argv.includes("--help") || Bun.argv.includes("-h")) {
   console.log("usage: bun run upload-r2.ts <local-file> <object-key>");
+  console.log("       bun run upload-r2.ts --dir <local-dir> <key-prefix>");
   console.log();
-  console.log("example:");
-  console.log("  bun run upload-r2.ts assets/xelatex_v33_wasm32-wasi_c1607948053fc5d4.fmt formats/xelatex_v33_wasm32-wasi_c1607948053fc5d4.fmt");
+  console.log("examples:");
+  console.log("  bun run upload-r2.ts assets/bundle.tar bundle.tar");
+  console.log("  bun run upload-r2.ts --dir assets/formats formats");
   process.exit(0);
 }
 
-const filePath = Bun.argv[2];
-const objectKey = Bun.argv[3];
+const dirMode = Bun.argv[2] === "--dir";
+const filePath = Bun.argv[dirMode ? 3 : 2];
+const objectKey = Bun.argv[dirMode ? 4 : 3];
 
 if (!filePath || !objectKey) {
   console.error("error: both <local-file> and <object-key> are required");
@@ -61,6 +66,22 @@ const client = new Bun.S3Client({
   bucket: BUCKET,
 });
 
+// generated formats: every *.fmt in the directory under <key-prefix>/. the
+// keys are content-addressed, so objects already in R2 are left alone.
+if (dirMode) {
+  const glob = new Bun.Glob("*.fmt");
+  for await (const name of glob.scan(filePath)) {
+    const key = `${objectKey.replace(/\/$/, "")}/${name}`;
+    if (await client.exists(key)) {
+      console.log(`exists: r2://${BUCKET}/${key}`);
+      continue;
+    }
+    await client.write(key, Bun.file(`${filePath}/${name}`));
+    console.log(`uploaded: r2://${BUCKET}/${key}`);
+  }
+  process.exit(0);
+}
+
 const localFile = Bun.file(filePath);
 
 if (!(await localFile.exists())) {
@@ -74,9 +74,14 @@ const keys = [
   "bundles/default_bundle_v33.tar",
   "tlextras-2022.0r0.tar.index.gz",
   "bundles/default_bundle_v33.tar.index.gz",
-  "formats/xelatex_v33_wasm32-wasi_c1607948053fc5d4.fmt",
 ];
 
+// formats from the last generate-format run, if any
+const manifest = Bun.file("assets/formats/manifest.json");
+if (await manifest.exists()) {
+  for (const entry of (await manifest.json()) as { key: string }[]) keys.push(entry.key);
+}
+
 for (const key of keys) {
   await checkObject(key);
 }